@@ -15,9 +15,12 @@
 #define DEVICE_BALLOON      1
 #define DEVICE_BASE_STATION 2
 
-// Uncomment the device type you're building:
+// Uncomment the device type you're building (the base station environment
+// sets it with -DDEVICE_TYPE, so the shared modules build as its side):
+#ifndef DEVICE_TYPE
 #define DEVICE_TYPE DEVICE_BALLOON
 // #define DEVICE_TYPE DEVICE_BASE_STATION
+#endif
 
 // ===========================
 // Balloon Operation Modes
@@ -29,18 +32,60 @@
 #define MAX_AWAKE_TIME_MS          5000  // Maximum awake time per cycle
 #define BATTERY_LOW_THRESHOLD      3.3   // Volts - below this, enable power saving
 #define BATTERY_CRITICAL_THRESHOLD 3.0   // Volts - below this, emergency mode
+#define PM_DFS_ENABLED             true  // esp_pm frequency scaling; subsystems hold locks while active
+#define PM_MAX_FREQ_MHZ            240   // With a CPU lock held
+#define PM_MIN_FREQ_MHZ            40    // With none - the crystal, PLL off
+#define PM_LIGHT_SLEEP             true  // Automatic light sleep with no lock held, if the IDF build has tickless idle
+#define BATTERY_CAPACITY_MAH       2000.0f  // Full charge
+#define POWER_PLAN_ENABLED         true  // Capture, telemetry and GPS rates from the energy budget
+#define POWER_RECOVERY_RESERVE_MAH 400.0f  // Left at landing for the recovery beacon
+#define ULP_MONITOR_ENABLED        true  // The ULP samples battery and pressure in deep sleep, waking on a crossing
+#define ULP_MONITOR_PERIOD_MS      2000  // Between ULP samples
+#define ULP_BATTERY_WAKE_VOLTAGE   3.1f  // One wake when the battery falls below this
+#define ULP_DESCENT_WAKE_MPS       15.0f // Pressure changing at this vertical speed wakes - a burst, not the ascent
+#define POWER_ARBITER_ENABLED      true  // LoRa TX and camera captures take turns when the battery can't carry both (power_arbiter.h)
+#define POWER_ARBITER_BROWNOUT_V   3.05f // Battery volts where the LDO drops the 3.3 V rail into the brownout detector
+#define POWER_ARBITER_OVERLAP_MARGIN_V 0.15f  // Predicted sag must clear the brownout by this for loads to overlap
+#define POWER_ARBITER_TX_CAP_MARGIN_V  0.05f  // TX alone gets its power lowered to keep this much
+#define POWER_ARBITER_TX_FLOOR_DBM 10    // Capping stops here, as LoRaManager::enterLowPowerMode()
+#define POWER_ARBITER_DEFAULT_OHM  0.3f  // Battery and wiring resistance until TX bursts measure it
+#define POWER_ARBITER_CAMERA_WAIT_MS 2500  // A capture waits this long for TX to finish, then goes anyway
 
 // Sensor Reading Intervals
-#define BMP280_READ_INTERVAL_MS    1000  // Read pressure/temp every 1 second
-#define GPS_READ_INTERVAL_MS       2000  // Read GPS every 2 seconds
+#define BMP280_READ_INTERVAL_MS    50    // Pressure/temp at 20 Hz, for the ascent rate
+#define SENSOR_PPS_ALIGNED         true  // Sensor samples land on GPS epochs, offset from the PPS edge; needs GPS_PPS_PIN
 #define CAMERA_CAPTURE_INTERVAL_MS 30000 // Capture image every 30 seconds
 #define LORA_TRANSMIT_INTERVAL_MS  10000 // Transmit data every 10 seconds
+#define GPS_REPORT_INTERVAL_MS     10000 // Position packet at most this often
+#define CADENCE_PROFILES_ENABLED   true  // Scale the intervals above per flight phase and power state (cadence_profile.cpp)
 
 // Camera Settings for Balloon
 #define BALLOON_CAMERA_FRAMESIZE   FRAMESIZE_QVGA  // 320x240 for low bandwidth
 #define BALLOON_CAMERA_QUALITY     10             // JPEG quality (0-63, lower=better)
 #define BALLOON_CAMERA_BRIGHTNESS  0              // -2 to 2
 #define BALLOON_CAMERA_CONTRAST    0              // -2 to 2
+#define CAMERA_STANDBY_BETWEEN_SHOTS true         // Sensor in standby between captures; a capture wakes it
+#define CAMERA_RAIL_MIN_OFF_MS     5000           // With a camera load switch, gaps of this beyond its settle lead power it off
+#define CAMERA_HOLD_FRAME_BUFFER   true           // Hand out the driver's PSRAM frame buffer instead of a copy (needs 2+ buffers)
+#define CAMERA_FB_COUNT            2              // Driver frame buffers in PSRAM (one in DRAM without it)
+#define CAMERA_FB_MAX_FRAMESIZE    FRAMESIZE_VGA  // Driver and frame pool buffers are sized for this; no resolution goes past it
+#define CAMERA_FB_MAX_WIDTH        640            // CAMERA_FB_MAX_FRAMESIZE's, for the frame pool's size classes (frame_pool.h)
+#define CAMERA_FB_MAX_HEIGHT       480
+#define CAMERA_HISTOGRAM_AE        true           // Exposure, gain and brightness set from each capture's luma histogram
+#define CAMERA_BURST_FRAMES        3              // Frames per capture; the sharpest is kept (1 = no burst)
+#define CAMERA_SCENE_DETECTION     true           // Skip downlinking frames that look like the last one sent
+#define CAMERA_NOVELTY_THRESHOLD   8              // Novelty (0-64, hash bits or histogram shift) a frame needs to be sent
+#define CAMERA_NOVELTY_MAX_SKIP_MS 300000         // Send a frame anyway after this long without one
+#define CAMERA_CLASSIFIER          true           // Label frames black/sky/cloud/earth/horizon; black ones aren't sent
+#define CAMERA_CLASSIFIER_MIN_CONFIDENCE 30       // Confidence (0-100) a label needs to change what is sent
+#define CAMERA_BUDGET_CONTROL      true           // Pick frame size and quality so each JPEG fits the airtime left per capture
+#define CAMERA_CAPTURE_PIPELINE    true           // Capture hand-off as a pipeline.h coroutine, where the toolchain has them
+#define CAMERA_BUDGET_TARGET_PERCENT 50           // Share of that byte budget an image aims for
+#define CAMERA_BUDGET_BEST_QUALITY 8              // Sensor quality range the controller stays in (lower = better)
+#define CAMERA_BUDGET_WORST_QUALITY 40
+#define CAMERA_BUDGET_MAX_FRAMESIZE BALLOON_CAMERA_FRAMESIZE  // At most CAMERA_FB_MAX_FRAMESIZE
+#define CAMERA_REGISTER_PROFILES   true           // Day/night/bandwidth/quality as register snapshots, switched in one SCCB batch (camera_profile.h)
+#define CAMERA_DC_DECODE           true           // 1/8-scale decodes from the DC terms alone, RGB565 and luma in one pass (jpeg_dc.h)
 
 // ===========================
 // Data Packet Configuration
@@ -67,6 +112,59 @@
 #define MAX_GPS_SIZE              60    // GPS packet size
 #define MAX_THUMBNAIL_SIZE        200   // Camera thumbnail chunk size
 #define MAX_STATUS_SIZE           30    // Status packet size
+#define MAX_CAMERA_INFO_SIZE      30    // Camera capture metadata packet size
+#define MAX_ALERT_SIZE            80    // Alert packet size
+#define MAX_DIGEST_SIZE           64    // Digest packet size - one frame at the rendezvous rate
+
+// Packet Handler Queue
+#define PACKET_QUEUE_DEPTH        32    // Packets buffered across all priorities (power of two) - rides out LoS dropouts
+#define PACKET_RADIO_SLOTS        16    // Slab slots lent to LoRaManager at once (payloads are sent in place)
+#define PACKET_DRAIN_BUDGET       4     // Handoffs to LoRaManager per loop iteration
+#define PACKET_BACKPRESSURE_LEVEL 24    // Queue depth at which normal/low priority creates are refused
+
+// Fragment Transfer (payloads larger than one packet)
+#define FRAGMENT_PUMP_BUDGET      4     // Fragments queued per loop iteration
+#define FRAGMENT_QUEUE_SHARE      (PACKET_BACKPRESSURE_LEVEL / 2)  // Queue depth fragments stop at, leaving room for telemetry
+#define FRAGMENT_ACK_TIMEOUT_MS   10000 // Re-poll if the bitmap ACK hasn't arrived (covers queueing and duty cycle)
+#define FRAGMENT_MAX_POLLS        6     // Unanswered polls before a transfer is abandoned
+#define FRAGMENT_REASSEMBLY_SLOTS 2     // Transfers reassembled at once
+#define FRAGMENT_REASSEMBLY_MAX_BYTES 98816  // Reassembly memory cap (two full-size transfers)
+#define FRAGMENT_REASSEMBLY_TIMEOUT_MS 60000 // Drop a reassembly after this much silence
+#define CAMERA_SEND_IMAGES        true  // Stream each captured JPEG as a fragment transfer
+#define CAMERA_TILE_MODE          true  // Keep the last image so the ground can ask for tiles of it
+#define CAMERA_PROGRESSIVE_MODE   true  // Send images as preview, thumbnail and refinement layers
+#define CAMERA_STORE_IMAGES       true  // Append every capture to the "images" flash partition
+#define CAMERA_STORE_DOWNLINK     true  // Send stored frames in the airtime live images leave, best value per byte first (image_downlink.h)
+#define SD_RECORDER_ENABLED       true  // Time-lapse of every frame as AVI on an SD card, where one is fitted (sd_recorder.h)
+#define CAMERA_EMBED_METADATA     true  // Position, altitude and exposure in the JPEG sent, no CAMERA_DATA packet for it
+
+// Telemetry Encoding
+#define TELEMETRY_KEYFRAME_INTERVAL 16  // Samples per keyframe; the rest are deltas against it
+
+// Text Compression
+#define PACKET_COMPRESS_TEXT      true  // Send STATUS/DEBUG text through the shared-dictionary codec
+
+// Send Rate Limits (token bucket per packet type; PacketMgr().setRateLimit() changes them at runtime)
+#define PACKET_RATE_ALERT         1.0f  // Alerts per second once the burst is spent
+#define PACKET_BURST_ALERT        4
+#define PACKET_RATE_STATUS        0.2f
+#define PACKET_BURST_STATUS       2
+#define PACKET_RATE_DEBUG         0.5f
+#define PACKET_BURST_DEBUG        4
+
+// Latest-value Packets (a newer GPS fix or telemetry sample replaces an older
+// one still queued or waiting for its ACK, and retries stop once it is stale)
+#define PACKET_LATEST_VALUE       true
+#define PACKET_FRESH_GPS_MS       (2 * GPS_REPORT_INTERVAL_MS)     // Retried only while the fix is younger
+#define PACKET_FRESH_TELEMETRY_MS (2 * LORA_TRANSMIT_INTERVAL_MS)  // Likewise a telemetry delta
+
+// Latency Histograms (create/queue/ACK per packet type, see PacketHandler::printStatistics())
+#define PACKET_LATENCY_REPORT     true  // Follow each status report with a "Lat" STATUS packet
+#define SCHEDULER_JITTER_REPORT   true  // And a "Sch" one: each job's start lateness p50/p99 and missed deadlines
+#define SENSOR_SUMMARY_REPORT     true  // And a "Sum" one: sensor range, mean and deviation over the window below
+#define SENSOR_SUMMARY_WINDOW_MS  60000
+#define SENSOR_PRESSURE_PROFILE   true  // PROFILE_LEVEL packets: per pressure level, mean and lag corrected temperature (pressure_profile.h)
+#define SYSTEM_STATS_REPORT       true  // And a "Stat" one: the whole flight's altitude, climb and temperature distribution
 
 // ===========================
 // Balloon-Specific Features
@@ -85,6 +183,24 @@
 // GPS Features
 #define GPS_SMART_SAVE              true   // Only transmit when position changes
 #define GPS_MIN_MOVEMENT_DISTANCE   10     // Minimum movement in meters
+#define GPS_MIN_ALTITUDE_CHANGE     10     // Or climb/sink in meters
+#define GPS_MAX_SILENCE_MS          60000  // Sent anyway after this long without one
+#define GPS_HOT_START               true   // UBX receiver in backup through deep sleep, aided with the last fix and time on waking
+#define GPS_POWER_POLICY            true   // Receiver power-save by flight phase and the altitude filter's certainty (cadence_profile.h)
+#define TRACK_HISTORY_ENABLED       true   // TRACK_SEGMENT packets: the simplified path from every fix (track_history.h)
+#define TRACK_SEGMENT_INTERVAL_MS   60000  // One segment of pending vertices this often
+
+// Digest (one DIGEST frame with every subsystem's key values)
+#define DIGEST_ENABLED              true
+#define DIGEST_INTERVAL_MS          60000  // Stretched by the duty cycle like the other reports
+#define DIGEST_LOW_RATE_AIRTIME_MS  400    // A digest frame this long on air: the heartbeat and status reports stop and the digest stands in
+
+// Telemetry Send-on-change (dead-band against the last one sent)
+#define TELEMETRY_SMART_SAVE        true   // Only transmit when a reading changes
+#define TELEMETRY_DEADBAND_PRESSURE 0.001f // Relative - about 8 m of height at any altitude
+#define TELEMETRY_DEADBAND_TEMPERATURE 0.5f  // °C
+#define TELEMETRY_DEADBAND_BATTERY  0.05f  // V
+#define TELEMETRY_MAX_SILENCE_MS    60000  // Sent anyway after this long without one
 #define GPS_MAX_AGE_MS              30000  // Maximum GPS data age in ms
 
 // Camera Features
@@ -92,6 +208,14 @@
 #define CAMERA_NIGHT_MODE_THRESHOLD 500    // Below this lux, use night settings
 #define CAMERA_MOTION_DETECTION     false  // Disable for power saving
 
+// Ground Access Point (camera web UI and stream, up on the ground and after
+// landing or for an uplinked WIFI_AP, torn down otherwise - balloon_ap.h)
+#define BALLOON_AP_ENABLED          true
+#define BALLOON_AP_SSID             "BalloonCam"
+#define BALLOON_AP_PASSWORD         "balloon123"
+#define BALLOON_AP_CHANNEL          1      // Away from the base station's WIFI_AP_CHANNEL
+#define BALLOON_AP_RETRY_MS         30000  // After a start that failed
+
 // ===========================
 // Communication Settings
 // ===========================
@@ -100,11 +224,177 @@
 #define MAX_RETRANSMIT_ATTEMPTS     3      // Max retransmission attempts
 #define ACK_TIMEOUT_MS_VAL          2000   // Wait for ACK this long
 #define PACKET_SEQUENCE_TIMEOUT    60000  // Reset sequence after this time
+#define LORA_ARQ_WINDOW_SIZE        4      // Frames awaiting ACK at once (1 = stop-and-wait, max 32)
 
-// Adaptive Transmission
-#define ENABLE_ADAPTIVE_SF         true   // Adjust spreading factor based on signal
-#define ADAPTIVE_SF_HIGH_THRESHOLD  -80   // Above this RSSI, use SF7
-#define ADAPTIVE_SF_LOW_THRESHOLD  -110  // Below this RSSI, use SF12
+// Delayed ACKs (a sender flags a frame with more right behind it; the
+// receiver answers the whole run with one selective ACK, on a frame of its
+// own when it has one queued)
+#define LORA_ACK_DELAY_ENABLED      true
+#define LORA_ACK_HOLD_MS            400    // Receiver: longest wait for the next frame of a run before ACKing what came
+#define LORA_ACK_RUN_MS             1000   // Sender: a run ends before its oldest frame is this old - well inside ACK_TIMEOUT_MS_VAL
+#define LORA_ACK_PIGGYBACK          true   // A due ACK rides in front of our next frame as an aggregate record
+
+// Emergency Beacon (sent by the radio task ahead of the lanes and the ARQ window)
+#define LORA_EMERGENCY_BEACON_INTERVAL_MS 30000  // Repeat period once armed
+#define LORA_EMERGENCY_BEACON_REPEATS     0      // Repeats after the first (0 = until stopped)
+
+// On-air Header Format
+#define LORA_COMPACT_HEADER         true   // Offer the compact v2 header, used once the peer offers it too
+#define LORA_LATENCY_STAMPS         true   // ACKed v2 frames carry their sample/queue/retry times (up to 10 bytes)
+
+// Link Authentication (every frame sealed with a truncated AES-CMAC tag in
+// place of its CRC, payloads AES-CTR encrypted; link_auth.h) - must match on both ends
+#define LINK_AUTH_ENABLED           false
+#define LINK_AUTH_ENCRYPT           true   // Encrypt payloads as well as tagging frames
+#define LINK_AUTH_KEY               { 0x6b, 0x1f, 0xd2, 0x40, 0x93, 0x5e, 0xa7, 0x0c, \
+                                      0x38, 0xe4, 0x71, 0xbd, 0x26, 0x8a, 0xcf, 0x55 }  // Pre-shared AES-128 key
+
+// Store-and-forward Backlog (ARQ packets the link dropped, spilled to the
+// flight recorder and backfilled once ACKs come back)
+#define LINK_BACKLOG_ENABLED        true
+#define LINK_BACKLOG_INDEX_SIZE     128    // Spilled packets remembered, newest kept (power of two)
+#define LINK_BACKLOG_INFLIGHT       2      // Backfilled packets queued at once
+#define LINK_BACKLOG_WINDOW_MS      10000  // Backfill byte budget is renewed this often
+#define LINK_BACKLOG_BUDGET_SHARE   50     // % of the spare airtime backfill may take
+#define LINK_BACKLOG_LINK_FRESH_MS  30000  // Link counts as up this long after the last frame heard
+#define LINK_BACKLOG_DECIMATION     4      // First pass sends every 4th packet, newest first (1 = newest first)
+
+// Frame Aggregation
+#define LORA_ENABLE_AGGREGATION     true   // Pack small queued packets into one LoRa frame
+#define LORA_MAX_AGGREGATE_RECORDS  8      // Sub-frames per aggregate frame
+
+// Camera Forward Error Correction (erasure coded chunks, no NACKs)
+#define LORA_ENABLE_CAMERA_FEC      true   // Send camera images as FEC chunk groups
+#define LORA_FEC_DATA_CHUNKS        8      // K data chunks per group
+#define LORA_FEC_PARITY_CHUNKS      4      // M parity chunks per group (any K of K+M rebuild it)
+#define LORA_FEC_CHUNK_SIZE         200    // Image bytes per chunk (plus 11 byte FEC header)
+#define LORA_FEC_PARITY_MIN         1      // Parity range once the link quality estimate sizes it
+#define LORA_FEC_PARITY_MAX         16
+
+// LoRa Radio Engine (DIO0 interrupt driven task)
+// Radio task core, priority and stack are in task_placement.cpp
+#define LORA_RADIO_TX_QUEUE_LEN     4      // Frames waiting for the radio
+#define LORA_RADIO_EVENT_QUEUE_LEN  8      // TX/RX events waiting for processQueue()
+#define LORA_QUEUE_DEPTH            32     // Packets per priority lane (power of two)
+#define LORA_RADIO_POLL_MS          50     // Task wakeup when no interrupt arrives
+#define LORA_TX_DONE_TIMEOUT_MS     1000   // Margin past the computed time on air before giving up on TX_DONE
+
+// Listen Before Talk (Channel Activity Detection before each frame)
+#define LORA_ENABLE_LBT             false  // Scan the channel before transmitting, back off when busy
+#define LORA_LBT_MAX_ATTEMPTS       5      // Busy scans before transmitting anyway
+#define LORA_LBT_BACKOFF_MIN_MS     50     // First backoff window, doubles after every busy scan
+#define LORA_LBT_BACKOFF_MAX_MS     2000   // Backoff window cap
+#define LORA_LBT_CAD_TIMEOUT_MS     100    // Treat the channel as busy if CAD_DONE never fires
+
+// Frequency Hopping (sequence keyed, both ends derive the same channel)
+#define LORA_ENABLE_HOPPING         false  // Hop across the channel plan instead of one fixed carrier
+#define LORA_HOP_CHANNEL_COUNT      8      // Entries in LORA_HOP_CHANNEL_PLAN (entry 0 is the home channel)
+#define LORA_HOP_CHANNEL_PLAN       { 903900000, 904100000, 904300000, 904500000, \
+                                      904700000, 904900000, 905100000, 905300000 }  // Hz, US915 sub-band 2
+#define LORA_HOP_SEED               0x5A17 // Hop sequence key - must match on both ends
+#define LORA_HOP_DWELL_MS           5000   // Base station: silence before trying the next candidate channel
+#define LORA_HOP_RESYNC_TIMEOUTS    3      // Balloon: consecutive ACK rounds timed out before returning home
+
+// Time-Slotted Transmission (TDMA for balloon fleets, GPS time aligned)
+#ifndef LORA_DEVICE_ID
+#define LORA_DEVICE_ID              DEVICE_TYPE  // Unique per balloon in a fleet (-DLORA_DEVICE_ID=n), picks its slot
+#endif
+#define LORA_ENABLE_TDMA            false  // Balloon transmits only in its own slot once GPS or link time is known
+#define LORA_TDMA_SLOT_COUNT        4      // Slots per TDMA frame - fleet size (max 32)
+#define LORA_TDMA_GUARD_MS          50     // Clock error allowance at each slot edge
+#define LORA_TDMA_WAKEUP_MS         20     // Base station receiver wakes this early for a slot
+#define LORA_TDMA_SYNC_MAX_AGE_MS   600000 // Slots keep to Clock() this long after the last GPS time, then to the link clock
+#define LORA_TDMA_SLOT_EXPIRY_MS    120000 // Base station stops waking for a slot silent this long
+
+// Link Clock Sync (NTP-style offset to the peer from ACK timestamps, for TDMA without GPS)
+#define LORA_ENABLE_CLOCK_SYNC      true   // ACKs carry radio TX/RX-done times every LORA_SYNC_INTERVAL_MS
+#define LORA_SYNC_INTERVAL_MS       15000  // Between timestamped ACKs, after the first two
+#define LORA_SYNC_HOLDOVER_MS       600000 // Offset used this long after the last good exchange
+#define LORA_SYNC_MAX_DELAY_US      20000  // One-way delay above this is a mismatched exchange
+#define LORA_SYNC_STEP_US           5000   // Residual that steps the offset instead of slewing it
+#define LORA_SYNC_GAIN              0.25f  // Weight of each exchange in the offset
+#define LORA_SYNC_DRIFT_SPAN_MS     60000  // Shortest span between exchanges used to measure drift
+
+// Scheduled RX Windows (balloon receiver sleeps between transmit windows)
+#define LORA_ENABLE_RX_WINDOWS      false  // Listen only after our own frames instead of continuously
+#define LORA_RX_WINDOW_MS           1500   // Listen this long after the last TX/RX for ACKs and commands
+#define LORA_RX_WAKEUP_MS           5      // Sleep -> standby oscillator start-up before the FIFO is usable
+
+// Airtime Budget (time-on-air scheduler)
+#define LORA_DUTY_CYCLE_PERMILLE    100    // Allowed airtime per window (100 = 10%, EU868 = 10)
+#define LORA_DUTY_CYCLE_WINDOW_MS   60000  // Budget window / token bucket depth
+
+// Lane Scheduling (EMERGENCY always first, then priority order - except a
+// lane that has fallen behind its share of the airtime goes first)
+#define LORA_LANE_SHARE_PERCENT     { 0, 30, 30, 20, 10 }  // Min airtime per lane while it has traffic, EMERGENCY..STATUS
+
+// Adaptive Transmission (ADR - link margin controller, balloon leads)
+#define ENABLE_ADAPTIVE_SF         true   // Adjust SF/BW/CR/power based on link margin
+#define LORA_ADR_MARGIN_DB          6.0   // Required margin above the demodulator floor
+#define LORA_ADR_HYSTERESIS_DB      3.0   // Extra margin before going faster or lowering power
+#define LORA_ADR_MIN_SAMPLES        5     // Fresh RSSI/SNR samples before a decision
+#define LORA_ADR_STABLE_FASTER      4     // Agreeing evaluations before speeding up
+#define LORA_ADR_STABLE_SLOWER      2     // Agreeing evaluations before slowing down
+#define LORA_ADR_MAX_BANDWIDTH      500000 // Widest bandwidth the controller may pick (Hz)
+#define LORA_ADR_NOISE_FIGURE_DB    6.0   // Receiver noise figure for RSSI based margin
+#define LORA_ADR_SNR_SATURATION_DB  8.0   // SNR reports flatten out above this - trust RSSI
+#define LORA_ADR_CR_GAIN_DB         0.33  // Approximate gain per coding rate step
+#define LORA_ADR_FALLBACK_TIMEOUTS  3     // Consecutive ACK rounds timed out, on top of the silence (balloon)
+#define LORA_ADR_FALLBACK_MS        60000 // Silence before rendezvous (both ends)
+#define LORA_ADR_RENDEZVOUS_SF      12    // Settings both ends fall back to when the link is lost
+#define LORA_ADR_RENDEZVOUS_BW      125000
+#define LORA_ADR_RENDEZVOUS_CR      8
+
+// Link Quality (delivery ratio / ETX per data rate from ACK outcomes)
+#define LINK_QUALITY_ALPHA_SHIFT    3      // EWMA weight 1/8 per outcome
+#define LINK_QUALITY_MIN_SAMPLES    4      // Fresh outcomes before a rate's estimate is used
+#define LINK_QUALITY_STALE_MS       120000 // A rate silent this long starts over
+#define LINK_QUALITY_PENALTY_DB     3.0    // ADR margin taken per expected retransmission
+#define LINK_QUALITY_AVOID_RATIO    0.8    // ADR won't go back to a faster rate delivering less than this
+
+// FSK Burst (queued camera fragments over (G)FSK while the link margin is huge,
+// balloon leads; needs a radio with FSK on both ends - SX126x)
+#define LORA_FSK_BURST_ENABLED      true
+#define LORA_FSK_BITRATE            100000 // bps
+#define LORA_FSK_REQUIRED_SNR_DB    10.0   // In the receiver bandwidth (twice the bit rate) for ~1e-3 BER
+#define LORA_FSK_BURST_MARGIN_DB    10.0   // FSK margin before a burst starts
+#define LORA_FSK_BURST_MAX_ETX      1.2    // Current LoRa rate must deliver at least this well
+#define LORA_FSK_BURST_MIN_FRAMES   4      // Camera frames queued or still to feed before it's worth switching
+#define LORA_FSK_BURST_MAX_MS       20000  // Longest burst before going back to LoRa
+#define LORA_FSK_FALLBACK_TIMEOUTS  2      // Consecutive ACK rounds timed out in FSK, on top of the silence (balloon)
+#define LORA_FSK_IDLE_MS            5000   // Silence in FSK before LoRa alone (both ends)
+#define LORA_FSK_BACKOFF_MS         60000  // No new burst this long after one failed
+
+// Fixed-Frame Profile (implicit header LoRa while only telemetry-sized frames
+// are queued, balloon leads; each frame carries a length byte in place of the
+// PHY header and CRC, its own CRC-16 does the checking)
+#define LORA_FIXED_FRAMES_ENABLED   true
+#define LORA_FIXED_FRAME_BYTES      48     // Receiver's frame length - a timing stamped GPS report and the length byte
+#define LORA_FIXED_PREAMBLE_LEN     6      // Symbols; both receivers are up ahead of the frame, so the chip minimum
+#define LORA_FIXED_MAX_ETX          1.5    // Current rate must deliver at least this well
+#define LORA_FIXED_MAX_MS           300000 // Back to the explicit header this often, for the base station's longer frames
+#define LORA_FIXED_HOLD_MS          30000  // Explicit header at least this long after any rate change
+#define LORA_FIXED_FALLBACK_TIMEOUTS 2     // Consecutive ACK rounds timed out, on top of the silence (balloon)
+#define LORA_FIXED_IDLE_MS          30000  // Silence before the explicit header alone (both ends)
+#define LORA_FIXED_BACKOFF_MS       120000 // No new profile this long after one failed
+
+// Bulk Link (second radio on the LORA_BULK_* pins, sensor_pins.h - images and
+// the backlog; telemetry and emergency stay on the primary link)
+#define LORA_BULK_FALLBACK_TIMEOUTS 3      // Consecutive bulk ACK rounds timed out before its traffic goes back to the primary
+#define LORA_BULK_PROBE_MS          30000  // After falling back, one payload on the bulk link this often to see if it's back
+
+// Delta Firmware Updates (patches against the running app, sent up as
+// FIRMWARE_DELTA fragment transfers and written into the other OTA slot)
+#define FIRMWARE_DELTA_ENABLED      true   // Apply patches; switching to the result waits for FIRMWARE_ACTIVATE
+#define FIRMWARE_DELTA_MAX_CHUNKS   8      // Transfers in one patch (~386 KB), held in PSRAM until applied
+#define FIRMWARE_APPLY_STEP_BYTES   4096   // Old image hashed or new image written per uplink iteration
+#define FIRMWARE_RECEIVE_TIMEOUT_MS 1800000 // A patch whose chunks stop coming this long is dropped
+#define FIRMWARE_RESTART_DELAY_MS   3000   // From FIRMWARE_ACTIVATE to the restart, so its ACK gets out
+
+// Geofence (no-fly and restricted zones in the "geofence" partition,
+// checked on the GPS task against every fix)
+#define GEOFENCE_ENABLED            true   // Check fixes when the partition holds a zone image
+#define GEOFENCE_EXIT_FIXES         3      // Fixes in a row outside a zone before it counts as left - one event per crossing, not per jitter
 
 // ===========================
 // Balloon Status LEDs
@@ -113,7 +403,9 @@
 // LED Blink Patterns (milliseconds ON, OFF)
 #define LED_PATTERN_GPS_LOCK        1000, 1000   // Slow blink when GPS locked
 #define LED_PATTERN_LORA_TX         100, 900     // Quick blink when transmitting
+#ifndef LED_PATTERN_ERROR
 #define LED_PATTERN_ERROR            200, 200     // Fast blink for errors
+#endif
 #define LED_PATTERN_LOW_BATTERY      500, 500     // Medium blink for low battery
 #define LED_PATTERN_NORMAL           2000, 2000   // Very slow blink for normal operation
 
@@ -132,6 +424,22 @@
 #define EMERGENCY_SAVE_LAST_DATA     true        // Save final data packet
 #define EMERGENCY_CONTINUE_CAMERA    false      // Stop camera in emergency
 
+// Task Watchdog (a heartbeat and budget per task, checked from loop() with
+// the ESP-IDF Task WDT behind it - see task_watchdog.h). A budget covers an
+// iteration and the task's longest bounded wait
+#define TASK_WATCHDOG_RESET          true        // A stall that lasts TASK_WATCHDOG_TIMEOUT_MS panics and resets; false only reports
+#define TASK_WATCHDOG_TIMEOUT_MS     5000        // Task WDT timeout for loop()
+#define TASK_BUDGET_RADIO_MS         1000        // Wakes every LORA_RADIO_POLL_MS
+#define TASK_BUDGET_SENSORS_MS       1000        // Sleeps at most SENSOR_TASK_MAX_SLEEP_MS
+#define TASK_BUDGET_GPS_MS           1000        // Per UART event; the wait for one isn't counted
+#define TASK_BUDGET_CAMERA_MS        10000       // Per capture, twice CAMERA_CAPTURE_TIMEOUT_MS; idle between
+#define TASK_BUDGET_FLIGHT_MS        3000        // Waits at most a second for its next job
+#define TASK_BUDGET_UPLINK_MS        6000        // Wakes every UPLINK_TASK_PERIOD_MS; stopping the camera waits out a capture
+
+// Runtime Configuration (the ground's settings over the build's defines, as
+// one versioned object kept in NVS - see runtime_config.h)
+#define CONFIG_STORE_SLOTS           4           // Versions at once: the current one, the ones readers hold and the next
+
 // ===========================
 // Debug and Development
 // ===========================
@@ -156,6 +464,28 @@
 
 // Serial Debug Settings
 #define DEBUG_BAUD_RATE           115200
+#ifndef DEBUG_BUFFER_SIZE
 #define DEBUG_BUFFER_SIZE         1024
+#endif
+
+// Flight Recorder Raw Capture (GPS bytes, BMP280 registers, LoRa RX frames,
+// camera frame metadata - fills the partition in minutes; for bench replay)
+#define FLIGHT_RECORDER_CAPTURE_RAW false
+
+// Link Capture (every LoRa frame sent and received, and each packet's ACK,
+// timeout or drop, as pcap records in the flight recorder for GET
+// /linkcap.pcap - a few hundred bytes a second, so the log wraps in minutes)
+#define LINK_CAPTURE_FLIGHT_RECORDER false
+#define LINK_CAPTURE_SNAP_BYTES   208   // Frame bytes per record: the flight recorder's payload less both headers
+
+// USB Dump (flight recorder, image store, core dump and log over the native
+// USB CDC to tools/usb_dump.py - usb_dump.h)
+#define USB_DUMP_ENABLED          true
+
+// On-target Benchmarks
+#define CRC_BENCHMARK_ON_BOOT     false  // Print CRC cycles/byte during system checks
+#define IMAGE_SCALE_BENCHMARK_ON_BOOT false // Print downscaler Mpx/s, scalar vs PIE, during system checks
+#define BARO_ALTITUDE_BENCHMARK_ON_BOOT false // Print altitude table error and cycles vs powf during system checks
+#define JPEG_DC_BENCHMARK_ON_BOOT false // Print 1/8-scale decode frames/s, DC-only vs jpg2rgb565, during system checks
 
 #endif // BALLOON_CONFIG_H
@@ -14,9 +14,12 @@
 #define DEVICE_BALLOON      1
 #define DEVICE_BASE_STATION 2
 
-// Uncomment the device type you're building:
+// Uncomment the device type you're building (env:esp32-s3-base-station sets
+// it with -DDEVICE_TYPE for every file, balloon_config.h included):
+#ifndef DEVICE_TYPE
 // #define DEVICE_TYPE DEVICE_BALLOON
 #define DEVICE_TYPE DEVICE_BASE_STATION
+#endif
 
 // ===========================
 // Base Station Hardware
@@ -54,6 +57,7 @@
 #define MAX_FLASH_PACKETS     1000    // Max packets to store in flash
 #define MAX_FLASH_IMAGES      100     // Max images to store in flash
 #define FLASH_STORAGE_PATH    "/balloon_data"
+#define ENABLE_LINK_CAPTURE   true    // Every frame both ways as pcap, GET /api/linkcap
 
 // ===========================
 // Base Station Features
@@ -67,6 +71,7 @@
 
 // Map Integration
 #define ENABLE_MAP_DISPLAY      true    // Show balloon position on map
+#define ENABLE_TILE_SERVER      true    // Offline map tiles from LittleFS, GET /api/tile
 #define MAP_UPDATE_INTERVAL_MS  5000    // Update map every 5 seconds
 #define DEFAULT_MAP_LATITUDE    0.0      // Default map center
 #define DEFAULT_MAP_LONGITUDE   0.0      // Default map center
@@ -98,6 +103,9 @@
 #define EXPORT_FORMATS_CSV        true    // CSV export
 #define EXPORT_FORMATS_JSON       true    // JSON export
 #define EXPORT_FORMATS_KML        true    // KML for Google Earth
+#define ENABLE_RANGE_API         true    // /api/telemetry: any window, raw or bucketed, paged by cursor
+#define RANGE_API_DEFAULT_ROWS    500     // Rows per page without limit=
+#define RANGE_API_MAX_ROWS        2000    // Cap on limit=
 
 // ===========================
 // Communication Settings
@@ -108,9 +116,35 @@
 #define LORA_RETRY_DELAY_MS      1000    // Delay between retry attempts
 #define EXPECTED_PACKET_TYPES     0x1F    // Expected packet types mask
 
+// Receive Diversity - several stations along the track, one of them ACKing
+// for all (base_station_diversity.h). Each station needs its own
+// WIFI_AP_SSID; a secondary joins the primary's access point as well
+#define DIVERSITY_OFF            0
+#define DIVERSITY_PRIMARY        1       // Merges every station's frames, sends the ACKs
+#define DIVERSITY_SECONDARY      2       // Forwards its frames to the primary, never ACKs
+#define DIVERSITY_ROLE           DIVERSITY_OFF
+#define DIVERSITY_STATION_ID     1       // Secondaries: 1..DIVERSITY_MAX_STATIONS-1, 0 is the primary's radio
+#define DIVERSITY_PRIMARY_SSID   "BalloonBaseStation"
+#define DIVERSITY_PRIMARY_PASS   "balloon123"
+#define DIVERSITY_PRIMARY_IP     "192.168.4.1"   // softAP default
+#define DIVERSITY_UDP_PORT       5247
+#define DIVERSITY_COMBINE_MS     60      // Wait for other stations' copies of a frame
+#define DIVERSITY_DEDUP_MS       1500    // Copies after the combine are dropped this long
+
+// Position Sharing - the balloon's fixes to a SondeHub-style tracker when
+// the station has internet (base_station_share.h). The station joins
+// SHARE_WIFI_SSID alongside its own access point
+#define SHARE_ENABLED            false
+#define SHARE_WIFI_SSID          ""
+#define SHARE_WIFI_PASS          ""
+#define SHARE_URL                "https://api.v2.sondehub.org/amateur/telemetry"
+#define SHARE_UPLOADER_CALLSIGN  "N0CALL"
+#define SHARE_PAYLOAD_CALLSIGN   "COSMIC1"       // Balloon n is COSMIC1-n
+#define SHARE_INTERVAL_MS        15000           // One batch this often
+
 // Packet Validation
 #define ENABLE_PACKET_VALIDATION true    // Validate packet integrity
-#define PACKET_TIMEOUT_MS        120000  // Packet considered stale after 2 minutes
+#define PACKET_STALE_TIMEOUT_MS  120000  // Packet considered stale after 2 minutes
 #define SEQUENCE_RESET_TIMEOUT   300000  // Reset sequence after 5 minutes
 
 // Signal Quality Monitoring
@@ -157,7 +191,7 @@
 // Data Backup
 #define ENABLE_AUTO_BACKUP        true    // Automatic backup of important data
 #define BACKUP_INTERVAL_MINUTES   10      // Backup every 10 minutes
-#define BACKUP retention_DAYS      7       // Keep backups for 7 days
+#define BACKUP_RETENTION_DAYS     7       // Keep backups for 7 days
 
 // Emergency Procedures
 #define EMERGENCY_DATA_SAVE       true    // Save all data on emergency
@@ -37,10 +37,23 @@ enum class PacketType : uint8_t {
     GPS = 0x02,
     CAMERA_THUMB = 0x03,
     CAMERA_FULL = 0x04,
-    ACK = 0x06,
-    NACK = 0x07,
-    PING = 0x08,
+    ACK = 0x0C,             // Link control - kept clear of COMMAND_ACK/STATUS/DEBUG
+    NACK = 0x0D,
+    PING = 0x0E,
     PONG = 0x09,
+    AGGREGATE = 0x0A,       // Several sub-frames packed into one LoRa frame
+    RATE_CHANGE = 0x0B,     // ADR request - both ends switch SF/BW/CR once ACKed
+    FRAGMENT = 0x10,        // One piece of a payload larger than MAX_PAYLOAD_SIZE
+    FRAGMENT_ACK = 0x11,    // Reassembly bitmap - the sender resends only the gaps
+    COMMAND = 0x12,         // Ground -> balloon: command id and parameters
+    CAMERA_TILE = 0x13,     // Fragment content - one separately encoded block of a retained image
+    CAMERA_LAYER = 0x14,    // Fragment content - one quality layer of a progressive image
+    CAMERA_PREVIEW = 0x15,  // Rows of a capture's dithered low-bit-depth preview (preview_frame.h)
+    COMMAND_BATCH = 0x16,   // Ground -> balloon: several commands, one COMMAND_ACK back
+    FIRMWARE_DELTA = 0x17,  // Fragment content - one chunk of a firmware patch (firmware_update.h)
+    PROFILE_LEVEL = 0x18,   // One pressure level's temperature and height (pressure_profile.h)
+    TRACK_SEGMENT = 0x19,   // Simplified flight path vertices, delta coded (track_history.h)
+    DIGEST = 0x1A,          // Every subsystem's key values in one fixed frame (DigestSchema, packet_handler.h)
     EMERGENCY = 0xFF
 };
 
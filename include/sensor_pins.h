@@ -24,12 +24,48 @@
 #define LORA_IRQ_PIN      20  // DIO0 - Interrupt/Ready
 #define LORA_DIO1_PIN     23  // DIO1 - Optional advanced features
 #define LORA_SPI_NUM      SPI3_HOST  // Use SPI3
+#define LORA_BUSY_PIN     LORA_IRQ_PIN  // SX126x BUSY - on the line an SX127x uses for DIO0, its IRQ then on DIO1
+
+// LoRa Transceiver (radio_driver.h) - -DLORA_RADIO_CHIP=LORA_RADIO_SX126X for an SX1262/SX1268 module
+#define LORA_RADIO_SX127X 0
+#define LORA_RADIO_SX126X 1
+#ifndef LORA_RADIO_CHIP
+#define LORA_RADIO_CHIP   LORA_RADIO_SX127X
+#endif
+#define LORA_SX126X_TCXO_MV      1800   // DIO3 TCXO supply, 0 for a crystal
+#define LORA_SX126X_DIO2_RF_SWITCH true // DIO2 drives the module's antenna switch
+#define LORA_SX126X_USE_DCDC     true   // DC-DC regulator rather than the LDO
+#define LORA_SX126X_MAX_POWER    22     // dBm, the SX1262/SX1268 high-power PA
 
 // LoRa SPI Pins (ESP32-S3 specific)
 #define LORA_SCK_PIN      21  // SPI Clock
 #define LORA_MOSI_PIN     47  // Master Out Slave In
 #define LORA_MISO_PIN     48  // Master In Slave Out
 
+// Bulk-data LoRa Module (optional second SX1262/SX1268, radio_driver.h) - -1 where not fitted.
+// It joins the main radio's SPI host as a second device; with an SX127x main
+// radio (on the Arduino SPI bus) give it pins of its own
+#define LORA_BULK_CS_PIN    -1
+#define LORA_BULK_RST_PIN   -1
+#define LORA_BULK_BUSY_PIN  -1
+#define LORA_BULK_DIO1_PIN  -1
+#define LORA_BULK_SCK_PIN   LORA_SCK_PIN
+#define LORA_BULK_MOSI_PIN  LORA_MOSI_PIN
+#define LORA_BULK_MISO_PIN  LORA_MISO_PIN
+#define LORA_BULK_SPI_NUM   LORA_SPI_NUM
+#define LORA_BULK_RADIO_FITTED (LORA_BULK_CS_PIN >= 0)
+
+// SD card on the SDMMC host (sd_recorder.h) - -1 where not fitted. The S3
+// routes SDMMC through the GPIO matrix, so any free pins will do; the
+// ESP32-S3-EYE's own slot (38-40) is the status LEDs here. D1-D3 at -1
+// runs the card 1-bit
+#define SD_CLK_PIN        -1
+#define SD_CMD_PIN        -1
+#define SD_D0_PIN         -1
+#define SD_D1_PIN         -1
+#define SD_D2_PIN         -1
+#define SD_D3_PIN         -1
+
 // Status LEDs (Optional)
 #define LED_GPS_LOCK_PIN  38  // GPS Lock Status
 #define LED_LORA_TX_PIN   39  // LoRa Transmit Status
@@ -37,22 +73,31 @@
 
 // Power Management Pins (Optional)
 #define POWER_ENABLE_PIN  41  // Enable power to sensors
-#define BATTERY_SENSE_PIN 4   // Battery voltage monitoring (ADC)
+#define CAMERA_RAIL_PIN   -1  // Camera load switch enable, -1 where the camera is on the board supply
+#define LORA_RAIL_PIN     -1  // LoRa module load switch enable, -1 where not fitted
+#define RAIL_ACTIVE_LEVEL HIGH  // Load switch enable polarity
+#define BATTERY_SENSE_PIN 4   // Battery voltage monitoring (ADC1 channel 3)
+#define BATTERY_DIVIDER_RATIO   2.0f    // Battery volts per volt at the sense pin
+#define BATTERY_VOLTAGE_TRIM    1.0f    // Per-board gain from a meter reading, for divider tolerance
 
 // ===========================
 // Sensor Configuration
 // ===========================
 
-// BMP280 Settings
-#define BMP280_SAMPLING_TEMP    2   // 0-16, higher = more precise
-#define BMP280_SAMPLING_PRESS   5   // 0-16, higher = more precise
-#define BMP280_FILTER           2   // 0-4, higher = more filtering
-#define BMP280_STANDBY_MS       0   // 0-7, 0=0.5ms, 7=4000ms
+// BMP280 Settings - register codes; forced mode, so no standby time
+#define BMP280_SAMPLING_TEMP    2   // 1-5 = x1-x16; x2 for 20-bit pressure resolution
+#define BMP280_SAMPLING_PRESS   4   // 1-5 = x1-x16; x8 converts in 25 ms, room for 20 Hz
+#define BMP280_FILTER           4   // 0-4 = off, 2, 4, 8, 16; IIR coefficient 16
+#define BMP280_I2C_CLOCK        400000
 
 // GPS Settings
 #define GPS_UPDATE_RATE     1000    // Update every 1000ms
 #define GPS_TIMEOUT_MS      5000    // GPS timeout
 #define GPS_MIN_SATS        4       // Minimum satellites for valid fix
+#define GPS_USE_UBX         true    // Binary NAV-PVT; falls back to NMEA if the receiver doesn't answer
+#define GPS_UBX_BAUD_RATE   115200  // After configuration; RAM only, so a power cycle is back at GPS_BAUD_RATE
+#define GPS_NAV_RATE_HZ     5       // Solutions per second; the M10 manages 10 with its default constellations
+#define GPS_DYNAMIC_MODEL   6       // Airborne <1g - the default portable model stops reporting above 12 km
 
 // LoRa Settings
 #define LORA_FREQUENCY      915.0   // MHz (US band)
@@ -63,6 +108,14 @@
 #define LORA_PREAMBLE_LEN   8       // 6-65535
 #define LORA_SYNC_WORD      0x12    // Network sync word
 
+// Bulk-data link - a fixed fast rate on its own channel, away from the hop plan
+#define LORA_BULK_FREQUENCY       923300000  // Hz, as the hop plan; US915 500 kHz channel 0
+#define LORA_BULK_SPREADING_FACTOR 7
+#define LORA_BULK_BANDWIDTH       500000  // Hz
+#define LORA_BULK_CODING_RATE     5
+#define LORA_BULK_TX_POWER        17      // dBm
+#define LORA_BULK_SYNC_WORD       0x24    // Not the main link's, so neither demodulates the other
+
 // ===========================
 // Pin Validation
 // ===========================
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "lora_comm.h"
+#include "packet_handler.h"
+#include "telemetry_codec.h"
+#include "text_codec.h"
+#include "wavelet_codec.h"
+
+// ===========================
+// Native Fuzz - Receive Parsers
+// libFuzzer entry point over everything that decodes bytes off the air or
+// the wire; see docs/Simulation.md. The first input byte picks the parser,
+// the rest is what it is fed. A crash, a sanitizer report or an abort()
+// below is a finding
+// ===========================
+
+#define FUZZ_TEXT_CAPACITY         1024    // Inflated status text
+#define FUZZ_TEXT_GUARD            16      // Past the capacity, must come back untouched
+
+enum class FuzzTarget : uint8_t {
+    WIRE_STREAM,        // PacketHandler::processIncomingData(), then it must find clean frames again
+    LORA_FRAME,         // deserializePacket() and verifyFrameCRC()
+    TELEMETRY,          // TelemetryDecoder::decode() over length-prefixed chunks, keyframes then deltas
+    TEXT,               // decompressText()
+    WAVELET,            // waveletDimensions() and waveletDecode()
+    COUNT
+};
+
+// One clean GPS frame, the one the stream parser has to resynchronise on
+static uint8_t cleanFrame[MAX_PACKET_SIZE];
+static size_t cleanFrameLength;
+
+static void buildCleanFrame() {
+    PacketHandler* handler = new PacketHandler();
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    GPSData gps;
+    memset(&gps, 0, sizeof(gps));
+    GPSSchema::encode(gps, payload);
+
+    PacketSlot slot = PACKET_SLOT_NONE;
+    if (!handler->createPacket(PacketType::GPS_DATA, payload, GPSSchema::size) ||
+        !handler->getBufferedPacket(slot, cleanFrameLength)) {
+        abort();
+    }
+    memcpy(cleanFrame, handler->getSlotData(slot), cleanFrameLength);
+    handler->releaseSlot(slot);
+    delete handler;
+}
+
+static void fuzzWireStream(const uint8_t* data, size_t size) {
+    PacketHandler* handler = new PacketHandler();
+    uint8_t buffer[MAX_PACKET_SIZE];
+
+    // processIncomingData() takes a mutable buffer
+    uint8_t* input = new uint8_t[size ? size : 1];
+    memcpy(input, data, size);
+    handler->processIncomingData(input, size);
+    delete[] input;
+
+    // A held bogus frame can swallow up to a full frame of what follows
+    const int recoveryFrames =
+        (PACKET_WIRE_HEADER_SIZE + MAX_PAYLOAD_SIZE + PACKET_WIRE_FOOTER_SIZE) / cleanFrameLength + 2;
+    uint32_t before = handler->getPacketsReceived();
+    for (int i = 0; i < recoveryFrames; i++) {
+        memcpy(buffer, cleanFrame, cleanFrameLength);
+        handler->processIncomingData(buffer, cleanFrameLength);
+    }
+    if (handler->getPacketsReceived() - before < (uint32_t)recoveryFrames - 1) {
+        abort();    // Failed to resynchronise
+    }
+    delete handler;
+}
+
+static void fuzzLoRaFrame(const uint8_t* data, size_t size) {
+    Packet packet;
+    if (deserializePacket(data, size, packet)) {
+        verifyFrameCRC(data, size);
+        if (packet.payloadLength > size ||
+            (packet.payloadLength > 0 && (packet.payload < data || packet.payload + packet.payloadLength > data + size))) {
+            abort();    // Payload outside the frame it came from
+        }
+    }
+}
+
+static void fuzzTelemetry(const uint8_t* data, size_t size) {
+    TelemetryDecoder decoder;
+    TelemetryData telemetry;
+    while (size > 0) {
+        size_t length = std::min((size_t)data[0], size - 1);
+        decoder.decode(data + 1, length, telemetry);
+        data += 1 + length;
+        size -= 1 + length;
+    }
+}
+
+static void fuzzText(const uint8_t* data, size_t size) {
+    static uint8_t text[FUZZ_TEXT_CAPACITY + FUZZ_TEXT_GUARD];
+    memset(text + FUZZ_TEXT_CAPACITY, 0xA5, FUZZ_TEXT_GUARD);
+    size_t length = decompressText(data, size, text, FUZZ_TEXT_CAPACITY);
+    if (length > FUZZ_TEXT_CAPACITY) {
+        abort();
+    }
+    for (size_t i = 0; i < FUZZ_TEXT_GUARD; i++) {
+        if (text[FUZZ_TEXT_CAPACITY + i] != 0xA5) {
+            abort();    // Wrote past the capacity it was given
+        }
+    }
+}
+
+static void fuzzWavelet(const uint8_t* data, size_t size) {
+    uint16_t width;
+    uint16_t height;
+    if (!waveletDimensions(data, size, width, height)) {
+        return;
+    }
+    size_t workspaceSize = waveletWorkspaceSize(width, height);
+    if (workspaceSize == 0) {
+        return;
+    }
+    size_t pixels = (size_t)width * height;
+    uint8_t* plane = new uint8_t[pixels];
+    uint8_t* workspace = new uint8_t[workspaceSize];
+    waveletDecode(data, size, plane, pixels, workspace);
+    delete[] workspace;
+    delete[] plane;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    if (cleanFrameLength == 0) {
+        buildCleanFrame();
+    }
+
+    FuzzTarget target = static_cast<FuzzTarget>(data[0] % static_cast<uint8_t>(FuzzTarget::COUNT));
+    data++;
+    size--;
+    switch (target) {
+        case FuzzTarget::WIRE_STREAM:
+            fuzzWireStream(data, size);
+            break;
+        case FuzzTarget::LORA_FRAME:
+            fuzzLoRaFrame(data, size);
+            break;
+        case FuzzTarget::TELEMETRY:
+            fuzzTelemetry(data, size);
+            break;
+        case FuzzTarget::TEXT:
+            fuzzText(data, size);
+            break;
+        default:
+            fuzzWavelet(data, size);
+            break;
+    }
+    return 0;
+}
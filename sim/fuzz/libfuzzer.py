@@ -0,0 +1,8 @@
+# native-fuzz: libFuzzer ships with clang, while the native platform builds
+# with the host's default compiler
+Import("env")
+
+SANITIZERS = "-fsanitize=fuzzer,address,undefined"
+
+env.Replace(CC="clang", CXX="clang++", LINK="clang++", AR="llvm-ar", RANLIB="llvm-ranlib")
+env.Append(CCFLAGS=[SANITIZERS, "-fno-sanitize-recover=undefined"], LINKFLAGS=[SANITIZERS])
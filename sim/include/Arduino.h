@@ -0,0 +1,156 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// ===========================
+// Native Simulation - Arduino Core
+// What the firmware uses of Arduino-ESP32, over the simulated kernel and
+// devices; see docs/Simulation.md
+// ===========================
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <type_traits>
+
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+#include "esp_cpu.h"
+#include "esp_sleep.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "WString.h"
+#include "Print.h"
+#include "HardwareSerial.h"
+#include "Esp.h"
+
+#define ARDUINO_ARCH_ESP32          1
+#define ARDUINO_RUNNING_CORE        1
+#define ARDUINO_LOOP_STACK_SIZE     8192
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH                0x1
+#define LOW                 0x0
+
+#define INPUT               0x01
+#define OUTPUT              0x03
+#define PULLUP              0x04
+#define INPUT_PULLUP        0x05
+#define PULLDOWN            0x08
+#define INPUT_PULLDOWN      0x09
+#define OPEN_DRAIN          0x10
+#define OUTPUT_OPEN_DRAIN   0x13
+#define ANALOG              0xC0
+
+#define RISING              0x01
+#define FALLING             0x02
+#define CHANGE              0x03
+#define ONLOW               0x04
+#define ONHIGH              0x05
+
+#define PI                  3.1415926535897932384626433832795
+#define HALF_PI             1.5707963267948966192313216916398
+#define TWO_PI              6.283185307179586476925286766559
+#define DEG_TO_RAD          0.017453292519943295769236907684886
+#define RAD_TO_DEG          57.295779513082320876798154814105
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define radians(deg)        ((deg) * DEG_TO_RAD)
+#define degrees(rad)        ((rad) * RAD_TO_DEG)
+#define sq(x)               ((x) * (x))
+#define _min(a, b)          ((a) < (b) ? (a) : (b))
+#define _max(a, b)          ((a) > (b) ? (a) : (b))
+
+#define lowByte(w)          ((uint8_t)((w) & 0xff))
+#define highByte(w)         ((uint8_t)((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit)  ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bit(b)              (1UL << (b))
+
+#define digitalPinToInterrupt(pin) (pin)
+
+// Flash is ordinary memory on the host
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_float(addr) (*(const float*)(addr))
+#define pgm_read_ptr(addr)  (*(const void* const*)(addr))
+
+using std::abs;
+using std::isinf;
+using std::isnan;
+using std::max;
+using std::min;
+using ::round;
+
+// Virtual time since boot
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// GPIO - outputs are kept, inputs read what the simulated board drives
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+// ADC one-shot, on the battery sense pin the simulated battery
+uint16_t analogRead(uint8_t pin);
+uint32_t analogReadMilliVolts(uint8_t pin);
+void analogReadResolution(uint8_t bits);
+typedef enum {
+    ADC_0db,
+    ADC_2_5db,
+    ADC_6db,
+    ADC_11db,
+} adc_attenuation_t;
+
+void analogSetAttenuation(adc_attenuation_t attenuation);
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation);
+
+// Clock
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+uint32_t getXtalFrequencyMhz();
+uint32_t getApbFrequency();
+
+bool psramFound();
+void* ps_malloc(size_t size);
+void* ps_calloc(size_t count, size_t size);
+float temperatureRead();
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+#define log_e(format, ...) do { } while (0)
+#define log_w(format, ...) do { } while (0)
+#define log_i(format, ...) do { } while (0)
+#define log_d(format, ...) do { } while (0)
+#define log_v(format, ...) do { } while (0)
+
+void setup();
+void loop();
+
+#endif // SIM_ARDUINO_H
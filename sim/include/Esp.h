@@ -0,0 +1,27 @@
+#ifndef SIM_ESP_H
+#define SIM_ESP_H
+
+#include <cstdint>
+
+class EspClass {
+public:
+    uint32_t getCpuFreqMHz();
+    uint32_t getCycleCount();
+    uint32_t getFlashChipSize() { return 16 * 1024 * 1024; }
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint32_t getPsramSize();
+    uint32_t getFreePsram();
+    uint32_t getMinFreePsram();
+    uint32_t getMaxAllocPsram();
+    const char* getChipModel() { return "ESP32-S3 (simulated)"; }
+    uint8_t getChipRevision() { return 0; }
+    const char* getSdkVersion() { return "v5.1.4-sim"; }
+    [[noreturn]] void restart();
+};
+
+extern EspClass ESP;
+
+#endif // SIM_ESP_H
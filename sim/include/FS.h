@@ -0,0 +1,16 @@
+#ifndef SIM_FS_H
+#define SIM_FS_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace fs {
+class FS {
+public:
+    bool exists(const char* path) { return false; }
+    bool remove(const char* path) { return false; }
+    bool mkdir(const char* path) { return false; }
+};
+}
+
+#endif // SIM_FS_H
@@ -0,0 +1,39 @@
+#ifndef SIM_HARDWARE_SERIAL_H
+#define SIM_HARDWARE_SERIAL_H
+
+#include "Print.h"
+
+// The console: what the firmware prints goes to the simulation's serial
+// log (sim_main.cpp --serial), and nothing is ever received. Serial1 is
+// the GPS port as the Arduino core sees it; the GPS driver itself reads
+// UART1 through driver/uart.h.
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream {
+public:
+    explicit HardwareSerial(int port) : port(port) {}
+
+    void begin(unsigned long baud, uint32_t config = 0, int8_t rxPin = -1, int8_t txPin = -1) { (void)baud; }
+    void end() {}
+    void setTxTimeoutMs(uint32_t timeoutMs) {}
+    void setRxBufferSize(size_t size) {}
+    void setTxBufferSize(size_t size) {}
+    int available() override { return 0; }
+    int availableForWrite() { return 4096; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    void flush() override;
+    operator bool() const { return true; }
+
+private:
+    int port;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif // SIM_HARDWARE_SERIAL_H
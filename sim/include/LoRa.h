@@ -0,0 +1,53 @@
+#ifndef SIM_LORA_H
+#define SIM_LORA_H
+
+#include <Arduino.h>
+#include <SPI.h>
+
+// The LoRa library's API with no SX127x behind it: begin() fails, so the
+// simulation's radios are the SimulatedLink endpoints sim_main.cpp fits
+
+class LoRaClass {
+public:
+    int begin(long frequency) { return 0; }
+    void end() {}
+    int beginPacket(int implicitHeader = false) { return 0; }
+    int endPacket(bool async = false) { return 0; }
+    int parsePacket(int size = 0) { return 0; }
+    int packetRssi() { return -157; }
+    float packetSnr() { return 0; }
+    long packetFrequencyError() { return 0; }
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t byte) { return 0; }
+    size_t write(const uint8_t* buffer, size_t size) { return 0; }
+    void onReceive(void (*callback)(int)) {}
+    void onCadDone(void (*callback)(bool)) {}
+    void onTxDone(void (*callback)()) {}
+    void receive(int size = 0) {}
+    void channelActivityDetection() {}
+    void idle() {}
+    void sleep() {}
+    void setTxPower(int level, int outputPin = 1) {}
+    void setFrequency(long frequency) {}
+    void setSpreadingFactor(int sf) {}
+    void setSignalBandwidth(long bandwidth) {}
+    void setCodingRate4(int denominator) {}
+    void setPreambleLength(long length) {}
+    void setSyncWord(int sw) {}
+    void enableCrc() {}
+    void disableCrc() {}
+    void enableInvertIQ() {}
+    void disableInvertIQ() {}
+    void setOCP(uint8_t mA) {}
+    void setGain(uint8_t gain) {}
+    uint8_t random() { return 0; }
+    void setPins(int ss, int reset, int dio0) {}
+    void setSPI(SPIClass& spi) {}
+    void setSPIFrequency(uint32_t frequency) {}
+};
+
+extern LoRaClass LoRa;
+
+#endif // SIM_LORA_H
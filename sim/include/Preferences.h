@@ -0,0 +1,37 @@
+#ifndef SIM_PREFERENCES_H
+#define SIM_PREFERENCES_H
+
+#include <cstdint>
+#include <cstddef>
+
+// NVS as in-memory namespaces: empty at the start of a run, as on a board
+// fresh off the flasher
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putUInt(const char* key, uint32_t value);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    size_t putInt(const char* key, int32_t value);
+    int32_t getInt(const char* key, int32_t defaultValue = 0);
+    size_t putUChar(const char* key, uint8_t value);
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+    size_t putBool(const char* key, bool value);
+    bool getBool(const char* key, bool defaultValue = false);
+    size_t putFloat(const char* key, float value);
+    float getFloat(const char* key, float defaultValue = 0);
+    size_t putBytes(const char* key, const void* value, size_t length);
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+    size_t getBytesLength(const char* key);
+
+private:
+    char space[16] = {};
+    bool open = false;
+};
+
+#endif // SIM_PREFERENCES_H
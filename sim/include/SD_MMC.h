@@ -0,0 +1,25 @@
+#ifndef SIM_SD_MMC_H
+#define SIM_SD_MMC_H
+
+#include "FS.h"
+
+// No card in the slot
+
+typedef enum { CARD_NONE, CARD_MMC, CARD_SD, CARD_SDHC, CARD_UNKNOWN } sdcard_type_t;
+
+class SDMMCFS : public fs::FS {
+public:
+    bool setPins(int clk, int cmd, int d0) { return true; }
+    bool setPins(int clk, int cmd, int d0, int d1, int d2, int d3) { return true; }
+    bool begin(const char* mountpoint = "/sdcard", bool mode1bit = false, bool formatOnFail = false,
+               int sdmmcFrequency = 20000, uint8_t maxOpenFiles = 5) { return false; }
+    void end() {}
+    sdcard_type_t cardType() { return CARD_NONE; }
+    uint64_t cardSize() { return 0; }
+    uint64_t totalBytes() { return 0; }
+    uint64_t usedBytes() { return 0; }
+};
+
+extern SDMMCFS SD_MMC;
+
+#endif // SIM_SD_MMC_H
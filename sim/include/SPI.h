@@ -0,0 +1,37 @@
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+
+#include <cstdint>
+#include <cstddef>
+
+// No SPI devices: the simulated LoRa link stands in for the radios at the
+// RadioDriver interface, so nothing drives this bus
+
+#define MSBFIRST    1
+#define LSBFIRST    0
+#define SPI_MODE0   0
+#define SPI_MODE1   1
+#define SPI_MODE2   2
+#define SPI_MODE3   3
+
+class SPISettings {
+public:
+    SPISettings() {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+class SPIClass {
+public:
+    explicit SPIClass(uint8_t bus = 0) {}
+    bool begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) { return true; }
+    void end() {}
+    void beginTransaction(SPISettings settings) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t data) { return 0; }
+    void transferBytes(const uint8_t* out, uint8_t* in, uint32_t length);
+    void writeBytes(const uint8_t* data, uint32_t length) {}
+};
+
+extern SPIClass SPI;
+
+#endif // SIM_SPI_H
@@ -0,0 +1,36 @@
+#ifndef SIM_WSTRING_H
+#define SIM_WSTRING_H
+
+#include <string>
+
+// Enough of Arduino's String for the firmware's few uses, and for
+// ArduinoJson's Arduino adapters
+
+class __FlashStringHelper;
+
+class String {
+public:
+    String(const char* text = "") : value(text ? text : "") {}
+    String(const std::string& text) : value(text) {}
+    String(int number) : value(std::to_string(number)) {}
+    String(unsigned int number) : value(std::to_string(number)) {}
+    String(long number) : value(std::to_string(number)) {}
+    String(unsigned long number) : value(std::to_string(number)) {}
+
+    const char* c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+    bool isEmpty() const { return value.empty(); }
+    bool equals(const String& other) const { return value == other.value; }
+    bool operator==(const String& other) const { return value == other.value; }
+    bool operator!=(const String& other) const { return value != other.value; }
+    String& operator+=(const String& other) { value += other.value; return *this; }
+    String operator+(const String& other) const { return String(value + other.value); }
+    bool concat(const char* text) { value += text; return true; }
+    bool concat(char c) { value += c; return true; }
+    char operator[](unsigned int index) const { return value[index]; }
+
+private:
+    std::string value;
+};
+
+#endif // SIM_WSTRING_H
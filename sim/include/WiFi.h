@@ -0,0 +1,44 @@
+#ifndef SIM_WIFI_H
+#define SIM_WIFI_H
+
+#include <cstdint>
+#include <cstdio>
+#include "WString.h"
+
+// The soft AP comes up and no station ever joins
+
+typedef enum { WIFI_OFF = 0, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+#define WIFI_MODE_NULL WIFI_OFF
+
+class IPAddress {
+public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} {}
+    uint8_t operator[](int i) const { return octets[i]; }
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+        return String(text);
+    }
+
+private:
+    uint8_t octets[4];
+};
+
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t next) { current = next; return true; }
+    wifi_mode_t getMode() const { return current; }
+    bool softAP(const char* ssid, const char* password = nullptr, int channel = 1, int hidden = 0,
+                int maxConnections = 4) { return current == WIFI_AP || current == WIFI_AP_STA; }
+    bool softAPdisconnect(bool wifiOff = false) { return true; }
+    IPAddress softAPIP() const { return IPAddress(192, 168, 4, 1); }
+    uint8_t softAPgetStationNum() const { return 0; }
+    bool setTxPower(int power) { return true; }
+
+private:
+    wifi_mode_t current = WIFI_OFF;
+};
+
+extern WiFiClass WiFi;
+
+#endif // SIM_WIFI_H
@@ -0,0 +1,46 @@
+#ifndef SIM_WIRE_H
+#define SIM_WIRE_H
+
+#include <cstdint>
+#include <cstddef>
+#include "Print.h"
+
+// I2C to the simulated devices on the sensor bus (sim_devices.cpp) - the
+// BMP280 answers at its address, anything else NACKs. A transaction costs
+// its bytes' time at the bus clock.
+
+class TwoWire : public Stream {
+public:
+    explicit TwoWire(uint8_t bus) : bus(bus) {}
+
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    bool end();
+    bool setClock(uint32_t frequency);
+    uint32_t getClock() { return clock; }
+    void setTimeOut(uint16_t timeoutMs) {}
+
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(bool sendStop = true);
+    size_t requestFrom(uint8_t address, size_t length, bool sendStop = true);
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t* data, size_t length) override;
+    using Print::write;
+    int available() override { return rxLength - rxPosition; }
+    int read() override { return rxPosition < rxLength ? rxBuffer[rxPosition++] : -1; }
+    int peek() override { return rxPosition < rxLength ? rxBuffer[rxPosition] : -1; }
+
+private:
+    uint8_t bus;
+    uint32_t clock = 100000;
+    uint8_t txAddress = 0;
+    uint8_t txBuffer[128];
+    size_t txLength = 0;
+    uint8_t rxBuffer[128];
+    size_t rxLength = 0;
+    size_t rxPosition = 0;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
+
+#endif // SIM_WIRE_H
@@ -0,0 +1,25 @@
+#ifndef SIM_DRIVER_I2C_H
+#define SIM_DRIVER_I2C_H
+
+#include <cstdint>
+#include <cstddef>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// The legacy I2C driver, as the camera's SCCB writes use it: commands are
+// counted and every write ACKs, which is all the simulated sensor needs
+
+typedef enum { I2C_NUM_0 = 0, I2C_NUM_1, I2C_NUM_MAX } i2c_port_t;
+typedef enum { I2C_MASTER_WRITE = 0, I2C_MASTER_READ } i2c_rw_t;
+
+typedef void* i2c_cmd_handle_t;
+
+i2c_cmd_handle_t i2c_cmd_link_create(void);
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ackEnable);
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t* data, size_t length, bool ackEnable);
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks);
+
+#endif // SIM_DRIVER_I2C_H
@@ -0,0 +1,8 @@
+#ifndef SIM_ESP32_HAL_PERIMAN_H
+#define SIM_ESP32_HAL_PERIMAN_H
+
+#include <cstdint>
+
+bool perimanClearPinBus(uint8_t pin);
+
+#endif // SIM_ESP32_HAL_PERIMAN_H
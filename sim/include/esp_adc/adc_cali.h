@@ -0,0 +1,11 @@
+#ifndef SIM_ADC_CALI_H
+#define SIM_ADC_CALI_H
+
+#include "esp_adc/adc_continuous.h"
+
+typedef struct adc_cali_scheme_t* adc_cali_handle_t;
+
+// Linear over the 12 dB range, as the eFuse curve is near enough
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int* voltage);
+
+#endif // SIM_ADC_CALI_H
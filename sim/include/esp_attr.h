@@ -0,0 +1,20 @@
+#ifndef SIM_ESP_ATTR_H
+#define SIM_ESP_ATTR_H
+
+// Placement attributes are no-ops on the host. RTC memory is ordinary
+// memory: the simulation ends at a deep sleep or reset rather than waking
+// into it
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_BSS_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_FAST_ATTR
+#define RTC_SLOW_ATTR
+#define RTC_IRAM_ATTR
+#define NOINLINE_ATTR       __attribute__((noinline))
+#define FORCE_INLINE_ATTR   static inline __attribute__((always_inline))
+#define WORD_ALIGNED_ATTR   __attribute__((aligned(4)))
+
+#endif // SIM_ESP_ATTR_H
@@ -0,0 +1,11 @@
+#ifndef SIM_ESP_CPU_H
+#define SIM_ESP_CPU_H
+
+#include <cstdint>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+// Virtual time at 240 MHz
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
+
+#endif // SIM_ESP_CPU_H
@@ -0,0 +1,12 @@
+#ifndef SIM_ESP_IDF_VERSION_H
+#define SIM_ESP_IDF_VERSION_H
+
+// The IDF under Arduino-ESP32 3.0
+#define ESP_IDF_VERSION_MAJOR   5
+#define ESP_IDF_VERSION_MINOR   1
+#define ESP_IDF_VERSION_PATCH   4
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH)
+
+#endif // SIM_ESP_IDF_VERSION_H
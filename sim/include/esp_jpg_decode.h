@@ -0,0 +1,16 @@
+#ifndef SIM_ESP_JPG_DECODE_H
+#define SIM_ESP_JPG_DECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+typedef enum {
+    JPG_SCALE_NONE,
+    JPG_SCALE_2X,
+    JPG_SCALE_4X,
+    JPG_SCALE_8X,
+    JPG_SCALE_MAX = JPG_SCALE_8X
+} jpg_scale_t;
+
+#endif // SIM_ESP_JPG_DECODE_H
@@ -0,0 +1,8 @@
+#ifndef SIM_ESP_MEMORY_UTILS_H
+#define SIM_ESP_MEMORY_UTILS_H
+
+// Whether heap_caps_malloc() gave the block from the PSRAM count
+bool esp_ptr_external_ram(const void* ptr);
+bool esp_ptr_internal(const void* ptr);
+
+#endif // SIM_ESP_MEMORY_UTILS_H
@@ -0,0 +1,11 @@
+#ifndef SIM_ESP_ROM_CRC_H
+#define SIM_ESP_ROM_CRC_H
+
+#include <cstdint>
+
+// The ROM's table CRCs, bit for bit
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
+uint16_t esp_rom_crc16_be(uint16_t crc, const uint8_t* buf, uint32_t len);
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t* buf, uint32_t len);
+
+#endif // SIM_ESP_ROM_CRC_H
@@ -0,0 +1,32 @@
+#ifndef SIM_ESP_SYSTEM_H
+#define SIM_ESP_SYSTEM_H
+
+#include <cstdint>
+#include <cstddef>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_RST_UNKNOWN = 0,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+// Always a power-on: a simulated flight starts from a cold boot
+esp_reset_reason_t esp_reset_reason(void);
+// Ends the simulation - see sim_kernel.h
+[[noreturn]] void esp_restart(void);
+
+uint32_t esp_random(void);
+void esp_fill_random(void* buffer, size_t length);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#endif // SIM_ESP_SYSTEM_H
@@ -0,0 +1,82 @@
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <climits>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
+// ===========================
+// Native Simulation - FreeRTOS
+// The IDF's SMP FreeRTOS API over the simulated kernel (sim_kernel.cpp)
+// ===========================
+
+// Every task is a host thread, but only one runs at a time: each of the
+// two simulated cores has its own virtual clock, and the kernel always
+// continues the core furthest behind. A critical section is a region the
+// kernel won't switch out of, so a spinlock needs nothing more.
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE                     ((BaseType_t)0)
+#define pdTRUE                      ((BaseType_t)1)
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+#define errQUEUE_EMPTY              ((BaseType_t)0)
+#define errQUEUE_FULL               ((BaseType_t)0)
+#define errCOULD_NOT_ALLOCATE_REQUIRED_MEMORY (-1)
+
+#define configTICK_RATE_HZ          CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES        25
+#define configMINIMAL_STACK_SIZE    768
+#define configMAX_TASK_NAME_LEN     16
+#define configUSE_TRACE_FACILITY    CONFIG_FREERTOS_USE_TRACE_FACILITY
+#define configGENERATE_RUN_TIME_STATS CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#define configNUM_CORES             2
+
+#define portNUM_PROCESSORS          2
+#define portMAX_DELAY               ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS          ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define pdTICKS_TO_MS(ticks)        ((TickType_t)(((uint64_t)(ticks) * 1000U) / configTICK_RATE_HZ))
+#define tskNO_AFFINITY              ((BaseType_t)0x7FFFFFFF)
+#define tskIDLE_PRIORITY            ((UBaseType_t)0U)
+
+// Spinlocks
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_FREE_VAL            0xB33FFFFFUL
+#define portMUX_INITIALIZER_UNLOCKED {portMUX_FREE_VAL, 0}
+#define portMUX_INITIALIZE(mux)     do { (mux)->owner = portMUX_FREE_VAL; (mux)->count = 0; } while (0)
+
+void simEnterCritical(portMUX_TYPE* mux);
+void simExitCritical(portMUX_TYPE* mux);
+void simYield(void);
+BaseType_t simInIsr(void);
+BaseType_t xPortGetCoreID(void);
+
+#define portENTER_CRITICAL(mux)         simEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)          simExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)     simEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)      simExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux)    simEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux)     simExitCritical(mux)
+#define taskENTER_CRITICAL(mux)         simEnterCritical(mux)
+#define taskEXIT_CRITICAL(mux)          simExitCritical(mux)
+#define taskENTER_CRITICAL_ISR(mux)     simEnterCritical(mux)
+#define taskEXIT_CRITICAL_ISR(mux)      simExitCritical(mux)
+#define portYIELD()                     simYield()
+#define portYIELD_FROM_ISR(...)         do { } while (0)
+#define xPortInIsrContext()             simInIsr()
+#define portDISABLE_INTERRUPTS()        do { } while (0)
+#define portENABLE_INTERRUPTS()         do { } while (0)
+
+#endif // SIM_FREERTOS_H
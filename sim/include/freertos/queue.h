@@ -0,0 +1,29 @@
+#ifndef SIM_FREERTOS_QUEUE_H
+#define SIM_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Queues, and the semaphores built on them as in FreeRTOS
+
+typedef struct SimQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueGenericSend(QueueHandle_t queue, const void* item, TickType_t ticks, BaseType_t toFront);
+BaseType_t xQueueGenericSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken, BaseType_t toFront);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void* item, BaseType_t* woken);
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#define xQueueSend(queue, item, ticks)              xQueueGenericSend(queue, item, ticks, pdFALSE)
+#define xQueueSendToBack(queue, item, ticks)        xQueueGenericSend(queue, item, ticks, pdFALSE)
+#define xQueueSendToFront(queue, item, ticks)       xQueueGenericSend(queue, item, ticks, pdTRUE)
+#define xQueueSendFromISR(queue, item, woken)       xQueueGenericSendFromISR(queue, item, woken, pdFALSE)
+#define xQueueSendToBackFromISR(queue, item, woken) xQueueGenericSendFromISR(queue, item, woken, pdFALSE)
+
+#endif // SIM_FREERTOS_QUEUE_H
@@ -0,0 +1,90 @@
+#ifndef SIM_FREERTOS_TASK_H
+#define SIM_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct SimTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef enum {
+    eNoAction = 0,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite
+} eNotifyAction;
+
+// Sized like the IDF's TCB, for memory accounting
+typedef struct {
+    uint8_t dummy[352];
+} StaticTask_t;
+
+typedef struct {
+    TaskHandle_t xHandle;
+    const char* pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;
+    StackType_t* pxStackBase;
+    uint32_t usStackHighWaterMark;
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* param,
+                       UBaseType_t priority, TaskHandle_t* created);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskDelayUntil(TickType_t* previousWake, TickType_t increment);
+#define vTaskDelayUntil(previous, increment) ((void)xTaskDelayUntil(previous, increment))
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t core);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(BaseType_t core);
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core);
+char* pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+eTaskState eTaskGetState(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+// The stack the task was created with; the TCB's first word points into it
+uint8_t* pxTaskGetStackStart(TaskHandle_t task);
+UBaseType_t uxTaskGetNumberOfTasks(void);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t count, configRUN_TIME_COUNTER_TYPE* totalRunTime);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+
+// Notifications - index 0 only
+BaseType_t xTaskGenericNotify(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t* previous);
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t* previous,
+                                     BaseType_t* woken);
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t* value, TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+BaseType_t xTaskNotifyStateClear(TaskHandle_t task);
+
+#define xTaskNotify(task, value, action)                 xTaskGenericNotify(task, value, action, nullptr)
+#define xTaskNotifyAndQuery(task, value, action, prev)   xTaskGenericNotify(task, value, action, prev)
+#define xTaskNotifyGive(task)                            xTaskGenericNotify(task, 0, eIncrement, nullptr)
+#define xTaskNotifyFromISR(task, value, action, woken)   xTaskGenericNotifyFromISR(task, value, action, nullptr, woken)
+#define vTaskNotifyGiveFromISR(task, woken)              ((void)xTaskGenericNotifyFromISR(task, 0, eIncrement, nullptr, woken))
+
+#define taskYIELD()                 simYield()
+#define taskDISABLE_INTERRUPTS()    do { } while (0)
+#define taskENABLE_INTERRUPTS()     do { } while (0)
+
+#endif // SIM_FREERTOS_TASK_H
@@ -0,0 +1,21 @@
+#ifndef SIM_IMG_CONVERTERS_H
+#define SIM_IMG_CONVERTERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_camera.h"
+#include "esp_jpg_decode.h"
+
+// The simulator's own baseline JPEG codec: the encoder writes Annex K
+// tables, and jpg2rgb565 decodes any baseline Huffman frame - DC alone at
+// 1/8, a full inverse DCT box-averaged down at the other scales.
+
+typedef size_t (*jpg_out_cb)(void* arg, size_t index, const void* data, size_t len);
+
+bool fmt2jpg_cb(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+                jpg_out_cb cb, void* arg);
+bool fmt2jpg(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+             uint8_t** out, size_t* out_len);
+bool jpg2rgb565(const uint8_t* src, size_t src_len, uint8_t* out, jpg_scale_t scale);
+
+#endif // SIM_IMG_CONVERTERS_H
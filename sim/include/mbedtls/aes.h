@@ -0,0 +1,28 @@
+#ifndef SIM_MBEDTLS_AES_H
+#define SIM_MBEDTLS_AES_H
+
+#include <cstddef>
+#include <cstdint>
+#include "platform.h"
+
+#define MBEDTLS_AES_ENCRYPT 1
+#define MBEDTLS_AES_DECRYPT 0
+
+typedef struct {
+    int unused;
+} mbedtls_aes_context;
+
+inline void mbedtls_aes_init(mbedtls_aes_context*) {}
+inline void mbedtls_aes_free(mbedtls_aes_context*) {}
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context*, const unsigned char*, unsigned int) {
+    return MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
+}
+inline int mbedtls_aes_crypt_ecb(mbedtls_aes_context*, int, const unsigned char[16], unsigned char[16]) {
+    return MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
+}
+inline int mbedtls_aes_crypt_ctr(mbedtls_aes_context*, size_t, size_t*, unsigned char[16], unsigned char[16],
+                                 const unsigned char*, unsigned char*) {
+    return MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
+}
+
+#endif // SIM_MBEDTLS_AES_H
@@ -0,0 +1,31 @@
+#ifndef SIM_MBEDTLS_CIPHER_H
+#define SIM_MBEDTLS_CIPHER_H
+
+#include <cstddef>
+#include "platform.h"
+
+typedef enum {
+    MBEDTLS_CIPHER_NONE = 0,
+    MBEDTLS_CIPHER_AES_128_ECB = 2,
+} mbedtls_cipher_type_t;
+
+typedef struct {
+    int unused;
+} mbedtls_cipher_info_t;
+
+typedef struct {
+    const mbedtls_cipher_info_t* cipher_info;
+} mbedtls_cipher_context_t;
+
+inline void mbedtls_cipher_init(mbedtls_cipher_context_t* ctx) {
+    ctx->cipher_info = nullptr;
+}
+inline void mbedtls_cipher_free(mbedtls_cipher_context_t*) {}
+inline const mbedtls_cipher_info_t* mbedtls_cipher_info_from_type(mbedtls_cipher_type_t) {
+    return nullptr;
+}
+inline int mbedtls_cipher_setup(mbedtls_cipher_context_t*, const mbedtls_cipher_info_t*) {
+    return MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
+}
+
+#endif // SIM_MBEDTLS_CIPHER_H
@@ -0,0 +1,19 @@
+#ifndef SIM_MBEDTLS_CMAC_H
+#define SIM_MBEDTLS_CMAC_H
+
+#include "cipher.h"
+
+inline int mbedtls_cipher_cmac_starts(mbedtls_cipher_context_t*, const unsigned char*, size_t) {
+    return MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
+}
+inline int mbedtls_cipher_cmac_update(mbedtls_cipher_context_t*, const unsigned char*, size_t) {
+    return MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
+}
+inline int mbedtls_cipher_cmac_finish(mbedtls_cipher_context_t*, unsigned char*) {
+    return MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
+}
+inline int mbedtls_cipher_cmac_reset(mbedtls_cipher_context_t*) {
+    return MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
+}
+
+#endif // SIM_MBEDTLS_CMAC_H
@@ -0,0 +1,10 @@
+#ifndef SIM_MBEDTLS_PLATFORM_H
+#define SIM_MBEDTLS_PLATFORM_H
+
+// The simulator carries no crypto: every mbedtls call fails with this,
+// so link auth refuses to start and a firmware patch fails verification
+// the way they would with a broken key or image
+
+#define MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED -0x0072
+
+#endif // SIM_MBEDTLS_PLATFORM_H
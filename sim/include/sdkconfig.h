@@ -0,0 +1,26 @@
+#ifndef SIM_SDKCONFIG_H
+#define SIM_SDKCONFIG_H
+
+// ===========================
+// Native Simulation - sdkconfig
+// The IDF options the firmware tests, set for what the simulation models
+// ===========================
+
+// No ULP, no DFS and no core dump: their paths compile out as on a build
+// without them. Run time stats are on - the simulated kernel counts each
+// task's virtual CPU time, so TaskUsageMonitor reports as on the board.
+
+#define CONFIG_IDF_TARGET_ESP32S3                   1
+#define CONFIG_FREERTOS_HZ                          1000
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY          1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS     1
+#define CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH         0
+#define CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF         0
+#define CONFIG_PM_ENABLE                            0
+#define CONFIG_PM_PROFILING                         0
+#define CONFIG_ULP_COPROC_TYPE_FSM                  0
+#define CONFIG_ULP_COPROC_RESERVE_MEM               0
+#define CONFIG_HTTPD_WS_SUPPORT                     0
+#define CONFIG_SPIRAM                               1
+
+#endif // SIM_SDKCONFIG_H
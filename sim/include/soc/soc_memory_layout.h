@@ -0,0 +1,6 @@
+#ifndef SIM_SOC_MEMORY_LAYOUT_H
+#define SIM_SOC_MEMORY_LAYOUT_H
+
+#include "esp_memory_utils.h"
+
+#endif // SIM_SOC_MEMORY_LAYOUT_H
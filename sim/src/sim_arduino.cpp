@@ -0,0 +1,607 @@
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SD_MMC.h>
+#include <SPI.h>
+#include <LoRa.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include "esp32-hal-periman.h"
+#include "sim_devices.h"
+#include "sim_kernel.h"
+
+// ===========================
+// Native Simulation - Arduino Core
+// ===========================
+
+int simAdcRaw(uint8_t pin);             // sim_idf.cpp
+
+// ===========================
+// Time
+// ===========================
+
+// unsigned long is 32 bits on the ESP32; wrap the same way so the
+// firmware's wrap arithmetic sees what it sees on the target
+unsigned long millis() {
+    sim::SimCall call;
+    return (uint32_t)(sim::now() / 1000);
+}
+
+unsigned long micros() {
+    sim::SimCall call;
+    return (uint32_t)sim::now();
+}
+
+void delay(uint32_t ms) {
+    sim::SimCall call;
+    sim::sleep((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    sim::SimCall call;
+    sim::busy(us);
+}
+
+void yield() {
+    sim::SimCall call;
+}
+
+// ===========================
+// GPIO
+// ===========================
+
+#define GPIO_PIN_COUNT      49
+
+struct PinState {
+    uint8_t mode;
+    int level;
+    int interruptMode;                  // 0 for none
+    void (*handler)(void*);
+    void* arg;
+};
+
+static PinState pins[GPIO_PIN_COUNT];
+
+static void plainHandler(void* arg) {
+    reinterpret_cast<void (*)(void)>(arg)();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin < GPIO_PIN_COUNT) {
+        pins[pin].mode = mode;
+        if (mode == INPUT_PULLUP) {
+            pins[pin].level = HIGH;
+        }
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < GPIO_PIN_COUNT) {
+        pins[pin].level = value ? HIGH : LOW;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < GPIO_PIN_COUNT ? pins[pin].level : LOW;
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode) {
+    if (pin < GPIO_PIN_COUNT) {
+        pins[pin].handler = handler;
+        pins[pin].arg = arg;
+        pins[pin].interruptMode = mode;
+    }
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+    attachInterruptArg(pin, plainHandler, reinterpret_cast<void*>(handler), mode);
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (pin < GPIO_PIN_COUNT) {
+        pins[pin].interruptMode = 0;
+        pins[pin].handler = nullptr;
+    }
+}
+
+void sim::driveInput(uint8_t pin, int level) {
+    if (pin >= GPIO_PIN_COUNT) {
+        return;
+    }
+    PinState& state = pins[pin];
+    int previous = state.level;
+    state.level = level ? HIGH : LOW;
+    if (!state.handler) {
+        return;
+    }
+    bool rising = previous == LOW && state.level == HIGH;
+    bool falling = previous == HIGH && state.level == LOW;
+    bool fire = false;
+    switch (state.interruptMode) {
+        case RISING: fire = rising; break;
+        case FALLING: fire = falling; break;
+        case CHANGE: fire = rising || falling; break;
+        case ONLOW: fire = state.level == LOW; break;
+        case ONHIGH: fire = state.level == HIGH; break;
+    }
+    if (fire) {
+        sim::runIsr(state.handler, state.arg);
+    }
+}
+
+bool perimanClearPinBus(uint8_t pin) {
+    return pin < GPIO_PIN_COUNT;
+}
+
+// ===========================
+// ADC
+// ===========================
+
+#define ANALOG_READ_US      20          // One-shot conversion and calibration
+#define ANALOG_FULL_SCALE_MV 3100       // 11 dB attenuation
+
+static uint8_t analogBits = 12;
+
+uint16_t analogRead(uint8_t pin) {
+    sim::SimCall call;
+    sim::busy(ANALOG_READ_US);
+    int raw = simAdcRaw(pin);
+    return analogBits >= 12 ? raw << (analogBits - 12) : raw >> (12 - analogBits);
+}
+
+uint32_t analogReadMilliVolts(uint8_t pin) {
+    sim::SimCall call;
+    sim::busy(ANALOG_READ_US);
+    return (uint32_t)lroundf(simAdcRaw(pin) * (float)ANALOG_FULL_SCALE_MV / 4095.0f);
+}
+
+void analogReadResolution(uint8_t bits) {
+    analogBits = std::max<uint8_t>(9, std::min<uint8_t>(16, bits));
+}
+
+// Only 11 dB is modelled; the firmware sets nothing else
+void analogSetAttenuation(adc_attenuation_t attenuation) {
+}
+
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation) {
+}
+
+// ===========================
+// Clock, Memory and the Rest
+// ===========================
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+    sim::SimCall call;
+    if (mhz != 240 && mhz != 160 && mhz != 80 && mhz != 40 && mhz != 20 && mhz != 10) {
+        return false;
+    }
+    sim::setCpuMhz(mhz);
+    return true;
+}
+
+uint32_t getCpuFrequencyMhz() {
+    return sim::cpuMhz();
+}
+
+uint32_t getXtalFrequencyMhz() {
+    return 40;
+}
+
+uint32_t getApbFrequency() {
+    return std::min<uint32_t>(sim::cpuMhz(), 80) * 1000000;
+}
+
+bool psramFound() {
+    return true;
+}
+
+void* ps_malloc(size_t size) {
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+void* ps_calloc(size_t count, size_t size) {
+    return heap_caps_calloc(count, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+float temperatureRead() {
+    sim::SimCall call;
+    return sim::chipTemperature();
+}
+
+// esp_random() underneath, as the core's; the seed changes nothing
+long random(long howBig) {
+    return howBig > 0 ? (long)(esp_random() % (uint32_t)howBig) : 0;
+}
+
+long random(long howSmall, long howBig) {
+    return howSmall >= howBig ? howSmall : howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed) {
+}
+
+// ===========================
+// Print
+// ===========================
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size && write(buffer[written])) {
+        written++;
+    }
+    return written;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char small[128];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (length < 0) {
+        return 0;
+    }
+    if ((size_t)length < sizeof(small)) {
+        return write((const uint8_t*)small, length);
+    }
+    std::vector<char> large(length + 1);
+    va_start(args, format);
+    vsnprintf(large.data(), large.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)large.data(), length);
+}
+
+static size_t printNumber(Print& out, unsigned long long value, int base, bool negative) {
+    char text[68];
+    char* at = &text[sizeof(text) - 1];
+    *at = '\0';
+    base = base < 2 ? 10 : base;
+    do {
+        int digit = value % base;
+        *--at = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value);
+    if (negative) {
+        *--at = '-';
+    }
+    return out.write(at);
+}
+
+size_t Print::print(long value, int base) {
+    return print((long long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+    return printNumber(*this, value, base, false);
+}
+
+size_t Print::print(long long value, int base) {
+    if (value < 0 && base == DEC) {
+        return printNumber(*this, 0ull - (unsigned long long)value, base, true);
+    }
+    return printNumber(*this, (unsigned long long)value, base, false);
+}
+
+size_t Print::print(unsigned long long value, int base) {
+    return printNumber(*this, value, base, false);
+}
+
+size_t Print::print(double value, int digits) {
+    char text[48];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return write(text);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    unsigned long start = millis();
+    while (count < length) {
+        int c = read();
+        if (c >= 0) {
+            buffer[count++] = (uint8_t)c;
+        } else if (millis() - start >= timeout) {
+            break;
+        } else {
+            delay(1);
+        }
+    }
+    return count;
+}
+
+// ===========================
+// Serial
+// ===========================
+
+// USB-CDC on boot, as the balloon builds: a TX ring the host drains at
+// full-speed bulk rates; a write waits for room once the ring is full
+#define SERIAL_TX_RING_BYTES    256
+#define SERIAL_NS_PER_BYTE      1000
+
+static FILE* serialLog;
+static uint64_t serialFreeAt;
+
+void sim::setSerialLog(FILE* log) {
+    serialLog = log;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    sim::SimCall call;
+    if (port == 0 && serialLog) {
+        fwrite(buffer, 1, size, serialLog);
+    }
+    uint64_t now = sim::now();
+    serialFreeAt = std::max(now, serialFreeAt) + size * SERIAL_NS_PER_BYTE / 1000;
+    uint64_t queued = SERIAL_TX_RING_BYTES * SERIAL_NS_PER_BYTE / 1000;
+    if (serialFreeAt > now + queued) {
+        sim::sleepUntil(serialFreeAt - queued);
+    }
+    return size;
+}
+
+void HardwareSerial::flush() {
+    sim::SimCall call;
+    sim::sleepUntil(serialFreeAt);
+    if (port == 0 && serialLog) {
+        fflush(serialLog);
+    }
+}
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+
+// ===========================
+// ESP
+// ===========================
+
+uint32_t EspClass::getCpuFreqMHz() {
+    return sim::cpuMhz();
+}
+
+uint32_t EspClass::getCycleCount() {
+    return esp_cpu_get_cycle_count();
+}
+
+uint32_t EspClass::getHeapSize() {
+    return heap_caps_get_total_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t EspClass::getPsramSize() {
+    return heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
+}
+
+uint32_t EspClass::getFreePsram() {
+    return heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+
+uint32_t EspClass::getMinFreePsram() {
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+}
+
+uint32_t EspClass::getMaxAllocPsram() {
+    return heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+}
+
+void EspClass::restart() {
+    sim::stop("ESP.restart()");
+}
+
+EspClass ESP;
+
+// ===========================
+// Wire
+// ===========================
+
+// The legacy driver's command setup and the wait for its interrupt
+#define WIRE_OVERHEAD_US    15
+
+static void wireTransfer(uint32_t clock, size_t bytes) {
+    sim::busy(WIRE_OVERHEAD_US);
+    sim::sleep((uint64_t)bytes * 9 * 1000000 / clock);
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+    if (frequency) {
+        clock = frequency;
+    }
+    return true;
+}
+
+bool TwoWire::end() {
+    return true;
+}
+
+bool TwoWire::setClock(uint32_t frequency) {
+    if (!frequency) {
+        return false;
+    }
+    clock = frequency;
+    return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    txAddress = address;
+    txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+    if (txLength >= sizeof(txBuffer)) {
+        return 0;
+    }
+    txBuffer[txLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t length) {
+    size_t written = 0;
+    while (written < length && write(data[written])) {
+        written++;
+    }
+    return written;
+}
+
+// 0 success, 2 address NACK, as the core's
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    sim::SimCall call;
+    wireTransfer(clock, 1 + txLength);
+    bool acked = sim::i2cWrite(txAddress, txBuffer, txLength);
+    txLength = 0;
+    return acked ? 0 : 2;
+}
+
+size_t TwoWire::requestFrom(uint8_t address, size_t length, bool sendStop) {
+    sim::SimCall call;
+    length = std::min(length, sizeof(rxBuffer));
+    rxPosition = 0;
+    rxLength = 0;
+    if (!sim::i2cRead(address, rxBuffer, length)) {
+        wireTransfer(clock, 1);
+        return 0;
+    }
+    wireTransfer(clock, 1 + length);
+    rxLength = length;
+    return length;
+}
+
+TwoWire Wire(0);
+TwoWire Wire1(1);
+
+// ===========================
+// Preferences
+// ===========================
+
+static std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nvs;
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    if (!name || strlen(name) >= sizeof(space)) {
+        return false;
+    }
+    strcpy(space, name);
+    open = true;
+    return true;
+}
+
+void Preferences::end() {
+    open = false;
+}
+
+bool Preferences::clear() {
+    if (!open) {
+        return false;
+    }
+    nvs[space].clear();
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    return open && nvs[space].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char* key) {
+    return open && nvs[space].count(key) > 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+    if (!open || !key || (!value && length)) {
+        return 0;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    nvs[space][key].assign(bytes, bytes + length);
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    if (!open) {
+        return 0;
+    }
+    auto entry = nvs[space].find(key);
+    return entry == nvs[space].end() ? 0 : entry->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength) {
+    size_t length = getBytesLength(key);
+    if (!length || length > maxLength) {
+        return 0;
+    }
+    memcpy(buffer, nvs[space][key].data(), length);
+    return length;
+}
+
+template <typename T>
+static T getValue(Preferences& preferences, const char* key, T defaultValue) {
+    T value;
+    return preferences.getBytesLength(key) == sizeof(T) && preferences.getBytes(key, &value, sizeof(T))
+               ? value
+               : defaultValue;
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+    return getValue(*this, key, defaultValue);
+}
+
+size_t Preferences::putInt(const char* key, int32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+int32_t Preferences::getInt(const char* key, int32_t defaultValue) {
+    return getValue(*this, key, defaultValue);
+}
+
+size_t Preferences::putUChar(const char* key, uint8_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint8_t Preferences::getUChar(const char* key, uint8_t defaultValue) {
+    return getValue(*this, key, defaultValue);
+}
+
+size_t Preferences::putBool(const char* key, bool value) {
+    return putUChar(key, value ? 1 : 0);
+}
+
+bool Preferences::getBool(const char* key, bool defaultValue) {
+    return getUChar(key, defaultValue ? 1 : 0) != 0;
+}
+
+size_t Preferences::putFloat(const char* key, float value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+float Preferences::getFloat(const char* key, float defaultValue) {
+    return getValue(*this, key, defaultValue);
+}
+
+// ===========================
+// Absent Peripherals
+// ===========================
+
+// No card, no stations, no SX127x: the balloon's radio is the SX126x
+// driver over the simulated link (sim_main.cpp)
+void SPIClass::transferBytes(const uint8_t* out, uint8_t* in, uint32_t length) {
+    if (in) {
+        memset(in, 0, length);
+    }
+}
+
+SPIClass SPI;
+SDMMCFS SD_MMC;
+WiFiClass WiFi;
+LoRaClass LoRa;
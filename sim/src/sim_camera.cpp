@@ -0,0 +1,1353 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "sim_devices.h"
+#include "sim_kernel.h"
+#include "esp_camera.h"
+#include "esp_heap_caps.h"
+#include "img_converters.h"
+
+// ===========================
+// Native Simulation - Camera
+// An OV2640 looking out at the flight, and the JPEG codec the firmware
+// links from esp32-camera
+// ===========================
+
+// Codec time on the S3 at SIM_REFERENCE_MHZ, charged to the caller; the
+// host's own time in the codec is not
+#define CAMERA_ENCODE_US_PER_PIXEL      1.3f
+#define CAMERA_DECODE_US_PER_PIXEL      0.55f       // Source pixel, full-size output
+#define CAMERA_DECODE_DC_US_PER_PIXEL   0.08f       // Source pixel at 1/8: Huffman only
+#define CAMERA_INIT_US                  250000      // Probe, register load, first frame
+#define CAMERA_FB_TIMEOUT_US            4000000     // The driver's wait for a free buffer
+#define CAMERA_FRAME_US                 40000       // 25 fps up to SVGA
+#define CAMERA_LARGE_FRAME_US           80000       // Beyond it
+
+const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+    {96, 96, ASPECT_RATIO_1X1},
+    {160, 120, ASPECT_RATIO_4X3},
+    {176, 144, ASPECT_RATIO_5X4},
+    {240, 176, ASPECT_RATIO_3X2},
+    {240, 240, ASPECT_RATIO_1X1},
+    {320, 240, ASPECT_RATIO_4X3},
+    {400, 296, ASPECT_RATIO_4X3},
+    {480, 320, ASPECT_RATIO_3X2},
+    {640, 480, ASPECT_RATIO_4X3},
+    {800, 600, ASPECT_RATIO_4X3},
+    {1024, 768, ASPECT_RATIO_4X3},
+    {1280, 720, ASPECT_RATIO_16X9},
+    {1280, 1024, ASPECT_RATIO_5X4},
+    {1600, 1200, ASPECT_RATIO_4X3},
+    {1920, 1080, ASPECT_RATIO_16X9},
+    {720, 1280, ASPECT_RATIO_9X16},
+    {864, 1536, ASPECT_RATIO_9X16},
+    {2048, 1536, ASPECT_RATIO_4X3},
+    {2560, 1440, ASPECT_RATIO_16X9},
+    {2560, 1600, ASPECT_RATIO_16X10},
+    {1080, 1920, ASPECT_RATIO_9X16},
+    {2560, 1920, ASPECT_RATIO_4X3},
+};
+
+static void computeBusy(float referenceUs) {
+    sim::busy((uint64_t)(referenceUs * SIM_REFERENCE_MHZ / sim::cpuMhz()));
+}
+
+// ===========================
+// JPEG Tables
+// ===========================
+
+static const uint8_t zigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// Annex K, natural order
+static const uint8_t lumaQuant[64] = {
+    16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+    14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+    18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99,
+};
+
+static const uint8_t chromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+static const uint8_t dcLumaBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t dcChromaBits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t dcValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t acLumaBits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t acLumaValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static const uint8_t acChromaBits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t acChromaValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+// cos((2x + 1) u pi / 16) scaled by C(u) / 2, for both transforms
+static float dctBasis[8][8];
+
+static void initDctBasis() {
+    static bool ready = false;
+    if (ready) {
+        return;
+    }
+    for (int u = 0; u < 8; u++) {
+        float scale = u == 0 ? sqrtf(0.125f) : 0.5f;
+        for (int x = 0; x < 8; x++) {
+            dctBasis[u][x] = scale * cosf((2 * x + 1) * u * (float)M_PI / 16.0f);
+        }
+    }
+    ready = true;
+}
+
+// ===========================
+// Encoder
+// ===========================
+
+struct HuffmanCode {
+    uint16_t code;
+    uint8_t length;
+};
+
+static void buildCodes(const uint8_t* bits, const uint8_t* values, HuffmanCode* codes) {
+    uint16_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++) {
+        for (int i = 0; i < bits[length - 1]; i++) {
+            codes[values[k++]] = {code++, (uint8_t)length};
+        }
+        code <<= 1;
+    }
+}
+
+class JpegEncoder {
+public:
+    JpegEncoder(int quality, bool color);
+    // Planes of 0-255 samples at full resolution; chroma ignored in gray
+    void encode(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, int width, int height);
+    std::vector<uint8_t> out;
+
+private:
+    bool color;
+    uint8_t quant[2][64];
+    HuffmanCode dc[2][12];
+    HuffmanCode ac[2][256];
+    uint32_t bitBuffer;
+    int bitCount;
+
+    void marker(uint8_t code) { out.push_back(0xFF); out.push_back(code); }
+    void word(uint16_t value) { out.push_back(value >> 8); out.push_back(value & 0xFF); }
+    void writeHuffmanTable(uint8_t id, const uint8_t* bits, const uint8_t* values, int count);
+    void putBits(uint32_t value, int length);
+    void flushBits();
+    void encodeBlock(const float* samples, int table, int& predictor);
+};
+
+JpegEncoder::JpegEncoder(int quality, bool color) : color(color), bitBuffer(0), bitCount(0) {
+    quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++) {
+        int luma = (lumaQuant[i] * scale + 50) / 100;
+        int chroma = (chromaQuant[i] * scale + 50) / 100;
+        quant[0][i] = luma < 1 ? 1 : luma > 255 ? 255 : luma;
+        quant[1][i] = chroma < 1 ? 1 : chroma > 255 ? 255 : chroma;
+    }
+    buildCodes(dcLumaBits, dcValues, dc[0]);
+    buildCodes(dcChromaBits, dcValues, dc[1]);
+    buildCodes(acLumaBits, acLumaValues, ac[0]);
+    buildCodes(acChromaBits, acChromaValues, ac[1]);
+    initDctBasis();
+}
+
+void JpegEncoder::writeHuffmanTable(uint8_t id, const uint8_t* bits, const uint8_t* values, int count) {
+    marker(0xC4);
+    word(3 + 16 + count);
+    out.push_back(id);
+    out.insert(out.end(), bits, bits + 16);
+    out.insert(out.end(), values, values + count);
+}
+
+void JpegEncoder::putBits(uint32_t value, int length) {
+    bitBuffer = bitBuffer << length | (value & ((1u << length) - 1));
+    bitCount += length;
+    while (bitCount >= 8) {
+        uint8_t byte = bitBuffer >> (bitCount - 8);
+        out.push_back(byte);
+        if (byte == 0xFF) {
+            out.push_back(0x00);
+        }
+        bitCount -= 8;
+    }
+}
+
+void JpegEncoder::flushBits() {
+    if (bitCount > 0) {
+        putBits(0x7F, 8 - bitCount);    // Padded with ones
+    }
+}
+
+static int magnitudeBits(int value) {
+    int magnitude = value < 0 ? -value : value;
+    int bits = 0;
+    while (magnitude) {
+        bits++;
+        magnitude >>= 1;
+    }
+    return bits;
+}
+
+void JpegEncoder::encodeBlock(const float* samples, int table, int& predictor) {
+    float rows[64];
+    for (int y = 0; y < 8; y++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0.0f;
+            for (int x = 0; x < 8; x++) {
+                sum += samples[y * 8 + x] * dctBasis[u][x];
+            }
+            rows[y * 8 + u] = sum;
+        }
+    }
+    int coefficients[64];
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+            float sum = 0.0f;
+            for (int y = 0; y < 8; y++) {
+                sum += rows[y * 8 + u] * dctBasis[v][y];
+            }
+            coefficients[v * 8 + u] = lroundf(sum / quant[table][v * 8 + u]);
+        }
+    }
+
+    int diff = coefficients[0] - predictor;
+    predictor = coefficients[0];
+    int bits = magnitudeBits(diff);
+    putBits(dc[table][bits].code, dc[table][bits].length);
+    if (bits) {
+        putBits(diff < 0 ? diff - 1 : diff, bits);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int value = coefficients[zigzag[k]];
+        if (value == 0) {
+            run++;
+            continue;
+        }
+        while (run >= 16) {
+            putBits(ac[table][0xF0].code, ac[table][0xF0].length);
+            run -= 16;
+        }
+        bits = magnitudeBits(value);
+        const HuffmanCode& code = ac[table][run << 4 | bits];
+        putBits(code.code, code.length);
+        putBits(value < 0 ? value - 1 : value, bits);
+        run = 0;
+    }
+    if (run) {
+        putBits(ac[table][0x00].code, ac[table][0x00].length);
+    }
+}
+
+// Baseline, Annex K Huffman tables; 4:2:0 in color
+void JpegEncoder::encode(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, int width, int height) {
+    out.clear();
+    out.reserve((size_t)width * height / 4 + 1024);
+    marker(0xD8);
+
+    // JFIF APP0
+    static const uint8_t jfif[] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+    marker(0xE0);
+    word(2 + sizeof(jfif));
+    out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+    int tables = color ? 2 : 1;
+    for (int t = 0; t < tables; t++) {
+        marker(0xDB);
+        word(2 + 65);
+        out.push_back(t);
+        for (int k = 0; k < 64; k++) {
+            out.push_back(quant[t][zigzag[k]]);
+        }
+    }
+
+    int components = color ? 3 : 1;
+    marker(0xC0);
+    word(8 + 3 * components);
+    out.push_back(8);
+    word(height);
+    word(width);
+    out.push_back(components);
+    for (int c = 0; c < components; c++) {
+        out.push_back(c + 1);
+        out.push_back(c == 0 && color ? 0x22 : 0x11);
+        out.push_back(c == 0 ? 0 : 1);
+    }
+
+    writeHuffmanTable(0x00, dcLumaBits, dcValues, 12);
+    writeHuffmanTable(0x10, acLumaBits, acLumaValues, 162);
+    if (color) {
+        writeHuffmanTable(0x01, dcChromaBits, dcValues, 12);
+        writeHuffmanTable(0x11, acChromaBits, acChromaValues, 162);
+    }
+
+    marker(0xDA);
+    word(6 + 2 * components);
+    out.push_back(components);
+    for (int c = 0; c < components; c++) {
+        out.push_back(c + 1);
+        out.push_back(c == 0 ? 0x00 : 0x11);
+    }
+    out.push_back(0);
+    out.push_back(63);
+    out.push_back(0);
+
+    int mcuSize = color ? 16 : 8;
+    int predictors[3] = {0, 0, 0};
+    float block[64];
+    auto sample = [&](const uint8_t* plane, int px, int py) {
+        px = px < width ? px : width - 1;
+        py = py < height ? py : height - 1;
+        return plane[py * width + px];
+    };
+
+    for (int my = 0; my < height; my += mcuSize) {
+        for (int mx = 0; mx < width; mx += mcuSize) {
+            for (int b = 0; b < (color ? 4 : 1); b++) {
+                int bx = mx + (b & 1) * 8;
+                int by = my + (b >> 1) * 8;
+                for (int i = 0; i < 64; i++) {
+                    block[i] = sample(y, bx + i % 8, by + i / 8) - 128.0f;
+                }
+                encodeBlock(block, 0, predictors[0]);
+            }
+            if (!color) {
+                continue;
+            }
+            const uint8_t* planes[2] = {cb, cr};
+            for (int c = 0; c < 2; c++) {
+                // Each chroma sample the mean of a 2x2
+                for (int i = 0; i < 64; i++) {
+                    int px = mx + (i % 8) * 2;
+                    int py = my + (i / 8) * 2;
+                    int sum = sample(planes[c], px, py) + sample(planes[c], px + 1, py) +
+                              sample(planes[c], px, py + 1) + sample(planes[c], px + 1, py + 1);
+                    block[i] = sum * 0.25f - 128.0f;
+                }
+                encodeBlock(block, 1, predictors[c + 1]);
+            }
+        }
+    }
+    flushBits();
+    marker(0xD9);
+}
+
+static uint8_t clampByte(float value) {
+    return value < 0.0f ? 0 : value > 255.0f ? 255 : (uint8_t)lroundf(value);
+}
+
+static void rgbToYcc(float r, float g, float b, uint8_t& y, uint8_t& cb, uint8_t& cr) {
+    y = clampByte(0.299f * r + 0.587f * g + 0.114f * b);
+    cb = clampByte(-0.168736f * r - 0.331264f * g + 0.5f * b + 128.0f);
+    cr = clampByte(0.5f * r - 0.418688f * g - 0.081312f * b + 128.0f);
+}
+
+// Source pixels to planes; false for a format the encoder doesn't take
+static bool toPlanes(const uint8_t* src, size_t srcLength, int width, int height, pixformat_t format,
+                     std::vector<uint8_t>& y, std::vector<uint8_t>& cb, std::vector<uint8_t>& cr) {
+    size_t pixels = (size_t)width * height;
+    size_t bytesPerPixel = format == PIXFORMAT_GRAYSCALE ? 1 : format == PIXFORMAT_RGB888 ? 3 : 2;
+    if (!src || srcLength < pixels * bytesPerPixel ||
+        (format != PIXFORMAT_GRAYSCALE && format != PIXFORMAT_RGB565 && format != PIXFORMAT_RGB888)) {
+        return false;
+    }
+    y.resize(pixels);
+    if (format == PIXFORMAT_GRAYSCALE) {
+        memcpy(y.data(), src, pixels);
+        return true;
+    }
+    cb.resize(pixels);
+    cr.resize(pixels);
+    for (size_t i = 0; i < pixels; i++) {
+        float r;
+        float g;
+        float b;
+        if (format == PIXFORMAT_RGB565) {
+            // Big endian, as the camera and jpg2rgb565() write it
+            uint16_t pixel = src[2 * i] << 8 | src[2 * i + 1];
+            r = ((pixel >> 11) & 0x1F) * 255.0f / 31.0f;
+            g = ((pixel >> 5) & 0x3F) * 255.0f / 63.0f;
+            b = (pixel & 0x1F) * 255.0f / 31.0f;
+        } else {
+            // esp32-camera's RGB888 is BGR in memory
+            b = src[3 * i];
+            g = src[3 * i + 1];
+            r = src[3 * i + 2];
+        }
+        rgbToYcc(r, g, b, y[i], cb[i], cr[i]);
+    }
+    return true;
+}
+
+bool fmt2jpg_cb(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+                jpg_out_cb cb, void* arg) {
+    sim::SimCall call;
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> cbPlane;
+    std::vector<uint8_t> crPlane;
+    if (!cb || width == 0 || height == 0 || !toPlanes(src, src_len, width, height, format, y, cbPlane, crPlane)) {
+        return false;
+    }
+    JpegEncoder encoder(quality, format != PIXFORMAT_GRAYSCALE);
+    encoder.encode(y.data(), cbPlane.data(), crPlane.data(), width, height);
+    computeBusy(CAMERA_ENCODE_US_PER_PIXEL * width * height);
+
+    // In the encoder's output chunks; a short write aborts
+    const size_t chunk = 1024;
+    for (size_t index = 0; index < encoder.out.size(); index += chunk) {
+        size_t length = std::min(chunk, encoder.out.size() - index);
+        if (cb(arg, index, &encoder.out[index], length) != length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool fmt2jpg(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+             uint8_t** out, size_t* out_len) {
+    sim::SimCall call;
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> cbPlane;
+    std::vector<uint8_t> crPlane;
+    if (!out || !out_len || width == 0 || height == 0 ||
+        !toPlanes(src, src_len, width, height, format, y, cbPlane, crPlane)) {
+        return false;
+    }
+    JpegEncoder encoder(quality, format != PIXFORMAT_GRAYSCALE);
+    encoder.encode(y.data(), cbPlane.data(), crPlane.data(), width, height);
+    computeBusy(CAMERA_ENCODE_US_PER_PIXEL * width * height);
+
+    // The caller frees it
+    *out = (uint8_t*)malloc(encoder.out.size());
+    if (!*out) {
+        return false;
+    }
+    memcpy(*out, encoder.out.data(), encoder.out.size());
+    *out_len = encoder.out.size();
+    return true;
+}
+
+// ===========================
+// Decoder
+// ===========================
+
+struct HuffmanTable {
+    bool present;
+    int32_t maxCode[18];
+    int32_t valuePointer[17];
+    int32_t minCode[17];
+    uint8_t values[256];
+};
+
+struct DecodeComponent {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t quant;
+    uint8_t dcTable;
+    uint8_t acTable;
+    int predictor;
+    int planeWidth;             // Block-aligned samples at the component's own resolution
+    int planeHeight;
+    std::vector<uint8_t> plane;
+};
+
+class JpegDecoder {
+public:
+    // False on anything but an 8-bit baseline frame of 1 or 3 components
+    bool decode(const uint8_t* data, size_t length, bool dcOnly);
+
+    int width = 0;
+    int height = 0;
+    int componentCount = 0;
+    int hMax = 1;
+    int vMax = 1;
+    DecodeComponent components[3];
+
+private:
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    size_t position = 0;
+    uint16_t quant[4][64];
+    HuffmanTable dc[4];
+    HuffmanTable ac[4];
+    uint16_t restartInterval = 0;
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    bool hitMarker = false;
+
+    bool readSegments(bool dcOnly);
+    bool defineHuffman(const uint8_t* segment, size_t size);
+    bool decodeScan(bool dcOnly);
+    int readBit();
+    int receive(int bits);
+    int decodeHuffman(const HuffmanTable& table);
+    bool decodeBlock(DecodeComponent& component, int bx, int by, bool dcOnly);
+    void resetBits() { bitBuffer = 0; bitCount = 0; hitMarker = false; }
+};
+
+int JpegDecoder::readBit() {
+    if (bitCount == 0) {
+        uint8_t byte = 0;
+        if (!hitMarker && position < length) {
+            byte = data[position];
+            if (byte == 0xFF) {
+                uint8_t next = position + 1 < length ? data[position + 1] : 0xD9;
+                if (next == 0x00) {
+                    position += 2;
+                } else {
+                    hitMarker = true;    // Zeros from here to the marker
+                    byte = 0;
+                }
+            } else {
+                position++;
+            }
+        }
+        bitBuffer = byte;
+        bitCount = 8;
+    }
+    bitCount--;
+    return (bitBuffer >> bitCount) & 1;
+}
+
+int JpegDecoder::receive(int bits) {
+    int value = 0;
+    for (int i = 0; i < bits; i++) {
+        value = value << 1 | readBit();
+    }
+    return value;
+}
+
+// Annex F.2.2.3
+int JpegDecoder::decodeHuffman(const HuffmanTable& table) {
+    int32_t code = readBit();
+    for (int length = 1; length <= 16; length++) {
+        if (code <= table.maxCode[length]) {
+            return table.values[table.valuePointer[length] + code - table.minCode[length]];
+        }
+        code = code << 1 | readBit();
+    }
+    return -1;
+}
+
+static int extend(int value, int bits) {
+    return bits && value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+}
+
+bool JpegDecoder::decodeBlock(DecodeComponent& component, int bx, int by, bool dcOnly) {
+    int coefficients[64] = {};
+    int bits = decodeHuffman(dc[component.dcTable]);
+    if (bits < 0 || bits > 11) {
+        return false;
+    }
+    component.predictor += extend(receive(bits), bits);
+    coefficients[0] = component.predictor * quant[component.quant][0];
+
+    for (int k = 1; k < 64;) {
+        int symbol = decodeHuffman(ac[component.acTable]);
+        if (symbol < 0) {
+            return false;
+        }
+        int run = symbol >> 4;
+        int size = symbol & 0x0F;
+        if (size == 0) {
+            if (run != 15) {
+                break;  // EOB
+            }
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63) {
+            return false;
+        }
+        // Huffman-decoded either way; the 1/8 path only skips the transform
+        coefficients[zigzag[k]] = extend(receive(size), size) * quant[component.quant][k];
+        k++;
+    }
+
+    uint8_t* out = &component.plane[(size_t)by * 8 * component.planeWidth + bx * 8];
+    if (dcOnly) {
+        uint8_t value = clampByte(coefficients[0] / 8.0f + 128.0f);
+        for (int y = 0; y < 8; y++) {
+            memset(&out[y * component.planeWidth], value, 8);
+        }
+        return true;
+    }
+
+    float rows[64];
+    for (int v = 0; v < 8; v++) {
+        for (int x = 0; x < 8; x++) {
+            float sum = 0.0f;
+            for (int u = 0; u < 8; u++) {
+                sum += coefficients[v * 8 + u] * dctBasis[u][x];
+            }
+            rows[v * 8 + x] = sum;
+        }
+    }
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            float sum = 0.0f;
+            for (int v = 0; v < 8; v++) {
+                sum += rows[v * 8 + x] * dctBasis[v][y];
+            }
+            out[y * component.planeWidth + x] = clampByte(sum + 128.0f);
+        }
+    }
+    return true;
+}
+
+bool JpegDecoder::defineHuffman(const uint8_t* segment, size_t size) {
+    size_t at = 0;
+    while (at + 17 <= size) {
+        uint8_t tableClass = segment[at] >> 4;
+        uint8_t id = segment[at] & 0x0F;
+        if (tableClass > 1 || id > 3) {
+            return false;
+        }
+        HuffmanTable& table = tableClass ? ac[id] : dc[id];
+        const uint8_t* bits = &segment[at + 1];
+        int count = 0;
+        for (int i = 0; i < 16; i++) {
+            count += bits[i];
+        }
+        if (count > 256 || at + 17 + count > size) {
+            return false;
+        }
+        memcpy(table.values, &segment[at + 17], count);
+
+        int32_t code = 0;
+        int k = 0;
+        for (int length = 1; length <= 16; length++) {
+            table.valuePointer[length] = k;
+            table.minCode[length] = code;
+            code += bits[length - 1];
+            k += bits[length - 1];
+            table.maxCode[length] = bits[length - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+        table.maxCode[17] = INT32_MAX;
+        table.present = true;
+        at += 17 + count;
+    }
+    return at == size;
+}
+
+bool JpegDecoder::readSegments(bool dcOnly) {
+    if (length < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return false;
+    }
+    position = 2;
+    bool frame = false;
+    while (position + 4 <= length) {
+        if (data[position] != 0xFF) {
+            return false;
+        }
+        uint8_t code = data[position + 1];
+        if (code == 0xFF) {
+            position++;     // Fill byte
+            continue;
+        }
+        size_t size = data[position + 2] << 8 | data[position + 3];
+        const uint8_t* segment = &data[position + 4];
+        if (size < 2 || position + 2 + size > length) {
+            return false;
+        }
+        size -= 2;
+        position += 4 + size;
+
+        if (code == 0xC0 || code == 0xC1) {
+            if (size < 6 || segment[0] != 8) {
+                return false;
+            }
+            height = segment[1] << 8 | segment[2];
+            width = segment[3] << 8 | segment[4];
+            componentCount = segment[5];
+            if ((componentCount != 1 && componentCount != 3) || size < 6u + 3 * componentCount || !width ||
+                !height) {
+                return false;
+            }
+            hMax = 1;
+            vMax = 1;
+            for (int c = 0; c < componentCount; c++) {
+                DecodeComponent& component = components[c];
+                component.id = segment[6 + 3 * c];
+                component.h = segment[7 + 3 * c] >> 4;
+                component.v = segment[7 + 3 * c] & 0x0F;
+                component.quant = segment[8 + 3 * c] & 0x03;
+                if (component.h < 1 || component.h > 2 || component.v < 1 || component.v > 2) {
+                    return false;
+                }
+                hMax = std::max<int>(hMax, component.h);
+                vMax = std::max<int>(vMax, component.v);
+            }
+            frame = true;
+        } else if (code >= 0xC2 && code <= 0xCF && code != 0xC4 && code != 0xC8 && code != 0xCC) {
+            return false;   // Progressive, lossless, arithmetic
+        } else if (code == 0xC4) {
+            if (!defineHuffman(segment, size)) {
+                return false;
+            }
+        } else if (code == 0xDB) {
+            size_t at = 0;
+            while (at < size) {
+                bool wide = segment[at] >> 4;
+                uint8_t id = segment[at] & 0x03;
+                if (at + 1 + (wide ? 128 : 64) > size) {
+                    return false;
+                }
+                for (int k = 0; k < 64; k++) {
+                    quant[id][k] = wide ? segment[at + 1 + 2 * k] << 8 | segment[at + 2 + 2 * k]
+                                        : segment[at + 1 + k];
+                }
+                at += 1 + (wide ? 128 : 64);
+            }
+        } else if (code == 0xDD) {
+            if (size < 2) {
+                return false;
+            }
+            restartInterval = segment[0] << 8 | segment[1];
+        } else if (code == 0xDA) {
+            if (!frame || size < 1 || segment[0] != componentCount || size < 4u + 2 * componentCount) {
+                return false;   // One interleaved scan only
+            }
+            for (int c = 0; c < componentCount; c++) {
+                uint8_t tables = segment[2 + 2 * c];
+                components[c].dcTable = tables >> 4 & 0x03;
+                components[c].acTable = tables & 0x03;
+                if (!dc[components[c].dcTable].present || !ac[components[c].acTable].present) {
+                    return false;
+                }
+            }
+            return decodeScan(dcOnly);
+        } else if (code == 0xD9) {
+            return false;
+        }
+        // APPn, COM and the rest are skipped
+    }
+    return false;
+}
+
+bool JpegDecoder::decodeScan(bool dcOnly) {
+    int mcuColumns = (width + 8 * hMax - 1) / (8 * hMax);
+    int mcuRows = (height + 8 * vMax - 1) / (8 * vMax);
+    for (int c = 0; c < componentCount; c++) {
+        DecodeComponent& component = components[c];
+        component.planeWidth = mcuColumns * component.h * 8;
+        component.planeHeight = mcuRows * component.v * 8;
+        component.plane.assign((size_t)component.planeWidth * component.planeHeight, 128);
+        component.predictor = 0;
+    }
+    resetBits();
+
+    int mcus = mcuColumns * mcuRows;
+    for (int m = 0; m < mcus; m++) {
+        if (restartInterval && m > 0 && m % restartInterval == 0) {
+            // Byte-align, then expect RSTn
+            resetBits();
+            if (position + 1 < length && data[position] == 0xFF && (data[position + 1] & 0xF8) == 0xD0) {
+                position += 2;
+            }
+            for (int c = 0; c < componentCount; c++) {
+                components[c].predictor = 0;
+            }
+        }
+        int mx = m % mcuColumns;
+        int my = m / mcuColumns;
+        for (int c = 0; c < componentCount; c++) {
+            DecodeComponent& component = components[c];
+            for (int by = 0; by < component.v; by++) {
+                for (int bx = 0; bx < component.h; bx++) {
+                    if (!decodeBlock(component, mx * component.h + bx, my * component.v + by, dcOnly)) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool JpegDecoder::decode(const uint8_t* data, size_t length, bool dcOnly) {
+    this->data = data;
+    this->length = length;
+    restartInterval = 0;
+    for (int i = 0; i < 4; i++) {
+        dc[i].present = false;
+        ac[i].present = false;
+    }
+    initDctBasis();
+    return data && readSegments(dcOnly);
+}
+
+// Big-endian RGB565, a box average over each scale x scale; 1/8 is a
+// block's DC alone, as the ROM decoder's
+bool jpg2rgb565(const uint8_t* src, size_t src_len, uint8_t* out, jpg_scale_t scale) {
+    sim::SimCall call;
+    JpegDecoder decoder;
+    bool dcOnly = scale == JPG_SCALE_8X;
+    if (!out || !decoder.decode(src, src_len, dcOnly)) {
+        return false;
+    }
+    int step = 1 << scale;
+    int outWidth = decoder.width >> scale;
+    int outHeight = decoder.height >> scale;
+    computeBusy((dcOnly ? CAMERA_DECODE_DC_US_PER_PIXEL : CAMERA_DECODE_US_PER_PIXEL) * decoder.width *
+                decoder.height);
+
+    for (int oy = 0; oy < outHeight; oy++) {
+        for (int ox = 0; ox < outWidth; ox++) {
+            float sums[3] = {0.0f, 128.0f * step * step, 128.0f * step * step};
+            for (int c = 0; c < decoder.componentCount; c++) {
+                const DecodeComponent& component = decoder.components[c];
+                float sum = 0.0f;
+                for (int dy = 0; dy < step; dy++) {
+                    int sy = (oy * step + dy) * component.v / decoder.vMax;
+                    const uint8_t* row = &component.plane[(size_t)sy * component.planeWidth];
+                    for (int dx = 0; dx < step; dx++) {
+                        sum += row[(ox * step + dx) * component.h / decoder.hMax];
+                    }
+                }
+                sums[c] = sum;
+            }
+            float y = sums[0] / (step * step);
+            float cb = sums[1] / (step * step) - 128.0f;
+            float cr = sums[2] / (step * step) - 128.0f;
+            uint8_t r = clampByte(y + 1.402f * cr);
+            uint8_t g = clampByte(y - 0.344136f * cb - 0.714136f * cr);
+            uint8_t b = clampByte(y + 1.772f * cb);
+            uint16_t pixel = (r >> 3) << 11 | (g >> 2) << 5 | (b >> 3);
+            out[2 * ((size_t)oy * outWidth + ox)] = pixel >> 8;
+            out[2 * ((size_t)oy * outWidth + ox) + 1] = pixel & 0xFF;
+        }
+    }
+    return true;
+}
+
+// ===========================
+// Scene
+// ===========================
+
+static uint32_t hash3(int32_t x, int32_t y, int32_t z) {
+    uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u + (uint32_t)z * 2147483647u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+}
+
+static float lattice(int32_t x, int32_t y, int32_t seed) {
+    return (hash3(x, y, seed) & 0xFFFF) / 65535.0f;
+}
+
+// Smooth value noise in 0-1
+static float valueNoise(float x, float y, int32_t seed) {
+    float fx = floorf(x);
+    float fy = floorf(y);
+    int32_t ix = (int32_t)fx;
+    int32_t iy = (int32_t)fy;
+    float tx = x - fx;
+    float ty = y - fy;
+    tx = tx * tx * (3.0f - 2.0f * tx);
+    ty = ty * ty * (3.0f - 2.0f * ty);
+    float top = lattice(ix, iy, seed) + (lattice(ix + 1, iy, seed) - lattice(ix, iy, seed)) * tx;
+    float bottom = lattice(ix, iy + 1, seed) + (lattice(ix + 1, iy + 1, seed) - lattice(ix, iy + 1, seed)) * tx;
+    return top + (bottom - top) * ty;
+}
+
+static float fractalNoise(float x, float y, int32_t seed, int octaves) {
+    float sum = 0.0f;
+    float amplitude = 0.5f;
+    for (int i = 0; i < octaves; i++) {
+        sum += valueNoise(x, y, seed + i) * amplitude;
+        x *= 2.03f;
+        y *= 2.03f;
+        amplitude *= 0.5f;
+    }
+    return sum;
+}
+
+// The payload swings under the balloon and turns on its line; the camera
+// looks out sideways, the horizon dipping with height. Radiance is linear,
+// about 0.2 for mid-grey sky at the sensor's default exposure
+static void renderScene(uint64_t us, int width, int height, uint32_t frame, std::vector<uint8_t>& y,
+                        std::vector<uint8_t>& cb, std::vector<uint8_t>& cr, float exposure, float brightness,
+                        float contrast) {
+    sim::FlightState state = sim::flightAt(us);
+    float t = us / 1e6f;
+    float altitude = std::max(state.altitude, 0.0f);
+    bool airborne = strcmp(sim::flightPhaseAt(us), "ascent") == 0 || strcmp(sim::flightPhaseAt(us), "descent") == 0;
+
+    float swing = airborne ? 0.12f * sinf(t * 2.0f * (float)M_PI / 3.7f) : 0.0f;          // Roll, rad
+    float pitch = airborne ? 0.08f * sinf(t * 2.0f * (float)M_PI / 5.3f + 1.0f) : 0.0f;
+    float yaw = airborne ? t * 2.0f * (float)M_PI / 40.0f : 0.3f;
+    float dip = sqrtf(2.0f * altitude / 6371000.0f);                                      // Horizon dip, rad
+    float fieldOfView = 1.1f;                                                             // Horizontal, rad
+    float perPixel = fieldOfView / width;
+
+    // Thinner air: a darker sky overhead, a brighter sun on the cloud tops
+    float thin = std::min(altitude / 30000.0f, 1.0f);
+    float skyHigh[3] = {0.05f * (1.0f - thin) + 0.005f, 0.10f * (1.0f - thin) + 0.008f, 0.35f * (1.0f - thin) + 0.03f};
+    float skyLow[3] = {0.30f, 0.36f, 0.45f};
+    float sun = 1.0f + 0.6f * thin;
+
+    // Terrain scrolls under the flight; clouds drift with the wind at their own height
+    float groundX = (float)(state.longitude * 2000.0);
+    float groundY = (float)(state.latitude * 2000.0);
+    float cloudShift = t * 0.002f;
+    float cosSwing = cosf(swing);
+    float sinSwing = sinf(swing);
+
+    size_t pixels = (size_t)width * height;
+    y.resize(pixels);
+    cb.resize(pixels);
+    cr.resize(pixels);
+    for (int py = 0; py < height; py++) {
+        for (int px = 0; px < width; px++) {
+            float cx = (px - width * 0.5f) * perPixel;
+            float cy = (py - height * 0.5f) * perPixel;
+            // Elevation above the view axis, rolled
+            float azimuth = yaw + cx * cosSwing - cy * sinSwing;
+            float elevation = -(cx * sinSwing + cy * cosSwing) + pitch;
+            float below = -dip - elevation;     // Angle under the horizon
+
+            float rgb[3];
+            if (below <= 0.0f) {
+                float up = std::min(-below / 0.8f, 1.0f);
+                for (int c = 0; c < 3; c++) {
+                    rgb[c] = skyLow[c] + (skyHigh[c] - skyLow[c]) * sqrtf(up);
+                }
+                if (altitude < 9000.0f) {
+                    // Cloud above the payload, fading as it climbs through
+                    float cover = fractalNoise(azimuth * 3.0f + cloudShift, elevation * 12.0f, 11, 3);
+                    float amount = std::max(0.0f, cover - 0.55f) * 2.5f * (1.0f - altitude / 9000.0f);
+                    for (int c = 0; c < 3; c++) {
+                        rgb[c] += (0.75f - rgb[c]) * std::min(amount, 1.0f);
+                    }
+                }
+            } else {
+                // Ground distance along the line of sight, flattened near the horizon
+                float range = altitude > 1.0f ? std::min(altitude / std::max(below, 0.002f), 400000.0f)
+                                              : 50.0f / std::max(below, 0.01f);
+                float gx = groundX + sinf(azimuth) * range * 0.001f;
+                float gy = groundY + cosf(azimuth) * range * 0.001f;
+                float land = fractalNoise(gx * 0.5f, gy * 0.5f, 3, 4);
+                float field = valueNoise(gx * 6.0f, gy * 6.0f, 7);
+                rgb[0] = 0.08f + 0.10f * land + 0.05f * field;
+                rgb[1] = 0.12f + 0.10f * land + 0.04f * field;
+                rgb[2] = 0.06f + 0.05f * land;
+
+                float cloud = fractalNoise(gx * 0.15f + cloudShift, gy * 0.15f, 21, 4);
+                float amount = std::min(std::max(0.0f, cloud - 0.5f) * 4.0f, 1.0f);
+                for (int c = 0; c < 3; c++) {
+                    rgb[c] += (0.8f * sun - rgb[c]) * amount;
+                }
+                // Haze toward the horizon
+                float haze = expf(-below * 40.0f) * (0.4f + 0.6f * (1.0f - thin));
+                for (int c = 0; c < 3; c++) {
+                    rgb[c] += (skyLow[c] - rgb[c]) * haze;
+                }
+            }
+
+            // Exposure, the sensor's gamma, then its brightness and contrast
+            float grain = ((hash3(px, py, frame) & 0xFF) / 255.0f - 0.5f) * 4.0f;
+            float out[3];
+            for (int c = 0; c < 3; c++) {
+                float encoded = powf(std::min(rgb[c] * exposure, 1.0f), 1.0f / 2.2f) * 255.0f;
+                encoded = (encoded - 128.0f) * contrast + 128.0f + brightness + grain;
+                out[c] = encoded;
+            }
+            size_t i = (size_t)py * width + px;
+            rgbToYcc(out[0], out[1], out[2], y[i], cb[i], cr[i]);
+        }
+    }
+}
+
+// ===========================
+// Sensor
+// ===========================
+
+static struct {
+    bool initialized;
+    camera_config_t config;
+    sensor_t sensor;
+    uint8_t registers[2][256];      // DSP and sensor banks, 0xFF selecting
+    camera_fb_t* buffers;
+    bool* held;
+    size_t capacity;                // Per buffer
+    uint32_t frames;
+} camera;
+
+#define OV2640_BANK_SELECT      0xFF
+#define OV2640_COM2             0x09        // Sensor bank
+#define OV2640_COM2_STANDBY     0x10
+
+static bool inStandby() {
+    return camera.registers[1][OV2640_COM2] & OV2640_COM2_STANDBY;
+}
+
+// The sensor's quality register, 0-63 with lower finer, as an encoder quality
+static int encoderQuality(uint8_t sensorQuality) {
+    int quality = 100 - (int)lroundf(sensorQuality * 1.4f);
+    return quality < 5 ? 5 : quality > 95 ? 95 : quality;
+}
+
+static int setFramesize(sensor_t* s, framesize_t framesize) {
+    if (framesize >= FRAMESIZE_INVALID || framesize > FRAMESIZE_UXGA) {
+        return -1;
+    }
+    s->status.framesize = framesize;
+    return 0;
+}
+
+static int setQuality(sensor_t* s, int quality) {
+    if (quality < 0 || quality > 63) {
+        return -1;
+    }
+    s->status.quality = quality;
+    return 0;
+}
+
+#define SENSOR_LEVEL_SETTER(name, field)                \
+    static int name(sensor_t* s, int level) {           \
+        if (level < -2 || level > 2) {                  \
+            return -1;                                  \
+        }                                               \
+        s->status.field = level;                        \
+        return 0;                                       \
+    }
+
+SENSOR_LEVEL_SETTER(setContrast, contrast)
+SENSOR_LEVEL_SETTER(setBrightness, brightness)
+SENSOR_LEVEL_SETTER(setSaturation, saturation)
+SENSOR_LEVEL_SETTER(setSharpness, sharpness)
+SENSOR_LEVEL_SETTER(setAeLevel, ae_level)
+
+#define SENSOR_FLAG_SETTER(name, field)                 \
+    static int name(sensor_t* s, int value) {           \
+        s->status.field = value;                        \
+        return 0;                                       \
+    }
+
+SENSOR_FLAG_SETTER(setDenoise, denoise)
+SENSOR_FLAG_SETTER(setColorbar, colorbar)
+SENSOR_FLAG_SETTER(setWhitebal, awb)
+SENSOR_FLAG_SETTER(setGainCtrl, agc)
+SENSOR_FLAG_SETTER(setExposureCtrl, aec)
+SENSOR_FLAG_SETTER(setHmirror, hmirror)
+SENSOR_FLAG_SETTER(setVflip, vflip)
+SENSOR_FLAG_SETTER(setAec2, aec2)
+SENSOR_FLAG_SETTER(setAwbGain, awb_gain)
+SENSOR_FLAG_SETTER(setSpecialEffect, special_effect)
+SENSOR_FLAG_SETTER(setWbMode, wb_mode)
+SENSOR_FLAG_SETTER(setDcw, dcw)
+SENSOR_FLAG_SETTER(setBpc, bpc)
+SENSOR_FLAG_SETTER(setWpc, wpc)
+SENSOR_FLAG_SETTER(setRawGma, raw_gma)
+SENSOR_FLAG_SETTER(setLenc, lenc)
+
+static int setAgcGain(sensor_t* s, int gain) {
+    if (gain < 0 || gain > 30) {
+        return -1;
+    }
+    s->status.agc_gain = gain;
+    return 0;
+}
+
+static int setAecValue(sensor_t* s, int value) {
+    if (value < 0 || value > 1200) {
+        return -1;
+    }
+    s->status.aec_value = value;
+    return 0;
+}
+
+static int setGainceiling(sensor_t* s, gainceiling_t gainceiling) {
+    s->status.gainceiling = gainceiling;
+    return 0;
+}
+
+static int setPixformat(sensor_t* s, pixformat_t pixformat) {
+    if (pixformat != PIXFORMAT_JPEG) {
+        return -1;      // The simulated sensor only encodes
+    }
+    s->pixformat = pixformat;
+    return 0;
+}
+
+static int initStatus(sensor_t* s) {
+    return 0;
+}
+
+static int resetSensor(sensor_t* s) {
+    memset(camera.registers, 0, sizeof(camera.registers));
+    return 0;
+}
+
+// Bit 8 of reg picks the sensor bank, as the OV2640 driver's
+static int getReg(sensor_t* s, int reg, int mask) {
+    if (reg == OV2640_BANK_SELECT) {
+        return camera.registers[0][OV2640_BANK_SELECT] & mask;
+    }
+    return camera.registers[(reg >> 8) & 1][reg & 0xFF] & mask;
+}
+
+static int setReg(sensor_t* s, int reg, int mask, int value) {
+    if (reg > 0x1FF) {
+        return -1;
+    }
+    uint8_t& target = reg == OV2640_BANK_SELECT ? camera.registers[0][OV2640_BANK_SELECT]
+                                                : camera.registers[(reg >> 8) & 1][reg & 0xFF];
+    target = (target & ~mask) | (value & mask);
+    return 0;
+}
+
+static int setResRaw(sensor_t* s, int startX, int startY, int endX, int endY, int offsetX, int offsetY,
+                     int totalX, int totalY, int outputX, int outputY, bool scale, bool binning) {
+    return 0;
+}
+
+static int setPll(sensor_t* s, int bypass, int mul, int sys, int root, int pre, int seld5, int pclken, int pclk) {
+    return 0;
+}
+
+static int setXclk(sensor_t* s, int timer, int xclk) {
+    s->xclk_freq_hz = xclk * 1000000;
+    return 0;
+}
+
+static void initSensor(const camera_config_t* config) {
+    sensor_t& s = camera.sensor;
+    memset(&s, 0, sizeof(s));
+    s.id.MIDH = 0x7F;
+    s.id.MIDL = 0xA2;
+    s.id.PID = OV2640_PID;
+    s.id.VER = 0x42;
+    s.slv_addr = OV2640_SCCB_ADDR;
+    s.pixformat = config->pixel_format;
+    s.xclk_freq_hz = config->xclk_freq_hz;
+    s.status.framesize = config->frame_size;
+    s.status.quality = config->jpeg_quality;
+    s.status.aec = 1;
+    s.status.agc = 1;
+    s.status.awb = 1;
+    s.status.aec_value = 300;
+
+    s.init_status = initStatus;
+    s.reset = resetSensor;
+    s.set_pixformat = setPixformat;
+    s.set_framesize = setFramesize;
+    s.set_contrast = setContrast;
+    s.set_brightness = setBrightness;
+    s.set_saturation = setSaturation;
+    s.set_sharpness = setSharpness;
+    s.set_denoise = setDenoise;
+    s.set_gainceiling = setGainceiling;
+    s.set_quality = setQuality;
+    s.set_colorbar = setColorbar;
+    s.set_whitebal = setWhitebal;
+    s.set_gain_ctrl = setGainCtrl;
+    s.set_exposure_ctrl = setExposureCtrl;
+    s.set_hmirror = setHmirror;
+    s.set_vflip = setVflip;
+    s.set_aec2 = setAec2;
+    s.set_awb_gain = setAwbGain;
+    s.set_agc_gain = setAgcGain;
+    s.set_aec_value = setAecValue;
+    s.set_special_effect = setSpecialEffect;
+    s.set_wb_mode = setWbMode;
+    s.set_ae_level = setAeLevel;
+    s.set_dcw = setDcw;
+    s.set_bpc = setBpc;
+    s.set_wpc = setWpc;
+    s.set_raw_gma = setRawGma;
+    s.set_lenc = setLenc;
+    s.get_reg = getReg;
+    s.set_reg = setReg;
+    s.set_res_raw = setResRaw;
+    s.set_pll = setPll;
+    s.set_xclk = setXclk;
+    memset(camera.registers, 0, sizeof(camera.registers));
+}
+
+// ===========================
+// Driver
+// ===========================
+
+esp_err_t esp_camera_init(const camera_config_t* config) {
+    sim::SimCall call;
+    if (camera.initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!config || config->pixel_format != PIXFORMAT_JPEG || config->frame_size >= FRAMESIZE_INVALID ||
+        config->fb_count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim::sleep(CAMERA_INIT_US);
+
+    camera.config = *config;
+    const resolution_info_t& largest = resolution[config->frame_size];
+    camera.capacity = (size_t)largest.width * largest.height / 5;
+    uint32_t caps = config->fb_location == CAMERA_FB_IN_PSRAM ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL;
+    camera.buffers = (camera_fb_t*)calloc(config->fb_count, sizeof(camera_fb_t));
+    camera.held = (bool*)calloc(config->fb_count, sizeof(bool));
+    for (size_t i = 0; i < config->fb_count; i++) {
+        camera.buffers[i].buf = (uint8_t*)heap_caps_malloc(camera.capacity, caps | MALLOC_CAP_8BIT);
+        if (!camera.buffers[i].buf) {
+            fprintf(stderr, "sim_camera: frame buffer %u of %u bytes failed\n", (unsigned)i, (unsigned)camera.capacity);
+            for (size_t j = 0; j < i; j++) {
+                heap_caps_free(camera.buffers[j].buf);
+            }
+            free(camera.buffers);
+            free(camera.held);
+            camera.buffers = nullptr;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    initSensor(config);
+    camera.initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit(void) {
+    sim::SimCall call;
+    if (!camera.initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (size_t i = 0; i < camera.config.fb_count; i++) {
+        heap_caps_free(camera.buffers[i].buf);
+    }
+    free(camera.buffers);
+    free(camera.held);
+    camera.buffers = nullptr;
+    camera.held = nullptr;
+    camera.initialized = false;
+    return ESP_OK;
+}
+
+// CAMERA_GRAB_LATEST: the next frame to finish, exposed over the frame before
+camera_fb_t* esp_camera_fb_get(void) {
+    sim::SimCall call;
+    if (!camera.initialized) {
+        return nullptr;
+    }
+    size_t slot = camera.config.fb_count;
+    for (size_t i = 0; i < camera.config.fb_count; i++) {
+        if (!camera.held[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == camera.config.fb_count || inStandby()) {
+        sim::sleep(CAMERA_FB_TIMEOUT_US);
+        fprintf(stderr, "sim_camera: failed to get the frame on time\n");
+        return nullptr;
+    }
+
+    const sensor_t& s = camera.sensor;
+    framesize_t size = s.status.framesize;
+    uint64_t period = size <= FRAMESIZE_SVGA ? CAMERA_FRAME_US : CAMERA_LARGE_FRAME_US;
+    uint64_t done = (sim::now() / period + 1) * period;
+    sim::sleepUntil(done);
+    uint64_t start = done - period;
+
+    // Its own AEC holds the scene near mid-grey; manual follows the registers
+    float exposure = 1.0f;
+    if (!s.status.aec) {
+        exposure = s.status.aec_value / 300.0f;
+    }
+    if (!s.status.agc) {
+        exposure *= powf(2.0f, s.status.agc_gain / 6.0f);
+    }
+    int width = resolution[size].width;
+    int height = resolution[size].height;
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> cb;
+    std::vector<uint8_t> cr;
+    renderScene(start, width, height, camera.frames++, y, cb, cr, exposure, s.status.brightness * 16.0f,
+                1.0f + s.status.contrast * 0.15f);
+    JpegEncoder encoder(encoderQuality(s.status.quality), true);
+    encoder.encode(y.data(), cb.data(), cr.data(), width, height);
+    if (encoder.out.size() > camera.capacity) {
+        fprintf(stderr, "sim_camera: JPEG of %u bytes overflows the frame buffer\n", (unsigned)encoder.out.size());
+        return nullptr;
+    }
+
+    camera_fb_t* fb = &camera.buffers[slot];
+    memcpy(fb->buf, encoder.out.data(), encoder.out.size());
+    fb->len = encoder.out.size();
+    fb->width = width;
+    fb->height = height;
+    fb->format = PIXFORMAT_JPEG;
+    fb->timestamp.tv_sec = start / 1000000;
+    fb->timestamp.tv_usec = start % 1000000;
+    camera.held[slot] = true;
+    return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t* fb) {
+    sim::SimCall call;
+    if (!camera.initialized || !fb) {
+        return;
+    }
+    for (size_t i = 0; i < camera.config.fb_count; i++) {
+        if (&camera.buffers[i] == fb) {
+            camera.held[i] = false;
+        }
+    }
+}
+
+sensor_t* esp_camera_sensor_get(void) {
+    return camera.initialized ? &camera.sensor : nullptr;
+}
+
+camera_sensor_info_t* esp_camera_sensor_get_info(sensor_id_t* id) {
+    static camera_sensor_info_t ov2640 = {CAMERA_OV2640, "OV2640", OV2640_SCCB_ADDR, OV2640_PID, FRAMESIZE_UXGA,
+                                          true};
+    return id && id->PID == OV2640_PID ? &ov2640 : nullptr;
+}
+
+// The balloon build's web UI is app_httpd.cpp, which needs the IDF's HTTP
+// server; nothing connects to the simulated access point anyway
+void startCameraServer() {
+}
+
+void stopCameraServer() {
+}
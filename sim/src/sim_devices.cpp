@@ -0,0 +1,859 @@
+#include "sim_devices.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+#include "sim_kernel.h"
+#include "driver/uart.h"
+#include "energy_ledger.h"
+#include "sensor_pins.h"
+#include "ubx_gps.h"
+
+// ===========================
+// Atmosphere
+// ===========================
+
+// ISA to 32 km: troposphere, tropopause, lower stratosphere
+struct AtmosphereLayer {
+    float base;                         // m
+    float baseTemperature;              // K
+    float lapse;                        // K/m
+    float basePressure;                 // Pa
+};
+
+static const AtmosphereLayer layers[] = {
+    {0.0f, 288.15f, -0.0065f, 101325.0f},
+    {11000.0f, 216.65f, 0.0f, 22632.1f},
+    {20000.0f, 216.65f, 0.001f, 5474.89f},
+    {32000.0f, 228.65f, 0.0028f, 868.019f},
+};
+
+static const float GAS_CONSTANT = 287.053f;     // J/(kg K), dry air
+static const float GRAVITY = 9.80665f;
+
+static void atmosphere(float altitude, float& pressure, float& temperatureK) {
+    const AtmosphereLayer* layer = &layers[0];
+    for (const AtmosphereLayer& candidate : layers) {
+        if (altitude >= candidate.base) {
+            layer = &candidate;
+        }
+    }
+    float height = altitude - layer->base;
+    temperatureK = layer->baseTemperature + layer->lapse * height;
+    if (layer->lapse == 0.0f) {
+        pressure = layer->basePressure * expf(-GRAVITY * height / (GAS_CONSTANT * layer->baseTemperature));
+    } else {
+        pressure = layer->basePressure *
+                   powf(temperatureK / layer->baseTemperature, -GRAVITY / (GAS_CONSTANT * layer->lapse));
+    }
+}
+
+static float airDensity(float altitude) {
+    float pressure;
+    float temperatureK;
+    atmosphere(altitude, pressure, temperatureK);
+    return pressure / (GAS_CONSTANT * temperatureK);
+}
+
+// ===========================
+// Flight
+// ===========================
+
+// A second at a time, interpolated between
+struct TrackPoint {
+    float altitude;
+    float verticalSpeed;
+    double latitude;
+    double longitude;
+    float windEast;
+    float windNorth;
+};
+
+static struct {
+    sim::FlightProfile profile;
+    std::vector<TrackPoint> track;
+    uint32_t launchSecond;
+    uint32_t burstSecond;
+    uint32_t landingSecond;
+    float maxAltitude;
+} flight;
+
+static const double EARTH_RADIUS = 6371000.0;
+
+// Westerlies with a jet stream at the tropopause
+static void windAt(float altitude, float& east, float& north) {
+    float jet = (altitude - 11000.0f) / 4000.0f;
+    east = 5.0f + 25.0f * expf(-jet * jet);
+    north = 2.0f * sinf(altitude / 5000.0f);
+}
+
+uint64_t sim::planFlight(const FlightProfile& profile) {
+    flight.profile = profile;
+    flight.track.clear();
+    flight.launchSecond = profile.padSeconds;
+    flight.burstSecond = 0;
+    flight.landingSecond = 0;
+    flight.maxAltitude = profile.padAltitude;
+
+    TrackPoint point = {profile.padAltitude, 0.0f, profile.latitude, profile.longitude, 0.0f, 0.0f};
+    bool ascending = true;
+    for (uint32_t second = 0;; second++) {
+        bool airborne = second >= flight.launchSecond && !flight.landingSecond;
+        if (airborne) {
+            if (ascending) {
+                point.verticalSpeed = profile.ascentRate;
+            } else {
+                // Terminal velocity goes as the root of the density
+                point.verticalSpeed = -profile.descentRate * sqrtf(airDensity(0.0f) / airDensity(point.altitude));
+            }
+            windAt(point.altitude, point.windEast, point.windNorth);
+        } else {
+            point.verticalSpeed = 0.0f;
+            point.windEast = 0.0f;
+            point.windNorth = 0.0f;
+        }
+        flight.track.push_back(point);
+        if (flight.landingSecond && second >= flight.landingSecond + profile.landedSeconds) {
+            break;
+        }
+        if (!airborne) {
+            continue;
+        }
+
+        point.altitude += point.verticalSpeed;
+        point.latitude += point.windNorth / EARTH_RADIUS * 180.0 / M_PI;
+        point.longitude += point.windEast / (EARTH_RADIUS * cos(point.latitude * M_PI / 180.0)) * 180.0 / M_PI;
+        if (ascending && point.altitude >= profile.burstAltitude) {
+            point.altitude = profile.burstAltitude;
+            ascending = false;
+            flight.burstSecond = second + 1;
+        }
+        flight.maxAltitude = std::max(flight.maxAltitude, point.altitude);
+        if (!ascending && point.altitude <= profile.padAltitude) {
+            point.altitude = profile.padAltitude;
+            flight.landingSecond = second + 1;
+        }
+    }
+    return (uint64_t)(flight.track.size() - 1) * 1000000;
+}
+
+sim::FlightState sim::flightAt(uint64_t us) {
+    FlightState state;
+    size_t second = us / 1000000;
+    float fraction = (us % 1000000) / 1e6f;
+    if (second + 1 >= flight.track.size()) {
+        second = flight.track.size() - 2;
+        fraction = 1.0f;
+    }
+    const TrackPoint& a = flight.track[second];
+    const TrackPoint& b = flight.track[second + 1];
+
+    state.altitude = a.altitude + (b.altitude - a.altitude) * fraction;
+    state.verticalSpeed = a.verticalSpeed;
+    state.latitude = a.latitude + (b.latitude - a.latitude) * fraction;
+    state.longitude = a.longitude + (b.longitude - a.longitude) * fraction;
+    state.groundSpeed = sqrtf(a.windEast * a.windEast + a.windNorth * a.windNorth);
+    state.heading = fmodf(atan2f(a.windEast, a.windNorth) * 180.0f / (float)M_PI + 360.0f, 360.0f);
+
+    float temperatureK;
+    atmosphere(state.altitude, state.pressure, temperatureK);
+    state.temperature = temperatureK - 273.15f;
+    return state;
+}
+
+const char* sim::flightPhaseAt(uint64_t us) {
+    uint32_t second = us / 1000000;
+    if (second < flight.launchSecond) {
+        return "pad";
+    }
+    if (!flight.burstSecond || second < flight.burstSecond) {
+        return "ascent";
+    }
+    if (!flight.landingSecond || second < flight.landingSecond) {
+        return "descent";
+    }
+    return "landed";
+}
+
+uint64_t sim::flightLandingUs() {
+    return (uint64_t)flight.landingSecond * 1000000;
+}
+
+float sim::flightMaxAltitude() {
+    return flight.maxAltitude;
+}
+
+// Inside the insulated payload: a fraction of the outside swing, kept off
+// the coldest air by the electronics' own heat
+static float payloadTemperature(const sim::FlightState& state) {
+    return 22.0f + (state.temperature - 15.0f) * 0.45f;
+}
+
+float sim::chipTemperature() {
+    return payloadTemperature(flightAt(sim::now())) + 12.0f;
+}
+
+// Repeatable from run to run
+static std::mt19937 noise(20240615);
+
+static float gaussian(float sigma) {
+    std::normal_distribution<float> distribution(0.0f, sigma);
+    return distribution(noise);
+}
+
+// ===========================
+// BMP280
+// ===========================
+
+#define BMP_REG_CALIBRATION     0x88
+#define BMP_REG_CHIP_ID         0xD0
+#define BMP_REG_RESET           0xE0
+#define BMP_REG_STATUS          0xF3
+#define BMP_REG_CTRL_MEAS       0xF4
+#define BMP_REG_CONFIG          0xF5
+#define BMP_REG_DATA            0xF7
+#define BMP_STATUS_MEASURING    0x08
+
+// The datasheet's example trim (section 3.12)
+static const uint16_t digT1 = 27504;
+static const int16_t digT2 = 26435;
+static const int16_t digT3 = -1000;
+static const uint16_t digP1 = 36477;
+static const int16_t digP2 = -10685;
+static const int16_t digP3 = 3024;
+static const int16_t digP4 = 2855;
+static const int16_t digP5 = 140;
+static const int16_t digP6 = -7;
+static const int16_t digP7 = 15500;
+static const int16_t digP8 = -14600;
+static const int16_t digP9 = 6000;
+
+static struct {
+    uint8_t registers[256];
+    uint8_t pointer;
+    uint64_t conversionDone;            // Forced conversion in progress until
+    bool converting;
+    float filteredPressure;             // IIR state, Pa
+    bool filterPrimed;
+} bmp;
+
+static int32_t bmpFine(int32_t adcT) {
+    int32_t var1 = ((((adcT >> 3) - ((int32_t)digT1 << 1))) * ((int32_t)digT2)) >> 11;
+    int32_t var2 = (((((adcT >> 4) - ((int32_t)digT1)) * ((adcT >> 4) - ((int32_t)digT1))) >> 12) *
+                    ((int32_t)digT3)) >> 14;
+    return var1 + var2;
+}
+
+// Q24.8 Pa
+static int64_t bmpPressure(int32_t adcP, int32_t tFine) {
+    int64_t p1 = ((int64_t)tFine) - 128000;
+    int64_t p2 = p1 * p1 * (int64_t)digP6;
+    p2 = p2 + ((p1 * (int64_t)digP5) << 17);
+    p2 = p2 + (((int64_t)digP4) << 35);
+    p1 = ((p1 * p1 * (int64_t)digP3) >> 8) + ((p1 * (int64_t)digP2) << 12);
+    p1 = (((((int64_t)1) << 47) + p1)) * ((int64_t)digP1) >> 33;
+    int64_t p = 1048576 - adcP;
+    p = (((p << 31) - p2) * 3125) / p1;
+    p1 = (((int64_t)digP9) * (p >> 13) * (p >> 13)) >> 25;
+    p2 = (((int64_t)digP8) * p) >> 19;
+    return ((p + p1 + p2) >> 8) + (((int64_t)digP7) << 4);
+}
+
+// The raw readings that compensate to the given values, by bisection -
+// temperature rises with adc_T, pressure falls with adc_P
+static void bmpRaw(float temperature, float pressure, int32_t& adcT, int32_t& adcP) {
+    int32_t target = lroundf(temperature * 100.0f);
+    int32_t low = 0;
+    int32_t high = 0xFFFFF;
+    while (low < high) {
+        int32_t middle = (low + high) / 2;
+        if ((bmpFine(middle) * 5 + 128) >> 8 < target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    adcT = low;
+
+    int32_t tFine = bmpFine(adcT);
+    int64_t targetP = llroundf(pressure * 256.0f);
+    low = 0;
+    high = 0xFFFFF;
+    while (low < high) {
+        int32_t middle = (low + high) / 2;
+        if (bmpPressure(middle, tFine) > targetP) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    adcP = low;
+}
+
+static uint8_t oversamples(uint8_t code) {
+    return code == 0 ? 0 : 1 << std::min<uint8_t>(code - 1, 4);
+}
+
+static void bmpReset() {
+    memset(bmp.registers, 0, sizeof(bmp.registers));
+    const int16_t trim[] = {(int16_t)digT1, digT2, digT3, (int16_t)digP1, digP2, digP3,
+                            digP4, digP5, digP6, digP7, digP8, digP9};
+    for (int i = 0; i < 12; i++) {
+        bmp.registers[BMP_REG_CALIBRATION + 2 * i] = trim[i] & 0xFF;
+        bmp.registers[BMP_REG_CALIBRATION + 2 * i + 1] = (uint16_t)trim[i] >> 8;
+    }
+    bmp.registers[BMP_REG_CHIP_ID] = 0x58;
+    // Data reads 0x80000 until the first conversion
+    bmp.registers[BMP_REG_DATA] = 0x80;
+    bmp.registers[BMP_REG_DATA + 3] = 0x80;
+    bmp.converting = false;
+    bmp.filterPrimed = false;
+}
+
+// A conversion's result into the data registers, through the IIR filter
+static void bmpConvert(uint64_t at) {
+    sim::FlightState state = sim::flightAt(at);
+    float pressure = state.pressure + gaussian(1.5f);
+    float temperature = payloadTemperature(state) + gaussian(0.02f);
+
+    uint8_t filter = (bmp.registers[BMP_REG_CONFIG] >> 2) & 0x07;
+    float coefficient = filter == 0 ? 1.0f : (float)(1 << std::min<uint8_t>(filter, 4));
+    if (!bmp.filterPrimed || coefficient == 1.0f) {
+        bmp.filteredPressure = pressure;
+        bmp.filterPrimed = true;
+    } else {
+        bmp.filteredPressure += (pressure - bmp.filteredPressure) / coefficient;
+    }
+
+    int32_t adcT;
+    int32_t adcP;
+    bmpRaw(temperature, bmp.filteredPressure, adcT, adcP);
+    uint8_t* data = &bmp.registers[BMP_REG_DATA];
+    data[0] = adcP >> 12;
+    data[1] = adcP >> 4;
+    data[2] = (adcP & 0x0F) << 4;
+    data[3] = adcT >> 12;
+    data[4] = adcT >> 4;
+    data[5] = (adcT & 0x0F) << 4;
+}
+
+// Brings the conversion state up to now
+static void bmpUpdate(uint64_t now) {
+    uint8_t mode = bmp.registers[BMP_REG_CTRL_MEAS] & 0x03;
+    if (bmp.converting && now >= bmp.conversionDone) {
+        bmpConvert(bmp.conversionDone);
+        bmp.converting = false;
+        if (mode != 0x03) {
+            bmp.registers[BMP_REG_CTRL_MEAS] &= ~0x03;     // Forced mode returns to sleep
+        }
+    }
+    if (mode == 0x03 && !bmp.converting) {
+        // Normal mode: the latest of back-to-back conversions
+        bmpConvert(now);
+    }
+    bmp.registers[BMP_REG_STATUS] = bmp.converting ? BMP_STATUS_MEASURING : 0;
+}
+
+static void bmpWriteRegister(uint8_t reg, uint8_t value, uint64_t now) {
+    if (reg == BMP_REG_RESET) {
+        if (value == 0xB6) {
+            bmpReset();
+        }
+        return;
+    }
+    if (reg != BMP_REG_CTRL_MEAS && reg != BMP_REG_CONFIG) {
+        return;     // Read-only
+    }
+    bmp.registers[reg] = value;
+    if (reg == BMP_REG_CTRL_MEAS && (value & 0x03) != 0) {
+        uint8_t tempOs = value >> 5;
+        uint8_t pressOs = (value >> 2) & 0x07;
+        uint32_t us = 1250 + 2300 * oversamples(tempOs) + 2300 * oversamples(pressOs) + (pressOs ? 575 : 0);
+        bmp.converting = true;
+        bmp.conversionDone = now + us;
+    }
+}
+
+// ===========================
+// Sensor Bus
+// ===========================
+
+bool sim::i2cWrite(uint8_t address, const uint8_t* data, size_t length) {
+    if (address != BMP280_ADDRESS) {
+        return false;
+    }
+    uint64_t now = sim::now();
+    bmpUpdate(now);
+    if (length == 0) {
+        return true;    // Address probe
+    }
+    // A lone register byte sets the read pointer; after it, register/value pairs
+    bmp.pointer = data[0];
+    if (length >= 2) {
+        bmpWriteRegister(data[0], data[1], now);
+        for (size_t i = 2; i + 1 < length; i += 2) {
+            bmpWriteRegister(data[i], data[i + 1], now);
+        }
+    }
+    return true;
+}
+
+bool sim::i2cRead(uint8_t address, uint8_t* data, size_t length) {
+    if (address != BMP280_ADDRESS) {
+        return false;
+    }
+    bmpUpdate(sim::now());
+    for (size_t i = 0; i < length; i++) {
+        data[i] = bmp.registers[(uint8_t)(bmp.pointer + i)];
+    }
+    return true;
+}
+
+// ===========================
+// GPS Receiver
+// ===========================
+
+#define GPS_COLD_START_US          29000000ull
+#define GPS_HOT_START_US           1500000ull
+#define GPS_OUTPUT_DELAY_US        40000       // Epoch to the first byte of its output
+#define GPS_FIX_CEILING            12000.0f    // m, without an airborne dynamic model
+#define GPS_GPS_EPOCH_UNIX         315964800u
+#define GPS_LEAP_SECONDS           18
+
+struct GpsInbound {
+    uint64_t arrival;
+    std::vector<uint8_t> bytes;
+    uint32_t baud;
+};
+
+static struct {
+    TaskHandle_t task;
+    std::deque<GpsInbound> inbox;
+    UbxParser parser;
+
+    // RAM configuration layer, reset by power-up and backup
+    uint32_t baud;
+    bool nmeaOut;
+    bool ubxOut;
+    uint8_t navPvtRate;
+    uint16_t measRateMs;
+    uint8_t dynModel;
+    uint8_t powerMode;
+    uint32_t psmooPeriodS;
+    uint16_t onTimeS;
+
+    bool backup;
+    uint64_t fixFrom;                   // Tracking from here on
+    uint64_t nextEpoch;
+    uint32_t epochs;
+    uint32_t ppsSecond;
+
+    sim::GpsStatus status;
+} gps;
+
+static void gpsDefaults() {
+    gps.baud = GPS_BAUD_RATE;
+    gps.nmeaOut = true;
+    gps.ubxOut = true;
+    gps.navPvtRate = 0;
+    gps.measRateMs = 1000;
+    gps.dynModel = 0;                   // Portable
+    gps.powerMode = UBX_PM_FULL;
+    gps.psmooPeriodS = 0;
+    gps.onTimeS = 0;
+}
+
+static void gpsSend(const uint8_t* data, size_t length) {
+    // Out at the receiver's baud, arriving as the last byte does
+    sim::sleep((uint64_t)length * 10 * 1000000 / gps.baud);
+    sim::uartFromDevice(GPS_UART_NUM, data, length, gps.baud);
+}
+
+static size_t ubxFrame(uint8_t* out, uint8_t msgClass, uint8_t msgId, const uint8_t* payload, uint16_t length) {
+    out[0] = UBX_SYNC_1;
+    out[1] = UBX_SYNC_2;
+    out[2] = msgClass;
+    out[3] = msgId;
+    out[4] = length & 0xFF;
+    out[5] = length >> 8;
+    memcpy(&out[6], payload, length);
+    uint8_t a = 0;
+    uint8_t b = 0;
+    for (size_t i = 2; i < 6u + length; i++) {
+        a += out[i];
+        b += a;
+    }
+    out[6 + length] = a;
+    out[7 + length] = b;
+    return UBX_FRAME_OVERHEAD + length;
+}
+
+static void put32(uint8_t* at, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        at[i] = value >> (8 * i);
+    }
+}
+
+static uint32_t get32(const uint8_t* at) {
+    return at[0] | at[1] << 8 | at[2] << 16 | (uint32_t)at[3] << 24;
+}
+
+// Days since 1970 to a civil date
+static void civilDate(uint32_t days, int& year, int& month, int& day) {
+    int32_t z = (int32_t)days + 719468;
+    int32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32_t y = yoe + era * 400;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = y + (month <= 2);
+}
+
+static bool gpsTracking(uint64_t now, const sim::FlightState& state) {
+    if (now < gps.fixFrom) {
+        return false;
+    }
+    return gps.dynModel >= UBX_DYNMODEL_AIRBORNE_1G || state.altitude < GPS_FIX_CEILING;
+}
+
+static void gpsNavPvt(uint64_t epoch, const sim::FlightState& state, bool fix) {
+    uint8_t payload[UBX_NAV_PVT_LEN] = {};
+    uint64_t unixMs = (uint64_t)flight.profile.utcStart * 1000 + epoch / 1000;
+    uint32_t unixSeconds = unixMs / 1000;
+    int year;
+    int month;
+    int day;
+    civilDate(unixSeconds / 86400, year, month, day);
+    uint32_t secondOfDay = unixSeconds % 86400;
+    uint64_t gpsMs = unixMs - (uint64_t)GPS_GPS_EPOCH_UNIX * 1000 + GPS_LEAP_SECONDS * 1000;
+    bool timeKnown = epoch >= gps.fixFrom - std::min<uint64_t>(gps.fixFrom, 3000000);
+
+    put32(&payload[0], (uint32_t)(gpsMs % (604800ull * 1000)));
+    payload[4] = year & 0xFF;
+    payload[5] = year >> 8;
+    payload[6] = month;
+    payload[7] = day;
+    payload[8] = secondOfDay / 3600;
+    payload[9] = secondOfDay / 60 % 60;
+    payload[10] = secondOfDay % 60;
+    payload[11] = timeKnown ? 0x07 : 0x00;
+    put32(&payload[12], fix ? 30 : 1000000000);
+    put32(&payload[16], (uint32_t)(int32_t)((unixMs % 1000) * 1000000));
+    payload[20] = fix ? UBX_FIX_3D : UBX_FIX_NONE;
+    payload[21] = fix ? 0x01 : 0x00;
+    payload[23] = fix ? 12 : (uint8_t)std::min<uint64_t>(epoch / 4000000, 3);
+    if (fix) {
+        float hAcc = 1.8f + fabsf(gaussian(0.4f));
+        put32(&payload[24], (uint32_t)(int32_t)llround((state.longitude + gaussian(1.5f) / 111000.0) * 1e7));
+        put32(&payload[28], (uint32_t)(int32_t)llround((state.latitude + gaussian(1.5f) / 111000.0) * 1e7));
+        int32_t hMsl = lroundf((state.altitude + gaussian(2.5f)) * 1000.0f);
+        put32(&payload[32], (uint32_t)(hMsl + 47000));
+        put32(&payload[36], (uint32_t)hMsl);
+        put32(&payload[40], (uint32_t)lroundf(hAcc * 1000.0f));
+        put32(&payload[44], (uint32_t)lroundf(hAcc * 1600.0f));
+        float headingRad = state.heading * (float)M_PI / 180.0f;
+        put32(&payload[48], (uint32_t)lroundf(state.groundSpeed * cosf(headingRad) * 1000.0f));
+        put32(&payload[52], (uint32_t)lroundf(state.groundSpeed * sinf(headingRad) * 1000.0f));
+        put32(&payload[56], (uint32_t)lroundf((-state.verticalSpeed + gaussian(0.1f)) * 1000.0f));
+        put32(&payload[60], (uint32_t)lroundf(state.groundSpeed * 1000.0f));
+        put32(&payload[64], (uint32_t)lroundf(state.heading * 1e5f));
+        put32(&payload[68], 300);
+        put32(&payload[72], 500000);
+        payload[76] = 120;                  // pDOP 1.2
+    } else {
+        put32(&payload[40], 0xFFFFFFFF);
+        put32(&payload[44], 0xFFFFFFFF);
+        payload[76] = 0x0F;                 // 99.99
+        payload[77] = 0x27;
+    }
+
+    uint8_t frame[UBX_FRAME_OVERHEAD + UBX_NAV_PVT_LEN];
+    size_t length = ubxFrame(frame, UBX_CLASS_NAV, UBX_ID_NAV_PVT, payload, sizeof(payload));
+    gpsSend(frame, length);
+    gps.status.framesSent++;
+}
+
+static void nmeaCoordinate(char* out, size_t size, double degrees, bool latitude) {
+    double magnitude = fabs(degrees);
+    int whole = (int)magnitude;
+    double minutes = (magnitude - whole) * 60.0;
+    snprintf(out, size, latitude ? "%02d%08.5f,%c" : "%03d%08.5f,%c", whole, minutes,
+             latitude ? (degrees >= 0 ? 'N' : 'S') : (degrees >= 0 ? 'E' : 'W'));
+}
+
+static void nmeaSend(const char* body) {
+    uint8_t checksum = 0;
+    for (const char* c = body; *c; c++) {
+        checksum ^= (uint8_t)*c;
+    }
+    char sentence[128];
+    int length = snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+    gpsSend((const uint8_t*)sentence, length);
+    gps.status.framesSent++;
+}
+
+static void gpsNmea(uint64_t epoch, const sim::FlightState& state, bool fix) {
+    uint32_t unixSeconds = flight.profile.utcStart + epoch / 1000000;
+    uint32_t hundredths = epoch / 10000 % 100;
+    uint32_t secondOfDay = unixSeconds % 86400;
+    int year;
+    int month;
+    int day;
+    civilDate(unixSeconds / 86400, year, month, day);
+
+    char time[16];
+    snprintf(time, sizeof(time), "%02u%02u%02u.%02u", secondOfDay / 3600, secondOfDay / 60 % 60, secondOfDay % 60,
+             hundredths);
+    char lat[24] = ",";
+    char lon[24] = ",";
+    if (fix) {
+        nmeaCoordinate(lat, sizeof(lat), state.latitude, true);
+        nmeaCoordinate(lon, sizeof(lon), state.longitude, false);
+    }
+
+    char altitude[16] = "";
+    if (fix) {
+        snprintf(altitude, sizeof(altitude), "%.1f", state.altitude);
+    }
+    char body[112];
+    snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,%d,%02d,%s,%s,M,47.0,M,,", time, lat, lon, fix ? 1 : 0,
+             fix ? 12 : 0, fix ? "0.9" : "", altitude);
+    nmeaSend(body);
+    snprintf(body, sizeof(body), "GPRMC,%s,%c,%s,%s,%.2f,%.1f,%02d%02d%02d,,,%c", time, fix ? 'A' : 'V', lat, lon,
+             state.groundSpeed * 1.943844f, state.heading, day, month, year % 100, fix ? 'A' : 'N');
+    nmeaSend(body);
+}
+
+static void gpsEpoch(uint64_t epoch) {
+    if (gps.backup) {
+        return;
+    }
+    sim::FlightState state = sim::flightAt(epoch);
+    bool fix = gpsTracking(epoch, state);
+    if (fix && !gps.status.firstFixUs) {
+        gps.status.firstFixUs = epoch;
+    }
+
+    // PSMOO: a fix every period, off in between
+    if (gps.powerMode == UBX_PM_PSMOO && gps.psmooPeriodS > 0 && fix) {
+        uint32_t intoPeriod = (uint32_t)(epoch / 1000000 % gps.psmooPeriodS);
+        if (intoPeriod > std::max<uint16_t>(gps.onTimeS, 1)) {
+            return;
+        }
+    }
+
+    uint32_t second = epoch / 1000000;
+    if (fix && second != gps.ppsSecond && epoch % 1000000 < gps.measRateMs * 1000u) {
+        gps.ppsSecond = second;
+        sim::driveInput(GPS_PPS_PIN, 1);
+        sim::driveInput(GPS_PPS_PIN, 0);
+    }
+
+    sim::sleep(GPS_OUTPUT_DELAY_US);
+    if (gps.ubxOut && gps.navPvtRate > 0 && gps.epochs % gps.navPvtRate == 0) {
+        gpsNavPvt(epoch, state, fix);
+    }
+    if (gps.nmeaOut && epoch % 1000000 < gps.measRateMs * 1000u) {
+        gpsNmea(epoch, state, fix);
+    }
+    gps.epochs++;
+}
+
+// Value size from the key's bits 28-30: 1 bit, 1, 2, 4 or 8 bytes
+static size_t valsetValueBytes(uint32_t key) {
+    static const uint8_t bytes[] = {0, 1, 1, 2, 4, 8, 0, 0};
+    return bytes[(key >> 28) & 0x07];
+}
+
+static void gpsValset(const uint8_t* payload, uint16_t length) {
+    uint32_t newBaud = 0;
+    for (size_t i = 4; i + 4 <= length;) {
+        uint32_t key = get32(&payload[i]);
+        size_t size = valsetValueBytes(key);
+        i += 4;
+        if (size == 0 || i + size > length) {
+            break;
+        }
+        uint32_t value = 0;
+        for (size_t b = 0; b < std::min<size_t>(size, 4); b++) {
+            value |= (uint32_t)payload[i + b] << (8 * b);
+        }
+        i += size;
+
+        switch (key) {
+            case UBX_KEY_UART1OUTPROT_NMEA: gps.nmeaOut = value != 0; break;
+            case UBX_KEY_UART1OUTPROT_UBX: gps.ubxOut = value != 0; break;
+            case UBX_KEY_MSGOUT_NAV_PVT_UART1: gps.navPvtRate = value; break;
+            case UBX_KEY_NAVSPG_DYNMODEL: gps.dynModel = value; break;
+            case UBX_KEY_RATE_MEAS: gps.measRateMs = std::max<uint32_t>(value, 25); break;
+            case UBX_KEY_UART1_BAUDRATE: newBaud = value; break;
+            case UBX_KEY_PM_OPERATEMODE: gps.powerMode = value; break;
+            case UBX_KEY_PM_POSUPDATEPERIOD: gps.psmooPeriodS = value; break;
+            case UBX_KEY_PM_ONTIME: gps.onTimeS = value; break;
+            default: break;
+        }
+    }
+
+    // ACK-ACK at the old rate; a new one takes after it
+    const uint8_t ack[] = {UBX_CLASS_CFG, UBX_ID_CFG_VALSET};
+    uint8_t frame[UBX_FRAME_OVERHEAD + sizeof(ack)];
+    gpsSend(frame, ubxFrame(frame, UBX_CLASS_ACK, UBX_ID_ACK_ACK, ack, sizeof(ack)));
+    gps.status.configsAcked++;
+    if (newBaud) {
+        gps.baud = newBaud;
+    }
+    uint64_t now = sim::now();
+    gps.nextEpoch = (now / (gps.measRateMs * 1000ull) + 1) * gps.measRateMs * 1000ull;
+}
+
+static void gpsReceive(const GpsInbound& inbound) {
+    if (gps.backup) {
+        // Any edge on RX wakes it, configuration gone and a hot start ahead
+        gps.backup = false;
+        gpsDefaults();
+        gps.fixFrom = inbound.arrival + GPS_HOT_START_US;
+        gps.parser.reset();
+        uint64_t period = gps.measRateMs * 1000ull;
+        gps.nextEpoch = (inbound.arrival / period + 1) * period;
+        return;
+    }
+    if (inbound.baud != gps.baud) {
+        gps.status.garbledBytes += inbound.bytes.size();
+        gps.parser.reset();
+        return;
+    }
+    for (uint8_t b : inbound.bytes) {
+        if (!gps.parser.feed(b)) {
+            continue;
+        }
+        if (gps.parser.is(UBX_CLASS_CFG, UBX_ID_CFG_VALSET)) {
+            gpsValset(gps.parser.getPayload(), gps.parser.getLength());
+        } else if (gps.parser.is(UBX_CLASS_RXM, UBX_ID_RXM_PMREQ) && gps.parser.getLength() == UBX_PMREQ_LEN &&
+                   (get32(&gps.parser.getPayload()[8]) & 0x02)) {
+            gps.backup = true;
+            gps.status.backups++;
+        }
+        // MGA-INI aiding: the hot start needs nothing more
+    }
+}
+
+static void gpsTaskEntry(void* param) {
+    gpsDefaults();
+    gps.fixFrom = GPS_COLD_START_US;
+    gps.nextEpoch = gps.measRateMs * 1000ull;
+    while (true) {
+        uint64_t wake = gps.backup ? SIM_TIME_NEVER : gps.nextEpoch;
+        if (!gps.inbox.empty()) {
+            wake = std::min(wake, gps.inbox.front().arrival);
+        }
+        sim::notifyTakeUntil(wake);
+
+        uint64_t now = sim::now();
+        while (!gps.inbox.empty() && gps.inbox.front().arrival <= now) {
+            GpsInbound inbound = std::move(gps.inbox.front());
+            gps.inbox.pop_front();
+            gpsReceive(inbound);
+        }
+        if (!gps.backup && now >= gps.nextEpoch) {
+            uint64_t epoch = gps.nextEpoch;
+            gps.nextEpoch += gps.measRateMs * 1000ull;
+            gpsEpoch(epoch);
+            // Past epochs are skipped, not caught up
+            uint64_t period = gps.measRateMs * 1000ull;
+            gps.nextEpoch = std::max(gps.nextEpoch, (sim::now() / period + 1) * period);
+        }
+    }
+}
+
+void sim::uartToDevice(int port, const uint8_t* data, size_t length, uint64_t arrival, uint32_t baud) {
+    if (port != GPS_UART_NUM || !gps.task) {
+        return;
+    }
+    gps.inbox.push_back({arrival, std::vector<uint8_t>(data, data + length), baud});
+    xTaskNotifyGive(gps.task);
+}
+
+sim::GpsStatus sim::gpsStatus() {
+    return gps.status;
+}
+
+// ===========================
+// Battery
+// ===========================
+
+#define BATTERY_MODEL_STEP_US      1000000
+#define BATTERY_RESISTANCE         0.12f       // Ohm at room temperature
+
+// Open-circuit volts at 0, 10 ... 100 % charge
+static const float ocvCurve[] = {3.00f, 3.45f, 3.60f, 3.68f, 3.74f, 3.79f, 3.84f, 3.91f, 3.99f, 4.08f, 4.18f};
+
+static struct {
+    float capacityMah;
+    float usedMah;
+    uint64_t countedTo;
+    float minVolts;
+    float peakDrawMa;
+} battery;
+
+// Coulombs up to now at the ledger's draw since the last count
+static float batteryCount() {
+    uint64_t now = sim::now();
+    float drawMa = Energy().getTotalDrawMa();
+    if (now > battery.countedTo) {
+        battery.usedMah += drawMa * (float)(now - battery.countedTo) / 3.6e9f;
+        battery.countedTo = now;
+    }
+    battery.peakDrawMa = std::max(battery.peakDrawMa, drawMa);
+    return drawMa;
+}
+
+float sim::batteryVolts() {
+    float drawMa = batteryCount();
+    float charge = std::max(0.0f, 1.0f - battery.usedMah / battery.capacityMah) * 10.0f;
+    int index = std::min((int)charge, 9);
+    float ocv = ocvCurve[index] + (ocvCurve[index + 1] - ocvCurve[index]) * (charge - index);
+
+    // Internal resistance climbs as the cell cools
+    float cold = std::max(0.0f, 15.0f - payloadTemperature(flightAt(sim::now()))) / 20.0f;
+    float volts = ocv - drawMa * 0.001f * BATTERY_RESISTANCE * (1.0f + cold);
+    volts = std::max(volts, 2.5f);
+    battery.minVolts = std::min(battery.minVolts, volts);
+    return volts;
+}
+
+sim::BatteryStatus sim::batteryStatus() {
+    BatteryStatus status;
+    status.volts = batteryVolts();
+    status.minVolts = battery.minVolts;
+    status.usedMah = battery.usedMah;
+    status.capacityMah = battery.capacityMah;
+    status.peakDrawMa = battery.peakDrawMa;
+    return status;
+}
+
+static void batteryTaskEntry(void* param) {
+    while (true) {
+        sim::sleep(BATTERY_MODEL_STEP_US);
+        batteryCount();
+    }
+}
+
+// ===========================
+// Start
+// ===========================
+
+void sim::startDevices(float batteryMah) {
+    bmpReset();
+    battery.capacityMah = batteryMah;
+    battery.usedMah = 0.0f;
+    battery.countedTo = 0;
+    battery.minVolts = ocvCurve[10];
+    battery.peakDrawMa = 0.0f;
+    gps.task = sim::createHardwareTask(gpsTaskEntry, "gps_model", nullptr, 10);
+    sim::createHardwareTask(batteryTaskEntry, "battery_model", nullptr, 1);
+}
@@ -0,0 +1,112 @@
+#ifndef SIM_DEVICES_H
+#define SIM_DEVICES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// ===========================
+// Native Simulation - Devices
+// The flight, and what the board's sensors, receiver and battery make of it
+// ===========================
+
+// The flight is planned once before the run: a wait on the pad, a steady
+// climb to burst, a parachute descent that slows as the air thickens, then
+// the ground. Winds carry it east, hardest at the jet stream. Everything
+// else reads it by time:
+//
+// - BMP280 at BMP280_ADDRESS on Wire: the register map, forced mode and
+//   the datasheet's trim, with raw values that compensate back to the ISA
+//   pressure and a payload temperature.
+// - MAX-M10S on GPS_UART_NUM: NMEA at 9600 baud from power-up; answers
+//   CFG-VALSET with ACK-ACK, then NAV-PVT at the configured rate and baud,
+//   a PPS edge per second with a fix, backup on RXM-PMREQ and a hot start
+//   after it. Above 12 km it loses the fix unless an airborne dynamic
+//   model is set, as the receiver does.
+// - The battery: coulombs counted from the firmware's own energy ledger,
+//   and a loaded voltage from the Li-ion discharge curve and its internal
+//   resistance, for the ADC.
+//
+// Device models run in hardware tasks (sim_kernel.h), so they cost the
+// simulated cores nothing.
+
+namespace sim {
+
+struct FlightProfile {
+    uint32_t padSeconds;                // Before launch
+    float padAltitude;                  // m MSL
+    float ascentRate;                   // m/s
+    float burstAltitude;                // m MSL
+    float descentRate;                  // m/s under the parachute at sea level
+    double latitude;                    // Launch site
+    double longitude;
+    uint32_t landedSeconds;             // On the ground after landing, to the end of the run
+    uint32_t utcStart;                  // Unix seconds at reset, for the receiver's clock
+};
+
+struct FlightState {
+    float altitude;                     // m MSL
+    float verticalSpeed;                // m/s, up positive
+    double latitude;
+    double longitude;
+    float groundSpeed;                  // m/s
+    float heading;                      // Degrees from north
+    float pressure;                     // Pa
+    float temperature;                  // °C, outside
+};
+
+// Plans the track; returns the flight's length to the end of landedSeconds, in µs
+uint64_t planFlight(const FlightProfile& profile);
+FlightState flightAt(uint64_t us);
+const char* flightPhaseAt(uint64_t us);
+uint64_t flightLandingUs();
+float flightMaxAltitude();
+
+// Creates the device tasks, with a battery of this capacity; before sim::run()
+void startDevices(float batteryMah);
+
+// Sensor bus: false is a NACK
+bool i2cWrite(uint8_t address, const uint8_t* data, size_t length);
+bool i2cRead(uint8_t address, uint8_t* data, size_t length);
+
+// UART, device side. What the firmware sent at baud reaches the device at
+// arrival, garbled if the device listens at another rate
+void uartToDevice(int port, const uint8_t* data, size_t length, uint64_t arrival, uint32_t baud);
+// In sim_idf.cpp: what a device sent at baud reaches the driver's ring now,
+// garbled likewise
+void uartFromDevice(int port, const uint8_t* data, size_t length, uint32_t baud);
+
+// In sim_arduino.cpp: a device drives an input pin, running its interrupt on an edge
+void driveInput(uint8_t pin, int level);
+// In sim_arduino.cpp: where Serial's output goes; nullptr drops it
+void setSerialLog(FILE* log);
+
+// The S3's die temperature sensor: the payload air and the chip's own heat
+float chipTemperature();
+
+// Battery terminal volts now, under the ledger's present draw
+float batteryVolts();
+
+struct BatteryStatus {
+    float volts;
+    float minVolts;
+    float usedMah;
+    float capacityMah;
+    float peakDrawMa;
+};
+
+BatteryStatus batteryStatus();
+
+struct GpsStatus {
+    uint32_t framesSent;                // NAV-PVT or NMEA sentences
+    uint32_t configsAcked;
+    uint32_t garbledBytes;              // Sent to it at the wrong baud
+    uint32_t backups;
+    uint64_t firstFixUs;                // 0 without one
+};
+
+GpsStatus gpsStatus();
+
+}  // namespace sim
+
+#endif // SIM_DEVICES_H
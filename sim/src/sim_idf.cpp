@@ -0,0 +1,1300 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+#include "sim_devices.h"
+#include "sim_kernel.h"
+#include "driver/i2c.h"
+#include "driver/spi_master.h"
+#include "driver/uart.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_pm.h"
+#include "esp_rom_crc.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+
+// ===========================
+// Native Simulation - IDF
+// The ESP-IDF drivers and services the firmware calls, over the simulated
+// kernel and devices
+// ===========================
+
+// ===========================
+// System
+// ===========================
+
+static std::mt19937 randomSource(0x5EED);
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return ESP_RST_POWERON;
+}
+
+void esp_restart(void) {
+    sim::stop("esp_restart()");
+}
+
+uint32_t esp_random(void) {
+    return randomSource();
+}
+
+void esp_fill_random(void* buffer, size_t length) {
+    uint8_t* bytes = static_cast<uint8_t*>(buffer);
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = randomSource();
+    }
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+    sim::SimCall call;
+    return (esp_cpu_cycle_count_t)(sim::now() * sim::cpuMhz());
+}
+
+// ===========================
+// ROM CRC
+// ===========================
+
+// Inverted in and out, as the ROM's are
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+uint16_t esp_rom_crc16_be(uint16_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)buf[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return ~crc;
+}
+
+// ===========================
+// Heap
+// ===========================
+
+#define HEAP_INTERNAL_BYTES         (320 * 1024)        // What the S3 leaves the heap after the IDF and Arduino
+#define HEAP_PSRAM_BYTES            (8 * 1024 * 1024)
+#define HEAP_ALWAYS_INTERNAL        4096                // CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL
+
+struct HeapBlock {
+    size_t size;
+    bool external;
+};
+
+static struct {
+    std::map<const void*, HeapBlock> blocks;
+    size_t used[2];                     // Internal, PSRAM
+    size_t peak[2];
+} heap;
+
+static const size_t heapTotal[2] = {HEAP_INTERNAL_BYTES, HEAP_PSRAM_BYTES};
+
+static bool pickExternal(size_t size, uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return true;
+    }
+    if (caps & (MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_EXEC)) {
+        return false;
+    }
+    return size > HEAP_ALWAYS_INTERNAL;
+}
+
+static void* heapRecord(void* ptr, size_t size, bool external) {
+    if (!ptr) {
+        return nullptr;
+    }
+    heap.blocks[ptr] = {size, external};
+    heap.used[external] += size;
+    heap.peak[external] = std::max(heap.peak[external], heap.used[external]);
+    return ptr;
+}
+
+static bool heapFits(size_t size, bool external) {
+    return heap.used[external] + size <= heapTotal[external];
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    bool external = pickExternal(size, caps);
+    if (!heapFits(size, external)) {
+        // The default caps fall back to the other region, as the IDF's do
+        if ((caps & (MALLOC_CAP_SPIRAM | MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA)) || !heapFits(size, !external)) {
+            return nullptr;
+        }
+        external = !external;
+    }
+    return heapRecord(malloc(size ? size : 1), size, external);
+}
+
+void* heap_caps_calloc(size_t count, size_t size, uint32_t caps) {
+    void* ptr = heap_caps_malloc(count * size, caps);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    bool external = pickExternal(size, caps);
+    if (!heapFits(size, external)) {
+        return nullptr;
+    }
+    size_t rounded = (size + alignment - 1) / alignment * alignment;
+    return heapRecord(aligned_alloc(alignment, rounded ? rounded : alignment), size, external);
+}
+
+void heap_caps_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    auto block = heap.blocks.find(ptr);
+    if (block != heap.blocks.end()) {
+        heap.used[block->second.external] -= block->second.size;
+        heap.blocks.erase(block);
+    }
+    free(ptr);
+}
+
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+    if (!ptr) {
+        return heap_caps_malloc(size, caps);
+    }
+    void* moved = heap_caps_malloc(size, caps);
+    if (!moved) {
+        return nullptr;
+    }
+    size_t old = heap_caps_get_allocated_size(ptr);
+    memcpy(moved, ptr, std::min(old, size));
+    heap_caps_free(ptr);
+    return moved;
+}
+
+size_t heap_caps_get_allocated_size(void* ptr) {
+    auto block = heap.blocks.find(ptr);
+    return block == heap.blocks.end() ? 0 : block->second.size;
+}
+
+// The regions a caps mask takes in: both unless it names one
+static bool capsInclude(uint32_t caps, bool external) {
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return external;
+    }
+    if (caps & (MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_EXEC)) {
+        return !external;
+    }
+    return true;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    size_t total = 0;
+    for (int external = 0; external < 2; external++) {
+        if (capsInclude(caps, external)) {
+            total += heapTotal[external] - heap.used[external];
+        }
+    }
+    return total;
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    size_t total = 0;
+    for (int external = 0; external < 2; external++) {
+        if (capsInclude(caps, external)) {
+            total += heapTotal[external];
+        }
+    }
+    return total;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    size_t total = 0;
+    for (int external = 0; external < 2; external++) {
+        if (capsInclude(caps, external)) {
+            total += heapTotal[external] - heap.peak[external];
+        }
+    }
+    return total;
+}
+
+// No fragmentation: the host's allocator hides it
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    size_t largest = 0;
+    for (int external = 0; external < 2; external++) {
+        if (capsInclude(caps, external)) {
+            largest = std::max(largest, heapTotal[external] - heap.used[external]);
+        }
+    }
+    return largest;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+}
+
+bool esp_ptr_external_ram(const void* ptr) {
+    auto block = heap.blocks.upper_bound(ptr);
+    if (block == heap.blocks.begin()) {
+        return false;
+    }
+    --block;
+    const uint8_t* start = static_cast<const uint8_t*>(block->first);
+    return block->second.external && static_cast<const uint8_t*>(ptr) < start + std::max<size_t>(block->second.size, 1);
+}
+
+bool esp_ptr_internal(const void* ptr) {
+    return !esp_ptr_external_ram(ptr);
+}
+
+// ===========================
+// Flash Partitions
+// ===========================
+
+#define FLASH_BYTES                 (16 * 1024 * 1024)
+#define FLASH_SECTOR_BYTES          4096
+#define FLASH_ERASE_US_PER_SECTOR   30000
+#define FLASH_WRITE_US_PER_BYTE     1.6f    // 256-byte pages at ~0.4 ms
+#define FLASH_READ_US_PER_BYTE      0.05f   // QIO at 80 MHz, through the cache
+
+// partitions.csv
+static const esp_partition_t partitions[] = {
+    {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, 0x9000, 0x5000, FLASH_SECTOR_BYTES, "nvs"},
+    {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, 0xe000, 0x2000, FLASH_SECTOR_BYTES, "otadata"},
+    {nullptr, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x3c0000, FLASH_SECTOR_BYTES, "app0"},
+    {nullptr, ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x41, 0x3d0000, 0x20000, FLASH_SECTOR_BYTES, "fr"},
+    {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_COREDUMP, 0x3f0000, 0x10000, FLASH_SECTOR_BYTES,
+     "coredump"},
+    {nullptr, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x400000, 0x3c0000, FLASH_SECTOR_BYTES, "app1"},
+    {nullptr, ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0x7c0000, 0x800000, FLASH_SECTOR_BYTES, "images"},
+    {nullptr, ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x42, 0xfc0000, 0x40000, FLASH_SECTOR_BYTES,
+     "geofence"},
+};
+
+static std::vector<uint8_t>& flash() {
+    static std::vector<uint8_t> chip(FLASH_BYTES, 0xFF);
+    return chip;
+}
+
+static void flashBusy(float referenceUs) {
+    sim::busy((uint64_t)referenceUs);
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+    for (const esp_partition_t& partition : partitions) {
+        if ((type == ESP_PARTITION_TYPE_ANY || partition.type == type) &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || partition.subtype == subtype) &&
+            (!label || strcmp(partition.label, label) == 0)) {
+            return &partition;
+        }
+    }
+    return nullptr;
+}
+
+static bool inPartition(const esp_partition_t* partition, size_t offset, size_t size) {
+    return partition && offset <= partition->size && size <= partition->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    sim::SimCall call;
+    if (!dst || !inPartition(partition, offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, &flash()[partition->address + offset], size);
+    flashBusy(FLASH_READ_US_PER_BYTE * size);
+    return ESP_OK;
+}
+
+// NOR: a write only clears bits
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+    sim::SimCall call;
+    if (!src || !inPartition(partition, offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t* at = &flash()[partition->address + offset];
+    const uint8_t* bytes = static_cast<const uint8_t*>(src);
+    for (size_t i = 0; i < size; i++) {
+        at[i] &= bytes[i];
+    }
+    flashBusy(FLASH_WRITE_US_PER_BYTE * size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    sim::SimCall call;
+    if (!inPartition(partition, offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset % FLASH_SECTOR_BYTES || size % FLASH_SECTOR_BYTES) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(&flash()[partition->address + offset], 0xFF, size);
+    flashBusy((float)FLASH_ERASE_US_PER_SECTOR * (size / FLASH_SECTOR_BYTES));
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void** out,
+                             esp_partition_mmap_handle_t* handle) {
+    if (!out || !handle || !inPartition(partition, offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    static esp_partition_mmap_handle_t nextHandle = 1;
+    *out = &flash()[partition->address + offset];
+    *handle = nextHandle++;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+}
+
+// ===========================
+// OTA
+// ===========================
+
+#define OTA_IMAGE_MAGIC     0xE9
+
+static struct {
+    bool open;
+    bool sequential;
+    const esp_partition_t* target;
+    size_t written;
+    size_t erased;
+} ota;
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, nullptr);
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start) {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, nullptr);
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* state) {
+    if (!partition || !state) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition != esp_ota_get_running_partition()) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t imageSize, esp_ota_handle_t* handle) {
+    sim::SimCall call;
+    if (!partition || !handle || partition == esp_ota_get_running_partition() || ota.open) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ota.open = true;
+    ota.target = partition;
+    ota.written = 0;
+    ota.erased = 0;
+    ota.sequential = imageSize == OTA_WITH_SEQUENTIAL_WRITES;
+    if (!ota.sequential) {
+        size_t size = imageSize == OTA_SIZE_UNKNOWN ? partition->size
+                                                    : (imageSize + FLASH_SECTOR_BYTES - 1) / FLASH_SECTOR_BYTES *
+                                                          FLASH_SECTOR_BYTES;
+        esp_partition_erase_range(partition, 0, std::min<size_t>(size, partition->size));
+        ota.erased = size;
+    }
+    *handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size) {
+    sim::SimCall call;
+    if (!ota.open || handle != 1 || !data) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota.written + size > ota.target->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Sequential writes erase a sector as they reach it
+    while (ota.sequential && ota.erased < ota.written + size) {
+        esp_partition_erase_range(ota.target, ota.erased, FLASH_SECTOR_BYTES);
+        ota.erased += FLASH_SECTOR_BYTES;
+    }
+    esp_err_t err = esp_partition_write(ota.target, ota.written, data, size);
+    ota.written += size;
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    sim::SimCall call;
+    if (!ota.open || handle != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ota.open = false;
+    uint8_t magic = 0;
+    esp_partition_read(ota.target, 0, &magic, 1);
+    return ota.written > 0 && magic == OTA_IMAGE_MAGIC ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    ota.open = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    return partition && partition->type == ESP_PARTITION_TYPE_APP ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// ===========================
+// esp_timer
+// ===========================
+
+#define ESP_TIMER_TASK_PRIORITY     22
+#define ESP_TIMER_TASK_CORE         0
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    const char* name;
+    uint64_t due;                       // SIM_TIME_NEVER when stopped
+    uint64_t period;                    // 0 for one-shot
+};
+
+static struct {
+    std::vector<esp_timer*> timers;
+    TaskHandle_t task;
+} timers;
+
+// Callbacks in deadline order, on the esp_timer task as the IDF's
+static void timerTaskEntry(void* param) {
+    while (true) {
+        uint64_t next = SIM_TIME_NEVER;
+        for (esp_timer* timer : timers.timers) {
+            next = std::min(next, timer->due);
+        }
+        sim::notifyTakeUntil(next);
+
+        while (true) {
+            esp_timer* due = nullptr;
+            uint64_t now = sim::now();
+            for (esp_timer* timer : timers.timers) {
+                if (timer->due <= now && (!due || timer->due < due->due)) {
+                    due = timer;
+                }
+            }
+            if (!due) {
+                break;
+            }
+            due->due = due->period ? due->due + due->period : SIM_TIME_NEVER;
+            due->callback(due->arg);
+        }
+    }
+}
+
+int64_t esp_timer_get_time(void) {
+    sim::SimCall call;
+    return (int64_t)sim::now();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+    if (!args || !args->callback || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!timers.task) {
+        xTaskCreatePinnedToCore(timerTaskEntry, "esp_timer", 4096, nullptr, ESP_TIMER_TASK_PRIORITY, &timers.task,
+                                ESP_TIMER_TASK_CORE);
+    }
+    esp_timer* timer = new esp_timer{args->callback, args->arg, args->name, SIM_TIME_NEVER, 0};
+    timers.timers.push_back(timer);
+    *out = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timerStart(esp_timer_handle_t timer, uint64_t timeoutUs, uint64_t period) {
+    sim::SimCall call;
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->due != SIM_TIME_NEVER) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->due = sim::now() + timeoutUs;
+    timer->period = period;
+    xTaskNotifyGive(timers.task);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+    return timerStart(timer, timeoutUs, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+    return timerStart(timer, periodUs, periodUs);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->due == SIM_TIME_NEVER) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->due = SIM_TIME_NEVER;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->due != SIM_TIME_NEVER) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timers.timers.erase(std::find(timers.timers.begin(), timers.timers.end(), timer));
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    return timer && timer->due != SIM_TIME_NEVER;
+}
+
+// ===========================
+// Sleep
+// ===========================
+
+static struct {
+    uint64_t timerWakeUs;
+    esp_sleep_wakeup_cause_t cause;
+} sleepState = {0, ESP_SLEEP_WAKEUP_UNDEFINED};
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+    sleepState.timerWakeUs = timeUs;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ulp_wakeup(void) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option) {
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void) {
+    return sleepState.cause;
+}
+
+// The caller sleeps out the timer; the other core's tasks still run,
+// where the chip would hold them too
+esp_err_t esp_light_sleep_start(void) {
+    if (!sleepState.timerWakeUs) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim::sleep(sleepState.timerWakeUs);
+    sleepState.cause = ESP_SLEEP_WAKEUP_TIMER;
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start(void) {
+    sim::stop("deep sleep");
+}
+
+// ===========================
+// Power Management
+// ===========================
+
+// CONFIG_PM_ENABLE is off, as in sdkconfig.h
+esp_err_t esp_pm_configure(const void* config) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char* name, esp_pm_lock_handle_t* out) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_dump_locks(FILE* stream) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// ===========================
+// Task Watchdog
+// ===========================
+
+#define TWDT_DEFAULT_TIMEOUT_MS     5000
+#define TWDT_CHECK_US               1000000
+
+struct TwdtEntry {
+    TaskHandle_t task;
+    uint64_t lastReset;
+};
+
+static struct {
+    bool running = true;                // The Arduino core starts it
+    esp_task_wdt_config_t config = {TWDT_DEFAULT_TIMEOUT_MS, 0, false};
+    std::vector<TwdtEntry> entries;
+    TaskHandle_t checker;
+    char reason[64];
+} twdt;
+
+static void twdtCheckerEntry(void* param) {
+    while (true) {
+        sim::sleep(TWDT_CHECK_US);
+        uint64_t now = sim::now();
+        for (const TwdtEntry& entry : twdt.entries) {
+            // A reset from a core up to the lookahead ahead of this clock is not late
+            if (now > entry.lastReset + (uint64_t)twdt.config.timeout_ms * 1000 && twdt.config.trigger_panic) {
+                snprintf(twdt.reason, sizeof(twdt.reason), "task watchdog: %s", pcTaskGetName(entry.task));
+                sim::stop(twdt.reason);
+            }
+        }
+    }
+}
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t* config) {
+    if (twdt.running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    twdt.config = *config;
+    twdt.running = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t* config) {
+    if (!twdt.running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    twdt.config = *config;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_deinit(void) {
+    if (!twdt.entries.empty()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    twdt.running = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t task) {
+    sim::SimCall call;
+    if (!twdt.running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    task = task ? task : xTaskGetCurrentTaskHandle();
+    for (const TwdtEntry& entry : twdt.entries) {
+        if (entry.task == task) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    twdt.entries.push_back({task, sim::now()});
+    if (!twdt.checker) {
+        twdt.checker = sim::createHardwareTask(twdtCheckerEntry, "twdt_check", nullptr, configMAX_PRIORITIES - 1);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_delete(TaskHandle_t task) {
+    task = task ? task : xTaskGetCurrentTaskHandle();
+    for (auto entry = twdt.entries.begin(); entry != twdt.entries.end(); ++entry) {
+        if (entry->task == task) {
+            twdt.entries.erase(entry);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_task_wdt_reset(void) {
+    sim::SimCall call;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (TwdtEntry& entry : twdt.entries) {
+        if (entry.task == task) {
+            entry.lastReset = sim::now();
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// ===========================
+// UART
+// ===========================
+
+#define UART_FIFO_BYTES         128
+#define UART_RX_EVENT_BYTES     120     // The driver's RX FIFO full threshold
+
+struct SimUart {
+    bool installed;
+    uint32_t baud;
+    size_t rxCapacity;
+    std::deque<uint8_t> rx;
+    uint64_t received;                  // Bytes into the ring since install, for pattern positions
+    uint64_t consumed;
+    QueueHandle_t events;
+    SemaphoreHandle_t rxSignal;         // Given on each arrival, for a blocked read
+    bool patternEnabled;
+    char pattern;
+    std::deque<uint64_t> patterns;      // Absolute positions of each pattern byte
+    size_t patternCapacity;
+    uint64_t txFreeAt;                  // The line is busy until
+};
+
+static SimUart uarts[UART_NUM_MAX];
+
+static void uartEvent(SimUart& uart, uart_event_type_t type, size_t size) {
+    if (!uart.events) {
+        return;
+    }
+    uart_event_t event = {type, size, false};
+    xQueueSend(uart.events, &event, 0);
+}
+
+// Bytes at the wrong baud come through as noise, as framing errors would
+void sim::uartFromDevice(int port, const uint8_t* data, size_t length, uint32_t baud) {
+    if (port < 0 || port >= UART_NUM_MAX || !uarts[port].installed) {
+        return;
+    }
+    SimUart& uart = uarts[port];
+    bool garbled = baud != uart.baud;
+    for (size_t start = 0; start < length; start += UART_RX_EVENT_BYTES) {
+        size_t chunk = std::min<size_t>(UART_RX_EVENT_BYTES, length - start);
+        if (uart.rx.size() + chunk > uart.rxCapacity) {
+            uartEvent(uart, UART_BUFFER_FULL, 0);
+            return;
+        }
+        bool pattern = false;
+        for (size_t i = 0; i < chunk; i++) {
+            uint8_t b = garbled ? (uint8_t)(randomSource() | 0x80) : data[start + i];
+            uart.rx.push_back(b);
+            if (uart.patternEnabled && b == (uint8_t)uart.pattern && uart.patterns.size() < uart.patternCapacity) {
+                uart.patterns.push_back(uart.received);
+                pattern = true;
+            }
+            uart.received++;
+        }
+        uartEvent(uart, UART_DATA, chunk);
+        if (pattern) {
+            uartEvent(uart, UART_PATTERN_DET, chunk);
+        }
+    }
+    xSemaphoreGive(uart.rxSignal);
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rxBufferSize, int txBufferSize, int queueSize,
+                              QueueHandle_t* queue, int intrFlags) {
+    sim::SimCall call;
+    if (port >= UART_NUM_MAX || uarts[port].installed || rxBufferSize <= UART_FIFO_BYTES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SimUart& uart = uarts[port];
+    uart.installed = true;
+    uart.baud = 115200;
+    uart.rxCapacity = rxBufferSize;
+    uart.rx.clear();
+    uart.received = 0;
+    uart.consumed = 0;
+    uart.events = queue && queueSize > 0 ? xQueueCreate(queueSize, sizeof(uart_event_t)) : nullptr;
+    if (queue) {
+        *queue = uart.events;
+    }
+    uart.rxSignal = xSemaphoreCreateBinary();
+    uart.patternEnabled = false;
+    uart.patterns.clear();
+    uart.patternCapacity = 0;
+    uart.txFreeAt = 0;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port) {
+    sim::SimCall call;
+    if (port >= UART_NUM_MAX || !uarts[port].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    SimUart& uart = uarts[port];
+    uart.installed = false;
+    if (uart.events) {
+        vQueueDelete(uart.events);
+        uart.events = nullptr;
+    }
+    vSemaphoreDelete(uart.rxSignal);
+    return ESP_OK;
+}
+
+bool uart_is_driver_installed(uart_port_t port) {
+    return port < UART_NUM_MAX && uarts[port].installed;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t* config) {
+    if (port >= UART_NUM_MAX || !config) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uarts[port].baud = config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts) {
+    return port < UART_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud) {
+    if (port >= UART_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uarts[port].baud = baud;
+    return ESP_OK;
+}
+
+esp_err_t uart_get_baudrate(uart_port_t port, uint32_t* baud) {
+    if (port >= UART_NUM_MAX || !baud) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *baud = uarts[port].baud;
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port, char pattern, uint8_t count, int gapTimeout,
+                                            int postIdle, int preIdle) {
+    if (port >= UART_NUM_MAX || count != 1) {
+        return ESP_ERR_INVALID_ARG;     // One-character patterns are all the model detects
+    }
+    uarts[port].patternEnabled = true;
+    uarts[port].pattern = pattern;
+    return ESP_OK;
+}
+
+esp_err_t uart_disable_pattern_det_intr(uart_port_t port) {
+    if (port >= UART_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uarts[port].patternEnabled = false;
+    return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t port, int queueLength) {
+    if (port >= UART_NUM_MAX || !uarts[port].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uarts[port].patterns.clear();
+    uarts[port].patternCapacity = queueLength;
+    return ESP_OK;
+}
+
+// Relative to the ring's read position; -1 for none
+int uart_pattern_pop_pos(uart_port_t port) {
+    if (port >= UART_NUM_MAX) {
+        return -1;
+    }
+    SimUart& uart = uarts[port];
+    while (!uart.patterns.empty()) {
+        uint64_t at = uart.patterns.front();
+        uart.patterns.pop_front();
+        if (at >= uart.consumed) {
+            return (int)(at - uart.consumed);
+        }
+    }
+    return -1;
+}
+
+int uart_pattern_get_pos(uart_port_t port) {
+    if (port >= UART_NUM_MAX) {
+        return -1;
+    }
+    SimUart& uart = uarts[port];
+    return uart.patterns.empty() || uart.patterns.front() < uart.consumed
+               ? -1
+               : (int)(uart.patterns.front() - uart.consumed);
+}
+
+esp_err_t uart_flush_input(uart_port_t port) {
+    if (port >= UART_NUM_MAX || !uarts[port].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    SimUart& uart = uarts[port];
+    uart.consumed += uart.rx.size();
+    uart.rx.clear();
+    uart.patterns.clear();
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t* size) {
+    if (port >= UART_NUM_MAX || !size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *size = uarts[port].rx.size();
+    return ESP_OK;
+}
+
+// Until length bytes or the timeout, as the driver's; returns what it got
+int uart_read_bytes(uart_port_t port, void* buffer, uint32_t length, TickType_t ticks) {
+    sim::SimCall call;
+    if (port >= UART_NUM_MAX || !uarts[port].installed || !buffer) {
+        return -1;
+    }
+    SimUart& uart = uarts[port];
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    uint32_t got = 0;
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        while (got < length && !uart.rx.empty()) {
+            out[got++] = uart.rx.front();
+            uart.rx.pop_front();
+            uart.consumed++;
+        }
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (got == length || waited >= ticks) {
+            return got;
+        }
+        xSemaphoreTake(uart.rxSignal, ticks - waited);
+    }
+}
+
+// A zero-size TX buffer: the call returns once the rest fits in the FIFO
+int uart_write_bytes(uart_port_t port, const void* data, size_t size) {
+    sim::SimCall call;
+    if (port >= UART_NUM_MAX || !uarts[port].installed || !data) {
+        return -1;
+    }
+    SimUart& uart = uarts[port];
+    uint64_t now = sim::now();
+    uint64_t byteUs = 10 * 1000000ull / uart.baud;
+    uint64_t start = std::max(now, uart.txFreeAt);
+    uart.txFreeAt = start + size * byteUs;
+    sim::uartToDevice(port, static_cast<const uint8_t*>(data), size, uart.txFreeAt, uart.baud);
+    uint64_t queued = UART_FIFO_BYTES * byteUs;
+    if (uart.txFreeAt > now + queued) {
+        sim::sleepUntil(uart.txFreeAt - queued);
+    }
+    return (int)size;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks) {
+    sim::SimCall call;
+    if (port >= UART_NUM_MAX || !uarts[port].installed) {
+        return ESP_FAIL;
+    }
+    uint64_t deadline = sim::now() + (uint64_t)ticks * 1000000 / configTICK_RATE_HZ;
+    sim::sleepUntil(std::min(uarts[port].txFreeAt, deadline));
+    return sim::now() >= uarts[port].txFreeAt ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+// ===========================
+// Legacy I2C
+// ===========================
+
+// SCCB register writes to the camera: the sensor model keeps its own
+// registers, so these only take their bus time
+#define SCCB_CLOCK_HZ       100000
+
+struct I2cCommand {
+    size_t bytes;
+};
+
+i2c_cmd_handle_t i2c_cmd_link_create(void) {
+    return new I2cCommand{0};
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd) {
+    delete static_cast<I2cCommand*>(cmd);
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd) {
+    return cmd ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd) {
+    return cmd ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ackEnable) {
+    if (!cmd) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    static_cast<I2cCommand*>(cmd)->bytes++;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t* data, size_t length, bool ackEnable) {
+    if (!cmd) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    static_cast<I2cCommand*>(cmd)->bytes += length;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks) {
+    sim::SimCall call;
+    if (!cmd) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim::busy(static_cast<I2cCommand*>(cmd)->bytes * 9 * 1000000ull / SCCB_CLOCK_HZ);
+    return ESP_OK;
+}
+
+// ===========================
+// SPI
+// ===========================
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t* config, spi_common_dma_t dma) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host) {
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t* config,
+                             spi_device_handle_t* handle) {
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t* transaction) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t* transaction) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+// ===========================
+// ADC
+// ===========================
+
+#define ADC_FULL_SCALE_MV       3100        // 12 dB attenuation
+#define ADC_NOISE_LSB           3.0f
+#define ADC_BATTERY_DIVIDER     2.0f        // As wired on the board: BATTERY_DIVIDER_RATIO
+#define ADC_BATTERY_CHANNEL     ADC_CHANNEL_3
+#define ADC_BATTERY_GPIO        4
+
+struct adc_continuous_ctx_t {
+    uint32_t poolBytes;
+    uint32_t frameBytes;
+    uint32_t sampleHz;
+    adc_channel_t channel;
+    adc_continuous_evt_cbs_t callbacks;
+    void* userData;
+    bool running;
+    uint64_t startUs;
+    uint64_t consumedSamples;
+};
+
+struct adc_cali_scheme_t {
+    adc_atten_t atten;
+};
+
+// The raw code for the battery's pin now, noise and all
+static int adcBatteryRaw() {
+    static std::normal_distribution<float> noise(0.0f, ADC_NOISE_LSB);
+    float millivolts = sim::batteryVolts() * 1000.0f / ADC_BATTERY_DIVIDER;
+    float raw = millivolts / ADC_FULL_SCALE_MV * 4095.0f + noise(randomSource);
+    return std::max(0, std::min(4095, (int)lroundf(raw)));
+}
+
+esp_err_t adc_continuous_io_to_channel(int io, adc_unit_t* unit, adc_channel_t* channel) {
+    // ADC1 is GPIO 1-10 on the S3
+    if (io < 1 || io > 10 || !unit || !channel) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *unit = ADC_UNIT_1;
+    *channel = (adc_channel_t)(io - 1);
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t* config, adc_continuous_handle_t* out) {
+    if (!config || !out || config->conv_frame_size % SOC_ADC_DIGI_RESULT_BYTES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    adc_continuous_ctx_t* handle = new adc_continuous_ctx_t();
+    handle->poolBytes = config->max_store_buf_size;
+    handle->frameBytes = config->conv_frame_size;
+    *out = handle;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t* config) {
+    if (!handle || !config || config->pattern_num != 1 || config->format != ADC_DIGI_OUTPUT_FORMAT_TYPE2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->sampleHz = config->sample_freq_hz;
+    handle->channel = (adc_channel_t)config->adc_pattern[0].channel;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t handle, const adc_continuous_evt_cbs_t* cbs,
+                                                  void* user_data) {
+    if (!handle || !cbs || handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->callbacks = *cbs;
+    handle->userData = user_data;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle) {
+    sim::SimCall call;
+    if (!handle || handle->running || !handle->sampleHz) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->running = true;
+    handle->startUs = sim::now();
+    handle->consumedSamples = 0;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle) {
+    if (!handle || !handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->running = false;
+    return ESP_OK;
+}
+
+// Whole frames only reach the pool, and past its size the oldest drop
+esp_err_t adc_continuous_read(adc_continuous_handle_t handle, uint8_t* buf, uint32_t length_max, uint32_t* out_length,
+                              uint32_t timeout_ms) {
+    sim::SimCall call;
+    if (!handle || !buf || !out_length || !handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t frameSamples = handle->frameBytes / SOC_ADC_DIGI_RESULT_BYTES;
+    uint32_t poolSamples = handle->poolBytes / SOC_ADC_DIGI_RESULT_BYTES;
+    auto produced = [&]() {
+        uint64_t samples = (sim::now() - handle->startUs) * handle->sampleHz / 1000000;
+        return samples / frameSamples * frameSamples;
+    };
+
+    uint64_t available = produced();
+    if (available == handle->consumedSamples) {
+        uint64_t nextFrame = (available + frameSamples) * 1000000 / handle->sampleHz + handle->startUs + 1;
+        uint64_t deadline = sim::now() + (uint64_t)timeout_ms * 1000;
+        sim::sleepUntil(std::min(nextFrame, deadline));
+        available = produced();
+        if (available == handle->consumedSamples) {
+            *out_length = 0;
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    if (available - handle->consumedSamples > poolSamples) {
+        handle->consumedSamples = available - poolSamples;
+        if (handle->callbacks.on_pool_ovf) {
+            adc_continuous_evt_data_t data = {nullptr, 0};
+            handle->callbacks.on_pool_ovf(handle, &data, handle->userData);
+        }
+    }
+
+    uint32_t samples = std::min<uint64_t>(length_max / SOC_ADC_DIGI_RESULT_BYTES, available - handle->consumedSamples);
+    for (uint32_t i = 0; i < samples; i++) {
+        adc_digi_output_data_t sample;
+        sample.val = 0;
+        sample.type2.channel = handle->channel;
+        sample.type2.unit = 0;
+        sample.type2.data = handle->channel == ADC_BATTERY_CHANNEL ? adcBatteryRaw() : 0;
+        memcpy(&buf[i * SOC_ADC_DIGI_RESULT_BYTES], &sample, SOC_ADC_DIGI_RESULT_BYTES);
+    }
+    handle->consumedSamples += samples;
+    *out_length = samples * SOC_ADC_DIGI_RESULT_BYTES;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_deinit(adc_continuous_handle_t handle) {
+    if (!handle || handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    delete handle;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_create_scheme_curve_fitting(const adc_cali_curve_fitting_config_t* config,
+                                               adc_cali_handle_t* out) {
+    if (!config || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = new adc_cali_scheme_t{config->atten};
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_delete_scheme_curve_fitting(adc_cali_handle_t handle) {
+    delete handle;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int* voltage) {
+    if (!handle || !voltage) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *voltage = (int)lroundf(raw * (float)ADC_FULL_SCALE_MV / 4095.0f);
+    return ESP_OK;
+}
+
+// For analogRead() in sim_arduino.cpp
+int simAdcRaw(uint8_t pin) {
+    return pin == ADC_BATTERY_GPIO ? adcBatteryRaw() : 0;
+}
@@ -0,0 +1,1153 @@
+#include "sim_kernel.h"
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+// ===========================
+// Tasks
+// ===========================
+
+// Every task is a host thread, and a baton decides which one runs: the
+// holder runs until it blocks, or reaches a kernel call with its core
+// more than SIM_LOOKAHEAD_US ahead of whatever else could run, or with a
+// higher-priority task ready on its core. The next holder is always the
+// earliest thing that can happen - a running core's clock, an idle core
+// dispatching its best ready task, or a hardware task's wake - so nothing
+// sees an event from another core's future by more than the lookahead.
+
+enum class TaskState : uint8_t { READY, RUNNING, BLOCKED, SUSPENDED, DELETED };
+
+enum class NotifyState : uint8_t { NOT_WAITING, WAITING, RECEIVED };
+
+struct SimTask {
+    uint32_t* topOfStack;               // First, as in a TCB - the task watchdog reads it
+    uint8_t* stack;
+    uint32_t stackBytes;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t entry;
+    void* param;
+    UBaseType_t priority;
+    BaseType_t affinity;
+    bool hardware;
+    bool idle;
+    uint32_t number;
+
+    TaskState state;
+    uint64_t readyAt;                   // Ready: since; blocked: the timeout
+    bool woken;                         // By an event rather than the timeout
+    int core;
+    uint64_t hwTime;                    // Hardware tasks' own clock
+    uint64_t dispatchedAt;
+    uint64_t cpuMark;                   // Host thread CPU ns last charged up to
+    uint64_t cpuRemainder;              // Host ns short of a whole charged microsecond
+
+    uint32_t notifyValue;
+    NotifyState notifyState;
+
+    uint64_t runUs;
+    uint64_t burstUs;                   // This activation so far
+    uint32_t activations;
+    uint32_t preemptions;
+    uint32_t burstBuckets[12];
+
+    std::condition_variable cv;
+    std::thread thread;
+};
+
+const uint32_t sim::burstBoundsUs[11] = {50, 100, 250, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000};
+
+struct SimQueue {
+    enum class Kind : uint8_t { QUEUE, MUTEX, RECURSIVE_MUTEX, COUNTING };
+
+    Kind kind;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t count;                  // Semaphores
+    SimTask* holder;                    // Mutexes
+    UBaseType_t recursion;
+    std::vector<SimTask*> sendWaiters;
+    std::vector<SimTask*> receiveWaiters;
+};
+
+namespace {
+
+struct Kernel {
+    sim::Options options = {60ull * 60 * 1000000, 20.0f};
+
+    std::mutex mutex;
+    std::condition_variable mainCv;
+    SimTask* baton = nullptr;
+    bool finished = false;
+    const char* finishReason = nullptr;
+
+    uint64_t clock[portNUM_PROCESSORS] = {};
+    SimTask* current[portNUM_PROCESSORS] = {};
+    SimTask idle[portNUM_PROCESSORS];
+    std::vector<SimTask*> tasks;
+    uint32_t nextNumber = 1;
+    uint64_t switches = 0;
+
+    uint32_t criticalDepth = 0;
+    bool inIsr = false;
+    uint32_t cpuMhz = SIM_REFERENCE_MHZ;
+};
+
+Kernel& K() {
+    static Kernel kernel;
+    return kernel;
+}
+
+thread_local SimTask* self = nullptr;
+thread_local int callDepth = 0;
+
+uint64_t threadCpuNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+bool onCore(const SimTask* task) {
+    return task && !task->hardware;
+}
+
+uint64_t timeOf(const SimTask* task) {
+    Kernel& k = K();
+    if (!task) {
+        return std::max(k.clock[0], k.clock[1]);
+    }
+    return task->hardware ? task->hwTime : k.clock[task->core];
+}
+
+// Host CPU since the last charge, onto the caller's core
+void chargeCpu() {
+    Kernel& k = K();
+    if (!onCore(self) || self->state != TaskState::RUNNING) {
+        return;
+    }
+    uint64_t us;
+    if (k.options.cpuScale > 0) {
+        uint64_t cpu = threadCpuNs();
+        float scale = k.options.cpuScale * SIM_REFERENCE_MHZ / k.cpuMhz;
+        uint64_t ns = (uint64_t)((cpu - self->cpuMark) * scale) + self->cpuRemainder;
+        self->cpuMark = cpu;
+        us = ns / 1000;
+        self->cpuRemainder = ns % 1000;
+    } else {
+        us = SIM_CALL_US * SIM_REFERENCE_MHZ / k.cpuMhz;
+    }
+    k.clock[self->core] += us;
+    self->runUs += us;
+    self->burstUs += us;
+}
+
+void endBurst(SimTask* task) {
+    uint8_t bucket = 0;
+    while (bucket < 11 && task->burstUs > sim::burstBoundsUs[bucket]) {
+        bucket++;
+    }
+    task->burstBuckets[bucket]++;
+    task->activations++;
+    task->burstUs = 0;
+}
+
+bool eligible(const SimTask* task, int core) {
+    return !task->hardware && !task->idle &&
+           (task->state == TaskState::READY ||
+            (task->state == TaskState::BLOCKED && task->readyAt != SIM_TIME_NEVER)) &&
+           (task->affinity == core || task->affinity == tskNO_AFFINITY);
+}
+
+// Ranks ready tasks: priority, then the longest ready, then creation
+bool before(const SimTask* a, const SimTask* b) {
+    if (a->priority != b->priority) {
+        return a->priority > b->priority;
+    }
+    if (a->readyAt != b->readyAt) {
+        return a->readyAt < b->readyAt;
+    }
+    return a->number < b->number;
+}
+
+// The best task for core at time, nullptr for none ready by then
+SimTask* bestFor(int core, uint64_t time) {
+    SimTask* best = nullptr;
+    for (SimTask* task : K().tasks) {
+        if (eligible(task, core) && task->readyAt <= time && (!best || before(task, best))) {
+            best = task;
+        }
+    }
+    return best;
+}
+
+struct Pick {
+    enum class Kind : uint8_t { NONE, HARDWARE, RUN, DISPATCH } kind;
+    uint64_t time;
+    int core;
+    SimTask* task;
+};
+
+Pick pickNext() {
+    Kernel& k = K();
+    Pick pick = {Pick::Kind::NONE, SIM_TIME_NEVER, -1, nullptr};
+
+    for (SimTask* task : k.tasks) {
+        if (task->hardware && (task->state == TaskState::READY || task->state == TaskState::BLOCKED) &&
+            task->readyAt < pick.time) {
+            pick = {Pick::Kind::HARDWARE, task->readyAt, -1, task};
+        }
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (k.current[core]) {
+            if (k.clock[core] < pick.time) {
+                pick = {Pick::Kind::RUN, k.clock[core], core, k.current[core]};
+            }
+            continue;
+        }
+        uint64_t earliest = SIM_TIME_NEVER;
+        for (SimTask* task : k.tasks) {
+            if (eligible(task, core)) {
+                earliest = std::min(earliest, task->readyAt);
+            }
+        }
+        if (earliest == SIM_TIME_NEVER) {
+            continue;
+        }
+        uint64_t time = std::max(k.clock[core], earliest);
+        if (time < pick.time) {
+            pick = {Pick::Kind::DISPATCH, time, core, bestFor(core, time)};
+        }
+    }
+    return pick;
+}
+
+void finishLocked(std::unique_lock<std::mutex>& lock, const char* reason) {
+    Kernel& k = K();
+    if (!k.finished) {
+        k.finished = true;
+        k.finishReason = reason;
+    }
+    k.baton = nullptr;
+    k.mainCv.notify_all();
+}
+
+// Give the baton to next and wait to get it back; returns at once if it's ours
+void handOver(SimTask* next) {
+    Kernel& k = K();
+    SimTask* me = self;
+    if (next == me) {
+        return;
+    }
+    k.switches++;
+    std::unique_lock<std::mutex> lock(k.mutex);
+    k.baton = next;
+    next->cv.notify_one();
+    me->cv.wait(lock, [&] { return k.baton == me; });
+}
+
+// Whatever runs next, given that self has stopped or may be overtaken
+void dispatch() {
+    Kernel& k = K();
+    Pick pick = pickNext();
+    if (pick.kind == Pick::Kind::NONE || pick.time >= k.options.endUs) {
+        sim::stop(pick.kind == Pick::Kind::NONE ? "every task blocked for good" : "end of the flight profile");
+    }
+
+    SimTask* next = pick.task;
+    switch (pick.kind) {
+        case Pick::Kind::HARDWARE:
+            next->hwTime = pick.time;
+            next->state = TaskState::RUNNING;
+            break;
+        case Pick::Kind::RUN:
+            break;
+        case Pick::Kind::DISPATCH: {
+            uint64_t idleUs = pick.time - k.clock[pick.core];
+            k.idle[pick.core].runUs += idleUs;
+            k.clock[pick.core] = pick.time;
+            next->state = TaskState::RUNNING;
+            next->core = pick.core;
+            next->dispatchedAt = pick.time;
+            k.current[pick.core] = next;
+            break;
+        }
+        case Pick::Kind::NONE:
+            break;
+    }
+    handOver(next);
+}
+
+// At a kernel call's way out: let a higher-priority task in, or a core behind this one catch up
+void checkpoint() {
+    Kernel& k = K();
+    if (!onCore(self) || k.criticalDepth || k.inIsr || self->state != TaskState::RUNNING) {
+        return;
+    }
+    int core = self->core;
+    SimTask* contender = bestFor(core, k.clock[core]);
+    bool preempt = contender &&
+                   (contender->priority > self->priority ||
+                    (contender->priority == self->priority &&
+                     k.clock[core] - self->dispatchedAt >= 1000000 / configTICK_RATE_HZ));
+    if (preempt) {
+        self->state = TaskState::READY;
+        self->readyAt = k.clock[core];
+        self->preemptions++;
+        k.current[core] = nullptr;
+        dispatch();
+        return;
+    }
+    Pick pick = pickNext();
+    if (pick.kind == Pick::Kind::RUN && pick.task == self) {
+        return;
+    }
+    if (pick.kind != Pick::Kind::NONE && k.clock[core] <= pick.time + SIM_LOOKAHEAD_US &&
+        k.clock[core] < k.options.endUs) {
+        return;
+    }
+    dispatch();
+}
+
+// Block self until woken or deadline; true when woken
+bool blockUntil(uint64_t deadline) {
+    Kernel& k = K();
+    if (!self) {
+        return false;
+    }
+    if (k.criticalDepth || k.inIsr) {
+        fprintf(stderr, "sim: %s blocked inside a critical section or ISR\n", self->name);
+        abort();
+    }
+    if (onCore(self)) {
+        k.current[self->core] = nullptr;
+        endBurst(self);
+    }
+    self->state = TaskState::BLOCKED;
+    self->readyAt = deadline;
+    self->woken = false;
+    dispatch();
+    return self->woken;
+}
+
+uint64_t tickDeadline(TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        return SIM_TIME_NEVER;
+    }
+    uint64_t tickUs = 1000000 / configTICK_RATE_HZ;
+    return (timeOf(self) / tickUs + ticks) * tickUs;
+}
+
+void wake(SimTask* task) {
+    if (task->state != TaskState::BLOCKED) {
+        return;
+    }
+    task->state = TaskState::READY;
+    task->readyAt = timeOf(self);
+    task->woken = true;
+}
+
+void wakeFirst(std::vector<SimTask*>& waiters) {
+    // A waiter deleted or suspended meanwhile is no longer waiting
+    for (auto it = waiters.begin(); it != waiters.end();) {
+        it = (*it)->state == TaskState::BLOCKED ? it + 1 : waiters.erase(it);
+    }
+    if (waiters.empty()) {
+        return;
+    }
+    auto best = waiters.begin();
+    for (auto it = waiters.begin(); it != waiters.end(); ++it) {
+        if ((*it)->priority > (*best)->priority) {
+            best = it;
+        }
+    }
+    SimTask* task = *best;
+    waiters.erase(best);
+    wake(task);
+}
+
+void forget(std::vector<SimTask*>& waiters, SimTask* task) {
+    for (auto it = waiters.begin(); it != waiters.end(); ++it) {
+        if (*it == task) {
+            waiters.erase(it);
+            return;
+        }
+    }
+}
+
+void taskMain(SimTask* task) {
+    Kernel& k = K();
+    {
+        std::unique_lock<std::mutex> lock(k.mutex);
+        task->cv.wait(lock, [&] { return k.baton == task; });
+    }
+    self = task;
+    task->cpuMark = threadCpuNs();
+    task->entry(task->param);
+    // A FreeRTOS task may not return
+    fprintf(stderr, "sim: task %s returned\n", task->name);
+    vTaskDelete(nullptr);
+}
+
+SimTask* newTask(TaskFunction_t entry, const char* name, uint32_t stackBytes, void* param, UBaseType_t priority,
+                 BaseType_t core, bool hardware) {
+    Kernel& k = K();
+    SimTask* task = new SimTask();
+    strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+    task->entry = entry;
+    task->param = param;
+    task->priority = std::min<UBaseType_t>(priority, configMAX_PRIORITIES - 1);
+    task->affinity = core;
+    task->hardware = hardware;
+    task->number = k.nextNumber++;
+    task->stackBytes = stackBytes;
+    task->stack = (uint8_t*)calloc(1, stackBytes);
+    task->topOfStack = (uint32_t*)(task->stack + stackBytes - 64);
+    task->state = TaskState::READY;
+    task->readyAt = timeOf(self);
+    task->core = core == tskNO_AFFINITY ? 0 : core;
+    task->hwTime = task->readyAt;
+    task->notifyState = NotifyState::NOT_WAITING;
+    k.tasks.push_back(task);
+    task->thread = std::thread(taskMain, task);
+    task->thread.detach();
+    return task;
+}
+
+}  // namespace
+
+// ===========================
+// Simulation Interface
+// ===========================
+
+sim::SimCall::SimCall() {
+    if (callDepth++ == 0) {
+        chargeCpu();
+    }
+}
+
+sim::SimCall::~SimCall() {
+    if (--callDepth == 0 && self) {
+        checkpoint();
+        self->cpuMark = threadCpuNs();
+    }
+}
+
+uint64_t sim::now() {
+    return timeOf(self);
+}
+
+void sim::busy(uint64_t us) {
+    Kernel& k = K();
+    if (!self) {
+        return;
+    }
+    if (self->hardware) {
+        self->hwTime += us;
+        return;
+    }
+    k.clock[self->core] += us;
+    self->runUs += us;
+    self->burstUs += us;
+}
+
+void sim::sleep(uint64_t us) {
+    sleepUntil(now() + us);
+}
+
+void sim::sleepUntil(uint64_t us) {
+    SimCall call;
+    if (us > now()) {
+        blockUntil(us);
+    }
+}
+
+TaskHandle_t sim::createHardwareTask(TaskFunction_t entry, const char* name, void* param, UBaseType_t priority) {
+    return newTask(entry, name, 4096, param, priority, tskNO_AFFINITY, true);
+}
+
+bool sim::isHardwareTask(TaskHandle_t task) {
+    return task && task->hardware;
+}
+
+void sim::runIsr(void (*handler)(void*), void* arg) {
+    Kernel& k = K();
+    bool outer = k.inIsr;
+    k.inIsr = true;
+    handler(arg);
+    k.inIsr = outer;
+}
+
+void sim::configure(const Options& options) {
+    K().options = options;
+}
+
+void sim::setCpuMhz(uint32_t mhz) {
+    K().cpuMhz = mhz ? mhz : SIM_REFERENCE_MHZ;
+}
+
+uint32_t sim::cpuMhz() {
+    return K().cpuMhz;
+}
+
+const char* sim::run() {
+    Kernel& k = K();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        SimTask& idle = k.idle[core];
+        snprintf(idle.name, sizeof(idle.name), "IDLE%d", core);
+        idle.idle = true;
+        idle.affinity = core;
+        idle.core = core;
+        idle.state = TaskState::READY;
+        idle.number = k.nextNumber++;
+    }
+
+    Pick pick = pickNext();
+    if (pick.kind == Pick::Kind::NONE) {
+        return "no tasks";
+    }
+    std::unique_lock<std::mutex> lock(k.mutex);
+    SimTask* first = pick.task;
+    if (pick.kind == Pick::Kind::DISPATCH) {
+        first->state = TaskState::RUNNING;
+        first->core = pick.core;
+        k.current[pick.core] = first;
+    } else if (pick.kind == Pick::Kind::HARDWARE) {
+        first->state = TaskState::RUNNING;
+    }
+    k.baton = first;
+    first->cv.notify_one();
+    k.mainCv.wait(lock, [&] { return k.finished; });
+    return k.finishReason;
+}
+
+void sim::stop(const char* reason) {
+    Kernel& k = K();
+    SimTask* me = self;
+    std::unique_lock<std::mutex> lock(k.mutex);
+    finishLocked(lock, reason);
+    if (!me) {
+        abort();
+    }
+    for (;;) {
+        me->cv.wait(lock);
+    }
+}
+
+uint64_t sim::coreClock(int core) {
+    return K().clock[core];
+}
+
+uint64_t sim::coreIdleUs(int core) {
+    return K().idle[core].runUs;
+}
+
+bool sim::taskReport(size_t index, TaskReport& report) {
+    for (SimTask* task : K().tasks) {
+        if (task->hardware) {
+            continue;
+        }
+        if (index-- == 0) {
+            report.name = task->name;
+            report.core = task->affinity == tskNO_AFFINITY ? -1 : task->affinity;
+            report.priority = task->priority;
+            report.runUs = task->runUs;
+            report.activations = task->activations;
+            report.preemptions = task->preemptions;
+            memcpy(report.burstBuckets, task->burstBuckets, sizeof(report.burstBuckets));
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t sim::switchCount() {
+    return K().switches;
+}
+
+// ===========================
+// Port
+// ===========================
+
+void simEnterCritical(portMUX_TYPE* mux) {
+    sim::SimCall call;
+    K().criticalDepth++;
+    mux->count++;
+}
+
+void simExitCritical(portMUX_TYPE* mux) {
+    sim::SimCall call;
+    K().criticalDepth--;
+    mux->count--;
+}
+
+void simYield() {
+    sim::SimCall call;
+    Kernel& k = K();
+    if (onCore(self) && !k.criticalDepth && !k.inIsr) {
+        SimTask* contender = bestFor(self->core, k.clock[self->core]);
+        if (contender && contender->priority >= self->priority) {
+            self->state = TaskState::READY;
+            self->readyAt = k.clock[self->core];
+            k.current[self->core] = nullptr;
+            dispatch();
+        }
+    }
+}
+
+BaseType_t simInIsr() {
+    return K().inIsr ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xPortGetCoreID() {
+    return onCore(self) ? self->core : 0;
+}
+
+// ===========================
+// Tasks
+// ===========================
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t core) {
+    sim::SimCall call;
+    bool hardware = self && self->hardware;
+    TaskHandle_t task = newTask(entry, name, stackDepth, param, priority, core, hardware);
+    if (created) {
+        *created = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* param,
+                       UBaseType_t priority, TaskHandle_t* created) {
+    return xTaskCreatePinnedToCore(entry, name, stackDepth, param, priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    sim::SimCall call;
+    Kernel& k = K();
+    SimTask* target = task ? task : self;
+    if (!target || target->state == TaskState::DELETED) {
+        return;
+    }
+    if (target->state == TaskState::RUNNING && onCore(target)) {
+        k.current[target->core] = nullptr;
+        endBurst(target);
+    }
+    target->state = TaskState::DELETED;
+    target->readyAt = SIM_TIME_NEVER;
+    // The thread parks where it is for good; its stack stays for anything still pointing into it
+    if (target == self) {
+        dispatch();
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim::SimCall call;
+    if (ticks == 0) {
+        simYield();
+        return;
+    }
+    blockUntil(tickDeadline(ticks));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t* previousWake, TickType_t increment) {
+    sim::SimCall call;
+    uint64_t tickUs = 1000000 / configTICK_RATE_HZ;
+    TickType_t target = *previousWake + increment;
+    TickType_t nowTicks = (TickType_t)(sim::now() / tickUs);
+    *previousWake = target;
+    if ((int32_t)(target - nowTicks) <= 0) {
+        return pdFALSE;
+    }
+    blockUntil((sim::now() / tickUs + (TickType_t)(target - nowTicks)) * tickUs);
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount() {
+    sim::SimCall call;
+    return (TickType_t)(sim::now() / (1000000 / configTICK_RATE_HZ));
+}
+
+TickType_t xTaskGetTickCountFromISR() {
+    return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return self;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t core) {
+    Kernel& k = K();
+    return k.current[core] ? k.current[core] : &k.idle[core];
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(BaseType_t core) {
+    return &K().idle[core];
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core) {
+    return &K().idle[core];
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+    SimTask* target = task ? task : self;
+    return target ? target->name : nullptr;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    SimTask* target = task ? task : self;
+    return target ? target->priority : 0;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    sim::SimCall call;
+    SimTask* target = task ? task : self;
+    if (target) {
+        target->priority = std::min<UBaseType_t>(priority, configMAX_PRIORITIES - 1);
+    }
+}
+
+eTaskState eTaskGetState(TaskHandle_t task) {
+    if (!task) {
+        return eInvalid;
+    }
+    if (task->idle) {
+        return K().current[task->core] ? eReady : eRunning;
+    }
+    switch (task->state) {
+        case TaskState::RUNNING: return eRunning;
+        case TaskState::READY: return eReady;
+        case TaskState::BLOCKED: return eBlocked;
+        case TaskState::SUSPENDED: return eSuspended;
+        case TaskState::DELETED: return eDeleted;
+    }
+    return eInvalid;
+}
+
+// Host stacks aren't the target's - a fixed three quarters free, so nothing reports an overflow it can't know about
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    SimTask* target = task ? task : self;
+    return target ? target->stackBytes * 3 / 4 : 0;
+}
+
+uint8_t* pxTaskGetStackStart(TaskHandle_t task) {
+    SimTask* target = task ? task : self;
+    return target ? target->stack : nullptr;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks() {
+    UBaseType_t count = portNUM_PROCESSORS;
+    for (SimTask* task : K().tasks) {
+        count += !task->hardware && task->state != TaskState::DELETED;
+    }
+    return count;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t count, configRUN_TIME_COUNTER_TYPE* totalRunTime) {
+    sim::SimCall call;
+    Kernel& k = K();
+    if (count < uxTaskGetNumberOfTasks()) {
+        return 0;
+    }
+    UBaseType_t used = 0;
+    auto add = [&](SimTask* task) {
+        TaskStatus_t& entry = status[used++];
+        entry.xHandle = task;
+        entry.pcTaskName = task->name;
+        entry.xTaskNumber = task->number;
+        entry.eCurrentState = eTaskGetState(task);
+        entry.uxCurrentPriority = task->priority;
+        entry.uxBasePriority = task->priority;
+        entry.ulRunTimeCounter = (configRUN_TIME_COUNTER_TYPE)task->runUs;
+        entry.pxStackBase = (StackType_t*)task->stack;
+        entry.usStackHighWaterMark = uxTaskGetStackHighWaterMark(task);
+        entry.xCoreID = task->affinity;
+    };
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        add(&k.idle[core]);
+        // Idle time is booked as a core jumps ahead; an idle core's gap up to now is idle too
+        uint64_t now = sim::now();
+        if (!k.current[core] && now > k.clock[core]) {
+            status[used - 1].ulRunTimeCounter += (configRUN_TIME_COUNTER_TYPE)(now - k.clock[core]);
+        }
+    }
+    for (SimTask* task : k.tasks) {
+        if (!task->hardware && task->state != TaskState::DELETED) {
+            add(task);
+        }
+    }
+    if (totalRunTime) {
+        *totalRunTime = (configRUN_TIME_COUNTER_TYPE)sim::now();
+    }
+    return used;
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+    sim::SimCall call;
+    Kernel& k = K();
+    SimTask* target = task ? task : self;
+    if (!target || target->state == TaskState::DELETED) {
+        return;
+    }
+    if (target->state == TaskState::RUNNING && onCore(target)) {
+        k.current[target->core] = nullptr;
+        endBurst(target);
+    }
+    target->state = TaskState::SUSPENDED;
+    target->readyAt = SIM_TIME_NEVER;
+    if (target == self) {
+        dispatch();
+    }
+}
+
+void vTaskResume(TaskHandle_t task) {
+    sim::SimCall call;
+    if (task && task->state == TaskState::SUSPENDED) {
+        task->state = TaskState::READY;
+        task->readyAt = sim::now();
+    }
+}
+
+void vTaskSuspendAll() {
+    K().criticalDepth++;
+}
+
+BaseType_t xTaskResumeAll() {
+    K().criticalDepth--;
+    return pdFALSE;
+}
+
+// ===========================
+// Notifications
+// ===========================
+
+static BaseType_t notify(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t* previous) {
+    if (!task) {
+        return pdFAIL;
+    }
+    if (previous) {
+        *previous = task->notifyValue;
+    }
+    NotifyState was = task->notifyState;
+    BaseType_t result = pdPASS;
+    switch (action) {
+        case eNoAction:
+            break;
+        case eSetBits:
+            task->notifyValue |= value;
+            break;
+        case eIncrement:
+            task->notifyValue++;
+            break;
+        case eSetValueWithOverwrite:
+            task->notifyValue = value;
+            break;
+        case eSetValueWithoutOverwrite:
+            if (was == NotifyState::RECEIVED) {
+                result = pdFAIL;
+            } else {
+                task->notifyValue = value;
+            }
+            break;
+    }
+    task->notifyState = NotifyState::RECEIVED;
+    if (was == NotifyState::WAITING) {
+        wake(task);
+    }
+    return result;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t* previous) {
+    sim::SimCall call;
+    return notify(task, value, action, previous);
+}
+
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t* previous,
+                                     BaseType_t* woken) {
+    sim::SimCall call;
+    BaseType_t result = notify(task, value, action, previous);
+    if (woken && self && task->priority > self->priority) {
+        *woken = pdTRUE;
+    }
+    return result;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t* value, TickType_t ticks) {
+    sim::SimCall call;
+    if (self->notifyState != NotifyState::RECEIVED) {
+        self->notifyValue &= ~clearOnEntry;
+        if (ticks > 0) {
+            self->notifyState = NotifyState::WAITING;
+            blockUntil(tickDeadline(ticks));
+        }
+    }
+    if (value) {
+        *value = self->notifyValue;
+    }
+    BaseType_t received = self->notifyState == NotifyState::RECEIVED ? pdTRUE : pdFALSE;
+    if (received) {
+        self->notifyValue &= ~clearOnExit;
+    }
+    self->notifyState = NotifyState::NOT_WAITING;
+    return received;
+}
+
+static uint32_t notifyTake(BaseType_t clearOnExit, bool wait, uint64_t deadline) {
+    if (self->notifyValue == 0 && wait) {
+        self->notifyState = NotifyState::WAITING;
+        blockUntil(deadline);
+    }
+    uint32_t value = self->notifyValue;
+    if (value) {
+        self->notifyValue = clearOnExit ? 0 : value - 1;
+    }
+    self->notifyState = NotifyState::NOT_WAITING;
+    return value;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    sim::SimCall call;
+    return notifyTake(clearOnExit, ticks > 0, tickDeadline(ticks));
+}
+
+uint32_t sim::notifyTakeUntil(uint64_t deadline) {
+    SimCall call;
+    return notifyTake(pdTRUE, deadline > now(), deadline);
+}
+
+BaseType_t xTaskNotifyStateClear(TaskHandle_t task) {
+    SimTask* target = task ? task : self;
+    BaseType_t was = target->notifyState == NotifyState::RECEIVED ? pdTRUE : pdFALSE;
+    target->notifyState = NotifyState::NOT_WAITING;
+    return was;
+}
+
+// ===========================
+// Queues and Semaphores
+// ===========================
+
+static QueueHandle_t newQueue(SimQueue::Kind kind, UBaseType_t length, UBaseType_t itemSize, UBaseType_t count) {
+    SimQueue* queue = new SimQueue();
+    queue->kind = kind;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->count = count;
+    queue->holder = nullptr;
+    queue->recursion = 0;
+    return queue;
+}
+
+// Tries op until it succeeds or ticks pass, waiting on waiters in between
+template <typename Op>
+static BaseType_t waitFor(std::vector<SimTask*>& waiters, TickType_t ticks, Op op) {
+    uint64_t deadline = tickDeadline(ticks);
+    while (!op()) {
+        if (ticks == 0 || !self || K().inIsr || sim::now() >= deadline) {
+            return pdFAIL;
+        }
+        waiters.push_back(self);
+        blockUntil(deadline);
+        forget(waiters, self);
+    }
+    return pdPASS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    sim::SimCall call;
+    return newQueue(SimQueue::Kind::QUEUE, length, itemSize, 0);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    sim::SimCall call;
+    delete queue;
+}
+
+static bool pushItem(QueueHandle_t queue, const void* item, bool toFront) {
+    if (queue->items.size() >= queue->length) {
+        return false;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(item);
+    std::vector<uint8_t> copy(bytes, bytes + queue->itemSize);
+    if (toFront) {
+        queue->items.push_front(std::move(copy));
+    } else {
+        queue->items.push_back(std::move(copy));
+    }
+    wakeFirst(queue->receiveWaiters);
+    return true;
+}
+
+static bool popItem(QueueHandle_t queue, void* item, bool remove) {
+    if (queue->items.empty()) {
+        return false;
+    }
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    if (remove) {
+        queue->items.pop_front();
+        wakeFirst(queue->sendWaiters);
+    }
+    return true;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t queue, const void* item, TickType_t ticks, BaseType_t toFront) {
+    sim::SimCall call;
+    return waitFor(queue->sendWaiters, ticks, [&] { return pushItem(queue, item, toFront); });
+}
+
+BaseType_t xQueueGenericSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken, BaseType_t toFront) {
+    sim::SimCall call;
+    if (!pushItem(queue, item, toFront)) {
+        return errQUEUE_FULL;
+    }
+    if (woken) {
+        *woken = pdTRUE;
+    }
+    return pdPASS;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) {
+    sim::SimCall call;
+    queue->items.clear();
+    pushItem(queue, item, false);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    sim::SimCall call;
+    return waitFor(queue->receiveWaiters, ticks, [&] { return popItem(queue, item, true); });
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void* item, BaseType_t* woken) {
+    sim::SimCall call;
+    return popItem(queue, item, true) ? pdPASS : pdFAIL;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticks) {
+    sim::SimCall call;
+    return waitFor(queue->receiveWaiters, ticks, [&] { return popItem(queue, item, false); });
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    sim::SimCall call;
+    queue->items.clear();
+    while (!queue->sendWaiters.empty()) {
+        wakeFirst(queue->sendWaiters);
+    }
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    if (queue->kind != SimQueue::Kind::QUEUE) {
+        return queue->count;
+    }
+    return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    return queue->length - queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    sim::SimCall call;
+    return newQueue(SimQueue::Kind::MUTEX, 1, 0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+    sim::SimCall call;
+    return newQueue(SimQueue::Kind::RECURSIVE_MUTEX, 1, 0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    sim::SimCall call;
+    return newQueue(SimQueue::Kind::COUNTING, 1, 0, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+    sim::SimCall call;
+    return newQueue(SimQueue::Kind::COUNTING, maxCount, 0, initialCount);
+}
+
+static bool takeOne(SemaphoreHandle_t semaphore) {
+    if (semaphore->count == 0) {
+        return false;
+    }
+    semaphore->count--;
+    semaphore->holder = self;
+    return true;
+}
+
+static bool giveOne(SemaphoreHandle_t semaphore) {
+    if (semaphore->count >= semaphore->length) {
+        return false;
+    }
+    semaphore->count++;
+    semaphore->holder = nullptr;
+    wakeFirst(semaphore->receiveWaiters);
+    return true;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    sim::SimCall call;
+    return waitFor(semaphore->receiveWaiters, ticks, [&] { return takeOne(semaphore); });
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    sim::SimCall call;
+    return giveOne(semaphore) ? pdPASS : pdFAIL;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    sim::SimCall call;
+    if (semaphore->holder == self && self) {
+        semaphore->recursion++;
+        return pdPASS;
+    }
+    BaseType_t taken = waitFor(semaphore->receiveWaiters, ticks, [&] { return takeOne(semaphore); });
+    if (taken) {
+        semaphore->recursion = 1;
+    }
+    return taken;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+    sim::SimCall call;
+    if (semaphore->holder != self || semaphore->recursion == 0) {
+        return pdFAIL;
+    }
+    if (--semaphore->recursion == 0) {
+        giveOne(semaphore);
+    }
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken) {
+    sim::SimCall call;
+    if (!giveOne(semaphore)) {
+        return pdFAIL;
+    }
+    if (woken) {
+        *woken = pdTRUE;
+    }
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken) {
+    sim::SimCall call;
+    return takeOne(semaphore) ? pdPASS : pdFAIL;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+    return semaphore->count;
+}
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t semaphore) {
+    return semaphore->count == 0 ? semaphore->holder : nullptr;
+}
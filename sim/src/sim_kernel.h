@@ -0,0 +1,103 @@
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// ===========================
+// Native Simulation - Kernel
+// Virtual time, the two simulated cores and the tasks on them
+// ===========================
+
+// Time is virtual microseconds since reset. A firmware task is charged
+// the host CPU time it takes between kernel calls, times cpuScale - the
+// host's speed over the S3's at SIM_REFERENCE_MHZ - on the core it runs on,
+// stretched when the firmware slows the clock; cpuScale 0 charges a fixed
+// SIM_CALL_US per call instead, which is repeatable run to run.
+//
+// Hardware tasks model the world outside the chip - the GPS, the far end
+// of the radio link, the battery - and any tasks they create are hardware
+// too. They sit on no core and cost nothing: they run at their wake time
+// and their clock only moves when they sleep.
+//
+// The shims wrap each entry point in a SimCall, which charges the caller
+// up to the call, keeps the shim's own host time off the bill, and on the
+// way out lets a higher-priority task or a core that has fallen behind
+// take over.
+
+#define SIM_CALL_US         1           // Per kernel call with cpuScale 0
+#define SIM_REFERENCE_MHZ   240         // The clock cpuScale is measured at
+#define SIM_LOOKAHEAD_US    100         // A core may run this far past the other before it hands over
+#define SIM_TIME_NEVER      UINT64_MAX
+
+namespace sim {
+
+struct Options {
+    uint64_t endUs;                     // The run stops here
+    float cpuScale;                     // Host CPU time to target CPU time; 0 = SIM_CALL_US per call
+};
+
+class SimCall {
+public:
+    SimCall();
+    ~SimCall();
+    SimCall(const SimCall&) = delete;
+    SimCall& operator=(const SimCall&) = delete;
+};
+
+// The caller's time: its core's clock, or a hardware task's own
+uint64_t now();
+// The caller is busy on its core this long - a busy-wait, a bus transfer
+void busy(uint64_t us);
+// The caller blocks this long and its core runs something else
+void sleep(uint64_t us);
+void sleepUntil(uint64_t us);
+// ulTaskNotifyTake(pdTRUE, ...) to the microsecond rather than the tick
+uint32_t notifyTakeUntil(uint64_t deadline);
+
+// Create a task as hardware, whoever the caller is
+TaskHandle_t createHardwareTask(TaskFunction_t entry, const char* name, void* param, UBaseType_t priority);
+bool isHardwareTask(TaskHandle_t task);
+
+// setCpuFrequencyMhz(): both cores' code takes longer in proportion
+void setCpuMhz(uint32_t mhz);
+uint32_t cpuMhz();
+
+// An interrupt handler, run from a hardware task as the chip would
+void runIsr(void (*handler)(void*), void* arg);
+
+// Set up before the first task, then run until the end time, a deep sleep
+// or a reset; returns why it stopped, on the main thread, with every task
+// parked
+void configure(const Options& options);
+const char* run();
+// From any task: stop the run now
+[[noreturn]] void stop(const char* reason);
+
+// ===========================
+// Report
+// ===========================
+
+struct TaskReport {
+    const char* name;
+    int core;                           // -1 unpinned
+    UBaseType_t priority;
+    uint64_t runUs;
+    uint32_t activations;               // Wakes that ran
+    uint32_t preemptions;
+    // Run time per activation, wake to block
+    uint32_t burstBuckets[12];
+};
+
+extern const uint32_t burstBoundsUs[11];
+
+uint64_t coreClock(int core);
+uint64_t coreIdleUs(int core);
+// Firmware tasks, not hardware; false past the last
+bool taskReport(size_t index, TaskReport& report);
+uint64_t switchCount();
+
+}  // namespace sim
+
+#endif // SIM_KERNEL_H
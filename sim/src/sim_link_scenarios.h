@@ -0,0 +1,43 @@
+#ifndef SIM_LINK_SCENARIOS_H
+#define SIM_LINK_SCENARIOS_H
+
+#include "link_sim.h"
+
+// ===========================
+// Native Simulation - Link Scenarios
+// The link layer alone over a SimulatedLink, scenario by scenario: goodput,
+// latency and airtime efficiency. Run with --link-scenarios in place of a
+// flight
+// ===========================
+
+#define LINK_SIM_MAX_PACKETS       256     // Per scenario
+#define LINK_SIM_SETTLE_MS         1000    // Quiet time after the last ACK before a scenario ends
+#define LINK_SIM_STAMP_BYTES       6       // Index (2 bytes) + send time (4 bytes) at the front of every payload
+
+struct LinkScenario {
+    const char* name;
+    LinkProfile profile;
+    uint16_t packets;          // Telemetry packets offered
+    uint8_t payloadBytes;
+    uint16_t intervalMs;       // Offered load
+};
+
+struct LinkSimResult {
+    uint16_t offered;
+    uint16_t delivered;        // Unique packets at the peer
+    uint32_t elapsedMs;
+    float goodputBps;          // Delivered payload bytes per second
+    uint32_t latencyMedianMs;  // sendTelemetry() to peer delivery
+    uint32_t latencyP99Ms;
+    uint32_t airtimeMs;        // Both ends, including ACKs and retries
+    float airtimeEfficiency;   // Delivered payload bits / (airtime x raw bit rate)
+};
+
+// Runs LoRaComm() against a second LoRaManager (auto-ACK on) over a
+// SimulatedLink. LoRaComm() is stopped for the run and restarted after
+bool runLinkSimulation(const LinkScenario& scenario, LinkSimResult& result);
+
+// Built-in scenarios, printed as a table
+void linkSimBenchmark();
+
+#endif // SIM_LINK_SCENARIOS_H
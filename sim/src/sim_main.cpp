@@ -0,0 +1,457 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <Arduino.h>
+#include "energy_ledger.h"
+#include "link_sim.h"
+#include "lora_comm.h"
+#include "metrics.h"
+#include "power_arbiter.h"
+#include "sim_devices.h"
+#include "sim_kernel.h"
+#include "sim_link_scenarios.h"
+#include "task_watchdog.h"
+
+// ===========================
+// Native Simulation - Main
+// The balloon firmware's setup() and loop() on the simulated board, flown
+// through a whole profile; see docs/Simulation.md
+// ===========================
+
+#define SIM_DEFAULT_CPU_SCALE       8.0f        // A desktop core over the S3's LX7 at 240 MHz
+#define SIM_GROUND_POLL_MS          20          // The far end's processQueue() period
+#define SIM_SAMPLE_US               1000000     // Airtime and energy by phase
+#define SIM_PROGRESS_US             3600000000ull
+#define SIM_PHASE_COUNT             4
+#define SIM_METRIC_TEXT_BYTES       4096
+#define SIM_LINK_SCENARIOS_DONE     "link scenarios done"
+
+struct SimArgs {
+    sim::FlightProfile profile;
+    float hours;                        // 0: the profile's length
+    float cpuScale;
+    float batteryMah;
+    uint8_t lossPercent;
+    const char* serialPath;             // nullptr: dropped; "-": stdout
+    bool linkScenarios;                 // The link scenarios in place of a flight
+};
+
+static SimArgs args = {
+    {600, 120.0f, 5.0f, 30000.0f, 5.0f, 52.2053, 0.1218, 1800, 1781510400},
+    0.0f,
+    SIM_DEFAULT_CPU_SCALE,
+    BATTERY_CAPACITY_MAH,
+    2,
+    nullptr,
+    false,
+};
+
+// ===========================
+// Ground Station
+// ===========================
+
+// The far end: a LoRaManager on the other radio of a SimulatedLink,
+// auto-ACKing, as hardware - it costs the balloon's cores nothing
+static struct {
+    SimulatedLink link;
+    LoRaManager* peer;
+    TaskHandle_t loopTask;
+    uint32_t packetsReceived;
+    uint32_t packetsByType[256];
+    uint32_t fallbacks;
+} ground;
+
+static void onGroundPacket(const Packet& packet) {
+    ground.packetsReceived++;
+    ground.packetsByType[static_cast<uint8_t>(packet.type)]++;
+}
+
+static void groundTaskEntry(void* param) {
+    LinkProfile profile = {args.lossPercent, 0, -100, nullptr, 0};
+    if (!ground.link.begin(profile) || !LoRaComm().setRadioDriver(&ground.link.endpoint(0))) {
+        sim::stop("simulated link failed to start");
+    }
+    ground.peer = new LoRaManager();
+    ground.peer->setRadioDriver(&ground.link.endpoint(1));
+    ground.peer->enableAutoAck(true);
+    ground.peer->setLocalLoads(false);
+    ground.peer->setPacketReceivedCallback(onGroundPacket);
+    if (!ground.peer->begin()) {
+        sim::stop("ground LoRaManager failed to start");
+    }
+
+    // The balloon boots once its radio is in place
+    xTaskNotifyGive(ground.loopTask);
+    uint32_t lastFallback = 0;
+    while (true) {
+        ground.peer->processQueue();
+
+        // The base station's half of the rate fallback, which this build
+        // compiles out: after LORA_ADR_FALLBACK_MS without a frame, back to
+        // the rendezvous settings the balloon falls back to
+        uint32_t now = millis();
+        uint32_t silence = std::min(now - ground.peer->getLastReceiveTime(), now - lastFallback);
+        if (silence >= LORA_ADR_FALLBACK_MS && (ground.peer->getSpreadingFactor() != LORA_ADR_RENDEZVOUS_SF ||
+                                                ground.peer->getBandwidth() != LORA_ADR_RENDEZVOUS_BW)) {
+            ground.peer->setSpreadingFactor(LORA_ADR_RENDEZVOUS_SF);
+            ground.peer->setBandwidth(LORA_ADR_RENDEZVOUS_BW);
+            ground.peer->setCodingRate(LORA_ADR_RENDEZVOUS_CR);
+            ground.fallbacks++;
+            lastFallback = now;
+        }
+        sim::sleep(SIM_GROUND_POLL_MS * 1000);
+    }
+}
+
+// ===========================
+// Firmware
+// ===========================
+
+// As the Arduino core's app_main() starts it
+static void loopTaskEntry(void* param) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    setup();
+    while (true) {
+        loop();
+    }
+}
+
+// --link-scenarios: the link layer on its own, in the loop task's place
+static void linkScenariosTaskEntry(void* param) {
+    linkSimBenchmark();
+    sim::stop(SIM_LINK_SCENARIOS_DONE);
+}
+
+// ===========================
+// Sampler
+// ===========================
+
+static const char* const phaseNames[SIM_PHASE_COUNT] = {"pad", "ascent", "descent", "landed"};
+
+// Airtime counters are 32-bit microseconds - 71 minutes - so the sampler
+// keeps its own running totals, per flight phase with the charge
+static struct {
+    uint32_t lastAirtime[2];
+    uint64_t airtimeUs[2];
+    uint64_t phaseAirtimeUs[SIM_PHASE_COUNT];
+    float phaseChargeMah[SIM_PHASE_COUNT];
+    uint64_t phaseUs[SIM_PHASE_COUNT];
+    float lastCharge;
+    uint64_t lastSample;
+    uint64_t nextProgress;
+    std::chrono::steady_clock::time_point wallStart;
+} sampler;
+
+static int phaseIndex(uint64_t us) {
+    const char* phase = sim::flightPhaseAt(us);
+    for (int i = 0; i < SIM_PHASE_COUNT; i++) {
+        if (strcmp(phase, phaseNames[i]) == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+static void sample() {
+    uint64_t now = sim::now();
+    int phase = phaseIndex(sampler.lastSample);
+    LoRaManager* managers[2] = {&LoRaComm(), &BulkLoRa()};
+    for (int i = 0; i < 2; i++) {
+        uint32_t airtime = managers[i]->getAirtimeUsedUs();
+        // A statistics reset starts the counter again
+        uint32_t delta = airtime >= sampler.lastAirtime[i] ? airtime - sampler.lastAirtime[i] : airtime;
+        sampler.lastAirtime[i] = airtime;
+        sampler.airtimeUs[i] += delta;
+        sampler.phaseAirtimeUs[phase] += delta;
+    }
+    float charge = Energy().getTotalChargeMah();
+    sampler.phaseChargeMah[phase] += charge - sampler.lastCharge;
+    sampler.lastCharge = charge;
+    sampler.phaseUs[phase] += now - sampler.lastSample;
+    sampler.lastSample = now;
+
+    if (now >= sampler.nextProgress) {
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - sampler.wallStart).count();
+        fprintf(stderr, "sim: %5.2f h %-8s %7.0f m  %.1f s wall\n", now / 3.6e9, sim::flightPhaseAt(now),
+                sim::flightAt(now).altitude, wall);
+        sampler.nextProgress += SIM_PROGRESS_US;
+    }
+}
+
+static void samplerTaskEntry(void* param) {
+    while (true) {
+        sim::sleep(SIM_SAMPLE_US);
+        sample();
+    }
+}
+
+// ===========================
+// Report
+// ===========================
+
+static void printRule(const char* title) {
+    printf("\n=== %s ===\n", title);
+}
+
+// Per-bucket counts from the registry's exposition text, so the report
+// reads the same histograms a scrape does
+static void printMetricHistogram(const char* name) {
+    MetricsRegistry& registry = Metrics();
+    static char text[SIM_METRIC_TEXT_BYTES];
+    char help[64];
+    int helpLength = snprintf(help, sizeof(help), "# HELP %s ", name);
+    for (size_t index = 0; index < registry.getCount(); index++) {
+        if (!registry.renderEntry(index, 0, text, sizeof(text)) || strncmp(text, help, helpLength) != 0) {
+            continue;
+        }
+        printRule(name);
+        for (uint8_t part = 0; part < registry.getPartCount(index); part++) {
+            if (!registry.renderEntry(index, part, text, sizeof(text))) {
+                continue;
+            }
+            unsigned long previous = 0;
+            unsigned long total = 0;
+            unsigned long sum = 0;
+            char label[48] = "";
+            for (char* line = strtok(text, "\n"); line; line = strtok(nullptr, "\n")) {
+                char* le = strstr(line, "le=\"");
+                char* value = strrchr(line, ' ');
+                if (strstr(line, "_sum") && value) {
+                    sum = strtoul(value + 1, nullptr, 10);
+                } else if (le && value) {
+                    char* labelStart = strchr(line, '{');
+                    if (labelStart && !label[0] && labelStart + 1 < le) {
+                        snprintf(label, sizeof(label), "%.*s", (int)(le - labelStart - 2), labelStart + 1);
+                        printf("%s\n", label);
+                    }
+                    unsigned long cumulative = strtoul(value + 1, nullptr, 10);
+                    total = cumulative;
+                    char bound[16];
+                    snprintf(bound, sizeof(bound), "%.*s", (int)strcspn(le + 4, "\""), le + 4);
+                    if (cumulative > previous) {
+                        printf("  <= %-8s %10lu\n", bound, cumulative - previous);
+                    }
+                    previous = cumulative;
+                }
+            }
+            if (total) {
+                printf("  count %lu, mean %.1f\n", total, (double)sum / total);
+            }
+        }
+        return;
+    }
+    printf("\n%s: not registered\n", name);
+}
+
+static uint32_t burstPercentile(const sim::TaskReport& report, float fraction) {
+    uint64_t total = 0;
+    for (uint32_t count : report.burstBuckets) {
+        total += count;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < 11; i++) {
+        seen += report.burstBuckets[i];
+        if (total && seen >= total * fraction) {
+            return sim::burstBoundsUs[i];
+        }
+    }
+    return UINT32_MAX;
+}
+
+static void printTasks(uint64_t elapsed) {
+    printRule("Tasks");
+    printf("%-16s %4s %4s %10s %6s %10s %8s %8s %8s\n", "task", "core", "prio", "cpu ms", "cpu %", "wakes",
+           "preempt", "p50 us", "p99 us");
+    sim::TaskReport report;
+    for (size_t i = 0; sim::taskReport(i, report); i++) {
+        if (!report.activations) {
+            continue;
+        }
+        uint32_t p50 = burstPercentile(report, 0.50f);
+        uint32_t p99 = burstPercentile(report, 0.99f);
+        char p50Text[12];
+        char p99Text[12];
+        snprintf(p50Text, sizeof(p50Text), p50 == UINT32_MAX ? ">100000" : "%lu", (unsigned long)p50);
+        snprintf(p99Text, sizeof(p99Text), p99 == UINT32_MAX ? ">100000" : "%lu", (unsigned long)p99);
+        printf("%-16s %4d %4u %10.1f %6.2f %10lu %8lu %8s %8s\n", report.name, report.core,
+               (unsigned)report.priority, report.runUs / 1000.0, 100.0 * report.runUs / elapsed,
+               (unsigned long)report.activations, (unsigned long)report.preemptions, p50Text, p99Text);
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint64_t idle = sim::coreIdleUs(core);
+        printf("core %d: %.2f %% busy\n", core, 100.0 * (1.0 - (double)std::min(idle, elapsed) / elapsed));
+    }
+}
+
+static void printReport(const char* reason, double wallSeconds) {
+    uint64_t elapsed = std::max<uint64_t>(1, std::max(sim::coreClock(0), sim::coreClock(1)));
+    sample();
+
+    printRule("Run");
+    printf("Stopped: %s at %.2f h (landing %.2f h, max %.0f m)\n", reason, elapsed / 3.6e9,
+           sim::flightLandingUs() / 3.6e9, sim::flightMaxAltitude());
+    printf("Wall clock: %.1f s, %.0fx real time, %llu context switches\n", wallSeconds, elapsed / 1e6 / wallSeconds,
+           (unsigned long long)sim::switchCount());
+
+    printMetricHistogram("balloon_loop_time_ms");
+    printMetricHistogram("camera_capture_time_ms");
+    printMetricHistogram("scheduler_job_late_us");
+    printTasks(elapsed);
+
+    printRule("Airtime");
+    printf("Primary: %.1f s (%.3f %% of the run)\n", sampler.airtimeUs[0] / 1e6, 100.0 * sampler.airtimeUs[0] / elapsed);
+    printf("Bulk:    %.1f s (%.3f %% of the run)\n", sampler.airtimeUs[1] / 1e6, 100.0 * sampler.airtimeUs[1] / elapsed);
+    printf("Ground received %lu packets, link delivered %lu frames, lost %lu, missed %lu\n",
+           (unsigned long)ground.packetsReceived, (unsigned long)ground.link.getFramesDelivered(),
+           (unsigned long)ground.link.getFramesLost(), (unsigned long)ground.link.getFramesMissed());
+    printf("Balloon: SF%d, %lu rate changes (%lu fallbacks), %lu ACK timeouts; ground fell back %lu times\n",
+           LoRaComm().getSpreadingFactor(), (unsigned long)LoRaComm().getRateChangeCount(),
+           (unsigned long)LoRaComm().getRateFallbackCount(), (unsigned long)LoRaComm().getAckTimeoutCount(),
+           (unsigned long)ground.fallbacks);
+
+    printRule("Energy");
+    printf("%-8s %10s %10s %10s %10s\n", "phase", "hours", "mAh", "mA avg", "air s");
+    for (int i = 0; i < SIM_PHASE_COUNT; i++) {
+        if (!sampler.phaseUs[i]) {
+            continue;
+        }
+        printf("%-8s %10.2f %10.1f %10.1f %10.1f\n", phaseNames[i], sampler.phaseUs[i] / 3.6e9,
+               sampler.phaseChargeMah[i], sampler.phaseChargeMah[i] / (sampler.phaseUs[i] / 3.6e9),
+               sampler.phaseAirtimeUs[i] / 1e6);
+    }
+    sim::BatteryStatus battery = sim::batteryStatus();
+    printf("Battery: %.0f of %.0f mAh used, %.2f V now, %.2f V lowest, %.0f mA peak\n", battery.usedMah,
+           battery.capacityMah, battery.volts, battery.minVolts, battery.peakDrawMa);
+    sim::GpsStatus gps = sim::gpsStatus();
+    printf("GPS: %lu frames, %lu configs acked, %lu garbled bytes, %lu backups, first fix %.1f s\n",
+           (unsigned long)gps.framesSent, (unsigned long)gps.configsAcked, (unsigned long)gps.garbledBytes,
+           (unsigned long)gps.backups, gps.firstFixUs / 1e6);
+
+    // The firmware's own status prints go to Serial; the report is on stdout
+    FILE* log = stdout;
+    sim::setSerialLog(log);
+    Energy().printLedger();
+    Arbiter().printStatus();
+    Watchdog().printStatus();
+    fflush(stdout);
+}
+
+// ===========================
+// Arguments
+// ===========================
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --hours H             run length (default: pad, flight and landedMinutes)\n"
+            "  --cpu-scale X         host CPU time to S3 time; 0 charges %d us per kernel call (default %.0f)\n"
+            "  --serial FILE         the firmware's Serial output; - for stdout (default: dropped)\n"
+            "  --battery-mah N       (default %.0f)\n"
+            "  --loss PERCENT        random frame loss on the link (default %u)\n"
+            "  --pad-minutes N       before launch (default %lu)\n"
+            "  --ascent-rate M_S     (default %.1f)\n"
+            "  --burst-altitude M    (default %.0f)\n"
+            "  --descent-rate M_S    under the parachute at sea level (default %.1f)\n"
+            "  --landed-minutes N    after landing (default %lu)\n"
+            "  --lat DEG --lon DEG   launch site (default %.4f, %.4f)\n"
+            "  --link-scenarios      run the link scenarios instead, printed to stdout or --serial\n",
+            program, SIM_CALL_US, SIM_DEFAULT_CPU_SCALE, args.batteryMah, args.lossPercent,
+            (unsigned long)args.profile.padSeconds / 60, args.profile.ascentRate, args.profile.burstAltitude,
+            args.profile.descentRate, (unsigned long)args.profile.landedSeconds / 60, args.profile.latitude,
+            args.profile.longitude);
+    exit(2);
+}
+
+static void parseArgs(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        if (strcmp(option, "--link-scenarios") == 0) {
+            args.linkScenarios = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        const char* value = argv[++i];
+        if (strcmp(option, "--hours") == 0) {
+            args.hours = atof(value);
+        } else if (strcmp(option, "--cpu-scale") == 0) {
+            args.cpuScale = atof(value);
+        } else if (strcmp(option, "--serial") == 0) {
+            args.serialPath = value;
+        } else if (strcmp(option, "--battery-mah") == 0) {
+            args.batteryMah = atof(value);
+        } else if (strcmp(option, "--loss") == 0) {
+            args.lossPercent = (uint8_t)std::min(100, atoi(value));
+        } else if (strcmp(option, "--pad-minutes") == 0) {
+            args.profile.padSeconds = atoi(value) * 60;
+        } else if (strcmp(option, "--ascent-rate") == 0) {
+            args.profile.ascentRate = atof(value);
+        } else if (strcmp(option, "--burst-altitude") == 0) {
+            args.profile.burstAltitude = atof(value);
+        } else if (strcmp(option, "--descent-rate") == 0) {
+            args.profile.descentRate = atof(value);
+        } else if (strcmp(option, "--landed-minutes") == 0) {
+            args.profile.landedSeconds = atoi(value) * 60;
+        } else if (strcmp(option, "--lat") == 0) {
+            args.profile.latitude = atof(value);
+        } else if (strcmp(option, "--lon") == 0) {
+            args.profile.longitude = atof(value);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (args.profile.ascentRate <= 0 || args.profile.descentRate <= 0 || args.batteryMah <= 0 ||
+        args.profile.burstAltitude <= args.profile.padAltitude || args.cpuScale < 0 || args.hours < 0) {
+        usage(argv[0]);
+    }
+}
+
+int main(int argc, char** argv) {
+    parseArgs(argc, argv);
+
+    FILE* serial = args.linkScenarios ? stdout : nullptr;
+    if (args.serialPath) {
+        serial = strcmp(args.serialPath, "-") == 0 ? stdout : fopen(args.serialPath, "w");
+        if (!serial) {
+            perror(args.serialPath);
+            return 1;
+        }
+    }
+    sim::setSerialLog(serial);
+
+    uint64_t flightUs = sim::planFlight(args.profile);
+    uint64_t endUs = args.hours > 0 ? (uint64_t)(args.hours * 3.6e9) : flightUs;
+    sim::configure({endUs, args.cpuScale});
+
+    if (args.linkScenarios) {
+        xTaskCreatePinnedToCore(linkScenariosTaskEntry, "loopTask", ARDUINO_LOOP_STACK_SIZE, nullptr, 1, nullptr,
+                                ARDUINO_RUNNING_CORE);
+        const char* reason = sim::run();
+        if (strcmp(reason, SIM_LINK_SCENARIOS_DONE) != 0) {
+            fprintf(stderr, "link scenarios: %s\n", reason);
+        }
+        fflush(serial);
+        _exit(strcmp(reason, SIM_LINK_SCENARIOS_DONE) == 0 ? 0 : 1);
+    }
+
+    sim::startDevices(args.batteryMah);
+    xTaskCreatePinnedToCore(loopTaskEntry, "loopTask", ARDUINO_LOOP_STACK_SIZE, nullptr, 1, &ground.loopTask,
+                            ARDUINO_RUNNING_CORE);
+    sim::createHardwareTask(groundTaskEntry, "ground", nullptr, 5);
+    sim::createHardwareTask(samplerTaskEntry, "sampler", nullptr, 1);
+
+    sampler.nextProgress = SIM_PROGRESS_US;
+    sampler.wallStart = std::chrono::steady_clock::now();
+    const char* reason = sim::run();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - sampler.wallStart).count();
+
+    printReport(reason, wall);
+    if (serial && serial != stdout) {
+        fclose(serial);
+    }
+    // The task threads are parked mid-call; nothing is left to unwind
+    _exit(0);
+}
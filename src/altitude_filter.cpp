@@ -0,0 +1,173 @@
+#include "altitude_filter.h"
+
+AltitudeFilter::AltitudeFilter() {
+    rejected = 0;
+    reset();
+}
+
+void AltitudeFilter::reset() {
+    for (uint8_t i = 0; i < 3; i++) {
+        x[i] = 0.0f;
+        for (uint8_t j = 0; j < 3; j++) {
+            P[i][j] = 0.0f;
+        }
+    }
+    lastTime = 0;
+    initialized = false;
+    gpsReferenced = false;
+    for (uint8_t i = 0; i < 3; i++) {
+        rejectRun[i] = 0;
+    }
+    seeded = false;
+    seedOffset = 0.0f;
+    seedVariance = 0.0f;
+}
+
+void AltitudeFilter::seedBaroOffset(float offset, float variance) {
+    seeded = true;
+    seedOffset = offset;
+    seedVariance = variance;
+}
+
+bool AltitudeFilter::predict(uint32_t time) {
+    if (!initialized) {
+        return false;
+    }
+    if ((int32_t)(time - lastTime) <= 0) {
+        return true;    // Same instant, or a measurement stamped before the last one - fuse it as now
+    }
+
+    float dt = (time - lastTime) / 1000.0f;
+    lastTime = time;
+    if (dt > ALT_FILTER_MAX_DT_S) {
+        reset();
+        return false;
+    }
+
+    // x = F x with F = [1 dt 0; 0 1 0; 0 0 1]
+    x[0] += x[1] * dt;
+
+    // P = F P F'
+    P[0][0] += dt * (P[1][0] + P[0][1]) + dt * dt * P[1][1];
+    P[0][1] += dt * P[1][1];
+    P[0][2] += dt * P[1][2];
+    P[1][0] = P[0][1];
+    P[2][0] = P[0][2];
+
+    // + Q, continuous white acceleration and bias walk
+    const float q = ALT_FILTER_ACCEL_NOISE;
+    P[0][0] += q * dt * dt * dt / 3.0f;
+    P[0][1] += q * dt * dt / 2.0f;
+    P[1][0] += q * dt * dt / 2.0f;
+    P[1][1] += q * dt;
+    if (gpsReferenced) {
+        P[2][2] += ALT_FILTER_BIAS_NOISE * dt;  // Before that the offset is 0 by definition
+    }
+    return true;
+}
+
+void AltitudeFilter::update(const float H[3], float z, float r, uint8_t& run) {
+    float PH[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        PH[i] = P[i][0] * H[0] + P[i][1] * H[1] + P[i][2] * H[2];
+    }
+    float S = H[0] * PH[0] + H[1] * PH[1] + H[2] * PH[2] + r;
+    float innovation = z - (H[0] * x[0] + H[1] * x[1] + H[2] * x[2]);
+
+    if (innovation * innovation > ALT_FILTER_GATE_SIGMA * ALT_FILTER_GATE_SIGMA * S &&
+        run < ALT_FILTER_MAX_REJECTS) {
+        run++;
+        rejected++;
+        return;
+    }
+    run = 0;
+
+    float K[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        K[i] = PH[i] / S;
+        x[i] += K[i] * innovation;
+    }
+
+    // P = P - K (H P), symmetric since H P = PH'
+    for (uint8_t i = 0; i < 3; i++) {
+        for (uint8_t j = 0; j < 3; j++) {
+            P[i][j] -= K[i] * PH[j];
+        }
+    }
+}
+
+void AltitudeFilter::addBaro(float altitude, uint32_t time) {
+    if (!predict(time)) {
+        // First sample, or after a gap: take the baro as truth, offset unknown unless seeded
+        bool seed = seeded;
+        float offset = seedOffset;
+        float offsetVariance = seedVariance;
+        reset();
+        x[0] = altitude;
+        P[0][0] = ALT_FILTER_BARO_VAR;
+        P[1][1] = ALT_FILTER_INITIAL_VEL_VAR;
+        if (seed) {
+            // h = z - b: the offset's uncertainty goes into h, anticorrelated
+            x[0] = altitude - offset;
+            x[2] = offset;
+            P[0][0] += offsetVariance;
+            P[0][2] = P[2][0] = -offsetVariance;
+            P[2][2] = offsetVariance;
+            gpsReferenced = true;
+        }
+        lastTime = time;
+        initialized = true;
+        return;
+    }
+
+    const float H[3] = {1.0f, 0.0f, 1.0f};
+    update(H, altitude, ALT_FILTER_BARO_VAR, rejectRun[0]);
+}
+
+void AltitudeFilter::addGpsAltitude(float altitude, float variance, uint32_t time) {
+    if (!predict(time)) {
+        return;     // Nothing to correct until the baro starts the filter
+    }
+
+    if (!gpsReferenced) {
+        // First fix: move the whole error into the baro offset rather than gating
+        // hundreds of metres of sea level pressure error away
+        float offset = altitude - x[0];
+        x[0] = altitude;
+        x[2] -= offset;
+        // New h is the fix, independent of v; new b = old h + b - fix keeps h + b as tight as the baro
+        P[1][2] = P[2][1] = P[1][0] + P[1][2];
+        P[0][1] = P[1][0] = 0.0f;
+        P[2][2] = P[0][0] + 2.0f * P[0][2] + P[2][2] + variance;
+        P[0][0] = variance;
+        P[0][2] = P[2][0] = -variance;
+        gpsReferenced = true;
+        return;
+    }
+
+    const float H[3] = {1.0f, 0.0f, 0.0f};
+    update(H, altitude, variance, rejectRun[1]);
+}
+
+void AltitudeFilter::addGpsVerticalSpeed(float verticalSpeed, uint32_t time) {
+    if (!predict(time)) {
+        return;
+    }
+
+    const float H[3] = {0.0f, 1.0f, 0.0f};
+    update(H, verticalSpeed, ALT_FILTER_GPS_VEL_VAR, rejectRun[2]);
+}
+
+AltitudeEstimate AltitudeFilter::getEstimate() const {
+    AltitudeEstimate estimate;
+    estimate.altitude = x[0];
+    estimate.verticalSpeed = x[1];
+    estimate.altitudeSigma = sqrtf(fmaxf(P[0][0], 0.0f));
+    estimate.verticalSpeedSigma = sqrtf(fmaxf(P[1][1], 0.0f));
+    estimate.baroOffset = x[2];
+    estimate.baroOffsetVariance = P[2][2];
+    estimate.timestamp = lastTime;
+    estimate.valid = initialized;
+    estimate.gpsReferenced = gpsReferenced;
+    return estimate;
+}
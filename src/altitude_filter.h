@@ -0,0 +1,91 @@
+#ifndef ALTITUDE_FILTER_H
+#define ALTITUDE_FILTER_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Altitude Filter
+// Kalman fusion of barometric and GPS altitude into altitude and vertical
+// speed, with their uncertainties
+// ===========================
+
+// State: altitude h (m MSL), vertical speed v (m/s, up positive), and the
+// barometer's offset b - the standard-atmosphere altitude from a fixed sea
+// level pressure is off from MSL by tens to hundreds of metres and drifts
+// with the weather and temperature lapse. Constant velocity with white
+// acceleration noise; b is a slow random walk.
+//
+//   baro         z = h + b    every BMP280 sample, the high-rate input
+//   GPS altitude z = h        every fix; variance from the receiver's vAcc when known
+//   GPS climb    z = v        NAV-PVT only (NMEA has no vertical rate)
+//
+// Until the first GPS fix b is held at 0 and h follows the baro alone; the
+// first fix moves the whole difference into b rather than gating it away.
+// Each measurement is gated on its innovation (ALT_FILTER_GATE_SIGMA), so a
+// GPS multipath jump or a sensor glitch is counted and dropped rather than
+// dragging the state; after ALT_FILTER_MAX_REJECTS in a row from one input
+// the next is taken, so a real step (a receiver reacquiring) gets through.
+//
+// A restart across a deep sleep can be seeded with the offset it had: the
+// first baro sample then starts GPS referenced, h = z - b, rather than at
+// b = 0 until the next fix.
+
+#define ALT_FILTER_ACCEL_NOISE     1.0f     // (m/s²)²/Hz - balloon ascent, burst and descent are gentle
+#define ALT_FILTER_BIAS_NOISE      0.05f    // m²/s - baro offset random walk
+#define ALT_FILTER_BARO_VAR        0.25f    // m², x8 oversampling with the x16 IIR
+#define ALT_FILTER_GPS_ALT_VAR     100.0f   // m², NMEA - no accuracy estimate
+#define ALT_FILTER_GPS_VEL_VAR     0.25f    // m²/s², NAV-PVT velD
+#define ALT_FILTER_INITIAL_VEL_VAR 25.0f
+#define ALT_FILTER_GATE_SIGMA      5.0f
+#define ALT_FILTER_MAX_REJECTS     10       // Consecutive gated measurements before one is forced in
+#define ALT_FILTER_MAX_DT_S        10.0f    // Longer gaps restart from the next baro sample
+
+struct AltitudeEstimate {
+    float altitude;             // m MSL (baro-only altitude before the first GPS fix)
+    float verticalSpeed;        // m/s, up positive
+    float altitudeSigma;        // m, 1 sigma
+    float verticalSpeedSigma;   // m/s, 1 sigma
+    float baroOffset;           // m, standard-atmosphere altitude above MSL
+    float baroOffsetVariance;   // m²
+    uint32_t timestamp;         // millis() of the last measurement
+    bool valid;
+    bool gpsReferenced;         // A GPS altitude has been fused
+};
+
+class AltitudeFilter {
+public:
+    AltitudeFilter();
+
+    void reset();
+
+    // Measurement times are millis(); each predicts the state forward first
+    void addBaro(float altitude, uint32_t time);
+    void addGpsAltitude(float altitude, float variance, uint32_t time);
+    void addGpsVerticalSpeed(float verticalSpeed, uint32_t time);
+
+    AltitudeEstimate getEstimate() const;
+    float getBaroOffset() const { return x[2]; }
+    uint32_t getRejectedCount() const { return rejected; }
+
+    // For the next first sample only; reset() drops it
+    void seedBaroOffset(float offset, float variance);
+
+private:
+    float x[3];                 // h, v, b
+    float P[3][3];
+    uint32_t lastTime;
+    bool initialized;
+    bool gpsReferenced;
+    uint8_t rejectRun[3];       // Consecutive rejections per input - baro, GPS altitude, GPS climb
+    uint32_t rejected;
+    bool seeded;
+    float seedOffset;
+    float seedVariance;
+
+    bool predict(uint32_t time);
+    // Scalar measurement z = H x with variance r
+    void update(const float H[3], float z, float r, uint8_t& run);
+};
+
+#endif // ALTITUDE_FILTER_H
@@ -13,14 +13,33 @@
 // limitations under the License.
 #include "esp_http_server.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_camera.h"
 #include "img_converters.h"
+#include "esp_jpg_decode.h"
 #include "fb_gfx.h"
 #include "esp32-hal-ledc.h"
 #include "sdkconfig.h"
 #include "camera_index.h"
 #include "board_config.h"
 #include "WiFi.h"
+#include "power_manager.h"
+#include "dashboard_feed.h"
+#include "metrics.h"
+#include "flight_recorder.h"
+#include "link_capture.h"
+#include "trace_buffer.h"
+#include "memory_ledger.h"
+#include "frame_pool.h"
+#include "task_placement.h"
+#include "rtp_jpeg.h"
+#include "power_scaling.h"
+#include "gzip_stream.h"
+#include "camera_manager.h"
+#include "lwip/sockets.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -45,9 +64,16 @@ static const char *_STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary="
 static const char *_STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
 static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n\r\n";
 
+// /status JSON this long and up is kept gzipped beside the plain copy;
+// /metrics, always longer, is gzipped as it is rendered
+#define HTTP_GZIP_MIN_BYTES 512
+
 httpd_handle_t stream_httpd = NULL;
 httpd_handle_t camera_httpd = NULL;
 
+// One stream for the camera server's handlers, which run one at a time
+static GzipStream http_gzip;
+
 typedef struct {
   size_t size;   //number of values used for filtering
   size_t index;  //current value index
@@ -59,9 +85,10 @@ typedef struct {
 static ra_filter_t ra_filter;
 
 static ra_filter_t *ra_filter_init(ra_filter_t *filter, size_t sample_size) {
+  memFree(MemTag::STREAM, filter->values);  // From a previous server start
   memset(filter, 0, sizeof(ra_filter_t));
 
-  filter->values = (int *)malloc(sample_size * sizeof(int));
+  filter->values = (int *)memAlloc(MemTag::STREAM, sample_size * sizeof(int));
   if (!filter->values) {
     return NULL;
   }
@@ -71,7 +98,15 @@ static ra_filter_t *ra_filter_init(ra_filter_t *filter, size_t sample_size) {
   return filter;
 }
 
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
+static void ra_filter_reset(ra_filter_t *filter) {
+  if (filter->values) {
+    memset(filter->values, 0, filter->size * sizeof(int));
+  }
+  filter->index = 0;
+  filter->count = 0;
+  filter->sum = 0;
+}
+
 static int ra_filter_run(ra_filter_t *filter, int value) {
   if (!filter->values) {
     return value;
@@ -86,7 +121,6 @@ static int ra_filter_run(ra_filter_t *filter, int value) {
   }
   return filter->sum / filter->count;
 }
-#endif
 
 #if defined(LED_GPIO_NUM)
 void enable_led(bool en) {  // Turn LED On or Off
@@ -101,6 +135,142 @@ void enable_led(bool en) {  // Turn LED On or Off
 }
 #endif
 
+// BMP is sent as it is converted: the header, then rows in strips through one
+// reused buffer. Rows are top-down (negative height), 24-bit BGR padded to 4
+// bytes. A JPEG frame is decoded an MCU row (8 or 16 lines) at a time; raw
+// frames go BMP_STRIP_BYTES worth of rows at a time, at least one
+#define BMP_HEADER_SIZE 54
+#define BMP_STRIP_BYTES 4096
+
+typedef struct {
+  httpd_req_t *req;
+  const uint8_t *input;
+  uint16_t width;
+  size_t row_bytes;
+  uint16_t strip_y;  // First row held in the strip
+  uint16_t strip_h;  // Rows held, 0 = empty
+  size_t sent;
+} bmp_stream_t;
+
+static uint8_t *bmp_strip = NULL;
+static size_t bmp_strip_size = 0;
+
+static bool bmp_reserve_strip(size_t size) {
+  if (size <= bmp_strip_size) {
+    return true;
+  }
+  memFree(MemTag::STREAM, bmp_strip);
+  bmp_strip = (uint8_t *)memAlloc(MemTag::STREAM, size);
+  bmp_strip_size = bmp_strip ? size : 0;
+  return bmp_strip != NULL;
+}
+
+static bool bmp_send_header(bmp_stream_t *bmp, uint16_t width, uint16_t height) {
+  uint8_t header[BMP_HEADER_SIZE] = {'B', 'M'};
+  bmp->width = width;
+  bmp->row_bytes = ((size_t)width * 3 + 3) & ~(size_t)3;
+  uint32_t image_size = bmp->row_bytes * height;
+  uint32_t fields[] = {
+    BMP_HEADER_SIZE + image_size, 0, BMP_HEADER_SIZE,          // File: size, reserved, pixel offset
+    40, width, (uint32_t)(-(int32_t)height), 1 | (24 << 16),  // DIB: size, width, height, planes + bpp
+    0, image_size, 2835, 2835, 0, 0                           // No compression, 72 dpi
+  };
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    for (int b = 0; b < 4; b++) {
+      header[2 + i * 4 + b] = fields[i] >> (8 * b);
+    }
+  }
+  bmp->sent = BMP_HEADER_SIZE;
+  return httpd_resp_send_chunk(bmp->req, (const char *)header, BMP_HEADER_SIZE) == ESP_OK;
+}
+
+static bool bmp_flush_strip(bmp_stream_t *bmp) {
+  if (!bmp->strip_h) {
+    return true;
+  }
+  size_t len = bmp->row_bytes * bmp->strip_h;
+  bmp->strip_y += bmp->strip_h;
+  bmp->strip_h = 0;
+  bmp->sent += len;
+  return httpd_resp_send_chunk(bmp->req, (const char *)bmp_strip, len) == ESP_OK;
+}
+
+static size_t bmp_jpg_read(void *arg, size_t index, uint8_t *buf, size_t len) {
+  bmp_stream_t *bmp = (bmp_stream_t *)arg;
+  if (buf) {
+    memcpy(buf, bmp->input + index, len);
+  }
+  return len;
+}
+
+// Blocks arrive left to right along an MCU row, rows top to bottom
+static bool bmp_jpg_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+  bmp_stream_t *bmp = (bmp_stream_t *)arg;
+  if (!data) {
+    if (x == 0 && y == 0) {
+      // Start - w and h are the whole image; a strip holds an MCU row, 16 lines at most
+      if (!bmp_send_header(bmp, w, h) || !bmp_reserve_strip(bmp->row_bytes * 16)) {
+        return false;
+      }
+      memset(bmp_strip, 0, bmp->row_bytes * 16);  // Row padding
+      return true;
+    }
+    return bmp_flush_strip(bmp);
+  }
+
+  if (y != bmp->strip_y && !bmp_flush_strip(bmp)) {
+    return false;
+  }
+  bmp->strip_y = y;
+  bmp->strip_h = h;
+  for (uint16_t iy = 0; iy < h; iy++) {
+    uint8_t *o = bmp_strip + iy * bmp->row_bytes + x * 3;
+    for (uint16_t ix = 0; ix < w; ix++, data += 3) {
+      o[ix * 3] = data[2];
+      o[ix * 3 + 1] = data[1];
+      o[ix * 3 + 2] = data[0];
+    }
+  }
+  return true;
+}
+
+static bool bmp_send_raw(bmp_stream_t *bmp, camera_fb_t *fb) {
+  size_t bpp = fb->format == PIXFORMAT_GRAYSCALE ? 1 : (fb->format == PIXFORMAT_RGB565 ? 2 : 3);
+  if (!bmp_send_header(bmp, fb->width, fb->height)) {
+    return false;
+  }
+  uint16_t strip_rows = bmp->row_bytes < BMP_STRIP_BYTES ? BMP_STRIP_BYTES / bmp->row_bytes : 1;
+  if (!bmp_reserve_strip(bmp->row_bytes * strip_rows)) {
+    return false;
+  }
+  memset(bmp_strip, 0, bmp->row_bytes * strip_rows);  // Row padding
+
+  const uint8_t *src = fb->buf;
+  bmp->strip_y = 0;
+  for (uint16_t y = 0; y < fb->height; y++) {
+    uint8_t *o = bmp_strip + bmp->strip_h * bmp->row_bytes;
+    for (uint16_t x = 0; x < fb->width; x++, src += bpp) {
+      if (bpp == 1) {
+        o[0] = o[1] = o[2] = src[0];
+      } else if (bpp == 2) {
+        // Big endian 5/6/5
+        o[0] = (src[1] & 0x1F) << 3;
+        o[1] = (src[0] & 0x07) << 5 | (src[1] & 0xE0) >> 3;
+        o[2] = src[0] & 0xF8;
+      } else {
+        o[0] = src[0];
+        o[1] = src[1];
+        o[2] = src[2];
+      }
+      o += 3;
+    }
+    if (++bmp->strip_h == strip_rows && !bmp_flush_strip(bmp)) {
+      return false;
+    }
+  }
+  return bmp_flush_strip(bmp);
+}
+
 static esp_err_t bmp_handler(httpd_req_t *req) {
   camera_fb_t *fb = NULL;
   esp_err_t res = ESP_OK;
@@ -113,6 +283,13 @@ static esp_err_t bmp_handler(httpd_req_t *req) {
     httpd_resp_send_500(req);
     return ESP_FAIL;
   }
+  if (fb->format != PIXFORMAT_JPEG && fb->format != PIXFORMAT_RGB565 && fb->format != PIXFORMAT_GRAYSCALE &&
+      fb->format != PIXFORMAT_RGB888) {
+    log_e("BMP Conversion not supported for format %u", fb->format);
+    esp_camera_fb_return(fb);
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
 
   httpd_resp_set_type(req, "image/x-windows-bmp");
   httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.bmp");
@@ -122,21 +299,28 @@ static esp_err_t bmp_handler(httpd_req_t *req) {
   snprintf(ts, 32, "%lld.%06ld", fb->timestamp.tv_sec, fb->timestamp.tv_usec);
   httpd_resp_set_hdr(req, "X-Timestamp", (const char *)ts);
 
-  uint8_t *buf = NULL;
-  size_t buf_len = 0;
-  bool converted = frame2bmp(fb, &buf, &buf_len);
+  bmp_stream_t bmp = {req, fb->buf, 0, 0, 0, 0, 0};
+  bool converted;
+  if (fb->format == PIXFORMAT_JPEG) {
+    converted = esp_jpg_decode(fb->len, JPG_SCALE_NONE, bmp_jpg_read, bmp_jpg_write, &bmp) == ESP_OK;
+  } else {
+    converted = bmp_send_raw(&bmp, fb);
+  }
   esp_camera_fb_return(fb);
   if (!converted) {
-    log_e("BMP Conversion failed");
-    httpd_resp_send_500(req);
-    return ESP_FAIL;
+    // Nothing sent yet can still be an error; a cut-off body just ends
+    log_e("BMP Conversion failed after %uB", bmp.sent);
+    if (!bmp.sent) {
+      httpd_resp_send_500(req);
+      return ESP_FAIL;
+    }
+    res = ESP_FAIL;
   }
-  res = httpd_resp_send(req, (const char *)buf, buf_len);
-  free(buf);
+  httpd_resp_send_chunk(req, NULL, 0);
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
   uint64_t fr_end = esp_timer_get_time();
 #endif
-  log_i("BMP: %llums, %uB", (uint64_t)((fr_end - fr_start) / 1000), buf_len);
+  log_i("BMP: %llums, %uB", (uint64_t)((fr_end - fr_start) / 1000), bmp.sent);
   return res;
 }
 
@@ -206,133 +390,689 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   return res;
 }
 
-static esp_err_t stream_handler(httpd_req_t *req) {
-  camera_fb_t *fb = NULL;
-  struct timeval _timestamp;
-  esp_err_t res = ESP_OK;
-  size_t _jpg_buf_len = 0;
-  uint8_t *_jpg_buf = NULL;
-  char *part_buf[128];
+// /status is built once per settings version and served from the cache until
+// it moves; the version is the ETag. Handlers that change the sensor bump
+// their own count, and CameraManager counts the changes it makes itself -
+// its setters, auto exposure, the quality controller and profile switches
+static std::atomic<uint32_t> status_version(1);
+
+static void status_changed() {
+  status_version.fetch_add(1, std::memory_order_release);
+}
 
-  static int64_t last_frame = 0;
-  if (!last_frame) {
-    last_frame = esp_timer_get_time();
+static uint32_t current_status_version() {
+  return status_version.load(std::memory_order_acquire) + Camera().getSettingsGeneration();
+}
+
+// Stream broadcaster - one producer task captures for every /stream client.
+// Each frame is a reference counted JPEG: the producer holds the newest until
+// the next replaces it, and a client holds the one it is sending. Clients only
+// ever take the newest frame, so a slow one skips frames rather than holding
+// up the camera or the other clients; at most one frame per client plus the
+// newest is alive. Each client runs on its own task off the httpd one; both
+// tasks are placed by task_placement.h.
+#define STREAM_MAX_CLIENTS       4
+#define STREAM_FRAME_TIMEOUT_MS  2000  // Client gives up after this long without a new frame
+#define STREAM_IDLE_POLL_MS      1000  // Producer rechecks for clients this often while none are connected
+#define STREAM_STOP_TIMEOUT_MS   3000  // stopCameraServer() waits this long for the clients to finish
+
+// Frame-rate governor - the producer captures no faster than the slowest
+// client takes to send a frame (its ra_filter average), nor than the power
+// state allows. A client that can't keep STREAM_SLOW_SEND_MS gets smaller
+// frames: the sensor's JPEG quality number goes up a step per frame until it
+// can or STREAM_QUALITY_MAX_OFFSET is reached, and comes back down once every
+// client sends in under half that
+#define STREAM_SEND_SAMPLES         10
+#define STREAM_GOVERNOR_HEADROOM    110   // % of the slowest send time between captures
+#define STREAM_MIN_FRAME_MS         50    // Full and normal power - 20 fps at most
+#define STREAM_LOW_POWER_FRAME_MS   200
+#define STREAM_CRITICAL_FRAME_MS    1000
+#define STREAM_SLOW_SEND_MS         250
+#define STREAM_QUALITY_MAX_OFFSET   20    // Sensor quality steps (0-63, higher is smaller)
+#define STREAM_CONVERT_QUALITY      80    // frame2jpg() quality for non-JPEG formats, less 2 per offset step
+#define STREAM_POOL_WAIT_MS         200   // Longest the producer waits for a frame pool block
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+#define STREAM_ASYNC_CLIENTS 1
+#else
+#define STREAM_ASYNC_CLIENTS 0  // No async requests - clients run on the httpd task, one at a time
+#endif
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  bool pooled;  // buf is a frame pool block, not frame2jpg()'s allocation
+  struct timeval timestamp;
+  int64_t captured;  // esp_timer_get_time() at capture
+  uint32_t seq;
+  int refs;
+} stream_frame_t;
+
+typedef struct {
+  httpd_req_t *req;
+  TaskHandle_t task;
+  uint32_t latency;    // ms, capture to sent, smoothed
+  uint32_t send_time;  // ms per frame sent, averaged by send_filter
+  uint32_t sent;
+  uint32_t skipped;
+  ra_filter_t send_filter;
+  bool used;
+} stream_client_t;
+
+static portMUX_TYPE stream_lock = portMUX_INITIALIZER_UNLOCKED;
+static stream_frame_t *stream_latest = NULL;
+static stream_client_t stream_clients[STREAM_MAX_CLIENTS];
+static int stream_client_count = 0;
+static volatile bool stream_stopping = false;  // stopCameraServer() is ending every client
+static PowerLock stream_power_lock("stream", PowerLockType::CPU_MAX);  // Held while anyone is watching
+static TaskHandle_t stream_producer = NULL;
+static uint32_t stream_frames = 0;
+static uint32_t stream_frame_time = 0;  // ms between published frames, averaged by ra_filter
+static uint32_t stream_interval = STREAM_MIN_FRAME_MS;  // Governed ms between captures
+static int stream_quality_offset = 0;
+static int stream_base_quality = -1;  // Sensor quality before the governor raised it, -1 = untouched
+
+static void stream_frame_release(stream_frame_t *frame) {
+  if (!frame) {
+    return;
   }
+  portENTER_CRITICAL(&stream_lock);
+  bool last = --frame->refs == 0;
+  portEXIT_CRITICAL(&stream_lock);
+  if (last) {
+    if (frame->pooled) {
+      FramePools().release(FrameClass::JPEG, frame->buf);
+    } else {
+      memFree(MemTag::STREAM, frame->buf);
+    }
+    memFree(MemTag::STREAM, frame);
+  }
+}
 
-  res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-  if (res != ESP_OK) {
-    return res;
+// Newest frame if it isn't the one last sent, with a reference taken
+static stream_frame_t *stream_frame_acquire(uint32_t last_seq) {
+  portENTER_CRITICAL(&stream_lock);
+  stream_frame_t *frame = stream_latest;
+  if (frame && frame->seq != last_seq) {
+    frame->refs++;
+  } else {
+    frame = NULL;
   }
+  portEXIT_CRITICAL(&stream_lock);
+  return frame;
+}
 
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_set_hdr(req, "X-Framerate", "60");
+// JPEG copy of a frame buffer, off the driver's buffers - into a frame
+// pool block, shared with the balloon's captures, waiting for one if a
+// slow client still holds them all
+static stream_frame_t *stream_frame_create(camera_fb_t *fb) {
+  stream_frame_t *frame = (stream_frame_t *)memAlloc(MemTag::STREAM, sizeof(stream_frame_t));
+  if (!frame) {
+    return NULL;
+  }
+  frame->buf = NULL;
+  frame->len = 0;
+  frame->pooled = fb->format == PIXFORMAT_JPEG;
+  if (fb->format != PIXFORMAT_JPEG) {
+    if (!frame2jpg(fb, STREAM_CONVERT_QUALITY - 2 * stream_quality_offset, &frame->buf, &frame->len)) {
+      log_e("JPEG compression failed");
+    }
+    memAdopt(MemTag::STREAM, frame->buf);   // frame2jpg()'s own allocation
+  } else {
+    size_t capacity = 0;
+    frame->buf = FramePools().acquire(FrameClass::JPEG, fb->len, capacity, STREAM_POOL_WAIT_MS);
+    if (frame->buf) {
+      memcpy(frame->buf, fb->buf, fb->len);
+      frame->len = fb->len;
+    }
+  }
+  if (!frame->buf) {
+    memFree(MemTag::STREAM, frame);
+    return NULL;
+  }
+  frame->timestamp.tv_sec = fb->timestamp.tv_sec;
+  frame->timestamp.tv_usec = fb->timestamp.tv_usec;
+  frame->captured = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+  frame->refs = 1;  // The producer's, until the next frame replaces it
+  return frame;
+}
 
-#if defined(LED_GPIO_NUM)
-  isStreaming = true;
-  enable_led(true);
-#endif
+static void stream_set_quality_offset(int offset) {
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s || offset == stream_quality_offset) {
+    return;
+  }
+  if (stream_base_quality < 0) {
+    stream_base_quality = s->status.quality;
+  }
+  int quality = stream_base_quality + offset;
+  if (quality > 63) {
+    quality = 63;
+  }
+  if (s->pixformat == PIXFORMAT_JPEG) {
+    s->set_quality(s, quality);
+  }
+  stream_quality_offset = offset;
+  status_changed();
+  if (!offset) {
+    stream_base_quality = -1;
+  }
+  log_i("Stream quality offset %d", offset);
+}
+
+// Capture interval and quality for the clients connected now
+static void stream_govern() {
+  uint32_t slowest = 0;
+  portENTER_CRITICAL(&stream_lock);
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    if (stream_clients[i].used && stream_clients[i].send_time > slowest) {
+      slowest = stream_clients[i].send_time;
+    }
+  }
+  portEXIT_CRITICAL(&stream_lock);
+
+  uint32_t floor = STREAM_MIN_FRAME_MS;
+  switch (PowerMgr().getPowerState()) {
+    case PowerState::LOW_POWER:       floor = STREAM_LOW_POWER_FRAME_MS; break;
+    case PowerState::CRITICAL_POWER:
+    case PowerState::EMERGENCY_POWER: floor = STREAM_CRITICAL_FRAME_MS; break;
+    default:                          break;
+  }
+  uint32_t interval = slowest * STREAM_GOVERNOR_HEADROOM / 100;
+  stream_interval = interval > floor ? interval : floor;
+
+  if (slowest > STREAM_SLOW_SEND_MS && stream_quality_offset < STREAM_QUALITY_MAX_OFFSET) {
+    stream_set_quality_offset(stream_quality_offset + 1);
+  } else if (slowest < STREAM_SLOW_SEND_MS / 2 && stream_quality_offset > 0) {
+    stream_set_quality_offset(stream_quality_offset - 1);
+  }
+}
+
+static void stream_producer_task(void *arg) {
+  int64_t last_frame = 0;
 
   while (true) {
-    fb = esp_camera_fb_get();
+    if (!stream_client_count) {
+      // Nobody watching - let go of the last frame and the sensor
+      portENTER_CRITICAL(&stream_lock);
+      stream_frame_t *old = stream_latest;
+      stream_latest = NULL;
+      portEXIT_CRITICAL(&stream_lock);
+      stream_frame_release(old);
+      stream_set_quality_offset(0);
+      last_frame = 0;
+      ulTaskNotifyTake(pdTRUE, STREAM_IDLE_POLL_MS / portTICK_PERIOD_MS);
+      continue;
+    }
+
+    // No sooner than the governed interval after the last frame
+    stream_govern();
+    if (last_frame) {
+      int64_t wait = (int64_t)stream_interval * 1000 - (esp_timer_get_time() - last_frame);
+      if (wait > 0) {
+        vTaskDelay(wait / 1000 / portTICK_PERIOD_MS);
+      }
+    }
+
+    camera_fb_t *fb = esp_camera_fb_get();
     if (!fb) {
       log_e("Camera capture failed");
-      res = ESP_FAIL;
-    } else {
-      _timestamp.tv_sec = fb->timestamp.tv_sec;
-      _timestamp.tv_usec = fb->timestamp.tv_usec;
-      if (fb->format != PIXFORMAT_JPEG) {
-        bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-        esp_camera_fb_return(fb);
-        fb = NULL;
-        if (!jpeg_converted) {
-          log_e("JPEG compression failed");
-          res = ESP_FAIL;
-        }
-      } else {
-        _jpg_buf_len = fb->len;
-        _jpg_buf = fb->buf;
+      vTaskDelay(10 / portTICK_PERIOD_MS);
+      continue;
+    }
+    stream_frame_t *frame = stream_frame_create(fb);
+    esp_camera_fb_return(fb);
+    if (!frame) {
+      log_e("Stream frame allocation failed");
+      continue;
+    }
+
+    portENTER_CRITICAL(&stream_lock);
+    stream_frame_t *old = stream_latest;
+    frame->seq = ++stream_frames;
+    stream_latest = frame;
+    TaskHandle_t waiting[STREAM_MAX_CLIENTS];
+    int count = 0;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+      if (stream_clients[i].used && stream_clients[i].task) {
+        waiting[count++] = stream_clients[i].task;
       }
     }
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+    portEXIT_CRITICAL(&stream_lock);
+    stream_frame_release(old);
+    for (int i = 0; i < count; i++) {
+      xTaskNotifyGive(waiting[i]);
     }
-    if (res == ESP_OK) {
-      size_t hlen = snprintf((char *)part_buf, 128, _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
-      res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
+
+    int64_t fr_end = esp_timer_get_time();
+    if (last_frame) {
+      stream_frame_time = ra_filter_run(&ra_filter, (fr_end - last_frame) / 1000);
+    }
+    last_frame = fr_end;
+  }
+}
+
+static int stream_client_add(httpd_req_t *req) {
+  int slot = -1;
+  portENTER_CRITICAL(&stream_lock);
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    if (!stream_clients[i].used) {
+      stream_clients[i].req = req;
+      stream_clients[i].task = NULL;
+      stream_clients[i].latency = 0;
+      stream_clients[i].send_time = 0;
+      stream_clients[i].sent = 0;
+      stream_clients[i].skipped = 0;
+      stream_clients[i].used = true;
+      stream_client_count++;
+      slot = i;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&stream_lock);
+
+  if (slot >= 0) {
+    stream_power_lock.hold(true);
+#if defined(LED_GPIO_NUM)
+    isStreaming = true;
+    enable_led(true);
+#endif
+    if (stream_producer) {
+      xTaskNotifyGive(stream_producer);
+    }
+  }
+  return slot;
+}
+
+static void stream_client_remove(int slot) {
+  portENTER_CRITICAL(&stream_lock);
+  stream_clients[slot].used = false;
+  stream_clients[slot].task = NULL;
+  bool last = --stream_client_count == 0;
+  portEXIT_CRITICAL(&stream_lock);
+
+  if (last) {
+    stream_power_lock.hold(false);
+  }
+
+#if defined(LED_GPIO_NUM)
+  if (last) {
+    isStreaming = false;
+    enable_led(false);
+  }
+#else
+  (void)last;
+#endif
+}
+
+static esp_err_t stream_send_frames(httpd_req_t *req, int slot) {
+  stream_client_t *client = &stream_clients[slot];
+  char part_buf[128];
+  uint32_t last_seq = 0;
+  esp_err_t res = ESP_OK;
+
+  ra_filter_reset(&client->send_filter);
+  portENTER_CRITICAL(&stream_lock);
+  client->task = xTaskGetCurrentTaskHandle();
+  portEXIT_CRITICAL(&stream_lock);
+
+  while (res == ESP_OK && !stream_stopping) {
+    stream_frame_t *frame = stream_frame_acquire(last_seq);
+    if (!frame) {
+      if (!ulTaskNotifyTake(pdTRUE, STREAM_FRAME_TIMEOUT_MS / portTICK_PERIOD_MS)) {
+        log_e("No stream frame in %ums", STREAM_FRAME_TIMEOUT_MS);
+        res = ESP_FAIL;
+      }
+      continue;
     }
+
+    if (last_seq && frame->seq > last_seq + 1) {
+      client->skipped += frame->seq - last_seq - 1;
+    }
+    last_seq = frame->seq;
+
+    int64_t send_start = esp_timer_get_time();
+    res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
     if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
+      size_t hlen = snprintf(part_buf, 128, _STREAM_PART, frame->len, frame->timestamp.tv_sec, frame->timestamp.tv_usec);
+      res = httpd_resp_send_chunk(req, part_buf, hlen);
     }
-    if (fb) {
-      esp_camera_fb_return(fb);
-      fb = NULL;
-      _jpg_buf = NULL;
-    } else if (_jpg_buf) {
-      free(_jpg_buf);
-      _jpg_buf = NULL;
+    if (res == ESP_OK) {
+      res = httpd_resp_send_chunk(req, (const char *)frame->buf, frame->len);
     }
+    size_t frame_len = frame->len;
+    int64_t send_end = esp_timer_get_time();
+    uint32_t latency = (send_end - frame->captured) / 1000;
+    stream_frame_release(frame);
     if (res != ESP_OK) {
       log_e("Send frame failed");
       break;
     }
-    int64_t fr_end = esp_timer_get_time();
-
-    int64_t frame_time = fr_end - last_frame;
-    last_frame = fr_end;
 
-    frame_time /= 1000;
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-    uint32_t avg_frame_time = ra_filter_run(&ra_filter, frame_time);
-#endif
+    client->sent++;
+    client->latency = client->latency ? (client->latency * 7 + latency) / 8 : latency;
+    client->send_time = ra_filter_run(&client->send_filter, (send_end - send_start) / 1000);
     log_i(
-      "MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps)", (uint32_t)(_jpg_buf_len), (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time, avg_frame_time,
-      1000.0 / avg_frame_time
+      "MJPG[%d]: %uB, send %ums, latency %ums, camera %ums (%.1ffps), %u skipped", slot, (uint32_t)frame_len, client->send_time, latency,
+      stream_frame_time, stream_frame_time ? 1000.0 / stream_frame_time : 0.0, client->skipped
     );
   }
+  return res;
+}
 
-#if defined(LED_GPIO_NUM)
-  isStreaming = false;
-  enable_led(false);
+#if STREAM_ASYNC_CLIENTS
+static void stream_client_task(void *arg) {
+  int slot = (int)(intptr_t)arg;
+  httpd_req_t *req = stream_clients[slot].req;
+
+  stream_send_frames(req, slot);
+  stream_client_remove(slot);
+  httpd_req_async_handler_complete(req);
+  vTaskDelete(NULL);
+}
+#endif
+
+static bool stream_producer_start() {
+  if (!stream_producer &&
+      createPlacedTask(TaskId::STREAM_PRODUCER, stream_producer_task, NULL, &stream_producer) != pdPASS) {
+    stream_producer = NULL;
+    return false;
+  }
+  return true;
+}
+
+static esp_err_t stream_handler(httpd_req_t *req) {
+  if (!stream_producer_start()) {
+    return httpd_resp_send_500(req);
+  }
+
+  int slot = stream_client_add(req);
+  if (slot < 0) {
+    log_e("Stream refused, %d clients", STREAM_MAX_CLIENTS);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  // The rate the governor is running at as this client joins
+  char framerate[8];
+  snprintf(framerate, sizeof(framerate), "%u", 1000 / stream_interval);
+  esp_err_t res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
+  if (res == ESP_OK) {
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "X-Framerate", framerate);
+  }
+
+#if STREAM_ASYNC_CLIENTS
+  // The request outlives the handler - the httpd task goes back to serving
+  httpd_req_t *async_req = NULL;
+  if (res == ESP_OK) {
+    res = httpd_req_async_handler_begin(req, &async_req);
+  }
+  if (res == ESP_OK) {
+    stream_clients[slot].req = async_req;
+    if (createPlacedTask(TaskId::STREAM_CLIENT, stream_client_task, (void *)(intptr_t)slot, NULL) == pdPASS) {
+      return ESP_OK;
+    }
+    httpd_req_async_handler_complete(async_req);
+    res = ESP_FAIL;
+  }
+#else
+  if (res == ESP_OK) {
+    res = stream_send_frames(req, slot);
+  }
 #endif
 
+  stream_client_remove(slot);
   return res;
 }
 
-static esp_err_t parse_get(httpd_req_t *req, char **obuf) {
-  char *buf = NULL;
-  size_t buf_len = 0;
+// Query strings - copied into a bounded buffer on the handler's stack and
+// split in place into a key table once, so a slider drag costs no heap and
+// each key is a scan of the table rather than of the string. A longer query
+// than QUERY_MAX_LEN is refused. Values aren't URL decoded, as before
+#define QUERY_MAX_LEN    256
+#define QUERY_MAX_PARAMS 16  // Further parameters are ignored; /resolution sends 12
 
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = (char *)malloc(buf_len);
-    if (!buf) {
-      httpd_resp_send_500(req);
-      return ESP_FAIL;
+typedef struct {
+  char buf[QUERY_MAX_LEN];
+  const char *keys[QUERY_MAX_PARAMS];
+  const char *values[QUERY_MAX_PARAMS];
+  int count;
+} query_t;
+
+static esp_err_t parse_get(httpd_req_t *req, query_t *query) {
+  query->count = 0;
+  size_t len = httpd_req_get_url_query_len(req);
+  if (len >= QUERY_MAX_LEN) {
+    httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, NULL);
+    return ESP_FAIL;
+  }
+  if (len == 0 || httpd_req_get_url_query_str(req, query->buf, sizeof(query->buf)) != ESP_OK) {
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
+
+  char *p = query->buf;
+  while (query->count < QUERY_MAX_PARAMS) {
+    char *end = p + strcspn(p, "&");
+    bool last = *end == 0;
+    *end = 0;
+    char *eq = strchr(p, '=');
+    if (eq) {
+      *eq = 0;
+      query->keys[query->count] = p;
+      query->values[query->count] = eq + 1;
+      query->count++;
     }
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-      *obuf = buf;
-      return ESP_OK;
+    if (last) {
+      break;
+    }
+    p = end + 1;
+  }
+  return ESP_OK;
+}
+
+static const char *query_get(const query_t *query, const char *key) {
+  for (int i = 0; i < query->count; i++) {
+    if (!strcmp(query->keys[i], key)) {
+      return query->values[i];
+    }
+  }
+  return NULL;
+}
+
+static int parse_get_var(const query_t *query, const char *key, int def) {
+  const char *value = query_get(query, key);
+  return value ? atoi(value) : def;
+}
+
+// RTP stream - /rtp?dest=<ip>[&port=<n>][&mtu=<n>] sends the broadcaster's
+// frames to one receiver as RTP/JPEG (rtp_jpeg.h) over UDP and answers with
+// the SDP to play it; the same request again retargets it and /rtp?stop=1
+// ends it. The sender takes a stream client slot, so the governor paces the
+// camera for it like any /stream client. A lost packet loses its frame only
+#define RTP_DEFAULT_PORT 5004
+#define RTP_SEND_RETRIES 3  // lwIP out of buffers - wait a tick and retry, then drop the rest of the frame
+
+typedef struct {
+  int slot;  // Stream client slot, -1 when not running
+  int sock;
+  struct sockaddr_in dest;
+  size_t mtu;
+  volatile bool stop;
+  uint32_t packets;
+  uint32_t frames_dropped;  // Not RFC 2435 compatible, or a send failed
+} rtp_session_t;
+
+static rtp_session_t rtp_session = {-1, -1};
+static RtpJpegPacketizer rtp_packetizer;
+static uint8_t rtp_packet[RTP_JPEG_MAX_MTU];  // Only the RTP task sends
+
+static bool rtp_send_frame(const stream_frame_t *frame) {
+  portENTER_CRITICAL(&stream_lock);
+  struct sockaddr_in dest = rtp_session.dest;
+  size_t mtu = rtp_session.mtu;
+  portEXIT_CRITICAL(&stream_lock);
+
+  uint32_t timestamp = (uint64_t)frame->captured * RTP_JPEG_CLOCK_HZ / 1000000;
+  if (!rtp_packetizer.setFrame(frame->buf, frame->len, timestamp)) {
+    return false;
+  }
+  size_t len;
+  while ((len = rtp_packetizer.nextPacket(rtp_packet, mtu)) > 0) {
+    int retries = 0;
+    while (sendto(rtp_session.sock, rtp_packet, len, 0, (struct sockaddr *)&dest, sizeof(dest)) < 0) {
+      if ((errno != ENOMEM && errno != EAGAIN) || ++retries > RTP_SEND_RETRIES) {
+        return false;
+      }
+      vTaskDelay(1);
+    }
+    rtp_session.packets++;
+  }
+  return true;
+}
+
+static void rtp_stream_task(void *arg) {
+  int slot = rtp_session.slot;
+  stream_client_t *client = &stream_clients[slot];
+  uint32_t last_seq = 0;
+
+  ra_filter_reset(&client->send_filter);
+  portENTER_CRITICAL(&stream_lock);
+  client->task = xTaskGetCurrentTaskHandle();
+  portEXIT_CRITICAL(&stream_lock);
+
+  // No receiver to lose - runs until stopped
+  while (!rtp_session.stop) {
+    stream_frame_t *frame = stream_frame_acquire(last_seq);
+    if (!frame) {
+      ulTaskNotifyTake(pdTRUE, STREAM_FRAME_TIMEOUT_MS / portTICK_PERIOD_MS);
+      continue;
+    }
+
+    if (last_seq && frame->seq > last_seq + 1) {
+      client->skipped += frame->seq - last_seq - 1;
+    }
+    last_seq = frame->seq;
+
+    int64_t send_start = esp_timer_get_time();
+    bool sent = rtp_send_frame(frame);
+    int64_t send_end = esp_timer_get_time();
+    uint32_t latency = (send_end - frame->captured) / 1000;
+    stream_frame_release(frame);
+    if (!sent) {
+      rtp_session.frames_dropped++;
+      continue;
+    }
+
+    client->sent++;
+    client->latency = client->latency ? (client->latency * 7 + latency) / 8 : latency;
+    client->send_time = ra_filter_run(&client->send_filter, (send_end - send_start) / 1000);
+  }
+
+  close(rtp_session.sock);
+  rtp_session.sock = -1;
+  stream_client_remove(slot);
+  rtp_session.slot = -1;
+  log_i("RTP stream stopped, %u packets", rtp_session.packets);
+  vTaskDelete(NULL);
+}
+
+static esp_err_t rtp_handler(httpd_req_t *req) {
+  query_t query;
+
+  if (parse_get(req, &query) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  if (parse_get_var(&query, "stop", 0)) {
+    int slot = rtp_session.slot;
+    if (slot >= 0) {
+      rtp_session.stop = true;
+      TaskHandle_t task = stream_clients[slot].task;
+      if (task) {
+        xTaskNotifyGive(task);
+      }
+    }
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  const char *dest = query_get(&query, "dest");
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(parse_get_var(&query, "port", RTP_DEFAULT_PORT));
+  if (!dest || inet_pton(AF_INET, dest, &addr.sin_addr) != 1 || !addr.sin_port) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "dest=<ip> required");
+  }
+  int mtu = parse_get_var(&query, "mtu", RTP_JPEG_DEFAULT_MTU);
+  mtu = mtu < RTP_JPEG_MIN_MTU ? RTP_JPEG_MIN_MTU : (mtu > RTP_JPEG_MAX_MTU ? RTP_JPEG_MAX_MTU : mtu);
+
+  if (rtp_session.slot >= 0) {
+    if (rtp_session.stop) {
+      httpd_resp_set_status(req, "503 Service Unavailable");  // Still stopping
+      return httpd_resp_send(req, NULL, 0);
+    }
+    portENTER_CRITICAL(&stream_lock);
+    rtp_session.dest = addr;
+    rtp_session.mtu = mtu;
+    portEXIT_CRITICAL(&stream_lock);
+  } else {
+    if (!stream_producer_start()) {
+      return httpd_resp_send_500(req);
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+      return httpd_resp_send_500(req);
+    }
+    int slot = stream_client_add(NULL);
+    if (slot < 0) {
+      close(sock);
+      log_e("RTP refused, %d clients", STREAM_MAX_CLIENTS);
+      httpd_resp_set_status(req, "503 Service Unavailable");
+      return httpd_resp_send(req, NULL, 0);
+    }
+    rtp_session.slot = slot;
+    rtp_session.sock = sock;
+    rtp_session.dest = addr;
+    rtp_session.mtu = mtu;
+    rtp_session.stop = false;
+    rtp_session.packets = 0;
+    rtp_session.frames_dropped = 0;
+    rtp_packetizer.begin(esp_random(), esp_random() & 0xFFFF);
+    if (createPlacedTask(TaskId::RTP_STREAM, rtp_stream_task, NULL, NULL) != pdPASS) {
+      close(sock);
+      rtp_session.sock = -1;
+      rtp_session.slot = -1;
+      stream_client_remove(slot);
+      return httpd_resp_send_500(req);
     }
-    free(buf);
   }
-  httpd_resp_send_404(req);
-  return ESP_FAIL;
+  log_i("RTP stream to %s:%u, MTU %d", dest, ntohs(addr.sin_port), mtu);
+
+  // Enough for ffplay / VLC to receive it: ffplay -protocol_whitelist file,udp,rtp stream.sdp
+  String local = WiFi.getMode() == WIFI_AP ? WiFi.softAPIP().toString() : WiFi.localIP().toString();
+  char sdp[256];
+  int len = snprintf(
+    sdp, sizeof(sdp), "v=0\r\no=- %lu 0 IN IP4 %s\r\ns=Cosmic1 camera\r\nc=IN IP4 %s\r\nt=0 0\r\nm=video %u RTP/AVP %u\r\na=rtpmap:%u JPEG/%u\r\n",
+    (unsigned long)rtp_packetizer.getSsrc(), local.c_str(), dest, ntohs(addr.sin_port), RTP_JPEG_PAYLOAD_TYPE, RTP_JPEG_PAYLOAD_TYPE, RTP_JPEG_CLOCK_HZ
+  );
+  httpd_resp_set_type(req, "application/sdp");
+  return httpd_resp_send(req, sdp, len);
 }
 
 static esp_err_t cmd_handler(httpd_req_t *req) {
-  char *buf = NULL;
-  char variable[32];
-  char value[32];
+  query_t query;
 
-  if (parse_get(req, &buf) != ESP_OK) {
+  if (parse_get(req, &query) != ESP_OK) {
     return ESP_FAIL;
   }
-  if (httpd_query_key_value(buf, "var", variable, sizeof(variable)) != ESP_OK || httpd_query_key_value(buf, "val", value, sizeof(value)) != ESP_OK) {
-    free(buf);
+  const char *variable = query_get(&query, "var");
+  const char *value = query_get(&query, "val");
+  if (!variable || !value) {
     httpd_resp_send_404(req);
     return ESP_FAIL;
   }
-  free(buf);
 
   int val = atoi(value);
   log_i("%s = %d", variable, val);
@@ -340,10 +1080,18 @@ static esp_err_t cmd_handler(httpd_req_t *req) {
   int res = 0;
 
   if (!strcmp(variable, "framesize")) {
-    if (s->pixformat == PIXFORMAT_JPEG) {
+    // Past CAMERA_FB_MAX_FRAMESIZE a frame would overrun the buffers sized at init
+    if (val < 0 || !frameSizeFits((framesize_t)val)) {
+      res = -1;
+    } else if (s->pixformat == PIXFORMAT_JPEG) {
       res = s->set_framesize(s, (framesize_t)val);
     }
   } else if (!strcmp(variable, "quality")) {
+    // The stream governor's offset stays on top of the new setting
+    if (stream_base_quality >= 0) {
+      stream_base_quality = val;
+      val = val + stream_quality_offset > 63 ? 63 : val + stream_quality_offset;
+    }
     res = s->set_quality(s, val);
   } else if (!strcmp(variable, "contrast")) {
     res = s->set_contrast(s, val);
@@ -403,6 +1151,7 @@ static esp_err_t cmd_handler(httpd_req_t *req) {
     res = -1;
   }
 
+  status_changed();
   if (res < 0) {
     return httpd_resp_send_500(req);
   }
@@ -415,11 +1164,10 @@ static int print_reg(char *p, sensor_t *s, uint16_t reg, uint32_t mask) {
   return sprintf(p, "\"0x%x\":%u,", reg, s->get_reg(s, reg, mask));
 }
 
-static esp_err_t status_handler(httpd_req_t *req) {
-  static char json_response[1024];
-
+// Sensor settings as JSON; returns the length
+static size_t build_status_json(char *json) {
   sensor_t *s = esp_camera_sensor_get();
-  char *p = json_response;
+  char *p = json;
   *p++ = '{';
 
   if (s->id.PID == OV5640_PID || s->id.PID == OV3660_PID) {
@@ -483,32 +1231,225 @@ static esp_err_t status_handler(httpd_req_t *req) {
 #else
   p += sprintf(p, ",\"led_intensity\":%d", -1);
 #endif
+  *p++ = '}';
+  *p++ = 0;
+  return p - 1 - json;
+}
+
+// Conditional GET - true when the client's cached copy is this one
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+  char match[16];
+  return httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK && !strcmp(match, etag);
+}
+
+static esp_err_t send_not_modified(httpd_req_t *req) {
+  httpd_resp_set_status(req, "304 Not Modified");
+  return httpd_resp_send(req, NULL, 0);
+}
+
+static bool accepts_gzip(httpd_req_t *req) {
+  char encoding[96];
+  return httpd_req_get_hdr_value_str(req, "Accept-Encoding", encoding, sizeof(encoding)) == ESP_OK && strstr(encoding, "gzip");
+}
+
+static bool send_gzip_chunk(const uint8_t *data, size_t length, void *context) {
+  return httpd_resp_send_chunk((httpd_req_t *)context, (const char *)data, length) == ESP_OK;
+}
+
+static esp_err_t status_handler(httpd_req_t *req) {
+  static char json_response[1024];
+  static size_t json_len = 0;
+  static uint8_t json_gzip[1024];
+  static size_t json_gzip_len = 0;  // 0 when only the plain copy is kept
+  static uint32_t json_version = 0;
+  static char etag[12];
+
+  uint32_t version = current_status_version();
+  if (json_version != version) {
+    json_len = build_status_json(json_response);
+    json_gzip_len = json_len >= HTTP_GZIP_MIN_BYTES ? http_gzip.compress(json_response, json_len, json_gzip, sizeof(json_gzip)) : 0;
+    json_version = version;
+    snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned)version);
+  }
+
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "ETag", etag);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+  httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+  if (etag_matches(req, etag)) {
+    return send_not_modified(req);
+  }
+  httpd_resp_set_type(req, "application/json");
+  if (json_gzip_len && accepts_gzip(req)) {
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)json_gzip, json_gzip_len);
+  }
+  return httpd_resp_send(req, json_response, json_len);
+}
+
+// Live stream numbers - change every frame, so never cached
+static esp_err_t stream_status_handler(httpd_req_t *req) {
+  char json[512];
+  char *p = json;
+  p += sprintf(p, "{\"stream_clients\":%d", stream_client_count);
+  p += sprintf(p, ",\"stream_frame_ms\":%u", stream_frame_time);
+  p += sprintf(p, ",\"stream_interval_ms\":%u", stream_interval);
+  p += sprintf(p, ",\"stream_quality_offset\":%d", stream_quality_offset);
+  FramePoolStats pool = FramePools().getStats(FrameClass::JPEG);
+  p += sprintf(p, ",\"pool_in_use\":%u,\"pool_blocks\":%u", pool.inUse, pool.blocks);
+  p += sprintf(p, ",\"pool_waits\":%u,\"pool_wait_worst_us\":%u,\"pool_timeouts\":%u", pool.waits, pool.worstWaitUs,
+               pool.timeouts);
+  if (rtp_session.slot >= 0) {
+    p += sprintf(p, ",\"rtp_packets\":%u", rtp_session.packets);
+    p += sprintf(p, ",\"rtp_frames_dropped\":%u", rtp_session.frames_dropped);
+  }
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    if (stream_clients[i].used) {
+      p += sprintf(p, ",\"stream_latency_%d\":%u", i, stream_clients[i].latency);
+      p += sprintf(p, ",\"stream_send_%d\":%u", i, stream_clients[i].send_time);
+    }
+  }
   *p++ = '}';
   *p++ = 0;
   httpd_resp_set_type(req, "application/json");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  return httpd_resp_send(req, json_response, strlen(json_response));
+  return httpd_resp_send(req, json, strlen(json));
+}
+
+// Prometheus text exposition of the metrics registry, an entry - or a family member - per chunk
+static esp_err_t metrics_handler(httpd_req_t *req) {
+  static char chunk[METRICS_ENTRY_MAX];  // Off the httpd task's stack; handlers run one at a time
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+  // Plain if the window can't be had
+  bool compressed = accepts_gzip(req) && http_gzip.begin(send_gzip_chunk, req);
+  if (compressed) {
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  }
+
+  esp_err_t res = ESP_OK;
+  for (size_t i = 0; i < Metrics().getCount() && res == ESP_OK; i++) {
+    for (uint8_t part = 0; part < Metrics().getPartCount(i) && res == ESP_OK; part++) {
+      size_t len = Metrics().renderEntry(i, part, chunk, sizeof(chunk));
+      if (!len) {
+        log_e("Metric %u too long", (unsigned)i);
+      } else if (compressed) {
+        res = http_gzip.write(chunk, len) ? ESP_OK : ESP_FAIL;
+      } else {
+        res = httpd_resp_send_chunk(req, chunk, len);
+      }
+    }
+  }
+  if (res == ESP_OK && compressed && !http_gzip.finish()) {
+    res = ESP_FAIL;
+  }
+  if (res == ESP_OK) {
+    res = httpd_resp_send_chunk(req, NULL, 0);
+  }
+  return res;
+}
+
+// The flight recorder's sectors as they are on flash, oldest first, a sector per chunk
+static esp_err_t flightlog_handler(httpd_req_t *req) {
+  if (!FlightRec().isReady()) {
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=flightlog.bin");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  // Straight from the memory map - nothing is copied to RAM
+  esp_err_t res = ESP_OK;
+  const uint8_t *sector;
+  for (uint32_t i = 0; res == ESP_OK && (sector = FlightRec().getSector(i)) != NULL; i++) {
+    res = httpd_resp_send_chunk(req, (const char *)sector, FLIGHT_RECORDER_SECTOR_SIZE);
+  }
+  if (res == ESP_OK) {
+    res = httpd_resp_send_chunk(req, NULL, 0);
+  }
+  return res;
+}
+
+// LINK_FRAME records out of the flight recorder behind a pcap header, for
+// Wireshark with tools/link_capture.lua; oldest sector first, as /flightlog
+static esp_err_t linkcap_handler(httpd_req_t *req) {
+  static uint8_t chunk[FLIGHT_RECORDER_SECTOR_SIZE];    // One client at a time on this server
+  if (!FlightRec().isReady()) {
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
+  httpd_resp_set_type(req, "application/vnd.tcpdump.pcap");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=linkcap.pcap");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  size_t used = linkCaptureFileHeader(chunk, LINK_CAPTURE_SNAP_BYTES);
+  esp_err_t res = ESP_OK;
+  const uint8_t *sector;
+  for (uint32_t i = 0; res == ESP_OK && (sector = FlightRec().getSector(i)) != NULL; i++) {
+    uint32_t pos = sizeof(FlightSectorHeader);
+    while (res == ESP_OK && pos < FLIGHT_RECORDER_SECTOR_SIZE &&
+           FlightRecorder::checkRecord(sector + pos, FLIGHT_RECORDER_SECTOR_SIZE - pos)) {
+      FlightRecordHeader header;
+      memcpy(&header, sector + pos, sizeof(header));
+      if (header.type == (uint8_t)FlightRecordType::LINK_FRAME) {
+        if (used + header.length > sizeof(chunk)) {
+          res = httpd_resp_send_chunk(req, (const char *)chunk, used);
+          used = 0;
+        }
+        memcpy(chunk + used, sector + pos + sizeof(header), header.length);
+        used += header.length;
+      }
+      pos += FlightRecorder::recordSize(header.length);
+    }
+  }
+  if (res == ESP_OK && used) {
+    res = httpd_resp_send_chunk(req, (const char *)chunk, used);
+  }
+  if (res == ESP_OK) {
+    res = httpd_resp_send_chunk(req, NULL, 0);
+  }
+  return res;
+}
+
+static bool trace_send_chunk(void *context, const char *data, size_t length) {
+  return httpd_resp_send_chunk((httpd_req_t *)context, data, length) == ESP_OK;
+}
+
+// The trace ring as Chrome trace JSON, for ui.perfetto.dev or chrome://tracing
+static esp_err_t trace_handler(httpd_req_t *req) {
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=trace.json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  if (!Trace().exportJson(trace_send_chunk, req)) {
+    // Nothing sent, or the client went away part way through
+    return ESP_FAIL;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 static esp_err_t xclk_handler(httpd_req_t *req) {
-  char *buf = NULL;
-  char _xclk[32];
+  query_t query;
 
-  if (parse_get(req, &buf) != ESP_OK) {
+  if (parse_get(req, &query) != ESP_OK) {
     return ESP_FAIL;
   }
-  if (httpd_query_key_value(buf, "xclk", _xclk, sizeof(_xclk)) != ESP_OK) {
-    free(buf);
+  const char *_xclk = query_get(&query, "xclk");
+  if (!_xclk) {
     httpd_resp_send_404(req);
     return ESP_FAIL;
   }
-  free(buf);
 
   int xclk = atoi(_xclk);
   log_i("Set XCLK: %d MHz", xclk);
 
   sensor_t *s = esp_camera_sensor_get();
   int res = s->set_xclk(s, LEDC_TIMER_0, xclk);
+  status_changed();
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -518,21 +1459,18 @@ static esp_err_t xclk_handler(httpd_req_t *req) {
 }
 
 static esp_err_t reg_handler(httpd_req_t *req) {
-  char *buf = NULL;
-  char _reg[32];
-  char _mask[32];
-  char _val[32];
+  query_t query;
 
-  if (parse_get(req, &buf) != ESP_OK) {
+  if (parse_get(req, &query) != ESP_OK) {
     return ESP_FAIL;
   }
-  if (httpd_query_key_value(buf, "reg", _reg, sizeof(_reg)) != ESP_OK || httpd_query_key_value(buf, "mask", _mask, sizeof(_mask)) != ESP_OK
-      || httpd_query_key_value(buf, "val", _val, sizeof(_val)) != ESP_OK) {
-    free(buf);
+  const char *_reg = query_get(&query, "reg");
+  const char *_mask = query_get(&query, "mask");
+  const char *_val = query_get(&query, "val");
+  if (!_reg || !_mask || !_val) {
     httpd_resp_send_404(req);
     return ESP_FAIL;
   }
-  free(buf);
 
   int reg = atoi(_reg);
   int mask = atoi(_mask);
@@ -541,6 +1479,7 @@ static esp_err_t reg_handler(httpd_req_t *req) {
 
   sensor_t *s = esp_camera_sensor_get();
   int res = s->set_reg(s, reg, mask, val);
+  status_changed();
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -550,19 +1489,17 @@ static esp_err_t reg_handler(httpd_req_t *req) {
 }
 
 static esp_err_t greg_handler(httpd_req_t *req) {
-  char *buf = NULL;
-  char _reg[32];
-  char _mask[32];
+  query_t query;
 
-  if (parse_get(req, &buf) != ESP_OK) {
+  if (parse_get(req, &query) != ESP_OK) {
     return ESP_FAIL;
   }
-  if (httpd_query_key_value(buf, "reg", _reg, sizeof(_reg)) != ESP_OK || httpd_query_key_value(buf, "mask", _mask, sizeof(_mask)) != ESP_OK) {
-    free(buf);
+  const char *_reg = query_get(&query, "reg");
+  const char *_mask = query_get(&query, "mask");
+  if (!_reg || !_mask) {
     httpd_resp_send_404(req);
     return ESP_FAIL;
   }
-  free(buf);
 
   int reg = atoi(_reg);
   int mask = atoi(_mask);
@@ -579,34 +1516,26 @@ static esp_err_t greg_handler(httpd_req_t *req) {
   return httpd_resp_send(req, val, strlen(val));
 }
 
-static int parse_get_var(char *buf, const char *key, int def) {
-  char _int[16];
-  if (httpd_query_key_value(buf, key, _int, sizeof(_int)) != ESP_OK) {
-    return def;
-  }
-  return atoi(_int);
-}
-
 static esp_err_t pll_handler(httpd_req_t *req) {
-  char *buf = NULL;
+  query_t query;
 
-  if (parse_get(req, &buf) != ESP_OK) {
+  if (parse_get(req, &query) != ESP_OK) {
     return ESP_FAIL;
   }
 
-  int bypass = parse_get_var(buf, "bypass", 0);
-  int mul = parse_get_var(buf, "mul", 0);
-  int sys = parse_get_var(buf, "sys", 0);
-  int root = parse_get_var(buf, "root", 0);
-  int pre = parse_get_var(buf, "pre", 0);
-  int seld5 = parse_get_var(buf, "seld5", 0);
-  int pclken = parse_get_var(buf, "pclken", 0);
-  int pclk = parse_get_var(buf, "pclk", 0);
-  free(buf);
+  int bypass = parse_get_var(&query, "bypass", 0);
+  int mul = parse_get_var(&query, "mul", 0);
+  int sys = parse_get_var(&query, "sys", 0);
+  int root = parse_get_var(&query, "root", 0);
+  int pre = parse_get_var(&query, "pre", 0);
+  int seld5 = parse_get_var(&query, "seld5", 0);
+  int pclken = parse_get_var(&query, "pclken", 0);
+  int pclk = parse_get_var(&query, "pclk", 0);
 
   log_i("Set Pll: bypass: %d, mul: %d, sys: %d, root: %d, pre: %d, seld5: %d, pclken: %d, pclk: %d", bypass, mul, sys, root, pre, seld5, pclken, pclk);
   sensor_t *s = esp_camera_sensor_get();
   int res = s->set_pll(s, bypass, mul, sys, root, pre, seld5, pclken, pclk);
+  status_changed();
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -616,25 +1545,24 @@ static esp_err_t pll_handler(httpd_req_t *req) {
 }
 
 static esp_err_t win_handler(httpd_req_t *req) {
-  char *buf = NULL;
+  query_t query;
 
-  if (parse_get(req, &buf) != ESP_OK) {
+  if (parse_get(req, &query) != ESP_OK) {
     return ESP_FAIL;
   }
 
-  int startX = parse_get_var(buf, "sx", 0);
-  int startY = parse_get_var(buf, "sy", 0);
-  int endX = parse_get_var(buf, "ex", 0);
-  int endY = parse_get_var(buf, "ey", 0);
-  int offsetX = parse_get_var(buf, "offx", 0);
-  int offsetY = parse_get_var(buf, "offy", 0);
-  int totalX = parse_get_var(buf, "tx", 0);
-  int totalY = parse_get_var(buf, "ty", 0);  // codespell:ignore totaly
-  int outputX = parse_get_var(buf, "ox", 0);
-  int outputY = parse_get_var(buf, "oy", 0);
-  bool scale = parse_get_var(buf, "scale", 0) == 1;
-  bool binning = parse_get_var(buf, "binning", 0) == 1;
-  free(buf);
+  int startX = parse_get_var(&query, "sx", 0);
+  int startY = parse_get_var(&query, "sy", 0);
+  int endX = parse_get_var(&query, "ex", 0);
+  int endY = parse_get_var(&query, "ey", 0);
+  int offsetX = parse_get_var(&query, "offx", 0);
+  int offsetY = parse_get_var(&query, "offy", 0);
+  int totalX = parse_get_var(&query, "tx", 0);
+  int totalY = parse_get_var(&query, "ty", 0);  // codespell:ignore totaly
+  int outputX = parse_get_var(&query, "ox", 0);
+  int outputY = parse_get_var(&query, "oy", 0);
+  bool scale = parse_get_var(&query, "scale", 0) == 1;
+  bool binning = parse_get_var(&query, "binning", 0) == 1;
 
   log_i(
     "Set Window: Start: %d %d, End: %d %d, Offset: %d %d, Total: %d %d, Output: %d %d, Scale: %u, Binning: %u", startX, startY, endX, endY, offsetX, offsetY,
@@ -642,6 +1570,7 @@ static esp_err_t win_handler(httpd_req_t *req) {
   );
   sensor_t *s = esp_camera_sensor_get();
   int res = s->set_res_raw(s, startX, startY, endX, endY, offsetX, offsetY, totalX, totalY, outputX, outputY, scale, binning);  // codespell:ignore totaly
+  status_changed();
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -650,17 +1579,170 @@ static esp_err_t win_handler(httpd_req_t *req) {
   return httpd_resp_send(req, NULL, 0);
 }
 
-static esp_err_t index_handler(httpd_req_t *req) {
-  httpd_resp_set_type(req, "text/html");
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+// Dashboard WebSocket - /ws pushes dashboard_feed.h messages every
+// DASHBOARD_UPDATE_RATE_MS to up to MAX_WEB_CLIENTS clients. The feed is
+// sampled and encoded on its own task; the sends run as httpd work so they
+// never interleave with the server's own writes to a socket
+
+typedef struct {
+  int fd;
+  bool keyframe;  // Needs a keyframe before the next delta
+} ws_client_t;
+
+static ws_client_t ws_clients[MAX_WEB_CLIENTS];
+static int ws_client_count = 0;
+static DashboardFeed ws_feed;
+static uint8_t ws_delta[DASHBOARD_MAX_MESSAGE];
+static size_t ws_delta_len = 0;
+static volatile bool ws_push_pending = false;
+static TaskHandle_t ws_push_task_handle = NULL;
+
+static void ws_client_remove(int slot) {
+  log_i("Dashboard client %d left", ws_clients[slot].fd);
+  ws_clients[slot] = ws_clients[--ws_client_count];
+}
+
+static esp_err_t ws_send(int fd, const uint8_t *data, size_t len) {
+  httpd_ws_frame_t frame = {};
+  frame.type = HTTPD_WS_TYPE_BINARY;
+  frame.payload = (uint8_t *)data;
+  frame.len = len;
+  return httpd_ws_send_frame_async(camera_httpd, fd, &frame);
+}
+
+// On the httpd task
+static void ws_push_work(void *arg) {
+  uint8_t keyframe[DASHBOARD_MAX_MESSAGE];
+  size_t keyframe_len = 0;
+
+  for (int i = ws_client_count - 1; i >= 0; i--) {
+    ws_client_t *client = &ws_clients[i];
+    if (httpd_ws_get_fd_info(camera_httpd, client->fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+      ws_client_remove(i);
+      continue;
+    }
+    esp_err_t res = ESP_OK;
+    if (client->keyframe) {
+      if (!keyframe_len) {
+        keyframe_len = ws_feed.encodeKeyframe(keyframe, sizeof(keyframe));
+      }
+      res = keyframe_len ? ws_send(client->fd, keyframe, keyframe_len) : ESP_FAIL;
+      client->keyframe = res != ESP_OK;
+    } else if (ws_delta_len) {
+      res = ws_send(client->fd, ws_delta, ws_delta_len);
+    }
+    if (res != ESP_OK) {
+      log_e("Dashboard send to %d failed", client->fd);
+    }
+  }
+  ws_push_pending = false;
+}
+
+static void ws_push_task(void *arg) {
+  while (true) {
+    vTaskDelay(DASHBOARD_UPDATE_RATE_MS / portTICK_PERIOD_MS);
+    // A slow push still running skips this one; the next delta covers both
+    if (!ws_client_count || ws_push_pending) {
+      continue;
+    }
+
+    ws_feed.sample(current_status_version());
+    ws_delta_len = ws_feed.encodeDelta(ws_delta, sizeof(ws_delta));
+    bool keyframes = false;
+    for (int i = 0; i < ws_client_count; i++) {
+      keyframes |= ws_clients[i].keyframe;
+    }
+    if (!ws_delta_len && !keyframes) {
+      continue;
+    }
+
+    ws_push_pending = true;
+    if (httpd_queue_work(camera_httpd, ws_push_work, NULL) != ESP_OK) {
+      ws_push_pending = false;
+    }
+  }
+}
+
+static esp_err_t ws_handler(httpd_req_t *req) {
+  int fd = httpd_req_to_sockfd(req);
+
+  // Handshake - the client joins and gets a keyframe on the next push
+  if (req->method == HTTP_GET) {
+    if (ws_client_count >= MAX_WEB_CLIENTS) {
+      log_e("Dashboard refused, %d clients", MAX_WEB_CLIENTS);
+      return ESP_FAIL;
+    }
+    ws_clients[ws_client_count++] = {fd, true};
+    log_i("Dashboard client %d joined", fd);
+    return ESP_OK;
+  }
+
+  // Nothing is expected from the client - read whatever small frame it sends and drop it
+  httpd_ws_frame_t frame = {};
+  esp_err_t res = httpd_ws_recv_frame(req, &frame, 0);
+  if (res != ESP_OK || !frame.len) {
+    return res;
+  }
+  uint8_t discard[128];
+  if (frame.len > sizeof(discard)) {
+    return ESP_FAIL;
+  }
+  frame.payload = discard;
+  return httpd_ws_recv_frame(req, &frame, sizeof(discard));
+}
+#endif
+
+// Static UI - each page in camera_index.h is an HTML shell that loads its
+// CSS and JS from /assets/<sensor>.<content hash>.<ext>. A changed asset is a
+// new URL, so the assets are cached for good and never revalidated; the shell
+// is revalidated on every load and answered with a 304 while unchanged
+typedef struct {
+  const char *uri;
+  const char *type;
+  const unsigned char *data;
+  size_t len;
+  const char *etag;
+} ui_asset_t;
+
+#define UI_PAGE(name)         {NULL, "text/html", name, name##_len, "\"" name##_hash "\""}
+#define UI_ASSET(name, type)  {name##_uri, type, name, name##_len, "\"" name##_hash "\""}
+
+static const ui_asset_t ui_pages[] = {
+  UI_PAGE(index_ov2640_html_gz),
+  UI_PAGE(index_ov3660_html_gz),
+  UI_PAGE(index_ov5640_html_gz),
+};
+
+static const ui_asset_t ui_assets[] = {
+  UI_ASSET(index_ov2640_css_gz, "text/css"),
+  UI_ASSET(index_ov2640_js_gz, "application/javascript"),
+  UI_ASSET(index_ov3660_css_gz, "text/css"),
+  UI_ASSET(index_ov3660_js_gz, "application/javascript"),
+  UI_ASSET(index_ov5640_css_gz, "text/css"),
+  UI_ASSET(index_ov5640_js_gz, "application/javascript"),
+};
+
+static esp_err_t send_ui_asset(httpd_req_t *req, const ui_asset_t *asset, const char *cache_control) {
+  httpd_resp_set_hdr(req, "ETag", asset->etag);
+  httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+  if (etag_matches(req, asset->etag)) {
+    return send_not_modified(req);
+  }
+  httpd_resp_set_type(req, asset->type);
   httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  return httpd_resp_send(req, (const char *)asset->data, asset->len);
+}
+
+static esp_err_t index_handler(httpd_req_t *req) {
   sensor_t *s = esp_camera_sensor_get();
   if (s != NULL) {
     if (s->id.PID == OV3660_PID) {
-      return httpd_resp_send(req, (const char *)index_ov3660_html_gz, index_ov3660_html_gz_len);
+      return send_ui_asset(req, &ui_pages[1], "no-cache");
     } else if (s->id.PID == OV5640_PID) {
-      return httpd_resp_send(req, (const char *)index_ov5640_html_gz, index_ov5640_html_gz_len);
+      return send_ui_asset(req, &ui_pages[2], "no-cache");
     } else {
-      return httpd_resp_send(req, (const char *)index_ov2640_html_gz, index_ov2640_html_gz_len);
+      return send_ui_asset(req, &ui_pages[0], "no-cache");
     }
   } else {
     log_e("Camera sensor not found");
@@ -668,9 +1750,28 @@ static esp_err_t index_handler(httpd_req_t *req) {
   }
 }
 
+static esp_err_t asset_handler(httpd_req_t *req) {
+  size_t uri_len = strcspn(req->uri, "?");
+  for (size_t i = 0; i < sizeof(ui_assets) / sizeof(ui_assets[0]); i++) {
+    if (strlen(ui_assets[i].uri) == uri_len && !strncmp(req->uri, ui_assets[i].uri, uri_len)) {
+      return send_ui_asset(req, &ui_assets[i], "public, max-age=31536000, immutable");
+    }
+  }
+  return httpd_resp_send_404(req);
+}
+
 void startCameraServer() {
+  FramePools().begin();  // The stream's frames come from it; a no-op once the camera has started it
+
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-  config.max_uri_handlers = 16;
+  config.max_uri_handlers = 20;
+  config.uri_match_fn = httpd_uri_match_wildcard;  // For /assets/*
+
+  // Off the loop() core and below the radio tasks - the default is priority 5, either core
+  const TaskPlacement &placement = taskPlacement(TaskId::HTTPD);
+  config.core_id = placement.core;
+  config.task_priority = placement.priority;
+  config.stack_size = placement.stack;
 
   // Get and display IP address information
   String ip_address = "Not Connected";
@@ -707,6 +1808,19 @@ void startCameraServer() {
 #endif
   };
 
+  httpd_uri_t asset_uri = {
+    .uri = "/assets/*",
+    .method = HTTP_GET,
+    .handler = asset_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
   httpd_uri_t status_uri = {
     .uri = "/status",
     .method = HTTP_GET,
@@ -720,6 +1834,96 @@ void startCameraServer() {
 #endif
   };
 
+  httpd_uri_t rtp_uri = {
+    .uri = "/rtp",
+    .method = HTTP_GET,
+    .handler = rtp_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t stream_status_uri = {
+    .uri = "/stream_status",
+    .method = HTTP_GET,
+    .handler = stream_status_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t metrics_uri = {
+    .uri = "/metrics",
+    .method = HTTP_GET,
+    .handler = metrics_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t flightlog_uri = {
+    .uri = "/flightlog",
+    .method = HTTP_GET,
+    .handler = flightlog_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t linkcap_uri = {
+    .uri = "/linkcap.pcap",
+    .method = HTTP_GET,
+    .handler = linkcap_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t trace_uri = {
+    .uri = "/trace",
+    .method = HTTP_GET,
+    .handler = trace_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+  httpd_uri_t ws_uri = {
+    .uri = "/ws",
+    .method = HTTP_GET,
+    .handler = ws_handler,
+    .user_ctx = NULL,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+  };
+#endif
+
   httpd_uri_t cmd_uri = {
     .uri = "/control",
     .method = HTTP_GET,
@@ -838,12 +2042,22 @@ void startCameraServer() {
   };
 
   ra_filter_init(&ra_filter, 20);
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    ra_filter_init(&stream_clients[i].send_filter, STREAM_SEND_SAMPLES);
+  }
 
   log_i("Starting web server on port: '%d' (Mode: %s, IP: %s)", config.server_port, mode.c_str(), ip_address.c_str());
   if (httpd_start(&camera_httpd, &config) == ESP_OK) {
     httpd_register_uri_handler(camera_httpd, &index_uri);
+    httpd_register_uri_handler(camera_httpd, &asset_uri);
     httpd_register_uri_handler(camera_httpd, &cmd_uri);
     httpd_register_uri_handler(camera_httpd, &status_uri);
+    httpd_register_uri_handler(camera_httpd, &stream_status_uri);
+    httpd_register_uri_handler(camera_httpd, &rtp_uri);
+    httpd_register_uri_handler(camera_httpd, &metrics_uri);
+    httpd_register_uri_handler(camera_httpd, &flightlog_uri);
+    httpd_register_uri_handler(camera_httpd, &linkcap_uri);
+    httpd_register_uri_handler(camera_httpd, &trace_uri);
     httpd_register_uri_handler(camera_httpd, &capture_uri);
     httpd_register_uri_handler(camera_httpd, &bmp_uri);
 
@@ -852,6 +2066,12 @@ void startCameraServer() {
     httpd_register_uri_handler(camera_httpd, &greg_uri);
     httpd_register_uri_handler(camera_httpd, &pll_uri);
     httpd_register_uri_handler(camera_httpd, &win_uri);
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    httpd_register_uri_handler(camera_httpd, &ws_uri);
+    if (!ws_push_task_handle) {
+      createPlacedTask(TaskId::WS_PUSH, ws_push_task, NULL, &ws_push_task_handle);
+    }
+#endif
   }
 
   config.server_port += 1;
@@ -862,6 +2082,50 @@ void startCameraServer() {
   }
 }
 
+// Ends every stream client and the RTP session, then both servers, so their
+// tasks, sockets and buffers go back to the heap. WiFi itself is the
+// caller's to take down; startCameraServer() brings it all back
+void stopCameraServer() {
+  stream_stopping = true;
+  TaskHandle_t waiting[STREAM_MAX_CLIENTS];
+  int count = 0;
+  portENTER_CRITICAL(&stream_lock);
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    if (stream_clients[i].used && stream_clients[i].task) {
+      waiting[count++] = stream_clients[i].task;
+    }
+  }
+  portEXIT_CRITICAL(&stream_lock);
+  if (rtp_session.slot >= 0) {
+    rtp_session.stop = true;
+  }
+  for (int i = 0; i < count; i++) {
+    xTaskNotifyGive(waiting[i]);
+  }
+
+  // A client mid-frame finishes it first
+  for (int waited = 0; stream_client_count && waited < STREAM_STOP_TIMEOUT_MS; waited += 10) {
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+  }
+  if (stream_client_count) {
+    log_e("%d stream clients still running", stream_client_count);
+  }
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+  ws_client_count = 0;  // Their sockets close with the server
+#endif
+  if (camera_httpd) {
+    httpd_stop(camera_httpd);
+    camera_httpd = NULL;
+  }
+  if (stream_httpd) {
+    httpd_stop(stream_httpd);
+    stream_httpd = NULL;
+  }
+  stream_stopping = false;
+  log_i("Web and stream servers stopped");
+}
+
 void setupLedFlash() {
 #if defined(LED_GPIO_NUM)
   ledcAttach(LED_GPIO_NUM, 5000, 8);
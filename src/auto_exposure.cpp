@@ -0,0 +1,81 @@
+#include "auto_exposure.h"
+#include <math.h>
+
+// Luma levels per histogram bin
+#define AE_BIN_WIDTH (256 / SCENE_HISTOGRAM_BINS)
+
+float histogramPercentile(const uint16_t* histogram, float share) {
+    float wanted = share * SCENE_HISTOGRAM_SCALE;
+    float below = 0.0f;
+    for (int bin = 0; bin < SCENE_HISTOGRAM_BINS; bin++) {
+        if (histogram[bin] > 0 && below + histogram[bin] >= wanted) {
+            return (bin + (wanted - below) / histogram[bin]) * AE_BIN_WIDTH;
+        }
+        below += histogram[bin];
+    }
+    return 255.0f;
+}
+
+// ===========================
+// Controller
+// ===========================
+
+AutoExposure::AutoExposure() {
+    reset();
+}
+
+void AutoExposure::reset() {
+    ev = log2f(AE_INITIAL_EXPOSURE);
+    lastCorrection = 0.0f;
+    split();
+}
+
+// Exposure first, gain for what exposure can't reach, brightness past that
+void AutoExposure::split() {
+    const float minEv = log2f(AE_MIN_EXPOSURE);
+    const float maxExposureEv = log2f(AE_MAX_EXPOSURE);
+    const float maxEv = maxExposureEv + (float)AE_MAX_GAIN / AE_GAIN_STEPS_PER_EV;
+
+    float clamped = constrain(ev, minEv, maxEv);
+    float exposureEv = min(clamped, maxExposureEv);
+    exposure = (uint16_t)lroundf(exp2f(exposureEv));
+    gain = (uint8_t)lroundf((clamped - exposureEv) * AE_GAIN_STEPS_PER_EV);
+
+    // Roughly one EV per brightness step at mid grey
+    brightness = (int8_t)constrain((int)lroundf(ev - clamped), -AE_MAX_BRIGHTNESS, AE_MAX_BRIGHTNESS);
+}
+
+bool AutoExposure::update(const SceneSignature& signature) {
+    lastCorrection = 0.0f;
+    if (!signature.valid) {
+        return false;
+    }
+
+    // Sensor output is gamma encoded - the light ratio is the luma ratio to the 2.2
+    float mean = max((float)signature.meanLuma, 1.0f);
+    float correction = AE_GAMMA * log2f(AE_TARGET_LUMA / mean);
+
+    float highlight = histogramPercentile(signature.histogram, AE_HIGHLIGHT_PERCENTILE / 100.0f);
+    if (highlight >= 256 - AE_BIN_WIDTH) {
+        correction = min(correction, -AE_CLIP_STEP_EV);
+    } else {
+        correction = min(correction, AE_GAMMA * log2f(AE_HIGHLIGHT_LUMA / max(highlight, 1.0f)));
+    }
+
+    if (fabsf(correction) < AE_DEADBAND_EV) {
+        return false;
+    }
+    correction = constrain(correction, -AE_MAX_STEP_EV, AE_MAX_STEP_EV);
+
+    // The wanted EV stays within reach of brightness past the sensor's limits
+    const float minEv = log2f(AE_MIN_EXPOSURE) - AE_MAX_BRIGHTNESS;
+    const float maxEv = log2f(AE_MAX_EXPOSURE) + (float)AE_MAX_GAIN / AE_GAIN_STEPS_PER_EV + AE_MAX_BRIGHTNESS;
+    uint16_t oldExposure = exposure;
+    uint8_t oldGain = gain;
+    int8_t oldBrightness = brightness;
+
+    ev = constrain(ev + correction, minEv, maxEv);
+    lastCorrection = correction;
+    split();
+    return exposure != oldExposure || gain != oldGain || brightness != oldBrightness;
+}
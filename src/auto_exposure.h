@@ -0,0 +1,70 @@
+#ifndef AUTO_EXPOSURE_H
+#define AUTO_EXPOSURE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "scene_change.h"
+
+// ===========================
+// Auto Exposure
+// Exposure, gain and brightness for the next capture, from the luma
+// histogram of the last one
+// ===========================
+
+// The sensor runs with its own AEC/AGC off and this picks the settings, so
+// the exposure behind every measured frame is known and one correction per
+// capture lands on target rather than creeping towards it. Exposure is
+// tracked in EV: log2(exposure lines) + gain steps / 6 (the OV2640 gain table
+// doubles every six steps). The correction is the smaller of
+//  - the one that brings the mean luma to AE_TARGET_LUMA, and
+//  - the one that keeps the AE_HIGHLIGHT_PERCENTILE luma below AE_HIGHLIGHT_LUMA,
+// both through a 2.2 gamma. A clipped top bin can't say by how much, so it
+// steps down AE_CLIP_STEP_EV. Exposure rises before gain, and past both
+// limits what is left goes into sensor brightness.
+//
+// The histogram is SceneSignature's (scene_change.h): decoded at 1/4 or 1/8
+// scale, which the JPEG decoder does from little more than the DC terms.
+
+#define AE_TARGET_LUMA             110
+#define AE_HIGHLIGHT_PERCENTILE    98
+#define AE_HIGHLIGHT_LUMA          235
+#define AE_CLIP_STEP_EV            1.5f     // Down this far when the top bin holds more than the highlight share
+#define AE_GAMMA                   2.2f
+#define AE_DEADBAND_EV             0.2f     // Corrections smaller than this are left alone
+#define AE_MAX_STEP_EV             4.0f
+#define AE_MIN_EXPOSURE            2        // Sensor exposure lines (OV2640 aec_value 0-1200)
+#define AE_MAX_EXPOSURE            800      // Kept below a full frame - blur from a swinging payload
+#define AE_INITIAL_EXPOSURE        300
+#define AE_MAX_GAIN                18       // Gain steps (agc_gain 0-30); 18 is 8x
+#define AE_GAIN_STEPS_PER_EV       6
+#define AE_MAX_BRIGHTNESS          2
+
+class AutoExposure {
+public:
+    AutoExposure();
+
+    void reset();
+
+    // Settings for the next frame from a frame taken at the current ones;
+    // true if any of them changed
+    bool update(const SceneSignature& signature);
+
+    uint16_t getExposure() const { return exposure; }
+    uint8_t getGain() const { return gain; }
+    int8_t getBrightness() const { return brightness; }
+    float getLastCorrection() const { return lastCorrection; }   // EV, last update()
+
+private:
+    float ev;               // Wanted exposure, may sit past the sensor's range
+    uint16_t exposure;
+    uint8_t gain;
+    int8_t brightness;
+    float lastCorrection;
+
+    void split();
+};
+
+// Luma below which the given share (0-1) of the histogram lies, interpolated within a bin
+float histogramPercentile(const uint16_t* histogram, float share);
+
+#endif // AUTO_EXPOSURE_H
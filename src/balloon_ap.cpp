@@ -0,0 +1,146 @@
+#include "balloon_ap.h"
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+#include "system_state.h"
+#include "power_manager.h"
+#include "energy_ledger.h"
+#include "debug_utils.h"
+
+// app_httpd.cpp
+void startCameraServer();
+void stopCameraServer();
+
+static BalloonAccessPoint balloonAccessPointInstance;
+
+BalloonAccessPoint& AccessPoint() {
+    return balloonAccessPointInstance;
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+BalloonAccessPoint::BalloonAccessPoint() {
+    up = false;
+    commanded = false;
+    commandUntil = 0;
+    failedAt = 0;
+    upSince = 0;
+    heapTaken = 0;
+    heapReturned = 0;
+    starts = 0;
+    stops = 0;
+    failures = 0;
+    upMs = 0;
+}
+
+// ===========================
+// Policy
+// ===========================
+
+void BalloonAccessPoint::command(uint16_t seconds) {
+    commandUntil = millis() + seconds * 1000UL;
+    commanded = seconds > 0;
+    SYS_INFO("WiFi AP: %s", seconds ? "commanded up" : "back to the flight phase");
+}
+
+bool BalloonAccessPoint::isWanted() const {
+    if (!BALLOON_AP_ENABLED) {
+        return false;
+    }
+    if (commanded && (int32_t)(commandUntil - millis()) > 0) {
+        return true;
+    }
+
+    switch (SysState().getFlightPhase()) {
+        case FlightPhase::GROUND:
+        case FlightPhase::LANDING:
+        case FlightPhase::RECOVERY:
+            return PowerMgr().getPowerState() < PowerState::CRITICAL_POWER;
+        default:
+            return false;
+    }
+}
+
+void BalloonAccessPoint::service() {
+    bool wanted = isWanted();
+    if (commanded && (int32_t)(commandUntil - millis()) <= 0) {
+        commanded = false;
+    }
+
+    if (wanted && !up) {
+        if (failedAt && millis() - failedAt < BALLOON_AP_RETRY_MS) {
+            return;
+        }
+        failedAt = start() ? 0 : max(millis(), 1UL);
+    } else if (!wanted && up) {
+        stop();
+    }
+}
+
+// ===========================
+// Start / Stop
+// ===========================
+
+bool BalloonAccessPoint::start() {
+    size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    if (!WiFi.mode(WIFI_AP) || !WiFi.softAP(BALLOON_AP_SSID, BALLOON_AP_PASSWORD, BALLOON_AP_CHANNEL)) {
+        WiFi.mode(WIFI_OFF);
+        failures++;
+        SYS_ERROR("WiFi AP: failed to start, retrying in %lu s", (unsigned long)(BALLOON_AP_RETRY_MS / 1000));
+        return false;
+    }
+    startCameraServer();
+
+    size_t freeAfter = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    heapTaken = freeBefore > freeAfter ? freeBefore - freeAfter : 0;
+    up = true;
+    upSince = millis();
+    starts++;
+    Energy().setActive(EnergyLoad::WIFI, true);
+    SYS_INFO("WiFi AP: \"%s\" up at %s, %lu bytes of internal heap", BALLOON_AP_SSID,
+             WiFi.softAPIP().toString().c_str(), (unsigned long)heapTaken);
+    return true;
+}
+
+void BalloonAccessPoint::stop() {
+    size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    stopCameraServer();
+    WiFi.softAPdisconnect(true);
+    WiFi.mode(WIFI_OFF);
+    Energy().setActive(EnergyLoad::WIFI, false);
+
+    size_t freeAfter = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    heapReturned = freeAfter > freeBefore ? freeAfter - freeBefore : 0;
+    up = false;
+    upMs += millis() - upSince;
+    stops++;
+    SYS_INFO("WiFi AP: down after %lu s, %lu bytes of internal heap back (%lu taken)",
+             (unsigned long)((millis() - upSince) / 1000), (unsigned long)heapReturned, (unsigned long)heapTaken);
+}
+
+// ===========================
+// Status
+// ===========================
+
+void BalloonAccessPoint::printStatus() const {
+    if (!BALLOON_AP_ENABLED) {
+        return;
+    }
+    uint32_t now = millis();
+    uint32_t totalUp = upMs + (up ? now - upSince : 0);
+    Serial.printf("WiFi AP: %s%s, %lu starts, %lu stops, %lu failed\n", up ? "up" : "down",
+                  commanded ? " (commanded)" : "", (unsigned long)starts, (unsigned long)stops,
+                  (unsigned long)failures);
+    if (up) {
+        Serial.printf("  %d stations on %s\n", WiFi.softAPgetStationNum(), WiFi.softAPIP().toString().c_str());
+    }
+    Serial.printf("  Internal heap: %lu bytes taken by the last start, %lu back from the last stop\n",
+                  (unsigned long)heapTaken, (unsigned long)heapReturned);
+    Serial.printf("  Up %lu s for %.1f mAh; down %lu s, %.1f mAh not drawn at %.0f mA\n",
+                  (unsigned long)(totalUp / 1000), Energy().getChargeMah(EnergyLoad::WIFI),
+                  (unsigned long)((now - totalUp) / 1000), (now - totalUp) * ENERGY_WIFI_AP_MA / 3.6e6f,
+                  ENERGY_WIFI_AP_MA);
+}
@@ -0,0 +1,66 @@
+#ifndef BALLOON_AP_H
+#define BALLOON_AP_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "balloon_config.h"
+
+// ===========================
+// Ground Access Point
+// The camera web UI and stream (app_httpd.cpp) over a soft AP, up only
+// while someone on the ground can use it
+// ===========================
+
+// Wanted on the ground before launch and from landing on, unless power is
+// CRITICAL or worse, and for as long as an uplinked WIFI_AP asks, whatever
+// the phase. service() runs on the uplink task and starts or stops it to
+// match: WiFi.softAP() and startCameraServer() up, then
+// stopCameraServer(), softAPdisconnect() and WIFI_OFF down. WIFI_OFF
+// deinits the driver, so its buffers and tasks go back to the heap along
+// with the servers'; nothing of WiFi stays resident through the flight.
+//
+// Each start and stop measures internal free heap either side. The
+// ledger's WIFI load is active while the AP is up, so its draw shows in
+// the budget and the runtime estimate and goes when the AP does.
+
+class BalloonAccessPoint {
+public:
+    BalloonAccessPoint();
+
+    // Uplink task: brings the AP up or down to match the phase and any command
+    void service();
+    // Up for this many seconds from now, whatever the phase; 0 back to the phase policy
+    void command(uint16_t seconds);
+
+    bool isUp() const { return up; }
+    bool isWanted() const;
+    uint32_t getHeapTaken() const { return heapTaken; }
+    uint32_t getHeapReturned() const { return heapReturned; }
+    void printStatus() const;
+
+private:
+    volatile bool up;
+    volatile bool commanded;
+    volatile uint32_t commandUntil;    // millis()
+    uint32_t failedAt;                  // millis() of the last failed start, 0 = none
+    uint32_t upSince;
+
+    // Measurements
+    uint32_t heapTaken;                 // Internal heap the last start used
+    uint32_t heapReturned;              // And the last stop gave back
+    uint32_t starts;
+    uint32_t stops;
+    uint32_t failures;
+    uint32_t upMs;                      // Total time up, to the last stop
+
+    bool start();
+    void stop();
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern BalloonAccessPoint& AccessPoint();
+
+#endif // BALLOON_AP_H
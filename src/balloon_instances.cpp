@@ -10,21 +10,140 @@
 #include "packet_handler.h"
 #include "system_state.h"
 #include "debug_utils.h"
+#include "metrics.h"
+#include "flight_recorder.h"
+#include "stage_profiler.h"
+#include "link_backlog.h"
+#include "uplink_queue.h"
+#include "job_scheduler.h"
+#include "rtc_state.h"
+#include "task_placement.h"
+#include "task_watchdog.h"
+#include "trace_buffer.h"
+#include "rx_pipeline.h"
+#include "fragment_transfer.h"
+#include "energy_ledger.h"
+#include "boot_sequence.h"
+#include "image_store.h"
+#include "power_planner.h"
+#include "report_deadband.h"
+#include "crash_report.h"
+#include "power_scaling.h"
+#include "perf_probe.h"
+#include "command_dispatch.h"
+#include "firmware_update.h"
+#include "geofence.h"
+#include "cadence_profile.h"
+#include "time_service.h"
+#include "ulp_monitor.h"
+#include "packet_store.h"
+#include "gzip_stream.h"
+#include "memory_budget.h"
+#include "track_history.h"
+#include "frame_pool.h"
+#include "sd_recorder.h"
+#include "link_auth.h"
+#include "balloon_ap.h"
+#include "usb_dump.h"
+#include "power_arbiter.h"
+#include "runtime_config.h"
 
 // Global instances
 static SensorManager sensorManagerInstance;
 static CameraManager cameraManagerInstance;
 static LoRaManager loraManagerInstance;
+static LoRaManager bulkLoRaInstance(LinkRole::BULK);
 static PowerManager powerManagerInstance;
 static SystemState systemStateInstance;
-static DebugUtils debugUtilsInstance;
+static TrackHistory trackHistoryInstance;
 
 // Global access functions
 SensorManager& Sensors() { return sensorManagerInstance; }
 CameraManager& Camera() { return cameraManagerInstance; }
 LoRaManager& LoRaComm() { return loraManagerInstance; }
+LoRaManager& BulkLoRa() { return bulkLoRaInstance; }
 PowerManager& PowerMgr() { return powerManagerInstance; }
 SystemState& SysState() { return systemStateInstance; }
+TrackHistory& Track() { return trackHistoryInstance; }
+
+// ===========================
+// Memory Budget
+// ===========================
+
+// Every manager with a static instance in this build, and the blocks
+// begin() reserves. The camera driver's frame buffers are sized for
+// CAMERA_FB_MAX_FRAMESIZE at init and take the PSRAM this leaves.
+#define BALLOON_INTERNAL_BUDGET     (128 * 1024)    // Statics; WiFi, the radio and the heap want the rest
+#define BALLOON_PSRAM_BUDGET        (3 * 1024 * 1024) // Mostly the SD recorder's ring, taken only with a card
+
+#define BALLOON_MEMORY_BUDGET(STATIC, RESERVED)                                                         \
+    STATIC(LoRaManager, 2, 48 * 1024)                                                                   \
+    STATIC(DebugUtils, 1, 2 * 1024)                                                                     \
+    STATIC(PacketHandler, 1, 24 * 1024)                                                                 \
+    STATIC(MetricsRegistry, 1, 10 * 1024)                                                               \
+    STATIC(CameraManager, 1, 10 * 1024)                                                                 \
+    STATIC(SystemState, 1, 6 * 1024)                                                                    \
+    STATIC(FirmwareUpdater, 1, 5 * 1024)                                                                \
+    STATIC(TrackHistory, 1, 5 * 1024)                                                                   \
+    STATIC(JobScheduler, 1, 4 * 1024)                                                                   \
+    STATIC(FlightRecorder, 1, 3 * 1024)                                                                 \
+    STATIC(LinkBacklog, 1, 3 * 1024)                                                                    \
+    STATIC(UplinkQueue, 1, 3 * 1024)                                                                    \
+    STATIC(StageProfiler, 1, 2 * 1024)                                                                  \
+    STATIC(SensorManager, 1, 2 * 1024)                                                                  \
+    STATIC(PowerManager, 1, 2 * 1024)                                                                   \
+    STATIC(RtcStateStore, 1, 2 * 1024)                                                                  \
+    STATIC(TaskUsageMonitor, 1, 2 * 1024)                                                               \
+    STATIC(TraceBuffer, 1, 2 * 1024)                                                                    \
+    STATIC(ReceivePipeline, 1, 2 * 1024)                                                                \
+    STATIC(FragmentManager, 1, 1024)                                                                    \
+    STATIC(EnergyLedger, 1, 1024)                                                                       \
+    STATIC(MemoryLedger, 1, 1024)                                                                       \
+    STATIC(PacketStore, 1, 1024)                                                                        \
+    STATIC(TaskWatchdog, 1, 1024)                                                                       \
+    STATIC(BootSequence, 1, 512)                                                                        \
+    STATIC(ImageStore, 1, 512)                                                                          \
+    STATIC(LinkAuth, 1, 512)                                                                            \
+    STATIC(SdRecorder, 1, 1024)                                                                         \
+    STATIC(BalloonAccessPoint, 1, 256)                                                                  \
+    STATIC(UsbDump, 1, 512)                                                                             \
+    STATIC(PowerArbiter, 1, 512)                                                                        \
+    STATIC(PowerPlanner, 1, 512)                                                                        \
+    STATIC(ReportDeadband, 1, 256)                                                                      \
+    STATIC(CrashReporter, 1, 256)                                                                       \
+    STATIC(PowerScaling, 1, 256)                                                                        \
+    STATIC(PerfProbe, 1, 256)                                                                           \
+    STATIC(CommandDispatcher, 1, 256)                                                                   \
+    STATIC(CadenceManager, 1, 256)                                                                      \
+    STATIC(ConfigStore, 1, 512)                                                                         \
+    STATIC(GeofenceManager, 1, 256)                                                                     \
+    STATIC(TimeService, 1, 256)                                                                         \
+    STATIC(UlpMonitor, 1, 256)                                                                          \
+    STATIC(GzipStream, 1, 256)                                                                          \
+    RESERVED("log ring", MemRegion::PSRAM, DEBUG_LOG_RING_BYTES, 256 * 1024)                            \
+    RESERVED("trace ring", TRACE_BUFFER_IN_PSRAM ? MemRegion::PSRAM : MemRegion::INTERNAL,              \
+             (TRACE_BUFFER_IN_PSRAM ? TRACE_BUFFER_EVENTS : TRACE_FALLBACK_EVENTS) * sizeof(TraceEvent), \
+             256 * 1024)                                                                                \
+    RESERVED("rx records", MemRegion::PSRAM,                                                            \
+             (RX_MAX_DEVICES * RX_REORDER_DEPTH + RX_BATCH_SIZE) * sizeof(ReceivedRecord), 32 * 1024)   \
+    RESERVED("reassembly", MemRegion::PSRAM, FRAGMENT_REASSEMBLY_SLOTS * FRAGMENT_MAX_TRANSFER_BYTES,   \
+             FRAGMENT_REASSEMBLY_MAX_BYTES)                                                             \
+    RESERVED("fragment send", MemRegion::PSRAM, FRAGMENT_MAX_TRANSFER_BYTES, 64 * 1024)                 \
+    RESERVED("sample windows", MemRegion::PSRAM,                                                        \
+             (SENSOR_WINDOW_BARO_SAMPLES * (SENSOR_WINDOW_BARO_CHANNELS + 1) +                          \
+              SENSOR_WINDOW_GPS_SAMPLES * (SENSOR_WINDOW_GPS_CHANNELS + 1)) * sizeof(float), 96 * 1024) \
+    RESERVED("image index", MemRegion::PSRAM, IMAGE_STORE_INDEX_SLOTS * sizeof(StoredImageInfo), 64 * 1024) \
+    RESERVED("web gzip", MemRegion::PSRAM, GZIP_STATE_BYTES, 32 * 1024)                                \
+    RESERVED("frame pool", MemRegion::PSRAM, FRAME_POOL_BYTES, 320 * 1024)                              \
+    RESERVED("sd ring", MemRegion::PSRAM, SD_RECORDER_BUFFER_BYTES, 1536 * 1024)                        \
+    RESERVED("sd index", MemRegion::PSRAM, SD_RECORDER_INDEX_MAX * sizeof(SdIndexEntry), 256 * 1024)
+
+MEM_BUDGET_TABLE(balloonBudget, BALLOON_MEMORY_BUDGET, BALLOON_INTERNAL_BUDGET, BALLOON_PSRAM_BUDGET)
+
+const MemBudgetEntry* memBudgetTable(size_t& count) {
+    count = sizeof(balloonBudget) / sizeof(balloonBudget[0]);
+    return balloonBudget;
+}
 
 // Board configuration functions are implemented in main_balloon.cpp
 // to avoid multiple definition errors
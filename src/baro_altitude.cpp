@@ -0,0 +1,142 @@
+#include "baro_altitude.h"
+#include <math.h>
+#include <string.h>
+
+#define BARO_TABLE_SIZE            ((BARO_TABLE_OCTAVES << BARO_TABLE_STEP_BITS) + 1)
+#define BARO_MANTISSA_SHIFT        (23 - BARO_TABLE_STEP_BITS)
+
+// 1976 standard atmosphere to the mesosphere: base geopotential altitude,
+// temperature, lapse rate and pressure
+static const struct {
+    double altitude;    // m
+    double temperature; // K
+    double lapse;       // K/m
+    double pressure;    // Pa
+} isaLayers[] = {
+    {0,     288.15, -0.0065, 101325.0},
+    {11000, 216.65,  0.0,    22632.06},
+    {20000, 216.65,  0.001,  5474.889},
+    {32000, 228.65,  0.0028, 868.0187},
+    {47000, 270.65,  0.0,    110.9063},
+    {51000, 270.65, -0.0028, 66.93887},
+    {71000, 214.65, -0.002,  3.956420}
+};
+
+#define ISA_LAYER_COUNT (sizeof(isaLayers) / sizeof(isaLayers[0]))
+
+static double isaAltitude(double pressure) {
+    size_t layer = 0;
+    while (layer + 1 < ISA_LAYER_COUNT && pressure < isaLayers[layer + 1].pressure) {
+        layer++;
+    }
+    const double base = isaLayers[layer].altitude;
+    const double temperature = isaLayers[layer].temperature;
+    const double lapse = isaLayers[layer].lapse;
+    const double ratio = pressure / isaLayers[layer].pressure;
+
+    if (lapse == 0.0) {
+        return base - BARO_GAS_CONSTANT * temperature / BARO_GRAVITY * log(ratio);
+    }
+    return base + temperature / lapse * (pow(ratio, -BARO_GAS_CONSTANT * lapse / BARO_GRAVITY) - 1.0);
+}
+
+// Altitude at 2^(exponent) * (1 + step / 128) Pa; built before setup()
+static float altitudeTable[BARO_TABLE_SIZE];
+
+static struct BaroTableBuilder {
+    BaroTableBuilder() {
+        for (int i = 0; i < BARO_TABLE_SIZE; i++) {
+            int octave = i >> BARO_TABLE_STEP_BITS;
+            int step = i & ((1 << BARO_TABLE_STEP_BITS) - 1);
+            double pressure = ldexp(1.0 + (double)step / (1 << BARO_TABLE_STEP_BITS),
+                                    BARO_TABLE_MIN_EXPONENT + octave);
+            altitudeTable[i] = (float)isaAltitude(pressure);
+        }
+    }
+} baroTableBuilder;
+
+float baroAltitudeIsa(float pressure, float seaLevelPressure) {
+    if (!(pressure > 0.0f) || !(seaLevelPressure > 0.0f)) {
+        return NAN;
+    }
+    return (float)isaAltitude((double)pressure * BARO_ISA_SEA_LEVEL_PA / seaLevelPressure);
+}
+
+float baroAltitude(float pressure, float seaLevelPressure) {
+    float standard = pressure * (BARO_ISA_SEA_LEVEL_PA / seaLevelPressure);
+
+    uint32_t bits;
+    memcpy(&bits, &standard, sizeof(bits));
+    int32_t octave = (int32_t)(bits >> 23) - 127 - BARO_TABLE_MIN_EXPONENT;   // Sign bit set lands out of range too
+    if (octave < 0 || octave >= BARO_TABLE_OCTAVES) {
+        return baroAltitudeIsa(pressure, seaLevelPressure);
+    }
+
+    uint32_t mantissa = bits & 0x7FFFFF;
+    uint32_t index = ((uint32_t)octave << BARO_TABLE_STEP_BITS) | (mantissa >> BARO_MANTISSA_SHIFT);
+    float fraction = (mantissa & ((1u << BARO_MANTISSA_SHIFT) - 1)) * (1.0f / (1u << BARO_MANTISSA_SHIFT));
+    float low = altitudeTable[index];
+    return low + fraction * (altitudeTable[index + 1] - low);
+}
+
+// ===========================
+// Benchmark
+// ===========================
+
+template <typename Fn>
+static uint32_t measureCycles(Fn fn, int iterations) {
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    return ESP.getCycleCount() - start;
+}
+
+static float singleLayerAltitude(float pressure, float seaLevelPressure) {
+    return 44330.0f * (1.0f - powf(pressure / seaLevelPressure, 0.190263f));
+}
+
+void baroAltitudeBenchmark(int iterations) {
+    if (iterations <= 0) {
+        return;
+    }
+
+    // Log-spaced over the table, 1 kPa to sea level for the timing - where the sensor reads
+    const float lowest = ldexpf(1.0f, BARO_TABLE_MIN_EXPONENT);
+    const float highest = ldexpf(1.0f, BARO_TABLE_MIN_EXPONENT + BARO_TABLE_OCTAVES);
+    float tableError = 0.0f;
+    float tableErrorAt = 0.0f;
+    const int points = 20000;
+    for (int i = 0; i < points; i++) {
+        float pressure = lowest * powf(highest / lowest, (float)i / points);
+        float error = fabsf(baroAltitude(pressure) - baroAltitudeIsa(pressure));
+        if (error > tableError) {
+            tableError = error;
+            tableErrorAt = pressure;
+        }
+    }
+
+    Serial.println("=== Baro Altitude Benchmark ===");
+    Serial.printf("%d calls each, CPU %lu MHz\n", iterations, ESP.getCpuFreqMHz());
+    Serial.printf("Table: worst error %.3f m at %.1f Pa over %.0f-%.0f Pa\n", tableError, tableErrorAt, lowest, highest);
+    const float checks[] = {70000.0f, 30000.0f, 16500.0f, 5500.0f, 1200.0f, 300.0f};
+    for (float pressure : checks) {
+        float isa = baroAltitudeIsa(pressure);
+        Serial.printf("  %8.0f Pa: ISA %8.1f m, table %+.3f m, single layer %+.1f m\n", pressure, isa,
+                     baroAltitude(pressure) - isa, singleLayerAltitude(pressure, BARO_ISA_SEA_LEVEL_PA) - isa);
+    }
+
+    volatile float sink = 0.0f;
+    float step = (BARO_ISA_SEA_LEVEL_PA - 1000.0f) / iterations;
+    uint32_t powCycles = measureCycles([&, i = 0]() mutable {
+        sink = sink + singleLayerAltitude(1000.0f + step * i++, BARO_ISA_SEA_LEVEL_PA);
+    }, iterations);
+    uint32_t tableCycles = measureCycles([&, i = 0]() mutable {
+        sink = sink + baroAltitude(1000.0f + step * i++, BARO_ISA_SEA_LEVEL_PA);
+    }, iterations);
+    uint32_t isaCycles = measureCycles([&, i = 0]() mutable {
+        sink = sink + baroAltitudeIsa(1000.0f + step * i++, BARO_ISA_SEA_LEVEL_PA);
+    }, iterations);
+    Serial.printf("Cycles/call: single layer powf %.0f, table %.0f, layered exact %.0f\n",
+                 (float)powCycles / iterations, (float)tableCycles / iterations, (float)isaCycles / iterations);
+}
@@ -0,0 +1,43 @@
+#ifndef BARO_ALTITUDE_H
+#define BARO_ALTITUDE_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Barometric Altitude
+// Pressure to altitude in the layered 1976 standard atmosphere, from a
+// table instead of powf, for every baro sample at the fusion rate
+// ===========================
+
+// The single-layer formula, 44330 * (1 - (p / p0)^0.190263), is the
+// troposphere's lapse rate carried all the way up: it reads 60 m low at
+// 13 km, 1.1 km low at 20 km and 4.6 km low at 30 km. The standard atmosphere instead
+// has isothermal and warming layers above 11 km. baroAltitudeIsa() is that
+// model exactly, in double; baroAltitude() looks the altitude up in a table
+// built from it once at boot, indexed by the float's exponent and the top
+// mantissa bits - 128 steps per octave of pressure, linear in between - so
+// a sample is a multiply, two loads and a lerp. Interpolation error is
+// under 7 cm anywhere from 64 Pa (51 km) to 131 kPa; outside that it falls
+// back to the exact model.
+//
+// The sea level pressure scales the input pressure, which in the troposphere
+// is exactly the single-layer formula's p / p0, and above it is how an
+// altimeter set to QNH reads.
+
+#define BARO_ISA_SEA_LEVEL_PA      101325.0f
+#define BARO_GAS_CONSTANT          287.053     // J/(kg K), dry air
+#define BARO_GRAVITY               9.80665     // m/s^2
+#define BARO_TABLE_MIN_EXPONENT    6       // 2^6 = 64 Pa, about 51.4 km
+#define BARO_TABLE_OCTAVES         11      // Up to 2^17 Pa
+#define BARO_TABLE_STEP_BITS       7       // 128 entries per octave
+
+// Geopotential altitude, m, for pressure and sea level pressure in Pa
+float baroAltitude(float pressure, float seaLevelPressure = BARO_ISA_SEA_LEVEL_PA);
+float baroAltitudeIsa(float pressure, float seaLevelPressure = BARO_ISA_SEA_LEVEL_PA);
+
+// Cycles per call and worst error of the table and the single-layer powf
+// formula against the layered model, over the table's range
+void baroAltitudeBenchmark(int iterations = 10000);
+
+#endif // BARO_ALTITUDE_H
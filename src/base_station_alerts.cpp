@@ -0,0 +1,551 @@
+#include "base_station_config.h"
+#include "base_station_alerts.h"
+#include "base_station_sessions.h"
+#include "memory_ledger.h"
+#include <cctype>
+#include <cstdlib>
+
+static AlertEngine alertEngineInstance;
+
+AlertEngine& Alerts() {
+    return alertEngineInstance;
+}
+
+const char* alertSeverityName(uint8_t severity) {
+    switch (severity) {
+        case ALERT_INFO: return "info";
+        case ALERT_WARNING: return "warning";
+        case ALERT_CRITICAL: return "critical";
+        default: return "unknown";
+    }
+}
+
+// The rules ALERT_* turns on; format takes first then second
+struct DefaultRule {
+    bool enabled;
+    const char* name;
+    const char* format;
+    float first;
+    float second;
+    uint8_t severity;
+};
+
+static const DefaultRule defaultRules[] = {
+    {ALERT_LOW_BATTERY, "low_battery", "battery_pct < %g", ALERT_BATTERY_PERCENT, 0, ALERT_WARNING},
+    {ALERT_ALTITUDE_HIGH, "altitude_high", "alt > %g", ALERT_ALTITUDE_M, 0, ALERT_INFO},
+    {true, "fast_descent", "rate(alt,%g) < %g", ALERT_DESCENT_WINDOW_S, -ALERT_DESCENT_MPS, ALERT_CRITICAL},
+    {ALERT_SIGNAL_LOST, "signal_lost", "silence(rssi) > %g", ALERT_SIGNAL_LOST_S, 0, ALERT_WARNING},
+    {ALERT_NO_DATA_TIMEOUT > 0, "no_telemetry", "silence(temperature) > %g", ALERT_NO_DATA_TIMEOUT / 1000.0f, 0,
+     ALERT_WARNING},
+};
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+AlertEngine::AlertEngine() {
+    memset(rules, 0, sizeof(rules));
+    ruleCount = 0;
+    memset(columnRules, 0, sizeof(columnRules));
+    memset(devices, 0, sizeof(devices));
+    mutex = nullptr;
+    nextIndex = 0;
+    eventHook = nullptr;
+    memset(wheel, 0, sizeof(wheel));
+    wheelTick = 0;
+    memset(history, 0, sizeof(history));
+    nextSequence = 0;
+    hookedSequence = 0;
+    samplesEvaluated = 0;
+    timersFired = 0;
+}
+
+AlertEngine::~AlertEngine() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool AlertEngine::begin() {
+    if (mutex) {
+        return true;
+    }
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex) {
+        return false;
+    }
+
+    for (const DefaultRule& rule : defaultRules) {
+        char expression[ALERT_EXPRESSION_MAX];
+        snprintf(expression, sizeof(expression), rule.format, rule.first, rule.second);
+        const char* error = nullptr;
+        if (rule.enabled && !addRule(rule.name, expression, rule.severity, &error)) {
+            Serial.printf("Alerts: rule %s \"%s\" not compiled - %s\n", rule.name, expression, error);
+        }
+    }
+    nextIndex = Packets().getOldest();
+    wheelTick = millis() / ALERT_WHEEL_TICK_MS;
+    return true;
+}
+
+void AlertEngine::end() {
+    for (uint8_t d = 0; d < RX_MAX_DEVICES; d++) {
+        BalloonSession* session = devices[d] ? Sessions().find(devices[d]->deviceId) : nullptr;
+        if (session) {
+            session->alerts = nullptr;
+        }
+        memFree(MemTag::ALERTS, devices[d]);
+        devices[d] = nullptr;
+    }
+    memset(wheel, 0, sizeof(wheel));
+    ruleCount = 0;
+    memset(columnRules, 0, sizeof(columnRules));
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+}
+
+DeviceAlerts* AlertEngine::device(uint8_t deviceId) {
+    BalloonSession* session = Sessions().open(deviceId);
+    if (!session || session->alerts) {
+        return session ? session->alerts : nullptr;
+    }
+    DeviceAlerts* created = (DeviceAlerts*)memCalloc(MemTag::ALERTS, 1, sizeof(DeviceAlerts));
+    if (!created) {
+        return nullptr;
+    }
+    created->deviceId = deviceId;
+    for (uint8_t r = 0; r < ALERT_MAX_RULES; r++) {
+        created->states[r].timer.device = session->slot;
+        created->states[r].timer.rule = r;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    devices[session->slot] = created;
+    session->alerts = created;
+    xSemaphoreGive(mutex);
+    return created;
+}
+
+// ===========================
+// Compiling
+// ===========================
+
+static const char* skipSpaces(const char* p) {
+    while (*p == ' ') {
+        p++;
+    }
+    return p;
+}
+
+// [a-z_]+ into out
+static const char* readName(const char* p, char* out, size_t size) {
+    size_t length = 0;
+    p = skipSpaces(p);
+    while ((isalnum((uint8_t)*p) || *p == '_') && length + 1 < size) {
+        out[length++] = *p++;
+    }
+    out[length] = 0;
+    return p;
+}
+
+static const char* readNumber(const char* p, float& value) {
+    char* end = nullptr;
+    value = strtof(skipSpaces(p), &end);
+    return end == skipSpaces(p) ? nullptr : end;
+}
+
+bool AlertEngine::compile(const char* expression, AlertRule& rule, const char** error) {
+    const char* fail = nullptr;
+    const char* p = expression;
+    char word[24];
+    float value = 0.0f;
+
+    rule.term = AlertTerm::VALUE;
+    rule.windowMs = 0;
+    rule.holdMs = 0;
+
+    p = readName(p, word, sizeof(word));
+    p = skipSpaces(p);
+    if (*p == '(') {
+        if (!strcmp(word, "mean")) {
+            rule.term = AlertTerm::MEAN;
+        } else if (!strcmp(word, "rate")) {
+            rule.term = AlertTerm::RATE;
+        } else if (!strcmp(word, "silence")) {
+            rule.term = AlertTerm::SILENCE;
+        } else {
+            fail = "unknown function";
+        }
+        p = readName(p + 1, word, sizeof(word));
+    }
+    if (!fail && !columnFromName(word, rule.column)) {
+        fail = "unknown column";
+    }
+
+    // The window, and the closing bracket
+    if (!fail && (rule.term == AlertTerm::MEAN || rule.term == AlertTerm::RATE)) {
+        p = skipSpaces(p);
+        if (*p != ',' || !(p = readNumber(p + 1, value)) || value <= 0.0f) {
+            fail = "window seconds expected";
+        } else {
+            rule.windowMs = (uint32_t)(value * 1000.0f);
+        }
+    }
+    if (!fail && rule.term != AlertTerm::VALUE) {
+        p = skipSpaces(p);
+        if (*p != ')') {
+            fail = "')' expected";
+        }
+        p++;
+    }
+
+    if (!fail) {
+        p = skipSpaces(p);
+        if (*p == '<' || *p == '>') {
+            rule.above = *p++ == '>';
+        } else {
+            fail = "'<' or '>' expected";
+        }
+    }
+    if (!fail && !(p = readNumber(p, rule.threshold))) {
+        fail = "threshold expected";
+    }
+    if (!fail && rule.term == AlertTerm::SILENCE && (!rule.above || rule.threshold <= 0.0f)) {
+        fail = "silence takes > seconds";
+    }
+
+    // for <seconds>
+    if (!fail) {
+        p = readName(p, word, sizeof(word));
+        if (!strcmp(word, "for")) {
+            if (!(p = readNumber(p, value)) || value < 0.0f) {
+                fail = "hold seconds expected";
+            } else {
+                rule.holdMs = (uint32_t)(value * 1000.0f);
+                p = skipSpaces(p);
+            }
+        } else if (word[0]) {
+            fail = "'for' expected";
+        }
+    }
+    if (!fail && *skipSpaces(p)) {
+        fail = "unexpected text at the end";
+    }
+
+    if (error) {
+        *error = fail;
+    }
+    return fail == nullptr;
+}
+
+bool AlertEngine::addRule(const char* name, const char* expression, uint8_t severity, const char** error) {
+    if (ruleCount == ALERT_MAX_RULES) {
+        if (error) {
+            *error = "rule table full";
+        }
+        return false;
+    }
+    AlertRule& rule = rules[ruleCount];
+    if (!compile(expression, rule, error)) {
+        return false;
+    }
+    strncpy(rule.name, name, sizeof(rule.name) - 1);
+    rule.name[sizeof(rule.name) - 1] = 0;
+    strncpy(rule.expression, expression, sizeof(rule.expression) - 1);
+    rule.expression[sizeof(rule.expression) - 1] = 0;
+    rule.severity = severity;
+    columnRules[static_cast<uint8_t>(rule.column)] |= 1u << ruleCount;
+    ruleCount++;
+    return true;
+}
+
+// ===========================
+// Evaluation (loop task, mutex held)
+// ===========================
+
+void AlertEngine::emit(uint8_t deviceId, uint8_t rule, uint8_t severity, bool raised, float value, uint32_t ms,
+                       const char* message) {
+    AlertEvent& event = history[nextSequence % ALERT_HISTORY];
+    event.sequence = nextSequence++;
+    event.time = Columns().toStoreTime(ms);
+    event.deviceId = deviceId;
+    event.rule = rule;
+    event.severity = severity;
+    event.raised = raised;
+    event.value = value;
+    strncpy(event.message, message, sizeof(event.message) - 1);
+    event.message[sizeof(event.message) - 1] = 0;
+}
+
+void AlertEngine::settle(DeviceAlerts& device, uint8_t r, bool holds, uint32_t ms, float value) {
+    const AlertRule& rule = rules[r];
+    AlertState& state = device.states[r];
+    state.value = value;
+
+    if (holds) {
+        state.clearing = false;
+        if (state.active) {
+            return;
+        }
+        if (!state.holding) {
+            state.holding = true;
+            state.since = ms;
+        }
+        if (ms - state.since >= rule.holdMs) {
+            state.active = true;
+            state.holding = false;
+            state.raisedAt = ms;
+            emit(device.deviceId, r, rule.severity, true, value, ms, rule.expression);
+        }
+        return;
+    }
+
+    state.holding = false;
+    if (!state.active) {
+        return;
+    }
+    if (!state.clearing) {
+        state.clearing = true;
+        state.since = ms;
+    }
+    if (ms - state.since >= ALERT_CLEAR_S * 1000UL) {
+        state.active = false;
+        state.clearing = false;
+        emit(device.deviceId, r, rule.severity, false, value, ms, rule.expression);
+    }
+}
+
+void AlertEngine::evaluate(DeviceAlerts& device, uint8_t r, uint32_t ms, float value) {
+    const AlertRule& rule = rules[r];
+    AlertState& state = device.states[r];
+
+    if (rule.term == AlertTerm::SILENCE) {
+        // Data again: the timer starts over, and a silence raised is over
+        arm(state.timer, ms + (uint32_t)(rule.threshold * 1000.0f));
+        if (state.active) {
+            state.active = false;
+            emit(device.deviceId, r, rule.severity, false, 0.0f, ms, rule.expression);
+        }
+        return;
+    }
+
+    if (rule.term != AlertTerm::VALUE) {
+        // Off the far end what has left the window, then on with the sample
+        while (state.count > 0 && (ms - state.window[state.head].ms > rule.windowMs ||
+                                   state.count == ALERT_WINDOW_SAMPLES)) {
+            state.sum -= state.window[state.head].value;
+            state.head = (state.head + 1) % ALERT_WINDOW_SAMPLES;
+            state.count--;
+        }
+        AlertWindowSample& sample = state.window[(state.head + state.count) % ALERT_WINDOW_SAMPLES];
+        sample.ms = ms;
+        sample.value = value;
+        state.count++;
+        state.sum += value;
+
+        if (rule.term == AlertTerm::MEAN) {
+            value = state.sum / state.count;
+        } else {
+            const AlertWindowSample& oldest = state.window[state.head];
+            uint32_t span = ms - oldest.ms;
+            if (span < rule.windowMs / 2) {
+                return;         // Too little of the window to call a rate yet
+            }
+            value = (value - oldest.value) * 1000.0f / span;
+        }
+    }
+    settle(device, r, rule.above ? value > rule.threshold : value < rule.threshold, ms, value);
+}
+
+// ===========================
+// Timer wheel (loop task, mutex held)
+// ===========================
+
+void AlertEngine::arm(AlertTimer& timer, uint32_t deadline) {
+    disarm(timer);
+
+    // A deadline already behind the wheel goes in the next slot visited
+    uint32_t tick = max(deadline / ALERT_WHEEL_TICK_MS, wheelTick);
+    AlertTimer*& slot = wheel[tick % ALERT_WHEEL_SLOTS];
+    timer.deadline = deadline;
+    timer.prev = nullptr;
+    timer.next = slot;
+    if (slot) {
+        slot->prev = &timer;
+    }
+    slot = &timer;
+    timer.armed = true;
+}
+
+void AlertEngine::disarm(AlertTimer& timer) {
+    if (!timer.armed) {
+        return;
+    }
+    if (timer.prev) {
+        timer.prev->next = timer.next;
+    } else {
+        for (uint8_t s = 0; s < ALERT_WHEEL_SLOTS; s++) {
+            if (wheel[s] == &timer) {
+                wheel[s] = timer.next;
+                break;
+            }
+        }
+    }
+    if (timer.next) {
+        timer.next->prev = timer.prev;
+    }
+    timer.next = nullptr;
+    timer.prev = nullptr;
+    timer.armed = false;
+}
+
+// Every slot of a tick that has passed; each timer in one fires if its
+// deadline is due, or waits for its lap
+void AlertEngine::advance(uint32_t now) {
+    uint32_t tick = now / ALERT_WHEEL_TICK_MS;
+    if (tick - wheelTick > ALERT_WHEEL_SLOTS) {
+        wheelTick = tick - ALERT_WHEEL_SLOTS;     // A lap visits every slot
+    }
+    for (; wheelTick < tick; wheelTick++) {
+        AlertTimer* timer = wheel[wheelTick % ALERT_WHEEL_SLOTS];
+        while (timer) {
+            AlertTimer* next = timer->next;
+            if ((int32_t)(now - timer->deadline) >= 0) {
+                disarm(*timer);
+                DeviceAlerts* owner = devices[timer->device];
+                const AlertRule& rule = rules[timer->rule];
+                AlertState& state = owner->states[timer->rule];
+                float silent = rule.threshold + (now - timer->deadline) / 1000.0f;
+                state.active = true;
+                state.value = silent;
+                state.raisedAt = now;
+                emit(owner->deviceId, timer->rule, rule.severity, true, silent, now, rule.expression);
+                timersFired++;
+            }
+            timer = next;
+        }
+    }
+}
+
+// ===========================
+// Updates (loop task)
+// ===========================
+
+void AlertEngine::update() {
+    if (!mutex) {
+        return;
+    }
+
+    static StoredPacket packet;         // Off the loop task's stack
+
+    nextIndex = max(nextIndex, Packets().getOldest());
+    for (uint32_t next = Packets().getNext(); nextIndex < next; nextIndex++) {
+        if (!Packets().get(nextIndex, packet)) {
+            continue;
+        }
+        DeviceAlerts* balloon = device(packet.deviceId);
+        if (!balloon) {
+            continue;
+        }
+
+        Column columns[COLUMN_COUNT];
+        float values[COLUMN_COUNT];
+        uint8_t count = columnSamples(packet, columns, values);
+
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        for (uint8_t i = 0; i < count; i++) {
+            for (uint16_t bits = columnRules[static_cast<uint8_t>(columns[i])]; bits; bits &= bits - 1) {
+                evaluate(*balloon, __builtin_ctz(bits), packet.receivedAt, values[i]);
+                samplesEvaluated++;
+            }
+        }
+        if (packet.decoded && packet.type == PacketType::ALERT) {
+            const AlertData& a = packet.data.alert;
+            char message[sizeof(a.message) + 1];
+            memcpy(message, a.message, sizeof(a.message));
+            message[sizeof(a.message)] = 0;
+            emit(packet.deviceId, ALERT_RULE_BALLOON, constrain(a.severity, (uint8_t)ALERT_INFO, (uint8_t)ALERT_CRITICAL), true,
+                 a.sensorValue, packet.receivedAt, message);
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    advance(millis());
+    xSemaphoreGive(mutex);
+
+    // The hook outside the mutex, so it can read the history back
+    if (hookedSequence + ALERT_HISTORY < nextSequence) {
+        hookedSequence = nextSequence - ALERT_HISTORY;
+    }
+    while (eventHook && hookedSequence < nextSequence) {
+        AlertEvent event;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        event = history[hookedSequence % ALERT_HISTORY];
+        xSemaphoreGive(mutex);
+        eventHook(event);
+        hookedSequence++;
+    }
+}
+
+// ===========================
+// Queries (any task)
+// ===========================
+
+size_t AlertEngine::getEvents(uint32_t since, AlertEvent* out, size_t maxEvents) const {
+    if (!mutex) {
+        return 0;
+    }
+    size_t found = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t first = nextSequence > ALERT_HISTORY ? nextSequence - ALERT_HISTORY : 0;
+    for (uint32_t s = max(since, first); s < nextSequence && found < maxEvents; s++) {
+        out[found++] = history[s % ALERT_HISTORY];
+    }
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+size_t AlertEngine::getActive(AlertEvent* out, size_t maxEvents) const {
+    if (!mutex) {
+        return 0;
+    }
+    size_t found = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (uint8_t d = 0; d < RX_MAX_DEVICES; d++) {
+        for (uint8_t r = 0; devices[d] && r < ruleCount && found < maxEvents; r++) {
+            const AlertState& state = devices[d]->states[r];
+            if (!state.active) {
+                continue;
+            }
+            AlertEvent& event = out[found++];
+            event.sequence = 0;
+            event.time = Columns().toStoreTime(state.raisedAt);
+            event.deviceId = devices[d]->deviceId;
+            event.rule = r;
+            event.severity = rules[r].severity;
+            event.raised = true;
+            event.value = state.value;
+            strncpy(event.message, rules[r].expression, sizeof(event.message) - 1);
+            event.message[sizeof(event.message) - 1] = 0;
+        }
+    }
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+void AlertEngine::printStatus() const {
+    AlertEvent active[RX_MAX_DEVICES * 4];
+    size_t count = getActive(active, sizeof(active) / sizeof(active[0]));
+    Serial.println("=== Alerts ===");
+    Serial.printf("Rules: %u, samples evaluated %lu, timers fired %lu, events %lu, active %u\n", ruleCount,
+                  (unsigned long)samplesEvaluated, (unsigned long)timersFired, (unsigned long)nextSequence,
+                  (unsigned)count);
+    for (size_t i = 0; i < count; i++) {
+        Serial.printf("  Balloon %u %s: %s (%.2f)\n", active[i].deviceId, rules[active[i].rule].name,
+                      active[i].message, active[i].value);
+    }
+}
@@ -0,0 +1,195 @@
+#ifndef BASE_STATION_ALERTS_H
+#define BASE_STATION_ALERTS_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "base_station_columns.h"
+
+// ===========================
+// Alert Rules (base station)
+// Alert predicates compiled once from text, evaluated sample by sample as
+// packets arrive, with a timer wheel for the ones that fire on silence
+// ===========================
+
+// A rule is "<term> <|> <number> [for <seconds>]", the term one of
+//   <column>                  the value itself
+//   mean(<column>,<seconds>)  mean over the last seconds
+//   rate(<column>,<seconds>)  change per second over the last seconds
+//   silence(<column>)         seconds since the column's last sample
+// Column names are the column store's. compile() parses it into a rule
+// record once; after that a sample costs the rules on its column, each a
+// compare and for mean and rate a push onto a window ring and the pops off
+// its far end - constant time amortised, whatever the window.
+//
+// Silence rules keep a timer per balloon in a hashed timer wheel of
+// ALERT_WHEEL_SLOTS one-second slots: each sample moves the timer to its
+// new deadline's slot, and update() visits only the slots time has passed.
+// A deadline further out than the wheel stays put until its lap comes round.
+//
+// A rule raises once it has held for its "for" time and clears once it
+// has been false for ALERT_CLEAR_S - a value hovering on the threshold
+// doesn't flap. Alerts the balloon sends are passed through as events too.
+// Each event goes into a history ring and to the event hook, on the loop
+// task, as it happens.
+
+#define ALERT_MAX_RULES            16
+#define ALERT_NAME_MAX             20
+#define ALERT_EXPRESSION_MAX       48
+#define ALERT_MESSAGE_MAX          64
+#define ALERT_WINDOW_SAMPLES       64      // Per windowed rule per balloon; a denser window is cut to this
+#define ALERT_WHEEL_SLOTS          64
+#define ALERT_WHEEL_TICK_MS        1000
+#define ALERT_CLEAR_S              10
+#define ALERT_HISTORY              32
+#define ALERT_RULE_BALLOON         0xFF   // AlertEvent::rule of an alert the balloon sent
+
+// Default rule thresholds
+#define ALERT_BATTERY_PERCENT      20
+#define ALERT_ALTITUDE_M           30000
+#define ALERT_DESCENT_MPS          15      // Falling faster than this over ALERT_DESCENT_WINDOW_S
+#define ALERT_DESCENT_WINDOW_S     10
+#define ALERT_SIGNAL_LOST_S        (LORA_RECEIVE_TIMEOUT_MS / 1000)
+
+enum class AlertTerm : uint8_t {
+    VALUE = 0,
+    MEAN,
+    RATE,
+    SILENCE
+};
+
+enum AlertSeverity : uint8_t {
+    ALERT_INFO = 1,
+    ALERT_WARNING,
+    ALERT_CRITICAL
+};
+
+const char* alertSeverityName(uint8_t severity);
+
+struct AlertRule {
+    char name[ALERT_NAME_MAX];
+    char expression[ALERT_EXPRESSION_MAX];
+    AlertTerm term;
+    Column column;
+    bool above;                 // > rather than <
+    float threshold;            // Seconds for SILENCE
+    uint32_t windowMs;          // MEAN and RATE
+    uint32_t holdMs;            // "for"
+    uint8_t severity;
+};
+
+struct AlertEvent {
+    uint32_t sequence;
+    uint32_t time;              // Store-clock seconds
+    uint8_t deviceId;
+    uint8_t rule;               // Index, or ALERT_RULE_BALLOON
+    uint8_t severity;
+    bool raised;                // false when it cleared
+    float value;                // The term's value at the time
+    char message[ALERT_MESSAGE_MAX];
+};
+
+typedef void (*AlertEventHook)(const AlertEvent& event);
+
+struct AlertWindowSample {
+    uint32_t ms;
+    float value;
+};
+
+// Intrusive, in its deadline's wheel slot while armed
+struct AlertTimer {
+    AlertTimer* next;
+    AlertTimer* prev;
+    uint32_t deadline;          // millis()
+    bool armed;
+    uint8_t device;             // AlertEngine::devices index
+    uint8_t rule;
+};
+
+struct AlertState {
+    bool active;
+    bool holding;               // Predicate true, waiting out the hold
+    bool clearing;              // Predicate false, waiting out ALERT_CLEAR_S
+    uint32_t since;             // Of holding or clearing, ms
+    uint32_t raisedAt;          // ms
+    float value;
+    double sum;                 // MEAN window
+    uint8_t head;               // Window ring
+    uint8_t count;
+    AlertTimer timer;
+    AlertWindowSample window[ALERT_WINDOW_SAMPLES];
+};
+
+struct DeviceAlerts {
+    uint8_t deviceId;
+    AlertState states[ALERT_MAX_RULES];
+};
+
+class AlertEngine {
+public:
+    AlertEngine();
+    ~AlertEngine();
+
+    // Compiles the default rules ALERT_* turns on; after Packets().begin()
+    bool begin();
+    void end();
+    bool isReady() const { return mutex != nullptr; }
+
+    // Parses expression into a new rule; false with error set on a syntax
+    // error or a full table. Before begin() or from the loop task
+    bool addRule(const char* name, const char* expression, uint8_t severity, const char** error = nullptr);
+    static bool compile(const char* expression, AlertRule& rule, const char** error);
+
+    // From loop(): the packets since the last call, then the timers due
+    void update();
+
+    // One hook, on the loop task
+    void setEventHook(AlertEventHook hook) { eventHook = hook; }
+
+    // Events with sequence >= since, oldest first; how many into out
+    size_t getEvents(uint32_t since, AlertEvent* out, size_t maxEvents) const;
+    uint32_t getNextSequence() const { return nextSequence; }
+
+    // The alerts raised and not cleared, as events; how many
+    size_t getActive(AlertEvent* out, size_t maxEvents) const;
+
+    uint8_t getRuleCount() const { return ruleCount; }
+    const AlertRule& getRule(uint8_t index) const { return rules[index]; }
+
+    void printStatus() const;
+
+private:
+    AlertRule rules[ALERT_MAX_RULES];
+    uint8_t ruleCount;
+    uint16_t columnRules[COLUMN_COUNT];     // Bit r: rule r reads the column
+
+    DeviceAlerts* devices[RX_MAX_DEVICES];  // PSRAM, by session slot, from the balloon's first packet
+    SemaphoreHandle_t mutex;                // History and active states
+    uint32_t nextIndex;
+    AlertEventHook eventHook;
+
+    AlertTimer* wheel[ALERT_WHEEL_SLOTS];
+    uint32_t wheelTick;                     // Next tick to visit
+
+    AlertEvent history[ALERT_HISTORY];
+    uint32_t nextSequence;
+    uint32_t hookedSequence;                // Next event to hand the hook
+
+    uint32_t samplesEvaluated;
+    uint32_t timersFired;
+
+    DeviceAlerts* device(uint8_t deviceId);
+    void evaluate(DeviceAlerts& device, uint8_t r, uint32_t ms, float value);
+    void settle(DeviceAlerts& device, uint8_t r, bool holds, uint32_t ms, float value);
+    void emit(uint8_t deviceId, uint8_t rule, uint8_t severity, bool raised, float value, uint32_t ms,
+              const char* message);
+
+    void arm(AlertTimer& timer, uint32_t deadline);
+    void disarm(AlertTimer& timer);
+    void advance(uint32_t now);
+};
+
+AlertEngine& Alerts();
+
+#endif // BASE_STATION_ALERTS_H
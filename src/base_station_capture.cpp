@@ -0,0 +1,260 @@
+#include "base_station_config.h"
+#include "base_station_capture.h"
+#include "base_station_columns.h"
+#include "memory_ledger.h"
+#include <LittleFS.h>
+
+#define CAPTURE_FILE               FLASH_STORAGE_PATH "/link.pcap"
+#define CAPTURE_OLD_FILE           FLASH_STORAGE_PATH "/link.old"
+
+static CaptureStore captureStoreInstance;
+
+CaptureStore& LinkCaptures() {
+    return captureStoreInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+CaptureStore::CaptureStore() {
+    buffer = nullptr;
+    buffered = 0;
+    writeBuffer = nullptr;
+    lock = portMUX_INITIALIZER_UNLOCKED;
+    fileMutex = nullptr;
+    fileBytes = 0;
+    lastFlush = 0;
+    recordsCaptured = 0;
+    recordsDropped = 0;
+    bytesWritten = 0;
+    rotations = 0;
+    writeErrors = 0;
+}
+
+CaptureStore::~CaptureStore() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool CaptureStore::begin() {
+    if (fileMutex) {
+        return true;
+    }
+    if (!Columns().isReady()) {
+        Serial.println("Link capture: LittleFS not mounted");
+        return false;
+    }
+
+    buffer = (uint8_t*)memAlloc(MemTag::LOGGING, CAPTURE_BUFFER_BYTES);
+    writeBuffer = (uint8_t*)memAlloc(MemTag::LOGGING, CAPTURE_BUFFER_BYTES);
+    fileMutex = xSemaphoreCreateMutex();
+    if (!buffer || !writeBuffer || !fileMutex) {
+        Serial.println("Link capture: No memory for the buffers");
+        end();
+        return false;
+    }
+
+    // Carries on after a reset; a file cut short of its header starts again
+    fileBytes = 0;
+    File file = LittleFS.open(CAPTURE_FILE, "r");
+    if (file) {
+        fileBytes = file.size();
+        file.close();
+        if (fileBytes < LINK_CAPTURE_FILE_HEADER) {
+            LittleFS.remove(CAPTURE_FILE);
+            fileBytes = 0;
+        }
+    }
+    buffered = 0;
+    lastFlush = millis();
+    return true;
+}
+
+void CaptureStore::end() {
+    if (fileMutex) {
+        xSemaphoreTake(fileMutex, portMAX_DELAY);
+        flushLocked();
+        vSemaphoreDelete(fileMutex);
+        fileMutex = nullptr;
+    }
+    if (buffer) {
+        memFree(MemTag::LOGGING, buffer);
+        buffer = nullptr;
+    }
+    if (writeBuffer) {
+        memFree(MemTag::LOGGING, writeBuffer);
+        writeBuffer = nullptr;
+    }
+    buffered = 0;
+}
+
+// ===========================
+// Capture (RX task)
+// ===========================
+
+void CaptureStore::onFrame(void* context, const LinkCaptureFrame& frame) {
+    uint8_t record[linkCaptureRecordMax(CAPTURE_SNAP_BYTES)];
+    size_t length = linkCaptureEncode(frame, record, sizeof(record), CAPTURE_SNAP_BYTES);
+    if (length) {
+        static_cast<CaptureStore*>(context)->append(record, length);
+    }
+}
+
+void CaptureStore::append(const uint8_t* record, size_t length) {
+    if (!buffer) {
+        return;
+    }
+    bool stored = false;
+    portENTER_CRITICAL(&lock);
+    if (buffered + length <= CAPTURE_BUFFER_BYTES) {
+        memcpy(buffer + buffered, record, length);
+        buffered += length;
+        stored = true;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (stored) {
+        recordsCaptured++;
+    } else {
+        recordsDropped++;
+    }
+}
+
+// ===========================
+// Flash (file mutex held)
+// ===========================
+
+bool CaptureStore::flushLocked() {
+    if (!buffer) {
+        return true;
+    }
+    portENTER_CRITICAL(&lock);
+    size_t length = buffered;
+    memcpy(writeBuffer, buffer, length);
+    buffered = 0;
+    portEXIT_CRITICAL(&lock);
+    lastFlush = millis();
+    if (length == 0) {
+        return true;
+    }
+
+    File file = LittleFS.open(CAPTURE_FILE, "a");
+    if (!file) {
+        writeErrors++;
+        return false;
+    }
+    // A file starts with its header; one left without it is written again
+    bool ok = true;
+    size_t header = 0;
+    if (fileBytes == 0) {
+        uint8_t fileHeader[LINK_CAPTURE_FILE_HEADER];
+        header = linkCaptureFileHeader(fileHeader, CAPTURE_SNAP_BYTES);
+        ok = file.write(fileHeader, header) == header;
+    }
+    ok = ok && file.write(writeBuffer, length) == length;
+    file.close();
+    if (!ok) {
+        if (fileBytes == 0) {
+            LittleFS.remove(CAPTURE_FILE);
+        }
+        writeErrors++;
+        return false;
+    }
+    fileBytes += header + length;
+    bytesWritten += length;
+
+    // Whole records only ever land in a file, so each rotates as a valid capture
+    if (fileBytes >= CAPTURE_FILE_MAX_BYTES) {
+        if (LittleFS.exists(CAPTURE_OLD_FILE)) {
+            LittleFS.remove(CAPTURE_OLD_FILE);
+        }
+        if (!LittleFS.rename(CAPTURE_FILE, CAPTURE_OLD_FILE)) {
+            LittleFS.remove(CAPTURE_FILE);
+            writeErrors++;
+        }
+        fileBytes = 0;
+        rotations++;
+    }
+    return true;
+}
+
+void CaptureStore::update() {
+    if (!fileMutex) {
+        return;
+    }
+    uint32_t now = millis();
+    if (now - lastFlush < CAPTURE_FLUSH_INTERVAL_MS && buffered < CAPTURE_BUFFER_BYTES / 2) {
+        return;
+    }
+    // A download holds the files; the buffer waits
+    if (xSemaphoreTake(fileMutex, 0) != pdTRUE) {
+        return;
+    }
+    flushLocked();
+    xSemaphoreGive(fileMutex);
+}
+
+// ===========================
+// Download
+// ===========================
+
+bool CaptureStore::sendFile(const char* path, size_t skip, CaptureSendHandler send, void* context) {
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return true;
+    }
+    bool ok = file.seek(skip);
+    while (ok) {
+        size_t length = file.read(writeBuffer, CAPTURE_BUFFER_BYTES);
+        if (length == 0) {
+            break;
+        }
+        ok = send(context, writeBuffer, length);
+    }
+    file.close();
+    return ok;
+}
+
+bool CaptureStore::download(CaptureSendHandler send, void* context) {
+    if (!fileMutex) {
+        return false;
+    }
+    xSemaphoreTake(fileMutex, portMAX_DELAY);
+    bool ok = flushLocked();
+
+    // One global header: link.old's, else link.pcap's, else one for an empty capture
+    bool old = LittleFS.exists(CAPTURE_OLD_FILE);
+    if (ok && old) {
+        ok = sendFile(CAPTURE_OLD_FILE, 0, send, context);
+    }
+    if (ok && fileBytes > 0) {
+        ok = sendFile(CAPTURE_FILE, old ? LINK_CAPTURE_FILE_HEADER : 0, send, context);
+    } else if (ok && !old) {
+        uint8_t header[LINK_CAPTURE_FILE_HEADER];
+        linkCaptureFileHeader(header, CAPTURE_SNAP_BYTES);
+        ok = send(context, header, sizeof(header));
+    }
+    xSemaphoreGive(fileMutex);
+    return ok;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void CaptureStore::printStatus() const {
+    if (!fileMutex) {
+        Serial.println("Link capture: not running");
+        return;
+    }
+    Serial.println("=== Link Capture ===");
+    Serial.printf("Records: %lu captured, %lu dropped, %u bytes buffered\n", (unsigned long)recordsCaptured,
+                  (unsigned long)recordsDropped, (unsigned)buffered);
+    Serial.printf("File: %lu of %lu KB, %lu rotations, %lu KB written, %lu write errors\n",
+                  (unsigned long)(fileBytes / 1024), (unsigned long)(CAPTURE_FILE_MAX_BYTES / 1024),
+                  (unsigned long)rotations, (unsigned long)(bytesWritten / 1024), (unsigned long)writeErrors);
+}
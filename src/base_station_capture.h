@@ -0,0 +1,89 @@
+#ifndef BASE_STATION_CAPTURE_H
+#define BASE_STATION_CAPTURE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "balloon_config.h"
+#include "link_capture.h"
+
+// ===========================
+// Link Capture Store (base station)
+// Every frame both radios send and receive, and what became of the packets
+// in them, as a pcap ring on LittleFS
+// ===========================
+
+// LoRaManager's capture sink (link_capture.h) encodes each frame into a RAM
+// buffer on the RX task; update() appends the buffer to
+// FLASH_STORAGE_PATH/link.pcap from loop() every CAPTURE_FLUSH_INTERVAL_MS,
+// or sooner when it is half full. A record that finds the buffer full is
+// dropped and counted - the RX task never waits on flash.
+//
+// Once link.pcap passes CAPTURE_FILE_MAX_BYTES it becomes link.old and a
+// new one starts, each a whole pcap file: the newest CAPTURE_FILE_MAX_BYTES
+// of the link are always on flash, and at most twice that. Frames are kept
+// whole (CAPTURE_SNAP_BYTES).
+//
+// download() sends link.old and link.pcap as one capture, buffer first
+// flushed, holding the file mutex throughout; update() skips a flush while
+// it does, and the buffer takes up the slack.
+
+#define CAPTURE_FILE_MAX_BYTES     (1024 * 1024)
+#define CAPTURE_BUFFER_BYTES       8192    // Records waiting for loop()
+#define CAPTURE_FLUSH_INTERVAL_MS  5000
+#define CAPTURE_SNAP_BYTES         MAX_PACKET_SIZE
+
+// One piece of a download; false stops it
+typedef bool (*CaptureSendHandler)(void* context, const uint8_t* data, size_t length);
+
+class CaptureStore {
+public:
+    CaptureStore();
+    ~CaptureStore();
+
+    // After Columns().begin(), which mounts LittleFS; false without it
+    bool begin();
+    void end();
+    bool isReady() const { return fileMutex != nullptr; }
+
+    // The sink to hand LoRaComm() and BulkLoRa(), context this store
+    static void onFrame(void* context, const LinkCaptureFrame& frame);
+
+    // From loop()
+    void update();
+
+    // Any task but the RX task; false if send gave up or flash failed
+    bool download(CaptureSendHandler send, void* context);
+
+    uint32_t getRecordsCaptured() const { return recordsCaptured; }
+    uint32_t getRecordsDropped() const { return recordsDropped; }
+    void printStatus() const;
+
+private:
+    uint8_t* buffer;            // CAPTURE_BUFFER_BYTES of encoded records
+    size_t buffered;
+    uint8_t* writeBuffer;       // The buffer as taken for a flush; download() chunks
+    portMUX_TYPE lock;          // buffer and buffered
+    SemaphoreHandle_t fileMutex;
+    size_t fileBytes;           // link.pcap's size, header included
+    uint32_t lastFlush;
+
+    volatile uint32_t recordsCaptured;
+    volatile uint32_t recordsDropped;
+    uint32_t bytesWritten;
+    uint32_t rotations;
+    uint32_t writeErrors;
+
+    void append(const uint8_t* record, size_t length);
+    bool flushLocked();
+    bool sendFile(const char* path, size_t skip, CaptureSendHandler send, void* context);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern CaptureStore& LinkCaptures();
+
+#endif // BASE_STATION_CAPTURE_H
@@ -0,0 +1,652 @@
+#include "base_station_config.h"
+#include "base_station_columns.h"
+#include "base_station_sessions.h"
+#include <LittleFS.h>
+#include "memory_ledger.h"
+
+static_assert(COLUMN_MAX_DEVICES == SESSION_MAX, "Per-balloon state is kept by session slot");
+
+static ColumnStore columnStoreInstance;
+
+ColumnStore& Columns() {
+    return columnStoreInstance;
+}
+
+// ===========================
+// Columns
+// ===========================
+
+struct ColumnInfo {
+    const char* name;
+    float resolution;
+};
+
+// Telemetry steps are the schema's fixed point; GPS is sent as floats
+static const ColumnInfo columnInfo[COLUMN_COUNT] = {
+    {"temperature",     0.01f},
+    {"pressure",        1.0f},
+    {"humidity",        0.01f},
+    {"battery_v",       0.001f},
+    {"battery_a",       0.001f},
+    {"battery_pct",     1.0f},
+    {"cpu_temperature", 0.01f},
+    {"lat",             0.000001f},     // ~0.1 m
+    {"lon",             0.000001f},
+    {"alt",             0.1f},
+    {"speed",           0.01f},
+    {"course",          0.1f},
+    {"sats",            1.0f},
+    {"hdop",            1.0f},
+    {"rssi",            1.0f},
+    {"snr",             1.0f},
+};
+
+const char* columnName(Column column) {
+    uint8_t c = static_cast<uint8_t>(column);
+    return c < COLUMN_COUNT ? columnInfo[c].name : "unknown";
+}
+
+float columnResolution(Column column) {
+    uint8_t c = static_cast<uint8_t>(column);
+    return c < COLUMN_COUNT ? columnInfo[c].resolution : 1.0f;
+}
+
+uint8_t columnDecimals(Column column) {
+    uint8_t decimals = 0;
+    for (float step = columnResolution(column); decimals < 6 && step < 0.999f; step *= 10.0f) {
+        decimals++;
+    }
+    return decimals;
+}
+
+bool columnFromName(const char* name, Column& column) {
+    for (uint8_t c = 0; c < COLUMN_COUNT; c++) {
+        if (strcmp(name, columnInfo[c].name) == 0) {
+            column = static_cast<Column>(c);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t columnSamples(const StoredPacket& packet, Column* columns, float* values) {
+    uint8_t count = 0;
+    auto add = [&](Column column, float value) {
+        columns[count] = column;
+        values[count++] = value;
+    };
+
+    add(Column::RSSI, packet.rssi);
+    add(Column::SNR, packet.snr);
+    if (!packet.decoded) {
+        return count;
+    }
+
+    if (packet.type == PacketType::TELEMETRY) {
+        const TelemetryData& t = packet.data.telemetry;
+        add(Column::TEMPERATURE, t.temperature);
+        add(Column::PRESSURE, t.pressure);
+        add(Column::HUMIDITY, t.humidity);
+        add(Column::BATTERY_VOLTAGE, t.batteryVoltage);
+        add(Column::BATTERY_CURRENT, t.batteryCurrent);
+        add(Column::BATTERY_PERCENT, t.batteryPercentage);
+        add(Column::CPU_TEMPERATURE, t.cpuTemperature);
+    } else if (packet.type == PacketType::GPS_DATA) {
+        const GPSData& g = packet.data.gps;
+        add(Column::LATITUDE, g.latitude);
+        add(Column::LONGITUDE, g.longitude);
+        add(Column::ALTITUDE, g.altitude);
+        add(Column::SPEED, g.speed);
+        add(Column::COURSE, g.course);
+        add(Column::SATELLITES, g.satellites);
+        add(Column::HDOP, g.hdop);
+    }
+    return count;
+}
+
+static bool holdsSamples(const ColumnFile& file) {
+    return file.head.count > 0 || file.liveBlocks > 0 || file.oldBlocks > 0;
+}
+
+// First span ending at or after time; count if none does
+static uint16_t firstReaching(const ColumnSpan* spans, uint16_t count, uint32_t time) {
+    uint16_t low = 0;
+    uint16_t high = count;
+    while (low < high) {
+        uint16_t mid = (low + high) / 2;
+        if (spans[mid].lastTime < time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+ColumnStore::ColumnStore() {
+    devices = nullptr;
+    mutex = nullptr;
+    clockBase = 0;
+    nextIndex = 0;
+    lastFlush = 0;
+    sampleHook = nullptr;
+
+    samplesStored = 0;
+    sameSecondDrops = 0;
+    packetsMissed = 0;
+    blocksWritten = 0;
+    writeErrors = 0;
+    readErrors = 0;
+}
+
+ColumnStore::~ColumnStore() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool ColumnStore::begin() {
+    if (devices) {
+        return true;
+    }
+
+    // Formats the partition the first time
+    if (!LittleFS.begin(true)) {
+        Serial.println("Column store: LittleFS mount failed");
+        return false;
+    }
+    if (!LittleFS.exists(FLASH_STORAGE_PATH) && !LittleFS.mkdir(FLASH_STORAGE_PATH)) {
+        Serial.println("Column store: Cannot create " FLASH_STORAGE_PATH);
+        LittleFS.end();
+        return false;
+    }
+
+    // ~70 KB of heads and indexes - memAlloc() puts it in PSRAM
+    devices = (DeviceColumns*)memCalloc(MemTag::TIMESERIES, COLUMN_MAX_DEVICES, sizeof(DeviceColumns));
+    mutex = xSemaphoreCreateMutex();
+    if (!devices || !mutex) {
+        Serial.println("Column store: No memory for the column heads");
+        end();
+        return false;
+    }
+
+    // Every balloon already on flash, and the store clock past its newest sample
+    File root = LittleFS.open(FLASH_STORAGE_PATH);
+    for (File entry = root.openNextFile(); entry; entry = root.openNextFile()) {
+        unsigned id;
+        if (entry.isDirectory() && sscanf(entry.name(), "dev%u", &id) == 1 && id <= 0xFF && !find(id)) {
+            open(id);
+        }
+        entry.close();
+    }
+    root.close();
+
+    bool any = false;
+    uint32_t newest = 0;
+    for (uint8_t d = 0; d < COLUMN_MAX_DEVICES; d++) {
+        for (uint8_t c = 0; devices[d].active && c < COLUMN_COUNT; c++) {
+            const ColumnFile& file = devices[d].columns[c];
+            if (holdsSamples(file)) {
+                newest = max(newest, file.cursor.prevTime);
+                any = true;
+            }
+        }
+    }
+    clockBase = any ? newest + 1 : 0;
+
+    // Packets received before the store came up are still in the ring
+    nextIndex = Packets().getOldest();
+    lastFlush = millis();
+    return true;
+}
+
+void ColumnStore::end() {
+    if (devices && mutex) {
+        flush();
+    }
+    if (devices) {
+        for (uint8_t d = 0; d < COLUMN_MAX_DEVICES; d++) {
+            BalloonSession* session = devices[d].active ? Sessions().find(devices[d].deviceId) : nullptr;
+            if (session) {
+                session->columns = nullptr;
+            }
+        }
+        memFree(MemTag::TIMESERIES, devices);
+        devices = nullptr;
+        LittleFS.end();
+    }
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+}
+
+// ===========================
+// Loading
+// ===========================
+
+DeviceColumns* ColumnStore::find(uint8_t deviceId) const {
+    const BalloonSession* session = Sessions().find(deviceId);
+    return session ? session->columns : nullptr;
+}
+
+// The balloon's session's slot, with whatever it already has on flash
+DeviceColumns* ColumnStore::open(uint8_t deviceId) {
+    BalloonSession* session = Sessions().open(deviceId);
+    if (!session) {
+        return nullptr;
+    }
+    DeviceColumns* device = &devices[session->slot];
+
+    char path[COLUMN_PATH_MAX];
+    snprintf(path, sizeof(path), FLASH_STORAGE_PATH "/dev%u", deviceId);
+    if (!LittleFS.exists(path) && !LittleFS.mkdir(path)) {
+        writeErrors++;
+        return nullptr;
+    }
+
+    memset(device, 0, sizeof(*device));
+    device->active = true;
+    device->deviceId = deviceId;
+    for (uint8_t c = 0; c < COLUMN_COUNT; c++) {
+        loadColumn(deviceId, static_cast<Column>(c), device->columns[c]);
+    }
+    session->columns = device;
+    return device;
+}
+
+// Block headers into spans, while they're whole and in time order. whole
+// is false if the file ends in a partial block or has more than the index
+// holds - a reset mid-append, or a build with a smaller COLUMN_FILE_BLOCKS
+uint16_t ColumnStore::loadIndex(const char* path, ColumnSpan* spans, uint32_t from, bool& whole) {
+    whole = true;
+    if (!LittleFS.exists(path)) {
+        return 0;
+    }
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        whole = false;
+        return 0;
+    }
+
+    size_t size = file.size();
+    uint32_t blocks = size / sizeof(TimeSeriesBlock);
+    whole = size % sizeof(TimeSeriesBlock) == 0 && blocks <= COLUMN_FILE_BLOCKS;
+
+    uint16_t indexed = 0;
+    TimeSeriesBlock header;
+    while (indexed < min(blocks, (uint32_t)COLUMN_FILE_BLOCKS)) {
+        if (!file.seek(indexed * sizeof(TimeSeriesBlock)) ||
+            file.read((uint8_t*)&header, 16) != 16 ||
+            header.count == 0 || header.firstTime < from || header.lastTime < header.firstTime) {
+            whole = false;
+            break;
+        }
+        spans[indexed].firstTime = header.firstTime;
+        spans[indexed].lastTime = header.lastTime;
+        spans[indexed].count = header.count;
+        from = header.lastTime + 1;
+        indexed++;
+    }
+    file.close();
+    return indexed;
+}
+
+void ColumnStore::loadColumn(uint8_t deviceId, Column column, ColumnFile& file) {
+    char path[COLUMN_PATH_MAX];
+    bool whole;
+
+    columnPath(path, deviceId, column, ".old");
+    file.oldBlocks = loadIndex(path, file.old, 0, whole);
+
+    uint32_t from = file.oldBlocks ? file.old[file.oldBlocks - 1].lastTime + 1 : 0;
+    columnPath(path, deviceId, column, ".col");
+    file.liveBlocks = loadIndex(path, file.live, from, whole);
+    file.liveSamples = 0;
+    for (uint16_t i = 0; i < file.liveBlocks; i++) {
+        file.liveSamples += file.live[i].count;
+    }
+
+    // Appending after a bad block would misalign everything behind it
+    if (!whole || file.liveSamples >= MAX_FLASH_PACKETS || file.liveBlocks >= COLUMN_FILE_BLOCKS) {
+        rotate(deviceId, column, file);
+    }
+
+    file.cursor.prevTime = 0;
+    if (file.liveBlocks > 0) {
+        file.cursor.prevTime = file.live[file.liveBlocks - 1].lastTime;
+    } else if (file.oldBlocks > 0) {
+        file.cursor.prevTime = file.old[file.oldBlocks - 1].lastTime;
+    }
+
+    // The head as last flushed. One no newer than the .col's last block was
+    // sealed into it before the reset and is already there
+    file.head.count = 0;
+    columnPath(path, deviceId, column, ".hd");
+    if (LittleFS.exists(path)) {
+        File hd = LittleFS.open(path, "r");
+        bool valid = hd && hd.read((uint8_t*)&file.head, sizeof(file.head)) == sizeof(file.head) &&
+                     file.head.count > 0 && file.head.bits <= sizeof(file.head.data) * 8 &&
+                     file.head.lastTime >= file.head.firstTime &&
+                     ((file.liveBlocks == 0 && file.oldBlocks == 0) || file.head.firstTime > file.cursor.prevTime);
+        hd.close();
+        if (valid) {
+            timeSeriesResume(file.head, file.cursor);
+        } else {
+            file.head.count = 0;
+        }
+    }
+    file.dirty = false;
+}
+
+// ===========================
+// Writing (loop task)
+// ===========================
+
+void ColumnStore::update() {
+    if (!devices) {
+        return;
+    }
+
+    static StoredPacket packet;         // Off the loop task's stack
+
+    uint32_t oldest = Packets().getOldest();
+    if (nextIndex < oldest) {
+        packetsMissed += oldest - nextIndex;
+        nextIndex = oldest;
+    }
+
+    // A packet per lock, so a query waits on one packet's columns at most
+    for (uint32_t next = Packets().getNext(); nextIndex < next; nextIndex++) {
+        if (!Packets().get(nextIndex, packet)) {
+            packetsMissed++;
+            continue;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        store(packet);
+        xSemaphoreGive(mutex);
+    }
+
+    if (millis() - lastFlush >= COLUMN_FLUSH_INTERVAL_MS) {
+        flush();
+        lastFlush = millis();
+    }
+}
+
+void ColumnStore::store(const StoredPacket& packet) {
+    DeviceColumns* device = find(packet.deviceId);
+    if (!device && !(device = open(packet.deviceId))) {
+        packetsMissed++;        // More balloons than COLUMN_MAX_DEVICES
+        return;
+    }
+
+    Column columns[COLUMN_COUNT];
+    float values[COLUMN_COUNT];
+    uint8_t count = columnSamples(packet, columns, values);
+    uint32_t time = toStoreTime(packet.receivedAt);
+    for (uint8_t i = 0; i < count; i++) {
+        record(*device, columns[i], time, values[i]);
+    }
+}
+
+void ColumnStore::record(DeviceColumns& device, Column column, uint32_t time, float value) {
+    ColumnFile& file = device.columns[static_cast<uint8_t>(column)];
+    int32_t quantized = timeSeriesQuantize(value, columnResolution(column));
+
+    if (holdsSamples(file) && time <= file.cursor.prevTime) {
+        sameSecondDrops++;
+        return;
+    }
+
+    if (file.head.count == 0 || !timeSeriesAppend(file.head, file.cursor, time, quantized)) {
+        if (file.head.count > 0) {
+            seal(device.deviceId, column, file);
+        }
+        timeSeriesStartBlock(file.head, file.cursor, time, quantized);
+    }
+    file.dirty = true;
+    samplesStored++;
+    if (sampleHook) {
+        sampleHook(device.deviceId, column, time, value);
+    }
+}
+
+// The full head onto the end of the .col file
+void ColumnStore::seal(uint8_t deviceId, Column column, ColumnFile& file) {
+    char path[COLUMN_PATH_MAX];
+    columnPath(path, deviceId, column, ".col");
+
+    File col = LittleFS.open(path, "a");
+    bool written = col && col.write((const uint8_t*)&file.head, sizeof(file.head)) == sizeof(file.head);
+    col.close();
+
+    if (written) {
+        ColumnSpan& span = file.live[file.liveBlocks++];
+        span.firstTime = file.head.firstTime;
+        span.lastTime = file.head.lastTime;
+        span.count = file.head.count;
+        file.liveSamples += file.head.count;
+        blocksWritten++;
+    } else {
+        writeErrors++;
+    }
+    file.head.count = 0;
+
+    // A short write leaves a partial block - nothing can follow it
+    if (!written || file.liveSamples >= MAX_FLASH_PACKETS || file.liveBlocks >= COLUMN_FILE_BLOCKS) {
+        rotate(deviceId, column, file);
+    }
+}
+
+// .col becomes .old, replacing the one before
+void ColumnStore::rotate(uint8_t deviceId, Column column, ColumnFile& file) {
+    char col[COLUMN_PATH_MAX];
+    char old[COLUMN_PATH_MAX];
+    columnPath(col, deviceId, column, ".col");
+    columnPath(old, deviceId, column, ".old");
+
+    // Nothing whole in it - the .old stays as it is
+    if (file.liveBlocks == 0) {
+        if (LittleFS.exists(col)) {
+            LittleFS.remove(col);
+        }
+        file.liveSamples = 0;
+        return;
+    }
+
+    if (LittleFS.exists(old)) {
+        LittleFS.remove(old);
+    }
+    file.oldBlocks = 0;
+    if (LittleFS.rename(col, old)) {
+        memcpy(file.old, file.live, file.liveBlocks * sizeof(ColumnSpan));
+        file.oldBlocks = file.liveBlocks;
+    } else {
+        writeErrors++;
+        LittleFS.remove(col);
+    }
+    file.liveBlocks = 0;
+    file.liveSamples = 0;
+}
+
+bool ColumnStore::writeHead(uint8_t deviceId, Column column, ColumnFile& file) {
+    char path[COLUMN_PATH_MAX];
+    columnPath(path, deviceId, column, ".hd");
+
+    if (file.head.count == 0) {
+        return !LittleFS.exists(path) || LittleFS.remove(path);
+    }
+    File hd = LittleFS.open(path, "w");
+    bool written = hd && hd.write((const uint8_t*)&file.head, sizeof(file.head)) == sizeof(file.head);
+    hd.close();
+    return written;
+}
+
+bool ColumnStore::flush() {
+    if (!devices) {
+        return false;
+    }
+
+    bool ok = true;
+    for (uint8_t d = 0; d < COLUMN_MAX_DEVICES; d++) {
+        for (uint8_t c = 0; devices[d].active && c < COLUMN_COUNT; c++) {
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            ColumnFile& file = devices[d].columns[c];
+            if (file.dirty) {
+                if (writeHead(devices[d].deviceId, static_cast<Column>(c), file)) {
+                    file.dirty = false;
+                } else {
+                    writeErrors++;
+                    ok = false;
+                }
+            }
+            xSemaphoreGive(mutex);
+        }
+    }
+    return ok;
+}
+
+// ===========================
+// Reading (any task)
+// ===========================
+
+bool ColumnStore::readBlock(uint8_t deviceId, Column column, const char* extension, uint16_t block,
+                            TimeSeriesBlock& out) const {
+    char path[COLUMN_PATH_MAX];
+    columnPath(path, deviceId, column, extension);
+
+    File file = LittleFS.open(path, "r");
+    bool read = file && file.seek(block * sizeof(TimeSeriesBlock)) &&
+                file.read((uint8_t*)&out, sizeof(out)) == sizeof(out);
+    file.close();
+    if (!read) {
+        readErrors++;
+    }
+    return read;
+}
+
+size_t ColumnStore::visit(uint8_t deviceId, Column column, uint32_t from, uint32_t to,
+                          TimeSeriesVisitor visitor, void* context) const {
+    if (!devices || !visitor || static_cast<uint8_t>(column) >= COLUMN_COUNT) {
+        return 0;
+    }
+
+    size_t visited = 0;
+    uint32_t cursor = from;
+    float resolution = columnResolution(column);
+    TimeSeriesBlock copy;
+
+    while (cursor <= to) {
+        // Rotation may move blocks between reads, so each one is found by
+        // time in the index, read under the lock and decoded outside it
+        bool haveBlock = false;
+        bool skipped = false;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        const DeviceColumns* device = find(deviceId);
+        if (device) {
+            const ColumnFile& file = device->columns[static_cast<uint8_t>(column)];
+            const ColumnSpan* span = nullptr;
+            const char* extension = nullptr;
+            uint16_t block = firstReaching(file.old, file.oldBlocks, cursor);
+            if (block < file.oldBlocks) {
+                span = &file.old[block];
+                extension = ".old";
+            } else if ((block = firstReaching(file.live, file.liveBlocks, cursor)) < file.liveBlocks) {
+                span = &file.live[block];
+                extension = ".col";
+            }
+
+            if (span) {
+                if (span->firstTime <= to) {
+                    haveBlock = readBlock(deviceId, column, extension, block, copy) && copy.count == span->count;
+                    if (!haveBlock) {
+                        cursor = span->lastTime + 1;    // Past the unreadable block
+                        skipped = span->lastTime < to;
+                    }
+                }
+            } else if (file.head.count > 0 && file.head.lastTime >= cursor && file.head.firstTime <= to) {
+                memcpy(&copy, &file.head, sizeof(copy));
+                haveBlock = true;
+            }
+        }
+        xSemaphoreGive(mutex);
+        if (skipped) {
+            continue;
+        }
+        if (!haveBlock) {
+            break;
+        }
+
+        if (!timeSeriesDecode(copy, resolution, cursor, to, visitor, context, visited)) {
+            break;
+        }
+        if (copy.lastTime >= to) {
+            break;
+        }
+        cursor = copy.lastTime + 1;
+    }
+    return visited;
+}
+
+bool ColumnStore::getRange(uint8_t deviceId, Column column, uint32_t& first, uint32_t& last) const {
+    if (!devices || static_cast<uint8_t>(column) >= COLUMN_COUNT) {
+        return false;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const DeviceColumns* device = find(deviceId);
+    bool any = device && holdsSamples(device->columns[static_cast<uint8_t>(column)]);
+    if (any) {
+        const ColumnFile& file = device->columns[static_cast<uint8_t>(column)];
+        first = file.oldBlocks ? file.old[0].firstTime :
+                (file.liveBlocks ? file.live[0].firstTime : file.head.firstTime);
+        last = file.head.count ? file.head.lastTime :
+               (file.liveBlocks ? file.live[file.liveBlocks - 1].lastTime : file.old[file.oldBlocks - 1].lastTime);
+    }
+    xSemaphoreGive(mutex);
+    return any;
+}
+
+uint8_t ColumnStore::getDevices(uint8_t* ids, uint8_t maxIds) const {
+    if (!devices) {
+        return 0;
+    }
+
+    uint8_t count = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (uint8_t d = 0; d < COLUMN_MAX_DEVICES && count < maxIds; d++) {
+        if (devices[d].active) {
+            ids[count++] = devices[d].deviceId;
+        }
+    }
+    xSemaphoreGive(mutex);
+    return count;
+}
+
+void ColumnStore::columnPath(char* out, uint8_t deviceId, Column column, const char* extension) {
+    snprintf(out, COLUMN_PATH_MAX, FLASH_STORAGE_PATH "/dev%u/%s%s", deviceId, columnName(column), extension);
+}
+
+void ColumnStore::printStatus() const {
+    Serial.println("=== Column Store ===");
+    if (!devices) {
+        Serial.println("Not running");
+        return;
+    }
+
+    uint8_t ids[COLUMN_MAX_DEVICES];
+    uint8_t count = getDevices(ids, COLUMN_MAX_DEVICES);
+    Serial.printf("Balloons: %u, store clock %lu s\n", count, (unsigned long)now());
+    Serial.printf("Samples: %lu stored, %lu same-second drops, %lu packets missed\n",
+                  (unsigned long)samplesStored, (unsigned long)sameSecondDrops, (unsigned long)packetsMissed);
+    Serial.printf("Blocks written: %lu, write errors %lu, read errors %lu\n",
+                  (unsigned long)blocksWritten, (unsigned long)writeErrors, (unsigned long)readErrors);
+    Serial.printf("LittleFS: %lu of %lu KB used\n", (unsigned long)(LittleFS.usedBytes() / 1024),
+                  (unsigned long)(LittleFS.totalBytes() / 1024));
+}
@@ -0,0 +1,188 @@
+#ifndef BASE_STATION_COLUMNS_H
+#define BASE_STATION_COLUMNS_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "timeseries.h"
+#include "packet_store.h"
+
+// ===========================
+// Column Store (base station)
+// Received telemetry on LittleFS, a file per field per balloon, so a graph
+// or export reads only the fields and time range it asks for
+// ===========================
+
+// Each column is a run of TimeSeriesBlocks - the block format the balloon's
+// in-memory series use, delta-of-delta times and quantized value deltas -
+// appended whole to FLASH_STORAGE_PATH/dev<N>/<column>.col as they fill.
+// The block being filled lives in RAM and is written to <column>.hd every
+// COLUMN_FLUSH_INTERVAL_MS, so a reset loses at most that much.
+//
+// Block headers carry their first and last time, and begin() reads them
+// into an in-RAM index per file; a query binary-searches it and reads only
+// the blocks that overlap its range, a 512-byte read each.
+//
+// Times are store-clock seconds: seconds since boot, offset past the
+// newest sample already on flash, so they keep increasing across base
+// station resets. The balloon's own clock restarts with the balloon and
+// can't key a column. A column holds one sample per second; a second value
+// in the same second (link quality, mostly) is dropped.
+//
+// Once a .col file holds MAX_FLASH_PACKETS samples, or COLUMN_FILE_BLOCKS
+// blocks, it becomes <column>.old and a new one starts: every column keeps
+// at least its last MAX_FLASH_PACKETS samples, and at most twice that.
+//
+// update() runs from loop(): it reads new packets out of the packet store
+// by index, never on the RX task. Queries run on any task, taking the
+// store's mutex for one block at a time and decoding outside it.
+
+#define COLUMN_FILE_BLOCKS         24      // Index entries per file - MAX_FLASH_PACKETS at the worst-case 55 samples a block
+#define COLUMN_FLUSH_INTERVAL_MS   30000   // Head blocks to flash
+#define COLUMN_MAX_DEVICES         RX_MAX_DEVICES
+#define COLUMN_PATH_MAX            64
+
+enum class Column : uint8_t {
+    // Telemetry
+    TEMPERATURE = 0,
+    PRESSURE,
+    HUMIDITY,
+    BATTERY_VOLTAGE,
+    BATTERY_CURRENT,
+    BATTERY_PERCENT,
+    CPU_TEMPERATURE,
+    // GPS
+    LATITUDE,
+    LONGITUDE,
+    ALTITUDE,
+    SPEED,
+    COURSE,
+    SATELLITES,
+    HDOP,
+    // Link, from every packet
+    RSSI,
+    SNR,
+    COUNT
+};
+
+#define COLUMN_COUNT static_cast<uint8_t>(Column::COUNT)
+
+// File name and JSON key; the quantization step, in the field's units
+const char* columnName(Column column);
+float columnResolution(Column column);
+
+// Decimal places that show one resolution step
+uint8_t columnDecimals(Column column);
+
+// false for a name no column has
+bool columnFromName(const char* name, Column& column);
+
+// The columns one packet carries and their values, link quality first;
+// how many, at most COLUMN_COUNT
+uint8_t columnSamples(const StoredPacket& packet, Column* columns, float* values);
+
+// Each sample as it is stored, on the loop task with the store's mutex held
+typedef void (*ColumnSampleHook)(uint8_t deviceId, Column column, uint32_t time, float value);
+
+struct ColumnSpan {
+    uint32_t firstTime;
+    uint32_t lastTime;
+    uint16_t count;
+};
+
+struct ColumnFile {
+    TimeSeriesBlock head;       // Being filled; count 0 when empty
+    TimeSeriesCursor cursor;
+    bool dirty;                 // Changed since the last .hd write
+    uint16_t liveBlocks;
+    uint16_t oldBlocks;
+    uint32_t liveSamples;       // In the .col file, head not included
+    ColumnSpan live[COLUMN_FILE_BLOCKS];
+    ColumnSpan old[COLUMN_FILE_BLOCKS];
+};
+
+struct DeviceColumns {
+    bool active;
+    uint8_t deviceId;
+    ColumnFile columns[COLUMN_COUNT];
+};
+
+class ColumnStore {
+public:
+    ColumnStore();
+    ~ColumnStore();
+
+    // Mounts LittleFS and indexes every balloon already on it - after
+    // Packets().begin()
+    bool begin();
+    void end();
+    bool isReady() const { return devices != nullptr; }
+
+    // From loop(): stores the packets that arrived since the last call and
+    // writes the head blocks every COLUMN_FLUSH_INTERVAL_MS
+    void update();
+
+    // Every head block to flash now
+    bool flush();
+
+    // One hook; before begin()
+    void setSampleHook(ColumnSampleHook hook) { sampleHook = hook; }
+
+    // Samples of one column with from <= time <= to, oldest first; the
+    // number visited. Any task
+    size_t visit(uint8_t deviceId, Column column, uint32_t from, uint32_t to,
+                 TimeSeriesVisitor visitor, void* context) const;
+
+    // Oldest and newest sample held; false when the column is empty
+    bool getRange(uint8_t deviceId, Column column, uint32_t& first, uint32_t& last) const;
+
+    // Store clock for a millis() value, and now
+    uint32_t toStoreTime(uint32_t ms) const { return clockBase + ms / 1000; }
+    uint32_t now() const { return toStoreTime(millis()); }
+
+    // Device IDs with columns into ids; how many
+    uint8_t getDevices(uint8_t* ids, uint8_t maxIds) const;
+
+    // Statistics
+    uint32_t getSamplesStored() const { return samplesStored; }
+    uint32_t getSameSecondDrops() const { return sameSecondDrops; }
+    uint32_t getPacketsMissed() const { return packetsMissed; }
+    uint32_t getBlocksWritten() const { return blocksWritten; }
+    uint32_t getWriteErrors() const { return writeErrors; }
+    void printStatus() const;
+
+private:
+    DeviceColumns* devices;     // COLUMN_MAX_DEVICES of them, by session slot
+    SemaphoreHandle_t mutex;    // File handles, heads and indexes
+    uint32_t clockBase;         // Store clock at boot
+    uint32_t nextIndex;         // Packet store index update() reads next
+    uint32_t lastFlush;
+    ColumnSampleHook sampleHook;
+
+    uint32_t samplesStored;
+    uint32_t sameSecondDrops;
+    uint32_t packetsMissed;     // Overwritten in the packet store before update() got to them
+    uint32_t blocksWritten;
+    volatile uint32_t writeErrors;
+    mutable volatile uint32_t readErrors;
+
+    DeviceColumns* find(uint8_t deviceId) const;
+    DeviceColumns* open(uint8_t deviceId);
+    void loadColumn(uint8_t deviceId, Column column, ColumnFile& file);
+    static uint16_t loadIndex(const char* path, ColumnSpan* spans, uint32_t from, bool& whole);
+
+    void store(const StoredPacket& packet);
+    void record(DeviceColumns& device, Column column, uint32_t time, float value);
+    void seal(uint8_t deviceId, Column column, ColumnFile& file);
+    void rotate(uint8_t deviceId, Column column, ColumnFile& file);
+    bool writeHead(uint8_t deviceId, Column column, ColumnFile& file);
+    bool readBlock(uint8_t deviceId, Column column, const char* extension, uint16_t block,
+                   TimeSeriesBlock& out) const;
+
+    static void columnPath(char* out, uint8_t deviceId, Column column, const char* extension);
+};
+
+ColumnStore& Columns();
+
+#endif // BASE_STATION_COLUMNS_H
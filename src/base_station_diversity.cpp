@@ -0,0 +1,354 @@
+#include "base_station_config.h"
+#include "base_station_diversity.h"
+#include <WiFi.h>
+#include "time_service.h"
+#include "lwip/sockets.h"
+
+static_assert(DIVERSITY_DEDUP_MS < ACK_TIMEOUT_MS_VAL, "A retransmission must not be taken for a late copy");
+static_assert(DIVERSITY_STATION_ID > 0 && DIVERSITY_STATION_ID < DIVERSITY_MAX_STATIONS,
+              "Station 0 is the primary's own radio");
+
+static DiversityLink diversityInstance;
+
+DiversityLink& Diversity() {
+    return diversityInstance;
+}
+
+static const char* const roleNames[] = {"off", "primary", "secondary"};
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+DiversityLink::DiversityLink() {
+    role = DIVERSITY_OFF;
+    socketFd = -1;
+    linked = false;
+    memset(slots, 0, sizeof(slots));
+    memset(recent, 0, sizeof(recent));
+    recentNext = 0;
+    memset(stations, 0, sizeof(stations));
+    framesCombined = 0;
+    lateCopies = 0;
+    forwarded = 0;
+    forwardFailures = 0;
+    badDatagrams = 0;
+}
+
+DiversityLink::~DiversityLink() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool DiversityLink::begin() {
+    if (DIVERSITY_ROLE == DIVERSITY_OFF) {
+        return true;
+    }
+    if (socketFd >= 0) {
+        return true;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (fd < 0) {
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    if (DIVERSITY_ROLE == DIVERSITY_PRIMARY) {
+        struct sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_port = htons(DIVERSITY_UDP_PORT);
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(fd, (struct sockaddr*)&local, sizeof(local)) < 0) {
+            ::close(fd);
+            return false;
+        }
+    }
+
+    role = DIVERSITY_ROLE;
+    socketFd = fd;
+    LoRaComm().setRxFrameFilter(onRadioFrame, this);
+    return true;
+}
+
+void DiversityLink::end() {
+    if (socketFd < 0) {
+        return;
+    }
+    LoRaComm().setRxFrameFilter(nullptr, nullptr);
+    ::close(socketFd);
+    socketFd = -1;
+    linked = false;
+}
+
+// ===========================
+// Both Roles
+// ===========================
+
+bool DiversityLink::onRadioFrame(void* context, const RadioEvent& event) {
+    DiversityLink* link = static_cast<DiversityLink*>(context);
+    if (link->role == DIVERSITY_SECONDARY) {
+        // Off the primary's network the frame is ours to handle
+        return link->linked && link->forward(event);
+    }
+    return link->offer(event, DIVERSITY_LOCAL_STATION);
+}
+
+void DiversityLink::service() {
+    if (role != DIVERSITY_PRIMARY || socketFd < 0) {
+        return;
+    }
+    receiveDatagrams();
+    closeDue(false);
+}
+
+void DiversityLink::update() {
+    if (role == DIVERSITY_SECONDARY) {
+        linked = WiFi.status() == WL_CONNECTED;
+    }
+}
+
+// ===========================
+// Secondary
+// ===========================
+
+bool DiversityLink::forward(const RadioEvent& event) {
+    if (event.length > MAX_PACKET_SIZE) {
+        return false;
+    }
+
+    int64_t age = TimeService::nowUs() - event.timeUs;
+    uint32_t ageUs = age > 0 ? (uint32_t)min(age, (int64_t)UINT32_MAX) : 0;
+    datagram[0] = DIVERSITY_MAGIC_0;
+    datagram[1] = DIVERSITY_MAGIC_1;
+    datagram[2] = DIVERSITY_VERSION;
+    datagram[3] = DIVERSITY_STATION_ID;
+    datagram[4] = static_cast<uint8_t>(event.rssi);
+    datagram[5] = static_cast<uint8_t>(event.snr);
+    datagram[6] = event.channel;
+    datagram[7] = static_cast<uint8_t>(event.length);
+    datagram[8] = (ageUs >> 24) & 0xFF;
+    datagram[9] = (ageUs >> 16) & 0xFF;
+    datagram[10] = (ageUs >> 8) & 0xFF;
+    datagram[11] = ageUs & 0xFF;
+    memcpy(&datagram[DIVERSITY_HEADER_BYTES], event.data, event.length);
+
+    struct sockaddr_in primary = {};
+    primary.sin_family = AF_INET;
+    primary.sin_port = htons(DIVERSITY_UDP_PORT);
+    primary.sin_addr.s_addr = inet_addr(DIVERSITY_PRIMARY_IP);
+
+    // Never waits - a frame the stack won't take is handled here instead
+    if (sendto(socketFd, datagram, DIVERSITY_HEADER_BYTES + event.length, 0, (struct sockaddr*)&primary,
+               sizeof(primary)) < 0) {
+        forwardFailures++;
+        return false;
+    }
+    forwarded++;
+    stations[DIVERSITY_STATION_ID].copies++;
+    stations[DIVERSITY_STATION_ID].lastHeard = millis();
+    return true;
+}
+
+// ===========================
+// Primary
+// ===========================
+
+void DiversityLink::receiveDatagrams() {
+    static RadioEvent event;    // RX task only
+    for (int i = 0; i < DIVERSITY_COMBINE_SLOTS; i++) {
+        int length = recvfrom(socketFd, datagram, sizeof(datagram), MSG_DONTWAIT, nullptr, nullptr);
+        if (length <= 0) {
+            return;
+        }
+
+        uint8_t station = datagram[3];
+        if (length < DIVERSITY_HEADER_BYTES || datagram[0] != DIVERSITY_MAGIC_0 ||
+            datagram[1] != DIVERSITY_MAGIC_1 || datagram[2] != DIVERSITY_VERSION ||
+            station == DIVERSITY_LOCAL_STATION || station >= DIVERSITY_MAX_STATIONS ||
+            datagram[7] != length - DIVERSITY_HEADER_BYTES) {
+            badDatagrams++;
+            continue;
+        }
+
+        uint32_t ageUs = ((uint32_t)datagram[8] << 24) | ((uint32_t)datagram[9] << 16) |
+                         ((uint32_t)datagram[10] << 8) | datagram[11];
+        memset(&event, 0, offsetof(RadioEvent, data));
+        event.type = RadioEventType::RX_DONE;
+        event.timeUs = TimeService::nowUs() - ageUs;
+        event.timestamp = millis() - ageUs / 1000;
+        event.rssi = static_cast<int8_t>(datagram[4]);
+        event.snr = static_cast<int8_t>(datagram[5]);
+        event.channel = datagram[6];
+        event.length = datagram[7];
+        memcpy(event.data, &datagram[DIVERSITY_HEADER_BYTES], event.length);
+        offer(event, station);
+    }
+}
+
+bool DiversityLink::offer(const RadioEvent& event, uint8_t station) {
+    DiversityStationStats& stats = stations[station];
+    DiversityKey key;
+    if (!keyOf(event, key)) {
+        stats.crcErrors++;
+        return station != DIVERSITY_LOCAL_STATION;  // Our own still counts as an error downstream
+    }
+
+    uint32_t now = millis();
+    stats.copies++;
+    stats.lastHeard = now;
+
+    for (DiversitySlot& slot : slots) {
+        if (!slot.open || !sameKey(slot.key, key)) {
+            continue;
+        }
+        slot.stations |= 1 << station;
+        if (better(event, slot.event)) {
+            slot.event = event;
+            slot.bestStation = station;
+        }
+        if (event.timeUs < slot.earliestUs) {
+            slot.earliestUs = event.timeUs;
+            slot.earliestMs = event.timestamp;
+        }
+        return true;
+    }
+
+    if (recentlyClosed(key, now)) {
+        lateCopies++;
+        return true;
+    }
+
+    // Full - the slot closest to closing goes now
+    DiversitySlot* slot = nullptr;
+    for (DiversitySlot& candidate : slots) {
+        if (!candidate.open) {
+            slot = &candidate;
+            break;
+        }
+        if (!slot || (int32_t)(candidate.closesAt - slot->closesAt) < 0) {
+            slot = &candidate;
+        }
+    }
+    if (slot->open) {
+        close(*slot);
+    }
+
+    slot->open = true;
+    slot->key = key;
+    slot->closesAt = now + DIVERSITY_COMBINE_MS;
+    slot->stations = 1 << station;
+    slot->bestStation = station;
+    slot->earliestUs = event.timeUs;
+    slot->earliestMs = event.timestamp;
+    slot->event = event;
+    return true;
+}
+
+void DiversityLink::close(DiversitySlot& slot) {
+    slot.open = false;
+    stations[slot.bestStation].chosen++;
+    if ((slot.stations & (slot.stations - 1)) == 0) {
+        stations[slot.bestStation].sole++;
+    } else {
+        framesCombined++;
+    }
+
+    recent[recentNext].key = slot.key;
+    recent[recentNext].closedAt = millis();
+    recentNext = (recentNext + 1) % DIVERSITY_RECENT_KEYS;
+
+    // The best copy's signal, the first station's timing
+    slot.event.timeUs = slot.earliestUs;
+    slot.event.timestamp = slot.earliestMs;
+    LoRaComm().receiveFrame(slot.event);
+}
+
+void DiversityLink::closeDue(bool all) {
+    // In the order they opened, so the link layer sees frames as sent
+    uint32_t now = millis();
+    while (true) {
+        DiversitySlot* next = nullptr;
+        for (DiversitySlot& slot : slots) {
+            if (!slot.open || (!all && (int32_t)(now - slot.closesAt) < 0)) {
+                continue;
+            }
+            if (!next || (int32_t)(slot.closesAt - next->closesAt) < 0) {
+                next = &slot;
+            }
+        }
+        if (!next) {
+            return;
+        }
+        close(*next);
+    }
+}
+
+bool DiversityLink::recentlyClosed(const DiversityKey& key, uint32_t now) const {
+    for (const DiversityRecent& entry : recent) {
+        if (entry.closedAt && now - entry.closedAt < DIVERSITY_DEDUP_MS && sameKey(entry.key, key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ===========================
+// Frames
+// ===========================
+
+bool DiversityLink::keyOf(const RadioEvent& event, DiversityKey& key) {
+    Packet packet;
+    if (event.length < 2 || !deserializePacket(event.data, event.length, packet) ||
+        !verifyFrameCRC(event.data, event.length)) {
+        return false;
+    }
+    key.deviceId = packet.header.deviceId;
+    key.sequenceNumber = packet.sequenceNumber;
+    key.crc = (event.data[event.length - 2] << 8) | event.data[event.length - 1];
+    return true;
+}
+
+bool DiversityLink::sameKey(const DiversityKey& a, const DiversityKey& b) {
+    return a.deviceId == b.deviceId && a.sequenceNumber == b.sequenceNumber && a.crc == b.crc;
+}
+
+bool DiversityLink::better(const RadioEvent& candidate, const RadioEvent& best) {
+    // FSK reports no SNR, so there it is the RSSI alone
+    if (candidate.snr != best.snr) {
+        return candidate.snr > best.snr;
+    }
+    return candidate.rssi > best.rssi;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void DiversityLink::printStatus() const {
+    if (socketFd < 0) {
+        return;
+    }
+    Serial.printf("Diversity: %s, %lu frames combined, %lu late copies dropped", roleNames[role],
+                  framesCombined, lateCopies);
+    if (role == DIVERSITY_SECONDARY) {
+        Serial.printf(", %s, %lu forwarded, %lu send failures", linked ? "linked" : "not linked", forwarded,
+                      forwardFailures);
+    } else {
+        Serial.printf(", %lu bad datagrams", badDatagrams);
+    }
+    Serial.println();
+
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < DIVERSITY_MAX_STATIONS; i++) {
+        const DiversityStationStats& stats = stations[i];
+        if (!stats.lastHeard) {
+            continue;
+        }
+        Serial.printf("  Station %u: %lu copies, %lu best, %lu only here, %lu CRC errors, heard %lu s ago\n", i,
+                      stats.copies, stats.chosen, stats.sole, stats.crcErrors, (now - stats.lastHeard) / 1000);
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef BASE_STATION_DIVERSITY_H
+#define BASE_STATION_DIVERSITY_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "lora_comm.h"
+
+// ===========================
+// Receive Diversity (base station)
+// Stations spread along the track forward what they hear to one primary,
+// which keeps the best copy of each frame and is the only one to ACK
+// ===========================
+
+// A secondary takes each frame off its radio ahead of its link layer and
+// sends it, with its RSSI, SNR and channel, to the primary as one UDP
+// datagram. Its own link layer never sees the frame, so it never ACKs,
+// and never moves a fragment transfer or hop key. While it is not joined
+// to the primary's network it handles frames itself, as a station on its
+// own would.
+//
+// The primary treats its own radio as station 0. The first good copy of a
+// frame opens a combine slot for DIVERSITY_COMBINE_MS. Copies are matched
+// on (deviceId, sequenceNumber) and the frame CRC; the CRC keeps apart the
+// balloon's ACKs, which all carry sequence 0, and a retransmission with a
+// new latency stamp. The slot keeps the copy with the best SNR (RSSI in
+// FSK). It then goes into LoRaComm() through receiveFrame(), with the
+// earliest RX time any station gave. Frames that fail the CRC are not
+// combined: the primary's own go straight to the link layer to be counted,
+// and a secondary's are dropped. A copy arriving after its slot has closed
+// is dropped for DIVERSITY_DEDUP_MS. That is shorter than the ACK timeout,
+// so a genuine retransmission still gets through.
+//
+// Datagram: [magic 2 'C' 'D'][version][station][rssi][snr][channel][length]
+// [age us 4, big endian][frame]. age is the frame's time at the secondary
+// between its RX done and the send, so the primary places the RX done at
+// its own clock less that age, give or take the Wi-Fi hop.
+//
+// The filter and service() both run on the RX task; update() on loop()
+// only watches the secondary's Wi-Fi association.
+//
+// With LoRa hopping on, a secondary's hop key never moves - it finds the
+// balloon's channel again through its dwell search.
+
+#define DIVERSITY_MAX_STATIONS     4
+#define DIVERSITY_COMBINE_SLOTS    8
+#define DIVERSITY_RECENT_KEYS      32
+#define DIVERSITY_MAGIC_0          'C'
+#define DIVERSITY_MAGIC_1          'D'
+#define DIVERSITY_VERSION          1
+#define DIVERSITY_HEADER_BYTES     12
+#define DIVERSITY_LOCAL_STATION    0
+
+struct DiversityKey {
+    uint8_t deviceId;
+    uint16_t sequenceNumber;
+    uint16_t crc;               // The frame's own
+};
+
+struct DiversitySlot {
+    bool open;
+    DiversityKey key;
+    uint32_t closesAt;          // millis()
+    uint8_t stations;           // Bit per station that delivered a copy
+    uint8_t bestStation;
+    int64_t earliestUs;
+    uint32_t earliestMs;
+    RadioEvent event;           // The best copy so far
+};
+
+struct DiversityRecent {
+    DiversityKey key;
+    uint32_t closedAt;
+};
+
+struct DiversityStationStats {
+    uint32_t copies;            // Good frames it delivered
+    uint32_t chosen;            // Copies that were the best of their frame
+    uint32_t sole;              // Frames no other station had
+    uint32_t crcErrors;
+    uint32_t lastHeard;         // millis(), 0 never
+};
+
+class DiversityLink {
+public:
+    DiversityLink();
+    ~DiversityLink();
+
+    // After the Wi-Fi is up; nothing is done at DIVERSITY_OFF
+    bool begin();
+    void end();
+    bool isActive() const { return socketFd >= 0; }
+    uint8_t getRole() const { return role; }
+
+    // RX task, ahead of LoRaComm().processQueue(): datagrams in, closed
+    // slots out to the link layer
+    void service();
+
+    // Loop task
+    void update();
+
+    const DiversityStationStats& getStationStats(uint8_t station) const { return stations[station]; }
+    void printStatus() const;
+
+private:
+    uint8_t role;
+    int socketFd;
+    volatile bool linked;       // Secondary: joined to the primary's network
+    uint8_t datagram[DIVERSITY_HEADER_BYTES + MAX_PACKET_SIZE];
+
+    DiversitySlot slots[DIVERSITY_COMBINE_SLOTS];
+    DiversityRecent recent[DIVERSITY_RECENT_KEYS];
+    uint8_t recentNext;
+
+    DiversityStationStats stations[DIVERSITY_MAX_STATIONS];
+    uint32_t framesCombined;
+    uint32_t lateCopies;
+    uint32_t forwarded;
+    uint32_t forwardFailures;
+    uint32_t badDatagrams;
+
+    static bool onRadioFrame(void* context, const RadioEvent& event);
+
+    bool forward(const RadioEvent& event);
+    void receiveDatagrams();
+    bool offer(const RadioEvent& event, uint8_t station);
+    void close(DiversitySlot& slot);
+    void closeDue(bool all);
+    bool recentlyClosed(const DiversityKey& key, uint32_t now) const;
+
+    static bool keyOf(const RadioEvent& event, DiversityKey& key);
+    static bool sameKey(const DiversityKey& a, const DiversityKey& b);
+    static bool better(const RadioEvent& candidate, const RadioEvent& best);
+};
+
+DiversityLink& Diversity();
+
+#endif // BASE_STATION_DIVERSITY_H
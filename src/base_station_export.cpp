@@ -0,0 +1,396 @@
+#include "base_station_config.h"
+#include "base_station_export.h"
+#include <esp_heap_caps.h>
+#include "esp_rom_crc.h"
+#include "rom/miniz.h"
+#include "memory_ledger.h"
+
+// ===========================
+// Formats
+// ===========================
+
+const char* exportFormatName(ExportFormat format) {
+    switch (format) {
+        case ExportFormat::CSV: return "csv";
+        case ExportFormat::JSON: return "json";
+        case ExportFormat::KML: return "kml";
+        default: return "unknown";
+    }
+}
+
+const char* exportContentType(ExportFormat format) {
+    switch (format) {
+        case ExportFormat::CSV: return "text/csv";
+        case ExportFormat::JSON: return "application/json";
+        case ExportFormat::KML: return "application/vnd.google-earth.kml+xml";
+        default: return "application/octet-stream";
+    }
+}
+
+bool exportFormatFromName(const char* name, ExportFormat& format) {
+    if (EXPORT_FORMATS_CSV && strcmp(name, "csv") == 0) {
+        format = ExportFormat::CSV;
+    } else if (EXPORT_FORMATS_JSON && strcmp(name, "json") == 0) {
+        format = ExportFormat::JSON;
+    } else if (EXPORT_FORMATS_KML && strcmp(name, "kml") == 0) {
+        format = ExportFormat::KML;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// ===========================
+// Export Stream
+// ===========================
+
+ExportStream::ExportStream() {
+    format = ExportFormat::CSV;
+    stage = Stage::DONE;
+    deviceId = 0;
+    from = 0;
+    to = 0;
+    columnCount = 0;
+    samples = nullptr;
+    cursor = 0;
+    windowEnd = 0;
+    lastWindow = true;
+    rows = 0;
+}
+
+ExportStream::~ExportStream() {
+    end();
+}
+
+bool ExportStream::begin(ExportFormat format, uint8_t deviceId, uint32_t from, uint32_t to,
+                         const Column* columns, uint8_t columnCount) {
+    static const Column track[] = {Column::LATITUDE, Column::LONGITUDE, Column::ALTITUDE};
+
+    end();
+    if (format == ExportFormat::KML) {
+        columns = track;
+        columnCount = sizeof(track) / sizeof(track[0]);
+    }
+    if (!columns || columnCount == 0 || columnCount > COLUMN_COUNT || from > to) {
+        return false;
+    }
+
+    // 16 KB with every column - memAlloc() puts it in PSRAM
+    samples = (TimeSeriesSample*)memAlloc(MemTag::EXPORT, (size_t)columnCount * EXPORT_WINDOW * sizeof(TimeSeriesSample));
+    if (!samples) {
+        return false;
+    }
+
+    this->format = format;
+    this->deviceId = deviceId;
+    this->from = from;
+    this->to = to;
+    this->columnCount = columnCount;
+    for (uint8_t c = 0; c < columnCount; c++) {
+        this->columns[c] = columns[c];
+        decimals[c] = columnDecimals(columns[c]);
+    }
+
+    stage = Stage::HEADER;
+    rows = 0;
+    cursor = from;
+    nextWindow();
+    return true;
+}
+
+void ExportStream::end() {
+    if (samples) {
+        memFree(MemTag::EXPORT, samples);
+        samples = nullptr;
+    }
+    stage = Stage::DONE;
+}
+
+struct WindowFill {
+    TimeSeriesSample* out;
+    uint8_t count;
+};
+
+static bool collectWindow(const TimeSeriesSample& sample, void* context) {
+    WindowFill* fill = static_cast<WindowFill*>(context);
+    fill->out[fill->count++] = sample;
+    return fill->count < EXPORT_WINDOW;
+}
+
+// The next EXPORT_WINDOW samples of every column from cursor. A column
+// that fills its window ends the rows that are complete in this one
+void ExportStream::nextWindow() {
+    windowEnd = to;
+    lastWindow = true;
+
+    for (uint8_t c = 0; c < columnCount; c++) {
+        WindowFill fill = {&samples[c * EXPORT_WINDOW], 0};
+        Columns().visit(deviceId, columns[c], cursor, to, collectWindow, &fill);
+        filled[c] = fill.count;
+        position[c] = 0;
+
+        uint32_t last = fill.count ? fill.out[fill.count - 1].time : 0;
+        if (fill.count == EXPORT_WINDOW && last < windowEnd) {
+            windowEnd = last;
+            lastWindow = false;
+        }
+    }
+}
+
+// The earliest time any column has next, and every column's value at it
+bool ExportStream::nextRow(uint32_t& time, float* values, bool* present) {
+    while (true) {
+        bool found = false;
+        for (uint8_t c = 0; c < columnCount; c++) {
+            if (position[c] < filled[c]) {
+                uint32_t t = samples[c * EXPORT_WINDOW + position[c]].time;
+                if (t <= windowEnd && (!found || t < time)) {
+                    time = t;
+                    found = true;
+                }
+            }
+        }
+        if (found) {
+            break;
+        }
+        if (lastWindow) {
+            return false;
+        }
+        cursor = windowEnd + 1;
+        nextWindow();
+    }
+
+    for (uint8_t c = 0; c < columnCount; c++) {
+        const TimeSeriesSample* sample = &samples[c * EXPORT_WINDOW + position[c]];
+        present[c] = position[c] < filled[c] && sample->time == time;
+        if (present[c]) {
+            values[c] = sample->value;
+            position[c]++;
+        }
+    }
+    return true;
+}
+
+size_t ExportStream::read(char* out, size_t space) {
+    size_t used = 0;
+    float values[COLUMN_COUNT];
+    bool present[COLUMN_COUNT];
+    uint32_t time;
+
+    if (stage == Stage::HEADER && space >= EXPORT_ROW_MAX) {
+        used += writeHeader(out, space);
+        stage = Stage::ROWS;
+    }
+    while (stage == Stage::ROWS && space - used >= EXPORT_ROW_MAX) {
+        if (!nextRow(time, values, present)) {
+            stage = Stage::FOOTER;
+            break;
+        }
+        used += writeRow(out + used, space - used, time, values, present);
+    }
+    if (stage == Stage::FOOTER && space - used >= EXPORT_ROW_MAX) {
+        used += writeFooter(out + used, space - used);
+        stage = Stage::DONE;
+        end();
+    }
+    return used;
+}
+
+size_t ExportStream::writeHeader(char* out, size_t space) const {
+    int used = 0;
+    switch (format) {
+        case ExportFormat::CSV:
+            used = snprintf(out, space, "time");
+            for (uint8_t c = 0; c < columnCount; c++) {
+                used += snprintf(out + used, space - used, ",%s", columnName(columns[c]));
+            }
+            used += snprintf(out + used, space - used, "\n");
+            break;
+
+        case ExportFormat::JSON:
+            used = snprintf(out, space, "{\"device\":%u,\"clock\":\"store_seconds\",\"columns\":[", deviceId);
+            for (uint8_t c = 0; c < columnCount; c++) {
+                used += snprintf(out + used, space - used, "%s\"%s\"", c ? "," : "", columnName(columns[c]));
+            }
+            used += snprintf(out + used, space - used, "],\"rows\":[\n");
+            break;
+
+        case ExportFormat::KML:
+            used = snprintf(out, space,
+                            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                            "<kml xmlns=\"http://www.opengis.net/kml/2.2\"><Document><name>Balloon %u</name>\n"
+                            "<Placemark><name>Flight track</name><LineString><altitudeMode>absolute</altitudeMode>\n"
+                            "<coordinates>\n", deviceId);
+            break;
+    }
+    return (size_t)used < space ? used : space - 1;
+}
+
+size_t ExportStream::writeRow(char* out, size_t space, uint32_t time, const float* values, const bool* present) {
+    int used = 0;
+    switch (format) {
+        case ExportFormat::CSV:
+            used = snprintf(out, space, "%lu", (unsigned long)time);
+            for (uint8_t c = 0; c < columnCount; c++) {
+                used += present[c] ? snprintf(out + used, space - used, ",%.*f", decimals[c], values[c])
+                                   : snprintf(out + used, space - used, ",");
+            }
+            used += snprintf(out + used, space - used, "\n");
+            break;
+
+        case ExportFormat::JSON:
+            used = snprintf(out, space, "%s{\"time\":%lu", rows ? ",\n" : "", (unsigned long)time);
+            for (uint8_t c = 0; c < columnCount; c++) {
+                if (present[c]) {
+                    used += snprintf(out + used, space - used, ",\"%s\":%.*f", columnName(columns[c]),
+                                     decimals[c], values[c]);
+                }
+            }
+            used += snprintf(out + used, space - used, "}");
+            break;
+
+        case ExportFormat::KML:
+            // A fix needs both coordinates; altitude is 0 if it didn't come
+            if (!present[0] || !present[1]) {
+                return 0;
+            }
+            used = snprintf(out, space, "%.*f,%.*f,%.*f\n", decimals[1], values[1], decimals[0], values[0],
+                            decimals[2], present[2] ? values[2] : 0.0f);
+            break;
+    }
+    rows++;
+    return (size_t)used < space ? used : space - 1;
+}
+
+size_t ExportStream::writeFooter(char* out, size_t space) const {
+    int used = 0;
+    switch (format) {
+        case ExportFormat::CSV:
+            break;
+        case ExportFormat::JSON:
+            used = snprintf(out, space, "\n],\"count\":%lu}\n", (unsigned long)rows);
+            break;
+        case ExportFormat::KML:
+            used = snprintf(out, space, "</coordinates></LineString></Placemark></Document></kml>\n");
+            break;
+    }
+    return (size_t)used < space ? used : space - 1;
+}
+
+// ===========================
+// Gzip Writer
+// ===========================
+
+// No name, no mtime, unknown OS (RFC 1952)
+static const uint8_t gzipHeader[10] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF};
+
+GzipWriter::GzipWriter() {
+    compressor = nullptr;
+    out = nullptr;
+    outUsed = 0;
+    crc = 0;
+    bytesIn = 0;
+    bytesOut = 0;
+    sink = nullptr;
+    context = nullptr;
+}
+
+GzipWriter::~GzipWriter() {
+    end();
+}
+
+bool GzipWriter::begin(ExportSink sink, void* context) {
+    end();
+    if (!sink) {
+        return false;
+    }
+
+    compressor = memAllocCaps(MemTag::EXPORT, sizeof(tdefl_compressor), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    out = (uint8_t*)memAlloc(MemTag::EXPORT, EXPORT_CHUNK_SIZE);
+    if (!compressor || !out ||
+        tdefl_init((tdefl_compressor*)compressor, nullptr, nullptr,
+                   EXPORT_GZIP_PROBES | TDEFL_GREEDY_PARSING_FLAG) != TDEFL_STATUS_OKAY) {
+        end();
+        return false;
+    }
+
+    this->sink = sink;
+    this->context = context;
+    memcpy(out, gzipHeader, sizeof(gzipHeader));
+    outUsed = sizeof(gzipHeader);
+    crc = 0;
+    bytesIn = 0;
+    bytesOut = 0;
+    return true;
+}
+
+void GzipWriter::end() {
+    if (compressor) {
+        memFree(MemTag::EXPORT, compressor);
+        compressor = nullptr;
+    }
+    if (out) {
+        memFree(MemTag::EXPORT, out);
+        out = nullptr;
+    }
+}
+
+bool GzipWriter::write(const void* data, size_t length) {
+    if (!compressor) {
+        return false;
+    }
+    crc = esp_rom_crc32_le(crc, (const uint8_t*)data, length);
+    bytesIn += length;
+    return compress((const uint8_t*)data, length, false);
+}
+
+bool GzipWriter::finish() {
+    if (!compressor || !compress(nullptr, 0, true)) {
+        return false;
+    }
+    if (outUsed + 8 > EXPORT_CHUNK_SIZE && !emit()) {
+        return false;
+    }
+
+    // CRC-32 and length of the uncompressed data, little-endian
+    for (int i = 0; i < 4; i++) {
+        out[outUsed++] = (uint8_t)(crc >> (8 * i));
+    }
+    for (int i = 0; i < 4; i++) {
+        out[outUsed++] = (uint8_t)(bytesIn >> (8 * i));
+    }
+    return emit();
+}
+
+// Until the input is taken - or, for the last call, the stream is complete
+bool GzipWriter::compress(const uint8_t* data, size_t length, bool last) {
+    tdefl_compressor* deflater = (tdefl_compressor*)compressor;
+    while (true) {
+        size_t inSize = length;
+        size_t outSize = EXPORT_CHUNK_SIZE - outUsed;
+        tdefl_status status = tdefl_compress(deflater, data, &inSize, out + outUsed, &outSize,
+                                             last ? TDEFL_FINISH : TDEFL_NO_FLUSH);
+        data += inSize;
+        length -= inSize;
+        outUsed += outSize;
+        if (status < TDEFL_STATUS_OKAY) {
+            return false;
+        }
+        if (outUsed == EXPORT_CHUNK_SIZE && !emit()) {
+            return false;
+        }
+        if (last ? status == TDEFL_STATUS_DONE : length == 0) {
+            return true;
+        }
+    }
+}
+
+bool GzipWriter::emit() {
+    if (outUsed == 0) {
+        return true;
+    }
+    bool sent = sink(out, outUsed, context);
+    bytesOut += outUsed;
+    outUsed = 0;
+    return sent;
+}
@@ -0,0 +1,130 @@
+#ifndef BASE_STATION_EXPORT_H
+#define BASE_STATION_EXPORT_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "base_station_columns.h"
+
+// ===========================
+// Export Streams (base station)
+// CSV, JSON and KML generated from the column store a chunk at a time,
+// gzip-compressed on the way out when the client takes it
+// ===========================
+
+// ExportStream is pulled: each read() writes the next few rows into the
+// caller's buffer and returns, so the web handler sends an export of any
+// length through one chunk buffer. Rows are joined across columns by time,
+// a window at a time - every column decodes its next EXPORT_WINDOW samples,
+// rows are written up to the earliest of the windows' ends, and the rest is
+// decoded again with the next window. A row has the values of the columns
+// that have a sample at its second; CSV leaves the others empty and JSON
+// leaves them out. KML is the GPS track alone, a coordinate per fix.
+//
+// GzipWriter deflates with the ROM's miniz and frames it as gzip, so the
+// browser decompresses a download itself; its compressor state is ~320 KB,
+// held in PSRAM for the length of one export.
+//
+// Memory is the window (columns x EXPORT_WINDOW samples, PSRAM) and the
+// compressor, whatever the flight's length.
+
+#define EXPORT_WINDOW              128     // Samples per column per pass
+#define EXPORT_ROW_MAX             512     // Longest row of any format, every column present
+#define EXPORT_CHUNK_SIZE          2048    // Bytes per httpd chunk
+#define EXPORT_GZIP_PROBES         32      // Deflate match search depth - speed over ratio
+
+enum class ExportFormat : uint8_t {
+    CSV = 0,
+    JSON,
+    KML
+};
+
+const char* exportFormatName(ExportFormat format);
+const char* exportContentType(ExportFormat format);
+
+// false for an unknown format or one EXPORT_FORMATS_* turns off
+bool exportFormatFromName(const char* name, ExportFormat& format);
+
+class ExportStream {
+public:
+    ExportStream();
+    ~ExportStream();
+
+    // One balloon's columns, in the order given, with from <= time <= to.
+    // KML takes latitude, longitude and altitude whatever columns says
+    bool begin(ExportFormat format, uint8_t deviceId, uint32_t from, uint32_t to,
+               const Column* columns, uint8_t columnCount);
+    void end();
+
+    // The next rows into out, at least EXPORT_ROW_MAX of space; 0 once
+    // the export is complete
+    size_t read(char* out, size_t space);
+
+    // The next row joined across the columns, for a caller formatting its
+    // own rather than read()ing: false past the last
+    bool nextRow(uint32_t& time, float* values, bool* present);
+
+    uint32_t getRows() const { return rows; }
+
+private:
+    enum class Stage : uint8_t { HEADER, ROWS, FOOTER, DONE };
+
+    ExportFormat format;
+    Stage stage;
+    uint8_t deviceId;
+    uint32_t from;
+    uint32_t to;
+    Column columns[COLUMN_COUNT];
+    uint8_t decimals[COLUMN_COUNT];
+    uint8_t columnCount;
+
+    // The window: samples[c * EXPORT_WINDOW + i], filled[c] of them, the
+    // next unwritten at position[c]
+    TimeSeriesSample* samples;
+    uint8_t filled[COLUMN_COUNT];
+    uint8_t position[COLUMN_COUNT];
+    uint32_t cursor;            // First time the window was decoded from
+    uint32_t windowEnd;         // Rows up to here are complete in the window
+    bool lastWindow;
+    uint32_t rows;
+
+    void nextWindow();
+    size_t writeHeader(char* out, size_t space) const;
+    size_t writeRow(char* out, size_t space, uint32_t time, const float* values, const bool* present);
+    size_t writeFooter(char* out, size_t space) const;
+};
+
+// Takes the compressed bytes; false aborts
+typedef bool (*ExportSink)(const uint8_t* data, size_t length, void* context);
+
+class GzipWriter {
+public:
+    GzipWriter();
+    ~GzipWriter();
+
+    // Allocates the compressor; false without the memory for it
+    bool begin(ExportSink sink, void* context);
+    void end();
+
+    bool write(const void* data, size_t length);
+
+    // The rest of the stream and the gzip trailer
+    bool finish();
+
+    uint32_t getBytesIn() const { return bytesIn; }
+    uint32_t getBytesOut() const { return bytesOut; }
+
+private:
+    void* compressor;           // tdefl_compressor, PSRAM
+    uint8_t* out;               // EXPORT_CHUNK_SIZE
+    size_t outUsed;
+    uint32_t crc;
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    ExportSink sink;
+    void* context;
+
+    bool compress(const uint8_t* data, size_t length, bool last);
+    bool emit();
+};
+
+#endif // BASE_STATION_EXPORT_H
@@ -0,0 +1,410 @@
+#include "base_station_config.h"
+#include "base_station_fanout.h"
+#include "memory_ledger.h"
+#include "lwip/sockets.h"
+
+static WsFanout fanoutInstance;
+
+WsFanout& Fanout() {
+    return fanoutInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+WsFanout::WsFanout() {
+    server = nullptr;
+    mutex = nullptr;
+    memset(clients, 0, sizeof(clients));
+    for (FanoutClient& client : clients) {
+        client.fd = -1;
+    }
+    clientCount = 0;
+    flushQueued = false;
+    published = 0;
+    allocationFailures = 0;
+    closedBehind = 0;
+}
+
+WsFanout::~WsFanout() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool WsFanout::begin(httpd_handle_t handle) {
+    if (!mutex) {
+        mutex = xSemaphoreCreateMutex();
+        if (!mutex) {
+            return false;
+        }
+    }
+    messagePool.begin("fanout", MemTag::FANOUT, FANOUT_POOL_BLOCK_BYTES, FANOUT_POOL_BLOCKS,
+                      MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    server = handle;
+    return true;
+}
+
+void WsFanout::end() {
+    if (!mutex) {
+        return;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (FanoutClient& client : clients) {
+        if (client.fd >= 0) {
+            drop(client);
+        }
+    }
+    xSemaphoreGive(mutex);
+    vSemaphoreDelete(mutex);
+    mutex = nullptr;
+    server = nullptr;
+}
+
+// ===========================
+// Messages (mutex held, bar make)
+// ===========================
+
+FanoutMessage* WsFanout::make(uint16_t key, const char* text, size_t length) {
+    length = min(length, (size_t)UINT16_MAX);
+    FanoutMessage* message = (FanoutMessage*)messagePool.alloc(sizeof(FanoutMessage) + length);
+    if (!message) {
+        allocationFailures++;
+        return nullptr;
+    }
+    message->refs = 1;          // The publisher's, until it is queued
+    message->key = key;
+    message->length = length;
+    message->createdAt = millis();
+    memcpy(message->text, text, length);
+    return message;
+}
+
+void WsFanout::release(FanoutMessage* message) {
+    if (message && --message->refs == 0) {
+        messagePool.free(message);
+    }
+}
+
+void WsFanout::drop(FanoutClient& client) {
+    for (uint8_t i = 0; i < client.eventCount; i++) {
+        release(client.events[(client.eventHead + i) % FANOUT_EVENT_DEPTH]);
+    }
+    for (FanoutMessage* snapshot : client.snapshots) {
+        release(snapshot);
+    }
+    memset(&client, 0, sizeof(client));
+    client.fd = -1;
+    clientCount--;
+}
+
+// ===========================
+// Clients (httpd task)
+// ===========================
+
+void WsFanout::addClient(int fd) {
+    if (!mutex) {
+        return;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    FanoutClient* slot = nullptr;
+    for (FanoutClient& client : clients) {
+        if (client.fd == fd) {
+            drop(client);   // The socket was reused; what was queued was for the last owner
+        }
+        if (client.fd < 0 && !slot) {
+            slot = &client;
+        }
+    }
+    if (slot) {
+        slot->fd = fd;
+        slot->connectedAt = millis();
+        clientCount++;
+    }
+    xSemaphoreGive(mutex);
+}
+
+// ===========================
+// Publishing (loop task)
+// ===========================
+
+void WsFanout::publishEvent(const char* text, size_t length) {
+    if (!mutex || clientCount == 0) {
+        return;
+    }
+    FanoutMessage* message = make(0, text, length);
+    if (!message) {
+        return;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (FanoutClient& client : clients) {
+        if (client.fd < 0 || client.closing) {
+            continue;
+        }
+        if (client.eventCount == FANOUT_EVENT_DEPTH) {
+            client.closing = true;      // Dropping an event would lose it; the client resyncs instead
+            closedBehind++;
+            continue;
+        }
+        client.events[(client.eventHead + client.eventCount) % FANOUT_EVENT_DEPTH] = message;
+        client.eventCount++;
+        message->refs++;
+    }
+    release(message);
+    published++;
+    xSemaphoreGive(mutex);
+    queueFlush();
+}
+
+void WsFanout::publishSnapshot(uint16_t key, const char* text, size_t length) {
+    if (!mutex || clientCount == 0) {
+        return;
+    }
+    FanoutMessage* message = make(key, text, length);
+    if (!message) {
+        return;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (FanoutClient& client : clients) {
+        if (client.fd < 0 || client.closing) {
+            continue;
+        }
+        // The same key's slot, else a free one, else the oldest
+        int8_t slot = -1;
+        for (uint8_t s = 0; s < FANOUT_SNAPSHOT_SLOTS; s++) {
+            const FanoutMessage* pending = client.snapshots[s];
+            if (pending && pending->key == key) {
+                slot = s;
+                break;
+            }
+            if (slot < 0 || (client.snapshots[slot] && (!pending || pending->createdAt < client.snapshots[slot]->createdAt))) {
+                slot = s;
+            }
+        }
+        if (client.snapshots[slot]) {
+            release(client.snapshots[slot]);
+            client.coalesced++;
+        }
+        client.snapshots[slot] = message;
+        message->refs++;
+    }
+    release(message);
+    published++;
+    xSemaphoreGive(mutex);
+    queueFlush();
+}
+
+void WsFanout::update() {
+    // Also how a client passed over gets its next try
+    if (clientCount > 0) {
+        queueFlush();
+    }
+}
+
+void WsFanout::queueFlush() {
+    if (flushQueued || !server) {
+        return;
+    }
+    flushQueued = true;
+    if (httpd_queue_work(server, flushWork, this) != ESP_OK) {
+        flushQueued = false;
+    }
+}
+
+// ===========================
+// Flushing (httpd task)
+// ===========================
+
+void WsFanout::flushWork(void* arg) {
+    static_cast<WsFanout*>(arg)->flush();
+}
+
+void WsFanout::flush() {
+    flushQueued = false;
+    if (!mutex) {
+        return;
+    }
+    uint32_t now = millis();
+    for (FanoutClient& client : clients) {
+        if (client.fd >= 0) {
+            flushClient(client, now);
+        }
+    }
+}
+
+// Room in the socket's send buffer now - a send there won't block
+bool WsFanout::writable(int fd) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    struct timeval zero = {0, 0};
+    return select(fd + 1, nullptr, &set, nullptr, &zero) > 0;
+}
+
+// The next message to send: events in order, then the oldest snapshot if
+// the client's interval has passed; slot -1 for an event
+FanoutMessage* WsFanout::due(const FanoutClient& client, uint32_t now, int8_t& slot) const {
+    slot = -1;
+    if (client.eventCount > 0) {
+        return client.events[client.eventHead];
+    }
+    if (now - client.lastSnapshotAt < client.intervalMs) {
+        return nullptr;
+    }
+    for (uint8_t s = 0; s < FANOUT_SNAPSHOT_SLOTS; s++) {
+        const FanoutMessage* pending = client.snapshots[s];
+        if (pending && (slot < 0 || pending->createdAt < client.snapshots[slot]->createdAt)) {
+            slot = s;
+        }
+    }
+    return slot < 0 ? nullptr : client.snapshots[slot];
+}
+
+uint32_t WsFanout::lag(const FanoutClient& client, uint32_t now) const {
+    int8_t slot;
+    const FanoutMessage* next = due(client, now, slot);
+    return next ? now - next->createdAt : 0;
+}
+
+void WsFanout::flushClient(FanoutClient& client, uint32_t now) {
+    int fd = client.fd;
+    if (client.closing || httpd_ws_get_fd_info(server, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+        bool closing = client.closing;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        drop(client);
+        xSemaphoreGive(mutex);
+        if (closing) {
+            httpd_sess_trigger_close(server, fd);
+        }
+        return;
+    }
+
+    bool behind = false;
+    bool sentSnapshot = false;
+    for (uint8_t sent = 0;; sent++) {
+        int8_t slot;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        FanoutMessage* message = due(client, now, slot);
+        if (message) {
+            message->refs++;            // The send's own, so a replacement can't free it
+        }
+        xSemaphoreGive(mutex);
+        if (!message) {
+            break;
+        }
+
+        if (sent == FANOUT_SEND_BUDGET || !writable(fd)) {
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            if (sent < FANOUT_SEND_BUDGET) {
+                client.deferred++;
+            }
+            release(message);
+            xSemaphoreGive(mutex);
+            behind = true;
+            break;
+        }
+
+        httpd_ws_frame_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.type = HTTPD_WS_TYPE_TEXT;
+        frame.payload = (uint8_t*)message->text;
+        frame.len = message->length;
+        esp_err_t res = httpd_ws_send_frame_async(server, fd, &frame);
+
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        if (res == ESP_OK) {
+            client.framesSent++;
+            client.bytesSent += message->length;
+            if (slot < 0) {
+                // Only a flush takes events off, so the head is still this one
+                client.events[client.eventHead] = nullptr;
+                client.eventHead = (client.eventHead + 1) % FANOUT_EVENT_DEPTH;
+                client.eventCount--;
+                release(message);
+            } else {
+                if (client.snapshots[slot] == message) {
+                    client.snapshots[slot] = nullptr;
+                    release(message);
+                }
+                client.lastSnapshotAt = now;
+                sentSnapshot = true;
+            }
+        }
+        release(message);
+        if (res != ESP_OK) {
+            drop(client);
+        }
+        xSemaphoreGive(mutex);
+        if (res != ESP_OK) {
+            return;
+        }
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    client.lagMs = lag(client, now);
+    client.maxLagMs = max(client.maxLagMs, client.lagMs);
+    if (behind) {
+        client.intervalMs = constrain(client.intervalMs * 2, (uint32_t)FANOUT_INTERVAL_STEP_MS,
+                                      (uint32_t)FANOUT_INTERVAL_MAX_MS);
+    } else if (sentSnapshot) {
+        // Kept up through a whole interval: back towards full rate
+        client.intervalMs = client.intervalMs / 2 < FANOUT_INTERVAL_STEP_MS ? 0 : client.intervalMs / 2;
+    }
+    xSemaphoreGive(mutex);
+}
+
+// ===========================
+// Status
+// ===========================
+
+size_t WsFanout::getClients(FanoutClientStatus* out, size_t maxClients) const {
+    if (!mutex) {
+        return 0;
+    }
+    size_t found = 0;
+    uint32_t now = millis();
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (const FanoutClient& client : clients) {
+        if (client.fd < 0 || found == maxClients) {
+            continue;
+        }
+        FanoutClientStatus& status = out[found++];
+        status.fd = client.fd;
+        status.connectedMs = now - client.connectedAt;
+        status.eventsQueued = client.eventCount;
+        status.snapshotsPending = 0;
+        for (const FanoutMessage* snapshot : client.snapshots) {
+            status.snapshotsPending += snapshot != nullptr;
+        }
+        status.intervalMs = client.intervalMs;
+        status.lagMs = client.lagMs;
+        status.maxLagMs = client.maxLagMs;
+        status.framesSent = client.framesSent;
+        status.bytesSent = client.bytesSent;
+        status.coalesced = client.coalesced;
+        status.deferred = client.deferred;
+    }
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+void WsFanout::printStatus() const {
+    FanoutClientStatus status[FANOUT_MAX_CLIENTS];
+    size_t count = getClients(status, FANOUT_MAX_CLIENTS);
+    Serial.println("=== WebSocket Fan-out ===");
+    Serial.printf("Clients: %u, published %lu, closed behind %lu, allocation failures %lu\n", (unsigned)count,
+                  (unsigned long)published, (unsigned long)closedBehind, (unsigned long)allocationFailures);
+    for (size_t i = 0; i < count; i++) {
+        const FanoutClientStatus& c = status[i];
+        Serial.printf("  fd %d: lag %lu ms (max %lu), every %lu ms, %u events queued, %u snapshots, "
+                      "%lu frames, %lu coalesced, %lu deferred\n",
+                      c.fd, (unsigned long)c.lagMs, (unsigned long)c.maxLagMs, (unsigned long)c.intervalMs,
+                      c.eventsQueued, c.snapshotsPending, (unsigned long)c.framesSent, (unsigned long)c.coalesced,
+                      (unsigned long)c.deferred);
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef BASE_STATION_FANOUT_H
+#define BASE_STATION_FANOUT_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_http_server.h"
+#include "memory_arena.h"
+
+// ===========================
+// WebSocket Fan-out (base station)
+// One bounded outbound queue per WebSocket client, so a laptop on a weak
+// link falls behind on its own without holding up the others or the radio
+// ===========================
+
+// The loop task publishes; each message is built once and shared by
+// reference between the client queues it goes into. A flush on the httpd
+// task - which owns the sockets, and runs below the radio and RX tasks -
+// then sends each client what its socket will take: the client's socket is
+// checked for room first, and one that has none is passed over until the
+// next flush rather than waited on.
+//
+// Two kinds of message, queued differently:
+//   events     alerts and one-off packets; kept in order, never dropped. A
+//              client FANOUT_EVENT_DEPTH behind is closed instead - it
+//              reconnects and catches up from /api/alerts?since=
+//   snapshots  the latest telemetry or fix of a balloon; a client holds one
+//              per key, and a newer one replaces the one still waiting
+//
+// A client that is passed over, or runs out of its FANOUT_SEND_BUDGET, has
+// its snapshot interval doubled, up to FANOUT_INTERVAL_MAX_MS, so it gets
+// fewer, newer snapshots; one that drains has it halved back towards full
+// rate. Lag is the age of the oldest message a client is due and hasn't
+// been sent.
+//
+// Messages are built and freed at telemetry rate, so they come from a
+// PSRAM pool of FANOUT_POOL_BLOCKS reserved in begin(); one longer than a
+// block, or past the last block, is allocated from the heap.
+
+#define FANOUT_MAX_CLIENTS         MAX_WEB_CLIENTS
+#define FANOUT_EVENT_DEPTH         32
+#define FANOUT_SNAPSHOT_SLOTS      8       // Keys pending per client; past it the oldest is replaced
+#define FANOUT_SEND_BUDGET         8       // Frames per client per flush
+#define FANOUT_INTERVAL_STEP_MS    250     // First step down from full rate
+#define FANOUT_INTERVAL_MAX_MS     8000
+#define FANOUT_POOL_BLOCK_BYTES    1024    // A message with its header
+#define FANOUT_POOL_BLOCKS         64
+
+// Refcounted, one per publish
+struct FanoutMessage {
+    uint16_t refs;              // Client queues and sends in flight holding it
+    uint16_t key;               // Snapshots: what replaces what
+    uint16_t length;
+    uint32_t createdAt;         // millis()
+    char text[];
+};
+
+struct FanoutClient {
+    int fd;                     // -1 when the slot is free
+    bool closing;               // Overflowed, closed on the next flush
+    uint32_t connectedAt;
+    FanoutMessage* events[FANOUT_EVENT_DEPTH];
+    uint8_t eventHead;
+    uint8_t eventCount;
+    FanoutMessage* snapshots[FANOUT_SNAPSHOT_SLOTS];
+    uint32_t intervalMs;        // Between snapshots; 0 at full rate
+    uint32_t lastSnapshotAt;
+    uint32_t lagMs;             // At the last flush
+    uint32_t maxLagMs;
+    uint32_t framesSent;
+    uint32_t bytesSent;
+    uint32_t coalesced;         // Snapshots replaced before they were sent
+    uint32_t deferred;          // Flushes its socket had no room in
+};
+
+struct FanoutClientStatus {
+    int fd;
+    uint32_t connectedMs;       // How long ago
+    uint8_t eventsQueued;
+    uint8_t snapshotsPending;
+    uint32_t intervalMs;
+    uint32_t lagMs;
+    uint32_t maxLagMs;
+    uint32_t framesSent;
+    uint32_t bytesSent;
+    uint32_t coalesced;
+    uint32_t deferred;
+};
+
+class WsFanout {
+public:
+    WsFanout();
+    ~WsFanout();
+
+    // From startBaseStationServer(), with the running server
+    bool begin(httpd_handle_t server);
+    void end();
+    bool isReady() const { return mutex != nullptr; }
+
+    // On the httpd task, from the WebSocket handshake
+    void addClient(int fd);
+
+    // Loop task
+    void publishEvent(const char* text, size_t length);
+    void publishSnapshot(uint16_t key, const char* text, size_t length);
+    void update();              // Queues a flush while anything is waiting
+
+    uint8_t getClientCount() const { return clientCount; }
+    size_t getClients(FanoutClientStatus* out, size_t maxClients) const;
+    uint32_t getClosedBehind() const { return closedBehind; }
+
+    void printStatus() const;
+
+private:
+    httpd_handle_t server;
+    SemaphoreHandle_t mutex;                // The client queues
+    FanoutClient clients[FANOUT_MAX_CLIENTS];
+    SlabPool messagePool;
+    uint8_t clientCount;
+    volatile bool flushQueued;
+
+    uint32_t published;
+    uint32_t allocationFailures;
+    uint32_t closedBehind;
+
+    FanoutMessage* make(uint16_t key, const char* text, size_t length);
+    void release(FanoutMessage* message);
+    void drop(FanoutClient& client);
+    void queueFlush();
+    void flush();
+    void flushClient(FanoutClient& client, uint32_t now);
+    FanoutMessage* due(const FanoutClient& client, uint32_t now, int8_t& slot) const;
+    uint32_t lag(const FanoutClient& client, uint32_t now) const;
+
+    static void flushWork(void* arg);
+    static bool writable(int fd);
+};
+
+WsFanout& Fanout();
+
+#endif // BASE_STATION_FANOUT_H
@@ -0,0 +1,233 @@
+#include "base_station_config.h"
+#include "base_station_firmware.h"
+#include "fragment_transfer.h"
+#include "memory_ledger.h"
+#include "debug_utils.h"
+
+static FirmwareUploader firmwareUploaderInstance;
+
+FirmwareUploader& FirmwareUplink() {
+    return firmwareUploaderInstance;
+}
+
+static inline uint32_t readU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+FirmwareUploader::FirmwareUploader() {
+    mutex = nullptr;
+    state = UploadState::IDLE;
+    patch = nullptr;
+    length = 0;
+    updateId = 0;
+    chunk = 0;
+    chunkCount = 0;
+    inFlight = false;
+    sentBefore = 0;
+    memset(newHash, 0, sizeof(newHash));
+    attempts = 0;
+    retries = 0;
+
+    commandPending = false;
+    command = CommandId::FIRMWARE_ABORT;
+    memset(commandParams, 0, sizeof(commandParams));
+    commandLength = 0;
+
+    uploads = 0;
+}
+
+bool FirmwareUploader::begin() {
+    if (!mutex) {
+        mutex = xSemaphoreCreateMutex();
+    }
+    return mutex != nullptr;
+}
+
+// ===========================
+// Web Server Side
+// ===========================
+
+uint8_t* FirmwareUploader::reserve(size_t bytes) {
+    if (!mutex || bytes < FIRMWARE_PATCH_HEADER_SIZE || bytes > FIRMWARE_DELTA_MAX_BYTES) {
+        return nullptr;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint8_t* buffer = nullptr;
+    if (state != UploadState::SENDING && state != UploadState::RECEIVING) {
+        release();
+        patch = static_cast<uint8_t*>(memAlloc(MemTag::FIRMWARE, bytes));
+        if (patch) {
+            length = bytes;
+            state = UploadState::RECEIVING;
+            buffer = patch;
+        }
+    }
+    xSemaphoreGive(mutex);
+    return buffer;
+}
+
+bool FirmwareUploader::commit() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (state != UploadState::RECEIVING) {
+        xSemaphoreGive(mutex);
+        return false;
+    }
+    if (readU32(patch) != FIRMWARE_PATCH_MAGIC || patch[4] != FIRMWARE_PATCH_VERSION) {
+        release();
+        state = UploadState::IDLE;
+        xSemaphoreGive(mutex);
+        return false;
+    }
+
+    // Never the last update's id, so its chunks can't be taken for this one's
+    updateId = static_cast<uint16_t>(updateId + 1 + (esp_random() & 0xFF));
+    chunkCount = static_cast<uint8_t>((length + FIRMWARE_CHUNK_DATA_BYTES - 1) / FIRMWARE_CHUNK_DATA_BYTES);
+    memcpy(newHash, &patch[48], sizeof(newHash));
+    chunk = 0;
+    inFlight = false;
+    attempts = 0;
+    retries = 0;
+    uploads++;
+    state = UploadState::SENDING;
+    SYS_INFO("Firmware update %u: %u byte patch in %u chunks, new image %02x%02x%02x%02x", updateId,
+             (unsigned)length, chunkCount, newHash[0], newHash[1], newHash[2], newHash[3]);
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+void FirmwareUploader::cancel() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (state == UploadState::RECEIVING) {
+        release();
+        state = UploadState::IDLE;
+    }
+    xSemaphoreGive(mutex);
+}
+
+bool FirmwareUploader::requestCommand(CommandId id, const uint8_t* params, size_t paramLength) {
+    if (!mutex || paramLength > sizeof(commandParams)) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    command = id;
+    if (paramLength > 0) {
+        memcpy(commandParams, params, paramLength);
+    }
+    commandLength = paramLength;
+    commandPending = true;
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+// ===========================
+// RX Task
+// ===========================
+
+void FirmwareUploader::process() {
+    if (!mutex) {
+        return;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+
+    if (commandPending && PacketMgr().createCommandPacket(command, commandParams, commandLength)) {
+        commandPending = false;
+    }
+
+    if (state == UploadState::SENDING && !FragmentMgr().isSending()) {
+        if (inFlight) {
+            inFlight = false;
+            if (FragmentMgr().getTransfersSent() != sentBefore) {
+                chunk++;
+                attempts = 0;
+            } else if (++attempts > FIRMWARE_UPLOAD_RETRIES) {
+                SYS_WARNING("Firmware update %u: chunk %u/%u not through after %u transfers", updateId, chunk + 1,
+                            chunkCount, attempts);
+                release();
+                state = UploadState::FAILED;
+            } else {
+                retries++;
+            }
+        }
+        if (state == UploadState::SENDING && chunk == chunkCount) {
+            SYS_INFO("Firmware update %u: all %u chunks sent", updateId, chunkCount);
+            release();
+            state = UploadState::SENT;
+        } else if (state == UploadState::SENDING) {
+            sendChunk();
+        }
+    }
+
+    xSemaphoreGive(mutex);
+}
+
+void FirmwareUploader::sendChunk() {
+    size_t offset = static_cast<size_t>(chunk) * FIRMWARE_CHUNK_DATA_BYTES;
+    size_t bytes = min(length - offset, (size_t)FIRMWARE_CHUNK_DATA_BYTES);
+
+    uint8_t header[FIRMWARE_CHUNK_HEADER_SIZE];
+    header[0] = static_cast<uint8_t>(updateId >> 8);
+    header[1] = static_cast<uint8_t>(updateId);
+    header[2] = chunk;
+    header[3] = chunkCount;
+    PayloadPart parts[2] = {{header, sizeof(header)}, {&patch[offset], bytes}};
+
+    sentBefore = FragmentMgr().getTransfersSent();
+    if (FragmentMgr().sendPayload(PacketType::FIRMWARE_DELTA, parts, 2)) {
+        inFlight = true;
+    }
+}
+
+void FirmwareUploader::release() {
+    if (patch) {
+        memFree(MemTag::FIRMWARE, patch);
+        patch = nullptr;
+    }
+    inFlight = false;
+}
+
+// ===========================
+// Status
+// ===========================
+
+FirmwareUploadStatus FirmwareUploader::getStatus() const {
+    FirmwareUploadStatus status;
+    memset(&status, 0, sizeof(status));
+    if (!mutex) {
+        return status;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    status.state = state;
+    status.updateId = updateId;
+    status.chunk = chunk;
+    status.chunkCount = chunkCount;
+    status.length = length;
+    status.retries = retries;
+    memcpy(status.newHash, newHash, sizeof(status.newHash));
+    xSemaphoreGive(mutex);
+    return status;
+}
+
+const char* FirmwareUploader::stateToString(UploadState state) {
+    switch (state) {
+        case UploadState::IDLE: return "idle";
+        case UploadState::RECEIVING: return "receiving";
+        case UploadState::SENDING: return "sending";
+        case UploadState::SENT: return "sent";
+        case UploadState::FAILED: return "failed";
+        default: return "unknown";
+    }
+}
+
+void FirmwareUploader::printStatus() const {
+    FirmwareUploadStatus status = getStatus();
+    Serial.println("=== Firmware Uplink ===");
+    Serial.printf("Update %u: %s, chunk %u/%u, %lu bytes, %lu chunks resent, %lu uploads\n", status.updateId,
+                  stateToString(status.state), status.chunk, status.chunkCount, (unsigned long)status.length,
+                  (unsigned long)status.retries, (unsigned long)uploads);
+}
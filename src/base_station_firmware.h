@@ -0,0 +1,101 @@
+#ifndef BASE_STATION_FIRMWARE_H
+#define BASE_STATION_FIRMWARE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "firmware_update.h"
+
+// ===========================
+// Firmware Uplink (base station)
+// A firmware patch from POST /api/firmware, sent up chunk by chunk as
+// FIRMWARE_DELTA fragment transfers, and the commands that go with it
+// ===========================
+
+// The web server hands over the patch: reserve() a PSRAM buffer for the
+// request body, fill it, commit() it. The patch's header is checked and
+// it is cut into FIRMWARE_CHUNK_DATA_BYTES chunks under a new update id
+// (layouts in firmware_update.h). process() on the RX task, ahead of
+// FragmentMgr().process(), sends one chunk per transfer; a transfer that
+// fails is sent again, up to FIRMWARE_UPLOAD_RETRIES times. The buffer is
+// freed once the last chunk is through.
+//
+// The balloon verifies and applies it on its own and says so in its log;
+// requestCommand() queues FIRMWARE_ACTIVATE or FIRMWARE_ABORT for the RX
+// task to send. The uplink is the base station's only outgoing transfer,
+// so FragmentMgr()'s transfer counts tell process() how a chunk went.
+
+#define FIRMWARE_UPLOAD_RETRIES      3      // Transfers of one chunk that may fail before the upload does
+
+enum class UploadState : uint8_t {
+    IDLE = 0,
+    RECEIVING,      // Web server filling the buffer
+    SENDING,
+    SENT,
+    FAILED
+};
+
+struct FirmwareUploadStatus {
+    UploadState state;
+    uint16_t updateId;
+    uint8_t chunk;              // Being sent, or all of them once SENT
+    uint8_t chunkCount;
+    uint32_t length;
+    uint32_t retries;           // Chunk transfers sent again, this upload
+    uint8_t newHash[FIRMWARE_ACTIVATE_PARAMS];
+};
+
+class FirmwareUploader {
+public:
+    FirmwareUploader();
+
+    bool begin();
+
+    // Web server task: a buffer for length bytes, nullptr while a patch is being sent
+    uint8_t* reserve(size_t length);
+    bool commit();              // false if it isn't a patch; the buffer goes either way
+    void cancel();
+
+    // Web server task: FIRMWARE_ACTIVATE or FIRMWARE_ABORT, sent by process()
+    bool requestCommand(CommandId command, const uint8_t* params, size_t length);
+
+    // RX task
+    void process();
+
+    FirmwareUploadStatus getStatus() const;
+    static const char* stateToString(UploadState state);
+    void printStatus() const;
+
+private:
+    mutable SemaphoreHandle_t mutex;
+    UploadState state;
+    uint8_t* patch;             // PSRAM, FIRMWARE_DELTA_MAX_BYTES at most
+    size_t length;
+    uint16_t updateId;
+    uint8_t chunk;
+    uint8_t chunkCount;
+    bool inFlight;
+    uint32_t sentBefore;        // FragmentMgr()'s count as the chunk went out
+    uint8_t newHash[FIRMWARE_ACTIVATE_PARAMS];
+    uint8_t attempts;
+    uint32_t retries;
+
+    bool commandPending;
+    CommandId command;
+    uint8_t commandParams[FIRMWARE_ACTIVATE_PARAMS];
+    size_t commandLength;
+
+    uint32_t uploads;
+
+    void sendChunk();
+    void release();
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern FirmwareUploader& FirmwareUplink();
+
+#endif // BASE_STATION_FIRMWARE_H
@@ -0,0 +1,358 @@
+#include "base_station_config.h"
+#include "base_station_flights.h"
+#include "base_station_columns.h"
+#include "memory_ledger.h"
+#include "packet_store.h"
+#include <LittleFS.h>
+
+#define FLIGHT_CATALOG_FILE        FLASH_STORAGE_PATH "/flights.cat"
+
+static FlightCatalog flightCatalogInstance;
+
+FlightCatalog& Flights() {
+    return flightCatalogInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+FlightCatalog::FlightCatalog() {
+    records = nullptr;
+    firstId = 1;
+    nextId = 1;
+    dirty = 0;
+    memset(imageMark, 0, sizeof(imageMark));
+    persistent = false;
+    mutex = nullptr;
+    nextIndex = 0;
+    lastFlush = 0;
+    revision = 0;
+    writeErrors = 0;
+}
+
+FlightCatalog::~FlightCatalog() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool FlightCatalog::begin() {
+    if (records) {
+        return true;
+    }
+
+    records = (FlightRecord*)memCalloc(MemTag::TIMESERIES, FLIGHT_CATALOG_MAX, sizeof(FlightRecord));
+    mutex = xSemaphoreCreateMutex();
+    if (!records || !mutex) {
+        Serial.println("Flight catalog: No memory for the records");
+        end();
+        return false;
+    }
+
+    // The column store mounted LittleFS; without it the catalog is this uptime's flights only
+    persistent = Columns().isReady();
+    uint32_t newest = 0;
+    File file = persistent ? LittleFS.open(FLIGHT_CATALOG_FILE, "r") : File();
+    if (file) {
+        for (uint32_t s = 0; s < FLIGHT_CATALOG_MAX; s++) {
+            FlightRecord record;
+            if (file.read((uint8_t*)&record, sizeof(record)) != sizeof(record)) {
+                break;
+            }
+            // A torn or stale record is left zeroed and its id not held
+            if (record.magic == FLIGHT_RECORD_MAGIC && record.id != 0 && (record.id - 1) % FLIGHT_CATALOG_MAX == s) {
+                records[s] = record;
+                newest = max(newest, record.id);
+            }
+        }
+        file.close();
+    }
+    nextId = newest + 1;
+    firstId = nextId > FLIGHT_CATALOG_MAX ? nextId - FLIGHT_CATALOG_MAX : 1;
+
+    nextIndex = Packets().getOldest();
+    lastFlush = millis();
+    return true;
+}
+
+void FlightCatalog::end() {
+    if (records && mutex) {
+        flush();
+    }
+    for (uint8_t s = 0; s < Sessions().getCount(); s++) {
+        BalloonSession* session = Sessions().find(Sessions().getSession(s).deviceId);
+        if (session) {
+            session->flightId = 0;
+        }
+    }
+    if (records) {
+        memFree(MemTag::TIMESERIES, records);
+        records = nullptr;
+    }
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+    firstId = 1;
+    nextId = 1;
+    dirty = 0;
+    memset(imageMark, 0, sizeof(imageMark));
+}
+
+// ===========================
+// Records (mutex held)
+// ===========================
+
+// Null unless id is held
+FlightRecord* FlightCatalog::slot(uint32_t id) const {
+    if (id < firstId || id >= nextId) {
+        return nullptr;
+    }
+    FlightRecord* record = &records[(id - 1) % FLIGHT_CATALOG_MAX];
+    return record->id == id ? record : nullptr;
+}
+
+// The balloon's flight for a packet at time: its newest one if that ended
+// less than FLIGHT_GAP_S before - a reset in mid-flight picks it back up -
+// else a new one
+FlightRecord* FlightCatalog::open(uint8_t deviceId, uint32_t time) {
+    for (uint32_t id = nextId - 1; id >= firstId && id > 0; id--) {
+        FlightRecord* record = slot(id);
+        if (record && record->deviceId == deviceId) {
+            if (time <= record->endTime + FLIGHT_GAP_S) {
+                return record;
+            }
+            break;
+        }
+    }
+
+    uint32_t id = nextId++;
+    if (nextId - firstId > FLIGHT_CATALOG_MAX) {
+        firstId++;              // Its slot is the one being reused
+    }
+    uint32_t s = (id - 1) % FLIGHT_CATALOG_MAX;
+    FlightRecord* record = &records[s];
+    memset(record, 0, sizeof(*record));
+    record->magic = FLIGHT_RECORD_MAGIC;
+    record->id = id;
+    record->startTime = time;
+    record->endTime = time;
+    record->deviceId = deviceId;
+    dirty |= 1ULL << s;
+    return record;
+}
+
+// The last flight held to start at or before time, null if none did;
+// start times increase with id
+FlightRecord* FlightCatalog::timeSearch(uint32_t time) const {
+    uint32_t low = firstId;
+    uint32_t high = nextId;         // First id known to start after time
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        const FlightRecord* record = slot(middle);
+        if (record && record->startTime > time) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    for (uint32_t id = low - 1; id >= firstId && id > 0; id--) {
+        FlightRecord* record = slot(id);
+        if (record) {
+            return record;
+        }
+    }
+    return nullptr;
+}
+
+// ===========================
+// Updates (loop task)
+// ===========================
+
+void FlightCatalog::update() {
+    if (!records) {
+        return;
+    }
+
+    static StoredPacket packet;         // Off the loop task's stack
+
+    nextIndex = max(nextIndex, Packets().getOldest());
+    for (uint32_t next = Packets().getNext(); nextIndex < next; nextIndex++) {
+        if (!Packets().get(nextIndex, packet)) {
+            continue;
+        }
+        BalloonSession* session = Sessions().open(packet.deviceId);
+        if (!session) {
+            continue;
+        }
+        uint32_t time = Columns().toStoreTime(packet.receivedAt);
+
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        FlightRecord* flight = slot(session->flightId);
+        if (!flight || time > flight->endTime + FLIGHT_GAP_S) {
+            flight = open(packet.deviceId, time);
+            session->flightId = flight->id;
+            revision++;
+        }
+        flight->endTime = max(flight->endTime, time);
+        flight->packets++;
+        if (packet.decoded && packet.type == PacketType::GPS_DATA && packet.data.gps.satellites > 0) {
+            flight->maxAltitude = max(flight->maxAltitude, packet.data.gps.altitude);
+        }
+        dirty |= 1ULL << ((flight->id - 1) % FLIGHT_CATALOG_MAX);
+        xSemaphoreGive(mutex);
+    }
+
+    // Images catalogued since the last call go to their balloon's open flight
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (uint8_t s = 0; s < Sessions().getCount(); s++) {
+        const BalloonSession& session = Sessions().getSession(s);
+        FlightRecord* flight = slot(session.flightId);
+        if (session.latestImage == imageMark[s] || !flight) {
+            continue;
+        }
+        imageMark[s] = session.latestImage;
+        flight->firstImage = flight->firstImage ? flight->firstImage : session.latestImage;
+        flight->lastImage = session.latestImage;
+        dirty |= 1ULL << ((flight->id - 1) % FLIGHT_CATALOG_MAX);
+        revision++;
+    }
+    xSemaphoreGive(mutex);
+
+    if (dirty && millis() - lastFlush >= FLIGHT_FLUSH_INTERVAL_MS) {
+        flush();
+    }
+}
+
+// Each changed record rewritten in place
+bool FlightCatalog::flush() {
+    static FlightRecord changed[FLIGHT_CATALOG_MAX];    // Off the loop task's stack
+
+    if (!records) {
+        return false;
+    }
+    lastFlush = millis();
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint64_t flushing = dirty;
+    for (uint32_t s = 0; s < FLIGHT_CATALOG_MAX; s++) {
+        if (flushing & (1ULL << s)) {
+            changed[s] = records[s];
+        }
+    }
+    dirty = 0;
+    xSemaphoreGive(mutex);
+
+    if (!persistent || !flushing) {
+        return true;
+    }
+    File file = LittleFS.exists(FLIGHT_CATALOG_FILE) ? LittleFS.open(FLIGHT_CATALOG_FILE, "r+")
+                                                     : LittleFS.open(FLIGHT_CATALOG_FILE, "w");
+    bool ok = (bool)file;
+    for (uint32_t s = 0; ok && s < FLIGHT_CATALOG_MAX; s++) {
+        if (flushing & (1ULL << s)) {
+            ok = file.seek(s * sizeof(FlightRecord)) &&
+                 file.write((const uint8_t*)&changed[s], sizeof(FlightRecord)) == sizeof(FlightRecord);
+        }
+    }
+    if (file) {
+        file.close();
+    }
+    if (!ok) {
+        // Tried again next interval
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        dirty |= flushing;
+        xSemaphoreGive(mutex);
+        writeErrors++;
+    }
+    return ok;
+}
+
+// ===========================
+// Queries (any task)
+// ===========================
+
+bool FlightCatalog::getFlight(uint32_t id, FlightRecord& out) const {
+    if (!records) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const FlightRecord* record = slot(id);
+    if (record) {
+        out = *record;
+    }
+    xSemaphoreGive(mutex);
+    return record != nullptr;
+}
+
+bool FlightCatalog::findFlight(uint32_t time, int16_t deviceId, FlightRecord& out) const {
+    if (!records) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const FlightRecord* found = nullptr;
+    const FlightRecord* start = timeSearch(time);
+    // Back from there through the balloon's own, latest start first, to one
+    // still going at time; flights of different balloons overlap
+    for (uint32_t id = start ? start->id : 0; id >= firstId && id > 0; id--) {
+        const FlightRecord* record = slot(id);
+        if (!record || (deviceId >= 0 && record->deviceId != deviceId)) {
+            continue;
+        }
+        found = found ? found : record;
+        if (record->endTime >= time) {
+            found = record;
+            break;
+        }
+    }
+    if (found) {
+        out = *found;
+    }
+    xSemaphoreGive(mutex);
+    return found != nullptr;
+}
+
+size_t FlightCatalog::getFlights(size_t skip, FlightRecord* out, size_t maxFlights, size_t& total) const {
+    total = 0;
+    if (!records) {
+        return 0;
+    }
+    size_t found = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (uint32_t id = nextId - 1; id >= firstId && id > 0; id--) {
+        const FlightRecord* record = slot(id);
+        if (!record) {
+            continue;
+        }
+        if (total >= skip && found < maxFlights) {
+            out[found++] = *record;
+        }
+        total++;
+    }
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+void FlightCatalog::printStatus() const {
+    if (!records) {
+        Serial.println("Flight catalog: not running");
+        return;
+    }
+    Serial.println("=== Flight Catalog ===");
+    Serial.printf("Flights %lu..%lu held, %s, %lu write errors\n", (unsigned long)firstId,
+                  (unsigned long)(nextId - 1), persistent ? FLIGHT_CATALOG_FILE : "RAM only",
+                  (unsigned long)writeErrors);
+    FlightRecord recent[4];
+    size_t total;
+    size_t count = getFlights(0, recent, 4, total);
+    for (size_t i = 0; i < count; i++) {
+        const FlightRecord& f = recent[i];
+        Serial.printf("  Flight %lu: balloon %u, %lu..%lu (%lu min), %lu packets, peak %.0f m, images %lu..%lu\n",
+                      (unsigned long)f.id, f.deviceId, (unsigned long)f.startTime, (unsigned long)f.endTime,
+                      (unsigned long)((f.endTime - f.startTime) / 60), (unsigned long)f.packets, f.maxAltitude,
+                      (unsigned long)f.firstImage, (unsigned long)f.lastImage);
+    }
+}
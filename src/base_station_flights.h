@@ -0,0 +1,101 @@
+#ifndef BASE_STATION_FLIGHTS_H
+#define BASE_STATION_FLIGHTS_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "base_station_sessions.h"
+
+// ===========================
+// Flight Catalog (base station)
+// Every flight the base station has received, with its time range, peak
+// altitude and the image ids it sent, in one fixed-record file
+// ===========================
+
+// A flight starts with a balloon's first packet, or its first after
+// FLIGHT_GAP_S of silence, and runs to its latest packet. Flight ids count
+// up across resets; record id lives at (id - 1) % FLIGHT_CATALOG_MAX in
+// FLASH_STORAGE_PATH/flights.cat, so the newest FLIGHT_CATALOG_MAX are
+// kept and the oldest overwritten past that.
+//
+// The record holds what it takes to open the flight in the other stores
+// without a scan: the balloon and the store-clock range for the column
+// store, which its block index turns into block reads, and the first and
+// last image id for the image catalog. Ids and start times both increase,
+// so getFlight() is one array index and findFlight() a binary search of
+// the copy in RAM; begin() reads the file once. Each balloon's open flight
+// is its session's flightId.
+//
+// update() runs from loop(): it reads new packets out of the packet store
+// by index and rewrites changed records every FLIGHT_FLUSH_INTERVAL_MS,
+// each in place.
+
+#define FLIGHT_CATALOG_MAX         64
+#define FLIGHT_GAP_S               3600    // Silence that ends a balloon's flight
+#define FLIGHT_FLUSH_INTERVAL_MS   30000
+#define FLIGHT_RECORD_MAGIC        0x31544C46  // "FLT1"
+
+struct FlightRecord {
+    uint32_t magic;
+    uint32_t id;
+    uint32_t startTime;         // Store-clock seconds
+    uint32_t endTime;
+    uint32_t packets;
+    uint32_t firstImage;        // Image ids, 0 when none
+    uint32_t lastImage;
+    float maxAltitude;          // m, from its GPS fixes; 0 before the first
+    uint8_t deviceId;
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(FlightRecord) == 36, "Record is part of the flash format");
+
+class FlightCatalog {
+public:
+    FlightCatalog();
+    ~FlightCatalog();
+
+    // After Columns().begin(), for its store clock
+    bool begin();
+    void end();
+    bool isReady() const { return mutex != nullptr; }
+
+    // From loop()
+    void update();
+    bool flush();
+
+    // Any task
+    bool getFlight(uint32_t id, FlightRecord& out) const;
+    // The flight of deviceId (any balloon for -1) that covers time, else the
+    // last one to start before it
+    bool findFlight(uint32_t time, int16_t deviceId, FlightRecord& out) const;
+    // Newest first, skipping skip; how many into out, total set to how many are held
+    size_t getFlights(size_t skip, FlightRecord* out, size_t maxFlights, size_t& total) const;
+    uint32_t getRevision() const { return revision; }
+
+    void printStatus() const;
+
+private:
+    FlightRecord* records;      // FLIGHT_CATALOG_MAX, by (id - 1) % FLIGHT_CATALOG_MAX
+    uint32_t firstId;           // Oldest held; ids firstId..nextId-1 are held
+    uint32_t nextId;
+    uint64_t dirty;             // Bit per record slot
+    uint32_t imageMark[SESSION_MAX];        // Each session's latestImage as last seen
+    bool persistent;            // Column store up, so LittleFS is mounted
+    SemaphoreHandle_t mutex;
+    uint32_t nextIndex;
+    uint32_t lastFlush;
+    uint32_t revision;
+    uint32_t writeErrors;
+
+    FlightRecord* slot(uint32_t id) const;
+    FlightRecord* open(uint8_t deviceId, uint32_t time);
+    FlightRecord* timeSearch(uint32_t time) const;
+};
+
+static_assert(FLIGHT_CATALOG_MAX <= 64, "dirty is a 64-bit mask");
+
+FlightCatalog& Flights();
+
+#endif // BASE_STATION_FLIGHTS_H
@@ -0,0 +1,763 @@
+#include "base_station_config.h"
+#include "base_station_images.h"
+#include "base_station_columns.h"
+#include "base_station_sessions.h"
+#include "packet_store.h"
+#include "image_scale.h"
+#include "memory_ledger.h"
+#include <LittleFS.h>
+#include <img_converters.h>
+
+static ImageCache imageCacheInstance;
+
+ImageCache& Images() {
+    return imageCacheInstance;
+}
+
+#define IMAGE_DIRECTORY          FLASH_STORAGE_PATH "/images"
+#define IMAGE_ORPHANS_MAX        8       // Stale files removed per begin(); the rest next time
+#define IMAGE_LAYER_HEADER_SIZE  4       // CAMERA_LAYER payload: [image id 2][layer][layer count]
+
+// fmt2jpg_cb() output straight into the thumbnail buffer
+struct JpegWriter {
+    uint8_t* buffer;
+    size_t length;
+    size_t capacity;
+};
+
+static size_t writeJpeg(void* arg, size_t index, const void* data, size_t length) {
+    JpegWriter* writer = static_cast<JpegWriter*>(arg);
+    if (index + length > writer->capacity) {
+        return 0;  // Short write aborts the encode
+    }
+    memcpy(&writer->buffer[index], data, length);
+    writer->length = index + length;
+    return length;
+}
+
+bool jpegDimensions(const uint8_t* jpeg, size_t length, uint16_t& width, uint16_t& height) {
+    if (length < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+        return false;
+    }
+    size_t pos = 2;
+    while (pos + 4 <= length) {
+        if (jpeg[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;              // Fill byte
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            pos += 2;           // No length
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA) {
+            return false;       // Scan data with no frame header ahead of it
+        }
+
+        // SOF0-15, bar DHT, JPG and DAC: [length 2][precision 1][height 2][width 2]
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (pos + 9 > length) {
+                return false;
+            }
+            height = (jpeg[pos + 5] << 8) | jpeg[pos + 6];
+            width = (jpeg[pos + 7] << 8) | jpeg[pos + 8];
+            return width && height;
+        }
+        pos += 2 + ((jpeg[pos + 2] << 8) | jpeg[pos + 3]);
+    }
+    return false;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+ImageCache::ImageCache() {
+    mutex = nullptr;
+    spill = false;
+    entries = nullptr;
+    first = 0;
+    count = 0;
+    nextId = 1;
+    revision = 0;
+    memset(images, 0, sizeof(images));
+    memset(thumbs, 0, sizeof(thumbs));
+    imagePool = nullptr;
+    thumbPool = nullptr;
+    tick = 0;
+    work = nullptr;
+    thumbWork = nullptr;
+    imagesReceived = 0;
+    imagesDropped = 0;
+    memset(&preview, 0, sizeof(preview));
+    previewSink = false;
+    previewBands = 0;
+    previewsDropped = 0;
+    thumbnailFailures = 0;
+    writeErrors = 0;
+    cacheHits = 0;
+    cacheMisses = 0;
+}
+
+ImageCache::~ImageCache() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool ImageCache::begin() {
+    if (mutex) {
+        return true;
+    }
+
+    // About 1.8 MB, all PSRAM
+    entries = (ImageInfo*)memCalloc(MemTag::IMAGE_STORE, IMAGE_CATALOG_SIZE, sizeof(ImageInfo));
+    imagePool = (uint8_t*)memAlloc(MemTag::IMAGE_STORE, (size_t)MAX_STORED_IMAGES * MAX_IMAGE_SIZE);
+    thumbPool = (uint8_t*)memAlloc(MemTag::IMAGE_STORE, (size_t)IMAGE_THUMB_SLOTS * IMAGE_THUMB_MAX_BYTES);
+    work = (uint8_t*)memAlloc(MemTag::IMAGE_STORE, MAX_IMAGE_SIZE);
+    thumbWork = (uint8_t*)memAlloc(MemTag::IMAGE_STORE, IMAGE_THUMB_MAX_BYTES);
+    scratch.begin("image_scratch", MemTag::IMAGE_STORE, IMAGE_SCRATCH_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    mutex = xSemaphoreCreateMutex();
+    if (!entries || !imagePool || !thumbPool || !work || !thumbWork || !mutex) {
+        end();
+        return false;
+    }
+
+    for (size_t i = 0; i < MAX_STORED_IMAGES; i++) {
+        images[i] = {0, 0, false, imagePool + i * MAX_IMAGE_SIZE, 0};
+    }
+    for (size_t i = 0; i < IMAGE_THUMB_SLOTS; i++) {
+        thumbs[i] = {0, 0, false, thumbPool + i * IMAGE_THUMB_MAX_BYTES, 0};
+    }
+    first = 0;
+    count = 0;
+    nextId = 1;
+
+    // Registered once; the sink outlives an end()
+    if (!previewSink) {
+        previewSink = RxPipeline().addSink(onRecordBatch);
+    }
+
+    spill = ENABLE_FLASH_STORAGE && Columns().isReady() &&
+            (LittleFS.exists(IMAGE_DIRECTORY) || LittleFS.mkdir(IMAGE_DIRECTORY));
+    if (spill) {
+        loadCatalog();
+    }
+    return true;
+}
+
+void ImageCache::end() {
+    memFree(MemTag::IMAGE_STORE, entries);
+    memFree(MemTag::IMAGE_STORE, imagePool);
+    memFree(MemTag::IMAGE_STORE, thumbPool);
+    memFree(MemTag::IMAGE_STORE, work);
+    memFree(MemTag::IMAGE_STORE, thumbWork);
+    entries = nullptr;
+    imagePool = nullptr;
+    thumbPool = nullptr;
+    work = nullptr;
+    thumbWork = nullptr;
+    memset(images, 0, sizeof(images));
+    memset(thumbs, 0, sizeof(thumbs));
+    count = 0;
+    spill = false;
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+}
+
+void ImageCache::imagePath(char* out, uint32_t id, bool thumbnail) {
+    snprintf(out, IMAGE_PATH_MAX, IMAGE_DIRECTORY "/%lu.%s", (unsigned long)id, thumbnail ? "thm" : "jpg");
+}
+
+// Every complete record, newest IMAGE_CATALOG_SIZE of them, in id order
+void ImageCache::loadCatalog() {
+    uint32_t orphans[IMAGE_ORPHANS_MAX];
+    uint8_t orphanCount = 0;
+
+    File directory = LittleFS.open(IMAGE_DIRECTORY);
+    for (File file = directory.openNextFile(); file; file = directory.openNextFile()) {
+        unsigned long id = 0;
+        char extension[4] = {0};
+        if (file.isDirectory() || sscanf(file.name(), "%lu.%3s", &id, extension) != 2 || id == 0) {
+            file.close();
+            continue;
+        }
+        nextId = max(nextId, (uint32_t)id + 1);     // Orphans' ids included - an id is never reused
+
+        ImageRecord record;
+        bool complete = !strcmp(extension, "thm") && file.read((uint8_t*)&record, sizeof(record)) == sizeof(record) &&
+                        record.magic == IMAGE_RECORD_MAGIC && record.id == id && record.length <= MAX_IMAGE_SIZE &&
+                        record.thumbLength <= IMAGE_THUMB_MAX_BYTES;
+        file.close();
+        if (!complete) {
+            continue;
+        }
+
+        // Full: the oldest held gives way if this one is newer
+        ImageInfo* entry = nullptr;
+        if (count < IMAGE_CATALOG_SIZE) {
+            entry = &entries[count++];
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                if (!entry || entries[i].id < entry->id) {
+                    entry = &entries[i];
+                }
+            }
+            uint32_t dropped = entry->id < id ? entry->id : (uint32_t)id;
+            if (orphanCount < IMAGE_ORPHANS_MAX) {
+                orphans[orphanCount++] = dropped;
+            }
+            if (dropped == id) {
+                continue;
+            }
+        }
+        entry->id = id;
+        entry->time = record.time;
+        entry->length = record.length;
+        entry->width = record.width;
+        entry->height = record.height;
+        entry->thumbLength = record.thumbLength;
+        entry->cameraId = record.cameraId;
+        entry->deviceId = record.deviceId;
+        entry->processed = true;
+        entry->onFlash = true;
+        entry->meta.valid = false;
+        if (record.flags & IMAGE_RECORD_METADATA) {
+            loadMetadata(*entry);
+        }
+    }
+    directory.close();
+
+    // Directory order isn't id order
+    for (size_t i = 1; i < count; i++) {
+        ImageInfo entry = entries[i];
+        size_t j = i;
+        for (; j > 0 && entries[j - 1].id > entry.id; j--) {
+            entries[j] = entries[j - 1];
+        }
+        entries[j] = entry;
+    }
+
+    // .jpg files a reset cut short of their .thm
+    directory = LittleFS.open(IMAGE_DIRECTORY);
+    for (File file = directory.openNextFile(); file && orphanCount < IMAGE_ORPHANS_MAX;
+         file = directory.openNextFile()) {
+        unsigned long id = 0;
+        char extension[4] = {0};
+        if (sscanf(file.name(), "%lu.%3s", &id, extension) == 2 && !strcmp(extension, "jpg") && !find(id)) {
+            orphans[orphanCount++] = id;
+        }
+        file.close();
+    }
+    directory.close();
+    for (uint8_t i = 0; i < orphanCount; i++) {
+        removeFiles(orphans[i]);
+    }
+}
+
+// The segment sits straight after SOI, so the head of the file holds it
+void ImageCache::loadMetadata(ImageInfo& info) const {
+    uint8_t head[2 + IMAGE_META_MAX_BYTES];
+    size_t length = readFile(info.id, false, 0, head, min(sizeof(head), (size_t)info.length));
+    imageMetadataParse(head, length, info.meta);
+}
+
+// ===========================
+// Catalog and slots (mutex held)
+// ===========================
+
+ImageInfo* ImageCache::find(uint32_t id) const {
+    // Ids ascend from the oldest
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        ImageInfo& entry = entries[(first + mid) % IMAGE_CATALOG_SIZE];
+        if (entry.id == id) {
+            return &entry;
+        }
+        if (entry.id < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return nullptr;
+}
+
+ImageSlot* ImageCache::findSlot(ImageSlot* pool, size_t size, uint32_t id) const {
+    for (size_t i = 0; i < size; i++) {
+        if (pool[i].id == id) {
+            return &pool[i];
+        }
+    }
+    return nullptr;
+}
+
+// A free slot, else the least recently used whose image is safe on flash
+ImageSlot* ImageCache::victim(ImageSlot* pool, size_t size) const {
+    ImageSlot* oldest = nullptr;
+    for (size_t i = 0; i < size; i++) {
+        ImageSlot& slot = pool[i];
+        if (slot.loading) {
+            continue;
+        }
+        if (slot.id == 0) {
+            return &slot;
+        }
+        const ImageInfo* entry = find(slot.id);
+        if ((!entry || entry->onFlash) && (!oldest || slot.lastUsed < oldest->lastUsed)) {
+            oldest = &slot;
+        }
+    }
+    return oldest;
+}
+
+ImageSlot* ImageCache::store(ImageSlot* pool, size_t size, uint32_t id, const uint8_t* data, size_t length) {
+    ImageSlot* slot = victim(pool, size);
+    if (slot) {
+        memcpy(slot->data, data, length);
+        slot->id = id;
+        slot->length = length;
+        slot->lastUsed = ++tick;
+    }
+    return slot;
+}
+
+// A slot being loaded is left to its loader, which finds the entry gone
+void ImageCache::release(uint32_t id) {
+    ImageSlot* slot = findSlot(images, MAX_STORED_IMAGES, id);
+    if (slot && !slot->loading) {
+        slot->id = 0;
+    }
+    slot = findSlot(thumbs, IMAGE_THUMB_SLOTS, id);
+    if (slot && !slot->loading) {
+        slot->id = 0;
+    }
+}
+
+void ImageCache::popOldest() {
+    release(entries[first].id);
+    first = (first + 1) % IMAGE_CATALOG_SIZE;
+    count--;
+    revision++;
+}
+
+// ===========================
+// Receiving (RX task)
+// ===========================
+
+void ImageCache::onTransferComplete(void* context, uint8_t deviceId, PacketType contentType,
+                                    const uint8_t* data, size_t length) {
+    if (!ENABLE_IMAGE_PROCESSING) {
+        return;
+    }
+    if (contentType == PacketType::CAMERA_FULL) {
+        static_cast<ImageCache*>(context)->receive(deviceId, data, length);
+    } else if (contentType == PacketType::CAMERA_LAYER && length > IMAGE_LAYER_HEADER_SIZE &&
+               data[2] + 1 == data[3]) {
+        // The last layer is the capture itself
+        static_cast<ImageCache*>(context)->receive(deviceId, &data[IMAGE_LAYER_HEADER_SIZE],
+                                                   length - IMAGE_LAYER_HEADER_SIZE);
+    }
+}
+
+bool ImageCache::receive(uint8_t deviceId, const uint8_t* data, size_t length) {
+    if (!mutex) {
+        return false;
+    }
+    if (length < 4 || length > MAX_IMAGE_SIZE || data[0] != 0xFF || data[1] != 0xD8) {
+        imagesDropped++;
+        return false;
+    }
+    uint32_t time = Columns().now();
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (!spill && count == MAX_STORED_IMAGES) {
+        popOldest();            // Without flash the catalog is what PSRAM holds
+    }
+    uint32_t id = nextId;
+    if (count == IMAGE_CATALOG_SIZE || !store(images, MAX_STORED_IMAGES, id, data, length)) {
+        imagesDropped++;        // Every slot still waiting on flash
+        xSemaphoreGive(mutex);
+        return false;
+    }
+    nextId++;
+
+    ImageInfo& entry = entries[(first + count) % IMAGE_CATALOG_SIZE];
+    memset(&entry, 0, sizeof(entry));
+    entry.id = id;
+    entry.time = time;
+    entry.length = length;
+    entry.deviceId = deviceId;
+    count++;
+    revision++;
+    imagesReceived++;
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+// ===========================
+// Preview frames (RX task)
+// ===========================
+
+void ImageCache::onRecordBatch(const ReceivedRecord* const* records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (records[i]->type == PacketType::CAMERA_PREVIEW) {
+            imageCacheInstance.receivePreview(records[i]->deviceId, records[i]->payload, records[i]->length);
+        }
+    }
+}
+
+bool ImageCache::receivePreview(uint8_t deviceId, const uint8_t* payload, size_t length) {
+    PreviewBand band;
+    if (!mutex || !previewParseBand(payload, length, band)) {
+        previewsDropped++;
+        return false;
+    }
+    size_t rowBytes = previewRowBytes(band.width, band.bits);
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool same = preview.revision && preview.deviceId == deviceId && preview.cameraId == band.imageId;
+    if (!same && preview.revision && preview.deviceId == deviceId && (int16_t)(band.imageId - preview.cameraId) < 0) {
+        previewsDropped++;      // A late band of an image already replaced
+        xSemaphoreGive(mutex);
+        return false;
+    }
+    if (!same || preview.width != band.width || preview.height != band.height || preview.bits != band.bits) {
+        preview.rows = 0;
+        preview.cameraId = band.imageId;
+        preview.deviceId = deviceId;
+        preview.width = band.width;
+        preview.height = band.height;
+        preview.bits = band.bits;
+    }
+    memcpy(&preview.pixels[band.firstRow * rowBytes], band.data, band.rows * rowBytes);
+    preview.rows |= ((band.rows < 64 ? (1ULL << band.rows) : 0) - 1) << band.firstRow;
+    preview.receivedAt = millis();
+    preview.revision++;
+    previewBands++;
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+bool ImageCache::getPreview(PreviewImage& out) const {
+    if (!mutex) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool held = preview.revision != 0;
+    if (held) {
+        memcpy(&out, &preview, sizeof(out));
+    }
+    xSemaphoreGive(mutex);
+    return held;
+}
+
+// ===========================
+// Thumbnails and flash (loop task)
+// ===========================
+
+// Decoded at the coarsest 1/2^n that keeps the long side at least
+// GALLERY_THUMBNAIL_SIZE, then box-scaled to fit it, aspect kept
+bool ImageCache::makeThumbnail(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height,
+                               uint16_t& thumbLength) {
+    thumbLength = 0;
+    uint16_t longest = max(width, height);
+    uint8_t shift = 0;
+    while (shift < 3 && (longest >> (shift + 1)) >= GALLERY_THUMBNAIL_SIZE) {
+        shift++;
+    }
+    uint16_t decodedWidth = width >> shift;
+    uint16_t decodedHeight = height >> shift;
+    if (decodedWidth == 0 || decodedHeight == 0) {
+        return false;
+    }
+    uint16_t thumbWidth = decodedWidth;
+    uint16_t thumbHeight = decodedHeight;
+    if (decodedWidth >= decodedHeight && decodedWidth > GALLERY_THUMBNAIL_SIZE) {
+        thumbWidth = GALLERY_THUMBNAIL_SIZE;
+        thumbHeight = max(1, decodedHeight * GALLERY_THUMBNAIL_SIZE / decodedWidth);
+    } else if (decodedHeight > decodedWidth && decodedHeight > GALLERY_THUMBNAIL_SIZE) {
+        thumbHeight = GALLERY_THUMBNAIL_SIZE;
+        thumbWidth = max(1, decodedWidth * GALLERY_THUMBNAIL_SIZE / decodedHeight);
+    }
+
+    size_t decodedBytes = (size_t)decodedWidth * decodedHeight * 2;
+    size_t thumbBytes = (size_t)thumbWidth * thumbHeight * 2;
+    ArenaMark mark = scratch.mark();
+    uint8_t* pixels = (uint8_t*)scratch.alloc(decodedBytes + thumbBytes);
+    bool heap = !pixels;
+    if (heap) {
+        pixels = (uint8_t*)memAlloc(MemTag::IMAGE_STORE, decodedBytes + thumbBytes);
+    }
+    bool made = pixels && jpg2rgb565(jpeg, length, pixels, static_cast<jpg_scale_t>(shift));
+
+    uint8_t* thumb = pixels;
+    if (made && (thumbWidth != decodedWidth || thumbHeight != decodedHeight)) {
+        thumb = pixels + decodedBytes;
+        made = scaleImage(PIXFORMAT_RGB565, pixels, decodedWidth, decodedHeight, thumb, thumbWidth, thumbHeight);
+    }
+
+    JpegWriter writer = {thumbWork, 0, IMAGE_THUMB_MAX_BYTES};
+    made = made && fmt2jpg_cb(thumb, thumbBytes, thumbWidth, thumbHeight, PIXFORMAT_RGB565, IMAGE_THUMB_QUALITY,
+                              writeJpeg, &writer) && writer.length > 0;
+    if (heap) {
+        memFree(MemTag::IMAGE_STORE, pixels);
+    }
+    scratch.rewind(mark);
+    thumbLength = made ? writer.length : 0;
+    return made;
+}
+
+bool ImageCache::writeImage(const ImageInfo& info, const uint8_t* jpeg, const uint8_t* thumb) {
+    char path[IMAGE_PATH_MAX];
+    imagePath(path, info.id, false);
+    File file = LittleFS.open(path, "w");
+    bool written = file && file.write(jpeg, info.length) == info.length;
+    file.close();
+
+    ImageRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = IMAGE_RECORD_MAGIC;
+    record.id = info.id;
+    record.time = info.time;
+    record.length = info.length;
+    record.width = info.width;
+    record.height = info.height;
+    record.thumbLength = info.thumbLength;
+    record.cameraId = info.cameraId;
+    record.deviceId = info.deviceId;
+    record.flags = info.meta.valid ? IMAGE_RECORD_METADATA : 0;
+
+    // The record last - it is what makes the image complete
+    if (written) {
+        imagePath(path, info.id, true);
+        file = LittleFS.open(path, "w");
+        written = file && file.write((const uint8_t*)&record, sizeof(record)) == sizeof(record) &&
+                  file.write(thumb, info.thumbLength) == info.thumbLength;
+        file.close();
+    }
+    if (!written) {
+        writeErrors++;
+        removeFiles(info.id);
+    }
+    return written;
+}
+
+void ImageCache::removeFiles(uint32_t id) {
+    char path[IMAGE_PATH_MAX];
+    imagePath(path, id, true);
+    if (LittleFS.exists(path)) {
+        LittleFS.remove(path);
+    }
+    imagePath(path, id, false);
+    if (LittleFS.exists(path)) {
+        LittleFS.remove(path);
+    }
+}
+
+void ImageCache::update() {
+    static StoredPacket packet;     // Off the loop task's stack
+
+    if (!mutex) {
+        return;
+    }
+
+    // The oldest past the flash's share, and the oldest image still to do,
+    // copied out so the work below runs without the mutex
+    uint32_t trimmed = 0;
+    ImageInfo job;
+    bool pending = false;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (spill && count > MAX_FLASH_IMAGES) {
+        trimmed = entries[first].id;
+        popOldest();
+    }
+    for (size_t i = 0; i < count; i++) {
+        ImageInfo& entry = entries[(first + i) % IMAGE_CATALOG_SIZE];
+        if (entry.processed) {
+            continue;
+        }
+        const ImageSlot* slot = findSlot(images, MAX_STORED_IMAGES, entry.id);
+        if (slot && !slot->loading) {
+            memcpy(work, slot->data, entry.length);
+            job = entry;
+            pending = true;
+        } else {
+            entry.processed = true;     // Nowhere left to read it from
+        }
+        break;
+    }
+    xSemaphoreGive(mutex);
+
+    if (trimmed) {
+        removeFiles(trimmed);
+    }
+    if (!pending) {
+        return;
+    }
+
+    if (!jpegDimensions(work, job.length, job.width, job.height) ||
+        (IMAGE_RESIZING && !makeThumbnail(work, job.length, job.width, job.height, job.thumbLength))) {
+        thumbnailFailures++;
+    }
+
+    // The balloon's own metadata, or else the CAMERA_DATA packet it sent ahead of the image
+    if (imageMetadataParse(work, job.length, job.meta)) {
+        job.cameraId = job.meta.imageId;
+    } else if (Packets().getLatest(PacketType::CAMERA_DATA, packet) && packet.decoded &&
+               packet.deviceId == job.deviceId && packet.data.camera.imageSize == job.length) {
+        job.cameraId = packet.data.camera.imageId;
+    }
+    job.onFlash = spill && writeImage(job, work, thumbWork);
+    job.processed = true;
+
+    BalloonSession* session = Sessions().open(job.deviceId);
+    if (session) {
+        session->images++;
+        session->latestImage = job.id;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    ImageInfo* entry = find(job.id);
+    if (entry) {
+        *entry = job;
+        if (job.thumbLength && !store(thumbs, IMAGE_THUMB_SLOTS, job.id, thumbWork, job.thumbLength) &&
+            !job.onFlash) {
+            entry->thumbLength = 0;     // Neither cached nor on flash
+        }
+        revision++;
+    }
+    xSemaphoreGive(mutex);
+}
+
+// ===========================
+// Reading (any task)
+// ===========================
+
+size_t ImageCache::getPage(size_t skip, ImageInfo* out, size_t maxImages, size_t& total) const {
+    total = 0;
+    if (!mutex) {
+        return 0;
+    }
+    size_t found = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    total = min(count, (size_t)MAX_GALLERY_HISTORY);
+    for (size_t i = skip; i < total && found < maxImages; i++) {
+        out[found++] = entries[(first + count - 1 - i) % IMAGE_CATALOG_SIZE];
+    }
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+bool ImageCache::getInfo(uint32_t id, ImageInfo& info) const {
+    if (!mutex) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const ImageInfo* entry = find(id);
+    if (entry) {
+        info = *entry;
+    }
+    xSemaphoreGive(mutex);
+    return entry != nullptr;
+}
+
+size_t ImageCache::readFile(uint32_t id, bool thumbnail, size_t offset, uint8_t* out, size_t space) const {
+    char path[IMAGE_PATH_MAX];
+    imagePath(path, id, thumbnail);
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return 0;
+    }
+    size_t read = file.seek(offset + (thumbnail ? sizeof(ImageRecord) : 0)) ? file.read(out, space) : 0;
+    file.close();
+    return read;
+}
+
+size_t ImageCache::read(uint32_t id, bool thumbnail, size_t offset, uint8_t* out, size_t space) {
+    if (!mutex) {
+        return 0;
+    }
+    ImageSlot* pool = thumbnail ? thumbs : images;
+    size_t size = thumbnail ? IMAGE_THUMB_SLOTS : MAX_STORED_IMAGES;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const ImageInfo* entry = find(id);
+    size_t length = entry ? (thumbnail ? entry->thumbLength : entry->length) : 0;
+    if (offset >= length) {
+        xSemaphoreGive(mutex);
+        return 0;
+    }
+    space = min(space, length - offset);
+    ImageSlot* slot = findSlot(pool, size, id);
+    if (slot && !slot->loading) {
+        memcpy(out, slot->data + offset, space);
+        slot->lastUsed = ++tick;
+        cacheHits += offset == 0 ? 1 : 0;
+        xSemaphoreGive(mutex);
+        return space;
+    }
+
+    // A miss from the start is loaded into a slot for next time
+    bool onFlash = entry->onFlash;
+    ImageSlot* load = nullptr;
+    if (onFlash && offset == 0 && !slot) {
+        load = victim(pool, size);
+        if (load) {
+            load->id = id;
+            load->loading = true;
+        }
+        cacheMisses++;
+    }
+    xSemaphoreGive(mutex);
+
+    if (!onFlash) {
+        return 0;
+    }
+    if (!load) {
+        return readFile(id, thumbnail, offset, out, space);
+    }
+
+    size_t loaded = readFile(id, thumbnail, 0, load->data, length);
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool kept = loaded == length && load->id == id && find(id);
+    load->loading = false;
+    if (kept) {
+        load->length = loaded;
+        load->lastUsed = ++tick;
+        memcpy(out, load->data, space);
+    } else {
+        load->id = 0;
+    }
+    xSemaphoreGive(mutex);
+    return kept ? space : readFile(id, thumbnail, offset, out, space);
+}
+
+void ImageCache::printStatus() const {
+    uint8_t cached = 0;
+    uint8_t thumbsCached = 0;
+    for (size_t i = 0; i < MAX_STORED_IMAGES; i++) {
+        cached += images[i].id ? 1 : 0;
+    }
+    for (size_t i = 0; i < IMAGE_THUMB_SLOTS; i++) {
+        thumbsCached += thumbs[i].id ? 1 : 0;
+    }
+    Serial.println("=== Image Cache ===");
+    Serial.printf("Images: %u cataloged, %u/%u cached, %u/%u thumbnails cached, flash %s\n", (unsigned)count,
+                  cached, MAX_STORED_IMAGES, thumbsCached, IMAGE_THUMB_SLOTS, spill ? "on" : "off");
+    Serial.printf("Received %lu, dropped %lu, thumbnail failures %lu, write errors %lu\n",
+                  (unsigned long)imagesReceived, (unsigned long)imagesDropped, (unsigned long)thumbnailFailures,
+                  (unsigned long)writeErrors);
+    Serial.printf("Reads: %lu hits, %lu misses\n", (unsigned long)cacheHits, (unsigned long)cacheMisses);
+    Serial.printf("Preview bands: %lu taken, %lu dropped\n", (unsigned long)previewBands,
+                  (unsigned long)previewsDropped);
+}
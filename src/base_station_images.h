@@ -0,0 +1,213 @@
+#ifndef BASE_STATION_IMAGES_H
+#define BASE_STATION_IMAGES_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "packet_handler.h"
+#include "rx_pipeline.h"
+#include "preview_frame.h"
+#include "image_metadata.h"
+#include "memory_arena.h"
+
+// ===========================
+// Image Cache (base station)
+// Reassembled JPEGs and their gallery thumbnails in PSRAM, least recently
+// used out first, with every image spilled to LittleFS behind them
+// ===========================
+
+// receive() runs on the RX task as a transfer completes: it copies the
+// JPEG into a PSRAM slot and returns - no decode, no flash. update() on the
+// loop task then takes one new image at a time, builds its thumbnail and
+// writes both to FLASH_STORAGE_PATH/images/<id>.jpg and <id>.thm. A slot
+// is only reused for a new image once what it holds is on flash; with the
+// slots all waiting on flash a new image is dropped rather than an older
+// one lost.
+//
+// The web server reads through read(): a cached image is copied out under
+// the mutex a chunk at a time, and a miss is loaded from flash into the
+// least recently used slot that is already on flash, outside the mutex, so
+// receive() never waits on a flash read. Thumbnails have their own pool,
+// sized for a whole gallery, so paging through one stays in PSRAM.
+//
+// Image ids count up from one past the newest on flash and never repeat,
+// so an id's bytes never change and "img-<id>" is a correct ETag for
+// them. The flash keeps the newest MAX_FLASH_IMAGES; without flash the
+// catalog is the MAX_STORED_IMAGES in PSRAM.
+//
+// .thm file: ImageRecord, then the thumbnail JPEG. It is written after the
+// .jpg, so a .jpg without one was cut short and begin() removes it.
+//
+// A JPEG from the balloon carries its capture's metadata (image_metadata.h);
+// update() parses it into the catalog, and begin() reads it back from the
+// head of each .jpg whose record is flagged. Images without it fall back to
+// the latest CAMERA_DATA packet for their camera id. In progressive mode the
+// last layer is the captured JPEG and is cataloged like a whole image.
+//
+// The cache is also a pipeline sink for CAMERA_PREVIEW bands. It keeps the
+// newest capture's preview frame packed, as it arrives, for /api/preview;
+// a band of a new image id starts over. It is not kept past the next one.
+
+#define IMAGE_CATALOG_SIZE         (MAX_FLASH_IMAGES + MAX_STORED_IMAGES)
+#define IMAGE_THUMB_SLOTS          MAX_GALLERY_HISTORY
+#define IMAGE_THUMB_MAX_BYTES      8192    // Encoded thumbnail; a larger one is not kept
+#define IMAGE_THUMB_QUALITY        60      // Encoder quality 1-100, higher is better
+#define IMAGE_SCRATCH_BYTES        (96 * 1024)     // Thumbnail decode: a UXGA frame at 1/8 and its scaled copy
+#define IMAGE_RECORD_MAGIC         0x31434D49  // "IMC1"
+#define IMAGE_RECORD_METADATA      0x01        // ImageRecord::flags - the JPEG has a metadata segment
+#define IMAGE_PATH_MAX             48
+
+struct ImageRecord {
+    uint32_t magic;
+    uint32_t id;
+    uint32_t time;              // Store-clock seconds at reassembly
+    uint32_t length;            // JPEG bytes
+    uint16_t width;             // 0 when the JPEG had no frame header
+    uint16_t height;
+    uint16_t thumbLength;       // 0 when no thumbnail could be made
+    uint16_t cameraId;          // CameraData::imageId, 0 if not known
+    uint8_t deviceId;
+    uint8_t flags;              // IMAGE_RECORD_*
+    uint8_t reserved[2];
+};
+
+static_assert(sizeof(ImageRecord) == 28, "Record header is part of the flash format");
+
+struct ImageInfo {
+    uint32_t id;
+    uint32_t time;
+    uint32_t length;
+    uint16_t width;
+    uint16_t height;
+    uint16_t thumbLength;
+    uint16_t cameraId;
+    uint8_t deviceId;
+    bool processed;             // Thumbnail attempted; width, height and cameraId set
+    bool onFlash;
+    ImageMetadata meta;         // valid false when the JPEG had none
+};
+
+// Newest preview frame; rows not yet received read as mid gray
+struct PreviewImage {
+    uint32_t revision;          // Bands taken in; 0 = none yet
+    uint32_t receivedAt;        // millis() of the last band
+    uint64_t rows;              // Bit r set = row r received
+    uint16_t cameraId;
+    uint8_t deviceId;
+    uint8_t width;
+    uint8_t height;
+    uint8_t bits;
+    uint8_t pixels[PREVIEW_MAX_BYTES];
+};
+
+struct ImageSlot {
+    uint32_t id;                // 0 when free
+    uint32_t lastUsed;          // Use tick
+    bool loading;               // Being filled from flash, outside the mutex
+    uint8_t* data;
+    size_t length;
+};
+
+class ImageCache {
+public:
+    ImageCache();
+    ~ImageCache();
+
+    // After Columns().begin(), which mounts LittleFS; catalogs the images
+    // already on flash
+    bool begin();
+    void end();
+    bool isReady() const { return mutex != nullptr; }
+
+    // The fragment transfer complete callback; RX task
+    static void onTransferComplete(void* context, uint8_t deviceId, PacketType contentType,
+                                   const uint8_t* data, size_t length);
+    bool receive(uint8_t deviceId, const uint8_t* data, size_t length);
+
+    // CAMERA_PREVIEW bands, on the RX task; getPreview() false until one is in
+    static void onRecordBatch(const ReceivedRecord* const* records, size_t count);
+    bool receivePreview(uint8_t deviceId, const uint8_t* payload, size_t length);
+    bool getPreview(PreviewImage& out) const;
+
+    // From loop(): thumbnail and flash for one new image, and the flash
+    // trimmed to MAX_FLASH_IMAGES
+    void update();
+
+    // Newest first, from the newest MAX_GALLERY_HISTORY; how many into
+    // out, and the total they are taken from
+    size_t getPage(size_t first, ImageInfo* out, size_t maxImages, size_t& total) const;
+    bool getInfo(uint32_t id, ImageInfo& info) const;
+
+    // Bytes of the image or its thumbnail from offset into out; 0 past
+    // the end or when it isn't held. Any task
+    size_t read(uint32_t id, bool thumbnail, size_t offset, uint8_t* out, size_t space);
+
+    // Changes on every catalog change - the gallery's ETag
+    uint32_t getRevision() const { return revision; }
+
+    // Statistics
+    uint32_t getImagesReceived() const { return imagesReceived; }
+    uint32_t getImagesDropped() const { return imagesDropped; }
+    uint32_t getCacheHits() const { return cacheHits; }
+    uint32_t getCacheMisses() const { return cacheMisses; }
+    void printStatus() const;
+
+private:
+    SemaphoreHandle_t mutex;    // Catalog and slots
+    bool spill;                 // LittleFS is there
+
+    // Oldest first, ids ascending: entries[(first + i) % IMAGE_CATALOG_SIZE]
+    ImageInfo* entries;
+    size_t first;
+    size_t count;
+    uint32_t nextId;
+    volatile uint32_t revision;
+
+    ImageSlot images[MAX_STORED_IMAGES];
+    ImageSlot thumbs[IMAGE_THUMB_SLOTS];
+    uint8_t* imagePool;
+    uint8_t* thumbPool;
+    uint32_t tick;
+
+    // update()'s copy of the image it is working on, and its thumbnail
+    uint8_t* work;
+    uint8_t* thumbWork;
+    BumpArena scratch;          // Decoded pixels, for one makeThumbnail() at a time
+
+    PreviewImage preview;
+    bool previewSink;
+
+    uint32_t imagesReceived;
+    uint32_t imagesDropped;
+    uint32_t previewBands;
+    uint32_t previewsDropped;   // Bands that didn't parse
+    uint32_t thumbnailFailures;
+    uint32_t writeErrors;
+    uint32_t cacheHits;
+    uint32_t cacheMisses;
+
+    ImageInfo* find(uint32_t id) const;
+    ImageSlot* findSlot(ImageSlot* pool, size_t size, uint32_t id) const;
+    ImageSlot* victim(ImageSlot* pool, size_t size) const;
+    ImageSlot* store(ImageSlot* pool, size_t size, uint32_t id, const uint8_t* data, size_t length);
+    void release(uint32_t id);
+    void popOldest();
+
+    void loadCatalog();
+    void loadMetadata(ImageInfo& info) const;
+    bool writeImage(const ImageInfo& info, const uint8_t* jpeg, const uint8_t* thumb);
+    void removeFiles(uint32_t id);
+    size_t readFile(uint32_t id, bool thumbnail, size_t offset, uint8_t* out, size_t space) const;
+    bool makeThumbnail(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height,
+                       uint16_t& thumbLength);
+
+    static void imagePath(char* out, uint32_t id, bool thumbnail);
+};
+
+// Frame size from the JPEG's SOF header; false if there is none
+bool jpegDimensions(const uint8_t* jpeg, size_t length, uint16_t& width, uint16_t& height);
+
+ImageCache& Images();
+
+#endif // BASE_STATION_IMAGES_H
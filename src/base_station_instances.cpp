@@ -0,0 +1,123 @@
+// ===========================
+// Global Instance Definitions
+// ESP32-S3 Balloon Project - Base Station
+// ===========================
+
+// The shared modules keep their own instances; LoRaManager's lives with the
+// balloon's managers in balloon_instances.cpp, which this build leaves out
+
+#include "base_station_config.h"
+#include "lora_comm.h"
+#include "packet_handler.h"
+#include "packet_store.h"
+#include "rx_pipeline.h"
+#include "fragment_transfer.h"
+#include "debug_utils.h"
+#include "trace_buffer.h"
+#include "stage_profiler.h"
+#include "task_placement.h"
+#include "task_watchdog.h"
+#include "energy_ledger.h"
+#include "time_service.h"
+#include "power_scaling.h"
+#include "base_station_images.h"
+#include "base_station_alerts.h"
+#include "base_station_latency.h"
+#include "base_station_fanout.h"
+#include "base_station_sessions.h"
+#include "base_station_rollups.h"
+#include "base_station_columns.h"
+#include "base_station_flights.h"
+#include "base_station_predictor.h"
+#include "base_station_firmware.h"
+#include "base_station_capture.h"
+#include "base_station_tiles.h"
+#include "base_station_track.h"
+#include "base_station_diversity.h"
+#include "base_station_share.h"
+#include "base_station_web.h"
+#include "gzip_stream.h"
+#include "memory_budget.h"
+
+static LoRaManager loraManagerInstance;
+static LoRaManager bulkLoRaInstance(LinkRole::BULK);
+
+LoRaManager& LoRaComm() { return loraManagerInstance; }
+LoRaManager& BulkLoRa() { return bulkLoRaInstance; }
+
+// ===========================
+// Memory Budget
+// ===========================
+
+// Every manager with a static instance in this build, and the blocks
+// begin() reserves. The rollups' per-balloon history comes with each
+// balloon heard and isn't listed.
+#define BASE_INTERNAL_BUDGET        (128 * 1024)    // Statics; WiFi, the radio and the heap want the rest
+#define BASE_PSRAM_BUDGET           (4 * 1024 * 1024)
+
+#define IMAGE_CACHE_RESERVED_BYTES                                                                      \
+    (IMAGE_CATALOG_SIZE * sizeof(ImageInfo) + (size_t)MAX_STORED_IMAGES * MAX_IMAGE_SIZE +             \
+     IMAGE_THUMB_SLOTS * IMAGE_THUMB_MAX_BYTES + MAX_IMAGE_SIZE + IMAGE_THUMB_MAX_BYTES + IMAGE_SCRATCH_BYTES)
+
+#define BASE_MEMORY_BUDGET(STATIC, RESERVED)                                                            \
+    STATIC(LoRaManager, 2, 48 * 1024)                                                                   \
+    STATIC(PacketHandler, 1, 24 * 1024)                                                                 \
+    STATIC(ImageCache, 1, 8 * 1024)                                                                     \
+    STATIC(AlertEngine, 1, 6 * 1024)                                                                    \
+    STATIC(LatencyMonitor, 1, 4 * 1024)                                                                 \
+    STATIC(WsFanout, 1, 2 * 1024)                                                                       \
+    STATIC(DiversityLink, 1, 4 * 1024)                                                                  \
+    STATIC(PositionShare, 1, 512)                                                                       \
+    STATIC(DebugUtils, 1, 2 * 1024)                                                                     \
+    STATIC(StageProfiler, 1, 2 * 1024)                                                                  \
+    STATIC(TaskUsageMonitor, 1, 2 * 1024)                                                               \
+    STATIC(TraceBuffer, 1, 2 * 1024)                                                                    \
+    STATIC(ReceivePipeline, 1, 2 * 1024)                                                                \
+    STATIC(SessionTable, 1, 1024)                                                                       \
+    STATIC(RollupStore, 1, 1024)                                                                        \
+    STATIC(FragmentManager, 1, 1024)                                                                    \
+    STATIC(EnergyLedger, 1, 1024)                                                                       \
+    STATIC(MemoryLedger, 1, 1024)                                                                       \
+    STATIC(PacketStore, 1, 1024)                                                                        \
+    STATIC(TaskWatchdog, 1, 1024)                                                                       \
+    STATIC(TileServer, 1, 512)                                                                          \
+    STATIC(FirmwareUploader, 1, 256)                                                                    \
+    STATIC(ColumnStore, 1, 256)                                                                         \
+    STATIC(FlightCatalog, 1, 256)                                                                       \
+    STATIC(CaptureStore, 1, 256)                                                                        \
+    STATIC(GzipStream, 1, 256)                                                                          \
+    STATIC(LandingPredictor, 1, 256)                                                                    \
+    STATIC(TrackStore, 1, 256)                                                                          \
+    STATIC(TimeService, 1, 256)                                                                         \
+    STATIC(PowerScaling, 1, 256)                                                                        \
+    RESERVED("image cache", MemRegion::PSRAM, IMAGE_CACHE_RESERVED_BYTES, 5 * 512 * 1024)              \
+    RESERVED("packet store", MemRegion::PSRAM, MAX_STORED_PACKETS * sizeof(StoredPacket), 64 * 1024)    \
+    RESERVED("columns", MemRegion::PSRAM, COLUMN_MAX_DEVICES * sizeof(DeviceColumns), 128 * 1024)       \
+    RESERVED("flights", MemRegion::PSRAM, FLIGHT_CATALOG_MAX * sizeof(FlightRecord), 8 * 1024)          \
+    RESERVED("tracks", MemRegion::PSRAM, TRACK_STORE_DEVICES * TRACK_STORE_VERTICES * sizeof(TrackVertex),\
+             192 * 1024)                                                                                \
+    RESERVED("link capture", MemRegion::PSRAM, 2 * CAPTURE_BUFFER_BYTES, 32 * 1024)                     \
+    RESERVED("tile cache", MemRegion::PSRAM,                                                            \
+             TILE_CACHE_SLOTS * TILE_CACHE_SLOT_BYTES + TILE_CHUNK_BYTES, 640 * 1024)                   \
+    RESERVED("tile index", MemRegion::PSRAM, TILE_INDEX_MAX * sizeof(TileIndexEntry), 256 * 1024)       \
+    RESERVED("fanout", MemRegion::PSRAM, FANOUT_POOL_BLOCKS * FANOUT_POOL_BLOCK_BYTES, 128 * 1024)      \
+    RESERVED("log ring", MemRegion::PSRAM, DEBUG_LOG_RING_BYTES, 256 * 1024)                            \
+    RESERVED("trace ring", TRACE_BUFFER_IN_PSRAM ? MemRegion::PSRAM : MemRegion::INTERNAL,              \
+             (TRACE_BUFFER_IN_PSRAM ? TRACE_BUFFER_EVENTS : TRACE_FALLBACK_EVENTS) * sizeof(TraceEvent), \
+             256 * 1024)                                                                                \
+    RESERVED("rx records", MemRegion::PSRAM,                                                            \
+             (RX_MAX_DEVICES * RX_REORDER_DEPTH + RX_BATCH_SIZE) * sizeof(ReceivedRecord), 32 * 1024)   \
+    RESERVED("reassembly", MemRegion::PSRAM, FRAGMENT_REASSEMBLY_SLOTS * FRAGMENT_MAX_TRANSFER_BYTES,   \
+             FRAGMENT_REASSEMBLY_MAX_BYTES)                                                             \
+    RESERVED("fragment send", MemRegion::PSRAM, FRAGMENT_MAX_TRANSFER_BYTES, 64 * 1024)                 \
+    RESERVED("web gzip", MemRegion::PSRAM, GZIP_STATE_BYTES, 32 * 1024)                                 \
+    RESERVED("api document", MemRegion::PSRAM, BASE_API_DOC_BYTES, 32 * 1024)                           \
+    RESERVED("position share", MemRegion::PSRAM,                                                        \
+             SHARE_QUEUE_DEPTH * sizeof(ShareRecord) + 2 * SHARE_BATCH_BYTES, 48 * 1024)
+
+MEM_BUDGET_TABLE(baseStationBudget, BASE_MEMORY_BUDGET, BASE_INTERNAL_BUDGET, BASE_PSRAM_BUDGET)
+
+const MemBudgetEntry* memBudgetTable(size_t& count) {
+    count = sizeof(baseStationBudget) / sizeof(baseStationBudget[0]);
+    return baseStationBudget;
+}
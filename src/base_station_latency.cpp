@@ -0,0 +1,178 @@
+#include "base_station_config.h"
+#include "base_station_latency.h"
+
+static LatencyMonitor latencyMonitorInstance;
+
+LatencyMonitor& Latency() {
+    return latencyMonitorInstance;
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+LatencyMonitor::LatencyMonitor() {
+    memset(types, 0, sizeof(types));
+    typeCount = 0;
+    unstamped = 0;
+    untracked = 0;
+    registered = false;
+    portMUX_INITIALIZE(&lock);
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool LatencyMonitor::begin() {
+    if (registered) {
+        return true;
+    }
+    registered = RxPipeline().addSink(onRecordBatch);
+    return registered;
+}
+
+// ===========================
+// Recording (pipeline task)
+// ===========================
+
+void LatencyMonitor::onRecordBatch(const ReceivedRecord* const* records, size_t count) {
+    uint32_t now = millis();
+    for (size_t i = 0; i < count; i++) {
+        latencyMonitorInstance.record(*records[i], now);
+    }
+}
+
+void LatencyMonitor::record(const ReceivedRecord& record, uint32_t now) {
+    const LatencyStamp& stamp = record.latency;
+    if (!stamp.valid) {
+        unstamped++;
+        return;
+    }
+
+    uint32_t stages[LINK_STAGE_COUNT];
+    stages[static_cast<uint8_t>(LinkStage::SAMPLE)] = stamp.sampleMs;
+    stages[static_cast<uint8_t>(LinkStage::QUEUE)] = stamp.queueMs;
+    stages[static_cast<uint8_t>(LinkStage::RETRY)] = stamp.retryMs;
+    stages[static_cast<uint8_t>(LinkStage::AIRTIME)] = (stamp.airtimeUs + 999) / 1000;
+    stages[static_cast<uint8_t>(LinkStage::DECODE)] = now - stamp.rxAt;
+    uint32_t total = 0;
+    for (uint8_t s = 0; s < static_cast<uint8_t>(LinkStage::TOTAL); s++) {
+        total += stages[s];
+    }
+    stages[static_cast<uint8_t>(LinkStage::TOTAL)] = total;
+
+    portENTER_CRITICAL(&lock);
+    LinkLatencyStats* stats = nullptr;
+    for (uint8_t i = 0; i < typeCount; i++) {
+        if (types[i].type == record.type) {
+            stats = &types[i];
+            break;
+        }
+    }
+    if (!stats && typeCount < LATENCY_MAX_TYPES) {
+        stats = &types[typeCount++];
+        stats->type = record.type;
+    }
+    if (stats) {
+        stats->stamped++;
+        stats->retransmitted += stamp.attempt > 1 ? 1 : 0;
+        for (uint8_t s = 0; s < LINK_STAGE_COUNT; s++) {
+            add(stats->stages[s], stages[s]);
+        }
+    } else {
+        untracked++;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void LatencyMonitor::add(LinkHistogram& histogram, uint32_t ms) {
+    int bucket = ms < 2 ? 0 : 31 - __builtin_clz(ms);
+    if (bucket >= LATENCY_BUCKETS) {
+        bucket = LATENCY_BUCKETS - 1;
+    }
+
+    // Same halving as PacketHandler's histograms - the shape outlives the counts
+    if (histogram.buckets[bucket] == 0xFFFF) {
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            histogram.buckets[i] >>= 1;
+        }
+    }
+    histogram.buckets[bucket]++;
+    histogram.samples++;
+    if (ms > histogram.maxMs) {
+        histogram.maxMs = ms;
+    }
+}
+
+// ===========================
+// Readers (any task)
+// ===========================
+
+uint8_t LatencyMonitor::getTypeCount() const {
+    portENTER_CRITICAL(&lock);
+    uint8_t count = typeCount;
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
+
+bool LatencyMonitor::getStats(uint8_t index, LinkLatencyStats& stats) const {
+    portENTER_CRITICAL(&lock);
+    bool found = index < typeCount;
+    if (found) {
+        stats = types[index];
+    }
+    portEXIT_CRITICAL(&lock);
+    return found;
+}
+
+uint32_t LatencyMonitor::percentile(const LinkHistogram& histogram, uint8_t percent) {
+    uint32_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        total += histogram.buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint32_t target = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        seen += histogram.buckets[i];
+        if (seen >= target) {
+            uint32_t edge = 2u << i;
+            return edge < histogram.maxMs ? edge : histogram.maxMs;
+        }
+    }
+    return histogram.maxMs;
+}
+
+const char* LatencyMonitor::stageToString(LinkStage stage) {
+    switch (stage) {
+        case LinkStage::SAMPLE: return "sample";
+        case LinkStage::QUEUE: return "queue";
+        case LinkStage::RETRY: return "retry";
+        case LinkStage::AIRTIME: return "airtime";
+        case LinkStage::DECODE: return "decode";
+        case LinkStage::TOTAL: return "total";
+        default: return "unknown";
+    }
+}
+
+void LatencyMonitor::printStatus() const {
+    static LinkLatencyStats stats;      // Off the loop task's stack
+
+    Serial.println("=== Link Latency ===");
+    Serial.printf("Unstamped records: %lu, stamped with the type table full: %lu\n",
+                  (unsigned long)unstamped, (unsigned long)untracked);
+    for (uint8_t i = 0; getStats(i, stats); i++) {
+        Serial.printf("  %s: %lu stamped, %lu retransmitted, ms p50/p99:", packetTypeToString(stats.type),
+                      (unsigned long)stats.stamped, (unsigned long)stats.retransmitted);
+        for (uint8_t s = 0; s < LINK_STAGE_COUNT; s++) {
+            Serial.printf(" %s %lu/%lu", stageToString(static_cast<LinkStage>(s)),
+                          (unsigned long)percentile(stats.stages[s], 50),
+                          (unsigned long)percentile(stats.stages[s], 99));
+        }
+        Serial.println();
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef BASE_STATION_LATENCY_H
+#define BASE_STATION_LATENCY_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "rx_pipeline.h"
+
+// ===========================
+// Link Latency (base station)
+// How stale each packet type is on arrival, from the balloon's reading to
+// the record reaching the sinks, by stage
+// ===========================
+
+// The balloon stamps its ACKed frames (LORA_LATENCY_STAMPS) with how long
+// the packet waited on its side: reading to packet (sample), packet to the
+// first hand-off to the radio (queue), and that hand-off to the one that got
+// through (retry). The two ends share no clock - only the balloon has GPS
+// time - so those three are the balloon's own millis() differences, and
+// this end adds its own from the frame's RX_DONE: its time on air at the
+// current settings (airtime) and RX_DONE to the record reaching this sink
+// through the dedup and reorder stages (decode). total is their sum per
+// record. The radio task's LBT wait and the preamble search fall between
+// the two clocks and are in none of them.
+//
+// Each histogram is log2 milliseconds like PacketHandler's microsecond
+// ones, halved together when a bucket would overflow; percentiles are the
+// upper edge of the bucket they fall in, capped at the largest seen.
+// Records from the pipeline task, reads from any task through a copy.
+
+#define LATENCY_MAX_TYPES          8       // Packet types tracked, first come
+#define LATENCY_BUCKETS            22      // Bucket b counts [2^b, 2^(b+1)) ms; the last is open-ended (>= 35 min)
+
+enum class LinkStage : uint8_t {
+    SAMPLE = 0,
+    QUEUE,
+    RETRY,
+    AIRTIME,
+    DECODE,
+    TOTAL,
+    COUNT
+};
+
+#define LINK_STAGE_COUNT static_cast<uint8_t>(LinkStage::COUNT)
+
+struct LinkHistogram {
+    uint16_t buckets[LATENCY_BUCKETS];
+    uint32_t samples;
+    uint32_t maxMs;
+};
+
+struct LinkLatencyStats {
+    PacketType type;
+    uint32_t stamped;
+    uint32_t retransmitted;     // Got through on a later attempt than the first
+    LinkHistogram stages[LINK_STAGE_COUNT];
+};
+
+class LatencyMonitor {
+public:
+    LatencyMonitor();
+
+    // Before RxPipeline().begin() - the sink can't be taken back off
+    bool begin();
+    bool isReady() const { return registered; }
+
+    // Copies of the tracked types, in the order first heard
+    uint8_t getTypeCount() const;
+    bool getStats(uint8_t index, LinkLatencyStats& stats) const;
+    uint32_t getUnstamped() const { return unstamped; }
+
+    static uint32_t percentile(const LinkHistogram& histogram, uint8_t percent);
+    static const char* stageToString(LinkStage stage);
+
+    void printStatus() const;
+
+private:
+    LinkLatencyStats types[LATENCY_MAX_TYPES];
+    uint8_t typeCount;
+    volatile uint32_t unstamped;        // Records that came without a stamp
+    uint32_t untracked;                 // Stamped, with the type table full
+    bool registered;
+    mutable portMUX_TYPE lock;
+
+    void record(const ReceivedRecord& record, uint32_t now);
+    static void add(LinkHistogram& histogram, uint32_t ms);
+    static void onRecordBatch(const ReceivedRecord* const* records, size_t count);
+};
+
+LatencyMonitor& Latency();
+
+#endif // BASE_STATION_LATENCY_H
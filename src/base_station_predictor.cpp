@@ -0,0 +1,383 @@
+#include "base_station_config.h"
+#include "base_station_predictor.h"
+#include "base_station_sessions.h"
+#include "base_station_columns.h"
+#include "memory_ledger.h"
+#include <cmath>
+
+static LandingPredictor landingPredictorInstance;
+
+LandingPredictor& Predictor() {
+    return landingPredictorInstance;
+}
+
+#define PREDICT_EARTH_RADIUS_M   6371000.0
+
+const char* flightLegName(FlightLeg leg) {
+    switch (leg) {
+        case FlightLeg::ASCENT: return "ascent";
+        case FlightLeg::DESCENT: return "descent";
+        case FlightLeg::LANDED: return "landed";
+        default: return "unknown";
+    }
+}
+
+// sqrt(rho0 / rho) - how much faster than at sea level the parachute falls
+static float densityFactor(float altitude) {
+    return expf(altitude / (2.0f * PREDICT_SCALE_HEIGHT_M));
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+LandingPredictor::LandingPredictor() {
+    memset(tracks, 0, sizeof(tracks));
+    mutex = nullptr;
+    nextIndex = 0;
+    fixesUsed = 0;
+    maxComputeMicros = 0;
+}
+
+LandingPredictor::~LandingPredictor() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool LandingPredictor::begin() {
+    if (mutex) {
+        return true;
+    }
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex) {
+        return false;
+    }
+    nextIndex = Packets().getOldest();
+    return true;
+}
+
+void LandingPredictor::end() {
+    for (uint8_t d = 0; d < RX_MAX_DEVICES; d++) {
+        BalloonSession* session = tracks[d] ? Sessions().find(tracks[d]->deviceId) : nullptr;
+        if (session) {
+            session->track = nullptr;
+        }
+        memFree(MemTag::PREDICTOR, tracks[d]);
+        tracks[d] = nullptr;
+    }
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+}
+
+FlightTrack* LandingPredictor::track(uint8_t deviceId) {
+    BalloonSession* session = Sessions().open(deviceId);
+    if (!session || session->track) {
+        return session ? session->track : nullptr;
+    }
+    FlightTrack* created = (FlightTrack*)memCalloc(MemTag::PREDICTOR, 1, sizeof(FlightTrack));
+    if (!created) {
+        return nullptr;
+    }
+    created->active = true;
+    created->deviceId = deviceId;
+    created->leg = FlightLeg::ASCENT;
+    created->ascentRate = PREDICT_ASCENT_MPS;
+    created->descentRate = PREDICT_DESCENT_MPS;
+    created->descentVariance = PREDICT_DESCENT_SIGMA_MPS * PREDICT_DESCENT_SIGMA_MPS;
+    rebuild(*created, 0);   // No wind yet - every bin unseen
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    tracks[session->slot] = created;
+    session->track = created;
+    xSemaphoreGive(mutex);
+    return created;
+}
+
+// ===========================
+// Wind profile
+// ===========================
+
+uint16_t LandingPredictor::binOf(float altitude) {
+    if (altitude <= 0.0f) {
+        return 0;
+    }
+    return min((uint16_t)(altitude / PREDICT_BIN_M), (uint16_t)(PREDICT_BINS - 1));
+}
+
+void LandingPredictor::addWind(FlightTrack& track, float altitude, float east, float north) {
+    uint16_t b = binOf(altitude);
+    WindBin& bin = track.bins[b];
+    bin.count++;
+    float de = east - bin.east;
+    float dn = north - bin.north;
+    bin.east += de / bin.count;
+    bin.north += dn / bin.count;
+    bin.m2ee += de * (east - bin.east);
+    bin.m2nn += dn * (north - bin.north);
+    bin.m2en += de * (north - bin.north);
+    track.windSamples++;
+    rebuild(track, b);
+}
+
+// Terms and prefix sums from fromBin up - or from the ground when the bins
+// below it lean on it, having none measured of their own
+void LandingPredictor::rebuild(FlightTrack& track, uint16_t fromBin) {
+    uint16_t lowest = 0;
+    while (lowest < PREDICT_BINS && track.bins[lowest].count == 0) {
+        lowest++;
+    }
+    uint16_t start = fromBin <= lowest ? 0 : fromBin;
+
+    // An unseen bin has the wind of the nearest measured one below, or
+    // above when there is none below
+    float east = 0.0f;
+    float north = 0.0f;
+    if (start > 0) {
+        east = track.term[TERM_ASCENT_E][start - 1];
+        north = track.term[TERM_ASCENT_N][start - 1];
+    } else if (lowest < PREDICT_BINS) {
+        east = track.bins[lowest].east;
+        north = track.bins[lowest].north;
+    }
+
+    const float floor2 = PREDICT_WIND_SIGMA_MPS * PREDICT_WIND_SIGMA_MPS;
+    const float unseen2 = PREDICT_UNSEEN_SIGMA_MPS * PREDICT_UNSEEN_SIGMA_MPS;
+    for (uint16_t i = start; i < PREDICT_BINS; i++) {
+        const WindBin& bin = track.bins[i];
+        float vee = unseen2;
+        float vnn = unseen2;
+        float ven = 0.0f;
+        if (bin.count > 0) {
+            east = bin.east;
+            north = bin.north;
+            float n = bin.count > 1 ? bin.count - 1 : 1;
+            vee = (bin.count > 1 ? bin.m2ee / n : 0.0f) + floor2;
+            vnn = (bin.count > 1 ? bin.m2nn / n : 0.0f) + floor2;
+            ven = bin.count > 1 ? bin.m2en / n : 0.0f;
+        }
+
+        float invK = 1.0f / densityFactor((i + 0.5f) * PREDICT_BIN_M);
+        track.term[TERM_DESCENT_E][i] = east * invK;
+        track.term[TERM_DESCENT_N][i] = north * invK;
+        track.term[TERM_DESCENT_T][i] = invK;
+        track.term[TERM_DESCENT_EE][i] = vee * PREDICT_BIN_M * invK * invK;
+        track.term[TERM_DESCENT_NN][i] = vnn * PREDICT_BIN_M * invK * invK;
+        track.term[TERM_DESCENT_EN][i] = ven * PREDICT_BIN_M * invK * invK;
+        track.term[TERM_ASCENT_E][i] = east;
+        track.term[TERM_ASCENT_N][i] = north;
+        track.term[TERM_ASCENT_EE][i] = vee * PREDICT_BIN_M;
+        track.term[TERM_ASCENT_NN][i] = vnn * PREDICT_BIN_M;
+        track.term[TERM_ASCENT_EN][i] = ven * PREDICT_BIN_M;
+
+        for (uint8_t t = 0; t < TERM_COUNT; t++) {
+            track.prefix[t][i + 1] = track.prefix[t][i] + track.term[t][i] * PREDICT_BIN_M;
+        }
+    }
+}
+
+// A term integrated over altitude from..to, from the prefix sums; above the
+// top bin the top bin's value carries on
+float LandingPredictor::integral(const FlightTrack& track, PredictTerm term, float from, float to) {
+    auto cumulative = [&](float altitude) {
+        if (altitude >= PREDICT_BINS * PREDICT_BIN_M) {
+            return track.prefix[term][PREDICT_BINS] +
+                   track.term[term][PREDICT_BINS - 1] * (altitude - PREDICT_BINS * PREDICT_BIN_M);
+        }
+        uint16_t b = binOf(altitude);
+        return track.prefix[term][b] + track.term[term][b] * (altitude - b * PREDICT_BIN_M);
+    };
+    return cumulative(to) - cumulative(from);
+}
+
+// ===========================
+// Prediction
+// ===========================
+
+void LandingPredictor::predict(FlightTrack& track, double latitude, double longitude, float altitude,
+                               LandingPrediction& out) const {
+    float east = 0.0f;
+    float north = 0.0f;
+    float ee = 0.0f;
+    float nn = 0.0f;
+    float en = 0.0f;
+    float seconds = 0.0f;
+    float ground = track.groundAltitude;
+
+    if (track.leg != FlightLeg::LANDED) {
+        // Up to the burst at the ascent rate, first
+        float top = max(altitude, ground);
+        if (track.leg == FlightLeg::ASCENT) {
+            float burst = max(PREDICT_BURST_ALTITUDE_M, top);
+            float a = max(track.ascentRate, PREDICT_CLIMB_MPS);
+            east += integral(track, TERM_ASCENT_E, top, burst) / a;
+            north += integral(track, TERM_ASCENT_N, top, burst) / a;
+            ee += integral(track, TERM_ASCENT_EE, top, burst) / (a * a);
+            nn += integral(track, TERM_ASCENT_NN, top, burst) / (a * a);
+            en += integral(track, TERM_ASCENT_EN, top, burst) / (a * a);
+            seconds += (burst - top) / a;
+            top = burst;
+        }
+
+        // Then down under the parachute; the descent rate's spread
+        // stretches the drift along its own direction
+        float v0 = max(track.descentRate, 0.5f);
+        float de = integral(track, TERM_DESCENT_E, ground, top) / v0;
+        float dn = integral(track, TERM_DESCENT_N, ground, top) / v0;
+        float spread = track.descentVariance / (v0 * v0);
+        ee += integral(track, TERM_DESCENT_EE, ground, top) / (v0 * v0) + de * de * spread;
+        nn += integral(track, TERM_DESCENT_NN, ground, top) / (v0 * v0) + dn * dn * spread;
+        en += integral(track, TERM_DESCENT_EN, ground, top) / (v0 * v0) + de * dn * spread;
+        seconds += integral(track, TERM_DESCENT_T, ground, top) / v0;
+        east += de;
+        north += dn;
+    }
+    ee += PREDICT_POSITION_SIGMA_M * PREDICT_POSITION_SIGMA_M;
+    nn += PREDICT_POSITION_SIGMA_M * PREDICT_POSITION_SIGMA_M;
+
+    // Flat earth over a flight's drift
+    out.latitude = latitude + (north / PREDICT_EARTH_RADIUS_M) * (180.0 / M_PI);
+    out.longitude = longitude + (east / (PREDICT_EARTH_RADIUS_M * cos(latitude * M_PI / 180.0))) * (180.0 / M_PI);
+
+    // Eigenvalues of the 2x2 covariance are the axes' variances
+    float mean = (ee + nn) * 0.5f;
+    float radius = sqrtf((ee - nn) * (ee - nn) * 0.25f + en * en);
+    out.ellipseMajor = PREDICT_ELLIPSE_SIGMAS * sqrtf(mean + radius);
+    out.ellipseMinor = PREDICT_ELLIPSE_SIGMAS * sqrtf(max(mean - radius, 0.0f));
+    float fromEast = 0.5f * atan2f(2.0f * en, ee - nn) * (180.0f / (float)M_PI);
+    out.ellipseBearing = fmodf(450.0f - fromEast, 180.0f);
+
+    out.valid = true;
+    out.leg = track.leg;
+    out.secondsToLanding = seconds;
+    out.verticalSpeed = track.verticalSpeed;
+    out.descentRate = track.descentRate;
+    out.groundAltitude = ground;
+}
+
+// ===========================
+// Fixes (loop task)
+// ===========================
+
+void LandingPredictor::addFix(FlightTrack& track, const StoredPacket& packet) {
+    const GPSData& g = packet.data.gps;
+    uint32_t started = micros();
+
+    if (!track.haveFix) {
+        track.haveFix = true;
+        track.groundAltitude = g.altitude < PREDICT_LAUNCH_MAX_M ? g.altitude : 0.0f;
+        track.peakAltitude = g.altitude;
+        track.lastAltitude = g.altitude;
+        track.lastMs = packet.receivedAt;
+    }
+
+    // Vertical speed across fixes at least half a second apart
+    float dt = (packet.receivedAt - track.lastMs) / 1000.0f;
+    if (dt >= 0.5f) {
+        float rate = (g.altitude - track.lastAltitude) / dt;
+        track.verticalSpeed += PREDICT_RATE_SMOOTHING * (rate - track.verticalSpeed);
+        track.lastAltitude = g.altitude;
+        track.lastMs = packet.receivedAt;
+    }
+    track.peakAltitude = max(track.peakAltitude, g.altitude);
+    float vz = track.verticalSpeed;
+
+    if (track.leg == FlightLeg::ASCENT) {
+        if (track.windSamples == 0) {
+            track.groundAltitude = min(track.groundAltitude, g.altitude);  // Still on the pad
+        }
+        if (vz > PREDICT_CLIMB_MPS) {
+            // Ground velocity is the wind at this altitude
+            float course = g.course * (float)M_PI / 180.0f;
+            addWind(track, g.altitude, g.speed * sinf(course), g.speed * cosf(course));
+            track.ascentRate += PREDICT_RATE_SMOOTHING * (vz - track.ascentRate);
+        }
+        if (track.peakAltitude - g.altitude > PREDICT_BURST_DROP_M && vz < -PREDICT_SINK_MPS) {
+            track.leg = FlightLeg::DESCENT;
+        }
+    } else if (track.leg == FlightLeg::DESCENT) {
+        if (-vz > PREDICT_SINK_MPS) {
+            // EMA of the sea level rate and of its spread
+            float diff = -vz / densityFactor(g.altitude) - track.descentRate;
+            track.descentRate += PREDICT_RATE_SMOOTHING * diff;
+            track.descentVariance = (1.0f - PREDICT_RATE_SMOOTHING) *
+                                    (track.descentVariance + PREDICT_RATE_SMOOTHING * diff * diff);
+        }
+        if (fabsf(vz) < PREDICT_LANDED_MPS && g.altitude - track.groundAltitude < PREDICT_LANDED_HEIGHT_M) {
+            track.leg = FlightLeg::LANDED;
+        }
+    }
+
+    LandingPrediction prediction;
+    predict(track, g.latitude, g.longitude, g.altitude, prediction);
+    prediction.fixTime = Columns().toStoreTime(packet.receivedAt);
+    prediction.computeMicros = micros() - started;
+    maxComputeMicros = max(maxComputeMicros, prediction.computeMicros);
+    fixesUsed++;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    track.prediction = prediction;
+    xSemaphoreGive(mutex);
+}
+
+void LandingPredictor::update() {
+    if (!mutex) {
+        return;
+    }
+
+    static StoredPacket packet;         // Off the loop task's stack
+
+    nextIndex = max(nextIndex, Packets().getOldest());
+    for (uint32_t next = Packets().getNext(); nextIndex < next; nextIndex++) {
+        if (!Packets().get(nextIndex, packet) || !packet.decoded || packet.type != PacketType::GPS_DATA) {
+            continue;
+        }
+        const GPSData& g = packet.data.gps;
+        if (g.satellites < 4 || (g.latitude == 0.0f && g.longitude == 0.0f)) {
+            continue;           // No fix
+        }
+        FlightTrack* flight = track(packet.deviceId);
+        if (flight) {
+            addFix(*flight, packet);
+        }
+    }
+}
+
+// ===========================
+// Queries (any task)
+// ===========================
+
+bool LandingPredictor::getPrediction(uint8_t deviceId, LandingPrediction& out) const {
+    if (!mutex) {
+        return false;
+    }
+    const BalloonSession* session = Sessions().find(deviceId);
+    bool found = false;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (session && session->track && session->track->prediction.valid) {
+        out = session->track->prediction;
+        found = true;
+    }
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+void LandingPredictor::printStatus() const {
+    Serial.println("=== Landing Predictor ===");
+    Serial.printf("Fixes: %lu, slowest %lu us\n", (unsigned long)fixesUsed, (unsigned long)maxComputeMicros);
+    for (uint8_t d = 0; d < RX_MAX_DEVICES; d++) {
+        const FlightTrack* flight = tracks[d];
+        if (!flight || !flight->prediction.valid) {
+            continue;
+        }
+        const LandingPrediction& p = flight->prediction;
+        Serial.printf("Balloon %u: %s, %.5f,%.5f in %.0f s, ellipse %.0f x %.0f m at %.0f deg, "
+                      "%lu wind samples, descent %.1f m/s\n",
+                      flight->deviceId, flightLegName(p.leg), p.latitude, p.longitude, p.secondsToLanding,
+                      p.ellipseMajor, p.ellipseMinor, p.ellipseBearing, (unsigned long)flight->windSamples,
+                      p.descentRate);
+    }
+}
@@ -0,0 +1,168 @@
+#ifndef BASE_STATION_PREDICTOR_H
+#define BASE_STATION_PREDICTOR_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "packet_store.h"
+
+// ===========================
+// Landing Predictor (base station)
+// Where each balloon will come down, and how sure that is, updated on
+// every GPS fix from a wind profile the ascent measured
+// ===========================
+
+// The ascent's fixes give the wind: a balloon drifts with the air, so its
+// ground velocity (speed and course) is the wind at its altitude. Each fix
+// goes into a PREDICT_BIN_M altitude bin as a running mean and covariance.
+// Bins the balloon hasn't been through take the nearest measured one below
+// with PREDICT_UNSEEN_SIGMA_MPS of doubt.
+//
+// Under the parachute the descent rate is v0 * sqrt(rho0 / rho), with the
+// density falling off as exp(-h / PREDICT_SCALE_HEIGHT_M); v0, the sea
+// level rate, is fitted from the descent as it is seen. The drift from an
+// altitude to the ground is then the integral of wind / (v0 * k(h)) over
+// the height, k the density factor - 1/v0 times an integral of the profile
+// alone. Each bin's share of it is kept as a prefix sum from the ground up,
+// rebuilt from the changed bin when a fix updates one, so a prediction is
+// a difference of two prefix sums and no simulation steps at all. On the
+// way up the ascent to PREDICT_BURST_ALTITUDE_M at the measured ascent
+// rate is added the same way.
+//
+// The uncertainty is the per-bin wind variance summed the same way (bins
+// taken as independent), plus the drift scaled by the descent rate's own
+// spread, plus PREDICT_POSITION_SIGMA_M; its ellipse is reported at
+// PREDICT_ELLIPSE_SIGMAS.
+//
+// update() runs from loop() and reads new GPS fixes out of the packet
+// store by index; getPrediction() copies the latest out on any task.
+
+#define PREDICT_BIN_M              250.0f
+#define PREDICT_BINS               160     // To 40 km
+#define PREDICT_SCALE_HEIGHT_M     7000.0f // Density e-folding height, close enough below 30 km
+#define PREDICT_BURST_ALTITUDE_M   30000.0f
+#define PREDICT_ASCENT_MPS         5.0f    // Until the ascent is measured
+#define PREDICT_DESCENT_MPS        5.0f    // Sea level rate under the parachute, until measured
+#define PREDICT_DESCENT_SIGMA_MPS  1.5f
+#define PREDICT_WIND_SIGMA_MPS     1.0f    // Floor on a measured bin's spread
+#define PREDICT_UNSEEN_SIGMA_MPS   5.0f
+#define PREDICT_POSITION_SIGMA_M   50.0f
+#define PREDICT_ELLIPSE_SIGMAS     2.0f
+#define PREDICT_RATE_SMOOTHING     0.3f    // Vertical speed EMA weight per fix
+#define PREDICT_CLIMB_MPS          1.0f    // Rising faster than this: an ascent fix, wind measured
+#define PREDICT_SINK_MPS           2.0f    // Falling faster than this, PREDICT_BURST_DROP_M below the peak: descending
+#define PREDICT_BURST_DROP_M       200.0f
+#define PREDICT_LANDED_MPS         0.5f    // Slower than this within PREDICT_LANDED_HEIGHT_M of the ground: landed
+#define PREDICT_LANDED_HEIGHT_M    100.0f
+#define PREDICT_LAUNCH_MAX_M       3000.0f // A first fix below this is the launch site's altitude
+
+enum class FlightLeg : uint8_t {
+    ASCENT = 0,
+    DESCENT,
+    LANDED
+};
+
+const char* flightLegName(FlightLeg leg);
+
+struct LandingPrediction {
+    bool valid;
+    FlightLeg leg;
+    double latitude;            // Predicted landing point
+    double longitude;
+    float ellipseMajor;         // Semi-axes, m, at PREDICT_ELLIPSE_SIGMAS
+    float ellipseMinor;
+    float ellipseBearing;       // Major axis, degrees clockwise from north
+    float secondsToLanding;
+    float verticalSpeed;        // m/s, smoothed over the fixes
+    float descentRate;          // Fitted sea level rate under the parachute
+    float groundAltitude;       // m - the launch site's, taken as the landing's
+    uint32_t fixTime;           // Store-clock seconds of the fix it was made from
+    uint32_t computeMicros;     // That fix's update and prediction
+};
+
+// One altitude bin's wind, running mean and covariance (Welford)
+struct WindBin {
+    uint16_t count;
+    float east;                 // m/s
+    float north;
+    float m2ee;
+    float m2nn;
+    float m2en;
+};
+
+// The profile's integrands per bin and their prefix sums from the ground
+enum PredictTerm : uint8_t {
+    TERM_DESCENT_E = 0,         // wind / k
+    TERM_DESCENT_N,
+    TERM_DESCENT_T,             // 1 / k - time
+    TERM_DESCENT_EE,            // covariance * PREDICT_BIN_M / k^2
+    TERM_DESCENT_NN,
+    TERM_DESCENT_EN,
+    TERM_ASCENT_E,              // wind
+    TERM_ASCENT_N,
+    TERM_ASCENT_EE,             // covariance * PREDICT_BIN_M
+    TERM_ASCENT_NN,
+    TERM_ASCENT_EN,
+    TERM_COUNT
+};
+
+struct FlightTrack {
+    bool active;
+    uint8_t deviceId;
+    bool haveFix;
+    FlightLeg leg;
+    uint32_t lastMs;            // receivedAt of the last fix
+    float lastAltitude;
+    float verticalSpeed;
+    float peakAltitude;
+    float groundAltitude;
+    float ascentRate;
+    float descentRate;          // v0
+    float descentVariance;
+    uint32_t windSamples;
+    WindBin bins[PREDICT_BINS];
+    float term[TERM_COUNT][PREDICT_BINS];
+    float prefix[TERM_COUNT][PREDICT_BINS + 1];
+    LandingPrediction prediction;
+};
+
+class LandingPredictor {
+public:
+    LandingPredictor();
+    ~LandingPredictor();
+
+    // After Packets().begin()
+    bool begin();
+    void end();
+    bool isReady() const { return mutex != nullptr; }
+
+    // From loop(): one prediction per new GPS fix
+    void update();
+
+    // The latest for one balloon; false before its first fix
+    bool getPrediction(uint8_t deviceId, LandingPrediction& out) const;
+
+    void printStatus() const;
+
+private:
+    FlightTrack* tracks[RX_MAX_DEVICES];    // PSRAM, by session slot, from the balloon's first fix
+    SemaphoreHandle_t mutex;                // The predictions
+    uint32_t nextIndex;
+    uint32_t fixesUsed;
+    uint32_t maxComputeMicros;
+
+    FlightTrack* track(uint8_t deviceId);
+    void addFix(FlightTrack& track, const StoredPacket& packet);
+    void addWind(FlightTrack& track, float altitude, float east, float north);
+    void rebuild(FlightTrack& track, uint16_t fromBin);
+    void predict(FlightTrack& track, double latitude, double longitude, float altitude,
+                 LandingPrediction& out) const;
+
+    static float integral(const FlightTrack& track, PredictTerm term, float from, float to);
+    static uint16_t binOf(float altitude);
+};
+
+LandingPredictor& Predictor();
+
+#endif // BASE_STATION_PREDICTOR_H
@@ -0,0 +1,346 @@
+#include "base_station_config.h"
+#include "base_station_range.h"
+#include "base_station_rollups.h"
+#include "crc_utils.h"
+#include "memory_ledger.h"
+
+// ===========================
+// Cursor
+// ===========================
+
+void rangeCursorEncode(const RangeRequest& request, char* out) {
+    uint8_t bytes[RANGE_CURSOR_BYTES];
+    bytes[0] = RANGE_CURSOR_VERSION;
+    bytes[1] = request.deviceId;
+    bytes[2] = request.fields & 0xFF;
+    bytes[3] = request.fields >> 8;
+    bytes[4] = request.resolution & 0xFF;
+    bytes[5] = request.resolution >> 8;
+    bytes[6] = request.limit & 0xFF;
+    bytes[7] = request.limit >> 8;
+    for (int i = 0; i < 4; i++) {
+        bytes[8 + i] = request.from >> (8 * i);
+        bytes[12 + i] = request.to >> (8 * i);
+    }
+    uint16_t crc = crc16CcittUpdate(CRC16_CCITT_INIT, bytes, RANGE_CURSOR_BYTES - 2);
+    bytes[16] = crc & 0xFF;
+    bytes[17] = crc >> 8;
+
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < RANGE_CURSOR_BYTES; i++) {
+        out[2 * i] = hex[bytes[i] >> 4];
+        out[2 * i + 1] = hex[bytes[i] & 0x0F];
+    }
+    out[2 * RANGE_CURSOR_BYTES] = '\0';
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+bool rangeCursorDecode(const char* text, RangeRequest& request) {
+    if (strlen(text) != 2 * RANGE_CURSOR_BYTES) {
+        return false;
+    }
+    uint8_t bytes[RANGE_CURSOR_BYTES];
+    for (int i = 0; i < RANGE_CURSOR_BYTES; i++) {
+        int high = hexDigit(text[2 * i]);
+        int low = hexDigit(text[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes[i] = high << 4 | low;
+    }
+    uint16_t crc = crc16CcittUpdate(CRC16_CCITT_INIT, bytes, RANGE_CURSOR_BYTES - 2);
+    if (bytes[0] != RANGE_CURSOR_VERSION || (bytes[16] | bytes[17] << 8) != crc) {
+        return false;
+    }
+
+    // The CRC only catches damage - a cursor written by hand gets the same
+    // limits as a query string. The resolution's 16 bits are its range there
+    request.deviceId = bytes[1];
+    request.fields = (bytes[2] | bytes[3] << 8) & ((1u << COLUMN_COUNT) - 1);
+    request.resolution = bytes[4] | bytes[5] << 8;
+    request.limit = constrain(bytes[6] | bytes[7] << 8, 1, RANGE_API_MAX_ROWS);
+    request.from = 0;
+    request.to = 0;
+    for (int i = 0; i < 4; i++) {
+        request.from |= (uint32_t)bytes[8 + i] << (8 * i);
+        request.to |= (uint32_t)bytes[12 + i] << (8 * i);
+    }
+    return true;
+}
+
+// ===========================
+// Range Query
+// ===========================
+
+RangeQuery::RangeQuery() {
+    memset(&request, 0, sizeof(request));
+    stage = Stage::DONE;
+    columnCount = 0;
+    rows = 0;
+    buckets = nullptr;
+    level = 0;
+    chunkStart = 0;
+    chunkBuckets = 0;
+    position = 0;
+    lastChunk = true;
+    pending = false;
+    pendingTime = 0;
+}
+
+RangeQuery::~RangeQuery() {
+    end();
+}
+
+bool RangeQuery::begin(const RangeRequest& request) {
+    end();
+    if (request.fields == 0 || request.limit == 0 || request.from > request.to) {
+        return false;
+    }
+
+    this->request = request;
+    columnCount = 0;
+    for (uint8_t c = 0; c < COLUMN_COUNT; c++) {
+        if (request.fields & (1u << c)) {
+            columns[columnCount] = static_cast<Column>(c);
+            decimals[columnCount] = columnDecimals(columns[columnCount]);
+            columnCount++;
+        }
+    }
+
+    if (!bucketed()) {
+        if (!samples.begin(ExportFormat::JSON, request.deviceId, request.from, request.to, columns, columnCount)) {
+            return false;
+        }
+    } else {
+        // 8 KB with every field - memAlloc() puts it in PSRAM
+        buckets = (RangeBucket*)memAlloc(MemTag::EXPORT,
+                                         (size_t)columnCount * RANGE_CHUNK_BUCKETS * sizeof(RangeBucket));
+        if (!buckets) {
+            return false;
+        }
+
+        // The coarsest rollup level that tiles a bucket exactly
+        level = 0;
+        for (uint8_t l = 1; l < ROLLUP_LEVELS; l++) {
+            if (request.resolution % RollupStore::getResolution(l) == 0) {
+                level = l;
+            }
+        }
+        lastChunk = false;
+        fillChunk(request.from / request.resolution * request.resolution);
+    }
+
+    stage = Stage::HEADER;
+    rows = 0;
+    pending = false;
+    return true;
+}
+
+void RangeQuery::end() {
+    samples.end();
+    if (buckets) {
+        memFree(MemTag::EXPORT, buckets);
+        buckets = nullptr;
+    }
+    stage = Stage::DONE;
+}
+
+// ===========================
+// Buckets
+// ===========================
+
+struct BucketFill {
+    RangeBucket* buckets;       // The column's chunk
+    uint32_t start;
+    uint32_t resolution;
+    bool any;
+};
+
+static void addToBucket(BucketFill* fill, uint32_t time, float low, float high, float sum, uint32_t count) {
+    RangeBucket& bucket = fill->buckets[(time - fill->start) / fill->resolution];
+    if (bucket.count == 0) {
+        bucket.min = low;
+        bucket.max = high;
+        bucket.sum = sum;
+    } else {
+        bucket.min = min(bucket.min, low);
+        bucket.max = max(bucket.max, high);
+        bucket.sum += sum;
+    }
+    bucket.count += count;
+    fill->any = true;
+}
+
+static bool addSample(const TimeSeriesSample& sample, void* context) {
+    addToBucket(static_cast<BucketFill*>(context), sample.time, sample.value, sample.value, sample.value, 1);
+    return true;
+}
+
+static bool addPoint(const RollupPoint& point, void* context) {
+    addToBucket(static_cast<BucketFill*>(context), point.time, point.min, point.max, point.mean * point.count,
+                point.count);
+    return true;
+}
+
+static bool firstSample(const TimeSeriesSample& sample, void* context) {
+    *static_cast<uint32_t*>(context) = sample.time;
+    return false;
+}
+
+// The chunk of buckets from start, or from the next sample on past an empty one
+void RangeQuery::fillChunk(uint32_t start) {
+    uint32_t resolution = request.resolution;
+    while (true) {
+        uint64_t last = (uint64_t)start + (uint64_t)resolution * RANGE_CHUNK_BUCKETS - 1;
+        if (last >= request.to) {
+            last = request.to;
+            lastChunk = true;
+        }
+        chunkStart = start;
+        chunkBuckets = (uint32_t)((last - start) / resolution + 1);
+        position = 0;
+        memset(buckets, 0, (size_t)columnCount * RANGE_CHUNK_BUCKETS * sizeof(RangeBucket));
+
+        bool any = false;
+        for (uint8_t c = 0; c < columnCount; c++) {
+            BucketFill fill = {&buckets[c * RANGE_CHUNK_BUCKETS], start, resolution, false};
+            uint32_t oldest;
+            if (level > 0 && Rollups().getOldestHeld(request.deviceId, columns[c], oldest) && start >= oldest) {
+                Rollups().visit(request.deviceId, columns[c], level, start, (uint32_t)last, addPoint, &fill);
+            } else {
+                Columns().visit(request.deviceId, columns[c], start, (uint32_t)last, addSample, &fill);
+            }
+            any |= fill.any;
+        }
+        if (any || lastChunk) {
+            return;
+        }
+
+        uint32_t next;
+        if (!nextSampleAfter((uint32_t)last, next)) {
+            lastChunk = true;
+            chunkBuckets = 0;
+            return;
+        }
+        start = next / resolution * resolution;
+    }
+}
+
+bool RangeQuery::nextSampleAfter(uint32_t time, uint32_t& next) const {
+    bool found = false;
+    for (uint8_t c = 0; c < columnCount && time < request.to; c++) {
+        uint32_t first = 0;
+        if (Columns().visit(request.deviceId, columns[c], time + 1, request.to, firstSample, &first) &&
+            (!found || first < next)) {
+            next = first;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool RangeQuery::nextBucketRow() {
+    while (true) {
+        while (position < chunkBuckets) {
+            uint32_t i = position++;
+            bool any = false;
+            for (uint8_t c = 0; c < columnCount; c++) {
+                row[c] = buckets[c * RANGE_CHUNK_BUCKETS + i];
+                any |= row[c].count > 0;
+            }
+            if (any) {
+                pendingTime = chunkStart + i * request.resolution;
+                return true;
+            }
+        }
+        if (lastChunk) {
+            return false;
+        }
+        fillChunk(chunkStart + chunkBuckets * request.resolution);
+    }
+}
+
+// ===========================
+// Output
+// ===========================
+
+bool RangeQuery::fetch() {
+    return bucketed() ? nextBucketRow() : samples.nextRow(pendingTime, values, present);
+}
+
+size_t RangeQuery::read(char* out, size_t space) {
+    size_t used = 0;
+
+    if (stage == Stage::HEADER && space >= RANGE_ROW_MAX) {
+        used += writeHeader(out, space);
+        stage = Stage::ROWS;
+    }
+    while (stage == Stage::ROWS && space - used >= RANGE_ROW_MAX) {
+        // One row past the page is read ahead: its time is the cursor
+        if (!pending) {
+            pending = fetch();
+        }
+        if (!pending || rows == request.limit) {
+            stage = Stage::FOOTER;
+            break;
+        }
+        used += writeRow(out + used, space - used);
+        rows++;
+        pending = false;
+    }
+    if (stage == Stage::FOOTER && space - used >= RANGE_ROW_MAX) {
+        used += writeFooter(out + used, space - used);
+        stage = Stage::DONE;
+        end();
+    }
+    return used;
+}
+
+size_t RangeQuery::writeHeader(char* out, size_t space) const {
+    int used = snprintf(out, space, "{\"device\":%u,\"clock\":\"store_seconds\",\"resolution\":%u,\"fields\":[",
+                        request.deviceId, bucketed() ? request.resolution : 0);
+    for (uint8_t c = 0; c < columnCount; c++) {
+        used += snprintf(out + used, space - used, "%s\"%s\"", c ? "," : "", columnName(columns[c]));
+    }
+    used += snprintf(out + used, space - used, "],\"rows\":[\n");
+    return (size_t)used < space ? used : space - 1;
+}
+
+// [time, value...] raw, [time, [min, max, mean, count]...] bucketed; null where a field has none
+size_t RangeQuery::writeRow(char* out, size_t space) const {
+    int used = snprintf(out, space, "%s[%lu", rows ? ",\n" : "", (unsigned long)pendingTime);
+    for (uint8_t c = 0; c < columnCount; c++) {
+        if (!bucketed()) {
+            used += present[c] ? snprintf(out + used, space - used, ",%.*f", decimals[c], values[c])
+                               : snprintf(out + used, space - used, ",null");
+        } else if (row[c].count) {
+            used += snprintf(out + used, space - used, ",[%.*f,%.*f,%.*f,%lu]", decimals[c], row[c].min,
+                             decimals[c], row[c].max, decimals[c] + 1, row[c].sum / row[c].count,
+                             (unsigned long)row[c].count);
+        } else {
+            used += snprintf(out + used, space - used, ",null");
+        }
+    }
+    used += snprintf(out + used, space - used, "]");
+    return (size_t)used < space ? used : space - 1;
+}
+
+size_t RangeQuery::writeFooter(char* out, size_t space) const {
+    if (!pending) {
+        return snprintf(out, space, "\n],\"next\":null}");
+    }
+    RangeRequest next = request;
+    next.from = pendingTime;
+    char cursor[RANGE_CURSOR_CHARS];
+    rangeCursorEncode(next, cursor);
+    return snprintf(out, space, "\n],\"next\":\"%s\"}", cursor);
+}
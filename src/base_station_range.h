@@ -0,0 +1,115 @@
+#ifndef BASE_STATION_RANGE_H
+#define BASE_STATION_RANGE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "base_station_columns.h"
+#include "base_station_export.h"
+
+// ===========================
+// Range Queries (base station)
+// Telemetry over any window, raw or bucketed, a page of rows at a time
+// with an opaque cursor to the next
+// ===========================
+
+// A RangeQuery is pulled like an ExportStream: each read() writes the next
+// rows as JSON into the caller's buffer, so the handler streams a page of
+// any size through one chunk buffer.
+//
+// Raw (resolution 0 or 1) rows are the column store's samples joined by
+// time through an ExportStream - the block index finds the first block at
+// from, and the page stops decoding at its last row.
+//
+// Bucketed rows are min/max/mean/count per resolution seconds, aligned to
+// multiples of it. They are built RANGE_CHUNK_BUCKETS buckets at a time from
+// the coarsest rollup level whose width divides the resolution, where the
+// rollups still hold the chunk, and from the column store's samples before
+// that. A chunk with nothing in it skips to the next sample any field has,
+// so a gap costs one block index search, not a bucket per second of it.
+//
+// A page ends at its row limit; the cursor then names the first time not
+// sent, along with the request, so the next page carries on exactly there
+// whatever arrives meanwhile. The cursor is the request packed and CRC'd
+// in hex: opaque to clients, and a mangled one is refused.
+
+#define RANGE_CHUNK_BUCKETS        32      // Buckets built per pass, per field
+#define RANGE_ROW_MAX              1024    // Longest row, every field bucketed
+#define RANGE_CURSOR_VERSION       1
+#define RANGE_CURSOR_BYTES         18      // Packed request and its CRC
+#define RANGE_CURSOR_CHARS         (RANGE_CURSOR_BYTES * 2 + 1)
+
+struct RangeRequest {
+    uint8_t deviceId;
+    uint16_t fields;            // Bit per Column; rows list them in Column order
+    uint16_t resolution;        // Seconds per bucket; 0 or 1 for the samples
+    uint16_t limit;             // Rows per page
+    uint32_t from;              // Store-clock seconds, inclusive
+    uint32_t to;
+};
+
+// Into out, RANGE_CURSOR_CHARS with its terminator
+void rangeCursorEncode(const RangeRequest& request, char* out);
+// false for anything rangeCursorEncode() didn't write
+bool rangeCursorDecode(const char* text, RangeRequest& request);
+
+struct RangeBucket {
+    float min;
+    float max;
+    float sum;
+    uint32_t count;
+};
+
+class RangeQuery {
+public:
+    RangeQuery();
+    ~RangeQuery();
+
+    bool begin(const RangeRequest& request);
+    void end();
+
+    // The next rows into out, at least RANGE_ROW_MAX of space; 0 once the
+    // page and its cursor are written
+    size_t read(char* out, size_t space);
+
+    uint32_t getRows() const { return rows; }
+
+private:
+    enum class Stage : uint8_t { HEADER, ROWS, FOOTER, DONE };
+
+    RangeRequest request;
+    Stage stage;
+    Column columns[COLUMN_COUNT];
+    uint8_t decimals[COLUMN_COUNT];
+    uint8_t columnCount;
+    uint32_t rows;
+
+    // Raw: the joined samples
+    ExportStream samples;
+
+    // Bucketed: buckets[c * RANGE_CHUNK_BUCKETS + i], the chunk from
+    // chunkStart, next unwritten at position
+    RangeBucket* buckets;
+    uint8_t level;              // Rollup level the resolution builds on
+    uint32_t chunkStart;
+    uint32_t chunkBuckets;
+    uint32_t position;
+    bool lastChunk;
+
+    // The next row, read ahead so a full page knows whether there are more
+    bool pending;
+    uint32_t pendingTime;
+    float values[COLUMN_COUNT];         // Raw
+    bool present[COLUMN_COUNT];
+    RangeBucket row[COLUMN_COUNT];      // Bucketed, count 0 where a field has none
+
+    bool bucketed() const { return request.resolution > 1; }
+    bool fetch();
+    bool nextBucketRow();
+    void fillChunk(uint32_t start);
+    bool nextSampleAfter(uint32_t time, uint32_t& next) const;
+    size_t writeHeader(char* out, size_t space) const;
+    size_t writeRow(char* out, size_t space) const;
+    size_t writeFooter(char* out, size_t space) const;
+};
+
+#endif // BASE_STATION_RANGE_H
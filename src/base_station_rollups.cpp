@@ -0,0 +1,314 @@
+#include "base_station_config.h"
+#include "base_station_rollups.h"
+#include "base_station_sessions.h"
+#include "memory_ledger.h"
+
+static RollupStore rollupStoreInstance;
+
+RollupStore& Rollups() {
+    return rollupStoreInstance;
+}
+
+// Seconds per bucket; level 0 is the samples
+static const uint16_t rollupResolution[ROLLUP_LEVELS] = {1, 10, 60};
+
+// Every coarser level's ring, end to end, per column
+static const uint32_t ROLLUP_BUCKETS_PER_COLUMN = ROLLUP_HISTORY_S / 10 + ROLLUP_HISTORY_S / 60;
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+RollupStore::RollupStore() {
+    memset(devices, 0, sizeof(devices));
+    mutex = nullptr;
+    samplesAdded = 0;
+    allocationFailures = 0;
+}
+
+RollupStore::~RollupStore() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+struct Replay {
+    uint8_t deviceId;
+    Column column;
+};
+
+static bool replaySample(const TimeSeriesSample& sample, void* context) {
+    const Replay* replay = static_cast<const Replay*>(context);
+    Rollups().add(replay->deviceId, replay->column, sample.time, sample.value);
+    return true;
+}
+
+bool RollupStore::begin() {
+    if (mutex) {
+        return true;
+    }
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex) {
+        return false;
+    }
+
+    // The graphs as they were before the reset
+    uint32_t now = Columns().now();
+    uint32_t from = now > ROLLUP_HISTORY_S ? now - ROLLUP_HISTORY_S : 0;
+    uint8_t ids[COLUMN_MAX_DEVICES];
+    uint8_t count = Columns().getDevices(ids, COLUMN_MAX_DEVICES);
+    for (uint8_t d = 0; d < count; d++) {
+        for (uint8_t c = 0; c < COLUMN_COUNT; c++) {
+            Replay replay = {ids[d], static_cast<Column>(c)};
+            Columns().visit(ids[d], replay.column, from, now, replaySample, &replay);
+        }
+    }
+    return true;
+}
+
+void RollupStore::end() {
+    for (uint8_t d = 0; d < COLUMN_MAX_DEVICES; d++) {
+        BalloonSession* session = devices[d].active ? Sessions().find(devices[d].deviceId) : nullptr;
+        if (session) {
+            session->rollups = nullptr;
+        }
+        memFree(MemTag::TIMESERIES, devices[d].samples);
+        memFree(MemTag::TIMESERIES, devices[d].buckets);
+        devices[d].samples = nullptr;
+        devices[d].buckets = nullptr;
+        devices[d].active = false;
+    }
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+}
+
+DeviceRollups* RollupStore::find(uint8_t deviceId) const {
+    const BalloonSession* session = Sessions().find(deviceId);
+    return session ? session->rollups : nullptr;
+}
+
+DeviceRollups* RollupStore::open(uint8_t deviceId) {
+    BalloonSession* session = Sessions().open(deviceId);
+    if (!session) {
+        return nullptr;
+    }
+    DeviceRollups& device = devices[session->slot];
+
+    // Zeroed, so every bucket reads as empty until written
+    device.samples = (RollupSample*)memCalloc(MemTag::TIMESERIES, (size_t)COLUMN_COUNT * ROLLUP_HISTORY_S,
+                                              sizeof(RollupSample));
+    device.buckets = (RollupBucket*)memCalloc(MemTag::TIMESERIES, (size_t)COLUMN_COUNT * ROLLUP_BUCKETS_PER_COLUMN,
+                                              sizeof(RollupBucket));
+    if (!device.samples || !device.buckets) {
+        memFree(MemTag::TIMESERIES, device.samples);
+        memFree(MemTag::TIMESERIES, device.buckets);
+        device.samples = nullptr;
+        device.buckets = nullptr;
+        allocationFailures++;
+        return nullptr;
+    }
+    memset(device.any, 0, sizeof(device.any));
+    device.deviceId = deviceId;
+    device.active = true;
+    session->rollups = &device;
+    return &device;
+}
+
+uint32_t RollupStore::ringSize(uint8_t level) {
+    return ROLLUP_HISTORY_S / rollupResolution[level];
+}
+
+uint16_t RollupStore::getResolution(uint8_t level) {
+    return level < ROLLUP_LEVELS ? rollupResolution[level] : 0;
+}
+
+// A coarser level's ring for the column
+RollupBucket* RollupStore::ring(const DeviceRollups& device, Column column, uint8_t level) const {
+    RollupBucket* bucket = device.buckets + static_cast<uint8_t>(column) * ROLLUP_BUCKETS_PER_COLUMN;
+    for (uint8_t l = 1; l < level; l++) {
+        bucket += ringSize(l);
+    }
+    return bucket;
+}
+
+// ===========================
+// Adding (loop task)
+// ===========================
+
+void RollupStore::add(uint8_t deviceId, Column column, uint32_t time, float value) {
+    uint8_t c = static_cast<uint8_t>(column);
+    if (!mutex || c >= COLUMN_COUNT) {
+        return;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    DeviceRollups* device = find(deviceId);
+    if (!device) {
+        device = open(deviceId);
+    }
+    if (!device || (device->any[c] && time <= device->newest[c])) {
+        xSemaphoreGive(mutex);
+        return;
+    }
+
+    RollupSample& sample = device->samples[c * ROLLUP_HISTORY_S + time % ROLLUP_HISTORY_S];
+    sample.stamp = time + 1;
+    sample.value = value;
+
+    for (uint8_t level = 1; level < ROLLUP_LEVELS; level++) {
+        uint32_t index = time / rollupResolution[level];
+        RollupBucket& bucket = ring(*device, column, level)[index % ringSize(level)];
+        if (bucket.count == 0 || bucket.index != index) {
+            bucket.index = index;
+            bucket.count = 1;
+            bucket.min = value;
+            bucket.max = value;
+            bucket.sum = value;
+        } else {
+            bucket.count++;
+            bucket.min = min(bucket.min, value);
+            bucket.max = max(bucket.max, value);
+            bucket.sum += value;
+        }
+    }
+
+    device->any[c] = true;
+    device->newest[c] = time;
+    samplesAdded++;
+    xSemaphoreGive(mutex);
+}
+
+// ===========================
+// Queries (any task)
+// ===========================
+
+size_t RollupStore::query(uint8_t deviceId, Column column, uint32_t from, uint32_t to,
+                          RollupPoint* out, size_t maxPoints, uint16_t& resolution) const {
+    uint8_t c = static_cast<uint8_t>(column);
+    resolution = rollupResolution[0];
+    if (!mutex || c >= COLUMN_COUNT || maxPoints == 0) {
+        return 0;
+    }
+
+    size_t found = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const DeviceRollups* device = find(deviceId);
+    if (device && device->any[c]) {
+        // The window cut to the history held
+        uint32_t newestTime = device->newest[c];
+        to = min(to, newestTime);
+        from = max(from, newestTime >= ROLLUP_HISTORY_S ? newestTime - ROLLUP_HISTORY_S + 1 : 0);
+
+        // The finest level that spans it in maxPoints buckets, else the
+        // coarsest's newest maxPoints
+        uint8_t level = 0;
+        while (level < ROLLUP_LEVELS - 1 && from <= to &&
+               to / rollupResolution[level] - from / rollupResolution[level] + 1 > maxPoints) {
+            level++;
+        }
+        resolution = rollupResolution[level];
+        if (from <= to && to / resolution - from / resolution + 1 > maxPoints) {
+            from = (to / resolution - (maxPoints - 1)) * resolution;
+        }
+
+        for (uint32_t index = from / resolution; from <= to && index <= to / resolution && found < maxPoints; index++) {
+            if (readPoint(*device, column, level, index, out[found])) {
+                found++;
+            }
+        }
+    }
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+size_t RollupStore::visit(uint8_t deviceId, Column column, uint8_t level, uint32_t from, uint32_t to,
+                          RollupVisitor visitor, void* context) const {
+    uint8_t c = static_cast<uint8_t>(column);
+    if (!mutex || c >= COLUMN_COUNT || level >= ROLLUP_LEVELS) {
+        return 0;
+    }
+
+    size_t visited = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const DeviceRollups* device = find(deviceId);
+    if (device && device->any[c]) {
+        // Nothing past the newest sample, and no more than a ring's worth
+        uint32_t resolution = rollupResolution[level];
+        to = min(to, device->newest[c]);
+        uint32_t last = to / resolution;
+        uint32_t first = max(from / resolution, last >= ringSize(level) ? last - ringSize(level) + 1 : 0);
+        RollupPoint point;
+        for (uint32_t index = first; from <= to && index <= last; index++) {
+            if (readPoint(*device, column, level, index, point)) {
+                visited++;
+                if (!visitor(point, context)) {
+                    break;
+                }
+            }
+        }
+    }
+    xSemaphoreGive(mutex);
+    return visited;
+}
+
+bool RollupStore::getOldestHeld(uint8_t deviceId, Column column, uint32_t& time) const {
+    uint8_t c = static_cast<uint8_t>(column);
+    if (!mutex || c >= COLUMN_COUNT) {
+        return false;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const DeviceRollups* device = find(deviceId);
+    bool any = device && device->any[c];
+    if (any) {
+        // The coarsest ring's oldest bucket starts latest
+        uint32_t width = rollupResolution[ROLLUP_LEVELS - 1];
+        uint32_t top = (device->newest[c] / width + 1) * width;
+        time = top > ROLLUP_HISTORY_S ? top - ROLLUP_HISTORY_S : 0;
+    }
+    xSemaphoreGive(mutex);
+    return any;
+}
+
+// The bucket at index of the level, false if it is empty or from before the ring wrapped
+bool RollupStore::readPoint(const DeviceRollups& device, Column column, uint8_t level, uint32_t index,
+                            RollupPoint& point) const {
+    uint8_t c = static_cast<uint8_t>(column);
+    uint32_t size = ringSize(level);
+    if (level == 0) {
+        const RollupSample& sample = device.samples[c * ROLLUP_HISTORY_S + index % size];
+        if (sample.stamp != index + 1) {
+            return false;
+        }
+        point.time = index;
+        point.min = point.max = point.mean = sample.value;
+        point.count = 1;
+        return true;
+    }
+    const RollupBucket& bucket = ring(device, column, level)[index % size];
+    if (bucket.count == 0 || bucket.index != index) {
+        return false;
+    }
+    point.time = index * rollupResolution[level];
+    point.min = bucket.min;
+    point.max = bucket.max;
+    point.mean = bucket.sum / bucket.count;
+    point.count = bucket.count;
+    return true;
+}
+
+void RollupStore::printStatus() const {
+    uint8_t active = 0;
+    for (uint8_t d = 0; d < COLUMN_MAX_DEVICES; d++) {
+        active += devices[d].active ? 1 : 0;
+    }
+    Serial.println("=== Graph Rollups ===");
+    Serial.printf("Balloons: %u, samples added %lu, allocation failures %lu\n", active,
+                  (unsigned long)samplesAdded, (unsigned long)allocationFailures);
+    Serial.printf("Levels: %u/%u/%u s over %u min\n", rollupResolution[0], rollupResolution[1],
+                  rollupResolution[2], GRAPH_HISTORY_MINUTES);
+}
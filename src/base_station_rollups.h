@@ -0,0 +1,114 @@
+#ifndef BASE_STATION_ROLLUPS_H
+#define BASE_STATION_ROLLUPS_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "base_station_columns.h"
+
+// ===========================
+// Graph Rollups (base station)
+// Min/max/mean of every column over the last GRAPH_HISTORY_MINUTES at
+// 1 s, 10 s and 1 min, kept up to date sample by sample
+// ===========================
+
+// Each level is a ring indexed by time / resolution, so adding a sample
+// touches one bucket per level and a bucket from before the ring wrapped
+// is told apart by the index it holds. The 1 s level is the samples
+// themselves - a column holds one a second.
+//
+// A graph query takes the finest level that covers its window in no more
+// than the points asked for and reads just those buckets: the work is the
+// points returned, whatever the window or the history behind it.
+//
+// Fed from the column store's sample hook on the loop task, and on begin()
+// from the column store's last GRAPH_HISTORY_MINUTES, so a reset keeps the
+// graphs. About 600 KB of PSRAM per balloon, allocated when it is first seen.
+
+#define ROLLUP_LEVELS              3
+#define ROLLUP_HISTORY_S           (GRAPH_HISTORY_MINUTES * 60)
+
+struct RollupPoint {
+    uint32_t time;              // Start of the bucket, store-clock seconds
+    float min;
+    float max;
+    float mean;
+    uint16_t count;
+};
+
+// A point at a time, oldest first; false stops the walk. Called with the
+// store's mutex held
+typedef bool (*RollupVisitor)(const RollupPoint& point, void* context);
+
+struct RollupBucket {
+    uint32_t index;             // time / resolution it holds
+    uint16_t count;
+    float min;
+    float max;
+    float sum;
+};
+
+struct RollupSample {
+    uint32_t stamp;             // time + 1, 0 while empty
+    float value;
+};
+
+struct DeviceRollups {
+    bool active;
+    uint8_t deviceId;
+    bool any[COLUMN_COUNT];
+    uint32_t newest[COLUMN_COUNT];      // Time of the column's last sample
+    RollupSample* samples;              // COLUMN_COUNT rings of ROLLUP_HISTORY_S
+    RollupBucket* buckets;              // COLUMN_COUNT x the coarser levels' rings
+};
+
+class RollupStore {
+public:
+    RollupStore();
+    ~RollupStore();
+
+    // After Columns().begin(); replays its last ROLLUP_HISTORY_S
+    bool begin();
+    void end();
+    bool isReady() const { return mutex != nullptr; }
+
+    // In time order per column - the column store's order
+    void add(uint8_t deviceId, Column column, uint32_t time, float value);
+
+    // Up to maxPoints points covering from..to, oldest first, at the finest
+    // level that fits - the newest maxPoints at the coarsest if none does.
+    // resolution is the level's bucket width in seconds
+    size_t query(uint8_t deviceId, Column column, uint32_t from, uint32_t to,
+                 RollupPoint* out, size_t maxPoints, uint16_t& resolution) const;
+
+    // Every point of one level with from <= time <= to, oldest first; the
+    // number visited. The work is the buckets in the window
+    size_t visit(uint8_t deviceId, Column column, uint8_t level, uint32_t from, uint32_t to,
+                 RollupVisitor visitor, void* context) const;
+
+    // The earliest time every level still has whole buckets from; false
+    // when the column has nothing
+    bool getOldestHeld(uint8_t deviceId, Column column, uint32_t& time) const;
+
+    static uint16_t getResolution(uint8_t level);
+
+    void printStatus() const;
+
+private:
+    DeviceRollups devices[COLUMN_MAX_DEVICES];  // By session slot
+    SemaphoreHandle_t mutex;
+    uint32_t samplesAdded;
+    uint32_t allocationFailures;
+
+    DeviceRollups* find(uint8_t deviceId) const;
+    DeviceRollups* open(uint8_t deviceId);
+    RollupBucket* ring(const DeviceRollups& device, Column column, uint8_t level) const;
+    static uint32_t ringSize(uint8_t level);
+    bool readPoint(const DeviceRollups& device, Column column, uint8_t level, uint32_t index,
+                   RollupPoint& point) const;
+};
+
+RollupStore& Rollups();
+
+#endif // BASE_STATION_ROLLUPS_H
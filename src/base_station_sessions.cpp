@@ -0,0 +1,125 @@
+#include "base_station_config.h"
+#include "base_station_sessions.h"
+#include "packet_store.h"
+
+static SessionTable sessionTableInstance;
+
+SessionTable& Sessions() {
+    return sessionTableInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+SessionTable::SessionTable() {
+    memset(sessions, 0, sizeof(sessions));
+    for (std::atomic<uint8_t>& entry : index) {
+        entry.store(0, std::memory_order_relaxed);
+    }
+    count = 0;
+    mutex = nullptr;
+    nextIndex = 0;
+    refused = 0;
+}
+
+SessionTable::~SessionTable() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool SessionTable::begin() {
+    if (mutex) {
+        return true;
+    }
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex) {
+        return false;
+    }
+    nextIndex = Packets().getOldest();
+    return true;
+}
+
+// After every module holding session state has ended
+void SessionTable::end() {
+    for (std::atomic<uint8_t>& entry : index) {
+        entry.store(0, std::memory_order_release);
+    }
+    memset(sessions, 0, sizeof(sessions));
+    count = 0;
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+}
+
+BalloonSession* SessionTable::open(uint8_t deviceId) {
+    BalloonSession* session = find(deviceId);
+    if (session || !mutex) {
+        return session;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    session = find(deviceId);           // Another task may have just opened it
+    if (!session && count < SESSION_MAX) {
+        session = &sessions[count];
+        memset(session, 0, sizeof(*session));
+        session->deviceId = deviceId;
+        session->slot = count;
+        session->openedAt = millis();
+        count++;
+        index[deviceId].store(session->slot + 1, std::memory_order_release);
+    }
+    xSemaphoreGive(mutex);
+    return session;
+}
+
+// ===========================
+// Updates (loop task)
+// ===========================
+
+void SessionTable::update() {
+    if (!mutex) {
+        return;
+    }
+
+    static StoredPacket packet;         // Off the loop task's stack
+
+    nextIndex = max(nextIndex, Packets().getOldest());
+    for (uint32_t next = Packets().getNext(); nextIndex < next; nextIndex++) {
+        if (!Packets().get(nextIndex, packet)) {
+            continue;
+        }
+        BalloonSession* session = open(packet.deviceId);
+        if (!session) {
+            refused++;
+            continue;
+        }
+        session->lastSeen = packet.receivedAt;
+        session->lastSequence = packet.sequenceNumber;
+        session->lastRssi = packet.rssi;
+        session->lastSnr = packet.snr;
+        session->packets++;
+        session->latePackets += packet.late ? 1 : 0;
+    }
+}
+
+void SessionTable::printStatus() const {
+    uint32_t now = millis();
+    Serial.println("=== Sessions ===");
+    Serial.printf("Balloons: %u of %u, packets refused with the table full %lu\n", count, SESSION_MAX,
+                  (unsigned long)refused);
+    for (uint8_t s = 0; s < count; s++) {
+        const BalloonSession& session = sessions[s];
+        Serial.printf("  Balloon %u: %lu packets (%lu late), last %lu s ago, seq %u, RSSI %d, SNR %d, "
+                      "%lu images, state:%s%s%s%s\n",
+                      session.deviceId, (unsigned long)session.packets, (unsigned long)session.latePackets,
+                      (unsigned long)((now - session.lastSeen) / 1000), session.lastSequence, session.lastRssi,
+                      session.lastSnr, (unsigned long)session.images, session.columns ? " columns" : "",
+                      session.rollups ? " rollups" : "", session.track ? " track" : "",
+                      session.alerts ? " alerts" : "");
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef BASE_STATION_SESSIONS_H
+#define BASE_STATION_SESSIONS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "rx_pipeline.h"
+
+// ===========================
+// Balloon Sessions (base station)
+// One session per balloon heard, found from its deviceId in one table
+// read, holding what each module keeps for that balloon
+// ===========================
+
+// A session is opened the first time any module needs one for a deviceId
+// and stays for the base station's uptime; SESSION_MAX of them, the
+// balloons tracked at once. Its slot is its index in the table, and the
+// index each module keeps its own per-balloon state at, so no module
+// searches for a balloon or shares a free-slot search with another:
+//   columns   the column store's heads and block indexes
+//   rollups   the graph pyramid
+//   track     the landing predictor's wind profile
+//   alerts    the alert engine's rule states and windows
+// each set by its module as it opens it, null until then.
+//
+// find() is a byte load from a 256-entry deviceId table and takes no
+// lock; only open() creating a session takes the table's mutex, once per
+// balloon. A session is filled in before its table entry is published.
+// update() keeps each session's link figures from the packet store.
+
+#define SESSION_MAX                RX_MAX_DEVICES
+
+struct DeviceColumns;
+struct DeviceRollups;
+struct FlightTrack;
+struct DeviceAlerts;
+
+struct BalloonSession {
+    uint8_t deviceId;
+    uint8_t slot;
+    uint32_t openedAt;          // millis()
+    uint32_t lastSeen;          // receivedAt of its newest stored packet
+    uint32_t packets;
+    uint32_t latePackets;       // Delivered after the reorder gave up on them
+    uint16_t lastSequence;
+    int8_t lastRssi;
+    int8_t lastSnr;
+    uint32_t images;            // Catalogued by the image cache
+    uint32_t latestImage;       // Its id, 0 before the first
+    uint32_t flightId;          // The flight catalog's open flight, 0 for none
+
+    DeviceColumns* columns;
+    DeviceRollups* rollups;
+    FlightTrack* track;
+    DeviceAlerts* alerts;
+};
+
+class SessionTable {
+public:
+    SessionTable();
+    ~SessionTable();
+
+    // First thing in setup() - every per-balloon module opens through it
+    bool begin();
+    void end();
+    bool isReady() const { return mutex != nullptr; }
+
+    // Any task, lock-free; null if the balloon has no session
+    BalloonSession* find(uint8_t deviceId) {
+        uint8_t entry = index[deviceId].load(std::memory_order_acquire);
+        return entry ? &sessions[entry - 1] : nullptr;
+    }
+    const BalloonSession* find(uint8_t deviceId) const {
+        uint8_t entry = index[deviceId].load(std::memory_order_acquire);
+        return entry ? &sessions[entry - 1] : nullptr;
+    }
+
+    // The balloon's session, opened if it has none; null with the table full
+    BalloonSession* open(uint8_t deviceId);
+
+    // From loop(): link figures from the packets since the last call
+    void update();
+
+    uint8_t getCount() const { return count; }
+    const BalloonSession& getSession(uint8_t slot) const { return sessions[slot]; }
+
+    void printStatus() const;
+
+private:
+    BalloonSession sessions[SESSION_MAX];
+    std::atomic<uint8_t> index[256];        // deviceId -> slot + 1, 0 for none
+    uint8_t count;
+    SemaphoreHandle_t mutex;                // Opening
+    uint32_t nextIndex;
+    uint32_t refused;                       // Balloons heard with the table full
+};
+
+SessionTable& Sessions();
+
+#endif // BASE_STATION_SESSIONS_H
@@ -0,0 +1,314 @@
+#include "base_station_config.h"
+#include "base_station_share.h"
+#include <WiFi.h>
+#include <time.h>
+#include "esp_crt_bundle.h"
+#include "memory_ledger.h"
+#include "task_placement.h"
+
+#define SHARE_SOFTWARE_NAME        "cosmic1"
+#define SHARE_SOFTWARE_VERSION     "2.0.0"
+
+static PositionShare shareInstance;
+
+PositionShare& Share() {
+    return shareInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+PositionShare::PositionShare() {
+    task = nullptr;
+    stopping = false;
+    client = nullptr;
+    queue = nullptr;
+    head = 0;
+    count = 0;
+    nextIndex = 0;
+    memset(telemetry, 0, sizeof(telemetry));
+    nextTelemetry = 0;
+    body = nullptr;
+    compressed = nullptr;
+    nextUploadAt = 0;
+    backoffMs = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+PositionShare::~PositionShare() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool PositionShare::begin() {
+    if (!SHARE_ENABLED || task) {
+        return true;
+    }
+
+    queue = (ShareRecord*)memCalloc(MemTag::WEB, SHARE_QUEUE_DEPTH, sizeof(ShareRecord));
+    body = (char*)memAlloc(MemTag::WEB, SHARE_BATCH_BYTES);
+    compressed = (uint8_t*)memAlloc(MemTag::WEB, SHARE_BATCH_BYTES);
+    if (!queue || !body || !compressed) {
+        Serial.println("Position share: No memory for the queue");
+        end();
+        return false;
+    }
+
+    configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+    nextIndex = Packets().getNext();    // Live positions - what came before boot isn't news
+    stopping = false;
+    if (createPlacedTask(TaskId::SHARE, taskEntry, this, &task) != pdPASS) {
+        task = nullptr;
+        end();
+        return false;
+    }
+    return true;
+}
+
+void PositionShare::end() {
+    if (task) {
+        stopping = true;
+        while (task) {
+            vTaskDelay(pdMS_TO_TICKS(10));   // The task clears it on its way out
+        }
+    }
+    gzip.end();
+    memFree(MemTag::WEB, queue);
+    memFree(MemTag::WEB, body);
+    memFree(MemTag::WEB, compressed);
+    queue = nullptr;
+    body = nullptr;
+    compressed = nullptr;
+    count = 0;
+}
+
+void PositionShare::taskEntry(void* parameter) {
+    PositionShare* share = static_cast<PositionShare*>(parameter);
+    share->run();
+    if (share->client) {
+        esp_http_client_cleanup(share->client);
+        share->client = nullptr;
+    }
+    share->task = nullptr;
+    vTaskDelete(nullptr);
+}
+
+void PositionShare::run() {
+    while (!stopping) {
+        collect();
+        if (count && (int32_t)(millis() - nextUploadAt) >= 0 && WiFi.status() == WL_CONNECTED &&
+            time(nullptr) >= (time_t)SHARE_VALID_UTC) {
+            upload();
+        }
+        vTaskDelay(pdMS_TO_TICKS(SHARE_POLL_MS));
+    }
+}
+
+// ===========================
+// Queue
+// ===========================
+
+void PositionShare::collect() {
+    static StoredPacket packet;         // Off the task's stack
+
+    nextIndex = max(nextIndex, Packets().getOldest());
+    for (uint32_t next = Packets().getNext(); nextIndex < next; nextIndex++) {
+        if (!Packets().get(nextIndex, packet) || !packet.decoded) {
+            continue;
+        }
+        if (packet.type == PacketType::TELEMETRY) {
+            DeviceTelemetry* device = telemetryFor(packet.deviceId);
+            device->temperature = packet.data.telemetry.temperature;
+            device->batteryVoltage = packet.data.telemetry.batteryVoltage;
+        } else if (packet.type == PacketType::GPS_DATA) {
+            push(packet);
+        }
+    }
+}
+
+void PositionShare::push(const StoredPacket& packet) {
+    const GPSData& gps = packet.data.gps;
+    if (gps.satellites == 0 || (gps.latitude == 0.0f && gps.longitude == 0.0f)) {
+        return;     // No fix to share
+    }
+
+    if (count == SHARE_QUEUE_DEPTH) {
+        head = (head + 1) % SHARE_QUEUE_DEPTH;
+        count--;
+        stats.overwritten++;
+    }
+    ShareRecord& record = queue[(head + count) % SHARE_QUEUE_DEPTH];
+    const DeviceTelemetry* device = telemetryFor(packet.deviceId);
+    record.deviceId = packet.deviceId;
+    record.rssi = packet.rssi;
+    record.snr = packet.snr;
+    record.satellites = gps.satellites;
+    record.receivedAt = packet.receivedAt;
+    record.latitude = gps.latitude;
+    record.longitude = gps.longitude;
+    record.altitude = gps.altitude;
+    record.speed = gps.speed;
+    record.course = gps.course;
+    record.temperature = device->temperature;
+    record.batteryVoltage = device->batteryVoltage;
+    count++;
+    stats.queued++;
+}
+
+// The balloon's slot, opened with no readings; the oldest is reused past SHARE_MAX_DEVICES
+PositionShare::DeviceTelemetry* PositionShare::telemetryFor(uint8_t deviceId) {
+    for (DeviceTelemetry& device : telemetry) {
+        if (device.active && device.deviceId == deviceId) {
+            return &device;
+        }
+    }
+    DeviceTelemetry* device = &telemetry[nextTelemetry];
+    nextTelemetry = (nextTelemetry + 1) % SHARE_MAX_DEVICES;
+    device->active = true;
+    device->deviceId = deviceId;
+    device->temperature = NAN;
+    device->batteryVoltage = NAN;
+    return device;
+}
+
+// ===========================
+// Upload
+// ===========================
+
+static size_t formatUtc(char* out, size_t space, time_t utc) {
+    struct tm parts;
+    gmtime_r(&utc, &parts);
+    return strftime(out, space, "%Y-%m-%dT%H:%M:%SZ", &parts);
+}
+
+size_t PositionShare::buildBatch(uint16_t& records) {
+    time_t utcNow = time(nullptr);
+    uint32_t now = millis();
+    size_t length = 0;
+    body[length++] = '[';
+    records = 0;
+
+    while (records < count && records < SHARE_BATCH_MAX) {
+        const ShareRecord& record = queue[(head + records) % SHARE_QUEUE_DEPTH];
+        char received[24];
+        formatUtc(received, sizeof(received), utcNow - (time_t)((now - record.receivedAt) / 1000));
+
+        char extra[64] = "";
+        size_t extraLength = 0;
+        if (!isnan(record.temperature)) {
+            extraLength += snprintf(extra, sizeof(extra), ",\"temp\":%.1f", record.temperature);
+        }
+        if (!isnan(record.batteryVoltage)) {
+            snprintf(extra + extraLength, sizeof(extra) - extraLength, ",\"batt\":%.2f", record.batteryVoltage);
+        }
+
+        int written = snprintf(body + length, SHARE_BATCH_BYTES - length,
+                               "%s{\"software_name\":\"" SHARE_SOFTWARE_NAME "\",\"software_version\":\""
+                               SHARE_SOFTWARE_VERSION "\",\"uploader_callsign\":\"" SHARE_UPLOADER_CALLSIGN
+                               "\",\"payload_callsign\":\"" SHARE_PAYLOAD_CALLSIGN "-%u\",\"time_received\":\"%s\","
+                               "\"datetime\":\"%s\",\"lat\":%.6f,\"lon\":%.6f,\"alt\":%.1f,\"sats\":%u,"
+                               "\"vel_h\":%.1f,\"heading\":%.1f,\"rssi\":%d,\"snr\":%d%s}",
+                               records ? "," : "", record.deviceId, received, received, record.latitude,
+                               record.longitude, record.altitude, record.satellites, record.speed, record.course,
+                               record.rssi, record.snr, extra);
+        if (written < 0 || length + written + 1 >= SHARE_BATCH_BYTES) {
+            break;      // The rest go in the next batch
+        }
+        length += written;
+        records++;
+    }
+    body[length++] = ']';
+    return length;
+}
+
+void PositionShare::upload() {
+    uint16_t records;
+    size_t length = buildBatch(records);
+    if (!records) {
+        return;
+    }
+
+    // Sent as it is when gzip doesn't make it smaller
+    size_t packed = gzip.compress(body, length, compressed, SHARE_BATCH_BYTES);
+    int status = packed ? send(compressed, packed, true) : send((const uint8_t*)body, length, false);
+    stats.lastStatus = status;
+
+    if (status >= 200 && status < 300) {
+        stats.uploaded += records;
+        stats.bytesRaw += length;
+        stats.bytesSent += packed ? packed : length;
+    } else if (status >= 400 && status < 500 && status != 408 && status != 429) {
+        stats.rejected += records;
+        Serial.printf("Position share: %d records refused (HTTP %d)\n", records, status);
+    } else {
+        fail();
+        return;
+    }
+
+    head = (head + records) % SHARE_QUEUE_DEPTH;
+    count -= records;
+    backoffMs = 0;
+    nextUploadAt = millis() + SHARE_INTERVAL_MS;
+}
+
+int PositionShare::send(const uint8_t* data, size_t length, bool gzipped) {
+    if (!client) {
+        esp_http_client_config_t config = {};
+        config.url = SHARE_URL;
+        config.method = HTTP_METHOD_PUT;
+        config.timeout_ms = SHARE_HTTP_TIMEOUT_MS;
+        config.keep_alive_enable = true;
+        config.crt_bundle_attach = esp_crt_bundle_attach;
+        client = esp_http_client_init(&config);
+        if (!client) {
+            return -1;
+        }
+        esp_http_client_set_header(client, "Content-Type", "application/json");
+    }
+    if (gzipped) {
+        esp_http_client_set_header(client, "Content-Encoding", "gzip");
+    } else {
+        esp_http_client_delete_header(client, "Content-Encoding");
+    }
+    esp_http_client_set_post_field(client, (const char*)data, length);
+
+    uint32_t start = millis();
+    stats.requests++;
+    esp_err_t err = esp_http_client_perform(client);
+    stats.lastRequestMs = millis() - start;
+    if (err != ESP_OK) {
+        return -1;
+    }
+    return esp_http_client_get_status_code(client);
+}
+
+void PositionShare::fail() {
+    stats.failures++;
+    if (client) {
+        esp_http_client_close(client);  // A fresh connection on the next try
+    }
+    backoffMs = backoffMs ? min(backoffMs * 2, (uint32_t)SHARE_BACKOFF_MAX_MS) : SHARE_BACKOFF_MIN_MS;
+    nextUploadAt = millis() + backoffMs;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void PositionShare::printStatus() const {
+    if (!task) {
+        return;
+    }
+    Serial.printf("Position Share: %u queued, %lu uploaded, %lu overwritten, %lu refused, %lu/%lu requests "
+                  "failed, last HTTP %d in %lu ms, %lu -> %lu bytes",
+                  count, stats.uploaded, stats.overwritten, stats.rejected, stats.failures, stats.requests,
+                  stats.lastStatus, stats.lastRequestMs, stats.bytesRaw, stats.bytesSent);
+    if (backoffMs) {
+        Serial.printf(", backing off %lu s", backoffMs / 1000);
+    }
+    Serial.println();
+}
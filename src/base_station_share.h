@@ -0,0 +1,128 @@
+#ifndef BASE_STATION_SHARE_H
+#define BASE_STATION_SHARE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "esp_http_client.h"
+#include "packet_store.h"
+#include "gzip_stream.h"
+
+// ===========================
+// Position Sharing (base station)
+// The balloon's fixes to a SondeHub-style tracker over the station's
+// internet uplink, batched and gzipped on one kept-alive TLS connection
+// ===========================
+
+// A task of its own below the RX task (task_placement.h) follows the
+// packet store by index, as the web server does, so the receive path never
+// sees it. Each decoded GPS fix is copied into a bounded queue of
+// SHARE_QUEUE_DEPTH records, with its balloon's latest temperature and
+// battery from telemetry. While the uplink is down the queue keeps the
+// newest fixes: the oldest is overwritten, and counted.
+//
+// Every SHARE_INTERVAL_MS the oldest SHARE_BATCH_MAX records go out as one
+// JSON array in the SondeHub amateur telemetry format, gzipped
+// (gzip_stream.h), in a single PUT. The HTTP client is made once and kept,
+// so its TLS session carries one batch after another; one handshake per
+// batch, let alone per packet, would take most of the task's time and
+// heap. Records leave the queue only on a 2xx. A transport error or a 5xx
+// closes the connection and backs off from SHARE_BACKOFF_MIN_MS, doubling
+// up to SHARE_BACKOFF_MAX_MS. A 4xx other than 408 or 429 drops the batch,
+// since sending it again would fail the same way.
+//
+// Times are UTC from SNTP. Until it has set the clock nothing is sent -
+// a fix's time is its arrival here, taken back from millis().
+
+#define SHARE_QUEUE_DEPTH          128
+#define SHARE_BATCH_MAX            32      // Records per request
+#define SHARE_BATCH_BYTES          (SHARE_BATCH_MAX * 384)
+#define SHARE_POLL_MS              1000    // Store polled this often
+#define SHARE_BACKOFF_MIN_MS       5000
+#define SHARE_BACKOFF_MAX_MS       300000
+#define SHARE_HTTP_TIMEOUT_MS      10000
+#define SHARE_MAX_DEVICES          RX_MAX_DEVICES
+#define SHARE_VALID_UTC            1577836800UL    // 2020-01-01 - an earlier clock hasn't been set
+
+struct ShareRecord {
+    uint8_t deviceId;
+    int8_t rssi;
+    int8_t snr;
+    uint8_t satellites;
+    uint32_t receivedAt;        // millis()
+    float latitude;
+    float longitude;
+    float altitude;
+    float speed;
+    float course;
+    float temperature;          // NAN without telemetry yet
+    float batteryVoltage;
+};
+
+struct ShareStats {
+    uint32_t queued;
+    uint32_t overwritten;       // Queue full - the oldest gave way
+    uint32_t requests;
+    uint32_t uploaded;          // Records a 2xx took
+    uint32_t rejected;          // Records in batches a 4xx refused
+    uint32_t failures;          // Requests that failed or got a 5xx
+    uint32_t bytesRaw;          // JSON of the batches taken
+    uint32_t bytesSent;         // As sent
+    uint32_t lastRequestMs;     // How long the last PUT took
+    int lastStatus;             // HTTP status, or -1 for a transport error
+};
+
+class PositionShare {
+public:
+    PositionShare();
+    ~PositionShare();
+
+    // After the Wi-Fi is up; nothing is started without SHARE_ENABLED
+    bool begin();
+    void end();
+    bool isRunning() const { return task != nullptr; }
+
+    uint16_t getQueued() const { return count; }
+    ShareStats getStats() const { return stats; }
+    void printStatus() const;
+
+private:
+    TaskHandle_t task;
+    volatile bool stopping;
+    esp_http_client_handle_t client;
+    GzipStream gzip;
+
+    ShareRecord* queue;
+    uint16_t head;
+    volatile uint16_t count;
+    uint32_t nextIndex;         // Packet store cursor
+
+    struct DeviceTelemetry {
+        bool active;
+        uint8_t deviceId;
+        float temperature;
+        float batteryVoltage;
+    };
+    DeviceTelemetry telemetry[SHARE_MAX_DEVICES];
+    uint8_t nextTelemetry;      // Replaced round robin past SHARE_MAX_DEVICES
+
+    char* body;                 // SHARE_BATCH_BYTES of JSON
+    uint8_t* compressed;        // As much again, gzipped
+    uint32_t nextUploadAt;
+    uint32_t backoffMs;
+    ShareStats stats;
+
+    void run();
+    void collect();
+    void push(const StoredPacket& packet);
+    DeviceTelemetry* telemetryFor(uint8_t deviceId);
+    void upload();
+    size_t buildBatch(uint16_t& records);
+    int send(const uint8_t* data, size_t length, bool gzipped);
+    void fail();
+
+    static void taskEntry(void* parameter);
+};
+
+PositionShare& Share();
+
+#endif // BASE_STATION_SHARE_H
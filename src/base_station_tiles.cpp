@@ -0,0 +1,338 @@
+#include "base_station_config.h"
+#include "base_station_tiles.h"
+#include "base_station_columns.h"
+#include "memory_ledger.h"
+#include <LittleFS.h>
+
+#define TILE_FILE                  FLASH_STORAGE_PATH "/tiles.pack"
+#define TILE_UPLOAD_FILE           FLASH_STORAGE_PATH "/tiles.tmp"
+
+static TileServer tileServerInstance;
+
+TileServer& Tiles() {
+    return tileServerInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+TileServer::TileServer() {
+    memset(&header, 0, sizeof(header));
+    index = nullptr;
+    cache = nullptr;
+    chunk = nullptr;
+    memset(slots, 0, sizeof(slots));
+    useClock = 0;
+    uploadLength = 0;
+    uploadReceived = 0;
+    hits = 0;
+    misses = 0;
+    streamed = 0;
+    readErrors = 0;
+}
+
+TileServer::~TileServer() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool TileServer::begin() {
+    if (cache) {
+        return true;
+    }
+    if (!Columns().isReady()) {
+        Serial.println("Tiles: LittleFS not mounted");
+        return false;
+    }
+
+    cache = (uint8_t*)memAllocCaps(MemTag::WEB, TILE_CACHE_SLOTS * TILE_CACHE_SLOT_BYTES,
+                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    chunk = (uint8_t*)memAlloc(MemTag::WEB, TILE_CHUNK_BYTES);
+    if (!cache || !chunk) {
+        Serial.println("Tiles: No memory for the cache");
+        end();
+        return false;
+    }
+    clearCache();
+
+    // An upload cut off by a reset is dropped
+    if (LittleFS.exists(TILE_UPLOAD_FILE)) {
+        LittleFS.remove(TILE_UPLOAD_FILE);
+    }
+    if (LittleFS.exists(TILE_FILE) && !loadIndex(TILE_FILE, header, index)) {
+        Serial.println("Tiles: tiles.pack is not a tile archive - upload one");
+    }
+    return true;
+}
+
+void TileServer::end() {
+    cancelUpload();
+    if (index) {
+        memFree(MemTag::WEB, index);
+        index = nullptr;
+    }
+    if (cache) {
+        memFree(MemTag::WEB, cache);
+        cache = nullptr;
+    }
+    if (chunk) {
+        memFree(MemTag::WEB, chunk);
+        chunk = nullptr;
+    }
+    memset(&header, 0, sizeof(header));
+}
+
+// The header and whole index or nothing: entries sorted, every tile inside the file
+bool TileServer::loadIndex(const char* path, TileArchiveHeader& loaded, TileIndexEntry*& entries) {
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return false;
+    }
+    size_t fileBytes = file.size();
+    TileArchiveHeader candidate;
+    bool ok = file.read((uint8_t*)&candidate, sizeof(candidate)) == sizeof(candidate) &&
+              candidate.magic == TILE_ARCHIVE_MAGIC && candidate.version == TILE_ARCHIVE_VERSION &&
+              candidate.tileCount > 0 && candidate.tileCount <= TILE_INDEX_MAX &&
+              TILE_HEADER_BYTES + (size_t)candidate.tileCount * sizeof(TileIndexEntry) <= fileBytes;
+
+    TileIndexEntry* read = nullptr;
+    if (ok) {
+        size_t bytes = candidate.tileCount * sizeof(TileIndexEntry);
+        read = (TileIndexEntry*)memAlloc(MemTag::WEB, bytes);
+        ok = read && file.read((uint8_t*)read, bytes) == bytes;
+    }
+    file.close();
+    for (uint32_t i = 0; ok && i < candidate.tileCount; i++) {
+        ok = (i == 0 || read[i].key > read[i - 1].key) && read[i].length > 0 &&
+             (size_t)read[i].offset + read[i].length <= fileBytes;
+    }
+    if (!ok) {
+        if (read) {
+            memFree(MemTag::WEB, read);
+        }
+        return false;
+    }
+
+    if (entries) {
+        memFree(MemTag::WEB, entries);
+    }
+    entries = read;
+    loaded = candidate;
+    return true;
+}
+
+// ===========================
+// Lookup
+// ===========================
+
+bool TileServer::findTile(uint8_t z, uint32_t x, uint32_t y, TileIndexEntry& entry) const {
+    if (!index) {
+        return false;
+    }
+    uint64_t key = tileKey(z, x, y);
+    size_t low = 0;
+    size_t high = header.tileCount;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (index[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == header.tileCount || index[low].key != key) {
+        return false;
+    }
+    entry = index[low];
+    return true;
+}
+
+const char* TileServer::formatContentType(uint8_t format) {
+    switch (static_cast<TileFormat>(format)) {
+        case TileFormat::PNG: return "image/png";
+        case TileFormat::JPEG: return "image/jpeg";
+        case TileFormat::WEBP: return "image/webp";
+        default: return "application/octet-stream";
+    }
+}
+
+// ===========================
+// Cache
+// ===========================
+
+void TileServer::clearCache() {
+    memset(slots, 0, sizeof(slots));
+    useClock = 0;
+}
+
+uint8_t TileServer::getSlotsHeld() const {
+    uint8_t held = 0;
+    for (const TileSlot& slot : slots) {
+        held += slot.length ? 1 : 0;
+    }
+    return held;
+}
+
+bool TileServer::sendTile(const TileIndexEntry& entry, TileSendHandler send, void* context) {
+    if (!cache) {
+        return false;
+    }
+    size_t victim = 0;
+    for (size_t i = 0; i < TILE_CACHE_SLOTS; i++) {
+        TileSlot& slot = slots[i];
+        if (slot.length && slot.offset == entry.offset) {
+            slot.lastUsed = ++useClock;
+            hits++;
+            return send(context, cache + i * TILE_CACHE_SLOT_BYTES, slot.length);
+        }
+        if (slots[victim].length && (!slot.length || slot.lastUsed < slots[victim].lastUsed)) {
+            victim = i;
+        }
+    }
+    misses++;
+    if (entry.length > TILE_CACHE_SLOT_BYTES) {
+        streamed++;
+        return sendFromFlash(entry, send, context);
+    }
+
+    // Into the least recently used slot, which holds it only once it is whole
+    uint8_t* data = cache + victim * TILE_CACHE_SLOT_BYTES;
+    slots[victim].length = 0;
+    File file = LittleFS.open(TILE_FILE, "r");
+    bool read = file && file.seek(entry.offset) && file.read(data, entry.length) == entry.length;
+    if (file) {
+        file.close();
+    }
+    if (!read) {
+        readErrors++;
+        return false;
+    }
+    slots[victim].offset = entry.offset;
+    slots[victim].length = entry.length;
+    slots[victim].lastUsed = ++useClock;
+    return send(context, data, entry.length);
+}
+
+bool TileServer::sendFromFlash(const TileIndexEntry& entry, TileSendHandler send, void* context) {
+    File file = LittleFS.open(TILE_FILE, "r");
+    if (!file || !file.seek(entry.offset)) {
+        readErrors++;
+        return false;
+    }
+    bool ok = true;
+    for (size_t left = entry.length; ok && left;) {
+        size_t length = file.read(chunk, min(left, (size_t)TILE_CHUNK_BYTES));
+        if (length == 0) {
+            readErrors++;
+            ok = false;
+            break;
+        }
+        ok = send(context, chunk, length);
+        left -= length;
+    }
+    file.close();
+    return ok;
+}
+
+// ===========================
+// Upload
+// ===========================
+
+bool TileServer::beginUpload(size_t length) {
+    if (!cache) {
+        return false;
+    }
+    cancelUpload();
+    size_t free = LittleFS.totalBytes() - LittleFS.usedBytes();
+    if (length < TILE_HEADER_BYTES || length > free) {
+        return false;
+    }
+    upload = LittleFS.open(TILE_UPLOAD_FILE, "w");
+    if (!upload) {
+        return false;
+    }
+    uploadLength = length;
+    uploadReceived = 0;
+    return true;
+}
+
+bool TileServer::writeUpload(const uint8_t* data, size_t length) {
+    if (!upload || uploadReceived + length > uploadLength || upload.write(data, length) != length) {
+        cancelUpload();
+        return false;
+    }
+    uploadReceived += length;
+    return true;
+}
+
+bool TileServer::commitUpload() {
+    if (!upload) {
+        return false;
+    }
+    upload.close();
+    TileArchiveHeader loaded;
+    TileIndexEntry* entries = nullptr;
+    if (uploadReceived != uploadLength || !loadIndex(TILE_UPLOAD_FILE, loaded, entries)) {
+        LittleFS.remove(TILE_UPLOAD_FILE);
+        return false;
+    }
+
+    // The old file goes first - the flash may not hold both for the rename
+    if (LittleFS.exists(TILE_FILE)) {
+        LittleFS.remove(TILE_FILE);
+    }
+    if (!LittleFS.rename(TILE_UPLOAD_FILE, TILE_FILE)) {
+        memFree(MemTag::WEB, entries);
+        LittleFS.remove(TILE_UPLOAD_FILE);
+        if (index) {
+            memFree(MemTag::WEB, index);
+            index = nullptr;
+        }
+        memset(&header, 0, sizeof(header));
+        clearCache();
+        return false;
+    }
+    if (index) {
+        memFree(MemTag::WEB, index);
+    }
+    index = entries;
+    header = loaded;
+    clearCache();
+    Serial.printf("Tiles: archive of %lu tiles, zoom %u-%u\n", (unsigned long)header.tileCount,
+                  header.minZoom, header.maxZoom);
+    return true;
+}
+
+void TileServer::cancelUpload() {
+    if (upload) {
+        upload.close();
+        LittleFS.remove(TILE_UPLOAD_FILE);
+    }
+    uploadLength = 0;
+    uploadReceived = 0;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void TileServer::printStatus() const {
+    if (!cache) {
+        Serial.println("Tiles: not running");
+        return;
+    }
+    Serial.println("=== Map Tiles ===");
+    if (index) {
+        Serial.printf("Archive: %lu tiles, zoom %u-%u\n", (unsigned long)header.tileCount, header.minZoom,
+                      header.maxZoom);
+    } else {
+        Serial.println("Archive: none");
+    }
+    Serial.printf("Cache: %u of %u slots, %lu hits, %lu misses, %lu streamed, %lu read errors\n", getSlotsHeld(),
+                  TILE_CACHE_SLOTS, (unsigned long)hits, (unsigned long)misses, (unsigned long)streamed,
+                  (unsigned long)readErrors);
+}
@@ -0,0 +1,144 @@
+#ifndef BASE_STATION_TILES_H
+#define BASE_STATION_TILES_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <FS.h>
+
+// ===========================
+// Map Tile Server (base station)
+// Slippy-map tiles out of a packed archive on LittleFS, for the map on
+// laptops with no internet at the launch site
+// ===========================
+
+// tools/make_tiles.py packs an MBTiles file, or a z/x/y directory, into
+// FLASH_STORAGE_PATH/tiles.pack:
+//   TileArchiveHeader    TILE_HEADER_BYTES, little endian
+//   TileIndexEntry[]     tileCount, sorted by key; tiles with the same
+//                        bytes share one offset
+//   tile data
+//
+// begin() reads the index into PSRAM, so a lookup is a binary search and
+// never touches flash. Tiles are served out of an LRU of TILE_CACHE_SLOTS
+// slots keyed by offset; a miss reads the tile from flash into the least
+// recently used slot, and one over TILE_CACHE_SLOT_BYTES streams from flash
+// each time without displacing any.
+//
+// A new archive is uploaded to tiles.tmp beside the one being served and
+// replaces it only once its index loads; the cache is then emptied. The
+// web server is the only caller, one handler at a time.
+
+#define TILE_ARCHIVE_MAGIC         0x4C495442  // "BTIL"
+#define TILE_ARCHIVE_VERSION       1
+#define TILE_HEADER_BYTES          36
+#define TILE_INDEX_MAX             16384   // Tiles an archive may hold; 16 bytes of PSRAM each
+#define TILE_CACHE_SLOTS           16      // About a screen of 256 px tiles
+#define TILE_CACHE_SLOT_BYTES      (32 * 1024)
+#define TILE_CHUNK_BYTES           4096    // Flash reads per piece of an uncached tile
+
+enum class TileFormat : uint8_t {
+    PNG = 0,
+    JPEG,
+    WEBP
+};
+
+struct TileArchiveHeader {
+    uint32_t magic;             // TILE_ARCHIVE_MAGIC
+    uint16_t version;           // TILE_ARCHIVE_VERSION
+    uint8_t format;             // TileFormat
+    uint8_t minZoom;
+    uint8_t maxZoom;
+    uint8_t reserved[3];
+    uint32_t tileCount;
+    uint32_t created;           // Unix time the archive was packed - its identity for ETags
+    int32_t west;               // Bounds, degrees E7
+    int32_t south;
+    int32_t east;
+    int32_t north;
+};
+
+static_assert(sizeof(TileArchiveHeader) == TILE_HEADER_BYTES, "Header is make_tiles.py's format");
+
+struct TileIndexEntry {
+    uint64_t key;               // tileKey(z, x, y)
+    uint32_t offset;            // From the start of the file
+    uint32_t length;
+};
+
+static_assert(sizeof(TileIndexEntry) == 16, "Entry is make_tiles.py's format");
+
+// XYZ (Google/OSM) numbering, y down from the north
+constexpr uint64_t tileKey(uint8_t z, uint32_t x, uint32_t y) {
+    return (uint64_t)z << 48 | (uint64_t)(x & 0xFFFFFF) << 24 | (y & 0xFFFFFF);
+}
+
+// One piece of a tile; false stops it
+typedef bool (*TileSendHandler)(void* context, const uint8_t* data, size_t length);
+
+class TileServer {
+public:
+    TileServer();
+    ~TileServer();
+
+    // After Columns().begin(), which mounts LittleFS; true without an
+    // archive, which an upload can bring
+    bool begin();
+    void end();
+    bool isReady() const { return cache != nullptr; }
+    bool hasArchive() const { return index != nullptr; }
+    const TileArchiveHeader& getHeader() const { return header; }
+
+    bool findTile(uint8_t z, uint32_t x, uint32_t y, TileIndexEntry& entry) const;
+
+    // false if send gave up or flash failed
+    bool sendTile(const TileIndexEntry& entry, TileSendHandler send, void* context);
+
+    // A new archive of length bytes, written as it arrives; false if
+    // LittleFS hasn't the room. commitUpload() is false, and the archive
+    // being served kept, when the new one doesn't load
+    bool beginUpload(size_t length);
+    bool writeUpload(const uint8_t* data, size_t length);
+    bool commitUpload();
+    void cancelUpload();
+
+    static const char* formatContentType(uint8_t format);
+
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+    uint8_t getSlotsHeld() const;
+    void printStatus() const;
+
+private:
+    struct TileSlot {
+        uint32_t offset;
+        uint32_t length;        // 0 = empty
+        uint32_t lastUsed;
+    };
+
+    TileArchiveHeader header;
+    TileIndexEntry* index;      // header.tileCount, PSRAM
+    uint8_t* cache;             // TILE_CACHE_SLOTS * TILE_CACHE_SLOT_BYTES, PSRAM
+    uint8_t* chunk;             // TILE_CHUNK_BYTES
+    TileSlot slots[TILE_CACHE_SLOTS];
+    uint32_t useClock;
+    File upload;
+    size_t uploadLength;
+    size_t uploadReceived;
+
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t streamed;          // Over a slot, sent from flash
+    uint32_t readErrors;
+
+    bool loadIndex(const char* path, TileArchiveHeader& loaded, TileIndexEntry*& entries);
+    void clearCache();
+    bool sendFromFlash(const TileIndexEntry& entry, TileSendHandler send, void* context);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern TileServer& Tiles();
+
+#endif // BASE_STATION_TILES_H
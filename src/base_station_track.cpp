@@ -0,0 +1,197 @@
+#include "base_station_config.h"
+#include "base_station_track.h"
+#include "memory_ledger.h"
+
+static TrackStore trackStoreInstance;
+
+TrackStore& Tracks() {
+    return trackStoreInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+TrackStore::TrackStore() {
+    memset(devices, 0, sizeof(devices));
+    block = nullptr;
+    mutex = nullptr;
+    nextIndex = 0;
+    undecodable = 0;
+}
+
+TrackStore::~TrackStore() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool TrackStore::begin() {
+    if (mutex) {
+        return true;
+    }
+    block = (TrackVertex*)memCalloc(MemTag::PREDICTOR, TRACK_STORE_DEVICES * TRACK_STORE_VERTICES, sizeof(TrackVertex));
+    mutex = xSemaphoreCreateMutex();
+    if (!block || !mutex) {
+        Serial.println("Track store: No memory for the vertices");
+        end();
+        return false;
+    }
+    nextIndex = Packets().getOldest();
+    return true;
+}
+
+void TrackStore::end() {
+    memFree(MemTag::PREDICTOR, block);
+    block = nullptr;
+    memset(devices, 0, sizeof(devices));
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+}
+
+const DeviceTrack* TrackStore::find(uint8_t deviceId) const {
+    for (uint8_t d = 0; d < TRACK_STORE_DEVICES; d++) {
+        if (devices[d].active && devices[d].deviceId == deviceId) {
+            return &devices[d];
+        }
+    }
+    return nullptr;
+}
+
+// The balloon's track, opened on its first segment; nullptr once every one is taken
+DeviceTrack* TrackStore::device(uint8_t deviceId) {
+    DeviceTrack* found = const_cast<DeviceTrack*>(find(deviceId));
+    for (uint8_t d = 0; !found && d < TRACK_STORE_DEVICES; d++) {
+        if (!devices[d].active) {
+            found = &devices[d];
+            found->active = true;
+            found->deviceId = deviceId;
+            found->slots = block + (size_t)d * TRACK_STORE_VERTICES;
+        }
+    }
+    return found;
+}
+
+// ===========================
+// Segments
+// ===========================
+
+void TrackStore::update() {
+    if (!mutex) {
+        return;
+    }
+
+    static StoredPacket packet;         // Off the loop task's stack
+    static TrackSegment segment;
+
+    nextIndex = max(nextIndex, Packets().getOldest());
+    for (uint32_t next = Packets().getNext(); nextIndex < next; nextIndex++) {
+        if (!Packets().get(nextIndex, packet) || packet.type != PacketType::TRACK_SEGMENT) {
+            continue;
+        }
+        if (!trackDecode(packet.payload, packet.length, segment)) {
+            undecodable++;
+            continue;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        DeviceTrack* track = device(packet.deviceId);
+        if (track) {
+            addSegment(*track, segment);
+        }
+        xSemaphoreGive(mutex);
+    }
+}
+
+void TrackStore::addSegment(DeviceTrack& track, const TrackSegment& segment) {
+    uint8_t vertices = (segment.flags & TRACK_FLAG_LATEST) ? segment.count - 1 : segment.count;
+    if (vertices) {
+        // A number already passed, on a vertex newer than any stored: the balloon started over
+        uint32_t first = track.base + segment.firstIndex;
+        if (track.vertices && first < track.next && segment.points[0].time > track.newestTime) {
+            track.base = track.next;
+            track.restarts++;
+            first = track.base + segment.firstIndex;
+        }
+        for (uint8_t i = 0; i < vertices; i++) {
+            uint32_t index = first + i;
+            if (index + TRACK_STORE_VERTICES <= track.next) {
+                continue;       // Older than the window holds
+            }
+            TrackVertex& slot = track.slots[index % TRACK_STORE_VERTICES];
+            if (slot.point.time && slot.index == index) {
+                track.duplicates++;
+                continue;
+            }
+            slot.index = index;
+            slot.point = segment.points[i];
+            track.vertices++;
+            track.next = max(track.next, index + 1);
+            track.newestTime = max(track.newestTime, slot.point.time);
+        }
+    }
+    if ((segment.flags & TRACK_FLAG_LATEST) && (!track.hasLatest || segment.points[vertices].time > track.latest.time)) {
+        track.latest = segment.points[vertices];
+        track.hasLatest = true;
+    }
+    track.segments++;
+}
+
+// ===========================
+// Queries (any task)
+// ===========================
+
+size_t TrackStore::getVertices(uint8_t deviceId, uint32_t since, TrackVertex* out, size_t space,
+                               uint32_t& resume) const {
+    resume = since;
+    if (!mutex) {
+        return 0;
+    }
+    size_t count = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const DeviceTrack* track = find(deviceId);
+    if (track) {
+        uint32_t index = max(since, track->next > TRACK_STORE_VERTICES ? track->next - TRACK_STORE_VERTICES : 0u);
+        for (; index < track->next && count < space; index++) {
+            const TrackVertex& slot = track->slots[index % TRACK_STORE_VERTICES];
+            if (slot.point.time && slot.index == index) {
+                out[count++] = slot;
+            }
+        }
+        resume = max(since, index);
+    }
+    xSemaphoreGive(mutex);
+    return count;
+}
+
+bool TrackStore::getEnd(uint8_t deviceId, uint32_t& next, TrackPoint& latest, bool& hasLatest) const {
+    if (!mutex) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    const DeviceTrack* track = find(deviceId);
+    if (track) {
+        next = track->next;
+        latest = track->latest;
+        hasLatest = track->hasLatest;
+    }
+    xSemaphoreGive(mutex);
+    return track != nullptr;
+}
+
+void TrackStore::printStatus() const {
+    Serial.println("=== Track Store ===");
+    Serial.printf("Undecodable segments: %lu\n", (unsigned long)undecodable);
+    for (uint8_t d = 0; d < TRACK_STORE_DEVICES; d++) {
+        const DeviceTrack& track = devices[d];
+        if (!track.active) {
+            continue;
+        }
+        Serial.printf("Balloon %u: %lu vertices to #%lu, %lu segments, %lu duplicates, %u restarts\n",
+                      track.deviceId, (unsigned long)track.vertices, (unsigned long)track.next,
+                      (unsigned long)track.segments, (unsigned long)track.duplicates, track.restarts);
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef BASE_STATION_TRACK_H
+#define BASE_STATION_TRACK_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "packet_store.h"
+#include "track_history.h"
+
+// ===========================
+// Track Store (base station)
+// Each balloon's simplified flight path, put back together from its
+// TRACK_SEGMENT packets in whatever order and how many times they arrive
+// ===========================
+
+// The balloon numbers its track vertices (track_history.h); a vertex goes
+// into the slot its number falls on, modulo TRACK_STORE_VERTICES, and
+// keeps the number with it. A segment the link backlog brings late lands
+// in its own gap, a segment heard twice writes the same slots again, and
+// the path from any vertex on is the slots read in number order, skipping
+// the gaps never filled. With a vertex every 10-60 s in flight the window
+// is hours of track.
+//
+// The numbers start over when the balloon does. A segment numbered below
+// the highest vertex stored but timed after every one of them is that:
+// the new numbers go after the old ones, the old track kept. A late segment
+// from before the restart that arrives after it is numbered as if after
+// it, and lands wherever that falls.
+//
+// The newest fix each segment carries unnumbered is kept as the latest
+// point, the path's provisional end.
+//
+// update() runs from loop() and reads new segments out of the packet store
+// by index; the queries copy vertices out on any task.
+
+#define TRACK_STORE_VERTICES       2048    // Per balloon
+#define TRACK_STORE_DEVICES        RX_MAX_DEVICES
+
+struct TrackVertex {
+    uint32_t index;             // The store's numbering: the balloon's, plus base
+    TrackPoint point;           // time 0 - the slot was never filled
+};
+
+struct DeviceTrack {
+    bool active;
+    uint8_t deviceId;
+    bool hasLatest;
+    TrackPoint latest;
+    uint32_t base;              // Added to the balloon's vertex numbers, past every restart
+    uint32_t next;              // One past the highest vertex stored
+    uint32_t newestTime;        // Of any vertex stored
+    uint32_t vertices;          // Distinct ones stored
+    uint32_t duplicates;
+    uint32_t segments;
+    uint8_t restarts;
+    TrackVertex* slots;         // TRACK_STORE_VERTICES of the store's block
+};
+
+class TrackStore {
+public:
+    TrackStore();
+    ~TrackStore();
+
+    // After Packets().begin()
+    bool begin();
+    void end();
+    bool isReady() const { return mutex != nullptr; }
+
+    // From loop(): every new TRACK_SEGMENT
+    void update();
+
+    // Stored vertices numbered since on, in order, up to space of them;
+    // resume is where the next call carries on, next once all are copied
+    size_t getVertices(uint8_t deviceId, uint32_t since, TrackVertex* out, size_t space, uint32_t& resume) const;
+    // One past the highest vertex and the latest point; false for a balloon with no track
+    bool getEnd(uint8_t deviceId, uint32_t& next, TrackPoint& latest, bool& hasLatest) const;
+
+    void printStatus() const;
+
+private:
+    DeviceTrack devices[TRACK_STORE_DEVICES];
+    TrackVertex* block;         // PSRAM, every device's slots
+    SemaphoreHandle_t mutex;
+    uint32_t nextIndex;
+    uint32_t undecodable;
+
+    DeviceTrack* device(uint8_t deviceId);
+    const DeviceTrack* find(uint8_t deviceId) const;
+    void addSegment(DeviceTrack& track, const TrackSegment& segment);
+};
+
+TrackStore& Tracks();
+
+#endif // BASE_STATION_TRACK_H
@@ -0,0 +1,1681 @@
+#include "base_station_config.h"
+#include "base_station_web.h"
+#include "esp_http_server.h"
+#include "packet_store.h"
+#include "base_station_sessions.h"
+#include "base_station_flights.h"
+#include "base_station_columns.h"
+#include "base_station_export.h"
+#include "base_station_range.h"
+#include "base_station_rollups.h"
+#include "base_station_images.h"
+#include "base_station_predictor.h"
+#include "base_station_alerts.h"
+#include "base_station_fanout.h"
+#include "base_station_latency.h"
+#include "base_station_firmware.h"
+#include "base_station_capture.h"
+#include "base_station_tiles.h"
+#include "base_station_track.h"
+#include "gzip_stream.h"
+#include "pressure_profile.h"
+#include <ArduinoJson.h>
+#include "rx_pipeline.h"
+#include "lora_comm.h"
+#include "fragment_transfer.h"
+#include "task_placement.h"
+#include "memory_arena.h"
+
+static httpd_handle_t serverHandle = nullptr;
+
+// ===========================
+// JSON
+// ===========================
+
+// Alert messages come off the air - quotes and control bytes escaped
+static size_t appendEscaped(char* out, size_t space, const char* text, size_t maxLength) {
+    size_t used = 0;
+    for (size_t i = 0; i < maxLength && text[i] && used + 7 < space; i++) {
+        uint8_t c = (uint8_t)text[i];
+        if (c == '"' || c == '\\') {
+            out[used++] = '\\';
+            out[used++] = c;
+        } else if (c < 0x20 || c >= 0x7F) {
+            used += snprintf(out + used, space - used, "\\u%04x", c);
+        } else {
+            out[used++] = c;
+        }
+    }
+    out[used] = 0;
+    return used;
+}
+
+// One packet as a JSON object; the payload as hex when there is no decoder for it
+static size_t packetToJson(const StoredPacket& packet, char* out, size_t space) {
+    ProfileLevel level;
+    DigestData digest;
+    uint8_t trackFlags, trackPoints;
+    uint32_t trackFirst;
+    int used = snprintf(out, space,
+                        "{\"index\":%lu,\"device\":%u,\"type\":\"%s\",\"seq\":%u,\"time\":%lu,"
+                        "\"received_ms\":%lu,\"rssi\":%d,\"snr\":%d,\"late\":%s",
+                        (unsigned long)packet.index, packet.deviceId, packetTypeToString(packet.type),
+                        packet.sequenceNumber, (unsigned long)packet.timestamp,
+                        (unsigned long)packet.receivedAt, packet.rssi, packet.snr,
+                        packet.late ? "true" : "false");
+
+    if (packet.decoded && packet.type == PacketType::TELEMETRY) {
+        const TelemetryData& t = packet.data.telemetry;
+        used += snprintf(out + used, space - used,
+                         ",\"telemetry\":{\"temperature\":%.2f,\"pressure\":%.0f,\"humidity\":%.2f,"
+                         "\"battery_v\":%.3f,\"battery_a\":%.3f,\"battery_pct\":%u,\"uptime\":%lu,"
+                         "\"free_heap\":%u,\"cpu_temperature\":%.2f,\"power_state\":%u}",
+                         t.temperature, t.pressure, t.humidity, t.batteryVoltage, t.batteryCurrent,
+                         t.batteryPercentage, (unsigned long)t.uptime, t.freeHeap, t.cpuTemperature,
+                         t.powerState);
+    } else if (packet.decoded && packet.type == PacketType::GPS_DATA) {
+        const GPSData& g = packet.data.gps;
+        used += snprintf(out + used, space - used,
+                         ",\"gps\":{\"lat\":%.6f,\"lon\":%.6f,\"alt\":%.1f,\"sats\":%u,\"speed\":%.2f,"
+                         "\"course\":%.1f,\"fix_time\":%lu,\"hdop\":%u,\"quality\":%u}",
+                         g.latitude, g.longitude, g.altitude, g.satellites, g.speed, g.course,
+                         (unsigned long)g.fixTime, g.hdop, g.quality);
+    } else if (packet.decoded && packet.type == PacketType::CAMERA_DATA) {
+        const CameraData& c = packet.data.camera;
+        used += snprintf(out + used, space - used,
+                         ",\"camera\":{\"image\":%u,\"time\":%lu,\"size\":%u,\"sharpness\":%u,\"scene\":%u}",
+                         c.imageId, (unsigned long)c.timestamp, c.imageSize, c.sharpness, c.sceneLabel);
+    } else if (packet.decoded && packet.type == PacketType::ALERT) {
+        const AlertData& a = packet.data.alert;
+        used += snprintf(out + used, space - used, ",\"alert\":{\"type\":%u,\"severity\":%u,\"value\":%.2f,\"message\":\"",
+                         static_cast<uint8_t>(a.alertType), a.severity, a.sensorValue);
+        used += appendEscaped(out + used, space - used - 3, a.message, sizeof(a.message));
+        used += snprintf(out + used, space - used, "\"}");
+    } else if (packet.type == PacketType::PROFILE_LEVEL && profileDecode(packet.payload, packet.length, level)) {
+        used += snprintf(out + used, space - used,
+                         ",\"profile\":{\"low_hpa\":%.1f,\"high_hpa\":%.1f,\"direction\":\"%s\",\"partial\":%s,"
+                         "\"samples\":%u,\"seconds\":%.1f,\"pressure\":%.1f,\"altitude\":%.2f,"
+                         "\"temperature\":%.2f,\"temperature_corrected\":%.2f,\"temperature_sd\":%.2f,"
+                         "\"vertical_speed\":%.2f,\"temperature_trend\":%.3f}",
+                         level.binLow / 100.0f, (level.binLow + level.binWidth) / 100.0f,
+                         profileDirectionToString(level.direction),
+                         (level.flags & PROFILE_FLAG_PARTIAL) ? "true" : "false", level.samples,
+                         level.durationMs / 1000.0f, level.pressure, level.altitude, level.temperature,
+                         level.correctedTemperature, level.temperatureSd, level.verticalSpeed,
+                         level.temperatureTrend);
+    } else if (packet.type == PacketType::TRACK_SEGMENT &&
+               trackHeader(packet.payload, packet.length, trackFlags, trackFirst, trackPoints)) {
+        used += snprintf(out + used, space - used, ",\"track\":{\"first\":%lu,\"points\":%u,\"latest\":%s}",
+                         (unsigned long)trackFirst, trackPoints, (trackFlags & TRACK_FLAG_LATEST) ? "true" : "false");
+    } else if (packet.type == PacketType::DIGEST && packet.length == DigestSchema::size) {
+        DigestSchema::decode(packet.payload, digest);
+        used += snprintf(out + used, space - used,
+                         ",\"digest\":{\"uptime\":%lu,\"phase\":%u,\"mode\":%u,\"status\":%u,\"subsystems\":%u,"
+                         "\"temperature\":%.2f,\"pressure\":%.0f,\"altitude\":%.1f,\"vertical_speed\":%.2f,"
+                         "\"lat\":%.6f,\"lon\":%.6f,\"sats\":%u,\"battery_v\":%.3f,\"battery_pct\":%u,"
+                         "\"current_ma\":%.0f,\"power_state\":%u,\"rssi\":%d,\"snr\":%d,\"sf\":%u,\"tx_power\":%d,"
+                         "\"per_pct\":%u,\"ack_timeouts\":%u,\"captures\":%u,\"capture_errors\":%u,"
+                         "\"free_heap_kb\":%u,\"config_version\":%u,\"p99_us\":{\"sensors\":%lu,"
+                         "\"reports\":%lu,\"camera\":%lu,\"comms\":%lu}}",
+                         (unsigned long)(digest.uptime / 1000), digest.flightPhase, digest.mode, digest.systemStatus,
+                         digest.subsystemBits, digest.temperature, digest.pressure, digest.altitude,
+                         digest.verticalSpeed, digest.latitude, digest.longitude, digest.satellites,
+                         digest.batteryVoltage, digest.batteryPercentage, digest.current, digest.powerState,
+                         digest.rssi, digest.snr, digest.spreadingFactor, digest.txPower, digest.packetErrorRate,
+                         digest.ackTimeouts, digest.captures, digest.captureErrors, digest.freeHeapKb,
+                         digest.configVersion, (unsigned long)digest.p99SensorsUs,
+                         (unsigned long)digest.p99ReportsUs, (unsigned long)digest.p99CameraUs,
+                         (unsigned long)digest.p99CommsUs);
+    } else {
+        used += snprintf(out + used, space - used, ",\"payload\":\"");
+        for (uint8_t i = 0; i < packet.length && (size_t)used + 5 < space; i++) {
+            used += snprintf(out + used, space - used, "%02x", packet.payload[i]);
+        }
+        used += snprintf(out + used, space - used, "\"");
+    }
+
+    used += snprintf(out + used, space - used, "}");
+    return (size_t)used < space ? used : space - 1;
+}
+
+// One alert event; balloon-sent ones carry the balloon's text
+static size_t alertToJson(const AlertEvent& event, char* out, size_t space) {
+    bool balloon = event.rule == ALERT_RULE_BALLOON;
+    int used = snprintf(out, space,
+                        "{\"seq\":%lu,\"time\":%lu,\"device\":%u,\"rule\":\"%s\",\"severity\":\"%s\","
+                        "\"state\":\"%s\",\"value\":%.2f,\"message\":\"",
+                        (unsigned long)event.sequence, (unsigned long)event.time, event.deviceId,
+                        balloon ? "balloon" : Alerts().getRule(event.rule).name, alertSeverityName(event.severity),
+                        event.raised ? "raised" : "cleared", event.value);
+    used += appendEscaped(out + used, space - used - 3, event.message, sizeof(event.message));
+    used += snprintf(out + used, space - used, "\"}");
+    return (size_t)used < space ? used : space - 1;
+}
+
+static bool queryString(httpd_req_t* req, const char* key, char* value, size_t size) {
+    char query[BASE_WEB_QUERY_MAX];
+    return httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+           httpd_query_key_value(query, key, value, size) == ESP_OK;
+}
+
+static uint32_t queryValue(httpd_req_t* req, const char* key, uint32_t fallback) {
+    char value[12];
+    return queryString(req, key, value, sizeof(value)) ? strtoul(value, nullptr, 10) : fallback;
+}
+
+// flight=<id> in place of device, from and to: false if it isn't catalogued
+static bool queryFlight(httpd_req_t* req, uint8_t& deviceId, uint32_t& from, uint32_t& to) {
+    uint32_t id = queryValue(req, "flight", 0);
+    if (!id) {
+        return true;
+    }
+    FlightRecord flight;
+    if (!Flights().getFlight(id, flight)) {
+        return false;
+    }
+    deviceId = flight.deviceId;
+    from = flight.startTime;
+    to = flight.endTime;
+    return true;
+}
+
+// ===========================
+// Responses
+// ===========================
+
+// A JSON body goes out through the one response below - handlers run one at
+// a time. It is gzipped when the client takes gzip, unless gzip=0, and it
+// runs past BASE_WEB_GZIP_MIN_BYTES: that much is held back, and a body that
+// ends within it is sent whole, as it is. Plain if the window can't be had
+//
+// A handler whose body only changes with a revision keeps the gzipped body
+// in a JsonCache under its ETag, and sends that again until the revision moves
+struct JsonCache {
+    char key[32];
+    uint8_t data[BASE_WEB_GZIP_CACHE_BYTES];
+    size_t length;          // 0 while nothing is kept
+};
+
+struct JsonResponse {
+    httpd_req_t* req;
+    size_t held;
+    bool accepted;          // Client takes gzip
+    bool streaming;         // Past the threshold, chunks going out
+    bool compressed;        // ... through the compressor
+    JsonCache* cache;       // Filling, or nullptr
+    size_t cached;
+};
+
+static JsonResponse response;
+static char responseHeld[BASE_WEB_GZIP_MIN_BYTES];
+static GzipStream responseGzip;
+
+static bool acceptsGzip(httpd_req_t* req) {
+    char encoding[96];
+    return httpd_req_get_hdr_value_str(req, "Accept-Encoding", encoding, sizeof(encoding)) == ESP_OK &&
+           strstr(encoding, "gzip") && queryValue(req, "gzip", 1) != 0;
+}
+
+static bool sendCompressed(const uint8_t* data, size_t length, void* context) {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), (const char*)data, length) == ESP_OK;
+}
+
+// Into the response, and a copy into the cache filling while it fits
+static bool sendJsonCompressed(const uint8_t* data, size_t length, void* context) {
+    JsonCache* cache = response.cache;
+    if (cache && response.cached + length <= sizeof(cache->data)) {
+        memcpy(cache->data + response.cached, data, length);
+        response.cached += length;
+    } else {
+        response.cache = nullptr;
+    }
+    return sendCompressed(data, length, response.req);
+}
+
+static void beginJson(httpd_req_t* req) {
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    response.req = req;
+    response.held = 0;
+    response.accepted = acceptsGzip(req);
+    response.streaming = false;
+    response.compressed = false;
+    response.cache = nullptr;
+    response.cached = 0;
+}
+
+// After beginJson(): true if the client takes gzip and cache holds key's
+// body, sent as res; otherwise the body to come is kept under key if it is
+// gzipped and fits
+static bool sendCachedJson(JsonCache& cache, const char* key, esp_err_t& res) {
+    if (!response.accepted) {
+        return false;
+    }
+    if (cache.length && !strcmp(cache.key, key)) {
+        httpd_resp_set_hdr(response.req, "Content-Encoding", "gzip");
+        res = httpd_resp_send(response.req, (const char*)cache.data, cache.length);
+        return true;
+    }
+    snprintf(cache.key, sizeof(cache.key), "%s", key);
+    cache.length = 0;
+    response.cache = &cache;
+    return false;
+}
+
+// The headers, then what was held
+static esp_err_t startJsonStream() {
+    response.streaming = true;
+    response.compressed = response.accepted && responseGzip.begin(sendJsonCompressed, nullptr);
+    if (response.compressed) {
+        httpd_resp_set_hdr(response.req, "Content-Encoding", "gzip");
+        return responseGzip.write(responseHeld, response.held) ? ESP_OK : ESP_FAIL;
+    }
+    return response.held ? httpd_resp_send_chunk(response.req, responseHeld, response.held) : ESP_OK;
+}
+
+static esp_err_t writeJson(const char* data, size_t length) {
+    if (!response.streaming) {
+        if (response.held + length <= sizeof(responseHeld)) {
+            memcpy(responseHeld + response.held, data, length);
+            response.held += length;
+            return ESP_OK;
+        }
+        esp_err_t res = startJsonStream();
+        if (res != ESP_OK) {
+            return res;
+        }
+    }
+    if (response.compressed) {
+        return responseGzip.write(data, length) ? ESP_OK : ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(response.req, data, length);
+}
+
+static esp_err_t finishJson() {
+    if (!response.streaming) {
+        return httpd_resp_send(response.req, responseHeld, response.held);
+    }
+    if (response.compressed && !responseGzip.finish()) {
+        return ESP_FAIL;
+    }
+    if (response.compressed && response.cache) {
+        response.cache->length = response.cached;
+    }
+    return httpd_resp_send_chunk(response.req, NULL, 0);
+}
+
+static esp_err_t sendJson(httpd_req_t* req, const char* json, size_t length) {
+    beginJson(req);
+    esp_err_t res = writeJson(json, length);
+    return res == ESP_OK ? finishJson() : res;
+}
+
+// ===========================
+// Handlers
+// ===========================
+
+static esp_err_t statusHandler(httpd_req_t* req) {
+    char json[640];
+    FirmwareUploadStatus upload = FirmwareUplink().getStatus();
+    int length = snprintf(json, sizeof(json),
+                          "{\"uptime_ms\":%lu,\"free_heap\":%lu,\"devices\":%d,\"records_delivered\":%lu,"
+                          "\"duplicates\":%lu,\"last_rssi\":%d,\"last_snr\":%d,\"stored\":%lu,\"oldest\":%lu,"
+                          "\"next\":%lu,\"capacity\":%lu,\"decode_failures\":%lu,\"transfers_reassembled\":%lu,"
+                          "\"firmware\":{\"state\":\"%s\",\"update\":%u,\"chunk\":%u,\"chunks\":%u,\"bytes\":%lu,"
+                          "\"resent\":%lu,\"image\":\"%02x%02x%02x%02x\"}}",
+                          (unsigned long)millis(), (unsigned long)ESP.getFreeHeap(), RxPipeline().getDeviceCount(),
+                          (unsigned long)RxPipeline().getRecordsDelivered(),
+                          (unsigned long)RxPipeline().getDuplicateCount(), LoRaComm().getLastRSSI(),
+                          LoRaComm().getLastSNR(), (unsigned long)Packets().getStored(),
+                          (unsigned long)Packets().getOldest(), (unsigned long)Packets().getNext(),
+                          (unsigned long)Packets().getCapacity(), (unsigned long)Packets().getDecodeFailures(),
+                          (unsigned long)FragmentMgr().getTransfersReassembled(),
+                          FirmwareUploader::stateToString(upload.state), upload.updateId, upload.chunk,
+                          upload.chunkCount, (unsigned long)upload.length, (unsigned long)upload.retries,
+                          upload.newHash[0], upload.newHash[1], upload.newHash[2], upload.newHash[3]);
+    return sendJson(req, json, min((size_t)length, sizeof(json) - 1));
+}
+
+// Every balloon heard, with its link figures and what is kept for it
+static esp_err_t sessionsHandler(httpd_req_t* req) {
+    static char json[BASE_WEB_ENTRY_MAX * 2];
+    uint32_t now = millis();
+
+    int length = snprintf(json, sizeof(json), "{\"max\":%u,\"sessions\":[", SESSION_MAX);
+    for (uint8_t s = 0; s < Sessions().getCount(); s++) {
+        const BalloonSession& session = Sessions().getSession(s);
+        length += snprintf(json + length, sizeof(json) - length,
+                           "%s{\"device\":%u,\"slot\":%u,\"packets\":%lu,\"late\":%lu,\"last_seen_ms\":%lu,"
+                           "\"seq\":%u,\"rssi\":%d,\"snr\":%d,\"images\":%lu,\"latest_image\":%lu,\"flight\":%lu,"
+                           "\"columns\":%s,\"rollups\":%s,\"track\":%s,\"alerts\":%s}",
+                           s ? "," : "", session.deviceId, session.slot, (unsigned long)session.packets,
+                           (unsigned long)session.latePackets, (unsigned long)(now - session.lastSeen),
+                           session.lastSequence, session.lastRssi, session.lastSnr,
+                           (unsigned long)session.images, (unsigned long)session.latestImage,
+                           (unsigned long)session.flightId,
+                           session.columns ? "true" : "false", session.rollups ? "true" : "false",
+                           session.track ? "true" : "false", session.alerts ? "true" : "false");
+    }
+    length += snprintf(json + length, sizeof(json) - length, "]}");
+    return sendJson(req, json, min((size_t)length, sizeof(json) - 1));
+}
+
+// A packet per chunk, oldest first
+static esp_err_t packetsHandler(httpd_req_t* req) {
+    static StoredPacket packet;             // Off the httpd task's stack; handlers run one at a time
+    static char entry[BASE_WEB_ENTRY_MAX];
+
+    uint32_t since = max(queryValue(req, "since", 0), Packets().getOldest());
+    uint32_t limit = constrain(queryValue(req, "limit", BASE_WEB_DEFAULT_LIMIT), 1u, Packets().getCapacity());
+    uint32_t end = min(Packets().getNext(), since + limit);
+
+    beginJson(req);
+
+    esp_err_t res = writeJson("[", 1);
+    bool first = true;
+    for (uint32_t index = since; index < end && res == ESP_OK; index++) {
+        if (!Packets().get(index, packet)) {
+            continue;       // Overwritten while we were sending
+        }
+        size_t length = 0;
+        if (!first) {
+            entry[length++] = ',';
+        }
+        length += packetToJson(packet, entry + length, sizeof(entry) - length);
+        res = writeJson(entry, length);
+        first = false;
+    }
+    if (res == ESP_OK) {
+        res = writeJson("]", 1);
+    }
+    if (res == ESP_OK) {
+        res = finishJson();
+    }
+    return res;
+}
+
+static esp_err_t sendLatest(httpd_req_t* req, PacketType type) {
+    static StoredPacket packet;
+    static char entry[BASE_WEB_ENTRY_MAX];
+
+    if (!Packets().getLatest(type, packet) || !packet.decoded) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    return sendJson(req, entry, packetToJson(packet, entry, sizeof(entry)));
+}
+
+static esp_err_t telemetryLatestHandler(httpd_req_t* req) {
+    return sendLatest(req, PacketType::TELEMETRY);
+}
+
+static esp_err_t gpsLatestHandler(httpd_req_t* req) {
+    return sendLatest(req, PacketType::GPS_DATA);
+}
+
+// A point per bucket of the finest rollup level that fits the window in points
+static esp_err_t graphHandler(httpd_req_t* req) {
+    static RollupPoint points[MAX_GRAPH_DATAPOINTS];
+    static char entry[BASE_WEB_ENTRY_MAX];
+
+    char name[24];
+    Column column;
+    if (!queryString(req, "field", name, sizeof(name)) || !columnFromName(name, column)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "field=<column name> required");
+    }
+
+    uint8_t ids[COLUMN_MAX_DEVICES];
+    uint8_t deviceId = Columns().getDevices(ids, COLUMN_MAX_DEVICES) ? ids[0] : 0;
+    deviceId = queryValue(req, "device", deviceId);
+    uint32_t to = queryValue(req, "to", Columns().now());
+    uint32_t from = queryValue(req, "from", to > ROLLUP_HISTORY_S ? to - ROLLUP_HISTORY_S : 0);
+    uint32_t limit = constrain(queryValue(req, "points", MAX_GRAPH_DATAPOINTS), 1u, (uint32_t)MAX_GRAPH_DATAPOINTS);
+    if (!queryFlight(req, deviceId, from, to)) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    uint16_t resolution;
+    size_t count = Rollups().query(deviceId, column, from, to, points, limit, resolution);
+
+    beginJson(req);
+
+    int length = snprintf(entry, sizeof(entry), "{\"device\":%u,\"field\":\"%s\",\"resolution\":%u,\"points\":[",
+                          deviceId, columnName(column), resolution);
+    esp_err_t res = writeJson(entry, length);
+
+    // [time, min, max, mean, count], a chunk per few points
+    uint8_t decimals = columnDecimals(column);
+    length = 0;
+    for (size_t i = 0; i < count && res == ESP_OK; i++) {
+        const RollupPoint& p = points[i];
+        length += snprintf(entry + length, sizeof(entry) - length, "%s[%lu,%.*f,%.*f,%.*f,%u]", i ? "," : "",
+                           (unsigned long)p.time, decimals, p.min, decimals, p.max, decimals + 1, p.mean, p.count);
+        if (length > BASE_WEB_ENTRY_MAX - 96 || i + 1 == count) {
+            res = writeJson(entry, length);
+            length = 0;
+        }
+    }
+    if (res == ESP_OK) {
+        res = writeJson("]}", 2);
+    }
+    if (res == ESP_OK) {
+        res = finishJson();
+    }
+    return res;
+}
+
+// The whole export through one chunk buffer, however long the flight
+static esp_err_t exportHandler(httpd_req_t* req) {
+    static ExportStream stream;
+    static GzipWriter gzip;
+    static char chunk[EXPORT_CHUNK_SIZE];
+
+    if (!Columns().isReady()) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Column store not running");
+    }
+
+    char text[BASE_WEB_QUERY_MAX];
+    ExportFormat format = ExportFormat::CSV;
+    if (queryString(req, "format", text, sizeof(text)) && !exportFormatFromName(text, format)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "format must be an enabled one of csv, json, kml");
+    }
+
+    uint8_t ids[COLUMN_MAX_DEVICES];
+    uint8_t deviceId = Columns().getDevices(ids, COLUMN_MAX_DEVICES) ? ids[0] : 0;
+    deviceId = queryValue(req, "device", deviceId);
+    uint32_t from = queryValue(req, "from", 0);
+    uint32_t to = queryValue(req, "to", UINT32_MAX);
+    if (!queryFlight(req, deviceId, from, to)) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    Column columns[COLUMN_COUNT];
+    uint8_t columnCount = 0;
+    if (queryString(req, "fields", text, sizeof(text))) {
+        char* save = nullptr;
+        for (char* name = strtok_r(text, ",", &save); name; name = strtok_r(nullptr, ",", &save)) {
+            if (columnCount == COLUMN_COUNT || !columnFromName(name, columns[columnCount])) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown field");
+            }
+            columnCount++;
+        }
+    } else {
+        for (uint8_t c = 0; c < COLUMN_COUNT; c++) {
+            columns[columnCount++] = static_cast<Column>(c);
+        }
+    }
+
+    if (!stream.begin(format, deviceId, from, to, columns, columnCount)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad range or fields");
+    }
+
+    // Compressed when the client takes gzip, unless gzip=0; plain if the
+    // compressor's memory isn't there
+    bool compressed = acceptsGzip(req) && gzip.begin(sendCompressed, req);
+
+    char disposition[48];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=balloon%u.%s", deviceId, exportFormatName(format));
+    httpd_resp_set_type(req, exportContentType(format));
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    if (compressed) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+
+    esp_err_t res = ESP_OK;
+    size_t length;
+    while (res == ESP_OK && (length = stream.read(chunk, sizeof(chunk))) > 0) {
+        if (compressed) {
+            res = gzip.write(chunk, length) ? ESP_OK : ESP_FAIL;
+        } else {
+            res = httpd_resp_send_chunk(req, chunk, length);
+        }
+    }
+    if (res == ESP_OK && compressed && !gzip.finish()) {
+        res = ESP_FAIL;
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    stream.end();
+    gzip.end();
+    return res;
+}
+
+// One page of a range query, and the cursor to the next in it
+static esp_err_t rangeHandler(httpd_req_t* req) {
+    static RangeQuery query;
+    static char chunk[EXPORT_CHUNK_SIZE];
+
+    if (!Columns().isReady()) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Column store not running");
+    }
+
+    // A cursor carries the whole request; anything else given with it is ignored
+    RangeRequest request;
+    char text[BASE_WEB_QUERY_MAX];
+    if (queryString(req, "cursor", text, sizeof(text))) {
+        if (!rangeCursorDecode(text, request)) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad cursor");
+        }
+    } else {
+        uint8_t ids[COLUMN_MAX_DEVICES];
+        uint8_t deviceId = Columns().getDevices(ids, COLUMN_MAX_DEVICES) ? ids[0] : 0;
+        deviceId = queryValue(req, "device", deviceId);
+        uint32_t from = queryValue(req, "from", 0);
+        uint32_t to = queryValue(req, "to", Columns().now());
+        if (!queryFlight(req, deviceId, from, to)) {
+            httpd_resp_send_404(req);
+            return ESP_FAIL;
+        }
+
+        uint16_t fields = 0;
+        if (queryString(req, "fields", text, sizeof(text))) {
+            char* save = nullptr;
+            for (char* name = strtok_r(text, ",", &save); name; name = strtok_r(nullptr, ",", &save)) {
+                Column column;
+                if (!columnFromName(name, column)) {
+                    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown field");
+                }
+                fields |= 1u << static_cast<uint8_t>(column);
+            }
+        } else {
+            fields = (1u << COLUMN_COUNT) - 1;
+        }
+
+        request.deviceId = deviceId;
+        request.fields = fields;
+        request.resolution = min(queryValue(req, "resolution", 0), (uint32_t)UINT16_MAX);
+        request.limit = constrain(queryValue(req, "limit", RANGE_API_DEFAULT_ROWS), 1u, (uint32_t)RANGE_API_MAX_ROWS);
+        request.from = from;
+        request.to = to;
+    }
+
+    if (!query.begin(request)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad range or fields");
+    }
+
+    beginJson(req);
+    esp_err_t res = ESP_OK;
+    size_t length;
+    while (res == ESP_OK && (length = query.read(chunk, sizeof(chunk))) > 0) {
+        res = writeJson(chunk, length);
+    }
+    if (res == ESP_OK) {
+        res = finishJson();
+    }
+    query.end();
+    return res;
+}
+
+static bool sendCapture(void* context, const uint8_t* data, size_t length) {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), (const char*)data, length) == ESP_OK;
+}
+
+// Both capture files as one pcap, straight off flash
+static esp_err_t linkCaptureHandler(httpd_req_t* req) {
+    if (!LinkCaptures().isReady()) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Link capture not running");
+    }
+    httpd_resp_set_type(req, "application/vnd.tcpdump.pcap");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=linkcap.pcap");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    if (!LinkCaptures().download(sendCapture, req)) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static size_t flightToJson(const FlightRecord& f, char* out, size_t space) {
+    int used = snprintf(out, space,
+                        "{\"id\":%lu,\"device\":%u,\"from\":%lu,\"to\":%lu,\"packets\":%lu,"
+                        "\"max_altitude\":%.0f,\"first_image\":%lu,\"last_image\":%lu}",
+                        (unsigned long)f.id, f.deviceId, (unsigned long)f.startTime, (unsigned long)f.endTime,
+                        (unsigned long)f.packets, f.maxAltitude, (unsigned long)f.firstImage,
+                        (unsigned long)f.lastImage);
+    return (size_t)used < space ? used : space - 1;
+}
+
+// A page of the flight catalog, newest first
+static esp_err_t flightsHandler(httpd_req_t* req) {
+    static FlightRecord page[BASE_WEB_FLIGHTS_PER_PAGE];
+    static char json[BASE_WEB_ENTRY_MAX * 4];
+    static JsonCache cache;
+
+    uint32_t number = queryValue(req, "page", 0);
+    char key[32];
+    snprintf(key, sizeof(key), "flights-%lu-%lu", (unsigned long)Flights().getRevision(), (unsigned long)number);
+    beginJson(req);
+    esp_err_t res;
+    if (sendCachedJson(cache, key, res)) {
+        return res;
+    }
+
+    size_t total = 0;
+    size_t count = Flights().getFlights((size_t)number * BASE_WEB_FLIGHTS_PER_PAGE, page, BASE_WEB_FLIGHTS_PER_PAGE,
+                                        total);
+    size_t length = snprintf(json, sizeof(json), "{\"page\":%lu,\"pages\":%u,\"total\":%u,\"flights\":[",
+                             (unsigned long)number,
+                             (unsigned)((total + BASE_WEB_FLIGHTS_PER_PAGE - 1) / BASE_WEB_FLIGHTS_PER_PAGE),
+                             (unsigned)total);
+    for (size_t i = 0; i < count && length < sizeof(json) - 4; i++) {
+        if (i) {
+            json[length++] = ',';
+        }
+        length += flightToJson(page[i], json + length, sizeof(json) - length - 3);
+    }
+    length += snprintf(json + length, sizeof(json) - length, "]}");
+    res = writeJson(json, min(length, sizeof(json) - 1));
+    return res == ESP_OK ? finishJson() : res;
+}
+
+// One flight by id, or the one covering time - of device, if given
+static esp_err_t flightHandler(httpd_req_t* req) {
+    char json[BASE_WEB_ENTRY_MAX];
+
+    FlightRecord flight;
+    uint32_t id = queryValue(req, "id", 0);
+    bool found;
+    if (id) {
+        found = Flights().getFlight(id, flight);
+    } else {
+        uint32_t time = queryValue(req, "time", Columns().now());
+        char value[12];
+        int16_t deviceId = queryString(req, "device", value, sizeof(value)) ? (uint8_t)strtoul(value, nullptr, 10) : -1;
+        found = Flights().findFlight(time, deviceId, flight);
+    }
+    if (!found) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    return sendJson(req, json, flightToJson(flight, json, sizeof(json)));
+}
+
+// The landing point and its ellipse, as of the balloon's last fix
+static esp_err_t predictionHandler(httpd_req_t* req) {
+    char json[BASE_WEB_ENTRY_MAX];
+
+    uint8_t ids[COLUMN_MAX_DEVICES];
+    uint8_t deviceId = Columns().getDevices(ids, COLUMN_MAX_DEVICES) ? ids[0] : 0;
+    deviceId = queryValue(req, "device", deviceId);
+
+    LandingPrediction p;
+    if (!Predictor().getPrediction(deviceId, p)) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    int length = snprintf(json, sizeof(json),
+                          "{\"device\":%u,\"leg\":\"%s\",\"lat\":%.6f,\"lon\":%.6f,\"seconds\":%.0f,"
+                          "\"ellipse\":{\"major\":%.0f,\"minor\":%.0f,\"bearing\":%.1f,\"sigmas\":%.1f},"
+                          "\"vertical_speed\":%.2f,\"descent_rate\":%.2f,\"ground\":%.0f,\"fix_time\":%lu,"
+                          "\"compute_us\":%lu}",
+                          deviceId, flightLegName(p.leg), p.latitude, p.longitude, p.secondsToLanding,
+                          p.ellipseMajor, p.ellipseMinor, p.ellipseBearing, PREDICT_ELLIPSE_SIGMAS,
+                          p.verticalSpeed, p.descentRate, p.groundAltitude, (unsigned long)p.fixTime,
+                          (unsigned long)p.computeMicros);
+    return sendJson(req, json, min((size_t)length, sizeof(json) - 1));
+}
+
+// The balloon's simplified path from vertex since on, its numbering; a map
+// polls with the next it was given to get only what arrived since
+static esp_err_t trackHandler(httpd_req_t* req) {
+    static TrackVertex page[BASE_WEB_TRACK_PAGE];
+    static char json[BASE_WEB_ENTRY_MAX];
+
+    uint8_t ids[COLUMN_MAX_DEVICES];
+    uint8_t deviceId = Columns().getDevices(ids, COLUMN_MAX_DEVICES) ? ids[0] : 0;
+    deviceId = queryValue(req, "device", deviceId);
+
+    uint32_t next;
+    TrackPoint latest;
+    bool hasLatest;
+    if (!Tracks().getEnd(deviceId, next, latest, hasLatest)) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    beginJson(req);
+    size_t length = snprintf(json, sizeof(json), "{\"device\":%u,\"next\":%lu,\"latest\":", deviceId,
+                             (unsigned long)next);
+    if (hasLatest) {
+        length += snprintf(json + length, sizeof(json) - length, "[%lu,%.6f,%.6f,%ld]", (unsigned long)latest.time,
+                           latest.latitude / 1e6, latest.longitude / 1e6, (long)latest.altitude);
+    } else {
+        length += snprintf(json + length, sizeof(json) - length, "null");
+    }
+    length += snprintf(json + length, sizeof(json) - length, ",\"points\":[");
+    esp_err_t res = writeJson(json, length);
+
+    // [index, time, lat, lon, alt] - vertices arriving meanwhile past next wait for the next poll
+    bool first = true;
+    uint32_t since = queryValue(req, "since", 0);
+    while (res == ESP_OK && since < next) {
+        size_t count = Tracks().getVertices(deviceId, since, page, BASE_WEB_TRACK_PAGE, since);
+        length = 0;
+        for (size_t i = 0; i < count && page[i].index < next; i++) {
+            const TrackVertex& v = page[i];
+            length += snprintf(json + length, sizeof(json) - length, "%s[%lu,%lu,%.6f,%.6f,%ld]", first ? "" : ",",
+                               (unsigned long)v.index, (unsigned long)v.point.time, v.point.latitude / 1e6,
+                               v.point.longitude / 1e6, (long)v.point.altitude);
+            first = false;
+        }
+        res = writeJson(json, length);
+        if (count == 0) {
+            break;
+        }
+    }
+    if (res == ESP_OK) {
+        res = writeJson("]}", 2);
+    }
+    return res == ESP_OK ? finishJson() : res;
+}
+
+// Conditional GET - true when the client's cached copy is this one
+static bool etagMatches(httpd_req_t* req, const char* etag) {
+    char match[32];
+    return httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK && !strcmp(match, etag);
+}
+
+static esp_err_t sendNotModified(httpd_req_t* req) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+// What the balloon embedded in the image, as more fields of its gallery entry
+static size_t imageMetaToJson(const ImageMetadata& meta, char* out, size_t space) {
+    if (!meta.valid) {
+        out[0] = 0;
+        return 0;
+    }
+    int used = snprintf(out, space,
+                        ",\"meta\":{\"capture_ms\":%lu,\"exposure\":%u,\"gain\":%u,\"luma\":%u,\"novelty\":%u,"
+                        "\"sharpness\":%u,\"scene\":%u,\"scene_confidence\":%u,\"burst\":%u",
+                        (unsigned long)meta.timestamp, meta.exposureLines, meta.gain, meta.meanLuma, meta.novelty,
+                        meta.sharpness, meta.sceneLabel, meta.sceneConfidence, meta.burstFrames);
+    if (meta.hasPosition) {
+        used += snprintf(out + used, space - used, ",\"lat\":%.7f,\"lon\":%.7f",
+                         meta.latitudeE7 / 1e7, meta.longitudeE7 / 1e7);
+    }
+    if (meta.hasAltitude) {
+        used += snprintf(out + used, space - used, ",\"alt\":%.2f", meta.altitudeCm / 100.0);
+    }
+    used += snprintf(out + used, space - used, "}");
+    return (size_t)used < space ? used : space - 1;
+}
+
+// A page of the gallery, newest first, out of the image catalog
+static esp_err_t galleryHandler(httpd_req_t* req) {
+    static ImageInfo page[GALLERY_IMAGES_PER_PAGE];
+    static char entry[BASE_WEB_ENTRY_MAX];
+    static JsonCache cache;
+
+    uint32_t number = queryValue(req, "page", 0);
+    uint32_t revision = Images().getRevision();
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"gallery-%lu-%lu\"", (unsigned long)revision, (unsigned long)number);
+
+    beginJson(req);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    if (etagMatches(req, etag)) {
+        return sendNotModified(req);
+    }
+    esp_err_t res;
+    if (sendCachedJson(cache, etag, res)) {
+        return res;
+    }
+
+    size_t total = 0;
+    size_t count = Images().getPage((size_t)number * GALLERY_IMAGES_PER_PAGE, page, GALLERY_IMAGES_PER_PAGE, total);
+
+    int length = snprintf(entry, sizeof(entry), "{\"page\":%lu,\"pages\":%u,\"total\":%u,\"images\":[",
+                          (unsigned long)number, (unsigned)((total + GALLERY_IMAGES_PER_PAGE - 1) / GALLERY_IMAGES_PER_PAGE),
+                          (unsigned)total);
+    res = writeJson(entry, length);
+    for (size_t i = 0; i < count && res == ESP_OK; i++) {
+        const ImageInfo& image = page[i];
+        length = snprintf(entry, sizeof(entry),
+                          "%s{\"id\":%lu,\"device\":%u,\"camera_id\":%u,\"time\":%lu,\"bytes\":%lu,"
+                          "\"width\":%u,\"height\":%u,\"thumb\":%s,\"ready\":%s",
+                          i ? "," : "", (unsigned long)image.id, image.deviceId, image.cameraId,
+                          (unsigned long)image.time, (unsigned long)image.length, image.width, image.height,
+                          image.thumbLength ? "true" : "false", image.processed ? "true" : "false");
+        length += imageMetaToJson(image.meta, entry + length, sizeof(entry) - length - 1);
+        entry[length++] = '}';
+        res = writeJson(entry, length);
+    }
+    if (res == ESP_OK) {
+        res = writeJson("]}", 2);
+    }
+    if (res == ESP_OK) {
+        res = finishJson();
+    }
+    return res;
+}
+
+// An id's bytes never change, so its ETag is the id
+static esp_err_t sendImage(httpd_req_t* req, bool thumbnail) {
+    static uint8_t chunk[BASE_WEB_IMAGE_CHUNK];
+
+    ImageInfo info;
+    uint32_t id = queryValue(req, "id", 0);
+    if (!Images().getInfo(id, info) || (thumbnail && info.thumbLength == 0)) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"%s-%lu\"", thumbnail ? "thumb" : "img", (unsigned long)id);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (etagMatches(req, etag)) {
+        return sendNotModified(req);
+    }
+    httpd_resp_set_type(req, "image/jpeg");
+
+    esp_err_t res = ESP_OK;
+    size_t offset = 0;
+    size_t length;
+    while (res == ESP_OK && (length = Images().read(id, thumbnail, offset, chunk, sizeof(chunk))) > 0) {
+        res = httpd_resp_send_chunk(req, (const char*)chunk, length);
+        offset += length;
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return res;
+}
+
+static esp_err_t imageHandler(httpd_req_t* req) {
+    return sendImage(req, false);
+}
+
+static esp_err_t thumbHandler(httpd_req_t* req) {
+    return sendImage(req, true);
+}
+
+// The newest preview frame as an 8-bit grayscale BMP, which an <img> shows
+// as it is; rows still on the air are mid gray. BMP rows run bottom up,
+// padded to 4 bytes
+#define PREVIEW_BMP_HEADER   (14 + 40 + 256 * 4)
+
+static void putLe16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void putLe32(uint8_t* out, uint32_t value) {
+    putLe16(out, value & 0xFFFF);
+    putLe16(out + 2, value >> 16);
+}
+
+static esp_err_t previewHandler(httpd_req_t* req) {
+    static PreviewImage preview;
+    static uint8_t gray[PREVIEW_MAX_WIDTH];
+    static uint8_t bmp[PREVIEW_BMP_HEADER + PREVIEW_MAX_WIDTH * PREVIEW_MAX_HEIGHT];
+
+    if (!Images().getPreview(preview)) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"preview-%lu\"", (unsigned long)preview.revision);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (etagMatches(req, etag)) {
+        return sendNotModified(req);
+    }
+
+    size_t stride = (preview.width + 3) & ~3;
+    size_t imageBytes = stride * preview.height;
+    memset(bmp, 0, PREVIEW_BMP_HEADER);
+    bmp[0] = 'B';
+    bmp[1] = 'M';
+    putLe32(&bmp[2], PREVIEW_BMP_HEADER + imageBytes);
+    putLe32(&bmp[10], PREVIEW_BMP_HEADER);
+    putLe32(&bmp[14], 40);
+    putLe32(&bmp[18], preview.width);
+    putLe32(&bmp[22], preview.height);
+    putLe16(&bmp[26], 1);
+    putLe16(&bmp[28], 8);
+    putLe32(&bmp[34], imageBytes);
+    putLe32(&bmp[46], 256);
+    for (int i = 0; i < 256; i++) {
+        uint8_t* entry = &bmp[54 + i * 4];
+        entry[0] = entry[1] = entry[2] = i;
+    }
+
+    size_t rowBytes = previewRowBytes(preview.width, preview.bits);
+    for (uint8_t y = 0; y < preview.height; y++) {
+        uint8_t* row = &bmp[PREVIEW_BMP_HEADER + (preview.height - 1 - y) * stride];
+        memset(row, 0, stride);
+        if (preview.rows & (1ULL << y)) {
+            previewUnpack(&preview.pixels[y * rowBytes], preview.width, 1, preview.bits, gray);
+            memcpy(row, gray, preview.width);
+        } else {
+            memset(row, 128, preview.width);
+        }
+    }
+
+    httpd_resp_set_type(req, "image/bmp");
+    return httpd_resp_send(req, (const char*)bmp, PREVIEW_BMP_HEADER + imageBytes);
+}
+
+// The alerts standing, then the events from sequence since (default all held)
+static esp_err_t alertsHandler(httpd_req_t* req) {
+    static AlertEvent events[ALERT_HISTORY];
+    static char entry[BASE_WEB_ENTRY_MAX];
+
+    beginJson(req);
+
+    size_t count = Alerts().getActive(events, ALERT_HISTORY);
+    esp_err_t res = writeJson("{\"active\":[", 11);
+    for (size_t i = 0; i < count && res == ESP_OK; i++) {
+        entry[0] = ',';
+        size_t length = alertToJson(events[i], entry + 1, sizeof(entry) - 1);
+        res = writeJson(i ? entry : entry + 1, i ? length + 1 : length);
+    }
+
+    count = Alerts().getEvents(queryValue(req, "since", 0), events, ALERT_HISTORY);
+    if (res == ESP_OK) {
+        int length = snprintf(entry, sizeof(entry), "],\"next\":%lu,\"events\":[",
+                              (unsigned long)Alerts().getNextSequence());
+        res = writeJson(entry, length);
+    }
+    for (size_t i = 0; i < count && res == ESP_OK; i++) {
+        entry[0] = ',';
+        size_t length = alertToJson(events[i], entry + 1, sizeof(entry) - 1);
+        res = writeJson(i ? entry : entry + 1, i ? length + 1 : length);
+    }
+    if (res == ESP_OK) {
+        res = writeJson("]}", 2);
+    }
+    if (res == ESP_OK) {
+        res = finishJson();
+    }
+    return res;
+}
+
+// ===========================
+// Map Tiles
+// ===========================
+
+// A tile as the map's layer asks for it; its bytes only change with the
+// archive, so the ETag is the archive's creation time and the tile's offset
+static esp_err_t tileHandler(httpd_req_t* req) {
+    uint32_t z = queryValue(req, "z", UINT32_MAX);
+    uint32_t x = queryValue(req, "x", UINT32_MAX);
+    uint32_t y = queryValue(req, "y", UINT32_MAX);
+    if (z > 30 || x >= (1u << z) || y >= (1u << z)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "z=&x=&y= of an XYZ tile");
+    }
+    TileIndexEntry entry;
+    if (!Tiles().findTile(z, x, y, entry)) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)Tiles().getHeader().created,
+             (unsigned long)entry.offset);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "public, max-age=86400");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    if (etagMatches(req, etag)) {
+        return sendNotModified(req);
+    }
+    httpd_resp_set_type(req, TileServer::formatContentType(Tiles().getHeader().format));
+    if (!Tiles().sendTile(entry, sendCapture, req)) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t tilesInfoHandler(httpd_req_t* req) {
+    const TileArchiveHeader& header = Tiles().getHeader();
+    static const char* const formats[] = {"png", "jpeg", "webp"};
+    char json[320];
+    int length;
+    if (Tiles().hasArchive()) {
+        length = snprintf(json, sizeof(json),
+                          "{\"archive\":true,\"format\":\"%s\",\"min_zoom\":%u,\"max_zoom\":%u,\"tiles\":%lu,"
+                          "\"created\":%lu,\"bounds\":[%.7f,%.7f,%.7f,%.7f],",
+                          header.format < 3 ? formats[header.format] : "unknown", header.minZoom, header.maxZoom,
+                          (unsigned long)header.tileCount, (unsigned long)header.created, header.west / 1e7,
+                          header.south / 1e7, header.east / 1e7, header.north / 1e7);
+    } else {
+        length = snprintf(json, sizeof(json), "{\"archive\":false,");
+    }
+    length += snprintf(json + length, sizeof(json) - length,
+                       "\"cache\":{\"slots\":%u,\"held\":%u,\"hits\":%lu,\"misses\":%lu}}", TILE_CACHE_SLOTS,
+                       Tiles().getSlotsHeld(), (unsigned long)Tiles().getHits(), (unsigned long)Tiles().getMisses());
+    return sendJson(req, json, min((size_t)length, sizeof(json) - 1));
+}
+
+// A tools/make_tiles.py archive as the body, replacing the one served
+static esp_err_t tilesUploadHandler(httpd_req_t* req) {
+    static uint8_t buffer[BASE_WEB_IMAGE_CHUNK];
+
+    if (!Tiles().beginUpload(req->content_len)) {
+        httpd_resp_set_status(req, "507 Insufficient Storage");
+        static const char full[] = "{\"error\":\"no room on flash for the archive beside the one served\"}";
+        return sendJson(req, full, sizeof(full) - 1);
+    }
+    for (size_t received = 0; received < req->content_len;) {
+        int n = httpd_req_recv(req, (char*)buffer, min(req->content_len - received, sizeof(buffer)));
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (n <= 0 || !Tiles().writeUpload(buffer, n)) {
+            Tiles().cancelUpload();
+            return ESP_FAIL;
+        }
+        received += n;
+    }
+    if (!Tiles().commitUpload()) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not a tile archive (tools/make_tiles.py)");
+    }
+    return tilesInfoHandler(req);
+}
+
+// ===========================
+// MsgPack API (v1)
+// ===========================
+
+// The same data as the JSON endpoints, with the same keys, built in one
+// preallocated document and serialized straight into httpd chunks. A
+// response that would outgrow the document stops short, and "next" says
+// where to pick up
+
+// ArduinoJson's document on the ledger; PSRAM at BASE_API_DOC_BYTES
+struct ApiAllocator {
+    void* allocate(size_t size) { return memAlloc(MemTag::WEB, size); }
+    void deallocate(void* pointer) { memFree(MemTag::WEB, pointer); }
+    void* reallocate(void*, size_t) { return nullptr; }    // shrinkToFit() isn't used
+};
+
+typedef BasicJsonDocument<ApiAllocator> ApiDocument;
+
+// Allocated by the first v1 request, then cleared for each; nullptr without the memory
+static ApiDocument* apiDocument() {
+    static ApiDocument document(BASE_API_DOC_BYTES);
+    if (document.capacity() == 0) {
+        return nullptr;
+    }
+    document.clear();
+    return &document;
+}
+
+// serializeMsgPack() output, BASE_API_CHUNK bytes to an httpd chunk
+class ApiChunkWriter {
+public:
+    explicit ApiChunkWriter(httpd_req_t* req) : req(req), used(0), res(ESP_OK) {}
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+
+    size_t write(const uint8_t* data, size_t length) {
+        for (size_t left = length; left && res == ESP_OK;) {
+            size_t take = min(left, sizeof(chunk) - used);
+            memcpy(chunk + used, data, take);
+            used += take;
+            data += take;
+            left -= take;
+            if (used == sizeof(chunk)) {
+                res = httpd_resp_send_chunk(req, (const char*)chunk, used);
+                used = 0;
+            }
+        }
+        return res == ESP_OK ? length : 0;
+    }
+
+    esp_err_t finish() {
+        if (res == ESP_OK && used) {
+            res = httpd_resp_send_chunk(req, (const char*)chunk, used);
+        }
+        return res == ESP_OK ? httpd_resp_send_chunk(req, NULL, 0) : res;
+    }
+
+private:
+    httpd_req_t* req;
+    static uint8_t chunk[BASE_API_CHUNK];   // Handlers run one at a time
+    size_t used;
+    esp_err_t res;
+};
+
+uint8_t ApiChunkWriter::chunk[BASE_API_CHUNK];
+
+static esp_err_t sendMsgPack(httpd_req_t* req, const ApiDocument& document) {
+    if (document.overflowed()) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response outgrew BASE_API_DOC_BYTES");
+    }
+    httpd_resp_set_type(req, "application/vnd.msgpack");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    ApiChunkWriter writer(req);
+    serializeMsgPack(document, writer);
+    return writer.finish();
+}
+
+static esp_err_t sendNoDocument(httpd_req_t* req) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+// Decoded telemetry and fixes from store index since, of one balloon or all
+static esp_err_t apiTelemetryHandler(httpd_req_t* req) {
+    static StoredPacket packet;
+
+    ApiDocument* document = apiDocument();
+    if (!document) {
+        return sendNoDocument(req);
+    }
+    char value[12];
+    int16_t deviceId = queryString(req, "device", value, sizeof(value)) ? (uint8_t)strtoul(value, nullptr, 10) : -1;
+    uint32_t since = max(queryValue(req, "since", 0), Packets().getOldest());
+    uint32_t limit = constrain(queryValue(req, "limit", BASE_WEB_DEFAULT_LIMIT), 1u, (uint32_t)BASE_API_MAX_RECORDS);
+    uint32_t end = Packets().getNext();
+
+    JsonArray records = document->createNestedArray("records");
+    uint32_t index = since;
+    for (; index < end && records.size() < limit; index++) {
+        if (document->capacity() - document->memoryUsage() < BASE_API_RECORD_BYTES) {
+            break;
+        }
+        if (!Packets().get(index, packet) || !packet.decoded ||
+            (packet.type != PacketType::TELEMETRY && packet.type != PacketType::GPS_DATA) ||
+            (deviceId >= 0 && packet.deviceId != deviceId)) {
+            continue;
+        }
+        JsonObject record = records.createNestedObject();
+        record["index"] = packet.index;
+        record["device"] = packet.deviceId;
+        record["type"] = packetTypeToString(packet.type);
+        record["seq"] = packet.sequenceNumber;
+        record["time"] = packet.timestamp;
+        record["received_ms"] = packet.receivedAt;
+        record["rssi"] = packet.rssi;
+        record["snr"] = packet.snr;
+        if (packet.type == PacketType::TELEMETRY) {
+            const TelemetryData& t = packet.data.telemetry;
+            JsonObject telemetry = record.createNestedObject("telemetry");
+            telemetry["temperature"] = t.temperature;
+            telemetry["pressure"] = t.pressure;
+            telemetry["humidity"] = t.humidity;
+            telemetry["battery_v"] = t.batteryVoltage;
+            telemetry["battery_a"] = t.batteryCurrent;
+            telemetry["battery_pct"] = t.batteryPercentage;
+            telemetry["uptime"] = t.uptime;
+            telemetry["free_heap"] = t.freeHeap;
+            telemetry["cpu_temperature"] = t.cpuTemperature;
+            telemetry["power_state"] = t.powerState;
+        } else {
+            const GPSData& g = packet.data.gps;
+            JsonObject gps = record.createNestedObject("gps");
+            gps["lat"] = g.latitude;
+            gps["lon"] = g.longitude;
+            gps["alt"] = g.altitude;
+            gps["sats"] = g.satellites;
+            gps["speed"] = g.speed;
+            gps["course"] = g.course;
+            gps["fix_time"] = g.fixTime;
+            gps["hdop"] = g.hdop;
+            gps["quality"] = g.quality;
+        }
+    }
+    (*document)["next"] = index;
+    return sendMsgPack(req, *document);
+}
+
+// The link and pipeline counters, each balloon's signal and the end-to-end latency per type
+static esp_err_t apiLinkHandler(httpd_req_t* req) {
+    static LinkLatencyStats stats;
+
+    ApiDocument* document = apiDocument();
+    if (!document) {
+        return sendNoDocument(req);
+    }
+    (*document)["uptime_ms"] = millis();
+    (*document)["rssi"] = LoRaComm().getLastRSSI();
+    (*document)["snr"] = LoRaComm().getLastSNR();
+    (*document)["records_delivered"] = RxPipeline().getRecordsDelivered();
+    (*document)["duplicates"] = RxPipeline().getDuplicateCount();
+    (*document)["decode_failures"] = Packets().getDecodeFailures();
+    (*document)["transfers_reassembled"] = FragmentMgr().getTransfersReassembled();
+
+    uint32_t now = millis();
+    JsonArray sessions = document->createNestedArray("sessions");
+    for (uint8_t s = 0; s < Sessions().getCount(); s++) {
+        const BalloonSession& session = Sessions().getSession(s);
+        JsonObject entry = sessions.createNestedObject();
+        entry["device"] = session.deviceId;
+        entry["packets"] = session.packets;
+        entry["late"] = session.latePackets;
+        entry["last_seen_ms"] = now - session.lastSeen;
+        entry["seq"] = session.lastSequence;
+        entry["rssi"] = session.lastRssi;
+        entry["snr"] = session.lastSnr;
+    }
+
+    JsonArray latency = document->createNestedArray("latency");
+    for (uint8_t i = 0; Latency().getStats(i, stats); i++) {
+        const LinkHistogram& h = stats.stages[static_cast<uint8_t>(LinkStage::TOTAL)];
+        JsonObject entry = latency.createNestedObject();
+        entry["type"] = packetTypeToString(stats.type);
+        entry["count"] = h.samples;
+        entry["p50"] = LatencyMonitor::percentile(h, 50);
+        entry["p90"] = LatencyMonitor::percentile(h, 90);
+        entry["p99"] = LatencyMonitor::percentile(h, 99);
+        entry["max"] = h.maxMs;
+    }
+    return sendMsgPack(req, *document);
+}
+
+// A gallery page; what the balloon embedded as integers, as it sent them
+static esp_err_t apiImagesHandler(httpd_req_t* req) {
+    static ImageInfo page[GALLERY_IMAGES_PER_PAGE];
+
+    uint32_t number = queryValue(req, "page", 0);
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"v1-gallery-%lu-%lu\"", (unsigned long)Images().getRevision(),
+             (unsigned long)number);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    if (etagMatches(req, etag)) {
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        return sendNotModified(req);
+    }
+    ApiDocument* document = apiDocument();
+    if (!document) {
+        return sendNoDocument(req);
+    }
+
+    size_t total = 0;
+    size_t count = Images().getPage((size_t)number * GALLERY_IMAGES_PER_PAGE, page, GALLERY_IMAGES_PER_PAGE, total);
+    (*document)["page"] = number;
+    (*document)["pages"] = (total + GALLERY_IMAGES_PER_PAGE - 1) / GALLERY_IMAGES_PER_PAGE;
+    (*document)["total"] = total;
+    JsonArray images = document->createNestedArray("images");
+    for (size_t i = 0; i < count; i++) {
+        const ImageInfo& image = page[i];
+        JsonObject entry = images.createNestedObject();
+        entry["id"] = image.id;
+        entry["device"] = image.deviceId;
+        entry["camera_id"] = image.cameraId;
+        entry["time"] = image.time;
+        entry["bytes"] = image.length;
+        entry["width"] = image.width;
+        entry["height"] = image.height;
+        entry["thumb"] = image.thumbLength != 0;
+        entry["ready"] = image.processed;
+        if (!image.meta.valid) {
+            continue;
+        }
+        const ImageMetadata& m = image.meta;
+        JsonObject meta = entry.createNestedObject("meta");
+        meta["capture_ms"] = m.timestamp;
+        meta["exposure"] = m.exposureLines;
+        meta["gain"] = m.gain;
+        meta["luma"] = m.meanLuma;
+        meta["novelty"] = m.novelty;
+        meta["sharpness"] = m.sharpness;
+        meta["scene"] = m.sceneLabel;
+        meta["scene_confidence"] = m.sceneConfidence;
+        meta["burst"] = m.burstFrames;
+        if (m.hasPosition) {
+            meta["lat_e7"] = m.latitudeE7;
+            meta["lon_e7"] = m.longitudeE7;
+        }
+        if (m.hasAltitude) {
+            meta["alt_cm"] = m.altitudeCm;
+        }
+    }
+    return sendMsgPack(req, *document);
+}
+
+// ===========================
+// WebSocket
+// ===========================
+
+// The handshake puts the client on the fan-out; what clients send is read
+// and dropped
+static esp_err_t wsHandler(httpd_req_t* req) {
+    if (req->method == HTTP_GET) {
+        Fanout().addClient(httpd_req_to_sockfd(req));
+        return ESP_OK;
+    }
+    uint8_t discard[BASE_WEB_WS_RECEIVE_MAX];
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    esp_err_t res = httpd_ws_recv_frame(req, &frame, 0);
+    if (res != ESP_OK || frame.len > sizeof(discard)) {
+        return res;
+    }
+    frame.payload = discard;
+    return httpd_ws_recv_frame(req, &frame, frame.len);
+}
+
+// Each WebSocket client's queue and lag
+static esp_err_t clientsHandler(httpd_req_t* req) {
+    static char json[BASE_WEB_ENTRY_MAX * 2];
+    FanoutClientStatus clients[FANOUT_MAX_CLIENTS];
+    size_t count = Fanout().getClients(clients, FANOUT_MAX_CLIENTS);
+
+    int length = snprintf(json, sizeof(json), "{\"closed_behind\":%lu,\"clients\":[",
+                          (unsigned long)Fanout().getClosedBehind());
+    for (size_t i = 0; i < count; i++) {
+        const FanoutClientStatus& c = clients[i];
+        length += snprintf(json + length, sizeof(json) - length,
+                           "%s{\"fd\":%d,\"connected_ms\":%lu,\"lag_ms\":%lu,\"max_lag_ms\":%lu,"
+                           "\"interval_ms\":%lu,\"events_queued\":%u,\"snapshots_pending\":%u,"
+                           "\"frames\":%lu,\"bytes\":%lu,\"coalesced\":%lu,\"deferred\":%lu}",
+                           i ? "," : "", c.fd, (unsigned long)c.connectedMs, (unsigned long)c.lagMs,
+                           (unsigned long)c.maxLagMs, (unsigned long)c.intervalMs, c.eventsQueued,
+                           c.snapshotsPending, (unsigned long)c.framesSent, (unsigned long)c.bytesSent,
+                           (unsigned long)c.coalesced, (unsigned long)c.deferred);
+    }
+    length += snprintf(json + length, sizeof(json) - length, "]}");
+    return sendJson(req, json, min((size_t)length, sizeof(json) - 1));
+}
+
+// A patch as the body, sent up to the balloon; or, with no body, the
+// command that boots or drops what the balloon applied
+static esp_err_t firmwareHandler(httpd_req_t* req) {
+    char value[12];
+    if (queryString(req, "activate", value, sizeof(value))) {
+        char* end = nullptr;
+        uint32_t prefix = strtoul(value, &end, 16);
+        if (strlen(value) != FIRMWARE_ACTIVATE_PARAMS * 2 || *end) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "activate=<first 8 hex digits of the new image's SHA-256>");
+        }
+        uint8_t params[FIRMWARE_ACTIVATE_PARAMS] = {(uint8_t)(prefix >> 24), (uint8_t)(prefix >> 16),
+                                                    (uint8_t)(prefix >> 8), (uint8_t)prefix};
+        FirmwareUplink().requestCommand(CommandId::FIRMWARE_ACTIVATE, params, sizeof(params));
+        static const char queued[] = "{\"queued\":\"firmware_activate\"}";
+        return sendJson(req, queued, sizeof(queued) - 1);
+    }
+    if (queryString(req, "abort", value, sizeof(value))) {
+        FirmwareUplink().requestCommand(CommandId::FIRMWARE_ABORT, nullptr, 0);
+        static const char queued[] = "{\"queued\":\"firmware_abort\"}";
+        return sendJson(req, queued, sizeof(queued) - 1);
+    }
+
+    uint8_t* buffer = FirmwareUplink().reserve(req->content_len);
+    if (!buffer) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        static const char busy[] = "{\"error\":\"a patch is being sent, or this one is too large\"}";
+        return sendJson(req, busy, sizeof(busy) - 1);
+    }
+    for (size_t received = 0; received < req->content_len;) {
+        int n = httpd_req_recv(req, (char*)buffer + received, req->content_len - received);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (n <= 0) {
+            FirmwareUplink().cancel();
+            return ESP_FAIL;
+        }
+        received += n;
+    }
+    if (!FirmwareUplink().commit()) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not a firmware patch (tools/make_delta.py)");
+    }
+
+    FirmwareUploadStatus upload = FirmwareUplink().getStatus();
+    char json[128];
+    int length = snprintf(json, sizeof(json), "{\"update\":%u,\"chunks\":%u,\"bytes\":%lu}", upload.updateId,
+                          upload.chunkCount, (unsigned long)upload.length);
+    return sendJson(req, json, min((size_t)length, sizeof(json) - 1));
+}
+
+// Per packet type, each stage's histogram and percentiles in ms
+static esp_err_t latencyHandler(httpd_req_t* req) {
+    static char json[BASE_WEB_ENTRY_MAX * 4];
+    static LinkLatencyStats stats;
+    beginJson(req);
+
+    int length = snprintf(json, sizeof(json), "{\"unstamped\":%lu,\"types\":[",
+                          (unsigned long)Latency().getUnstamped());
+    esp_err_t res = writeJson(json, length);
+    for (uint8_t i = 0; res == ESP_OK && Latency().getStats(i, stats); i++) {
+        length = snprintf(json, sizeof(json), "%s{\"type\":\"%s\",\"stamped\":%lu,\"retransmitted\":%lu",
+                          i ? "," : "", packetTypeToString(stats.type), (unsigned long)stats.stamped,
+                          (unsigned long)stats.retransmitted);
+        for (uint8_t s = 0; s < LINK_STAGE_COUNT; s++) {
+            const LinkHistogram& h = stats.stages[s];
+            length += snprintf(json + length, sizeof(json) - length,
+                               ",\"%s\":{\"count\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu,\"buckets\":[",
+                               LatencyMonitor::stageToString(static_cast<LinkStage>(s)), (unsigned long)h.samples,
+                               (unsigned long)LatencyMonitor::percentile(h, 50),
+                               (unsigned long)LatencyMonitor::percentile(h, 90),
+                               (unsigned long)LatencyMonitor::percentile(h, 99), (unsigned long)h.maxMs);
+            for (int b = 0; b < LATENCY_BUCKETS; b++) {
+                length += snprintf(json + length, sizeof(json) - length, "%s%u", b ? "," : "", h.buckets[b]);
+            }
+            length += snprintf(json + length, sizeof(json) - length, "]}");
+        }
+        length += snprintf(json + length, sizeof(json) - length, "}");
+        res = writeJson(json, min((size_t)length, sizeof(json) - 1));
+    }
+    if (res == ESP_OK) {
+        res = writeJson("]}", 2);
+    }
+    if (res == ESP_OK) {
+        res = finishJson();
+    }
+    return res;
+}
+
+// What the build budgets, what the ledger and arenas hold, and what is left
+static esp_err_t memoryHandler(httpd_req_t* req) {
+    static char json[BASE_WEB_ENTRY_MAX];
+    beginJson(req);
+
+    size_t budgetCount = 0;
+    const MemBudgetEntry* budget = memBudgetTable(budgetCount);
+    esp_err_t res = writeJson("{\"budget\":[", 11);
+    for (size_t i = 0; res == ESP_OK && i < budgetCount; i++) {
+        int length = snprintf(json, sizeof(json), "%s{\"name\":\"%s\",\"region\":\"%s\",\"bytes\":%lu,\"limit\":%lu}",
+                              i ? "," : "", budget[i].name, MemoryLedger::regionToString(budget[i].region),
+                              (unsigned long)budget[i].bytes, (unsigned long)budget[i].limit);
+        res = writeJson(json, min((size_t)length, sizeof(json) - 1));
+    }
+
+    if (res == ESP_OK) {
+        res = writeJson("],\"subsystems\":[", 16);
+    }
+    for (uint8_t i = 0; res == ESP_OK && i < MEM_TAG_COUNT; i++) {
+        MemTagStatus status = MemLedger().getStatus(static_cast<MemTag>(i));
+        int length = snprintf(json, sizeof(json),
+                              "%s{\"name\":\"%s\",\"internal\":%lu,\"psram\":%lu,\"peak\":%lu,"
+                              "\"allocations\":%lu,\"frees\":%lu,\"failures\":%lu}",
+                              i ? "," : "", MemoryLedger::tagToString(static_cast<MemTag>(i)),
+                              (unsigned long)status.current[0], (unsigned long)status.current[1],
+                              (unsigned long)status.peak, (unsigned long)status.allocations,
+                              (unsigned long)status.frees, (unsigned long)status.failures);
+        res = writeJson(json, min((size_t)length, sizeof(json) - 1));
+    }
+
+    MemArenaStatus arenas[MEM_ARENA_MAX];
+    size_t arenaCount = min(getMemoryArenas(arenas, MEM_ARENA_MAX), (size_t)MEM_ARENA_MAX);
+    if (res == ESP_OK) {
+        res = writeJson("],\"arenas\":[", 12);
+    }
+    for (size_t i = 0; res == ESP_OK && i < arenaCount; i++) {
+        const MemArenaStatus& a = arenas[i];
+        int length = snprintf(json, sizeof(json),
+                              "%s{\"name\":\"%s\",\"subsystem\":\"%s\",\"region\":\"%s\",\"bytes\":%lu,"
+                              "\"used\":%lu,\"peak\":%lu,\"misses\":%lu}",
+                              i ? "," : "", a.name, MemoryLedger::tagToString(a.tag),
+                              a.base ? MemoryLedger::regionToString(a.region) : "none", (unsigned long)a.capacity,
+                              (unsigned long)a.used, (unsigned long)a.peak, (unsigned long)a.misses);
+        res = writeJson(json, min((size_t)length, sizeof(json) - 1));
+    }
+
+    if (res == ESP_OK) {
+        res = writeJson("],\"regions\":[", 13);
+    }
+    for (uint8_t r = 0; res == ESP_OK && r < MEM_REGION_COUNT; r++) {
+        MemRegionStatus region = MemoryLedger::getRegion(static_cast<MemRegion>(r));
+        int length = snprintf(json, sizeof(json),
+                              "%s{\"name\":\"%s\",\"free\":%lu,\"largest_block\":%lu,\"minimum_free\":%lu}",
+                              r ? "," : "", MemoryLedger::regionToString(static_cast<MemRegion>(r)),
+                              (unsigned long)region.freeBytes, (unsigned long)region.largestBlock,
+                              (unsigned long)region.minimumFree);
+        res = writeJson(json, min((size_t)length, sizeof(json) - 1));
+    }
+    if (res == ESP_OK) {
+        res = writeJson("]}", 2);
+    }
+    if (res == ESP_OK) {
+        res = finishJson();
+    }
+    return res;
+}
+
+void broadcastAlert(const AlertEvent& event) {
+    char json[BASE_WEB_ENTRY_MAX];
+    int length = snprintf(json, sizeof(json), "{\"alert\":");
+    length += alertToJson(event, json + length, sizeof(json) - length - 1);
+    json[length++] = '}';
+    Fanout().publishEvent(json, length);
+}
+
+// Telemetry and fixes go out as snapshots - a client behind gets the newest
+// of each balloon's - and everything else the alert engine doesn't already
+// report as an event
+void updateBaseStationServer() {
+    static StoredPacket packet;             // Off the loop task's stack
+    static char json[BASE_WEB_ENTRY_MAX + 16];
+    static uint32_t nextIndex = 0;
+
+    if (Fanout().getClientCount() == 0) {
+        nextIndex = Packets().getNext();    // Nobody to tell
+        return;
+    }
+    nextIndex = max(nextIndex, Packets().getOldest());
+    for (uint32_t next = Packets().getNext(); nextIndex < next; nextIndex++) {
+        if (!Packets().get(nextIndex, packet) || (ENABLE_ALERTS && packet.type == PacketType::ALERT)) {
+            continue;
+        }
+        int length = snprintf(json, sizeof(json), "{\"packet\":");
+        length += packetToJson(packet, json + length, sizeof(json) - length - 1);
+        json[length++] = '}';
+        if (packet.type == PacketType::TELEMETRY || packet.type == PacketType::GPS_DATA) {
+            Fanout().publishSnapshot(packet.deviceId << 8 | static_cast<uint8_t>(packet.type), json, length);
+        } else {
+            Fanout().publishEvent(json, length);
+        }
+    }
+    Fanout().update();
+}
+
+// ===========================
+// Server
+// ===========================
+
+bool startBaseStationServer() {
+    if (serverHandle) {
+        return true;
+    }
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = WEB_SERVER_PORT;
+    config.max_open_sockets = MAX_WEB_CLIENTS;
+    config.max_uri_handlers = BASE_WEB_MAX_URIS;
+    config.recv_wait_timeout = WEB_TIMEOUT_MS / 1000;
+    config.send_wait_timeout = WEB_TIMEOUT_MS / 1000;
+
+    // Below the radio and RX tasks - the default is priority 5, either core
+    const TaskPlacement& placement = taskPlacement(TaskId::HTTPD);
+    config.core_id = placement.core;
+    config.task_priority = placement.priority;
+    config.stack_size = placement.stack;
+
+    if (httpd_start(&serverHandle, &config) != ESP_OK) {
+        serverHandle = nullptr;
+        return false;
+    }
+    Fanout().begin(serverHandle);
+
+    static const httpd_uri_t uris[] = {
+        {"/api/status", HTTP_GET, statusHandler, nullptr},
+        {"/api/packets", HTTP_GET, packetsHandler, nullptr},
+        {"/api/telemetry/latest", HTTP_GET, telemetryLatestHandler, nullptr},
+        {"/api/gps/latest", HTTP_GET, gpsLatestHandler, nullptr},
+        {"/api/graph", HTTP_GET, graphHandler, nullptr},
+        {"/api/sessions", HTTP_GET, sessionsHandler, nullptr},
+        {"/api/flights", HTTP_GET, flightsHandler, nullptr},
+        {"/api/flight", HTTP_GET, flightHandler, nullptr},
+        {"/api/clients", HTTP_GET, clientsHandler, nullptr},
+        {"/api/latency", HTTP_GET, latencyHandler, nullptr},
+        {"/api/memory", HTTP_GET, memoryHandler, nullptr},
+        {"/api/firmware", HTTP_POST, firmwareHandler, nullptr},
+        {"/api/v1/telemetry", HTTP_GET, apiTelemetryHandler, nullptr},
+        {"/api/v1/link", HTTP_GET, apiLinkHandler, nullptr},
+        {"/ws", HTTP_GET, wsHandler, nullptr, true},
+    };
+    for (const httpd_uri_t& uri : uris) {
+        httpd_register_uri_handler(serverHandle, &uri);
+    }
+    if (ENABLE_IMAGE_PROCESSING) {
+        static const httpd_uri_t imageUris[] = {
+            {"/api/gallery", HTTP_GET, galleryHandler, nullptr},
+            {"/api/v1/images", HTTP_GET, apiImagesHandler, nullptr},
+            {"/api/image", HTTP_GET, imageHandler, nullptr},
+            {"/api/thumb", HTTP_GET, thumbHandler, nullptr},
+            {"/api/preview", HTTP_GET, previewHandler, nullptr},
+        };
+        for (const httpd_uri_t& uri : imageUris) {
+            httpd_register_uri_handler(serverHandle, &uri);
+        }
+    }
+    if (ENABLE_MAP_DISPLAY) {
+        static const httpd_uri_t mapUris[] = {
+            {"/api/prediction", HTTP_GET, predictionHandler, nullptr},
+            {"/api/track", HTTP_GET, trackHandler, nullptr},
+        };
+        for (const httpd_uri_t& uri : mapUris) {
+            httpd_register_uri_handler(serverHandle, &uri);
+        }
+    }
+    if (ENABLE_MAP_DISPLAY && ENABLE_TILE_SERVER) {
+        static const httpd_uri_t tileUris[] = {
+            {"/api/tile", HTTP_GET, tileHandler, nullptr},
+            {"/api/tiles", HTTP_GET, tilesInfoHandler, nullptr},
+            {"/api/tiles", HTTP_POST, tilesUploadHandler, nullptr},
+        };
+        for (const httpd_uri_t& uri : tileUris) {
+            httpd_register_uri_handler(serverHandle, &uri);
+        }
+    }
+    if (ENABLE_ALERTS) {
+        static const httpd_uri_t alertsUri = {"/api/alerts", HTTP_GET, alertsHandler, nullptr};
+        httpd_register_uri_handler(serverHandle, &alertsUri);
+    }
+    if (ENABLE_DATA_EXPORT) {
+        static const httpd_uri_t exportUri = {"/api/export", HTTP_GET, exportHandler, nullptr};
+        httpd_register_uri_handler(serverHandle, &exportUri);
+    }
+    if (ENABLE_RANGE_API) {
+        static const httpd_uri_t rangeUri = {"/api/telemetry", HTTP_GET, rangeHandler, nullptr};
+        httpd_register_uri_handler(serverHandle, &rangeUri);
+    }
+    if (ENABLE_LINK_CAPTURE) {
+        static const httpd_uri_t linkCaptureUri = {"/api/linkcap", HTTP_GET, linkCaptureHandler, nullptr};
+        httpd_register_uri_handler(serverHandle, &linkCaptureUri);
+    }
+    return true;
+}
+
+void stopBaseStationServer() {
+    if (serverHandle) {
+        Fanout().end();
+        httpd_stop(serverHandle);
+        serverHandle = nullptr;
+    }
+}
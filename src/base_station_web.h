@@ -0,0 +1,150 @@
+#ifndef BASE_STATION_WEB_H
+#define BASE_STATION_WEB_H
+
+#include <Arduino.h>
+
+// ===========================
+// Base Station Web Server
+// JSON API over the packet store for the laptops on the base station's AP
+// ===========================
+
+// Endpoints (port WEB_SERVER_PORT):
+//   GET /api/status                 link, pipeline and store counters
+//   GET /api/sessions               each balloon heard: packets, last seen,
+//                                   signal, images, open flight and the state
+//                                   kept for it
+//   GET /api/flights?page=          BASE_WEB_FLIGHTS_PER_PAGE flights, newest
+//                                   first, out of the flight catalog
+//   GET /api/flight?id=             one flight: balloon, store-clock range,
+//   GET /api/flight?time=&device=   packets, peak altitude and image ids; or
+//                                   the balloon's (any, without device) flight
+//                                   covering time (default now), else the last
+//                                   to start before it
+//   GET /api/packets?since=&limit=  stored packets from index since (default
+//                                   the oldest held), up to limit (default 50)
+//                                   PROFILE_LEVEL ones decoded as "profile",
+//                                   TRACK_SEGMENT ones summarised as "track",
+//                                   DIGEST ones decoded as "digest"
+//   GET /api/telemetry/latest       newest decoded telemetry, 404 if none yet
+//   GET /api/gps/latest             newest GPS fix, 404 if none yet
+//   GET /api/graph?field=&device=&from=&to=&points=
+//                                   [time, min, max, mean, count] of one column,
+//                                   at most points (default and cap
+//                                   MAX_GRAPH_DATAPOINTS) over from..to (default
+//                                   the last GRAPH_HISTORY_MINUTES)
+//                                   flight=<id> here and in /api/export stands
+//                                   for that flight's device, from and to
+//   GET /api/export?format=&device=&from=&to=&fields=
+//                                   csv (default), json or kml from the column
+//                                   store; fields is a comma list of column
+//                                   names (default all), from/to store-clock
+//                                   seconds. Gzipped if the client accepts it
+//                                   and gzip=0 isn't given
+//   GET /api/telemetry?device=&from=&to=&fields=&resolution=&limit=
+//   GET /api/telemetry?cursor=      a page of up to limit (default
+//                                   RANGE_API_DEFAULT_ROWS) rows over from..to
+//                                   (default everything to now), oldest first:
+//                                   [time, value...] per sample, or with
+//                                   resolution=<s> [time, [min, max, mean,
+//                                   count]...] per bucket, null where a field
+//                                   has none; fields in column order. next is
+//                                   the cursor to the following page, null on
+//                                   the last (base_station_range.h)
+//   GET /api/linkcap                every frame both radios sent and received,
+//                                   and each packet's ACK, timeout or drop: a
+//                                   pcap of link type 147 for Wireshark with
+//                                   tools/link_capture.lua
+//   GET /api/gallery?page=          GALLERY_IMAGES_PER_PAGE images, newest
+//                                   first, from the newest MAX_GALLERY_HISTORY
+//   GET /api/image?id=              the JPEG, 404 if it is no longer held
+//   GET /api/thumb?id=              its GALLERY_THUMBNAIL_SIZE thumbnail
+//                                   The three carry ETags and answer a
+//                                   matching If-None-Match with 304
+//   GET /api/prediction?device=     predicted landing point, seconds to it and
+//                                   its uncertainty ellipse, 404 before a fix
+//   GET /api/track?device=&since=   the balloon's simplified path out of its
+//                                   TRACK_SEGMENT packets (base_station_track.h):
+//                                   [index, time, lat, lon, alt] per vertex
+//                                   from index since on, the latest fix, and
+//                                   next - the since to poll with for only
+//                                   what arrived after; 404 before a segment
+//   GET /api/tile?z=&x=&y=          an XYZ map tile out of the archive on
+//                                   LittleFS (base_station_tiles.h), 404 if it
+//                                   hasn't the tile; ETag and 304, and a day's
+//                                   max-age
+//   GET /api/tiles                  the archive's format, zoom range, tile count
+//                                   and bounds, and the tile cache's counters
+//   POST /api/tiles                 body: an archive from tools/make_tiles.py,
+//                                   replacing the one served once it loads;
+//                                   400 if it doesn't, 507 without the room
+//   GET /api/alerts?since=          the alerts standing, and the events from
+//                                   sequence since out of the last ALERT_HISTORY
+//   GET /api/clients                each WebSocket client's queue, snapshot
+//                                   interval and lag
+//   GET /api/latency                per packet type, sample/queue/retry/
+//                                   airtime/decode/total histograms in log2
+//                                   ms buckets with p50/p90/p99 and max
+//   GET /api/memory                 the build's memory budget table, each
+//                                   subsystem's ledger, the arenas and the
+//                                   regions' free, largest block and low mark
+//   POST /api/firmware              body: a patch from tools/make_delta.py,
+//                                   sent up in FIRMWARE_DELTA transfers; 503
+//                                   while one is. ?activate=<8 hex digits of
+//                                   the new image's SHA-256> or ?abort=1, no
+//                                   body: FIRMWARE_ACTIVATE or FIRMWARE_ABORT.
+//                                   Progress is /api/status's "firmware"
+//   GET /api/v1/telemetry?since=&limit=&device=
+//                                   MsgPack: decoded telemetry and fixes from
+//                                   store index since, of one balloon or all,
+//                                   up to limit (cap BASE_API_MAX_RECORDS);
+//                                   "next" is the since to ask for after
+//   GET /api/v1/link                MsgPack: link and pipeline counters, each
+//                                   balloon's packets and signal, and total
+//                                   latency percentiles per packet type
+//   GET /api/v1/images?page=        MsgPack: /api/gallery's page, position
+//                                   and altitude as lat_e7/lon_e7/alt_cm;
+//                                   ETag and 304 as it
+//                                   The v1 endpoints keep the JSON ones' keys
+//                                   and answer 503 without their document
+//   GET /ws                         WebSocket: {"alert":{...}} as in /api/alerts
+//                                   and {"packet":{...}} as in /api/packets, as
+//                                   they arrive. Through the fan-out: a client
+//                                   behind gets fewer, newer telemetry and fix
+//                                   packets, and every alert and other packet
+//
+// JSON bodies past BASE_WEB_GZIP_MIN_BYTES are gzipped when the client takes
+// it, a GZIP_WINDOW_BYTES window at a time (gzip_stream.h), unless gzip=0 is
+// given; /api/gallery and /api/flights keep their last gzipped page and send
+// it again until the catalog's revision moves.
+//
+// The server runs at the TaskId::HTTPD placement, below the radio and RX
+// tasks on core 0; each handler copies one packet out of the store at a
+// time, so a slow client holds up nothing but its own response.
+
+#define BASE_WEB_DEFAULT_LIMIT   50
+#define BASE_WEB_ENTRY_MAX       768     // One packet's JSON object - a DIGEST is the longest
+#define BASE_WEB_QUERY_MAX       256     // URL query string, export field lists included
+#define BASE_WEB_IMAGE_CHUNK     4096    // Image bytes per httpd chunk
+#define BASE_WEB_MAX_URIS        32      // httpd's default of 8 is too few
+#define BASE_WEB_FLIGHTS_PER_PAGE 16
+#define BASE_WEB_TRACK_PAGE      8       // Vertices per store lock and chunk, within BASE_WEB_ENTRY_MAX
+#define BASE_WEB_WS_RECEIVE_MAX  128     // Larger client frames are left unread
+#define BASE_WEB_GZIP_MIN_BYTES  1024    // Smaller JSON goes out as it is, in one send
+#define BASE_WEB_GZIP_CACHE_BYTES 2048   // Per cached page, gzipped
+#define BASE_API_DOC_BYTES       (24 * 1024)     // The v1 responses' document, PSRAM
+#define BASE_API_MAX_RECORDS     64
+#define BASE_API_RECORD_BYTES    (JSON_OBJECT_SIZE(10) + JSON_OBJECT_SIZE(12))  // Room one more record needs
+#define BASE_API_CHUNK           1024    // MsgPack bytes per httpd chunk
+
+struct AlertEvent;
+
+bool startBaseStationServer();
+void stopBaseStationServer();
+
+// From loop(): new packets out to the WebSocket clients
+void updateBaseStationServer();
+
+// The alert engine's event hook: queues the event to every WebSocket client
+void broadcastAlert(const AlertEvent& event);
+
+#endif // BASE_STATION_WEB_H
@@ -0,0 +1,234 @@
+#include "battery_adc.h"
+#include <algorithm>
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_idf_version.h"
+#include "esp32-hal-periman.h"
+#include "sensor_pins.h"
+#include "task_placement.h"
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#define BATTERY_ADC_ATTEN          ADC_ATTEN_DB_12
+#else
+#define BATTERY_ADC_ATTEN          ADC_ATTEN_DB_11     // Same setting, older name
+#endif
+
+#define BATTERY_ADC_MIN_SAMPLES    (BATTERY_ADC_FRAME_SAMPLES / 2)     // A shorter read waits for the rest
+
+BatteryAdc::BatteryAdc() {
+    handle = nullptr;
+    cali = nullptr;
+    task = nullptr;
+    mutex = nullptr;
+    channel = 0;
+    historyCount = 0;
+    historyNext = 0;
+    historySum = 0;
+    frames = 0;
+    overflows = 0;
+    errors = 0;
+}
+
+BatteryAdc::~BatteryAdc() {
+    end();
+}
+
+bool BatteryAdc::begin(uint8_t pin) {
+    if (task) {
+        return true;
+    }
+
+    adc_unit_t unit;
+    adc_channel_t adcChannel;
+    if (adc_continuous_io_to_channel(pin, &unit, &adcChannel) != ESP_OK || unit != ADC_UNIT_1) {
+        return false;   // ADC2 is shared with WiFi and has no continuous mode here
+    }
+    channel = adcChannel;
+
+    // analogRead() leaves a one-shot unit holding the pin; the two modes can't share it
+    perimanClearPinBus(pin);
+
+    adc_continuous_handle_cfg_t handleConfig = {};
+    handleConfig.max_store_buf_size = BATTERY_ADC_POOL_FRAMES * sizeof(frame);
+    handleConfig.conv_frame_size = sizeof(frame);
+    if (adc_continuous_new_handle(&handleConfig, &handle) != ESP_OK) {
+        handle = nullptr;
+        return false;
+    }
+
+    adc_digi_pattern_config_t pattern = {};
+    pattern.atten = BATTERY_ADC_ATTEN;
+    pattern.channel = channel;
+    pattern.unit = ADC_UNIT_1;
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+    adc_continuous_config_t config = {};
+    config.pattern_num = 1;
+    config.adc_pattern = &pattern;
+    config.sample_freq_hz = BATTERY_ADC_SAMPLE_HZ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+
+    adc_continuous_evt_cbs_t callbacks = {};
+    callbacks.on_pool_ovf = onPoolOverflow;
+
+    if (adc_continuous_config(handle, &config) != ESP_OK ||
+        adc_continuous_register_event_callbacks(handle, &callbacks, this) != ESP_OK) {
+        releaseDriver();
+        return false;
+    }
+
+    // eFuse two-point values through the curve-fitting scheme; linear without them
+    adc_cali_curve_fitting_config_t caliConfig = {};
+    caliConfig.unit_id = ADC_UNIT_1;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+    caliConfig.chan = adcChannel;
+#endif
+    caliConfig.atten = BATTERY_ADC_ATTEN;
+    caliConfig.bitwidth = ADC_BITWIDTH_12;
+    if (adc_cali_create_scheme_curve_fitting(&caliConfig, &cali) != ESP_OK) {
+        cali = nullptr;
+    }
+
+    historyCount = 0;
+    historyNext = 0;
+    historySum = 0;
+    frames = 0;
+    reading.publish(BatteryAdcReading{0.0f, 0, 0, 0, 0});
+
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex || adc_continuous_start(handle) != ESP_OK) {
+        releaseDriver();
+        return false;
+    }
+    if (createPlacedTask(TaskId::BATTERY_ADC, taskEntry, this, &task) != pdPASS) {
+        task = nullptr;
+        adc_continuous_stop(handle);
+        releaseDriver();
+        return false;
+    }
+    return true;
+}
+
+void BatteryAdc::end() {
+    if (task) {
+        // Between frames, never inside adc_continuous_read()
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        vTaskDelete(task);
+        task = nullptr;
+        xSemaphoreGive(mutex);
+        adc_continuous_stop(handle);
+    }
+    releaseDriver();
+}
+
+void BatteryAdc::releaseDriver() {
+    if (handle) {
+        adc_continuous_deinit(handle);
+        handle = nullptr;
+    }
+    if (cali) {
+        adc_cali_delete_scheme_curve_fitting(cali);
+        cali = nullptr;
+    }
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+}
+
+bool IRAM_ATTR BatteryAdc::onPoolOverflow(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* data,
+                                          void* context) {
+    BatteryAdc* adc = static_cast<BatteryAdc*>(context);
+    adc->overflows = adc->overflows + 1;
+    return false;   // Nothing woken
+}
+
+// ===========================
+// Task
+// ===========================
+
+void BatteryAdc::taskEntry(void* param) {
+    static_cast<BatteryAdc*>(param)->taskLoop();
+}
+
+void BatteryAdc::taskLoop() {
+    while (true) {
+        // The read blocks on the driver's pool, so the task sleeps between frames
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        service();
+        xSemaphoreGive(mutex);
+        taskYIELD();
+    }
+}
+
+bool BatteryAdc::service() {
+    uint32_t length = 0;
+    esp_err_t result = adc_continuous_read(handle, frame, sizeof(frame), &length, BATTERY_ADC_READ_TIMEOUT_MS);
+    if (result != ESP_OK) {
+        if (result != ESP_ERR_TIMEOUT) {
+            errors = errors + 1;
+        }
+        return false;
+    }
+
+    size_t count = 0;
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t* sample = reinterpret_cast<const adc_digi_output_data_t*>(&frame[i]);
+        if (sample->type2.channel == channel) {
+            samples[count++] = sample->type2.data;
+        }
+    }
+    if (count < BATTERY_ADC_MIN_SAMPLES) {
+        errors = errors + 1;
+        return false;
+    }
+
+    uint16_t* middle = samples + count / 2;
+    std::nth_element(samples, middle, samples + count);
+    uint16_t frameMv = toMillivolts(*middle);
+
+    // Running mean of the frame medians
+    if (historyCount == BATTERY_ADC_AVERAGE_FRAMES) {
+        historySum -= history[historyNext];
+    } else {
+        historyCount++;
+    }
+    history[historyNext] = frameMv;
+    historySum += frameMv;
+    historyNext = (historyNext + 1) % BATTERY_ADC_AVERAGE_FRAMES;
+    frames++;
+
+    uint16_t averageMv = (historySum + historyCount / 2) / historyCount;
+    BatteryAdcReading latest;
+    latest.voltage = averageMv * 0.001f * BATTERY_DIVIDER_RATIO * BATTERY_VOLTAGE_TRIM;
+    latest.millivolts = averageMv;
+    latest.lastFrameMv = frameMv;
+    latest.frames = frames;
+    latest.timestamp = millis();
+    reading.publish(latest);
+    return true;
+}
+
+uint16_t BatteryAdc::toMillivolts(uint16_t raw) const {
+    int millivolts = 0;
+    if (cali && adc_cali_raw_to_voltage(cali, raw, &millivolts) == ESP_OK) {
+        return millivolts;
+    }
+    return (uint32_t)raw * BATTERY_ADC_UNCAL_FULL_MV / 4095;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void BatteryAdc::printStatus() const {
+    if (!isRunning()) {
+        Serial.println("Battery ADC: not running");
+        return;
+    }
+    BatteryAdcReading latest = reading.read();
+    Serial.printf("Battery ADC: %.3f V (%u mV at pin, last frame %u mV), %s, %lu frames, %lu overflows, %lu errors\n",
+                  latest.voltage, latest.millivolts, latest.lastFrameMv,
+                  isCalibrated() ? "eFuse calibrated" : "uncalibrated", (unsigned long)latest.frames,
+                  (unsigned long)overflows, (unsigned long)errors);
+}
@@ -0,0 +1,95 @@
+#ifndef BATTERY_ADC_H
+#define BATTERY_ADC_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali.h"
+#include "snapshot.h"
+
+// ===========================
+// Battery ADC
+// The battery divider sampled continuously by DMA, filtered on its own task
+// and published as one calibrated voltage every caller reads for free
+// ===========================
+
+// The ADC digital controller converts the sense pin at BATTERY_ADC_SAMPLE_HZ
+// into DMA frames of BATTERY_ADC_FRAME_SAMPLES with no CPU involved. The
+// task wakes per frame, takes its median - a radio burst or camera inrush
+// spike in a few samples moves a median, not at all, where it would drag a
+// mean - converts that through the eFuse curve-fitting calibration and
+// averages the last BATTERY_ADC_AVERAGE_FRAMES medians, about a second.
+// The result is a Snapshot, so PowerManager and anything else read the
+// latest voltage without a lock and without touching the ADC.
+//
+// Without eFuse calibration (early samples) raw counts are scaled linearly
+// over the attenuation's nominal range, as analogRead() used to be.
+
+#define BATTERY_ADC_SAMPLE_HZ        1000    // Above the S3's 611 Hz controller minimum
+#define BATTERY_ADC_FRAME_SAMPLES    64      // Per DMA frame and per median, ~16 frames/s
+#define BATTERY_ADC_POOL_FRAMES      4       // Driver pool; the task falls this far behind before samples drop
+#define BATTERY_ADC_AVERAGE_FRAMES   16      // Frame medians in the published mean
+#define BATTERY_ADC_READ_TIMEOUT_MS  100     // One wait for a frame, so end() never waits on a stalled driver
+#define BATTERY_ADC_UNCAL_FULL_MV    3100    // Top of the 12 dB range without calibration
+
+struct BatteryAdcReading {
+    float voltage;          // Battery volts, divider and trim applied
+    uint16_t millivolts;    // At the pin, averaged
+    uint16_t lastFrameMv;   // At the pin, the latest frame median
+    uint32_t frames;        // Frames filtered since begin()
+    uint32_t timestamp;     // millis() of the latest frame
+};
+
+class BatteryAdc {
+public:
+    BatteryAdc();
+    ~BatteryAdc();
+
+    // Channel, calibration, DMA and the task; false if the pin isn't on ADC1
+    // or the driver wouldn't start
+    bool begin(uint8_t pin);
+    void end();
+
+    bool isRunning() const { return task != nullptr; }
+    bool isCalibrated() const { return cali != nullptr; }
+    bool hasReading() const { return reading.read().frames > 0; }
+
+    BatteryAdcReading getReading() const { return reading.read(); }
+    float getVoltage() const { return reading.read().voltage; }
+
+    uint32_t getOverflowCount() const { return overflows; }
+    uint32_t getErrorCount() const { return errors; }
+
+    void printStatus() const;
+
+private:
+    adc_continuous_handle_t handle;
+    adc_cali_handle_t cali;
+    TaskHandle_t task;
+    SemaphoreHandle_t mutex;    // Held for a frame, so end() never deletes the task inside the driver
+    uint8_t channel;
+    Snapshot<BatteryAdcReading> reading;
+
+    uint8_t frame[BATTERY_ADC_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES];
+    uint16_t samples[BATTERY_ADC_FRAME_SAMPLES];
+    uint16_t history[BATTERY_ADC_AVERAGE_FRAMES];
+    uint8_t historyCount;
+    uint8_t historyNext;
+    uint32_t historySum;
+    uint32_t frames;
+
+    volatile uint32_t overflows;
+    volatile uint32_t errors;
+
+    static bool IRAM_ATTR onPoolOverflow(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* data,
+                                         void* context);
+    static void taskEntry(void* param);
+    void taskLoop();
+    bool service();             // One frame; false on a timeout or driver error
+    uint16_t toMillivolts(uint16_t raw) const;
+    void releaseDriver();
+};
+
+#endif // BATTERY_ADC_H
@@ -0,0 +1,211 @@
+#include "bmp280.h"
+
+#define BMP280_REG_CALIBRATION     0x88
+#define BMP280_REG_CHIP_ID         0xD0
+#define BMP280_REG_RESET           0xE0
+#define BMP280_REG_CTRL_MEAS       0xF4
+#define BMP280_REG_CONFIG          0xF5
+#define BMP280_REG_DATA            0xF7
+#define BMP280_RESET_WORD          0xB6
+#define BMP280_MODE_FORCED         0x01
+#define BMP280_MODE_NORMAL         0x03
+#define BMP280_STARTUP_MS          3       // Power-on and soft-reset time, datasheet 2 ms
+
+static uint16_t readLE16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t oversamples(uint8_t code) {
+    return code ? 1u << (code - 1) : 0;
+}
+
+Bmp280::Bmp280() {
+    bus = nullptr;
+    address = 0;
+    ctrlMeas = 0;
+    tempOversampling = 0;
+    pressOversampling = 0;
+    filter = 0;
+    sample = {0, 0};
+    measurementTimeMs = 0;
+    lastAdcP = 0;
+    lastAdcT = 0;
+    memset(rawData, 0, sizeof(rawData));
+    memset(trim, 0, sizeof(trim));
+    digT1 = digP1 = 0;
+    digT2 = digT3 = 0;
+    digP2 = digP3 = digP4 = digP5 = digP6 = digP7 = digP8 = digP9 = 0;
+}
+
+bool Bmp280::begin(TwoWire& bus, uint8_t address, uint8_t tempOversampling, uint8_t pressOversampling,
+                   uint8_t filter) {
+    this->bus = &bus;
+    this->address = address;
+
+    uint8_t chipId = 0;
+    if (!readRegisters(BMP280_REG_CHIP_ID, &chipId, 1) || chipId != BMP280_CHIP_ID) {
+        return false;
+    }
+
+    // From a known state - a previous run may have left it in normal mode
+    if (!writeRegister(BMP280_REG_RESET, BMP280_RESET_WORD)) {
+        return false;
+    }
+    delay(BMP280_STARTUP_MS);
+
+    uint8_t trimData[BMP280_CALIBRATION_LEN];
+    if (!readRegisters(BMP280_REG_CALIBRATION, trimData, sizeof(trimData)) || !loadTrim(trimData)) {
+        return false;
+    }
+
+    // Standby only applies in normal mode; the filter runs on every forced conversion
+    if (!writeRegister(BMP280_REG_CONFIG, (filter & 0x07) << 2)) {
+        return false;
+    }
+    ctrlMeas = ((tempOversampling & 0x07) << 5) | ((pressOversampling & 0x07) << 2) | BMP280_MODE_FORCED;
+
+    // Datasheet section 9.1: 1.25 ms, 2.3 ms per temperature and pressure oversample, 0.575 ms with pressure
+    uint32_t us = 1250 + 2300 * oversamples(tempOversampling) + 2300 * oversamples(pressOversampling) +
+                  (pressOversampling ? 575 : 0);
+    measurementTimeMs = (us + 999) / 1000;
+    return true;
+}
+
+void Bmp280::configure(uint8_t address, uint8_t tempOversampling, uint8_t pressOversampling, uint8_t filter) {
+    this->address = address;
+    this->tempOversampling = tempOversampling;
+    this->pressOversampling = pressOversampling;
+    this->filter = filter;
+}
+
+bool Bmp280::startMeasurement() {
+    return bus && writeRegister(BMP280_REG_CTRL_MEAS, ctrlMeas);
+}
+
+bool Bmp280::readMeasurement(Bmp280Sample& sample) {
+    if (!bus || !readRegisters(BMP280_REG_DATA, rawData, sizeof(rawData))) {
+        return false;
+    }
+    return decode(rawData, sample);
+}
+
+bool Bmp280::loadTrim(const uint8_t* trimData) {
+    memcpy(trim, trimData, sizeof(trim));
+    digT1 = readLE16(&trim[0]);
+    digT2 = (int16_t)readLE16(&trim[2]);
+    digT3 = (int16_t)readLE16(&trim[4]);
+    digP1 = readLE16(&trim[6]);
+    digP2 = (int16_t)readLE16(&trim[8]);
+    digP3 = (int16_t)readLE16(&trim[10]);
+    digP4 = (int16_t)readLE16(&trim[12]);
+    digP5 = (int16_t)readLE16(&trim[14]);
+    digP6 = (int16_t)readLE16(&trim[16]);
+    digP7 = (int16_t)readLE16(&trim[18]);
+    digP8 = (int16_t)readLE16(&trim[20]);
+    digP9 = (int16_t)readLE16(&trim[22]);
+    return digT1 != 0 && digP1 != 0;   // Unprogrammed or misread - compensation would divide by zero
+}
+
+bool Bmp280::decode(const uint8_t* raw, Bmp280Sample& sample) {
+    int32_t adcP = ((int32_t)raw[0] << 12) | ((int32_t)raw[1] << 4) | (raw[2] >> 4);
+    int32_t adcT = ((int32_t)raw[3] << 12) | ((int32_t)raw[4] << 4) | (raw[5] >> 4);
+    if (adcT == 0x80000 || adcP == 0x80000) {
+        return false;   // Reset value - skipped or not yet converted
+    }
+    if (!compensate(adcP, adcT, sample)) {
+        return false;
+    }
+    lastAdcP = adcP;
+    lastAdcT = adcT;
+    return true;
+}
+
+bool Bmp280::startNormalMode(uint8_t oversampling, uint8_t standby) {
+    // Config only takes in sleep mode, which forced mode returns to after each conversion
+    if (!bus || !writeRegister(BMP280_REG_CONFIG, (standby & 0x07) << 5)) {
+        return false;
+    }
+    return writeRegister(BMP280_REG_CTRL_MEAS,
+                         ((oversampling & 0x07) << 5) | ((oversampling & 0x07) << 2) | BMP280_MODE_NORMAL);
+}
+
+float Bmp280::getCountsPerPa() const {
+    // adc_P falls as pressure rises; the slope 256 counts away is the same to well under a percent
+    Bmp280Sample at, above;
+    if (!lastAdcP || !compensate(lastAdcP, lastAdcT, at) || !compensate(lastAdcP + 256, lastAdcT, above) ||
+        at.pressure == above.pressure) {
+        return 0.0f;
+    }
+    return 256.0f * 256.0f / fabsf((float)at.pressure - (float)above.pressure);  // Pressure is Q24.8
+}
+
+bool Bmp280::compensate(int32_t adcP, int32_t adcT, Bmp280Sample& out) const {
+    // Datasheet section 8.2, bmp280_compensate_T_int32
+    int32_t var1 = ((((adcT >> 3) - ((int32_t)digT1 << 1))) * ((int32_t)digT2)) >> 11;
+    int32_t var2 = (((((adcT >> 4) - ((int32_t)digT1)) * ((adcT >> 4) - ((int32_t)digT1))) >> 12) *
+                    ((int32_t)digT3)) >> 14;
+    int32_t tFine = var1 + var2;
+    out.temperature = (tFine * 5 + 128) >> 8;
+
+    // bmp280_compensate_P_int64
+    int64_t p1 = ((int64_t)tFine) - 128000;
+    int64_t p2 = p1 * p1 * (int64_t)digP6;
+    p2 = p2 + ((p1 * (int64_t)digP5) << 17);
+    p2 = p2 + (((int64_t)digP4) << 35);
+    p1 = ((p1 * p1 * (int64_t)digP3) >> 8) + ((p1 * (int64_t)digP2) << 12);
+    p1 = (((((int64_t)1) << 47) + p1)) * ((int64_t)digP1) >> 33;
+    if (p1 == 0) {
+        return false;
+    }
+    int64_t p = 1048576 - adcP;
+    p = (((p << 31) - p2) * 3125) / p1;
+    p1 = (((int64_t)digP9) * (p >> 13) * (p >> 13)) >> 25;
+    p2 = (((int64_t)digP8) * p) >> 19;
+    p = ((p + p1 + p2) >> 8) + (((int64_t)digP7) << 4);
+    out.pressure = (uint32_t)p;
+    return true;
+}
+
+// ===========================
+// SensorDriver
+// ===========================
+
+bool Bmp280::init(TwoWire& bus) {
+    return begin(bus, address, tempOversampling, pressOversampling, filter);
+}
+
+bool Bmp280::trigger(uint32_t& conversionMs) {
+    conversionMs = measurementTimeMs;
+    return startMeasurement();
+}
+
+bool Bmp280::read() {
+    return readMeasurement(sample);
+}
+
+bool Bmp280::validate() const {
+    return sample.pressure >= BMP280_PRESSURE_MIN && sample.pressure <= BMP280_PRESSURE_MAX &&
+           sample.temperature >= BMP280_TEMPERATURE_MIN && sample.temperature <= BMP280_TEMPERATURE_MAX;
+}
+
+bool Bmp280::writeRegister(uint8_t reg, uint8_t value) {
+    bus->beginTransmission(address);
+    bus->write(reg);
+    bus->write(value);
+    return bus->endTransmission() == 0;
+}
+
+bool Bmp280::readRegisters(uint8_t reg, uint8_t* out, uint8_t length) {
+    bus->beginTransmission(address);
+    bus->write(reg);
+    if (bus->endTransmission(false) != 0) {
+        return false;
+    }
+    if (bus->requestFrom(address, length) != length) {
+        return false;
+    }
+    for (uint8_t i = 0; i < length; i++) {
+        out[i] = bus->read();
+    }
+    return true;
+}
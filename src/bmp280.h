@@ -0,0 +1,112 @@
+#ifndef BMP280_H
+#define BMP280_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <cstdint>
+#include "sensor_scheduler.h"
+
+// ===========================
+// BMP280 Driver
+// Forced-mode measurements, one burst read each, Bosch's integer compensation
+// ===========================
+
+// begin() reads the trim once and sets oversampling and the IIR filter;
+// after that a sample is two bus transactions - startMeasurement() writes
+// ctrl_meas, and readMeasurement() fetches press_msb..temp_xlsb (0xF7-0xFC)
+// in one 6-byte read. The caller waits getMeasurementTimeMs() in between,
+// so neither call blocks on the conversion. Compensation is the datasheet's
+// fixed-point code: temperature in 0.01 °C and pressure in Q24.8 Pa.
+//
+// As a SensorDriver the same two transactions are trigger() and read(), with
+// the settings from configure() and the result in getSample().
+//
+// The register bytes behind the last sample and the trim stay readable, for
+// capture; decode() and loadTrim() take them back without a bus, for replay.
+//
+// Oversampling and filter settings are register codes: oversampling 1-5 is
+// x1-x16, filter 0-4 is off, 2, 4, 8, 16.
+
+#define BMP280_CHIP_ID             0x58
+#define BMP280_CALIBRATION_LEN     24      // dig_T1..dig_P9, 0x88-0x9F
+#define BMP280_DATA_LEN            6
+#define BMP280_PRESSURE_MIN        (30000u << 8)   // 300 hPa, Q24.8 - the sensor's rated range
+#define BMP280_PRESSURE_MAX        (120000u << 8)  // 1200 hPa
+#define BMP280_TEMPERATURE_MIN     (-4000)         // -40 °C
+#define BMP280_TEMPERATURE_MAX     8500            // 85 °C
+
+struct Bmp280Sample {
+    int32_t temperature;    // 0.01 °C
+    uint32_t pressure;      // Pa, Q24.8
+};
+
+class Bmp280 : public SensorDriver {
+public:
+    Bmp280();
+
+    // Settings for init()
+    void configure(uint8_t address, uint8_t tempOversampling, uint8_t pressOversampling, uint8_t filter);
+
+    bool begin(TwoWire& bus, uint8_t address, uint8_t tempOversampling, uint8_t pressOversampling,
+               uint8_t filter);
+
+    // One conversion, then the sensor sleeps until the next call
+    bool startMeasurement();
+    bool readMeasurement(Bmp280Sample& sample);
+
+    // Datasheet maximum for the configured oversampling, rounded up
+    uint32_t getMeasurementTimeMs() const { return measurementTimeMs; }
+
+    // Converting on its own every standby code (0-7 = 0.5 ms-4 s), filter
+    // off, for a reader other than this driver - the ULP during deep sleep.
+    // begin() goes back to forced mode.
+    bool startNormalMode(uint8_t oversampling, uint8_t standby);
+
+    // adc_P of the last readMeasurement(), and counts per Pa around it
+    int32_t getRawPressure() const { return lastAdcP; }
+    float getCountsPerPa() const;
+
+    // Register bytes: the trim from begin(), press_msb..temp_xlsb of the last read
+    const uint8_t* getTrim() const { return trim; }
+    const uint8_t* getRawData() const { return rawData; }
+    // Off-bus: trim as getTrim() gave it, then data as getRawData() did
+    bool loadTrim(const uint8_t* trimData);
+    bool decode(const uint8_t* raw, Bmp280Sample& sample);
+
+    // SensorDriver
+    const char* getName() const override { return "bmp280"; }
+    bool init(TwoWire& bus) override;
+    bool trigger(uint32_t& conversionMs) override;
+    bool read() override;
+    bool validate() const override;
+
+    // From the last read()
+    const Bmp280Sample& getSample() const { return sample; }
+
+private:
+    TwoWire* bus;
+    uint8_t address;
+    uint8_t ctrlMeas;       // Oversampling with forced mode
+    uint8_t tempOversampling;
+    uint8_t pressOversampling;
+    uint8_t filter;
+    Bmp280Sample sample;
+    uint32_t measurementTimeMs;
+    int32_t lastAdcP;
+    int32_t lastAdcT;
+
+    uint8_t rawData[BMP280_DATA_LEN];
+
+    // Trim
+    uint8_t trim[BMP280_CALIBRATION_LEN];
+    uint16_t digT1;
+    int16_t digT2, digT3;
+    uint16_t digP1;
+    int16_t digP2, digP3, digP4, digP5, digP6, digP7, digP8, digP9;
+
+    bool compensate(int32_t adcP, int32_t adcT, Bmp280Sample& out) const;
+    bool writeRegister(uint8_t reg, uint8_t value);
+    bool readRegisters(uint8_t reg, uint8_t* out, uint8_t length);
+};
+
+#endif // BMP280_H
@@ -0,0 +1,177 @@
+#include "boot_sequence.h"
+#include "task_placement.h"
+
+#define BOOT_POLL_MS    1       // Between looks for a ready step on a runner with none
+
+BootSequence::BootSequence() {
+    steps = nullptr;
+    count = 0;
+    startMs = 0;
+    foregroundMs = 0;
+    singleCore = false;
+    lock = portMUX_INITIALIZER_UNLOCKED;
+    memset(status, 0, sizeof(status));
+}
+
+// ===========================
+// Running
+// ===========================
+
+bool BootSequence::run(const BootStepSpec* table, uint8_t stepCount) {
+    if (!table || stepCount == 0 || stepCount > BOOT_MAX_STEPS) {
+        return false;
+    }
+    steps = table;
+    count = stepCount;
+    startMs = millis();
+    memset(status, 0, sizeof(status));
+
+    // The other core's worker, if it has steps
+    BaseType_t ownCore = xPortGetCoreID();
+    bool otherSteps = false;
+    for (uint8_t i = 0; i < count; i++) {
+        otherSteps |= steps[i].core != ownCore;
+    }
+    singleCore = otherSteps && createPlacedTask(TaskId::BOOT_WORKER, workerEntry, this, nullptr) != pdPASS;
+
+    // No worker - everything runs here one step at a time, background included
+    runSteps(ownCore, !singleCore);
+    foregroundMs = millis() - startMs;
+
+    bool ok = true;
+    for (uint8_t i = 0; i < count; i++) {
+        if (steps[i].required && !steps[i].background && status[i].state != BootStepState::DONE) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// The next step for core whose predecessors are all done, marked RUNNING; -1 with none.
+// remaining says whether core still has steps that may become ready
+int8_t BootSequence::claimReady(BaseType_t core, bool& remaining) {
+    int8_t claimed = -1;
+    remaining = false;
+
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < count && claimed < 0; i++) {
+        if ((!singleCore && steps[i].core != core) || status[i].state != BootStepState::PENDING) {
+            continue;
+        }
+
+        bool ready = true;
+        bool blocked = false;
+        for (uint8_t j = 0; j < count; j++) {
+            if (!(steps[i].after & (1u << j))) {
+                continue;
+            }
+            if (status[j].state == BootStepState::FAILED || status[j].state == BootStepState::SKIPPED) {
+                blocked = true;
+            } else if (status[j].state != BootStepState::DONE) {
+                ready = false;
+            }
+        }
+
+        if (blocked) {
+            status[i].state = BootStepState::SKIPPED;
+        } else if (ready) {
+            status[i].state = BootStepState::RUNNING;
+            status[i].startMs = millis() - startMs;
+            claimed = i;
+        } else {
+            remaining = true;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return claimed;
+}
+
+void BootSequence::runSteps(BaseType_t core, bool foregroundOnly) {
+    for (;;) {
+        bool remaining;
+        int8_t step = claimReady(core, remaining);
+        if (step >= 0) {
+            bool ok = steps[step].function();
+            portENTER_CRITICAL(&lock);
+            status[step].durationMs = millis() - startMs - status[step].startMs;
+            status[step].state = ok ? BootStepState::DONE : BootStepState::FAILED;
+            portEXIT_CRITICAL(&lock);
+            continue;
+        }
+
+        // setup() goes on once the foreground is through; the worker stays for the background
+        if (foregroundOnly ? foregroundFinished() : !remaining) {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(BOOT_POLL_MS));
+    }
+}
+
+void BootSequence::workerEntry(void* parameter) {
+    BootSequence* sequence = static_cast<BootSequence*>(parameter);
+    sequence->runSteps(xPortGetCoreID(), false);
+    vTaskDelete(nullptr);
+}
+
+bool BootSequence::foregroundFinished() const {
+    portENTER_CRITICAL(&lock);
+    bool finished = true;
+    for (uint8_t i = 0; i < count; i++) {
+        BootStepState state = status[i].state;
+        if (!steps[i].background && (state == BootStepState::PENDING || state == BootStepState::RUNNING)) {
+            finished = false;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return finished;
+}
+
+bool BootSequence::isFinished() const {
+    portENTER_CRITICAL(&lock);
+    bool finished = true;
+    for (uint8_t i = 0; i < count; i++) {
+        if (status[i].state == BootStepState::PENDING || status[i].state == BootStepState::RUNNING) {
+            finished = false;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return finished;
+}
+
+// ===========================
+// Report
+// ===========================
+
+void BootSequence::printReport() const {
+    uint32_t serialMs = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        serialMs += status[i].durationMs;
+    }
+
+    Serial.printf("=== Boot Sequence (foreground %lu ms, %lu ms of steps) ===\n", (unsigned long)foregroundMs,
+                  (unsigned long)serialMs);
+    for (uint8_t i = 0; i < count; i++) {
+        Serial.printf("%-10s core %d  +%5lu ms  %5lu ms  %s%s\n", steps[i].name, (int)steps[i].core,
+                      (unsigned long)status[i].startMs, (unsigned long)status[i].durationMs,
+                      stateToString(status[i].state), steps[i].background ? " (background)" : "");
+    }
+}
+
+const char* BootSequence::stateToString(BootStepState state) {
+    switch (state) {
+        case BootStepState::PENDING: return "Pending";
+        case BootStepState::RUNNING: return "Running";
+        case BootStepState::DONE: return "Done";
+        case BootStepState::FAILED: return "Failed";
+        case BootStepState::SKIPPED: return "Skipped";
+        default: return "Unknown";
+    }
+}
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+static BootSequence bootSequenceInstance;
+
+BootSequence& Boot() { return bootSequenceInstance; }
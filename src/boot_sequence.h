@@ -0,0 +1,96 @@
+#ifndef BOOT_SEQUENCE_H
+#define BOOT_SEQUENCE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// ===========================
+// Boot Sequence
+// Subsystem bring-up as a dependency table run on both cores at once, with
+// each step's start and duration for the startup report
+// ===========================
+
+// Each step names the steps it comes after and the core it runs on. setup()
+// runs its core's steps itself; a worker task on the other core runs that
+// one's. A step starts as soon as everything it comes after is done, so a
+// slow begin() (the GPS receiver's configuration, esp_camera_init()) holds
+// up only what depends on it. A step after one that failed is skipped.
+//
+// run() returns once every foreground step has finished, false if a
+// required one failed or was skipped. Background steps carry on on the
+// worker after that, so the tasks start and the first frame goes out while
+// they are still running; a background step publishes whatever it brings
+// up itself.
+//
+// Steps must not share a bus or an owner with a step that can run at the
+// same time on the other core - the table's order is the only lock.
+
+#define BOOT_MAX_STEPS          16
+#define BOOT_AFTER(step)        (1u << static_cast<uint8_t>(step))
+
+enum class BootStepState : uint8_t {
+    PENDING = 0,
+    RUNNING,
+    DONE,
+    FAILED,
+    SKIPPED         // Something it comes after failed
+};
+
+typedef bool (*BootStepFunction)();
+
+struct BootStepSpec {
+    const char* name;
+    BootStepFunction function;
+    uint32_t after;             // BOOT_AFTER() of each step this one needs
+    BaseType_t core;            // 0 or 1
+    bool required;              // Boot fails without it
+    bool background;            // run() doesn't wait for it
+};
+
+struct BootStepStatus {
+    BootStepState state;
+    uint32_t startMs;           // millis()
+    uint32_t durationMs;
+};
+
+class BootSequence {
+public:
+    BootSequence();
+
+    // steps in the caller's enum order; false if a required step failed
+    bool run(const BootStepSpec* steps, uint8_t count);
+
+    bool isDone(uint8_t step) const { return step < count && status[step].state == BootStepState::DONE; }
+    bool isFinished() const;                // Background steps included
+    const BootStepStatus& getStatus(uint8_t step) const { return status[step]; }
+    const char* getName(uint8_t step) const { return steps ? steps[step].name : "unknown"; }
+    uint8_t getCount() const { return count; }
+    uint32_t getForegroundMs() const { return foregroundMs; }
+    void printReport() const;
+
+    static const char* stateToString(BootStepState state);
+
+private:
+    const BootStepSpec* steps;
+    uint8_t count;
+    BootStepStatus status[BOOT_MAX_STEPS];
+    uint32_t startMs;
+    uint32_t foregroundMs;      // run() from start to return
+    bool singleCore;            // No worker; run() takes every step
+    mutable portMUX_TYPE lock;
+
+    int8_t claimReady(BaseType_t core, bool& remaining);
+    void runSteps(BaseType_t core, bool foregroundOnly);
+    bool foregroundFinished() const;
+    static void workerEntry(void* parameter);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern BootSequence& Boot();
+
+#endif // BOOT_SEQUENCE_H
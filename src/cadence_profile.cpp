@@ -0,0 +1,233 @@
+#include "cadence_profile.h"
+#include "balloon_config.h"
+#include "sensor_pins.h"
+#include "system_state.h"
+#include "power_manager.h"
+#include "sensor_manager.h"
+#include "debug_utils.h"
+
+// Percent of each stream's base interval, in CadenceStream order:
+//                     sense  baro  fix  telem  gps  capture
+static const uint16_t phasePercent[][CADENCE_STREAM_COUNT] = {
+    {100,  400,  500,  200,  200,  400},    // GROUND - the pad, nothing moving
+    {100,  100,  100,   50,   50,  100},    // LAUNCH
+    {100,  100,  100,  100,  100,  100},    // POWERED_ASCENT
+    {100,  200,  200,  100,  100,  100},    // BALLOON_ASCENT - the slow climb and float
+    {100,  100,  100,   50,   50,   50},    // APEX - the burst
+    {100,  100,  100,  100,   50,  100},    // PARACHUTE_DESCENT - position for recovery
+    {100,  100,  100,  100,   50,  200},    // LANDING
+    {500, 1000,  500,  400,  100,    0}     // RECOVERY - a beacon, camera off
+};
+
+static const uint16_t powerPercent[][CADENCE_STREAM_COUNT] = {
+    {100,  100,  100,  100,  100,  100},    // FULL_POWER
+    {100,  100,  100,  100,  100,  100},    // NORMAL_POWER
+    {100,  200,  200,  150,  150,  200},    // LOW_POWER
+    {200,  400,  500,  200,  200,    0},    // CRITICAL_POWER
+    {200,  400,  500,  300,  100,    0}     // EMERGENCY_POWER - position over everything else
+};
+
+// Receiver power mode by flight phase; BALLOON_ASCENT drops to ON_OFF at a steady float
+static const GpsPowerMode phaseGpsPower[] = {
+    GpsPowerMode::CYCLIC,       // GROUND
+    GpsPowerMode::FULL,         // LAUNCH
+    GpsPowerMode::FULL,         // POWERED_ASCENT
+    GpsPowerMode::CYCLIC,       // BALLOON_ASCENT
+    GpsPowerMode::FULL,         // APEX
+    GpsPowerMode::FULL,         // PARACHUTE_DESCENT
+    GpsPowerMode::FULL,         // LANDING
+    GpsPowerMode::ON_OFF        // RECOVERY
+};
+
+#define PHASE_ROWS (sizeof(phasePercent) / sizeof(phasePercent[0]))
+#define POWER_ROWS (sizeof(powerPercent) / sizeof(powerPercent[0]))
+#define GPS_POWER_ROWS (sizeof(phaseGpsPower) / sizeof(phaseGpsPower[0]))
+
+static const char* const gpsPowerNames[] = {"full", "cyclic", "on/off"};
+
+CadenceManager::CadenceManager() {
+    changes = 0;
+    gpsMode = GpsPowerMode::FULL;
+    gpsWanted = GpsPowerMode::FULL;
+    gpsWantedSince = 0;
+    gpsBoostUntil = 0;
+    gpsModeChanges = 0;
+}
+
+// ===========================
+// Profile Selection (flight task)
+// ===========================
+
+void CadenceManager::update() {
+    FlightPhase phase = SysState().getFlightPhase();
+    PowerState power = PowerMgr().getPowerState();
+
+    if (GPS_POWER_POLICY) {
+        updateGPSPower(phase);
+    }
+
+    CadenceProfile current = profile.read();
+    if (current.valid && current.phase == phase && current.power == power) {
+        return;
+    }
+    apply(phase, power);
+}
+
+// ===========================
+// GPS Power Policy (flight task)
+// ===========================
+
+GpsPowerMode CadenceManager::gpsPolicy(FlightPhase phase) const {
+    uint32_t boostUntil = gpsBoostUntil;
+    if (boostUntil && (int32_t)(millis() - boostUntil) < 0) {
+        return GpsPowerMode::FULL;
+    }
+
+    uint8_t row = static_cast<uint8_t>(phase);
+    GpsPowerMode mode = row < GPS_POWER_ROWS ? phaseGpsPower[row] : GpsPowerMode::FULL;
+    if (mode == GpsPowerMode::FULL) {
+        return mode;
+    }
+
+    // Unsure where it is, or how fast it's moving: positions until the filter settles
+    AltitudeEstimate estimate = Sensors().getAltitudeEstimate();
+    if (!estimate.valid || estimate.altitudeSigma > CADENCE_GPS_MAX_ALT_SIGMA ||
+        estimate.verticalSpeedSigma > CADENCE_GPS_MAX_VS_SIGMA) {
+        return GpsPowerMode::FULL;
+    }
+    if (phase == FlightPhase::BALLOON_ASCENT && fabsf(estimate.verticalSpeed) < CADENCE_GPS_FLOAT_MPS) {
+        return GpsPowerMode::ON_OFF;
+    }
+    return mode;
+}
+
+void CadenceManager::updateGPSPower(FlightPhase phase) {
+    if (!Sensors().isGPSUbx()) {
+        return;
+    }
+    uint32_t now = millis();
+    GpsPowerMode wanted = gpsPolicy(phase);
+    if (wanted != gpsWanted) {
+        gpsWanted = wanted;
+        gpsWantedSince = now;
+    }
+
+    // Up at once, down only once it has been asked for a while
+    bool up = static_cast<uint8_t>(wanted) < static_cast<uint8_t>(gpsMode);
+    if (wanted == gpsMode || (!up && now - gpsWantedSince < CADENCE_GPS_SETTLE_MS)) {
+        return;
+    }
+    if (Sensors().setGPSPowerMode(wanted)) {
+        SYS_INFO("GPS power %s -> %s (%s)", gpsPowerNames[static_cast<uint8_t>(gpsMode)],
+                 gpsPowerNames[static_cast<uint8_t>(wanted)], SysState().flightPhaseToString(phase));
+        gpsMode = wanted;
+        gpsModeChanges++;
+    }
+}
+
+void CadenceManager::boostGPS(uint32_t durationMs) {
+    durationMs = min(durationMs, (uint32_t)CADENCE_GPS_BOOST_MAX_MS);
+    uint32_t until = millis() + durationMs;
+    gpsBoostUntil = durationMs ? (until ? until : 1) : 0;
+}
+
+void CadenceManager::apply(FlightPhase phase, PowerState power) {
+    CadenceProfile next = {};
+    next.phase = phase;
+    next.power = power;
+    next.appliedAt = millis();
+    next.valid = true;
+
+    uint8_t phaseRow = static_cast<uint8_t>(phase);
+    uint8_t powerRow = static_cast<uint8_t>(power);
+    for (uint8_t i = 0; i < CADENCE_STREAM_COUNT; i++) {
+        uint32_t percent = 100;
+        if (CADENCE_PROFILES_ENABLED) {
+            percent = (phaseRow < PHASE_ROWS ? phasePercent[phaseRow][i] : 100) *
+                      (powerRow < POWER_ROWS ? powerPercent[powerRow][i] : 100) / 100;
+        }
+        next.percent[i] = (uint16_t)min(percent, (uint32_t)0xFFFF);
+    }
+    profile.publish(next);
+    changes++;
+
+    // The sensor side runs on its own tasks - hand it the new rates now
+    uint32_t baroMs = getInterval(CadenceStream::BARO, BMP280_READ_INTERVAL_MS);
+    if (baroMs) {
+        Sensors().setBaroInterval(baroMs);
+    }
+    uint32_t fixMs = getInterval(CadenceStream::GPS_FIX, 1000 / GPS_NAV_RATE_HZ);
+    if (fixMs) {
+        Sensors().setGPSFixInterval(min(fixMs, (uint32_t)CADENCE_GPS_FIX_MAX_MS));
+    }
+
+    SENSOR_TRACE("Cadence: %s / %s - baro %lu ms, fix %lu ms", SysState().flightPhaseToString(phase),
+                 powerStateToString(power), (unsigned long)baroMs, (unsigned long)fixMs);
+}
+
+// ===========================
+// Readers (any task)
+// ===========================
+
+uint32_t CadenceManager::getInterval(CadenceStream stream, uint32_t baseMs) const {
+    uint8_t index = static_cast<uint8_t>(stream);
+    CadenceProfile current = profile.read();
+    if (!current.valid || index >= CADENCE_STREAM_COUNT) {
+        return baseMs;
+    }
+    return (uint32_t)((uint64_t)baseMs * current.percent[index] / 100);
+}
+
+void CadenceManager::printStatus() const {
+    CadenceProfile current = profile.read();
+    Serial.println("=== Cadence Profile ===");
+    if (!current.valid) {
+        Serial.println("Not applied yet - base intervals");
+        return;
+    }
+    Serial.printf("%s / %s, applied %lu s ago (%lu changes)\n", SysState().flightPhaseToString(current.phase),
+                  powerStateToString(current.power), (unsigned long)((millis() - current.appliedAt) / 1000),
+                  (unsigned long)changes);
+    for (uint8_t i = 0; i < CADENCE_STREAM_COUNT; i++) {
+        const char* name = cadenceStreamToString(static_cast<CadenceStream>(i));
+        if (current.percent[i]) {
+            Serial.printf("  %-10s %u%%\n", name, current.percent[i]);
+        } else {
+            Serial.printf("  %-10s off\n", name);
+        }
+    }
+    if (GPS_POWER_POLICY) {
+        uint32_t boostUntil = gpsBoostUntil;
+        bool boosted = boostUntil && (int32_t)(millis() - boostUntil) < 0;
+        Serial.printf("GPS power: %s, policy wants %s (%lu changes)", gpsPowerNames[static_cast<uint8_t>(gpsMode)],
+                      gpsPowerNames[static_cast<uint8_t>(gpsWanted)], (unsigned long)gpsModeChanges);
+        if (boosted) {
+            Serial.printf(", full rate for %lu s more", (unsigned long)((boostUntil - millis()) / 1000));
+        }
+        Serial.println();
+    }
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static CadenceManager cadenceManagerInstance;
+
+CadenceManager& Cadence() { return cadenceManagerInstance; }
+
+// ===========================
+// Utility Functions
+// ===========================
+
+const char* cadenceStreamToString(CadenceStream stream) {
+    switch (stream) {
+        case CadenceStream::SENSE: return "sense";
+        case CadenceStream::BARO: return "baro";
+        case CadenceStream::GPS_FIX: return "gps_fix";
+        case CadenceStream::TELEMETRY: return "telemetry";
+        case CadenceStream::GPS_REPORT: return "gps_report";
+        case CadenceStream::CAPTURE: return "capture";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef CADENCE_PROFILE_H
+#define CADENCE_PROFILE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "snapshot.h"
+
+// ===========================
+// Cadence Profiles
+// Sampling and reporting rates per flight phase and power state
+// ===========================
+
+// Each stream has a base interval - a define, or the power planner's for
+// the three it plans - and runs at a percentage of it. The percentage is
+// the flight phase's entry times the power state's: the launch and the
+// burst sampled and sent closer together, the float and a landed payload
+// further apart, and everything stretched as the battery runs down. 0 in
+// either table turns the stream off.
+//
+// The flight task re-evaluates on every phase change event and from the
+// sense job, which also notices power state changes. The whole profile is
+// published at once, so the jobs never mix two profiles' rates; the baro
+// interval and the GPS navigation rate are pushed to the sensor side in
+// the same step.
+//
+// GPS power policy (GPS_POWER_POLICY): the receiver tracks continuously
+// through the launch, the burst and the descent, and saves power the rest
+// of the time - cyclic tracking on the pad and in the climb, on/off at a
+// steady float and in recovery. A steady float is a vertical speed within
+// CADENCE_GPS_FLOAT_MPS. The altitude filter's certainty overrides the
+// table: if its altitude or vertical speed sigma grows past
+// CADENCE_GPS_MAX_*_SIGMA, the receiver goes back to full tracking until
+// the filter settles. A step up is taken at once. A step down waits until
+// the policy has asked for it for CADENCE_GPS_SETTLE_MS. boostGPS() forces
+// full tracking for a while, from the ground or for anything on board that
+// wants positions closer together.
+
+enum class CadenceStream : uint8_t {
+    SENSE = 0,      // Flight task's sense job
+    BARO,           // BMP280 conversions on the sensor task
+    GPS_FIX,        // Receiver navigation rate (UBX only)
+    TELEMETRY,
+    GPS_REPORT,
+    CAPTURE,
+    COUNT
+};
+
+#define CADENCE_STREAM_COUNT    static_cast<uint8_t>(CadenceStream::COUNT)
+#define CADENCE_GPS_FIX_MAX_MS  2000    // A fix at least this often - GPS_TIMEOUT_MS calls the lock lost
+#define CADENCE_GPS_FLOAT_MPS   1.0f    // Slower climb or sink than this is a steady float
+#define CADENCE_GPS_MAX_ALT_SIGMA   30.0f   // m - less sure than this and the receiver tracks
+#define CADENCE_GPS_MAX_VS_SIGMA    1.0f    // m/s
+#define CADENCE_GPS_SETTLE_MS   60000   // A lower power mode asked for this long before it's taken
+#define CADENCE_GPS_BOOST_MAX_MS 3600000
+
+enum class FlightPhase : uint8_t;     // system_state.h
+enum class PowerState : uint8_t;      // power_manager.h
+enum class GpsPowerMode : uint8_t;    // sensor_manager.h
+
+struct CadenceProfile {
+    uint16_t percent[CADENCE_STREAM_COUNT];     // Of the base interval, 0 = off
+    FlightPhase phase;
+    PowerState power;
+    uint32_t appliedAt;                         // millis()
+    bool valid;
+};
+
+class CadenceManager {
+public:
+    CadenceManager();
+
+    // Flight task: once the sensors are up, then on phase changes and from the sense job
+    void update();
+
+    // Base interval to this profile's; 0 (the stream is off) stays 0
+    uint32_t getInterval(CadenceStream stream, uint32_t baseMs) const;
+    CadenceProfile getProfile() const { return profile.read(); }
+    uint32_t getChangeCount() const { return changes; }
+
+    // Full GPS tracking for durationMs from now, up to CADENCE_GPS_BOOST_MAX_MS; 0 ends it
+    void boostGPS(uint32_t durationMs);
+    GpsPowerMode getGPSPowerMode() const { return gpsMode; }
+
+    void printStatus() const;
+
+private:
+    Snapshot<CadenceProfile> profile;
+    uint32_t changes;
+
+    // GPS power policy - flight task, but for boostGPS()
+    GpsPowerMode gpsMode;
+    GpsPowerMode gpsWanted;         // What the policy last asked for
+    uint32_t gpsWantedSince;
+    volatile uint32_t gpsBoostUntil;    // millis(), 0 none
+    uint32_t gpsModeChanges;
+
+    void apply(FlightPhase phase, PowerState power);
+    void updateGPSPower(FlightPhase phase);
+    GpsPowerMode gpsPolicy(FlightPhase phase) const;
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern CadenceManager& Cadence();
+
+const char* cadenceStreamToString(CadenceStream stream);
+
+#endif // CADENCE_PROFILE_H
@@ -1,14 +1,88 @@
 #include "camera_manager.h"
+#include <esp_heap_caps.h>
+#include <img_converters.h>
+#include "image_scale.h"
+#include "wavelet_codec.h"
+#include "task_placement.h"
+#include "task_watchdog.h"
+#include "energy_ledger.h"
+#include "power_arbiter.h"
+#include "memory_ledger.h"
+#include "flight_recorder.h"
+#include "frame_pool.h"
+#include "jpeg_dc.h"
+#include "debug_utils.h"
+#include "pipeline.h"
+#include "sd_recorder.h"
+
+// Image-sized scratch belongs in PSRAM - grown in 4 KB steps so small
+// changes in size don't reallocate, and kept between captures
+static bool reserveBuffer(uint8_t*& buffer, size_t& capacity, size_t length) {
+    if (buffer && capacity >= length) {
+        return true;
+    }
+    
+    size_t size = (length + 4095) & ~(size_t)4095;
+    memFree(MemTag::CAMERA, buffer);
+    buffer = (uint8_t*)memAlloc(MemTag::CAMERA, size);
+    capacity = buffer ? size : 0;
+    return buffer != nullptr;
+}
+
+// A scaled decode to RGB565 and, where luma isn't nullptr, its luma plane.
+// At 1/8 that is the DC-only decoder's one pass, jpg2rgb565() and a luma
+// pass when it can't take the frame or there is no workspace for it
+static bool decodeScaled(const uint8_t* jpeg, size_t length, uint8_t shift, uint8_t* rgb565, uint8_t* luma,
+                         size_t pixels, uint8_t*& workspace, size_t& workspaceSize) {
+    if (CAMERA_DC_DECODE && shift == 3 && reserveBuffer(workspace, workspaceSize, jpegDcWorkspaceSize())) {
+        uint16_t width = 0;
+        uint16_t height = 0;
+        if (jpegDecodeDc(jpeg, length, rgb565, luma, width, height, workspace) &&
+            (size_t)(width >> 3) * (height >> 3) == pixels) {
+            return true;
+        }
+    }
+    if (!jpg2rgb565(jpeg, length, rgb565, static_cast<jpg_scale_t>(shift))) {
+        return false;
+    }
+    if (luma) {
+        rgb565ToLuma(rgb565, pixels, luma);
+    }
+    return true;
+}
+
+// Jobs for the thumbnail task, as notification bits
+#define CAMERA_JOB_THUMBNAIL   (1UL << 0)
+#define CAMERA_JOB_TILE        (1UL << 1)
+#define CAMERA_JOB_LAYER       (1UL << 2)
+
+// fmt2jpg_cb() output straight into a reused thumbnail or tile buffer
+struct JpegWriter {
+    uint8_t* buffer;
+    size_t length;
+    size_t capacity;
+};
+
+static size_t writeJpeg(void* arg, size_t index, const void* data, size_t length) {
+    JpegWriter* writer = static_cast<JpegWriter*>(arg);
+    if (index + length > writer->capacity) {
+        return 0;  // Short write aborts the encode
+    }
+    memcpy(&writer->buffer[index], data, length);
+    writer->length = index + length;
+    return length;
+}
 
 // ===========================
 // Constructor/Destructor
 // ===========================
 
-CameraManager::CameraManager() {
+CameraManager::CameraManager()
+    : sensorPowerLock("camera", PowerLockType::APB_MAX), capturePowerLock("capture", PowerLockType::CPU_MAX) {
     initialized = false;
     
     // Initialize data structures
-    currentImage = {nullptr, 0, 0, 0, 0, 0, false};
+    currentImage = {nullptr, 0, 0, 0, 0, 0, 0, false};
     currentThumbnail = {nullptr, 0, 0, 0, 0, 0, false};
     
     // Initialize camera settings
@@ -22,13 +96,135 @@ CameraManager::CameraManager() {
     captureStartTime = 0;
     
     // Initialize error tracking
+    captureCount = 0;
     captureErrorCount = 0;
     initErrorCount = 0;
     
     // Initialize buffer management
+    heldFrame = nullptr;
     imageBuffer = nullptr;
     imageBufferSize = 0;
     
+    // Nothing retained for tiles yet
+    tileImageId = 0;
+    tileSource = nullptr;
+    tileSourceSize = 0;
+    tileSourceLength = 0;
+    tileSourceWidth = 0;
+    tileSourceHeight = 0;
+    tilePixels = nullptr;
+    tilePixelsSize = 0;
+    tilePixelsValid = false;
+    tileCrop = nullptr;
+    tileCropSize = 0;
+    tileJpeg = nullptr;
+    memset(tileWanted, 0, sizeof(tileWanted));
+    tileIndex = 0;
+    tileBusy = false;
+    tileLength = 0;
+    tilesSent = 0;
+    
+    // No layers until the first image is started
+    layerImageId = 0;
+    layerSource = nullptr;
+    layerSourceSize = 0;
+    layerSourceLength = 0;
+    layerSourceWidth = 0;
+    layerSourceHeight = 0;
+    memset(layerWidths, 0, sizeof(layerWidths));
+    layerCount = 0;
+    layerNext = 0;
+    layerIndex = 0;
+    layerPixels = nullptr;
+    layerPixelsSize = 0;
+    layerScaled = nullptr;
+    layerScaledSize = 0;
+    layerJpeg = nullptr;
+    layerWavelet = nullptr;
+    layerWaveletSize = 0;
+    layerBusy = false;
+    layerLength = 0;
+    layersSent = 0;
+    
+    // Capture task starts with the first request
+    captureTask = nullptr;
+    captureStatus = CaptureStatus::IDLE;
+    pendingImage = {nullptr, 0, 0, 0, 0, 0, 0, false};
+    pendingFrame = nullptr;
+    pendingBuffer = nullptr;
+    pendingBufferSize = 0;
+    pendingSignature.valid = false;
+    pendingFrameSize = currentFrameSize;
+    recorderGrab = false;
+    recorderEnabled = false;
+    recorderLock = portMUX_INITIALIZER_UNLOCKED;
+    
+    // Awake once initialized; times are 0 until measured
+    standby = false;
+    coldResumeTime = 0;
+    warmResumeTime = 0;
+    standbyWakes = 0;
+    
+    // Nothing allocated until the first begin()
+    driverMemory = 0;
+    lastReleased = 0;
+    peakReleased = 0;
+    coldStarts = 0;
+    releases = 0;
+    
+    // Scores stay 0 until a frame has been analyzed
+    burstFrames = CAMERA_BURST_FRAMES;
+    pendingBurstScored = 0;
+    pendingSharpness = 0;
+    pendingSharpnessWorst = 0;
+    currentBurstScored = 0;
+    currentSharpness = 0;
+    currentSharpnessWorst = 0;
+    pendingScene.valid = false;
+    currentScene.valid = false;
+    
+    // Thumbnail task starts with the first thumbnail
+    thumbnailTask = nullptr;
+    thumbnailSource = {nullptr, 0, 0, 0, 0, 0, 0, false};
+    orphanedFrame = nullptr;
+    thumbnailBusy = false;
+    portMUX_INITIALIZE(&thumbnailLock);
+    thumbnailPixels = nullptr;
+    thumbnailPixelsSize = 0;
+    thumbnailDecodeWorkspace = nullptr;
+    thumbnailDecodeWorkspaceSize = 0;
+    thumbnailJpeg = nullptr;
+    thumbnailsCreated = 0;
+    thumbnailDuration = 0;
+    
+    // No reference until the first image goes out
+    currentSignature.valid = false;
+    downlinkSignature.valid = false;
+    currentNovelty = SCENE_NOVELTY_MAX;
+    lastDownlinkTime = 0;
+    framesRetained = 0;
+    scenePixels = nullptr;
+    scenePixelsSize = 0;
+    sceneDecodeWorkspace = nullptr;
+    sceneDecodeWorkspaceSize = 0;
+    sceneWidth = 0;
+    sceneHeight = 0;
+    pendingPreview.valid = false;
+    currentPreview.valid = false;
+    previewScaled = nullptr;
+    previewScaledSize = 0;
+    
+    currentExposureLines = 0;
+    currentGain = 0;
+    
+    // No budget until the scheduler gives one
+    byteBudget = 0;
+    budgetSettling = false;
+    
+    // Exposure starts from AE_INITIAL_EXPOSURE
+    exposureChanges = 0;
+    settingsGeneration.store(0, std::memory_order_relaxed);
+    
     // Configure camera settings
     configureCameraForBalloon();
 }
@@ -46,15 +242,34 @@ bool CameraManager::begin() {
         return true;
     }
     
+    // Frame pool blocks first - taken once, and not the driver's to count
+    FramePools().begin();
+    
+    uint32_t start = millis();
+    size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
     if (!initCamera()) {
+        esp_camera_deinit();    // Whatever a part-way init allocated
         initErrorCount++;
         return false;
     }
+    size_t freeAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    driverMemory = freeBefore > freeAfter ? freeBefore - freeAfter : 0;
     
     initialized = true;
+    standby = false;
+    recorderEnabled = true;
+    coldStarts++;
+    reportSensorPower(true);
+    
+    // Cold resume is measured to a first frame, as the warm one is
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (fb) {
+        esp_camera_fb_return(fb);
+    }
+    coldResumeTime = millis() - start;
     
     if (DEBUG_CAMERA) {
-        Serial.println("Camera: Initialized successfully");
+        CAMERA_TRACE("Initialized successfully");
         printCameraInfo();
     }
     
@@ -62,12 +277,50 @@ bool CameraManager::begin() {
 }
 
 void CameraManager::end() {
+    // No time-lapse frames from here on
+    portENTER_CRITICAL(&recorderLock);
+    recorderEnabled = false;
+    portEXIT_CRITICAL(&recorderLock);
+    
+    // Let a capture or time-lapse grab in flight land, then drop it
+    uint32_t start = millis();
+    while ((captureStatus == CaptureStatus::PENDING || recorderGrab) &&
+           millis() - start < CAMERA_CAPTURE_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    if (captureStatus != CaptureStatus::PENDING && !recorderGrab && captureTask) {
+        Watchdog().unwatch(TaskId::CAMERA_CAPTURE);
+        vTaskDelete(captureTask);
+        captureTask = nullptr;
+    }
+    releasePendingImage();
+    
+    // The task may still be reading the frame, a tile or a layer; it is idle again once done
+    start = millis();
+    while ((tileBusy || layerBusy) && millis() - start < CAMERA_THUMB_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    if (waitForThumbnail() && !tileBusy && !layerBusy && thumbnailTask) {
+        vTaskDelete(thumbnailTask);
+        thumbnailTask = nullptr;
+    }
+    
+    // A held frame has to go back before the driver frees its buffers
+    size_t released = getMemoryUsage();
+    releaseImageBuffers();
+    
+    // The sensor is reset by the next init, standby with it
     if (initialized) {
         esp_camera_deinit();
         initialized = false;
+        
+        lastReleased = released + driverMemory;
+        peakReleased = max(peakReleased, lastReleased);
+        releases++;
+        CAMERA_TRACE("Released, %u bytes freed", (unsigned)lastReleased);
     }
-    
-    releaseImageBuffers();
+    standby = false;
+    reportSensorPower(false);
 }
 
 bool CameraManager::reinitialize() {
@@ -84,21 +337,24 @@ bool CameraManager::initCamera() {
     // Initialize camera with balloon configuration
     esp_err_t err = esp_camera_init(&cameraConfig);
     if (err != ESP_OK) {
-        if (DEBUG_CAMERA) {
-            Serial.printf("Camera init failed with error 0x%x\n", err);
-        }
+        CAMERA_TRACE("Camera init failed with error 0x%x", err);
         return false;
     }
     
     // Get sensor handle for configuration
     sensor_t* s = esp_camera_sensor_get();
     if (!s) {
-        if (DEBUG_CAMERA) {
-            Serial.println("Camera: Failed to get sensor handle");
-        }
+        CAMERA_TRACE("Failed to get sensor handle");
         return false;
     }
     
+    // Profile snapshots before the settings below, which leave the
+    // registers at none of them
+    if (CAMERA_REGISTER_PROFILES && !profiles.isCaptured() && !profiles.captureAll(s)) {
+        CAMERA_TRACE("Profile capture failed, profiles run their setters");
+    }
+    profiles.invalidate();
+    
     // Apply initial settings
     s->set_framesize(s, currentFrameSize);
     s->set_quality(s, currentQuality);
@@ -119,6 +375,12 @@ bool CameraManager::initCamera() {
     s->set_lenc(s, 1);  // Lens correction
     s->set_dcw(s, 1);  // Down weight
     s->set_colorbar(s, 0);  // No color bar test
+    settingsChanged();
+    
+    // Manual exposure from the histogram controller from the first frame on
+    if (CAMERA_HISTOGRAM_AE) {
+        applyExposure();
+    }
     
     return true;
 }
@@ -150,20 +412,18 @@ void CameraManager::configureCameraForBalloon() {
     // PSRAM configuration
     if (psramFound()) {
         cameraConfig.fb_location = CAMERA_FB_IN_PSRAM;
-        cameraConfig.fb_count = 2;
-        if (DEBUG_CAMERA) {
-            Serial.println("Camera: PSRAM detected, using PSRAM for frame buffer");
-        }
+        cameraConfig.fb_count = CAMERA_FB_COUNT;
+        CAMERA_TRACE("PSRAM detected, using PSRAM for frame buffer");
     } else {
         cameraConfig.fb_location = CAMERA_FB_IN_DRAM;
         cameraConfig.fb_count = 1;
-        if (DEBUG_CAMERA) {
-            Serial.println("Camera: No PSRAM detected, using DRAM for frame buffer");
-        }
+        CAMERA_TRACE("No PSRAM detected, using DRAM for frame buffer");
     }
     
-    // Set initial frame size and quality
-    cameraConfig.frame_size = currentFrameSize;
+    // The driver sizes its frame buffers for the init frame size - the
+    // largest one allowed, so any later one fits without reallocating.
+    // initCamera() then sets the current one
+    cameraConfig.frame_size = CAMERA_FB_MAX_FRAMESIZE;
     cameraConfig.jpeg_quality = currentQuality;
 }
 
@@ -171,170 +431,889 @@ void CameraManager::configureCameraForBalloon() {
 // Image Capture Methods
 // ===========================
 
-bool CameraManager::captureImage() {
-    if (!initialized) {
+bool CameraManager::requestCapture() {
+    if (captureStatus != CaptureStatus::IDLE || (!initialized && !begin())) {
+        return false;
+    }
+    
+    if (!captureTask &&
+        createPlacedTask(TaskId::CAMERA_CAPTURE, captureTaskEntry, this, &captureTask) != pdPASS) {
+        captureTask = nullptr;
         captureErrorCount++;
         return false;
     }
+    Watchdog().watch(TaskId::CAMERA_CAPTURE, captureTask, TASK_BUDGET_CAMERA_MS);
     
+    // Settings the frame is taken at, for the size model
+    pendingFrameSize = currentFrameSize;
     captureStartTime = millis();
-    
-    // Free previous image
-    freeCurrentImage();
-    
-    // Capture new image
-    if (!captureImageToBuffer()) {
+    captureStatus = CaptureStatus::PENDING;
+    xTaskNotifyGive(captureTask);
+    return true;
+}
+
+CaptureStatus CameraManager::pollCaptureResult() {
+    CaptureStatus status = captureStatus;
+    switch (status) {
+        case CaptureStatus::CAPTURED:
+            acceptPendingImage();
+            captureStatus = CaptureStatus::IDLE;
+            break;
+        case CaptureStatus::FAILED:
+            // Waits out the interval like a good capture rather than retrying every loop
+            captureErrorCount++;
+            lastCaptureTime = millis();
+            captureStatus = CaptureStatus::IDLE;
+            break;
+        default:
+            break;
+    }
+    return status;
+}
+
+bool CameraManager::captureImage() {
+    if (!requestCapture() && captureStatus != CaptureStatus::PENDING) {
         captureErrorCount++;
         return false;
     }
     
-    lastCaptureTime = millis();
-    
-    if (DEBUG_CAMERA) {
-        Serial.printf("Camera: Image captured, size: %d bytes, duration: %lu ms\n",
-                     currentImage.length, getCaptureDuration());
+    uint32_t start = millis();
+    for (;;) {
+        CaptureStatus status = pollCaptureResult();
+        if (status != CaptureStatus::PENDING) {
+            return status == CaptureStatus::CAPTURED;
+        }
+        if (millis() - start >= CAMERA_CAPTURE_TIMEOUT_MS) {
+            captureErrorCount++;
+            return false;   // Still lands later, through pollCaptureResult()
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
     }
-    
-    return true;
 }
 
 bool CameraManager::captureThumbnail() {
-    if (!initialized || !currentImage.valid) {
+    if (!initialized || !currentImage.valid || thumbnailBusy) {
         captureErrorCount++;
         return false;
     }
     
-    // Free previous thumbnail
-    freeCurrentThumbnail();
-    
-    // Create thumbnail from current image
-    if (!createThumbnail(currentImage, currentThumbnail)) {
+    if (!startThumbnailTask()) {
         captureErrorCount++;
         return false;
     }
     
-    if (DEBUG_CAMERA) {
-        Serial.printf("Camera: Thumbnail created, size: %d bytes\n",
-                     currentThumbnail.length);
-    }
+    // Free previous thumbnail
+    freeCurrentThumbnail();
     
+    thumbnailSource = currentImage;
+    thumbnailBusy = true;
+    xTaskNotify(thumbnailTask, CAMERA_JOB_THUMBNAIL, eSetBits);
+    return true;
+}
+
+bool CameraManager::startThumbnailTask() {
+    if (!thumbnailTask &&
+        createPlacedTask(TaskId::CAMERA_THUMB, thumbnailTaskEntry, this, &thumbnailTask) != pdPASS) {
+        thumbnailTask = nullptr;
+        return false;
+    }
     return true;
 }
 
 bool CameraManager::captureBoth() {
-    if (captureImage()) {
-        return captureThumbnail();
+    if (captureImage() && captureThumbnail()) {
+        return waitForThumbnail() && currentThumbnail.valid;
     }
     return false;
 }
 
+bool CameraManager::waitForThumbnail(uint32_t timeoutMs) {
+    uint32_t start = millis();
+    while (thumbnailBusy && millis() - start < timeoutMs) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return !thumbnailBusy;
+}
+
 // ===========================
 // Private Capture Methods
 // ===========================
 
 bool CameraManager::captureImageToBuffer() {
-    // Get frame buffer
-    camera_fb_t* fb = esp_camera_fb_get();
-    if (!fb) {
-        if (DEBUG_CAMERA) {
-            Serial.println("Camera: Failed to get frame buffer");
-        }
+    if (standby && !wakeSensor()) {
         return false;
     }
     
-    // Validate image data
-    if (!validateImageBuffer(fb->buf, fb->len)) {
-        if (DEBUG_CAMERA) {
-            Serial.println("Camera: Invalid image data");
+    // Two held frames would leave the driver nothing to burst into
+    bool hold = canHoldFrames();
+    uint8_t frames = burstFrames;
+    if (hold && (heldFrame || orphanedFrame)) {
+        frames = 1;
+    }
+    bool analyze = CAMERA_SCENE_DETECTION || CAMERA_HISTOGRAM_AE || CAMERA_CLASSIFIER || CAMERA_PREVIEW_FRAME ||
+                   frames > 1;
+    
+    // The pending arena was currentImage's last time round, and a thumbnail may still be reading it
+    if (!hold && !waitForThumbnail()) {
+        return false;
+    }
+    
+    pendingFrame = nullptr;
+    pendingImage.valid = false;
+    pendingBurstScored = 0;
+    pendingSharpness = 0;
+    pendingSharpnessWorst = 0xFFFF;
+    pendingPreview.valid = false;
+    
+    for (uint8_t i = 0; i < frames; i++) {
+        // CAMERA_GRAB_LATEST - each call is a fresh exposure, not a queued one
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (!fb) {
+            CAMERA_TRACE("Failed to get frame buffer");
+            break;
+        }
+        
+        // Validate image data
+        if (!validateImageBuffer(fb->buf, fb->len)) {
+            CAMERA_TRACE("Invalid image data");
+            esp_camera_fb_return(fb);
+            continue;
+        }
+        
+        int64_t exposureUs = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+        ImageData image = {fb->buf, fb->len, (uint16_t)fb->width, (uint16_t)fb->height,
+                           (uint8_t)currentQuality, (uint32_t)(exposureUs / 1000), exposureUs, true};
+        SceneSignature signature;
+        SceneClassification scene;
+        uint16_t sharpness = 0;
+        scene.valid = false;
+        if (!analyze || !analyzeFrame(image, signature, sharpness, scene)) {
+            signature.valid = false;
         }
+        pendingBurstScored++;
+        if (sharpness < pendingSharpnessWorst) {
+            pendingSharpnessWorst = sharpness;
+        }
+        
+        // Ties go to the earlier frame, which is already kept
+        if (pendingImage.valid && sharpness <= pendingSharpness) {
+            esp_camera_fb_return(fb);
+            continue;
+        }
+        if (keepBurstFrame(fb, image)) {
+            pendingSignature = signature;
+            pendingSharpness = sharpness;
+            pendingScene = scene;
+            
+            // While the luma is still this frame's
+            if (CAMERA_PREVIEW_FRAME && analyze) {
+                makePreview(pendingPreview);
+            }
+        }
+    }
+    
+    if (pendingBurstScored > 1) {
+        CAMERA_TRACE("Burst of %u, sharpness %u (worst %u)",
+                     pendingBurstScored, pendingSharpness, pendingSharpnessWorst);
+    }
+    return pendingImage.valid;
+}
+
+bool CameraManager::keepBurstFrame(camera_fb_t* fb, const ImageData& image) {
+    if (canHoldFrames()) {
+        // Keep the driver's buffer - the other one goes on capturing
+        if (pendingFrame) {
+            esp_camera_fb_return(pendingFrame);
+        }
+        pendingFrame = fb;
+        pendingImage = image;
+        return true;
+    }
+    
+    bool copied = FramePools().reserve(FrameClass::JPEG, pendingBuffer, pendingBufferSize, fb->len);
+    if (copied) {
+        memcpy(pendingBuffer, fb->buf, fb->len);
+        pendingImage = image;
+        pendingImage.buffer = pendingBuffer;
+    } else {
+        CAMERA_TRACE("Failed to allocate memory for image");
+    }
+    esp_camera_fb_return(fb);
+    return copied;
+}
+
+bool CameraManager::setBurstFrames(uint8_t frames) {
+    if (frames < 1 || frames > CAMERA_BURST_MAX_FRAMES) {
+        return false;
+    }
+    burstFrames = frames;
+    return true;
+}
+
+void CameraManager::captureTaskEntry(void* parameter) {
+    CameraManager* camera = static_cast<CameraManager*>(parameter);
+    
+    for (;;) {
+        // Until the next request, or the SD recorder's next time-lapse frame;
+        // only a capture or a grab has a budget
+        Watchdog().wait(TaskId::CAMERA_CAPTURE);
+        uint32_t requested = ulTaskNotifyTake(pdTRUE, SD_RECORDER_ENABLED ? SdRec().getTicksUntilNext()
+                                                                          : portMAX_DELAY);
+        Watchdog().beat(TaskId::CAMERA_CAPTURE);
+        if (!requested) {
+            camera->recordTimeLapseFrame();
+            continue;
+        }
+        
+        // Not on top of a TX burst when the battery is marginal
+        Arbiter().waitClaim(EnergyLoad::CAMERA, ENERGY_CAMERA_MA, POWER_ARBITER_CAMERA_WAIT_MS);
+        camera->capturePowerLock.hold(true);
+        bool captured = camera->captureImageToBuffer();
+        if (SD_RECORDER_ENABLED && captured && camera->pendingImage.valid) {
+            SdRec().pushFrame(camera->pendingImage.buffer, camera->pendingImage.length, camera->pendingImage.width,
+                              camera->pendingImage.height);
+        }
+        
+        // Powered down until the next request; the driver and buffers stay up.
+        // Not while recording - the next time-lapse frame is at most an interval off
+        bool recording = SD_RECORDER_ENABLED && SdRec().isRecording();
+        if (CAMERA_STANDBY_BETWEEN_SHOTS && !recording && camera->setSensorStandby(true)) {
+            camera->standby = true;
+            camera->reportSensorPower(false);
+        }
+        camera->capturePowerLock.hold(false);
+        Arbiter().release(EnergyLoad::CAMERA);
+        camera->captureStatus = captured ? CaptureStatus::CAPTURED : CaptureStatus::FAILED;
+        Pipes().signal(PipeEvent::CAPTURE_DONE);
+    }
+}
+
+void CameraManager::recordTimeLapseFrame() {
+    portENTER_CRITICAL(&recorderLock);
+    bool grab = recorderEnabled && initialized;
+    recorderGrab = grab;
+    portEXIT_CRITICAL(&recorderLock);
+    
+    // One frame straight from the driver, copied into the recorder's ring and given back
+    camera_fb_t* fb = nullptr;
+    if (grab) {
+        Arbiter().waitClaim(EnergyLoad::CAMERA, ENERGY_CAMERA_MA, POWER_ARBITER_CAMERA_WAIT_MS);
+        capturePowerLock.hold(true);
+        if (!standby || wakeSensor()) {
+            fb = esp_camera_fb_get();
+        }
+        capturePowerLock.hold(false);
+        Arbiter().release(EnergyLoad::CAMERA);
+    }
+    if (fb && validateImageBuffer(fb->buf, fb->len)) {
+        SdRec().pushFrame(fb->buf, fb->len, fb->width, fb->height);
+    } else {
+        SdRec().skipFrame();
+    }
+    if (fb) {
         esp_camera_fb_return(fb);
+    }
+    recorderGrab = false;
+}
+
+void CameraManager::acceptPendingImage() {
+    // Previous image goes first - its frame back to the driver, or its arena to the task
+    freeCurrentImage();
+    
+    if (pendingFrame) {
+        heldFrame = pendingFrame;
+        pendingFrame = nullptr;
+    } else {
+        uint8_t* buffer = imageBuffer;
+        size_t size = imageBufferSize;
+        imageBuffer = pendingBuffer;
+        imageBufferSize = pendingBufferSize;
+        pendingBuffer = buffer;
+        pendingBufferSize = size;
+    }
+    currentImage = pendingImage;
+    pendingImage.valid = false;
+    lastCaptureTime = millis();
+    captureCount++;
+    
+    currentSignature = pendingSignature;
+    currentNovelty = sceneNovelty(currentSignature, downlinkSignature);
+    currentBurstScored = pendingBurstScored;
+    currentSharpness = pendingSharpness;
+    currentSharpnessWorst = pendingSharpnessWorst;
+    currentScene = pendingScene;
+    currentPreview = pendingPreview;
+    
+    if (FlightRec().isCapturing()) {
+        FlightCameraRecord frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.timeUs = currentImage.timeUs;
+        frame.length = currentImage.length;
+        frame.width = currentImage.width;
+        frame.height = currentImage.height;
+        frame.sharpness = currentSharpness;
+        frame.quality = currentImage.quality;
+        frame.novelty = currentNovelty;
+        frame.frameSize = pendingFrameSize;
+        FlightRec().captureCameraFrame(frame);
+    }
+    
+    if (!budgetSettling) {
+        sizeModel.record(pendingFrameSize, currentImage.quality, sceneLuma(), currentImage.length);
+    }
+    budgetSettling = false;
+    
+    // What this frame was exposed at, before its histogram moves it on; the
+    // sensor's own AEC doesn't say
+    currentExposureLines = CAMERA_HISTOGRAM_AE ? autoExposure.getExposure() : 0;
+    currentGain = CAMERA_HISTOGRAM_AE ? autoExposure.getGain() : 0;
+    
+    // Next capture's exposure from this one's histogram
+    adaptiveBrightnessControl();
+    
+    CAMERA_TRACE("Image captured, size: %d bytes, duration: %lu ms, novelty %u",
+                 currentImage.length, getCaptureDuration(), currentNovelty);
+}
+
+void CameraManager::releasePendingImage() {
+    // Only once the task is done with the slot
+    if (captureStatus == CaptureStatus::PENDING) {
+        return;
+    }
+    if (pendingFrame) {
+        esp_camera_fb_return(pendingFrame);
+        pendingFrame = nullptr;
+    }
+    pendingImage.valid = false;
+    captureStatus = CaptureStatus::IDLE;
+}
+
+bool CameraManager::canHoldFrames() const {
+    // Holding the only frame buffer would stall the next capture
+    return CAMERA_HOLD_FRAME_BUFFER && cameraConfig.fb_location == CAMERA_FB_IN_PSRAM &&
+           cameraConfig.fb_count >= 2;
+}
+
+
+void CameraManager::thumbnailTaskEntry(void* parameter) {
+    CameraManager* camera = static_cast<CameraManager*>(parameter);
+    
+    for (;;) {
+        uint32_t jobs = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &jobs, portMAX_DELAY);
+        
+        if (jobs & CAMERA_JOB_THUMBNAIL) {
+            uint32_t start = millis();
+            ThumbnailData thumbnail = {nullptr, 0, 0, 0, 0, 0, false};
+            bool created = camera->createThumbnail(camera->thumbnailSource, thumbnail);
+            camera->thumbnailDuration = millis() - start;
+            camera->finishThumbnail(thumbnail, created);
+        }
+        
+        if (jobs & CAMERA_JOB_TILE) {
+            if (!camera->encodeTile()) {
+                camera->tileLength = 0;
+                camera->captureErrorCount++;
+            }
+            camera->tileBusy = false;
+        }
+        
+        if (jobs & CAMERA_JOB_LAYER) {
+            if (!camera->encodeLayer()) {
+                camera->layerLength = 0;
+                camera->captureErrorCount++;
+            }
+            camera->layerBusy = false;
+        }
+    }
+}
+
+void CameraManager::finishThumbnail(const ThumbnailData& thumbnail, bool created) {
+    portENTER_CRITICAL(&thumbnailLock);
+    if (created) {
+        currentThumbnail = thumbnail;
+        thumbnailsCreated++;
+    } else {
+        captureErrorCount++;
+    }
+    camera_fb_t* orphan = orphanedFrame;
+    orphanedFrame = nullptr;
+    thumbnailBusy = false;
+    portEXIT_CRITICAL(&thumbnailLock);
+    
+    if (orphan) {
+        esp_camera_fb_return(orphan);
+    }
+    
+    if (created) {
+        CAMERA_TRACE("Thumbnail %ux%u, %d bytes in %lu ms",
+                     thumbnail.width, thumbnail.height, thumbnail.length, thumbnailDuration);
+    }
+}
+
+bool CameraManager::createThumbnail(const ImageData& source, ThumbnailData& thumbnail) {
+    if (!source.valid || source.width == 0 || source.height == 0) {
+        return false;
+    }
+    
+    // The JPEG decoder scales by 1/2, 1/4 or 1/8 while it decodes
+    uint8_t shift = 1;
+    while (shift < 3 && (source.width >> shift) > CAMERA_THUMB_MAX_WIDTH) {
+        shift++;
+    }
+    uint16_t width = source.width >> shift;
+    uint16_t height = source.height >> shift;
+    size_t pixelBytes = (size_t)width * height * 2;
+    
+    if (!FramePools().reserve(FrameClass::PIXELS, thumbnailPixels, thumbnailPixelsSize, pixelBytes)) {
+        return false;
+    }
+    if (!thumbnailJpeg) {
+        size_t capacity = 0;
+        if (!reserveBuffer(thumbnailJpeg, capacity, CAMERA_THUMB_MAX_BYTES)) {
+            return false;
+        }
+    }
+    
+    if (!decodeScaled(source.buffer, source.length, shift, thumbnailPixels, nullptr, (size_t)width * height,
+                      thumbnailDecodeWorkspace, thumbnailDecodeWorkspaceSize)) {
+        CAMERA_TRACE("Thumbnail decode failed");
+        return false;
+    }
+    
+    JpegWriter writer = {thumbnailJpeg, 0, CAMERA_THUMB_MAX_BYTES};
+    if (!fmt2jpg_cb(thumbnailPixels, pixelBytes, width, height, PIXFORMAT_RGB565,
+                    CAMERA_THUMB_JPEG_QUALITY, writeJpeg, &writer) || writer.length == 0) {
+        CAMERA_TRACE("Thumbnail encode failed or exceeded buffer");
+        return false;
+    }
+    
+    thumbnail.buffer = thumbnailJpeg;
+    thumbnail.length = writer.length;
+    thumbnail.width = width;
+    thumbnail.height = height;
+    thumbnail.quality = CAMERA_THUMB_JPEG_QUALITY;
+    thumbnail.timestamp = source.timestamp;  // Same exposure as the full image
+    thumbnail.valid = true;
+    return true;
+}
+
+bool CameraManager::analyzeFrame(const ImageData& image, SceneSignature& signature, uint16_t& sharpness,
+                                 SceneClassification& scene) {
+    // The JPEG decoder scales by 1/2, 1/4 or 1/8 while it decodes
+    uint8_t shift = 1;
+    while (shift < 3 && (image.width >> shift) > CAMERA_ANALYSIS_MAX_WIDTH) {
+        shift++;
+    }
+    uint16_t width = image.width >> shift;
+    uint16_t height = image.height >> shift;
+    size_t pixels = (size_t)width * height;
+    
+    // RGB565 then luma in one buffer
+    sceneWidth = 0;
+    sceneHeight = 0;
+    if (!image.valid || !reserveBuffer(scenePixels, scenePixelsSize, pixels * 3)) {
+        return false;
+    }
+    // One decode for every consumer below and makePreview()
+    uint8_t* luma = &scenePixels[pixels * 2];
+    if (!decodeScaled(image.buffer, image.length, shift, scenePixels, luma, pixels,
+                      sceneDecodeWorkspace, sceneDecodeWorkspaceSize)) {
+        return false;
+    }
+    sceneWidth = width;
+    sceneHeight = height;
+    sharpness = lumaSharpness(luma, width, height);
+    if (CAMERA_CLASSIFIER) {
+        classifyScene(scenePixels, luma, width, height, scene);
+    }
+    return computeSceneSignature(luma, width, height, signature);
+}
+
+bool CameraManager::makePreview(PreviewFrame& preview) {
+    preview.valid = false;
+    if (sceneWidth == 0 || sceneHeight == 0) {
+        return false;
+    }
+    
+    // Box scale (PIE where IMAGE_SCALE_USE_PIE) of the luma analyzeFrame() left, then dither
+    uint16_t width = min((uint16_t)CAMERA_PREVIEW_FRAME_WIDTH, sceneWidth);
+    uint16_t height = max((uint32_t)1, (uint32_t)sceneHeight * width / sceneWidth);
+    height = min(height, (uint16_t)PREVIEW_MAX_HEIGHT);
+    const uint8_t* luma = &scenePixels[(size_t)sceneWidth * sceneHeight * 2];
+    if (!reserveBuffer(previewScaled, previewScaledSize, (size_t)width * height) ||
+        !scaleImage(PIXFORMAT_GRAYSCALE, luma, sceneWidth, sceneHeight, previewScaled, width, height)) {
         return false;
     }
+    return previewPack(previewScaled, width, height, CAMERA_PREVIEW_FRAME_BITS, preview);
+}
+
+bool CameraManager::isNovelFrame() const {
+    // A steady scene still gets an occasional image, even a black one
+    if (millis() - lastDownlinkTime >= CAMERA_NOVELTY_MAX_SKIP_MS) {
+        return true;
+    }
     
-    // Copy image data to our buffer
-    currentImage.buffer = (uint8_t*)malloc(fb->len);
-    if (!currentImage.buffer) {
-        if (DEBUG_CAMERA) {
-            Serial.println("Camera: Failed to allocate memory for image");
+    // Black frames stay on board; the other labels move the bar
+    int threshold = CAMERA_NOVELTY_THRESHOLD;
+    if (CAMERA_CLASSIFIER && currentScene.valid && currentScene.confidence >= CAMERA_CLASSIFIER_MIN_CONFIDENCE) {
+        if (currentScene.label == SceneLabel::BLACK) {
+            return false;
         }
-        esp_camera_fb_return(fb);
+        threshold += sceneNoveltyBias(currentScene.label);
+    }
+    
+    if (!CAMERA_SCENE_DETECTION || !downlinkSignature.valid) {
+        return true;
+    }
+    return currentNovelty >= max(threshold, 1);
+}
+
+void CameraManager::markDownlinked() {
+    downlinkSignature = currentSignature;
+    lastDownlinkTime = millis();
+}
+
+// ===========================
+// Tiles
+// ===========================
+
+uint16_t CameraManager::getTileCount() const {
+    uint16_t columns = (tileSourceWidth + CAMERA_TILE_SIZE - 1) / CAMERA_TILE_SIZE;
+    uint16_t rows = (tileSourceHeight + CAMERA_TILE_SIZE - 1) / CAMERA_TILE_SIZE;
+    return columns * rows;
+}
+
+bool CameraManager::retainForTiles(uint16_t imageId) {
+    if (!currentImage.valid || imageId == 0) {
         return false;
     }
     
-    memcpy(currentImage.buffer, fb->buf, fb->len);
-    currentImage.length = fb->len;
-    currentImage.width = fb->width;
-    currentImage.height = fb->height;
-    currentImage.quality = currentQuality;  // Use our tracked quality
-    currentImage.timestamp = millis();
-    currentImage.valid = true;
+    // The task reads the source and pixels while it encodes
+    uint32_t start = millis();
+    while (tileBusy && millis() - start < CAMERA_THUMB_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    if (tileBusy) {
+        return false;
+    }
     
-    // Return frame buffer
-    esp_camera_fb_return(fb);
+    // Requests for the previous image are dropped with it
+    tileImageId = 0;
+    tileLength = 0;
+    tilePixelsValid = false;
+    memset(tileWanted, 0, sizeof(tileWanted));
     
+    uint16_t columns = (currentImage.width + CAMERA_TILE_SIZE - 1) / CAMERA_TILE_SIZE;
+    uint16_t rows = (currentImage.height + CAMERA_TILE_SIZE - 1) / CAMERA_TILE_SIZE;
+    if ((uint32_t)columns * rows > CAMERA_TILE_MAX_TILES ||
+        !reserveBuffer(tileSource, tileSourceSize, currentImage.length)) {
+        return false;
+    }
+    memcpy(tileSource, currentImage.buffer, currentImage.length);
+    tileSourceLength = currentImage.length;
+    tileSourceWidth = currentImage.width;
+    tileSourceHeight = currentImage.height;
+    tileImageId = imageId;
     return true;
 }
 
-bool CameraManager::createThumbnail(const ImageData& source, ThumbnailData& thumbnail) {
-    // Define thumbnail dimensions (quarter size)
-    uint16_t thumbWidth = source.width / 4;
-    uint16_t thumbHeight = source.height / 4;
-    
-    // Ensure minimum dimensions
-    if (thumbWidth < 80) thumbWidth = 80;
-    if (thumbHeight < 60) thumbHeight = 60;
-    
-    // Estimate thumbnail size
-    size_t estimatedSize = estimateImageSize(FRAMESIZE_QQVGA, 15); // Higher quality for thumbnail
-    
-    // Allocate thumbnail buffer
-    thumbnail.buffer = (uint8_t*)malloc(estimatedSize);
-    if (!thumbnail.buffer) {
-        if (DEBUG_CAMERA) {
-            Serial.println("Camera: Failed to allocate memory for thumbnail");
+bool CameraManager::requestTiles(const uint8_t* params, size_t length) {
+    if (!params || length < 4) {
+        return false;
+    }
+    
+    uint16_t imageId = (params[0] << 8) | params[1];
+    uint16_t first = (params[2] << 8) | params[3];
+    uint16_t count = getTileCount();
+    if (tileImageId == 0 || imageId != tileImageId || first >= count) {
+        return false;
+    }
+    
+    tileWanted[first >> 3] |= 1 << (first & 7);
+    for (size_t i = 0; i < (length - 4) * 8; i++) {
+        uint32_t tile = first + 1 + i;
+        if ((params[4 + (i >> 3)] & (1 << (i & 7))) && tile < count) {
+            tileWanted[tile >> 3] |= 1 << (tile & 7);
+        }
+    }
+    return true;
+}
+
+void CameraManager::processTiles() {
+    if (tileImageId == 0 || tileBusy || tileLength > 0) {
+        return;
+    }
+    
+    // Lowest index first
+    uint16_t count = getTileCount();
+    for (uint16_t tile = 0; tile < count; tile++) {
+        if (!(tileWanted[tile >> 3] & (1 << (tile & 7)))) {
+            continue;
+        }
+        if (!startThumbnailTask()) {
+            return;
+        }
+        tileWanted[tile >> 3] &= ~(1 << (tile & 7));
+        tileIndex = tile;
+        tileBusy = true;
+        xTaskNotify(thumbnailTask, CAMERA_JOB_TILE, eSetBits);
+        return;
+    }
+}
+
+bool CameraManager::getEncodedTile(const uint8_t*& data, size_t& length) const {
+    if (tileBusy || tileLength == 0) {
+        return false;
+    }
+    data = tileJpeg;
+    length = tileLength;
+    return true;
+}
+
+void CameraManager::releaseTile() {
+    if (!tileBusy && tileLength > 0) {
+        tileLength = 0;
+        tilesSent++;
+    }
+}
+
+bool CameraManager::encodeTile() {
+    uint16_t width = tileSourceWidth;
+    uint16_t height = tileSourceHeight;
+    
+    // One full-resolution decode serves every tile of the image
+    if (!tilePixelsValid) {
+        if (!reserveBuffer(tilePixels, tilePixelsSize, (size_t)width * height * 2) ||
+            !jpg2rgb565(tileSource, tileSourceLength, tilePixels, JPG_SCALE_NONE)) {
+            return false;
         }
+        tilePixelsValid = true;
+    }
+    
+    uint16_t columns = (width + CAMERA_TILE_SIZE - 1) / CAMERA_TILE_SIZE;
+    uint16_t rows = (height + CAMERA_TILE_SIZE - 1) / CAMERA_TILE_SIZE;
+    uint16_t x = (tileIndex % columns) * CAMERA_TILE_SIZE;
+    uint16_t y = (tileIndex / columns) * CAMERA_TILE_SIZE;
+    uint16_t tileWidth = min((uint16_t)CAMERA_TILE_SIZE, (uint16_t)(width - x));
+    uint16_t tileHeight = min((uint16_t)CAMERA_TILE_SIZE, (uint16_t)(height - y));
+    size_t rowBytes = (size_t)tileWidth * 2;
+    
+    size_t jpegCapacity = 0;
+    if (!reserveBuffer(tileCrop, tileCropSize, rowBytes * tileHeight) ||
+        (!tileJpeg && !reserveBuffer(tileJpeg, jpegCapacity, CAMERA_TILE_HEADER_SIZE + CAMERA_TILE_MAX_BYTES))) {
         return false;
     }
+    for (uint16_t row = 0; row < tileHeight; row++) {
+        memcpy(&tileCrop[row * rowBytes], &tilePixels[((size_t)(y + row) * width + x) * 2], rowBytes);
+    }
     
-    // For simplicity, we'll create a thumbnail by recapturing with smaller frame size
-    framesize_t originalSize = currentFrameSize;
-    int originalQuality = currentQuality;
+    tileJpeg[0] = tileImageId >> 8;
+    tileJpeg[1] = tileImageId & 0xFF;
+    tileJpeg[2] = tileIndex >> 8;
+    tileJpeg[3] = tileIndex & 0xFF;
+    tileJpeg[4] = static_cast<uint8_t>(columns);
+    tileJpeg[5] = static_cast<uint8_t>(rows);
+    tileJpeg[6] = CAMERA_TILE_SIZE / 8;
+    
+    JpegWriter writer = {&tileJpeg[CAMERA_TILE_HEADER_SIZE], 0, CAMERA_TILE_MAX_BYTES};
+    if (!fmt2jpg_cb(tileCrop, rowBytes * tileHeight, tileWidth, tileHeight, PIXFORMAT_RGB565,
+                    CAMERA_TILE_JPEG_QUALITY, writeJpeg, &writer) || writer.length == 0) {
+        return false;
+    }
+    tileLength = CAMERA_TILE_HEADER_SIZE + writer.length;
+    return true;
+}
+
+// ===========================
+// Progressive Layers
+// ===========================
+
+bool CameraManager::startLayers(uint16_t imageId, const uint8_t* metadata, size_t metadataLength) {
+    if (!currentImage.valid || imageId == 0 || currentImage.width == 0 || currentImage.height == 0) {
+        return false;
+    }
     
-    // Temporarily set thumbnail settings
-    setFrameSize(FRAMESIZE_QQVGA);
-    setQuality(15); // Better quality for thumbnail
+    // The task reads the source while it encodes
+    uint32_t start = millis();
+    while (layerBusy && millis() - start < CAMERA_THUMB_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    if (layerBusy) {
+        return false;
+    }
     
-    // Capture thumbnail
-    camera_fb_t* fb = esp_camera_fb_get();
-    if (!fb) {
-        free(thumbnail.buffer);
-        setFrameSize(originalSize);
-        setQuality(originalQuality);
-        return false;
-    }
-    
-    // Copy thumbnail data
-    if (fb->len <= estimatedSize) {
-        memcpy(thumbnail.buffer, fb->buf, fb->len);
-        thumbnail.length = fb->len;
-        thumbnail.width = fb->width;
-        thumbnail.height = fb->height;
-        thumbnail.quality = 15;  // Use our thumbnail quality setting
-        thumbnail.timestamp = millis();
-        thumbnail.valid = true;
+    // The previous image's unsent layers give way; the ground keeps what it has
+    layerImageId = 0;
+    layerLength = 0;
+    if (!metadata || currentImage.length < 2) {
+        metadataLength = 0;
+    }
+    if (!reserveBuffer(layerSource, layerSourceSize, CAMERA_LAYER_HEADER_SIZE + metadataLength + currentImage.length)) {
+        return false;
+    }
+    
+    // A metadata segment goes in straight after SOI, where a decoder skips it
+    uint8_t* jpeg = &layerSource[CAMERA_LAYER_HEADER_SIZE];
+    if (metadataLength > 0) {
+        memcpy(jpeg, currentImage.buffer, 2);
+        memcpy(&jpeg[2], metadata, metadataLength);
+        memcpy(&jpeg[2 + metadataLength], &currentImage.buffer[2], currentImage.length - 2);
     } else {
-        free(thumbnail.buffer);
-        esp_camera_fb_return(fb);
-        setFrameSize(originalSize);
-        setQuality(originalQuality);
+        memcpy(jpeg, currentImage.buffer, currentImage.length);
+    }
+    layerSourceLength = metadataLength + currentImage.length;
+    layerSourceWidth = currentImage.width;
+    layerSourceHeight = currentImage.height;
+    
+    // Each layer wider than the last, and the capture itself to finish
+    const uint16_t widths[] = {
+        CAMERA_LAYER_PREVIEW_WAVELET ? CAMERA_LAYER_WAVELET_WIDTH : CAMERA_LAYER_PREVIEW_WIDTH,
+        CAMERA_LAYER_THUMB_WIDTH,
+        min((uint16_t)(currentImage.width / 2), (uint16_t)CAMERA_LAYER_MID_MAX_WIDTH)
+    };
+    layerCount = 0;
+    for (uint16_t width : widths) {
+        if (width < currentImage.width && (layerCount == 0 || width > layerWidths[layerCount - 1])) {
+            layerWidths[layerCount++] = width;
+        }
+    }
+    layerWidths[layerCount++] = currentImage.width;
+    
+    layerNext = 0;
+    layerImageId = imageId;
+    return true;
+}
+
+void CameraManager::processLayers() {
+    if (layerImageId == 0 || layerBusy || layerLength > 0 || layerNext >= layerCount) {
+        return;
+    }
+    
+    // The capture itself needs no work, only its header
+    if (layerNext == layerCount - 1) {
+        layerIndex = layerNext++;
+        layerSource[0] = layerImageId >> 8;
+        layerSource[1] = layerImageId & 0xFF;
+        layerSource[2] = layerIndex;
+        layerSource[3] = layerCount;
+        layerLength = CAMERA_LAYER_HEADER_SIZE + layerSourceLength;
+        return;
+    }
+    
+    if (!startThumbnailTask()) {
+        return;
+    }
+    layerIndex = layerNext++;
+    layerBusy = true;
+    xTaskNotify(thumbnailTask, CAMERA_JOB_LAYER, eSetBits);
+}
+
+bool CameraManager::getEncodedLayer(const uint8_t*& data, size_t& length, uint8_t& layer) const {
+    if (layerBusy || layerLength == 0) {
+        return false;
+    }
+    data = layerIndex == layerCount - 1 ? layerSource : layerJpeg;
+    length = layerLength;
+    layer = layerIndex;
+    return true;
+}
+
+void CameraManager::releaseLayer() {
+    if (layerBusy || layerLength == 0) {
+        return;
+    }
+    layerLength = 0;
+    layersSent++;
+    if (layerIndex == layerCount - 1) {
+        layerImageId = 0;
+    }
+}
+
+bool CameraManager::encodeLayer() {
+    uint16_t width = layerWidths[layerIndex];
+    uint16_t height = max((uint32_t)1, (uint32_t)layerSourceHeight * width / layerSourceWidth);
+    bool preview = layerIndex == 0;
+    pixformat_t format = preview ? PIXFORMAT_GRAYSCALE : PIXFORMAT_RGB565;
+    size_t bytesPerPixel = preview ? 1 : 2;
+    
+    // Decode at the smallest scale still as wide as the layer; the box filter does the rest
+    uint8_t shift = 0;
+    while (shift < 3 && (layerSourceWidth >> (shift + 1)) >= width) {
+        shift++;
+    }
+    uint16_t decodedWidth = layerSourceWidth >> shift;
+    uint16_t decodedHeight = layerSourceHeight >> shift;
+    size_t decodedPixels = (size_t)decodedWidth * decodedHeight;
+    size_t pixels = (size_t)width * height;
+    
+    size_t jpegCapacity = 0;
+    if (!reserveBuffer(layerPixels, layerPixelsSize, decodedPixels * (preview ? 3 : 2)) ||
+        !reserveBuffer(layerScaled, layerScaledSize, pixels * bytesPerPixel) ||
+        (!layerJpeg && !reserveBuffer(layerJpeg, jpegCapacity, CAMERA_LAYER_HEADER_SIZE + CAMERA_LAYER_MAX_BYTES))) {
+        return false;
+    }
+    uint8_t* luma = preview ? &layerPixels[decodedPixels * 2] : nullptr;
+    if (!decodeScaled(&layerSource[CAMERA_LAYER_HEADER_SIZE], layerSourceLength, shift, layerPixels, luma,
+                      decodedPixels, thumbnailDecodeWorkspace, thumbnailDecodeWorkspaceSize)) {
+        return false;
+    }
+    const uint8_t* decoded = preview ? luma : layerPixels;
+    if (!scaleImage(format, decoded, decodedWidth, decodedHeight, layerScaled, width, height)) {
         return false;
     }
     
-    // Return frame buffer and restore settings
-    esp_camera_fb_return(fb);
-    setFrameSize(originalSize);
-    setQuality(originalQuality);
+    layerJpeg[0] = layerImageId >> 8;
+    layerJpeg[1] = layerImageId & 0xFF;
+    layerJpeg[2] = layerIndex;
+    layerJpeg[3] = layerCount;
+    
+    // The coder stops at the budget; any shorter cut of it would decode too
+    if (preview && CAMERA_LAYER_PREVIEW_WAVELET) {
+        size_t workspace = waveletWorkspaceSize(width, height);
+        if (!workspace || !reserveBuffer(layerWavelet, layerWaveletSize, workspace)) {
+            return false;
+        }
+        size_t length = waveletEncode(layerScaled, width, height, &layerJpeg[CAMERA_LAYER_HEADER_SIZE],
+                                      min((size_t)CAMERA_LAYER_WAVELET_BYTES, (size_t)CAMERA_LAYER_MAX_BYTES),
+                                      layerWavelet);
+        if (length == 0) {
+            return false;
+        }
+        layerLength = CAMERA_LAYER_HEADER_SIZE + length;
+        CAMERA_TRACE("Image %u layer %u/%u %ux%u wavelet, %u bytes", layerImageId, layerIndex + 1,
+                     layerCount, width, height, (unsigned)length);
+        return true;
+    }
+    
+    uint8_t quality = preview ? CAMERA_LAYER_PREVIEW_QUALITY :
+                      layerIndex == 1 ? CAMERA_THUMB_JPEG_QUALITY : CAMERA_LAYER_MID_QUALITY;
+    JpegWriter writer = {&layerJpeg[CAMERA_LAYER_HEADER_SIZE], 0, CAMERA_LAYER_MAX_BYTES};
+    if (!fmt2jpg_cb(layerScaled, pixels * bytesPerPixel, width, height, format, quality, writeJpeg, &writer) ||
+        writer.length == 0) {
+        return false;
+    }
+    layerLength = CAMERA_LAYER_HEADER_SIZE + writer.length;
     
+    CAMERA_TRACE("Image %u layer %u/%u %ux%u, %u bytes", layerImageId, layerIndex + 1,
+                 layerCount, width, height, (unsigned)writer.length);
+    return true;
+}
+
+bool CameraManager::resizeImage(const uint8_t* src, size_t srcLen, uint16_t srcW, uint16_t srcH,
+                                uint8_t* dst, size_t& dstLen, uint16_t dstW, uint16_t dstH,
+                                pixformat_t format) {
+    // Raw frames only - dstLen is the capacity going in, bytes written coming out
+    size_t bytesPerPixel = format == PIXFORMAT_RGB565 ? 2 : 1;
+    size_t needed = (size_t)dstW * dstH * bytesPerPixel;
+    if (srcLen < (size_t)srcW * srcH * bytesPerPixel || dstLen < needed) {
+        return false;
+    }
+    
+    if (!scaleImage(format, src, srcW, srcH, dst, dstW, dstH)) {
+        return false;
+    }
+    dstLen = needed;
     return true;
 }
 
@@ -343,7 +1322,7 @@ bool CameraManager::createThumbnail(const ImageData& source, ThumbnailData& thum
 // ===========================
 
 bool CameraManager::setFrameSize(framesize_t size) {
-    if (!initialized) {
+    if (!initialized || !frameSizeFits(size)) {
         return false;
     }
     
@@ -355,9 +1334,10 @@ bool CameraManager::setFrameSize(framesize_t size) {
     if (s->set_framesize(s, size) != 0) {
         return false;
     }
+    profiles.invalidate();
+    settingsChanged();
     
     currentFrameSize = size;
-    cameraConfig.frame_size = size;
     
     return true;
 }
@@ -375,6 +1355,8 @@ bool CameraManager::setQuality(int quality) {
     if (s->set_quality(s, quality) != 0) {
         return false;
     }
+    profiles.invalidate();
+    settingsChanged();
     
     currentQuality = quality;
     cameraConfig.jpeg_quality = quality;
@@ -395,6 +1377,7 @@ bool CameraManager::setBrightness(int brightness) {
     if (s->set_brightness(s, brightness) != 0) {
         return false;
     }
+    settingsChanged();
     
     currentBrightness = brightness;
     
@@ -414,6 +1397,7 @@ bool CameraManager::setContrast(int contrast) {
     if (s->set_contrast(s, contrast) != 0) {
         return false;
     }
+    settingsChanged();
     
     currentContrast = contrast;
     
@@ -445,9 +1429,98 @@ bool CameraManager::isTimeToCapture(uint32_t intervalMs) const {
 void CameraManager::enableCamera(bool enable) {
     if (enable && !initialized) {
         begin();
-    } else if (!enable && initialized) {
-        end();
+    } else if (enable) {
+        exitStandby();
+    } else if (initialized) {
+        enterStandby();
+    }
+}
+
+bool CameraManager::enterStandby() {
+    if (!initialized) {
+        return false;
+    }
+    if (standby) {
+        return true;
+    }
+    
+    // The capture task owns the sensor while a capture or time-lapse grab is in flight
+    uint32_t start = millis();
+    while ((captureStatus == CaptureStatus::PENDING || recorderGrab) &&
+           millis() - start < CAMERA_CAPTURE_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(5));
     }
+    if (captureStatus == CaptureStatus::PENDING || recorderGrab || !setSensorStandby(true)) {
+        return false;
+    }
+    standby = true;
+    reportSensorPower(false);
+    
+    CAMERA_TRACE("Standby");
+    return true;
+}
+
+bool CameraManager::exitStandby() {
+    if (!initialized || captureStatus == CaptureStatus::PENDING) {
+        return false;
+    }
+    return !standby || wakeSensor();
+}
+
+bool CameraManager::setSensorStandby(bool enable) {
+    sensor_t* s = esp_camera_sensor_get();
+    if (!s) {
+        return false;
+    }
+    
+    // set_reg() only touches the mask bits, so nothing else is rewritten
+    switch (s->id.PID) {
+        case OV2640_PID:
+            return s->set_reg(s, 0x100 | 0x09, 0x10, enable ? 0x10 : 0x00) == 0;  // Sensor bank COM2 standby
+        case OV3660_PID:
+        case OV5640_PID:
+            return s->set_reg(s, 0x3008, 0x40, enable ? 0x40 : 0x00) == 0;        // SYSTEM_CTRL0 power down
+        default:
+            break;
+    }
+    if (PWDN_GPIO_NUM >= 0) {
+        digitalWrite(PWDN_GPIO_NUM, enable ? HIGH : LOW);
+        return true;
+    }
+    return false;
+}
+
+void CameraManager::reportSensorPower(bool awake) {
+    Energy().setActive(EnergyLoad::CAMERA, awake);
+    sensorPowerLock.hold(awake);
+}
+
+bool CameraManager::wakeSensor() {
+    uint32_t start = millis();
+    if (!setSensorStandby(false)) {
+        return false;
+    }
+    standby = false;
+    reportSensorPower(true);
+    
+    // CAMERA_GRAB_LATEST may still hold a frame from before, and the one
+    // the sensor was part way through at the wake is torn
+    camera_fb_t* fb = nullptr;
+    for (int i = 0; i <= CAMERA_STANDBY_SETTLE_FRAMES; i++) {
+        if (fb) {
+            esp_camera_fb_return(fb);
+        }
+        fb = esp_camera_fb_get();
+        if (!fb) {
+            return false;
+        }
+    }
+    esp_camera_fb_return(fb);
+    
+    warmResumeTime = millis() - start;
+    standbyWakes++;
+    CAMERA_TRACE("Woke in %lu ms (cold start %lu ms)", warmResumeTime, coldResumeTime);
+    return true;
 }
 
 void CameraManager::enterLowPowerMode() {
@@ -455,9 +1528,7 @@ void CameraManager::enterLowPowerMode() {
     setQuality(20); // Lower quality = smaller images
     setFrameSize(FRAMESIZE_QVGA); // Smaller frame size
     
-    if (DEBUG_CAMERA) {
-        Serial.println("Camera: Entered low power mode");
-    }
+    CAMERA_TRACE("Entered low power mode");
 }
 
 void CameraManager::exitLowPowerMode() {
@@ -465,9 +1536,7 @@ void CameraManager::exitLowPowerMode() {
     setQuality(BALLOON_CAMERA_QUALITY);
     setFrameSize(BALLOON_CAMERA_FRAMESIZE);
     
-    if (DEBUG_CAMERA) {
-        Serial.println("Camera: Exited low power mode");
-    }
+    CAMERA_TRACE("Exited low power mode");
 }
 
 // ===========================
@@ -482,10 +1551,13 @@ void CameraManager::updateForConditions(float altitude, float temperature, float
         exitLowPowerMode();
     }
     
-    // Adjust brightness based on altitude (higher = brighter)
-    float brightnessAdjustment = altitude / 10000.0f; // Adjust by altitude
-    int newBrightness = constrain(currentBrightness + (int)brightnessAdjustment, -2, 2);
-    setBrightness(newBrightness);
+    // Adjust brightness based on altitude (higher = brighter) - the
+    // histogram controller measures the image instead when it runs
+    if (!CAMERA_HISTOGRAM_AE) {
+        float brightnessAdjustment = altitude / 10000.0f; // Adjust by altitude
+        int newBrightness = constrain(currentBrightness + (int)brightnessAdjustment, -2, 2);
+        setBrightness(newBrightness);
+    }
     
     // Adjust contrast based on temperature
     if (temperature < 0.0f) {
@@ -496,27 +1568,111 @@ void CameraManager::updateForConditions(float altitude, float temperature, float
 }
 
 bool CameraManager::optimizeForBandwidth() {
-    // Optimize for minimal bandwidth usage
-    setFrameSize(FRAMESIZE_QVGA);
-    setQuality(25); // Higher quality number = lower quality = smaller size
+    // Optimize for minimal bandwidth usage - QVGA at quality 25
+    bool applied = applyProfile(CameraProfileId::BANDWIDTH);
     
-    if (DEBUG_CAMERA) {
-        Serial.println("Camera: Optimized for bandwidth");
+    CAMERA_TRACE("Optimized for bandwidth");
+    
+    return applied;
+}
+
+bool CameraManager::applyProfile(CameraProfileId id) {
+    // Not mid-capture - the frame would be put down to the wrong settings
+    if (!initialized || captureStatus == CaptureStatus::PENDING) {
+        return false;
     }
     
+    sensor_t* s = esp_camera_sensor_get();
+    if (!s) {
+        return false;
+    }
+    
+    const CameraProfileSpec& spec = profiles.getSpec(id);
+    bool changesSize = spec.frameSize != currentFrameSize || spec.quality != currentQuality;
+    bool applied = profiles.apply(s, id);
+    settingsChanged();  // A failed apply may still have written some of it
+    if (!applied) {
+        return false;
+    }
+    
+    currentFrameSize = spec.frameSize;
+    currentQuality = spec.quality;
+    currentContrast = spec.contrast;
+    if (!CAMERA_HISTOGRAM_AE) {
+        currentBrightness = spec.brightness;
+    }
+    cameraConfig.jpeg_quality = spec.quality;
+    
+    // The next frame may still be one grabbed at the old size, as after the budget's own changes
+    budgetSettling = budgetSettling || changesSize;
     return true;
 }
 
-bool CameraManager::optimizeForQuality() {
-    // Optimize for best quality within constraints
-    setFrameSize(FRAMESIZE_VGA);
-    setQuality(10); // Lower quality number = higher quality
+bool CameraManager::applyByteBudget(size_t budgetBytes) {
+    // Not mid-capture - the frame would be put down to the wrong settings
+    if (!initialized || budgetBytes == 0 || captureStatus == CaptureStatus::PENDING) {
+        return false;
+    }
+    byteBudget = budgetBytes;
     
-    if (DEBUG_CAMERA) {
-        Serial.println("Camera: Optimized for quality");
+    // Aim under the budget; the spare covers polls, ACKs and resends
+    size_t target = budgetBytes / 100 * CAMERA_BUDGET_TARGET_PERCENT;
+    JpegBudgetChoice choice = sizeModel.choose(target, sceneLuma(), CAMERA_BUDGET_MAX_FRAMESIZE,
+                                               CAMERA_BUDGET_BEST_QUALITY, CAMERA_BUDGET_WORST_QUALITY);
+    if (choice.frameSize == currentFrameSize && choice.quality == currentQuality) {
+        return true;
     }
     
-    return true;
+    bool applied = true;
+    if (choice.frameSize != currentFrameSize) {
+        applied = setFrameSize(choice.frameSize);
+    }
+    if (applied && choice.quality != currentQuality) {
+        applied = setQuality(choice.quality);
+    }
+    budgetSettling = true;
+    
+    CAMERA_TRACE("Budget %u bytes -> framesize %d quality %d, predicted %u bytes%s",
+                 (unsigned)budgetBytes, choice.frameSize, choice.quality,
+                 (unsigned)choice.predictedBytes, applied ? "" : " (sensor refused)");
+    return applied;
+}
+
+bool CameraManager::adaptiveBrightnessControl() {
+    if (!CAMERA_HISTOGRAM_AE || !autoExposure.update(currentSignature)) {
+        return false;
+    }
+    exposureChanges++;
+    
+    CAMERA_TRACE("Exposure %+.1f EV - %u lines, gain %u, brightness %d",
+                 autoExposure.getLastCorrection(), autoExposure.getExposure(), autoExposure.getGain(),
+                 autoExposure.getBrightness());
+    return applyExposure();
+}
+
+bool CameraManager::applyExposure() {
+    sensor_t* s = esp_camera_sensor_get();
+    if (!s) {
+        return false;
+    }
+    
+    bool applied = s->set_exposure_ctrl(s, 0) == 0 && s->set_aec_value(s, autoExposure.getExposure()) == 0 &&
+                   s->set_gain_ctrl(s, 0) == 0 && s->set_agc_gain(s, autoExposure.getGain()) == 0 &&
+                   s->set_brightness(s, autoExposure.getBrightness()) == 0;
+    settingsChanged();
+    if (applied) {
+        currentBrightness = autoExposure.getBrightness();
+    }
+    return applied;
+}
+
+bool CameraManager::optimizeForQuality() {
+    // Optimize for best quality within constraints - VGA at quality 10
+    bool applied = applyProfile(CameraProfileId::QUALITY);
+    
+    CAMERA_TRACE("Optimized for quality");
+    
+    return applied;
 }
 
 // ===========================
@@ -524,18 +1680,30 @@ bool CameraManager::optimizeForQuality() {
 // ===========================
 
 void CameraManager::freeCurrentImage() {
-    if (currentImage.buffer) {
-        free(currentImage.buffer);
-        currentImage.buffer = nullptr;
+    // The arena is kept for the next capture; only a held frame goes back
+    if (heldFrame) {
+        camera_fb_t* frame = heldFrame;
+        heldFrame = nullptr;
+        
+        // The thumbnail task still reads it - it returns the frame when done
+        portENTER_CRITICAL(&thumbnailLock);
+        if (thumbnailBusy && thumbnailSource.buffer == frame->buf) {
+            orphanedFrame = frame;
+            frame = nullptr;
+        }
+        portEXIT_CRITICAL(&thumbnailLock);
+        
+        if (frame) {
+            esp_camera_fb_return(frame);
+        }
     }
+    currentImage.buffer = nullptr;
     currentImage.valid = false;
 }
 
 void CameraManager::freeCurrentThumbnail() {
-    if (currentThumbnail.buffer) {
-        free(currentThumbnail.buffer);
-        currentThumbnail.buffer = nullptr;
-    }
+    // Points into thumbnailJpeg, which is reused
+    currentThumbnail.buffer = nullptr;
     currentThumbnail.valid = false;
 }
 
@@ -543,27 +1711,121 @@ void CameraManager::releaseImageBuffers() {
     freeCurrentImage();
     freeCurrentThumbnail();
     
+    // JPEG copies back to the frame pool for the stream
     if (imageBuffer) {
-        free(imageBuffer);
+        FramePools().release(FrameClass::JPEG, imageBuffer);
         imageBuffer = nullptr;
         imageBufferSize = 0;
     }
+    
+    // Left alone while a capture still owns it
+    if (captureStatus != CaptureStatus::PENDING) {
+        FramePools().release(FrameClass::JPEG, pendingBuffer);
+        pendingBuffer = nullptr;
+        pendingBufferSize = 0;
+    }
+    
+    // Tile buffers the same, while a tile is being encoded
+    if (!tileBusy) {
+        memFree(MemTag::CAMERA, tileSource);
+        memFree(MemTag::CAMERA, tilePixels);
+        memFree(MemTag::CAMERA, tileCrop);
+        memFree(MemTag::CAMERA, tileJpeg);
+        tileSource = nullptr;
+        tileSourceSize = 0;
+        tilePixels = nullptr;
+        tilePixelsSize = 0;
+        tilePixelsValid = false;
+        tileCrop = nullptr;
+        tileCropSize = 0;
+        tileJpeg = nullptr;
+        tileImageId = 0;
+        tileLength = 0;
+    }
+    
+    // Layer buffers likewise
+    if (!layerBusy) {
+        memFree(MemTag::CAMERA, layerSource);
+        memFree(MemTag::CAMERA, layerPixels);
+        memFree(MemTag::CAMERA, layerScaled);
+        memFree(MemTag::CAMERA, layerJpeg);
+        memFree(MemTag::CAMERA, layerWavelet);
+        layerSource = nullptr;
+        layerSourceSize = 0;
+        layerPixels = nullptr;
+        layerPixelsSize = 0;
+        layerScaled = nullptr;
+        layerScaledSize = 0;
+        layerJpeg = nullptr;
+        layerWavelet = nullptr;
+        layerWaveletSize = 0;
+        layerImageId = 0;
+        layerLength = 0;
+    }
+    
+    // Left alone if a thumbnail outlived end()'s wait
+    if (!thumbnailBusy) {
+        FramePools().release(FrameClass::PIXELS, thumbnailPixels);
+        memFree(MemTag::CAMERA, thumbnailJpeg);
+        thumbnailPixels = nullptr;
+        thumbnailPixelsSize = 0;
+        thumbnailJpeg = nullptr;
+    }
+    
+    // The thumbnail task's decode tables serve its layers too
+    if (!thumbnailBusy && !layerBusy) {
+        memFree(MemTag::CAMERA, thumbnailDecodeWorkspace);
+        thumbnailDecodeWorkspace = nullptr;
+        thumbnailDecodeWorkspaceSize = 0;
+    }
+    
+    memFree(MemTag::CAMERA, scenePixels);
+    scenePixels = nullptr;
+    scenePixelsSize = 0;
+    memFree(MemTag::CAMERA, sceneDecodeWorkspace);
+    sceneDecodeWorkspace = nullptr;
+    sceneDecodeWorkspaceSize = 0;
+    sceneWidth = 0;
+    sceneHeight = 0;
+    memFree(MemTag::CAMERA, previewScaled);
+    previewScaled = nullptr;
+    previewScaledSize = 0;
 }
 
 size_t CameraManager::getMemoryUsage() const {
     size_t usage = 0;
     
-    if (currentImage.buffer) {
-        usage += currentImage.length;
-    }
-    
-    if (currentThumbnail.buffer) {
-        usage += currentThumbnail.length;
+    // A held frame is the driver's memory, but pinned until it is freed
+    if (heldFrame) {
+        usage += heldFrame->len;
     }
     
     if (imageBuffer) {
         usage += imageBufferSize;
     }
+    if (pendingFrame) {
+        usage += pendingFrame->len;
+    }
+    usage += pendingBufferSize;
+    
+    // Thumbnail scratch; currentThumbnail lives in thumbnailJpeg
+    usage += thumbnailPixelsSize + thumbnailDecodeWorkspaceSize;
+    if (thumbnailJpeg) {
+        usage += CAMERA_THUMB_MAX_BYTES;
+    }
+    usage += scenePixelsSize + sceneDecodeWorkspaceSize + previewScaledSize;
+    
+    // Tile source, decode and output
+    usage += tileSourceSize + tilePixelsSize + tileCropSize;
+    if (tileJpeg) {
+        usage += CAMERA_TILE_HEADER_SIZE + CAMERA_TILE_MAX_BYTES;
+    }
+    
+    // Layer source, decode, scale and output
+    usage += layerSourceSize + layerPixelsSize + layerScaledSize + layerWaveletSize;
+    if (layerJpeg) {
+        usage += CAMERA_LAYER_HEADER_SIZE + CAMERA_LAYER_MAX_BYTES;
+    }
     
     return usage;
 }
@@ -632,6 +1894,42 @@ void CameraManager::printStatus() const {
     Serial.printf("Valid Thumbnail: %s\n", currentThumbnail.valid ? "Yes" : "No");
     Serial.printf("Capture Errors: %lu\n", captureErrorCount);
     Serial.printf("Init Errors: %lu\n", initErrorCount);
+    Serial.printf("Capture Buffer: %s\n", canHoldFrames() ? "Held frame buffer" : "Frame pool block");
+    Serial.printf("Capture Task: %s\n", !captureTask ? "Not started" :
+                 captureStatus == CaptureStatus::PENDING ? "Capturing" : "Idle");
+    Serial.printf("Standby: %s, %lu wakes, resume cold %lu ms / warm %lu ms\n", standby ? "Yes" : "No",
+                 standbyWakes, coldResumeTime, warmResumeTime);
+    Serial.printf("Lazy Start: %lu cold starts, %lu releases, driver %u bytes, freed last %u / peak %u bytes\n",
+                 coldStarts, releases, (unsigned)driverMemory, (unsigned)lastReleased, (unsigned)peakReleased);
+    Serial.printf("Thumbnails: %lu created, last %lu ms%s\n", thumbnailsCreated, thumbnailDuration,
+                 thumbnailBusy ? " (one in progress)" : "");
+    if (byteBudget > 0) {
+        Serial.printf("Byte Budget: %u bytes, model %lu captures, last error %+.0f%%\n",
+                     (unsigned)byteBudget, sizeModel.getSamples(), sizeModel.getLastError() * 100.0f);
+    }
+    if (tileImageId != 0) {
+        Serial.printf("Tiles: image %u held, %u tiles, %lu sent\n", tileImageId, getTileCount(), tilesSent);
+    }
+    if (layerImageId != 0) {
+        Serial.printf("Layers: image %u, %u of %u started\n", layerImageId, layerNext, layerCount);
+    }
+    Serial.printf("Layers Sent: %lu\n", layersSent);
+    if (CAMERA_HISTOGRAM_AE) {
+        Serial.printf("Exposure: %u lines, gain %u, brightness %d, %lu changes (last %+.1f EV)\n",
+                     autoExposure.getExposure(), autoExposure.getGain(), autoExposure.getBrightness(),
+                     exposureChanges, autoExposure.getLastCorrection());
+    }
+    if (CAMERA_REGISTER_PROFILES) {
+        profiles.printStatus();
+    }
+    FramePools().printStatus();
+    Serial.printf("Burst: %u frames, last kept sharpness %u of %u scored (worst %u)\n",
+                 burstFrames, currentSharpness, currentBurstScored, currentSharpnessWorst);
+    Serial.printf("Scene: novelty %u/%u, %lu frames kept on board\n",
+                 currentNovelty, CAMERA_NOVELTY_THRESHOLD, framesRetained);
+    if (currentScene.valid) {
+        Serial.printf("Classifier: %s, confidence %u%%\n", sceneLabelName(currentScene.label), currentScene.confidence);
+    }
     Serial.printf("Memory Usage: %d bytes\n", getMemoryUsage());
     Serial.printf("Last Capture: %lu ms ago\n", millis() - lastCaptureTime);
 }
@@ -2,12 +2,114 @@
 #define CAMERA_MANAGER_H
 
 #include <Arduino.h>
+#include <atomic>
 
 // Include esp_camera.h before any Adafruit sensor libraries to avoid sensor_t conflicts
 #include <esp_camera.h>
 
 #include "balloon_config.h"
 #include "camera_pins.h"
+#include "scene_change.h"
+#include "jpeg_budget.h"
+#include "auto_exposure.h"
+#include "scene_classifier.h"
+#include "power_scaling.h"
+#include "preview_frame.h"
+#include "camera_profile.h"
+
+// Thumbnails are decoded out of the captured JPEG at 1/2, 1/4 or 1/8 scale
+// and re-encoded on their own task, so the full image and its thumbnail are
+// the same exposure and the sensor is never reconfigured
+#define CAMERA_THUMB_MAX_WIDTH     160     // Decode scale is the smallest that gets the width to this
+#define CAMERA_THUMB_JPEG_QUALITY  60      // Encoder quality 1-100, higher is better (not the sensor scale)
+#define CAMERA_THUMB_MAX_BYTES     12288   // Reused output buffer; a larger thumbnail fails
+#define CAMERA_THUMB_TIMEOUT_MS    2000    // Longest a capture or end() waits for a running thumbnail
+
+// Captures run on their own task next to loop() - sensor exposure and JPEG
+// readout block it rather than the main loop. The task fills a pending slot
+// and pollCaptureResult() swaps it in as currentImage, so the image being
+// sent and the one being captured never share a buffer. Both tasks are
+// placed by task_placement.h
+#define CAMERA_CAPTURE_TIMEOUT_MS    5000  // Longest captureImage() or end() waits for the task
+
+// Standby - the sensor's own power-down (PWDN only for sensors without one),
+// with the driver, its frame buffers and the sensor registers left as they
+// are. Waking costs a few frames instead of a full esp_camera_init()
+#define CAMERA_STANDBY_SETTLE_FRAMES 2     // Dropped after a wake - one left over from before, one mid-wake
+
+// Lazy start - nothing of the driver exists until it is wanted: begin()
+// ahead of a scheduled capture, or requestCapture() itself if nobody did.
+// end() while the camera is disabled gives the driver's frame and DMA
+// buffers back along with the capture scratch; each end() records what it
+// released, measured as the heap esp_camera_init() took plus getMemoryUsage()
+#define CAMERA_PREWARM_LEAD_MS       1500  // begin() this far ahead of a capture until a cold start is measured
+#define CAMERA_PREWARM_MARGIN_MS     250   // On top of the measured cold start
+
+// Tiles - the last image handed to retainForTiles() can be sent as separately
+// encoded blocks that the ground asks for by index, so one region comes down
+// at full resolution without the rest of the frame. Tiles are CAMERA_TILE_SIZE
+// square, row-major, clipped at the right and bottom edges; the decode, crop
+// and encode run on the thumbnail task.
+//
+// CommandId::REQUEST_TILES parameters:
+//   [0-1]  image id (big endian, CameraData::imageId)
+//   [2-3]  first tile index (big endian)
+//   [4..]  optional bitmap of further tiles, bit (i & 7) of byte (i >> 3) = tile first + 1 + i
+// CAMERA_TILE payload (fragment content type):
+//   [0-1]  image id, [2-3] tile index (big endian)
+//   [4]    columns, [5] rows, [6] tile size / 8
+//   [7..]  baseline JPEG of the tile
+#define CAMERA_TILE_SIZE           64
+#define CAMERA_TILE_JPEG_QUALITY   50      // Encoder quality 1-100, higher is better
+#define CAMERA_TILE_MAX_BYTES      8192    // Reused output buffer; a larger tile fails
+#define CAMERA_TILE_HEADER_SIZE    7
+#define CAMERA_TILE_MAX_TILES      512     // 1600x1200 is 25 x 19
+
+// Progressive downlink - an image goes down as a run of standalone JPEG
+// layers from the same capture, each better than the one before, so a pass
+// that ends mid-image still leaves the ground the best layer it finished:
+//   0     grayscale preview, CAMERA_LAYER_PREVIEW_WIDTH wide - or with
+//         CAMERA_LAYER_PREVIEW_WAVELET, CAMERA_LAYER_WAVELET_WIDTH wide as a
+//         wavelet stream (wavelet_codec.h) cut at CAMERA_LAYER_WAVELET_BYTES;
+//         at a kilobyte it has no JPEG headers to pay for and blurs rather
+//         than blocks
+//   1     colour thumbnail, CAMERA_LAYER_THUMB_WIDTH wide (QQVGA for 4:3)
+//   2     half width, up to CAMERA_LAYER_MID_MAX_WIDTH, if wider than the thumbnail
+//   last  the captured JPEG itself
+// Layers narrower than the frame are decoded, box-scaled and encoded on the
+// thumbnail task, one at a time as the last one is sent. A new image takes
+// over from whatever layers of the previous one are still unsent.
+//
+// CAMERA_LAYER payload (fragment content type):
+//   [0-1]  image id (big endian, CameraData::imageId)
+//   [2]    layer, [3] layer count
+//   [4..]  baseline JPEG of the layer, or the preview's wavelet stream
+//          (first byte WAVELET_MAGIC where a JPEG has 0xFF)
+#define CAMERA_LAYER_PREVIEW_WIDTH   40
+#define CAMERA_LAYER_PREVIEW_QUALITY 30    // Encoder quality 1-100, higher is better
+#define CAMERA_LAYER_PREVIEW_WAVELET true
+#define CAMERA_LAYER_WAVELET_WIDTH   80    // Luma plane; at most WAVELET_MAX_DIMENSION either way
+#define CAMERA_LAYER_WAVELET_BYTES   1024  // Stream, its header included
+#define CAMERA_LAYER_THUMB_WIDTH     160   // Encoded at CAMERA_THUMB_JPEG_QUALITY
+#define CAMERA_LAYER_MID_MAX_WIDTH   400
+#define CAMERA_LAYER_MID_QUALITY     50
+#define CAMERA_LAYER_MAX_BYTES       32768 // Reused output buffer; a larger layer is skipped
+#define CAMERA_LAYER_HEADER_SIZE     4
+#define CAMERA_LAYER_MAX_LAYERS      4
+#define CAMERA_LAYER_BASE_LAYERS     2     // Preview and thumbnail go ahead of tiles; refinements after
+
+// Each capture is decoded at 1/2, 1/4 or 1/8 scale for its scene signature,
+// compared with the last image downlinked, its sharpness (scene_change.h) and
+// what it shows (scene_classifier.h). A burst keeps only the sharpest of its frames
+#define CAMERA_ANALYSIS_MAX_WIDTH  80      // Decode scale is the smallest that gets the width to this
+#define CAMERA_BURST_MAX_FRAMES    8
+
+// The kept frame's analysis luma also makes its preview frame (preview_frame.h):
+// box-scaled on the capture task, dithered and packed, ready for the main
+// loop to send ahead of anything else from the capture
+#define CAMERA_PREVIEW_FRAME       true
+#define CAMERA_PREVIEW_FRAME_WIDTH 40      // At most PREVIEW_MAX_WIDTH, and no wider than the analysis plane
+#define CAMERA_PREVIEW_FRAME_BITS  2       // 1, 2 or 4 bits per pixel
 
 // ===========================
 // Camera Data Structures
@@ -20,6 +122,7 @@ struct ImageData {
     uint16_t height;         // Image height
     uint8_t quality;         // JPEG quality (0-63)
     uint32_t timestamp;      // Capture timestamp
+    int64_t timeUs;          // Start of readout, Clock() time - the driver's frame stamp
     bool valid;             // Data validity flag
 };
 
@@ -33,6 +136,13 @@ struct ThumbnailData {
     bool valid;            // Validity flag
 };
 
+enum class CaptureStatus : uint8_t {
+    IDLE,       // Nothing requested
+    PENDING,    // Capture task still working
+    CAPTURED,   // currentImage is new - reported once
+    FAILED      // Reported once, counted in getCaptureErrorCount()
+};
+
 // ===========================
 // Camera Manager Class
 // ===========================
@@ -58,22 +168,196 @@ private:
     uint32_t captureStartTime;
     
     // Error tracking
+    uint32_t captureCount;          // Images accepted
     uint32_t captureErrorCount;
     uint32_t initErrorCount;
     
-    // Image buffer management
+    // Image buffer management - currentImage.buffer points into the held
+    // driver frame buffer, or into imageBuffer (a frame pool block kept
+    // across captures, frame_pool.h) when there are too few frame buffers
+    // to keep one back
+    camera_fb_t* heldFrame;
     uint8_t* imageBuffer;
     size_t imageBufferSize;
     
+    // Capture task - owns the pending slot while PENDING; a frame held by the
+    // slot moves to heldFrame on handoff, an arena swaps with imageBuffer
+    TaskHandle_t captureTask;
+    volatile CaptureStatus captureStatus;
+    ImageData pendingImage;
+    camera_fb_t* pendingFrame;
+    uint8_t* pendingBuffer;
+    size_t pendingBufferSize;
+    SceneSignature pendingSignature;
+    framesize_t pendingFrameSize;
+    
+    // SD recorder - between requests the task also takes its time-lapse
+    // frames (sd_recorder.h). end() clears recorderEnabled under the lock
+    // and waits out a grab in progress before the task goes
+    volatile bool recorderGrab;
+    bool recorderEnabled;
+    portMUX_TYPE recorderLock;
+    
+    // Standby and resume timing - both to the first usable frame
+    volatile bool standby;
+    uint32_t coldResumeTime;        // ms, begin(): esp_camera_init() and a first frame
+    uint32_t warmResumeTime;        // ms, last wake from standby
+    uint32_t standbyWakes;
+    
+    // Lazy start - heap the driver took at the last begin(), what end() gave back
+    size_t driverMemory;
+    size_t lastReleased;
+    size_t peakReleased;
+    uint32_t coldStarts;
+    uint32_t releases;
+    
+    // Awake: XCLK comes from LEDC on the APB clock. Capturing: the full clock
+    PowerLock sensorPowerLock;
+    PowerLock capturePowerLock;
+    
+    // Burst - frames per capture, and the scores of the last one
+    uint8_t burstFrames;
+    uint8_t pendingBurstScored;
+    uint16_t pendingSharpness;
+    uint16_t pendingSharpnessWorst;
+    uint8_t currentBurstScored;
+    uint16_t currentSharpness;
+    uint16_t currentSharpnessWorst;
+    
+    // Scene classifier - label of the kept frame of a burst
+    SceneClassification pendingScene;
+    SceneClassification currentScene;
+    
+    // Thumbnail task - works from a snapshot of currentImage; a held frame
+    // freed while it runs is handed over and returned by the task
+    TaskHandle_t thumbnailTask;
+    ImageData thumbnailSource;
+    camera_fb_t* orphanedFrame;
+    volatile bool thumbnailBusy;
+    portMUX_TYPE thumbnailLock;
+    uint8_t* thumbnailPixels;       // RGB565 decode scratch, reused
+    size_t thumbnailPixelsSize;
+    uint8_t* thumbnailDecodeWorkspace;  // jpeg_dc.h tables for the thumbnail task's 1/8 decodes
+    size_t thumbnailDecodeWorkspaceSize;
+    uint8_t* thumbnailJpeg;         // CAMERA_THUMB_MAX_BYTES, currentThumbnail points here
+    uint32_t thumbnailsCreated;
+    uint32_t thumbnailDuration;     // ms, last thumbnail
+    
+    // Tiles - tileSource is a copy of the retained JPEG, decoded into
+    // tilePixels on the first tile asked for. tileJpeg holds one encoded tile
+    // (header included) from the task until releaseTile()
+    uint16_t tileImageId;           // 0 = nothing retained
+    uint8_t* tileSource;
+    size_t tileSourceSize;
+    size_t tileSourceLength;
+    uint16_t tileSourceWidth;
+    uint16_t tileSourceHeight;
+    uint8_t* tilePixels;            // Full-frame RGB565
+    size_t tilePixelsSize;
+    bool tilePixelsValid;
+    uint8_t* tileCrop;
+    size_t tileCropSize;
+    uint8_t* tileJpeg;
+    uint8_t tileWanted[CAMERA_TILE_MAX_TILES / 8];
+    uint16_t tileIndex;
+    volatile bool tileBusy;
+    size_t tileLength;              // Encoded tile waiting to be sent, 0 = none
+    uint32_t tilesSent;
+    
+    // Progressive layers - layerSource is a copy of the image with header
+    // room in front, so the last layer goes out from it as it is. An encoded
+    // layer (header included) waits in layerJpeg from the task until releaseLayer()
+    uint16_t layerImageId;          // 0 = no layers left to send
+    uint8_t* layerSource;
+    size_t layerSourceSize;
+    size_t layerSourceLength;       // JPEG bytes after the header
+    uint16_t layerSourceWidth;
+    uint16_t layerSourceHeight;
+    uint16_t layerWidths[CAMERA_LAYER_MAX_LAYERS];  // Last one is the image's own width
+    uint8_t layerCount;
+    uint8_t layerNext;              // Next layer to start
+    uint8_t layerIndex;             // Layer being encoded or waiting to be sent
+    uint8_t* layerPixels;           // RGB565 decode, then luma for the preview
+    size_t layerPixelsSize;
+    uint8_t* layerScaled;
+    size_t layerScaledSize;
+    uint8_t* layerJpeg;
+    uint8_t* layerWavelet;          // Wavelet coder workspace, preview only
+    size_t layerWaveletSize;
+    volatile bool layerBusy;
+    size_t layerLength;             // Layer waiting to be sent, 0 = none
+    uint32_t layersSent;
+    
+    // Scene change - currentSignature against the last image downlinked
+    SceneSignature currentSignature;
+    SceneSignature downlinkSignature;
+    uint8_t currentNovelty;
+    uint32_t lastDownlinkTime;
+    uint32_t framesRetained;
+    uint8_t* scenePixels;           // 1/8-scale RGB565 decode followed by its luma plane, reused
+    size_t scenePixelsSize;
+    uint8_t* sceneDecodeWorkspace;  // jpeg_dc.h tables for the capture task's, apart from the thumbnail task's
+    size_t sceneDecodeWorkspaceSize;
+    uint16_t sceneWidth;            // Of the last frame analysed, 0 when it wasn't decoded
+    uint16_t sceneHeight;
+    
+    // Preview frame - made from the kept frame's luma, swapped in with it
+    PreviewFrame pendingPreview;
+    PreviewFrame currentPreview;
+    uint8_t* previewScaled;
+    size_t previewScaledSize;
+    
+    // Byte budget controller - the size model learns from every capture taken
+    // at settings it chose; the first capture after a change may still be a
+    // frame the driver grabbed at the old settings, so it isn't learned from
+    JpegSizeModel sizeModel;
+    size_t byteBudget;
+    bool budgetSettling;
+    
+    // Histogram auto exposure - the sensor's AEC/AGC stay off while it runs
+    AutoExposure autoExposure;
+    uint32_t exposureChanges;
+    uint16_t currentExposureLines;  // The current image's, 0 under the sensor's AEC
+    uint8_t currentGain;
+    
+    // Register profiles - snapshots taken at the first begin(), kept for the flight
+    CameraProfiles profiles;
+    
+    // Bumped on every sensor settings write from any task, so a cached copy
+    // of them (the web server's /status) knows to rebuild
+    std::atomic<uint32_t> settingsGeneration;
+    
     // Private methods
     bool initCamera();
     void configureCameraForBalloon();
+    void settingsChanged() { settingsGeneration.fetch_add(1, std::memory_order_release); }
     bool captureImageToBuffer();
+    void recordTimeLapseFrame();
+    static void captureTaskEntry(void* parameter);
+    void acceptPendingImage();
+    void releasePendingImage();
+    bool canHoldFrames() const;
+    bool setSensorStandby(bool enable);
+    bool wakeSensor();
+    void reportSensorPower(bool awake);     // Energy ledger and the APB lock
+    static void thumbnailTaskEntry(void* parameter);
+    bool startThumbnailTask();
+    bool encodeTile();
+    bool encodeLayer();
+    uint16_t getTileCount() const;
+    void finishThumbnail(const ThumbnailData& thumbnail, bool created);
     bool createThumbnail(const ImageData& source, ThumbnailData& thumbnail);
+    bool analyzeFrame(const ImageData& image, SceneSignature& signature, uint16_t& sharpness,
+                      SceneClassification& scene);
+    bool keepBurstFrame(camera_fb_t* fb, const ImageData& image);
+    bool makePreview(PreviewFrame& preview);
+    uint8_t sceneLuma() const { return currentSignature.valid ? currentSignature.meanLuma : 128; }  // Mid band unsigned
     bool resizeImage(const uint8_t* src, size_t srcLen, uint16_t srcW, uint16_t srcH,
-                     uint8_t* dst, size_t& dstLen, uint16_t dstW, uint16_t dstH);
+                     uint8_t* dst, size_t& dstLen, uint16_t dstW, uint16_t dstH,
+                     pixformat_t format = PIXFORMAT_RGB565);
     void updateCameraSettings(float altitude, float lightLevel);
     bool adaptiveBrightnessControl();
+    bool applyExposure();
     void releaseImageBuffers();
     
 public:
@@ -85,10 +369,56 @@ public:
     void end();
     bool reinitialize();
     
-    // Image capture
+    // Image capture - requestCapture() returns at once and pollCaptureResult()
+    // reports the outcome; captureImage() is the same pair, waited on. A
+    // request with the driver down starts it first, a cold start on the caller
+    bool requestCapture();
+    CaptureStatus pollCaptureResult();
+    bool isCapturePending() const { return captureStatus == CaptureStatus::PENDING; }
     bool captureImage();
-    bool captureThumbnail();
-    bool captureBoth();
+    
+    // Tiles - retain an image, queue the tiles a command asks for, and send
+    // each one getEncodedTile() hands out before calling releaseTile()
+    bool retainForTiles(uint16_t imageId);
+    bool requestTiles(const uint8_t* params, size_t length);
+    void processTiles();
+    bool getEncodedTile(const uint8_t*& data, size_t& length) const;
+    void releaseTile();
+    uint16_t getTileImageId() const { return tileImageId; }
+    uint32_t getTilesSent() const { return tilesSent; }
+    
+    // Progressive downlink - start an image's layers, then send each one
+    // getEncodedLayer() hands out before calling releaseLayer(). A metadata
+    // segment (image_metadata.h) goes into the last layer's JPEG after SOI
+    bool startLayers(uint16_t imageId, const uint8_t* metadata = nullptr, size_t metadataLength = 0);
+    void processLayers();
+    bool getEncodedLayer(const uint8_t*& data, size_t& length, uint8_t& layer) const;
+    void releaseLayer();
+    uint16_t getLayerImageId() const { return layerImageId; }
+    uint8_t getLayerCount() const { return layerCount; }
+    uint32_t getLayersSent() const { return layersSent; }
+    
+    // Burst - each capture grabs this many frames and keeps the sharpest
+    bool setBurstFrames(uint8_t frames);
+    uint8_t getBurstFrames() const { return burstFrames; }
+    uint8_t getBurstScored() const { return currentBurstScored; }        // Frames the current image beat, itself included
+    uint16_t getSharpness() const { return currentSharpness; }           // 0 when not analyzed
+    uint8_t getMeanLuma() const { return sceneLuma(); }                  // 128 when not analyzed
+    uint16_t getSharpnessWorst() const { return currentSharpnessWorst; } // Blurriest frame of the burst
+    bool captureThumbnail();    // Starts a thumbnail of the current image; valid once no longer pending
+    bool captureBoth();         // Image, then waits for its thumbnail
+    bool isThumbnailPending() const { return thumbnailBusy; }
+    bool waitForThumbnail(uint32_t timeoutMs = CAMERA_THUMB_TIMEOUT_MS);
+    
+    // Scene change - a frame too close to the last downlinked one stays on
+    // board; markDownlinked() makes the current frame the new reference
+    bool isNovelFrame() const;
+    const SceneClassification& getScene() const { return currentScene; }    // valid false when not classified
+    const PreviewFrame& getPreview() const { return currentPreview; }        // valid false when not made
+    uint8_t getNovelty() const { return currentNovelty; }
+    void markDownlinked();
+    void markRetained() { framesRetained++; }
+    uint32_t getFramesRetained() const { return framesRetained; }
     
     // Data access
     ImageData getCurrentImage() const { return currentImage; }
@@ -104,6 +434,7 @@ public:
     int getQuality() const { return currentQuality; }
     int getBrightness() const { return currentBrightness; }
     int getContrast() const { return currentContrast; }
+    uint32_t getSettingsGeneration() const { return settingsGeneration.load(std::memory_order_acquire); }
     
     // Status methods
     bool isReady() const { return initialized; }
@@ -116,12 +447,26 @@ public:
     bool isTimeToCapture(uint32_t intervalMs) const;
     
     // Error handling
+    uint32_t getCaptureCount() const { return captureCount; }
     uint32_t getCaptureErrorCount() const { return captureErrorCount; }
     uint32_t getInitErrorCount() const { return initErrorCount; }
+    uint32_t getThumbnailsCreated() const { return thumbnailsCreated; }
     void resetErrorCounts();
     
-    // Power management
+    // Power management - disabling puts the camera in standby rather than
+    // ending it; a capture wakes it again
     void enableCamera(bool enable);
+    bool enterStandby();
+    bool exitStandby();
+    bool isStandby() const { return standby; }
+    uint32_t getColdResumeTime() const { return coldResumeTime; }
+    uint32_t getWarmResumeTime() const { return warmResumeTime; }
+    uint32_t getPrewarmLeadMs() const { return coldResumeTime ? coldResumeTime + CAMERA_PREWARM_MARGIN_MS : CAMERA_PREWARM_LEAD_MS; }
+    uint32_t getColdStarts() const { return coldStarts; }
+    uint32_t getReleases() const { return releases; }
+    size_t getDriverMemory() const { return driverMemory; }         // 0 before the first begin()
+    size_t getLastReleased() const { return lastReleased; }
+    size_t getPeakReleased() const { return peakReleased; }         // Most one end() gave back
     void enterLowPowerMode();
     void exitLowPowerMode();
     
@@ -129,6 +474,14 @@ public:
     void updateForConditions(float altitude, float temperature, float batteryLevel);
     bool optimizeForBandwidth();
     bool optimizeForQuality();
+    bool applyProfile(CameraProfileId id);      // One batched register write; the settings follow the profile
+    const CameraProfiles& getProfiles() const { return profiles; }
+    bool applyByteBudget(size_t budgetBytes);   // Frame size and quality the size model says fit
+    size_t getByteBudget() const { return byteBudget; }
+    const JpegSizeModel& getSizeModel() const { return sizeModel; }
+    const AutoExposure& getAutoExposure() const { return autoExposure; }
+    uint16_t getExposureLines() const { return currentExposureLines; }  // Current image; 0 = sensor AEC
+    uint8_t getGain() const { return currentGain; }
     
     // Debug methods
     void printCameraInfo() const;
@@ -136,7 +489,8 @@ public:
     void printThumbnailInfo() const;
     void printStatus() const;
     
-    // Buffer management
+    // Buffer management - freeCurrentImage() hands a held frame back to the
+    // driver, so call it as soon as the image has been consumed
     void freeCurrentImage();
     void freeCurrentThumbnail();
     size_t getMemoryUsage() const;
@@ -0,0 +1,206 @@
+#include "camera_profile.h"
+#include "balloon_config.h"
+#include "debug_utils.h"
+
+// OV2640 registers (the driver's ov2640_regs.h, not exported by the library)
+#define OV2640_BANK_SEL        0xFF
+#define OV2640_BANK_DSP        0x00
+#define OV2640_BANK_SENSOR     0x01
+#define OV2640_SENSOR_REG      0x100    // set_reg()/get_reg() bank bit
+#define OV2640_R_BYPASS        0x05
+#define OV2640_R_BYPASS_DSP    0x00
+#define OV2640_R_BYPASS_NO_DSP 0x01
+#define OV2640_RESET           0xE0
+#define OV2640_RESET_DVP       0x04
+
+// Everything the profile setters move, in the order the driver's mode
+// tables write it: COM7 leads the sensor bank, since it picks the mode the
+// window registers after it belong to
+static const uint16_t profileRegisters[] = {
+    // Sensor bank - mode, window, clock, banding, gain ceiling
+    0x112, 0x103, 0x132, 0x117, 0x118, 0x119, 0x11A, 0x111,    // COM7, COM1, REG32, HSTART/HSTOP, VSTART/VSTOP, CLKRC
+    0x14F, 0x150, 0x15A, 0x16D, 0x13D, 0x139, 0x135, 0x122,    // BD50, BD60, then the mode tables' unnamed ones
+    0x137, 0x123, 0x134, 0x106, 0x107, 0x10D, 0x10E, 0x14C,    // ..., ARCOM2, ..., COM4, ...
+    0x114,                                                      // COM9
+    // DSP bank - input size, window, zoom, output clock, JPEG quality
+    0x0C0, 0x0C1, 0x08C, 0x051, 0x052, 0x053, 0x054, 0x055,    // HSIZE8, VSIZE8, SIZEL, HSIZE, VSIZE, XOFFL, YOFFL, VHYX
+    0x057, 0x05A, 0x05B, 0x05C, 0x086, 0x087, 0x050, 0x0D3,    // TEST, ZMOW, ZMOH, ZMHH, CTRL2, CTRL3, CTRLI, R_DVP_SP
+    0x044,                                                      // QS
+};
+
+#define PROFILE_REGISTER_COUNT (sizeof(profileRegisters) / sizeof(profileRegisters[0]))
+
+static_assert(PROFILE_REGISTER_COUNT <= CAMERA_PROFILE_MAX_REGISTERS, "CAMERA_PROFILE_MAX_REGISTERS too small");
+
+static const CameraProfileSpec profileSpecs[CAMERA_PROFILE_COUNT] = {
+    {"day", BALLOON_CAMERA_FRAMESIZE, BALLOON_CAMERA_QUALITY, BALLOON_CAMERA_BRIGHTNESS, BALLOON_CAMERA_CONTRAST,
+     GAINCEILING_2X},
+    {"night", BALLOON_CAMERA_FRAMESIZE, BALLOON_CAMERA_QUALITY + 4, BALLOON_CAMERA_BRIGHTNESS + 1, 0,
+     GAINCEILING_16X},
+    {"bandwidth", FRAMESIZE_QVGA, 25, BALLOON_CAMERA_BRIGHTNESS, BALLOON_CAMERA_CONTRAST, GAINCEILING_2X},
+    {"quality", FRAMESIZE_VGA, 10, BALLOON_CAMERA_BRIGHTNESS, BALLOON_CAMERA_CONTRAST, GAINCEILING_2X},
+};
+
+static void queueWrite(i2c_cmd_handle_t cmd, uint8_t address, uint8_t reg, uint8_t value) {
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, reg, true);
+    i2c_master_write_byte(cmd, value, true);
+    i2c_master_stop(cmd);
+}
+
+// ===========================
+// Camera Profiles
+// ===========================
+
+CameraProfiles::CameraProfiles() {
+    captured = false;
+    active = CAMERA_PROFILE_NONE;
+    registerCount = 0;
+    memset(registers, 0, sizeof(registers));
+    memset(stats, 0, sizeof(stats));
+}
+
+const char* CameraProfiles::profileName(CameraProfileId id) {
+    uint8_t index = static_cast<uint8_t>(id);
+    return index < CAMERA_PROFILE_COUNT ? profileSpecs[index].name : "unknown";
+}
+
+const CameraProfileSpec& CameraProfiles::getSpec(CameraProfileId id) const {
+    return profileSpecs[static_cast<uint8_t>(id)];
+}
+
+bool CameraProfiles::runSetters(sensor_t* s, const CameraProfileSpec& spec) {
+    bool ok = s->set_framesize(s, spec.frameSize) == 0 && s->set_quality(s, spec.quality) == 0 &&
+              s->set_gainceiling(s, spec.gainCeiling) == 0 && s->set_contrast(s, spec.contrast) == 0;
+    if (ok && !CAMERA_HISTOGRAM_AE) {
+        ok = s->set_brightness(s, spec.brightness) == 0;
+    }
+    return ok;
+}
+
+bool CameraProfiles::captureAll(sensor_t* s) {
+    captured = false;
+    active = CAMERA_PROFILE_NONE;
+    registerCount = s->id.PID == OV2640_PID ? PROFILE_REGISTER_COUNT : 0;
+
+    for (uint8_t p = 0; p < CAMERA_PROFILE_COUNT; p++) {
+        if (!runSetters(s, profileSpecs[p])) {
+            return false;
+        }
+        for (uint8_t i = 0; i < registerCount; i++) {
+            int value = s->get_reg(s, profileRegisters[i], 0xFF);
+            if (value < 0) {
+                return false;
+            }
+            registers[p][i] = {profileRegisters[i], (uint8_t)value};
+        }
+        active = p;
+    }
+
+    captured = true;
+    CAMERA_TRACE("%u profiles captured, %u registers each", CAMERA_PROFILE_COUNT, registerCount);
+    return true;
+}
+
+// One command list: the sensor bank's changes, then the DSP's between a
+// bypass and DVP reset and their release
+bool CameraProfiles::writeBatch(sensor_t* s, const CameraRegister* target, const CameraRegister* from,
+                                uint8_t& writes) {
+    writes = 0;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (!cmd) {
+        return false;
+    }
+
+    bool sensorBank = false;
+    bool dspBank = false;
+    for (uint8_t i = 0; i < registerCount; i++) {
+        if (from && from[i].value == target[i].value) {
+            continue;
+        }
+        bool sensor = (target[i].reg & OV2640_SENSOR_REG) != 0;
+        if (sensor && !sensorBank) {
+            queueWrite(cmd, s->slv_addr, OV2640_BANK_SEL, OV2640_BANK_SENSOR);
+            sensorBank = true;
+        } else if (!sensor && !dspBank) {
+            queueWrite(cmd, s->slv_addr, OV2640_BANK_SEL, OV2640_BANK_DSP);
+            queueWrite(cmd, s->slv_addr, OV2640_R_BYPASS, OV2640_R_BYPASS_NO_DSP);
+            queueWrite(cmd, s->slv_addr, OV2640_RESET, OV2640_RESET_DVP);
+            dspBank = true;
+        }
+        queueWrite(cmd, s->slv_addr, target[i].reg & 0xFF, target[i].value);
+        writes++;
+    }
+    if (dspBank) {
+        queueWrite(cmd, s->slv_addr, OV2640_RESET, 0x00);
+        queueWrite(cmd, s->slv_addr, OV2640_R_BYPASS, OV2640_R_BYPASS_DSP);
+    }
+
+    esp_err_t err = writes ? i2c_master_cmd_begin(CAMERA_SCCB_PORT, cmd, pdMS_TO_TICKS(CAMERA_SCCB_TIMEOUT_MS))
+                           : ESP_OK;
+    i2c_cmd_link_delete(cmd);
+    if (err != ESP_OK || !writes) {
+        return err == ESP_OK;
+    }
+
+    // The driver remembers the bank it last selected and skips selecting it
+    // again; set_reg() on BANK_SEL puts the sensor and that memory back in step
+    return s->set_reg(s, OV2640_BANK_SEL, 0xFF, OV2640_BANK_DSP) == 0;
+}
+
+void CameraProfiles::setStatus(sensor_t* s, const CameraProfileSpec& spec) {
+    s->status.framesize = spec.frameSize;
+    s->status.quality = spec.quality;
+    s->status.gainceiling = spec.gainCeiling;
+}
+
+bool CameraProfiles::apply(sensor_t* s, CameraProfileId id) {
+    uint8_t index = static_cast<uint8_t>(id);
+    if (!s || index >= CAMERA_PROFILE_COUNT) {
+        return false;
+    }
+    const CameraProfileSpec& spec = profileSpecs[index];
+    CameraProfileStats& stat = stats[index];
+
+    uint32_t start = micros();
+    bool ok;
+    uint8_t writes = 0;
+    if (captured && registerCount > 0) {
+        const CameraRegister* from = active != CAMERA_PROFILE_NONE ? registers[active] : nullptr;
+        ok = writeBatch(s, registers[index], from, writes);
+        if (ok) {
+            setStatus(s, spec);
+            if (s->status.contrast != spec.contrast) {
+                ok = s->set_contrast(s, spec.contrast) == 0;
+            }
+            if (ok && !CAMERA_HISTOGRAM_AE && s->status.brightness != spec.brightness) {
+                ok = s->set_brightness(s, spec.brightness) == 0;
+            }
+        }
+    } else {
+        ok = runSetters(s, spec);
+    }
+    uint32_t elapsed = micros() - start;
+
+    active = ok ? index : CAMERA_PROFILE_NONE;
+    stat.applies++;
+    stat.lastUs = elapsed;
+    stat.worstUs = max(stat.worstUs, elapsed);
+    stat.lastWrites = writes;
+
+    CAMERA_TRACE("Profile %s in %lu us, %u registers%s", spec.name, elapsed, writes,
+                 ok ? "" : " (write failed)");
+    return ok;
+}
+
+void CameraProfiles::printStatus() const {
+    Serial.printf("Profiles: %s, %u registers, active %s\n", captured ? "captured" : "not captured",
+                 registerCount, hasActive() ? profileName(getActive()) : "none");
+    for (uint8_t p = 0; p < CAMERA_PROFILE_COUNT; p++) {
+        if (stats[p].applies > 0) {
+            Serial.printf("  %-9s %lu applies, last %lu us (%u registers), worst %lu us\n", profileSpecs[p].name,
+                         stats[p].applies, stats[p].lastUs, stats[p].lastWrites, stats[p].worstUs);
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef CAMERA_PROFILE_H
+#define CAMERA_PROFILE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_camera.h>
+#include <driver/i2c.h>
+
+// ===========================
+// Camera Profiles
+// Named sensor settings captured once as register snapshots, so switching
+// between them is one pass of SCCB writes rather than a run of setters
+// ===========================
+
+// Each sensor_t setter is a read-modify-write over SCCB, some several, and
+// a frame size change on the OV2640 reloads a whole mode table. captureAll()
+// runs each profile's setters once, at the first begin(), and reads back
+// the registers they move: the sensor bank's mode, window and clock, the
+// DSP's image, zoom and output size, and the JPEG quality. apply() then
+// writes only the entries that differ from the profile last applied, as one
+// I2C command list on the driver's SCCB port - no reads, a bank select per
+// bank - the sensor bank first and the DSP window inside a DVP reset, the
+// way the driver's own mode change does. The driver's status is set to the
+// profile's frame size, quality and gain ceiling as its setters would.
+//
+// Exposure, gain and AEC/AGC control are left out - they belong to the
+// histogram controller (auto_exposure.h), which sets them every capture,
+// and so does brightness while it runs. Brightness and contrast on the
+// OV2640 go through the DSP's indirect SDE registers, which can't be read
+// back; they stay setter calls, made only when they differ.
+//
+// A setter used in between (the byte budget's frame size and quality) or a
+// cold start leaves the registers unknown: invalidate(), and the next
+// apply() writes every entry. The snapshots themselves outlive end().
+// Sensors other than the OV2640 have no register list, and apply() runs
+// the setters.
+//
+// apply() is timed per profile, last and worst.
+
+#define CAMERA_PROFILE_MAX_REGISTERS  48
+#define CAMERA_SCCB_PORT              I2C_NUM_1   // esp32-camera's CONFIG_SCCB_HARDWARE_I2C_PORT1 default
+#define CAMERA_SCCB_TIMEOUT_MS        50
+
+enum class CameraProfileId : uint8_t {
+    DAY = 0,            // The flight's default
+    NIGHT,              // Higher gain ceiling once the exposure runs out
+    BANDWIDTH,          // QVGA at a coarse quality
+    QUALITY,            // VGA at a fine one
+    COUNT
+};
+
+#define CAMERA_PROFILE_COUNT static_cast<uint8_t>(CameraProfileId::COUNT)
+
+struct CameraProfileSpec {
+    const char* name;
+    framesize_t frameSize;
+    int quality;
+    int brightness;
+    int contrast;
+    gainceiling_t gainCeiling;
+};
+
+struct CameraRegister {
+    uint16_t reg;               // 0x100 set: the OV2640 sensor bank, as set_reg() takes it
+    uint8_t value;
+};
+
+struct CameraProfileStats {
+    uint32_t applies;
+    uint32_t lastUs;
+    uint32_t worstUs;
+    uint8_t lastWrites;         // Registers written by the last apply
+};
+
+class CameraProfiles {
+public:
+    CameraProfiles();
+
+    // Every profile's setters and snapshot, leaving the sensor at the last
+    // one; false if the sensor refused one
+    bool captureAll(sensor_t* s);
+
+    // The profile's registers over the last one's; false if a write failed,
+    // which leaves the registers unknown
+    bool apply(sensor_t* s, CameraProfileId id);
+
+    void invalidate() { active = CAMERA_PROFILE_NONE; }
+    bool isCaptured() const { return captured; }
+    CameraProfileId getActive() const { return static_cast<CameraProfileId>(active); }
+    bool hasActive() const { return active != CAMERA_PROFILE_NONE; }
+    const CameraProfileSpec& getSpec(CameraProfileId id) const;
+    const CameraProfileStats& getStats(CameraProfileId id) const { return stats[static_cast<uint8_t>(id)]; }
+    uint8_t getRegisterCount() const { return registerCount; }
+    void printStatus() const;
+
+    static const char* profileName(CameraProfileId id);
+
+private:
+    static const uint8_t CAMERA_PROFILE_NONE = 0xFF;
+
+    bool captured;
+    uint8_t active;
+    uint8_t registerCount;      // Per profile, the same registers in the same order
+    CameraRegister registers[CAMERA_PROFILE_COUNT][CAMERA_PROFILE_MAX_REGISTERS];
+    CameraProfileStats stats[CAMERA_PROFILE_COUNT];
+
+    bool runSetters(sensor_t* s, const CameraProfileSpec& spec);
+    bool writeBatch(sensor_t* s, const CameraRegister* target, const CameraRegister* from, uint8_t& writes);
+    void setStatus(sensor_t* s, const CameraProfileSpec& spec);
+};
+
+#endif // CAMERA_PROFILE_H
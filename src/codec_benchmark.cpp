@@ -0,0 +1,196 @@
+#include "codec_benchmark.h"
+#include "packet_handler.h"
+#include "lora_comm.h"
+#include "text_codec.h"
+#include "wavelet_codec.h"
+#include <new>
+
+// ===========================
+// Helpers
+// ===========================
+
+template <typename Fn>
+static uint32_t measureCycles(Fn fn, int iterations) {
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    return ESP.getCycleCount() - start;
+}
+
+// One result row: packets/s from cycles per packet, ns/byte from cycles per byte
+static void printRate(const char* name, uint32_t cycles, int packets, size_t bytesPerPacket) {
+    float mhz = ESP.getCpuFreqMHz();
+    float cyclesPerPacket = (float)cycles / packets;
+    float nsPerByte = cyclesPerPacket / bytesPerPacket * 1000.0f / mhz;
+    Serial.printf("%-22s %10.0f %9.1f\n", name, mhz * 1000000.0f / cyclesPerPacket, nsPerByte);
+}
+
+static void fillTelemetry(TelemetryData& data, int step) {
+    memset(&data, 0, sizeof(data));
+    data.temperature = 12.5f - step * 0.03f;
+    data.pressure = 87000.0f - step * 5.5f;
+    data.humidity = 40.0f;
+    data.batteryVoltage = 3.9f - step * 0.0005f;
+    data.batteryCurrent = 0.12f;
+    data.batteryPercentage = 85;
+    data.uptime = 1000 + step * 1000;
+    data.rssi = -90;
+    data.freeHeap = 180;
+    data.cpuTemperature = 35.0f;
+}
+
+// Builds a PacketHandler frame straight out of the scratch handler's slab
+static size_t buildFrame(PacketHandler& handler, PacketType type, const uint8_t* payload, size_t length,
+                         uint8_t* out) {
+    PacketSlot slot = PACKET_SLOT_NONE;
+    size_t packetSize = 0;
+    if (!handler.createPacket(type, const_cast<uint8_t*>(payload), length) ||
+        !handler.getBufferedPacket(slot, packetSize)) {
+        return 0;
+    }
+    memcpy(out, handler.getSlotData(slot), packetSize);
+    handler.releaseSlot(slot);
+    return packetSize;
+}
+
+// ===========================
+// Benchmark
+// ===========================
+
+void codecBenchmark(int iterations) {
+    if (iterations <= 0) {
+        return;
+    }
+
+    PacketHandler* handler = new (std::nothrow) PacketHandler();
+    uint8_t* stream = (uint8_t*)malloc(CODEC_BENCH_STREAM_FRAMES * MAX_PACKET_SIZE);
+    if (!handler || !stream) {
+        delete handler;
+        free(stream);
+        return;
+    }
+
+    volatile uint32_t sink = 0;
+    uint8_t payload[TELEMETRY_KEYFRAME_SIZE];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = random(256);
+    }
+    size_t frameSize = PACKET_WIRE_HEADER_SIZE + sizeof(payload) + PACKET_WIRE_FOOTER_SIZE;
+
+    Serial.println("=== Codec Benchmark ===");
+    Serial.printf("%d iterations, CPU %lu MHz\n", iterations, ESP.getCpuFreqMHz());
+    Serial.println("codec                    packets/s   ns/byte");
+
+    // PacketHandler framing - assemble into a slot and give it back
+    uint32_t cycles = measureCycles([&]() {
+        PacketSlot slot = PACKET_SLOT_NONE;
+        size_t packetSize = 0;
+        handler->createPacket(PacketType::GPS_DATA, payload, sizeof(payload));
+        handler->getBufferedPacket(slot, packetSize);
+        handler->releaseSlot(slot);
+        sink = sink + packetSize;
+    }, iterations);
+    printRate("frame assemble", cycles, iterations, frameSize);
+
+    // Span parser over back-to-back frames, as they arrive from a UART or radio
+    size_t streamLength = 0;
+    for (int i = 0; i < CODEC_BENCH_STREAM_FRAMES; i++) {
+        streamLength += buildFrame(*handler, PacketType::GPS_DATA, payload, sizeof(payload), &stream[streamLength]);
+    }
+    uint32_t before = handler->getPacketsReceived();
+    cycles = measureCycles([&]() { handler->processIncomingData(stream, streamLength); }, iterations);
+    printRate("frame parse", cycles, iterations * CODEC_BENCH_STREAM_FRAMES, frameSize);
+    if (handler->getPacketsReceived() - before != (uint32_t)iterations * CODEC_BENCH_STREAM_FRAMES) {
+        Serial.println("frame parse: MISSED FRAMES");
+    }
+
+    // LoRa frame header + CRC
+    uint8_t frame[MAX_PACKET_SIZE];
+    size_t frameLength = 0;
+    Packet packet = createPacket(PacketType::TELEMETRY, payload, sizeof(payload));
+    serializePacket(packet, frame, frameLength);
+    cycles = measureCycles([&]() {
+        size_t length = 0;
+        serializePacket(packet, frame, length);
+        sink = sink + length;
+    }, iterations);
+    printRate("lora serialize", cycles, iterations, frameLength);
+
+    cycles = measureCycles([&]() {
+        Packet decoded;
+        sink = sink + (deserializePacket(frame, frameLength, decoded) && verifyFrameCRC(frame, frameLength));
+    }, iterations);
+    printRate("lora deserialize+crc", cycles, iterations, frameLength);
+
+    // Telemetry delta codec over a slow climb
+    TelemetryEncoder encoder;
+    TelemetryDecoder decoder;
+    TelemetryData sample;
+    uint8_t encoded[TELEMETRY_KEYFRAME_SIZE];
+    int step = 0;
+    cycles = measureCycles([&]() {
+        fillTelemetry(sample, step++);
+        sink = sink + encoder.encode(sample, encoded);
+    }, iterations);
+    printRate("telemetry encode", cycles, iterations, TELEMETRY_RAW_SIZE);
+
+    encoder.reset();
+    step = 0;
+    cycles = measureCycles([&]() {
+        fillTelemetry(sample, step++);
+        size_t length = encoder.encode(sample, encoded);
+        sink = sink + decoder.decode(encoded, length, sample);
+    }, iterations);
+    printRate("telemetry enc+dec", cycles, iterations, TELEMETRY_RAW_SIZE);
+
+    // Status text through the shared dictionary
+    const char* status = "Mode:Ascent Phase:Balloon Ascent Status:Nominal Loop:123456 MaxLoop:87";
+    size_t statusLength = strlen(status);
+    uint8_t compressed[PACKET_TEXT_MAX];
+    uint8_t inflated[PACKET_TEXT_MAX];
+    size_t compressedLength = 0;
+    cycles = measureCycles([&]() {
+        compressedLength = compressText((const uint8_t*)status, statusLength, compressed, sizeof(compressed));
+    }, iterations);
+    printRate("text compress", cycles, iterations, statusLength);
+
+    cycles = measureCycles([&]() {
+        sink = sink + decompressText(compressed, compressedLength, inflated, sizeof(inflated));
+    }, iterations);
+    printRate("text decompress", cycles, iterations, statusLength);
+
+    // Preview plane through the wavelet coder, cut at the layer budget -
+    // a frame per image, not per packet, so fewer rounds
+    const uint16_t planeWidth = 80;
+    const uint16_t planeHeight = 60;
+    size_t pixels = (size_t)planeWidth * planeHeight;
+    size_t workspaceSize = waveletWorkspaceSize(planeWidth, planeHeight);
+    uint8_t* plane = (uint8_t*)malloc(pixels * 2 + CODEC_BENCH_WAVELET_BYTES + workspaceSize);
+    if (plane) {
+        uint8_t* decodedPlane = &plane[pixels];
+        uint8_t* waveletStream = &decodedPlane[pixels];
+        uint8_t* workspace = &waveletStream[CODEC_BENCH_WAVELET_BYTES];
+        for (uint16_t y = 0; y < planeHeight; y++) {
+            for (uint16_t x = 0; x < planeWidth; x++) {
+                plane[y * planeWidth + x] = (uint8_t)(x * 2 + y + ((x / 8 + y / 8) & 1) * 40 + random(8));
+            }
+        }
+        int rounds = max(1, iterations / 50);
+        size_t streamLength = 0;
+        cycles = measureCycles([&]() {
+            streamLength = waveletEncode(plane, planeWidth, planeHeight, waveletStream, CODEC_BENCH_WAVELET_BYTES,
+                                         workspace);
+        }, rounds);
+        printRate("wavelet encode 80x60", cycles, rounds, pixels);
+
+        cycles = measureCycles([&]() {
+            sink = sink + waveletDecode(waveletStream, streamLength, decodedPlane, pixels, workspace);
+        }, rounds);
+        printRate("wavelet decode 80x60", cycles, rounds, pixels);
+        free(plane);
+    }
+
+    free(stream);
+    delete handler;
+}
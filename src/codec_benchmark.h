@@ -0,0 +1,23 @@
+#ifndef CODEC_BENCHMARK_H
+#define CODEC_BENCHMARK_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Codec Benchmark
+// Throughput of the frame and payload codecs, run on the board by the
+// benchmark firmware. The receive parsers are fuzzed on the host instead
+// (sim/fuzz/fuzz_parsers.cpp)
+// ===========================
+
+// Uses its own PacketHandler, so PacketMgr() queues and statistics are left alone
+#define CODEC_BENCH_STREAM_FRAMES  16      // Frames per processIncomingData() call in the parse test
+#define CODEC_BENCH_WAVELET_BYTES  1024    // Wavelet stream budget, as a preview layer's
+
+// Packets/s and ns/byte for PacketHandler assemble/parse, LoRa
+// serialize/deserialize, telemetry and text codecs, and the wavelet coder
+// (frames/s and ns/pixel)
+void codecBenchmark(int iterations = 500);
+
+#endif // CODEC_BENCHMARK_H
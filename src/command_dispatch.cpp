@@ -0,0 +1,367 @@
+#include "command_dispatch.h"
+#include "balloon_config.h"
+#include "camera_manager.h"
+#include "lora_comm.h"
+#include "power_manager.h"
+#include "debug_utils.h"
+#include "perf_probe.h"
+#include "firmware_update.h"
+#include "cadence_profile.h"
+#include "image_downlink.h"
+#include "balloon_ap.h"
+#include "runtime_config.h"
+
+static CommandDispatcher commandDispatcherInstance;
+
+CommandDispatcher& Commands() {
+    return commandDispatcherInstance;
+}
+
+// ===========================
+// Handlers
+// ===========================
+
+// The settings that are runtime config keys go into one draft, which the
+// dispatcher publishes after the command or the whole batch
+static RuntimeConfig configDraft;
+static bool configEdited = false;
+
+static bool setting(const char* what, int value, bool applied) {
+    if (applied) {
+        SYS_INFO("%s set to %d", what, value);
+    } else {
+        SYS_WARNING("%s %d refused", what, value);
+    }
+    return applied;
+}
+
+static bool configKey(const char* what, ConfigKey key, int32_t value) {
+    bool applied = Config().isReady() && ConfigStore::setKey(configDraft, static_cast<uint8_t>(key), value);
+    configEdited |= applied;
+    return setting(what, value, applied);
+}
+
+static bool requestTiles(CommandId, const uint8_t* params, size_t length) {
+    if (CAMERA_TILE_MODE && Camera().requestTiles(params, length)) {
+        SYS_LOG("Tiles requested from image %u", Camera().getTileImageId());
+        return true;
+    }
+    SYS_WARNING("Tile request refused - image %u is held", Camera().getTileImageId());
+    return false;
+}
+
+static bool imagesReceived(CommandId, const uint8_t* params, size_t length) {
+    if (length % 2 || !Downlink().isReady()) {
+        return false;
+    }
+    Downlink().onImagesReceived(params, length / 2);
+    SYS_LOG("Ground holds %u images, stored downlink re-ranked", (unsigned)(length / 2));
+    return true;
+}
+
+static bool probe(CommandId id, const uint8_t* params, size_t length) {
+    if (Probe().handleCommand(id, params, length)) {
+        SYS_INFO("Probe 0x%02X started", static_cast<uint8_t>(id));
+        return true;
+    }
+    SYS_WARNING("Probe 0x%02X refused - %s", static_cast<uint8_t>(id), Probe().isBusy() ? "busy" : "bad parameters");
+    return false;
+}
+
+static bool cameraFrameSize(CommandId, const uint8_t* params, size_t) {
+    return setting("Camera frame size", params[0],
+                   params[0] < FRAMESIZE_INVALID && Camera().setFrameSize(static_cast<framesize_t>(params[0])));
+}
+
+static bool cameraQuality(CommandId, const uint8_t* params, size_t) {
+    return setting("Camera quality", params[0], params[0] <= 63 && Camera().setQuality(params[0]));
+}
+
+static bool cameraBrightness(CommandId, const uint8_t* params, size_t) {
+    int8_t value = static_cast<int8_t>(params[0]);
+    return setting("Camera brightness", value, value >= -2 && value <= 2 && Camera().setBrightness(value));
+}
+
+static bool cameraContrast(CommandId, const uint8_t* params, size_t) {
+    int8_t value = static_cast<int8_t>(params[0]);
+    return setting("Camera contrast", value, value >= -2 && value <= 2 && Camera().setContrast(value));
+}
+
+static bool cameraBurst(CommandId, const uint8_t* params, size_t) {
+    return configKey("Camera burst", ConfigKey::BURST_FRAMES, params[0]);
+}
+
+static bool cameraProfile(CommandId, const uint8_t* params, size_t) {
+    return setting("Camera profile", params[0], params[0] < CAMERA_PROFILE_COUNT &&
+                   Camera().applyProfile(static_cast<CameraProfileId>(params[0])));
+}
+
+static bool loraTxPower(CommandId, const uint8_t* params, size_t) {
+    int8_t power = static_cast<int8_t>(params[0]);
+    return configKey("LoRa TX power", ConfigKey::TX_POWER, power);
+}
+
+static bool loraArqWindow(CommandId, const uint8_t* params, size_t) {
+    return configKey("LoRa ARQ window", ConfigKey::ARQ_WINDOW, params[0]);
+}
+
+static bool powerRail(CommandId, const uint8_t* params, size_t) {
+    // The uplink this came in on is on the LoRa rail
+    PowerRail rail = static_cast<PowerRail>(params[0]);
+    bool allowed = params[0] < POWER_RAIL_COUNT && (rail != PowerRail::LORA || params[1]);
+    return setting(params[1] ? "Power rail on" : "Power rail off", params[0],
+                   allowed && PowerMgr().setRail(rail, params[1] != 0));
+}
+
+static bool gpsFullRate(CommandId, const uint8_t* params, size_t) {
+    uint16_t seconds = (params[0] << 8) | params[1];
+    Cadence().boostGPS(seconds * 1000UL);
+    return setting("GPS full rate seconds", seconds, GPS_POWER_POLICY);
+}
+
+static bool wifiAp(CommandId, const uint8_t* params, size_t) {
+    uint16_t seconds = (params[0] << 8) | params[1];
+    AccessPoint().command(seconds);
+    return setting("WiFi AP seconds", seconds, BALLOON_AP_ENABLED);
+}
+
+static bool debugLevel(CommandId, const uint8_t* params, size_t) {
+    return configKey("Debug level", ConfigKey::DEBUG_LEVEL, params[0]);
+}
+
+static bool debugCategory(CommandId, const uint8_t* params, size_t) {
+    Debug.setCategoryEnabled(static_cast<DebugCategory>(params[0]), params[1] != 0);
+    return setting(params[1] ? "Debug category on" : "Debug category off", params[0], true);
+}
+
+static bool firmwareActivate(CommandId, const uint8_t* params, size_t length) {
+    if (Firmware().activate(params, length)) {
+        return true;
+    }
+    SYS_WARNING("Firmware activate refused - update %s", Firmware().stateToString(Firmware().getStatus().state));
+    return false;
+}
+
+static bool firmwareAbort(CommandId, const uint8_t*, size_t) {
+    Firmware().abort();
+    SYS_INFO("Firmware update aborted");
+    return true;
+}
+
+static bool configSet(CommandId, const uint8_t* params, size_t) {
+    int32_t value = static_cast<int32_t>(((uint32_t)params[1] << 24) | ((uint32_t)params[2] << 16) |
+                                         ((uint32_t)params[3] << 8) | params[4]);
+    const ConfigKeySpec* spec = ConfigStore::findKey(params[0]);
+    if (!spec) {
+        SYS_WARNING("Config key %u unknown", params[0]);
+        return false;
+    }
+    return configKey(spec->name, static_cast<ConfigKey>(params[0]), value);
+}
+
+static bool configDefaults(CommandId, const uint8_t*, size_t) {
+    if (!Config().isReady()) {
+        return false;
+    }
+    configDraft = Config().getDefaults();
+    configEdited = true;
+    SYS_INFO("Config back to the build's defaults");
+    return true;
+}
+
+// ===========================
+// Table
+// ===========================
+
+static constexpr CommandSpec commandTable[] = {
+    {CommandId::REQUEST_TILES, "request_tiles", 4, PACKET_COMMAND_MAX_PARAMS, requestTiles},
+    {CommandId::PROBE_PROFILE, "probe_profile", 0, 0, probe},
+    {CommandId::PROBE_SLOW_SCOPES, "probe_slow_scopes", 0, 1, probe},
+    {CommandId::PROBE_LOG_LEVEL, "probe_log_level", 1, 3, probe},
+    {CommandId::PROBE_TRACE, "probe_trace", 4, 4, probe},
+    {CommandId::IMAGES_RECEIVED, "images_received", 2, PACKET_COMMAND_MAX_PARAMS, imagesReceived},
+    {CommandId::CAMERA_FRAME_SIZE, "camera_frame_size", 1, 1, cameraFrameSize},
+    {CommandId::CAMERA_QUALITY, "camera_quality", 1, 1, cameraQuality},
+    {CommandId::CAMERA_BRIGHTNESS, "camera_brightness", 1, 1, cameraBrightness},
+    {CommandId::CAMERA_CONTRAST, "camera_contrast", 1, 1, cameraContrast},
+    {CommandId::CAMERA_BURST, "camera_burst", 1, 1, cameraBurst},
+    {CommandId::CAMERA_PROFILE, "camera_profile", 1, 1, cameraProfile},
+    {CommandId::RADIO_TX_POWER, "radio_tx_power", 1, 1, loraTxPower},
+    {CommandId::RADIO_ARQ_WINDOW, "radio_arq_window", 1, 1, loraArqWindow},
+    {CommandId::POWER_RAIL, "power_rail", 2, 2, powerRail},
+    {CommandId::GPS_FULL_RATE, "gps_full_rate", 2, 2, gpsFullRate},
+    {CommandId::WIFI_AP, "wifi_ap", 2, 2, wifiAp},
+    {CommandId::DEBUG_LEVEL, "debug_level", 1, 1, debugLevel},
+    {CommandId::DEBUG_CATEGORY, "debug_category", 2, 2, debugCategory},
+    {CommandId::FIRMWARE_ACTIVATE, "firmware_activate", FIRMWARE_ACTIVATE_PARAMS, FIRMWARE_ACTIVATE_PARAMS,
+     firmwareActivate},
+    {CommandId::FIRMWARE_ABORT, "firmware_abort", 0, 0, firmwareAbort},
+    {CommandId::CONFIG_SET, "config_set", 5, 5, configSet},
+    {CommandId::CONFIG_DEFAULTS, "config_defaults", 0, 0, configDefaults},
+};
+
+#define COMMAND_TABLE_SIZE (sizeof(commandTable) / sizeof(commandTable[0]))
+
+static constexpr bool commandTableOrdered() {
+    for (size_t i = 1; i < COMMAND_TABLE_SIZE; i++) {
+        if (static_cast<uint8_t>(commandTable[i - 1].id) >= static_cast<uint8_t>(commandTable[i].id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(commandTableOrdered(), "commandTable must list each CommandId once, in ascending order");
+static_assert(PACKET_COMMAND_BATCH_MAX <= 32, "runBatch keeps the config commands in a uint32_t");
+
+// ===========================
+// Constructor
+// ===========================
+
+CommandDispatcher::CommandDispatcher() {
+    haveLastBatch = false;
+    lastBatchId = 0;
+    memset(lastAck, 0, sizeof(lastAck));
+    lastAckLength = 0;
+    commandsRun = 0;
+    commandsFailed = 0;
+    batchesRun = 0;
+    batchesRepeated = 0;
+    acksFailed = 0;
+    configRefused = 0;
+}
+
+// ===========================
+// Dispatch
+// ===========================
+
+const CommandSpec* CommandDispatcher::find(uint8_t commandId) {
+    size_t low = 0;
+    size_t high = COMMAND_TABLE_SIZE;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        uint8_t id = static_cast<uint8_t>(commandTable[mid].id);
+        if (id == commandId) {
+            return &commandTable[mid];
+        }
+        if (id < commandId) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return nullptr;
+}
+
+bool CommandDispatcher::dispatch(uint8_t commandId, const uint8_t* params, size_t length) {
+    configDraft = Config().draft();
+    configEdited = false;
+    bool ran = run(commandId, params, length);
+    if (ran && configEdited && !Config().publish(configDraft)) {
+        ran = false;
+        configRefused++;
+        commandsRun--;
+        commandsFailed++;
+    }
+    return ran;
+}
+
+bool CommandDispatcher::run(uint8_t commandId, const uint8_t* params, size_t length) {
+    const CommandSpec* spec = find(commandId);
+    bool ran = false;
+    if (!spec) {
+        SYS_WARNING("Unknown command 0x%02X", commandId);
+    } else if (length < spec->minParams || length > spec->maxParams) {
+        SYS_WARNING("Command %s: %u parameter bytes, takes %u-%u", spec->name, (unsigned)length,
+                    spec->minParams, spec->maxParams);
+    } else {
+        ran = spec->handler(spec->id, params, length);
+    }
+
+    if (ran) {
+        commandsRun++;
+    } else {
+        commandsFailed++;
+    }
+    return ran;
+}
+
+bool CommandDispatcher::runBatch(const uint8_t* batch, size_t length) {
+    if (length < 1) {
+        return false;
+    }
+
+    uint8_t batchId = batch[0];
+    if (haveLastBatch && batchId == lastBatchId) {
+        // Ran already; the ground didn't hear the ACK
+        batchesRepeated++;
+        SYS_LOG("Command batch %u repeated - ACK resent", batchId);
+    } else {
+        uint8_t ack[COMMAND_ACK_MAX_BYTES];
+        memset(ack, 0, sizeof(ack));
+        ack[0] = batchId;
+
+        // One draft for the whole batch, published once at the end
+        configDraft = Config().draft();
+        uint32_t configCommands = 0;
+
+        uint8_t count = 0;
+        size_t pos = 1;
+        while (pos + 2 <= length && count < PACKET_COMMAND_BATCH_MAX) {
+            uint8_t commandId = batch[pos];
+            size_t paramLength = batch[pos + 1];
+            if (pos + 2 + paramLength > length) {
+                SYS_WARNING("Command batch %u cut short after %u commands", batchId, count);
+                break;
+            }
+            configEdited = false;
+            if (run(commandId, &batch[pos + 2], paramLength)) {
+                ack[COMMAND_ACK_HEADER_SIZE + (count >> 3)] |= 1 << (count & 7);
+                if (configEdited) {
+                    configCommands |= 1UL << count;
+                }
+            }
+            pos += 2 + paramLength;
+            count++;
+        }
+        ack[1] = count;
+
+        if (configCommands && !Config().publish(configDraft)) {
+            // None of the batch's settings took, so none of them is ACKed
+            uint32_t refusedCommands = 0;
+            for (uint8_t i = 0; i < count; i++) {
+                if (configCommands & (1UL << i)) {
+                    ack[COMMAND_ACK_HEADER_SIZE + (i >> 3)] &= ~(1 << (i & 7));
+                    refusedCommands++;
+                }
+            }
+            configRefused++;
+            commandsRun -= refusedCommands;
+            commandsFailed += refusedCommands;
+            SYS_WARNING("Command batch %u: config not published - %lu settings dropped", batchId,
+                        (unsigned long)refusedCommands);
+        }
+
+        memcpy(lastAck, ack, sizeof(ack));
+        lastAckLength = COMMAND_ACK_HEADER_SIZE + (count + 7) / 8;
+        lastBatchId = batchId;
+        haveLastBatch = true;
+        batchesRun++;
+        SYS_INFO("Command batch %u: %u commands", batchId, count);
+    }
+
+    if (!PacketMgr().createPacket(PacketType::COMMAND_ACK, lastAck, lastAckLength)) {
+        acksFailed++;
+        SYS_WARNING("Command batch %u ACK not queued", batchId);
+        return false;
+    }
+    return true;
+}
+
+void CommandDispatcher::printStatus() const {
+    Serial.println("=== Commands ===");
+    Serial.printf("Run: %lu, failed: %lu, batches: %lu (%lu repeated), ACKs not queued: %lu, "
+                  "config not published: %lu\n",
+                  (unsigned long)commandsRun, (unsigned long)commandsFailed, (unsigned long)batchesRun,
+                  (unsigned long)batchesRepeated, (unsigned long)acksFailed, (unsigned long)configRefused);
+}
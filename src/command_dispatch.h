@@ -0,0 +1,92 @@
+#ifndef COMMAND_DISPATCH_H
+#define COMMAND_DISPATCH_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "packet_handler.h"
+
+// ===========================
+// Command Dispatch
+// Every ground command in one table, run one to a COMMAND or several to a
+// COMMAND_BATCH
+// ===========================
+
+// The table is constexpr. It pairs each CommandId with its name, the
+// parameter lengths it takes and a handler that calls the owning manager:
+// the camera, the radio, power and debug setters, the tile request, the
+// probes and the firmware update's activate and abort. So a whole
+// reconfiguration goes up as one batch and comes back as one ACK.
+//
+// COMMAND_ACK payload, one per batch, once all of it has run:
+//   [0]    batch id
+//   [1]    commands in the batch
+//   [2..]  bitmap of the ones that ran, bit (i & 7) of byte (i >> 3)
+// A command the table doesn't have, with a parameter length outside its
+// range, or refused by its setter has its bit clear, and the rest still
+// run. A tuple running past the frame ends the batch there. A batch with
+// the last one's id is a resend after its ACK was lost: the ACK goes again
+// and nothing runs twice. A single COMMAND gets no COMMAND_ACK.
+//
+// The camera burst, TX power, ARQ window and debug level setters, and
+// CONFIG_SET and CONFIG_DEFAULTS, edit a draft of the runtime config
+// (runtime_config.h) rather than the managers. The draft is published once
+// the command, or the whole batch, has run, so a profile lands as one
+// version. A publish that is refused clears the ACK bits of the commands
+// that edited the draft.
+//
+// The radio's SF, bandwidth and frequency aren't here: both ends must
+// change them together, which is what RATE_CHANGE does.
+
+#define COMMAND_ACK_HEADER_SIZE  2
+#define COMMAND_ACK_MAX_BYTES    (COMMAND_ACK_HEADER_SIZE + PACKET_COMMAND_BATCH_MAX / 8)
+
+typedef bool (*CommandHandler)(CommandId id, const uint8_t* params, size_t length);
+
+struct CommandSpec {
+    CommandId id;
+    const char* name;
+    uint8_t minParams;
+    uint8_t maxParams;
+    CommandHandler handler;
+};
+
+class CommandDispatcher {
+public:
+    CommandDispatcher();
+
+    // One command; false when it is unknown, malformed or refused
+    bool dispatch(uint8_t commandId, const uint8_t* params, size_t length);
+
+    // A COMMAND_BATCH payload; false when its ACK couldn't be queued
+    bool runBatch(const uint8_t* batch, size_t length);
+
+    static const CommandSpec* find(uint8_t commandId);
+
+    uint32_t getCommandsRun() const { return commandsRun; }
+    uint32_t getCommandsFailed() const { return commandsFailed; }
+    uint32_t getBatchesRun() const { return batchesRun; }
+    void printStatus() const;
+
+private:
+    bool haveLastBatch;
+    uint8_t lastBatchId;
+    uint8_t lastAck[COMMAND_ACK_MAX_BYTES];
+    size_t lastAckLength;
+
+    uint32_t commandsRun;
+    uint32_t commandsFailed;
+    uint32_t batchesRun;
+    uint32_t batchesRepeated;
+    uint32_t acksFailed;
+    uint32_t configRefused;             // Publishes refused, per command or batch
+
+    bool run(uint8_t commandId, const uint8_t* params, size_t length);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern CommandDispatcher& Commands();
+
+#endif // COMMAND_DISPATCH_H
@@ -0,0 +1,113 @@
+#include "crash_report.h"
+#include "sdkconfig.h"
+#include "packet_handler.h"
+
+#if CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH && CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF
+#include "esp_core_dump.h"
+#define CRASH_REPORT_COREDUMP 1
+#else
+#define CRASH_REPORT_COREDUMP 0
+#endif
+
+CrashReporter::CrashReporter() {
+    crashBoot = false;
+    reported = false;
+    resetReason = ESP_RST_UNKNOWN;
+    memset(&summary, 0, sizeof(summary));
+}
+
+bool CrashReporter::begin() {
+    resetReason = esp_reset_reason();
+    ResetClass resetClass = classifyReset(resetReason);
+    crashBoot = resetClass == ResetClass::CRASH || resetClass == ResetClass::WATCHDOG;
+    memset(&summary, 0, sizeof(summary));
+
+    // A dump left from an earlier crash is stale by now, so it's read on a crash boot only
+    readCoreDump();
+    return summary.valid;
+}
+
+void CrashReporter::readCoreDump() {
+#if CRASH_REPORT_COREDUMP
+    if (esp_core_dump_image_check() != ESP_OK) {
+        return;
+    }
+
+    if (crashBoot) {
+        esp_core_dump_summary_t dump;
+        if (esp_core_dump_get_summary(&dump) == ESP_OK) {
+            strncpy(summary.task, dump.exc_task, sizeof(summary.task) - 1);
+            summary.pc = dump.exc_pc;
+            summary.cause = dump.ex_info.exc_cause;
+            summary.faultAddress = dump.ex_info.exc_vaddr;
+            summary.depth = dump.exc_bt_info.depth < CRASH_REPORT_BACKTRACE ? dump.exc_bt_info.depth
+                                                                           : CRASH_REPORT_BACKTRACE;
+            for (uint8_t i = 0; i < summary.depth; i++) {
+                summary.backtrace[i] = dump.exc_bt_info.bt[i];
+            }
+            summary.valid = true;
+        }
+    }
+    esp_core_dump_image_erase();
+#endif
+}
+
+size_t CrashReporter::formatMessage(char* message, size_t size) const {
+    const char* resetName = resetClassToString(classifyReset(resetReason));
+    uint8_t resumes = Retained().getResumeCount();
+    int length;
+    if (summary.valid) {
+        length = snprintf(message, size, "%s %s pc=%08lx c=%lu a=%08lx r=%u", resetName, summary.task,
+                          (unsigned long)summary.pc, (unsigned long)summary.cause,
+                          (unsigned long)summary.faultAddress, resumes);
+    } else {
+        length = snprintf(message, size, "%s reset %d, no dump, r=%u", resetName, (int)resetReason, resumes);
+    }
+    return length < 0 ? 0 : (size_t)length;
+}
+
+bool CrashReporter::sendReport() {
+    if (!crashBoot || reported) {
+        return false;
+    }
+
+    AlertData alert;
+    memset(&alert, 0, sizeof(alert));
+    alert.alertType = AlertType::SYSTEM_CRASH;
+    alert.timestamp = millis();
+    alert.severity = Retained().isResume() ? 2 : 3;     // A resumed flight is degraded, a full boot lost it
+    formatMessage(alert.message, sizeof(alert.message));
+    alert.sensorValue = Retained().getResumeCount();
+    alert.sensorId = static_cast<uint8_t>(resetReason);
+
+    uint8_t payload[AlertSchema::size];
+    AlertSchema::encode(alert, payload);
+    reported = PacketMgr().sendUrgentPacket(PacketType::ALERT, payload, AlertSchema::size);
+    return reported;
+}
+
+void CrashReporter::printStatus() const {
+    if (!crashBoot) {
+        Serial.printf("Crash report: none (reset reason %d)\n", (int)resetReason);
+        return;
+    }
+
+    char message[64];
+    formatMessage(message, sizeof(message));
+    Serial.printf("Crash report: %s%s\n", message, reported ? ", sent" : "");
+    if (summary.valid && summary.depth > 0) {
+        Serial.print("  Backtrace:");
+        for (uint8_t i = 0; i < summary.depth; i++) {
+            Serial.printf(" 0x%08lx", (unsigned long)summary.backtrace[i]);
+        }
+        Serial.println();
+    }
+}
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+static CrashReporter crashReportInstance;
+
+CrashReporter& CrashReport() { return crashReportInstance; }
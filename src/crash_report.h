@@ -0,0 +1,69 @@
+#ifndef CRASH_REPORT_H
+#define CRASH_REPORT_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "esp_system.h"
+#include "rtc_state.h"
+
+// ===========================
+// Crash Report
+// What the core dump partition says about the crash this boot came from,
+// sent to the ground as one SYSTEM_CRASH alert
+// ===========================
+
+// On a panic the IDF writes a core dump to the "coredump" partition before
+// the reset. begin() reads back its summary - the task, the faulting PC and
+// address, the exception cause and a short backtrace - then erases the dump
+// so the next crash has the partition to itself. The summary needs the
+// ELF core dump to flash in the SDK configuration; a build without it (and
+// a watchdog reset, which leaves no dump) still reports the reset reason.
+//
+// The alert's message is compact text for the ground station's log, its
+// sensorId the esp_reset_reason_t and its sensorValue the resume count. It
+// goes out on the emergency lane, ahead of anything the checkpoint kept.
+
+#define CRASH_REPORT_BACKTRACE  8           // Frames kept of the dump's backtrace
+#define CRASH_REPORT_TASK_NAME  16
+
+struct CrashSummary {
+    bool valid;                 // A core dump was on flash and checked
+    char task[CRASH_REPORT_TASK_NAME];
+    uint32_t pc;
+    uint32_t cause;             // EXCCAUSE
+    uint32_t faultAddress;      // EXCVADDR
+    uint32_t backtrace[CRASH_REPORT_BACKTRACE];
+    uint8_t depth;
+};
+
+class CrashReporter {
+public:
+    CrashReporter();
+
+    // After Retained().begin(); reads the dump on a crash or watchdog boot, true if there was one
+    bool begin();
+
+    bool isCrashBoot() const { return crashBoot; }
+    const CrashSummary& getSummary() const { return summary; }
+
+    // Once the packet handler is up; false if it wasn't a crash boot or the alert wasn't taken
+    bool sendReport();
+    void printStatus() const;
+
+private:
+    bool crashBoot;
+    bool reported;
+    esp_reset_reason_t resetReason;
+    CrashSummary summary;
+
+    void readCoreDump();
+    size_t formatMessage(char* message, size_t size) const;
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern CrashReporter& CrashReport();
+
+#endif // CRASH_REPORT_H
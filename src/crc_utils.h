@@ -0,0 +1,48 @@
+#ifndef CRC_UTILS_H
+#define CRC_UTILS_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// CRC Utilities
+// ESP32-S3 Balloon Project
+// ===========================
+
+// Table driven, one byte per step. Every function takes the running CRC so a
+// frame can be hashed span by span (header, type/sequence, payload) in place.
+
+#define CRC8_INIT           0x00     // PacketHandler header CRC (poly 0x07)
+#define CRC16_CCITT_INIT    0x0000   // PacketHandler payload CRC (poly 0x1021)
+#define CRC16_MODBUS_INIT   0xFFFF   // LoRa frame CRC (poly 0xA001 reflected)
+
+// The ROM crc16_be routine matches the CCITT variant only; MODBUS and the
+// 0x07 CRC-8 have no ROM equivalent and always use the tables.
+// crcBenchmark() reports whether the ROM result agrees before enabling this.
+#ifndef CRC_USE_ROM
+#define CRC_USE_ROM         0
+#endif
+
+uint8_t crc8Update(uint8_t crc, const uint8_t* data, size_t length);
+uint16_t crc16CcittUpdate(uint16_t crc, const uint8_t* data, size_t length);
+uint16_t crc16ModbusUpdate(uint16_t crc, const uint8_t* data, size_t length);
+
+// Copy src to dst and fold the bytes into the CRC in the same pass
+uint16_t crc16ModbusCopy(uint16_t crc, uint8_t* dst, const uint8_t* src, size_t length);
+
+inline uint8_t crc8(const uint8_t* data, size_t length) {
+    return crc8Update(CRC8_INIT, data, length);
+}
+
+inline uint16_t crc16Ccitt(const uint8_t* data, size_t length) {
+    return crc16CcittUpdate(CRC16_CCITT_INIT, data, length);
+}
+
+inline uint16_t crc16Modbus(const uint8_t* data, size_t length) {
+    return crc16ModbusUpdate(CRC16_MODBUS_INIT, data, length);
+}
+
+// Cycles per byte of the bitwise reference vs the table/ROM versions
+void crcBenchmark(size_t length = 1024, int iterations = 100);
+
+#endif // CRC_UTILS_H
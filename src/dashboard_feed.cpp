@@ -0,0 +1,138 @@
+#include "dashboard_feed.h"
+#include <ArduinoJson.h>
+#include <math.h>
+#include "packet_handler.h"
+#include "sensor_manager.h"
+#include "lora_comm.h"
+#include "system_state.h"
+
+// ===========================
+// Fields
+// ===========================
+
+struct DashboardFieldInfo {
+    const char* key;
+    float resolution;       // A change smaller than this isn't sent
+    bool integer;
+};
+
+// In DashboardField order
+static const DashboardFieldInfo dashboardFields[DASH_FIELD_COUNT] = {
+    {"temp",  0.1f,       false},   // C
+    {"pres",  10.0f,      true},    // Pa
+    {"bv",    0.01f,      false},   // V
+    {"bp",    1.0f,       true},    // %
+    {"heap",  1024.0f,    true},    // Bytes
+    {"cpu",   0.5f,       false},   // C
+    {"pwr",   1.0f,       true},
+    {"phase", 1.0f,       true},
+    {"lat",   0.00001f,   false},   // Degrees, about 1 m
+    {"lon",   0.00001f,   false},
+    {"alt",   1.0f,       false},   // m
+    {"sats",  1.0f,       true},
+    {"spd",   0.1f,       false},   // m/s
+    {"crs",   1.0f,       false},   // Degrees
+    {"hdop",  1.0f,       true},
+    {"rssi",  1.0f,       true},    // dBm
+    {"snr",   1.0f,       true},    // dB
+    {"per",   0.001f,     false},   // Fraction
+    {"tx",    1.0f,       true},
+    {"rx",    1.0f,       true},
+    {"drop",  1.0f,       true},
+    {"queue", 1.0f,       true},
+    {"air",   1000.0f,    true},    // us
+    {"cfg",   1.0f,       true}
+};
+
+// ===========================
+// Feed
+// ===========================
+
+DashboardFeed::DashboardFeed() {
+    memset(current, 0, sizeof(current));
+    memset(sent, 0, sizeof(sent));
+    haveSent = false;
+    sequence = 0;
+}
+
+void DashboardFeed::sample(uint32_t settingsVersion) {
+    const TelemetryData& telemetry = PacketMgr().getSentTelemetry();
+    current[DASH_TEMPERATURE] = telemetry.temperature;
+    current[DASH_PRESSURE] = telemetry.pressure;
+    current[DASH_BATTERY_VOLTAGE] = telemetry.batteryVoltage;
+    current[DASH_BATTERY_PERCENT] = telemetry.batteryPercentage;
+    current[DASH_FREE_HEAP] = telemetry.freeHeap;
+    current[DASH_CPU_TEMPERATURE] = telemetry.cpuTemperature;
+    current[DASH_POWER_STATE] = telemetry.powerState;
+    current[DASH_FLIGHT_PHASE] = static_cast<uint8_t>(SysState().getSnapshot().flightPhase);
+
+    GPSData gps = Sensors().getGPSData();
+    current[DASH_LATITUDE] = gps.latitude;
+    current[DASH_LONGITUDE] = gps.longitude;
+    current[DASH_ALTITUDE] = gps.altitude;
+    current[DASH_SATELLITES] = gps.satellites;
+    current[DASH_SPEED] = gps.speed;
+    current[DASH_COURSE] = gps.course;
+    current[DASH_HDOP] = gps.hdop;
+
+    current[DASH_RSSI] = LoRaComm().getLastRSSI();
+    current[DASH_SNR] = LoRaComm().getLastSNR();
+    current[DASH_PACKET_ERROR_RATE] = LoRaComm().getPacketErrorRate();
+    current[DASH_PACKETS_SENT] = PacketMgr().getPacketsSent();
+    current[DASH_PACKETS_RECEIVED] = PacketMgr().getPacketsReceived();
+    current[DASH_PACKETS_DROPPED] = PacketMgr().getPacketsDropped();
+    current[DASH_QUEUE_SIZE] = LoRaComm().getTotalQueueSize();
+    current[DASH_AIRTIME_USED] = LoRaComm().getAirtimeUsedUs();
+    current[DASH_SETTINGS_VERSION] = settingsVersion;
+}
+
+size_t DashboardFeed::encodeDelta(uint8_t* out, size_t size) {
+    bool changed[DASH_FIELD_COUNT];
+    bool any = false;
+    for (int i = 0; i < DASH_FIELD_COUNT; i++) {
+        changed[i] = !haveSent || fabsf(current[i] - sent[i]) >= dashboardFields[i].resolution;
+        any |= changed[i];
+    }
+    if (!any) {
+        return 0;
+    }
+
+    // Only what went out becomes the reference - small drifts add up until sent
+    size_t length = encode(out, size, current, false, changed);
+    if (length > 0) {
+        for (int i = 0; i < DASH_FIELD_COUNT; i++) {
+            if (changed[i]) {
+                sent[i] = current[i];
+            }
+        }
+        haveSent = true;
+        sequence++;
+    }
+    return length;
+}
+
+size_t DashboardFeed::encodeKeyframe(uint8_t* out, size_t size) const {
+    return encode(out, size, sent, true, nullptr);
+}
+
+size_t DashboardFeed::encode(uint8_t* out, size_t size, const float* values, bool keyframe,
+                             const bool* changed) const {
+    StaticJsonDocument<JSON_OBJECT_SIZE(DASH_FIELD_COUNT + 2)> doc;
+    doc["t"] = keyframe ? "k" : "d";
+    doc["n"] = keyframe ? sequence : sequence + 1;
+    for (int i = 0; i < DASH_FIELD_COUNT; i++) {
+        if (changed && !changed[i]) {
+            continue;
+        }
+        // Integers pack in 1-5 bytes rather than a float's 5
+        if (dashboardFields[i].integer) {
+            doc[dashboardFields[i].key] = (int32_t)lroundf(values[i]);
+        } else {
+            doc[dashboardFields[i].key] = values[i];
+        }
+    }
+    if (doc.overflowed() || measureMsgPack(doc) > size) {
+        return 0;
+    }
+    return serializeMsgPack(doc, out, size);
+}
@@ -0,0 +1,88 @@
+#ifndef DASHBOARD_FEED_H
+#define DASHBOARD_FEED_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Dashboard Feed
+// Telemetry, GPS and link statistics as delta-encoded MsgPack messages for
+// the web UI's WebSocket
+// ===========================
+
+// sample() takes a snapshot of every field; encodeDelta() writes the fields
+// that moved past their resolution since the last delta and makes the
+// snapshot the new reference. A client that joins gets encodeKeyframe() -
+// every field as of the last delta - and the deltas after it.
+//
+// Message: MsgPack map of short keys to numbers
+//   "t"  "k" keyframe / "d" delta
+//   "n"  message sequence, as of the last delta
+//   ...  changed fields (all fields in a keyframe)
+
+// Dashboard settings come from base_station_config.h when it is included
+// first; these fallbacks keep the module building in the balloon tree
+#ifndef DASHBOARD_UPDATE_RATE_MS
+#define DASHBOARD_UPDATE_RATE_MS   1000
+#endif
+#ifndef MAX_WEB_CLIENTS
+#define MAX_WEB_CLIENTS            4
+#endif
+
+#define DASHBOARD_MAX_MESSAGE      512
+
+enum DashboardField : uint8_t {
+    // Telemetry - the last frame sent down
+    DASH_TEMPERATURE = 0,
+    DASH_PRESSURE,
+    DASH_BATTERY_VOLTAGE,
+    DASH_BATTERY_PERCENT,
+    DASH_FREE_HEAP,
+    DASH_CPU_TEMPERATURE,
+    DASH_POWER_STATE,
+    DASH_FLIGHT_PHASE,
+    // GPS
+    DASH_LATITUDE,
+    DASH_LONGITUDE,
+    DASH_ALTITUDE,
+    DASH_SATELLITES,
+    DASH_SPEED,
+    DASH_COURSE,
+    DASH_HDOP,
+    // Link
+    DASH_RSSI,
+    DASH_SNR,
+    DASH_PACKET_ERROR_RATE,
+    DASH_PACKETS_SENT,
+    DASH_PACKETS_RECEIVED,
+    DASH_PACKETS_DROPPED,
+    DASH_QUEUE_SIZE,
+    DASH_AIRTIME_USED,
+    // Camera settings version - the /status ETag; a change means refetch it
+    DASH_SETTINGS_VERSION,
+    DASH_FIELD_COUNT
+};
+
+class DashboardFeed {
+public:
+    DashboardFeed();
+
+    // Snapshot from PacketMgr(), Sensors(), LoRaComm() and SysState()
+    void sample(uint32_t settingsVersion);
+
+    // Bytes written, 0 if nothing changed (delta) or the buffer is too small
+    size_t encodeDelta(uint8_t* out, size_t size);
+    size_t encodeKeyframe(uint8_t* out, size_t size) const;
+
+    uint32_t getSequence() const { return sequence; }
+
+private:
+    float current[DASH_FIELD_COUNT];
+    float sent[DASH_FIELD_COUNT];
+    bool haveSent;
+    uint32_t sequence;
+
+    size_t encode(uint8_t* out, size_t size, const float* values, bool keyframe, const bool* changed) const;
+};
+
+#endif // DASHBOARD_FEED_H
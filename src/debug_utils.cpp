@@ -1,32 +1,978 @@
-// Minimal stub implementation to get compilation working
-// TODO: Implement proper debug utilities later
-
 #include "debug_utils.h"
+#include <cctype>
+#include <esp_heap_caps.h>
+#include "memory_ledger.h"
+#include "task_placement.h"
+
+#define LOG_RECORD_HEADER   offsetof(LogRecord, args)
+
+static_assert((DEBUG_LOG_RING_BYTES & (DEBUG_LOG_RING_BYTES - 1)) == 0, "DEBUG_LOG_RING_BYTES must be a power of two");
+static_assert((DEBUG_LOG_FALLBACK_BYTES & (DEBUG_LOG_FALLBACK_BYTES - 1)) == 0, "DEBUG_LOG_FALLBACK_BYTES must be a power of two");
+static_assert(DEBUG_LOG_ARG_BYTES < 256, "LogRecord::argLength is a byte");
+static_assert(((LOG_RECORD_HEADER + DEBUG_LOG_ARG_BYTES + 3) & ~3) < 256, "LogRecord::size is a byte");
+
+// A record's bytes in the ring
+static inline uint32_t recordBytes(uint8_t argLength) {
+    return (LOG_RECORD_HEADER + argLength + 3) & ~(uint32_t)3;
+}
+
+// ===========================
+// Format Conversions
+// ===========================
+
+// What a conversion reads off the va_list, and how it's kept in a record
+enum class LogArg : uint8_t {
+    NONE = 0,           // End of the format, or a conversion this can't carry
+    INT,
+    LONG,
+    LONG_LONG,
+    SIZE,               // z and t
+    POINTER,
+    DOUBLE,
+    LONG_DOUBLE,        // Kept as a double, printed through the L it was written with
+    STRING
+};
+
+struct LogConversion {
+    const char* start;  // The '%'
+    const char* end;    // Past the conversion character
+    LogArg arg;
+    uint8_t stars;      // '*' width and precision, an int each ahead of the value
+};
+
+// The next conversion after format, %% skipped; arg NONE at the end
+static void nextConversion(const char* format, LogConversion& conversion) {
+    conversion.arg = LogArg::NONE;
+    for (const char* p = strchr(format, '%'); p; p = strchr(p, '%')) {
+        conversion.start = p++;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        conversion.stars = 0;
+        while (*p && strchr("-+ #0", *p)) {
+            p++;
+        }
+        if (*p == '*') {
+            conversion.stars++;
+            p++;
+        }
+        while (isdigit((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                conversion.stars++;
+                p++;
+            }
+            while (isdigit((unsigned char)*p)) {
+                p++;
+            }
+        }
+
+        uint8_t longs = 0;
+        bool size = false;
+        bool longDouble = false;
+        for (; *p && strchr("hlLqjzt", *p); p++) {
+            if (*p == 'l') {
+                longs++;
+            } else if (*p == 'q' || *p == 'j') {
+                longs = 2;
+            } else if (*p == 'z' || *p == 't') {
+                size = true;
+            } else if (*p == 'L') {
+                longDouble = true;
+            }
+        }
+
+        switch (*p) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                conversion.arg = longs >= 2 ? LogArg::LONG_LONG : longs ? LogArg::LONG :
+                                 size ? LogArg::SIZE : LogArg::INT;
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                conversion.arg = longDouble ? LogArg::LONG_DOUBLE : LogArg::DOUBLE;
+                break;
+            case 'p':
+                conversion.arg = LogArg::POINTER;
+                break;
+            case 's':
+                conversion.arg = LogArg::STRING;
+                break;
+            default:
+                return;     // %n, or a format cut short
+        }
+        conversion.end = p + 1;
+        return;
+    }
+}
+
+static size_t argSize(LogArg arg) {
+    switch (arg) {
+        case LogArg::INT: return sizeof(int);
+        case LogArg::LONG: return sizeof(long);
+        case LogArg::LONG_LONG: return sizeof(long long);
+        case LogArg::SIZE: return sizeof(size_t);
+        case LogArg::POINTER: return sizeof(void*);
+        case LogArg::DOUBLE:
+        case LogArg::LONG_DOUBLE: return sizeof(double);
+        default: return 0;
+    }
+}
+
+// snprintf() of one conversion with its star arguments ahead of the value
+template <typename T>
+static int formatConversion(char* out, size_t size, const char* spec, uint8_t stars, const int* starValues, T value) {
+    switch (stars) {
+        case 0: return snprintf(out, size, spec, value);
+        case 1: return snprintf(out, size, spec, starValues[0], value);
+        default: return snprintf(out, size, spec, starValues[0], starValues[1], value);
+    }
+}
+
+// ===========================
+// Static Instance
+// ===========================
 
-// Static instance
 static DebugUtils debugUtilsInstance;
 
 // Global instance reference
 DebugUtils& Debug = debugUtilsInstance;
 
-// Minimal implementations
-DebugUtils::DebugUtils() {}
-DebugUtils::~DebugUtils() {}
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+DebugUtils::DebugUtils() {
+    currentDebugLevel = DEFAULT_DEBUG_LEVEL;
+    debugEnabled = DEBUG_GLOBAL;
+    serialEnabled = true;
+    fileLoggingEnabled = false;
+    memset(enabledCategories, 0xFF, sizeof(enabledCategories));
+
+    logRing = nullptr;
+    logRingSize = 0;
+    logRingInPsram = false;
+    logOldest = 0;
+    logHead = 0;
+    drainTail = 0;
+    oldestSequence = 0;
+    headSequence = 0;
+    drainSequence = 0;
+    portMUX_INITIALIZE(&logLock);
+    drainTask = nullptr;
+    sink = nullptr;
+
+    loopStartTime = 0;
+    performanceMonitorActive = false;
+    lastStatisticsReset = 0;
+
+    watchdogEnabled = false;
+    watchdogTimeout = DEFAULT_WATCHDOG_TIMEOUT;
+    lastWatchdogFeed = 0;
+
+    debugModeActive = false;
+    debugModeStartTime = 0;
+    timerCount = 0;
+    memset(timers, 0, sizeof(timers));
+    codeTimers = nullptr;
+    portMUX_INITIALIZE(&timerLock);
+
+    initializePerformanceMetrics();
+    initializeStatistics();
+}
+
+DebugUtils::~DebugUtils() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool DebugUtils::begin() {
+    if (!logRing) {
+        uint32_t size = DEBUG_LOG_RING_BYTES;
+        uint8_t* ring = (uint8_t*)memAllocCaps(MemTag::LOGGING, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        bool inPsram = ring != nullptr;
+        if (!ring) {
+            size = DEBUG_LOG_FALLBACK_BYTES;
+            ring = (uint8_t*)memAllocCaps(MemTag::LOGGING, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (!ring) {
+            Serial.println("Debug: No memory for the log ring - records are dropped");
+        } else {
+            portENTER_CRITICAL(&logLock);
+            logRing = ring;
+            logRingSize = size;
+            logRingInPsram = inPsram;
+            portEXIT_CRITICAL(&logLock);
+            Serial.printf("Debug: %lu KB log ring in %s, %u bytes of internal RAM\n",
+                          (unsigned long)(size / 1024), inPsram ? "PSRAM" : "internal RAM",
+                          (unsigned)sizeof(DebugUtils));
+        }
+    }
+
+    // Records are kept from the first call on; the task only prints them
+    if (!drainTask && createPlacedTask(TaskId::LOG_DRAIN, drainTaskEntry, this, &drainTask) != pdPASS) {
+        drainTask = nullptr;
+        Serial.println("Debug: No drain task - log records are kept but not printed");
+    }
+    return true;
+}
+
+void DebugUtils::end() {
+    if (drainTask) {
+        vTaskDelete(drainTask);
+        drainTask = nullptr;
+    }
+    portENTER_CRITICAL(&logLock);
+    uint8_t* ring = logRing;
+    logRing = nullptr;
+    logRingSize = 0;
+    logRingInPsram = false;
+    logOldest = logHead = drainTail = 0;
+    oldestSequence = headSequence = drainSequence = 0;
+    portEXIT_CRITICAL(&logLock);
+    memFree(MemTag::LOGGING, ring);
+}
+
+void DebugUtils::initializePerformanceMetrics() {
+    memset(&performanceMetrics, 0, sizeof(performanceMetrics));
+    performanceMetrics.loopTimeMin = UINT32_MAX;
+}
+
+void DebugUtils::initializeStatistics() {
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+// ===========================
+// Configuration
+// ===========================
+
+void DebugUtils::setDebugLevel(DebugLevel level) {
+    currentDebugLevel = level;
+}
+
+void DebugUtils::setCategoryEnabled(DebugCategory category, bool enabled) {
+    setCategoryBit(category, enabled);
+}
+
+bool DebugUtils::isCategoryEnabled(DebugCategory category) const {
+    return isCategoryBitSet(category);
+}
+
+bool DebugUtils::isCategoryBitSet(DebugCategory category) const {
+    uint8_t bit = static_cast<uint8_t>(category);
+    if (category == DebugCategory::ALL || bit >= sizeof(enabledCategories) * 8) {
+        return true;
+    }
+    return enabledCategories[bit >> 3] & (1 << (bit & 7));
+}
+
+void DebugUtils::setCategoryBit(DebugCategory category, bool enabled) {
+    uint8_t bit = static_cast<uint8_t>(category);
+    if (category == DebugCategory::ALL) {
+        memset(enabledCategories, enabled ? 0xFF : 0x00, sizeof(enabledCategories));
+    } else if (bit < sizeof(enabledCategories) * 8) {
+        if (enabled) {
+            enabledCategories[bit >> 3] |= 1 << (bit & 7);
+        } else {
+            enabledCategories[bit >> 3] &= ~(1 << (bit & 7));
+        }
+    }
+}
+
+// ===========================
+// Logging Functions
+// ===========================
+
+bool DebugUtils::isLogged(DebugLevel level, DebugCategory category) const {
+    return debugEnabled && level != DebugLevel::NONE &&
+           static_cast<uint8_t>(level) <= static_cast<uint8_t>(currentDebugLevel) && isCategoryBitSet(category);
+}
+
+void DebugUtils::logError(DebugCategory category, const char* function, int line, const char* format, ...) {
+    if (!isLogged(DebugLevel::ERROR, category)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    writeToLogBuffer(DebugLevel::ERROR, category, function, line, format, args);
+    va_end(args);
+}
+
+void DebugUtils::logWarning(DebugCategory category, const char* function, int line, const char* format, ...) {
+    if (!isLogged(DebugLevel::WARNING, category)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    writeToLogBuffer(DebugLevel::WARNING, category, function, line, format, args);
+    va_end(args);
+}
+
+void DebugUtils::logInfo(DebugCategory category, const char* function, int line, const char* format, ...) {
+    if (!isLogged(DebugLevel::INFO, category)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    writeToLogBuffer(DebugLevel::INFO, category, function, line, format, args);
+    va_end(args);
+}
+
+void DebugUtils::logDebug(DebugCategory category, const char* function, int line, const char* format, ...) {
+    if (!isLogged(DebugLevel::DEBUG, category)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    writeToLogBuffer(DebugLevel::DEBUG, category, function, line, format, args);
+    va_end(args);
+}
+
+void DebugUtils::logVerbose(DebugCategory category, const char* function, int line, const char* format, ...) {
+    if (!isLogged(DebugLevel::VERBOSE, category)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    writeToLogBuffer(DebugLevel::VERBOSE, category, function, line, format, args);
+    va_end(args);
+}
+
+// A DEBUG_* build switch is the level here - only the category and the
+// master switch still apply at run time
+void DebugUtils::logTrace(DebugCategory category, const char* function, int line, const char* format, ...) {
+    if (!debugEnabled || !isCategoryBitSet(category)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    writeToLogBuffer(DebugLevel::DEBUG, category, function, line, format, args);
+    va_end(args);
+}
+
+// Filtered first, so a message nobody would see neither logs nor counts
+bool DebugUtils::logLimited(LogLimiter& limiter, DebugLevel level, DebugCategory category, const char* function,
+                            int line, const char* format, ...) {
+    if (!isLogged(level, category)) {
+        return false;
+    }
+
+    uint32_t now = millis();
+    if (limiter.logged && now - limiter.lastLogged < limiter.intervalMs) {
+        limiter.suppressed++;
+        portENTER_CRITICAL(&logLock);
+        statistics.suppressedEntries++;
+        portEXIT_CRITICAL(&logLock);
+        return false;
+    }
+    if (limiter.suppressed) {
+        writeRecord(level, category, function, line, "%lu more suppressed in %lu s",
+                    (unsigned long)limiter.suppressed, (unsigned long)((now - limiter.lastLogged) / 1000));
+        limiter.suppressed = 0;
+    }
+    limiter.logged = true;
+    limiter.lastLogged = now;
+
+    va_list args;
+    va_start(args, format);
+    writeToLogBuffer(level, category, function, line, format, args);
+    va_end(args);
+    return true;
+}
+
+// The message is copied in as a %s argument, DEBUG_LOG_MAX_STRING of it
+void DebugUtils::logRaw(DebugLevel level, DebugCategory category, const char* function, int line, const char* message) {
+    if (isLogged(level, category)) {
+        writeRecord(level, category, function, line, "%s", message);
+    }
+}
 
-bool DebugUtils::begin() { return true; }
-void DebugUtils::end() {}
+void DebugUtils::writeRecord(DebugLevel level, DebugCategory category, const char* function, int line,
+                             const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    writeToLogBuffer(level, category, function, line, format, args);
+    va_end(args);
+}
 
-void DebugUtils::logInfo(DebugCategory, const char*, int, const char*, ...) {}
-void DebugUtils::logWarning(DebugCategory, const char*, int, const char*, ...) {}
-void DebugUtils::logError(DebugCategory, const char*, int, const char*, ...) {}
-void DebugUtils::logDebug(DebugCategory, const char*, int, const char*, ...) {}
+// The caller's whole cost: the arguments copied out, then their bytes under the lock
+void DebugUtils::writeToLogBuffer(DebugLevel level, DebugCategory category, const char* function, int line,
+                                  const char* format, va_list args) {
+    LogRecord record;
+    bool truncated = false;
+    record.timestamp = micros();
+    record.format = format;
+    record.function = function;
+    record.lineNumber = (uint16_t)line;
+    record.level = level;
+    record.category = category;
+    record.argLength = packArguments(format, args, record.args, truncated);
+    record.flags = truncated ? LOG_RECORD_TRUNCATED : 0;
+    uint32_t size = recordBytes(record.argLength);
+    record.size = (uint8_t)size;
 
-void DebugUtils::updateLoopTime(unsigned long) {}
+    portENTER_CRITICAL(&logLock);
+    if (!logRing) {
+        statistics.droppedEntries++;
+        portEXIT_CRITICAL(&logLock);
+        return;
+    }
+    uint32_t mask = logRingSize - 1;
+    uint32_t offset = logHead & mask;
+    uint32_t pad = offset + size > logRingSize ? logRingSize - offset : 0;
+
+    // Room for the pad and the record, oldest records out first
+    while (logHead + pad + size - logOldest > logRingSize) {
+        uint32_t oldest = logOldest & mask;
+        uint8_t oldSize = logRing[oldest];
+        if (oldSize) {
+            logOldest += oldSize;
+            oldestSequence++;
+        } else {
+            logOldest += logRingSize - oldest;
+        }
+    }
+    if (pad) {
+        logRing[offset] = 0;
+        logHead += pad;
+        offset = 0;
+    }
+    memcpy(logRing + offset, &record, LOG_RECORD_HEADER + record.argLength);
+    logHead += size;
+    headSequence++;
+    statistics.totalLogEntries++;
+    switch (level) {
+        case DebugLevel::ERROR: statistics.errorCount++; break;
+        case DebugLevel::WARNING: statistics.warningCount++; break;
+        case DebugLevel::INFO: statistics.infoCount++; break;
+        case DebugLevel::DEBUG: statistics.debugCount++; break;
+        default: statistics.verboseCount++; break;
+    }
+    if (truncated) {
+        statistics.bufferOverflows++;
+    }
+    portEXIT_CRITICAL(&logLock);
+
+    // Trouble goes out now rather than at the next drain period
+    if (level <= DebugLevel::WARNING && drainTask) {
+        xTaskNotifyGive(drainTask);
+    }
+}
+
+uint8_t DebugUtils::packArguments(const char* format, va_list args, uint8_t* out, bool& truncated) {
+    size_t length = 0;
+    LogConversion conversion;
+
+    for (nextConversion(format, conversion); conversion.arg != LogArg::NONE; nextConversion(conversion.end, conversion)) {
+        size_t needed = conversion.stars * sizeof(int) + (conversion.arg == LogArg::STRING ? 1 : argSize(conversion.arg));
+        if (length + needed > DEBUG_LOG_ARG_BYTES) {
+            truncated = true;
+            break;
+        }
+
+        for (uint8_t i = 0; i < conversion.stars; i++) {
+            int star = va_arg(args, int);
+            memcpy(out + length, &star, sizeof(star));
+            length += sizeof(star);
+        }
+
+        switch (conversion.arg) {
+            case LogArg::INT: {
+                int value = va_arg(args, int);
+                memcpy(out + length, &value, sizeof(value));
+                break;
+            }
+            case LogArg::LONG: {
+                long value = va_arg(args, long);
+                memcpy(out + length, &value, sizeof(value));
+                break;
+            }
+            case LogArg::LONG_LONG: {
+                long long value = va_arg(args, long long);
+                memcpy(out + length, &value, sizeof(value));
+                break;
+            }
+            case LogArg::SIZE: {
+                size_t value = va_arg(args, size_t);
+                memcpy(out + length, &value, sizeof(value));
+                break;
+            }
+            case LogArg::POINTER: {
+                void* value = va_arg(args, void*);
+                memcpy(out + length, &value, sizeof(value));
+                break;
+            }
+            case LogArg::DOUBLE: {
+                double value = va_arg(args, double);
+                memcpy(out + length, &value, sizeof(value));
+                break;
+            }
+            case LogArg::LONG_DOUBLE: {
+                double value = (double)va_arg(args, long double);
+                memcpy(out + length, &value, sizeof(value));
+                break;
+            }
+            case LogArg::STRING: {
+                const char* value = va_arg(args, const char*);
+                if (!value) {
+                    value = "(null)";
+                }
+                size_t room = min((size_t)DEBUG_LOG_MAX_STRING, (size_t)DEBUG_LOG_ARG_BYTES - length - 1);
+                size_t copied = strnlen(value, room);
+                if (value[copied] != '\0') {
+                    truncated = true;
+                }
+                out[length] = (uint8_t)copied;
+                memcpy(out + length + 1, value, copied);
+                needed = 1 + copied;
+                break;
+            }
+            default:
+                break;
+        }
+        length += needed - conversion.stars * sizeof(int);
+    }
+    return (uint8_t)length;
+}
+
+// ===========================
+// Formatting
+// ===========================
+
+// The format's text with each conversion filled in from args; a record
+// that ran out of arguments ends " ..."
+size_t DebugUtils::formatArguments(const char* format, const uint8_t* args, size_t argLength,
+                                   char* buffer, size_t bufferSize) {
+    size_t length = 0;
+    size_t used = 0;
+    const char* text = format;
+    LogConversion conversion;
+
+    auto append = [&](const char* from, size_t count) {
+        count = min(count, bufferSize - 1 - length);
+        memcpy(buffer + length, from, count);
+        length += count;
+    };
+    // Literal text, %% as %
+    auto appendText = [&](const char* from, const char* to) {
+        while (from < to) {
+            const char* percent = (const char*)memchr(from, '%', to - from);
+            const char* stop = percent ? percent + 1 : to;
+            append(from, stop - from);
+            from = percent ? percent + 2 : to;
+        }
+    };
+
+    for (nextConversion(format, conversion); conversion.arg != LogArg::NONE; nextConversion(conversion.end, conversion)) {
+        appendText(text, conversion.start);
+        text = conversion.end;
+
+        char spec[16];
+        size_t specLength = conversion.end - conversion.start;
+        int starValues[2] = {0, 0};
+        size_t needed = conversion.stars * sizeof(int) + (conversion.arg == LogArg::STRING ? 1 : argSize(conversion.arg));
+        if (specLength >= sizeof(spec) || used + needed > argLength) {
+            append(" ...", 4);
+            text = nullptr;
+            break;
+        }
+        memcpy(spec, conversion.start, specLength);
+        spec[specLength] = '\0';
+        for (uint8_t i = 0; i < conversion.stars; i++) {
+            memcpy(&starValues[i], args + used, sizeof(int));
+            used += sizeof(int);
+        }
+
+        char* out = buffer + length;
+        size_t room = bufferSize - length;
+        int written = 0;
+        switch (conversion.arg) {
+            case LogArg::INT: {
+                int value;
+                memcpy(&value, args + used, sizeof(value));
+                written = formatConversion(out, room, spec, conversion.stars, starValues, value);
+                break;
+            }
+            case LogArg::LONG: {
+                long value;
+                memcpy(&value, args + used, sizeof(value));
+                written = formatConversion(out, room, spec, conversion.stars, starValues, value);
+                break;
+            }
+            case LogArg::LONG_LONG: {
+                long long value;
+                memcpy(&value, args + used, sizeof(value));
+                written = formatConversion(out, room, spec, conversion.stars, starValues, value);
+                break;
+            }
+            case LogArg::SIZE: {
+                size_t value;
+                memcpy(&value, args + used, sizeof(value));
+                written = formatConversion(out, room, spec, conversion.stars, starValues, value);
+                break;
+            }
+            case LogArg::POINTER: {
+                void* value;
+                memcpy(&value, args + used, sizeof(value));
+                written = formatConversion(out, room, spec, conversion.stars, starValues, value);
+                break;
+            }
+            case LogArg::DOUBLE: {
+                double value;
+                memcpy(&value, args + used, sizeof(value));
+                written = formatConversion(out, room, spec, conversion.stars, starValues, value);
+                break;
+            }
+            case LogArg::LONG_DOUBLE: {
+                double value;
+                memcpy(&value, args + used, sizeof(value));
+                written = formatConversion(out, room, spec, conversion.stars, starValues, (long double)value);
+                break;
+            }
+            case LogArg::STRING: {
+                char value[DEBUG_LOG_MAX_STRING + 1];
+                size_t copied = min((size_t)args[used], (size_t)DEBUG_LOG_MAX_STRING);
+                if (used + 1 + copied > argLength) {
+                    copied = argLength - used - 1;
+                }
+                memcpy(value, args + used + 1, copied);
+                value[copied] = '\0';
+                needed = 1 + copied;
+                written = formatConversion(out, room, spec, conversion.stars, starValues, (const char*)value);
+                break;
+            }
+            default:
+                break;
+        }
+        used += needed - conversion.stars * sizeof(int);
+        if (written > 0) {
+            length = min(length + (size_t)written, bufferSize - 1);
+        }
+    }
+    if (text) {
+        appendText(text, text + strlen(text));
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+size_t DebugUtils::formatRecord(const LogRecord& record, char* buffer, size_t bufferSize) const {
+    if (bufferSize == 0) {
+        return 0;
+    }
+    int prefix = snprintf(buffer, bufferSize, "[%5lu.%06lu] %-7s %-13s %s:%u: ",
+                          (unsigned long)(record.timestamp / 1000000), (unsigned long)(record.timestamp % 1000000),
+                          levelToString(record.level), categoryToString(record.category),
+                          record.function ? record.function : "?", record.lineNumber);
+    size_t length = prefix > 0 ? min((size_t)prefix, bufferSize - 1) : 0;
+    length += formatArguments(record.format, record.args, record.argLength, buffer + length, bufferSize - length);
+    if ((record.flags & LOG_RECORD_TRUNCATED) && length + 4 < bufferSize &&
+        (length < 4 || strcmp(buffer + length - 4, " ...") != 0)) {
+        strcpy(buffer + length, " ...");
+        length += 4;
+    }
+    return length;
+}
+
+// ===========================
+// Drain Task
+// ===========================
+
+void DebugUtils::drainTaskEntry(void* parameter) {
+    DebugUtils* debug = static_cast<DebugUtils*>(parameter);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DEBUG_LOG_DRAIN_MS));
+        debug->drainLog();
+    }
+}
+
+// The record at position, past a pad in front of it; advances position
+bool DebugUtils::readRecord(uint32_t& position, LogRecord& record) const {
+    uint32_t offset = position & (logRingSize - 1);
+    if (logRing[offset] == 0) {
+        position += logRingSize - offset;
+        offset = 0;
+    }
+    if (position == logHead) {
+        return false;
+    }
+    uint8_t size = logRing[offset];
+    memcpy(&record, logRing + offset, size);
+    position += size;
+    return true;
+}
+
+// Everything new since the last pass; what was overwritten first is counted, not printed
+void DebugUtils::drainLog() {
+    char line[DEBUG_LOG_LINE_MAX];
+    LogRecord record;
+
+    for (;;) {
+        portENTER_CRITICAL(&logLock);
+        if (drainTail == logHead) {
+            portEXIT_CRITICAL(&logLock);
+            return;
+        }
+        if ((int32_t)(logOldest - drainTail) > 0) {
+            statistics.droppedEntries += oldestSequence - drainSequence;
+            drainTail = logOldest;
+            drainSequence = oldestSequence;
+        }
+        bool read = readRecord(drainTail, record);
+        drainSequence++;
+        portEXIT_CRITICAL(&logLock);
+        if (!read) {
+            return;
+        }
+
+        formatRecord(record, line, sizeof(line));
+        if (serialEnabled) {
+            Serial.println(line);
+        }
+        LogSink logSink = sink;
+        if (logSink) {
+            logSink(record.level, line);
+        }
+    }
+}
+
+// ===========================
+// Buffer Management
+// ===========================
+
+void DebugUtils::clearLogBuffer() {
+    portENTER_CRITICAL(&logLock);
+    logOldest = logHead = drainTail = 0;
+    oldestSequence = headSequence = drainSequence = 0;
+    portEXIT_CRITICAL(&logLock);
+}
+
+// Every record still in the ring, oldest first, formatted here
+void DebugUtils::dumpLogBuffer() {
+    char line[DEBUG_LOG_LINE_MAX];
+    LogRecord record;
+
+    portENTER_CRITICAL(&logLock);
+    uint32_t position = logOldest;
+    uint32_t head = logHead;
+    uint32_t kept = headSequence - oldestSequence;
+    uint32_t total = headSequence;
+    portEXIT_CRITICAL(&logLock);
+
+    Serial.printf("=== Log (%lu of %lu records) ===\n", (unsigned long)kept, (unsigned long)total);
+    while ((int32_t)(head - position) > 0) {
+        portENTER_CRITICAL(&logLock);
+        if ((int32_t)(logOldest - position) > 0) {
+            position = logOldest;       // Overwritten while printing
+        }
+        bool read = (int32_t)(head - position) > 0 && readRecord(position, record);
+        portEXIT_CRITICAL(&logLock);
+        if (!read) {
+            break;
+        }
+        formatRecord(record, line, sizeof(line));
+        Serial.println(line);
+    }
+}
+
+// The ring as raw records for the host decoder
+void DebugUtils::dumpBinary(Print& out) {
+    LogRecord record;
+
+    portENTER_CRITICAL(&logLock);
+    uint32_t position = logOldest;
+    uint32_t count = headSequence - oldestSequence;
+    portEXIT_CRITICAL(&logLock);
+
+    uint8_t header[12];
+    uint32_t magic = DEBUG_LOG_MAGIC;
+    uint16_t version = DEBUG_LOG_VERSION;
+    uint16_t headerSize = LOG_RECORD_HEADER;
+    memcpy(header, &magic, 4);
+    memcpy(header + 4, &version, 2);
+    memcpy(header + 6, &headerSize, 2);
+    memcpy(header + 8, &count, 4);
+    out.write(header, sizeof(header));
+
+    // Exactly count records, even if newer ones replace some meanwhile
+    for (uint32_t i = 0; i < count; i++) {
+        portENTER_CRITICAL(&logLock);
+        if ((int32_t)(logOldest - position) > 0) {
+            position = logOldest;
+        }
+        bool read = readRecord(position, record);
+        portEXIT_CRITICAL(&logLock);
+        if (!read) {
+            break;
+        }
+        out.write(reinterpret_cast<const uint8_t*>(&record), record.size);
+    }
+}
+
+// ===========================
+// Performance Monitoring
+// ===========================
+
+void DebugUtils::updateLoopTime(uint32_t loopTime) {
+    performanceMetrics.lastLoopTime = loopTime;
+    performanceMetrics.loopTimeMax = max(performanceMetrics.loopTimeMax, loopTime);
+    performanceMetrics.loopTimeMin = min(performanceMetrics.loopTimeMin, loopTime);
+    performanceMetrics.loopCount++;
+    performanceMetrics.loopTimeAvg += ((int32_t)loopTime - (int32_t)performanceMetrics.loopTimeAvg) / 16;
+    performanceMetrics.lastUpdateTime = millis();
+}
+
+// ===========================
+// Timing and Profiling
+// ===========================
+
+void DebugUtils::startTimer(const char* timerName) {
+    Timer* timer = nullptr;
+    for (uint8_t i = 0; i < timerCount; i++) {
+        if (strncmp(timers[i].name, timerName, sizeof(timers[i].name) - 1) == 0) {
+            timer = &timers[i];
+            break;
+        }
+    }
+    if (!timer) {
+        if (timerCount >= MAX_TIMER_COUNT) {
+            return;
+        }
+        timer = &timers[timerCount++];
+        strncpy(timer->name, timerName, sizeof(timer->name) - 1);
+        timer->name[sizeof(timer->name) - 1] = '\0';
+    }
+    timer->startTime = micros();
+    timer->active = true;
+}
+
+// Microseconds since startTimer(), 0 for a timer that isn't running
+uint32_t DebugUtils::endTimer(const char* timerName) {
+    for (uint8_t i = 0; i < timerCount; i++) {
+        if (timers[i].active && strncmp(timers[i].name, timerName, sizeof(timers[i].name) - 1) == 0) {
+            timers[i].active = false;
+            return micros() - timers[i].startTime;
+        }
+    }
+    return 0;
+}
+
+// A DEBUG_TIMER's first run
+void DebugUtils::registerTimer(CodeTimer& timer) {
+    portENTER_CRITICAL(&timerLock);
+    if (!timer.registered) {
+        timer.next = codeTimers;
+        codeTimers = &timer;
+        timer.registered = true;
+    }
+    portEXIT_CRITICAL(&timerLock);
+}
+
+void DebugUtils::printTimers() {
+    portENTER_CRITICAL(&timerLock);
+    CodeTimer* timer = codeTimers;
+    portEXIT_CRITICAL(&timerLock);
+    if (!timer) {
+        return;
+    }
+
+    // Registration only ever pushes at the front, so the list from here on is fixed
+    Serial.printf("=== Code Timers (cycles, us at %d MHz) ===\n", PM_MAX_FREQ_MHZ);
+    Serial.println("Timer                    Count        Min        Avg        Max    Avg us");
+    for (; timer; timer = timer->next) {
+        uint32_t count = timer->count;
+        uint64_t total = timer->totalCycles;
+        uint32_t average = count ? (uint32_t)(total / count) : 0;
+        Serial.printf("%-20s %9lu %10lu %10lu %10lu %9.2f\n", timer->name, (unsigned long)count,
+                      (unsigned long)(count ? timer->minCycles : 0), (unsigned long)average,
+                      (unsigned long)timer->maxCycles, (float)average / PM_MAX_FREQ_MHZ);
+    }
+}
+
+void DebugUtils::clearTimers() {
+    timerCount = 0;
+    portENTER_CRITICAL(&timerLock);
+    for (CodeTimer* timer = codeTimers; timer; timer = timer->next) {
+        timer->count = 0;
+        timer->minCycles = UINT32_MAX;
+        timer->maxCycles = 0;
+        timer->totalCycles = 0;
+    }
+    portEXIT_CRITICAL(&timerLock);
+}
+
+// ===========================
+// Watchdog and Safety
+// ===========================
 
 void DebugUtils::feedWatchdog() {}
-void DebugUtils::enableWatchdog(unsigned long) {}
+void DebugUtils::enableWatchdog(uint32_t) {}
 void DebugUtils::disableWatchdog() {}
 
-void DebugUtils::resetStatistics() {}
-void DebugUtils::printStatistics() const {}
-void DebugUtils::clearLogBuffer() {}
+// ===========================
+// Statistics
+// ===========================
+
+void DebugUtils::resetStatistics() {
+    portENTER_CRITICAL(&logLock);
+    initializeStatistics();
+    statistics.lastResetTime = millis();
+    portEXIT_CRITICAL(&logLock);
+}
+
+void DebugUtils::printStatistics() const {
+    portENTER_CRITICAL(&logLock);
+    DebugStatistics stats = statistics;
+    uint32_t kept = headSequence - oldestSequence;
+    uint32_t pending = headSequence - drainSequence;
+    uint32_t used = logHead - logOldest;
+    portEXIT_CRITICAL(&logLock);
+
+    Serial.println("=== Debug Log Statistics ===");
+    Serial.printf("Records: %lu (%lu errors, %lu warnings, %lu info, %lu debug, %lu verbose)\n",
+                  stats.totalLogEntries, stats.errorCount, stats.warningCount, stats.infoCount,
+                  stats.debugCount, stats.verboseCount);
+    Serial.printf("Ring: %lu kept in %lu of %lu bytes (%s), %lu waiting for the drain\n",
+                  (unsigned long)kept, (unsigned long)used, (unsigned long)logRingSize,
+                  logRingInPsram ? "PSRAM" : "internal RAM", (unsigned long)min(pending, kept));
+    Serial.printf("Internal RAM: %u bytes\n", (unsigned)sizeof(DebugUtils));
+    Serial.printf("Dropped: %lu overwritten before printing, %lu with arguments cut short, %lu repeats suppressed\n",
+                  stats.droppedEntries, stats.bufferOverflows, stats.suppressedEntries);
+}
+
+// ===========================
+// Utility Methods
+// ===========================
+
+const char* DebugUtils::levelToString(DebugLevel level) const {
+    switch (level) {
+        case DebugLevel::ERROR: return "ERROR";
+        case DebugLevel::WARNING: return "WARNING";
+        case DebugLevel::INFO: return "INFO";
+        case DebugLevel::DEBUG: return "DEBUG";
+        case DebugLevel::VERBOSE: return "VERBOSE";
+        default: return "Unknown";
+    }
+}
+
+const char* DebugUtils::categoryToString(DebugCategory category) const {
+    switch (category) {
+        case DebugCategory::SYSTEM: return "SYSTEM";
+        case DebugCategory::SENSORS: return "SENSORS";
+        case DebugCategory::CAMERA: return "CAMERA";
+        case DebugCategory::LORA: return "LORA";
+        case DebugCategory::POWER: return "POWER";
+        case DebugCategory::GPS: return "GPS";
+        case DebugCategory::COMMUNICATION: return "COMMUNICATION";
+        case DebugCategory::STATE: return "STATE";
+        case DebugCategory::MEMORY: return "MEMORY";
+        case DebugCategory::PERFORMANCE: return "PERFORMANCE";
+        default: return "Unknown";
+    }
+}
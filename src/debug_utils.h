@@ -2,7 +2,12 @@
 #define DEBUG_UTILS_H
 
 #include <Arduino.h>
+#include <cstdarg>
 #include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_cpu.h"
+#include "trace_buffer.h"
 #include "balloon_config.h"
 
 // ===========================
@@ -10,6 +15,67 @@
 // ESP32-S3 Balloon Project
 // ===========================
 
+// Logging is deferred: a log call stores a binary record - timestamp,
+// level, category, the format string's address and the raw arguments - in
+// a ring and returns, with no formatting on the caller. The record is the
+// format's conversions read off the va_list in order: integers and
+// pointers at their own width, floating point as a double, strings copied
+// in with a length byte (DEBUG_LOG_MAX_STRING at most, as the caller's
+// buffer may be gone by the time it's printed). Arguments past
+// DEBUG_LOG_ARG_BYTES are dropped and the record marked truncated.
+//
+// Records are stored at their own length - the header, then only the
+// argument bytes used, padded to 4 - in a byte ring begin() puts in PSRAM,
+// so internal RAM holds the ring's positions and nothing else. Format and
+// function are pointers into flash, never copies. A record doesn't wrap:
+// one that doesn't fit before the ring's end leaves a pad there (a size
+// byte of 0) and starts over at the front. Writing past the oldest record
+// drops it, so the ring always holds the newest DEBUG_LOG_RING_BYTES' worth.
+// Records logged before begin() have nowhere to go and count as dropped.
+//
+// A drain task at the lowest priority formats what's new for Serial and
+// the sink (setLogSink(): a file, a LoRa debug packet), reading at its own
+// pace; records overwritten before the drain reached them are counted as
+// dropped. dumpBinary() writes the ring as it is for a host decoder, which
+// takes each format (and function name) from the firmware ELF by its address.
+//
+// Binary dump:
+//   [0-3]   DEBUG_LOG_MAGIC
+//   [4-5]   DEBUG_LOG_VERSION, [6-7] offsetof(LogRecord, args), [8-11] records to follow
+//   [12..]  records, oldest first, each LogRecord::size bytes
+
+#define DEBUG_LOG_RING_BYTES     131072  // PSRAM, power of two - about 5000 records
+#define DEBUG_LOG_FALLBACK_BYTES 8192    // Internal RAM, without PSRAM
+#define DEBUG_LOG_ARG_BYTES      42      // At most; a full record is 61 bytes
+#define DEBUG_LOG_MAX_STRING     24      // Longest %s argument kept
+#define DEBUG_LOG_LINE_MAX       192     // A formatted line, prefix included
+#define DEBUG_LOG_DRAIN_MS       100     // Longest a record waits for the drain; errors and warnings wake it
+#define DEBUG_LOG_MAGIC          0x31474C44  // "DLG1"
+#define DEBUG_LOG_VERSION        2
+
+// Code timers: DEBUG_TIMER("name") at the top of a block times the rest of
+// the scope in CPU cycles (CCOUNT, two register reads) into a CodeTimer
+// that is a static at the call site - constant-initialized, so there is no
+// guard, no lookup and no lock. It joins the list printTimers() reports
+// the first time it runs. Counts are updated without a lock, as in the
+// stage profiler: exact for a site one task runs, and the odd sample off
+// where two tasks race on one. CCOUNT is per core, so a scope a task can
+// migrate across (not the pinned tasks) may read wild once in a while.
+// DEBUG_TIMERS 0 compiles the timers out.
+#ifndef DEBUG_TIMERS
+#define DEBUG_TIMERS             1
+#endif
+
+// Rate-limited logging: DEBUG_LIMITED() and the *_LIMITED shorthands take
+// a LogLimiter that is a static at the call site, as a code timer is, so
+// the site itself is the key - no table, no hashing of the message. The
+// first call logs; calls within intervalMs after it are only counted. The
+// first one past the interval logs a "N more suppressed" record ahead of
+// its own, so a condition that holds shows up once per interval with a
+// count rather than every loop. The limiter is unlocked too: exact for a
+// site one task runs.
+#define DEBUG_LOG_LIMIT_MS       30000   // The *_LIMITED shorthands
+
 // Debug Levels
 enum class DebugLevel : uint8_t {
     NONE = 0x00,
@@ -35,17 +101,29 @@ enum class DebugCategory : uint8_t {
     ALL = 0xFF
 };
 
-// Log Entry Structure
-struct LogEntry {
-    uint32_t timestamp;
+#define LOG_RECORD_TRUNCATED     0x01    // Arguments past DEBUG_LOG_ARG_BYTES were dropped
+
+struct CodeTimer;
+struct LogLimiter;
+
+// Log Record Structure - one log call, unformatted; the ring holds the
+// first size bytes of it
+struct LogRecord {
+    uint8_t size;               // Header and argLength, padded to 4; 0 pads to the ring's end
     DebugLevel level;
     DebugCategory category;
+    uint8_t argLength;          // Bytes used in args
+    uint32_t timestamp;         // micros()
+    const char* format;         // In flash; the decoder's format id
+    const char* function;       // __FUNCTION__, in flash
     uint16_t lineNumber;
-    char functionName[32];
-    char message[128];
-    uint8_t messageLength;
+    uint8_t flags;              // LOG_RECORD_*
+    uint8_t args[DEBUG_LOG_ARG_BYTES];
 };
 
+// Formatted line and its level, from the drain task
+typedef void (*LogSink)(DebugLevel level, const char* line);
+
 // Performance Metrics
 struct PerformanceMetrics {
     uint32_t loopTimeMax;
@@ -71,6 +149,7 @@ struct DebugStatistics {
     uint32_t verboseCount;
     uint32_t droppedEntries;
     uint32_t bufferOverflows;
+    uint32_t suppressedEntries;     // Held back by a LogLimiter
     uint32_t lastResetTime;
 };
 
@@ -108,6 +187,11 @@ public:
     void logDebug(DebugCategory category, const char* function, int line, const char* format, ...);
     void logVerbose(DebugCategory category, const char* function, int line, const char* format, ...);
     void logRaw(DebugLevel level, DebugCategory category, const char* function, int line, const char* message);
+    // DEBUG_LORA / DEBUG_CAMERA / DEBUG_SENSORS diagnostics, through *_TRACE()
+    void logTrace(DebugCategory category, const char* function, int line, const char* format, ...);
+    // Through DEBUG_LIMITED(); false while the limiter holds it back
+    bool logLimited(LogLimiter& limiter, DebugLevel level, DebugCategory category, const char* function, int line,
+                    const char* format, ...);
 
     // Convenience Macros (defined in header for debug utils)
     void printHex(const uint8_t* data, size_t length, DebugCategory category = DebugCategory::SYSTEM);
@@ -116,12 +200,15 @@ public:
     void printTaskInfo(DebugCategory category = DebugCategory::SYSTEM);
     void printStackTrace(DebugCategory category = DebugCategory::SYSTEM);
 
-    // Buffer Management
-    LogEntry* getLogBuffer(uint16_t& count);
+    // Buffer Management - the newest records that fit the ring, drained or not
     void clearLogBuffer();
-    bool isLogBufferFull() const;
-    uint16_t getLogBufferSize() const { return LOG_BUFFER_SIZE; }
-    uint16_t getLogBufferUsage() const { return logIndex; }
+    bool isLogBufferFull() const { return logOldest != 0; }        // Has dropped its oldest
+    uint32_t getLogBufferSize() const { return logRingSize; }        // Bytes, 0 before begin()
+    uint32_t getLogBufferUsage() const { return headSequence - oldestSequence; }    // Records
+    bool isLogBufferInPsram() const { return logRingInPsram; }
+    size_t formatRecord(const LogRecord& record, char* buffer, size_t bufferSize) const;
+    void dumpBinary(Print& out);
+    void setLogSink(LogSink logSink) { sink = logSink; }
 
     // Performance Monitoring
     void startPerformanceMonitor();
@@ -149,9 +236,12 @@ public:
     void feedWatchdog();
     bool isWatchdogEnabled() const { return watchdogEnabled; }
 
-    // Timing and Profiling
+    // Timing and Profiling - by name, in microseconds, for the odd ad hoc
+    // measurement; DEBUG_TIMER() for anything on a hot path
     void startTimer(const char* timerName);
     uint32_t endTimer(const char* timerName);
+    void registerTimer(CodeTimer& timer);
+    const CodeTimer* getCodeTimers() const { return codeTimers; }     // Newest first, then ->next
     void printTimers();
     void clearTimers();
 
@@ -166,6 +256,9 @@ public:
     void exitDebugMode();
     bool isInDebugMode() const { return debugModeActive; }
 
+    const char* levelToString(DebugLevel level) const;
+    const char* categoryToString(DebugCategory category) const;
+
     // Data Export
     bool exportLogToFile(const char* filename);
     bool exportStatisticsToFile(const char* filename);
@@ -179,11 +272,21 @@ private:
     bool fileLoggingEnabled;
     uint8_t enabledCategories[16];  // Bit mask for enabled categories
 
-    // Log Buffer
-    LogEntry logBuffer[500];
-    uint16_t logIndex;
-    uint16_t logCount;
-    bool logBufferFull;
+    // Log ring - byte positions that only grow, the ring's offset masked
+    // out of them: the oldest record kept, the next to write and the next
+    // one the drain formats, with record counts to match; all under logLock
+    uint8_t* logRing;
+    uint32_t logRingSize;
+    bool logRingInPsram;
+    uint32_t logOldest;
+    uint32_t logHead;
+    uint32_t drainTail;
+    uint32_t oldestSequence;
+    uint32_t headSequence;
+    uint32_t drainSequence;
+    mutable portMUX_TYPE logLock;
+    TaskHandle_t drainTask;
+    LogSink sink;
 
     // Performance Monitoring
     PerformanceMetrics performanceMetrics;
@@ -211,9 +314,8 @@ private:
     };
     Timer timers[16];
     uint8_t timerCount;
-
-    // Constants
-    static const uint16_t LOG_BUFFER_SIZE = 500;
+    CodeTimer* codeTimers;          // Newest registered first
+    mutable portMUX_TYPE timerLock;
 
     // Internal Methods
     void initializeLogBuffer();
@@ -221,10 +323,17 @@ private:
     void initializeStatistics();
     
     // Logging Helpers
-    void writeToLogBuffer(const LogEntry& entry);
-    void writeToSerial(const LogEntry& entry);
-    bool writeToFile(const LogEntry& entry);
-    void formatLogMessage(const LogEntry& entry, char* buffer, size_t bufferSize);
+    bool isLogged(DebugLevel level, DebugCategory category) const;
+    void writeToLogBuffer(DebugLevel level, DebugCategory category, const char* function, int line,
+                          const char* format, va_list args);
+    void writeRecord(DebugLevel level, DebugCategory category, const char* function, int line,
+                     const char* format, ...);
+    static uint8_t packArguments(const char* format, va_list args, uint8_t* out, bool& truncated);
+    static size_t formatArguments(const char* format, const uint8_t* args, size_t argLength,
+                                  char* buffer, size_t bufferSize);
+    bool readRecord(uint32_t& position, LogRecord& record) const;     // Caller holds logLock
+    void drainLog();
+    static void drainTaskEntry(void* parameter);
     
     // Performance Helpers
     void updatePerformanceMetrics();
@@ -235,8 +344,6 @@ private:
     void setCategoryBit(DebugCategory category, bool enabled);
     
     // Utility Methods
-    const char* levelToString(DebugLevel level) const;
-    const char* categoryToString(DebugCategory category) const;
     uint32_t getTimestamp() const;
     void processLogBufferOverflow();
     
@@ -311,6 +418,17 @@ extern DebugUtils& Debug;
 #define GPS_INFO(...)    DEBUG_INFO(GPS, __VA_ARGS__)
 #define GPS_LOG(...)     DEBUG_LOG(GPS, __VA_ARGS__)
 
+// Build-switched diagnostics (DEBUG_LORA, DEBUG_CAMERA, DEBUG_SENSORS):
+// compiled out when the switch is off, and when on, a record in the ring
+// like any other log call - the hot paths they sit in never wait on the
+// serial port, and what the drain can't keep up with is counted dropped
+#define DEBUG_TRACE(enabled, cat, ...) \
+    do { if (enabled) Debug.logTrace(DebugCategory::cat, __FUNCTION__, __LINE__, __VA_ARGS__); } while(0)
+
+#define LORA_TRACE(...)     DEBUG_TRACE(DEBUG_LORA, LORA, __VA_ARGS__)
+#define CAMERA_TRACE(...)   DEBUG_TRACE(DEBUG_CAMERA, CAMERA, __VA_ARGS__)
+#define SENSOR_TRACE(...)   DEBUG_TRACE(DEBUG_SENSORS, SENSORS, __VA_ARGS__)
+
 // Convenience macros
 #define DEBUG_ASSERT(condition) \
     do { if (!Debug.assertCondition((condition), #condition, __FUNCTION__, __LINE__)) { return false; } } while(0)
@@ -330,6 +448,93 @@ extern DebugUtils& Debug;
 #define DEBUG_END_TIMER(name) \
     Debug.endTimer(name)
 
+// ===========================
+// Code Timers
+// ===========================
+
+// One call site's cycle counts; see DEBUG_TIMER
+struct CodeTimer {
+    const char* name;
+    CodeTimer* next = nullptr;
+    bool registered = false;
+    uint32_t count = 0;
+    uint32_t minCycles = UINT32_MAX;
+    uint32_t maxCycles = 0;
+    uint64_t totalCycles = 0;
+
+    constexpr explicit CodeTimer(const char* timerName) : name(timerName) {}
+
+    void add(uint32_t cycles) {
+        if (!registered) {
+            Debug.registerTimer(*this);
+        }
+        count++;
+        totalCycles += cycles;
+        if (cycles < minCycles) {
+            minCycles = cycles;
+        }
+        if (cycles > maxCycles) {
+            maxCycles = cycles;
+        }
+    }
+};
+
+// From construction to the end of the scope, with a trace slice around it
+class ScopedTimer {
+public:
+    explicit ScopedTimer(CodeTimer& timer) : timer(timer) {
+        Trace().beginScope(timer.name);
+        start = esp_cpu_get_cycle_count();
+    }
+    ~ScopedTimer() {
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        Trace().endScope(timer.name);
+        timer.add(cycles);
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    CodeTimer& timer;
+    uint32_t start;
+};
+
+#define DEBUG_TIMER_CONCAT_(a, b) a##b
+#define DEBUG_TIMER_CONCAT(a, b)  DEBUG_TIMER_CONCAT_(a, b)
+
+#if DEBUG_TIMERS
+#define DEBUG_TIMER(name) \
+    static CodeTimer DEBUG_TIMER_CONCAT(debugTimer, __LINE__)(name); \
+    ScopedTimer DEBUG_TIMER_CONCAT(debugTimerScope, __LINE__)(DEBUG_TIMER_CONCAT(debugTimer, __LINE__))
+#else
+#define DEBUG_TIMER(name) do {} while (0)
+#endif
+
+// One call site's rate limit; see DEBUG_LIMITED
+struct LogLimiter {
+    uint32_t intervalMs;
+    uint32_t lastLogged = 0;        // millis()
+    uint32_t suppressed = 0;        // Since lastLogged
+    bool logged = false;
+
+    constexpr explicit LogLimiter(uint32_t interval) : intervalMs(interval) {}
+};
+
+#define DEBUG_LIMITED(level, cat, intervalMs, ...) \
+    do { \
+        static LogLimiter DEBUG_TIMER_CONCAT(logLimiter, __LINE__)(intervalMs); \
+        if (Debug.isDebugEnabled()) { \
+            Debug.logLimited(DEBUG_TIMER_CONCAT(logLimiter, __LINE__), DebugLevel::level, DebugCategory::cat, \
+                             __FUNCTION__, __LINE__, __VA_ARGS__); \
+        } \
+    } while(0)
+
+#define SYS_WARNING_LIMITED(...)    DEBUG_LIMITED(WARNING, SYSTEM, DEBUG_LOG_LIMIT_MS, __VA_ARGS__)
+#define SYS_INFO_LIMITED(...)       DEBUG_LIMITED(INFO, SYSTEM, DEBUG_LOG_LIMIT_MS, __VA_ARGS__)
+#define SENSOR_WARNING_LIMITED(...) DEBUG_LIMITED(WARNING, SENSORS, DEBUG_LOG_LIMIT_MS, __VA_ARGS__)
+#define LORA_WARNING_LIMITED(...)   DEBUG_LIMITED(WARNING, LORA, DEBUG_LOG_LIMIT_MS, __VA_ARGS__)
+
 #define DEBUG_MEMORY_INFO() \
     Debug.printMemoryInfo(DebugCategory::MEMORY)
 
@@ -0,0 +1,316 @@
+#include "downsample.h"
+
+// Twice the triangle's area; times relative to a so float keeps the milliseconds
+static float triangleArea(const TimeSeriesSample& a, const TimeSeriesSample& b, float cTime, float cValue) {
+    float bt = (float)(b.time - a.time);
+    float ct = cTime;
+    return fabsf(bt * (cValue - a.value) - ct * (b.value - a.value));
+}
+
+// ===========================
+// Arrays
+// ===========================
+
+size_t downsampleLttb(const TimeSeriesSample* in, size_t count, TimeSeriesSample* out, size_t outCount) {
+    if (count <= outCount) {
+        memcpy(out, in, count * sizeof(TimeSeriesSample));
+        return count;
+    }
+    if (outCount < 3) {
+        out[0] = in[0];
+        if (outCount == 2) {
+            out[1] = in[count - 1];
+        }
+        return outCount;
+    }
+
+    const size_t buckets = outCount - 2;
+    size_t written = 0;
+    size_t a = 0;
+    out[written++] = in[0];
+
+    for (size_t bucket = 0; bucket < buckets; bucket++) {
+        // Samples 1..count-2 split evenly; integer bounds so every sample is in exactly one bucket
+        size_t start = 1 + bucket * (count - 2) / buckets;
+        size_t end = 1 + (bucket + 1) * (count - 2) / buckets;
+        size_t nextEnd = bucket + 1 < buckets ? 1 + (bucket + 2) * (count - 2) / buckets : count;
+
+        // Next bucket's average, or the last sample after the final bucket
+        float nextTime = 0.0f;
+        float nextValue = 0.0f;
+        for (size_t i = end; i < nextEnd; i++) {
+            nextTime += (float)(in[i].time - in[a].time);
+            nextValue += in[i].value;
+        }
+        nextTime /= (nextEnd - end);
+        nextValue /= (nextEnd - end);
+
+        size_t best = start;
+        float bestArea = -1.0f;
+        for (size_t i = start; i < end; i++) {
+            float area = triangleArea(in[a], in[i], nextTime, nextValue);
+            if (area > bestArea) {
+                bestArea = area;
+                best = i;
+            }
+        }
+        out[written++] = in[best];
+        a = best;
+    }
+
+    out[written++] = in[count - 1];
+    return written;
+}
+
+size_t downsampleMinMax(const TimeSeriesSample* in, size_t count, TimeSeriesSample* out, size_t outCount) {
+    if (count <= outCount) {
+        memcpy(out, in, count * sizeof(TimeSeriesSample));
+        return count;
+    }
+
+    const size_t buckets = outCount / 2;
+    size_t written = 0;
+    for (size_t bucket = 0; bucket < buckets; bucket++) {
+        size_t start = bucket * count / buckets;
+        size_t end = (bucket + 1) * count / buckets;
+        size_t low = start;
+        size_t high = start;
+        for (size_t i = start + 1; i < end; i++) {
+            if (in[i].value < in[low].value) {
+                low = i;
+            }
+            if (in[i].value > in[high].value) {
+                high = i;
+            }
+        }
+        out[written++] = in[min(low, high)];
+        if (low != high) {
+            out[written++] = in[max(low, high)];
+        }
+    }
+    return written;
+}
+
+// ===========================
+// Time Series
+// ===========================
+
+// Buckets of equal time across (start, end]; start is the first sample, kept apart
+struct TimeBuckets {
+    uint32_t start;
+    uint32_t span;
+    size_t count;
+
+    size_t of(uint32_t time) const {
+        size_t bucket = (size_t)((uint64_t)(time - start) * count / ((uint64_t)span + 1));
+        return bucket < count ? bucket : count - 1;
+    }
+};
+
+static bool timeBuckets(const TimeSeries& series, uint32_t from, uint32_t to, size_t count, TimeBuckets& buckets) {
+    uint32_t first, last;
+    if (count == 0 || !series.getRange(first, last)) {
+        return false;
+    }
+    buckets.start = max(from, first);
+    uint32_t end = min(to, last);
+    if (end < buckets.start) {
+        return false;
+    }
+    buckets.span = end - buckets.start;
+    buckets.count = count;
+    return true;
+}
+
+// Pass 1: first and last sample, the count, and each bucket's average into out[1 + bucket]
+struct LttbAverages {
+    TimeBuckets buckets;
+    TimeSeriesSample* out;
+    TimeSeriesSample first;
+    TimeSeriesSample last;
+    size_t samples;
+    size_t bucket;
+    float timeSum;
+    float valueSum;
+    size_t inBucket;
+};
+
+static void finishAverage(LttbAverages& pass) {
+    if (pass.inBucket > 0) {
+        pass.out[1 + pass.bucket].time = pass.first.time + (uint32_t)(pass.timeSum / pass.inBucket);
+        pass.out[1 + pass.bucket].value = pass.valueSum / pass.inBucket;
+    }
+}
+
+static bool averageSample(const TimeSeriesSample& sample, void* context) {
+    LttbAverages& pass = *static_cast<LttbAverages*>(context);
+    if (pass.samples++ == 0) {
+        pass.first = sample;
+        pass.last = sample;
+        return true;
+    }
+    // The previous last joins its bucket now that it isn't the last
+    if (pass.samples > 2) {
+        size_t bucket = pass.buckets.of(pass.last.time);
+        if (bucket != pass.bucket) {
+            finishAverage(pass);
+            pass.bucket = bucket;
+            pass.timeSum = 0.0f;
+            pass.valueSum = 0.0f;
+            pass.inBucket = 0;
+        }
+        pass.timeSum += (float)(pass.last.time - pass.first.time);
+        pass.valueSum += pass.last.value;
+        pass.inBucket++;
+    }
+    pass.last = sample;
+    return true;
+}
+
+// Pass 2: the pick from each bucket, written behind the walk
+struct LttbPicks {
+    TimeBuckets buckets;
+    TimeSeriesSample* out;
+    const TimeSeriesSample* last;
+    size_t written;
+    TimeSeriesSample previous;  // Last pick
+    size_t bucket;
+    bool haveBest;
+    TimeSeriesSample best;
+    float bestArea;
+    float nextTime;             // Relative to previous
+    float nextValue;
+};
+
+static bool isEmptyBucket(const TimeSeriesSample& average) {
+    return isnan(average.value);
+}
+
+static void aimAtNext(LttbPicks& pass) {
+    // The next bucket holding samples, else the last sample
+    const TimeSeriesSample* next = pass.last;
+    for (size_t b = pass.bucket + 1; b < pass.buckets.count; b++) {
+        if (!isEmptyBucket(pass.out[1 + b])) {
+            next = &pass.out[1 + b];
+            break;
+        }
+    }
+    pass.nextTime = (float)(next->time - pass.previous.time);
+    pass.nextValue = next->value;
+}
+
+static bool pickSample(const TimeSeriesSample& sample, void* context) {
+    LttbPicks& pass = *static_cast<LttbPicks*>(context);
+    if (sample.time >= pass.last->time) {
+        return false;   // Kept apart, like the first
+    }
+
+    size_t bucket = pass.buckets.of(sample.time);
+    if (bucket != pass.bucket || !pass.haveBest) {
+        if (pass.haveBest) {
+            pass.out[pass.written++] = pass.best;
+            pass.previous = pass.best;
+        }
+        pass.bucket = bucket;
+        pass.haveBest = false;
+        pass.bestArea = -1.0f;
+        aimAtNext(pass);
+    }
+
+    float area = triangleArea(pass.previous, sample, pass.nextTime, pass.nextValue);
+    if (area > pass.bestArea) {
+        pass.bestArea = area;
+        pass.best = sample;
+        pass.haveBest = true;
+    }
+    return true;
+}
+
+size_t downsampleLttb(const TimeSeries& series, uint32_t from, uint32_t to, TimeSeriesSample* out, size_t outCount) {
+    if (outCount < 3) {
+        return series.query(from, to, out, outCount);   // Room for the ends at most
+    }
+
+    LttbAverages averages = {};
+    if (!timeBuckets(series, from, to, outCount - 2, averages.buckets)) {
+        return 0;
+    }
+    for (size_t b = 0; b < averages.buckets.count; b++) {
+        out[1 + b].value = NAN;
+    }
+    averages.out = out;
+    series.visit(from, to, averageSample, &averages);
+    finishAverage(averages);
+
+    if (averages.samples <= outCount) {
+        return series.query(from, to, out, outCount);
+    }
+
+    LttbPicks picks = {};
+    picks.buckets = averages.buckets;
+    picks.out = out;
+    picks.last = &averages.last;
+    picks.previous = averages.first;
+    out[0] = averages.first;
+    picks.written = 1;
+    series.visit(averages.first.time + 1, averages.last.time, pickSample, &picks);
+    if (picks.haveBest) {
+        out[picks.written++] = picks.best;
+    }
+    out[picks.written++] = averages.last;
+    return picks.written;
+}
+
+struct MinMaxPass {
+    TimeBuckets buckets;
+    TimeSeriesSample* out;
+    size_t written;
+    size_t bucket;
+    bool haveBucket;
+    TimeSeriesSample low;
+    TimeSeriesSample high;
+};
+
+static void finishMinMax(MinMaxPass& pass) {
+    if (!pass.haveBucket) {
+        return;
+    }
+    const TimeSeriesSample& early = pass.low.time <= pass.high.time ? pass.low : pass.high;
+    const TimeSeriesSample& late = pass.low.time <= pass.high.time ? pass.high : pass.low;
+    pass.out[pass.written++] = early;
+    if (late.time != early.time) {
+        pass.out[pass.written++] = late;
+    }
+}
+
+static bool minMaxSample(const TimeSeriesSample& sample, void* context) {
+    MinMaxPass& pass = *static_cast<MinMaxPass*>(context);
+    size_t bucket = pass.buckets.of(sample.time);
+    if (!pass.haveBucket || bucket != pass.bucket) {
+        finishMinMax(pass);
+        pass.bucket = bucket;
+        pass.haveBucket = true;
+        pass.low = sample;
+        pass.high = sample;
+        return true;
+    }
+    if (sample.value < pass.low.value) {
+        pass.low = sample;
+    }
+    if (sample.value > pass.high.value) {
+        pass.high = sample;
+    }
+    return true;
+}
+
+size_t downsampleMinMax(const TimeSeries& series, uint32_t from, uint32_t to, TimeSeriesSample* out,
+                        size_t outCount) {
+    MinMaxPass pass = {};
+    if (!timeBuckets(series, from, to, outCount / 2, pass.buckets)) {
+        return 0;
+    }
+    pass.out = out;
+    series.visit(from, to, minMaxSample, &pass);
+    finishMinMax(pass);
+    return pass.written;
+}
@@ -0,0 +1,35 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "timeseries.h"
+
+// ===========================
+// Downsampling
+// The few samples of a series that best keep its shape - for summary
+// packets on the balloon and graphs on the ground
+// ===========================
+
+// LTTB (Largest-Triangle-Three-Buckets, Steinarsson 2013) keeps the first and
+// last sample and, from each bucket between, the one forming the largest
+// triangle with the sample kept before it and the average of the next
+// bucket - peaks, bursts and turning points survive where plain averaging
+// would flatten them. Min-max keeps each bucket's lowest and highest sample,
+// for envelopes (a graph that must show every spike).
+//
+// Array versions bucket by sample index. TimeSeries versions bucket by time
+// over [from, to] and walk the ring with visit(): LTTB twice (bucket
+// averages go into out first, then are overwritten by the picks behind the
+// walk), min-max once. Both are O(n) in the samples walked, with nothing
+// allocated; out must hold outCount samples. Time-bucketed output may be
+// shorter than outCount where the series has gaps.
+
+size_t downsampleLttb(const TimeSeriesSample* in, size_t count, TimeSeriesSample* out, size_t outCount);
+size_t downsampleMinMax(const TimeSeriesSample* in, size_t count, TimeSeriesSample* out, size_t outCount);
+
+size_t downsampleLttb(const TimeSeries& series, uint32_t from, uint32_t to, TimeSeriesSample* out, size_t outCount);
+size_t downsampleMinMax(const TimeSeries& series, uint32_t from, uint32_t to, TimeSeriesSample* out,
+                        size_t outCount);
+
+#endif // DOWNSAMPLE_H
@@ -0,0 +1,165 @@
+#include "energy_ledger.h"
+#include "time_service.h"
+
+#define ENERGY_MA_US_PER_MAH       3.6e9   // 1 mAh = 3600 s x 1e6 us
+
+EnergyLedger::EnergyLedger() : lock(portMUX_INITIALIZER_UNLOCKED) {
+    static const float activeMa[ENERGY_LOAD_COUNT] = {
+        ENERGY_CPU_MA_240MHZ, ENERGY_CAMERA_MA, ENERGY_RADIO_TX_MA, ENERGY_RADIO_RX_MA, ENERGY_GPS_MA,
+        ENERGY_SENSORS_MA, ENERGY_BULK_RADIO_TX_MA, ENERGY_BULK_RADIO_RX_MA, ENERGY_WIFI_AP_MA
+    };
+    static const float idleMa[ENERGY_LOAD_COUNT] = {
+        0.0f, ENERGY_CAMERA_STANDBY_MA, 0.0f, ENERGY_RADIO_SLEEP_MA, 0.0f, ENERGY_SENSORS_IDLE_MA,
+        0.0f, ENERGY_RADIO_SLEEP_MA, 0.0f
+    };
+
+    for (uint8_t i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        Load& load = loads[i];
+        load.activeMa = activeMa[i];
+        load.idleMa = idleMa[i];
+        load.active = false;
+        load.sinceUs = 0;
+        load.chargeMaUs = 0.0;
+        load.activeUs = 0;
+        load.transitions = 0;
+    }
+
+    // Running from reset - nothing reports these turning on
+    loads[static_cast<uint8_t>(EnergyLoad::CPU)].active = true;
+    loads[static_cast<uint8_t>(EnergyLoad::GPS)].active = true;
+}
+
+void EnergyLedger::settle(Load& load, int64_t nowUs) {
+    int64_t elapsed = nowUs - load.sinceUs;
+    if (elapsed <= 0) {
+        return;
+    }
+    load.chargeMaUs += (double)(load.active ? load.activeMa : load.idleMa) * elapsed;
+    if (load.active) {
+        load.activeUs += elapsed;
+    }
+    load.sinceUs = nowUs;
+}
+
+void EnergyLedger::setActive(EnergyLoad load, bool active) {
+    int64_t now = TimeService::nowUs();
+    Load& entry = loads[static_cast<uint8_t>(load)];
+    portENTER_CRITICAL(&lock);
+    if (entry.active != active) {
+        settle(entry, now);
+        entry.active = active;
+        if (active) {
+            entry.transitions++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void EnergyLedger::setActiveCurrent(EnergyLoad load, float milliamps) {
+    int64_t now = TimeService::nowUs();
+    Load& entry = loads[static_cast<uint8_t>(load)];
+    portENTER_CRITICAL(&lock);
+    settle(entry, now);
+    entry.activeMa = milliamps;
+    portEXIT_CRITICAL(&lock);
+}
+
+void EnergyLedger::setIdleCurrent(EnergyLoad load, float milliamps) {
+    int64_t now = TimeService::nowUs();
+    Load& entry = loads[static_cast<uint8_t>(load)];
+    portENTER_CRITICAL(&lock);
+    settle(entry, now);
+    entry.idleMa = milliamps;
+    portEXIT_CRITICAL(&lock);
+}
+
+EnergyLoadStatus EnergyLedger::getStatus(EnergyLoad load) const {
+    int64_t now = TimeService::nowUs();
+    portENTER_CRITICAL(&lock);
+    Load entry = loads[static_cast<uint8_t>(load)];
+    portEXIT_CRITICAL(&lock);
+
+    settle(entry, now);
+    EnergyLoadStatus status;
+    status.chargeMah = entry.chargeMaUs / ENERGY_MA_US_PER_MAH;
+    status.activeSeconds = entry.activeUs / 1e6f;
+    status.drawMa = entry.active ? entry.activeMa : entry.idleMa;
+    status.transitions = entry.transitions;
+    status.active = entry.active;
+    return status;
+}
+
+float EnergyLedger::getChargeMah(EnergyLoad load) const {
+    return getStatus(load).chargeMah;
+}
+
+float EnergyLedger::getTotalChargeMah() const {
+    float total = 0.0f;
+    for (uint8_t i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        total += getChargeMah(static_cast<EnergyLoad>(i));
+    }
+    return total;
+}
+
+float EnergyLedger::getTotalDrawMa() const {
+    float total = 0.0f;
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        total += loads[i].active ? loads[i].activeMa : loads[i].idleMa;
+    }
+    portEXIT_CRITICAL(&lock);
+    return total;
+}
+
+void EnergyLedger::reset() {
+    int64_t now = TimeService::nowUs();
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        loads[i].sinceUs = now;
+        loads[i].chargeMaUs = 0.0;
+        loads[i].activeUs = 0;
+        loads[i].transitions = 0;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void EnergyLedger::printLedger() const {
+    Serial.println("=== Energy Ledger ===");
+    float total = getTotalChargeMah();
+    for (uint8_t i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        EnergyLoad load = static_cast<EnergyLoad>(i);
+        EnergyLoadStatus status = getStatus(load);
+        Serial.printf("%-9s %8.2f mAh %5.1f%%  on %9.1f s (%lu times)  now %s %.1f mA\n", energyLoadToString(load),
+                      status.chargeMah, total > 0.0f ? 100.0f * status.chargeMah / total : 0.0f,
+                      status.activeSeconds, (unsigned long)status.transitions, status.active ? "on" : "off",
+                      status.drawMa);
+    }
+    Serial.printf("Total     %8.2f mAh, drawing %.1f mA\n", total, getTotalDrawMa());
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static EnergyLedger energyLedgerInstance;
+
+EnergyLedger& Energy() { return energyLedgerInstance; }
+
+// ===========================
+// Utility Functions
+// ===========================
+
+const char* energyLoadToString(EnergyLoad load) {
+    switch (load) {
+        case EnergyLoad::CPU: return "CPU";
+        case EnergyLoad::CAMERA: return "Camera";
+        case EnergyLoad::RADIO_TX: return "Radio TX";
+        case EnergyLoad::RADIO_RX: return "Radio RX";
+        case EnergyLoad::GPS: return "GPS";
+        case EnergyLoad::SENSORS: return "Sensors";
+        case EnergyLoad::BULK_RADIO_TX: return "Bulk radio TX";
+        case EnergyLoad::BULK_RADIO_RX: return "Bulk radio RX";
+        case EnergyLoad::WIFI: return "WiFi AP";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef ENERGY_LEDGER_H
+#define ENERGY_LEDGER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+
+// ===========================
+// Energy Ledger
+// Charge drawn by each subsystem, integrated from the on/off transitions the
+// subsystems report themselves
+// ===========================
+
+// There's no current sensor, so the draw of each load is its datasheet
+// current in the state it is in, and what the ledger adds is how long it
+// was in it: the camera driver reports sensor standby and wake, the radio
+// task every RX/TX/sleep change (so TX airtime counts at the current TX
+// power), the sensor scheduler its conversions, PowerManager the CPU clock.
+// Each transition closes the previous interval, charge += draw * time;
+// reads close it up to now on a copy. PowerManager turns the growth of the
+// totals into average currents and the runtime estimate.
+//
+// Transitions come from several tasks; one spinlock, held for a few adds.
+
+#define ENERGY_CPU_MA_240MHZ       100.0f  // Both cores and WiFi idle; scaled by clock
+#define ENERGY_CAMERA_MA           200.0f  // Sensor streaming into the driver
+#define ENERGY_CAMERA_STANDBY_MA   2.0f    // Sensor standby, registers kept
+#define ENERGY_RADIO_TX_MA         120.0f  // SX127x PA_BOOST at 20 dBm, until the radio sets its power
+#define ENERGY_RADIO_RX_MA         12.0f   // SX127x RX or CAD
+#define ENERGY_RADIO_SLEEP_MA      0.001f  // SX127x sleep; standby between operations is counted here, it lasts ms
+#define ENERGY_BULK_RADIO_TX_MA    90.0f   // SX1262 at 17 dBm, until the bulk link sets its power
+#define ENERGY_BULK_RADIO_RX_MA    5.0f    // SX1262 RX on the DC-DC
+#define ENERGY_GPS_MA              25.0f   // Tracking; the module is powered with the board
+#define ENERGY_SENSORS_MA          1.0f    // A BMP280 conversion and the I2C pull-ups
+#define ENERGY_SENSORS_IDLE_MA     0.005f  // BMP280 sleep
+#define ENERGY_WIFI_AP_MA          90.0f   // Soft AP up, beaconing with no power save; over the CPU's
+
+enum class EnergyLoad : uint8_t {
+    CPU = 0,
+    CAMERA,
+    RADIO_TX,           // Active for the airtime; draw set from the TX power
+    RADIO_RX,           // Active while receiving or scanning, idle asleep
+    GPS,
+    SENSORS,            // Active while any I2C conversion is running
+    BULK_RADIO_TX,      // The second, bulk-data module (LORA_BULK_* pins) - as RADIO_TX/RX
+    BULK_RADIO_RX,
+    WIFI,               // Active while the ground access point is up
+    COUNT
+};
+
+#define ENERGY_LOAD_COUNT static_cast<uint8_t>(EnergyLoad::COUNT)
+
+struct EnergyLoadStatus {
+    float chargeMah;        // Since boot or reset()
+    float activeSeconds;
+    float drawMa;           // Now
+    uint32_t transitions;   // Off to on
+    bool active;
+};
+
+class EnergyLedger {
+public:
+    EnergyLedger();
+
+    // State changes; repeating the current state costs only the lock
+    void setActive(EnergyLoad load, bool active);
+
+    // Draw while active from now on, for loads whose current changes with a setting
+    void setActiveCurrent(EnergyLoad load, float milliamps);
+    void setIdleCurrent(EnergyLoad load, float milliamps);     // 0 with the load's rail switched off
+
+    EnergyLoadStatus getStatus(EnergyLoad load) const;
+    float getChargeMah(EnergyLoad load) const;
+    float getTotalChargeMah() const;
+    float getTotalDrawMa() const;       // Instantaneous, every load in its current state
+
+    void reset();                       // Totals to zero, states kept
+
+    void printLedger() const;
+
+private:
+    struct Load {
+        float activeMa;
+        float idleMa;
+        bool active;
+        int64_t sinceUs;
+        double chargeMaUs;      // mA x us; a float would stop adding short intervals within a flight
+        int64_t activeUs;
+        uint32_t transitions;
+    };
+
+    Load loads[ENERGY_LOAD_COUNT];
+    mutable portMUX_TYPE lock;
+
+    static void settle(Load& load, int64_t nowUs);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern EnergyLedger& Energy();
+
+const char* energyLoadToString(EnergyLoad load);
+
+#endif // ENERGY_LEDGER_H
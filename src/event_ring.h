@@ -0,0 +1,93 @@
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// ===========================
+// Event Ring
+// A bounded multi-producer, single-consumer queue: any task, core or ISR
+// posts without blocking, one task drains
+// ===========================
+
+// Each slot carries a sequence number. A producer claims the slot at the
+// tail with one compare-exchange, copies the item in, then sets the slot's
+// sequence to say it's filled; the consumer takes the slot at the head only
+// once its sequence says so, and hands it back to the producers a lap later.
+// No producer waits on another or on the consumer: a full ring fails the
+// push at once and counts the drop. A producer preempted between its claim
+// and its publish only holds up the consumer at that slot, never another
+// producer, and an ISR on the same core claims the next slot past it.
+//
+// N must be a power of two; T must be trivially copyable.
+
+template <typename T, uint32_t N>
+class EventRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "EventRing<T, N> needs a power of two N");
+    static_assert(std::is_trivially_copyable<T>::value, "EventRing<T, N> copies T with memcpy");
+
+public:
+    EventRing() : tail(0), head(0), dropped(0) {
+        for (uint32_t i = 0; i < N; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any task or ISR; false with the ring full
+    bool push(const T& item) {
+        uint32_t position = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[position & (N - 1)];
+            int32_t lag = (int32_t)(slot.sequence.load(std::memory_order_acquire) - position);
+            if (lag == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    memcpy(&slot.item, &item, sizeof(item));
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // The consumer only; false when nothing is ready
+    bool pop(T& item) {
+        Slot& slot = slots[head & (N - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        memcpy(&item, &slot.item, sizeof(item));
+        slot.sequence.store(head + N, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    bool isEmpty() const {
+        return slots[head & (N - 1)].sequence.load(std::memory_order_acquire) != head + 1;
+    }
+
+    // Claimed and not yet popped; a snapshot, producers may be mid-copy
+    uint32_t size() const { return tail.load(std::memory_order_relaxed) - head; }
+    uint32_t capacity() const { return N; }
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        T item;
+    };
+
+    Slot slots[N];
+    std::atomic<uint32_t> tail;     // Next slot a producer claims
+    uint32_t head;                  // Next slot the consumer takes - its own
+    std::atomic<uint32_t> dropped;
+};
+
+#endif // EVENT_RING_H
@@ -0,0 +1,465 @@
+#include "fec_codec.h"
+#include "memory_ledger.h"
+#include "debug_utils.h"
+
+// ===========================
+// GF(256) Arithmetic
+// ===========================
+
+#define GF_POLYNOMIAL        0x11D   // x^8 + x^4 + x^3 + x^2 + 1
+#define FEC_PARITY_X_BASE    0x80    // Cauchy x_j = 0x80 + j, y_i = i (never equal)
+
+static uint8_t gfExp[512];
+static uint8_t gfLog[256];
+static bool gfReady = false;
+
+static void gfInit() {
+    if (gfReady) {
+        return;
+    }
+    
+    uint16_t x = 1;
+    for (int i = 0; i < 255; i++) {
+        gfExp[i] = x;
+        gfLog[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= GF_POLYNOMIAL;
+        }
+    }
+    
+    // Doubled table so gfExp[logA + logB] needs no modulo
+    for (int i = 255; i < 512; i++) {
+        gfExp[i] = gfExp[i - 255];
+    }
+    gfLog[0] = 0;
+    gfReady = true;
+}
+
+static inline uint8_t gfMul(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gfExp[gfLog[a] + gfLog[b]];
+}
+
+static inline uint8_t gfInv(uint8_t a) {
+    return gfExp[255 - gfLog[a]];
+}
+
+// dst ^= coefficient * src over a whole chunk
+static void gfMulAdd(uint8_t* dst, uint8_t coefficient, const uint8_t* src, size_t length) {
+    if (coefficient == 0) {
+        return;
+    }
+    
+    uint8_t logC = gfLog[coefficient];
+    for (size_t i = 0; i < length; i++) {
+        if (src[i]) {
+            dst[i] ^= gfExp[logC + gfLog[src[i]]];
+        }
+    }
+}
+
+static inline uint8_t cauchyCoefficient(uint8_t parityIndex, uint8_t dataIndex) {
+    return gfInv((FEC_PARITY_X_BASE + parityIndex) ^ dataIndex);
+}
+
+static void writeChunkHeader(uint8_t* out, const FecChunkHeader& header) {
+    out[0] = (header.imageId >> 8) & 0xFF;
+    out[1] = header.imageId & 0xFF;
+    out[2] = (header.imageSize >> 24) & 0xFF;
+    out[3] = (header.imageSize >> 16) & 0xFF;
+    out[4] = (header.imageSize >> 8) & 0xFF;
+    out[5] = header.imageSize & 0xFF;
+    out[6] = header.group;
+    out[7] = header.index;
+    out[8] = header.dataChunks;
+    out[9] = header.parityChunks;
+    out[10] = header.chunkSize;
+}
+
+bool parseFecChunkHeader(const uint8_t* payload, size_t length, FecChunkHeader& header) {
+    if (!payload || length < FEC_CHUNK_HEADER_SIZE) {
+        return false;
+    }
+    
+    header.imageId = (payload[0] << 8) | payload[1];
+    header.imageSize = ((uint32_t)payload[2] << 24) | ((uint32_t)payload[3] << 16) |
+                       ((uint32_t)payload[4] << 8) | payload[5];
+    header.group = payload[6];
+    header.index = payload[7];
+    header.dataChunks = payload[8];
+    header.parityChunks = payload[9];
+    header.chunkSize = payload[10];
+    
+    if (header.dataChunks == 0 || header.chunkSize == 0 ||
+        header.dataChunks + header.parityChunks > FEC_MAX_GROUP_CHUNKS) {
+        return false;
+    }
+    
+    return length >= (size_t)FEC_CHUNK_HEADER_SIZE + header.chunkSize;
+}
+
+// ===========================
+// FEC Encoder
+// ===========================
+
+FecEncoder::FecEncoder() {
+    chunkStorage = nullptr;
+    chunkStride = 0;
+    chunkCount = 0;
+    groupCount = 0;
+    dataChunkCount = 0;
+    imageId = 0;
+}
+
+FecEncoder::~FecEncoder() {
+    release();
+}
+
+void FecEncoder::release() {
+    if (chunkStorage) {
+        memFree(MemTag::FEC, chunkStorage);
+        chunkStorage = nullptr;
+    }
+    chunkCount = 0;
+    groupCount = 0;
+    dataChunkCount = 0;
+}
+
+size_t FecEncoder::slotFor(size_t group, size_t position) const {
+    // Chunks are stored interleaved (position-major across groups) so a burst
+    // of lost frames is spread over many groups instead of wiping out one
+    size_t lastGroupData = dataChunkCount - (groupCount - 1) * LORA_FEC_DATA_CHUNKS;
+    size_t slot = 0;
+    
+    for (size_t p = 0; p < position; p++) {
+        bool shortInLastGroup = (p < LORA_FEC_DATA_CHUNKS && p >= lastGroupData);
+        slot += shortInLastGroup ? groupCount - 1 : groupCount;
+    }
+    
+    return slot + group;
+}
+
+bool FecEncoder::encode(uint16_t id, const uint8_t* data, size_t length, uint8_t parity) {
+    release();
+    gfInit();
+    
+    if (!data || length == 0 || LORA_FEC_DATA_CHUNKS + parity > FEC_MAX_GROUP_CHUNKS) {
+        return false;
+    }
+    
+    const size_t chunkSize = LORA_FEC_CHUNK_SIZE;
+    const size_t k = LORA_FEC_DATA_CHUNKS;
+    const size_t m = parity;
+    
+    dataChunkCount = (length + chunkSize - 1) / chunkSize;
+    groupCount = (dataChunkCount + k - 1) / k;
+    if (groupCount > 0xFF) {
+        LORA_TRACE("FEC: Image too large (%u bytes)", (unsigned)length);
+        dataChunkCount = 0;
+        groupCount = 0;
+        return false;
+    }
+    
+    chunkCount = dataChunkCount + groupCount * m;
+    chunkStride = FEC_CHUNK_HEADER_SIZE + chunkSize;
+    chunkStorage = (uint8_t*)memAlloc(MemTag::FEC, chunkCount * chunkStride);
+    if (!chunkStorage) {
+        LORA_TRACE("FEC: Failed to allocate chunk storage");
+        chunkCount = 0;
+        return false;
+    }
+    memset(chunkStorage, 0, chunkCount * chunkStride);
+    imageId = id;
+    
+    FecChunkHeader header;
+    header.imageId = id;
+    header.imageSize = length;
+    header.dataChunks = k;
+    header.parityChunks = m;
+    header.chunkSize = chunkSize;
+    
+    for (size_t group = 0; group < groupCount; group++) {
+        size_t groupData = min(k, dataChunkCount - group * k);
+        header.group = group;
+        
+        // Systematic part - the data chunks themselves (last one zero padded)
+        for (size_t i = 0; i < groupData; i++) {
+            uint8_t* chunk = chunkStorage + slotFor(group, i) * chunkStride;
+            size_t offset = (group * k + i) * chunkSize;
+            size_t bytes = min(chunkSize, length - offset);
+            
+            header.index = i;
+            writeChunkHeader(chunk, header);
+            memcpy(chunk + FEC_CHUNK_HEADER_SIZE, data + offset, bytes);
+        }
+        
+        // Parity part - Cauchy rows over the group's data chunks
+        for (size_t j = 0; j < m; j++) {
+            uint8_t* chunk = chunkStorage + slotFor(group, k + j) * chunkStride;
+            uint8_t* parity = chunk + FEC_CHUNK_HEADER_SIZE;
+            
+            header.index = groupData + j;
+            writeChunkHeader(chunk, header);
+            
+            for (size_t i = 0; i < groupData; i++) {
+                const uint8_t* source = chunkStorage + slotFor(group, i) * chunkStride + FEC_CHUNK_HEADER_SIZE;
+                gfMulAdd(parity, cauchyCoefficient(j, i), source, chunkSize);
+            }
+        }
+    }
+    
+    LORA_TRACE("FEC: Image %u encoded - %u bytes, %u groups, %u chunks (%u parity per group)",
+               id, (unsigned)length, (unsigned)groupCount, (unsigned)chunkCount, (unsigned)m);
+    
+    return true;
+}
+
+const uint8_t* FecEncoder::getChunk(size_t index, size_t& length) const {
+    if (!chunkStorage || index >= chunkCount) {
+        length = 0;
+        return nullptr;
+    }
+    
+    length = chunkStride;
+    return chunkStorage + index * chunkStride;
+}
+
+// ===========================
+// FEC Decoder
+// ===========================
+
+FecDecoder::FecDecoder() {
+    imageBuffer = nullptr;
+    parityBuffer = nullptr;
+    receivedMask = nullptr;
+    groupComplete = nullptr;
+    groupCount = 0;
+    groupsComplete = 0;
+    dataChunkCount = 0;
+    imageId = 0;
+    imageSize = 0;
+    dataChunks = 0;
+    parityChunks = 0;
+    chunkSize = 0;
+    active = false;
+    chunksReceived = 0;
+    chunksRecovered = 0;
+}
+
+FecDecoder::~FecDecoder() {
+    reset();
+}
+
+void FecDecoder::reset() {
+    memFree(MemTag::FEC, imageBuffer);
+    memFree(MemTag::FEC, parityBuffer);
+    memFree(MemTag::FEC, receivedMask);
+    memFree(MemTag::FEC, groupComplete);
+    imageBuffer = nullptr;
+    parityBuffer = nullptr;
+    receivedMask = nullptr;
+    groupComplete = nullptr;
+    groupCount = 0;
+    groupsComplete = 0;
+    dataChunkCount = 0;
+    active = false;
+}
+
+uint8_t FecDecoder::groupDataChunks(size_t group) const {
+    return min((size_t)dataChunks, dataChunkCount - group * dataChunks);
+}
+
+bool FecDecoder::allocate(const FecChunkHeader& header) {
+    reset();
+    gfInit();
+    
+    imageId = header.imageId;
+    imageSize = header.imageSize;
+    dataChunks = header.dataChunks;
+    parityChunks = header.parityChunks;
+    chunkSize = header.chunkSize;
+    dataChunkCount = (imageSize + chunkSize - 1) / chunkSize;
+    groupCount = (dataChunkCount + dataChunks - 1) / dataChunks;
+    
+    imageBuffer = (uint8_t*)memAlloc(MemTag::FEC, dataChunkCount * chunkSize);
+    parityBuffer = (uint8_t*)memAlloc(MemTag::FEC, groupCount * parityChunks * chunkSize);
+    receivedMask = (uint32_t*)memCalloc(MemTag::FEC, groupCount, sizeof(uint32_t));
+    groupComplete = (bool*)memCalloc(MemTag::FEC, groupCount, sizeof(bool));
+    
+    if (!imageBuffer || (parityChunks > 0 && !parityBuffer) || !receivedMask || !groupComplete) {
+        reset();
+        return false;
+    }
+    
+    active = true;
+    return true;
+}
+
+bool FecDecoder::addChunk(const uint8_t* payload, size_t length) {
+    FecChunkHeader header;
+    if (!parseFecChunkHeader(payload, length, header)) {
+        return false;
+    }
+    
+    // A new image id starts a new transfer
+    if (!active || header.imageId != imageId) {
+        if (!allocate(header)) {
+            return false;
+        }
+    }
+    
+    if (header.chunkSize != chunkSize || header.dataChunks != dataChunks ||
+        header.parityChunks != parityChunks || header.group >= groupCount) {
+        return false;
+    }
+    
+    uint8_t groupData = groupDataChunks(header.group);
+    if (header.index >= groupData + parityChunks) {
+        return false;
+    }
+    
+    if (groupComplete[header.group] || (receivedMask[header.group] & (1UL << header.index))) {
+        return true;  // Duplicate or no longer needed
+    }
+    
+    const uint8_t* body = payload + FEC_CHUNK_HEADER_SIZE;
+    uint8_t* destination;
+    if (header.index < groupData) {
+        destination = imageBuffer + (header.group * dataChunks + header.index) * chunkSize;
+    } else {
+        destination = parityBuffer + (header.group * parityChunks + (header.index - groupData)) * chunkSize;
+    }
+    memcpy(destination, body, chunkSize);
+    receivedMask[header.group] |= (1UL << header.index);
+    chunksReceived++;
+    
+    // Any k chunks of the group are enough
+    if (__builtin_popcount(receivedMask[header.group]) >= groupData) {
+        if (recoverGroup(header.group)) {
+            groupComplete[header.group] = true;
+            groupsComplete++;
+        }
+    }
+    
+    return true;
+}
+
+bool FecDecoder::recoverGroup(size_t group) {
+    uint8_t k = groupDataChunks(group);
+    uint32_t mask = receivedMask[group];
+    uint8_t missing[FEC_MAX_GROUP_CHUNKS];
+    uint8_t parityUsed[FEC_MAX_GROUP_CHUNKS];
+    int missingCount = 0;
+    int parityCount = 0;
+    
+    for (uint8_t i = 0; i < k; i++) {
+        if (!(mask & (1UL << i))) {
+            missing[missingCount++] = i;
+        }
+    }
+    
+    if (missingCount == 0) {
+        return true;
+    }
+    
+    for (uint8_t j = 0; j < parityChunks && parityCount < missingCount; j++) {
+        if (mask & (1UL << (k + j))) {
+            parityUsed[parityCount++] = j;
+        }
+    }
+    
+    if (parityCount < missingCount) {
+        return false;
+    }
+    
+    uint8_t* dataBase = imageBuffer + group * dataChunks * chunkSize;
+    uint8_t* syndromes = (uint8_t*)memAlloc(MemTag::FEC, missingCount * chunkSize);
+    if (!syndromes) {
+        return false;
+    }
+    
+    // Strip the known data chunks out of each parity chunk
+    for (int r = 0; r < missingCount; r++) {
+        uint8_t* syndrome = syndromes + r * chunkSize;
+        memcpy(syndrome, parityBuffer + (group * parityChunks + parityUsed[r]) * chunkSize, chunkSize);
+        for (uint8_t i = 0; i < k; i++) {
+            if (mask & (1UL << i)) {
+                gfMulAdd(syndrome, cauchyCoefficient(parityUsed[r], i), dataBase + i * chunkSize, chunkSize);
+            }
+        }
+    }
+    
+    // Invert the square Cauchy sub-matrix (always non-singular) by Gauss-Jordan
+    uint8_t matrix[FEC_MAX_GROUP_CHUNKS][FEC_MAX_GROUP_CHUNKS];
+    uint8_t inverse[FEC_MAX_GROUP_CHUNKS][FEC_MAX_GROUP_CHUNKS];
+    for (int r = 0; r < missingCount; r++) {
+        for (int c = 0; c < missingCount; c++) {
+            matrix[r][c] = cauchyCoefficient(parityUsed[r], missing[c]);
+            inverse[r][c] = (r == c) ? 1 : 0;
+        }
+    }
+    
+    for (int col = 0; col < missingCount; col++) {
+        int pivot = col;
+        while (pivot < missingCount && matrix[pivot][col] == 0) {
+            pivot++;
+        }
+        if (pivot == missingCount) {
+            memFree(MemTag::FEC, syndromes);
+            return false;
+        }
+        if (pivot != col) {
+            for (int c = 0; c < missingCount; c++) {
+                uint8_t t = matrix[col][c]; matrix[col][c] = matrix[pivot][c]; matrix[pivot][c] = t;
+                t = inverse[col][c]; inverse[col][c] = inverse[pivot][c]; inverse[pivot][c] = t;
+            }
+        }
+        
+        uint8_t scale = gfInv(matrix[col][col]);
+        for (int c = 0; c < missingCount; c++) {
+            matrix[col][c] = gfMul(matrix[col][c], scale);
+            inverse[col][c] = gfMul(inverse[col][c], scale);
+        }
+        
+        for (int r = 0; r < missingCount; r++) {
+            uint8_t factor = matrix[r][col];
+            if (r == col || factor == 0) {
+                continue;
+            }
+            for (int c = 0; c < missingCount; c++) {
+                matrix[r][c] ^= gfMul(factor, matrix[col][c]);
+                inverse[r][c] ^= gfMul(factor, inverse[col][c]);
+            }
+        }
+    }
+    
+    // Rebuild each missing chunk from the syndromes
+    for (int c = 0; c < missingCount; c++) {
+        uint8_t* target = dataBase + missing[c] * chunkSize;
+        memset(target, 0, chunkSize);
+        for (int r = 0; r < missingCount; r++) {
+            gfMulAdd(target, inverse[c][r], syndromes + r * chunkSize, chunkSize);
+        }
+    }
+    
+    memFree(MemTag::FEC, syndromes);
+    chunksRecovered += missingCount;
+    
+    LORA_TRACE("FEC: Image %u group %u rebuilt %d lost chunk(s)",
+               imageId, (unsigned)group, missingCount);
+    
+    return true;
+}
+
+const uint8_t* FecDecoder::getImage(size_t& length) const {
+    if (!isComplete()) {
+        length = 0;
+        return nullptr;
+    }
+    
+    length = imageSize;
+    return imageBuffer;
+}
@@ -0,0 +1,107 @@
+#ifndef FEC_CODEC_H
+#define FEC_CODEC_H
+
+#include <Arduino.h>
+#include "balloon_config.h"
+
+// ===========================
+// Forward Error Correction
+// Systematic Reed-Solomon erasure code over GF(256)
+// ===========================
+
+// An image is cut into LORA_FEC_CHUNK_SIZE data chunks, grouped K at a time.
+// Each group gets M Cauchy parity chunks; any K of the K+M chunks of a group
+// rebuild it, so lost chunks never need a NACK round trip.
+
+// Chunk header (prefixed to every FEC chunk payload)
+// [imageId 2][imageSize 4][group 1][index 1][k 1][m 1][chunkSize 1]
+// k is the nominal group size; the last group may carry fewer data chunks
+#define FEC_CHUNK_HEADER_SIZE   11
+#define FEC_MAX_GROUP_CHUNKS    32    // k + m per group (receive mask is 32 bits)
+
+struct FecChunkHeader {
+    uint16_t imageId;
+    uint32_t imageSize;
+    uint8_t group;
+    uint8_t index;           // 0..k-1 data, k..k+m-1 parity
+    uint8_t dataChunks;      // k - nominal data chunks per group
+    uint8_t parityChunks;    // m
+    uint8_t chunkSize;
+};
+
+// ===========================
+// FEC Encoder (balloon side)
+// ===========================
+
+class FecEncoder {
+private:
+    uint8_t* chunkStorage;   // All chunk payloads, header included, back to back
+    size_t chunkStride;
+    size_t chunkCount;
+    size_t groupCount;
+    size_t dataChunkCount;
+    uint16_t imageId;
+
+    size_t slotFor(size_t group, size_t position) const;
+
+public:
+    FecEncoder();
+    ~FecEncoder();
+
+    // parity is M for every group of this image; the header carries it
+    bool encode(uint16_t id, const uint8_t* data, size_t length, uint8_t parity = LORA_FEC_PARITY_CHUNKS);
+    void release();
+
+    size_t getChunkCount() const { return chunkCount; }
+    size_t getGroupCount() const { return groupCount; }
+    uint16_t getImageId() const { return imageId; }
+    const uint8_t* getChunk(size_t index, size_t& length) const;
+};
+
+// ===========================
+// FEC Decoder (base station side)
+// ===========================
+
+class FecDecoder {
+private:
+    uint8_t* imageBuffer;    // All data chunks in place, chunkSize apart
+    uint8_t* parityBuffer;   // groups * m * chunkSize
+    uint32_t* receivedMask;  // Per group, bit i = chunk i present
+    bool* groupComplete;
+    size_t groupCount;
+    size_t groupsComplete;
+    size_t dataChunkCount;
+    uint16_t imageId;
+    uint32_t imageSize;
+    uint8_t dataChunks;
+    uint8_t parityChunks;
+    uint8_t chunkSize;
+    bool active;
+    uint32_t chunksReceived;
+    uint32_t chunksRecovered;
+
+    bool allocate(const FecChunkHeader& header);
+    bool recoverGroup(size_t group);
+    uint8_t groupDataChunks(size_t group) const;
+
+public:
+    FecDecoder();
+    ~FecDecoder();
+
+    bool addChunk(const uint8_t* payload, size_t length);
+    void reset();
+
+    bool isComplete() const { return active && groupsComplete == groupCount; }
+    uint16_t getImageId() const { return imageId; }
+    const uint8_t* getImage(size_t& length) const;
+    uint32_t getChunksReceived() const { return chunksReceived; }
+    uint32_t getChunksRecovered() const { return chunksRecovered; }
+};
+
+// ===========================
+// Utility Functions
+// ===========================
+
+bool parseFecChunkHeader(const uint8_t* payload, size_t length, FecChunkHeader& header);
+
+#endif // FEC_CODEC_H
@@ -0,0 +1,497 @@
+#include "firmware_update.h"
+#include "memory_ledger.h"
+#include "debug_utils.h"
+
+static FirmwareUpdater firmwareUpdaterInstance;
+
+FirmwareUpdater& Firmware() {
+    return firmwareUpdaterInstance;
+}
+
+static inline uint32_t readU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+static inline uint16_t readU16(const uint8_t* in) {
+    return (static_cast<uint16_t>(in[0]) << 8) | in[1];
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+FirmwareUpdater::FirmwareUpdater() {
+    state = FirmwareState::IDLE;
+    failure = nullptr;
+    updateId = 0;
+    chunkCount = 0;
+    chunksHeld = 0;
+    patch = nullptr;
+    patchCapacity = 0;
+    patchLength = 0;
+    lastChunkAt = 0;
+    memset(&header, 0, sizeof(header));
+
+    running = nullptr;
+    target = nullptr;
+    otaHandle = 0;
+    otaOpen = false;
+    memset(&sha, 0, sizeof(sha));
+    hashed = 0;
+    patchPos = 0;
+    opCode = FIRMWARE_OP_SEEK;
+    opRemaining = 0;
+    oldPos = 0;
+    written = 0;
+    restartAt = 0;
+
+    chunksReceived = 0;
+    patchesApplied = 0;
+    patchesFailed = 0;
+}
+
+void FirmwareUpdater::confirmBoot() {
+    const esp_partition_t* partition = esp_ota_get_running_partition();
+    esp_ota_img_states_t imageState;
+    if (partition && esp_ota_get_state_partition(partition, &imageState) == ESP_OK &&
+        imageState == ESP_OTA_IMG_PENDING_VERIFY) {
+        esp_ota_mark_app_valid_cancel_rollback();
+        SYS_INFO("Firmware in %s booted - kept", partition->label);
+    }
+}
+
+// ===========================
+// Receiving
+// ===========================
+
+void FirmwareUpdater::onTransferComplete(void* context, uint8_t deviceId, PacketType contentType,
+                                         const uint8_t* data, size_t length) {
+    if (contentType == PacketType::FIRMWARE_DELTA) {
+        static_cast<FirmwareUpdater*>(context)->receiveChunk(data, length);
+    }
+}
+
+bool FirmwareUpdater::receiveChunk(const uint8_t* payload, size_t length) {
+    if (!FIRMWARE_DELTA_ENABLED || length <= FIRMWARE_CHUNK_HEADER_SIZE) {
+        return false;
+    }
+
+    uint16_t id = readU16(payload);
+    uint8_t index = payload[2];
+    uint8_t count = payload[3];
+    size_t dataLength = length - FIRMWARE_CHUNK_HEADER_SIZE;
+    bool last = index + 1 == count;
+    if (count == 0 || count > FIRMWARE_DELTA_MAX_CHUNKS || index >= count ||
+        dataLength > FIRMWARE_CHUNK_DATA_BYTES || (!last && dataLength != FIRMWARE_CHUNK_DATA_BYTES)) {
+        SYS_WARNING("Firmware chunk %u/%u of update %u malformed (%u bytes)", index, count, id, (unsigned)length);
+        return false;
+    }
+    chunksReceived++;
+
+    bool ours = state != FirmwareState::IDLE && id == updateId && count == chunkCount;
+    if (ours && state != FirmwareState::RECEIVING) {
+        // A resend of one already applied, or that failed
+        return true;
+    }
+    if (!ours) {
+        if (state == FirmwareState::RESTARTING) {
+            return false;
+        }
+        release();
+        patchCapacity = static_cast<size_t>(count) * FIRMWARE_CHUNK_DATA_BYTES;
+        patch = static_cast<uint8_t*>(memAlloc(MemTag::FIRMWARE, patchCapacity));
+        if (!patch) {
+            patchCapacity = 0;
+            updateId = id;
+            chunkCount = count;
+            fail("no memory for the patch");
+            return false;
+        }
+        updateId = id;
+        chunkCount = count;
+        chunksHeld = 0;
+        patchLength = 0;
+        failure = nullptr;
+        state = FirmwareState::RECEIVING;
+        SYS_INFO("Firmware update %u: receiving %u chunks", id, count);
+    }
+
+    lastChunkAt = millis();
+    if (!(chunksHeld & (1 << index))) {
+        memcpy(&patch[static_cast<size_t>(index) * FIRMWARE_CHUNK_DATA_BYTES],
+               &payload[FIRMWARE_CHUNK_HEADER_SIZE], dataLength);
+        chunksHeld |= 1 << index;
+        if (last) {
+            patchLength = static_cast<size_t>(index) * FIRMWARE_CHUNK_DATA_BYTES + dataLength;
+        }
+    }
+
+    if (chunksHeld == (1 << count) - 1) {
+        startApply();
+    }
+    return true;
+}
+
+// ===========================
+// Applying
+// ===========================
+
+void FirmwareUpdater::update() {
+    switch (state) {
+        case FirmwareState::RECEIVING:
+            if (millis() - lastChunkAt > FIRMWARE_RECEIVE_TIMEOUT_MS) {
+                fail("chunks stopped coming");
+            }
+            break;
+        case FirmwareState::VERIFYING:
+            stepVerify();
+            break;
+        case FirmwareState::APPLYING:
+            stepApply();
+            break;
+        default:
+            break;
+    }
+}
+
+bool FirmwareUpdater::isRestartDue() const {
+    return state == FirmwareState::RESTARTING && (int32_t)(millis() - restartAt) >= 0;
+}
+
+bool FirmwareUpdater::parseHeader() {
+    if (patchLength < FIRMWARE_PATCH_HEADER_SIZE + 1 || readU32(patch) != FIRMWARE_PATCH_MAGIC) {
+        fail("not a patch");
+        return false;
+    }
+    if (patch[4] != FIRMWARE_PATCH_VERSION) {
+        fail("patch version unknown");
+        return false;
+    }
+    header.oldLength = readU32(&patch[8]);
+    memcpy(header.oldHash, &patch[12], FIRMWARE_HASH_SIZE);
+    header.newLength = readU32(&patch[44]);
+    memcpy(header.newHash, &patch[48], FIRMWARE_HASH_SIZE);
+    return true;
+}
+
+bool FirmwareUpdater::startApply() {
+    if (!parseHeader()) {
+        return false;
+    }
+
+    running = esp_ota_get_running_partition();
+    target = esp_ota_get_next_update_partition(nullptr);
+    if (!running || !target || target == running) {
+        fail("no second OTA slot");
+        return false;
+    }
+    if (header.oldLength == 0 || header.oldLength > running->size) {
+        fail("base image larger than the running slot");
+        return false;
+    }
+    if (header.newLength == 0 || header.newLength > target->size) {
+        fail("new image larger than the other slot");
+        return false;
+    }
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    hashed = 0;
+    state = FirmwareState::VERIFYING;
+    SYS_INFO("Firmware update %u: %u byte patch, %lu -> %lu bytes into %s", updateId, (unsigned)patchLength,
+             (unsigned long)header.oldLength, (unsigned long)header.newLength, target->label);
+    return true;
+}
+
+bool FirmwareUpdater::stepVerify() {
+    for (size_t step = 0; step < FIRMWARE_APPLY_STEP_BYTES && hashed < header.oldLength;
+         step += FIRMWARE_SECTOR_BYTES) {
+        size_t n = min((size_t)FIRMWARE_SECTOR_BYTES, header.oldLength - hashed);
+        if (esp_partition_read(running, hashed, sector, n) != ESP_OK) {
+            fail("running image unreadable");
+            return false;
+        }
+        mbedtls_sha256_update(&sha, sector, n);
+        hashed += n;
+    }
+    if (hashed < header.oldLength) {
+        return true;
+    }
+
+    uint8_t digest[FIRMWARE_HASH_SIZE];
+    mbedtls_sha256_finish(&sha, digest);
+    if (memcmp(digest, header.oldHash, FIRMWARE_HASH_SIZE) != 0) {
+        fail("running image isn't the patch's base");
+        return false;
+    }
+
+    // Sequential writes erase each sector as it is reached, not the whole slot up front
+    esp_err_t err = esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES, &otaHandle);
+    if (err != ESP_OK) {
+        fail("esp_ota_begin failed");
+        return false;
+    }
+    otaOpen = true;
+
+    mbedtls_sha256_free(&sha);
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    patchPos = FIRMWARE_PATCH_HEADER_SIZE;
+    opCode = FIRMWARE_OP_SEEK;
+    opRemaining = 0;
+    oldPos = 0;
+    written = 0;
+    state = FirmwareState::APPLYING;
+    return true;
+}
+
+bool FirmwareUpdater::stepApply() {
+    for (size_t step = 0; step < FIRMWARE_APPLY_STEP_BYTES; step += FIRMWARE_SECTOR_BYTES) {
+        size_t filled = 0;
+        if (!fillSector(filled)) {
+            return false;
+        }
+        if (filled > 0) {
+            if (esp_ota_write(otaHandle, sector, filled) != ESP_OK) {
+                fail("esp_ota_write failed");
+                return false;
+            }
+            mbedtls_sha256_update(&sha, sector, filled);
+            written += filled;
+        }
+        if (opCode == FIRMWARE_OP_END) {
+            return finishApply();
+        }
+    }
+    return true;
+}
+
+bool FirmwareUpdater::nextOp() {
+    if (patchPos >= patchLength) {
+        fail("patch has no END");
+        return false;
+    }
+    opCode = patch[patchPos++];
+    opRemaining = 0;
+    if (opCode == FIRMWARE_OP_END) {
+        return true;
+    }
+    if (opCode > FIRMWARE_OP_SEEK) {
+        fail("unknown patch op");
+        return false;
+    }
+
+    // Unsigned LEB128, 32 bits at most
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        if (patchPos >= patchLength || shift > 28) {
+            fail("patch op length cut short");
+            return false;
+        }
+        uint8_t byte = patch[patchPos++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+
+    if (opCode == FIRMWARE_OP_SEEK) {
+        oldPos += (value & 1) ? -static_cast<int64_t>(value >> 1) - 1 : static_cast<int64_t>(value >> 1);
+    } else {
+        opRemaining = value;
+    }
+    return true;
+}
+
+bool FirmwareUpdater::fillSector(size_t& filled) {
+    filled = 0;
+    while (filled < FIRMWARE_SECTOR_BYTES) {
+        if (opRemaining == 0) {
+            if (opCode == FIRMWARE_OP_END) {
+                break;
+            }
+            if (!nextOp()) {
+                return false;
+            }
+            continue;
+        }
+
+        size_t n = min((size_t)opRemaining, (size_t)FIRMWARE_SECTOR_BYTES - filled);
+        if (written + filled + n > header.newLength) {
+            fail("patch runs past the new length");
+            return false;
+        }
+        bool fromPatch = opCode != FIRMWARE_OP_COPY;
+        if (fromPatch && patchPos + n > patchLength) {
+            fail("patch data cut short");
+            return false;
+        }
+
+        if (opCode == FIRMWARE_OP_INSERT) {
+            memcpy(&sector[filled], &patch[patchPos], n);
+        } else {
+            // The old bytes straight into the sector, the diff added in place
+            if (oldPos < 0 || oldPos + (int64_t)n > (int64_t)header.oldLength) {
+                fail("patch reads outside the base image");
+                return false;
+            }
+            if (esp_partition_read(running, (size_t)oldPos, &sector[filled], n) != ESP_OK) {
+                fail("running image unreadable");
+                return false;
+            }
+            if (opCode == FIRMWARE_OP_DIFF) {
+                for (size_t i = 0; i < n; i++) {
+                    sector[filled + i] += patch[patchPos + i];
+                }
+            }
+            oldPos += n;
+        }
+        if (fromPatch) {
+            patchPos += n;
+        }
+        filled += n;
+        opRemaining -= n;
+    }
+    return true;
+}
+
+bool FirmwareUpdater::finishApply() {
+    if (written != header.newLength) {
+        fail("patch ends short of the new length");
+        return false;
+    }
+
+    uint8_t digest[FIRMWARE_HASH_SIZE];
+    mbedtls_sha256_finish(&sha, digest);
+    if (memcmp(digest, header.newHash, FIRMWARE_HASH_SIZE) != 0) {
+        fail("new image hash mismatch");
+        return false;
+    }
+
+    // Checks the image header and its appended digest too
+    otaOpen = false;
+    esp_err_t err = esp_ota_end(otaHandle);
+    if (err != ESP_OK) {
+        fail("image refused by esp_ota_end");
+        return false;
+    }
+
+    // The patch has done its work; the header's hashes stay for activate()
+    release();
+    patchesApplied++;
+    state = FirmwareState::READY;
+    SYS_INFO("Firmware update %u ready in %s - activate with %02x%02x%02x%02x", updateId, target->label,
+             header.newHash[0], header.newHash[1], header.newHash[2], header.newHash[3]);
+    return true;
+}
+
+// ===========================
+// Commands
+// ===========================
+
+bool FirmwareUpdater::activate(const uint8_t* hashPrefix, size_t length) {
+    if (state != FirmwareState::READY || length < FIRMWARE_ACTIVATE_PARAMS ||
+        memcmp(hashPrefix, header.newHash, FIRMWARE_ACTIVATE_PARAMS) != 0) {
+        return false;
+    }
+    esp_err_t err = esp_ota_set_boot_partition(target);
+    if (err != ESP_OK) {
+        fail("esp_ota_set_boot_partition failed");
+        return false;
+    }
+    state = FirmwareState::RESTARTING;
+    restartAt = millis() + FIRMWARE_RESTART_DELAY_MS;
+    SYS_INFO("Firmware update %u: booting %s in %lu ms", updateId, target->label,
+             (unsigned long)FIRMWARE_RESTART_DELAY_MS);
+    return true;
+}
+
+void FirmwareUpdater::abort() {
+    if (state == FirmwareState::RESTARTING) {
+        // The boot partition is set; the other slot is still good to go back to
+        esp_ota_set_boot_partition(running);
+    }
+    release();
+    state = FirmwareState::IDLE;
+}
+
+void FirmwareUpdater::fail(const char* why) {
+    SYS_WARNING("Firmware update %u failed: %s", updateId, why);
+    release();
+    failure = why;
+    state = FirmwareState::FAILED;
+    patchesFailed++;
+}
+
+void FirmwareUpdater::release() {
+    if (otaOpen) {
+        esp_ota_abort(otaHandle);
+        otaOpen = false;
+    }
+    if (state == FirmwareState::VERIFYING || state == FirmwareState::APPLYING) {
+        mbedtls_sha256_free(&sha);
+    }
+    if (patch) {
+        memFree(MemTag::FIRMWARE, patch);
+        patch = nullptr;
+    }
+    patchCapacity = 0;
+    patchLength = 0;
+    chunksHeld = 0;
+}
+
+// ===========================
+// Status
+// ===========================
+
+FirmwareStatus FirmwareUpdater::getStatus() const {
+    FirmwareStatus status;
+    status.state = state;
+    status.updateId = updateId;
+    status.chunksHeld = __builtin_popcount(chunksHeld);
+    status.chunkCount = chunkCount;
+    status.patchLength = patchLength;
+    status.oldLength = header.oldLength;
+    status.newLength = header.newLength;
+    status.done = state == FirmwareState::VERIFYING ? hashed : written;
+    status.failure = state == FirmwareState::FAILED ? failure : nullptr;
+    return status;
+}
+
+const char* FirmwareUpdater::stateToString(FirmwareState state) {
+    switch (state) {
+        case FirmwareState::IDLE: return "idle";
+        case FirmwareState::RECEIVING: return "receiving";
+        case FirmwareState::VERIFYING: return "verifying";
+        case FirmwareState::APPLYING: return "applying";
+        case FirmwareState::READY: return "ready";
+        case FirmwareState::RESTARTING: return "restarting";
+        case FirmwareState::FAILED: return "failed";
+        default: return "unknown";
+    }
+}
+
+void FirmwareUpdater::printStatus() const {
+    FirmwareStatus status = getStatus();
+    Serial.println("=== Firmware Update ===");
+    Serial.printf("Update %u: %s", status.updateId, stateToString(status.state));
+    switch (status.state) {
+        case FirmwareState::RECEIVING:
+            Serial.printf(", %u/%u chunks", status.chunksHeld, status.chunkCount);
+            break;
+        case FirmwareState::VERIFYING:
+            Serial.printf(", %lu/%lu bytes hashed", (unsigned long)status.done, (unsigned long)status.oldLength);
+            break;
+        case FirmwareState::APPLYING:
+            Serial.printf(", %lu/%lu bytes written", (unsigned long)status.done, (unsigned long)status.newLength);
+            break;
+        case FirmwareState::FAILED:
+            Serial.printf(" - %s", status.failure);
+            break;
+        default:
+            break;
+    }
+    Serial.printf("\nChunks: %lu, applied: %lu, failed: %lu\n", (unsigned long)chunksReceived,
+                  (unsigned long)patchesApplied, (unsigned long)patchesFailed);
+}
@@ -0,0 +1,189 @@
+#ifndef FIRMWARE_UPDATE_H
+#define FIRMWARE_UPDATE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include "balloon_config.h"
+#include "common_types.h"
+#include "fragment_transfer.h"
+
+// ===========================
+// Firmware Update
+// A delta against the running app, sent up in FIRMWARE_DELTA fragment
+// transfers and applied into the other OTA slot a step at a time
+// ===========================
+
+// A whole image is 1.5 MB, hours of uplink; a patch against the image the
+// balloon is running is what changed. tools/make_delta.py builds it from
+// the two .bin files, and the base station's POST /api/firmware sends it.
+//
+// Patch, big endian:
+//   [0..3]    "BDLT"
+//   [4]       FIRMWARE_PATCH_VERSION
+//   [5..7]    zero
+//   [8..11]   old image length
+//   [12..43]  SHA-256 of the running partition's first old-length bytes
+//   [44..47]  new image length
+//   [48..79]  SHA-256 of the new image
+//   [80..]    ops, each an opcode and an unsigned LEB128 length n:
+//               0x00 COPY n     n old bytes at the old cursor, which moves on n
+//               0x01 DIFF n ..  n old bytes, each plus the next patch byte mod 256
+//               0x02 INSERT n ..  the next n patch bytes; the old cursor stays
+//               0x03 SEEK z     the old cursor moves by z, zigzag signed
+//               0xFF END
+// COPY and DIFF are bsdiff's add block, with the runs of zeroes bsdiff
+// leaves to bzip2 turned into COPY; SEEK is its seek.
+//
+// A patch is too big for one fragment transfer, so it goes up in chunks,
+// one transfer each, the FIRMWARE_DELTA payload being
+//   [0..1]  update id
+//   [2]     chunk index
+//   [3]     chunk count, at most FIRMWARE_DELTA_MAX_CHUNKS
+//   [4..]   patch bytes, FIRMWARE_CHUNK_DATA_BYTES in every chunk but the last
+// A chunk of another update id starts over. Held chunks go into one PSRAM
+// buffer; once they all are, update() on the uplink task hashes the
+// running image against the patch's old SHA-256 - a patch for other
+// firmware stops there, before anything is erased - then writes the new
+// image through esp_ota_write(), its sectors erased as it goes. Each call
+// reads or writes FIRMWARE_APPLY_STEP_BYTES, through one sector-sized
+// buffer; the old bytes are read straight into it and the diff added in
+// place. The new image's SHA-256 must match before esp_ota_end() and
+// READY.
+//
+// Nothing boots it until FIRMWARE_ACTIVATE with the first four bytes of
+// that hash (command_dispatch.cpp) sets the boot partition; the uplink
+// task restarts FIRMWARE_RESTART_DELAY_MS later, so the ACK goes first.
+// confirmBoot(), once setup() is through, marks a new image valid; with
+// the bootloader's rollback enabled one that doesn't get that far goes
+// back to the old slot on the next reset.
+//
+// Owned by the uplink task: the transfer callback, update() and the
+// commands all run there.
+
+#define FIRMWARE_PATCH_MAGIC         0x42444C54  // "BDLT"
+#define FIRMWARE_PATCH_VERSION       1
+#define FIRMWARE_PATCH_HEADER_SIZE   80
+#define FIRMWARE_HASH_SIZE           32
+#define FIRMWARE_CHUNK_HEADER_SIZE   4
+#define FIRMWARE_CHUNK_DATA_BYTES    (FRAGMENT_MAX_TRANSFER_BYTES - FIRMWARE_CHUNK_HEADER_SIZE)
+#define FIRMWARE_DELTA_MAX_BYTES     (FIRMWARE_DELTA_MAX_CHUNKS * FIRMWARE_CHUNK_DATA_BYTES)
+#define FIRMWARE_SECTOR_BYTES        4096
+#define FIRMWARE_ACTIVATE_PARAMS     4           // New image SHA-256 prefix
+
+#define FIRMWARE_OP_COPY             0x00
+#define FIRMWARE_OP_DIFF             0x01
+#define FIRMWARE_OP_INSERT           0x02
+#define FIRMWARE_OP_SEEK             0x03
+#define FIRMWARE_OP_END              0xFF
+
+static_assert(FIRMWARE_DELTA_MAX_CHUNKS <= 8, "Chunks held are one byte of bits");
+static_assert(FIRMWARE_APPLY_STEP_BYTES % FIRMWARE_SECTOR_BYTES == 0, "Steps write whole sectors");
+
+enum class FirmwareState : uint8_t {
+    IDLE = 0,
+    RECEIVING,      // Chunks of the patch arriving
+    VERIFYING,      // Hashing the running image
+    APPLYING,       // Writing the other slot
+    READY,          // Written and verified; waits for FIRMWARE_ACTIVATE
+    RESTARTING,
+    FAILED
+};
+
+struct FirmwarePatchHeader {
+    uint32_t oldLength;
+    uint8_t oldHash[FIRMWARE_HASH_SIZE];
+    uint32_t newLength;
+    uint8_t newHash[FIRMWARE_HASH_SIZE];
+};
+
+struct FirmwareStatus {
+    FirmwareState state;
+    uint16_t updateId;
+    uint8_t chunksHeld;
+    uint8_t chunkCount;
+    uint32_t patchLength;       // Once the last chunk is held
+    uint32_t oldLength;         // From the header
+    uint32_t newLength;
+    uint32_t done;              // Bytes hashed or written in the current state
+    const char* failure;        // Why, in FAILED
+};
+
+class FirmwareUpdater {
+public:
+    FirmwareUpdater();
+
+    // After setup(): a new image that got this far is kept
+    void confirmBoot();
+
+    // FragmentMgr()'s completion callback; other content types are ignored
+    static void onTransferComplete(void* context, uint8_t deviceId, PacketType contentType,
+                                   const uint8_t* data, size_t length);
+    bool receiveChunk(const uint8_t* payload, size_t length);
+
+    // Uplink task, every iteration: one step of whatever is under way
+    void update();
+    // FIRMWARE_RESTART_DELAY_MS after an activate; the caller restarts
+    bool isRestartDue() const;
+
+    // FIRMWARE_ACTIVATE and FIRMWARE_ABORT
+    bool activate(const uint8_t* hashPrefix, size_t length);
+    void abort();
+
+    FirmwareStatus getStatus() const;
+    static const char* stateToString(FirmwareState state);
+    void printStatus() const;
+
+private:
+    FirmwareState state;
+    const char* failure;
+    uint16_t updateId;
+    uint8_t chunkCount;
+    uint8_t chunksHeld;         // Bit per chunk index
+    uint8_t* patch;             // FIRMWARE_DELTA_MAX_BYTES at most, PSRAM
+    size_t patchCapacity;
+    size_t patchLength;
+    uint32_t lastChunkAt;
+    FirmwarePatchHeader header;
+
+    // Verifying and applying
+    const esp_partition_t* running;
+    const esp_partition_t* target;
+    esp_ota_handle_t otaHandle;
+    bool otaOpen;
+    mbedtls_sha256_context sha;
+    size_t hashed;
+    size_t patchPos;            // Next op or op data byte
+    uint8_t opCode;             // Op in progress
+    uint32_t opRemaining;
+    int64_t oldPos;
+    size_t written;
+    uint32_t restartAt;
+
+    uint8_t sector[FIRMWARE_SECTOR_BYTES];
+
+    // Statistics
+    uint32_t chunksReceived;
+    uint32_t patchesApplied;
+    uint32_t patchesFailed;
+
+    bool parseHeader();
+    bool startApply();
+    bool stepVerify();
+    bool stepApply();
+    bool nextOp();
+    bool fillSector(size_t& filled);
+    bool finishApply();
+    void fail(const char* why);
+    void release();
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern FirmwareUpdater& Firmware();
+
+#endif // FIRMWARE_UPDATE_H
@@ -0,0 +1,601 @@
+#include "flight_recorder.h"
+#include "crc_utils.h"
+#include "task_placement.h"
+#include "packet_handler.h"
+#include "system_state.h"
+#include "lora_comm.h"
+#include "esp_system.h"
+
+static_assert(TelemetrySchema::size <= FLIGHT_RECORDER_MAX_PAYLOAD, "TelemetrySchema exceeds the payload limit");
+static_assert(GPSSchema::size <= FLIGHT_RECORDER_MAX_PAYLOAD, "GPSSchema exceeds the payload limit");
+
+// ===========================
+// Global Instance
+// ===========================
+
+static FlightRecorder flightRecorderInstance;
+
+FlightRecorder& FlightRec() {
+    return flightRecorderInstance;
+}
+
+// ===========================
+// Helpers
+// ===========================
+
+static uint16_t recordCrc(uint32_t timestamp, uint8_t type, uint8_t length, const uint8_t* payload) {
+    uint8_t prefix[6];
+    memcpy(prefix, &timestamp, sizeof(timestamp));
+    prefix[4] = type;
+    prefix[5] = length;
+    uint16_t crc = crc16CcittUpdate(CRC16_CCITT_INIT, prefix, sizeof(prefix));
+    return crc16CcittUpdate(crc, payload, length);
+}
+
+static bool isErased(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t FlightRecorder::sectorCrc(const FlightSectorHeader& header) {
+    return crc16Ccitt(reinterpret_cast<const uint8_t*>(&header), offsetof(FlightSectorHeader, headerCrc));
+}
+
+bool FlightRecorder::checkSector(const uint8_t* sector) {
+    FlightSectorHeader header;
+    memcpy(&header, sector, sizeof(header));
+    return header.magic == FLIGHT_RECORDER_MAGIC && header.version == FLIGHT_RECORDER_VERSION &&
+           header.headerCrc == sectorCrc(header);
+}
+
+bool FlightRecorder::checkRecord(const uint8_t* record, size_t space) {
+    FlightRecordHeader header;
+    if (space < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, record, sizeof(header));
+    if (header.type == (uint8_t)FlightRecordType::ERASED || header.length > FLIGHT_RECORDER_MAX_PAYLOAD ||
+        recordSize(header.length) > space) {
+        return false;
+    }
+    return header.crc == recordCrc(header.timestamp, header.type, header.length, record + sizeof(header));
+}
+
+const char* FlightRecorder::recordTypeToString(uint8_t type) {
+    switch (static_cast<FlightRecordType>(type)) {
+        case FlightRecordType::TELEMETRY: return "TELEMETRY";
+        case FlightRecordType::GPS: return "GPS";
+        case FlightRecordType::EVENT: return "EVENT";
+        case FlightRecordType::LINK: return "LINK";
+        case FlightRecordType::BOOT: return "BOOT";
+        case FlightRecordType::RAW_GPS: return "RAW_GPS";
+        case FlightRecordType::RAW_BARO: return "RAW_BARO";
+        case FlightRecordType::BARO_TRIM: return "BARO_TRIM";
+        case FlightRecordType::RADIO_RX: return "RADIO_RX";
+        case FlightRecordType::CAMERA_FRAME: return "CAMERA_FRAME";
+        case FlightRecordType::BACKLOG: return "BACKLOG";
+        case FlightRecordType::TASK_STALL: return "TASK_STALL";
+        case FlightRecordType::LINK_FRAME: return "LINK_FRAME";
+        default: return "Unknown";
+    }
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+FlightRecorder::FlightRecorder() {
+    initialized = false;
+    capturing = false;
+    partition = nullptr;
+    sectorCount = 0;
+
+    mapped = nullptr;
+    mapHandle = 0;
+
+    head = 0;
+    headSequence = 0;
+    nextErased = -1;
+
+    memset(batchLength, 0, sizeof(batchLength));
+    fillBatch = 0;
+    writeBusy = false;
+    batchStarted = 0;
+    portMUX_INITIALIZE(&batchLock);
+    recorderTask = nullptr;
+    writeHook = nullptr;
+
+    recordsWritten = 0;
+    recordsDropped = 0;
+    sectorsErased = 0;
+    bytesWritten = 0;
+    lastWriteDuration = 0;
+}
+
+FlightRecorder::~FlightRecorder() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool FlightRecorder::begin(const char* firmwareVersion) {
+    if (initialized) {
+        return true;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         FLIGHT_RECORDER_PARTITION_LABEL);
+    if (!partition || partition->size < 2 * FLIGHT_RECORDER_SECTOR_SIZE) {
+        if (DEBUG_SERIAL) {
+            Serial.println("FlightRecorder: No usable \"" FLIGHT_RECORDER_PARTITION_LABEL "\" partition");
+        }
+        partition = nullptr;
+        return false;
+    }
+    sectorCount = partition->size / FLIGHT_RECORDER_SECTOR_SIZE;
+
+    const void* view = nullptr;
+    if (esp_partition_mmap(partition, 0, sectorCount * FLIGHT_RECORDER_SECTOR_SIZE, ESP_PARTITION_MMAP_DATA,
+                           &view, &mapHandle) != ESP_OK) {
+        partition = nullptr;
+        return false;
+    }
+    mapped = static_cast<const uint8_t*>(view);
+
+    uint32_t start = millis();
+    if (!scan() ||
+        createPlacedTask(TaskId::FLIGHT_RECORDER, recorderTaskEntry, this, &recorderTask) != pdPASS) {
+        recorderTask = nullptr;
+        esp_partition_munmap(mapHandle);
+        mapped = nullptr;
+        partition = nullptr;
+        return false;
+    }
+    initialized = true;
+
+    if (DEBUG_SERIAL) {
+        Serial.printf("FlightRecorder: %lu sectors, sector %lu seq %lu at +%lu, scanned in %lu ms\n",
+                      sectorCount, headSector(), headSequence, head - headSector() * FLIGHT_RECORDER_SECTOR_SIZE,
+                      millis() - start);
+    }
+
+    uint8_t boot[1 + 16] = { static_cast<uint8_t>(esp_reset_reason()) };
+    size_t versionLength = firmwareVersion ? strnlen(firmwareVersion, sizeof(boot) - 1) : 0;
+    memcpy(&boot[1], firmwareVersion, versionLength);
+    record(FlightRecordType::BOOT, boot, 1 + versionLength);
+    return true;
+}
+
+void FlightRecorder::end() {
+    if (!initialized) {
+        return;
+    }
+
+    sync();
+    initialized = false;
+    if (!writeBusy && recorderTask) {
+        vTaskDelete(recorderTask);
+        recorderTask = nullptr;
+    }
+    // Left mapped if the task outlived the wait
+    if (!recorderTask) {
+        esp_partition_munmap(mapHandle);
+        mapped = nullptr;
+        partition = nullptr;
+    }
+}
+
+bool FlightRecorder::isSectorValid(uint32_t sector) const {
+    return checkSector(mapped + sector * FLIGHT_RECORDER_SECTOR_SIZE);
+}
+
+// Finds the newest sector and reads its records back to the first one
+// that doesn't check; only clean erased flash after it is resumed on
+bool FlightRecorder::scan() {
+    bool found = false;
+    uint32_t newest = 0;
+    for (uint32_t sector = 0; sector < sectorCount; sector++) {
+        if (!isSectorValid(sector)) {
+            continue;
+        }
+        FlightSectorHeader header;
+        memcpy(&header, mapped + sector * FLIGHT_RECORDER_SECTOR_SIZE, sizeof(header));
+        if (!found || (int32_t)(header.sequence - headSequence) > 0) {
+            headSequence = header.sequence;
+            newest = sector;
+            found = true;
+        }
+    }
+    if (!found) {
+        headSequence = 0;
+        return openSector(0);
+    }
+
+    const uint8_t* base = mapped + newest * FLIGHT_RECORDER_SECTOR_SIZE;
+    uint32_t pos = sizeof(FlightSectorHeader);
+    while (pos < FLIGHT_RECORDER_SECTOR_SIZE && checkRecord(base + pos, FLIGHT_RECORDER_SECTOR_SIZE - pos)) {
+        FlightRecordHeader header;
+        memcpy(&header, base + pos, sizeof(header));
+        pos += recordSize(header.length);
+    }
+    if (pos < FLIGHT_RECORDER_SECTOR_SIZE && isErased(base + pos, FLIGHT_RECORDER_SECTOR_SIZE - pos)) {
+        head = newest * FLIGHT_RECORDER_SECTOR_SIZE + pos;
+        return true;
+    }
+    return openSector((newest + 1) % sectorCount);
+}
+
+// ===========================
+// Sectors
+// ===========================
+
+bool FlightRecorder::eraseSector(uint32_t sector) {
+    if (esp_partition_erase_range(partition, sector * FLIGHT_RECORDER_SECTOR_SIZE,
+                                  FLIGHT_RECORDER_SECTOR_SIZE) != ESP_OK) {
+        return false;
+    }
+    sectorsErased++;
+    return true;
+}
+
+bool FlightRecorder::openSector(uint32_t sector) {
+    if (nextErased != (int32_t)sector && !eraseSector(sector)) {
+        return false;
+    }
+    nextErased = -1;
+
+    FlightSectorHeader header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = FLIGHT_RECORDER_MAGIC;
+    header.sequence = headSequence + 1;
+    header.version = FLIGHT_RECORDER_VERSION;
+    header.headerCrc = sectorCrc(header);
+    if (esp_partition_write(partition, sector * FLIGHT_RECORDER_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    headSequence = header.sequence;
+    head = sector * FLIGHT_RECORDER_SECTOR_SIZE + sizeof(header);
+
+    // The next erase is paid now, while this sector fills, rather than when
+    // the batch that needs it is waiting
+    uint32_t next = (sector + 1) % sectorCount;
+    if (eraseSector(next)) {
+        nextErased = next;
+    }
+    return true;
+}
+
+const uint8_t* FlightRecorder::getSector(uint32_t index) const {
+    if (!mapped) {
+        return nullptr;
+    }
+
+    // Oldest is the first valid sector after the one being written
+    uint32_t current = headSector();
+    for (uint32_t step = 1; step <= sectorCount; step++) {
+        uint32_t sector = (current + step) % sectorCount;
+        if (isSectorValid(sector) && index-- == 0) {
+            return mapped + sector * FLIGHT_RECORDER_SECTOR_SIZE;
+        }
+    }
+    return nullptr;
+}
+
+const uint8_t* FlightRecorder::getMapped(uint32_t offset) const {
+    if (!mapped || offset >= sectorCount * FLIGHT_RECORDER_SECTOR_SIZE) {
+        return nullptr;
+    }
+    return mapped + offset;
+}
+
+// ===========================
+// Recording
+// ===========================
+
+bool FlightRecorder::record(FlightRecordType type, const uint8_t* payload, size_t length) {
+    if (!initialized || length > FLIGHT_RECORDER_MAX_PAYLOAD || (length && !payload)) {
+        return false;
+    }
+
+    uint8_t entry[sizeof(FlightRecordHeader) + FLIGHT_RECORDER_MAX_PAYLOAD + 3];
+    uint32_t size = recordSize(length);
+    FlightRecordHeader header;
+    header.type = static_cast<uint8_t>(type);
+    header.length = length;
+    header.timestamp = millis();
+    header.crc = recordCrc(header.timestamp, header.type, header.length, payload);
+    memcpy(entry, &header, sizeof(header));
+    memcpy(entry + sizeof(header), payload, length);
+    memset(entry + sizeof(header) + length, 0xFF, size - sizeof(header) - length);
+
+    bool stored = true;
+    bool handed = false;
+    portENTER_CRITICAL(&batchLock);
+    if (batchLength[fillBatch] + size > FLIGHT_RECORDER_BATCH_BYTES) {
+        handed = handOver();
+    }
+    if (batchLength[fillBatch] + size <= FLIGHT_RECORDER_BATCH_BYTES) {
+        if (batchLength[fillBatch] == 0) {
+            batchStarted = header.timestamp;
+        }
+        memcpy(&batches[fillBatch][batchLength[fillBatch]], entry, size);
+        batchLength[fillBatch] += size;
+    } else {
+        recordsDropped++;
+        stored = false;
+    }
+    portEXIT_CRITICAL(&batchLock);
+
+    if (handed) {
+        xTaskNotifyGive(recorderTask);
+    }
+    return stored;
+}
+
+bool FlightRecorder::handOver() {
+    if (writeBusy || batchLength[fillBatch] == 0) {
+        return false;
+    }
+    fillBatch ^= 1;
+    writeBusy = true;
+    return true;
+}
+
+bool FlightRecorder::recordTelemetry(const TelemetryData& data) {
+    uint8_t payload[TelemetrySchema::size];
+    TelemetrySchema::encode(data, payload);
+    return record(FlightRecordType::TELEMETRY, payload, sizeof(payload));
+}
+
+bool FlightRecorder::recordGps(const GPSData& data) {
+    uint8_t payload[GPSSchema::size];
+    GPSSchema::encode(data, payload);
+    return record(FlightRecordType::GPS, payload, sizeof(payload));
+}
+
+bool FlightRecorder::recordEvent(const SystemEvent& event) {
+    uint8_t payload[2 + EVENT_DATA_SIZE];
+    size_t length = min((size_t)event.dataLength, (size_t)EVENT_DATA_SIZE);
+    payload[0] = static_cast<uint8_t>(event.eventType);
+    payload[1] = event.priority;
+    memcpy(&payload[2], event.data, length);
+    return record(FlightRecordType::EVENT, payload, 2 + length);
+}
+
+bool FlightRecorder::recordLink() {
+    LoRaManager& lora = LoRaComm();
+    FlightLinkRecord link;
+    link.rssi = lora.getAverageRSSI();
+    link.snr = lora.getAverageSNR();
+    link.spreadingFactor = lora.getSpreadingFactor();
+    link.txPower = lora.getTxPower();
+    link.packetErrorRate = (uint16_t)constrain(lora.getPacketErrorRate() * 10000.0f, 0.0f, 10000.0f);
+    link.queued = lora.getTotalQueueSize();
+    link.airtimeUsedUs = lora.getAirtimeUsedUs();
+    link.transmitErrors = lora.getTransmitErrorCount();
+    link.receiveErrors = lora.getReceiveErrorCount();
+    link.crcErrors = lora.getCrcErrorCount();
+    link.ackTimeouts = lora.getAckTimeoutCount();
+    return record(FlightRecordType::LINK, reinterpret_cast<const uint8_t*>(&link), sizeof(link));
+}
+
+// ===========================
+// Raw Input Capture
+// ===========================
+
+bool FlightRecorder::captureGps(FlightGpsSource source, const uint8_t* data, size_t length) {
+    if (!isCapturing()) {
+        return false;
+    }
+
+    uint8_t payload[FLIGHT_RECORDER_MAX_PAYLOAD];
+    payload[0] = static_cast<uint8_t>(source);
+    bool stored = true;
+    while (length > 0) {
+        size_t chunk = min(length, sizeof(payload) - 1);
+        memcpy(&payload[1], data, chunk);
+        stored &= record(FlightRecordType::RAW_GPS, payload, 1 + chunk);
+        data += chunk;
+        length -= chunk;
+    }
+    return stored;
+}
+
+bool FlightRecorder::captureBaro(const uint8_t* raw, size_t length) {
+    return isCapturing() && record(FlightRecordType::RAW_BARO, raw, length);
+}
+
+bool FlightRecorder::captureBaroTrim(const uint8_t* trim, size_t length) {
+    return isCapturing() && record(FlightRecordType::BARO_TRIM, trim, length);
+}
+
+bool FlightRecorder::captureRadioRx(int8_t rssi, int8_t snr, const uint8_t* frame, size_t length) {
+    if (!isCapturing() || length > FLIGHT_RECORDER_MAX_PAYLOAD - 2) {
+        return false;
+    }
+    uint8_t payload[FLIGHT_RECORDER_MAX_PAYLOAD];
+    payload[0] = static_cast<uint8_t>(rssi);
+    payload[1] = static_cast<uint8_t>(snr);
+    memcpy(&payload[2], frame, length);
+    return record(FlightRecordType::RADIO_RX, payload, 2 + length);
+}
+
+bool FlightRecorder::captureCameraFrame(const FlightCameraRecord& frame) {
+    return isCapturing() &&
+           record(FlightRecordType::CAMERA_FRAME, reinterpret_cast<const uint8_t*>(&frame), sizeof(frame));
+}
+
+void FlightRecorder::update() {
+    if (!initialized) {
+        return;
+    }
+
+    bool handed = false;
+    portENTER_CRITICAL(&batchLock);
+    if (batchLength[fillBatch] > 0 && millis() - batchStarted >= FLIGHT_RECORDER_FLUSH_MS) {
+        handed = handOver();
+    }
+    portEXIT_CRITICAL(&batchLock);
+
+    if (handed) {
+        xTaskNotifyGive(recorderTask);
+    }
+}
+
+bool FlightRecorder::sync(uint32_t timeoutMs) {
+    if (!recorderTask) {
+        return false;
+    }
+
+    // Until neither batch holds anything: the one being written, then what
+    // filled meanwhile
+    uint32_t start = millis();
+    for (;;) {
+        bool handed = false;
+        bool pending;
+        portENTER_CRITICAL(&batchLock);
+        handed = handOver();
+        pending = writeBusy || batchLength[fillBatch] > 0;
+        portEXIT_CRITICAL(&batchLock);
+
+        if (handed) {
+            xTaskNotifyGive(recorderTask);
+        }
+        if (!pending) {
+            return true;
+        }
+        if (millis() - start >= timeoutMs) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+}
+
+// ===========================
+// Recorder Task
+// ===========================
+
+bool FlightRecorder::writeRun(const uint8_t* data, size_t length, uint32_t records) {
+    if (esp_partition_write(partition, head, data, length) != ESP_OK) {
+        // The rest of the sector is in an unknown state; start on the next
+        recordsDropped += records;
+        openSector((headSector() + 1) % sectorCount);
+        return false;
+    }
+    head += length;
+    bytesWritten += length;
+    recordsWritten += records;
+    return true;
+}
+
+// One esp_partition_write() per run of records that fits what's left of
+// the current sector
+void FlightRecorder::writeBatch(const uint8_t* data, size_t length) {
+    size_t pos = 0;
+    while (pos < length) {
+        uint32_t space = (headSector() + 1) * FLIGHT_RECORDER_SECTOR_SIZE - head;
+        size_t run = 0;
+        uint32_t records = 0;
+        while (pos + run < length) {
+            FlightRecordHeader header;
+            memcpy(&header, data + pos + run, sizeof(header));
+            uint32_t size = recordSize(header.length);
+            if (run + size > space) {
+                break;
+            }
+            run += size;
+            records++;
+        }
+
+        if (run == 0) {
+            if (!openSector((headSector() + 1) % sectorCount)) {
+                // Flash refuses the erase; what's left of the batch is lost
+                for (size_t rest = pos; rest < length; ) {
+                    FlightRecordHeader header;
+                    memcpy(&header, data + rest, sizeof(header));
+                    rest += recordSize(header.length);
+                    recordsDropped++;
+                }
+                return;
+            }
+            continue;
+        }
+        uint32_t offset = head;
+        if (writeRun(data + pos, run, records) && writeHook) {
+            for (size_t at = 0; at < run; ) {
+                FlightRecordHeader header;
+                memcpy(&header, data + pos + at, sizeof(header));
+                writeHook(header.type, offset + at, data + pos + at + sizeof(header), header.length);
+                at += recordSize(header.length);
+            }
+        }
+        pos += run;
+    }
+}
+
+void FlightRecorder::recorderTaskEntry(void* parameter) {
+    FlightRecorder* recorder = static_cast<FlightRecorder*>(parameter);
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!recorder->writeBusy) {
+            continue;
+        }
+
+        // fillBatch only moves on a hand-over, which waits for writeBusy
+        uint8_t batch = recorder->fillBatch ^ 1;
+        uint32_t start = millis();
+        recorder->writeBatch(recorder->batches[batch], recorder->batchLength[batch]);
+        recorder->lastWriteDuration = millis() - start;
+        recorder->batchLength[batch] = 0;
+        recorder->writeBusy = false;
+    }
+}
+
+// ===========================
+// Debug
+// ===========================
+
+void FlightRecorder::dumpRecords(Print& out) const {
+    out.println("sequence,timestamp,type,length,payload");
+    const uint8_t* base;
+    for (uint32_t index = 0; (base = getSector(index)) != nullptr; index++) {
+        FlightSectorHeader sector;
+        memcpy(&sector, base, sizeof(sector));
+
+        uint32_t pos = sizeof(FlightSectorHeader);
+        while (pos < FLIGHT_RECORDER_SECTOR_SIZE && checkRecord(base + pos, FLIGHT_RECORDER_SECTOR_SIZE - pos)) {
+            FlightRecordHeader header;
+            memcpy(&header, base + pos, sizeof(header));
+            out.printf("%lu,%lu,%s,%u,", sector.sequence, header.timestamp, recordTypeToString(header.type),
+                       header.length);
+            for (uint8_t i = 0; i < header.length; i++) {
+                out.printf("%02X", base[pos + sizeof(header) + i]);
+            }
+            out.println();
+            pos += recordSize(header.length);
+        }
+    }
+}
+
+void FlightRecorder::printStatus() const {
+    Serial.println("=== Flight Recorder Status ===");
+    Serial.printf("Initialized: %s\n", initialized ? "Yes" : "No");
+    if (!initialized) {
+        return;
+    }
+    Serial.printf("Partition: %lu KB in %lu sectors, sector %lu seq %lu at +%lu\n",
+                  partition->size / 1024, sectorCount, headSector(), headSequence,
+                  head - headSector() * FLIGHT_RECORDER_SECTOR_SIZE);
+    Serial.printf("Records: %lu written, %lu dropped, %lu bytes\n", recordsWritten, recordsDropped, bytesWritten);
+    Serial.printf("Sectors Erased: %lu\n", sectorsErased);
+    Serial.printf("Raw Capture: %s\n", capturing ? "On" : "Off");
+    Serial.printf("Batches: %u + %u bytes pending\n", (unsigned)batchLength[fillBatch], (unsigned)batchLength[fillBatch ^ 1]);
+    Serial.printf("Last Write: %lu ms%s\n", lastWriteDuration, writeBusy ? " (one in progress)" : "");
+}
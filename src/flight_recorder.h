@@ -0,0 +1,263 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "balloon_config.h"
+
+// ===========================
+// Flight Recorder
+// Append-only log of telemetry, position, system events and link statistics
+// in the "fr" flash partition, read back through a memory map after landing
+// ===========================
+
+// The partition is a ring of 4 KB sectors, each opened with a sector header
+// carrying a sequence number and filled with records that never cross into
+// the next sector. Recording only copies into one of two RAM batches; the
+// recorder task writes a full (or FLIGHT_RECORDER_FLUSH_MS old) batch in one
+// esp_partition_write() per sector touched, and erases the next sector as
+// soon as it starts on the current one, so neither a write nor an erase is
+// ever on loop()'s path.
+//
+// Every record carries a CRC over its header and payload, and a sector
+// header is written before any record in the sector. A write torn by a reset
+// leaves a record that fails its CRC; begin() reads back up to the first
+// record that doesn't check and, if that isn't clean erased flash, resumes on
+// the next sector, so a partial record is never followed by good ones. The
+// oldest sector is erased as the log wraps.
+//
+// With setCapture(true) the recorder also takes the raw inputs - GPS UART
+// bytes, BMP280 data and trim registers, received LoRa frames with their
+// RSSI and SNR, and each accepted camera frame's metadata - which
+// InputReplay (input_replay.h) feeds back through the parsers. They fill
+// the 128 KB partition in minutes, so capture is for bench and tethered
+// runs, not a flight.
+//
+// BACKLOG records are packets the link dropped, kept for LinkBacklog
+// (link_backlog.h) to send again. The write hook tells it where each
+// record landed as the task writes it; getMapped() reads it back.
+//
+// TASK_STALL records are TaskWatchdog's: a task past its budget, its state
+// and the top of its stack as it last left the CPU.
+//
+// LINK_FRAME records, with LINK_CAPTURE_FLIGHT_RECORDER, are pcap records
+// as they go into a capture file; /linkcap.pcap is a pcap header and them.
+//
+// Sector:
+//   [0-15]   FlightSectorHeader, CRC-16 CCITT over bytes 0-13
+//   [16..]   records, each FlightRecordHeader then payload padded to 4 bytes
+//   ...      erased (0xFF) after the last record
+
+#define FLIGHT_RECORDER_PARTITION_LABEL "fr"
+#define FLIGHT_RECORDER_MAGIC        0x31524C46  // "FLR1"
+#define FLIGHT_RECORDER_VERSION      1
+#define FLIGHT_RECORDER_SECTOR_SIZE  4096
+#define FLIGHT_RECORDER_BATCH_BYTES  1024        // Per RAM batch; two of them
+#define FLIGHT_RECORDER_MAX_PAYLOAD  248         // A record in 256 bytes; a LoRa frame with RSSI and SNR fits
+#define FLIGHT_RECORDER_FLUSH_MS     10000       // Oldest a record waits in RAM
+#define FLIGHT_RECORDER_LINK_INTERVAL_MS 30000
+#define FLIGHT_RECORDER_TRIM_INTERVAL_MS 60000    // BMP280 trim again, so a wrapped capture still has it
+
+enum class FlightRecordType : uint8_t {
+    TELEMETRY = 0x01,   // TelemetrySchema, as the keyframe carries it
+    GPS = 0x02,         // GPSSchema
+    EVENT = 0x03,       // EventType, priority, then the event's data
+    LINK = 0x04,        // FlightLinkRecord
+    BOOT = 0x05,        // Reset reason, firmware version string
+    RAW_GPS = 0x06,     // FlightGpsSource, then UART bytes as read
+    RAW_BARO = 0x07,    // BMP280 press_msb..temp_xlsb
+    BARO_TRIM = 0x08,   // BMP280 dig_T1..dig_P9
+    RADIO_RX = 0x09,    // RSSI, SNR, then the frame as received
+    CAMERA_FRAME = 0x0A,    // FlightCameraRecord
+    BACKLOG = 0x0B,     // FlightBacklogRecord, then the packet's payload
+    TASK_STALL = 0x0C,  // TaskStallRecord (task_watchdog.h)
+    LINK_FRAME = 0x0D,  // A pcap record: header, LinkCaptureHeader and frame (link_capture.h)
+    ERASED = 0xFF       // End of a sector's records
+};
+
+struct FlightSectorHeader {
+    uint32_t magic;
+    uint32_t sequence;          // Sector write order, across wraps and reboots
+    uint16_t version;
+    uint16_t reserved;
+    uint16_t reserved2;
+    uint16_t headerCrc;
+};
+
+struct FlightRecordHeader {
+    uint8_t type;               // FlightRecordType
+    uint8_t length;             // Payload bytes, before padding
+    uint16_t crc;               // CRC-16 CCITT over timestamp, type, length and payload
+    uint32_t timestamp;         // millis()
+};
+
+struct FlightLinkRecord {
+    int8_t rssi;                // dBm, averaged
+    int8_t snr;                 // dB, averaged
+    int8_t spreadingFactor;
+    int8_t txPower;             // dBm
+    uint16_t packetErrorRate;   // Per 10000
+    uint16_t queued;
+    uint32_t airtimeUsedUs;
+    uint32_t transmitErrors;
+    uint32_t receiveErrors;
+    uint32_t crcErrors;
+    uint32_t ackTimeouts;
+};
+
+enum class FlightGpsSource : uint8_t {
+    NMEA = 0,
+    UBX = 1
+};
+
+struct FlightCameraRecord {
+    int64_t timeUs;             // Start of readout, Clock() time
+    uint32_t length;            // JPEG bytes
+    uint16_t width;
+    uint16_t height;
+    uint16_t sharpness;         // 0 when not analyzed
+    uint8_t quality;
+    uint8_t novelty;
+    uint8_t frameSize;          // framesize_t
+    uint8_t reserved[3];
+};
+
+struct FlightBacklogRecord {
+    uint32_t id;                // LinkBacklog's, in spill order
+    uint32_t timestamp;         // The packet's header timestamp, seconds
+    uint32_t sampledAt;         // millis()
+    uint32_t createdAt;         // millis()
+    uint8_t type;               // PacketType
+    uint8_t priority;           // Priority
+    uint8_t reserved[2];
+};
+
+#define FLIGHT_BACKLOG_MAX_PAYLOAD (FLIGHT_RECORDER_MAX_PAYLOAD - sizeof(FlightBacklogRecord))
+
+// From the recorder task, once per record on flash; offset is the record
+// header's in the partition
+typedef void (*FlightWriteHook)(uint8_t type, uint32_t offset, const uint8_t* payload, size_t length);
+
+static_assert(sizeof(FlightSectorHeader) == 16, "Sector header is part of the flash format");
+static_assert(sizeof(FlightRecordHeader) == 8, "Record header is part of the flash format");
+static_assert(sizeof(FlightLinkRecord) <= FLIGHT_RECORDER_MAX_PAYLOAD, "Link record exceeds the payload limit");
+static_assert(sizeof(FlightCameraRecord) == 24, "Camera record is part of the flash format");
+static_assert(sizeof(FlightBacklogRecord) == 20, "Backlog record is part of the flash format");
+
+struct TelemetryData;
+struct GPSData;
+struct SystemEvent;
+
+class FlightRecorder {
+public:
+    FlightRecorder();
+    ~FlightRecorder();
+
+    // Records a BOOT with the reset reason and firmwareVersion
+    bool begin(const char* firmwareVersion);
+    void end();
+    bool isReady() const { return initialized; }
+
+    // Any task; copies into the current batch and returns. false when both
+    // batches are full (the record is dropped) or the recorder isn't running
+    bool record(FlightRecordType type, const uint8_t* payload, size_t length);
+    bool recordTelemetry(const TelemetryData& data);
+    bool recordGps(const GPSData& data);
+    bool recordEvent(const SystemEvent& event);
+    bool recordLink();
+
+    // Raw inputs, for replay; each a no-op unless capturing. GPS bytes are
+    // split across records as the payload limit needs
+    void setCapture(bool enabled) { capturing = enabled; }
+    bool isCapturing() const { return capturing && initialized; }
+    bool captureGps(FlightGpsSource source, const uint8_t* data, size_t length);
+    bool captureBaro(const uint8_t* raw, size_t length);
+    bool captureBaroTrim(const uint8_t* trim, size_t length);
+    bool captureRadioRx(int8_t rssi, int8_t snr, const uint8_t* frame, size_t length);
+    bool captureCameraFrame(const FlightCameraRecord& frame);
+
+    // From loop(): hands an aged batch to the task
+    void update();
+
+    void setWriteHook(FlightWriteHook hook) { writeHook = hook; }
+
+    // Hands the current batch over and waits until it is on flash - before a
+    // sleep or reset, and on an emergency
+    bool sync(uint32_t timeoutMs = 1000);
+
+    // Post-flight read-back through the partition's memory map, oldest sector first
+    uint32_t getSectorCount() const { return sectorCount; }
+    const uint8_t* getSector(uint32_t index) const;     // nullptr past the last written one
+    const uint8_t* getMapped(uint32_t offset) const;    // Partition offset; nullptr outside it. Check what's there
+    void dumpRecords(Print& out) const;                 // One line per record
+
+    // Statistics
+    uint32_t getRecordsWritten() const { return recordsWritten; }
+    uint32_t getRecordsDropped() const { return recordsDropped; }
+    uint32_t getSectorsErased() const { return sectorsErased; }
+    uint32_t getBytesWritten() const { return bytesWritten; }
+    size_t getCapacity() const { return partition ? partition->size : 0; }
+    void printStatus() const;
+
+    // The flash format, for readers of a mapped partition
+    static bool checkSector(const uint8_t* sector);
+    static bool checkRecord(const uint8_t* record, size_t space);
+    static uint32_t recordSize(uint8_t length) { return (sizeof(FlightRecordHeader) + length + 3) & ~(uint32_t)3; }
+    static const char* recordTypeToString(uint8_t type);
+
+private:
+    bool initialized;
+    bool capturing;
+    const esp_partition_t* partition;
+    uint32_t sectorCount;
+
+    // Read-only view of the partition
+    const uint8_t* mapped;
+    esp_partition_mmap_handle_t mapHandle;
+
+    // Log position - the task's; head is the partition offset the next
+    // record goes to, in the sector headed by headSequence, and nextErased
+    // the sector erased ahead of it
+    uint32_t head;
+    uint32_t headSequence;
+    int32_t nextErased;         // Sector index, -1 = none yet
+
+    // RAM batches - filled under batchLock, written by the task
+    uint8_t batches[2][FLIGHT_RECORDER_BATCH_BYTES];
+    size_t batchLength[2];
+    uint8_t fillBatch;          // The one record() appends to
+    volatile bool writeBusy;    // The other one is the task's
+    uint32_t batchStarted;      // millis() of the fill batch's first record
+    mutable portMUX_TYPE batchLock;
+    TaskHandle_t recorderTask;
+    FlightWriteHook writeHook;
+
+    // Statistics
+    uint32_t recordsWritten;
+    uint32_t recordsDropped;
+    uint32_t sectorsErased;
+    uint32_t bytesWritten;
+    uint32_t lastWriteDuration;     // ms
+
+    bool scan();
+    bool handOver();                    // Caller holds batchLock
+    bool openSector(uint32_t sector);
+    uint32_t headSector() const { return (head - 1) / FLIGHT_RECORDER_SECTOR_SIZE; }     // head is past a sector header, up to the sector's end
+    bool isSectorValid(uint32_t sector) const;
+    bool eraseSector(uint32_t sector);
+    void writeBatch(const uint8_t* data, size_t length);
+    bool writeRun(const uint8_t* data, size_t length, uint32_t records);
+    static uint16_t sectorCrc(const FlightSectorHeader& header);
+    static void recorderTaskEntry(void* parameter);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern FlightRecorder& FlightRec();
+
+#endif // FLIGHT_RECORDER_H
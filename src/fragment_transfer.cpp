@@ -0,0 +1,588 @@
+#include "fragment_transfer.h"
+#include "rx_pipeline.h"
+#include "memory_ledger.h"
+
+// ===========================
+// Global Instance
+// ===========================
+
+static FragmentManager fragmentManagerInstance;
+
+FragmentManager& FragmentMgr() {
+    return fragmentManagerInstance;
+}
+
+// ===========================
+// Bitmap Helpers
+// ===========================
+
+static inline bool testBit(const uint8_t* bitmap, uint16_t index) {
+    return bitmap[index >> 3] & (1 << (index & 7));
+}
+
+static inline void setBit(uint8_t* bitmap, uint16_t index) {
+    bitmap[index >> 3] |= 1 << (index & 7);
+}
+
+static inline size_t bitmapBytes(uint16_t count) {
+    return (count + 7) / 8;
+}
+
+static inline uint16_t readU16(const uint8_t* in) {
+    return (static_cast<uint16_t>(in[0]) << 8) | in[1];
+}
+
+static inline void writeU16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+FragmentManager::FragmentManager() {
+    initialized = false;
+    memset(&outgoing, 0, sizeof(outgoing));
+    sendBuffer = nullptr;
+    nextTransferId = 0;
+
+    memset(slots, 0, sizeof(slots));
+    reassemblyBytes = 0;
+    rejectPending = false;
+    rejectTransferId = 0;
+    rejectCount = 0;
+    mutex = nullptr;
+    completeHandler = nullptr;
+    completeContext = nullptr;
+
+    transfersSent = 0;
+    transfersFailed = 0;
+    fragmentsSent = 0;
+    fragmentsResent = 0;
+    transfersReassembled = 0;
+    reassemblyTimeouts = 0;
+    reassemblyRejects = 0;
+}
+
+FragmentManager::~FragmentManager() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool FragmentManager::begin() {
+    if (initialized) {
+        return true;
+    }
+
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex) {
+        return false;
+    }
+
+    // Seed from the clock so a reboot mid-transfer doesn't reuse the id the
+    // base station is still holding fragments for
+    nextTransferId = static_cast<uint8_t>(millis());
+
+    // Reassembly buffers come and go with every transfer; in blocks of
+    // their own they leave no holes in the heap between tens of KB of them
+    reassemblyPool.begin("reassembly", MemTag::FRAGMENTS, FRAGMENT_MAX_TRANSFER_BYTES, FRAGMENT_REASSEMBLY_SLOTS,
+                         MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    initialized = true;
+
+    if (DEBUG_PACKETS) {
+        Serial.printf("Fragment: Ready (%u bytes/fragment, %u byte max transfer)\n",
+                      FRAGMENT_DATA_SIZE, FRAGMENT_MAX_TRANSFER_BYTES);
+    }
+    return true;
+}
+
+void FragmentManager::end() {
+    if (!initialized) {
+        return;
+    }
+
+    cancelTransfer();
+    if (sendBuffer) {
+        memFree(MemTag::FRAGMENTS, sendBuffer);
+        sendBuffer = nullptr;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (size_t i = 0; i < FRAGMENT_REASSEMBLY_SLOTS; i++) {
+        freeSlot(slots[i]);
+    }
+    xSemaphoreGive(mutex);
+
+    vSemaphoreDelete(mutex);
+    mutex = nullptr;
+    initialized = false;
+}
+
+void* FragmentManager::allocate(size_t size) {
+    // Transfers are tens of KB - PSRAM when we have it
+    return memAlloc(MemTag::FRAGMENTS, size);
+}
+
+void FragmentManager::setTransferCompleteCallback(TransferCompleteHandler handler, void* context) {
+    completeHandler = handler;
+    completeContext = context;
+}
+
+bool FragmentManager::attachToPipeline() {
+    return RxPipeline().addSink(onRecordBatch);
+}
+
+// ===========================
+// Main Loop
+// ===========================
+
+void FragmentManager::process() {
+    if (!initialized) {
+        return;
+    }
+
+    pumpOutgoing();
+    serviceReassembly();
+}
+
+// ===========================
+// Sender
+// ===========================
+
+bool FragmentManager::sendPayload(PacketType contentType, const uint8_t* data, size_t length) {
+    PayloadPart part = {data, length};
+    return sendPayload(contentType, &part, 1);
+}
+
+bool FragmentManager::sendPayload(PacketType contentType, const PayloadPart* parts, size_t partCount) {
+    size_t length = 0;
+    for (size_t i = 0; i < partCount; i++) {
+        if (!parts[i].data && parts[i].length > 0) {
+            return false;
+        }
+        length += parts[i].length;
+    }
+    if (!initialized || outgoing.active || length == 0) {
+        return false;
+    }
+    if (length > FRAGMENT_MAX_TRANSFER_BYTES) {
+        if (DEBUG_PACKETS) {
+            Serial.printf("Fragment: %u byte payload exceeds %u byte limit\n",
+                          (unsigned)length, FRAGMENT_MAX_TRANSFER_BYTES);
+        }
+        return false;
+    }
+
+    if (!sendBuffer) {
+        sendBuffer = static_cast<uint8_t*>(allocate(FRAGMENT_MAX_TRANSFER_BYTES));
+        if (!sendBuffer) {
+            if (DEBUG_PACKETS) {
+                Serial.println("Fragment: Failed to allocate send buffer");
+            }
+            return false;
+        }
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < partCount; i++) {
+        memcpy(&sendBuffer[offset], parts[i].data, parts[i].length);
+        offset += parts[i].length;
+    }
+    memset(&outgoing, 0, sizeof(outgoing));
+    outgoing.active = true;
+    outgoing.transferId = nextTransferId++;
+    outgoing.contentType = contentType;
+    outgoing.length = length;
+    outgoing.count = static_cast<uint16_t>((length + FRAGMENT_DATA_SIZE - 1) / FRAGMENT_DATA_SIZE);
+    startPass();
+
+    if (DEBUG_PACKETS) {
+        Serial.printf("Fragment: Transfer %u - %u bytes in %u fragments\n",
+                      outgoing.transferId, (unsigned)length, outgoing.count);
+    }
+    return true;
+}
+
+void FragmentManager::cancelTransfer() {
+    if (outgoing.active) {
+        finishTransfer(false);
+    }
+}
+
+void FragmentManager::startPass() {
+    outgoing.nextIndex = 0;
+    outgoing.awaitingAck = false;
+    outgoing.polls = 0;
+
+    // The last gap carries the poll, so the ACK comes back as soon as the pass ends
+    outgoing.lastMissing = 0;
+    for (uint16_t i = outgoing.count; i > 0; i--) {
+        if (!testBit(outgoing.acked, i - 1)) {
+            outgoing.lastMissing = i - 1;
+            break;
+        }
+    }
+}
+
+void FragmentManager::pumpOutgoing() {
+    if (!outgoing.active) {
+        return;
+    }
+
+    uint32_t now = millis();
+
+    if (outgoing.awaitingAck) {
+        if (now - outgoing.pollSentAt < FRAGMENT_ACK_TIMEOUT_MS) {
+            return;
+        }
+        if (outgoing.polls >= FRAGMENT_MAX_POLLS) {
+            finishTransfer(false);
+            return;
+        }
+
+        // Poll or its ACK was lost - ask again with the last gap
+        if (sendFragment(outgoing.lastMissing, FRAGMENT_FLAG_POLL)) {
+            fragmentsResent++;
+            outgoing.polls++;
+            outgoing.pollSentAt = now;
+        }
+        return;
+    }
+
+    size_t sent = 0;
+    while (sent < FRAGMENT_PUMP_BUDGET && outgoing.nextIndex <= outgoing.lastMissing) {
+        // Fragments only take part of the queue, so telemetry behind them isn't refused
+        if (PacketMgr().getBufferUsage() >= FRAGMENT_QUEUE_SHARE) {
+            break;
+        }
+
+        uint16_t index = outgoing.nextIndex;
+        if (testBit(outgoing.acked, index)) {
+            outgoing.nextIndex++;
+            continue;
+        }
+
+        bool poll = index == outgoing.lastMissing;
+        if (!sendFragment(index, poll ? FRAGMENT_FLAG_POLL : 0)) {
+            break;
+        }
+        if (outgoing.passes > 0) {
+            fragmentsResent++;
+        }
+        outgoing.nextIndex++;
+        sent++;
+
+        if (poll) {
+            outgoing.awaitingAck = true;
+            outgoing.pollSentAt = now;
+            outgoing.polls = 1;
+        }
+    }
+}
+
+bool FragmentManager::sendFragment(uint16_t index, uint8_t flags) {
+    size_t offset = static_cast<size_t>(index) * FRAGMENT_DATA_SIZE;
+    size_t dataLength = outgoing.length - offset;
+    if (dataLength > FRAGMENT_DATA_SIZE) {
+        dataLength = FRAGMENT_DATA_SIZE;
+    }
+
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    payload[0] = outgoing.transferId;
+    writeU16(&payload[1], index);
+    writeU16(&payload[3], outgoing.count);
+    payload[5] = static_cast<uint8_t>(outgoing.contentType);
+    payload[6] = flags;
+    memcpy(&payload[FRAGMENT_HEADER_SIZE], &sendBuffer[offset], dataLength);
+
+    // Copied into a packet slot, so the stack buffer can go
+    if (!PacketMgr().createPacket(PacketType::FRAGMENT, payload, FRAGMENT_HEADER_SIZE + dataLength)) {
+        return false;
+    }
+
+    fragmentsSent++;
+    return true;
+}
+
+bool FragmentManager::handleAck(const uint8_t* payload, size_t length) {
+    if (!outgoing.active || !payload || length < FRAGMENT_ACK_HEADER_SIZE ||
+        payload[0] != outgoing.transferId) {
+        return false;
+    }
+
+    uint8_t flags = payload[1];
+    if (flags & FRAGMENT_ACK_REJECTED) {
+        finishTransfer(false);
+        return true;
+    }
+
+    uint16_t count = readU16(&payload[2]);
+    if (count != outgoing.count || length < FRAGMENT_ACK_HEADER_SIZE + bitmapBytes(count)) {
+        return false;
+    }
+
+    // Merge rather than replace - an old ACK can't un-receive anything
+    bool complete = true;
+    for (size_t i = 0; i < bitmapBytes(count); i++) {
+        outgoing.acked[i] |= payload[FRAGMENT_ACK_HEADER_SIZE + i];
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        if (!testBit(outgoing.acked, i)) {
+            complete = false;
+            break;
+        }
+    }
+
+    if (complete || (flags & FRAGMENT_ACK_COMPLETE)) {
+        finishTransfer(true);
+    } else if (outgoing.awaitingAck) {
+        // Next pass resends only the gaps
+        outgoing.passes++;
+        startPass();
+    }
+    return true;
+}
+
+void FragmentManager::finishTransfer(bool success) {
+    outgoing.active = false;
+    outgoing.awaitingAck = false;
+
+    if (success) {
+        transfersSent++;
+    } else {
+        transfersFailed++;
+    }
+
+    if (DEBUG_PACKETS) {
+        Serial.printf("Fragment: Transfer %u %s after %u passes\n", outgoing.transferId,
+                      success ? "complete" : "failed", outgoing.passes + 1);
+    }
+}
+
+// ===========================
+// Reassembler
+// ===========================
+
+bool FragmentManager::handleFragment(uint8_t deviceId, const uint8_t* payload, size_t length) {
+    if (!initialized || !payload || length <= FRAGMENT_HEADER_SIZE) {
+        return false;
+    }
+
+    uint8_t transferId = payload[0];
+    uint16_t index = readU16(&payload[1]);
+    uint16_t count = readU16(&payload[3]);
+    uint8_t flags = payload[6];
+    size_t dataLength = length - FRAGMENT_HEADER_SIZE;
+
+    // Every fragment but the last is full
+    bool last = index + 1 == count;
+    if (count == 0 || count > FRAGMENT_MAX_COUNT || index >= count ||
+        dataLength > FRAGMENT_DATA_SIZE || (!last && dataLength != FRAGMENT_DATA_SIZE)) {
+        return false;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+
+    ReassemblySlot* slot = findSlot(deviceId, transferId);
+    if (slot && slot->count != count) {
+        // Transfer id wrapped onto a stale reassembly
+        freeSlot(*slot);
+        slot = nullptr;
+    }
+    if (!slot) {
+        slot = claimSlot(deviceId, transferId, count);
+    }
+
+    if (!slot) {
+        reassemblyRejects++;
+        if (flags & FRAGMENT_FLAG_POLL) {
+            rejectPending = true;
+            rejectTransferId = transferId;
+            rejectCount = count;
+        }
+        xSemaphoreGive(mutex);
+        return false;
+    }
+
+    slot->lastActivity = millis();
+    if (!slot->complete && !testBit(slot->bitmap, index)) {
+        memcpy(&slot->buffer[static_cast<size_t>(index) * FRAGMENT_DATA_SIZE],
+               &payload[FRAGMENT_HEADER_SIZE], dataLength);
+        setBit(slot->bitmap, index);
+        slot->received++;
+        slot->contentType = static_cast<PacketType>(payload[5]);
+        if (last) {
+            slot->length = static_cast<size_t>(index) * FRAGMENT_DATA_SIZE + dataLength;
+        }
+    }
+    if (flags & FRAGMENT_FLAG_POLL) {
+        slot->ackPending = true;
+    }
+
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+ReassemblySlot* FragmentManager::findSlot(uint8_t deviceId, uint8_t transferId) {
+    for (size_t i = 0; i < FRAGMENT_REASSEMBLY_SLOTS; i++) {
+        if (slots[i].active && slots[i].deviceId == deviceId && slots[i].transferId == transferId) {
+            return &slots[i];
+        }
+    }
+    return nullptr;
+}
+
+ReassemblySlot* FragmentManager::claimSlot(uint8_t deviceId, uint8_t transferId, uint16_t count) {
+    size_t capacity = static_cast<size_t>(count) * FRAGMENT_DATA_SIZE;
+
+    // A delivered transfer waiting out late polls gives way to a new one
+    ReassemblySlot* slot = nullptr;
+    for (size_t i = 0; i < FRAGMENT_REASSEMBLY_SLOTS && !slot; i++) {
+        if (!slots[i].active) {
+            slot = &slots[i];
+        }
+    }
+    for (size_t i = 0; i < FRAGMENT_REASSEMBLY_SLOTS && !slot; i++) {
+        if (slots[i].complete) {
+            freeSlot(slots[i]);
+            slot = &slots[i];
+        }
+    }
+
+    if (!slot || reassemblyBytes + capacity > FRAGMENT_REASSEMBLY_MAX_BYTES) {
+        return nullptr;
+    }
+
+    uint8_t* buffer = static_cast<uint8_t*>(reassemblyPool.alloc(capacity));
+    if (!buffer) {
+        return nullptr;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->active = true;
+    slot->deviceId = deviceId;
+    slot->transferId = transferId;
+    slot->count = count;
+    slot->buffer = buffer;
+    slot->capacity = capacity;
+    reassemblyBytes += capacity;
+    return slot;
+}
+
+void FragmentManager::freeSlot(ReassemblySlot& slot) {
+    if (slot.buffer) {
+        reassemblyPool.free(slot.buffer);
+        reassemblyBytes -= slot.capacity;
+    }
+    memset(&slot, 0, sizeof(slot));
+}
+
+void FragmentManager::serviceReassembly() {
+    uint32_t now = millis();
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+
+    if (rejectPending) {
+        uint8_t ack[FRAGMENT_ACK_HEADER_SIZE];
+        ack[0] = rejectTransferId;
+        ack[1] = FRAGMENT_ACK_REJECTED;
+        writeU16(&ack[2], rejectCount);
+        if (PacketMgr().createPacket(PacketType::FRAGMENT_ACK, ack, sizeof(ack))) {
+            rejectPending = false;
+        }
+    }
+
+    for (size_t i = 0; i < FRAGMENT_REASSEMBLY_SLOTS; i++) {
+        ReassemblySlot& slot = slots[i];
+        if (!slot.active) {
+            continue;
+        }
+
+        if (now - slot.lastActivity > FRAGMENT_REASSEMBLY_TIMEOUT_MS) {
+            if (!slot.complete) {
+                reassemblyTimeouts++;
+            }
+            freeSlot(slot);
+            continue;
+        }
+
+        if (!slot.complete && slot.received == slot.count) {
+            // Detach the buffer so the RX task can keep re-ACKing while the
+            // payload is handed over outside the lock
+            uint8_t* buffer = slot.buffer;
+            size_t capacity = slot.capacity;
+            uint8_t deviceId = slot.deviceId;
+            PacketType contentType = slot.contentType;
+            size_t length = slot.length;
+
+            slot.complete = true;
+            slot.ackPending = true;
+            slot.buffer = nullptr;
+            slot.capacity = 0;
+            transfersReassembled++;
+
+            xSemaphoreGive(mutex);
+            if (completeHandler) {
+                completeHandler(completeContext, deviceId, contentType, buffer, length);
+            }
+            reassemblyPool.free(buffer);
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            reassemblyBytes -= capacity;
+        }
+
+        if (slot.active && slot.ackPending && sendAck(slot)) {
+            slot.ackPending = false;
+        }
+    }
+
+    xSemaphoreGive(mutex);
+}
+
+bool FragmentManager::sendAck(const ReassemblySlot& slot) {
+    uint8_t ack[FRAGMENT_ACK_HEADER_SIZE + FRAGMENT_BITMAP_BYTES];
+    size_t bytes = bitmapBytes(slot.count);
+
+    ack[0] = slot.transferId;
+    ack[1] = slot.complete ? FRAGMENT_ACK_COMPLETE : 0;
+    writeU16(&ack[2], slot.count);
+    memcpy(&ack[FRAGMENT_ACK_HEADER_SIZE], slot.bitmap, bytes);
+
+    // Refused under backpressure - stays pending for the next call
+    return PacketMgr().createPacket(PacketType::FRAGMENT_ACK, ack, FRAGMENT_ACK_HEADER_SIZE + bytes);
+}
+
+void FragmentManager::onRecordBatch(const ReceivedRecord* const* records, size_t count) {
+    // The pipeline task is the one that runs process(), so an ACK for what
+    // this end sends can go straight in
+    for (size_t i = 0; i < count; i++) {
+        if (records[i]->type == PacketType::FRAGMENT) {
+            FragmentMgr().handleFragment(records[i]->deviceId, records[i]->payload, records[i]->length);
+        } else if (records[i]->type == PacketType::FRAGMENT_ACK) {
+            FragmentMgr().handleAck(records[i]->payload, records[i]->length);
+        }
+    }
+}
+
+// ===========================
+// Diagnostics
+// ===========================
+
+void FragmentManager::printStatus() const {
+    Serial.println("=== Fragment Transfer ===");
+    if (outgoing.active) {
+        uint16_t acked = 0;
+        for (uint16_t i = 0; i < outgoing.count; i++) {
+            acked += testBit(outgoing.acked, i) ? 1 : 0;
+        }
+        Serial.printf("Sending: transfer %u, %u/%u acked, pass %u%s\n", outgoing.transferId,
+                      acked, outgoing.count, outgoing.passes + 1, outgoing.awaitingAck ? ", polling" : "");
+    }
+    Serial.printf("Sent: %lu transfers, %lu failed, %lu fragments (%lu resent)\n",
+                  transfersSent, transfersFailed, fragmentsSent, fragmentsResent);
+    Serial.printf("Reassembled: %lu, timed out: %lu, rejected: %lu, holding %u bytes\n",
+                  transfersReassembled, reassemblyTimeouts, reassemblyRejects, (unsigned)reassemblyBytes);
+}
@@ -0,0 +1,185 @@
+#ifndef FRAGMENT_TRANSFER_H
+#define FRAGMENT_TRANSFER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "balloon_config.h"
+#include "common_types.h"
+#include "packet_handler.h"
+#include "memory_arena.h"
+
+struct ReceivedRecord;
+
+// ===========================
+// Fragment Transfer
+// Payloads larger than MAX_PAYLOAD_SIZE split into FRAGMENT packets,
+// reassembled on the far side and repaired from a bitmap ACK
+// ===========================
+
+// FRAGMENT payload:
+//   [0]    transfer id
+//   [1-2]  fragment index (big endian)
+//   [3-4]  fragment count (big endian)
+//   [5]    content type (PacketType of the reassembled payload)
+//   [6]    flags
+//   [7..]  data - FRAGMENT_DATA_SIZE bytes, except the last fragment
+//
+// FRAGMENT_ACK payload:
+//   [0]    transfer id
+//   [1]    flags
+//   [2-3]  fragment count (big endian)
+//   [4..]  received bitmap, bit (i & 7) of byte (i >> 3) = fragment i held
+//
+// The sender streams every missing fragment once per pass and sets
+// FRAGMENT_FLAG_POLL on the last one; the receiver answers a poll (or a
+// completed transfer) with its bitmap and the next pass resends only the gaps.
+
+#define FRAGMENT_HEADER_SIZE        7
+#define FRAGMENT_DATA_SIZE          (MAX_PAYLOAD_SIZE - FRAGMENT_HEADER_SIZE)
+#define FRAGMENT_MAX_COUNT          256
+#define FRAGMENT_BITMAP_BYTES       (FRAGMENT_MAX_COUNT / 8)
+#define FRAGMENT_MAX_TRANSFER_BYTES (FRAGMENT_MAX_COUNT * FRAGMENT_DATA_SIZE)
+#define FRAGMENT_ACK_HEADER_SIZE    4
+
+#define FRAGMENT_FLAG_POLL          0x01   // Answer with the bitmap
+#define FRAGMENT_ACK_COMPLETE       0x01   // Every fragment held - the sender can stop
+#define FRAGMENT_ACK_REJECTED       0x02   // No room to reassemble - the sender should give up
+
+static_assert(FRAGMENT_ACK_HEADER_SIZE + FRAGMENT_BITMAP_BYTES <= MAX_PAYLOAD_SIZE, "Bitmap ACK must fit one packet");
+
+// FRAGMENT_PUMP_BUDGET, FRAGMENT_ACK_TIMEOUT_MS, FRAGMENT_MAX_POLLS,
+// FRAGMENT_REASSEMBLY_* - defined in balloon_config.h
+
+// Called from FragmentMgr().process() with the whole payload; the buffer is
+// only valid for the duration of the call
+typedef void (*TransferCompleteHandler)(void* context, uint8_t deviceId, PacketType contentType,
+                                        const uint8_t* data, size_t length);
+
+// One piece of a payload sent from several buffers, copied in order
+struct PayloadPart {
+    const uint8_t* data;
+    size_t length;
+};
+
+struct OutgoingTransfer {
+    bool active;
+    bool awaitingAck;           // Pass finished, poll sent
+    uint8_t transferId;
+    PacketType contentType;
+    size_t length;
+    uint16_t count;
+    uint16_t nextIndex;         // Cursor within the current pass
+    uint16_t lastMissing;       // Fragment that carries the poll this pass
+    uint8_t acked[FRAGMENT_BITMAP_BYTES];
+    uint32_t pollSentAt;
+    uint8_t polls;              // Polls since the last ACK
+    uint16_t passes;            // Completed repair passes
+};
+
+struct ReassemblySlot {
+    bool active;
+    bool complete;              // Delivered - kept around to re-ACK late polls
+    bool ackPending;
+    uint8_t deviceId;
+    uint8_t transferId;
+    PacketType contentType;
+    uint16_t count;
+    uint16_t received;
+    size_t length;              // Known once the last fragment arrives
+    uint8_t bitmap[FRAGMENT_BITMAP_BYTES];
+    uint8_t* buffer;
+    size_t capacity;
+    uint32_t lastActivity;
+};
+
+class FragmentManager {
+public:
+    FragmentManager();
+    ~FragmentManager();
+
+    bool begin();
+    void end();
+
+    // Balloon side - data is copied, so the caller's buffer can be reused at once
+    bool sendPayload(PacketType contentType, const uint8_t* data, size_t length);
+    bool sendPayload(PacketType contentType, const PayloadPart* parts, size_t partCount);
+    void cancelTransfer();
+    bool isSending() const { return outgoing.active; }
+
+    // Called from the main loop - streams fragments, handles poll timeouts,
+    // expires reassemblies, sends pending ACKs and delivers completed payloads
+    void process();
+
+    // Inbound packets; handleFragment is safe to call from the RX pipeline task
+    bool handleFragment(uint8_t deviceId, const uint8_t* payload, size_t length);
+    bool handleAck(const uint8_t* payload, size_t length);
+
+    // Base station - registers a ReceivePipeline sink that feeds FRAGMENT and FRAGMENT_ACK records in
+    bool attachToPipeline();
+
+    void setTransferCompleteCallback(TransferCompleteHandler handler, void* context);
+
+    // Statistics
+    uint32_t getTransfersSent() const { return transfersSent; }
+    uint32_t getTransfersFailed() const { return transfersFailed; }
+    uint32_t getFragmentsSent() const { return fragmentsSent; }
+    uint32_t getFragmentsResent() const { return fragmentsResent; }
+    uint32_t getTransfersReassembled() const { return transfersReassembled; }
+    uint32_t getReassemblyTimeouts() const { return reassemblyTimeouts; }
+    uint32_t getReassemblyRejects() const { return reassemblyRejects; }
+    size_t getReassemblyBytes() const { return reassemblyBytes; }
+    void printStatus() const;
+
+private:
+    bool initialized;
+
+    // Sender
+    OutgoingTransfer outgoing;
+    uint8_t* sendBuffer;        // FRAGMENT_MAX_TRANSFER_BYTES, PSRAM when available
+    uint8_t nextTransferId;
+
+    // Reassembler
+    ReassemblySlot slots[FRAGMENT_REASSEMBLY_SLOTS];
+    SlabPool reassemblyPool;    // A full-size transfer's buffer per slot, PSRAM, reserved in begin()
+    size_t reassemblyBytes;
+    bool rejectPending;         // No slot for a polled transfer - tell the sender
+    uint8_t rejectTransferId;
+    uint16_t rejectCount;
+    SemaphoreHandle_t mutex;
+    TransferCompleteHandler completeHandler;
+    void* completeContext;
+
+    // Statistics
+    uint32_t transfersSent;
+    uint32_t transfersFailed;
+    uint32_t fragmentsSent;
+    uint32_t fragmentsResent;
+    uint32_t transfersReassembled;
+    uint32_t reassemblyTimeouts;
+    uint32_t reassemblyRejects;
+
+    // Sender internals
+    void pumpOutgoing();
+    bool sendFragment(uint16_t index, uint8_t flags);
+    void startPass();
+    void finishTransfer(bool success);
+
+    // Reassembler internals
+    ReassemblySlot* findSlot(uint8_t deviceId, uint8_t transferId);
+    ReassemblySlot* claimSlot(uint8_t deviceId, uint8_t transferId, uint16_t count);
+    void freeSlot(ReassemblySlot& slot);
+    void serviceReassembly();
+    bool sendAck(const ReassemblySlot& slot);
+
+    static void* allocate(size_t size);
+    static void onRecordBatch(const ReceivedRecord* const* records, size_t count);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern FragmentManager& FragmentMgr();
+
+#endif // FRAGMENT_TRANSFER_H
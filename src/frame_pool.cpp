@@ -0,0 +1,167 @@
+#include "frame_pool.h"
+#include <esp_timer.h>
+#include "camera_manager.h"
+
+static FramePool framePoolInstance;
+
+FramePool& FramePools() { return framePoolInstance; }
+
+static const char* const frameClassNames[FRAME_CLASS_COUNT] = {"jpeg", "pixels"};
+
+bool frameSizeFits(framesize_t size) {
+    if (size >= FRAMESIZE_INVALID) {
+        return false;
+    }
+    return resolution[size].width <= CAMERA_FB_MAX_WIDTH && resolution[size].height <= CAMERA_FB_MAX_HEIGHT;
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+FramePool::FramePool() {
+    started = false;
+    reserved = false;
+    for (uint8_t i = 0; i < FRAME_CLASS_COUNT; i++) {
+        classes[i].available = nullptr;
+        memset(&classes[i].stats, 0, sizeof(classes[i].stats));
+    }
+    portMUX_INITIALIZE(&lock);
+}
+
+const char* FramePool::className(FrameClass cls) {
+    uint8_t index = static_cast<uint8_t>(cls);
+    return index < FRAME_CLASS_COUNT ? frameClassNames[index] : "unknown";
+}
+
+// ===========================
+// Blocks
+// ===========================
+
+bool FramePool::begin() {
+    if (started) {
+        return reserved;
+    }
+    started = true;
+
+    static const size_t blockBytes[FRAME_CLASS_COUNT] = {FRAME_POOL_JPEG_BYTES, FRAME_POOL_PIXEL_BYTES};
+    static const uint16_t blockCounts[FRAME_CLASS_COUNT] = {FRAME_POOL_JPEG_BLOCKS, FRAME_POOL_PIXEL_BLOCKS};
+    static const char* const arenaNames[FRAME_CLASS_COUNT] = {"frame jpeg", "frame pixels"};
+
+    reserved = true;
+    for (uint8_t i = 0; i < FRAME_CLASS_COUNT; i++) {
+        SizeClass& sizeClass = classes[i];
+        if (!sizeClass.slab.begin(arenaNames[i], MemTag::CAMERA, blockBytes[i], blockCounts[i],
+                                  MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)) {
+            reserved = false;
+            continue;
+        }
+        sizeClass.available = xSemaphoreCreateCounting(blockCounts[i], blockCounts[i]);
+        sizeClass.stats.blocks = sizeClass.available ? blockCounts[i] : 0;
+        reserved = reserved && sizeClass.available;
+    }
+    return reserved;
+}
+
+uint8_t* FramePool::acquire(FrameClass cls, size_t length, size_t& capacity, uint32_t timeoutMs) {
+    capacity = 0;
+    uint8_t index = static_cast<uint8_t>(cls);
+    if (index >= FRAME_CLASS_COUNT) {
+        return nullptr;
+    }
+    SizeClass& sizeClass = classes[index];
+
+    // Too big for a block, or no blocks: the slab's heap fallback
+    if (!sizeClass.available || length > sizeClass.slab.getBlockSize()) {
+        uint8_t* buffer = static_cast<uint8_t*>(sizeClass.slab.alloc(length));
+        capacity = buffer ? length : 0;
+        return buffer;
+    }
+
+    // A semaphore count is a block on the free list
+    uint32_t waitedUs = 0;
+    bool taken = xSemaphoreTake(sizeClass.available, 0) == pdTRUE;
+    if (!taken) {
+        int64_t start = esp_timer_get_time();
+        taken = xSemaphoreTake(sizeClass.available, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+        waitedUs = (uint32_t)(esp_timer_get_time() - start);
+    }
+
+    portENTER_CRITICAL(&lock);
+    FramePoolStats& stats = sizeClass.stats;
+    stats.acquires++;
+    if (waitedUs || !taken) {
+        stats.waits++;
+        stats.lastWaitUs = waitedUs;
+        stats.worstWaitUs = max(stats.worstWaitUs, waitedUs);
+        stats.totalWaitUs += waitedUs;
+    }
+    if (taken) {
+        stats.inUse++;
+        stats.peakInUse = max(stats.peakInUse, stats.inUse);
+    } else {
+        stats.timeouts++;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (!taken) {
+        return nullptr;
+    }
+    capacity = sizeClass.slab.getBlockSize();
+    return static_cast<uint8_t*>(sizeClass.slab.alloc(length));
+}
+
+void FramePool::release(FrameClass cls, uint8_t* buffer) {
+    uint8_t index = static_cast<uint8_t>(cls);
+    if (!buffer || index >= FRAME_CLASS_COUNT) {
+        return;
+    }
+    SizeClass& sizeClass = classes[index];
+    bool block = sizeClass.available && sizeClass.slab.owns(buffer);
+    sizeClass.slab.free(buffer);
+    if (!block) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+    sizeClass.stats.inUse--;
+    portEXIT_CRITICAL(&lock);
+    xSemaphoreGive(sizeClass.available);
+}
+
+bool FramePool::reserve(FrameClass cls, uint8_t*& buffer, size_t& capacity, size_t length, uint32_t timeoutMs) {
+    if (buffer && capacity >= length) {
+        return true;
+    }
+    release(cls, buffer);
+    buffer = acquire(cls, length, capacity, timeoutMs);
+    return buffer != nullptr;
+}
+
+size_t FramePool::getBlockSize(FrameClass cls) const {
+    uint8_t index = static_cast<uint8_t>(cls);
+    return index < FRAME_CLASS_COUNT ? classes[index].slab.getBlockSize() : 0;
+}
+
+FramePoolStats FramePool::getStats(FrameClass cls) const {
+    FramePoolStats stats;
+    memset(&stats, 0, sizeof(stats));
+    uint8_t index = static_cast<uint8_t>(cls);
+    if (index < FRAME_CLASS_COUNT) {
+        portENTER_CRITICAL(&lock);
+        stats = classes[index].stats;
+        portEXIT_CRITICAL(&lock);
+    }
+    return stats;
+}
+
+void FramePool::printStatus() const {
+    for (uint8_t i = 0; i < FRAME_CLASS_COUNT; i++) {
+        FramePoolStats stats = getStats(static_cast<FrameClass>(i));
+        Serial.printf("Frame Pool %s: %u x %u bytes, %u in use (peak %u), %lu acquires, %lu waited "
+                     "(last %lu us, worst %lu us), %lu timed out\n",
+                     frameClassNames[i], stats.blocks, (unsigned)classes[i].slab.getBlockSize(), stats.inUse,
+                     stats.peakInUse, stats.acquires, stats.waits, stats.lastWaitUs, stats.worstWaitUs,
+                     stats.timeouts);
+    }
+}
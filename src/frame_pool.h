@@ -0,0 +1,119 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_camera.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "balloon_config.h"
+#include "memory_arena.h"
+
+// ===========================
+// Frame Pool
+// PSRAM blocks for frame-sized buffers, in a few size classes sized for
+// the largest frame the camera is configured for
+// ===========================
+
+// The capture task's JPEG copies, the HTTP stream's frames and the
+// thumbnail task's decode all come from here rather than memAlloc(), so a
+// resolution change never reallocates and tens of KB never have to be
+// found in a fragmented heap mid-flight. Each class is a SlabPool
+// (memory_arena.h) of equal blocks reserved at begin(), with a counting
+// semaphore in front: when every block is out, acquire() waits for one to
+// come back instead of going to the heap, up to its timeout. The wait is
+// measured per class - how often, last, worst and total.
+//
+// A request bigger than its class's block, or any request when the blocks
+// couldn't be reserved, is the SlabPool's heap fallback, unbounded and
+// unwaited. release() tells the two apart.
+//
+// Classes:
+//   JPEG    a captured frame - CAMERA_FB_MAX_WIDTH x HEIGHT / 5, as the
+//           driver sizes its own JPEG frame buffers, so any frame fits
+//   PIXELS  a thumbnail's RGB565 decode of the largest frame (expands
+//           CAMERA_THUMB_MAX_WIDTH from camera_manager.h)
+
+#define FRAME_POOL_JPEG_BYTES    ((size_t)CAMERA_FB_MAX_WIDTH * CAMERA_FB_MAX_HEIGHT / 5)
+#define FRAME_POOL_JPEG_BLOCKS   4      // The capture's pending and current copies, the stream's latest and next
+#define FRAME_POOL_PIXEL_BYTES   ((size_t)framePoolThumbSide(CAMERA_FB_MAX_WIDTH, CAMERA_FB_MAX_WIDTH, CAMERA_THUMB_MAX_WIDTH) * \
+                                  framePoolThumbSide(CAMERA_FB_MAX_HEIGHT, CAMERA_FB_MAX_WIDTH, CAMERA_THUMB_MAX_WIDTH) * 2)
+#define FRAME_POOL_PIXEL_BLOCKS  1      // The thumbnail task's
+#define FRAME_POOL_BYTES         (FRAME_POOL_JPEG_BYTES * FRAME_POOL_JPEG_BLOCKS + \
+                                  FRAME_POOL_PIXEL_BYTES * FRAME_POOL_PIXEL_BLOCKS)
+#define FRAME_POOL_WAIT_MS       500    // Default longest acquire() waits for a block
+
+enum class FrameClass : uint8_t {
+    JPEG = 0,
+    PIXELS,
+    COUNT
+};
+
+#define FRAME_CLASS_COUNT static_cast<uint8_t>(FrameClass::COUNT)
+
+// Thumbnail decode size along one side of a frame: the JPEG decoder's 1/2,
+// 1/4 or 1/8 scale, the smallest that gets its width to maxWidth - the
+// rule createThumbnail() uses
+constexpr uint16_t framePoolThumbSide(uint16_t side, uint16_t width, uint16_t maxWidth, uint8_t shift = 1) {
+    return shift < 3 && (width >> shift) > maxWidth ? framePoolThumbSide(side, width, maxWidth, shift + 1)
+                                                    : (uint16_t)(side >> shift);
+}
+
+struct FramePoolStats {
+    uint16_t blocks;
+    uint16_t inUse;
+    uint16_t peakInUse;
+    uint32_t acquires;
+    uint32_t waits;             // Acquires that found every block out
+    uint32_t timeouts;          // Of those, ones that gave up
+    uint32_t lastWaitUs;
+    uint32_t worstWaitUs;
+    uint64_t totalWaitUs;
+};
+
+class FramePool {
+public:
+    FramePool();
+
+    // Every class's blocks; once, later calls return what the first did
+    bool begin();
+
+    // A block of the class, waiting up to timeoutMs for one; capacity is
+    // what the buffer holds. nullptr on a timeout or no heap
+    uint8_t* acquire(FrameClass cls, size_t length, size_t& capacity, uint32_t timeoutMs = FRAME_POOL_WAIT_MS);
+    void release(FrameClass cls, uint8_t* buffer);
+
+    // Keeps buffer if it holds length, otherwise trades it for one that does
+    bool reserve(FrameClass cls, uint8_t*& buffer, size_t& capacity, size_t length,
+                 uint32_t timeoutMs = FRAME_POOL_WAIT_MS);
+
+    bool isReserved() const { return reserved; }
+    size_t getBlockSize(FrameClass cls) const;
+    FramePoolStats getStats(FrameClass cls) const;
+    void printStatus() const;
+
+    static const char* className(FrameClass cls);
+
+private:
+    struct SizeClass {
+        SlabPool slab;
+        SemaphoreHandle_t available;
+        FramePoolStats stats;
+    };
+
+    bool started;
+    bool reserved;
+    SizeClass classes[FRAME_CLASS_COUNT];
+    mutable portMUX_TYPE lock;
+};
+
+// Whether a resolution's frames fit the pool and the driver's buffers
+bool frameSizeFits(framesize_t size);
+
+// ===========================
+// Global Instance
+// ===========================
+
+extern FramePool& FramePools();
+
+#endif // FRAME_POOL_H
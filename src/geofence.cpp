@@ -0,0 +1,365 @@
+#include "geofence.h"
+#include <cstddef>
+#include "crc_utils.h"
+#include "debug_utils.h"
+
+static GeofenceManager geofenceInstance;
+
+GeofenceManager& Geofence() {
+    return geofenceInstance;
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+GeofenceManager::GeofenceManager() {
+    partition = nullptr;
+    mapHandle = 0;
+    view = nullptr;
+    header = nullptr;
+    zones = nullptr;
+    cells = nullptr;
+    refs = nullptr;
+    edges = nullptr;
+    vertices = nullptr;
+
+    memset(inside, 0, sizeof(inside));
+    insideCount = 0;
+
+    fixesChecked = 0;
+    entries = 0;
+    exits = 0;
+    edgesTested = 0;
+    lastUs = 0;
+    worstUs = 0;
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool GeofenceManager::begin() {
+    if (view) {
+        return true;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         GEOFENCE_PARTITION_LABEL);
+    if (!partition || partition->size < sizeof(GeofenceHeader)) {
+        SYS_WARNING("Geofence: No \"" GEOFENCE_PARTITION_LABEL "\" partition");
+        partition = nullptr;
+        return false;
+    }
+
+    const void* mapped = nullptr;
+    if (esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped, &mapHandle) != ESP_OK) {
+        partition = nullptr;
+        return false;
+    }
+    view = static_cast<const uint8_t*>(mapped);
+    header = reinterpret_cast<const GeofenceHeader*>(view);
+
+    if (!validate(partition->size)) {
+        esp_partition_munmap(mapHandle);
+        view = nullptr;
+        header = nullptr;
+        partition = nullptr;
+        return false;
+    }
+    zones = reinterpret_cast<const GeofenceZone*>(view + header->zonesOffset);
+    cells = reinterpret_cast<const GeofenceCell*>(view + header->cellsOffset);
+    refs = reinterpret_cast<const GeofenceRef*>(view + header->refsOffset);
+    edges = reinterpret_cast<const uint32_t*>(view + header->edgesOffset);
+    vertices = reinterpret_cast<const GeofenceVertex*>(view + header->verticesOffset);
+    insideCount = 0;
+    return true;
+}
+
+void GeofenceManager::end() {
+    if (!view) {
+        return;
+    }
+    // The GPS task reads the map from the fix callback; stop that first
+    esp_partition_munmap(mapHandle);
+    view = nullptr;
+    header = nullptr;
+    partition = nullptr;
+}
+
+static bool tableFits(uint32_t offset, uint32_t count, size_t size, uint32_t length) {
+    return offset % 4 == 0 && offset >= sizeof(GeofenceHeader) &&
+           static_cast<uint64_t>(offset) + static_cast<uint64_t>(count) * size <= length;
+}
+
+bool GeofenceManager::validate(size_t partitionSize) const {
+    if (header->magic != GEOFENCE_MAGIC || header->version != GEOFENCE_VERSION) {
+        SYS_WARNING("Geofence: No zone image in the partition");
+        return false;
+    }
+    if (crc16Ccitt(view, offsetof(GeofenceHeader, headerCrc)) != header->headerCrc ||
+        header->length < sizeof(GeofenceHeader) || header->length > partitionSize ||
+        crc16Ccitt(view + sizeof(GeofenceHeader), header->length - sizeof(GeofenceHeader)) != header->bodyCrc) {
+        SYS_WARNING("Geofence: Zone image fails its CRC");
+        return false;
+    }
+
+    // The tables and every index into them, once, so a fix never reads outside the image
+    uint32_t cellCount = static_cast<uint32_t>(header->columns) * header->rows;
+    if (header->columns == 0 || header->rows == 0 || header->cellLat <= 0 || header->cellLon <= 0 ||
+        !tableFits(header->zonesOffset, header->zoneCount, sizeof(GeofenceZone), header->length) ||
+        !tableFits(header->cellsOffset, cellCount, sizeof(GeofenceCell), header->length) ||
+        !tableFits(header->refsOffset, header->refCount, sizeof(GeofenceRef), header->length) ||
+        !tableFits(header->edgesOffset, header->edgeCount, sizeof(uint32_t), header->length) ||
+        !tableFits(header->verticesOffset, header->vertexCount, sizeof(GeofenceVertex), header->length)) {
+        SYS_WARNING("Geofence: Zone image tables don't fit");
+        return false;
+    }
+
+    const GeofenceZone* zoneTable = reinterpret_cast<const GeofenceZone*>(view + header->zonesOffset);
+    const GeofenceCell* cellTable = reinterpret_cast<const GeofenceCell*>(view + header->cellsOffset);
+    const GeofenceRef* refTable = reinterpret_cast<const GeofenceRef*>(view + header->refsOffset);
+    const uint32_t* edgeTable = reinterpret_cast<const uint32_t*>(view + header->edgesOffset);
+    for (uint16_t i = 0; i < header->zoneCount; i++) {
+        if (static_cast<uint64_t>(zoneTable[i].firstVertex) + zoneTable[i].vertexCount > header->vertexCount) {
+            SYS_WARNING("Geofence: Zone %u vertices out of range", i);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < cellCount; i++) {
+        if (static_cast<uint64_t>(cellTable[i].firstRef) + cellTable[i].refCount > header->refCount) {
+            SYS_WARNING("Geofence: Cell %lu refs out of range", (unsigned long)i);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->refCount; i++) {
+        if (refTable[i].zone >= header->zoneCount ||
+            static_cast<uint64_t>(refTable[i].firstEdge) + refTable[i].edgeCount > header->edgeCount) {
+            SYS_WARNING("Geofence: Ref %lu out of range", (unsigned long)i);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->edgeCount; i++) {
+        if (header->vertexCount == 0 || edgeTable[i] >= header->vertexCount - 1) {
+            SYS_WARNING("Geofence: Edge %lu out of range", (unsigned long)i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ===========================
+// Queries
+// ===========================
+
+void GeofenceManager::onFix(void* context, const SensorGPSData& fix) {
+    static_cast<GeofenceManager*>(context)->check(static_cast<int32_t>(lround(fix.latitude * 1e7)),
+                                                  static_cast<int32_t>(lround(fix.longitude * 1e7)),
+                                                  static_cast<int32_t>(lroundf(fix.altitude)));
+}
+
+void GeofenceManager::check(int32_t lat, int32_t lon, int32_t altitude) {
+    if (!view) {
+        return;
+    }
+    uint32_t start = micros();
+
+    uint16_t found[GEOFENCE_MAX_INSIDE];
+    uint32_t tested = 0;
+    uint8_t count = min(find(lat, lon, altitude, found, GEOFENCE_MAX_INSIDE, tested), (uint8_t)GEOFENCE_MAX_INSIDE);
+
+    // Held zones this fix is outside of, let go after GEOFENCE_EXIT_FIXES of them
+    for (int8_t i = insideCount - 1; i >= 0; i--) {
+        bool still = false;
+        for (uint8_t j = 0; j < count && !still; j++) {
+            still = found[j] == inside[i].zone;
+        }
+        if (still) {
+            inside[i].missed = 0;
+        } else if (++inside[i].missed >= GEOFENCE_EXIT_FIXES) {
+            post(inside[i].zone, false, lat, lon, altitude);
+            inside[i] = inside[--insideCount];
+        }
+    }
+
+    // Zones this fix is in that weren't held
+    for (uint8_t j = 0; j < count; j++) {
+        bool held = false;
+        for (uint8_t i = 0; i < insideCount && !held; i++) {
+            held = inside[i].zone == found[j];
+        }
+        if (!held && insideCount < GEOFENCE_MAX_INSIDE) {
+            inside[insideCount++] = {found[j], 0};
+            post(found[j], true, lat, lon, altitude);
+        }
+    }
+
+    uint32_t elapsed = micros() - start;
+    lastUs = elapsed;
+    if (elapsed > worstUs) {
+        worstUs = elapsed;
+    }
+    edgesTested = edgesTested + tested;
+    fixesChecked = fixesChecked + 1;
+}
+
+uint8_t GeofenceManager::query(int32_t lat, int32_t lon, int32_t altitude, uint16_t* found, uint8_t max) const {
+    if (!view) {
+        return 0;
+    }
+    uint32_t tested = 0;
+    return find(lat, lon, altitude, found, max, tested);
+}
+
+uint8_t GeofenceManager::find(int32_t lat, int32_t lon, int32_t altitude, uint16_t* found, uint8_t max,
+                              uint32_t& tested) const {
+    int64_t fromLat = static_cast<int64_t>(lat) - header->minLat;
+    int64_t fromLon = static_cast<int64_t>(lon) - header->minLon;
+    if (fromLat < 0 || fromLon < 0) {
+        return 0;
+    }
+    int64_t row = fromLat / header->cellLat;
+    int64_t column = fromLon / header->cellLon;
+    if (row >= header->rows || column >= header->columns) {
+        return 0;
+    }
+
+    const GeofenceCell& cell = cells[row * header->columns + column];
+    int64_t centreLat = header->minLat + row * header->cellLat + static_cast<int64_t>(header->cellLat) * (128 + cell.nudgeLat) / 256;
+    int64_t centreLon = header->minLon + column * header->cellLon + static_cast<int64_t>(header->cellLon) * (128 + cell.nudgeLon) / 256;
+
+    uint8_t count = 0;
+    for (uint16_t i = 0; i < cell.refCount; i++) {
+        const GeofenceRef& ref = refs[cell.firstRef + i];
+        const GeofenceZone& zone = zones[ref.zone];
+        if (altitude < zone.floor || altitude > zone.ceiling) {
+            continue;
+        }
+        tested += ref.edgeCount;
+        if (!containsRef(ref, lat, lon, centreLat, centreLon)) {
+            continue;
+        }
+        if (count < max) {
+            found[count] = ref.zone;
+        }
+        if (count < UINT8_MAX) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static inline double cross(double ax, double ay, double bx, double by) {
+    return ax * by - ay * bx;
+}
+
+bool GeofenceManager::containsRef(const GeofenceRef& ref, int32_t lat, int32_t lon, int64_t centreLat,
+                                  int64_t centreLon) const {
+    bool in = (ref.flags & GEOFENCE_REF_CENTRE_INSIDE) != 0;
+
+    // Relative to the fix: the short fix-centre segment keeps the side tests exact in doubles
+    double cx = static_cast<double>(centreLon - lon);
+    double cy = static_cast<double>(centreLat - lat);
+    for (uint32_t i = 0; i < ref.edgeCount; i++) {
+        const GeofenceVertex& a = vertices[edges[ref.firstEdge + i]];
+        const GeofenceVertex& b = vertices[edges[ref.firstEdge + i] + 1];
+        double ax = static_cast<double>(static_cast<int64_t>(a.lon) - lon);
+        double ay = static_cast<double>(static_cast<int64_t>(a.lat) - lat);
+        double bx = static_cast<double>(static_cast<int64_t>(b.lon) - lon);
+        double by = static_cast<double>(static_cast<int64_t>(b.lat) - lat);
+
+        // The ends on either side of the fix-centre line, a vertex on it
+        // taken as right of it so it counts for exactly one of its two edges...
+        if ((cross(cx, cy, ax, ay) > 0) == (cross(cx, cy, bx, by) > 0)) {
+            continue;
+        }
+        // ...and the fix and the centre on either side of the edge
+        double ex = bx - ax;
+        double ey = by - ay;
+        if ((cross(ex, ey, -ax, -ay) > 0) != (cross(ex, ey, cx - ax, cy - ay) > 0)) {
+            in = !in;
+        }
+    }
+    return in;
+}
+
+const GeofenceZone* GeofenceManager::getZone(uint16_t index) const {
+    if (!view || index >= header->zoneCount) {
+        return nullptr;
+    }
+    return &zones[index];
+}
+
+void GeofenceManager::post(uint16_t zone, bool entered, int32_t lat, int32_t lon, int32_t altitude) {
+    const GeofenceZone& info = zones[zone];
+    GeofenceEventData data;
+    data.zoneId = info.id;
+    data.kind = info.kind;
+    data.entered = entered ? 1 : 0;
+    data.lat = lat;
+    data.lon = lon;
+    data.altitude = altitude;
+    memcpy(data.name, info.name, sizeof(data.name));
+
+    // A no-fly zone is a warning; leaving anything is only news
+    uint8_t priority = 1;
+    if (entered) {
+        priority = info.kind == static_cast<uint8_t>(GeofenceKind::NO_FLY)       ? 3
+                   : info.kind == static_cast<uint8_t>(GeofenceKind::RESTRICTED) ? 2
+                                                                                 : 1;
+    }
+    SysState().addEvent(EventType::GEOFENCE, priority, reinterpret_cast<const uint8_t*>(&data), sizeof(data));
+    if (entered) {
+        entries = entries + 1;
+    } else {
+        exits = exits + 1;
+    }
+}
+
+// ===========================
+// Status
+// ===========================
+
+GeofenceStatus GeofenceManager::getStatus() const {
+    GeofenceStatus status;
+    memset(&status, 0, sizeof(status));
+    status.loaded = view != nullptr;
+    if (view) {
+        status.zoneCount = header->zoneCount;
+        status.columns = header->columns;
+        status.rows = header->rows;
+        status.length = header->length;
+    }
+    status.inside = insideCount;
+    status.fixesChecked = fixesChecked;
+    status.entries = entries;
+    status.exits = exits;
+    status.edgesTested = edgesTested;
+    status.lastUs = lastUs;
+    status.worstUs = worstUs;
+    return status;
+}
+
+const char* GeofenceManager::kindToString(GeofenceKind kind) {
+    switch (kind) {
+        case GeofenceKind::NO_FLY: return "no-fly";
+        case GeofenceKind::RESTRICTED: return "restricted";
+        case GeofenceKind::CAUTION: return "caution";
+        default: return "unknown";
+    }
+}
+
+void GeofenceManager::printStatus() const {
+    GeofenceStatus status = getStatus();
+    Serial.println("=== Geofence ===");
+    if (!status.loaded) {
+        Serial.println("No zone image");
+        return;
+    }
+    Serial.printf("%u zones, %ux%u grid, %lu bytes\n", status.zoneCount, status.columns, status.rows,
+                  (unsigned long)status.length);
+    Serial.printf("Inside %u, %lu fixes checked, %lu entries, %lu exits\n", status.inside,
+                  (unsigned long)status.fixesChecked, (unsigned long)status.entries, (unsigned long)status.exits);
+    Serial.printf("Edges tested: %lu, last check %lu us, worst %lu us\n", (unsigned long)status.edgesTested,
+                  (unsigned long)status.lastUs, (unsigned long)status.worstUs);
+}
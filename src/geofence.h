@@ -0,0 +1,210 @@
+#ifndef GEOFENCE_H
+#define GEOFENCE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_partition.h>
+#include "balloon_config.h"
+#include "sensor_manager.h"
+#include "system_state.h"
+
+// ===========================
+// Geofence
+// No-fly and restricted zones from the "geofence" flash partition, read
+// through a memory map and checked against every GPS fix
+// ===========================
+
+// tools/make_geofence.py turns a GeoJSON file of zone polygons into the
+// partition image, and a regular lat/lon grid over the zones goes with it.
+// Each cell lists the zones that reach into it; for each one, whether the
+// cell's centre is inside and the zone's edges that cross the cell; the
+// centre is nudged off any edge through it, so that answer is never a tie.
+// A fix finds its cell with two divisions. Inside a zone is then the
+// centre's answer, flipped once for every listed edge the segment from the
+// fix to the centre crosses - that segment never leaves the cell, so no
+// other edge can cross it. A cell deep inside or outside a zone has no
+// edges at all, and the answer is one load whatever the size of the zone
+// database.
+//
+// The tests take lat/lon as plane coordinates. Crossings don't change
+// under that stretch, so nothing is lost; zones don't cross the
+// antimeridian or reach the poles.
+//
+// check() runs on the GPS task from SensorManager's fix callback and posts
+// EventType::GEOFENCE with GeofenceEventData on entering a zone whose
+// altitude band holds the fix's MSL altitude, and again on leaving it once
+// GEOFENCE_EXIT_FIXES fixes in a row are outside. The image is only read,
+// so query() works from any task.
+//
+// Image, little endian, every table 4-byte aligned:
+//   GeofenceHeader
+//   GeofenceZone[zoneCount]
+//   GeofenceCell[rows * columns], row-major from the south-west corner
+//   GeofenceRef[]          a cell's refs are consecutive
+//   uint32_t[]             edges: vertex i, the edge going to vertex i + 1
+//   GeofenceVertex[]       each zone's rings, every one closed by repeating its first vertex
+// Coordinates are degrees * 1e7, as UBX carries them.
+
+#define GEOFENCE_PARTITION_LABEL   "geofence"
+#define GEOFENCE_MAGIC             0x314F4547  // "GEO1"
+#define GEOFENCE_VERSION           1
+#define GEOFENCE_NAME_SIZE         12
+#define GEOFENCE_MAX_INSIDE        8           // Zones held at once; a ninth is entered without an event
+
+#define GEOFENCE_REF_CENTRE_INSIDE 0x01
+
+enum class GeofenceKind : uint8_t {
+    NO_FLY = 0,
+    RESTRICTED = 1,
+    CAUTION = 2
+};
+
+struct GeofenceHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t zoneCount;
+    uint16_t columns;
+    uint16_t rows;
+    int32_t minLat;             // South-west corner of the grid
+    int32_t minLon;
+    int32_t cellLat;            // Cell size
+    int32_t cellLon;
+    uint32_t zonesOffset;       // From the start of the image
+    uint32_t cellsOffset;
+    uint32_t refsOffset;
+    uint32_t edgesOffset;
+    uint32_t verticesOffset;
+    uint32_t refCount;
+    uint32_t edgeCount;
+    uint32_t vertexCount;
+    uint32_t length;            // Whole image
+    uint16_t bodyCrc;           // CRC-16 CCITT over everything after the header
+    uint16_t headerCrc;         // CRC-16 CCITT over the bytes before it
+};
+
+struct GeofenceZone {
+    uint16_t id;
+    uint8_t kind;               // GeofenceKind
+    uint8_t reserved;
+    int32_t floor;              // m MSL
+    int32_t ceiling;
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    char name[GEOFENCE_NAME_SIZE];  // Not terminated when it fills the field
+};
+
+// The centre is (128 + nudge) / 256 of the cell from its south-west corner
+struct GeofenceCell {
+    uint32_t firstRef;
+    uint16_t refCount;
+    int8_t nudgeLat;
+    int8_t nudgeLon;
+};
+
+struct GeofenceRef {
+    uint16_t zone;              // Index into the zone table
+    uint8_t flags;              // GEOFENCE_REF_CENTRE_INSIDE
+    uint8_t reserved;
+    uint32_t firstEdge;
+    uint32_t edgeCount;
+};
+
+struct GeofenceVertex {
+    int32_t lat;
+    int32_t lon;
+};
+
+static_assert(sizeof(GeofenceHeader) == 68, "Header is part of the flash format");
+static_assert(sizeof(GeofenceZone) == 32, "Zone is part of the flash format");
+static_assert(sizeof(GeofenceCell) == 8, "Cell is part of the flash format");
+static_assert(sizeof(GeofenceRef) == 12, "Ref is part of the flash format");
+static_assert(sizeof(GeofenceVertex) == 8, "Vertex is part of the flash format");
+
+// EventType::GEOFENCE data
+struct GeofenceEventData {
+    uint16_t zoneId;
+    uint8_t kind;               // GeofenceKind
+    uint8_t entered;            // 1 entered, 0 left
+    int32_t lat;                // The fix, degrees * 1e7
+    int32_t lon;
+    int32_t altitude;           // m MSL
+    char name[GEOFENCE_NAME_SIZE];
+};
+
+static_assert(sizeof(GeofenceEventData) <= EVENT_DATA_SIZE, "Geofence event exceeds the event data");
+
+struct GeofenceStatus {
+    bool loaded;
+    uint16_t zoneCount;
+    uint16_t columns;
+    uint16_t rows;
+    uint32_t length;
+    uint8_t inside;             // Zones the last fix was in
+    uint32_t fixesChecked;
+    uint32_t entries;
+    uint32_t exits;
+    uint32_t edgesTested;       // Across all fixes
+    uint32_t lastUs;            // Duration of the last check
+    uint32_t worstUs;
+};
+
+class GeofenceManager {
+public:
+    GeofenceManager();
+
+    bool begin();               // false without a valid image; nothing is checked then
+    void end();
+    bool isLoaded() const { return view != nullptr; }
+
+    // SensorManager's fix callback
+    static void onFix(void* context, const SensorGPSData& fix);
+    void check(int32_t lat, int32_t lon, int32_t altitude);
+
+    // Zone indices the point is in, up to max of them; the count of all
+    uint8_t query(int32_t lat, int32_t lon, int32_t altitude, uint16_t* zones, uint8_t max) const;
+    const GeofenceZone* getZone(uint16_t index) const;
+
+    GeofenceStatus getStatus() const;
+    static const char* kindToString(GeofenceKind kind);
+    void printStatus() const;
+
+private:
+    const esp_partition_t* partition;
+    esp_partition_mmap_handle_t mapHandle;
+    const uint8_t* view;
+    const GeofenceHeader* header;
+    const GeofenceZone* zones;
+    const GeofenceCell* cells;
+    const GeofenceRef* refs;
+    const uint32_t* edges;
+    const GeofenceVertex* vertices;
+
+    // GPS task
+    struct Inside {
+        uint16_t zone;
+        uint8_t missed;         // Fixes outside since the last inside
+    };
+    Inside inside[GEOFENCE_MAX_INSIDE];
+    uint8_t insideCount;
+
+    // Statistics - written by the GPS task
+    volatile uint32_t fixesChecked;
+    volatile uint32_t entries;
+    volatile uint32_t exits;
+    volatile uint32_t edgesTested;
+    volatile uint32_t lastUs;
+    volatile uint32_t worstUs;
+
+    bool validate(size_t partitionSize) const;
+    uint8_t find(int32_t lat, int32_t lon, int32_t altitude, uint16_t* found, uint8_t max, uint32_t& tested) const;
+    bool containsRef(const GeofenceRef& ref, int32_t lat, int32_t lon, int64_t centreLat, int64_t centreLon) const;
+    void post(uint16_t zone, bool entered, int32_t lat, int32_t lon, int32_t altitude);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern GeofenceManager& Geofence();
+
+#endif // GEOFENCE_H
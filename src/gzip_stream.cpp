@@ -0,0 +1,326 @@
+#include "gzip_stream.h"
+#include "esp_rom_crc.h"
+#include "memory_ledger.h"
+
+#define GZIP_HASH_SIZE             (1 << GZIP_HASH_BITS)
+#define GZIP_WINDOW_MASK           (GZIP_WINDOW_BYTES - 1)
+
+static_assert((GZIP_WINDOW_BYTES & GZIP_WINDOW_MASK) == 0, "Window is a power of two");
+static_assert(GZIP_WINDOW_BYTES >= GZIP_MAX_MATCH && GZIP_WINDOW_BYTES <= 16384,
+              "Distances within deflate's 32 KB, positions + 1 in the chains' uint16_t");
+
+static const uint8_t gzipHeader[10] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF};
+
+// RFC 1951 3.2.5: length codes 257..285 and distance codes 0..29
+static const uint16_t lengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,
+                                          33,  49,  65,  97,  129, 193,  257,  385,  513,  769,
+                                          1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                          6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Huffman codes go out most significant bit first, into a stream packed LSB first
+static uint32_t reverseBits(uint32_t code, uint8_t count) {
+    uint32_t reversed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+static inline uint32_t hashAt(const uint8_t* p) {
+    return (((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761u) >> (32 - GZIP_HASH_BITS);
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+GzipStream::GzipStream() {
+    window = nullptr;
+    head = nullptr;
+    prev = nullptr;
+    out = nullptr;
+    fill = 0;
+    pos = 0;
+    bits = 0;
+    bitCount = 0;
+    outUsed = 0;
+    crc = 0;
+    bytesIn = 0;
+    bytesOut = 0;
+    sink = nullptr;
+    context = nullptr;
+    failed = false;
+}
+
+GzipStream::~GzipStream() {
+    end();
+}
+
+// ===========================
+// Stream
+// ===========================
+
+bool GzipStream::begin(GzipSink sink, void* context) {
+    if (!sink) {
+        return false;
+    }
+    if (!window) {
+        window = (uint8_t*)memAlloc(MemTag::WEB, GZIP_STATE_BYTES);
+        if (!window) {
+            return false;
+        }
+        head = (uint16_t*)(window + 2 * GZIP_WINDOW_BYTES);
+        prev = head + GZIP_HASH_SIZE;
+        out = (uint8_t*)(prev + GZIP_WINDOW_BYTES);
+    }
+    memset(head, 0, GZIP_HASH_SIZE * sizeof(uint16_t));
+    memset(prev, 0, GZIP_WINDOW_BYTES * sizeof(uint16_t));
+
+    this->sink = sink;
+    this->context = context;
+    fill = 0;
+    pos = 0;
+    bits = 0;
+    bitCount = 0;
+    crc = 0;
+    bytesIn = 0;
+    bytesOut = 0;
+    failed = false;
+    memcpy(out, gzipHeader, sizeof(gzipHeader));
+    outUsed = sizeof(gzipHeader);
+
+    // The whole stream is one final block of fixed codes
+    putBits(1, 1);
+    putBits(1, 2);
+    return true;
+}
+
+void GzipStream::end() {
+    if (window) {
+        memFree(MemTag::WEB, window);
+        window = nullptr;
+        head = nullptr;
+        prev = nullptr;
+        out = nullptr;
+    }
+    sink = nullptr;
+}
+
+bool GzipStream::write(const void* data, size_t length) {
+    if (!sink || failed) {
+        return false;
+    }
+    const uint8_t* bytes = (const uint8_t*)data;
+    crc = esp_rom_crc32_le(crc, bytes, length);
+    bytesIn += length;
+
+    while (length && !failed) {
+        size_t take = min(length, 2 * GZIP_WINDOW_BYTES - fill);
+        memcpy(window + fill, bytes, take);
+        fill += take;
+        bytes += take;
+        length -= take;
+        deflate(false);
+        if (fill == 2 * GZIP_WINDOW_BYTES) {
+            slide();
+        }
+    }
+    return !failed;
+}
+
+bool GzipStream::finish() {
+    if (!sink || failed) {
+        return false;
+    }
+    deflate(true);
+    putSymbol(256);             // End of block
+    if (bitCount) {
+        putByte(bits);
+        bits = 0;
+        bitCount = 0;
+    }
+
+    // CRC-32 and length of the uncompressed data, little-endian
+    for (int i = 0; i < 4; i++) {
+        putByte(crc >> (8 * i));
+    }
+    for (int i = 0; i < 4; i++) {
+        putByte(bytesIn >> (8 * i));
+    }
+    bool ok = emit() && !failed;
+    sink = nullptr;
+    return ok;
+}
+
+struct GzipBuffer {
+    uint8_t* out;
+    size_t space;
+    size_t used;
+};
+
+static bool copyCompressed(const uint8_t* data, size_t length, void* context) {
+    GzipBuffer* buffer = static_cast<GzipBuffer*>(context);
+    if (buffer->used + length > buffer->space) {
+        return false;
+    }
+    memcpy(buffer->out + buffer->used, data, length);
+    buffer->used += length;
+    return true;
+}
+
+size_t GzipStream::compress(const void* data, size_t length, uint8_t* out, size_t space) {
+    GzipBuffer buffer = {out, min(space, length), 0};
+    if (!begin(copyCompressed, &buffer) || !write(data, length) || !finish()) {
+        sink = nullptr;
+        return 0;
+    }
+    return buffer.used;
+}
+
+// ===========================
+// LZ77
+// ===========================
+
+// Codes the window up to GZIP_MAX_MATCH short of what is written, so every
+// match search sees as far ahead as a match can go; the last call codes the rest
+void GzipStream::deflate(bool last) {
+    while (pos < fill && (last || fill - pos >= GZIP_MAX_MATCH) && !failed) {
+        size_t distance = 0;
+        size_t length = longestMatch(distance);
+        if (length >= GZIP_MIN_MATCH) {
+            putMatch(length, distance);
+            for (size_t end = pos + length; pos < end; pos++) {
+                insert(pos);
+            }
+        } else {
+            putSymbol(window[pos]);
+            insert(pos);
+            pos++;
+        }
+    }
+}
+
+void GzipStream::insert(size_t position) {
+    if (position + GZIP_MIN_MATCH > fill) {
+        return;
+    }
+    uint32_t h = hashAt(window + position);
+    prev[position & GZIP_WINDOW_MASK] = head[h];
+    head[h] = position + 1;
+}
+
+// Greedy: the longest of the first GZIP_PROBES strings with pos's hash
+size_t GzipStream::longestMatch(size_t& distance) {
+    size_t available = min(fill - pos, (size_t)GZIP_MAX_MATCH);
+    if (available < GZIP_MIN_MATCH) {
+        return 0;
+    }
+    size_t limit = pos > GZIP_WINDOW_BYTES ? pos - GZIP_WINDOW_BYTES : 0;
+    const uint8_t* current = window + pos;
+    size_t best = 0;
+    uint16_t next = head[hashAt(current)];
+
+    for (uint8_t probe = 0; probe < GZIP_PROBES && next && (size_t)(next - 1) >= limit; probe++) {
+        size_t candidate = next - 1;
+        const uint8_t* match = window + candidate;
+        if (match[best] == current[best] && match[0] == current[0]) {
+            size_t length = 1;
+            while (length < available && match[length] == current[length]) {
+                length++;
+            }
+            if (length > best) {
+                best = length;
+                distance = pos - candidate;
+                if (length == available) {
+                    break;
+                }
+            }
+        }
+        next = prev[candidate & GZIP_WINDOW_MASK];
+        if ((size_t)next > candidate) {
+            break;              // A slot the window has since written over
+        }
+    }
+    return best;
+}
+
+// Drops the older half; every string left is within the window of pos
+void GzipStream::slide() {
+    memmove(window, window + GZIP_WINDOW_BYTES, GZIP_WINDOW_BYTES);
+    fill -= GZIP_WINDOW_BYTES;
+    pos -= GZIP_WINDOW_BYTES;
+    for (size_t i = 0; i < GZIP_HASH_SIZE; i++) {
+        head[i] = head[i] > GZIP_WINDOW_BYTES ? head[i] - GZIP_WINDOW_BYTES : 0;
+    }
+    for (size_t i = 0; i < GZIP_WINDOW_BYTES; i++) {
+        prev[i] = prev[i] > GZIP_WINDOW_BYTES ? prev[i] - GZIP_WINDOW_BYTES : 0;
+    }
+}
+
+// ===========================
+// Fixed Huffman Codes
+// ===========================
+
+// RFC 1951 3.2.6
+void GzipStream::putSymbol(uint16_t symbol) {
+    if (symbol < 144) {
+        putBits(reverseBits(0x30 + symbol, 8), 8);
+    } else if (symbol < 256) {
+        putBits(reverseBits(0x190 + symbol - 144, 9), 9);
+    } else if (symbol < 280) {
+        putBits(reverseBits(symbol - 256, 7), 7);
+    } else {
+        putBits(reverseBits(0xC0 + symbol - 280, 8), 8);
+    }
+}
+
+void GzipStream::putMatch(size_t length, size_t distance) {
+    int code = 28;
+    while (lengthBase[code] > length) {
+        code--;
+    }
+    putSymbol(257 + code);
+    putBits(length - lengthBase[code], lengthExtra[code]);
+
+    code = 29;
+    while (distanceBase[code] > distance) {
+        code--;
+    }
+    putBits(reverseBits(code, 5), 5);
+    putBits(distance - distanceBase[code], distanceExtra[code]);
+}
+
+void GzipStream::putBits(uint32_t value, uint8_t count) {
+    bits |= value << bitCount;
+    bitCount += count;
+    while (bitCount >= 8) {
+        putByte(bits);
+        bits >>= 8;
+        bitCount -= 8;
+    }
+}
+
+void GzipStream::putByte(uint8_t value) {
+    out[outUsed++] = value;
+    if (outUsed == GZIP_CHUNK_BYTES) {
+        emit();
+    }
+}
+
+bool GzipStream::emit() {
+    if (outUsed == 0) {
+        return true;
+    }
+    if (!failed && !sink(out, outUsed, context)) {
+        failed = true;
+    }
+    bytesOut += outUsed;
+    outUsed = 0;
+    return !failed;
+}
@@ -0,0 +1,90 @@
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Gzip Stream
+// Streaming deflate in a bounded window, for HTTP responses
+// ===========================
+
+// GzipStream compresses as it is written: LZ77 with matches no further back
+// than GZIP_WINDOW_BYTES, coded with deflate's fixed Huffman tables in one
+// block, framed as gzip. Its memory is the window (twice GZIP_WINDOW_BYTES,
+// written into and slid down by half), the hash chains over it and a
+// GZIP_CHUNK_BYTES output chunk - ~21 KB, allocated by the first begin()
+// and kept for the streams after it, so it sits beside the httpd task
+// rather than the ~320 KB of miniz's compressor that the base station's
+// exports use (base_station_export.h). On JSON and Prometheus text, whose
+// repeats are field names a few hundred bytes apart, it gets most of what
+// a full window with dynamic tables would.
+//
+// The sink is called with each full chunk and the last, from the writing
+// task; a false from it fails the stream. One stream at a time per
+// instance - the web servers keep one each and run a handler at a time.
+
+#define GZIP_WINDOW_BYTES          4096    // Longest match distance
+#define GZIP_HASH_BITS             11      // Hash chain heads, 2 bytes each
+#define GZIP_PROBES                8       // Chain entries tried per match search
+#define GZIP_CHUNK_BYTES           1024    // Compressed bytes per sink call
+#define GZIP_MIN_MATCH             3
+#define GZIP_MAX_MATCH             258
+
+// What the first begin() allocates
+#define GZIP_STATE_BYTES           (2 * GZIP_WINDOW_BYTES + (1 << GZIP_HASH_BITS) * sizeof(uint16_t) + \
+                                    GZIP_WINDOW_BYTES * sizeof(uint16_t) + GZIP_CHUNK_BYTES)
+
+// Takes the compressed bytes; false aborts
+typedef bool (*GzipSink)(const uint8_t* data, size_t length, void* context);
+
+class GzipStream {
+public:
+    GzipStream();
+    ~GzipStream();
+
+    // The gzip header; false without the memory for the window
+    bool begin(GzipSink sink, void* context);
+    void end();                 // Frees the window
+
+    bool write(const void* data, size_t length);
+
+    // The end of the block and the gzip trailer
+    bool finish();
+
+    // All of data as one gzip member into out; 0 if it doesn't fit in space
+    // or would come out larger than data - for responses compressed once and kept
+    size_t compress(const void* data, size_t length, uint8_t* out, size_t space);
+
+    uint32_t getBytesIn() const { return bytesIn; }
+    uint32_t getBytesOut() const { return bytesOut; }
+
+private:
+    uint8_t* window;            // 2 * GZIP_WINDOW_BYTES of input
+    uint16_t* head;             // Position + 1 of the newest string per hash, 0 for none
+    uint16_t* prev;             // Position + 1 of the one before, by position modulo the window
+    uint8_t* out;               // GZIP_CHUNK_BYTES
+    size_t fill;                // Window bytes written
+    size_t pos;                 // Window bytes coded
+    uint32_t bits;              // Not yet a whole byte, LSB first
+    uint8_t bitCount;
+    size_t outUsed;
+    uint32_t crc;
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    GzipSink sink;
+    void* context;
+    bool failed;
+
+    void deflate(bool last);
+    void insert(size_t position);
+    size_t longestMatch(size_t& distance);
+    void slide();
+    void putSymbol(uint16_t symbol);
+    void putMatch(size_t length, size_t distance);
+    void putBits(uint32_t value, uint8_t count);
+    void putByte(uint8_t value);
+    bool emit();
+};
+
+#endif // GZIP_STREAM_H
@@ -0,0 +1,307 @@
+#include "image_downlink.h"
+#include "camera_manager.h"
+#include "fragment_transfer.h"
+#include "lora_comm.h"
+#include "scene_change.h"
+#include "scene_classifier.h"
+#include "memory_ledger.h"
+#include "debug_utils.h"
+
+#define DOWNLINK_ID_BITS_BYTES  (65536 / 8)
+
+// Points by SceneLabel; UNKNOWN (and records from before labels were kept) in between
+static const uint16_t labelPoints[SCENE_LABEL_COUNT] = {
+    0,      // BLACK - never sent
+    64,     // SKY
+    128,    // CLOUD
+    192,    // EARTH
+    256     // HORIZON
+};
+#define DOWNLINK_UNKNOWN_LABEL_POINTS 96
+
+static ImageDownlink imageDownlinkInstance;
+
+ImageDownlink& Downlink() {
+    return imageDownlinkInstance;
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+ImageDownlink::ImageDownlink() {
+    delivered = nullptr;
+    sentLive = nullptr;
+    bandsHeld = 0;
+    memset(candidates, 0, sizeof(candidates));
+    memset(plan, 0, sizeof(plan));
+    planCount = 0;
+    planNext = 0;
+    planBudget = 0;
+    planValue = 0;
+    rankedAt = 0;
+    rerank = true;
+    sendingId = 0;
+    sentBefore = 0;
+    imagesSent = 0;
+    bytesSent = 0;
+    transfersFailed = 0;
+    ranks = 0;
+}
+
+bool ImageDownlink::begin() {
+    if (delivered) {
+        return true;
+    }
+    if (!ImageStoreMgr().isReady()) {
+        return false;
+    }
+    delivered = static_cast<uint8_t*>(memCalloc(MemTag::IMAGE_STORE, 1, DOWNLINK_ID_BITS_BYTES));
+    sentLive = static_cast<uint8_t*>(memCalloc(MemTag::IMAGE_STORE, 1, DOWNLINK_ID_BITS_BYTES));
+    if (!delivered || !sentLive) {
+        memFree(MemTag::IMAGE_STORE, delivered);
+        memFree(MemTag::IMAGE_STORE, sentLive);
+        delivered = nullptr;
+        sentLive = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// ===========================
+// Ground Feedback
+// ===========================
+
+void ImageDownlink::markDelivered(uint16_t imageId) {
+    if (testBit(delivered, imageId)) {
+        return;
+    }
+    setBit(delivered, imageId);
+
+    // Its altitude band has a frame on the ground now
+    StoredImageInfo info;
+    if (ImageStoreMgr().findImage(imageId, info) && info.altitude >= 0.0f) {
+        uint32_t band = (uint32_t)info.altitude / DOWNLINK_MILESTONE_M;
+        if (band < DOWNLINK_MILESTONE_BANDS) {
+            bandsHeld |= 1u << band;
+        }
+    }
+    rerank = true;
+}
+
+void ImageDownlink::onImagesReceived(const uint8_t* ids, size_t count) {
+    if (!delivered) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        markDelivered((ids[i * 2] << 8) | ids[i * 2 + 1]);
+    }
+}
+
+void ImageDownlink::onLiveQueued(uint16_t imageId) {
+    if (sentLive) {
+        setBit(sentLive, imageId);
+    }
+}
+
+// ===========================
+// Ranking
+// ===========================
+
+uint32_t ImageDownlink::valueOf(const StoredImageInfo& info, uint16_t sharpest, uint32_t now) const {
+    uint32_t value = min(info.novelty, (uint8_t)SCENE_NOVELTY_MAX) * DOWNLINK_NOVELTY_WEIGHT;
+
+    if (info.sceneLabel < SCENE_LABEL_COUNT) {
+        if (labelPoints[info.sceneLabel] == 0) {
+            return 0;
+        }
+        value += labelPoints[info.sceneLabel];
+    } else {
+        value += DOWNLINK_UNKNOWN_LABEL_POINTS;
+    }
+
+    if (sharpest && info.sharpness && info.sharpness != 0xFFFF) {
+        value += (uint32_t)info.sharpness * DOWNLINK_SHARPNESS_POINTS / sharpest;
+    }
+
+    if (info.altitude >= 0.0f) {
+        uint32_t band = (uint32_t)info.altitude / DOWNLINK_MILESTONE_M;
+        if (band < DOWNLINK_MILESTONE_BANDS && !(bandsHeld & (1u << band))) {
+            value += DOWNLINK_MILESTONE_POINTS;
+        }
+    }
+
+    // Halved every DOWNLINK_AGE_HALF_MS, linearly between the halvings
+    uint32_t age = info.timestamp <= now ? now - info.timestamp : DOWNLINK_AGE_HALF_MS;   // Before a reboot
+    uint32_t halvings = age / DOWNLINK_AGE_HALF_MS;
+    if (halvings >= 16) {
+        return 0;
+    }
+    value >>= halvings;
+    value -= (uint32_t)((uint64_t)value * (age % DOWNLINK_AGE_HALF_MS) / DOWNLINK_AGE_HALF_MS / 2);
+
+    if (testBit(sentLive, info.imageId)) {
+        value /= DOWNLINK_LIVE_DIVISOR;
+    }
+    return value;
+}
+
+void ImageDownlink::rank() {
+    uint32_t now = millis();
+    rankedAt = now;
+    rerank = false;
+    planCount = 0;
+    planNext = 0;
+    planValue = 0;
+    ranks++;
+
+    // Sharpness is only comparable across one analysis size - scored against the sharpest on board
+    StoredImageInfo info;
+    uint16_t sharpest = 0;
+    for (uint16_t slot = 0; slot < IMAGE_STORE_INDEX_SLOTS; slot++) {
+        if (ImageStoreMgr().getIndexSlot(slot, info) && !testBit(delivered, info.imageId) &&
+            info.sharpness != 0xFFFF) {
+            sharpest = max(sharpest, info.sharpness);
+        }
+    }
+
+    // The best DOWNLINK_CANDIDATES by value per byte, the worst of them replaced as better ones turn up
+    uint8_t count = 0;
+    for (uint16_t slot = 0; slot < IMAGE_STORE_INDEX_SLOTS; slot++) {
+        if (!ImageStoreMgr().getIndexSlot(slot, info) || testBit(delivered, info.imageId) ||
+            info.length == 0 || info.length > FRAGMENT_MAX_TRANSFER_BYTES) {
+            continue;
+        }
+        uint32_t value = valueOf(info, sharpest, now);
+        if (value == 0) {
+            continue;
+        }
+        DownlinkCandidate candidate = {info.imageId, info.length, value,
+                                       (uint32_t)((uint64_t)value * 1024 / info.length)};
+        if (count < DOWNLINK_CANDIDATES) {
+            candidates[count++] = candidate;
+            continue;
+        }
+        uint8_t worst = 0;
+        for (uint8_t i = 1; i < count; i++) {
+            if (candidates[i].valuePerKb < candidates[worst].valuePerKb) {
+                worst = i;
+            }
+        }
+        if (candidate.valuePerKb > candidates[worst].valuePerKb) {
+            candidates[worst] = candidate;
+        }
+    }
+
+    // Best value per byte first
+    for (uint8_t i = 1; i < count; i++) {
+        DownlinkCandidate candidate = candidates[i];
+        int j = i - 1;
+        while (j >= 0 && candidates[j].valuePerKb < candidate.valuePerKb) {
+            candidates[j + 1] = candidates[j];
+            j--;
+        }
+        candidates[j + 1] = candidate;
+    }
+
+    // Greedy knapsack: each in turn if it still fits what the window can carry
+    planBudget = LoRaLink(Priority::CAMERA).getBulkByteBudget(DOWNLINK_WINDOW_MS, FRAGMENT_DATA_SIZE,
+                                                              FRAGMENT_HEADER_SIZE);
+    uint32_t left = planBudget;
+    for (uint8_t i = 0; i < count && planCount < DOWNLINK_PLAN_MAX; i++) {
+        if (candidates[i].length <= left) {
+            plan[planCount++] = candidates[i].imageId;
+            left -= candidates[i].length;
+            planValue += candidates[i].value;
+        }
+    }
+    if (planCount) {
+        SYS_LOG("Downlink plan: %u stored images, %lu of %lu bytes, value %lu", planCount,
+                (unsigned long)(planBudget - left), (unsigned long)planBudget, (unsigned long)planValue);
+    }
+}
+
+// ===========================
+// Sending
+// ===========================
+
+void ImageDownlink::checkTransfer() {
+    if (!sendingId || FragmentMgr().isSending()) {
+        return;
+    }
+    if (FragmentMgr().getTransfersSent() != sentBefore) {
+        markDelivered(sendingId);
+        imagesSent++;
+    } else {
+        transfersFailed++;      // Still a candidate at the next ranking
+    }
+    sendingId = 0;
+}
+
+bool ImageDownlink::sendNext() {
+    while (planNext < planCount) {
+        uint16_t imageId = plan[planNext++];
+        StoredImageInfo info;
+        if (testBit(delivered, imageId) || !ImageStoreMgr().findImage(imageId, info)) {
+            continue;       // Reported held, or wrapped over, since the ranking
+        }
+
+        // The fragment sender copies it, so the read-back buffer goes straight back
+        uint8_t* jpeg = static_cast<uint8_t*>(memAlloc(MemTag::IMAGE_STORE, info.length));
+        if (!jpeg) {
+            return false;
+        }
+        bool queued = ImageStoreMgr().readImage(imageId, 0, jpeg, info.length);
+        if (queued) {
+            sentBefore = FragmentMgr().getTransfersSent();
+            queued = FragmentMgr().sendPayload(PacketType::CAMERA_FULL, jpeg, info.length);
+        }
+        memFree(MemTag::IMAGE_STORE, jpeg);
+        if (!queued) {
+            SYS_WARNING("Stored image %u not sent", imageId);
+            continue;
+        }
+        sendingId = imageId;
+        bytesSent += info.length;
+        SYS_LOG("Stored image %u queued (%lu bytes)", imageId, (unsigned long)info.length);
+        return true;
+    }
+    return false;
+}
+
+void ImageDownlink::service() {
+    if (!delivered) {
+        return;
+    }
+    checkTransfer();
+    if (sendingId || FragmentMgr().isSending()) {
+        return;
+    }
+
+    // The live image's layers and tiles go first
+    const uint8_t* tile;
+    size_t tileLength;
+    if (Camera().getLayerImageId() || Camera().getEncodedTile(tile, tileLength)) {
+        return;
+    }
+
+    if (rerank || millis() - rankedAt >= DOWNLINK_WINDOW_MS) {
+        rank();
+    }
+    sendNext();
+}
+
+// ===========================
+// Status
+// ===========================
+
+void ImageDownlink::printStatus() const {
+    if (!delivered) {
+        return;
+    }
+    Serial.printf("Image Downlink: %lu stored images sent (%lu bytes), %lu transfers failed, %lu rankings\n",
+                  (unsigned long)imagesSent, (unsigned long)bytesSent, (unsigned long)transfersFailed,
+                  (unsigned long)ranks);
+    Serial.printf("  Plan: %u of %u sent, value %lu, window budget %lu bytes%s\n", planNext, planCount,
+                  (unsigned long)planValue, (unsigned long)planBudget, sendingId ? ", one in flight" : "");
+}
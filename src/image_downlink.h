@@ -0,0 +1,120 @@
+#ifndef IMAGE_DOWNLINK_H
+#define IMAGE_DOWNLINK_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "balloon_config.h"
+#include "image_store.h"
+
+// ===========================
+// Image Downlink Scheduler
+// Picks which stored frames go down in the airtime live images leave, by
+// value per byte, and drops them from the running once the ground has them
+// ===========================
+
+// Every DOWNLINK_WINDOW_MS, and whenever the ground reports what it holds,
+// the stored frames are ranked again. A frame's value is the sum of its
+// novelty (against the last image downlinked when it was taken), its
+// sharpness against the sharpest candidate, and a weight for its scene
+// label. A bonus goes to frames from an altitude band of
+// DOWNLINK_MILESTONE_M the ground has nothing from yet. The sum then
+// decays with age: halved at DOWNLINK_AGE_HALF_MS, and a frame from before
+// the last reboot counts as that old. A frame that went down
+// live but hasn't been confirmed keeps a quarter of its value, and a
+// BLACK frame is worth nothing.
+//
+// The store keeps each frame as the one JPEG the camera took, so a stored
+// frame has a single quality layer: its whole length is its cost. The
+// window's budget is what the camera link can carry in DOWNLINK_WINDOW_MS
+// (getBulkByteBudget()). The plan is a greedy knapsack over at most
+// DOWNLINK_CANDIDATES frames: sorted by value per byte, each taken if it
+// still fits. It is sent one transfer at a time, only while no live layer,
+// tile or image transfer is going.
+//
+// Delivery: a transfer the fragment ACKs complete marks its frame held.
+// So does the ground's IMAGES_RECEIVED command, which also covers frames
+// that went down live. Both are kept as bits by image id in PSRAM; a
+// reboot forgets them, and the ground's next report restores them.
+//
+// Everything runs on the uplink task, which owns Camera() and the sending
+// side of FragmentMgr().
+
+#define DOWNLINK_WINDOW_MS          60000
+#define DOWNLINK_CANDIDATES         64      // Best-valued frames the plan is chosen from
+#define DOWNLINK_PLAN_MAX           16
+#define DOWNLINK_MILESTONE_M        5000    // Altitude bands a first frame is wanted from
+#define DOWNLINK_MILESTONE_BANDS    32
+#define DOWNLINK_AGE_HALF_MS        3600000 // Value halves an hour after capture
+#define DOWNLINK_LIVE_DIVISOR       4       // Sent live, not confirmed
+
+// Value points
+#define DOWNLINK_NOVELTY_WEIGHT     4       // Per novelty step, up to SCENE_NOVELTY_MAX
+#define DOWNLINK_SHARPNESS_POINTS   128     // The sharpest candidate
+#define DOWNLINK_MILESTONE_POINTS   256
+
+struct DownlinkCandidate {
+    uint16_t imageId;
+    uint32_t length;
+    uint32_t value;
+    uint32_t valuePerKb;        // value * 1024 / length - the ranking
+};
+
+class ImageDownlink {
+public:
+    ImageDownlink();
+
+    // After the image store; false (and nothing sent) without it
+    bool begin();
+    bool isReady() const { return delivered != nullptr; }
+
+    // Uplink task, after the live image's own downlink
+    void service();
+
+    // The ground holds these; count ids, big endian pairs
+    void onImagesReceived(const uint8_t* ids, size_t count);
+    // Sent as it was captured
+    void onLiveQueued(uint16_t imageId);
+
+    uint32_t getImagesSent() const { return imagesSent; }
+    uint32_t getBytesSent() const { return bytesSent; }
+    void printStatus() const;
+
+private:
+    uint8_t* delivered;         // Bit per image id
+    uint8_t* sentLive;
+    uint32_t bandsHeld;         // Bit per DOWNLINK_MILESTONE_M band
+
+    DownlinkCandidate candidates[DOWNLINK_CANDIDATES];
+    uint16_t plan[DOWNLINK_PLAN_MAX];
+    uint8_t planCount;
+    uint8_t planNext;
+    uint32_t planBudget;
+    uint32_t planValue;
+    uint32_t rankedAt;
+    bool rerank;
+
+    uint16_t sendingId;         // 0 = none of ours in flight
+    uint32_t sentBefore;        // FragmentMgr()'s completed transfers when it went
+
+    uint32_t imagesSent;
+    uint32_t bytesSent;
+    uint32_t transfersFailed;
+    uint32_t ranks;
+
+    void rank();
+    uint32_t valueOf(const StoredImageInfo& info, uint16_t sharpest, uint32_t now) const;
+    bool sendNext();
+    void checkTransfer();
+    void markDelivered(uint16_t imageId);
+
+    static bool testBit(const uint8_t* bits, uint16_t id) { return bits[id >> 3] & (1 << (id & 7)); }
+    static void setBit(uint8_t* bits, uint16_t id) { bits[id >> 3] |= 1 << (id & 7); }
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern ImageDownlink& Downlink();
+
+#endif // IMAGE_DOWNLINK_H
@@ -0,0 +1,160 @@
+#include "image_metadata.h"
+
+static const uint8_t IMAGE_META_ID[4] = {'H', 'A', 'B', 'M'};
+#define IMAGE_META_PREAMBLE  (4 + sizeof(IMAGE_META_ID) + 1)    // Marker, length, id, version
+
+static uint8_t* putTag(uint8_t* out, ImageMetaTag tag, uint8_t length) {
+    out[0] = static_cast<uint8_t>(tag);
+    out[1] = length;
+    return out + 2;
+}
+
+static uint8_t* put16(uint8_t* out, uint16_t value) {
+    out[0] = value >> 8;
+    out[1] = value & 0xFF;
+    return out + 2;
+}
+
+static uint8_t* put32(uint8_t* out, uint32_t value) {
+    return put16(put16(out, value >> 16), value & 0xFFFF);
+}
+
+static uint16_t get16(const uint8_t* in) {
+    return (in[0] << 8) | in[1];
+}
+
+static uint32_t get32(const uint8_t* in) {
+    return ((uint32_t)get16(in) << 16) | get16(in + 2);
+}
+
+// ===========================
+// Encoder
+// ===========================
+
+size_t imageMetadataEncode(const ImageMetadata& meta, uint8_t* out, size_t capacity) {
+    uint8_t segment[IMAGE_META_MAX_BYTES];
+    uint8_t* p = &segment[IMAGE_META_PREAMBLE];
+
+    p = put16(putTag(p, ImageMetaTag::IMAGE_ID, 2), meta.imageId);
+    p = put32(putTag(p, ImageMetaTag::TIME, 4), meta.timestamp);
+    if (meta.hasPosition) {
+        p = put32(put32(putTag(p, ImageMetaTag::POSITION, 8), meta.latitudeE7), meta.longitudeE7);
+    }
+    if (meta.hasAltitude) {
+        p = put32(putTag(p, ImageMetaTag::ALTITUDE, 4), meta.altitudeCm);
+    }
+    p = put16(putTag(p, ImageMetaTag::EXPOSURE, 4), meta.exposureLines);
+    *p++ = meta.gain;
+    *p++ = meta.meanLuma;
+    p = putTag(p, ImageMetaTag::SCENE, 6);
+    *p++ = meta.novelty;
+    p = put16(p, meta.sharpness);
+    *p++ = meta.sceneLabel;
+    *p++ = meta.sceneConfidence;
+    *p++ = meta.burstFrames;
+
+    size_t length = p - segment;
+    if (length > capacity) {
+        return 0;
+    }
+    segment[0] = 0xFF;
+    segment[1] = IMAGE_META_MARKER;
+    put16(&segment[2], length - 2);
+    memcpy(&segment[4], IMAGE_META_ID, sizeof(IMAGE_META_ID));
+    segment[4 + sizeof(IMAGE_META_ID)] = IMAGE_META_VERSION;
+    memcpy(out, segment, length);
+    return length;
+}
+
+// ===========================
+// Parser
+// ===========================
+
+static bool parseSegment(const uint8_t* body, size_t length, ImageMetadata& meta) {
+    if (length < sizeof(IMAGE_META_ID) + 1 || memcmp(body, IMAGE_META_ID, sizeof(IMAGE_META_ID)) != 0) {
+        return false;
+    }
+
+    memset(&meta, 0, sizeof(meta));
+    size_t pos = sizeof(IMAGE_META_ID) + 1;
+    bool haveId = false;
+    while (pos + 2 <= length && pos + 2 + body[pos + 1] <= length) {
+        ImageMetaTag tag = static_cast<ImageMetaTag>(body[pos]);
+        uint8_t size = body[pos + 1];
+        const uint8_t* value = &body[pos + 2];
+        pos += 2 + size;
+
+        // Shorter than this version's field: skipped like an unknown tag
+        switch (tag) {
+            case ImageMetaTag::IMAGE_ID:
+                if (size >= 2) {
+                    meta.imageId = get16(value);
+                    haveId = true;
+                }
+                break;
+            case ImageMetaTag::TIME:
+                if (size >= 4) {
+                    meta.timestamp = get32(value);
+                }
+                break;
+            case ImageMetaTag::POSITION:
+                if (size >= 8) {
+                    meta.latitudeE7 = (int32_t)get32(value);
+                    meta.longitudeE7 = (int32_t)get32(value + 4);
+                    meta.hasPosition = true;
+                }
+                break;
+            case ImageMetaTag::ALTITUDE:
+                if (size >= 4) {
+                    meta.altitudeCm = (int32_t)get32(value);
+                    meta.hasAltitude = true;
+                }
+                break;
+            case ImageMetaTag::EXPOSURE:
+                if (size >= 4) {
+                    meta.exposureLines = get16(value);
+                    meta.gain = value[2];
+                    meta.meanLuma = value[3];
+                }
+                break;
+            case ImageMetaTag::SCENE:
+                if (size >= 6) {
+                    meta.novelty = value[0];
+                    meta.sharpness = get16(value + 1);
+                    meta.sceneLabel = value[3];
+                    meta.sceneConfidence = value[4];
+                    meta.burstFrames = value[5];
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    meta.valid = haveId;
+    return haveId;
+}
+
+bool imageMetadataParse(const uint8_t* jpeg, size_t length, ImageMetadata& meta) {
+    meta.valid = false;
+    if (length < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+        return false;
+    }
+
+    // Marker segments up to the first scan or frame header
+    size_t pos = 2;
+    while (pos + 4 <= length && jpeg[pos] == 0xFF) {
+        uint8_t marker = jpeg[pos + 1];
+        if (marker < 0xE0 || marker > 0xEF) {
+            break;
+        }
+        size_t segmentLength = get16(&jpeg[pos + 2]);
+        if (segmentLength < 2 || pos + 2 + segmentLength > length) {
+            break;
+        }
+        if (marker == IMAGE_META_MARKER && parseSegment(&jpeg[pos + 4], segmentLength - 2, meta)) {
+            return true;
+        }
+        pos += 2 + segmentLength;
+    }
+    return false;
+}
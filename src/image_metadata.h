@@ -0,0 +1,66 @@
+#ifndef IMAGE_METADATA_H
+#define IMAGE_METADATA_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Image Metadata
+// What the balloon knew at a capture, carried inside the JPEG itself
+// ===========================
+
+// A JPEG APP9 segment straight after SOI, so it rides in the transfer's
+// first fragment and ends up in whatever file the ground writes. Any
+// decoder skips an APPn segment it doesn't know.
+//
+//   FF E9 [length 2, big endian, counts itself] 'H' 'A' 'B' 'M' [version]
+//   then TLVs: [tag][length][value, big endian]
+//
+// Tags are optional and may come in any order; a reader skips the ones
+// it doesn't know, so new ones need no version change.
+//   1  image id            u16 (CameraData::imageId)
+//   2  capture time        u32, ms (CameraData::timestamp)
+//   3  position            i32 latitude, i32 longitude, degrees x 1e7 - with a GPS lock only
+//   4  altitude            i32, cm - the fused baro/GPS estimate
+//   5  exposure            u16 sensor lines, u8 gain, u8 scene mean luma (0 lines = sensor AEC)
+//   6  scene               u8 novelty, u16 sharpness, u8 label, u8 confidence, u8 burst frames
+
+#define IMAGE_META_MARKER        0xE9    // APP9
+#define IMAGE_META_VERSION       1
+#define IMAGE_META_MAX_BYTES     64      // Whole segment, marker included
+
+enum class ImageMetaTag : uint8_t {
+    IMAGE_ID = 1,
+    TIME = 2,
+    POSITION = 3,
+    ALTITUDE = 4,
+    EXPOSURE = 5,
+    SCENE = 6
+};
+
+struct ImageMetadata {
+    uint16_t imageId;
+    uint32_t timestamp;
+    int32_t latitudeE7;
+    int32_t longitudeE7;
+    int32_t altitudeCm;
+    uint16_t exposureLines;
+    uint8_t gain;
+    uint8_t meanLuma;
+    uint8_t novelty;
+    uint16_t sharpness;
+    uint8_t sceneLabel;
+    uint8_t sceneConfidence;
+    uint8_t burstFrames;
+    bool hasPosition;
+    bool hasAltitude;
+    bool valid;                 // Parsed from a segment (an image id at least)
+};
+
+// The whole segment into out; its length, 0 if capacity is too small
+size_t imageMetadataEncode(const ImageMetadata& meta, uint8_t* out, size_t capacity);
+
+// From the segments ahead of the JPEG's first scan; false when it has none
+bool imageMetadataParse(const uint8_t* jpeg, size_t length, ImageMetadata& meta);
+
+#endif // IMAGE_METADATA_H
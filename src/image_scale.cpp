@@ -0,0 +1,354 @@
+#include "image_scale.h"
+#include <esp_heap_caps.h>
+
+// ===========================
+// Helpers
+// ===========================
+
+static inline uint8_t channelsFor(pixformat_t format) {
+    return format == PIXFORMAT_RGB565 ? 3 : 1;
+}
+
+static inline uint8_t bytesPerPixel(pixformat_t format) {
+    return format == PIXFORMAT_RGB565 ? 2 : 1;
+}
+
+static void* allocateSums(size_t size) {
+    // Hot on every source row - internal RAM first; 16-byte aligned for the PIE loads
+    void* buffer = heap_caps_aligned_alloc(16, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!buffer) {
+        buffer = heap_caps_aligned_alloc(16, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+// ===========================
+// PIE Accumulation (ESP32-S3)
+// ===========================
+
+#if IMAGE_SCALE_USE_PIE
+
+static const uint16_t PIE_MASK_5BIT = 0x001F;
+static const uint16_t PIE_MASK_3BIT = 0x0007;
+
+// 16 grey pixels per step: zip with zero to widen them to two vectors of
+// eight u16 lanes, then add into the column sums
+static void accumulateGrayPie(uint16_t* sums, const uint8_t* row, uint16_t width) {
+    for (uint16_t x = 0; x < width; x += 16) {
+        asm volatile(
+            "ee.vld.128.ip  q0, %[src], 16\n"
+            "ee.zero.q      q1\n"
+            "ee.vzip.8      q0, q1\n"
+            "ee.vld.128.ip  q2, %[acc], 16\n"
+            "ee.vld.128.ip  q3, %[acc], -32\n"
+            "ee.vadds.s16   q2, q2, q0\n"
+            "ee.vadds.s16   q3, q3, q1\n"
+            "ee.vst.128.ip  q2, %[acc], 16\n"
+            "ee.vst.128.ip  q3, %[acc], 16\n"
+            : [src] "+r"(row), [acc] "+r"(sums)
+            :
+            : "memory");
+    }
+}
+
+// 8 RGB565 pixels per step. Loaded little endian, each big-endian pixel
+// lane reads GGGBBBBB RRRRRGGG: red is bits 3-7, blue bits 8-12, green
+// bits 13-15 (low) and 0-2 (high). 32-bit lane shifts are safe - the mask
+// drops whatever crosses over from the neighbouring pixel.
+static void accumulateRGB565Pie(uint16_t* red, uint16_t* green, uint16_t* blue,
+                                const uint8_t* row, uint16_t width) {
+    for (uint16_t x = 0; x < width; x += 8) {
+        asm volatile(
+            "ee.vld.128.ip  q0, %[src], 16\n"
+            "ee.vldbc.16    q6, %[m5]\n"
+            "ee.vldbc.16    q7, %[m3]\n"
+            "ssai           3\n"
+            "ee.vsr.32      q1, q0\n"
+            "ee.andq        q1, q1, q6\n"
+            "ssai           8\n"
+            "ee.vsr.32      q2, q0\n"
+            "ee.andq        q2, q2, q6\n"
+            "ssai           13\n"
+            "ee.vsr.32      q3, q0\n"
+            "ee.andq        q3, q3, q7\n"
+            "ee.andq        q4, q0, q7\n"
+            "ee.vadds.s16   q4, q4, q4\n"
+            "ee.vadds.s16   q4, q4, q4\n"
+            "ee.vadds.s16   q4, q4, q4\n"
+            "ee.orq         q3, q3, q4\n"
+            "ee.vld.128.ip  q5, %[r], 0\n"
+            "ee.vadds.s16   q5, q5, q1\n"
+            "ee.vst.128.ip  q5, %[r], 16\n"
+            "ee.vld.128.ip  q5, %[g], 0\n"
+            "ee.vadds.s16   q5, q5, q3\n"
+            "ee.vst.128.ip  q5, %[g], 16\n"
+            "ee.vld.128.ip  q5, %[b], 0\n"
+            "ee.vadds.s16   q5, q5, q2\n"
+            "ee.vst.128.ip  q5, %[b], 16\n"
+            : [src] "+r"(row), [r] "+r"(red), [g] "+r"(green), [b] "+r"(blue)
+            : [m5] "r"(&PIE_MASK_5BIT), [m3] "r"(&PIE_MASK_3BIT)
+            : "memory");
+    }
+}
+
+#endif
+
+// ===========================
+// Image Scaler
+// ===========================
+
+ImageScaler::ImageScaler() {
+    format = PIXFORMAT_GRAYSCALE;
+    srcWidth = 0;
+    srcHeight = 0;
+    dst = nullptr;
+    dstWidth = 0;
+    dstHeight = 0;
+    sums = nullptr;
+    sumsCapacity = 0;
+    columnStart = nullptr;
+    plane = 0;
+    inputRow = 0;
+    outputRow = 0;
+    rowEnd = 0;
+    rowsSummed = 0;
+    accelerated = true;
+}
+
+ImageScaler::~ImageScaler() {
+    end();
+}
+
+bool ImageScaler::begin(pixformat_t pixelFormat, uint16_t sourceWidth, uint16_t sourceHeight,
+                        uint8_t* output, uint16_t outputWidth, uint16_t outputHeight) {
+    if ((pixelFormat != PIXFORMAT_GRAYSCALE && pixelFormat != PIXFORMAT_RGB565) || !output ||
+        outputWidth == 0 || outputHeight == 0 || outputWidth > sourceWidth || outputHeight > sourceHeight ||
+        (sourceHeight + outputHeight - 1) / outputHeight > IMAGE_SCALE_MAX_BOX_ROWS) {
+        return false;
+    }
+
+    // Planes padded to whole 16-byte vectors so the PIE loop never runs short
+    size_t padded = (sourceWidth + 15) & ~(size_t)15;
+    size_t entries = padded * channelsFor(pixelFormat) + outputWidth + 1;
+    if (entries > sumsCapacity) {
+        heap_caps_free(sums);
+        sums = static_cast<uint16_t*>(allocateSums(entries * sizeof(uint16_t)));
+        sumsCapacity = sums ? entries : 0;
+        if (!sums) {
+            dst = nullptr;
+            return false;
+        }
+    }
+
+    format = pixelFormat;
+    srcWidth = sourceWidth;
+    srcHeight = sourceHeight;
+    dst = output;
+    dstWidth = outputWidth;
+    dstHeight = outputHeight;
+    plane = padded;
+    columnStart = &sums[padded * channelsFor(pixelFormat)];
+    for (uint16_t x = 0; x <= dstWidth; x++) {
+        columnStart[x] = static_cast<uint16_t>((uint32_t)x * srcWidth / dstWidth);
+    }
+
+    memset(sums, 0, padded * channelsFor(format) * sizeof(uint16_t));
+    inputRow = 0;
+    outputRow = 0;
+    rowEnd = static_cast<uint16_t>((uint32_t)srcHeight / dstHeight);
+    rowsSummed = 0;
+    return true;
+}
+
+void ImageScaler::end() {
+    heap_caps_free(sums);
+    sums = nullptr;
+    sumsCapacity = 0;
+    columnStart = nullptr;
+    dst = nullptr;
+}
+
+uint16_t ImageScaler::pushRows(const uint8_t* rows, uint16_t rowCount, size_t stride) {
+    if (!dst || !rows) {
+        return 0;
+    }
+
+    uint16_t taken = 0;
+    while (taken < rowCount && outputRow < dstHeight) {
+        accumulate(&rows[taken * stride]);
+        taken++;
+        inputRow++;
+        rowsSummed++;
+
+        if (inputRow == rowEnd) {
+            emitRow();
+            outputRow++;
+            rowEnd = static_cast<uint16_t>((uint32_t)(outputRow + 1) * srcHeight / dstHeight);
+            rowsSummed = 0;
+            memset(sums, 0, plane * channelsFor(format) * sizeof(uint16_t));
+        }
+    }
+    return taken;
+}
+
+void ImageScaler::accumulate(const uint8_t* row) {
+#if IMAGE_SCALE_USE_PIE
+    // Aligned rows of whole vectors only; anything else takes the scalar path
+    if (accelerated && ((uintptr_t)row & 15) == 0) {
+        if (format == PIXFORMAT_GRAYSCALE && (srcWidth & 15) == 0) {
+            accumulateGrayPie(sums, row, srcWidth);
+            return;
+        }
+        if (format == PIXFORMAT_RGB565 && (srcWidth & 7) == 0) {
+            accumulateRGB565Pie(sums, &sums[plane], &sums[plane * 2], row, srcWidth);
+            return;
+        }
+    }
+#endif
+
+    if (format == PIXFORMAT_GRAYSCALE) {
+        for (uint16_t x = 0; x < srcWidth; x++) {
+            sums[x] += row[x];
+        }
+        return;
+    }
+
+    uint16_t* red = sums;
+    uint16_t* green = &sums[plane];
+    uint16_t* blue = &sums[plane * 2];
+    for (uint16_t x = 0; x < srcWidth; x++) {
+        uint16_t pixel = (row[x * 2] << 8) | row[x * 2 + 1];
+        red[x] += pixel >> 11;
+        green[x] += (pixel >> 5) & 0x3F;
+        blue[x] += pixel & 0x1F;
+    }
+}
+
+void ImageScaler::emitRow() {
+    uint8_t* out = &dst[(size_t)outputRow * dstWidth * bytesPerPixel(format)];
+
+    for (uint16_t x = 0; x < dstWidth; x++) {
+        uint16_t first = columnStart[x];
+        uint16_t last = columnStart[x + 1];
+        uint32_t count = (uint32_t)(last - first) * rowsSummed;
+        uint32_t half = count / 2;
+
+        if (format == PIXFORMAT_GRAYSCALE) {
+            uint32_t total = 0;
+            for (uint16_t i = first; i < last; i++) {
+                total += sums[i];
+            }
+            out[x] = static_cast<uint8_t>((total + half) / count);
+            continue;
+        }
+
+        uint32_t red = 0;
+        uint32_t green = 0;
+        uint32_t blue = 0;
+        for (uint16_t i = first; i < last; i++) {
+            red += sums[i];
+            green += sums[plane + i];
+            blue += sums[plane * 2 + i];
+        }
+        uint16_t pixel = static_cast<uint16_t>((((red + half) / count) << 11) |
+                                               (((green + half) / count) << 5) |
+                                               ((blue + half) / count));
+        out[x * 2] = pixel >> 8;
+        out[x * 2 + 1] = pixel & 0xFF;
+    }
+}
+
+// ===========================
+// Whole Frame
+// ===========================
+
+bool scaleImage(pixformat_t format, const uint8_t* src, uint16_t srcWidth, uint16_t srcHeight,
+                uint8_t* dst, uint16_t dstWidth, uint16_t dstHeight) {
+    if (!src) {
+        return false;
+    }
+
+    ImageScaler scaler;
+    if (!scaler.begin(format, srcWidth, srcHeight, dst, dstWidth, dstHeight)) {
+        return false;
+    }
+
+    size_t stride = (size_t)srcWidth * bytesPerPixel(format);
+    for (uint16_t row = 0; row < srcHeight; row += IMAGE_SCALE_STRIP_ROWS) {
+        uint16_t count = min<uint16_t>(IMAGE_SCALE_STRIP_ROWS, srcHeight - row);
+        scaler.pushRows(&src[row * stride], count, stride);
+    }
+    return scaler.isComplete();
+}
+
+// ===========================
+// Benchmark
+// ===========================
+
+template <typename Fn>
+static uint32_t measureCycles(Fn fn, int iterations) {
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    return ESP.getCycleCount() - start;
+}
+
+static void benchmarkFormat(const char* name, pixformat_t format, const uint8_t* src,
+                            uint16_t srcWidth, uint16_t srcHeight, uint16_t dstWidth, uint16_t dstHeight,
+                            uint8_t* scalarOut, uint8_t* pieOut, int iterations) {
+    ImageScaler scaler;
+    size_t stride = (size_t)srcWidth * bytesPerPixel(format);
+    auto run = [&](uint8_t* out, bool accelerated) {
+        scaler.begin(format, srcWidth, srcHeight, out, dstWidth, dstHeight);
+        scaler.setAccelerated(accelerated);
+        for (uint16_t row = 0; row < srcHeight; row += IMAGE_SCALE_STRIP_ROWS) {
+            scaler.pushRows(&src[row * stride], min<uint16_t>(IMAGE_SCALE_STRIP_ROWS, srcHeight - row), stride);
+        }
+    };
+
+    float pixels = (float)srcWidth * srcHeight * iterations;
+    float hz = ESP.getCpuFreqMHz() * 1000000.0f;
+    uint32_t scalar = measureCycles([&]() { run(scalarOut, false); }, iterations);
+    uint32_t pie = measureCycles([&]() { run(pieOut, true); }, iterations);
+    size_t outBytes = (size_t)dstWidth * dstHeight * bytesPerPixel(format);
+
+    Serial.printf("%-8s %ux%u -> %ux%u: scalar %.1f Mpx/s, %s %.1f Mpx/s (%s)\n",
+                 name, srcWidth, srcHeight, dstWidth, dstHeight,
+                 pixels * hz / scalar / 1000000.0f, IMAGE_SCALE_USE_PIE ? "PIE" : "scalar",
+                 pixels * hz / pie / 1000000.0f,
+                 memcmp(scalarOut, pieOut, outBytes) == 0 ? "match" : "MISMATCH");
+}
+
+void imageScaleBenchmark(int iterations) {
+    const uint16_t width = 320;
+    const uint16_t height = 240;
+
+    // 16-byte aligned source rows so the PIE path is the one measured
+    uint8_t* src = static_cast<uint8_t*>(heap_caps_aligned_alloc(16, width * height * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    uint8_t* scalarOut = static_cast<uint8_t*>(malloc(160 * 120 * 2));
+    uint8_t* pieOut = static_cast<uint8_t*>(malloc(160 * 120 * 2));
+    if (!src || !scalarOut || !pieOut || iterations <= 0) {
+        heap_caps_free(src);
+        free(scalarOut);
+        free(pieOut);
+        return;
+    }
+
+    // Noise, so every channel and lane carries data
+    for (size_t i = 0; i < (size_t)width * height * 2; i++) {
+        src[i] = random(256);
+    }
+
+    Serial.println("=== Image Scale Benchmark ===");
+    Serial.printf("%d iterations, CPU %lu MHz, PIE %s\n", iterations, ESP.getCpuFreqMHz(),
+                 IMAGE_SCALE_USE_PIE ? "built" : "not built (IMAGE_SCALE_USE_PIE 0)");
+    benchmarkFormat("Gray", PIXFORMAT_GRAYSCALE, src, width, height, 160, 120, scalarOut, pieOut, iterations);
+    benchmarkFormat("Gray", PIXFORMAT_GRAYSCALE, src, width, height, 40, 30, scalarOut, pieOut, iterations);
+    benchmarkFormat("RGB565", PIXFORMAT_RGB565, src, width, height, 160, 120, scalarOut, pieOut, iterations);
+    benchmarkFormat("RGB565", PIXFORMAT_RGB565, src, width, height, 80, 60, scalarOut, pieOut, iterations);
+
+    heap_caps_free(src);
+    free(scalarOut);
+    free(pieOut);
+}
@@ -0,0 +1,78 @@
+#ifndef IMAGE_SCALE_H
+#define IMAGE_SCALE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_camera.h>
+
+// ===========================
+// Image Scale
+// Box downscaler for GRAYSCALE and RGB565 frames, fed in strips
+// ===========================
+
+// Each output pixel is the mean of the source pixels that map onto it:
+// columns [x * srcW / dstW, (x + 1) * srcW / dstW), rows likewise. Source
+// rows are summed into one source-width accumulator per channel as they
+// arrive, and an output row is written once its last source row is in, so
+// a decoder can hand over strips and no second full frame is ever needed.
+//
+// RGB565 is big endian in memory, as the camera and jpg2rgb565() write it.
+
+// The ESP32-S3 PIE path does the per-row accumulation 16 bytes at a time.
+// imageScaleBenchmark() checks it against the scalar path before enabling this.
+#ifndef IMAGE_SCALE_USE_PIE
+#define IMAGE_SCALE_USE_PIE        0
+#endif
+
+#define IMAGE_SCALE_MAX_BOX_ROWS   128     // Source rows per output row - keeps 16-bit sums below 32768
+#define IMAGE_SCALE_STRIP_ROWS     16      // Rows per pushRows() call in scaleImage()
+
+class ImageScaler {
+public:
+    ImageScaler();
+    ~ImageScaler();
+
+    // Downscale only (dst no larger than src in either direction). dst must hold
+    // dstWidth * dstHeight pixels; the accumulators are kept for the next begin()
+    bool begin(pixformat_t format, uint16_t srcWidth, uint16_t srcHeight,
+               uint8_t* dst, uint16_t dstWidth, uint16_t dstHeight);
+    void end();
+
+    // Source rows top to bottom, stride bytes apart; returns rows taken
+    uint16_t pushRows(const uint8_t* rows, uint16_t rowCount, size_t stride);
+    bool isComplete() const { return dst && outputRow >= dstHeight; }
+
+    void setAccelerated(bool enable) { accelerated = enable; }   // PIE builds only
+
+private:
+    pixformat_t format;
+    uint16_t srcWidth;
+    uint16_t srcHeight;
+    uint8_t* dst;
+    uint16_t dstWidth;
+    uint16_t dstHeight;
+
+    // Planar column sums (one plane per channel) and output column edges
+    uint16_t* sums;
+    size_t sumsCapacity;        // uint16_t entries
+    uint16_t* columnStart;      // dstWidth + 1 entries, part of the same allocation
+    size_t plane;               // Entries per channel plane, padded to 16
+
+    uint16_t inputRow;
+    uint16_t outputRow;
+    uint16_t rowEnd;            // First source row of the next output row
+    uint16_t rowsSummed;
+    bool accelerated;
+
+    void accumulate(const uint8_t* row);
+    void emitRow();
+};
+
+// Whole frame in one go, through an ImageScaler in IMAGE_SCALE_STRIP_ROWS strips
+bool scaleImage(pixformat_t format, const uint8_t* src, uint16_t srcWidth, uint16_t srcHeight,
+                uint8_t* dst, uint16_t dstWidth, uint16_t dstHeight);
+
+// Pixels per second, scalar vs PIE, and whether the two agree
+void imageScaleBenchmark(int iterations = 10);
+
+#endif // IMAGE_SCALE_H
@@ -0,0 +1,478 @@
+#include "image_store.h"
+#include "crc_utils.h"
+#include "task_placement.h"
+#include <esp_heap_caps.h>
+#include "memory_ledger.h"
+#include "debug_utils.h"
+
+// ===========================
+// Global Instance
+// ===========================
+
+static ImageStore imageStoreInstance;
+
+ImageStore& ImageStoreMgr() {
+    return imageStoreInstance;
+}
+
+// ===========================
+// Helpers
+// ===========================
+
+static void* allocate(size_t size) {
+    // The index and staging copy are tens of KB - PSRAM when we have it
+    return memAlloc(MemTag::IMAGE_STORE, size);
+}
+
+static inline uint32_t sectorFloor(uint32_t offset) {
+    return offset & ~(uint32_t)(IMAGE_STORE_SECTOR_SIZE - 1);
+}
+
+static inline uint32_t sectorCeil(uint32_t offset) {
+    return sectorFloor(offset + IMAGE_STORE_SECTOR_SIZE - 1);
+}
+
+uint32_t ImageStore::recordSize(uint32_t length) {
+    return (sizeof(StoredImageHeader) + length + 3) & ~(uint32_t)3;
+}
+
+uint16_t ImageStore::headerCrc(const StoredImageHeader& header) {
+    return crc16Ccitt(reinterpret_cast<const uint8_t*>(&header), offsetof(StoredImageHeader, headerCrc));
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+ImageStore::ImageStore() {
+    initialized = false;
+    partition = nullptr;
+
+    index = nullptr;
+    imageCount = 0;
+    portMUX_INITIALIZE(&indexLock);
+
+    head = 0;
+    erasedEnd = 0;
+    nextSequence = 1;
+    newestImageId = 0;
+
+    writeOpen = false;
+    memset(&writeHeader, 0, sizeof(writeHeader));
+    writeOffset = 0;
+    writeLength = 0;
+    written = 0;
+    writeCrc = CRC16_CCITT_INIT;
+
+    storeTask = nullptr;
+    writeBusy = false;
+    staging = nullptr;
+    stagingSize = 0;
+    stagingLength = 0;
+    stagingId = 0;
+    stagingTimestamp = 0;
+    stagingAltitude = 0.0f;
+    stagingNovelty = 0;
+    stagingSceneLabel = 0xFF;
+    stagingSharpness = 0xFFFF;
+
+    imagesStored = 0;
+    imagesDropped = 0;
+    imagesEvicted = 0;
+    lastWriteDuration = 0;
+}
+
+ImageStore::~ImageStore() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool ImageStore::begin() {
+    if (initialized) {
+        return true;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         IMAGE_STORE_PARTITION_LABEL);
+    if (!partition) {
+        CAMERA_TRACE("ImageStore: No \"" IMAGE_STORE_PARTITION_LABEL "\" partition");
+        return false;
+    }
+
+    index = static_cast<StoredImageInfo*>(allocate(IMAGE_STORE_INDEX_SLOTS * sizeof(StoredImageInfo)));
+    if (!index) {
+        partition = nullptr;
+        return false;
+    }
+    memset(index, 0, IMAGE_STORE_INDEX_SLOTS * sizeof(StoredImageInfo));
+
+    uint32_t start = millis();
+    if (!scan()) {
+        memFree(MemTag::IMAGE_STORE, index);
+        index = nullptr;
+        partition = nullptr;
+        return false;
+    }
+    initialized = true;
+
+    CAMERA_TRACE("ImageStore: %lu images in %lu KB, write at 0x%06lx, scanned in %lu ms",
+                 imageCount, partition->size / 1024, head, millis() - start);
+    return true;
+}
+
+void ImageStore::end() {
+    if (!initialized) {
+        return;
+    }
+
+    // A write in progress is lost; it has no header yet and is skipped next boot
+    uint32_t start = millis();
+    while (writeBusy && millis() - start < 2000) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    if (!writeBusy && storeTask) {
+        vTaskDelete(storeTask);
+        storeTask = nullptr;
+    }
+    if (writeOpen) {
+        abortWrite();
+    }
+
+    // Left alone if the task outlived the wait
+    if (!writeBusy) {
+        memFree(MemTag::IMAGE_STORE, staging);
+        staging = nullptr;
+        stagingSize = 0;
+    }
+    memFree(MemTag::IMAGE_STORE, index);
+    index = nullptr;
+    imageCount = 0;
+    partition = nullptr;
+    initialized = false;
+}
+
+// Walks the whole partition: a valid header is indexed and its data skipped,
+// anything else is stepped over a word at a time
+bool ImageStore::scan() {
+    uint8_t* block = static_cast<uint8_t*>(memAllocCaps(MemTag::IMAGE_STORE,
+        IMAGE_STORE_SECTOR_SIZE + sizeof(StoredImageHeader), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    if (!block) {
+        return false;
+    }
+
+    uint32_t size = partition->size;
+    uint32_t newestSequence = 0;
+    uint32_t newestEnd = 0;
+    bool found = false;
+    uint32_t blockStart = 0;
+    uint32_t blockLength = 0;
+    uint32_t pos = 0;
+
+    while (pos + sizeof(StoredImageHeader) <= size) {
+        // Refill so a whole header at pos is in the block
+        if (pos < blockStart || pos + sizeof(StoredImageHeader) > blockStart + blockLength) {
+            blockStart = pos;
+            blockLength = min((uint32_t)(IMAGE_STORE_SECTOR_SIZE + sizeof(StoredImageHeader)), size - pos);
+            if (esp_partition_read(partition, blockStart, block, blockLength) != ESP_OK) {
+                memFree(MemTag::IMAGE_STORE, block);
+                return false;
+            }
+        }
+
+        uint32_t magic;
+        memcpy(&magic, &block[pos - blockStart], sizeof(magic));
+        if (magic != IMAGE_STORE_MAGIC) {
+            pos += 4;
+            continue;
+        }
+        StoredImageHeader header;
+        memcpy(&header, &block[pos - blockStart], sizeof(header));
+        if (header.headerCrc != headerCrc(header) ||
+            header.length == 0 || header.length > IMAGE_STORE_MAX_IMAGE_BYTES ||
+            pos + recordSize(header.length) > size) {
+            pos += 4;
+            continue;
+        }
+
+        indexRecord(header, pos);
+        if (!found || (int32_t)(header.sequence - newestSequence) > 0) {
+            newestSequence = header.sequence;
+            newestEnd = pos + recordSize(header.length);
+            newestImageId = header.imageId;
+            found = true;
+        }
+        pos += recordSize(header.length);
+    }
+    memFree(MemTag::IMAGE_STORE, block);
+
+    // The rest of the newest record's sector may hold an interrupted write,
+    // so appending starts on the next clean sector
+    nextSequence = found ? newestSequence + 1 : 1;
+    head = found ? sectorCeil(newestEnd) : 0;
+    if (head >= size) {
+        head = 0;
+    }
+    erasedEnd = head;
+    return true;
+}
+
+// ===========================
+// Index
+// ===========================
+
+void ImageStore::indexRecord(const StoredImageHeader& header, uint32_t offset) {
+    StoredImageInfo info = {offset, header.sequence, header.timestamp, header.length, header.altitude,
+                            header.imageId, header.novelty, header.sceneLabel, header.sharpness, true};
+
+    // The scan meets records out of write order once the log has wrapped
+    portENTER_CRITICAL(&indexLock);
+    StoredImageInfo& slot = index[header.imageId % IMAGE_STORE_INDEX_SLOTS];
+    if (!slot.valid) {
+        imageCount++;
+        slot = info;
+    } else if ((int32_t)(header.sequence - slot.sequence) > 0) {
+        slot = info;
+    }
+    portEXIT_CRITICAL(&indexLock);
+}
+
+void ImageStore::evictRange(uint32_t start, uint32_t end) {
+    portENTER_CRITICAL(&indexLock);
+    for (size_t i = 0; i < IMAGE_STORE_INDEX_SLOTS; i++) {
+        StoredImageInfo& slot = index[i];
+        if (slot.valid && slot.offset < end && slot.offset + recordSize(slot.length) > start) {
+            slot.valid = false;
+            imageCount--;
+            imagesEvicted++;
+        }
+    }
+    portEXIT_CRITICAL(&indexLock);
+}
+
+bool ImageStore::findImage(uint16_t imageId, StoredImageInfo& info) const {
+    if (!initialized) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&indexLock);
+    info = index[imageId % IMAGE_STORE_INDEX_SLOTS];
+    portEXIT_CRITICAL(&indexLock);
+    return info.valid && info.imageId == imageId;
+}
+
+bool ImageStore::getIndexSlot(uint16_t slot, StoredImageInfo& info) const {
+    if (!initialized || slot >= IMAGE_STORE_INDEX_SLOTS) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&indexLock);
+    info = index[slot];
+    portEXIT_CRITICAL(&indexLock);
+    return info.valid;
+}
+
+bool ImageStore::readImage(uint16_t imageId, size_t offset, uint8_t* buffer, size_t length) const {
+    StoredImageInfo info;
+    if (!buffer || !findImage(imageId, info) || offset + length > info.length) {
+        return false;
+    }
+    if (esp_partition_read(partition, info.offset + sizeof(StoredImageHeader) + offset, buffer, length) != ESP_OK) {
+        return false;
+    }
+
+    // The writer may have erased it while we read
+    StoredImageInfo after;
+    return findImage(imageId, after) && after.offset == info.offset;
+}
+
+uint16_t ImageStore::getNextImageId() const {
+    uint16_t next = newestImageId + 1;
+    return next == 0 ? 1 : next;
+}
+
+// ===========================
+// Writer
+// ===========================
+
+bool ImageStore::ensureErased(uint32_t end) {
+    while (erasedEnd < end) {
+        uint32_t sector = sectorFloor(erasedEnd);
+        evictRange(sector, sector + IMAGE_STORE_SECTOR_SIZE);
+        if (esp_partition_erase_range(partition, sector, IMAGE_STORE_SECTOR_SIZE) != ESP_OK) {
+            return false;
+        }
+        erasedEnd = sector + IMAGE_STORE_SECTOR_SIZE;
+    }
+    return true;
+}
+
+bool ImageStore::beginWrite(uint16_t imageId, size_t length, uint32_t timestamp, float altitude, uint8_t novelty,
+                            uint8_t sceneLabel, uint16_t sharpness) {
+    if (!initialized || writeOpen || length == 0 || length > IMAGE_STORE_MAX_IMAGE_BYTES) {
+        return false;
+    }
+
+    // A record never straddles the end - the tail is left and the log wraps
+    uint32_t size = recordSize(length);
+    if (size > partition->size) {
+        return false;
+    }
+    if (head + size > partition->size) {
+        head = 0;
+        erasedEnd = 0;
+    }
+    if (!ensureErased(head + size)) {
+        return false;
+    }
+
+    memset(&writeHeader, 0xFF, sizeof(writeHeader));
+    writeHeader.magic = IMAGE_STORE_MAGIC;
+    writeHeader.sequence = nextSequence;
+    writeHeader.timestamp = timestamp;
+    writeHeader.length = length;
+    writeHeader.altitude = altitude;
+    writeHeader.imageId = imageId;
+    writeHeader.novelty = novelty;
+    writeHeader.sceneLabel = sceneLabel;
+    writeHeader.sharpness = sharpness;
+
+    writeOffset = head;
+    writeLength = length;
+    written = 0;
+    writeCrc = CRC16_CCITT_INIT;
+    writeOpen = true;
+    return true;
+}
+
+bool ImageStore::write(const uint8_t* data, size_t length) {
+    if (!writeOpen || !data || written + length > writeLength) {
+        return false;
+    }
+    if (esp_partition_write(partition, writeOffset + sizeof(StoredImageHeader) + written, data, length) != ESP_OK) {
+        abortWrite();
+        return false;
+    }
+    writeCrc = crc16CcittUpdate(writeCrc, data, length);
+    written += length;
+    return true;
+}
+
+bool ImageStore::finishWrite() {
+    if (!writeOpen || written != writeLength) {
+        abortWrite();
+        return false;
+    }
+
+    writeHeader.dataCrc = writeCrc;
+    writeHeader.headerCrc = headerCrc(writeHeader);
+    if (esp_partition_write(partition, writeOffset, &writeHeader, sizeof(writeHeader)) != ESP_OK) {
+        abortWrite();
+        return false;
+    }
+
+    indexRecord(writeHeader, writeOffset);
+    head = writeOffset + recordSize(writeLength);
+    nextSequence++;
+    newestImageId = writeHeader.imageId;
+    writeOpen = false;
+    imagesStored++;
+    return true;
+}
+
+void ImageStore::abortWrite() {
+    // The space may be part written, so the next record starts after it
+    if (writeOpen) {
+        head = writeOffset + recordSize(writeLength);
+        writeOpen = false;
+    }
+}
+
+// ===========================
+// Store Task
+// ===========================
+
+bool ImageStore::storeImage(const uint8_t* jpeg, size_t length, uint16_t imageId, uint32_t timestamp,
+                            float altitude, uint8_t novelty, uint8_t sceneLabel, uint16_t sharpness) {
+    if (!initialized || !jpeg || length == 0 || length > IMAGE_STORE_MAX_IMAGE_BYTES) {
+        return false;
+    }
+    if (writeBusy || writeOpen) {
+        imagesDropped++;
+        return false;
+    }
+
+    if (!storeTask &&
+        createPlacedTask(TaskId::IMAGE_STORE, storeTaskEntry, this, &storeTask) != pdPASS) {
+        storeTask = nullptr;
+        return false;
+    }
+
+    // Grown in 4 KB steps and kept, like the camera's arenas
+    if (stagingSize < length) {
+        size_t size = (length + 4095) & ~(size_t)4095;
+        memFree(MemTag::IMAGE_STORE, staging);
+        staging = static_cast<uint8_t*>(allocate(size));
+        stagingSize = staging ? size : 0;
+        if (!staging) {
+            return false;
+        }
+    }
+
+    memcpy(staging, jpeg, length);
+    stagingLength = length;
+    stagingId = imageId;
+    stagingTimestamp = timestamp;
+    stagingAltitude = altitude;
+    stagingNovelty = novelty;
+    stagingSceneLabel = sceneLabel;
+    stagingSharpness = sharpness;
+    writeBusy = true;
+    xTaskNotifyGive(storeTask);
+    return true;
+}
+
+void ImageStore::storeTaskEntry(void* parameter) {
+    ImageStore* store = static_cast<ImageStore*>(parameter);
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint32_t start = millis();
+        bool stored = store->beginWrite(store->stagingId, store->stagingLength, store->stagingTimestamp,
+                                        store->stagingAltitude, store->stagingNovelty, store->stagingSceneLabel,
+                                        store->stagingSharpness);
+        for (size_t offset = 0; stored && offset < store->stagingLength; offset += IMAGE_STORE_WRITE_CHUNK) {
+            size_t chunk = min((size_t)IMAGE_STORE_WRITE_CHUNK, store->stagingLength - offset);
+            stored = store->write(&store->staging[offset], chunk);
+        }
+        if (stored) {
+            stored = store->finishWrite();
+        } else {
+            store->abortWrite();
+        }
+        if (!stored) {
+            store->imagesDropped++;
+        }
+        store->lastWriteDuration = millis() - start;
+        store->writeBusy = false;
+    }
+}
+
+// ===========================
+// Debug
+// ===========================
+
+void ImageStore::printStatus() const {
+    Serial.println("=== Image Store Status ===");
+    Serial.printf("Initialized: %s\n", initialized ? "Yes" : "No");
+    if (!initialized) {
+        return;
+    }
+    Serial.printf("Partition: %lu KB, write at 0x%06lx\n", partition->size / 1024, head);
+    Serial.printf("Images: %lu indexed, next id %u\n", imageCount, getNextImageId());
+    Serial.printf("Stored: %lu, dropped %lu, evicted %lu\n", imagesStored, imagesDropped, imagesEvicted);
+    Serial.printf("Last Write: %lu ms%s\n", lastWriteDuration, writeBusy ? " (one in progress)" : "");
+}
@@ -0,0 +1,162 @@
+#ifndef IMAGE_STORE_H
+#define IMAGE_STORE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "balloon_config.h"
+
+// ===========================
+// Image Store
+// Append-only log of captured JPEGs in the "images" flash partition, with
+// an in-RAM index for lookup by image id
+// ===========================
+
+// Records are packed 4-byte aligned from the start of the partition and wrap
+// back to it at the end, erasing sectors just ahead of the write position -
+// the oldest images go first, and any index entry on an erased sector with
+// them. Data is streamed in before the header, so a record cut short by a
+// reset has no header and is skipped by the scan in begin(), which rebuilds
+// the index and finds the newest record by sequence number.
+//
+// Record:
+//   [0-31]  StoredImageHeader, CRC-16 CCITT over bytes 0-29
+//   [32..]  JPEG, padded to a multiple of 4 with erased bytes
+
+#define IMAGE_STORE_PARTITION_LABEL "images"
+#define IMAGE_STORE_MAGIC           0x31474D49  // "IMG1"
+#define IMAGE_STORE_SECTOR_SIZE     4096
+#define IMAGE_STORE_INDEX_SLOTS     2048        // Slot = image id % slots; a newer id takes the slot
+#define IMAGE_STORE_MAX_IMAGE_BYTES 131072
+#define IMAGE_STORE_WRITE_CHUNK     4096        // Bytes per esp_partition_write() from the staging copy
+
+struct StoredImageHeader {
+    uint32_t magic;
+    uint32_t sequence;          // Write order, across wraps and reboots
+    uint32_t timestamp;         // millis() at capture
+    uint32_t length;            // JPEG bytes
+    float altitude;             // m
+    uint16_t imageId;           // CameraData::imageId
+    uint8_t novelty;            // 0-64 against the last image downlinked
+    uint8_t sceneLabel;         // SceneLabel, 0xFF unknown (and in records from before it was kept)
+    uint16_t sharpness;         // lumaSharpness() of the analysis plane, 0xFFFF unknown
+    uint8_t reserved[2];
+    uint16_t dataCrc;           // CRC-16 CCITT of the JPEG
+    uint16_t headerCrc;
+};
+
+static_assert(sizeof(StoredImageHeader) == 32, "Record header is part of the flash format");
+
+struct StoredImageInfo {
+    uint32_t offset;            // Record start in the partition
+    uint32_t sequence;
+    uint32_t timestamp;
+    uint32_t length;
+    float altitude;
+    uint16_t imageId;
+    uint8_t novelty;
+    uint8_t sceneLabel;
+    uint16_t sharpness;
+    bool valid;
+};
+
+class ImageStore {
+public:
+    ImageStore();
+    ~ImageStore();
+
+    bool begin();
+    void end();
+    bool isReady() const { return initialized; }
+
+    // Copies the JPEG and writes it from the store task; false while the last
+    // one is still being written
+    bool storeImage(const uint8_t* jpeg, size_t length, uint16_t imageId, uint32_t timestamp,
+                    float altitude, uint8_t novelty, uint8_t sceneLabel, uint16_t sharpness);
+    bool isWriting() const { return writeBusy; }
+
+    // Streaming writer - the whole record's space is erased up front, data
+    // follows in any number of pieces and finishWrite() commits the header.
+    // One writer at a time; storeImage() uses it from the task
+    bool beginWrite(uint16_t imageId, size_t length, uint32_t timestamp, float altitude, uint8_t novelty,
+                    uint8_t sceneLabel, uint16_t sharpness);
+    bool write(const uint8_t* data, size_t length);
+    bool finishWrite();
+    void abortWrite();
+
+    // Lookup and read-back for retransmission
+    bool findImage(uint16_t imageId, StoredImageInfo& info) const;
+    // Index slot 0..IMAGE_STORE_INDEX_SLOTS-1, for a walk over every stored image; false if empty
+    bool getIndexSlot(uint16_t slot, StoredImageInfo& info) const;
+    bool readImage(uint16_t imageId, size_t offset, uint8_t* buffer, size_t length) const;
+    uint16_t getNextImageId() const;        // After the newest stored id, never 0
+
+    // Statistics
+    uint32_t getImageCount() const { return imageCount; }
+    uint32_t getImagesStored() const { return imagesStored; }
+    uint32_t getImagesDropped() const { return imagesDropped; }
+    uint32_t getImagesEvicted() const { return imagesEvicted; }
+    size_t getCapacity() const { return partition ? partition->size : 0; }
+    void printStatus() const;
+
+private:
+    bool initialized;
+    const esp_partition_t* partition;
+
+    // Index - a slot per id modulo IMAGE_STORE_INDEX_SLOTS, PSRAM when available
+    StoredImageInfo* index;
+    uint32_t imageCount;
+    mutable portMUX_TYPE indexLock;
+
+    // Log position - head is where the next record starts, everything from
+    // head up to erasedEnd is known to be erased
+    uint32_t head;
+    uint32_t erasedEnd;
+    uint32_t nextSequence;
+    uint16_t newestImageId;
+
+    // Open record
+    bool writeOpen;
+    StoredImageHeader writeHeader;
+    uint32_t writeOffset;
+    uint32_t writeLength;
+    uint32_t written;
+    uint16_t writeCrc;
+
+    // Store task and its staging copy
+    TaskHandle_t storeTask;
+    volatile bool writeBusy;
+    uint8_t* staging;
+    size_t stagingSize;
+    size_t stagingLength;
+    uint16_t stagingId;
+    uint32_t stagingTimestamp;
+    float stagingAltitude;
+    uint8_t stagingNovelty;
+    uint8_t stagingSceneLabel;
+    uint16_t stagingSharpness;
+
+    // Statistics
+    uint32_t imagesStored;
+    uint32_t imagesDropped;
+    uint32_t imagesEvicted;
+    uint32_t lastWriteDuration;     // ms
+
+    bool scan();
+    bool ensureErased(uint32_t end);
+    void evictRange(uint32_t start, uint32_t end);
+    void indexRecord(const StoredImageHeader& header, uint32_t offset);
+    static uint32_t recordSize(uint32_t length);
+    static uint16_t headerCrc(const StoredImageHeader& header);
+    static void storeTaskEntry(void* parameter);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern ImageStore& ImageStoreMgr();
+
+#endif // IMAGE_STORE_H
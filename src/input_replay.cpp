@@ -0,0 +1,346 @@
+#include "input_replay.h"
+#include <TinyGPSPlus.h>
+#include "crc_utils.h"
+#include "baro_altitude.h"
+#include "lora_comm.h"
+#include "sensor_pins.h"
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+InputReplay::InputReplay() {
+    partition = nullptr;
+    sectorCount = 0;
+    mapped = nullptr;
+    mapHandle = 0;
+}
+
+InputReplay::~InputReplay() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool InputReplay::begin() {
+    if (mapped) {
+        return true;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         FLIGHT_RECORDER_PARTITION_LABEL);
+    if (!partition || partition->size < FLIGHT_RECORDER_SECTOR_SIZE) {
+        partition = nullptr;
+        return false;
+    }
+    sectorCount = partition->size / FLIGHT_RECORDER_SECTOR_SIZE;
+
+    const void* view = nullptr;
+    if (esp_partition_mmap(partition, 0, sectorCount * FLIGHT_RECORDER_SECTOR_SIZE, ESP_PARTITION_MMAP_DATA,
+                           &view, &mapHandle) != ESP_OK) {
+        partition = nullptr;
+        return false;
+    }
+    mapped = static_cast<const uint8_t*>(view);
+    return true;
+}
+
+void InputReplay::end() {
+    if (mapped) {
+        esp_partition_munmap(mapHandle);
+        mapped = nullptr;
+    }
+    partition = nullptr;
+    sectorCount = 0;
+}
+
+// ===========================
+// Replay
+// ===========================
+
+// -1 when no sector is valid
+int32_t InputReplay::findNewestSector() const {
+    int32_t newest = -1;
+    uint32_t newestSequence = 0;
+    for (uint32_t sector = 0; sector < sectorCount; sector++) {
+        const uint8_t* base = mapped + sector * FLIGHT_RECORDER_SECTOR_SIZE;
+        if (!FlightRecorder::checkSector(base)) {
+            continue;
+        }
+        FlightSectorHeader header;
+        memcpy(&header, base, sizeof(header));
+        if (newest < 0 || (int32_t)(header.sequence - newestSequence) > 0) {
+            newestSequence = header.sequence;
+            newest = sector;
+        }
+    }
+    return newest;
+}
+
+bool InputReplay::run(ReplaySink& sink, float speed, ReplayResult& result) {
+    memset(&result, 0, sizeof(result));
+    if (!mapped) {
+        return false;
+    }
+
+    int32_t newest = findNewestSector();
+    if (newest < 0) {
+        return true;
+    }
+
+    uint32_t start = millis();
+    uint32_t paceStart = start;         // millis() that firstTimestamp is paced from
+    uint32_t firstTimestamp = 0;
+    uint32_t lastTimestamp = 0;
+    bool timed = false;
+
+    // Oldest is the first valid sector after the newest
+    for (uint32_t step = 1; step <= sectorCount; step++) {
+        uint32_t sector = (newest + step) % sectorCount;
+        const uint8_t* base = mapped + sector * FLIGHT_RECORDER_SECTOR_SIZE;
+        if (!FlightRecorder::checkSector(base)) {
+            continue;
+        }
+        result.sectors++;
+
+        uint32_t pos = sizeof(FlightSectorHeader);
+        while (pos < FLIGHT_RECORDER_SECTOR_SIZE &&
+               FlightRecorder::checkRecord(base + pos, FLIGHT_RECORDER_SECTOR_SIZE - pos)) {
+            FlightRecordHeader header;
+            memcpy(&header, base + pos, sizeof(header));
+            const uint8_t* payload = base + pos + sizeof(header);
+            pos += FlightRecorder::recordSize(header.length);
+
+            // A boot, or a wrap that lost one, restarts millis()
+            if (header.type == (uint8_t)FlightRecordType::BOOT || (timed && header.timestamp < lastTimestamp)) {
+                if (timed) {
+                    result.recordedMs += lastTimestamp - firstTimestamp;
+                }
+                timed = false;
+                if (header.type == (uint8_t)FlightRecordType::BOOT) {
+                    result.boots++;
+                    sink.onBoot(header.timestamp);
+                    continue;
+                }
+            }
+            if (!timed) {
+                firstTimestamp = header.timestamp;
+                paceStart = millis();
+                timed = true;
+            }
+            lastTimestamp = header.timestamp;
+
+            if (speed > 0.0f) {
+                uint32_t due = (uint32_t)((header.timestamp - firstTimestamp) / speed);
+                uint32_t elapsed = millis() - paceStart;
+                if (due > elapsed) {
+                    delay(due - elapsed);
+                }
+            }
+            dispatch(sink, header, payload, result);
+        }
+    }
+    if (timed) {
+        result.recordedMs += lastTimestamp - firstTimestamp;
+    }
+    result.elapsedMs = millis() - start;
+    return true;
+}
+
+void InputReplay::dispatch(ReplaySink& sink, const FlightRecordHeader& header, const uint8_t* payload,
+                           ReplayResult& result) {
+    switch (static_cast<FlightRecordType>(header.type)) {
+        case FlightRecordType::RAW_GPS:
+            if (header.length >= 1) {
+                sink.onGps(header.timestamp, static_cast<FlightGpsSource>(payload[0]), payload + 1,
+                           header.length - 1);
+                result.records++;
+                return;
+            }
+            break;
+
+        case FlightRecordType::RAW_BARO:
+            sink.onBaro(header.timestamp, payload, header.length);
+            result.records++;
+            return;
+
+        case FlightRecordType::BARO_TRIM:
+            sink.onBaroTrim(header.timestamp, payload, header.length);
+            result.records++;
+            return;
+
+        case FlightRecordType::RADIO_RX:
+            if (header.length >= 2) {
+                sink.onRadioRx(header.timestamp, (int8_t)payload[0], (int8_t)payload[1], payload + 2,
+                               header.length - 2);
+                result.records++;
+                return;
+            }
+            break;
+
+        case FlightRecordType::CAMERA_FRAME:
+            if (header.length == sizeof(FlightCameraRecord)) {
+                FlightCameraRecord frame;
+                memcpy(&frame, payload, sizeof(frame));
+                sink.onCameraFrame(header.timestamp, frame);
+                result.records++;
+                return;
+            }
+            break;
+
+        default:
+            break;
+    }
+    result.skipped++;
+}
+
+// ===========================
+// Pipeline
+// ===========================
+
+ReplayPipeline::ReplayPipeline() {
+    gps = nullptr;
+    memset(frameBuffer, 0, sizeof(frameBuffer));
+    reset();
+}
+
+ReplayPipeline::~ReplayPipeline() {
+    delete gps;
+}
+
+void ReplayPipeline::reset() {
+    onBoot(0);
+    trimLoaded = false;
+    memset(stages, 0, sizeof(stages));
+    fixes = 0;
+    baroSamples = 0;
+    baroRejected = 0;
+    framesGood = 0;
+    framesBad = 0;
+    digest = CRC16_CCITT_INIT;
+}
+
+// What a reset clears on the balloon; the trim is the sensor's and survives
+void ReplayPipeline::onBoot(uint32_t timestamp) {
+    delete gps;
+    gps = new TinyGPSPlus();
+    ubx.reset();
+    filter.reset();
+}
+
+void ReplayPipeline::fold(const void* data, size_t length) {
+    digest = crc16CcittUpdate(digest, static_cast<const uint8_t*>(data), length);
+}
+
+void ReplayPipeline::count(ReplayStage stage, size_t bytes, uint32_t cycles) {
+    ReplayStageStats& stats = stages[static_cast<uint8_t>(stage)];
+    stats.records++;
+    stats.bytes += bytes;
+    stats.cycles += cycles;
+}
+
+void ReplayPipeline::addFix(uint32_t timestamp, double latitude, double longitude, float altitude, float variance) {
+    fixes++;
+    filter.addGpsAltitude(altitude, variance, timestamp);
+    int32_t fix[3] = { (int32_t)lround(latitude * 1e7), (int32_t)lround(longitude * 1e7),
+                       (int32_t)lroundf(altitude * 1000.0f) };
+    fold(&timestamp, sizeof(timestamp));
+    fold(fix, sizeof(fix));
+}
+
+// Same validity as SensorManager, less the fix age - replay runs faster than the
+// receiver's clock
+void ReplayPipeline::onGps(uint32_t timestamp, FlightGpsSource source, const uint8_t* data, size_t length) {
+    uint32_t start = ESP.getCycleCount();
+    for (size_t i = 0; i < length; i++) {
+        if (source == FlightGpsSource::UBX) {
+            UbxNavPvt pvt;
+            if (ubx.feed(data[i]) && ubx.is(UBX_CLASS_NAV, UBX_ID_NAV_PVT) &&
+                ubxDecodeNavPvt(ubx.getPayload(), ubx.getLength(), pvt) && pvt.fixOk &&
+                (pvt.fixType == UBX_FIX_3D || pvt.fixType == UBX_FIX_GNSS_DR) && pvt.numSV >= GPS_MIN_SATS &&
+                pvt.pDOP <= 500) {
+                float vAcc = pvt.vAcc / 1000.0f;
+                addFix(timestamp, pvt.lat * 1e-7, pvt.lon * 1e-7, pvt.hMSL / 1000.0f,
+                       vAcc > 0.0f ? vAcc * vAcc : ALT_FILTER_GPS_ALT_VAR);
+                filter.addGpsVerticalSpeed(-pvt.velD / 1000.0f, timestamp);
+            }
+        } else if (gps->encode(data[i]) && gps->location.isUpdated()) {
+            if (gps->location.isValid() && gps->satellites.value() >= GPS_MIN_SATS &&
+                !(gps->hdop.isValid() && gps->hdop.value() > 500)) {
+                addFix(timestamp, gps->location.lat(), gps->location.lng(), gps->altitude.meters(),
+                       ALT_FILTER_GPS_ALT_VAR);
+            }
+            gps->location.isUpdated();      // Reading it clears the flag
+        }
+    }
+    count(ReplayStage::GPS, length, ESP.getCycleCount() - start);
+}
+
+void ReplayPipeline::onBaroTrim(uint32_t timestamp, const uint8_t* trim, size_t length) {
+    if (length == BMP280_CALIBRATION_LEN) {
+        trimLoaded = bmp280.loadTrim(trim);
+    }
+}
+
+void ReplayPipeline::onBaro(uint32_t timestamp, const uint8_t* raw, size_t length) {
+    uint32_t start = ESP.getCycleCount();
+    Bmp280Sample sample;
+    if (!trimLoaded || length != BMP280_DATA_LEN || !bmp280.decode(raw, sample)) {
+        baroRejected++;
+        return;
+    }
+    filter.addBaro(baroAltitude(sample.pressure / 256.0f), timestamp);
+    AltitudeEstimate estimate = filter.getEstimate();
+    count(ReplayStage::BARO, length, ESP.getCycleCount() - start);
+
+    baroSamples++;
+    fold(&sample, sizeof(sample));
+    fold(&estimate.altitude, sizeof(estimate.altitude));
+    fold(&estimate.verticalSpeed, sizeof(estimate.verticalSpeed));
+}
+
+// Into RAM first, as the radio task hands it over
+void ReplayPipeline::onRadioRx(uint32_t timestamp, int8_t rssi, int8_t snr, const uint8_t* frame, size_t length) {
+    if (length > sizeof(frameBuffer)) {
+        framesBad++;
+        return;
+    }
+    uint32_t start = ESP.getCycleCount();
+    memcpy(frameBuffer, frame, length);
+    Packet packet;
+    bool good = deserializePacket(frameBuffer, length, packet) && verifyFrameCRC(frameBuffer, length);
+    count(ReplayStage::RADIO, length, ESP.getCycleCount() - start);
+
+    uint8_t outcome[4] = {0};
+    if (good) {
+        outcome[0] = 1;
+        outcome[1] = static_cast<uint8_t>(packet.type);
+        outcome[2] = packet.sequenceNumber & 0xFF;
+        outcome[3] = packet.sequenceNumber >> 8;
+        framesGood++;
+    } else {
+        framesBad++;
+    }
+    fold(outcome, sizeof(outcome));
+}
+
+void ReplayPipeline::onCameraFrame(uint32_t timestamp, const FlightCameraRecord& frame) {
+    count(ReplayStage::CAMERA, frame.length, 0);
+    fold(&frame, sizeof(frame));
+}
+
+void ReplayPipeline::printSummary(Print& out) const {
+    static const char* const names[REPLAY_STAGE_COUNT] = { "gps", "baro", "radio", "camera" };
+    AltitudeEstimate estimate = filter.getEstimate();
+    out.printf("Replay: %lu fixes, %lu baro samples (%lu rejected), %lu/%lu frames good, digest %04X\n",
+               (unsigned long)fixes, (unsigned long)baroSamples, (unsigned long)baroRejected,
+               (unsigned long)framesGood, (unsigned long)(framesGood + framesBad), digest);
+    out.printf("Replay: final altitude %.1f m, climb %.2f m/s\n", estimate.altitude, estimate.verticalSpeed);
+    for (uint8_t s = 0; s < REPLAY_STAGE_COUNT; s++) {
+        const ReplayStageStats& stats = stages[s];
+        out.printf("  %-6s %6lu records %8lu bytes %10llu cycles\n", names[s], (unsigned long)stats.records,
+                   (unsigned long)stats.bytes, (unsigned long long)stats.cycles);
+    }
+}
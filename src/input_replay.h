@@ -0,0 +1,149 @@
+#ifndef INPUT_REPLAY_H
+#define INPUT_REPLAY_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_partition.h>
+#include "flight_recorder.h"
+#include "altitude_filter.h"
+#include "bmp280.h"
+#include "ubx_gps.h"
+
+// ===========================
+// Input Replay
+// The raw inputs a capturing flight recorder logged, fed back through the
+// balloon's parsers and filter - deterministically, and as fast as they go
+// ===========================
+
+// InputReplay maps the "fr" partition read-only on its own, walks it oldest
+// sector first like FlightRecorder::getSector(), and hands each RAW_GPS,
+// RAW_BARO, BARO_TRIM, RADIO_RX and CAMERA_FRAME record to a ReplaySink with
+// the millis() it was recorded at. Nothing is written, so every run of the
+// same capture gives the sink the same calls. A BOOT record starts a new
+// millis() base; the sink hears onBoot() and pacing starts over.
+//
+// speed 0 replays as fast as the sink takes records; otherwise run() waits
+// out the recorded gaps divided by speed - 1 is real time.
+//
+// ReplayPipeline is the sink for the balloon's own input path: GPS bytes
+// into UbxParser or TinyGPSPlus as they were captured, BMP280 registers
+// through Bmp280::decode() with the captured trim, both into an
+// AltitudeFilter at their recorded times, and frames through
+// deserializePacket() and verifyFrameCRC(). It counts CPU cycles per stage
+// and folds every output into a CRC digest, which differs between two runs
+// only if the code under them does.
+//
+// A capture from another board replays after copying its partition over:
+//   esptool.py read_flash 0x3d0000 0x20000 capture.bin     (flight board)
+//   esptool.py write_flash 0x3d0000 capture.bin            (bench board)
+
+enum class ReplayStage : uint8_t {
+    GPS = 0,
+    BARO = 1,
+    RADIO = 2,
+    CAMERA = 3
+};
+
+#define REPLAY_STAGE_COUNT         4
+
+struct ReplayResult {
+    uint32_t sectors;           // Valid sectors read
+    uint32_t records;           // Raw input records handed to the sink
+    uint32_t skipped;           // Other records - telemetry, events, link
+    uint32_t boots;
+    uint32_t recordedMs;        // Recorded time covered, summed across boots
+    uint32_t elapsedMs;         // Time the replay took
+};
+
+class ReplaySink {
+public:
+    virtual ~ReplaySink() {}
+
+    virtual void onBoot(uint32_t timestamp) {}
+    virtual void onGps(uint32_t timestamp, FlightGpsSource source, const uint8_t* data, size_t length) {}
+    virtual void onBaroTrim(uint32_t timestamp, const uint8_t* trim, size_t length) {}
+    virtual void onBaro(uint32_t timestamp, const uint8_t* raw, size_t length) {}
+    virtual void onRadioRx(uint32_t timestamp, int8_t rssi, int8_t snr, const uint8_t* frame, size_t length) {}
+    virtual void onCameraFrame(uint32_t timestamp, const FlightCameraRecord& frame) {}
+};
+
+class InputReplay {
+public:
+    InputReplay();
+    ~InputReplay();
+
+    bool begin();
+    void end();
+    bool isReady() const { return mapped != nullptr; }
+
+    // false when nothing is mapped
+    bool run(ReplaySink& sink, float speed, ReplayResult& result);
+
+private:
+    const esp_partition_t* partition;
+    uint32_t sectorCount;
+    const uint8_t* mapped;
+    esp_partition_mmap_handle_t mapHandle;
+
+    int32_t findNewestSector() const;
+    void dispatch(ReplaySink& sink, const FlightRecordHeader& header, const uint8_t* payload,
+                  ReplayResult& result);
+};
+
+struct ReplayStageStats {
+    uint32_t records;
+    uint32_t bytes;
+    uint64_t cycles;
+};
+
+class TinyGPSPlus;
+
+class ReplayPipeline : public ReplaySink {
+public:
+    ReplayPipeline();
+    ~ReplayPipeline();
+
+    // Back to a fresh boot's state, counters and digest included
+    void reset();
+
+    // ReplaySink
+    void onBoot(uint32_t timestamp) override;
+    void onGps(uint32_t timestamp, FlightGpsSource source, const uint8_t* data, size_t length) override;
+    void onBaroTrim(uint32_t timestamp, const uint8_t* trim, size_t length) override;
+    void onBaro(uint32_t timestamp, const uint8_t* raw, size_t length) override;
+    void onRadioRx(uint32_t timestamp, int8_t rssi, int8_t snr, const uint8_t* frame, size_t length) override;
+    void onCameraFrame(uint32_t timestamp, const FlightCameraRecord& frame) override;
+
+    const ReplayStageStats& getStage(ReplayStage stage) const { return stages[static_cast<uint8_t>(stage)]; }
+    uint32_t getFixes() const { return fixes; }
+    uint32_t getBaroSamples() const { return baroSamples; }
+    uint32_t getBaroRejected() const { return baroRejected; }      // Before trim, or failing decode
+    uint32_t getFramesGood() const { return framesGood; }
+    uint32_t getFramesBad() const { return framesBad; }
+    AltitudeEstimate getEstimate() const { return filter.getEstimate(); }
+    uint16_t getDigest() const { return digest; }
+
+    void printSummary(Print& out) const;
+
+private:
+    TinyGPSPlus* gps;
+    UbxParser ubx;
+    Bmp280 bmp280;
+    bool trimLoaded;
+    AltitudeFilter filter;
+    uint8_t frameBuffer[MAX_PACKET_SIZE];
+
+    ReplayStageStats stages[REPLAY_STAGE_COUNT];
+    uint32_t fixes;
+    uint32_t baroSamples;
+    uint32_t baroRejected;
+    uint32_t framesGood;
+    uint32_t framesBad;
+    uint16_t digest;
+
+    void addFix(uint32_t timestamp, double latitude, double longitude, float altitude, float variance);
+    void fold(const void* data, size_t length);
+    void count(ReplayStage stage, size_t bytes, uint32_t cycles);
+};
+
+#endif // INPUT_REPLAY_H
@@ -0,0 +1,269 @@
+#include "job_scheduler.h"
+
+JobScheduler::JobScheduler() {
+    jobCount = 0;
+    task = nullptr;
+    wakes = 0;
+    triggerLock = portMUX_INITIALIZER_UNLOCKED;
+    memset(jobs, 0, sizeof(jobs));
+    memset(status, 0, sizeof(status));
+
+    static const uint32_t lateBounds[] = SCHEDULER_LATE_BOUNDS_US;
+    for (uint8_t i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+        lateHistograms[i].setBounds(lateBounds, sizeof(lateBounds) / sizeof(lateBounds[0]));
+    }
+}
+
+// ===========================
+// Jobs
+// ===========================
+
+JobId JobScheduler::add(const char* name, JobFunction function, JobPeriodReader period) {
+    if (jobCount >= SCHEDULER_MAX_JOBS || !function) {
+        return JOB_NONE;
+    }
+    JobId id = jobCount++;
+    jobs[id].function = function;
+    jobs[id].period = period;
+    jobs[id].anchor = micros();
+    status[id].name = name;
+    return id;
+}
+
+JobId JobScheduler::addPeriodic(const char* name, JobFunction function, JobPeriodReader period, bool runNow) {
+    if (!period) {
+        return JOB_NONE;
+    }
+    JobId id = add(name, function, period);
+    if (id != JOB_NONE && runNow) {
+        trigger(id);
+    }
+    return id;
+}
+
+JobId JobScheduler::addOneShot(const char* name, JobFunction function) {
+    return add(name, function, nullptr);
+}
+
+void JobScheduler::trigger(JobId id, uint32_t delayMs) {
+    if (id < 0 || id >= jobCount) {
+        return;
+    }
+    uint32_t at = micros() + delayMs * 1000;
+    portENTER_CRITICAL(&triggerLock);
+    Job& job = jobs[id];
+    if (!job.oneShotArmed || (int32_t)(at - job.oneShotAt) < 0) {
+        job.oneShotAt = at;
+        job.oneShotArmed = true;
+    }
+    portEXIT_CRITICAL(&triggerLock);
+
+    if (task && task != xTaskGetCurrentTaskHandle()) {
+        xTaskNotifyGive(task);
+    }
+}
+
+// ===========================
+// Dispatch
+// ===========================
+
+// The earlier of the job's periodic and one-shot deadlines; false if it has neither
+bool JobScheduler::nextDeadline(uint8_t index, uint32_t now, uint32_t& deadline, bool& oneShot) const {
+    const Job& job = jobs[index];
+    bool found = false;
+    oneShot = false;
+
+    uint32_t period = job.period ? job.period() : 0;
+    if (period) {
+        deadline = job.anchor + period * 1000;
+        found = true;
+    }
+    if (job.oneShotArmed && (!found || (int32_t)(job.oneShotAt - deadline) < 0)) {
+        deadline = job.oneShotAt;
+        oneShot = true;
+        found = true;
+    }
+    if (found && job.held && (int32_t)(job.holdUntil - deadline) > 0) {
+        deadline = job.holdUntil;
+    }
+    return found;
+}
+
+uint8_t JobScheduler::runDue() {
+    uint8_t ran = 0;
+    wakes++;
+
+    // A parked cadence restarts from when it's unparked, not from before
+    uint32_t start = micros();
+    for (uint8_t i = 0; i < jobCount; i++) {
+        if (jobs[i].period && jobs[i].period() == 0) {
+            jobs[i].anchor = start;
+        }
+    }
+
+    // Each job at most once per call, earliest deadline first
+    uint32_t done = 0;
+    for (;;) {
+        uint32_t now = micros();
+        int8_t earliest = JOB_NONE;
+        uint32_t earliestDeadline = 0;
+        bool earliestOneShot = false;
+
+        for (uint8_t i = 0; i < jobCount; i++) {
+            uint32_t deadline;
+            bool oneShot;
+            if ((done & (1u << i)) || !nextDeadline(i, now, deadline, oneShot) || (int32_t)(deadline - now) > 0) {
+                continue;
+            }
+            if (earliest == JOB_NONE || (int32_t)(deadline - earliestDeadline) < 0) {
+                earliest = i;
+                earliestDeadline = deadline;
+                earliestOneShot = oneShot;
+            }
+        }
+        if (earliest == JOB_NONE) {
+            break;
+        }
+
+        done |= 1u << earliest;
+        run(earliest, earliestDeadline, earliestOneShot);
+        ran++;
+    }
+    return ran;
+}
+
+void JobScheduler::run(uint8_t index, uint32_t deadline, bool oneShot) {
+    Job& job = jobs[index];
+    JobStatus& stats = status[index];
+
+    uint32_t start = micros();
+    bool ready = job.function();
+    uint32_t end = micros();
+
+    if (!ready) {
+        stats.retries++;
+        job.held = true;
+        job.holdUntil = end + SCHEDULER_RETRY_MS * 1000;
+        return;
+    }
+    job.held = false;
+
+    uint32_t late = start - deadline;
+    uint32_t duration = end - start;
+    stats.runs++;
+    stats.lateWorstUs = max(stats.lateWorstUs, late);
+    stats.lateMeanUs = stats.runs == 1 ? late : stats.lateMeanUs + ((int32_t)(late - stats.lateMeanUs) >> 4);
+    stats.runWorstUs = max(stats.runWorstUs, duration);
+    lateHistograms[index].observe(late);
+
+    if (oneShot) {
+        portENTER_CRITICAL(&triggerLock);
+        if (job.oneShotAt == deadline) {
+            job.oneShotArmed = false;   // Not one triggered again while it ran
+        }
+        portEXIT_CRITICAL(&triggerLock);
+        job.anchor = start;             // A triggered periodic job carries on from here
+        stats.periodMs = job.period ? job.period() : 0;
+        return;
+    }
+
+    // Whole periods on from the deadline, past any missed while late
+    uint32_t period = job.period();
+    stats.periodMs = period;
+    uint32_t periodUs = period * 1000;
+    job.anchor = deadline;
+    if (periodUs && end - job.anchor >= periodUs) {
+        stats.missed++;
+        uint32_t missed = (end - job.anchor) / periodUs;
+        stats.skipped += missed;
+        job.anchor += missed * periodUs;
+    }
+}
+
+void JobScheduler::wait() {
+    uint32_t until = getTimeUntilNextUs();
+    uint32_t ms = min(until / 1000 + (until % 1000 ? 1 : 0), (uint32_t)SCHEDULER_MAX_WAIT_MS);
+    if (ms == 0) {
+        return;
+    }
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+}
+
+uint32_t JobScheduler::getTimeUntilUs(JobId id) const {
+    if (id < 0 || id >= jobCount) {
+        return UINT32_MAX;
+    }
+    uint32_t now = micros();
+    uint32_t deadline;
+    bool oneShot;
+    if (!nextDeadline(id, now, deadline, oneShot)) {
+        return UINT32_MAX;
+    }
+    int32_t remaining = (int32_t)(deadline - now);
+    return remaining > 0 ? (uint32_t)remaining : 0;
+}
+
+uint32_t JobScheduler::getTimeUntilNextUs() const {
+    uint32_t next = UINT32_MAX;
+    for (uint8_t i = 0; i < jobCount; i++) {
+        next = min(next, getTimeUntilUs(i));
+    }
+    return next;
+}
+
+void JobScheduler::printStatus() const {
+    Serial.printf("=== Job Scheduler (%u jobs, %lu wakes) ===\n", jobCount, (unsigned long)wakes);
+    for (uint8_t i = 0; i < jobCount; i++) {
+        const JobStatus& stats = status[i];
+        uint32_t until = getTimeUntilUs(i);
+        Serial.printf("%-12s period %6lu ms, runs %6lu, late avg %5lu us / p99 %6lu us / worst %6lu us, "
+                      "run worst %6lu us, missed %lu, skipped %lu, retries %lu, next %s%lu ms\n",
+                      stats.name, (unsigned long)stats.periodMs, (unsigned long)stats.runs,
+                      (unsigned long)stats.lateMeanUs, (unsigned long)lateHistograms[i].getPercentileBound(99),
+                      (unsigned long)stats.lateWorstUs, (unsigned long)stats.runWorstUs, (unsigned long)stats.missed,
+                      (unsigned long)stats.skipped, (unsigned long)stats.retries,
+                      until == UINT32_MAX ? "never " : "", until == UINT32_MAX ? 0UL : (unsigned long)(until / 1000));
+    }
+}
+
+size_t JobScheduler::formatReport(char* text, size_t size) const {
+    if (size == 0) {
+        return 0;
+    }
+    // Bounds are us; ms rounds up, so a start within 100 us reads 1, and past the last bound is 9999
+    auto toMs = [](uint32_t us) { return us == UINT32_MAX ? 9999UL : (unsigned long)((us + 999) / 1000); };
+    int length = snprintf(text, size, "Sch ms");
+    if (length < 0 || (size_t)length >= size) {
+        text[0] = '\0';
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < jobCount; i++) {
+        const MetricHistogram& histogram = lateHistograms[i];
+        if (histogram.getCount() == 0) {
+            continue;
+        }
+        char entry[40];
+        int entryLength = snprintf(entry, sizeof(entry), " %s %lu/%lu", status[i].name,
+                                   toMs(histogram.getPercentileBound(50)), toMs(histogram.getPercentileBound(99)));
+        if (status[i].missed && entryLength > 0 && entryLength < (int)sizeof(entry)) {
+            entryLength += snprintf(&entry[entryLength], sizeof(entry) - entryLength, " m%lu",
+                                    (unsigned long)status[i].missed);
+        }
+        if (entryLength <= 0 || entryLength >= (int)sizeof(entry) || (size_t)(length + entryLength) >= size) {
+            break;
+        }
+        memcpy(&text[length], entry, entryLength + 1);
+        length += entryLength;
+    }
+    return length;
+}
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+static JobScheduler jobSchedulerInstance;
+
+JobScheduler& Scheduler() { return jobSchedulerInstance; }
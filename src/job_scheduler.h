@@ -0,0 +1,120 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "metrics.h"
+
+// ===========================
+// Job Scheduler
+// Earliest-deadline dispatch of periodic and one-shot jobs for one task,
+// which blocks until the next deadline instead of polling on a fixed tick
+// ===========================
+
+// A periodic job's deadline is its anchor - the deadline it last ran
+// for - plus what its period reader says now, so a period the planner or
+// the flight phase changes takes effect at once, and running late never
+// drifts the cadence: the anchor steps on by whole periods, and the ones
+// passed over are counted as skipped. A period of 0 parks the job. A
+// one-shot deadline comes from trigger(), on any job; on a periodic one
+// it runs it early and restarts its cadence from there.
+//
+// runDue() runs every job whose deadline has passed, earliest first (ties
+// in registration order), and records how late each started against its
+// deadline, into a histogram per job for /metrics. A periodic run that
+// ends past its next deadline has missed it - its result came a period
+// late or more. A job that returns false isn't ready: it's tried again after
+// SCHEDULER_RETRY_MS, its anchor unchanged. Between calls the task blocks
+// in wait() until the earliest deadline or a trigger() from another task,
+// so with nothing due the idle task has the core and can light sleep.
+//
+// Jobs are added during setup(), before the task runs; trigger() is the
+// only call for other tasks.
+
+#define SCHEDULER_MAX_JOBS      12
+#define SCHEDULER_RETRY_MS      100         // After a job that wasn't ready
+#define SCHEDULER_MAX_WAIT_MS   1000        // Longest wait() blocks, so parked periods are looked at again
+#define SCHEDULER_LATE_BOUNDS_US {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000}
+
+typedef int8_t JobId;
+#define JOB_NONE                -1
+
+typedef bool (*JobFunction)();              // false = not ready, try again shortly
+typedef uint32_t (*JobPeriodReader)();      // ms, 0 = parked
+
+struct JobStatus {
+    const char* name;
+    uint32_t periodMs;          // As of the last run
+    uint32_t runs;
+    uint32_t retries;           // Not ready when due
+    uint32_t skipped;           // Periods passed over running late
+    uint32_t missed;            // Periodic runs that ended past the next deadline
+    uint32_t lateWorstUs;       // Start past the deadline
+    uint32_t lateMeanUs;        // Exponential mean, 1/16 per run
+    uint32_t runWorstUs;
+};
+
+class JobScheduler {
+public:
+    JobScheduler();
+
+    // Periodic; the first run is one period from now, or at once with runNow
+    JobId addPeriodic(const char* name, JobFunction function, JobPeriodReader period, bool runNow = false);
+    // Only when triggered
+    JobId addOneShot(const char* name, JobFunction function);
+
+    // Any task; the job runs delayMs from now, or sooner if already due
+    void trigger(JobId id, uint32_t delayMs = 0);
+
+    // The scheduling task: runs what's due, returns how many ran
+    uint8_t runDue();
+    // Blocks until the next deadline, at most SCHEDULER_MAX_WAIT_MS
+    void wait();
+    void setTask(TaskHandle_t handle) { task = handle; }
+
+    // Until the job's next deadline, 0 if due; UINT32_MAX if parked
+    uint32_t getTimeUntilUs(JobId id) const;
+    uint32_t getTimeUntilNextUs() const;
+
+    uint8_t getJobCount() const { return jobCount; }
+    const JobStatus& getStatus(JobId id) const { return status[id]; }
+    const MetricHistogram& getLateHistogram(JobId id) const { return lateHistograms[id]; }
+    // "Sch ms name p50/p99 ..." start lateness for the STATUS packet, plus m<missed> where
+    // there are any; whole entries that fit in size, returns the length
+    size_t formatReport(char* text, size_t size) const;
+    uint32_t getWakes() const { return wakes; }
+    void printStatus() const;
+
+private:
+    struct Job {
+        JobFunction function;
+        JobPeriodReader period;
+        uint32_t anchor;            // micros() of the periodic deadline last run for
+        uint32_t oneShotAt;         // micros()
+        uint32_t holdUntil;         // micros(); no run before, after a retry
+        bool oneShotArmed;
+        bool held;
+    };
+
+    Job jobs[SCHEDULER_MAX_JOBS];
+    JobStatus status[SCHEDULER_MAX_JOBS];
+    MetricHistogram lateHistograms[SCHEDULER_MAX_JOBS];     // us
+    uint8_t jobCount;
+    TaskHandle_t task;
+    uint32_t wakes;
+    portMUX_TYPE triggerLock;
+
+    JobId add(const char* name, JobFunction function, JobPeriodReader period);
+    bool nextDeadline(uint8_t index, uint32_t now, uint32_t& deadline, bool& oneShot) const;
+    void run(uint8_t index, uint32_t deadline, bool oneShot);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern JobScheduler& Scheduler();
+
+#endif // JOB_SCHEDULER_H
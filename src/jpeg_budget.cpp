@@ -0,0 +1,150 @@
+#include "jpeg_budget.h"
+#include <math.h>
+
+// Frame sizes the controller steps between, smallest first
+static const framesize_t JPEG_BUDGET_LADDER[] = {
+    FRAMESIZE_QQVGA, FRAMESIZE_QVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA,
+    FRAMESIZE_XGA, FRAMESIZE_SXGA, FRAMESIZE_UXGA
+};
+#define JPEG_BUDGET_LADDER_SIZE (sizeof(JPEG_BUDGET_LADDER) / sizeof(JPEG_BUDGET_LADDER[0]))
+
+uint32_t frameSizePixels(framesize_t size) {
+    switch (size) {
+        case FRAMESIZE_QQVGA: return 160UL * 120;
+        case FRAMESIZE_QVGA:  return 320UL * 240;
+        case FRAMESIZE_VGA:   return 640UL * 480;
+        case FRAMESIZE_SVGA:  return 800UL * 600;
+        case FRAMESIZE_XGA:   return 1024UL * 768;
+        case FRAMESIZE_SXGA:  return 1280UL * 1024;
+        case FRAMESIZE_UXGA:  return 1600UL * 1200;
+        default:              return 0;
+    }
+}
+
+static inline uint8_t lumaBand(uint8_t meanLuma) {
+    return meanLuma / (256 / JPEG_BUDGET_LUMA_BANDS);
+}
+
+// ===========================
+// Model
+// ===========================
+
+JpegSizeModel::JpegSizeModel() {
+    reset();
+}
+
+void JpegSizeModel::reset() {
+    memset(cells, 0, sizeof(cells));
+    samples = 0;
+    lastError = 0.0f;
+}
+
+void JpegSizeModel::record(framesize_t size, int quality, uint8_t meanLuma, size_t bytes) {
+    uint32_t pixels = frameSizePixels(size);
+    if (pixels == 0 || bytes == 0) {
+        return;
+    }
+
+    size_t predicted = predict(size, quality, meanLuma);
+    lastError = predicted ? (float)bytes / predicted - 1.0f : 0.0f;
+
+    Cell& cell = cells[size][lumaBand(meanLuma)];
+    float q = (float)quality;
+    float y = logf((float)bytes / pixels);
+    cell.weight = cell.weight * JPEG_BUDGET_FORGET + 1.0f;
+    cell.sumQ = cell.sumQ * JPEG_BUDGET_FORGET + q;
+    cell.sumY = cell.sumY * JPEG_BUDGET_FORGET + y;
+    cell.sumQQ = cell.sumQQ * JPEG_BUDGET_FORGET + q * q;
+    cell.sumQY = cell.sumQY * JPEG_BUDGET_FORGET + q * y;
+    samples++;
+}
+
+void JpegSizeModel::fit(framesize_t size, uint8_t meanLuma, float& intercept, float& slope) const {
+    slope = JPEG_BUDGET_PRIOR_SLOPE;
+    intercept = logf(JPEG_BUDGET_PRIOR_BPP) - JPEG_BUDGET_PRIOR_SLOPE * JPEG_BUDGET_PRIOR_QUALITY;
+
+    // Nearest cell with captures - same band first, then neighbouring bands
+    int band = lumaBand(meanLuma);
+    const Cell* found = nullptr;
+    for (int bandStep = 0; bandStep < JPEG_BUDGET_LUMA_BANDS && !found; bandStep++) {
+        for (int sizeStep = 0; sizeStep < JPEG_BUDGET_FRAMESIZES && !found; sizeStep++) {
+            const int bands[2] = {band - bandStep, band + bandStep};
+            const int sizes[2] = {(int)size - sizeStep, (int)size + sizeStep};
+            for (int b = 0; b < 2 && !found; b++) {
+                for (int s = 0; s < 2 && !found; s++) {
+                    if (bands[b] >= 0 && bands[b] < JPEG_BUDGET_LUMA_BANDS &&
+                        sizes[s] >= 0 && sizes[s] < JPEG_BUDGET_FRAMESIZES &&
+                        cells[sizes[s]][bands[b]].weight > 0.0f) {
+                        found = &cells[sizes[s]][bands[b]];
+                    }
+                }
+            }
+        }
+    }
+    if (!found) {
+        return;
+    }
+
+    float meanQ = found->sumQ / found->weight;
+    float meanY = found->sumY / found->weight;
+    float variance = found->sumQQ / found->weight - meanQ * meanQ;
+    if (variance >= JPEG_BUDGET_MIN_SPREAD) {
+        float fitted = (found->sumQY / found->weight - meanQ * meanY) / variance;
+        slope = constrain(fitted, JPEG_BUDGET_SLOPE_MIN, JPEG_BUDGET_SLOPE_MAX);
+    }
+    intercept = meanY - slope * meanQ;
+}
+
+size_t JpegSizeModel::predict(framesize_t size, int quality, uint8_t meanLuma) const {
+    uint32_t pixels = frameSizePixels(size);
+    if (pixels == 0) {
+        return 0;
+    }
+
+    float intercept, slope;
+    fit(size, meanLuma, intercept, slope);
+    return (size_t)(pixels * expf(intercept + slope * quality));
+}
+
+// ===========================
+// Controller
+// ===========================
+
+int JpegSizeModel::qualityFor(framesize_t size, uint8_t meanLuma, size_t budget,
+                              int bestQuality, int worstQuality) const {
+    uint32_t pixels = frameSizePixels(size);
+    if (pixels == 0 || budget == 0) {
+        return -1;
+    }
+
+    // Solve ln(budget / pixels) = a + b * q; b < 0, so round towards smaller files
+    float intercept, slope;
+    fit(size, meanLuma, intercept, slope);
+    float exact = (logf((float)budget / pixels) - intercept) / slope;
+    int quality = (int)ceilf(exact);
+    if (quality < bestQuality) {
+        quality = bestQuality;
+    }
+    return quality <= worstQuality ? quality : -1;
+}
+
+JpegBudgetChoice JpegSizeModel::choose(size_t budget, uint8_t meanLuma, framesize_t maxSize,
+                                       int bestQuality, int worstQuality) const {
+    JpegBudgetChoice choice = {JPEG_BUDGET_LADDER[0], worstQuality, 0};
+
+    for (int i = JPEG_BUDGET_LADDER_SIZE - 1; i >= 0; i--) {
+        framesize_t size = JPEG_BUDGET_LADDER[i];
+        if (size > maxSize) {
+            continue;
+        }
+        int quality = qualityFor(size, meanLuma, budget, bestQuality, worstQuality);
+        if (quality >= 0) {
+            choice.frameSize = size;
+            choice.quality = quality;
+            break;
+        }
+    }
+
+    choice.predictedBytes = predict(choice.frameSize, choice.quality, meanLuma);
+    return choice;
+}
@@ -0,0 +1,76 @@
+#ifndef JPEG_BUDGET_H
+#define JPEG_BUDGET_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_camera.h>
+
+// ===========================
+// JPEG Budget
+// Size model learned from real captures, and the frame size and quality
+// predicted to fit a byte budget
+// ===========================
+
+// Size is modelled per pixel and log-linear in the sensor quality number
+// (0-63, higher = smaller file): ln(bytes / pixels) = a + b * quality.
+// Each (frame size, brightness band) cell keeps exponentially forgotten
+// moments of its captures and refits a and b from them, so the model follows
+// the scene as light and altitude change. An empty cell borrows from the
+// nearest cell that has captures - bytes per pixel move little between frame
+// sizes - and a cell that has only seen one quality keeps the prior slope.
+
+#define JPEG_BUDGET_FRAMESIZES     (FRAMESIZE_UXGA + 1)
+#define JPEG_BUDGET_LUMA_BANDS     4        // Scene mean luma, 64 levels per band
+#define JPEG_BUDGET_FORGET         0.7f     // Weight the older captures keep per new one
+#define JPEG_BUDGET_PRIOR_BPP      0.13f    // Bytes per pixel at the prior quality, before any capture
+#define JPEG_BUDGET_PRIOR_QUALITY  12
+#define JPEG_BUDGET_PRIOR_SLOPE    -0.045f  // ln(bytes) per quality step until captures show a spread
+#define JPEG_BUDGET_MIN_SPREAD     4.0f     // Quality variance a cell needs to fit its own slope
+#define JPEG_BUDGET_SLOPE_MIN      -0.15f
+#define JPEG_BUDGET_SLOPE_MAX      -0.01f
+
+struct JpegBudgetChoice {
+    framesize_t frameSize;
+    int quality;
+    size_t predictedBytes;
+};
+
+class JpegSizeModel {
+public:
+    JpegSizeModel();
+
+    void reset();
+    void record(framesize_t size, int quality, uint8_t meanLuma, size_t bytes);
+    size_t predict(framesize_t size, int quality, uint8_t meanLuma) const;
+
+    // Lowest quality number in [bestQuality, worstQuality] predicted to fit, -1 if none does
+    int qualityFor(framesize_t size, uint8_t meanLuma, size_t budget, int bestQuality, int worstQuality) const;
+
+    // Largest frame size up to maxSize that fits at worstQuality or better; the
+    // smallest size at worstQuality when nothing fits
+    JpegBudgetChoice choose(size_t budget, uint8_t meanLuma, framesize_t maxSize,
+                            int bestQuality, int worstQuality) const;
+
+    uint32_t getSamples() const { return samples; }
+    float getLastError() const { return lastError; }   // Last capture: actual / predicted - 1
+
+private:
+    struct Cell {
+        float weight;
+        float sumQ;
+        float sumY;         // Y = ln(bytes / pixels)
+        float sumQQ;
+        float sumQY;
+    };
+
+    Cell cells[JPEG_BUDGET_FRAMESIZES][JPEG_BUDGET_LUMA_BANDS];
+    uint32_t samples;
+    float lastError;
+
+    void fit(framesize_t size, uint8_t meanLuma, float& intercept, float& slope) const;
+};
+
+// Pixels in a frame size, 0 for sizes the model doesn't cover
+uint32_t frameSizePixels(framesize_t size);
+
+#endif // JPEG_BUDGET_H
@@ -0,0 +1,533 @@
+#include "jpeg_dc.h"
+#include <esp_heap_caps.h>
+#include <img_converters.h>
+#include "scene_change.h"
+
+#define JPEG_DC_MAX_COMPONENTS  3
+#define JPEG_DC_MAX_SAMPLING    2       // Per axis, per component
+#define JPEG_DC_TABLES          2       // Baseline: two DC and two AC tables
+
+// Markers
+#define JPEG_SOI   0xD8
+#define JPEG_EOI   0xD9
+#define JPEG_SOF0  0xC0
+#define JPEG_SOF1  0xC1
+#define JPEG_DHT   0xC4
+#define JPEG_DQT   0xDB
+#define JPEG_DRI   0xDD
+#define JPEG_SOS   0xDA
+#define JPEG_RST0  0xD0
+#define JPEG_RST7  0xD7
+
+struct HuffmanTable {
+    uint16_t fast[1 << JPEG_DC_FAST_BITS];  // (length << 8) | symbol; 0 = longer than JPEG_DC_FAST_BITS
+    uint32_t maxCode[18];                   // Per length, first code past it, left aligned to 16 bits
+    int16_t valueOffset[17];                // Symbol index = code + offset, per length
+    uint8_t symbols[256];
+    bool defined;
+};
+
+struct JpegComponent {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t quant;
+    uint8_t dcTable;
+    uint8_t acTable;
+    int32_t predictor;
+};
+
+struct JpegDcState {
+    HuffmanTable dc[JPEG_DC_TABLES];
+    HuffmanTable ac[JPEG_DC_TABLES];
+    uint16_t quant[4];                      // Each table's DC step
+    JpegComponent components[JPEG_DC_MAX_COMPONENTS];
+    uint8_t componentCount;
+    uint16_t restartInterval;
+
+    // Bit reader
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t bits;                          // Left aligned
+    int bitCount;
+    bool markerHit;
+};
+
+size_t jpegDcWorkspaceSize() {
+    return sizeof(JpegDcState);
+}
+
+// ===========================
+// Huffman Tables
+// ===========================
+
+static bool buildTable(HuffmanTable& table, const uint8_t* counts, const uint8_t* symbols) {
+    uint16_t total = 0;
+    for (int length = 1; length <= 16; length++) {
+        total += counts[length - 1];
+    }
+    if (total > 256) {
+        return false;
+    }
+    memcpy(table.symbols, symbols, total);
+    memset(table.fast, 0, sizeof(table.fast));
+
+    // Canonical codes: consecutive within a length, doubled going to the next
+    uint32_t code = 0;
+    uint16_t index = 0;
+    for (int length = 1; length <= 16; length++) {
+        table.valueOffset[length] = (int16_t)(index - code);
+        for (uint8_t i = 0; i < counts[length - 1]; i++, index++, code++) {
+            if (length <= JPEG_DC_FAST_BITS) {
+                uint16_t first = code << (JPEG_DC_FAST_BITS - length);
+                uint16_t fill = 1 << (JPEG_DC_FAST_BITS - length);
+                for (uint16_t j = 0; j < fill; j++) {
+                    table.fast[first + j] = (length << 8) | table.symbols[index];
+                }
+            }
+        }
+        if (code > (1UL << length)) {
+            return false;   // More codes than the length has room for
+        }
+        table.maxCode[length] = code << (16 - length);
+        code <<= 1;
+    }
+    table.maxCode[17] = 0xFFFFFFFF;
+    table.defined = true;
+    return true;
+}
+
+// ===========================
+// Bit Reader
+// ===========================
+
+// Entropy bytes into the bit buffer, FF00 unstuffed; a marker stops it and
+// zeros are fed from there
+static inline void fillBits(JpegDcState& st) {
+    while (st.bitCount <= 24) {
+        uint8_t byte = 0;
+        if (!st.markerHit && st.p < st.end) {
+            byte = *st.p;
+            if (byte == 0xFF) {
+                uint8_t next = st.p + 1 < st.end ? st.p[1] : JPEG_EOI;
+                if (next == 0x00) {
+                    st.p += 2;
+                } else {
+                    st.markerHit = true;
+                    byte = 0;
+                }
+            } else {
+                st.p++;
+            }
+        }
+        st.bits |= (uint32_t)byte << (24 - st.bitCount);
+        st.bitCount += 8;
+    }
+}
+
+static inline uint32_t getBits(JpegDcState& st, int count) {
+    fillBits(st);
+    uint32_t value = st.bits >> (32 - count);
+    st.bits <<= count;
+    st.bitCount -= count;
+    return value;
+}
+
+// A magnitude category's bits as a signed value
+static inline int32_t receiveExtend(JpegDcState& st, int size) {
+    if (size == 0) {
+        return 0;
+    }
+    int32_t value = getBits(st, size);
+    return value < (1 << (size - 1)) ? value - (1 << size) + 1 : value;
+}
+
+// Next symbol, -1 on a code the table doesn't have
+static inline int decodeSymbol(JpegDcState& st, const HuffmanTable& table) {
+    fillBits(st);
+    uint16_t fast = table.fast[st.bits >> (32 - JPEG_DC_FAST_BITS)];
+    if (fast) {
+        uint8_t length = fast >> 8;
+        st.bits <<= length;
+        st.bitCount -= length;
+        return fast & 0xFF;
+    }
+
+    uint32_t peek = st.bits >> 16;
+    int length = JPEG_DC_FAST_BITS + 1;
+    while (peek >= table.maxCode[length]) {
+        length++;
+    }
+    if (length > 16) {
+        return -1;
+    }
+    int index = (int)(peek >> (16 - length)) + table.valueOffset[length];
+    if (index < 0 || index > 255) {
+        return -1;
+    }
+    st.bits <<= length;
+    st.bitCount -= length;
+    return table.symbols[index];
+}
+
+// A block's DC predictor after it; the AC run-lengths are read past
+static bool decodeBlock(JpegDcState& st, JpegComponent& component) {
+    int size = decodeSymbol(st, st.dc[component.dcTable]);
+    if (size < 0 || size > 11) {
+        return false;
+    }
+    component.predictor += receiveExtend(st, size);
+
+    const HuffmanTable& ac = st.ac[component.acTable];
+    for (int k = 1; k < 64; k++) {
+        int symbol = decodeSymbol(st, ac);
+        if (symbol < 0) {
+            return false;
+        }
+        int run = symbol >> 4;
+        int bits = symbol & 0x0F;
+        if (bits == 0) {
+            if (run != 15) {
+                break;      // End of block
+            }
+            k += 15;        // Sixteen zeros
+            continue;
+        }
+        k += run;
+        getBits(st, bits);
+    }
+    return true;
+}
+
+// Past the RSTn the last interval ended at, bit buffer and predictors reset
+static bool restart(JpegDcState& st) {
+    st.bits = 0;
+    st.bitCount = 0;
+    st.markerHit = false;
+    while (st.p + 1 < st.end && !(st.p[0] == 0xFF && st.p[1] >= JPEG_RST0 && st.p[1] <= JPEG_RST7)) {
+        st.p++;
+    }
+    if (st.p + 1 >= st.end) {
+        return false;
+    }
+    st.p += 2;
+    for (uint8_t c = 0; c < st.componentCount; c++) {
+        st.components[c].predictor = 0;
+    }
+    return true;
+}
+
+// ===========================
+// Decode
+// ===========================
+
+static inline uint8_t dcLevel(int32_t predictor, uint16_t step) {
+    int32_t coefficient = predictor * step;
+    int32_t level = (coefficient >= 0 ? coefficient + 4 : coefficient - 4) / 8 + 128;
+    return (uint8_t)constrain(level, 0, 255);
+}
+
+static bool decodeScan(JpegDcState& st, uint16_t frameWidth, uint16_t frameHeight, uint8_t* rgb565, uint8_t* luma) {
+    // One component is never interleaved: an MCU is one block whatever its sampling
+    uint8_t hMax = 1;
+    uint8_t vMax = 1;
+    if (st.componentCount == 1) {
+        st.components[0].h = 1;
+        st.components[0].v = 1;
+    }
+    for (uint8_t c = 0; c < st.componentCount; c++) {
+        hMax = max(hMax, st.components[c].h);
+        vMax = max(vMax, st.components[c].v);
+        st.components[c].predictor = 0;
+    }
+
+    uint16_t outWidth = frameWidth >> 3;
+    uint16_t outHeight = frameHeight >> 3;
+    uint16_t mcuColumns = (frameWidth + 8 * hMax - 1) / (8 * hMax);
+    uint16_t mcuRows = (frameHeight + 8 * vMax - 1) / (8 * vMax);
+
+    int32_t dcs[JPEG_DC_MAX_COMPONENTS][JPEG_DC_MAX_SAMPLING * JPEG_DC_MAX_SAMPLING];
+    uint32_t mcu = 0;
+    for (uint16_t row = 0; row < mcuRows; row++) {
+        for (uint16_t column = 0; column < mcuColumns; column++, mcu++) {
+            if (st.restartInterval && mcu > 0 && mcu % st.restartInterval == 0 && !restart(st)) {
+                return false;
+            }
+            for (uint8_t c = 0; c < st.componentCount; c++) {
+                JpegComponent& component = st.components[c];
+                for (uint8_t block = 0; block < component.h * component.v; block++) {
+                    if (!decodeBlock(st, component)) {
+                        return false;
+                    }
+                    dcs[c][block] = component.predictor;
+                }
+            }
+
+            // A pixel per luma block, chroma from the block covering it
+            for (uint8_t py = 0; py < vMax; py++) {
+                uint16_t y = row * vMax + py;
+                for (uint8_t px = 0; px < hMax; px++) {
+                    uint16_t x = column * hMax + px;
+                    if (x >= outWidth || y >= outHeight) {
+                        continue;
+                    }
+                    uint8_t levels[JPEG_DC_MAX_COMPONENTS] = {0, 128, 128};
+                    for (uint8_t c = 0; c < st.componentCount; c++) {
+                        const JpegComponent& component = st.components[c];
+                        uint8_t block = (py * component.v / vMax) * component.h + px * component.h / hMax;
+                        levels[c] = dcLevel(dcs[c][block], st.quant[component.quant]);
+                    }
+
+                    size_t index = (size_t)y * outWidth + x;
+                    if (luma) {
+                        luma[index] = levels[0];
+                    }
+                    if (rgb565) {
+                        // BT.601 full range, 16-bit fixed point
+                        int32_t yy = levels[0];
+                        int32_t cb = levels[1] - 128;
+                        int32_t cr = levels[2] - 128;
+                        int32_t r = constrain(yy + ((91881 * cr) >> 16), 0, 255);
+                        int32_t g = constrain(yy - ((22554 * cb + 46802 * cr) >> 16), 0, 255);
+                        int32_t b = constrain(yy + ((116130 * cb) >> 16), 0, 255);
+                        uint16_t pixel = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+                        rgb565[index * 2] = pixel >> 8;
+                        rgb565[index * 2 + 1] = pixel & 0xFF;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool jpegDecodeDc(const uint8_t* jpeg, size_t length, uint8_t* rgb565, uint8_t* luma,
+                  uint16_t& width, uint16_t& height, void* workspace) {
+    width = 0;
+    height = 0;
+    if (!jpeg || !workspace || length < 4 || jpeg[0] != 0xFF || jpeg[1] != JPEG_SOI) {
+        return false;
+    }
+    JpegDcState& st = *static_cast<JpegDcState*>(workspace);
+    for (uint8_t t = 0; t < JPEG_DC_TABLES; t++) {
+        st.dc[t].defined = false;
+        st.ac[t].defined = false;
+    }
+    memset(st.quant, 0, sizeof(st.quant));
+    st.componentCount = 0;
+    st.restartInterval = 0;
+
+    const uint8_t* p = jpeg + 2;
+    const uint8_t* end = jpeg + length;
+    while (p + 4 <= end) {
+        if (p[0] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = p[1];
+        if (marker == 0xFF) {
+            p++;            // Fill byte
+            continue;
+        }
+        p += 2;
+        if (marker == JPEG_EOI) {
+            return false;
+        }
+        uint16_t segmentLength = (p[0] << 8) | p[1];
+        if (segmentLength < 2 || p + segmentLength > end) {
+            return false;
+        }
+        const uint8_t* seg = p + 2;
+        const uint8_t* segEnd = p + segmentLength;
+
+        switch (marker) {
+            case JPEG_DQT:
+                // Only each table's first (DC) entry is used
+                while (seg < segEnd) {
+                    bool wide = (seg[0] >> 4) != 0;
+                    uint8_t id = seg[0] & 0x0F;
+                    if (id > 3 || seg + 1 + (wide ? 128 : 64) > segEnd) {
+                        return false;
+                    }
+                    st.quant[id] = wide ? (seg[1] << 8) | seg[2] : seg[1];
+                    seg += 1 + (wide ? 128 : 64);
+                }
+                break;
+
+            case JPEG_DHT:
+                while (seg + 17 <= segEnd) {
+                    uint8_t tableClass = seg[0] >> 4;
+                    uint8_t id = seg[0] & 0x0F;
+                    uint16_t count = 0;
+                    for (int i = 1; i <= 16; i++) {
+                        count += seg[i];
+                    }
+                    if (tableClass > 1 || id >= JPEG_DC_TABLES || seg + 17 + count > segEnd) {
+                        return false;
+                    }
+                    HuffmanTable& table = tableClass == 0 ? st.dc[id] : st.ac[id];
+                    if (!buildTable(table, &seg[1], &seg[17])) {
+                        return false;
+                    }
+                    seg += 17 + count;
+                }
+                break;
+
+            case JPEG_SOF0:
+            case JPEG_SOF1:
+                if (segmentLength < 8 || seg[0] != 8) {
+                    return false;
+                }
+                height = (seg[1] << 8) | seg[2];
+                width = (seg[3] << 8) | seg[4];
+                st.componentCount = seg[5];
+                if ((st.componentCount != 1 && st.componentCount != 3) ||
+                    segmentLength < 8 + 3 * st.componentCount || width == 0 || height == 0) {
+                    return false;
+                }
+                for (uint8_t c = 0; c < st.componentCount; c++) {
+                    JpegComponent& component = st.components[c];
+                    component.id = seg[6 + c * 3];
+                    component.h = seg[7 + c * 3] >> 4;
+                    component.v = seg[7 + c * 3] & 0x0F;
+                    component.quant = seg[8 + c * 3] & 0x03;
+                    if (component.h < 1 || component.h > JPEG_DC_MAX_SAMPLING ||
+                        component.v < 1 || component.v > JPEG_DC_MAX_SAMPLING) {
+                        return false;
+                    }
+                }
+                break;
+
+            case JPEG_DRI:
+                if (segmentLength < 4) {
+                    return false;
+                }
+                st.restartInterval = (seg[0] << 8) | seg[1];
+                break;
+
+            case JPEG_SOS: {
+                // Every component in the one scan - a baseline frame's only one
+                uint8_t scanCount = seg[0];
+                if (st.componentCount == 0 || scanCount != st.componentCount ||
+                    segmentLength < 6 + 2 * scanCount) {
+                    return false;
+                }
+                for (uint8_t s = 0; s < scanCount; s++) {
+                    uint8_t id = seg[1 + s * 2];
+                    uint8_t tables = seg[2 + s * 2];
+                    JpegComponent& component = st.components[s];
+                    if (component.id != id) {
+                        return false;
+                    }
+                    component.dcTable = tables >> 4;
+                    component.acTable = tables & 0x0F;
+                    if (component.dcTable >= JPEG_DC_TABLES || component.acTable >= JPEG_DC_TABLES ||
+                        !st.dc[component.dcTable].defined || !st.ac[component.acTable].defined ||
+                        st.quant[component.quant] == 0) {
+                        return false;
+                    }
+                }
+
+                st.p = segEnd;
+                st.end = end;
+                st.bits = 0;
+                st.bitCount = 0;
+                st.markerHit = false;
+                return decodeScan(st, width, height, rgb565, luma);
+            }
+
+            default:
+                // Progressive, lossless, arithmetic and hierarchical frames
+                if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC8 && marker != 0xCC) {
+                    return false;
+                }
+                break;
+        }
+        p = segEnd;
+    }
+    return false;
+}
+
+// ===========================
+// Benchmark
+// ===========================
+
+template <typename Fn>
+static uint32_t measureCycles(Fn fn, int iterations) {
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    return ESP.getCycleCount() - start;
+}
+
+void jpegDcBenchmark(int iterations) {
+    const uint16_t width = 640;
+    const uint16_t height = 480;
+    const size_t outPixels = (size_t)(width >> 3) * (height >> 3);
+
+    uint8_t* frame = static_cast<uint8_t*>(heap_caps_malloc((size_t)width * height * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    uint8_t* romOut = static_cast<uint8_t*>(malloc(outPixels * 3));
+    uint8_t* dcOut = static_cast<uint8_t*>(malloc(outPixels * 3));
+    void* workspace = malloc(jpegDcWorkspaceSize());
+    uint8_t* jpeg = nullptr;
+    size_t jpegLength = 0;
+    if (!frame || !romOut || !dcOut || !workspace || iterations <= 0) {
+        heap_caps_free(frame);
+        free(romOut);
+        free(dcOut);
+        free(workspace);
+        return;
+    }
+
+    // Sky-to-ground gradients with noise, so the AC codes aren't all end-of-block
+    for (uint16_t y = 0; y < height; y++) {
+        for (uint16_t x = 0; x < width; x++) {
+            uint8_t r = (x * 255 / width + random(32)) & 0xFF;
+            uint8_t g = (y * 255 / height + random(32)) & 0xFF;
+            uint8_t b = (255 - y * 255 / height) & 0xFF;
+            uint16_t pixel = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+            size_t i = ((size_t)y * width + x) * 2;
+            frame[i] = pixel >> 8;
+            frame[i + 1] = pixel & 0xFF;
+        }
+    }
+    bool encoded = fmt2jpg(frame, (size_t)width * height * 2, width, height, PIXFORMAT_RGB565, 80, &jpeg, &jpegLength);
+    heap_caps_free(frame);
+    if (!encoded) {
+        free(romOut);
+        free(dcOut);
+        free(workspace);
+        return;
+    }
+
+    uint16_t decodedWidth = 0;
+    uint16_t decodedHeight = 0;
+    bool romOk = true;
+    bool dcOk = true;
+    uint32_t rom = measureCycles([&]() {
+        romOk = jpg2rgb565(jpeg, jpegLength, romOut, JPG_SCALE_8X) && romOk;
+        rgb565ToLuma(romOut, outPixels, &romOut[outPixels * 2]);
+    }, iterations);
+    uint32_t dc = measureCycles([&]() {
+        dcOk = jpegDecodeDc(jpeg, jpegLength, dcOut, &dcOut[outPixels * 2], decodedWidth, decodedHeight,
+                            workspace) && dcOk;
+    }, iterations);
+
+    uint32_t difference = 0;
+    for (size_t i = 0; i < outPixels; i++) {
+        difference += abs((int)romOut[outPixels * 2 + i] - (int)dcOut[outPixels * 2 + i]);
+    }
+
+    float hz = ESP.getCpuFreqMHz() * 1000000.0f;
+    Serial.println("=== JPEG DC Decode Benchmark ===");
+    Serial.printf("%ux%u, %u byte JPEG -> %ux%u, %d iterations\n", width, height, (unsigned)jpegLength,
+                 width >> 3, height >> 3, iterations);
+    Serial.printf("jpg2rgb565 1/8 + luma: %.1f frames/s%s\n", hz * iterations / rom, romOk ? "" : " (failed)");
+    Serial.printf("DC decode:             %.1f frames/s%s, mean luma difference %.2f\n",
+                 hz * iterations / dc, dcOk ? "" : " (failed)", (float)difference / outPixels);
+
+    free(jpeg);
+    free(romOut);
+    free(dcOut);
+    free(workspace);
+}
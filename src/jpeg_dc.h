@@ -0,0 +1,46 @@
+#ifndef JPEG_DC_H
+#define JPEG_DC_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// JPEG DC Decode
+// A baseline JPEG at 1/8 scale from its DC coefficients alone - a pixel per
+// 8x8 block, as RGB565 and luma in one pass
+// ===========================
+
+// A block's DC coefficient is its mean times eight, so the 1/8 scale image
+// needs no IDCT at all: the entropy decoder runs the Huffman codes (the AC
+// ones only to be skipped), each DC is dequantised and the MCU's luma and
+// chroma means go straight to RGB565 and luma. Against jpg2rgb565() at
+// JPG_SCALE_8X - which decodes the same DC terms through TJpgDec's block
+// buffers, colour conversion callback and a separate luma pass - that
+// leaves out the AC dequantisation, the output callbacks and the second
+// pass. With no transform left there is nothing for the S3's SIMD kernels
+// to do; the 1/2 and 1/4 scales stay with the ROM decoder.
+//
+// Huffman decoding is table driven: codes up to JPEG_DC_FAST_BITS long
+// resolve with one lookup, longer ones by the canonical code limits.
+// Baseline and extended sequential Huffman frames, 8-bit, with one or
+// three components, sampling factors 1 or 2 and restart intervals are
+// decoded; anything else returns false for the caller's fallback.
+//
+// The tables live in a caller-owned workspace of jpegDcWorkspaceSize()
+// bytes, so each task keeps its own and nothing is allocated per frame.
+// Output is width / 8 x height / 8, as JPG_SCALE_8X gives; RGB565 is big
+// endian, as jpg2rgb565() writes it. Either output may be nullptr.
+
+#define JPEG_DC_FAST_BITS   8
+
+size_t jpegDcWorkspaceSize();
+
+// width and height are the frame's on the way out, 0 when no frame header was read
+bool jpegDecodeDc(const uint8_t* jpeg, size_t length, uint8_t* rgb565, uint8_t* luma,
+                  uint16_t& width, uint16_t& height, void* workspace);
+
+// Frames/s against jpg2rgb565() at 1/8 with a luma pass, and the mean
+// luma difference between the two, on an encoded VGA test frame
+void jpegDcBenchmark(int iterations = 20);
+
+#endif // JPEG_DC_H
@@ -0,0 +1,306 @@
+#include "link_auth.h"
+#include <Preferences.h>
+#include "debug_utils.h"
+
+#define LINK_AUTH_NAMESPACE     "linkauth"
+#define KEY_RESERVED            "reserved"
+
+static const uint8_t linkAuthKey[16] = LINK_AUTH_KEY;
+static Preferences authPrefs;
+
+static LinkAuth linkAuthInstance;
+
+LinkAuth& LinkAuthMgr() {
+    return linkAuthInstance;
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+LinkAuth::LinkAuth() {
+    ready = false;
+    mutex = nullptr;
+    txCounter = 0;
+    txReserved = 0;
+    memset(peers, 0, sizeof(peers));
+    nextPeer = 0;
+    framesSealed = 0;
+    framesOpened = 0;
+    tagFailures = 0;
+    replays = 0;
+    plainDropped = 0;
+    sealCycles = 0;
+    openCycles = 0;
+    worstSealCycles = 0;
+    worstOpenCycles = 0;
+    sealedBytes = 0;
+}
+
+bool LinkAuth::begin() {
+    if (ready) {
+        return true;
+    }
+    if (!LINK_AUTH_ENABLED) {
+        return false;
+    }
+
+    if (!authPrefs.begin(LINK_AUTH_NAMESPACE, false)) {
+        SYS_ERROR("Link auth: no NVS for the frame counter");
+        return false;
+    }
+    txCounter = authPrefs.getUInt(KEY_RESERVED, 0);
+    if (!reserve()) {
+        SYS_ERROR("Link auth: frame counter not reserved");
+        return false;
+    }
+
+    // Separate encryption and MAC keys, each the pre-shared key's AES of a constant
+    uint8_t block[16] = {};
+    uint8_t encKey[16];
+    uint8_t macKey[16];
+    mbedtls_aes_init(&aes);
+    mbedtls_cipher_init(&cmac);
+    bool keyed = mbedtls_aes_setkey_enc(&aes, linkAuthKey, 128) == 0;
+    block[0] = 0x01;
+    keyed = keyed && mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, block, encKey) == 0;
+    block[0] = 0x02;
+    keyed = keyed && mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, block, macKey) == 0;
+    keyed = keyed && mbedtls_aes_setkey_enc(&aes, encKey, 128) == 0;
+    keyed = keyed && mbedtls_cipher_setup(&cmac, mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_ECB)) == 0;
+    keyed = keyed && mbedtls_cipher_cmac_starts(&cmac, macKey, 128) == 0;
+    memset(encKey, 0, sizeof(encKey));
+    memset(macKey, 0, sizeof(macKey));
+    if (!keyed) {
+        mbedtls_aes_free(&aes);
+        mbedtls_cipher_free(&cmac);
+        SYS_ERROR("Link auth: key setup failed");
+        return false;
+    }
+
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex) {
+        mbedtls_aes_free(&aes);
+        mbedtls_cipher_free(&cmac);
+        return false;
+    }
+    ready = true;
+    SYS_INFO("Link auth: %s + CMAC-%d, frames from %lu", LINK_AUTH_ENCRYPT ? "AES-128-CTR" : "clear payloads",
+             LINK_AUTH_TAG_BYTES * 8, (unsigned long)txCounter);
+    return true;
+}
+
+bool LinkAuth::reserve() {
+    uint32_t reserved = txCounter + LINK_AUTH_COUNTER_RESERVE;
+    if (authPrefs.putUInt(KEY_RESERVED, reserved) != sizeof(reserved)) {
+        return false;
+    }
+    txReserved = reserved;
+    return true;
+}
+
+// ===========================
+// Sealing
+// ===========================
+
+bool LinkAuth::seal(uint8_t deviceId, uint8_t* frame, size_t payloadOffset, size_t& length) {
+    if (!ready) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t start = ESP.getCycleCount();
+
+    // Never a number a reset could hand out again
+    if (txCounter == txReserved && !reserve()) {
+        xSemaphoreGive(mutex);
+        return false;
+    }
+    uint32_t counter = txCounter++;
+
+    bool sealed = !LINK_AUTH_ENCRYPT || crypt(deviceId, counter, frame + payloadOffset, length - payloadOffset);
+    if (sealed) {
+        frame[length] = (counter >> 8) & 0xFF;
+        frame[length + 1] = counter & 0xFF;
+        uint8_t tag[16];
+        sealed = computeTag(counter, frame, length + LINK_AUTH_COUNTER_BYTES, tag);
+        memcpy(&frame[length + LINK_AUTH_COUNTER_BYTES], tag, LINK_AUTH_TAG_BYTES);
+    }
+
+    if (sealed) {
+        uint32_t cycles = ESP.getCycleCount() - start;
+        framesSealed++;
+        sealCycles += cycles;
+        worstSealCycles = max(worstSealCycles, cycles);
+        sealedBytes += length - payloadOffset;
+        length += LINK_AUTH_TRAILER_BYTES;
+    }
+    xSemaphoreGive(mutex);
+    return sealed;
+}
+
+bool LinkAuth::crypt(uint8_t deviceId, uint32_t counter, uint8_t* data, size_t length) {
+    // [deviceId][0 0 0][counter][0 0 0 0][block] - unique per frame, the
+    // last four bytes count the frame's blocks
+    uint8_t nonce[16] = {};
+    uint8_t stream[16];
+    size_t offset = 0;
+    nonce[0] = deviceId;
+    nonce[4] = (counter >> 24) & 0xFF;
+    nonce[5] = (counter >> 16) & 0xFF;
+    nonce[6] = (counter >> 8) & 0xFF;
+    nonce[7] = counter & 0xFF;
+    return mbedtls_aes_crypt_ctr(&aes, length, &offset, nonce, stream, data, data) == 0;
+}
+
+bool LinkAuth::computeTag(uint32_t counter, const uint8_t* frame, size_t length, uint8_t* tag) {
+    uint8_t prefix[4] = {
+        (uint8_t)(counter >> 24), (uint8_t)(counter >> 16), (uint8_t)(counter >> 8), (uint8_t)counter
+    };
+    return mbedtls_cipher_cmac_reset(&cmac) == 0 &&
+           mbedtls_cipher_cmac_update(&cmac, prefix, sizeof(prefix)) == 0 &&
+           mbedtls_cipher_cmac_update(&cmac, frame, length) == 0 &&
+           mbedtls_cipher_cmac_finish(&cmac, tag) == 0;
+}
+
+// ===========================
+// Opening
+// ===========================
+
+bool LinkAuth::check(uint8_t deviceId, const uint8_t* frame, size_t length) {
+    if (!ready || length < LINK_AUTH_TRAILER_BYTES) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t counter;
+    bool good = findCounter(deviceId, frame, length, counter);
+    xSemaphoreGive(mutex);
+    return good;
+}
+
+bool LinkAuth::open(uint8_t deviceId, const uint8_t* frame, size_t length, uint8_t* payload, size_t payloadLength) {
+    if (!ready || length < LINK_AUTH_TRAILER_BYTES) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t start = ESP.getCycleCount();
+
+    // The tag before anything is decrypted
+    uint32_t counter;
+    bool opened = findCounter(deviceId, frame, length, counter);
+    if (!opened) {
+        tagFailures++;
+    } else if (!accept(deviceId, counter)) {
+        replays++;
+        opened = false;
+    } else if (LINK_AUTH_ENCRYPT) {
+        opened = crypt(deviceId, counter, payload, payloadLength);
+    }
+
+    if (opened) {
+        uint32_t cycles = ESP.getCycleCount() - start;
+        framesOpened++;
+        openCycles += cycles;
+        worstOpenCycles = max(worstOpenCycles, cycles);
+    }
+    xSemaphoreGive(mutex);
+    return opened;
+}
+
+bool LinkAuth::findCounter(uint8_t deviceId, const uint8_t* frame, size_t length, uint32_t& counter) {
+    size_t tagged = length - LINK_AUTH_TAG_BYTES;
+    uint16_t low = (frame[tagged - 2] << 8) | frame[tagged - 1];
+    const uint8_t* tag = &frame[tagged];
+
+    // The last epoch heard from it, the next few, then the one before for a
+    // late frame; every epoch up to LINK_AUTH_EPOCH_SEARCH for a stranger
+    const LinkAuthPeer* peer = findPeer(deviceId);
+    int32_t epoch = peer ? (int32_t)(peer->newest >> 16) : 0;
+    int32_t tries = peer ? LINK_AUTH_EPOCH_LOOKAHEAD + 2 : LINK_AUTH_EPOCH_SEARCH;
+    for (int32_t i = 0; i < tries; i++) {
+        int32_t candidate = (peer && i == tries - 1) ? epoch - 1 : epoch + i;
+        if (candidate < 0 || candidate > 0xFFFF) {
+            continue;
+        }
+        counter = ((uint32_t)candidate << 16) | low;
+
+        uint8_t expected[16];
+        if (!computeTag(counter, frame, tagged, expected)) {
+            return false;
+        }
+        uint8_t diff = 0;
+        for (int b = 0; b < LINK_AUTH_TAG_BYTES; b++) {
+            diff |= expected[b] ^ tag[b];
+        }
+        if (diff == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+LinkAuthPeer* LinkAuth::findPeer(uint8_t deviceId) {
+    for (LinkAuthPeer& peer : peers) {
+        if (peer.used && peer.deviceId == deviceId) {
+            return &peer;
+        }
+    }
+    return nullptr;
+}
+
+bool LinkAuth::accept(uint8_t deviceId, uint32_t counter) {
+    LinkAuthPeer* peer = findPeer(deviceId);
+    if (!peer) {
+        peer = &peers[nextPeer];
+        nextPeer = (nextPeer + 1) % LINK_AUTH_PEERS;
+        peer->deviceId = deviceId;
+        peer->used = true;
+        peer->newest = counter;
+        peer->window = 0;
+        return true;
+    }
+
+    if (counter > peer->newest) {
+        uint32_t shift = counter - peer->newest;
+        if (shift < LINK_AUTH_REPLAY_WINDOW) {
+            peer->window = (peer->window << shift) | (1ULL << (shift - 1));
+        } else {
+            peer->window = (shift == LINK_AUTH_REPLAY_WINDOW) ? 1ULL << (LINK_AUTH_REPLAY_WINDOW - 1) : 0;
+        }
+        peer->newest = counter;
+        return true;
+    }
+
+    uint32_t behind = peer->newest - counter;
+    if (behind == 0 || behind > LINK_AUTH_REPLAY_WINDOW) {
+        return false;
+    }
+    uint64_t bit = 1ULL << (behind - 1);
+    if (peer->window & bit) {
+        return false;
+    }
+    peer->window |= bit;
+    return true;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void LinkAuth::printStatus() const {
+    if (!ready) {
+        return;
+    }
+    Serial.printf("Link Auth: %s + CMAC-%d, next frame %lu (reserved to %lu)\n",
+                  LINK_AUTH_ENCRYPT ? "AES-128-CTR" : "clear payloads", LINK_AUTH_TAG_BYTES * 8,
+                  (unsigned long)txCounter, (unsigned long)txReserved);
+    Serial.printf("  Sealed %lu: %lu cycles a frame (worst %lu), %.1f a payload byte\n",
+                  (unsigned long)framesSealed,
+                  (unsigned long)(framesSealed ? sealCycles / framesSealed : 0), (unsigned long)worstSealCycles,
+                  sealedBytes ? (float)sealCycles / sealedBytes : 0.0f);
+    Serial.printf("  Opened %lu: %lu cycles a frame (worst %lu); %lu tag failures, %lu replays, %lu unsealed dropped\n",
+                  (unsigned long)framesOpened,
+                  (unsigned long)(framesOpened ? openCycles / framesOpened : 0), (unsigned long)worstOpenCycles,
+                  (unsigned long)tagFailures, (unsigned long)replays, (unsigned long)plainDropped);
+    Serial.printf("  Overhead: %d bytes a frame over the CRC, %lu bytes sent\n", LINK_AUTH_TRAILER_BYTES - 2,
+                  (unsigned long)(framesSealed * (LINK_AUTH_TRAILER_BYTES - 2)));
+}
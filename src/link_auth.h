@@ -0,0 +1,125 @@
+#ifndef LINK_AUTH_H
+#define LINK_AUTH_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <mbedtls/aes.h>
+#include <mbedtls/cipher.h>
+#include <mbedtls/cmac.h>
+#include "balloon_config.h"
+
+// ===========================
+// Link Authentication
+// AES-128-CTR over each LoRa frame's payload and a truncated AES-CMAC tag
+// over the whole frame, in place of its CRC-16
+// ===========================
+
+// A sealed frame has LORA_FLAG_AUTH in its header and ends in
+//   [..]     header, in the clear
+//   [..]     payload, AES-CTR encrypted (LINK_AUTH_ENCRYPT) or as it was
+//   [-6..-5] frame counter, low 16 bits, big endian
+//   [-4..-1] first LINK_AUTH_TAG_BYTES of the CMAC
+// The CMAC runs over the full 32-bit counter and every byte before the tag,
+// so the tag checks the frame at least as well as the CRC did; it costs
+// LINK_AUTH_TRAILER_BYTES - 2 more bytes a frame than the CRC.
+//
+// Each end numbers the frames it seals from one 32-bit counter. The CTR
+// block is [deviceId][0 0 0][counter][0 0 0 0][block], so no two frames
+// from a device share keystream. The counter never goes back across a
+// reset: LINK_AUTH_COUNTER_RESERVE numbers at a time are reserved in NVS
+// and a boot starts after the last reservation. A retransmission is a new
+// frame with a new counter.
+//
+// Receivers rebuild the top half from the last counter they accepted from
+// that device, trying its epoch (counter >> 16) first, then the next
+// LINK_AUTH_EPOCH_LOOKAHEAD, then the one before. A device not heard yet
+// is searched for over LINK_AUTH_EPOCH_SEARCH epochs. Only the tag decides
+// between the candidates. An accepted counter more than
+// LINK_AUTH_REPLAY_WINDOW behind the newest, or seen already, is a replay.
+//
+// Encryption and CMAC go through mbedTLS, which hands AES to the ESP32-S3's
+// AES accelerator; the frame never leaves the buffer it was built or
+// received in. The key is split into an encryption and a MAC key at begin().
+// Callable from any task - a mutex guards the contexts.
+
+#define LINK_AUTH_COUNTER_BYTES     2
+#define LINK_AUTH_TAG_BYTES         4       // Truncated CMAC
+#define LINK_AUTH_TRAILER_BYTES     (LINK_AUTH_COUNTER_BYTES + LINK_AUTH_TAG_BYTES)
+#define LINK_AUTH_COUNTER_RESERVE   4096    // Frame numbers per NVS write
+#define LINK_AUTH_EPOCH_LOOKAHEAD   4       // Epochs ahead of the last accepted one
+#define LINK_AUTH_EPOCH_SEARCH      256     // Epochs tried for a device not heard yet
+#define LINK_AUTH_REPLAY_WINDOW     64      // Counters behind the newest still taken once
+#define LINK_AUTH_PEERS             8       // Devices tracked
+
+struct LinkAuthPeer {
+    uint8_t deviceId;
+    bool used;
+    uint32_t newest;            // Highest counter accepted
+    uint64_t window;            // Bit i set = newest - 1 - i accepted
+};
+
+class LinkAuth {
+public:
+    LinkAuth();
+
+    // Keys and the counter reservation; true at once if already begun,
+    // false with LINK_AUTH_ENABLED off
+    bool begin();
+    bool isReady() const { return ready; }
+
+    // Encrypts frame[payloadOffset, length) in place and appends the counter
+    // and tag; the buffer needs LINK_AUTH_TRAILER_BYTES past length
+    bool seal(uint8_t deviceId, uint8_t* frame, size_t payloadOffset, size_t& length);
+    // The tag alone, for a frame someone else will open - no replay check
+    bool check(uint8_t deviceId, const uint8_t* frame, size_t length);
+    // Tag and replay window, then the payload (inside frame) decrypted in place
+    bool open(uint8_t deviceId, const uint8_t* frame, size_t length, uint8_t* payload, size_t payloadLength);
+    // An unsealed frame turned away
+    void notePlainFrame() { plainDropped++; }
+
+    uint32_t getFramesSealed() const { return framesSealed; }
+    uint32_t getFramesOpened() const { return framesOpened; }
+    uint32_t getTagFailures() const { return tagFailures; }
+    uint32_t getReplays() const { return replays; }
+    void printStatus() const;
+
+private:
+    bool ready;
+    SemaphoreHandle_t mutex;
+    mbedtls_aes_context aes;
+    mbedtls_cipher_context_t cmac;
+
+    uint32_t txCounter;
+    uint32_t txReserved;        // First counter not reserved in NVS
+    LinkAuthPeer peers[LINK_AUTH_PEERS];
+    uint8_t nextPeer;           // Replaced next when the table is full
+
+    // Statistics
+    uint32_t framesSealed;
+    uint32_t framesOpened;
+    uint32_t tagFailures;
+    uint32_t replays;
+    uint32_t plainDropped;
+    uint64_t sealCycles;
+    uint64_t openCycles;
+    uint32_t worstSealCycles;
+    uint32_t worstOpenCycles;
+    uint64_t sealedBytes;       // Payload bytes through the cipher
+
+    bool reserve();
+    bool computeTag(uint32_t counter, const uint8_t* frame, size_t length, uint8_t* tag);
+    bool findCounter(uint8_t deviceId, const uint8_t* frame, size_t length, uint32_t& counter);
+    bool crypt(uint8_t deviceId, uint32_t counter, uint8_t* data, size_t length);
+    LinkAuthPeer* findPeer(uint8_t deviceId);
+    bool accept(uint8_t deviceId, uint32_t counter);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern LinkAuth& LinkAuthMgr();
+
+#endif // LINK_AUTH_H
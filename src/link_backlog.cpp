@@ -0,0 +1,339 @@
+#include "link_backlog.h"
+#include "packet_handler.h"
+
+static_assert((LINK_BACKLOG_INDEX_SIZE & (LINK_BACKLOG_INDEX_SIZE - 1)) == 0, "Backlog index must be a power of two");
+static_assert(LINK_BACKLOG_INFLIGHT <= LORA_QUEUE_DEPTH, "Backfill can't hold more than its lane");
+
+LinkBacklog::LinkBacklog() {
+    memset(entries, 0, sizeof(entries));
+    nextId = 0;
+    memset(poolId, 0, sizeof(poolId));
+    memset(poolBusy, 0, sizeof(poolBusy));
+    inflight = 0;
+    stride = LINK_BACKLOG_DECIMATION;
+    windowStart = 0;
+    windowBudget = 0;
+    ready = false;
+    portMUX_INITIALIZE(&lock);
+
+    spilled = 0;
+    backfilled = 0;
+    skipped = 0;
+    lost = 0;
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool LinkBacklog::begin() {
+    if (!LINK_BACKLOG_ENABLED || !FlightRec().isReady()) {
+        return false;
+    }
+    FlightRec().setWriteHook(onRecordWritten);
+    LoRaComm().setBacklogCallbacks(onSpill, onRelease, this);
+    BulkLoRa().setBacklogCallbacks(onSpill, onRelease, this);
+    windowStart = millis() - LINK_BACKLOG_WINDOW_MS;
+    ready = true;
+    return true;
+}
+
+// ===========================
+// Spill (LoRaComm() owner)
+// ===========================
+
+bool LinkBacklog::worthKeeping(PacketType type) {
+    switch (static_cast<PacketType>(static_cast<uint8_t>(type) & ~PACKET_TYPE_COMPRESSED)) {
+        case PacketType::TELEMETRY:
+        case PacketType::GPS_DATA:
+        case PacketType::CAMERA_DATA:
+        case PacketType::ALERT:
+        case PacketType::STATUS:
+        case PacketType::TRACK_SEGMENT:
+        case PacketType::DIGEST:
+            return true;
+        default:
+            return type == PacketType::EMERGENCY;
+    }
+}
+
+void LinkBacklog::onSpill(void* context, const QueuedPacket& queuedPacket) {
+    static_cast<LinkBacklog*>(context)->spill(queuedPacket);
+}
+
+void LinkBacklog::spill(const QueuedPacket& queuedPacket) {
+    static uint8_t record[FLIGHT_RECORDER_MAX_PAYLOAD];      // Off the loop task's stack
+    const Packet& packet = queuedPacket.packet;
+
+    // A backfill that didn't get through either waits for the next chance
+    if (queuedPacket.payloadHandle >= LORA_BACKLOG_HANDLE_BASE) {
+        uint8_t slot = queuedPacket.payloadHandle - LORA_BACKLOG_HANDLE_BASE;
+        portENTER_CRITICAL(&lock);
+        BacklogEntry* entry = find(poolId[slot]);
+        if (entry && entry->state == BacklogState::QUEUED) {
+            entry->state = BacklogState::PENDING;
+        }
+        portEXIT_CRITICAL(&lock);
+        return;
+    }
+
+    if (!worthKeeping(packet.type)) {
+        skipped++;
+        return;
+    }
+
+    size_t length;
+    if (packet.type == PacketType::TELEMETRY) {
+        length = PacketMgr().getTelemetryEncoder().standalone(packet.payload, packet.payloadLength,
+                                                              record + sizeof(FlightBacklogRecord));
+    } else if (packet.payloadLength <= FLIGHT_BACKLOG_MAX_PAYLOAD) {
+        memcpy(record + sizeof(FlightBacklogRecord), packet.payload, packet.payloadLength);
+        length = packet.payloadLength;
+    } else {
+        length = 0;
+    }
+    if (length == 0) {
+        skipped++;
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+    uint32_t id = nextId++;
+    BacklogEntry& entry = entries[id & (LINK_BACKLOG_INDEX_SIZE - 1)];
+    if (entry.state == BacklogState::WRITING || entry.state == BacklogState::PENDING) {
+        lost++;
+    }
+    entry.id = id;
+    entry.offset = 0;
+    entry.state = BacklogState::WRITING;
+    portEXIT_CRITICAL(&lock);
+
+    FlightBacklogRecord header;
+    header.id = id;
+    header.timestamp = packet.header.timestamp;
+    header.sampledAt = packet.header.sampledAt;
+    header.createdAt = packet.header.createdAt;
+    header.type = static_cast<uint8_t>(packet.type);
+    header.priority = static_cast<uint8_t>(queuedPacket.priority);
+    header.reserved[0] = 0;
+    header.reserved[1] = 0;
+    memcpy(record, &header, sizeof(header));
+
+    if (!FlightRec().record(FlightRecordType::BACKLOG, record, sizeof(header) + length)) {
+        portENTER_CRITICAL(&lock);
+        if (entry.id == id && entry.state == BacklogState::WRITING) {
+            entry.state = BacklogState::FREE;
+        }
+        portEXIT_CRITICAL(&lock);
+        lost++;
+        return;
+    }
+    spilled++;
+}
+
+// Recorder task
+void LinkBacklog::onRecordWritten(uint8_t type, uint32_t offset, const uint8_t* payload, size_t length) {
+    if (type != static_cast<uint8_t>(FlightRecordType::BACKLOG) || length < sizeof(FlightBacklogRecord)) {
+        return;
+    }
+    uint32_t id;
+    memcpy(&id, payload, sizeof(id));
+
+    LinkBacklog& backlog = Backlog();
+    portENTER_CRITICAL(&backlog.lock);
+    BacklogEntry* entry = backlog.find(id);
+    if (entry && entry->state == BacklogState::WRITING) {
+        entry->offset = offset;
+        entry->state = BacklogState::PENDING;
+    }
+    portEXIT_CRITICAL(&backlog.lock);
+}
+
+// Caller holds the lock
+BacklogEntry* LinkBacklog::find(uint32_t id) {
+    BacklogEntry& entry = entries[id & (LINK_BACKLOG_INDEX_SIZE - 1)];
+    return entry.state != BacklogState::FREE && entry.id == id ? &entry : nullptr;
+}
+
+// ===========================
+// Backfill (LoRaComm() owner)
+// ===========================
+
+bool LinkBacklog::linkUp() const {
+    // The link the backfill goes out on - the bulk radio's while it's up
+    const LoRaManager& link = LoRaLink(Priority::STATUS);
+    uint32_t heard = link.getLastReceiveTime();
+    return heard != 0 && millis() - heard < LINK_BACKLOG_LINK_FRESH_MS && link.getAckTimeoutStreak() == 0;
+}
+
+// Newest pending id on the current stride, moving to the next pass when it has none
+bool LinkBacklog::next(uint32_t& id, uint32_t& offset) {
+    uint32_t depth = nextId < LINK_BACKLOG_INDEX_SIZE ? nextId : LINK_BACKLOG_INDEX_SIZE;
+
+    portENTER_CRITICAL(&lock);
+    for (;;) {
+        for (uint32_t back = 1; back <= depth; back++) {
+            uint32_t candidate = nextId - back;
+            BacklogEntry* entry = find(candidate);
+            if (entry && entry->state == BacklogState::PENDING && candidate % stride == 0) {
+                id = candidate;
+                offset = entry->offset;
+                portEXIT_CRITICAL(&lock);
+                return true;
+            }
+        }
+        if (stride == 1) {
+            break;
+        }
+        stride /= 2;
+    }
+    stride = LINK_BACKLOG_DECIMATION;
+    portEXIT_CRITICAL(&lock);
+    return false;
+}
+
+// False when the window's budget is spent; a record that can't be read back
+// is written off and the caller moves on
+bool LinkBacklog::backfill(uint32_t id, uint32_t offset) {
+    static uint8_t copy[sizeof(FlightRecordHeader) + FLIGHT_RECORDER_MAX_PAYLOAD];     // Off the loop task's stack
+
+    // Copied out before checking - the recorder may erase the sector under us
+    const uint8_t* mapped = FlightRec().getMapped(offset);
+    size_t space = FLIGHT_RECORDER_SECTOR_SIZE - offset % FLIGHT_RECORDER_SECTOR_SIZE;
+    if (space > sizeof(copy)) {
+        space = sizeof(copy);
+    }
+    FlightRecordHeader header;
+    FlightBacklogRecord backlogHeader;
+    bool valid = false;
+    if (mapped) {
+        memcpy(copy, mapped, space);
+        memcpy(&header, copy, sizeof(header));
+        memcpy(&backlogHeader, copy + sizeof(header), sizeof(backlogHeader));
+        valid = FlightRecorder::checkRecord(copy, space) && header.type == static_cast<uint8_t>(FlightRecordType::BACKLOG) &&
+                header.length > sizeof(backlogHeader) && backlogHeader.id == id;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < LINK_BACKLOG_INFLIGHT; i++) {
+        if (!poolBusy[i]) {
+            slot = i;
+            break;
+        }
+    }
+
+    portENTER_CRITICAL(&lock);
+    BacklogEntry* entry = find(id);
+    if (!valid || !entry || slot < 0) {
+        if (entry && !valid) {
+            entry->state = BacklogState::FREE;
+            lost++;
+        }
+        portEXIT_CRITICAL(&lock);
+        return slot >= 0;
+    }
+    size_t length = header.length - sizeof(backlogHeader);
+    if (length > windowBudget) {
+        portEXIT_CRITICAL(&lock);
+        return false;
+    }
+    entry->state = BacklogState::QUEUED;
+    portEXIT_CRITICAL(&lock);
+
+    memcpy(pool[slot], copy + sizeof(header) + sizeof(backlogHeader), length);
+    poolId[slot] = id;
+    poolBusy[slot] = true;
+    inflight++;
+    windowBudget -= length;
+
+    Packet packet = createPacket(static_cast<PacketType>(backlogHeader.type), pool[slot], length);
+    packet.header.timestamp = backlogHeader.timestamp;
+    packet.header.sampledAt = backlogHeader.sampledAt;
+    packet.header.createdAt = backlogHeader.createdAt;
+    LoRaLink(Priority::STATUS).sendPacket(packet, Priority::STATUS, true, LORA_BACKLOG_HANDLE_BASE + slot);
+    return true;
+}
+
+void LinkBacklog::service() {
+    if (!ready) {
+        return;
+    }
+
+    uint32_t now = millis();
+    if (now - windowStart >= LINK_BACKLOG_WINDOW_MS) {
+        windowStart = now;
+        windowBudget = LoRaLink(Priority::STATUS).getBulkByteBudget(LINK_BACKLOG_WINDOW_MS, FLIGHT_BACKLOG_MAX_PAYLOAD,
+                                                                 LORA_MAX_FRAME_HEADER) * LINK_BACKLOG_BUDGET_SHARE / 100;
+    }
+
+    uint32_t id;
+    uint32_t offset;
+    while (inflight < LINK_BACKLOG_INFLIGHT && linkUp() && LoRaLink(Priority::STATUS).canAccept(Priority::STATUS) &&
+           next(id, offset)) {
+        if (!backfill(id, offset)) {
+            break;
+        }
+    }
+}
+
+void LinkBacklog::onRelease(void* context, int16_t handle) {
+    static_cast<LinkBacklog*>(context)->release(handle);
+}
+
+// After an ACK, or after spill() on a drop
+void LinkBacklog::release(int16_t handle) {
+    uint8_t slot = handle - LORA_BACKLOG_HANDLE_BASE;
+    if (slot >= LINK_BACKLOG_INFLIGHT || !poolBusy[slot]) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+    BacklogEntry* entry = find(poolId[slot]);
+    bool acknowledged = entry && entry->state == BacklogState::QUEUED;
+    if (acknowledged) {
+        entry->state = BacklogState::FREE;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (acknowledged) {
+        backfilled++;
+    }
+    poolBusy[slot] = false;
+    inflight--;
+}
+
+// ===========================
+// Status
+// ===========================
+
+uint32_t LinkBacklog::getPending() const {
+    uint32_t pending = 0;
+    portENTER_CRITICAL(&lock);
+    for (uint32_t i = 0; i < LINK_BACKLOG_INDEX_SIZE; i++) {
+        if (entries[i].state == BacklogState::WRITING || entries[i].state == BacklogState::PENDING) {
+            pending++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return pending;
+}
+
+void LinkBacklog::printStatus() const {
+    Serial.println("=== Link Backlog ===");
+    Serial.printf("Ready: %s, link %s\n", ready ? "Yes" : "No", ready && linkUp() ? "up" : "down");
+    if (!ready) {
+        return;
+    }
+    Serial.printf("Pending: %lu, in flight: %u, stride %u, %u bytes left this window\n",
+                  (unsigned long)getPending(), inflight, stride, (unsigned)windowBudget);
+    Serial.printf("Spilled: %lu, backfilled: %lu, skipped: %lu, lost: %lu\n", (unsigned long)spilled,
+                  (unsigned long)backfilled, (unsigned long)skipped, (unsigned long)lost);
+}
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+static LinkBacklog linkBacklogInstance;
+
+LinkBacklog& Backlog() { return linkBacklogInstance; }
@@ -0,0 +1,110 @@
+#ifndef LINK_BACKLOG_H
+#define LINK_BACKLOG_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "balloon_config.h"
+#include "lora_comm.h"
+#include "flight_recorder.h"
+
+// ===========================
+// Link Backlog
+// Store-and-forward for link loss: ARQ packets LoRaComm() gives up on go to
+// the flight recorder, and come back once the base station is heard again
+// ===========================
+
+// LoRaComm() hands over each ACKed packet it drops - evicted from a full
+// lane or out of retries - before the payload goes back to its owner. The
+// ones worth having late (telemetry, GPS, alerts, camera metadata and
+// status) are written as BACKLOG records; link control and heartbeats are
+// stale by definition and let go. A telemetry delta only decodes against
+// the keyframe before it, so it is stored as a standalone keyframe that
+// leaves the base station's live decoder alone.
+//
+// The index in RAM remembers the newest LINK_BACKLOG_INDEX_SIZE records and
+// where on flash each landed. Backfill starts once frames come in and ACKs
+// stop timing out: at most LINK_BACKLOG_INFLIGHT records at a time, in the
+// STATUS lane so live traffic keeps going ahead of it, within a share of the
+// airtime the duty cycle leaves spare. With LINK_BACKLOG_DECIMATION above 1
+// the first pass sends every Nth record, newest first, then the ones in
+// between at half the stride, so a long outage fills in evenly rather than
+// only at its end. A record the flight recorder has wrapped over is lost.
+//
+// Backfilled packets are new packets with the original header timestamp
+// and sample time. If the ACK of the original was lost rather than the
+// packet itself, the base station gets it twice.
+//
+// Spill, release and service() run in the task that owns LoRaComm(); the
+// write hook in the recorder task.
+
+enum class BacklogState : uint8_t {
+    FREE = 0,
+    WRITING,        // Handed to the recorder, not on flash yet
+    PENDING,        // On flash, waiting for the link
+    QUEUED          // Backfill queued, waiting for its ACK
+};
+
+struct BacklogEntry {
+    uint32_t id;
+    uint32_t offset;            // Record header's, in the partition
+    BacklogState state;
+};
+
+class LinkBacklog {
+public:
+    LinkBacklog();
+
+    // After FlightRec().begin(); false (and nothing spilled) without the recorder
+    bool begin();
+    bool isReady() const { return ready; }
+
+    // From the LoRaComm() owner's loop, before processQueue()
+    void service();
+
+    uint32_t getPending() const;
+    uint32_t getSpilled() const { return spilled; }
+    uint32_t getBackfilled() const { return backfilled; }
+    uint32_t getSkipped() const { return skipped; }
+    uint32_t getLost() const { return lost; }
+    void printStatus() const;
+
+private:
+    BacklogEntry entries[LINK_BACKLOG_INDEX_SIZE];
+    uint32_t nextId;
+    uint8_t pool[LINK_BACKLOG_INFLIGHT][FLIGHT_BACKLOG_MAX_PAYLOAD];
+    uint32_t poolId[LINK_BACKLOG_INFLIGHT];
+    bool poolBusy[LINK_BACKLOG_INFLIGHT];
+    uint8_t inflight;
+    uint8_t stride;             // Current decimation pass
+    uint32_t windowStart;
+    size_t windowBudget;        // Bytes left in this window
+    bool ready;
+    mutable portMUX_TYPE lock;
+
+    // Statistics
+    uint32_t spilled;           // Written to the recorder
+    uint32_t backfilled;        // Re-sent and ACKed
+    uint32_t skipped;           // Dropped by the link, not worth or too big to keep
+    uint32_t lost;              // Spilled, never backfilled: index overrun, recorder full or wrapped
+
+    bool linkUp() const;
+    BacklogEntry* find(uint32_t id);
+    bool next(uint32_t& id, uint32_t& offset);
+    bool backfill(uint32_t id, uint32_t offset);
+    void spill(const QueuedPacket& queuedPacket);
+    void release(int16_t handle);
+
+    static bool worthKeeping(PacketType type);
+    static void onSpill(void* context, const QueuedPacket& queuedPacket);
+    static void onRelease(void* context, int16_t handle);
+    static void onRecordWritten(uint8_t type, uint32_t offset, const uint8_t* payload, size_t length);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern LinkBacklog& Backlog();
+
+#endif // LINK_BACKLOG_H
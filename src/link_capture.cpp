@@ -0,0 +1,76 @@
+#include "link_capture.h"
+#include "time_service.h"
+
+// ===========================
+// pcap Encoding
+// ===========================
+
+// pcap is written in the writer's byte order and the magic tells readers
+// which; this is the ESP32's, little endian, as the capture header is
+static void putLe32(uint8_t* out, uint32_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+    out[2] = value >> 16;
+    out[3] = value >> 24;
+}
+
+static void putLe16(uint8_t* out, uint16_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+size_t linkCaptureFileHeader(uint8_t* out, size_t snap) {
+    putLe32(out, LINK_CAPTURE_PCAP_MAGIC);
+    putLe16(out + 4, 2);                    // Version 2.4
+    putLe16(out + 6, 4);
+    putLe32(out + 8, 0);                    // UTC offset
+    putLe32(out + 12, 0);                   // Timestamp accuracy
+    putLe32(out + 16, sizeof(LinkCaptureHeader) + snap);
+    putLe32(out + 20, LINK_CAPTURE_DLT);
+    return LINK_CAPTURE_FILE_HEADER;
+}
+
+size_t linkCaptureEncode(const LinkCaptureFrame& frame, uint8_t* out, size_t space, size_t snap) {
+    size_t length = frame.data ? frame.header.length : 0;
+    size_t kept = min(length, snap);
+    size_t total = LINK_CAPTURE_RECORD_HEADER + sizeof(LinkCaptureHeader) + kept;
+    if (total > space) {
+        return 0;
+    }
+
+    LinkCaptureHeader header = frame.header;
+    int64_t timeUs = frame.timeUs;
+    int64_t utcUs;
+    if (Clock().toUtc(frame.timeUs, utcUs)) {
+        timeUs = utcUs;
+        header.flags |= LINK_CAPTURE_FLAG_UTC;
+    } else {
+        header.flags &= ~LINK_CAPTURE_FLAG_UTC;
+    }
+    timeUs = max(timeUs, (int64_t)0);
+
+    putLe32(out, (uint32_t)(timeUs / 1000000));
+    putLe32(out + 4, (uint32_t)(timeUs % 1000000));
+    putLe32(out + 8, sizeof(LinkCaptureHeader) + kept);
+    putLe32(out + 12, sizeof(LinkCaptureHeader) + length);
+    memcpy(out + LINK_CAPTURE_RECORD_HEADER, &header, sizeof(header));
+    if (kept) {
+        memcpy(out + LINK_CAPTURE_RECORD_HEADER + sizeof(header), frame.data, kept);
+    }
+    return total;
+}
+
+const char* linkCaptureKindToString(uint8_t kind) {
+    switch (static_cast<LinkCaptureKind>(kind)) {
+        case LinkCaptureKind::TX: return "TX";
+        case LinkCaptureKind::RX: return "RX";
+        case LinkCaptureKind::RX_CRC_ERROR: return "RX CRC error";
+        case LinkCaptureKind::TX_TIMEOUT: return "TX timeout";
+        case LinkCaptureKind::TX_ABORTED: return "TX aborted";
+        case LinkCaptureKind::BEACON: return "Beacon";
+        case LinkCaptureKind::ACKED: return "ACKed";
+        case LinkCaptureKind::ACK_TIMEOUT: return "ACK timeout";
+        case LinkCaptureKind::DROPPED: return "Dropped";
+        default: return "Unknown";
+    }
+}
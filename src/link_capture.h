@@ -0,0 +1,97 @@
+#ifndef LINK_CAPTURE_H
+#define LINK_CAPTURE_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Link Capture
+// Every frame on and off the radio, and what became of the packets in them,
+// as pcap records for Wireshark
+// ===========================
+
+// LoRaManager hands a LinkCaptureFrame to its capture sink for each frame
+// it transmits or receives, and for each ACK, ACK timeout and retry drop;
+// the balloon keeps them in the flight recorder, the base station in a file
+// pair on LittleFS (base_station_capture.h). Both store the encoded pcap
+// record, so a download is a global header and the records as stored.
+//
+// Records are link type LINK_CAPTURE_DLT (LINKTYPE_USER0): a
+// LinkCaptureHeader, little endian, then the frame as it went on air, cut
+// to the writer's snap length. tools/link_capture.lua dissects both, frame
+// header v1 and v2, and marks each TX with the ACK, timeout or drop of its
+// sequence. ACKED, ACK_TIMEOUT and DROPPED records have no frame: the
+// sequence is the packet's, the rate the one in use when it happened.
+//
+// The timestamp is UTC when Clock() has it, else time since boot
+// (LINK_CAPTURE_FLAG_UTC clear) - each reboot starts again at zero.
+
+#define LINK_CAPTURE_DLT             147     // LINKTYPE_USER0
+#define LINK_CAPTURE_VERSION         1
+#define LINK_CAPTURE_PCAP_MAGIC      0xA1B2C3D4  // Microsecond timestamps
+#define LINK_CAPTURE_FILE_HEADER     24      // pcap global header
+#define LINK_CAPTURE_RECORD_HEADER   16      // pcap record header
+
+#define LINK_CAPTURE_FLAG_UTC        0x01    // Timestamp is UTC
+#define LINK_CAPTURE_FLAG_TRACKED    0x02    // TX: carries packets waiting for an ACK
+#define LINK_CAPTURE_FLAG_CLOCK_SYNC 0x04    // TX: an ACK with a LinkClock extension
+#define LINK_CAPTURE_FLAG_FSK        0x08    // FSK burst; bandwidth is the bit rate
+
+enum class LinkCaptureKind : uint8_t {
+    TX = 0,             // Frame sent
+    RX = 1,             // Frame received with a good radio CRC
+    RX_CRC_ERROR = 2,   // As received, radio CRC failed
+    TX_TIMEOUT = 3,     // TX done never came; no frame
+    TX_ABORTED = 4,     // Cut off by the emergency beacon; no frame
+    BEACON = 5,         // Emergency beacon sent
+    ACKED = 6,          // Packet sequence acknowledged
+    ACK_TIMEOUT = 7,    // Packet sequence's ACK wait ran out
+    DROPPED = 8         // Packet sequence given up after MAX_RETRIES
+};
+
+struct LinkCaptureHeader {
+    uint8_t version;            // LINK_CAPTURE_VERSION
+    uint8_t kind;               // LinkCaptureKind
+    uint8_t link;               // LinkRole: 0 primary, 1 bulk
+    uint8_t flags;              // LINK_CAPTURE_FLAG_*
+    uint8_t spreadingFactor;    // 0 in FSK
+    uint8_t codingRate;         // 4/5 to 4/8 as 5 to 8
+    int8_t txPower;             // dBm
+    uint8_t channel;            // Hop channel, LORA_CHANNEL_FIXED when not hopping
+    uint32_t bandwidth;         // Hz; bps in FSK
+    uint32_t frequency;         // Hz
+    int8_t rssi;                // dBm, RX only
+    int8_t snr;                 // dB, RX only
+    uint16_t sequence;          // TX: the frame's; ACKED..DROPPED: the packet's
+    uint16_t airtimeMs;         // TX and BEACON: measured time on air
+    uint8_t device;             // The capturing station's LORA_DEVICE_ID
+    uint8_t length;             // Frame bytes on air; the record may hold fewer
+};
+
+static_assert(sizeof(LinkCaptureHeader) == 24, "Header is the dissector's format");
+
+struct LinkCaptureFrame {
+    LinkCaptureHeader header;
+    int64_t timeUs;             // nowUs() of the TX or RX done interrupt, or of the event
+    const uint8_t* data;        // header.length bytes; nullptr without a frame
+};
+
+// Called from the task running LoRaManager::processQueue()
+typedef void (*LinkCaptureSink)(void* context, const LinkCaptureFrame& frame);
+
+// pcap global header for records of sizeof(LinkCaptureHeader) + snap bytes;
+// LINK_CAPTURE_FILE_HEADER bytes
+size_t linkCaptureFileHeader(uint8_t* out, size_t snap);
+
+// The pcap record header, capture header and up to snap frame bytes into
+// out; 0 if it doesn't fit in space
+size_t linkCaptureEncode(const LinkCaptureFrame& frame, uint8_t* out, size_t space, size_t snap);
+
+// Largest linkCaptureEncode() output for snap
+constexpr size_t linkCaptureRecordMax(size_t snap) {
+    return LINK_CAPTURE_RECORD_HEADER + sizeof(LinkCaptureHeader) + snap;
+}
+
+const char* linkCaptureKindToString(uint8_t kind);
+
+#endif // LINK_CAPTURE_H
@@ -0,0 +1,219 @@
+#include "link_clock.h"
+#include "time_service.h"
+
+static void writeUs48(uint8_t* out, uint64_t value) {
+    for (int i = 5; i >= 0; i--) {
+        out[i] = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+static uint64_t readUs48(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 6; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+LinkClock::LinkClock() {
+    reset();
+}
+
+void LinkClock::reset() {
+    memset(&estimate, 0, sizeof(estimate));
+    driftRefOffsetUs = 0;
+    driftRefLocalUs = 0;
+    driftRefValid = false;
+    for (int i = 0; i < LINK_CLOCK_TX_LOG; i++) {
+        txLog[i].sequence = 0;
+        txLog[i].txUs = -1;
+    }
+    txLogNext = 0;
+    rxValid = false;
+    rxSequence = 0;
+    rxUs = 0;
+    extensionId = 0;
+    extensionTxUs = LINK_CLOCK_UNKNOWN;
+    extensionsSent = 0;
+    lastExtensionAt = 0;
+    peerExtensionValid = false;
+    peerExtensionId = 0;
+    peerExtensionRxUs = 0;
+    rejected = 0;
+}
+
+// ===========================
+// Radio Times
+// ===========================
+
+void LinkClock::recordTx(uint16_t sequence, int64_t txUs) {
+    // A retransmission replaces the earlier copy's time
+    for (int i = 0; i < LINK_CLOCK_TX_LOG; i++) {
+        if (txLog[i].txUs >= 0 && txLog[i].sequence == sequence) {
+            txLog[i].txUs = txUs;
+            return;
+        }
+    }
+    txLog[txLogNext].sequence = sequence;
+    txLog[txLogNext].txUs = txUs;
+    txLogNext = (txLogNext + 1) % LINK_CLOCK_TX_LOG;
+}
+
+void LinkClock::recordRx(uint16_t sequence, int64_t frameRxUs) {
+    rxValid = true;
+    rxSequence = sequence;
+    rxUs = frameRxUs;
+}
+
+void LinkClock::recordExtensionTx(int64_t txUs) {
+    extensionTxUs = txUs;
+}
+
+bool LinkClock::findTx(uint16_t sequence, int64_t& txUs) const {
+    for (int i = 0; i < LINK_CLOCK_TX_LOG; i++) {
+        if (txLog[i].txUs >= 0 && txLog[i].sequence == sequence) {
+            txUs = txLog[i].txUs;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ===========================
+// Extension
+// ===========================
+
+bool LinkClock::wantsExtension(uint32_t now) const {
+    return LORA_ENABLE_CLOCK_SYNC && rxValid &&
+           (extensionsSent < 2 || now - lastExtensionAt >= LORA_SYNC_INTERVAL_MS);
+}
+
+size_t LinkClock::writeExtension(uint8_t* out, uint32_t now) {
+    out[0] = extensionId + 1;
+    out[1] = (rxSequence >> 8) & 0xFF;
+    out[2] = rxSequence & 0xFF;
+    writeUs48(&out[3], (uint64_t)rxUs);
+    writeUs48(&out[9], (uint64_t)extensionTxUs);
+
+    // Its own TX-done goes in the next one
+    extensionId++;
+    extensionTxUs = LINK_CLOCK_UNKNOWN;
+    extensionsSent++;
+    lastExtensionAt = now;
+    return LINK_CLOCK_EXT_SIZE;
+}
+
+bool LinkClock::readExtension(uint8_t peer, const uint8_t* ext, size_t length, int64_t ackRxUs) {
+    if (length < LINK_CLOCK_EXT_SIZE) {
+        return false;
+    }
+
+    uint8_t id = ext[0];
+    uint16_t sequence = (ext[1] << 8) | ext[2];
+    int64_t t2 = (int64_t)readUs48(&ext[3]);
+    uint64_t previousTx = readUs48(&ext[9]);
+
+    if (estimate.samples > 0 && peer != estimate.peer) {
+        // Another peer's clock - start over on it
+        memset(&estimate, 0, sizeof(estimate));
+        driftRefValid = false;
+        peerExtensionValid = false;
+    }
+
+    bool paired = peerExtensionValid && id == (uint8_t)(peerExtensionId + 1) && previousTx != LINK_CLOCK_UNKNOWN;
+    int64_t t4 = peerExtensionRxUs;
+    peerExtensionValid = true;
+    peerExtensionId = id;
+    peerExtensionRxUs = ackRxUs;
+    estimate.peer = peer;
+
+    int64_t t1;
+    if (!paired || !findTx(sequence, t1)) {
+        return false;
+    }
+    int64_t t3 = (int64_t)previousTx;
+
+    // The return leg is an interval older; bring it up to T1 at the rate measured so far
+    int64_t up = t2 - t1;
+    int64_t down = t3 - t4;
+    if (estimate.driftKnown) {
+        down += (int64_t)((float)(t1 - t4) * estimate.driftPpm * 1e-6f);
+    }
+    int64_t delay = (up - down) / 2;
+    if (delay < -LORA_SYNC_MAX_DELAY_US || delay > LORA_SYNC_MAX_DELAY_US) {
+        rejected++;
+        return false;
+    }
+
+    accept((up + down) / 2, t1, (int32_t)delay);
+    return true;
+}
+
+void LinkClock::accept(int64_t offsetUs, int64_t localUs, int32_t delayUs) {
+    LinkClockEstimate next = estimate;
+    next.localUs = localUs;
+    next.delayUs = delayUs;
+    next.samples = estimate.samples + 1;
+
+    int64_t predicted;
+    if (estimate.samples == 0 || !toPeer(localUs, predicted)) {
+        next.offsetUs = offsetUs;
+    } else {
+        predicted -= localUs;
+        int64_t residual = offsetUs - predicted;
+        next.offsetUs = (residual > LORA_SYNC_STEP_US || residual < -LORA_SYNC_STEP_US)
+                        ? offsetUs : predicted + (int64_t)((float)residual * LORA_SYNC_GAIN);
+    }
+
+    // Rate difference over a long enough span, so interrupt jitter doesn't swamp it
+    int64_t span = localUs - driftRefLocalUs;
+    if (!driftRefValid) {
+        driftRefOffsetUs = offsetUs;
+        driftRefLocalUs = localUs;
+        driftRefValid = true;
+    } else if (span >= (int64_t)LORA_SYNC_DRIFT_SPAN_MS * 1000) {
+        float ppm = (float)(offsetUs - driftRefOffsetUs) * 1e6f / (float)span;
+        if (fabsf(ppm) > LINK_CLOCK_DRIFT_MAX_PPM) {
+            rejected++;
+        } else if (!estimate.driftKnown) {
+            next.driftPpm = ppm;
+            next.driftKnown = true;
+        } else {
+            next.driftPpm = estimate.driftPpm + LINK_CLOCK_DRIFT_GAIN * (ppm - estimate.driftPpm);
+        }
+        driftRefOffsetUs = offsetUs;
+        driftRefLocalUs = localUs;
+    }
+
+    estimate = next;
+}
+
+// ===========================
+// Conversion
+// ===========================
+
+bool LinkClock::isSynced() const {
+    return estimate.samples > 0 &&
+           TimeService::nowUs() - estimate.localUs < (int64_t)LORA_SYNC_HOLDOVER_MS * 1000;
+}
+
+bool LinkClock::toPeer(int64_t localUs, int64_t& peerUs) const {
+    if (!isSynced()) {
+        return false;
+    }
+    int64_t elapsed = localUs - estimate.localUs;
+    int64_t offset = estimate.offsetUs;
+    if (estimate.driftKnown) {
+        offset += (int64_t)((float)elapsed * estimate.driftPpm * 1e-6f);
+    }
+    peerUs = localUs + offset;
+    return true;
+}
+
+void LinkClock::printStatus() const {
+    Serial.printf("Link clock: %s, peer %u, offset %lld us, delay %ld us, drift %s%.2f ppm, %lu exchanges, %lu rejected\n",
+                 isSynced() ? "synced" : "unsynced", estimate.peer, (long long)estimate.offsetUs,
+                 (long)estimate.delayUs, estimate.driftKnown ? "" : "unknown ", estimate.driftPpm,
+                 (unsigned long)estimate.samples, (unsigned long)rejected);
+}
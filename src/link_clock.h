@@ -0,0 +1,114 @@
+#ifndef LINK_CLOCK_H
+#define LINK_CLOCK_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "balloon_config.h"
+
+// ===========================
+// Link Clock
+// The peer's esp_timer clock as an offset from ours, measured NTP-style from
+// the radio's TX-done and RX-done interrupt times carried on ACKs
+// ===========================
+
+// Every LORA_SYNC_INTERVAL_MS (and on the first two) an ACK gets an extension:
+//   [0]      sync id, one more than the last ACK that had one
+//   [1..2]   sequence of the frame of yours received last
+//   [3..8]   its RX-done, sender's nowUs(), 48 bits big endian
+//   [9..14]  TX-done of the ACK with sync id - 1, all ones if unknown
+// The receiver holds its TX-done of every tracked frame by sequence (T1)
+// and its RX-done of the last extended ACK (T4). The new ACK's RX time of
+// our frame is T2 and its previous TX time T3, so
+//   offset = ((T2 - T1) + (T3 - T4)) / 2,   delay = ((T2 - T1) - (T3 - T4)) / 2
+// with T3 - T4 carried forward by the drift first: it is an interval older.
+// Both edges are taken in the radio's interrupt, so what is left is the
+// interrupt latency on each end and the propagation, which cancels. A
+// delay over LORA_SYNC_MAX_DELAY_US is a retransmission paired with the
+// wrong copy and is dropped.
+//
+// The offset slews by LORA_SYNC_GAIN toward each exchange, or steps when
+// it is LORA_SYNC_STEP_US off; exchanges LORA_SYNC_DRIFT_SPAN_MS or more
+// apart measure the two crystals' rate difference, which toPeer()
+// extrapolates through the holdover. Older firmware ignores the extra bytes.
+//
+// Either end keeps one; it follows whichever peer it last heard from. The
+// balloon runs its TDMA slots on the base station's clock through it when
+// GPS time is gone. Owned by LoRaManager and used from the task that runs
+// processQueue().
+
+#define LINK_CLOCK_EXT_SIZE       15
+#define LINK_CLOCK_TX_LOG         8       // TX-done times kept, newest sequences
+#define LINK_CLOCK_UNKNOWN        0xFFFFFFFFFFFFULL
+#define LINK_CLOCK_DRIFT_MAX_PPM  200.0f  // Rate difference past this is a bad exchange
+#define LINK_CLOCK_DRIFT_GAIN     0.125f
+
+struct LinkClockEstimate {
+    int64_t offsetUs;       // Peer's nowUs() minus ours at localUs
+    int64_t localUs;        // Of the last exchange
+    float driftPpm;         // Offset grows by this much
+    bool driftKnown;
+    int32_t delayUs;        // One-way, last exchange
+    uint8_t peer;           // Device id
+    uint32_t samples;       // Exchanges accepted since the last reset
+};
+
+class LinkClock {
+public:
+    LinkClock();
+
+    void reset();
+
+    // Radio interrupt times, in nowUs()
+    void recordTx(uint16_t sequence, int64_t txUs);             // TX-done of a tracked frame
+    void recordRx(uint16_t sequence, int64_t rxUs);             // RX-done of a frame to be ACKed
+    void recordExtensionTx(int64_t txUs);                       // TX-done of an ACK with an extension
+
+    // Sending an ACK: whether it gets an extension now, and the extension
+    bool wantsExtension(uint32_t now) const;
+    size_t writeExtension(uint8_t* out, uint32_t now);
+
+    // An ACK's extension from peer, the ACK's own RX-done at rxUs; true
+    // when it made an exchange
+    bool readExtension(uint8_t peer, const uint8_t* ext, size_t length, int64_t rxUs);
+
+    bool isSynced() const;
+    bool toPeer(int64_t localUs, int64_t& peerUs) const;     // False while unsynced
+    LinkClockEstimate getEstimate() const { return estimate; }
+    uint32_t getRejected() const { return rejected; }
+
+    void printStatus() const;
+
+private:
+    struct TxRecord {
+        uint16_t sequence;
+        int64_t txUs;
+    };
+
+    LinkClockEstimate estimate;
+    int64_t driftRefOffsetUs;       // Exchange the next drift span starts from
+    int64_t driftRefLocalUs;
+    bool driftRefValid;
+
+    // Our side of the exchanges
+    TxRecord txLog[LINK_CLOCK_TX_LOG];
+    uint8_t txLogNext;
+    bool rxValid;
+    uint16_t rxSequence;
+    int64_t rxUs;
+    uint8_t extensionId;            // Of the last extension sent
+    int64_t extensionTxUs;          // Its TX-done, LINK_CLOCK_UNKNOWN until then
+    uint32_t extensionsSent;
+    uint32_t lastExtensionAt;       // millis()
+
+    // The peer's last extension
+    bool peerExtensionValid;
+    uint8_t peerExtensionId;
+    int64_t peerExtensionRxUs;
+
+    uint32_t rejected;
+
+    bool findTx(uint16_t sequence, int64_t& txUs) const;
+    void accept(int64_t offsetUs, int64_t localUs, int32_t delayUs);
+};
+
+#endif // LINK_CLOCK_H
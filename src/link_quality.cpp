@@ -0,0 +1,103 @@
+#include "link_quality.h"
+
+LinkQualityEstimator::LinkQualityEstimator() {
+    reset();
+}
+
+void LinkQualityEstimator::reset() {
+    memset(entries, 0, sizeof(entries));
+}
+
+int LinkQualityEstimator::indexOf(int spreadingFactor, long bandwidth, int codingRate) {
+    if (spreadingFactor == LINK_QUALITY_FSK_SF) {
+        return LINK_QUALITY_RATES;
+    }
+    int sf = constrain(spreadingFactor, 7, 12) - 7;
+    int bw = bandwidth >= 500000 ? 2 : (bandwidth >= 250000 ? 1 : 0);
+    int cr = codingRate >= 7 ? 1 : 0;
+    return (sf * LINK_QUALITY_BW_COUNT + bw) * LINK_QUALITY_CR_COUNT + cr;
+}
+
+bool LinkQualityEstimator::fresh(const LinkQualityEntry& entry, uint32_t now) const {
+    return entry.samples > 0 && now - entry.lastUpdate <= LINK_QUALITY_STALE_MS;
+}
+
+// ===========================
+// Outcomes
+// ===========================
+
+void LinkQualityEstimator::recordOutcome(int spreadingFactor, long bandwidth, int codingRate, bool delivered,
+                                         uint32_t now) {
+    LinkQualityEntry& entry = entries[indexOf(spreadingFactor, bandwidth, codingRate)];
+    if (!fresh(entry, now)) {
+        entry.samples = 0;
+    }
+
+    // Mean of the first 2^shift outcomes, then the fixed weight
+    uint32_t sample = delivered ? 0xFFFF : 0;
+    uint32_t weight = entry.samples + 1;
+    if (weight > (1u << LINK_QUALITY_ALPHA_SHIFT)) {
+        weight = 1u << LINK_QUALITY_ALPHA_SHIFT;
+    }
+    int32_t delta = (int32_t)sample - (int32_t)entry.delivery;
+    entry.delivery = (uint16_t)((int32_t)entry.delivery + delta / (int32_t)weight);
+
+    if (entry.samples < 0xFFFF) {
+        entry.samples++;
+    }
+    if (delivered) {
+        entry.delivered++;
+    } else {
+        entry.lost++;
+    }
+    entry.lastUpdate = now;
+}
+
+// ===========================
+// Readers
+// ===========================
+
+bool LinkQualityEstimator::isKnown(int spreadingFactor, long bandwidth, int codingRate, uint32_t now) const {
+    const LinkQualityEntry& entry = entries[indexOf(spreadingFactor, bandwidth, codingRate)];
+    return fresh(entry, now) && entry.samples >= LINK_QUALITY_MIN_SAMPLES;
+}
+
+float LinkQualityEstimator::getDeliveryRatio(int spreadingFactor, long bandwidth, int codingRate, uint32_t now) const {
+    if (!isKnown(spreadingFactor, bandwidth, codingRate, now)) {
+        return 1.0f;
+    }
+    return entries[indexOf(spreadingFactor, bandwidth, codingRate)].delivery / 65535.0f;
+}
+
+float LinkQualityEstimator::getEtx(int spreadingFactor, long bandwidth, int codingRate, uint32_t now) const {
+    float ratio = getDeliveryRatio(spreadingFactor, bandwidth, codingRate, now);
+    return ratio * LINK_QUALITY_MAX_ETX > 1.0f ? 1.0f / ratio : LINK_QUALITY_MAX_ETX;
+}
+
+void LinkQualityEstimator::printStatus(uint32_t now) const {
+    static const long bandwidths[] = {125000, 250000, 500000};
+    static const int codingRates[] = {5, 8};
+
+    Serial.println("=== Link Quality ===");
+    for (int sf = 7; sf <= 12; sf++) {
+        for (long bw : bandwidths) {
+            for (int cr : codingRates) {
+                const LinkQualityEntry& entry = entries[indexOf(sf, bw, cr)];
+                if (entry.delivered + entry.lost == 0) {
+                    continue;
+                }
+                Serial.printf("  SF%d/%ldk/4-%d: %.0f%% delivered, ETX %.2f%s (%lu ok, %lu lost)\n", sf, bw / 1000,
+                              cr, entry.delivery / 655.35f, getEtx(sf, bw, cr, now),
+                              isKnown(sf, bw, cr, now) ? "" : " (stale)", (unsigned long)entry.delivered,
+                              (unsigned long)entry.lost);
+            }
+        }
+    }
+
+    const LinkQualityEntry& fsk = entries[LINK_QUALITY_RATES];
+    if (fsk.delivered + fsk.lost > 0) {
+        Serial.printf("  FSK burst: %.0f%% delivered, ETX %.2f%s (%lu ok, %lu lost)\n", fsk.delivery / 655.35f,
+                      getEtx(LINK_QUALITY_FSK_SF, 0, 0, now), isKnown(LINK_QUALITY_FSK_SF, 0, 0, now) ? "" : " (stale)",
+                      (unsigned long)fsk.delivered, (unsigned long)fsk.lost);
+    }
+}
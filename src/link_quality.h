@@ -0,0 +1,70 @@
+#ifndef LINK_QUALITY_H
+#define LINK_QUALITY_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "balloon_config.h"
+
+// ===========================
+// Link Quality
+// Delivery ratio and expected transmissions (ETX) per data rate, from the
+// ARQ's ACK outcomes
+// ===========================
+
+// Every ACKed record counts as delivered, every ACK timeout or NACK as
+// lost, against the data rate the frame went out at. Each rate keeps an
+// exponentially weighted average, 1/2^LINK_QUALITY_ALPHA_SHIFT per outcome
+// once warmed up (a plain mean before that, so the first few outcomes
+// already count fully), so a few seconds of frames move it. A rate
+// silent for LINK_QUALITY_STALE_MS starts over.
+//
+// An outcome needs the frame and its ACK, so the ratio is the round trip
+// and ETX = 1/ratio is the number of attempts one record needs. ADR takes
+// a margin penalty from it, aggregation packs fewer records into a frame
+// as it rises, and camera FEC sizes its parity to it. Below
+// LINK_QUALITY_MIN_SAMPLES fresh outcomes a rate is unknown and readers
+// keep their defaults.
+//
+// An FSK burst's outcomes go to one extra entry, LINK_QUALITY_FSK_SF with
+// any bandwidth and coding rate, so a burst that lost frames isn't tried
+// again until it goes stale.
+//
+// Owned by LoRaManager and used from the task that runs processQueue().
+
+#define LINK_QUALITY_SF_COUNT   6       // SF7-SF12
+#define LINK_QUALITY_BW_COUNT   3       // 125/250/500 kHz
+#define LINK_QUALITY_CR_COUNT   2       // 4/5-4/6, 4/7-4/8
+#define LINK_QUALITY_RATES      (LINK_QUALITY_SF_COUNT * LINK_QUALITY_BW_COUNT * LINK_QUALITY_CR_COUNT)
+#define LINK_QUALITY_MAX_ETX    16.0f   // Reported for a rate that delivers nothing
+#define LINK_QUALITY_FSK_SF     0       // Pseudo spreading factor of the FSK burst entry
+
+struct LinkQualityEntry {
+    uint16_t delivery;          // Q16 fraction delivered, 0xFFFF = all
+    uint16_t samples;           // Outcomes since the rate last went stale, saturating
+    uint32_t delivered;         // Lifetime counts, for the status print
+    uint32_t lost;
+    uint32_t lastUpdate;        // millis()
+};
+
+class LinkQualityEstimator {
+public:
+    LinkQualityEstimator();
+
+    void reset();
+    void recordOutcome(int spreadingFactor, long bandwidth, int codingRate, bool delivered, uint32_t now);
+
+    // False while the rate has too few fresh outcomes to go on
+    bool isKnown(int spreadingFactor, long bandwidth, int codingRate, uint32_t now) const;
+    float getDeliveryRatio(int spreadingFactor, long bandwidth, int codingRate, uint32_t now) const;     // 1 when unknown
+    float getEtx(int spreadingFactor, long bandwidth, int codingRate, uint32_t now) const;               // 1 when unknown
+
+    void printStatus(uint32_t now) const;
+
+private:
+    LinkQualityEntry entries[LINK_QUALITY_RATES + 1];     // FSK last
+
+    static int indexOf(int spreadingFactor, long bandwidth, int codingRate);
+    bool fresh(const LinkQualityEntry& entry, uint32_t now) const;
+};
+
+#endif // LINK_QUALITY_H
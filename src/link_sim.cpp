@@ -0,0 +1,349 @@
+#include "link_sim.h"
+#include "task_placement.h"
+
+// ===========================
+// Simulated Radio
+// ===========================
+
+SimulatedRadio::SimulatedRadio() {
+    link = nullptr;
+    mode = Mode::SLEEP;
+    frequency = 0;
+    spreadingFactor = LORA_SPREADING_FACTOR;
+    bandwidth = LORA_BANDWIDTH;
+    codingRate = LORA_CODING_RATE;
+    preambleLength = LORA_PREAMBLE_LEN;
+    syncWord = LORA_SYNC_WORD;
+    irqHandler = nullptr;
+    irqContext = nullptr;
+    pendingIrq = RadioIrq::NONE;
+    txLength = 0;
+    txEnd = 0;
+    txReachesPeer = false;
+    scanEnd = 0;
+    inboundLength = 0;
+    inboundPending = false;
+    inboundAt = 0;
+    inboundRssi = 0;
+    inboundSnr = 0;
+    rxLength = 0;
+    rxRssi = 0;
+    rxSnr = 0;
+}
+
+bool SimulatedRadio::begin(long freq) {
+    if (!link) {
+        return false;
+    }
+    link->lock();
+    frequency = freq;
+    mode = Mode::IDLE;
+    pendingIrq = RadioIrq::NONE;
+    inboundPending = false;
+    link->unlock();
+    return true;
+}
+
+void SimulatedRadio::end() {
+    sleep();
+}
+
+void SimulatedRadio::attachIrq(RadioIrqHandler handler, void* context) {
+    link->lock();
+    irqHandler = handler;
+    irqContext = context;
+    link->unlock();
+}
+
+void SimulatedRadio::detachIrq() {
+    link->lock();
+    irqHandler = nullptr;
+    irqContext = nullptr;
+    link->unlock();
+}
+
+void SimulatedRadio::setFrequency(long freq) {
+    link->lock();
+    frequency = freq;
+    link->unlock();
+}
+
+void SimulatedRadio::setSpreadingFactor(int sf) {
+    link->lock();
+    spreadingFactor = sf;
+    link->unlock();
+}
+
+void SimulatedRadio::setSignalBandwidth(long bw) {
+    link->lock();
+    bandwidth = bw;
+    link->unlock();
+}
+
+void SimulatedRadio::setCodingRate4(int denominator) {
+    link->lock();
+    codingRate = denominator;
+    link->unlock();
+}
+
+void SimulatedRadio::setPreambleLength(long length) {
+    link->lock();
+    preambleLength = length;
+    link->unlock();
+}
+
+void SimulatedRadio::setSyncWord(int sw) {
+    link->lock();
+    syncWord = sw;
+    link->unlock();
+}
+
+void SimulatedRadio::startTransmit(const uint8_t* data, size_t length) {
+    link->lock();
+    txLength = min(length, (size_t)MAX_PACKET_SIZE);
+    memcpy(txData, data, txLength);
+
+    uint32_t timeOnAirUs = calculateTimeOnAirUs(txLength, spreadingFactor, bandwidth,
+                                                codingRate, preambleLength);
+    txEnd = millis() + (timeOnAirUs + 999) / 1000;
+
+    // Half duplex - keying up also kills anything the peer is sending us
+    SimulatedRadio& peer = link->peerOf(*this);
+    txReachesPeer = (peer.mode == Mode::RECEIVE) && link->compatible(*this, peer);
+    peer.txReachesPeer = false;
+    mode = Mode::TRANSMIT;
+    link->unlock();
+    link->wakeTask();
+}
+
+void SimulatedRadio::startReceive() {
+    link->lock();
+    mode = Mode::RECEIVE;
+    link->unlock();
+}
+
+void SimulatedRadio::startChannelScan() {
+    link->lock();
+    // CAD takes about two symbols
+    uint32_t symbolUs = (uint32_t)(((1UL << spreadingFactor) * 1000000ULL) / bandwidth);
+    scanEnd = millis() + max((uint32_t)1, (2 * symbolUs + 999) / 1000);
+    link->peerOf(*this).txReachesPeer = false;
+    mode = Mode::CHANNEL_SCAN;
+    link->unlock();
+    link->wakeTask();
+}
+
+void SimulatedRadio::idle() {
+    link->lock();
+    link->peerOf(*this).txReachesPeer = false;
+    mode = Mode::IDLE;
+    link->unlock();
+}
+
+void SimulatedRadio::sleep() {
+    if (!link) {
+        return;
+    }
+    link->lock();
+    link->peerOf(*this).txReachesPeer = false;
+    inboundPending = false;
+    mode = Mode::SLEEP;
+    link->unlock();
+}
+
+RadioIrq SimulatedRadio::serviceIrq(uint8_t* buffer, size_t capacity, size_t& length,
+                                    int8_t& rssi, int8_t& snr) {
+    link->lock();
+    RadioIrq irq = pendingIrq;
+    pendingIrq = RadioIrq::NONE;
+    length = 0;
+
+    if (irq == RadioIrq::RX_DONE) {
+        length = min(rxLength, capacity);
+        memcpy(buffer, rxData, length);
+        rssi = rxRssi;
+        snr = rxSnr;
+    }
+    link->unlock();
+    return irq;
+}
+
+// ===========================
+// Simulated Link
+// ===========================
+
+SimulatedLink::SimulatedLink() {
+    radios[0].link = this;
+    radios[1].link = this;
+    memset(&profile, 0, sizeof(profile));
+    traceIndex = 0;
+    mutex = nullptr;
+    taskHandle = nullptr;
+    running = false;
+    framesDelivered = 0;
+    framesLost = 0;
+    framesMissed = 0;
+}
+
+SimulatedLink::~SimulatedLink() {
+    end();
+}
+
+bool SimulatedLink::begin(const LinkProfile& linkProfile) {
+    if (running) {
+        return true;
+    }
+
+    profile = linkProfile;
+    traceIndex = 0;
+    framesDelivered = 0;
+    framesLost = 0;
+    framesMissed = 0;
+
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex) {
+        return false;
+    }
+
+    running = true;
+    if (createPlacedTask(TaskId::LINK_SIM, taskEntry, this, &taskHandle) != pdPASS) {
+        running = false;
+        taskHandle = nullptr;
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void SimulatedLink::end() {
+    if (!running) {
+        return;
+    }
+
+    // The task deletes itself at the end of its current step
+    running = false;
+    wakeTask();
+    while (taskHandle) {
+        vTaskDelay(1);
+    }
+
+    vSemaphoreDelete(mutex);
+    mutex = nullptr;
+}
+
+bool SimulatedLink::compatible(const SimulatedRadio& a, const SimulatedRadio& b) const {
+    return a.frequency == b.frequency && a.spreadingFactor == b.spreadingFactor &&
+           a.bandwidth == b.bandwidth && a.syncWord == b.syncWord;
+}
+
+void SimulatedLink::finishTransmit(SimulatedRadio& sender, uint32_t now) {
+    sender.mode = SimulatedRadio::Mode::IDLE;
+    sender.pendingIrq = RadioIrq::TX_DONE;
+
+    SimulatedRadio& peer = peerOf(sender);
+    if (!sender.txReachesPeer || peer.mode != SimulatedRadio::Mode::RECEIVE ||
+        !compatible(sender, peer) || peer.inboundPending) {
+        framesMissed++;
+        return;
+    }
+
+    int8_t snr = LINK_SIM_DEFAULT_SNR;
+    if (profile.snrTrace && profile.snrTraceLength > 0) {
+        snr = profile.snrTrace[traceIndex++ % profile.snrTraceLength];
+    }
+    if (snr < demodulatorFloorDb(sender.spreadingFactor)) {
+        framesMissed++;
+        return;
+    }
+    if ((uint32_t)random(100) < profile.lossPercent) {
+        framesLost++;
+        return;
+    }
+
+    memcpy(peer.inboundData, sender.txData, sender.txLength);
+    peer.inboundLength = sender.txLength;
+    peer.inboundRssi = profile.rssi;
+    peer.inboundSnr = snr;
+    peer.inboundAt = now + profile.latencyMs;
+    peer.inboundPending = true;
+}
+
+TickType_t SimulatedLink::step(uint32_t now) {
+    bool raise[2] = {false, false};
+
+    lock();
+    for (int i = 0; i < 2; i++) {
+        SimulatedRadio& radio = radios[i];
+
+        if (radio.mode == SimulatedRadio::Mode::TRANSMIT && (int32_t)(now - radio.txEnd) >= 0) {
+            finishTransmit(radio, now);
+            raise[i] = true;
+        } else if (radio.mode == SimulatedRadio::Mode::CHANNEL_SCAN &&
+                   (int32_t)(now - radio.scanEnd) >= 0) {
+            const SimulatedRadio& peer = peerOf(radio);
+            bool busy = peer.mode == SimulatedRadio::Mode::TRANSMIT && peer.frequency == radio.frequency;
+            radio.pendingIrq = busy ? RadioIrq::CAD_DETECTED : RadioIrq::CAD_CLEAR;
+            radio.mode = SimulatedRadio::Mode::IDLE;
+            raise[i] = true;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        SimulatedRadio& radio = radios[i];
+        if (!radio.inboundPending || (int32_t)(now - radio.inboundAt) < 0) {
+            continue;
+        }
+
+        radio.inboundPending = false;
+        if (radio.mode != SimulatedRadio::Mode::RECEIVE) {
+            framesMissed++;  // Left RX while the frame was in flight
+            continue;
+        }
+
+        memcpy(radio.rxData, radio.inboundData, radio.inboundLength);
+        radio.rxLength = radio.inboundLength;
+        radio.rxRssi = radio.inboundRssi;
+        radio.rxSnr = radio.inboundSnr;
+        radio.pendingIrq = RadioIrq::RX_DONE;
+        framesDelivered++;
+        raise[i] = true;
+    }
+
+    // Nothing changes between deadlines, so the task sleeps to the nearest
+    TickType_t wait = portMAX_DELAY;
+    for (int i = 0; i < 2; i++) {
+        const SimulatedRadio& radio = radios[i];
+        uint32_t due[] = {radio.txEnd, radio.scanEnd, radio.inboundAt};
+        bool pending[] = {radio.mode == SimulatedRadio::Mode::TRANSMIT,
+                          radio.mode == SimulatedRadio::Mode::CHANNEL_SCAN, radio.inboundPending};
+        for (int d = 0; d < 3; d++) {
+            if (pending[d]) {
+                int32_t ms = max((int32_t)(due[d] - now), (int32_t)0);
+                wait = min(wait, max(pdMS_TO_TICKS(ms), (TickType_t)1));
+            }
+        }
+    }
+
+    RadioIrqHandler handlers[2] = {radios[0].irqHandler, radios[1].irqHandler};
+    void* contexts[2] = {radios[0].irqContext, radios[1].irqContext};
+    unlock();
+
+    // Raised outside the lock - the handler's radio task will call serviceIrq()
+    for (int i = 0; i < 2; i++) {
+        if (raise[i] && handlers[i]) {
+            handlers[i](contexts[i], false);
+        }
+    }
+    return wait;
+}
+
+void SimulatedLink::taskEntry(void* parameter) {
+    SimulatedLink* link = static_cast<SimulatedLink*>(parameter);
+    while (link->running) {
+        ulTaskNotifyTake(pdTRUE, link->step(millis()));
+    }
+    link->taskHandle = nullptr;
+    vTaskDelete(nullptr);
+}
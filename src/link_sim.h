@@ -0,0 +1,141 @@
+#ifndef LINK_SIM_H
+#define LINK_SIM_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "lora_comm.h"
+
+// ===========================
+// Simulated LoRa Link
+// Two loopback radios joined by a lossy channel, for benchmarking the link
+// layer without RF hardware
+// ===========================
+
+#define LINK_SIM_DEFAULT_SNR       10
+
+// Channel model, applied to both directions
+struct LinkProfile {
+    uint8_t lossPercent;       // Random frame loss
+    uint16_t latencyMs;        // Delay from end of TX to RX_DONE
+    int8_t rssi;               // Reported for every delivered frame
+    const int8_t* snrTrace;    // SNR per frame, cycled; nullptr = LINK_SIM_DEFAULT_SNR
+    size_t snrTraceLength;
+};
+
+class SimulatedLink;
+
+class SimulatedRadio : public RadioDriver {
+    friend class SimulatedLink;
+
+private:
+    enum class Mode : uint8_t { SLEEP, IDLE, TRANSMIT, RECEIVE, CHANNEL_SCAN };
+
+    SimulatedLink* link;
+    Mode mode;
+
+    // Modem settings - both ends must match for a frame to get through
+    long frequency;
+    int spreadingFactor;
+    long bandwidth;
+    int codingRate;
+    long preambleLength;
+    int syncWord;
+
+    RadioIrqHandler irqHandler;
+    void* irqContext;
+    RadioIrq pendingIrq;
+
+    // Outgoing frame
+    uint8_t txData[MAX_PACKET_SIZE];
+    size_t txLength;
+    uint32_t txEnd;
+    bool txReachesPeer;        // Peer was listening when we keyed up
+
+    uint32_t scanEnd;
+
+    // Frame on its way to us, raised as RX_DONE at inboundAt
+    uint8_t inboundData[MAX_PACKET_SIZE];
+    size_t inboundLength;
+    bool inboundPending;
+    uint32_t inboundAt;
+    int8_t inboundRssi;
+    int8_t inboundSnr;
+
+    // Last delivered frame, read back by serviceIrq()
+    uint8_t rxData[MAX_PACKET_SIZE];
+    size_t rxLength;
+    int8_t rxRssi;
+    int8_t rxSnr;
+
+public:
+    SimulatedRadio();
+
+    bool begin(long frequency) override;
+    void end() override;
+    void attachIrq(RadioIrqHandler handler, void* context) override;
+    void detachIrq() override;
+
+    void setFrequency(long frequency) override;
+    void setSpreadingFactor(int spreadingFactor) override;
+    void setSignalBandwidth(long bandwidth) override;
+    void setCodingRate4(int denominator) override;
+    void setTxPower(int power) override {}
+    void setPreambleLength(long length) override;
+    void setSyncWord(int syncWord) override;
+
+    void startTransmit(const uint8_t* data, size_t length) override;
+    void startReceive() override;
+    void startChannelScan() override;
+    void idle() override;
+    void sleep() override;
+
+    RadioIrq serviceIrq(uint8_t* buffer, size_t capacity, size_t& length,
+                        int8_t& rssi, int8_t& snr) override;
+    const char* getName() const override { return "simulated"; }
+};
+
+class SimulatedLink {
+    friend class SimulatedRadio;
+
+private:
+    SimulatedRadio radios[2];
+    LinkProfile profile;
+    size_t traceIndex;
+
+    SemaphoreHandle_t mutex;
+    TaskHandle_t taskHandle;
+    volatile bool running;
+
+    // Statistics
+    uint32_t framesDelivered;
+    uint32_t framesLost;        // Random loss
+    uint32_t framesMissed;      // Peer not listening, mistuned or below its SNR floor
+
+    SimulatedRadio& peerOf(SimulatedRadio& radio) { return &radio == &radios[0] ? radios[1] : radios[0]; }
+    void lock() { xSemaphoreTake(mutex, portMAX_DELAY); }
+    void unlock() { xSemaphoreGive(mutex); }
+    bool compatible(const SimulatedRadio& a, const SimulatedRadio& b) const;
+    void finishTransmit(SimulatedRadio& sender, uint32_t now);
+    // Ticks to the next TX end, scan end or arrival; portMAX_DELAY for none
+    TickType_t step(uint32_t now);
+    // A radio call that starts something with a deadline
+    void wakeTask() { if (taskHandle) xTaskNotifyGive(taskHandle); }
+    static void taskEntry(void* parameter);
+
+public:
+    SimulatedLink();
+    ~SimulatedLink();
+
+    bool begin(const LinkProfile& linkProfile);
+    void end();
+
+    SimulatedRadio& endpoint(int index) { return radios[index & 1]; }
+
+    uint32_t getFramesDelivered() const { return framesDelivered; }
+    uint32_t getFramesLost() const { return framesLost; }
+    uint32_t getFramesMissed() const { return framesMissed; }
+};
+
+#endif // LINK_SIM_H
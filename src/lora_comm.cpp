@@ -1,18 +1,88 @@
 #include "lora_comm.h"
+#include "crc_utils.h"
+#include "task_placement.h"
+#include "task_watchdog.h"
+#include "time_service.h"
+#include "energy_ledger.h"
+#include "power_arbiter.h"
+#include "esp_timer.h"
+#include "debug_utils.h"
+
+// ===========================
+// Radio Engine Interrupt Glue
+// ===========================
+
+// Notification bits delivered to the radio task
+#define RADIO_NOTIFY_DIO0      (1UL << 0)
+#define RADIO_NOTIFY_TX_FRAME  (1UL << 1)
+#define RADIO_NOTIFY_EMERGENCY (1UL << 2)
+
+// Hop channel plan shared by both ends
+static const long hopChannelPlan[] = LORA_HOP_CHANNEL_PLAN;
+static_assert(sizeof(hopChannelPlan) / sizeof(hopChannelPlan[0]) == LORA_HOP_CHANNEL_COUNT,
+              "LORA_HOP_CHANNEL_PLAN must list LORA_HOP_CHANNEL_COUNT frequencies");
+
+// SX1276 supply current on PA_BOOST, the module's output: the datasheet's
+// 87 mA at 17 dBm and 120 mA at 20, and ~30 mA at the 2 dBm floor
+static float transmitCurrentMa(int power) {
+    if (power >= 17) {
+        return 87.0f + (power - 17) * 11.0f;
+    }
+    return 30.0f + (max(power, 2) - 2) * 3.8f;
+}
+
+void IRAM_ATTR LoRaManager::radioIrqEntry(void* context, bool fromIsr) {
+    // No SPI access here - just wake the radio task
+    TaskHandle_t target = static_cast<LoRaManager*>(context)->radioTaskHandle;
+    if (!target) {
+        return;
+    }
+    
+    if (!fromIsr) {
+        xTaskNotify(target, RADIO_NOTIFY_DIO0, eSetBits);
+        return;
+    }
+    
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xTaskNotifyFromISR(target, RADIO_NOTIFY_DIO0, eSetBits, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// [newest seq 2][LORA_ACK_TYPE_SELECTIVE][rssi][bitmap 4] - sent alone or as an aggregate record
+static void encodeSelectiveAck(uint16_t newestSequence, uint32_t bitmap, int8_t rssi, uint8_t* out) {
+    out[0] = (newestSequence >> 8) & 0xFF;
+    out[1] = newestSequence & 0xFF;
+    out[2] = LORA_ACK_TYPE_SELECTIVE;
+    out[3] = static_cast<uint8_t>(rssi);
+    out[4] = (bitmap >> 24) & 0xFF;
+    out[5] = (bitmap >> 16) & 0xFF;
+    out[6] = (bitmap >> 8) & 0xFF;
+    out[7] = bitmap & 0xFF;
+}
 
 // ===========================
 // Constructor/Destructor
 // ===========================
 
-LoRaManager::LoRaManager() {
+LoRaManager::LoRaManager(LinkRole linkRole)
+    : radioPowerLock(linkRole == LinkRole::BULK ? "lora_bulk" : "lora", PowerLockType::NO_SLEEP) {
+    bool bulk = linkRole == LinkRole::BULK;
+    role = linkRole;
+    radioTaskId = bulk ? TaskId::LORA_BULK_RADIO : TaskId::LORA_RADIO;
+    txLoad = bulk ? EnergyLoad::BULK_RADIO_TX : EnergyLoad::RADIO_TX;
+    rxLoad = bulk ? EnergyLoad::BULK_RADIO_RX : EnergyLoad::RADIO_RX;
+    localLoads = true;
+    
     // Initialize LoRa configuration
-    frequency = LORA_FREQUENCY;
-    spreadingFactor = LORA_SPREADING_FACTOR;
-    bandwidth = LORA_BANDWIDTH;
-    codingRate = LORA_CODING_RATE;
-    txPower = LORA_TX_POWER;
+    frequency = bulk ? LORA_BULK_FREQUENCY : LORA_FREQUENCY;
+    spreadingFactor = bulk ? LORA_BULK_SPREADING_FACTOR : LORA_SPREADING_FACTOR;
+    bandwidth = bulk ? LORA_BULK_BANDWIDTH : LORA_BANDWIDTH;
+    codingRate = bulk ? LORA_BULK_CODING_RATE : LORA_CODING_RATE;
+    txPower = bulk ? LORA_BULK_TX_POWER : LORA_TX_POWER;
     preambleLength = LORA_PREAMBLE_LEN;
-    syncWord = LORA_SYNC_WORD;
+    syncWord = bulk ? LORA_BULK_SYNC_WORD : LORA_SYNC_WORD;
     
     // Initialize current settings
     currentSpreadingFactor = spreadingFactor;
@@ -21,10 +91,11 @@ LoRaManager::LoRaManager() {
     
     // Initialize packet management
     nextSequenceNumber = random(0xFFFF);
-    deviceId = DEVICE_TYPE;  // From balloon_config.h
+    portMUX_INITIALIZE(&sequenceLock);
+    sequenceSource = nullptr;
+    deviceId = LORA_DEVICE_ID;  // From balloon_config.h
     
     // Initialize queues
-    memset(queueSizes, 0, sizeof(queueSizes));
     memset(priorityQueues, 0, sizeof(priorityQueues));
     
     // Initialize transmission state
@@ -34,6 +105,62 @@ LoRaManager::LoRaManager() {
     lastReceiveTime = 0;
     ackTimeout = 0;
     
+    // Initialize airtime budget - start with full buckets
+    for (int i = 0; i < LORA_HOP_CHANNEL_COUNT; i++) {
+        airtimeTokensUs[i] = (int32_t)LORA_DUTY_CYCLE_WINDOW_MS * LORA_DUTY_CYCLE_PERMILLE;
+    }
+    lastAirtimeRefill = 0;
+    airtimeUsedUs = 0;
+    dutyCycleDeferrals = 0;
+    memset(laneCreditUs, 0, sizeof(laneCreditUs));
+    laneEligibleMask = 0;
+    memset(laneShareServes, 0, sizeof(laneShareServes));
+    
+    // Initialize ARQ
+    arqWindowSize = LORA_ARQ_WINDOW_SIZE;
+    arqOutstanding = 0;
+    autoAckEnabled = (DEVICE_TYPE == DEVICE_BASE_STATION);
+    rxWindowValid = false;
+    rxNewestSequence = 0;
+    rxSequenceBitmap = 0;
+    ackHeld = false;
+    ackDueAt = 0;
+    ackHeldFrames = 0;
+    acksSent = 0;
+    acksPiggybacked = 0;
+    ackFramesHeld = 0;
+    ackTurnaround = false;
+    ackTurnaroundHeld = false;
+    ackTurnaroundHoldMs = 0;
+    ackTurnaroundFrom = 0;
+    ackTurnaroundUntil = 0;
+    ackTurnaroundWaits = 0;
+    
+    // Initialize adaptive data rate
+    adaptiveModeEnabled = ENABLE_ADAPTIVE_SF && !bulk;   // The bulk rate is fixed
+    adrCandidate = {spreadingFactor, bandwidth, codingRate, txPower, 0, 0, 0};
+    adrCandidateCount = 0;
+    signalSamples = 0;
+    peerRssi = -128;
+    ackTimeoutStreak = 0;
+    rateChangeState = RateChangeState::IDLE;
+    pendingRate = adrCandidate;
+    rateChangeSequence = 0;
+    memset(rateChangePayload, 0, sizeof(rateChangePayload));
+    rateChangeTime = 0;
+    rateChanges = 0;
+    rateFallbacks = 0;
+    fskBitrate = 0;
+    fskBurstStart = 0;
+    fskBackoffUntil = 0;
+    fskBursts = 0;
+    fskBurstFailures = 0;
+    fixedFrameBytes = 0;
+    fixedFramesStart = 0;
+    fixedBackoffUntil = 0;
+    fixedFrameSessions = 0;
+    fixedFrameFailures = 0;
+    
     // Initialize signal quality monitoring
     memset(rssiHistory, 0, sizeof(rssiHistory));
     memset(snrHistory, 0, sizeof(snrHistory));
@@ -47,6 +174,120 @@ LoRaManager::LoRaManager() {
     receiveErrorCount = 0;
     crcErrorCount = 0;
     ackTimeoutCount = 0;
+    
+    // Initialize radio engine
+    radio = bulk ? BulkHardwareRadio() : &HardwareRadio();
+    radioTaskHandle = nullptr;
+    txFrameQueue = nullptr;
+    radioEventQueue = nullptr;
+    radioMutex = nullptr;
+    radioState = RadioState::IDLE;
+    radioTxStartTime = 0;
+    radioTxSequence = 0;
+    inFlightBatchCount = 0;
+    aggregateFramesSent = 0;
+    aggregatedRecordsSent = 0;
+    radioTxDeadline = LORA_TX_DONE_TIMEOUT_MS;
+    radioTxTracked = false;
+    radioTxClockSync = false;
+    txFramesPending = 0;
+    lastAirtime = 0;
+    framesTransmitted = 0;
+    framesReceived = 0;
+    firstTransmitTime = 0;
+    onPacketReceivedCallback = nullptr;
+    onLinkPacketCallback = nullptr;
+    onFrameTapCallback = nullptr;
+    rxFrameFilter = nullptr;
+    rxFilterContext = nullptr;
+    captureSink = nullptr;
+    captureContext = nullptr;
+    radioTxCurrent = nullptr;
+    payloadReleaseHandler = nullptr;
+    payloadReleaseContext = nullptr;
+    payloadEventHandler = nullptr;
+    payloadEventContext = nullptr;
+    spillHandler = nullptr;
+    backlogReleaseHandler = nullptr;
+    backlogContext = nullptr;
+    supersedeHandler = nullptr;
+    retransmitHandler = nullptr;
+    freshnessContext = nullptr;
+    
+    // Initialize frequency hopping - everyone starts on the home channel
+    hoppingEnabled = LORA_ENABLE_HOPPING && !bulk;
+    hopKey = 0;
+    hopPreviousKey = 0;
+    hopKeyValid = false;
+    hopResync = false;
+    hopLastRxChannel = LORA_HOP_HOME_CHANNEL;
+    hopDwellPhase = 0;
+    hopDwellStart = 0;
+    hopChanges = 0;
+    hopResyncs = 0;
+    radioChannel = LORA_CHANNEL_FIXED;
+    radioRxChannel = hoppingEnabled ? LORA_HOP_HOME_CHANNEL : LORA_CHANNEL_FIXED;
+    
+    // Initialize time-slotted transmission
+    tdmaEnabled = LORA_ENABLE_TDMA && !bulk;
+    for (int i = 0; i < LORA_TDMA_SLOT_COUNT; i++) {
+        tdmaSlotLastHeard[i] = 0;
+    }
+    tdmaSlotsHeard = 0;
+    tdmaReceiverAsleep = false;
+    tdmaSlotDeferrals = 0;
+    tdmaReceiverSleeps = 0;
+    tdmaDeferring = false;
+    
+    // Initialize scheduled RX windows
+    rxWindowsEnabled = LORA_ENABLE_RX_WINDOWS;
+    rxWindowUntil = 0;
+    rxWindowAsleep = false;
+    rxWindowWaking = false;
+    rxWindowWakeAt = 0;
+    rxWindowSleepStart = 0;
+    rxWindowSleeps = 0;
+    rxWindowSleepMs = 0;
+    rxWindowSince = 0;
+    
+    // Initialize emergency beacon
+    memset(&emergencyBeacon, 0, sizeof(emergencyBeacon));
+    portMUX_INITIALIZE(&emergencyLock);
+    emergencyActive = false;
+    emergencyRequestedUs = 0;
+    emergencyNextAt = 0;
+    emergencyRepeat = 0;
+    radioTxEmergency = false;
+    radioTxTailMs = 0;
+    radioQuietUntil = 0;
+    emergencyBeaconsSent = 0;
+    emergencyLatencyUs = 0;
+    emergencyWorstLatencyUs = 0;
+    txPreemptions = 0;
+    
+    // Initialize listen before talk
+    radioTxFramePending = false;
+    lbtEnabled = LORA_ENABLE_LBT;
+    lbtAttempts = 0;
+    lbtScanStart = 0;
+    lbtBackoffUntil = 0;
+    lbtScans = 0;
+    lbtBusyCount = 0;
+    lbtForcedTransmits = 0;
+    lbtBackoffTotalMs = 0;
+    arbiterDeferrals = 0;
+    for (int i = 0; i < 4; i++) {
+        lbtBusyHistogram[i] = 0;
+    }
+    txHeaderVersion = LORA_HEADER_V1;  // Until the peer offers v2
+    
+    // Initialize camera FEC transfer
+    cameraTransferType = PacketType::CAMERA_THUMB;
+    cameraNextChunk = 0;
+    cameraTransferActive = false;
+    nextImageId = random(0xFFFF);
+    fecChunksSent = 0;
+    onImageReceivedCallback = nullptr;
 }
 
 LoRaManager::~LoRaManager() {
@@ -58,14 +299,26 @@ LoRaManager::~LoRaManager() {
 // ===========================
 
 bool LoRaManager::begin() {
+    if (!radio) {
+        return false;   // Bulk link without its module
+    }
+    if (LINK_AUTH_ENABLED && !LinkAuthMgr().begin()) {
+        return false;   // Nothing goes out unsealed
+    }
     if (!initLoRaModule()) {
         return false;
     }
     
     configureLoRaSettings();
     
+    if (!startRadioTask()) {
+        LORA_TRACE("Failed to start radio task");
+        radio->end();
+        return false;
+    }
+    
     if (DEBUG_LORA) {
-        Serial.println("LoRa: Initialized successfully");
+        LORA_TRACE("Initialized successfully");
         printLoRaInfo();
     }
     
@@ -73,7 +326,10 @@ bool LoRaManager::begin() {
 }
 
 void LoRaManager::end() {
-    LoRa.end();
+    stopRadioTask();
+    if (radio) {
+        radio->end();
+    }
     transmitting = false;
     receiving = false;
 }
@@ -84,19 +340,25 @@ bool LoRaManager::reinitialize() {
     return begin();
 }
 
+bool LoRaManager::setRadioDriver(RadioDriver* driver) {
+    if (radioTaskHandle) {
+        return false;
+    }
+    if (!driver) {
+        driver = role == LinkRole::BULK ? BulkHardwareRadio() : &HardwareRadio();
+    }
+    radio = driver;
+    return true;
+}
+
 // ===========================
 // Private Initialization Methods
 // ===========================
 
 bool LoRaManager::initLoRaModule() {
-    // Configure SPI pins for LoRa
-    SPI.begin(LORA_SCK_PIN, LORA_MISO_PIN, LORA_MOSI_PIN, LORA_CS_PIN);
-    
-    // Initialize LoRa module
-    if (!LoRa.begin(frequency)) {
-        if (DEBUG_LORA) {
-            Serial.printf("LoRa: Failed to initialize at %.1f MHz\n", frequency);
-        }
+    // Driver owns the SPI pins and module reset
+    if (!radio->begin(frequency)) {
+        LORA_TRACE("Failed to initialize at %.1f MHz", frequency);
         return false;
     }
     
@@ -104,18 +366,28 @@ bool LoRaManager::initLoRaModule() {
 }
 
 void LoRaManager::configureLoRaSettings() {
-    LoRa.setSpreadingFactor(spreadingFactor);
-    LoRa.setSignalBandwidth(bandwidth);
-    LoRa.setCodingRate4(codingRate);
-    LoRa.setTxPower(txPower);
-    LoRa.setPreambleLength(preambleLength);
-    LoRa.setSyncWord(syncWord);
-    // CRC is automatically enabled in most LoRa libraries
+    radio->setSpreadingFactor(spreadingFactor);
+    radio->setSignalBandwidth(bandwidth);
+    radio->setCodingRate4(codingRate);
+    radio->setTxPower(txPower);
+    radioTxPower = txPower;
+    if (localLoads) {
+        Energy().setActiveCurrent(txLoad, transmitCurrentMa(txPower));
+    }
+    radio->setPreambleLength(preambleLength);
+    radio->setSyncWord(syncWord);
     
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: Configured - SF:%d, BW:%ld, CR:%d, Power:%d\n",
-                     spreadingFactor, bandwidth, codingRate, txPower);
+    // begin() left the radio in LoRa - back into a burst the peer is still in
+    if (fskBitrate && !radio->setFskMode(fskBitrate)) {
+        fskBitrate = 0;
     }
+    if (fixedFrameBytes && !radio->setImplicitHeader(fixedFrameBytes)) {
+        fixedFrameBytes = 0;
+    }
+    // CRC is automatically enabled in most LoRa libraries
+    
+    LORA_TRACE("Configured - SF:%d, BW:%ld, CR:%d, Power:%d",
+               spreadingFactor, bandwidth, codingRate, txPower);
 }
 
 // ===========================
@@ -124,16 +396,15 @@ void LoRaManager::configureLoRaSettings() {
 
 bool LoRaManager::setFrequency(long freq) {
     frequency = freq;
-    LoRa.setFrequency(freq);
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: Frequency set to %.1f MHz\n", freq);
-    }
+    lockRadio();
+    radio->setFrequency(freq);
+    radioChannel = LORA_CHANNEL_FIXED;  // Hopping retunes on the next frame
+    unlockRadio();
+    LORA_TRACE("Frequency set to %.1f MHz", freq);
     return true;
 
     
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: Failed to set frequency to %.1f MHz\n", freq);
-    }
+    LORA_TRACE("Failed to set frequency to %.1f MHz", freq);
     return false;
 }
 
@@ -143,21 +414,21 @@ bool LoRaManager::setSpreadingFactor(int sf) {
     }
     
     spreadingFactor = sf;
-    LoRa.setSpreadingFactor(sf);
+    lockRadio();
+    radio->setSpreadingFactor(sf);
+    unlockRadio();
     currentSpreadingFactor = sf;
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: Spreading factor set to %d\n", sf);
-    }
+    LORA_TRACE("Spreading factor set to %d", sf);
     return true;
 }
 
 bool LoRaManager::setBandwidth(long bw) {
     bandwidth = bw;
-    LoRa.setSignalBandwidth(bw);
+    lockRadio();
+    radio->setSignalBandwidth(bw);
+    unlockRadio();
     currentBandwidth = bw;
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: Bandwidth set to %ld Hz\n", bw);
-    }
+    LORA_TRACE("Bandwidth set to %ld Hz", bw);
     return true;
 }
 
@@ -167,11 +438,15 @@ bool LoRaManager::setTxPower(int power) {
     }
     
     txPower = power;
-    LoRa.setTxPower(power);
-    currentTxPower = power;
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: TX power set to %d dBm\n", power);
+    lockRadio();
+    radio->setTxPower(power);
+    radioTxPower = power;
+    unlockRadio();
+    if (localLoads) {
+        Energy().setActiveCurrent(txLoad, transmitCurrentMa(power));
     }
+    currentTxPower = power;
+    LORA_TRACE("TX power set to %d dBm", power);
     return true;
 }
 
@@ -181,19 +456,19 @@ bool LoRaManager::setCodingRate(int cr) {
     }
     
     codingRate = cr;
-    LoRa.setCodingRate4(cr);
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: Coding rate set to %d\n", cr);
-    }
+    lockRadio();
+    radio->setCodingRate4(cr);
+    unlockRadio();
+    LORA_TRACE("Coding rate set to %d", cr);
     return true;
 }
 
 bool LoRaManager::setSyncWord(byte sw) {
     syncWord = sw;
-    LoRa.setSyncWord(sw);
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: Sync word set to 0x%02X\n", sw);
-    }
+    lockRadio();
+    radio->setSyncWord(sw);
+    unlockRadio();
+    LORA_TRACE("Sync word set to 0x%02X", sw);
     return true;
 }
 
@@ -201,21 +476,32 @@ bool LoRaManager::setSyncWord(byte sw) {
 // Packet Operations
 // ===========================
 
-bool LoRaManager::sendPacket(const Packet& packet, Priority priority) {
+bool LoRaManager::sendPacket(const Packet& packet, Priority priority, bool ackRequired,
+                             int16_t payloadHandle) {
     QueuedPacket queuedPacket;
     queuedPacket.packet = packet;
+    queuedPacket.packet.sequenceNumber = takeSequenceNumber();
+    queuedPacket.packet.header.version = txHeaderVersion;
     queuedPacket.priority = priority;
     queuedPacket.enqueueTime = millis();
     queuedPacket.transmitAttempts = 0;
     queuedPacket.lastTransmitTime = 0;
+    queuedPacket.firstTransmitTime = 0;
     queuedPacket.waitingForAck = false;
+    queuedPacket.ackRequired = ackRequired;
+    queuedPacket.released = false;
+    queuedPacket.payloadHandle = payloadHandle;
+    
+    // Only ARQ traffic from the balloon is stamped - what the base station
+    // measures is how stale the balloon's data is by the time it lands
+    if (LORA_LATENCY_STAMPS && DEVICE_TYPE == DEVICE_BALLOON && ackRequired) {
+        queuedPacket.packet.header.flags |= LORA_FLAG_TIMING;
+    }
     
     addToQueueInternal(queuedPacket);
     
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: Packet queued for transmission (Type: %s, Priority: %s)\n",
-                     packetTypeToString(packet.type), priorityToString(priority));
-    }
+    LORA_TRACE("Packet queued for transmission (Type: %s, Priority: %s)",
+               packetTypeToString(packet.type), priorityToString(priority));
     
     return true;
 }
@@ -231,10 +517,24 @@ bool LoRaManager::sendGPSData(const uint8_t* data, size_t length) {
 }
 
 bool LoRaManager::sendCameraThumbnail(const uint8_t* data, size_t length) {
+    // Anything bigger than one chunk goes out erasure coded
+    if (LORA_ENABLE_CAMERA_FEC && length > LORA_FEC_CHUNK_SIZE) {
+        return startCameraTransfer(PacketType::CAMERA_THUMB, data, length);
+    }
+    
     Packet packet = createPacket(PacketType::CAMERA_THUMB, data, length);
     return sendPacket(packet, Priority::CAMERA);
 }
 
+bool LoRaManager::sendCameraImage(const uint8_t* data, size_t length) {
+    if (LORA_ENABLE_CAMERA_FEC && length > LORA_FEC_CHUNK_SIZE) {
+        return startCameraTransfer(PacketType::CAMERA_FULL, data, length);
+    }
+    
+    Packet packet = createPacket(PacketType::CAMERA_FULL, data, length);
+    return sendPacket(packet, Priority::CAMERA);
+}
+
 bool LoRaManager::sendStatus(const uint8_t* data, size_t length) {
     Packet packet = createPacket(PacketType::STATUS, data, length);
     return sendPacket(packet, Priority::STATUS);
@@ -245,6 +545,110 @@ bool LoRaManager::sendEmergency(const uint8_t* data, size_t length) {
     return sendPacket(packet, Priority::EMERGENCY);
 }
 
+uint16_t LoRaManager::takeSequenceNumber() {
+    if (sequenceSource) {
+        return sequenceSource->takeSequenceNumber();
+    }
+    portENTER_CRITICAL(&sequenceLock);
+    uint16_t sequenceNumber = nextSequenceNumber++;
+    portEXIT_CRITICAL(&sequenceLock);
+    return sequenceNumber;
+}
+
+// ===========================
+// Emergency Beacon
+// ===========================
+
+bool LoRaManager::sendEmergencyBeacon(const EmergencyBeacon& beacon) {
+    if (!radioTaskHandle) {
+        return false;
+    }
+    
+    portENTER_CRITICAL(&emergencyLock);
+    emergencyBeacon = beacon;
+    if (emergencyRequestedUs == 0) {
+        emergencyRequestedUs = micros() | 1;     // 0 means none pending
+    }
+    emergencyActive = true;
+    portEXIT_CRITICAL(&emergencyLock);
+    
+    xTaskNotify(radioTaskHandle, RADIO_NOTIFY_EMERGENCY, eSetBits);
+    return true;
+}
+
+void LoRaManager::updateEmergencyBeacon(const EmergencyBeacon& beacon) {
+    portENTER_CRITICAL(&emergencyLock);
+    emergencyBeacon = beacon;
+    portEXIT_CRITICAL(&emergencyLock);
+}
+
+void LoRaManager::stopEmergencyBeacon() {
+    emergencyActive = false;
+}
+
+// Radio task, radio locked
+void LoRaManager::radioSendEmergency() {
+    if (!emergencyActive || (radioState == RadioState::TRANSMITTING && radioTxEmergency)) {
+        return;
+    }
+    
+    // A frame on air is lost - processRadioEvents() puts its packets back in
+    // line. One waiting out a channel scan or LBT backoff keeps waiting
+    if (radioState == RadioState::TRANSMITTING) {
+        RadioEvent event;
+        event.type = RadioEventType::TX_ABORTED;
+        event.timestamp = millis();
+        event.airtime = event.timestamp - radioTxStartTime;
+        event.sequenceNumber = radioTxSequence;
+        event.tracked = radioTxTracked;
+        event.length = 0;
+        postRadioEvent(event);
+        txPreemptions = txPreemptions + 1;
+    }
+    
+    portENTER_CRITICAL(&emergencyLock);
+    EmergencyBeacon beacon = emergencyBeacon;
+    uint32_t requestedUs = emergencyRequestedUs;
+    emergencyRequestedUs = 0;
+    portEXIT_CRITICAL(&emergencyLock);
+    
+    uint8_t payload[LORA_EMERGENCY_BEACON_SIZE];
+    Packet packet = createPacket(PacketType::EMERGENCY, payload, encodeEmergencyBeacon(beacon, emergencyRepeat, payload));
+    packet.sequenceNumber = takeSequenceNumber();
+    packet.header.version = txHeaderVersion;
+    if (!serializePacket(packet, emergencyFrame.data, emergencyFrame.length)) {
+        return;
+    }
+    emergencyFrame.sequenceNumber = packet.sequenceNumber;
+    emergencyFrame.tracked = false;
+    emergencyFrame.clockSync = false;
+    emergencyFrame.timeOnAirMs = (getTimeOnAirUs(emergencyFrame.length) + 999) / 1000;
+    emergencyFrame.channel = radioRxChannel;     // Where the base station last heard us
+    
+    // Asleep between RX windows or TDMA slots - the FIFO needs the oscillator up
+    if (radioState == RadioState::SLEEPING) {
+        radio->idle();
+        setRadioState(RadioState::IDLE);
+        vTaskDelay(pdMS_TO_TICKS(LORA_RX_WAKEUP_MS) + 1);
+    }
+    
+    radioTxEmergency = true;
+    radioStartTransmit(emergencyFrame);
+    
+    if (requestedUs != 0) {
+        emergencyLatencyUs = micros() - requestedUs;
+        if (emergencyLatencyUs > emergencyWorstLatencyUs) {
+            emergencyWorstLatencyUs = emergencyLatencyUs;
+        }
+    }
+    emergencyBeaconsSent = emergencyBeaconsSent + 1;
+    emergencyRepeat++;
+    emergencyNextAt = millis() + LORA_EMERGENCY_BEACON_INTERVAL_MS;
+    if (LORA_EMERGENCY_BEACON_REPEATS > 0 && emergencyRepeat > LORA_EMERGENCY_BEACON_REPEATS) {
+        emergencyActive = false;
+    }
+}
+
 // ===========================
 // Queue Management
 // ===========================
@@ -254,407 +658,2890 @@ void LoRaManager::addToQueue(const Packet& packet, Priority priority) {
 }
 
 void LoRaManager::addToQueueInternal(const QueuedPacket& queuedPacket) {
-    int priorityIndex = static_cast<int>(queuedPacket.priority) - 1;
+    PriorityLane& lane = priorityQueues[laneIndex(queuedPacket.priority)];
     
-    if (queueSizes[priorityIndex] < MAX_QUEUE_SIZE) {
-        priorityQueues[priorityIndex][queueSizes[priorityIndex]] = queuedPacket;
-        queueSizes[priorityIndex]++;
-    } else {
-        // Queue is full, remove oldest packet
-        for (int i = 0; i < MAX_QUEUE_SIZE - 1; i++) {
-            priorityQueues[priorityIndex][i] = priorityQueues[priorityIndex][i + 1];
+    if (supersedeQueued(queuedPacket)) {
+        return;
+    }
+    
+    if (lane.count == MAX_QUEUE_SIZE) {
+        // Lane is full, drop the oldest packet
+        if (!lane.slots[lane.head].released) {
+            if (lane.slots[lane.head].transmitAttempts > 0 && arqOutstanding > 0) {
+                arqOutstanding--;
+            }
+            spillPacket(lane.slots[lane.head]);
+            releasePayload(lane.slots[lane.head]);
+            lane.pending--;
+            lane.dropCount++;
         }
-        priorityQueues[priorityIndex][MAX_QUEUE_SIZE - 1] = queuedPacket;
+        lane.head = (lane.head + 1) & QUEUE_INDEX_MASK;
+        lane.count--;
+        compactLaneHead(lane);
         
-        if (DEBUG_LORA) {
-            Serial.printf("LoRa: Queue overflow, oldest packet removed\n");
-        }
+        LORA_TRACE("Queue overflow, oldest packet removed");
+    }
+    
+    uint16_t tail = (lane.head + lane.count) & QUEUE_INDEX_MASK;
+    lane.slots[tail] = queuedPacket;
+    lane.slots[tail].released = false;
+    lane.count++;
+    lane.pending++;
+    
+    if (lane.pending > lane.highWaterMark) {
+        lane.highWaterMark = lane.pending;
     }
 }
 
 bool LoRaManager::processQueue() {
-    // Check for incoming packets
-    processIncomingPacket();
+    // Drain TX/RX events from the radio task
+    processRadioEvents();
+    
+    // Expire outstanding frames whose ACK never came
+    checkAckTimeouts();
+    refillAirtimeBudget();
+    
+    // Feed the next FEC chunks of a camera image into its lane
+    pumpCameraTransfer();
+    
+    // Switch data rate between frames once both ends agreed, or fall back if the link died
+    if (rateChangeState == RateChangeState::SWITCHING && !transmitting) {
+        applyLinkRate(pendingRate);
+        rateChangeState = RateChangeState::IDLE;
+    }
+    checkLinkFallback();
+    updateFskBurst();
+    updateFixedFrames();
+    
+    // Base station sleeps its receiver between the slots it has heard, the
+    // balloon between its own transmit windows
+    if (DEVICE_TYPE == DEVICE_BASE_STATION) {
+        updateSlotReceiver();
+        updateHopDwell();
+    } else {
+        updateRxWindow();
+    }
+    
+    // An ACK held for a run goes out once due - in front of our next frame
+    // if there is one, on its own otherwise
+    bool ackDue = ackHeld && (int32_t)(millis() - ackDueAt) >= 0;
+    bool handedOff = transmitNext(ackDue);
+    if (ackDue && ackHeld) {
+        sendHeldAck();
+    }
+    return handedOff;
+}
+
+bool LoRaManager::transmitNext(bool carryAck) {
+    // Radio is busy with the previous frame
+    if (transmitting) {
+        return false;
+    }
     
-    // Get next packet to transmit
+    // Get next packet to transmit (new or retransmission) that fits the airtime budget
     QueuedPacket* nextPacket = getNextPacket();
     if (!nextPacket) {
-        return false;  // No packets to send
+        return false;  // Nothing eligible - empty, window full or out of airtime
     }
     
-    // Check if we need to wait for ACK
-    if (nextPacket->waitingForAck) {
-        if (millis() - nextPacket->lastTransmitTime > ACK_TIMEOUT_MS) {
-            nextPacket->waitingForAck = false;
-            ackTimeoutCount++;
-            
-            if (DEBUG_LORA) {
-                Serial.printf("LoRa: ACK timeout for packet %d\n", nextPacket->packet.sequenceNumber);
-            }
-        } else {
-            return false;  // Still waiting for ACK
-        }
-    }
+    // Piggyback other small packets that fit in the same frame
+    QueuedPacket* batch[LORA_MAX_AGGREGATE_RECORDS];
+    int batchCount = collectAggregate(nextPacket, batch, aggregateLimit());
     
-    // Check retry limit
-    if (nextPacket->transmitAttempts >= MAX_RETRIES) {
-        // Remove packet from queue
-        Priority priority = nextPacket->priority;
-        int priorityIndex = static_cast<int>(priority) - 1;
-        int index = nextPacket - &priorityQueues[priorityIndex][0];
-        removePacketFromQueue(priority, index);
-        
-        if (DEBUG_LORA) {
-            Serial.printf("LoRa: Max retries exceeded for packet %d\n", nextPacket->packet.sequenceNumber);
+    // Hold the frame for our slot unless it and its ACK fit in what is left of it
+    size_t frameBytes = serializedPacketSize(nextPacket->packet);
+    if (batchCount > 1) {
+        frameBytes = frameHeaderSize(txHeaderVersion) + LORA_FRAME_TRAILER_BYTES;
+        for (int i = 0; i < batchCount; i++) {
+            frameBytes += aggregateRecordSize(batch[i]->packet);
         }
-        
-        transmitErrorCount++;
-        return false;
     }
     
-    // Transmit packet
-    if (transmitPacket(nextPacket->packet)) {
-        nextPacket->transmitAttempts++;
-        nextPacket->lastTransmitTime = millis();
-        nextPacket->waitingForAck = true;
-        transmitStartTime = millis();
-        transmitting = true;
-        
-        if (DEBUG_LORA) {
-            Serial.printf("LoRa: Transmitted packet %d (Attempt %d/%d)\n",
-                         nextPacket->packet.sequenceNumber, nextPacket->transmitAttempts, MAX_RETRIES);
+    // A due ACK goes in front as a record of its own, making the frame an aggregate
+    bool piggyback = false;
+    if (carryAck && LORA_ACK_PIGGYBACK && nextPacket->packet.payloadLength <= 0xFF &&
+        !(nextPacket->packet.header.flags & LORA_FLAG_FEC_CHUNK)) {
+        size_t aggregateBytes = frameHeaderSize(txHeaderVersion) + LORA_FRAME_TRAILER_BYTES +
+                                LORA_AGGREGATE_RECORD_HEADER + LORA_SELECTIVE_ACK_SIZE;
+        if (txHeaderVersion >= LORA_HEADER_V2 && (nextPacket->packet.header.flags & LORA_FLAG_TIMING)) {
+            aggregateBytes += LORA_LATENCY_STAMP_MAX;
+        }
+        for (int i = 0; i < batchCount; i++) {
+            aggregateBytes += aggregateRecordSize(batch[i]->packet);
+        }
+        if (aggregateBytes <= fixedFrameCapacity()) {
+            piggyback = true;
+            frameBytes = aggregateBytes;
         }
-        
-        return true;
-    } else {
-        transmitErrorCount++;
-        return false;
     }
-}
-
-QueuedPacket* LoRaManager::getNextPacket() {
-    // Check queues in priority order (1=Emergency, 5=Status)
-    for (int priority = 0; priority < 5; priority++) {
-        if (queueSizes[priority] > 0) {
-            return &priorityQueues[priority][0];  // FIFO within priority
+    
+    // Half duplex - a frame still on air when the peer's held ACK goes out
+    // collides with it, so it waits for the ACK instead
+    if (ackTurnaround) {
+        uint32_t nowMs = millis();
+        uint32_t frameEnd = nowMs + getTimeOnAirUs(frameBytes) / 1000;
+        if ((int32_t)(nowMs - ackTurnaroundUntil) >= 0) {
+            ackTurnaround = false;
+        } else if ((int32_t)(frameEnd - ackTurnaroundFrom) > 0) {
+            if (!ackTurnaroundHeld) {
+                ackTurnaroundHeld = true;
+                ackTurnaroundWaits++;
+            }
+            return false;
         }
     }
     
-    return nullptr;  // No packets available
-}
-
-void LoRaManager::removePacketFromQueue(Priority priority, int index) {
-    int priorityIndex = static_cast<int>(priority) - 1;
+    if (!tdmaSlotOpen(frameBytes)) {
+        return false;
+    }
     
-    // Shift remaining packets
-    for (int i = index; i < queueSizes[priorityIndex] - 1; i++) {
-        priorityQueues[priorityIndex][i] = priorityQueues[priorityIndex][i + 1];
+    // Receiver asleep between windows - hold the frame until the module is up
+    if (!rxWindowReady()) {
+        return false;
     }
     
-    queueSizes[priorityIndex]--;
-}
-
-void LoRaManager::clearQueue() {
-    memset(queueSizes, 0, sizeof(queueSizes));
-    memset(priorityQueues, 0, sizeof(priorityQueues));
-}
-
-int LoRaManager::getQueueSize(Priority priority) const {
-    int priorityIndex = static_cast<int>(priority) - 1;
-    return queueSizes[priorityIndex];
-}
-
-int LoRaManager::getTotalQueueSize() const {
-    int total = 0;
-    for (int i = 0; i < 5; i++) {
-        total += queueSizes[i];
+    uint32_t now = millis();
+    for (int i = 0; i < batchCount; i++) {
+        stampLatency(*batch[i], now);
     }
-    return total;
-}
-
-// ===========================
-// Transmission Methods
-// ===========================
-
-bool LoRaManager::transmitPacket(const Packet& packet) {
-    // Serialize packet
-    static uint8_t buffer[MAX_PACKET_SIZE];
-    size_t bufferLength = 0;
     
-    if (!serializePacket(packet, buffer, bufferLength)) {
-        if (DEBUG_LORA) {
-            Serial.println("LoRa: Failed to serialize packet");
-        }
+    // Tell the receiver whether another frame is right behind this one
+    bool more = moreFramesFollow(batch, batchCount, frameBytes);
+    uint8_t& flags = nextPacket->packet.header.flags;
+    flags = more ? (flags | LORA_FLAG_MORE) : (flags & ~LORA_FLAG_MORE);
+    
+    bool handedOff = (batchCount > 1 || piggyback) ? transmitAggregate(batch, batchCount, more, piggyback)
+                                                   : transmitPacket(nextPacket->packet);
+    if (!handedOff) {
+        transmitErrorCount++;
         return false;
     }
     
-    // Transmit packet
-    LoRa.beginPacket();
-    LoRa.write(buffer, bufferLength);
-    bool success = LoRa.endPacket();
+    inFlightBatchCount = batchCount;
+    chargeLane(laneIndex(nextPacket->priority), getTimeOnAirUs(frameBytes));
     
-    if (success) {
-        transmitting = false;
-        transmitStartTime = 0;
+    for (int i = 0; i < batchCount; i++) {
+        QueuedPacket* qp = batch[i];
+        inFlightBatch[i] = qp->packet.sequenceNumber;
         
-        // Update signal quality (transmit side)
-        updateSignalQuality(LoRa.packetRssi(), LoRa.packetSnr());
+        if (qp->transmitAttempts == 0) {
+            notifyPayload(*qp, PayloadEvent::TRANSMITTED);
+        }
+        
+        // Fire-and-forget frames leave the queue as soon as the radio has them
+        if (!qp->ackRequired) {
+            Priority priority;
+            int slot;
+            if (findQueuedPacket(qp->packet.sequenceNumber, priority, slot)) {
+                removePacketFromQueue(priority, slot);
+            }
+            fecChunksSent++;
+            continue;
+        }
+        
+        if (qp->transmitAttempts == 0) {
+            arqOutstanding++;
+            qp->firstTransmitTime = now;
+        }
+        qp->transmitAttempts++;
+        qp->lastTransmitTime = now;
+        qp->waitingForAck = true;
+        
+        LORA_TRACE("Packet %d handed to radio (Attempt %d/%d, window %d/%d)",
+                   qp->packet.sequenceNumber, qp->transmitAttempts, MAX_RETRIES,
+                   arqOutstanding, arqWindowSize);
+    }
+    
+    // With ACKs owed the peer answers right after a run's last frame, or once
+    // its hold runs out within a run; TX done re-arms from the real frame end
+    ackTurnaround = arqOutstanding > 0 && LORA_ACK_DELAY_ENABLED && !tdmaEnabled;
+    if (ackTurnaround) {
+        ackTurnaroundHeld = false;
+        ackTurnaroundHoldMs = more ? LORA_ACK_HOLD_MS : 0;
+        armAckTurnaround(now + getTimeOnAirUs(frameBytes) / 1000);
     }
     
-    return success;
+    transmitStartTime = now;
+    return true;
 }
 
-bool LoRaManager::receivePacket(Packet& packet) {
-    int packetSize = LoRa.parsePacket();
-    if (packetSize == 0) {
-        return false;
-    }
+int LoRaManager::collectAggregate(QueuedPacket* first, QueuedPacket** batch, int maxRecords) {
+    const size_t frameOverhead = frameHeaderSize(txHeaderVersion) + LORA_FRAME_TRAILER_BYTES;
+    const size_t maxAggregatePayload = fixedFrameCapacity() - frameOverhead;
     
-    // Read packet data
-    static uint8_t buffer[MAX_PACKET_SIZE];
-    int bytesRead = 0;
+    batch[0] = first;
+    size_t aggregateSize = aggregateRecordSize(first->packet);
     
-    while (LoRa.available() && bytesRead < packetSize && bytesRead < MAX_PACKET_SIZE) {
-        buffer[bytesRead] = LoRa.read();
-        bytesRead++;
+    if (!LORA_ENABLE_AGGREGATION || !first->ackRequired || first->packet.payloadLength > 0xFF ||
+        aggregateSize + LORA_AGGREGATE_RECORD_HEADER > maxAggregatePayload) {
+        return 1;
     }
     
-    // Update signal quality (receive side)
-    lastRssi = LoRa.packetRssi();
-    lastSnr = LoRa.packetSnr();
-    updateSignalQuality(lastRssi, lastSnr);
-    lastReceiveTime = millis();
+    int count = 1;
+    int newPackets = (first->transmitAttempts == 0) ? 1 : 0;
     
-    // Deserialize packet
-    if (deserializePacket(buffer, bytesRead, packet)) {
-        if (validatePacket(packet)) {
-            packet.rssi = lastRssi;
-            packet.snr = lastSnr;
-            packet.valid = true;
+    for (int priority = 0; priority < NUM_PRIORITY_LANES && count < maxRecords; priority++) {
+        PriorityLane& lane = priorityQueues[priority];
+        for (int i = 0; i < lane.count && count < maxRecords; i++) {
+            QueuedPacket* qp = &lane.slots[(lane.head + i) & QUEUE_INDEX_MASK];
+            if (qp == first || qp->released || qp->waitingForAck || !qp->ackRequired) {
+                continue;
+            }
             
-            if (DEBUG_LORA) {
-                Serial.printf("LoRa: Received packet (Type: %s, RSSI: %d dBm, SNR: %d dB)\n",
-                             packetTypeToString(packet.type), lastRssi, lastSnr);
+            // Same window rule as getNextPacket()
+            bool isNew = (qp->transmitAttempts == 0);
+            if (isNew && arqOutstanding + newPackets >= arqWindowSize) {
+                continue;
             }
             
-            return true;
-        } else {
-            crcErrorCount++;
+            size_t recordSize = aggregateRecordSize(qp->packet);
+            if (qp->packet.payloadLength > 0xFF || aggregateSize + recordSize > maxAggregatePayload) {
+                continue;
+            }
             
-            if (DEBUG_LORA) {
-                Serial.println("LoRa: CRC validation failed");
+            if ((int32_t)getTimeOnAirUs(frameOverhead + aggregateSize + recordSize) > airtimeBucket(txChannel())) {
+                continue;
+            }
+            
+            batch[count++] = qp;
+            aggregateSize += recordSize;
+            if (isNew) {
+                newPackets++;
             }
-        }
-    } else {
-        receiveErrorCount++;
-        
-        if (DEBUG_LORA) {
-            Serial.println("LoRa: Failed to deserialize packet");
         }
     }
     
-    return false;
+    return count;
 }
 
-void LoRaManager::processIncomingPacket() {
-    Packet packet;
-    if (receivePacket(packet)) {
-        // Handle special packet types
-        switch (packet.type) {
-            case PacketType::ACK:
-                handleAck(packet);
-                break;
-                
-            case PacketType::NACK:
-                handleNack(packet);
-                break;
-                
-            default:
-                // Regular data packets could be handled by application layer
-                break;
-        }
-    }
+size_t LoRaManager::aggregateRecordSize(const Packet& packet) {
+    size_t stamp = (packet.header.flags & LORA_FLAG_TIMING) ? LORA_LATENCY_STAMP_MAX : 0;
+    return LORA_AGGREGATE_RECORD_HEADER + stamp + packet.payloadLength;
 }
 
-// ===========================
-// ACK/NACK Handling
-// ===========================
+void LoRaManager::stampLatency(QueuedPacket& qp, uint32_t now) {
+    LoRaPacketHeader& header = qp.packet.header;
+    if (!(header.flags & LORA_FLAG_TIMING)) {
+        return;
+    }
+    
+    // Written before each hand-off, so a retransmission reports its own attempt
+    uint32_t firstHandOff = (qp.transmitAttempts == 0) ? now : qp.firstTransmitTime;
+    int32_t sampleAge = (int32_t)(header.createdAt - header.sampledAt);
+    header.latency.sampleMs = sampleAge > 0 ? sampleAge : 0;
+    header.latency.queueMs = firstHandOff - header.createdAt;
+    header.latency.retryMs = now - firstHandOff;
+    header.latency.attempt = qp.transmitAttempts + 1;
+    header.latency.valid = true;
+}
 
-void LoRaManager::handleAck(const Packet& ack) {
-    if (ack.payloadLength < 4) {
-        return;  // Invalid ACK packet
+bool LoRaManager::transmitAggregate(QueuedPacket** batch, int count, bool more, bool carryAck) {
+    // Records are written straight into the TX frame behind the outer header
+    Packet outer = createPacket(PacketType::AGGREGATE, nullptr, 0);
+    outer.header.version = txHeaderVersion;
+    bool timing = txHeaderVersion >= LORA_HEADER_V2 && (batch[0]->packet.header.flags & LORA_FLAG_TIMING);
+    if (timing) {
+        outer.header.flags |= LORA_FLAG_TIMING;
     }
+    if (more) {
+        outer.header.flags |= LORA_FLAG_MORE;
+    }
+    FrameWriter writer;
+    frameBegin(writer, txFrame.data, sizeof(txFrame.data), outer.header,
+               PacketType::AGGREGATE, batch[0]->packet.sequenceNumber);
     
-    uint16_t ackSequence = (ack.payload[0] << 8) | ack.payload[1];
-    uint8_t ackType = ack.payload[2];
-    int8_t rssi = static_cast<int8_t>(ack.payload[3]);
+    // The held selective ACK first, sequence 0 like any ACK
+    if (carryAck) {
+        uint8_t record[LORA_AGGREGATE_RECORD_HEADER + LORA_SELECTIVE_ACK_SIZE] = {
+            static_cast<uint8_t>(PacketType::ACK), 0, 0, LORA_SELECTIVE_ACK_SIZE};
+        encodeSelectiveAck(rxNewestSequence, rxSequenceBitmap, lastRssi, &record[LORA_AGGREGATE_RECORD_HEADER]);
+        frameAppend(writer, record, LORA_AGGREGATE_RECORD_HEADER);
+        if (timing) {
+            uint8_t stamp[LORA_LATENCY_STAMP_MAX];
+            LatencyStamp none = {};
+            frameAppend(writer, stamp, encodeLatencyStamp(none, stamp));
+        }
+        frameAppend(writer, &record[LORA_AGGREGATE_RECORD_HEADER], LORA_SELECTIVE_ACK_SIZE);
+    }
     
-    // Find and remove the corresponding packet from queue
-    for (int priority = 0; priority < 5; priority++) {
-        for (int i = 0; i < queueSizes[priority]; i++) {
-            QueuedPacket* qp = &priorityQueues[priority][i];
-            if (qp->packet.sequenceNumber == ackSequence && qp->waitingForAck) {
-                // Packet acknowledged, remove from queue
-                removePacketFromQueue(static_cast<Priority>(priority + 1), i);
-                
-                if (DEBUG_LORA) {
-                    Serial.printf("LoRa: Packet %d acknowledged (Type: %d)\n", ackSequence, ackType);
-                }
-                
-                // Adapt transmission settings based on signal quality
-                adaptTransmissionSettings(rssi, ack.snr);
-                
-                return;
-            }
+    for (int i = 0; i < count; i++) {
+        const Packet& member = batch[i]->packet;
+        uint8_t record[LORA_AGGREGATE_RECORD_HEADER];
+        record[0] = static_cast<uint8_t>(member.type);
+        record[1] = (member.sequenceNumber >> 8) & 0xFF;
+        record[2] = member.sequenceNumber & 0xFF;
+        record[3] = static_cast<uint8_t>(member.payloadLength);
+        frameAppend(writer, record, sizeof(record));
+        if (timing) {
+            // Every record carries one; an unstamped member says attempt 0
+            uint8_t stamp[LORA_LATENCY_STAMP_MAX];
+            LatencyStamp none = {};
+            const LatencyStamp& latency = (member.header.flags & LORA_FLAG_TIMING) ? member.header.latency : none;
+            frameAppend(writer, stamp, encodeLatencyStamp(latency, stamp));
         }
+        frameAppend(writer, member.payload, member.payloadLength);
     }
     
-    if (DEBUG_LORA) {
-        Serial.printf("LoRa: ACK received for unknown packet %d\n", ackSequence);
+    if (!frameFinish(writer, txFrame.length)) {
+        return false;
+    }
+    
+    txFrame.sequenceNumber = batch[0]->packet.sequenceNumber;
+    txFrame.tracked = true;
+    txFrame.clockSync = false;
+    if (!queueFrame(txFrame)) {
+        return false;
     }
+    
+    aggregateFramesSent++;
+    aggregatedRecordsSent += count;
+    if (carryAck) {
+        acksSent++;
+        acksPiggybacked++;
+        ackSent();
+    }
+    return true;
 }
 
-void LoRaManager::handleNack(const Packet& nack) {
-    if (nack.payloadLength < 3) {
-        return;  // Invalid NACK packet
+bool LoRaManager::moreFramesFollow(QueuedPacket** batch, int count, size_t frameBytes) const {
+    if (!LORA_ACK_DELAY_ENABLED || tdmaEnabled) {
+        return false;  // A slot ends the run whatever is queued
     }
     
-    uint16_t nackSequence = (nack.payload[0] << 8) | nack.payload[1];
-    uint8_t nackType = nack.payload[2];
+    // The frame that fills the window ends the run - the receiver should answer it
+    int newPackets = 0;
+    for (int i = 0; i < count; i++) {
+        if (batch[i]->ackRequired && batch[i]->transmitAttempts == 0) {
+            newPackets++;
+        }
+    }
+    if (arqOutstanding + newPackets >= arqWindowSize) {
+        return false;
+    }
     
-    // Find the corresponding packet and reset waiting for ACK
-    for (int priority = 0; priority < 5; priority++) {
-        for (int i = 0; i < queueSizes[priority]; i++) {
-            QueuedPacket* qp = &priorityQueues[priority][i];
-            if (qp->packet.sequenceNumber == nackSequence && qp->waitingForAck) {
-                qp->waitingForAck = false;
-                
-                if (DEBUG_LORA) {
-                    Serial.printf("LoRa: Packet %d NACK received (Type: %d)\n", nackSequence, nackType);
+    uint32_t now = millis();
+    uint32_t oldest = now;
+    bool another = false;
+    for (int i = 0; i < NUM_PRIORITY_LANES; i++) {
+        const PriorityLane& lane = priorityQueues[i];
+        for (int j = 0; j < lane.count; j++) {
+            const QueuedPacket* qp = &lane.slots[(lane.head + j) & QUEUE_INDEX_MASK];
+            if (qp->released) {
+                continue;
+            }
+            if (qp->waitingForAck) {
+                if ((int32_t)(qp->lastTransmitTime - oldest) < 0) {
+                    oldest = qp->lastTransmitTime;
+                }
+                continue;
+            }
+            // Fragments and FEC chunks too - an ACK sent in front of them
+            // would land while we are still transmitting
+            bool inFrame = false;
+            for (int k = 0; k < count && !inFrame; k++) {
+                inFrame = batch[k] == qp;
+            }
+            another = another || !inFrame;
+        }
+    }
+    
+    // Held ACKs come later, so a run stops while its oldest frame is well
+    // inside its ACK timeout
+    return another && now - oldest + 2 * getTimeOnAirUs(frameBytes) / 1000 < LORA_ACK_RUN_MS;
+}
+
+void LoRaManager::checkAckTimeouts() {
+    // Frames still on air get their timeout from TX done, and no ACK gets
+    // through to us before then anyway
+    if (transmitting) {
+        return;
+    }
+    
+    uint32_t now = millis();
+    bool expired = false;
+    
+    // Leave room for the selective ACK itself to come back at slow spreading factors
+    uint32_t ackTimeout = ACK_TIMEOUT_MS +
+                          getTimeOnAirUs(frameHeaderSize(txHeaderVersion) + 8 + LORA_FRAME_TRAILER_BYTES) / 1000;
+    
+    // Fixed frames: the peer hears out our frame's whole length before it
+    // answers, and we hear out the whole length of its ACK
+    if (fixedFrameBytes) {
+        ackTimeout = ACK_TIMEOUT_MS + 2 * getTimeOnAirUs(fixedFrameCapacity()) / 1000;
+    }
+    
+    for (int priority = 0; priority < NUM_PRIORITY_LANES; priority++) {
+        PriorityLane& lane = priorityQueues[priority];
+        for (int i = 0; i < lane.count; i++) {
+            int slot = (lane.head + i) & QUEUE_INDEX_MASK;
+            QueuedPacket* qp = &lane.slots[slot];
+            if (qp->released || qp->transmitAttempts == 0) {
+                continue;
+            }
+            
+            if (qp->waitingForAck) {
+                if (now - qp->lastTransmitTime <= ackTimeout) {
+                    continue;
+                }
+                qp->waitingForAck = false;
+                ackTimeoutCount++;
+                captureFrame(LinkCaptureKind::ACK_TIMEOUT, qp->packet.sequenceNumber, nullptr);
+                recordLinkOutcome(false);
+                expired = true;
+                
+                LORA_TRACE("ACK timeout for packet %d", qp->packet.sequenceNumber);
+            }
+            
+            // A newer sample is on its way, or this one is too old to be worth a retry
+            if (isStaleRetry(*qp, now)) {
+                captureFrame(LinkCaptureKind::DROPPED, qp->packet.sequenceNumber, nullptr);
+                removePacketFromQueue(static_cast<Priority>(priority + 1), slot);
+                lane.supersededCount++;
+                continue;
+            }
+            
+            // Check retry limit
+            if (qp->transmitAttempts >= MAX_RETRIES) {
+                uint16_t sequenceNumber = qp->packet.sequenceNumber;
+                captureFrame(LinkCaptureKind::DROPPED, sequenceNumber, nullptr);
+                spillPacket(*qp);
+                removePacketFromQueue(static_cast<Priority>(priority + 1), slot);
+                transmitErrorCount++;
+                
+                // Unconfirmed rate change - the peer may or may not have switched. A
+                // burst or fixed-frame profile it never started is just not tried
+                // again for a while; one it did start, it leaves on its own once we
+                // go quiet in it
+                if (rateChangeState == RateChangeState::REQUESTED && sequenceNumber == rateChangeSequence) {
+                    if (pendingRate.fskBitrate && !fskBitrate) {
+                        rateChangeState = RateChangeState::IDLE;
+                        fskBackoffUntil = millis() + LORA_FSK_BACKOFF_MS;
+                        fskBurstFailures++;
+                    } else if (pendingRate.fixedFrameBytes && !fixedFrameBytes) {
+                        rateChangeState = RateChangeState::IDLE;
+                        fixedBackoffUntil = millis() + LORA_FIXED_BACKOFF_MS;
+                        fixedFrameFailures++;
+                    } else {
+                        pendingRate = {LORA_ADR_RENDEZVOUS_SF, LORA_ADR_RENDEZVOUS_BW, LORA_ADR_RENDEZVOUS_CR, 20, 0, 0, 0};
+                        rateChangeState = RateChangeState::SWITCHING;
+                        rateFallbacks++;
+                    }
+                }
+                
+                LORA_TRACE("Max retries exceeded for packet %d", sequenceNumber);
+            }
+        }
+    }
+    
+    // One selective ACK answers a whole run, so a lost one times out every
+    // frame of it at once - the streak counts rounds, not frames
+    if (expired && ackTimeoutStreak < 0xFF) {
+        ackTimeoutStreak++;
+    }
+    
+    // The base station may be listening elsewhere - meet it on the home channel
+    if (hoppingEnabled && !hopResync && ackTimeoutStreak >= LORA_HOP_RESYNC_TIMEOUTS) {
+        hopResync = true;
+        hopResyncs++;
+    }
+}
+
+QueuedPacket* LoRaManager::getNextPacket() {
+    bool windowOpen = arqOutstanding < arqWindowSize;
+    bool deferred = false;
+    QueuedPacket* candidates[NUM_PRIORITY_LANES];
+    
+    laneEligibleMask = 0;
+    for (int lane = 0; lane < NUM_PRIORITY_LANES; lane++) {
+        candidates[lane] = laneCandidate(lane, windowOpen, deferred);
+        if (candidates[lane]) {
+            laneEligibleMask |= 1 << lane;
+        }
+    }
+    if (deferred) {
+        dutyCycleDeferrals++;
+    }
+    
+    // Emergency never waits on a share
+    if (candidates[0]) {
+        return candidates[0];
+    }
+    
+    // A lane whose credit covers its next frame is owed airtime - the
+    // highest such lane goes first, otherwise plain priority order
+    QueuedPacket* first = nullptr;
+    for (int lane = 1; lane < NUM_PRIORITY_LANES; lane++) {
+        QueuedPacket* qp = candidates[lane];
+        if (!qp) {
+            continue;
+        }
+        if (!first) {
+            first = qp;
+        } else if (laneCreditUs[lane] >= (int32_t)getTimeOnAirUs(serializedPacketSize(qp->packet))) {
+            laneShareServes[lane]++;
+            return qp;
+        }
+    }
+    
+    return first;  // nullptr when no packets are available
+}
+
+// Oldest frame in the lane that may go now, FIFO within priority
+QueuedPacket* LoRaManager::laneCandidate(int lane, bool windowOpen, bool& deferred) {
+    PriorityLane& queue = priorityQueues[lane];
+    for (int i = 0; i < queue.count; i++) {
+        QueuedPacket* qp = &queue.slots[(queue.head + i) & QUEUE_INDEX_MASK];
+        if (qp->released || qp->waitingForAck) {
+            continue;  // Gone, or in flight
+        }
+        
+        // Retransmissions reuse their window slot; new packets need a free one.
+        // Frames sent without an ACK never occupy the window
+        if (qp->ackRequired && qp->transmitAttempts == 0 && !windowOpen) {
+            continue;
+        }
+        
+        // Frames too long for the fixed-frame profile wait for the explicit header
+        size_t frameBytes = serializedPacketSize(qp->packet);
+        if (fixedFrameBytes && frameBytes > fixedFrameCapacity()) {
+            continue;
+        }
+        
+        // Skip frames that would overrun the duty cycle; a shorter one may still fit.
+        // A frame longer than the whole window (a long one at the rendezvous
+        // rate) goes once the bucket is full and is paid back before the next
+        int32_t bucket = airtimeBucket(txChannel());
+        int32_t capacity = (int32_t)LORA_DUTY_CYCLE_WINDOW_MS * LORA_DUTY_CYCLE_PERMILLE;
+        if ((int32_t)getTimeOnAirUs(frameBytes) > bucket && bucket < capacity) {
+            deferred = true;
+            continue;
+        }
+        
+        return qp;
+    }
+    return nullptr;
+}
+
+// Deficit accounting for the lane shares: the served lane pays the frame's
+// airtime, every other lane that was waiting earns its share of it. Credit
+// stays between zero and one full frame, so a lane that was idle can't
+// bank a burst and a busy one never owes more than its next frame
+void LoRaManager::chargeLane(int lane, uint32_t airtimeUs) {
+    static const uint8_t shares[NUM_PRIORITY_LANES] = LORA_LANE_SHARE_PERCENT;
+    int32_t cap = (int32_t)getTimeOnAirUs(MAX_PACKET_SIZE);
+    
+    for (int i = 1; i < NUM_PRIORITY_LANES; i++) {
+        int32_t credit = laneCreditUs[i];
+        if (i == lane) {
+            credit -= (int32_t)airtimeUs;
+        } else if (laneEligibleMask & (1 << i)) {
+            credit += (int32_t)(airtimeUs * shares[i] / 100);
+        } else {
+            credit = 0;
+        }
+        laneCreditUs[i] = credit < 0 ? 0 : (credit > cap ? cap : credit);
+    }
+}
+
+void LoRaManager::refillAirtimeBudget() {
+    uint32_t now = millis();
+    uint32_t elapsed = now - lastAirtimeRefill;
+    lastAirtimeRefill = now;
+    
+    // PERMILLE microseconds of airtime accrue per millisecond
+    int32_t capacity = (int32_t)LORA_DUTY_CYCLE_WINDOW_MS * LORA_DUTY_CYCLE_PERMILLE;
+    for (int i = 0; i < LORA_HOP_CHANNEL_COUNT; i++) {
+        int64_t tokens = (int64_t)airtimeTokensUs[i] + (int64_t)elapsed * LORA_DUTY_CYCLE_PERMILLE;
+        airtimeTokensUs[i] = (tokens > capacity) ? capacity : (int32_t)tokens;
+    }
+}
+
+QueuedPacket* LoRaManager::findQueuedPacket(uint16_t sequenceNumber, Priority& priority, int& slot) {
+    for (int lane = 0; lane < NUM_PRIORITY_LANES; lane++) {
+        PriorityLane& queue = priorityQueues[lane];
+        for (int i = 0; i < queue.count; i++) {
+            int index = (queue.head + i) & QUEUE_INDEX_MASK;
+            QueuedPacket* qp = &queue.slots[index];
+            if (!qp->released && qp->packet.sequenceNumber == sequenceNumber) {
+                priority = static_cast<Priority>(lane + 1);
+                slot = index;
+                return qp;
+            }
+        }
+    }
+    
+    return nullptr;
+}
+
+bool LoRaManager::acknowledgeSequence(uint16_t sequenceNumber) {
+    Priority priority;
+    int slot;
+    QueuedPacket* qp = findQueuedPacket(sequenceNumber, priority, slot);
+    
+    // Late ACKs for frames already marked for retransmission still count
+    if (!qp || qp->transmitAttempts == 0) {
+        return false;
+    }
+    
+    notifyPayload(*qp, PayloadEvent::ACKNOWLEDGED);
+    captureFrame(LinkCaptureKind::ACKED, sequenceNumber, nullptr);
+    removePacketFromQueue(priority, slot);
+    
+    // The peer switches as soon as its ACK is out; follow between frames
+    if (rateChangeState == RateChangeState::REQUESTED && sequenceNumber == rateChangeSequence) {
+        rateChangeState = RateChangeState::SWITCHING;
+    }
+    return true;
+}
+
+bool LoRaManager::setArqWindowSize(uint8_t windowSize) {
+    if (windowSize < 1 || windowSize > LORA_ACK_BITMAP_BITS) {
+        return false;
+    }
+    
+    arqWindowSize = windowSize;
+    LORA_TRACE("ARQ window set to %d", windowSize);
+    return true;
+}
+
+void LoRaManager::removePacketFromQueue(Priority priority, int slot) {
+    PriorityLane& lane = priorityQueues[laneIndex(priority)];
+    
+    if (lane.slots[slot].released) {
+        return;
+    }
+    
+    if (lane.slots[slot].transmitAttempts > 0 && arqOutstanding > 0) {
+        arqOutstanding--;
+    }
+    
+    // Out-of-order removals leave a released slot behind instead of shifting
+    lane.slots[slot].released = true;
+    lane.pending--;
+    releasePayload(lane.slots[slot]);
+    compactLaneHead(lane);
+}
+
+void LoRaManager::releasePayload(QueuedPacket& queuedPacket) {
+    if (queuedPacket.payloadHandle == LORA_PAYLOAD_UNOWNED) {
+        return;
+    }
+
+    int16_t handle = queuedPacket.payloadHandle;
+    queuedPacket.payloadHandle = LORA_PAYLOAD_UNOWNED;
+    queuedPacket.packet.payload = nullptr;
+    if (handle >= LORA_BACKLOG_HANDLE_BASE) {
+        if (backlogReleaseHandler) {
+            backlogReleaseHandler(backlogContext, handle);
+        }
+    } else if (payloadReleaseHandler) {
+        payloadReleaseHandler(payloadReleaseContext, handle);
+    }
+}
+
+void LoRaManager::spillPacket(const QueuedPacket& queuedPacket) {
+    if (spillHandler && queuedPacket.ackRequired && queuedPacket.packet.payload) {
+        spillHandler(backlogContext, queuedPacket);
+    }
+}
+
+void LoRaManager::setBacklogCallbacks(PacketSpillHandler spill, PayloadReleaseHandler release, void* context) {
+    spillHandler = spill;
+    backlogReleaseHandler = release;
+    backlogContext = context;
+}
+
+// ===========================
+// Latest-value Packets
+// ===========================
+
+void LoRaManager::setFreshnessCallbacks(SupersedeHandler supersede, RetransmitHandler retransmit, void* context) {
+    supersedeHandler = supersede;
+    retransmitHandler = retransmit;
+    freshnessContext = context;
+}
+
+uint32_t LoRaManager::getSupersededCount(Priority priority) const {
+    return priorityQueues[laneIndex(priority)].supersededCount;
+}
+
+bool LoRaManager::supersedeQueued(const QueuedPacket& queuedPacket) {
+    // Only payloads the owner lent are its to judge; backfill is history by
+    // design and never supersedes or is superseded
+    if (!supersedeHandler || queuedPacket.payloadHandle == LORA_PAYLOAD_UNOWNED ||
+        queuedPacket.payloadHandle >= LORA_BACKLOG_HANDLE_BASE) {
+        return false;
+    }
+    
+    // Everything older it makes redundant goes, sent or not: the oldest
+    // one's slot is reused so the new sample keeps its place in the lane,
+    // the rest are released. An in-flight frame may still land - its ACK
+    // then matches nothing
+    PriorityLane& lane = priorityQueues[laneIndex(queuedPacket.priority)];
+    int replaced = -1;
+    for (int i = 0; i < lane.count; i++) {
+        int slot = (lane.head + i) & QUEUE_INDEX_MASK;
+        QueuedPacket& qp = lane.slots[slot];
+        if (qp.released || qp.packet.type != queuedPacket.packet.type ||
+            qp.payloadHandle == LORA_PAYLOAD_UNOWNED || qp.payloadHandle >= LORA_BACKLOG_HANDLE_BASE ||
+            !supersedeHandler(freshnessContext, queuedPacket.packet, qp.packet)) {
+            continue;
+        }
+        
+        if (qp.transmitAttempts > 0) {
+            captureFrame(LinkCaptureKind::DROPPED, qp.packet.sequenceNumber, nullptr);
+            if (arqOutstanding > 0) {
+                arqOutstanding--;
+            }
+        }
+        releasePayload(qp);
+        lane.supersededCount++;
+        if (replaced < 0) {
+            replaced = slot;
+        } else {
+            qp.released = true;
+            lane.pending--;
+        }
+    }
+    if (replaced < 0) {
+        return false;
+    }
+    
+    lane.slots[replaced] = queuedPacket;
+    lane.slots[replaced].released = false;
+    compactLaneHead(lane);
+    
+    LORA_TRACE("%s packet %d superseded older ones", packetTypeToString(queuedPacket.packet.type),
+               queuedPacket.packet.sequenceNumber);
+    return true;
+}
+
+bool LoRaManager::isStaleRetry(const QueuedPacket& queuedPacket, uint32_t now) {
+    if (!retransmitHandler || queuedPacket.transmitAttempts >= MAX_RETRIES ||
+        queuedPacket.payloadHandle == LORA_PAYLOAD_UNOWNED || queuedPacket.payloadHandle >= LORA_BACKLOG_HANDLE_BASE) {
+        return false;
+    }
+    uint32_t ageMs = now - queuedPacket.packet.header.sampledAt;
+    return !retransmitHandler(freshnessContext, queuedPacket.packet, queuedPacket.transmitAttempts, ageMs);
+}
+
+void LoRaManager::setPayloadReleaseCallback(PayloadReleaseHandler handler, void* context) {
+    payloadReleaseHandler = handler;
+    payloadReleaseContext = context;
+}
+
+void LoRaManager::notifyPayload(const QueuedPacket& queuedPacket, PayloadEvent event) {
+    if (queuedPacket.payloadHandle != LORA_PAYLOAD_UNOWNED && queuedPacket.payloadHandle < LORA_BACKLOG_HANDLE_BASE &&
+        payloadEventHandler) {
+        payloadEventHandler(payloadEventContext, queuedPacket.payloadHandle, event);
+    }
+}
+
+void LoRaManager::setPayloadEventCallback(PayloadEventHandler handler, void* context) {
+    payloadEventHandler = handler;
+    payloadEventContext = context;
+}
+
+// ===========================
+// Link Capture
+// ===========================
+
+void LoRaManager::setCaptureSink(LinkCaptureSink sink, void* context) {
+    captureContext = context;
+    captureSink = sink;
+}
+
+// At the rate in use now - a frame received across a rate switch is the
+// one record that can be off
+void LoRaManager::captureFrame(LinkCaptureKind kind, uint16_t sequenceNumber, const RadioEvent* event) {
+    LinkCaptureSink sink = captureSink;
+    if (!sink) {
+        return;
+    }
+    
+    LinkCaptureFrame frame;
+    LinkCaptureHeader& header = frame.header;
+    memset(&header, 0, sizeof(header));
+    header.version = LINK_CAPTURE_VERSION;
+    header.kind = static_cast<uint8_t>(kind);
+    header.link = static_cast<uint8_t>(role);
+    header.flags = fskBitrate ? LINK_CAPTURE_FLAG_FSK : 0;
+    header.spreadingFactor = fskBitrate ? 0 : currentSpreadingFactor;
+    header.codingRate = codingRate;
+    header.txPower = currentTxPower;
+    header.bandwidth = fskBitrate ? fskBitrate : currentBandwidth;
+    header.channel = event ? event->channel : (DEVICE_TYPE == DEVICE_BALLOON ? radioRxChannel : radioChannel);
+    header.sequence = sequenceNumber;
+    header.device = LORA_DEVICE_ID;
+    
+    // The primary link's frequency is configured in MHz, the bulk link's and the hop plan's in Hz
+    if (hoppingEnabled && header.channel != LORA_CHANNEL_FIXED) {
+        header.frequency = hopChannelFrequency(header.channel);
+    } else {
+        header.frequency = frequency < 1.0e6f ? (uint32_t)(frequency * 1.0e6f) : (uint32_t)frequency;
+    }
+    
+    frame.timeUs = Clock().nowUs();
+    frame.data = nullptr;
+    if (event) {
+        frame.timeUs = event->timeUs;
+        frame.data = event->data;
+        header.length = event->length;
+        if (kind == LinkCaptureKind::RX || kind == LinkCaptureKind::RX_CRC_ERROR) {
+            header.rssi = event->rssi;
+            header.snr = fskBitrate ? 0 : event->snr;
+        } else {
+            header.airtimeMs = min(event->airtime, (uint32_t)UINT16_MAX);
+            header.flags |= (event->tracked ? LINK_CAPTURE_FLAG_TRACKED : 0) |
+                            (event->clockSync ? LINK_CAPTURE_FLAG_CLOCK_SYNC : 0);
+        }
+    }
+    sink(captureContext, frame);
+}
+
+void LoRaManager::compactLaneHead(PriorityLane& lane) {
+    // Pop released slots so the head always holds a live packet
+    while (lane.count > 0 && lane.slots[lane.head].released) {
+        lane.head = (lane.head + 1) & QUEUE_INDEX_MASK;
+        lane.count--;
+    }
+}
+
+void LoRaManager::clearQueue() {
+    for (int i = 0; i < NUM_PRIORITY_LANES; i++) {
+        PriorityLane& lane = priorityQueues[i];
+        for (uint16_t n = 0; n < lane.count; n++) {
+            QueuedPacket& qp = lane.slots[(lane.head + n) & QUEUE_INDEX_MASK];
+            if (!qp.released) {
+                releasePayload(qp);
+            }
+        }
+
+        priorityQueues[i].head = 0;
+        priorityQueues[i].count = 0;
+        priorityQueues[i].pending = 0;
+    }
+    arqOutstanding = 0;
+}
+
+int LoRaManager::getQueueSize(Priority priority) const {
+    return priorityQueues[laneIndex(priority)].pending;
+}
+
+int LoRaManager::getTotalQueueSize() const {
+    int total = 0;
+    for (int i = 0; i < NUM_PRIORITY_LANES; i++) {
+        total += priorityQueues[i].pending;
+    }
+    return total;
+}
+
+int LoRaManager::getQueueHighWaterMark(Priority priority) const {
+    return priorityQueues[laneIndex(priority)].highWaterMark;
+}
+
+uint32_t LoRaManager::getQueueDropCount(Priority priority) const {
+    return priorityQueues[laneIndex(priority)].dropCount;
+}
+
+uint32_t LoRaManager::getLaneShareServes(Priority priority) const {
+    return laneShareServes[laneIndex(priority)];
+}
+
+bool LoRaManager::canAccept(Priority priority) const {
+    return priorityQueues[laneIndex(priority)].count < MAX_QUEUE_SIZE;
+}
+
+// ===========================
+// Transmission Methods
+// ===========================
+
+bool LoRaManager::transmitPacket(const Packet& packet, bool clockSync) {
+    // The header format can change between queueing and sending
+    Packet framed = packet;
+    framed.header.version = txHeaderVersion;
+    
+    // Serialize packet straight into the radio frame
+    if (!serializePacket(framed, txFrame.data, txFrame.length)) {
+        LORA_TRACE("Failed to serialize packet");
+        return false;
+    }
+    
+    txFrame.sequenceNumber = packet.sequenceNumber;
+    txFrame.tracked = (packet.type != PacketType::ACK && packet.type != PacketType::NACK);
+    txFrame.clockSync = clockSync;
+    return queueFrame(txFrame);
+}
+
+bool LoRaManager::queueFrame(RadioFrame& frame) {
+    if (!txFrameQueue || !radioTaskHandle) {
+        return false;
+    }
+    
+    uint32_t timeOnAir = getTimeOnAirUs(frame.length);
+    frame.timeOnAirMs = (timeOnAir + 999) / 1000;
+    frame.channel = txChannel();
+    
+    // Hand the frame to the radio task - never blocks the caller
+    if (xQueueSend(txFrameQueue, &frame, 0) != pdTRUE) {
+        LORA_TRACE("Radio TX queue full");
+        return false;
+    }
+    
+    xTaskNotify(radioTaskHandle, RADIO_NOTIFY_TX_FRAME, eSetBits);
+    
+    // Every frame is charged, ACKs included; the bucket may go briefly negative
+    airtimeBucket(frame.channel) -= timeOnAir;
+    airtimeUsedUs += timeOnAir;
+    
+    txFramesPending++;
+    transmitting = true;
+    return true;
+}
+
+void LoRaManager::processRadioEvents() {
+    RadioEvent& event = rxEvent;
+    
+    if (!radioEventQueue) {
+        return;
+    }
+    
+    while (xQueueReceive(radioEventQueue, &event, 0) == pdTRUE) {
+        switch (event.type) {
+            case RadioEventType::TX_DONE: {
+                if (txFramesPending > 0) {
+                    txFramesPending--;
+                }
+                transmitting = (txFramesPending > 0);
+                lastAirtime = event.airtime;
+                framesTransmitted++;
+                if (firstTransmitTime == 0) {
+                    firstTransmitTime = event.timestamp;
+                }
+                
+                // The times the peer's next timestamped ACK is paired with
+                if (event.tracked) {
+                    linkClock.recordTx(event.sequenceNumber, event.timeUs);
+                }
+                if (event.clockSync) {
+                    linkClock.recordExtensionTx(event.timeUs);
+                }
+                
+                // ACK timeout runs from the end of the frame, not from queueing
+                if (event.tracked) {
+                    for (int i = 0; i < inFlightBatchCount; i++) {
+                        Priority priority;
+                        int slot;
+                        QueuedPacket* inFlight = findQueuedPacket(inFlightBatch[i], priority, slot);
+                        if (inFlight && inFlight->waitingForAck) {
+                            inFlight->lastTransmitTime = event.timestamp;
+                        }
+                    }
+                    inFlightBatchCount = 0;
+                }
+                
+                if (ackTurnaround && !transmitting) {
+                    armAckTurnaround(event.timestamp);
+                }
+                
+                // ACKs and commands come back in the window after our frame
+                rxWindowUntil = event.timestamp + LORA_RX_WINDOW_MS;
+                captureFrame(LinkCaptureKind::TX, event.sequenceNumber, event.length ? &event : nullptr);
+                
+                LORA_TRACE("TX done (%lu ms on air)", event.airtime);
+                break;
+            }
+                
+            case RadioEventType::TX_ABORTED:
+                if (txFramesPending > 0) {
+                    txFramesPending--;
+                }
+                transmitting = (txFramesPending > 0);
+                captureFrame(LinkCaptureKind::TX_ABORTED, event.sequenceNumber, nullptr);
+                
+                // Cut off by the emergency beacon - the attempt counts, the ACK wait doesn't
+                if (event.tracked) {
+                    for (int i = 0; i < inFlightBatchCount; i++) {
+                        Priority priority;
+                        int slot;
+                        QueuedPacket* inFlight = findQueuedPacket(inFlightBatch[i], priority, slot);
+                        if (inFlight) {
+                            inFlight->waitingForAck = false;
+                        }
+                    }
+                    inFlightBatchCount = 0;
+                }
+                break;
+                
+            case RadioEventType::EMERGENCY_DONE: {
+                // Outside the airtime scheduler, but still on the bill
+                uint32_t timeOnAir = event.airtime * 1000;
+                airtimeBucket(txChannel()) -= timeOnAir;
+                airtimeUsedUs += timeOnAir;
+                framesTransmitted++;
+                rxWindowUntil = event.timestamp + LORA_RX_WINDOW_MS;
+                captureFrame(LinkCaptureKind::BEACON, event.sequenceNumber, event.length ? &event : nullptr);
+                break;
+            }
+                
+            case RadioEventType::TX_TIMEOUT:
+                if (txFramesPending > 0) {
+                    txFramesPending--;
+                }
+                transmitting = (txFramesPending > 0);
+                transmitErrorCount++;
+                captureFrame(LinkCaptureKind::TX_TIMEOUT, event.sequenceNumber, nullptr);
+                
+                LORA_TRACE("TX done interrupt timed out");
+                break;
+                
+            case RadioEventType::RX_DONE:
+                if (rxFrameFilter && rxFrameFilter(rxFilterContext, event)) {
+                    break;  // Comes back through receiveFrame() when its turn comes
+                }
+                receiveFrame(event);
+                break;
+                
+            case RadioEventType::RX_ERROR:
+                crcErrorCount++;
+                captureFrame(LinkCaptureKind::RX_CRC_ERROR, 0, &event);
+                
+                LORA_TRACE("Radio reported payload CRC error");
+                break;
+        }
+    }
+}
+
+void LoRaManager::setRxFrameFilter(RxFrameFilter filter, void* context) {
+    rxFilterContext = context;
+    rxFrameFilter = filter;
+}
+
+void LoRaManager::receiveFrame(const RadioEvent& event) {
+    rxWindowUntil = event.timestamp + LORA_RX_WINDOW_MS;  // A command may have more behind it
+    handleReceivedFrame(event);
+}
+
+void LoRaManager::handleReceivedFrame(const RadioEvent& event) {
+    Packet packet;
+    
+    // Update signal quality (receive side) - FSK reports no SNR, and the ADR
+    // history is for the LoRa rate anyway
+    lastRssi = event.rssi;
+    if (!fskBitrate) {
+        lastSnr = event.snr;
+        updateSignalQuality(lastRssi, lastSnr);
+    }
+    lastReceiveTime = event.timestamp;
+    framesReceived++;
+    
+    if (onFrameTapCallback) {
+        onFrameTapCallback(event);
+    }
+    captureFrame(LinkCaptureKind::RX, 0, &event);
+    
+    // Deserialize packet - payload points into the event buffer
+    if (!deserializePacket(event.data, event.length, packet)) {
+        receiveErrorCount++;
+        
+        LORA_TRACE("Failed to deserialize packet");
+        return;
+    }
+    
+    // A sealed frame is opened where it lies - the payload view is decrypted in place
+    bool intact;
+    if (isFrameSealed(event.data, event.length)) {
+        intact = LinkAuthMgr().open(packet.header.deviceId, event.data, event.length,
+                                    packet.payload, packet.payloadLength);
+    } else if (LINK_AUTH_ENABLED) {
+        LinkAuthMgr().notePlainFrame();
+        intact = false;
+    } else {
+        intact = verifyFrameCRC(event.data, event.length);
+    }
+    if (!intact) {
+        crcErrorCount++;
+        
+        LORA_TRACE("CRC validation failed");
+        return;
+    }
+    
+    packet.rssi = lastRssi;
+    packet.snr = lastSnr;
+    packet.valid = true;
+    packet.header.latency.rxAt = event.timestamp;
+    packet.header.latency.airtimeUs = getTimeOnAirUs(event.length);
+    
+    hopLastRxChannel = event.channel;
+    hopDwellPhase = 0;
+    hopDwellStart = event.timestamp;
+    
+    // Remember which slots are in use so the base station knows when to listen
+    uint8_t slot = packet.header.deviceId % LORA_TDMA_SLOT_COUNT;
+    tdmaSlotLastHeard[slot] = event.timestamp;
+    tdmaSlotsHeard |= (1UL << slot);
+    
+    // The RX-done our next timestamped ACK reports
+    if (packet.type != PacketType::ACK && packet.type != PacketType::NACK) {
+        linkClock.recordRx(packet.sequenceNumber, event.timeUs);
+    }
+    
+    // Header negotiation - compact only while the peer says it understands it
+    uint8_t peerVersion = (packet.header.version >= LORA_HEADER_V2 && LORA_COMPACT_HEADER)
+                          ? LORA_HEADER_V2 : LORA_HEADER_V1;
+    if (peerVersion != txHeaderVersion) {
+        txHeaderVersion = peerVersion;
+        LORA_TRACE("Switched to header v%d", txHeaderVersion);
+    }
+    
+    LORA_TRACE("Received packet (Type: %s, RSSI: %d dBm, SNR: %d dB)",
+               packetTypeToString(packet.type), lastRssi, lastSnr);
+    
+    // Handle special packet types
+    switch (packet.type) {
+        case PacketType::ACK:
+            handleAck(packet, event.timeUs);
+            break;
+            
+        case PacketType::NACK:
+            handleNack(packet);
+            break;
+            
+        case PacketType::AGGREGATE:
+            handleAggregate(packet);
+            break;
+            
+        case PacketType::RATE_CHANGE:
+            // Only ACKed when accepted, so the initiator never switches alone;
+            // never held, the switch waits for this ACK to leave
+            if (handleRateChange(packet) && autoAckEnabled) {
+                recordReceivedSequence(packet.sequenceNumber);
+                sendHeldAck();
+            }
+            break;
+            
+        case PacketType::CAMERA_THUMB:
+        case PacketType::CAMERA_FULL:
+            if (packet.header.flags & LORA_FLAG_FEC_CHUNK) {
+                handleFecChunk(packet);  // Recovered from parity, never ACKed
+                continueAckRun(packet.header.flags & LORA_FLAG_MORE);
+                break;
+            }
+            deliverPacket(packet);
+            if (autoAckEnabled) {
+                scheduleAck(packet.header.flags & LORA_FLAG_MORE);
+            }
+            break;
+            
+        case PacketType::FRAGMENT:
+            deliverPacket(packet);  // Sent without ARQ - the transfer's bitmap ACK covers it
+            continueAckRun(packet.header.flags & LORA_FLAG_MORE);
+            break;
+            
+        default:
+            deliverPacket(packet);
+            if (autoAckEnabled) {
+                scheduleAck(packet.header.flags & LORA_FLAG_MORE);
+            }
+            break;
+    }
+    
+    // An ACK just queued still goes out on this channel; listen on the next
+    // one after it. A held one moves the channel when it goes
+    if (DEVICE_TYPE == DEVICE_BASE_STATION && autoAckEnabled && rxWindowValid && !ackHeld) {
+        updateHopKey(rxNewestSequence);
+    }
+}
+
+void LoRaManager::handleAggregate(const Packet& aggregate) {
+    size_t offset = 0;
+    int records = 0;
+    
+    // Split back into the original packets; they share the outer header
+    while (offset + LORA_AGGREGATE_RECORD_HEADER <= aggregate.payloadLength) {
+        Packet member = aggregate;
+        member.type = static_cast<PacketType>(aggregate.payload[offset]);
+        member.sequenceNumber = (aggregate.payload[offset + 1] << 8) | aggregate.payload[offset + 2];
+        member.payloadLength = aggregate.payload[offset + 3];
+        offset += LORA_AGGREGATE_RECORD_HEADER;
+        
+        // Each record's own stamp; the receive side is the frame's
+        if (aggregate.header.flags & LORA_FLAG_TIMING) {
+            size_t stampLength = decodeLatencyStamp(aggregate.payload + offset, aggregate.payloadLength - offset,
+                                                    member.header.latency);
+            if (stampLength == 0) {
+                receiveErrorCount++;
+                break;
+            }
+            member.header.latency.rxAt = aggregate.header.latency.rxAt;
+            member.header.latency.airtimeUs = aggregate.header.latency.airtimeUs;
+            offset += stampLength;
+        }
+        
+        member.payload = aggregate.payload + offset;
+        offset += member.payloadLength;
+        
+        if (offset > aggregate.payloadLength) {
+            receiveErrorCount++;
+            
+            LORA_TRACE("Truncated aggregate record");
+            break;
+        }
+        
+        if (member.header.flags & LORA_FLAG_FEC_CHUNK) {
+            handleFecChunk(member);
+            continue;
+        }
+        
+        // The peer's held ACK, riding in front of its own records
+        if (member.type == PacketType::ACK) {
+            handleAck(member, 0);
+            continue;
+        }
+        
+        if (member.type == PacketType::RATE_CHANGE) {
+            if (handleRateChange(member)) {
+                if (autoAckEnabled) {
+                    recordReceivedSequence(member.sequenceNumber);
+                }
+                records++;
+            }
+            continue;
+        }
+        
+        deliverPacket(member);
+        records++;
+    }
+    
+    LORA_TRACE("Aggregate frame carried %d record(s)", records);
+    
+    // One selective ACK covers every record in the frame - right away if a
+    // rate change is among them, the switch waits for it
+    if (autoAckEnabled && records > 0) {
+        if (rateChangeState == RateChangeState::SWITCHING) {
+            sendHeldAck();
+        } else {
+            scheduleAck(aggregate.header.flags & LORA_FLAG_MORE);
+        }
+    } else {
+        continueAckRun(aggregate.header.flags & LORA_FLAG_MORE);
+    }
+}
+
+void LoRaManager::deliverPacket(const Packet& packet) {
+    if (autoAckEnabled) {
+        recordReceivedSequence(packet.sequenceNumber);
+    }
+    
+    // Regular data packets are handled by the application layer
+    if (onPacketReceivedCallback) {
+        onPacketReceivedCallback(packet);
+    }
+}
+
+// ===========================
+// Camera FEC Transfer
+// ===========================
+
+bool LoRaManager::startCameraTransfer(PacketType type, const uint8_t* data, size_t length) {
+    // Queued chunks point into the encoder, so one image at a time
+    if (cameraTransferActive) {
+        LORA_TRACE("Camera transfer already in progress, image skipped");
+        return false;
+    }
+    
+    if (!cameraEncoder.encode(nextImageId, data, length, cameraParityChunks())) {
+        return false;
+    }
+    
+    nextImageId++;
+    cameraTransferType = type;
+    cameraNextChunk = 0;
+    cameraTransferActive = true;
+    
+    pumpCameraTransfer();
+    return true;
+}
+
+void LoRaManager::pumpCameraTransfer() {
+    if (!cameraTransferActive) {
+        return;
+    }
+    
+    // Keep half the camera lane free so plain camera packets are not crowded out
+    PriorityLane& lane = priorityQueues[laneIndex(Priority::CAMERA)];
+    while (cameraNextChunk < cameraEncoder.getChunkCount() && lane.count < MAX_QUEUE_SIZE / 2) {
+        size_t chunkLength;
+        const uint8_t* chunk = cameraEncoder.getChunk(cameraNextChunk, chunkLength);
+        
+        Packet packet = createPacket(cameraTransferType, chunk, chunkLength);
+        packet.header.flags |= LORA_FLAG_FEC_CHUNK;
+        sendPacket(packet, Priority::CAMERA, false);
+        cameraNextChunk++;
+    }
+    
+    // Done once every chunk has left the queue (handed off or dropped)
+    if (cameraNextChunk >= cameraEncoder.getChunkCount() && !cameraChunksQueued()) {
+        LORA_TRACE("Camera image %d sent (%d FEC chunks)",
+                   cameraEncoder.getImageId(), (int)cameraEncoder.getChunkCount());
+        cameraEncoder.release();
+        cameraTransferActive = false;
+    }
+}
+
+bool LoRaManager::cameraChunksQueued() const {
+    const PriorityLane& lane = priorityQueues[laneIndex(Priority::CAMERA)];
+    for (int i = 0; i < lane.count; i++) {
+        const QueuedPacket& qp = lane.slots[(lane.head + i) & QUEUE_INDEX_MASK];
+        if (!qp.released && !qp.ackRequired) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LoRaManager::handleFecChunk(const Packet& chunk) {
+    if (onLinkPacketCallback) {
+        onLinkPacketCallback(chunk);
+    }
+    
+    FecChunkHeader header;
+    if (!parseFecChunkHeader(chunk.payload, chunk.payloadLength, header)) {
+        receiveErrorCount++;
+        return;
+    }
+    
+    bool alreadyComplete = cameraDecoder.isComplete() && cameraDecoder.getImageId() == header.imageId;
+    if (!cameraDecoder.addChunk(chunk.payload, chunk.payloadLength)) {
+        receiveErrorCount++;
+        
+        LORA_TRACE("Rejected FEC chunk");
+        return;
+    }
+    
+    if (!alreadyComplete && cameraDecoder.isComplete()) {
+        size_t imageLength;
+        const uint8_t* image = cameraDecoder.getImage(imageLength);
+        
+        LORA_TRACE("Camera image %d rebuilt (%d bytes, %lu chunks recovered)",
+                   header.imageId, (int)imageLength, cameraDecoder.getChunksRecovered());
+        
+        if (onImageReceivedCallback) {
+            onImageReceivedCallback(header.imageId, image, imageLength);
+        }
+    }
+}
+
+// ===========================
+// Radio Engine
+// ===========================
+
+bool LoRaManager::startRadioTask() {
+    if (radioTaskHandle) {
+        return true;
+    }
+    
+    radioMutex = xSemaphoreCreateMutex();
+    txFrameQueue = xQueueCreate(LORA_RADIO_TX_QUEUE_LEN, sizeof(RadioFrame));
+    radioEventQueue = xQueueCreate(LORA_RADIO_EVENT_QUEUE_LEN, sizeof(RadioEvent));
+    
+    if (!radioMutex || !txFrameQueue || !radioEventQueue) {
+        stopRadioTask();
+        return false;
+    }
+    
+    BaseType_t created = createPlacedTask(radioTaskId, radioTaskEntry, this, &radioTaskHandle);
+    if (created != pdPASS) {
+        radioTaskHandle = nullptr;
+        stopRadioTask();
+        return false;
+    }
+    if (localLoads) {
+        Watchdog().watch(radioTaskId, radioTaskHandle, TASK_BUDGET_RADIO_MS);
+    }
+    
+    radio->attachIrq(radioIrqEntry, this);
+    
+    lockRadio();
+    radioStartReceive();
+    unlockRadio();
+    
+    return true;
+}
+
+void LoRaManager::stopRadioTask() {
+    if (radioTaskHandle) {
+        radio->detachIrq();
+        
+        // Make sure the task is not in the middle of an SPI transaction
+        lockRadio();
+        if (localLoads) {
+            Watchdog().unwatch(radioTaskId);
+        }
+        vTaskDelete(radioTaskHandle);
+        radioTaskHandle = nullptr;
+        unlockRadio();
+    }
+    
+    if (txFrameQueue) {
+        vQueueDelete(txFrameQueue);
+        txFrameQueue = nullptr;
+    }
+    
+    if (radioEventQueue) {
+        vQueueDelete(radioEventQueue);
+        radioEventQueue = nullptr;
+    }
+    
+    if (radioMutex) {
+        vSemaphoreDelete(radioMutex);
+        radioMutex = nullptr;
+    }
+    
+    setRadioState(RadioState::IDLE);
+    radioTxFramePending = false;
+    txFramesPending = 0;
+}
+
+void LoRaManager::radioTaskEntry(void* parameter) {
+    static_cast<LoRaManager*>(parameter)->radioTaskLoop();
+}
+
+void LoRaManager::radioTaskLoop() {
+    for (;;) {
+        if (localLoads) {
+            Watchdog().beat(radioTaskId);
+        }
+        
+        // Wake in time for the end of a listen-before-talk backoff
+        TickType_t wait = pdMS_TO_TICKS(LORA_RADIO_POLL_MS);
+        if (radioTxFramePending) {
+            int32_t remaining = (int32_t)(lbtBackoffUntil - millis());
+            if (remaining > 0 && remaining < LORA_RADIO_POLL_MS) {
+                wait = pdMS_TO_TICKS(remaining) + 1;
+            }
+        }
+        if (emergencyActive) {
+            int32_t remaining = (int32_t)(emergencyNextAt - millis());
+            if (remaining > 0 && pdMS_TO_TICKS(remaining) + 1 < wait) {
+                wait = pdMS_TO_TICKS(remaining) + 1;
+            }
+        }
+        
+        uint32_t notifyBits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notifyBits, wait);
+        
+        lockRadio();
+        
+        if (notifyBits & RADIO_NOTIFY_DIO0) {
+            radioHandleDio0();
+        }
+        
+        // The beacon goes ahead of everything, whatever the radio is doing
+        if ((notifyBits & RADIO_NOTIFY_EMERGENCY) ||
+            (emergencyActive && (int32_t)(millis() - emergencyNextAt) >= 0)) {
+            radioSendEmergency();
+        }
+        
+        // Recover if the TX_DONE interrupt never arrives
+        if (radioState == RadioState::TRANSMITTING &&
+            millis() - radioTxStartTime > radioTxDeadline) {
+            RadioEvent event;
+            event.type = radioTxEmergency ? RadioEventType::EMERGENCY_DONE : RadioEventType::TX_TIMEOUT;
+            event.timestamp = millis();
+            event.airtime = event.timestamp - radioTxStartTime;
+            event.sequenceNumber = radioTxSequence;
+            event.tracked = radioTxTracked;
+            event.length = 0;
+            postRadioEvent(event);
+            radioTxEmergency = false;
+            radioStartReceive();
+        }
+        
+        // Same for a CAD that never completes
+        if (radioState == RadioState::CHANNEL_SCAN &&
+            millis() - lbtScanStart > LORA_LBT_CAD_TIMEOUT_MS) {
+            radioChannelBusy();
+        }
+        
+        // Start the next frame once the channel is ours again
+        if (radioState == RadioState::RECEIVING || radioState == RadioState::IDLE) {
+            if (!radioTxFramePending && xQueueReceive(txFrameQueue, &radioTxFrame, 0) == pdTRUE) {
+                radioTxFramePending = true;
+                lbtAttempts = 0;
+                lbtBackoffUntil = millis();
+                if ((int32_t)(radioQuietUntil - lbtBackoffUntil) > 0) {
+                    lbtBackoffUntil = radioQuietUntil;
+                }
+            }
+            
+            // A capture holding the battery keeps the frame back a little
+            if (radioTxFramePending && (int32_t)(millis() - lbtBackoffUntil) >= 0 && localLoads &&
+                Arbiter().claim(txLoad, transmitCurrentMa(currentTxPower)) == ArbiterDecision::REFUSED) {
+                lbtBackoffUntil = millis() + ARBITER_RETRY_MS;
+                arbiterDeferrals = arbiterDeferrals + 1;
+            }
+            
+            if (radioTxFramePending && (int32_t)(millis() - lbtBackoffUntil) >= 0) {
+                // CAD only detects LoRa preambles - an FSK burst goes straight out
+                bool listen = lbtEnabled && fskBitrate == 0;
+                if (listen && lbtAttempts < LORA_LBT_MAX_ATTEMPTS) {
+                    radioStartChannelScan();
+                } else {
+                    if (listen) {
+                        lbtForcedTransmits = lbtForcedTransmits + 1;
+                    }
+                    radioSendPendingFrame();
+                }
+            }
+        }
+        
+        unlockRadio();
+    }
+}
+
+void LoRaManager::radioStartChannelScan() {
+    radioTune(radioTxFrame.channel);
+    radio->startChannelScan();
+    lbtScanStart = millis();
+    lbtScans = lbtScans + 1;
+    setRadioState(RadioState::CHANNEL_SCAN);
+}
+
+void LoRaManager::radioChannelBusy() {
+    lbtAttempts++;
+    lbtBusyCount = lbtBusyCount + 1;
+    
+    // Binary exponential backoff, randomized over the upper half of the window
+    uint32_t window = LORA_LBT_BACKOFF_MIN_MS << min((int)lbtAttempts - 1, 8);
+    if (window > LORA_LBT_BACKOFF_MAX_MS) {
+        window = LORA_LBT_BACKOFF_MAX_MS;
+    }
+    uint32_t backoff = window / 2 + random(window / 2 + 1);
+    lbtBackoffUntil = millis() + backoff;
+    lbtBackoffTotalMs = lbtBackoffTotalMs + backoff;
+    
+    // Listen while we wait - the busy channel may be a frame for us
+    radioStartReceive();
+}
+
+void LoRaManager::radioSendPendingFrame() {
+    int busyScans = min((int)lbtAttempts, 3);
+    lbtBusyHistogram[busyScans] = lbtBusyHistogram[busyScans] + 1;
+    radioTxFramePending = false;
+    radioTxEmergency = false;
+    radioStartTransmit(radioTxFrame);
+}
+
+void LoRaManager::radioStartTransmit(const RadioFrame& frame) {
+    radioTxSequence = frame.sequenceNumber;
+    radioTxTracked = frame.tracked;
+    radioTxClockSync = frame.clockSync;
+    radioTxDeadline = frame.timeOnAirMs + LORA_TX_DONE_TIMEOUT_MS;
+    radioTxCurrent = &frame;
+    
+    // A fixed frame shorter than the profile's length still keeps the peer
+    // demodulating to the end of it
+    uint8_t fixedBytes = fixedFrameBytes;
+    radioTxTailMs = 0;
+    if (fixedBytes && frame.length < fixedBytes - 1u) {
+        radioTxTailMs = (getTimeOnAirUs(fixedBytes - 1) - getTimeOnAirUs(frame.length) + 999) / 1000;
+    }
+    
+    // The balloon waits for its ACK where it transmitted
+    if (DEVICE_TYPE == DEVICE_BALLOON) {
+        radioRxChannel = frame.channel;
+    }
+    
+    radio->idle();
+    radioTune(frame.channel);
+    
+    // On a battery near brownout the burst goes out quieter rather than reset the board
+    int power = localLoads ? Arbiter().capTxPower(currentTxPower, transmitCurrentMa) : currentTxPower;
+    if (power != radioTxPower) {
+        radio->setTxPower(power);
+        radioTxPower = power;
+        if (localLoads) {
+            Energy().setActiveCurrent(txLoad, transmitCurrentMa(power));
+        }
+    }
+    
+    radioTxStartTime = millis();
+    setRadioState(RadioState::TRANSMITTING);
+    radio->startTransmit(frame.data, frame.length);
+}
+
+void LoRaManager::radioHandleDio0() {
+    RadioEvent event;
+    event.timestamp = millis();
+    
+    // The frame ended when the interrupt fired, not when this task got to it
+    int64_t irqTimeUs = radio->getIrqTimeUs();
+    event.timeUs = esp_timer_get_time();
+    if (irqTimeUs > 0) {
+        event.timestamp -= (uint32_t)((event.timeUs - irqTimeUs) / 1000);
+        event.timeUs = irqTimeUs;
+    }
+    event.airtime = 0;
+    event.sequenceNumber = 0;
+    event.tracked = false;
+    event.clockSync = false;
+    event.rssi = -128;
+    event.snr = -128;
+    event.length = 0;
+    event.channel = radioChannel;
+    
+    RadioIrq irq = radio->serviceIrq(event.data, MAX_PACKET_SIZE, event.length,
+                                     event.rssi, event.snr);
+    
+    if (radioState == RadioState::CHANNEL_SCAN) {
+        if (irq == RadioIrq::CAD_DETECTED) {
+            radioChannelBusy();
+        } else {
+            radioSendPendingFrame();
+        }
+        return;
+    }
+    
+    if (radioState == RadioState::TRANSMITTING && irq == RadioIrq::TX_DONE) {
+        event.type = radioTxEmergency ? RadioEventType::EMERGENCY_DONE : RadioEventType::TX_DONE;
+        event.airtime = event.timestamp - radioTxStartTime;
+        event.sequenceNumber = radioTxSequence;
+        event.tracked = radioTxTracked;
+        event.clockSync = radioTxClockSync;
+        // The frame still sits in radioTxFrame or emergencyFrame - nothing
+        // replaces either until the radio is idle again
+        if (captureSink && radioTxCurrent) {
+            event.length = radioTxCurrent->length;
+            memcpy(event.data, radioTxCurrent->data, event.length);
+        }
+        postRadioEvent(event);
+        radioTxEmergency = false;
+        radioQuietUntil = event.timestamp + radioTxTailMs;
+    } else if (radioState == RadioState::RECEIVING &&
+               (irq == RadioIrq::RX_DONE || irq == RadioIrq::RX_CRC_ERROR)) {
+        event.type = irq == RadioIrq::RX_DONE ? RadioEventType::RX_DONE : RadioEventType::RX_ERROR;
+        postRadioEvent(event);
+    }
+    
+    radioStartReceive();
+}
+
+void LoRaManager::setRadioState(RadioState state) {
+    radioState = state;
+    
+    // The ledger's view of the radio: airtime at the TX power, listening, or asleep
+    if (localLoads) {
+        Energy().setActive(txLoad, state == RadioState::TRANSMITTING);
+        Energy().setActive(rxLoad, state == RadioState::RECEIVING || state == RadioState::CHANNEL_SCAN);
+        
+        // The loop claimed ahead of the scan; the beacon claims whatever is drawing
+        if (state == RadioState::TRANSMITTING) {
+            Arbiter().claim(txLoad, transmitCurrentMa(radioTxPower), true);
+        } else if (state != RadioState::CHANNEL_SCAN) {
+            Arbiter().release(txLoad);
+        }
+    }
+    radioPowerLock.hold(state == RadioState::RECEIVING || state == RadioState::CHANNEL_SCAN ||
+                        state == RadioState::TRANSMITTING);
+}
+
+void LoRaManager::radioStartReceive() {
+    radioTune(radioRxChannel);
+    radio->startReceive();
+    setRadioState(RadioState::RECEIVING);
+}
+
+void LoRaManager::radioTune(uint8_t channel) {
+    if (channel == radioChannel || channel == LORA_CHANNEL_FIXED) {
+        return;
+    }
+    
+    radio->setFrequency(hopChannelFrequency(channel));
+    radioChannel = channel;
+}
+
+void LoRaManager::postRadioEvent(const RadioEvent& event) {
+    if (xQueueSend(radioEventQueue, &event, 0) != pdTRUE) {
+        // Consumer is behind - drop the oldest event to keep the newest
+        RadioEvent discarded;
+        xQueueReceive(radioEventQueue, &discarded, 0);
+        xQueueSend(radioEventQueue, &event, 0);
+    }
+}
+
+void LoRaManager::lockRadio() {
+    if (radioMutex) {
+        xSemaphoreTake(radioMutex, portMAX_DELAY);
+    }
+}
+
+void LoRaManager::unlockRadio() {
+    if (radioMutex) {
+        xSemaphoreGive(radioMutex);
+    }
+}
+
+// ===========================
+// ACK/NACK Handling
+// ===========================
+
+void LoRaManager::handleAck(const Packet& ack, int64_t rxUs) {
+    if (ack.payloadLength < 4) {
+        return;  // Invalid ACK packet
+    }
+    
+    uint16_t ackSequence = (ack.payload[0] << 8) | ack.payload[1];
+    uint8_t ackType = ack.payload[2];
+    int8_t rssi = static_cast<int8_t>(ack.payload[3]);
+    ackTimeoutStreak = 0;
+    ackTurnaround = false;
+    
+    // Clock sync extension after the ACK proper
+    size_t ackSize = (ackType == LORA_ACK_TYPE_SELECTIVE && ack.payloadLength >= 8) ? 8 : 4;
+    if (ack.payloadLength >= ackSize + LINK_CLOCK_EXT_SIZE) {
+        linkClock.readExtension(ack.header.deviceId, ack.payload + ackSize, ack.payloadLength - ackSize, rxUs);
+    }
+    
+    // The base station now listens on the channel of the newest sequence it has
+    if (DEVICE_TYPE == DEVICE_BALLOON) {
+        hopResync = false;
+        updateHopKey(ackSequence);
+    }
+    int acknowledged = acknowledgeSequence(ackSequence) ? 1 : 0;
+    
+    // Selective ACK - every set bit confirms an older sequence number
+    if (ackType == LORA_ACK_TYPE_SELECTIVE && ack.payloadLength >= 8) {
+        uint32_t bitmap = ((uint32_t)ack.payload[4] << 24) | ((uint32_t)ack.payload[5] << 16) |
+                          ((uint32_t)ack.payload[6] << 8) | ack.payload[7];
+        for (int bit = 0; bitmap != 0 && bit < LORA_ACK_BITMAP_BITS; bit++, bitmap >>= 1) {
+            if ((bitmap & 1) && acknowledgeSequence(ackSequence - 1 - bit)) {
+                acknowledged++;
+            }
+        }
+    }
+    
+    if (acknowledged > 0) {
+        recordLinkOutcome(true, acknowledged);
+        LORA_TRACE("%d packet(s) acknowledged up to %d (Type: %d)",
+                   acknowledged, ackSequence, ackType);
+        
+        // Adapt transmission settings based on signal quality
+        adaptTransmissionSettings(rssi, ack.snr);
+        return;
+    }
+    
+    LORA_TRACE("ACK received for unknown packet %d", ackSequence);
+}
+
+void LoRaManager::handleNack(const Packet& nack) {
+    if (nack.payloadLength < 3) {
+        return;  // Invalid NACK packet
+    }
+    
+    uint16_t nackSequence = (nack.payload[0] << 8) | nack.payload[1];
+    uint8_t nackType = nack.payload[2];
+    
+    // Find the corresponding packet and make it eligible for retransmission
+    Priority priority;
+    int slot;
+    QueuedPacket* qp = findQueuedPacket(nackSequence, priority, slot);
+    if (qp && qp->waitingForAck) {
+        qp->waitingForAck = false;
+        recordLinkOutcome(false);
+        
+        LORA_TRACE("Packet %d NACK received (Type: %d)", nackSequence, nackType);
+    }
+}
+
+void LoRaManager::sendAck(uint16_t sequenceNumber, uint8_t ackType, int8_t rssi, int8_t snr) {
+    uint8_t payload[4 + LINK_CLOCK_EXT_SIZE];
+    payload[0] = (sequenceNumber >> 8) & 0xFF;
+    payload[1] = sequenceNumber & 0xFF;
+    payload[2] = ackType;
+    payload[3] = static_cast<uint8_t>(rssi);
+    
+    bool clockSync = role == LinkRole::PRIMARY && linkClock.wantsExtension(millis());
+    size_t length = 4 + (clockSync ? linkClock.writeExtension(&payload[4], millis()) : 0);
+    Packet ackPacket = createPacket(PacketType::ACK, payload, length);
+    ackPacket.header.rssiAvg = getAverageRSSI();
+    ackPacket.header.snrAvg = getAverageSNR();
+    
+    transmitPacket(ackPacket, clockSync);
+}
+
+void LoRaManager::sendSelectiveAck(uint16_t newestSequence, uint32_t bitmap, int8_t rssi) {
+    uint8_t payload[LORA_SELECTIVE_ACK_SIZE + LINK_CLOCK_EXT_SIZE];
+    encodeSelectiveAck(newestSequence, bitmap, rssi, payload);
+    
+    bool clockSync = role == LinkRole::PRIMARY && linkClock.wantsExtension(millis());
+    size_t length = LORA_SELECTIVE_ACK_SIZE +
+                    (clockSync ? linkClock.writeExtension(&payload[LORA_SELECTIVE_ACK_SIZE], millis()) : 0);
+    Packet ackPacket = createPacket(PacketType::ACK, payload, length);
+    ackPacket.header.rssiAvg = getAverageRSSI();
+    ackPacket.header.snrAvg = getAverageSNR();
+    
+    transmitPacket(ackPacket, clockSync);
+}
+
+void LoRaManager::scheduleAck(bool moreFollow) {
+    uint32_t now = millis();
+    if (!ackHeld) {
+        ackHeldFrames = 0;
+    }
+    ackHeld = true;
+    ackHeldFrames++;
+    
+    // The sender has another frame right behind this one - answering now
+    // would only collide with it. One ACK covers the run, LORA_ACK_HOLD_MS
+    // after the last frame at the latest in case the rest never comes
+    if (LORA_ACK_DELAY_ENABLED && moreFollow && !tdmaEnabled && ackHeldFrames < LORA_ARQ_WINDOW_SIZE) {
+        ackDueAt = now + LORA_ACK_HOLD_MS;
+        ackFramesHeld++;
+        return;
+    }
+    
+    // Run over: processQueue() sends it next, on a frame of ours if one is going
+    ackDueAt = now;
+}
+
+// A frame sent without ARQ in the middle of a run: nothing to ACK in it,
+// but a held ACK waits for the end of the run all the same
+void LoRaManager::continueAckRun(bool moreFollow) {
+    if (!ackHeld) {
+        return;
+    }
+    bool hold = LORA_ACK_DELAY_ENABLED && moreFollow && !tdmaEnabled;
+    ackDueAt = millis() + (hold ? LORA_ACK_HOLD_MS : 0);
+}
+
+// The peer's selective ACK on air, plus the longest it may hold one for the
+// rest of a run in case the frame that ended it was lost
+uint32_t LoRaManager::ackTurnaroundMs() const {
+    size_t ackBytes = fixedFrameBytes ? fixedFrameCapacity()
+                                      : frameHeaderSize(txHeaderVersion) + LORA_SELECTIVE_ACK_SIZE +
+                                        LINK_CLOCK_EXT_SIZE + LORA_FRAME_TRAILER_BYTES;
+    return getTimeOnAirUs(ackBytes) / 1000 + LORA_ACK_HOLD_MS;
+}
+
+void LoRaManager::armAckTurnaround(uint32_t frameEnd) {
+    ackTurnaroundFrom = frameEnd + ackTurnaroundHoldMs;
+    ackTurnaroundUntil = ackTurnaroundFrom + ackTurnaroundMs();
+}
+
+void LoRaManager::sendHeldAck() {
+    sendSelectiveAck(rxNewestSequence, rxSequenceBitmap, lastRssi);
+    acksSent++;
+    ackSent();
+}
+
+void LoRaManager::ackSent() {
+    ackHeld = false;
+    ackHeldFrames = 0;
+    
+    // The sender moves on to the channel of the newest sequence once it has this
+    if (DEVICE_TYPE == DEVICE_BASE_STATION && rxWindowValid) {
+        updateHopKey(rxNewestSequence);
+    }
+}
+
+void LoRaManager::recordReceivedSequence(uint16_t sequenceNumber) {
+    if (!rxWindowValid) {
+        rxNewestSequence = sequenceNumber;
+        rxSequenceBitmap = 0;
+        rxWindowValid = true;
+        return;
+    }
+    
+    int16_t delta = static_cast<int16_t>(sequenceNumber - rxNewestSequence);
+    
+    if (delta > 0) {
+        // Newer frame - slide the window forward
+        if (delta > LORA_ACK_BITMAP_BITS) {
+            rxSequenceBitmap = 0;
+        } else {
+            rxSequenceBitmap = (delta == LORA_ACK_BITMAP_BITS) ? 0 : (rxSequenceBitmap << delta);
+            rxSequenceBitmap |= (1UL << (delta - 1));
+        }
+        rxNewestSequence = sequenceNumber;
+    } else if (delta < 0 && -delta <= LORA_ACK_BITMAP_BITS) {
+        // Older frame filling a gap (retransmission)
+        rxSequenceBitmap |= (1UL << (-delta - 1));
+    }
+}
+
+void LoRaManager::sendNack(uint16_t sequenceNumber, uint8_t nackType) {
+    uint8_t payload[3];
+    payload[0] = (sequenceNumber >> 8) & 0xFF;
+    payload[1] = sequenceNumber & 0xFF;
+    payload[2] = nackType;
+    
+    Packet nackPacket = createPacket(PacketType::NACK, payload, 3);
+    nackPacket.header.rssiAvg = getAverageRSSI();
+    nackPacket.header.snrAvg = getAverageSNR();
+    
+    transmitPacket(nackPacket);
+}
+
+// ===========================
+// Adaptive Transmission
+// ===========================
+
+void LoRaManager::adaptTransmissionSettings(int8_t rssi, int8_t snr) {
+    // rssi is how the peer hears us; snr is the local sample of its frame
+    peerRssi = rssi;
+    adaptTransmissionSettings();
+}
+
+void LoRaManager::adaptTransmissionSettings() {
+    // The balloon leads rate changes; the base station follows RATE_CHANGE requests
+    if (!adaptiveModeEnabled || DEVICE_TYPE != DEVICE_BALLOON ||
+        rateChangeState != RateChangeState::IDLE || fskBitrate) {
+        return;
+    }
+    
+    float margin;
+    if (!estimateLinkMargin(margin)) {
+        return;  // Not enough evidence at the current rate yet
+    }
+    
+    // Frames going missing at a good SNR (interference, fading between samples)
+    // still cost airtime - count each expected retransmission against the margin
+    LinkRate current = currentLinkRate();
+    margin -= LINK_QUALITY_PENALTY_DB * (getExpectedTransmissions() - 1.0f);
+    
+    LinkRate pick = chooseLinkRate(margin);
+    bool sameDataRate = pick.spreadingFactor == current.spreadingFactor &&
+                        pick.bandwidth == current.bandwidth &&
+                        pick.codingRate == current.codingRate;
+    
+    if (sameDataRate && pick.txPower == current.txPower) {
+        adrCandidateCount = 0;
+        return;
+    }
+    
+    // Require the same answer several evaluations in a row
+    if (pick.spreadingFactor != adrCandidate.spreadingFactor || pick.bandwidth != adrCandidate.bandwidth ||
+        pick.codingRate != adrCandidate.codingRate || pick.txPower != adrCandidate.txPower) {
+        adrCandidate = pick;
+        adrCandidateCount = 0;
+    }
+    adrCandidateCount++;
+    
+    uint32_t pickAirtime = calculateTimeOnAirUs(MAX_PACKET_SIZE, pick.spreadingFactor, pick.bandwidth,
+                                                pick.codingRate, preambleLength);
+    bool slower = pickAirtime > getTimeOnAirUs(MAX_PACKET_SIZE) ||
+                  (sameDataRate && pick.txPower > current.txPower);
+    if (adrCandidateCount < (slower ? LORA_ADR_STABLE_SLOWER : LORA_ADR_STABLE_FASTER)) {
+        return;
+    }
+    adrCandidateCount = 0;
+    
+    LORA_TRACE("ADR margin %.1f dB -> SF:%d BW:%ld CR:4/%d Power:%d",
+               margin, pick.spreadingFactor, pick.bandwidth, pick.codingRate, pick.txPower);
+    
+    // Power is local to this end; only the modulation has to match the peer
+    if (sameDataRate) {
+        setTxPower(pick.txPower);
+        return;
+    }
+    
+    // The frame format carries over to the new rate
+    pick.fixedFrameBytes = current.fixedFrameBytes;
+    pick.preambleLength = current.preambleLength;
+    requestRateChange(pick);
+}
+
+bool LoRaManager::estimateLinkMargin(float& margin) const {
+    int samples = min((int)signalSamples, (int)SIGNAL_HISTORY_SIZE);
+    if (samples < LORA_ADR_MIN_SAMPLES) {
+        return false;
+    }
+    
+    // Walk back over the samples taken at the current rate
+    float snrSum = 0;
+    float rssiSum = 0;
+    for (int i = 1; i <= samples; i++) {
+        int index = (snrIndex - i + SIGNAL_HISTORY_SIZE) % SIGNAL_HISTORY_SIZE;
+        snrSum += snrHistory[index];
+        rssiSum += rssiHistory[(rssiIndex - i + SIGNAL_HISTORY_SIZE) % SIGNAL_HISTORY_SIZE];
+    }
+    float snrMean = snrSum / samples;
+    float rssiMean = rssiSum / samples;
+    
+    // Fading allowance - mean absolute deviation of the SNR window
+    float deviation = 0;
+    for (int i = 1; i <= samples; i++) {
+        deviation += fabsf(snrHistory[(snrIndex - i + SIGNAL_HISTORY_SIZE) % SIGNAL_HISTORY_SIZE] - snrMean);
+    }
+    float snrWorst = snrMean - deviation / samples;
+    
+    float floorDb = demodulatorFloorDb(currentSpreadingFactor);
+    margin = snrWorst - floorDb;
+    
+    // SNR saturates on strong links; RSSI over sensitivity shows the real headroom,
+    // taking the worse of the two directions
+    if (snrWorst >= LORA_ADR_SNR_SATURATION_DB) {
+        float sensitivity = -174.0f + 10.0f * log10f((float)currentBandwidth) +
+                            LORA_ADR_NOISE_FIGURE_DB + floorDb;
+        float rssiWorst = (peerRssi > -128 && peerRssi < rssiMean) ? peerRssi : rssiMean;
+        margin = max(margin, rssiWorst - sensitivity);
+    }
+    
+    return true;
+}
+
+LinkRate LoRaManager::chooseLinkRate(float margin) const {
+    static const long bandwidths[] = {125000, 250000, 500000};
+    static const int codingRates[] = {5, 8};
+    
+    LinkRate current = currentLinkRate();
+    uint32_t currentAirtime = getTimeOnAirUs(MAX_PACKET_SIZE);
+    LinkRate best = {LORA_ADR_RENDEZVOUS_SF, LORA_ADR_RENDEZVOUS_BW, LORA_ADR_RENDEZVOUS_CR, 20, 0, 0, 0};
+    uint32_t bestAirtime = UINT32_MAX;
+    
+    for (int sf = 7; sf <= 12; sf++) {
+        for (long bw : bandwidths) {
+            if (bw > LORA_ADR_MAX_BANDWIDTH) {
+                continue;
+            }
+            
+            for (int cr : codingRates) {
+                uint32_t airtime = calculateTimeOnAirUs(MAX_PACKET_SIZE, sf, bw, cr, preambleLength);
+                
+                // Margin this combination would have at the current power
+                float candidateMargin = margin +
+                    (demodulatorFloorDb(current.spreadingFactor) - demodulatorFloorDb(sf)) +
+                    10.0f * log10f((float)current.bandwidth / (float)bw) +
+                    (cr - current.codingRate) * LORA_ADR_CR_GAIN_DB;
+                
+                // Going faster or quieter needs the hysteresis on top; backing off does not
+                bool faster = airtime < currentAirtime;
+                float required = LORA_ADR_MARGIN_DB + (faster ? LORA_ADR_HYSTERESIS_DB : 0.0f);
+                int power = current.txPower + (int)ceilf(required - candidateMargin);
+                if (!faster && power < current.txPower) {
+                    int quieter = current.txPower + (int)ceilf(required + LORA_ADR_HYSTERESIS_DB - candidateMargin);
+                    power = min(quieter, current.txPower);
+                }
+                power = max(power, 2);
+                
+                if (power > 20) {
+                    continue;  // Cannot close the link this fast
+                }
+                
+                // Not back to a faster rate that recently lost frames whatever its margin says
+                if (faster && linkQuality.isKnown(sf, bw, cr, millis()) &&
+                    linkQuality.getDeliveryRatio(sf, bw, cr, millis()) < LINK_QUALITY_AVOID_RATIO) {
+                    continue;
+                }
+                
+                if (airtime < bestAirtime || (airtime == bestAirtime && power < best.txPower)) {
+                    best = {sf, bw, cr, power, 0, 0, 0};
+                    bestAirtime = airtime;
                 }
-                
-                return;
             }
         }
     }
+    
+    return best;
 }
 
-void LoRaManager::sendAck(uint16_t sequenceNumber, uint8_t ackType, int8_t rssi, int8_t snr) {
-    uint8_t payload[4];
-    payload[0] = (sequenceNumber >> 8) & 0xFF;
-    payload[1] = sequenceNumber & 0xFF;
-    payload[2] = ackType;
-    payload[3] = static_cast<uint8_t>(rssi);
+LinkRate LoRaManager::currentLinkRate() const {
+    return {currentSpreadingFactor, currentBandwidth, codingRate, currentTxPower, fskBitrate, fixedFrameBytes,
+            (uint8_t)(preambleLength == LORA_PREAMBLE_LEN ? 0 : preambleLength)};
+}
+
+// ===========================
+// Link Quality
+// ===========================
+
+void LoRaManager::recordLinkOutcome(bool delivered, int count) {
+    uint32_t now = millis();
+    for (int i = 0; i < count; i++) {
+        linkQuality.recordOutcome(qualitySpreadingFactor(), currentBandwidth, codingRate, delivered, now);
+    }
+}
+
+float LoRaManager::getExpectedTransmissions() const {
+    return linkQuality.getEtx(qualitySpreadingFactor(), currentBandwidth, codingRate, millis());
+}
+
+int LoRaManager::aggregateLimit() const {
+    // A lost aggregate loses every record in it - pack fewer as losses rise
+    float etx = getExpectedTransmissions();
+    int limit = (int)(LORA_MAX_AGGREGATE_RECORDS / etx + 0.5f);
+    return constrain(limit, 1, LORA_MAX_AGGREGATE_RECORDS);
+}
+
+uint8_t LoRaManager::cameraParityChunks() const {
+    if (!linkQuality.isKnown(qualitySpreadingFactor(), currentBandwidth, codingRate, millis())) {
+        return LORA_FEC_PARITY_CHUNKS;
+    }
     
-    Packet ackPacket = createPacket(PacketType::ACK, payload, 4);
-    ackPacket.header.rssiAvg = getAverageRSSI();
-    ackPacket.header.snrAvg = getAverageSNR();
+    // Enough parity that K + M chunks at the current delivery ratio still
+    // leave K on average, plus one for the spread around it
+    float etx = getExpectedTransmissions();
+    int parity = (int)ceilf(LORA_FEC_DATA_CHUNKS * (etx - 1.0f)) + 1;
+    parity = constrain(parity, LORA_FEC_PARITY_MIN, LORA_FEC_PARITY_MAX);
+    return (uint8_t)min(parity, FEC_MAX_GROUP_CHUNKS - LORA_FEC_DATA_CHUNKS);
+}
+
+bool LoRaManager::requestRateChange(const LinkRate& rate) {
+    // [sf 1][bandwidth kHz 2][coding rate 1], then [FSK kbps 2] for a burst
+    // (the LoRa rate is the one to return to), then [fixed frame bytes 1]
+    // [preamble symbols 1] for the implicit header profile; kept in a
+    // member, queued packets don't own payloads
+    uint16_t bandwidthKhz = rate.bandwidth / 1000;
+    uint16_t fskKbps = rate.fskBitrate / 1000;
+    rateChangePayload[0] = rate.spreadingFactor;
+    rateChangePayload[1] = (bandwidthKhz >> 8) & 0xFF;
+    rateChangePayload[2] = bandwidthKhz & 0xFF;
+    rateChangePayload[3] = rate.codingRate;
+    rateChangePayload[4] = (fskKbps >> 8) & 0xFF;
+    rateChangePayload[5] = fskKbps & 0xFF;
+    rateChangePayload[6] = rate.fixedFrameBytes;
+    rateChangePayload[7] = rate.preambleLength;
+    
+    size_t length = (rate.fixedFrameBytes || rate.preambleLength) ? 8 : (fskKbps ? 6 : 4);
+    rateChangeSequence = nextSequenceNumber;
+    Packet request = createPacket(PacketType::RATE_CHANGE, rateChangePayload, length);
+    if (!sendPacket(request, Priority::GPS)) {
+        return false;
+    }
+    
+    pendingRate = rate;
+    rateChangeState = RateChangeState::REQUESTED;
+    return true;
+}
+
+bool LoRaManager::handleRateChange(const Packet& request) {
+    if (onLinkPacketCallback) {
+        onLinkPacketCallback(request);
+    }
+    
+    if (!adaptiveModeEnabled || request.payloadLength < 4) {
+        return false;
+    }
+    
+    LinkRate rate;
+    rate.spreadingFactor = request.payload[0];
+    rate.bandwidth = (long)((request.payload[1] << 8) | request.payload[2]) * 1000;
+    rate.codingRate = request.payload[3];
+    rate.txPower = currentTxPower;  // Our own power is not negotiated
+    rate.fskBitrate = request.payloadLength >= 6 ? (uint32_t)((request.payload[4] << 8) | request.payload[5]) * 1000 : 0;
+    rate.fixedFrameBytes = request.payloadLength >= 8 ? request.payload[6] : 0;
+    rate.preambleLength = request.payloadLength >= 8 ? request.payload[7] : 0;
+    
+    if (rate.spreadingFactor < 6 || rate.spreadingFactor > 12 ||
+        rate.codingRate < 5 || rate.codingRate > 8 || rate.bandwidth == 0) {
+        return false;
+    }
+    
+    // Left unACKed, the initiator stays on LoRa and backs off
+    if (rate.fskBitrate && (!LORA_FSK_BURST_ENABLED || !radio->supportsFsk())) {
+        return false;
+    }
+    if (rate.fixedFrameBytes && (!LORA_FIXED_FRAMES_ENABLED || !radio->supportsImplicitHeader() || rate.fskBitrate ||
+                                 rate.fixedFrameBytes < LORA_FIXED_FRAME_MIN_BYTES ||
+                                 rate.fixedFrameBytes > MAX_PACKET_SIZE)) {
+        return false;
+    }
+    if (rate.preambleLength && rate.preambleLength < 6) {
+        return false;
+    }
+    
+    // Applied once the ACK for this request has left the radio
+    pendingRate = rate;
+    rateChangeState = RateChangeState::SWITCHING;
+    
+    LORA_TRACE("Peer requested SF:%d BW:%ld CR:4/%d FSK:%lu bps Fixed:%u bytes",
+               rate.spreadingFactor, rate.bandwidth, rate.codingRate, (unsigned long)rate.fskBitrate,
+               rate.fixedFrameBytes);
+    return true;
+}
+
+void LoRaManager::applyLinkRate(const LinkRate& rate) {
+    if (rate.spreadingFactor != currentSpreadingFactor) {
+        setSpreadingFactor(rate.spreadingFactor);
+    }
+    if (rate.bandwidth != currentBandwidth) {
+        setBandwidth(rate.bandwidth);
+    }
+    if (rate.codingRate != codingRate) {
+        setCodingRate(rate.codingRate);
+    }
+    if (rate.txPower != currentTxPower) {
+        setTxPower(rate.txPower);
+    }
+    if (rate.fskBitrate != fskBitrate) {
+        lockRadio();
+        bool switched = radio->setFskMode(rate.fskBitrate);
+        unlockRadio();
+        if (switched) {
+            fskBitrate = rate.fskBitrate;
+        }
+        if (switched && fskBitrate) {
+            fskBurstStart = millis();
+            fskBursts++;
+        }
+        LORA_TRACE("%s %s", fskBitrate ? "FSK burst" : "Back to LoRa", switched ? "" : "failed");
+    }
+    int preamble = rate.preambleLength ? rate.preambleLength : LORA_PREAMBLE_LEN;
+    if (rate.fixedFrameBytes != fixedFrameBytes || preamble != preambleLength) {
+        lockRadio();
+        radio->setPreambleLength(preamble);
+        bool switched = radio->setImplicitHeader(rate.fixedFrameBytes);
+        unlockRadio();
+        preambleLength = preamble;
+        if (switched && rate.fixedFrameBytes != fixedFrameBytes) {
+            fixedFrameBytes = rate.fixedFrameBytes;
+            if (fixedFrameBytes) {
+                fixedFramesStart = millis();
+                fixedFrameSessions++;
+            }
+        }
+        LORA_TRACE("%s, preamble %d %s", fixedFrameBytes ? "Fixed frames" : "Explicit header",
+                   preambleLength, switched ? "" : "failed");
+    }
+    
+    // Old samples describe the old rate - gather fresh evidence
+    memset(rssiHistory, 0, sizeof(rssiHistory));
+    memset(snrHistory, 0, sizeof(snrHistory));
+    signalSamples = 0;
+    adrCandidateCount = 0;
+    ackTimeoutStreak = 0;
+    rateChangeTime = millis();
+    rateChanges++;
+}
+
+void LoRaManager::checkLinkFallback() {
+    if (!adaptiveModeEnabled || transmitting || rateChangeState != RateChangeState::IDLE) {
+        return;
+    }
+    
+    // A burst that stopped getting through ends on each side alone, back to
+    // the LoRa rate it started from
+    if (fskBitrate) {
+        uint32_t now = millis();
+        bool lost = min(now - lastReceiveTime, now - rateChangeTime) >= LORA_FSK_IDLE_MS &&
+                    (DEVICE_TYPE != DEVICE_BALLOON || ackTimeoutStreak >= LORA_FSK_FALLBACK_TIMEOUTS);
+        if (lost) {
+            LORA_TRACE("FSK burst lost, back to LoRa");
+            LinkRate lora = currentLinkRate();
+            lora.fskBitrate = 0;
+            applyLinkRate(lora);
+            fskBackoffUntil = now + LORA_FSK_BACKOFF_MS;
+            fskBurstFailures++;
+        }
+        return;
+    }
+    
+    // Same for the fixed-frame profile, back to the explicit header at the same rate
+    if (fixedFrameBytes) {
+        uint32_t now = millis();
+        bool lost = min(now - lastReceiveTime, now - rateChangeTime) >= LORA_FIXED_IDLE_MS &&
+                    (DEVICE_TYPE != DEVICE_BALLOON || ackTimeoutStreak >= LORA_FIXED_FALLBACK_TIMEOUTS);
+        if (lost) {
+            LORA_TRACE("Fixed frames lost, back to the explicit header");
+            LinkRate explicitHeader = currentLinkRate();
+            explicitHeader.fixedFrameBytes = 0;
+            explicitHeader.preambleLength = 0;
+            applyLinkRate(explicitHeader);
+            fixedBackoffUntil = now + LORA_FIXED_BACKOFF_MS;
+            fixedFrameFailures++;
+        }
+        return;
+    }
+    
+    if (currentSpreadingFactor == LORA_ADR_RENDEZVOUS_SF &&
+        currentBandwidth == LORA_ADR_RENDEZVOUS_BW && codingRate == LORA_ADR_RENDEZVOUS_CR) {
+        return;
+    }
+    
+    // Nothing heard since the last frame or switch, and on the balloon ACK
+    // rounds going unanswered too. Both ends wait out the same silence, so
+    // they reach the rendezvous settings together
+    uint32_t now = millis();
+    uint32_t silence = min(now - lastReceiveTime, now - rateChangeTime);
+    if (silence < LORA_ADR_FALLBACK_MS) {
+        return;
+    }
+    if (DEVICE_TYPE == DEVICE_BALLOON && ackTimeoutStreak < LORA_ADR_FALLBACK_TIMEOUTS) {
+        return;
+    }
+    
+    LORA_TRACE("Link lost, falling back to rendezvous settings");
+    
+    applyLinkRate({LORA_ADR_RENDEZVOUS_SF, LORA_ADR_RENDEZVOUS_BW, LORA_ADR_RENDEZVOUS_CR,
+                   DEVICE_TYPE == DEVICE_BALLOON ? 20 : currentTxPower, 0, 0, 0});
+    rateFallbacks++;
+}
+
+// ===========================
+// FSK Burst
+// ===========================
+
+void LoRaManager::updateFskBurst() {
+    // The balloon leads; the base station follows its RATE_CHANGE requests
+    if (DEVICE_TYPE != DEVICE_BALLOON || !adaptiveModeEnabled || rateChangeState != RateChangeState::IDLE) {
+        return;
+    }
+    
+    uint32_t now = millis();
+    bool urgent = emergencyActive;
+    for (int i = laneIndex(Priority::EMERGENCY); i <= laneIndex(Priority::TELEMETRY); i++) {
+        urgent = urgent || priorityQueues[i].pending > 0;
+    }
+    LinkRate lora = currentLinkRate();
+    lora.fskBitrate = 0;
+    lora.fixedFrameBytes = 0;   // Images never fit a fixed frame
+    lora.preambleLength = 0;
+    
+    // Back to LoRa as soon as anything but images wants the air, the images
+    // are out, or the burst has had its time
+    if (fskBitrate) {
+        if (urgent || fskBurstFrames() == 0 || now - fskBurstStart >= LORA_FSK_BURST_MAX_MS) {
+            requestRateChange(lora);
+        }
+        return;
+    }
+    
+    if (!LORA_FSK_BURST_ENABLED || !radio->supportsFsk() || urgent || (int32_t)(now - fskBackoffUntil) < 0 ||
+        fskBurstFrames() < LORA_FSK_BURST_MIN_FRAMES) {
+        return;
+    }
+    
+    // The LoRa rate has to be delivering almost everything, and the last
+    // burst must not have been losing frames
+    if (!linkQuality.isKnown(currentSpreadingFactor, currentBandwidth, codingRate, now) ||
+        getExpectedTransmissions() > LORA_FSK_BURST_MAX_ETX) {
+        return;
+    }
+    if (linkQuality.isKnown(LINK_QUALITY_FSK_SF, 0, 0, now) &&
+        linkQuality.getDeliveryRatio(LINK_QUALITY_FSK_SF, 0, 0, now) < LINK_QUALITY_AVOID_RATIO) {
+        return;
+    }
+    
+    float margin;
+    if (!estimateLinkMargin(margin) || fskMarginDb(margin) < LORA_FSK_BURST_MARGIN_DB) {
+        return;
+    }
+    
+    LinkRate burst = lora;
+    burst.fskBitrate = LORA_FSK_BITRATE;
+    if (requestRateChange(burst)) {
+        LORA_TRACE("FSK margin %.1f dB, %d camera frames - requesting a %lu bps burst",
+                   fskMarginDb(margin), (int)fskBurstFrames(), (unsigned long)burst.fskBitrate);
+    }
+}
+
+size_t LoRaManager::fskBurstFrames() const {
+    // Camera frames queued, and FEC chunks still to feed in
+    size_t frames = priorityQueues[laneIndex(Priority::CAMERA)].pending;
+    if (cameraTransferActive && cameraNextChunk < cameraEncoder.getChunkCount()) {
+        frames += cameraEncoder.getChunkCount() - cameraNextChunk;
+    }
+    return frames;
+}
+
+float LoRaManager::fskMarginDb(float loraMargin) const {
+    // The LoRa margin moved to the FSK receiver's sensitivity: its noise
+    // bandwidth is twice the bit rate and it wants LORA_FSK_REQUIRED_SNR_DB
+    // where LoRa demodulates below the noise
+    float loraSensitivity = 10.0f * log10f((float)currentBandwidth) + demodulatorFloorDb(currentSpreadingFactor);
+    float fskSensitivity = 10.0f * log10f(2.0f * LORA_FSK_BITRATE) + LORA_FSK_REQUIRED_SNR_DB;
+    return loraMargin - (fskSensitivity - loraSensitivity);
+}
+
+// ===========================
+// Fixed-Frame Profile
+// ===========================
+
+void LoRaManager::updateFixedFrames() {
+    // The balloon leads, as for rate changes and bursts
+    if (DEVICE_TYPE != DEVICE_BALLOON || !adaptiveModeEnabled || rateChangeState != RateChangeState::IDLE ||
+        fskBitrate) {
+        return;
+    }
+    
+    uint32_t now = millis();
+    LinkRate rate = currentLinkRate();
+    
+    // Back to the explicit header for anything that doesn't fit - images,
+    // status text, a long command reply - and now and then regardless, so
+    // what the base station has queued too long for the profile gets out
+    if (fixedFrameBytes) {
+        if (fskBurstFrames() > 0 || !queuedFramesFit(fixedFrameCapacity()) ||
+            now - fixedFramesStart >= LORA_FIXED_MAX_MS) {
+            rate.fixedFrameBytes = 0;
+            rate.preambleLength = 0;
+            requestRateChange(rate);
+        }
+        return;
+    }
+    
+    if (!LORA_FIXED_FRAMES_ENABLED || !radio->supportsImplicitHeader() ||
+        (int32_t)(now - fixedBackoffUntil) < 0 || now - rateChangeTime < LORA_FIXED_HOLD_MS) {
+        return;
+    }
+    
+    // Only telemetry-sized traffic, on a rate that is delivering - a lost
+    // profile costs the fallback timeouts on both ends
+    if (fskBurstFrames() > 0 || !queuedFramesFit(LORA_FIXED_FRAME_BYTES - 1)) {
+        return;
+    }
+    if (!linkQuality.isKnown(currentSpreadingFactor, currentBandwidth, codingRate, now) ||
+        getExpectedTransmissions() > LORA_FIXED_MAX_ETX) {
+        return;
+    }
+    
+    rate.fixedFrameBytes = LORA_FIXED_FRAME_BYTES;
+    rate.preambleLength = LORA_FIXED_PREAMBLE_LEN;
+    if (requestRateChange(rate)) {
+        LORA_TRACE("Requesting fixed %d byte frames, preamble %d",
+                   LORA_FIXED_FRAME_BYTES, LORA_FIXED_PREAMBLE_LEN);
+    }
+}
+
+bool LoRaManager::queuedFramesFit(size_t capacity) const {
+    for (int i = 0; i < NUM_PRIORITY_LANES; i++) {
+        const PriorityLane& lane = priorityQueues[i];
+        for (int j = 0; j < lane.count; j++) {
+            const QueuedPacket& qp = lane.slots[(lane.head + j) & QUEUE_INDEX_MASK];
+            if (!qp.released && serializedPacketSize(qp.packet) > capacity) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void LoRaManager::enableAdaptiveMode(bool enable) {
+    adaptiveModeEnabled = enable;
+    adrCandidateCount = 0;
+    
+    LORA_TRACE("Adaptive data rate %s", enable ? "enabled" : "disabled");
+}
+
+bool LoRaManager::isAdaptiveModeEnabled() const {
+    return adaptiveModeEnabled;
+}
+
+// ===========================
+// Signal Quality Monitoring
+// ===========================
+
+void LoRaManager::updateSignalQuality(int8_t rssi, int8_t snr) {
+    // Update RSSI history
+    rssiHistory[rssiIndex] = rssi;
+    rssiIndex = (rssiIndex + 1) % SIGNAL_HISTORY_SIZE;
+    
+    // Update SNR history
+    snrHistory[snrIndex] = snr;
+    snrIndex = (snrIndex + 1) % SIGNAL_HISTORY_SIZE;
+    
+    lastRssi = rssi;
+    lastSnr = snr;
+    
+    if (signalSamples < 0xFF) {
+        signalSamples++;
+    }
+}
+
+int8_t LoRaManager::getAverageRSSI() const {
+    int32_t sum = 0;
+    int count = 0;
+    
+    for (int i = 0; i < SIGNAL_HISTORY_SIZE; i++) {
+        if (rssiHistory[i] != 0) {
+            sum += rssiHistory[i];
+            count++;
+        }
+    }
+    
+    return (count > 0) ? (sum / count) : -128;
+}
+
+int8_t LoRaManager::getAverageSNR() const {
+    int32_t sum = 0;
+    int count = 0;
+    
+    for (int i = 0; i < SIGNAL_HISTORY_SIZE; i++) {
+        if (snrHistory[i] != 0) {
+            sum += snrHistory[i];
+            count++;
+        }
+    }
+    
+    return (count > 0) ? (sum / count) : -128;
+}
+
+float LoRaManager::getPacketErrorRate() const {
+    return 1.0f - linkQuality.getDeliveryRatio(qualitySpreadingFactor(), currentBandwidth, codingRate, millis());
+}
+
+// ===========================
+// Time on Air
+// ===========================
+
+float LoRaManager::getTransmitCurrentMa() const {
+    return transmitCurrentMa(currentTxPower);
+}
+
+uint32_t LoRaManager::getTimeOnAirUs(size_t frameBytes) const {
+    if (fskBitrate) {
+        return calculateFskTimeOnAirUs(frameBytes, fskBitrate);
+    }
+    
+    // Fixed frames go out as a length byte and the frame, nothing else
+    if (frameBytes < fixedFrameBytes) {
+        return calculateTimeOnAirUs(frameBytes + 1, currentSpreadingFactor, currentBandwidth,
+                                    codingRate, preambleLength, true);
+    }
+    return calculateTimeOnAirUs(frameBytes, currentSpreadingFactor, currentBandwidth,
+                                codingRate, preambleLength);
+}
+
+uint32_t LoRaManager::telemetryCycleAirtimeUs() const {
+    // One cycle = telemetry + GPS + status frames at the current settings
+    return getTimeOnAirUs(MAX_TELEMETRY_SIZE) +
+           getTimeOnAirUs(MAX_GPS_SIZE) +
+           getTimeOnAirUs(MAX_STATUS_SIZE);
+}
+
+uint32_t LoRaManager::getTransmitInterval(uint32_t baseInterval) const {
+    uint32_t cycleAirtimeUs = telemetryCycleAirtimeUs();
+    
+    // Interval at which that cycle stays inside the duty cycle
+    uint32_t dutyInterval = (uint32_t)(((uint64_t)cycleAirtimeUs + LORA_DUTY_CYCLE_PERMILLE - 1) /
+                                       LORA_DUTY_CYCLE_PERMILLE);
+    
+    // Hopping spreads the cycle over every channel's budget
+    if (hoppingEnabled) {
+        dutyInterval /= LORA_HOP_CHANNEL_COUNT;
+    }
+    
+    return (dutyInterval > baseInterval) ? dutyInterval : baseInterval;
+}
+
+size_t LoRaManager::getBulkByteBudget(uint32_t periodMs, size_t payloadPerFrame, size_t overheadPerFrame) const {
+    if (payloadPerFrame == 0) {
+        return 0;
+    }
+    
+    // PERMILLE microseconds accrue per millisecond, on every channel when hopping
+    uint64_t availableUs = (uint64_t)periodMs * LORA_DUTY_CYCLE_PERMILLE;
+    if (hoppingEnabled) {
+        availableUs *= LORA_HOP_CHANNEL_COUNT;
+    }
+    
+    // Telemetry cycles that fall inside the period go first
+    uint32_t interval = getTransmitInterval();
+    uint64_t telemetryUs = (uint64_t)telemetryCycleAirtimeUs() * ((periodMs + interval - 1) / interval);
+    if (telemetryUs >= availableUs) {
+        return 0;
+    }
+    
+    uint32_t frameUs = getTimeOnAirUs(frameHeaderSize(txHeaderVersion) + overheadPerFrame + payloadPerFrame +
+                                      LORA_FRAME_TRAILER_BYTES);
+    return frameUs ? (size_t)((availableUs - telemetryUs) / frameUs) * payloadPerFrame : 0;
+}
+
+// ===========================
+// Frequency Hopping
+// ===========================
+
+void LoRaManager::enableHopping(bool enable) {
+    hoppingEnabled = enable;
+    hopKeyValid = false;
+    hopResync = false;
+    setReceiveChannel(enable ? LORA_HOP_HOME_CHANNEL : LORA_CHANNEL_FIXED);
+    
+    if (!enable) {
+        lockRadio();
+        radio->setFrequency(frequency);
+        radioChannel = LORA_CHANNEL_FIXED;
+        unlockRadio();
+    }
+}
+
+uint8_t LoRaManager::txChannel() const {
+    if (!hoppingEnabled) {
+        return LORA_CHANNEL_FIXED;
+    }
+    
+    // Base station answers on the channel the balloon is listening on
+    if (DEVICE_TYPE == DEVICE_BASE_STATION) {
+        return hopLastRxChannel;
+    }
     
-    transmitPacket(ackPacket);
+    if (!hopKeyValid || hopResync) {
+        return LORA_HOP_HOME_CHANNEL;
+    }
+    return hopChannelForSequence(hopKey);
 }
 
-void LoRaManager::sendNack(uint16_t sequenceNumber, uint8_t nackType) {
-    uint8_t payload[3];
-    payload[0] = (sequenceNumber >> 8) & 0xFF;
-    payload[1] = sequenceNumber & 0xFF;
-    payload[2] = nackType;
+void LoRaManager::updateHopKey(uint16_t key) {
+    if (!hoppingEnabled || (hopKeyValid && key == hopKey)) {
+        return;
+    }
     
-    Packet nackPacket = createPacket(PacketType::NACK, payload, 3);
-    nackPacket.header.rssiAvg = getAverageRSSI();
-    nackPacket.header.snrAvg = getAverageSNR();
+    hopPreviousKey = hopKeyValid ? hopKey : key;
+    hopKey = key;
+    hopKeyValid = true;
+    hopChanges++;
     
-    transmitPacket(nackPacket);
+    if (DEVICE_TYPE == DEVICE_BASE_STATION) {
+        hopDwellPhase = 0;
+        hopDwellStart = millis();
+        setReceiveChannel(hopChannelForSequence(hopKey));
+    }
 }
 
-// ===========================
-// Adaptive Transmission
-// ===========================
+void LoRaManager::setReceiveChannel(uint8_t channel) {
+    lockRadio();
+    radioRxChannel = channel;
+    if (radioState == RadioState::RECEIVING) {
+        radioStartReceive();  // Otherwise applied when the radio returns to RX
+    }
+    unlockRadio();
+}
 
-void LoRaManager::adaptTransmissionSettings(int8_t rssi, int8_t snr) {
-    if (!ENABLE_ADAPTIVE_SF) {
+void LoRaManager::updateHopDwell() {
+    if (!hoppingEnabled || !hopKeyValid || transmitting ||
+        millis() - hopDwellStart < LORA_HOP_DWELL_MS) {
         return;
     }
     
-    bool settingsChanged = false;
+    // Nothing heard - our last ACK may have been lost (balloon still on the
+    // previous channel) or the balloon gave up and went home. Try each in turn
+    hopDwellPhase = (hopDwellPhase + 1) % 3;
+    hopDwellStart = millis();
     
-    // Adapt spreading factor based on signal quality
-    if (rssi > ADAPTIVE_SF_HIGH_THRESHOLD && currentSpreadingFactor > 7) {
-        // Good signal, use faster spreading factor
-        setSpreadingFactor(currentSpreadingFactor - 1);
-        settingsChanged = true;
-    } else if (rssi < ADAPTIVE_SF_LOW_THRESHOLD && currentSpreadingFactor < 12) {
-        // Poor signal, use more robust spreading factor
-        setSpreadingFactor(currentSpreadingFactor + 1);
-        settingsChanged = true;
+    uint8_t channel = LORA_HOP_HOME_CHANNEL;
+    if (hopDwellPhase == 0) {
+        channel = hopChannelForSequence(hopKey);
+    } else if (hopDwellPhase == 1) {
+        channel = hopChannelForSequence(hopPreviousKey);
+    }
+    setReceiveChannel(channel);
+}
+
+uint32_t LoRaManager::getAvailableAirtimeUs() const {
+    int32_t tokens = airtimeTokensUs[txChannel() == LORA_CHANNEL_FIXED ? 0 : txChannel()];
+    return tokens > 0 ? tokens : 0;
+}
+
+// ===========================
+// Time-Slotted Transmission
+// ===========================
+
+bool LoRaManager::gpsTimeSynced() const {
+    TimeReference reference = Clock().getReference();
+    return reference.updates > 0 && Clock().nowUs() - reference.localUs < (int64_t)LORA_TDMA_SYNC_MAX_AGE_MS * 1000;
+}
+
+bool LoRaManager::isTimeSynced() const {
+    // The base station's own clock is the link's, so it never slots on it
+    return gpsTimeSynced() || (DEVICE_TYPE == DEVICE_BALLOON && linkClock.isSynced());
+}
+
+bool LoRaManager::networkTimeMs(uint64_t& now) const {
+    int64_t timeUs;
+    if (gpsTimeSynced() && Clock().utcNowUs(timeUs)) {
+        now = (uint64_t)(timeUs / 1000);
+        return true;
     }
     
-    if (settingsChanged && DEBUG_LORA) {
-        Serial.printf("LoRa: Adapted settings - SF:%d (RSSI:%d, SNR:%d)\n",
-                     currentSpreadingFactor, rssi, snr);
+    // No GPS - the base station's clock, as measured over the ACKs
+    if (DEVICE_TYPE == DEVICE_BALLOON && linkClock.toPeer(Clock().nowUs(), timeUs) && timeUs >= 0) {
+        now = (uint64_t)(timeUs / 1000);
+        return true;
     }
+    return false;
 }
 
-void LoRaManager::enableAdaptiveMode(bool enable) {
-    // This would enable/disable adaptive transmission
-    // Implementation depends on specific requirements
+uint32_t LoRaManager::getSlotLengthMs() const {
+    // A full-size frame plus its selective ACK, guarded at both edges
+    uint32_t ackBytes = frameHeaderSize(LORA_HEADER_V1) + 8 + LORA_FRAME_TRAILER_BYTES;
+    uint32_t airtimeMs = (getTimeOnAirUs(MAX_PACKET_SIZE) + getTimeOnAirUs(ackBytes) + 999) / 1000;
+    uint32_t slotMs = airtimeMs + 2 * LORA_TDMA_GUARD_MS;
+    
+    // Round up to 10 ms so both ends land on the same boundaries
+    return (slotMs + 9) / 10 * 10;
 }
 
-bool LoRaManager::isAdaptiveModeEnabled() const {
-    return ENABLE_ADAPTIVE_SF;
+uint32_t LoRaManager::msUntilSlot(uint8_t slot, uint32_t& remainingMs) const {
+    uint64_t now;
+    remainingMs = 0;
+    if (!networkTimeMs(now)) {
+        return 0;
+    }
+    
+    uint32_t slotMs = getSlotLengthMs();
+    uint32_t frameMs = slotMs * LORA_TDMA_SLOT_COUNT;
+    uint32_t position = (uint32_t)(now % frameMs);
+    uint32_t slotStart = slot * slotMs;
+    
+    if (position >= slotStart && position < slotStart + slotMs) {
+        remainingMs = slotStart + slotMs - position;
+        return 0;
+    }
+    
+    return (slotStart + frameMs - position) % frameMs;
 }
 
-// ===========================
-// Signal Quality Monitoring
-// ===========================
+bool LoRaManager::tdmaSlotOpen(size_t frameBytes) {
+    // Without GPS time the fleet is unslotted and we fall back to plain ALOHA.
+    // The base station answers inside the slot it is replying to
+    if (!tdmaEnabled || DEVICE_TYPE == DEVICE_BASE_STATION || !isTimeSynced()) {
+        return true;
+    }
+    
+    uint32_t remainingMs;
+    uint32_t waitMs = msUntilSlot(getSlotIndex(), remainingMs);
+    uint32_t ackBytes = frameHeaderSize(LORA_HEADER_V1) + 8 + LORA_FRAME_TRAILER_BYTES;
+    uint32_t neededMs = (getTimeOnAirUs(frameBytes) + getTimeOnAirUs(ackBytes) + 999) / 1000 +
+                        LORA_TDMA_GUARD_MS + (rxWindowAsleep ? LORA_RX_WAKEUP_MS : 0);
+    
+    // Skip the leading guard too - the previous slot owner may run late
+    uint32_t slotMs = getSlotLengthMs();
+    bool open = waitMs == 0 && remainingMs <= slotMs - LORA_TDMA_GUARD_MS && remainingMs >= neededMs;
+    
+    if (!open && !tdmaDeferring) {
+        tdmaSlotDeferrals++;
+    }
+    tdmaDeferring = !open;
+    return open;
+}
 
-void LoRaManager::updateSignalQuality(int8_t rssi, int8_t snr) {
-    // Update RSSI history
-    rssiHistory[rssiIndex] = rssi;
-    rssiIndex = (rssiIndex + 1) % RSSI_HISTORY_SIZE;
+void LoRaManager::updateSlotReceiver() {
+    bool anyActive = false;
+    bool slotNear = false;
     
-    // Update SNR history
-    snrHistory[snrIndex] = snr;
-    snrIndex = (snrIndex + 1) % RSSI_HISTORY_SIZE;
+    uint32_t now = millis();
+    for (int slot = 0; slot < LORA_TDMA_SLOT_COUNT; slot++) {
+        if (!(tdmaSlotsHeard & (1UL << slot)) || now - tdmaSlotLastHeard[slot] > LORA_TDMA_SLOT_EXPIRY_MS) {
+            continue;
+        }
+        
+        anyActive = true;
+        uint32_t remainingMs;
+        if (msUntilSlot(slot, remainingMs) <= LORA_TDMA_WAKEUP_MS) {
+            slotNear = true;
+        }
+    }
     
-    lastRssi = rssi;
-    lastSnr = snr;
+    // Listen continuously until slots are known, and whenever we have something to send
+    bool listen = !tdmaEnabled || !isTimeSynced() || transmitting || !anyActive || slotNear;
+    
+    if (listen && tdmaReceiverAsleep) {
+        lockRadio();
+        if (radioState == RadioState::SLEEPING) {
+            radioStartReceive();
+        }
+        unlockRadio();
+        tdmaReceiverAsleep = false;
+    } else if (!listen && !tdmaReceiverAsleep) {
+        lockRadio();
+        if (radioState == RadioState::RECEIVING) {
+            radio->sleep();
+            setRadioState(RadioState::SLEEPING);
+            tdmaReceiverAsleep = true;
+            tdmaReceiverSleeps++;
+        }
+        unlockRadio();
+    }
 }
 
-int8_t LoRaManager::getAverageRSSI() const {
-    int32_t sum = 0;
-    int count = 0;
+void LoRaManager::enableRxWindows(bool enable) {
+    rxWindowsEnabled = enable;
+    rxWindowUntil = millis() + LORA_RX_WINDOW_MS;
     
-    for (int i = 0; i < RSSI_HISTORY_SIZE; i++) {
-        if (rssiHistory[i] != 0) {
-            sum += rssiHistory[i];
-            count++;
+    // Back to continuous listening straight away
+    if (!enable && rxWindowAsleep) {
+        lockRadio();
+        if (radioState == RadioState::SLEEPING || radioState == RadioState::IDLE) {
+            radioStartReceive();
         }
+        unlockRadio();
+        if (!rxWindowWaking) {
+            rxWindowSleepMs += millis() - rxWindowSleepStart;
+        }
+        rxWindowAsleep = false;
+        rxWindowWaking = false;
+    }
+}
+
+void LoRaManager::updateRxWindow() {
+    if (!rxWindowsEnabled || rxWindowAsleep) {
+        return;
     }
     
-    return (count > 0) ? (sum / count) : -128;
+    // Stay up while a frame is on its way out or still owed an ACK
+    uint32_t now = millis();
+    if (transmitting || arqOutstanding > 0 || (int32_t)(now - rxWindowUntil) < 0) {
+        return;
+    }
+    
+    lockRadio();
+    if (radioState == RadioState::RECEIVING) {
+        radio->sleep();
+        setRadioState(RadioState::SLEEPING);
+        rxWindowAsleep = true;
+        rxWindowSleepStart = now;
+        rxWindowSleeps++;
+    }
+    unlockRadio();
 }
 
-int8_t LoRaManager::getAverageSNR() const {
-    int32_t sum = 0;
-    int count = 0;
+bool LoRaManager::rxWindowReady() {
+    if (!rxWindowAsleep) {
+        return true;
+    }
     
-    for (int i = 0; i < RSSI_HISTORY_SIZE; i++) {
-        if (snrHistory[i] != 0) {
-            sum += snrHistory[i];
-            count++;
+    uint32_t now = millis();
+    if (!rxWindowWaking) {
+        // Sleep -> standby first; the FIFO is unusable until the oscillator is up
+        lockRadio();
+        if (radioState == RadioState::SLEEPING) {
+            radio->idle();
+            setRadioState(RadioState::IDLE);
         }
+        unlockRadio();
+        rxWindowWaking = true;
+        rxWindowWakeAt = now + LORA_RX_WAKEUP_MS;
+        rxWindowSleepMs += now - rxWindowSleepStart;
+        return false;
     }
     
-    return (count > 0) ? (sum / count) : -128;
+    if ((int32_t)(now - rxWindowWakeAt) < 0) {
+        return false;
+    }
+    
+    lockRadio();
+    if (radioState == RadioState::IDLE) {
+        radioStartReceive();
+    }
+    unlockRadio();
+    rxWindowAsleep = false;
+    rxWindowWaking = false;
+    rxWindowUntil = now + LORA_RX_WINDOW_MS;
+    return true;
 }
 
-float LoRaManager::getPacketErrorRate() const {
-    uint32_t totalPackets = transmitErrorCount + receiveErrorCount + crcErrorCount;
-    if (totalPackets == 0) {
-        return 0.0f;
+float LoRaManager::getReceiverDutyCycle() const {
+    uint32_t now = millis();
+    uint32_t elapsed = now - rxWindowSince;
+    if (elapsed == 0) {
+        return 1.0f;
     }
     
-    return (float)(transmitErrorCount + receiveErrorCount + crcErrorCount) / totalPackets;
+    uint32_t asleep = rxWindowSleepMs;
+    if (rxWindowAsleep && !rxWindowWaking) {
+        asleep += now - rxWindowSleepStart;
+    }
+    return asleep >= elapsed ? 0.0f : 1.0f - (float)asleep / elapsed;
 }
 
 // ===========================
@@ -662,13 +3549,84 @@ float LoRaManager::getPacketErrorRate() const {
 // ===========================
 
 bool LoRaManager::isReady() const {
-    return LoRa.begin(frequency);  // Quick check if LoRa is responsive
+    // Radio task owns the module - don't re-run LoRa.begin() underneath it
+    return radioTaskHandle != nullptr && radioState != RadioState::SLEEPING;
 }
 
 uint32_t LoRaManager::getLastTransmitTime() const {
     return transmitStartTime;
 }
 
+// ===========================
+// Deep Sleep Retention
+// ===========================
+
+void LoRaManager::saveRetained(RtcLinkState& state) const {
+    LinkRate rate = currentLinkRate();
+    state.nextSequence = nextSequenceNumber;
+    state.spreadingFactor = rate.spreadingFactor;
+    state.bandwidth = rate.bandwidth;
+    state.codingRate = rate.codingRate;
+    state.txPower = rate.txPower;
+    state.headerVersion = txHeaderVersion;
+    state.hopKey = hopKey;
+    state.hopKeyValid = hopKeyValid && !hopResync;
+    state.valid = true;
+}
+
+uint8_t LoRaManager::saveQueue(RtcQueuedFrame* frames, uint8_t max) const {
+    uint8_t saved = 0;
+    for (int i = 0; i < NUM_PRIORITY_LANES && saved < max; i++) {
+        const PriorityLane& lane = priorityQueues[i];
+        for (int j = 0; j < lane.count && saved < max; j++) {
+            const QueuedPacket& qp = lane.slots[(lane.head + j) & QUEUE_INDEX_MASK];
+            PacketType type = qp.packet.type;
+            if (qp.released || !qp.packet.payload || qp.packet.payloadLength > RTC_QUEUE_PAYLOAD ||
+                (type != PacketType::ALERT && type != PacketType::GPS_DATA &&
+                 type != PacketType::TELEMETRY && type != PacketType::STATUS)) {
+                continue;
+            }
+            frames[saved].type = static_cast<uint8_t>(type);
+            frames[saved].length = qp.packet.payloadLength;
+            memcpy(frames[saved].payload, qp.packet.payload, qp.packet.payloadLength);
+            saved++;
+        }
+    }
+    return saved;
+}
+
+bool LoRaManager::restoreRetained(const RtcLinkState& state) {
+    if (!state.valid || radioTaskHandle) {
+        return false;
+    }
+    
+    // Carry on the base station's sequence window rather than a random restart
+    nextSequenceNumber = state.nextSequence;
+    
+    // The rate both ends agreed on; begin() configures the module with it
+    if (state.spreadingFactor >= 6 && state.spreadingFactor <= 12 && state.codingRate >= 5 &&
+        state.codingRate <= 8 && state.bandwidth > 0) {
+        spreadingFactor = currentSpreadingFactor = state.spreadingFactor;
+        bandwidth = currentBandwidth = state.bandwidth;
+        codingRate = state.codingRate;
+        txPower = currentTxPower = state.txPower;
+        adrCandidate = currentLinkRate();
+        pendingRate = adrCandidate;
+    }
+    
+    if (state.headerVersion == LORA_HEADER_V1 || state.headerVersion == LORA_HEADER_V2) {
+        txHeaderVersion = state.headerVersion;
+    }
+    
+    // Where the base station expects us, not the home channel
+    if (hoppingEnabled && state.hopKeyValid) {
+        hopKey = hopPreviousKey = state.hopKey;
+        hopKeyValid = true;
+        radioRxChannel = hopChannelForSequence(hopKey);
+    }
+    return true;
+}
+
 // ===========================
 // Power Management
 // ===========================
@@ -677,9 +3635,7 @@ void LoRaManager::enterLowPowerMode() {
     setTxPower(10);  // Reduce transmit power
     setSpreadingFactor(12);  // Use most robust setting
     
-    if (DEBUG_LORA) {
-        Serial.println("LoRa: Entered low power mode");
-    }
+    LORA_TRACE("Entered low power mode");
 }
 
 void LoRaManager::exitLowPowerMode() {
@@ -687,18 +3643,31 @@ void LoRaManager::exitLowPowerMode() {
     setTxPower(LORA_TX_POWER);
     setSpreadingFactor(LORA_SPREADING_FACTOR);
     
-    if (DEBUG_LORA) {
-        Serial.println("LoRa: Exited low power mode");
-    }
+    LORA_TRACE("Exited low power mode");
 }
 
 void LoRaManager::sleep() {
-    LoRa.sleep();
+    lockRadio();
+    radio->sleep();
+    setRadioState(RadioState::SLEEPING);
+    unlockRadio();
 }
 
 void LoRaManager::wakeup() {
-    LoRa.begin(frequency);
+    lockRadio();
+    radio->begin(frequency);
+    radioChannel = LORA_CHANNEL_FIXED;  // begin() went back to the configured carrier
     configureLoRaSettings();
+    radioStartReceive();
+    unlockRadio();
+    
+    // Full listen window before the scheduler may sleep the receiver again
+    if (rxWindowAsleep && !rxWindowWaking) {
+        rxWindowSleepMs += millis() - rxWindowSleepStart;
+    }
+    rxWindowAsleep = false;
+    rxWindowWaking = false;
+    rxWindowUntil = millis() + LORA_RX_WINDOW_MS;
 }
 
 // ===========================
@@ -710,6 +3679,38 @@ void LoRaManager::resetStatistics() {
     receiveErrorCount = 0;
     crcErrorCount = 0;
     ackTimeoutCount = 0;
+    airtimeUsedUs = 0;
+    dutyCycleDeferrals = 0;
+    aggregateFramesSent = 0;
+    aggregatedRecordsSent = 0;
+    acksSent = 0;
+    acksPiggybacked = 0;
+    ackFramesHeld = 0;
+    ackTurnaroundWaits = 0;
+    fecChunksSent = 0;
+    lbtScans = 0;
+    lbtBusyCount = 0;
+    lbtForcedTransmits = 0;
+    lbtBackoffTotalMs = 0;
+    arbiterDeferrals = 0;
+    for (int i = 0; i < 4; i++) {
+        lbtBusyHistogram[i] = 0;
+    }
+    tdmaSlotDeferrals = 0;
+    tdmaReceiverSleeps = 0;
+    rxWindowSleeps = 0;
+    rxWindowSleepMs = 0;
+    rxWindowSince = millis();
+    rxWindowSleepStart = rxWindowSince;
+    hopChanges = 0;
+    hopResyncs = 0;
+    
+    for (int i = 0; i < NUM_PRIORITY_LANES; i++) {
+        priorityQueues[i].highWaterMark = priorityQueues[i].pending;
+        priorityQueues[i].dropCount = 0;
+        priorityQueues[i].supersededCount = 0;
+        laneShareServes[i] = 0;
+    }
     
     memset(rssiHistory, 0, sizeof(rssiHistory));
     memset(snrHistory, 0, sizeof(snrHistory));
@@ -721,37 +3722,9 @@ void LoRaManager::resetStatistics() {
 // CRC and Validation
 // ===========================
 
-uint16_t LoRaManager::calculateCRC16(const uint8_t* data, size_t length) {
-    uint16_t crc = 0xFFFF;
-    
-    for (size_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xA001;
-            } else {
-                crc >>= 1;
-            }
-        }
-    }
-    
-    return crc;
-}
-
 bool LoRaManager::validatePacket(const Packet& packet) {
-    // Calculate CRC for header + type + sequence + payload
-    size_t headerSize = sizeof(PacketHeader);
-    size_t dataSize = headerSize + 1 + 2 + packet.payloadLength;
-    
-    static uint8_t buffer[MAX_PACKET_SIZE];
-    memcpy(buffer, &packet.header, headerSize);
-    buffer[headerSize] = static_cast<uint8_t>(packet.type);
-    buffer[headerSize + 1] = (packet.sequenceNumber >> 8) & 0xFF;
-    buffer[headerSize + 2] = packet.sequenceNumber & 0xFF;
-    memcpy(buffer + headerSize + 3, packet.payload, packet.payloadLength);
-    
-    uint16_t calculatedCRC = calculateCRC16(buffer, dataSize);
-    return (calculatedCRC == packet.crc16);
+    // CRC over header + type + sequence + payload, hashed in place
+    return calculatePacketCRC(packet) == packet.crc16;
 }
 
 // ===========================
@@ -759,7 +3732,7 @@ bool LoRaManager::validatePacket(const Packet& packet) {
 // ===========================
 
 void LoRaManager::printLoRaInfo() const {
-    Serial.println("=== LoRa Information ===");
+    Serial.printf("=== LoRa Information (%s, %s) ===\n", linkRoleToString(role), radio ? radio->getName() : "not fitted");
     Serial.printf("Frequency: %.1f MHz\n", frequency);
     Serial.printf("Spreading Factor: %d\n", spreadingFactor);
     Serial.printf("Bandwidth: %ld Hz\n", bandwidth);
@@ -768,15 +3741,35 @@ void LoRaManager::printLoRaInfo() const {
     Serial.printf("Preamble Length: %d\n", preambleLength);
     Serial.printf("Sync Word: 0x%02X\n", syncWord);
     Serial.printf("Device ID: %d\n", deviceId);
+    
+    float margin;
+    if (estimateLinkMargin(margin)) {
+        Serial.printf("ADR: %s, link margin %.1f dB\n", adaptiveModeEnabled ? "Enabled" : "Disabled", margin);
+    } else {
+        Serial.printf("ADR: %s, collecting samples (%d/%d)\n", adaptiveModeEnabled ? "Enabled" : "Disabled",
+                     signalSamples, LORA_ADR_MIN_SAMPLES);
+    }
+    Serial.printf("Rate Changes: %lu (%lu fallbacks)\n", rateChanges, rateFallbacks);
+    if (radio->supportsFsk()) {
+        Serial.printf("FSK Burst: %s, %lu bursts (%lu failed)\n",
+                     fskBitrate ? "Active" : "Idle", (unsigned long)fskBursts, (unsigned long)fskBurstFailures);
+    }
+    if (radio->supportsImplicitHeader()) {
+        Serial.printf("Fixed Frames: %s, %lu sessions (%lu failed)\n",
+                     fixedFrameBytes ? "Active" : "Idle", (unsigned long)fixedFrameSessions,
+                     (unsigned long)fixedFrameFailures);
+    }
 }
 
 void LoRaManager::printQueueStatus() const {
     Serial.println("=== Queue Status ===");
-    Serial.printf("Emergency: %d/%d\n", getQueueSize(Priority::EMERGENCY), MAX_QUEUE_SIZE);
-    Serial.printf("GPS: %d/%d\n", getQueueSize(Priority::GPS), MAX_QUEUE_SIZE);
-    Serial.printf("Telemetry: %d/%d\n", getQueueSize(Priority::TELEMETRY), MAX_QUEUE_SIZE);
-    Serial.printf("Camera: %d/%d\n", getQueueSize(Priority::CAMERA), MAX_QUEUE_SIZE);
-    Serial.printf("Status: %d/%d\n", getQueueSize(Priority::STATUS), MAX_QUEUE_SIZE);
+    for (int i = 0; i < NUM_PRIORITY_LANES; i++) {
+        Priority priority = static_cast<Priority>(i + 1);
+        Serial.printf("%s: %d/%d (peak %d, dropped %lu, superseded %lu, %lu on its share)\n",
+                     priorityToString(priority), getQueueSize(priority), MAX_QUEUE_SIZE,
+                     getQueueHighWaterMark(priority), getQueueDropCount(priority), getSupersededCount(priority),
+                     getLaneShareServes(priority));
+    }
     Serial.printf("Total: %d packets\n", getTotalQueueSize());
 }
 
@@ -786,7 +3779,9 @@ void LoRaManager::printSignalQuality() const {
     Serial.printf("Last SNR: %d dB\n", lastSnr);
     Serial.printf("Average RSSI: %d dBm\n", getAverageRSSI());
     Serial.printf("Average SNR: %d dB\n", getAverageSNR());
-    Serial.printf("Packet Error Rate: %.2f%%\n", getPacketErrorRate() * 100);
+    Serial.printf("Packet Error Rate: %.2f%% (ETX %.2f)\n", getPacketErrorRate() * 100,
+                 getExpectedTransmissions());
+    linkQuality.printStatus(millis());
 }
 
 void LoRaManager::printStatistics() const {
@@ -797,6 +3792,46 @@ void LoRaManager::printStatistics() const {
     Serial.printf("ACK Timeouts: %lu\n", ackTimeoutCount);
     Serial.printf("Last Transmit: %lu ms ago\n", millis() - getLastTransmitTime());
     Serial.printf("Last Receive: %lu ms ago\n", millis() - lastReceiveTime);
+    Serial.printf("Frames TX/RX: %lu/%lu\n", framesTransmitted, framesReceived);
+    Serial.printf("Last Airtime: %lu ms\n", lastAirtime);
+    Serial.printf("Radio State: %s\n", radioStateToString(radioState));
+    Serial.printf("ARQ Window: %d/%d outstanding\n", arqOutstanding, arqWindowSize);
+    Serial.printf("Time on Air (max frame): %lu ms\n", getTimeOnAirUs(MAX_PACKET_SIZE) / 1000);
+    Serial.printf("Airtime Budget: %ld/%ld ms (%d.%d%% duty cycle)\n",
+                 (long)(getAvailableAirtimeUs() / 1000),
+                 (long)((int32_t)LORA_DUTY_CYCLE_WINDOW_MS * LORA_DUTY_CYCLE_PERMILLE / 1000),
+                 LORA_DUTY_CYCLE_PERMILLE / 10, LORA_DUTY_CYCLE_PERMILLE % 10);
+    Serial.printf("Airtime Used: %lu ms\n", airtimeUsedUs / 1000);
+    Serial.printf("Duty Cycle Deferrals: %lu\n", dutyCycleDeferrals);
+    Serial.printf("Emergency Beacons: %lu%s, trigger to air %lu us (worst %lu), %lu frames cut off\n",
+                  emergencyBeaconsSent, emergencyActive ? " (armed)" : "", emergencyLatencyUs,
+                  emergencyWorstLatencyUs, txPreemptions);
+    Serial.printf("Aggregate Frames: %lu (%lu records)\n", aggregateFramesSent, aggregatedRecordsSent);
+    Serial.printf("ACKs Sent: %lu (%lu on our frames), %lu frames held for their run\n",
+                  acksSent, acksPiggybacked, ackFramesHeld);
+    Serial.printf("ACK Turnarounds: %lu held a handoff for the peer's ACK\n", ackTurnaroundWaits);
+    Serial.printf("FEC Chunks: %lu sent, %lu recovered\n", fecChunksSent, cameraDecoder.getChunksRecovered());
+    Serial.printf("Transmit Interval: %lu ms\n", getTransmitInterval());
+    Serial.printf("Listen Before Talk: %s, %lu scans, %lu busy, %lu forced\n",
+                 lbtEnabled ? "Enabled" : "Disabled", lbtScans, lbtBusyCount, lbtForcedTransmits);
+    Serial.printf("Hopping: %s, channel %d, %lu hops, %lu resyncs\n",
+                 hoppingEnabled ? "Enabled" : "Disabled", txChannel(), hopChanges, hopResyncs);
+    Serial.printf("TDMA: %s, %s, slot %d of %d (%lu ms), %lu deferrals, %lu receiver sleeps\n",
+                 tdmaEnabled ? "Enabled" : "Disabled", isTimeSynced() ? "Synced" : "Unsynced",
+                 getSlotIndex(), LORA_TDMA_SLOT_COUNT, getSlotLengthMs(),
+                 tdmaSlotDeferrals, tdmaReceiverSleeps);
+    linkClock.printStatus();
+    LinkAuthMgr().printStatus();
+    Serial.printf("RX Windows: %s, %s, %lu sleeps, listening %.1f%%\n",
+                 rxWindowsEnabled ? "Enabled" : "Disabled", rxWindowAsleep ? "Asleep" : "Awake",
+                 rxWindowSleeps, getReceiverDutyCycle() * 100.0f);
+    Serial.printf("LBT Backoff: %lu ms total, sent after 0/1/2/3+ busy: %lu/%lu/%lu/%lu\n",
+                 lbtBackoffTotalMs, lbtBusyHistogram[0], lbtBusyHistogram[1],
+                 lbtBusyHistogram[2], lbtBusyHistogram[3]);
+    if (arbiterDeferrals || radioTxPower != currentTxPower) {
+        Serial.printf("Power Arbiter: %lu frames held for a capture, PA at %d dBm of %d\n",
+                     arbiterDeferrals, radioTxPower, currentTxPower);
+    }
 }
 
 void LoRaManager::printPacket(const Packet& packet) const {
@@ -813,6 +3848,26 @@ void LoRaManager::printPacket(const Packet& packet) const {
     Serial.printf("Valid: %s\n", packet.valid ? "Yes" : "No");
 }
 
+// ===========================
+// Link Selection
+// ===========================
+
+LoRaManager& LoRaLink(Priority priority) {
+    // Emergency, position and telemetry stay on the robust link whatever happens
+    // to the bulk one; a bulk link that stops getting ACKs (or a peer without
+    // one) hands its traffic back, bar a probe now and then
+    bool bulkTraffic = priority == Priority::CAMERA || priority == Priority::STATUS;
+    if (!LORA_BULK_RADIO_FITTED || !bulkTraffic || !BulkLoRa().isReady()) {
+        return LoRaComm();
+    }
+    LoRaManager& bulk = BulkLoRa();
+    if (bulk.getAckTimeoutStreak() < LORA_BULK_FALLBACK_TIMEOUTS ||
+        millis() - bulk.getLastTransmitTime() >= LORA_BULK_PROBE_MS) {
+        return bulk;
+    }
+    return LoRaComm();
+}
+
 // ===========================
 // Utility Functions
 // ===========================
@@ -822,13 +3877,16 @@ Packet createPacket(PacketType type, const uint8_t* payload, size_t length) {
     
     // Initialize header
     packet.header.version = 0x01;  // Protocol version 1
-    packet.header.deviceId = DEVICE_TYPE;
+    packet.header.deviceId = LORA_DEVICE_ID;
     packet.header.flags = 0;  // No special flags
     packet.header.retryCount = 0;
     packet.header.timestamp = millis() / 1000;  // Convert to seconds
     packet.header.batteryLevel = 330;  // TODO: Get actual battery voltage
     packet.header.rssiAvg = LoRaComm().getAverageRSSI();
     packet.header.snrAvg = LoRaComm().getAverageSNR();
+    packet.header.createdAt = millis();
+    packet.header.sampledAt = packet.header.createdAt;
+    packet.header.latency = LatencyStamp();
     
     // Initialize packet
     packet.type = type;
@@ -844,81 +3902,330 @@ Packet createPacket(PacketType type, const uint8_t* payload, size_t length) {
 }
 
 uint16_t calculatePacketCRC(const Packet& packet) {
-    // Simple CRC calculation for utility function
-    uint16_t crc = 0xFFFF;
-    size_t headerSize = sizeof(PacketHeader);
-    uint8_t tempBuffer[MAX_PACKET_SIZE];
-    
-    // Build temporary buffer for CRC calculation
-    memcpy(tempBuffer, &packet.header, headerSize);
-    tempBuffer[headerSize] = static_cast<uint8_t>(packet.type);
-    tempBuffer[headerSize + 1] = (packet.sequenceNumber >> 8) & 0xFF;
-    tempBuffer[headerSize + 2] = packet.sequenceNumber & 0xFF;
-    memcpy(tempBuffer + headerSize + 3, packet.payload, packet.payloadLength);
+    // Same bytes as the serialized frame, hashed span by span - no staging copy
+    uint8_t fields[LORA_MAX_FRAME_HEADER];
+    size_t length = encodeFrameHeader(packet.header, packet.type, packet.sequenceNumber, fields);
+    uint16_t crc = crc16ModbusUpdate(CRC16_MODBUS_INIT, fields, length);
+    return crc16ModbusUpdate(crc, packet.payload, packet.payloadLength);
+}
+
+bool serializePacket(const Packet& packet, uint8_t* buffer, size_t& length) {
+    FrameWriter writer;
+    frameBegin(writer, buffer, MAX_PACKET_SIZE, packet.header, packet.type, packet.sequenceNumber);
+    frameAppend(writer, packet.payload, packet.payloadLength);
+    return frameFinish(writer, length);
+}
+
+size_t encodeFrameHeader(const LoRaPacketHeader& header, PacketType type, uint16_t sequenceNumber,
+                         uint8_t* out) {
+    size_t length = 0;
     
-    // Calculate CRC
-    for (size_t i = 0; i < headerSize + 3 + packet.payloadLength; i++) {
-        crc ^= tempBuffer[i];
-        for (int j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xA001;
-            } else {
-                crc >>= 1;
-            }
+    if (header.version >= LORA_HEADER_V2) {
+        // Compact header: age instead of uptime, 7 bits per varint byte
+        uint32_t age = millis() / 1000 - header.timestamp;
+        uint8_t flags = header.flags | (LINK_AUTH_ENABLED ? LORA_FLAG_AUTH : 0);
+        out[length++] = LORA_HEADER_V2_MARKER | (flags & LORA_HEADER_V2_FLAGS_MASK);
+        out[length++] = header.deviceId;
+        out[length++] = static_cast<uint8_t>(type);
+        out[length++] = (sequenceNumber >> 8) & 0xFF;
+        out[length++] = sequenceNumber & 0xFF;
+        do {
+            out[length++] = (age & 0x7F) | (age > 0x7F ? 0x80 : 0);
+            age >>= 7;
+        } while (age);
+        
+        // An aggregate's stamps ride in its records
+        if ((header.flags & LORA_FLAG_TIMING) && type != PacketType::AGGREGATE) {
+            length += encodeLatencyStamp(header.latency, out + length);
         }
+        return length;
     }
     
-    return crc;
+    // v1: raw header, version byte advertises the newest header we can parse;
+    // it has no room for a stamp
+    memcpy(out, &header, sizeof(PacketHeader));
+    out[0] = LORA_COMPACT_HEADER ? LORA_HEADER_V2 : LORA_HEADER_V1;
+    out[offsetof(LoRaPacketHeader, flags)] &= ~LORA_FLAG_TIMING;
+    if (LINK_AUTH_ENABLED) {
+        out[offsetof(LoRaPacketHeader, flags)] |= LORA_FLAG_AUTH;
+    }
+    length = sizeof(PacketHeader);
+    out[length++] = static_cast<uint8_t>(type);
+    out[length++] = (sequenceNumber >> 8) & 0xFF;
+    out[length++] = sequenceNumber & 0xFF;
+    return length;
 }
 
-bool serializePacket(const Packet& packet, uint8_t* buffer, size_t& length) {
-    size_t headerSize = sizeof(PacketHeader);
-    size_t totalSize = headerSize + 1 + 2 + packet.payloadLength + 2;  // +2 for CRC
+void frameBegin(FrameWriter& writer, uint8_t* buffer, size_t capacity, const LoRaPacketHeader& header,
+                PacketType type, uint16_t sequenceNumber) {
+    writer.buffer = buffer;
+    writer.capacity = capacity;
+    writer.length = 0;
+    writer.crc = CRC16_MODBUS_INIT;
+    writer.deviceId = header.deviceId;
+    writer.overflow = false;
     
-    if (totalSize > MAX_PACKET_SIZE) {
+    uint8_t fields[LORA_MAX_FRAME_HEADER];
+    size_t length = encodeFrameHeader(header, type, sequenceNumber, fields);
+    frameAppend(writer, fields, length);
+    writer.headerLength = writer.length;
+}
+
+bool frameAppend(FrameWriter& writer, const uint8_t* data, size_t length) {
+    // Always leave room for the trailing CRC, or counter and tag
+    if (writer.overflow || writer.length + length + LORA_FRAME_TRAILER_BYTES > writer.capacity) {
+        writer.overflow = true;
         return false;
     }
     
-    // Copy header
-    memcpy(buffer, &packet.header, headerSize);
+    if (LINK_AUTH_ENABLED) {
+        memcpy(writer.buffer + writer.length, data, length);    // The tag covers it at the end
+    } else {
+        writer.crc = crc16ModbusCopy(writer.crc, writer.buffer + writer.length, data, length);
+    }
+    writer.length += length;
+    return true;
+}
+
+bool frameFinish(FrameWriter& writer, size_t& length) {
+    if (writer.overflow) {
+        return false;
+    }
     
-    // Copy type and sequence
-    buffer[headerSize] = static_cast<uint8_t>(packet.type);
-    buffer[headerSize + 1] = (packet.sequenceNumber >> 8) & 0xFF;
-    buffer[headerSize + 2] = packet.sequenceNumber & 0xFF;
+    if (LINK_AUTH_ENABLED) {
+        // Payload encrypted where it was written, counter and tag after it
+        if (!LinkAuthMgr().seal(writer.deviceId, writer.buffer, writer.headerLength, writer.length)) {
+            return false;
+        }
+        length = writer.length;
+        return true;
+    }
     
-    // Copy payload
-    memcpy(buffer + headerSize + 3, packet.payload, packet.payloadLength);
+    writer.buffer[writer.length] = (writer.crc >> 8) & 0xFF;
+    writer.buffer[writer.length + 1] = writer.crc & 0xFF;
+    length = writer.length + 2;
+    return true;
+}
+
+bool isFrameSealed(const uint8_t* buffer, size_t length) {
+    if (length > 0 && (buffer[0] & 0xE0) == LORA_HEADER_V2_MARKER) {
+        return buffer[0] & LORA_FLAG_AUTH;
+    }
+    return length > offsetof(LoRaPacketHeader, flags) && (buffer[offsetof(LoRaPacketHeader, flags)] & LORA_FLAG_AUTH);
+}
+
+bool verifyFrameCRC(const uint8_t* buffer, size_t length) {
+    if (length < 2) {
+        return false;
+    }
     
-    // Calculate and add CRC
-    uint16_t crc = calculatePacketCRC(packet);
-    buffer[totalSize - 2] = (crc >> 8) & 0xFF;
-    buffer[totalSize - 1] = crc & 0xFF;
+    if (isFrameSealed(buffer, length)) {
+        uint8_t deviceId = ((buffer[0] & 0xE0) == LORA_HEADER_V2_MARKER) ? buffer[1]
+                           : buffer[offsetof(LoRaPacketHeader, deviceId)];
+        return LinkAuthMgr().check(deviceId, buffer, length);
+    }
     
-    length = totalSize;
-    return true;
+    // One pass over the received bytes as they sit in the RX buffer
+    uint16_t received = (buffer[length - 2] << 8) | buffer[length - 1];
+    return crc16Modbus(buffer, length - 2) == received;
 }
 
-bool deserializePacket(const uint8_t* buffer, size_t length, Packet& packet) {
-    size_t headerSize = sizeof(PacketHeader);
+float demodulatorFloorDb(int spreadingFactor) {
+    // SX127x demodulator SNR limit: -5 dB at SF6, 2.5 dB lower per SF step
+    return -5.0f - 2.5f * (spreadingFactor - 6);
+}
+
+size_t serializedPacketSize(const Packet& packet) {
+    size_t headerSize = frameHeaderSize(packet.header.version);
+    
+    // Packets older than two minutes need extra age bytes
+    if (packet.header.version >= LORA_HEADER_V2) {
+        for (uint32_t age = (millis() / 1000 - packet.header.timestamp) >> 7; age; age >>= 7) {
+            headerSize++;
+        }
+    }
+    
+    // Stamped at hand-off, so budget for the longest one
+    if (packet.header.flags & LORA_FLAG_TIMING) {
+        headerSize += LORA_LATENCY_STAMP_MAX;
+    }
+    
+    return headerSize + packet.payloadLength + LORA_FRAME_TRAILER_BYTES;
+}
+
+size_t frameHeaderSize(uint8_t headerVersion) {
+    // Everything before the payload: header + type + sequence (v2 with a one byte age)
+    return (headerVersion >= LORA_HEADER_V2) ? 6 : sizeof(PacketHeader) + 3;
+}
+
+size_t encodeLatencyStamp(const LatencyStamp& stamp, uint8_t* out) {
+    const uint32_t fields[] = { stamp.sampleMs, stamp.queueMs, stamp.retryMs };
+    size_t length = 0;
     
-    if (length < headerSize + 5) {  // Minimum packet size
+    for (uint32_t value : fields) {
+        value = min(value, (uint32_t)LORA_LATENCY_STAMP_CAP);
+        do {
+            out[length++] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+            value >>= 7;
+        } while (value);
+    }
+    out[length++] = stamp.attempt;
+    return length;
+}
+
+size_t encodeEmergencyBeacon(const EmergencyBeacon& beacon, uint8_t repeat, uint8_t* out) {
+    const uint32_t fields[] = { (uint32_t)beacon.altitude, (uint32_t)beacon.latitude, (uint32_t)beacon.longitude };
+    out[0] = beacon.code >> 8;
+    out[1] = beacon.code;
+    out[2] = beacon.severity;
+    out[3] = beacon.battery >> 8;
+    out[4] = beacon.battery;
+    size_t length = 5;
+    for (uint32_t value : fields) {
+        out[length++] = value >> 24;
+        out[length++] = value >> 16;
+        out[length++] = value >> 8;
+        out[length++] = value;
+    }
+    out[length++] = repeat;
+    return length;
+}
+
+bool decodeEmergencyBeacon(const uint8_t* data, size_t length, EmergencyBeacon& beacon, uint8_t& repeat) {
+    if (length != LORA_EMERGENCY_BEACON_SIZE) {
         return false;
     }
+    int32_t* fields[] = { &beacon.altitude, &beacon.latitude, &beacon.longitude };
+    beacon.code = (data[0] << 8) | data[1];
+    beacon.severity = data[2];
+    beacon.battery = (data[3] << 8) | data[4];
+    size_t offset = 5;
+    for (int32_t* field : fields) {
+        *field = (int32_t)(((uint32_t)data[offset] << 24) | ((uint32_t)data[offset + 1] << 16) |
+                           ((uint32_t)data[offset + 2] << 8) | data[offset + 3]);
+        offset += 4;
+    }
+    repeat = data[offset];
+    return true;
+}
+
+size_t decodeLatencyStamp(const uint8_t* data, size_t length, LatencyStamp& stamp) {
+    uint32_t fields[3];
+    size_t offset = 0;
+    
+    for (uint32_t& value : fields) {
+        value = 0;
+        for (int shift = 0;; shift += 7) {
+            if (offset >= length || shift > 14) {
+                return 0;
+            }
+            uint8_t byte = data[offset++];
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+    }
+    if (offset >= length) {
+        return 0;
+    }
+    
+    stamp.sampleMs = fields[0];
+    stamp.queueMs = fields[1];
+    stamp.retryMs = fields[2];
+    stamp.attempt = data[offset++];
+    stamp.valid = stamp.attempt > 0;
+    return offset;
+}
+
+uint32_t calculateTimeOnAirUs(size_t frameBytes, int spreadingFactor, long bandwidth,
+                              int codingRate, int preambleLength, bool implicitHeader) {
+    // Semtech SX127x time-on-air. Explicit header with the payload CRC
+    // assumed on, so the estimate never comes in under the real airtime;
+    // implicit header has neither its 20 bits nor the CRC's 16
+    float symbolTimeUs = (float)(1UL << spreadingFactor) * 1000000.0f / (float)bandwidth;
+    bool lowDataRateOptimize = symbolTimeUs > 16000.0f;
+    
+    float preambleUs = (preambleLength + 4.25f) * symbolTimeUs;
+    
+    int numerator = 8 * (int)frameBytes - 4 * spreadingFactor + 28 + (implicitHeader ? -20 : 16);
+    int denominator = 4 * (spreadingFactor - (lowDataRateOptimize ? 2 : 0));
+    int payloadSymbols = 8;
+    if (numerator > 0) {
+        payloadSymbols += ((numerator + denominator - 1) / denominator) * codingRate;
+    }
+    
+    return (uint32_t)(preambleUs + payloadSymbols * symbolTimeUs);
+}
+
+uint32_t calculateFskTimeOnAirUs(size_t frameBytes, uint32_t bitrate) {
+    // Preamble, sync word, length byte and CRC around the payload, bit for bit
+    uint64_t bits = (uint64_t)(frameBytes + RADIO_FSK_OVERHEAD_BYTES) * 8;
+    return bitrate ? (uint32_t)((bits * 1000000ULL + bitrate - 1) / bitrate) : 0;
+}
+
+bool deserializePacket(const uint8_t* buffer, size_t length, Packet& packet) {
+    size_t offset;
+    size_t trailer = isFrameSealed(buffer, length) ? LINK_AUTH_TRAILER_BYTES : 2;
     
-    // Copy header
-    memcpy(&packet.header, buffer, headerSize);
+    // Only v2 carries a stamp; the v1 copy below stops short of these
+    packet.header.sampledAt = 0;
+    packet.header.createdAt = 0;
+    packet.header.latency = LatencyStamp();
     
-    // Extract type and sequence
-    packet.type = static_cast<PacketType>(buffer[headerSize]);
-    packet.sequenceNumber = (buffer[headerSize + 1] << 8) | buffer[headerSize + 2];
+    if (length > 0 && (buffer[0] & 0xE0) == LORA_HEADER_V2_MARKER) {
+        if (length < frameHeaderSize(LORA_HEADER_V2) + trailer) {
+            return false;
+        }
+        
+        packet.header.version = LORA_HEADER_V2;
+        packet.header.flags = buffer[0] & LORA_HEADER_V2_FLAGS_MASK;
+        packet.header.deviceId = buffer[1];
+        packet.header.retryCount = 0;
+        packet.type = static_cast<PacketType>(buffer[2]);
+        packet.sequenceNumber = (buffer[3] << 8) | buffer[4];
+        
+        uint32_t age = 0;
+        offset = 5;
+        for (int shift = 0; offset < length - trailer && shift < 32; shift += 7) {
+            uint8_t byte = buffer[offset++];
+            age |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        
+        // Rebase onto our own clock
+        packet.header.timestamp = millis() / 1000 - age;
+        
+        if ((packet.header.flags & LORA_FLAG_TIMING) && packet.type != PacketType::AGGREGATE) {
+            size_t stampLength = decodeLatencyStamp(buffer + offset, length - trailer - offset, packet.header.latency);
+            if (stampLength == 0) {
+                return false;
+            }
+            offset += stampLength;
+        }
+    } else {
+        size_t headerSize = sizeof(PacketHeader);
+        if (length < headerSize + 3 + trailer) {  // Minimum packet size
+            return false;
+        }
+        
+        // Copy header
+        memcpy(&packet.header, buffer, headerSize);
+        
+        // Extract type and sequence
+        packet.type = static_cast<PacketType>(buffer[headerSize]);
+        packet.sequenceNumber = (buffer[headerSize + 1] << 8) | buffer[headerSize + 2];
+        offset = headerSize + 3;
+    }
     
-    // Extract payload
-    packet.payloadLength = length - headerSize - 3 - 2;  // -3 for type+seq, -2 for CRC
-    packet.payload = const_cast<uint8_t*>(buffer + headerSize + 3);
+    // Extract payload - a view into the receive buffer
+    packet.payloadLength = length - offset - trailer;  // CRC, or counter and tag
+    packet.payload = const_cast<uint8_t*>(buffer + offset);
     
-    // Extract CRC
-    packet.crc16 = (buffer[length - 2] << 8) | buffer[length - 1];
+    // Extract CRC - none on a sealed frame
+    packet.crc16 = (trailer == 2) ? (buffer[length - 2] << 8) | buffer[length - 1] : 0;
     
     packet.rssi = -128;
     packet.snr = -128;
@@ -927,6 +4234,20 @@ bool deserializePacket(const uint8_t* buffer, size_t length, Packet& packet) {
     return true;
 }
 
+uint8_t hopChannelForSequence(uint16_t sequenceNumber) {
+    // Keyed integer hash - consecutive sequences land on unrelated channels
+    uint32_t x = (((uint32_t)sequenceNumber << 16) | sequenceNumber) ^ LORA_HOP_SEED;
+    x *= 0x9E3779B1UL;
+    x ^= x >> 16;
+    x *= 0x85EBCA6BUL;
+    x ^= x >> 13;
+    return (uint8_t)(x % LORA_HOP_CHANNEL_COUNT);
+}
+
+long hopChannelFrequency(uint8_t channel) {
+    return hopChannelPlan[channel % LORA_HOP_CHANNEL_COUNT];
+}
+
 const char* packetTypeToString(PacketType type) {
     switch (type) {
         case PacketType::TELEMETRY: return "Telemetry";
@@ -935,9 +4256,22 @@ const char* packetTypeToString(PacketType type) {
         case PacketType::CAMERA_FULL: return "Camera Full";
         case PacketType::STATUS: return "Status";
         case PacketType::ACK: return "ACK";
-     //   case PacketType::NACK: return "NACK";
+        case PacketType::NACK: return "NACK";
         case PacketType::PING: return "Ping";
         case PacketType::PONG: return "Pong";
+        case PacketType::AGGREGATE: return "Aggregate";
+        case PacketType::RATE_CHANGE: return "Rate Change";
+        case PacketType::FRAGMENT: return "Fragment";
+        case PacketType::FRAGMENT_ACK: return "Fragment ACK";
+        case PacketType::COMMAND: return "Command";
+        case PacketType::CAMERA_TILE: return "Camera Tile";
+        case PacketType::CAMERA_LAYER: return "Camera Layer";
+        case PacketType::CAMERA_PREVIEW: return "Camera Preview";
+        case PacketType::COMMAND_BATCH: return "Command Batch";
+        case PacketType::FIRMWARE_DELTA: return "Firmware Delta";
+        case PacketType::PROFILE_LEVEL: return "Profile Level";
+        case PacketType::TRACK_SEGMENT: return "Track Segment";
+        case PacketType::DIGEST: return "Digest";
         case PacketType::EMERGENCY: return "Emergency";
         default: return "Unknown";
     }
@@ -953,3 +4287,22 @@ const char* priorityToString(Priority priority) {
         default: return "Unknown";
     }
 }
+
+const char* linkRoleToString(LinkRole role) {
+    switch (role) {
+        case LinkRole::PRIMARY: return "Primary";
+        case LinkRole::BULK: return "Bulk";
+        default: return "Unknown";
+    }
+}
+
+const char* radioStateToString(RadioState state) {
+    switch (state) {
+        case RadioState::IDLE: return "Idle";
+        case RadioState::RECEIVING: return "Receiving";
+        case RadioState::TRANSMITTING: return "Transmitting";
+        case RadioState::SLEEPING: return "Sleeping";
+        case RadioState::CHANNEL_SCAN: return "Channel Scan";
+        default: return "Unknown";
+    }
+}
@@ -2,11 +2,23 @@
 #define LORA_COMM_H
 
 #include <Arduino.h>
-#include <SPI.h>
-#include <LoRa.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include "balloon_config.h"
 #include "sensor_pins.h"
 #include "common_types.h"
+#include "fec_codec.h"
+#include "link_quality.h"
+#include "link_clock.h"
+#include "radio_driver.h"
+#include "power_scaling.h"
+#include "energy_ledger.h"
+#include "task_placement.h"
+#include "rtc_state.h"
+#include "link_capture.h"
+#include "link_auth.h"
 
 // ===========================
 // LoRa Data Structures
@@ -22,6 +34,112 @@ enum class Priority : uint8_t {
     STATUS = 5
 };
 
+// Which module a LoRaManager drives. PRIMARY is the robust, adaptive link on
+// the hop plan; BULK the optional second radio (LORA_BULK_* pins) at a fixed
+// fast rate on a channel of its own, carrying images and the backlog
+enum class LinkRole : uint8_t {
+    PRIMARY = 0,
+    BULK = 1
+};
+
+// ACK types (payload[2] of an ACK packet)
+#define LORA_ACK_TYPE_OK          0x00   // Single sequence acknowledged
+#define LORA_ACK_TYPE_SELECTIVE   0x04   // Ack Seq is newest received, followed by a 32-bit bitmap
+#define LORA_ACK_BITMAP_BITS      32     // Bit i set = (Ack Seq - 1 - i) also received
+
+// Header flags (LoRaPacketHeader.flags)
+#define LORA_FLAG_FEC_CHUNK       0x01   // Payload is an FEC chunk, never ACKed
+#define LORA_FLAG_TIMING          0x02   // v2 only: a LatencyStamp follows the age (per record in an aggregate)
+#define LORA_FLAG_MORE            0x04   // Another frame follows straight after - the receiver may hold its ACK
+#define LORA_FLAG_AUTH            0x08   // Sealed: counter and tag (link_auth.h) in place of the CRC
+
+// Bytes after the payload: the CRC-16, or a sealed frame's counter and tag
+#define LORA_FRAME_TRAILER_BYTES  (LINK_AUTH_ENABLED ? LINK_AUTH_TRAILER_BYTES : 2)
+
+// On-air header versions (LoRaPacketHeader.version)
+#define LORA_HEADER_V1            0x01   // Raw 8-byte header; version byte = highest version understood
+#define LORA_HEADER_V2            0x02   // Compact: [010 flags:5][deviceId][type][seq 2][age varint]
+#define LORA_HEADER_V2_MARKER     0x40   // Top 3 bits of byte 0 in a v2 frame (v1 byte 0 is < 0x20)
+#define LORA_HEADER_V2_FLAGS_MASK 0x1F
+#define LORA_MAX_FRAME_HEADER     24     // Header + type + sequence, either version, stamp included
+
+// Frequency hopping
+#define LORA_CHANNEL_FIXED        0xFF   // RadioFrame/RadioEvent channel when not hopping
+#define LORA_HOP_HOME_CHANNEL     0      // Rendezvous channel before the first exchange and after resync
+
+// Aggregate frame record: [type 1][sequence 2][length 1][payload length]
+#define LORA_AGGREGATE_RECORD_HEADER 4
+#define LORA_SELECTIVE_ACK_SIZE      8   // [newest seq 2][type 1][rssi 1][bitmap 4], as an ACK payload or record
+
+// Queued payloads are borrowed, not copied. A sender that lends one by handle
+// (e.g. a PacketHandler slab slot) gets it back once the packet leaves the queue
+#define LORA_PAYLOAD_UNOWNED      -1
+typedef void (*PayloadReleaseHandler)(void* context, int16_t handle);
+
+// Handles from here up are the store-and-forward backlog's (link_backlog.h),
+// released to its own handler and never reported as PayloadEvents
+#define LORA_BACKLOG_HANDLE_BASE  0x4000
+
+// Progress of a lent payload while it is still queued - TRANSMITTED on its
+// first handoff to the radio, ACKNOWLEDGED just before the ACK releases it
+enum class PayloadEvent : uint8_t {
+    TRANSMITTED,
+    ACKNOWLEDGED
+};
+typedef void (*PayloadEventHandler)(void* context, int16_t handle, PayloadEvent event);
+
+// An ARQ packet about to be dropped unacknowledged - evicted from a full
+// lane or out of retries - while its payload is still valid
+struct QueuedPacket;
+typedef void (*PacketSpillHandler)(void* context, const QueuedPacket& queuedPacket);
+
+// Latest-value freshness, from the packets' owner: whether a newer packet
+// makes a queued one of its type redundant, sent or not, and whether one
+// waiting on a retry is still worth it at its sample's age
+struct Packet;
+typedef bool (*SupersedeHandler)(void* context, const Packet& newer, const Packet& older);
+typedef bool (*RetransmitHandler)(void* context, const Packet& packet, uint8_t attempts, uint32_t ageMs);
+
+// Where a packet's time went before it reached the air, in the sender's
+// millis(). A few varint bytes on a v2 frame with LORA_FLAG_TIMING:
+// [sample][queue][retry] 7 bits per byte, each capped at
+// LORA_LATENCY_STAMP_CAP, then [attempt]. The sender has no clock in common
+// with the receiver, so each end only measures its own side; rxAt and
+// airtimeUs are the receiver's, filled in as the frame is handed up.
+#define LORA_LATENCY_STAMP_MAX    10       // Encoded bytes at most
+#define LORA_LATENCY_STAMP_CAP    0x1FFFFF // ms, three varint bytes - about 35 minutes
+
+struct LatencyStamp {
+    uint32_t sampleMs;       // Reading taken -> packet built
+    uint32_t queueMs;        // Packet built -> first hand-off to the radio
+    uint32_t retryMs;        // First hand-off -> the one that got through
+    uint8_t attempt;         // 1 = first transmission
+    bool valid;              // Frame carried a stamp
+    uint32_t airtimeUs;      // Receiver: time on air of the frame it came in
+    uint32_t rxAt;           // Receiver: millis() of the RX_DONE
+};
+
+// Emergency beacon: a fixed EMERGENCY payload the radio task sends the
+// moment it is armed - ahead of the lanes, outside the ARQ window, cutting
+// off a frame already on air - then repeats on its own timer, unACKed.
+// [code 2][severity 1][battery 2][altitude 4][latitude 4][longitude 4][repeat 1], big endian
+#define LORA_EMERGENCY_BEACON_SIZE 18
+
+#define LORA_EMERGENCY_BATTERY     0x0001
+#define LORA_EMERGENCY_DESCENT     0x0002
+#define LORA_EMERGENCY_GPS_LOSS    0x0003
+#define LORA_EMERGENCY_SYSTEM      0x0004
+#define LORA_EMERGENCY_ALTITUDE    0x0005
+
+struct EmergencyBeacon {
+    uint16_t code;           // LORA_EMERGENCY_*
+    uint8_t severity;        // 1-5
+    uint16_t battery;        // Volts * 100
+    int32_t altitude;        // m
+    int32_t latitude;        // Degrees * 1e7
+    int32_t longitude;       // Degrees * 1e7
+};
+
 struct LoRaPacketHeader {
     uint8_t version;         // Protocol version
     uint8_t deviceId;        // Device identifier
@@ -31,6 +149,10 @@ struct LoRaPacketHeader {
     uint16_t batteryLevel;   // Battery voltage (scaled by 100)
     int8_t rssiAvg;         // Average RSSI
     int8_t snrAvg;          // Average SNR
+    // Not part of the v1 wire header, which is the fields above
+    uint32_t sampledAt;      // Sender millis() of the reading behind the payload
+    uint32_t createdAt;      // Sender millis() the packet was built
+    LatencyStamp latency;
 };
 
 struct Packet {
@@ -45,13 +167,112 @@ struct Packet {
     bool valid;              // Packet validity
 };
 
+// Radio engine events (radio task -> LoRaManager)
+enum class RadioEventType : uint8_t {
+    TX_DONE = 0,
+    TX_TIMEOUT = 1,
+    RX_DONE = 2,
+    RX_ERROR = 3,
+    TX_ABORTED = 4,          // Frame cut off for the emergency beacon
+    EMERGENCY_DONE = 5       // Beacon off the air (or timed out) - airtime only
+};
+
+enum class RadioState : uint8_t {
+    IDLE = 0,
+    RECEIVING = 1,
+    TRANSMITTING = 2,
+    SLEEPING = 3,
+    CHANNEL_SCAN = 4         // CAD running before a transmission
+};
+
+// Data rate + power combination chosen by the ADR controller. An FSK burst
+// keeps the LoRa settings it returns to
+struct LinkRate {
+    int spreadingFactor;
+    long bandwidth;
+    int codingRate;
+    int txPower;
+    uint32_t fskBitrate;     // bps, 0 = LoRa
+    uint8_t fixedFrameBytes; // Implicit header frame length, 0 = explicit header
+    uint8_t preambleLength;  // Symbols, 0 = LORA_PREAMBLE_LEN
+};
+
+// Smallest fixed frame the profile may use: a selective ACK with the clock
+// extension and the emergency beacon have to fit, plus the length byte
+#define LORA_FIXED_FRAME_MIN_BYTES  32
+static_assert(LORA_FIXED_FRAME_BYTES >= LORA_FIXED_FRAME_MIN_BYTES && LORA_FIXED_FRAME_BYTES <= MAX_PACKET_SIZE,
+              "LORA_FIXED_FRAME_BYTES out of range");
+
+enum class RateChangeState : uint8_t {
+    IDLE = 0,
+    REQUESTED = 1,           // RATE_CHANGE queued, waiting for its ACK
+    SWITCHING = 2            // Confirmed, applied once the radio is idle
+};
+
+// Raw frame handed to the radio task for transmission
+struct RadioFrame {
+    uint8_t data[MAX_PACKET_SIZE];
+    size_t length;
+    uint16_t sequenceNumber; // Queued packet this frame carries
+    bool tracked;            // False for ACK/NACK frames
+    uint32_t timeOnAirMs;    // Expected airtime at the settings it was queued with
+    uint8_t channel;         // Hop channel index, LORA_CHANNEL_FIXED when not hopping
+    bool clockSync;          // An ACK carrying a LinkClock extension
+};
+
+struct RadioEvent {
+    RadioEventType type;
+    uint32_t timestamp;      // millis() when the event was raised
+    int64_t timeUs;          // TX/RX done - nowUs() of the interrupt
+    uint32_t airtime;        // TX only - measured time on air in ms
+    uint16_t sequenceNumber; // TX only - copied from RadioFrame
+    bool tracked;            // TX only - copied from RadioFrame
+    bool clockSync;          // TX only - copied from RadioFrame
+    int8_t rssi;             // RX only
+    int8_t snr;              // RX only
+    size_t length;           // RX - received frame length; TX - the frame's, while capturing
+    uint8_t channel;         // Channel the frame arrived or went out on
+    uint8_t data[MAX_PACKET_SIZE];
+};
+
+// A received frame ahead of the link layer - true when the filter takes it
+// (receive diversity, base_station_diversity.h)
+typedef bool (*RxFrameFilter)(void* context, const RadioEvent& event);
+
+// Builds a frame straight into its TX buffer, CRC accumulated while copying -
+// or, with LINK_AUTH_ENABLED, sealed in place by frameFinish()
+struct FrameWriter {
+    uint8_t* buffer;
+    size_t capacity;
+    size_t length;           // Bytes written so far, trailer excluded
+    size_t headerLength;     // Where the payload starts
+    uint16_t crc;
+    uint8_t deviceId;
+    bool overflow;
+};
+
 struct QueuedPacket {
     Packet packet;
     Priority priority;
     uint32_t enqueueTime;
     uint8_t transmitAttempts;
     uint32_t lastTransmitTime;
+    uint32_t firstTransmitTime;  // millis() of the first hand-off, for the latency stamp
     bool waitingForAck;
+    bool ackRequired;        // False for fire-and-forget frames (FEC chunks)
+    bool released;           // Slot freed out of order, skipped on dequeue
+    int16_t payloadHandle;   // Handed back on removal, LORA_PAYLOAD_UNOWNED if none
+};
+
+// Fixed-capacity ring buffer for one priority lane
+struct PriorityLane {
+    QueuedPacket slots[LORA_QUEUE_DEPTH];
+    uint16_t head;           // Oldest occupied slot
+    uint16_t count;          // Occupied slots, including released ones
+    uint16_t pending;        // Packets still waiting for delivery
+    uint16_t highWaterMark;  // Peak pending count since reset
+    uint32_t dropCount;      // Packets dropped on overflow
+    uint32_t supersededCount;    // Replaced by a newer one, or retries cancelled as stale
 };
 
 // ===========================
@@ -74,14 +295,31 @@ private:
     long currentBandwidth;
     int currentTxPower;
     
+    // Link role - the bulk link has its own module, radio task and ledger loads
+    LinkRole role;
+    TaskId radioTaskId;
+    EnergyLoad txLoad;
+    EnergyLoad rxLoad;
+    bool localLoads;             // Off for a simulated link's far end - see setLocalLoads()
+    
     // Packet management
     uint16_t nextSequenceNumber;
+    portMUX_TYPE sequenceLock;   // The radio task numbers the emergency beacon
+    LoRaManager* sequenceSource; // Numbers taken from this link instead, nullptr for our own
     uint8_t deviceId;
     
-    // Priority queues
-    static const int MAX_QUEUE_SIZE = 10;
-    QueuedPacket priorityQueues[5][MAX_QUEUE_SIZE];  // 5 priority levels
-    int queueSizes[5];  // Current size of each queue
+    // Priority queues (ring buffer per lane)
+    static const int MAX_QUEUE_SIZE = LORA_QUEUE_DEPTH;
+    static const int QUEUE_INDEX_MASK = MAX_QUEUE_SIZE - 1;
+    static const int NUM_PRIORITY_LANES = 5;
+    static_assert((MAX_QUEUE_SIZE & QUEUE_INDEX_MASK) == 0, "LORA_QUEUE_DEPTH must be a power of two");
+    PriorityLane priorityQueues[NUM_PRIORITY_LANES];  // 5 priority levels
+    
+    // Minimum lane shares - every lane with something eligible earns its
+    // share of each frame's airtime and spends it when served
+    int32_t laneCreditUs[NUM_PRIORITY_LANES];
+    uint8_t laneEligibleMask;    // Lanes with a frame getNextPacket() could have sent
+    uint32_t laneShareServes[NUM_PRIORITY_LANES];    // Served ahead of a higher lane on credit
     
     // Transmission state
     bool transmitting;
@@ -94,10 +332,67 @@ private:
     static const int MAX_RETRIES = 3;
     static const uint32_t ACK_TIMEOUT_MS = 2000U;
     
+    // Airtime budget (token bucket per channel, refilled at the duty cycle rate)
+    int32_t airtimeTokensUs[LORA_HOP_CHANNEL_COUNT];
+    uint32_t lastAirtimeRefill;
+    uint32_t airtimeUsedUs;
+    uint32_t dutyCycleDeferrals;
+    
+    // Selective-repeat ARQ (window 1 = stop-and-wait)
+    uint8_t arqWindowSize;
+    uint8_t arqOutstanding;      // Sequence numbers sent but not yet ACKed or dropped
+    bool autoAckEnabled;         // Receiver side - ACK every data frame with a bitmap
+    bool rxWindowValid;
+    uint16_t rxNewestSequence;
+    uint32_t rxSequenceBitmap;   // Bit i set = (rxNewestSequence - 1 - i) received
+    bool ackHeld;                // Receiver side - an ACK owed, held for the rest of a run
+    uint32_t ackDueAt;
+    uint8_t ackHeldFrames;       // Frames it covers so far
+    uint32_t acksSent;
+    uint32_t acksPiggybacked;    // Of those, carried in front of a frame of ours
+    uint32_t ackFramesHeld;      // Frames answered later, with the rest of their run
+    bool ackTurnaround;          // Sender side - ACKs owed, the peer may be answering
+    bool ackTurnaroundHeld;      // A handoff already waited on this one
+    uint32_t ackTurnaroundHoldMs; // 0 after a run's last frame, LORA_ACK_HOLD_MS within a run
+    uint32_t ackTurnaroundFrom;  // Earliest its ACK can go out
+    uint32_t ackTurnaroundUntil;
+    uint32_t ackTurnaroundWaits; // Turnarounds that held a handoff back
+    
+    // Adaptive data rate
+    bool adaptiveModeEnabled;
+    LinkRate adrCandidate;       // Last controller pick
+    uint8_t adrCandidateCount;   // Consecutive evaluations agreeing on it
+    uint8_t signalSamples;       // History entries taken at the current rate
+    int8_t peerRssi;             // Our RSSI as reported back in the last ACK
+    uint8_t ackTimeoutStreak;
+    LinkQualityEstimator linkQuality;  // Delivery ratio per rate, from ACK outcomes
+    LinkClock linkClock;         // Peer's clock, from ACK timestamps
+    RateChangeState rateChangeState;
+    LinkRate pendingRate;
+    uint16_t rateChangeSequence;
+    uint8_t rateChangePayload[8];
+    uint32_t rateChangeTime;
+    uint32_t rateChanges;
+    uint32_t rateFallbacks;
+    
+    // FSK burst - camera frames over (G)FSK while the margin allows, LoRa for the rest
+    volatile uint32_t fskBitrate;    // 0 = LoRa; the radio task skips CAD in FSK
+    uint32_t fskBurstStart;
+    uint32_t fskBackoffUntil;        // No new burst before this millis() after one failed
+    uint32_t fskBursts;
+    uint32_t fskBurstFailures;
+    
+    // Fixed-frame profile - implicit header LoRa while only small frames are queued
+    volatile uint8_t fixedFrameBytes;  // 0 = explicit header; the radio task holds off for the tail
+    uint32_t fixedFramesStart;
+    uint32_t fixedBackoffUntil;      // No new profile before this millis() after one failed
+    uint32_t fixedFrameSessions;
+    uint32_t fixedFrameFailures;
+    
     // Signal quality monitoring
-    static const int RSSI_HISTORY_SIZE = 10;
-    int8_t rssiHistory[RSSI_HISTORY_SIZE];
-    int8_t snrHistory[RSSI_HISTORY_SIZE];
+    static constexpr int SIGNAL_HISTORY_SIZE = 10;
+    int8_t rssiHistory[SIGNAL_HISTORY_SIZE];
+    int8_t snrHistory[SIGNAL_HISTORY_SIZE];
     int rssiIndex;
     int snrIndex;
     int8_t lastRssi;
@@ -109,24 +404,226 @@ private:
     uint32_t crcErrorCount;
     uint32_t ackTimeoutCount;
     
+    // Radio engine (DIO0 interrupt + dedicated FreeRTOS task)
+    RadioDriver* radio;
+    TaskHandle_t radioTaskHandle;
+    QueueHandle_t txFrameQueue;
+    QueueHandle_t radioEventQueue;
+    SemaphoreHandle_t radioMutex;
+    volatile RadioState radioState;
+    PowerLock radioPowerLock;       // No light sleep while DIO0 can fire - the edge would be missed
+    uint32_t radioTxStartTime;
+    uint16_t radioTxSequence;
+    uint16_t inFlightBatch[LORA_MAX_AGGREGATE_RECORDS];  // Sequences in the frame on air
+    uint8_t inFlightBatchCount;
+    uint32_t aggregateFramesSent;
+    uint32_t aggregatedRecordsSent;
+    uint32_t radioTxDeadline;
+    bool radioTxTracked;
+    bool radioTxClockSync;
+    const RadioFrame* radioTxCurrent;   // Frame on air, copied into its TX done while capturing
+    uint8_t txFramesPending;
+    uint32_t lastAirtime;
+    uint32_t framesTransmitted;
+    uint32_t framesReceived;
+    uint32_t firstTransmitTime;      // millis() of the first TX done since boot - on a wake, wake to transmit
+    
+    // Emergency beacon (armed from any task, sent by the radio task)
+    EmergencyBeacon emergencyBeacon;
+    portMUX_TYPE emergencyLock;
+    volatile bool emergencyActive;
+    volatile uint32_t emergencyRequestedUs;   // micros() of the trigger not yet on air, 0 if none
+    uint32_t emergencyNextAt;        // Radio task: millis() of the next repeat
+    uint8_t emergencyRepeat;         // Radio task: beacons sent since armed
+    RadioFrame emergencyFrame;       // Radio task
+    bool radioTxEmergency;           // Radio task: the frame on air is the beacon
+    uint32_t radioTxTailMs;          // Radio task: peer still demodulating a short fixed frame after TX done
+    uint32_t radioQuietUntil;        // Radio task: no new frame before this millis()
+    int radioTxPower;                // The PA's power now - txPower, or under it while the power arbiter caps
+    volatile uint32_t emergencyBeaconsSent;
+    volatile uint32_t emergencyLatencyUs;     // Trigger to the start of transmission, last and worst
+    volatile uint32_t emergencyWorstLatencyUs;
+    volatile uint32_t txPreemptions;          // Frames cut off by the beacon
+    
+    // Listen before talk (radio task owned, counters read by the loop task)
+    RadioFrame radioTxFrame;         // Frame waiting for a clear channel
+    bool radioTxFramePending;
+    volatile bool lbtEnabled;
+    uint8_t lbtAttempts;
+    uint32_t lbtScanStart;
+    uint32_t lbtBackoffUntil;
+    volatile uint32_t lbtScans;
+    volatile uint32_t lbtBusyCount;
+    volatile uint32_t lbtForcedTransmits;
+    volatile uint32_t lbtBackoffTotalMs;
+    volatile uint32_t arbiterDeferrals;       // Frames held back while a capture had the battery
+    volatile uint32_t lbtBusyHistogram[4];   // Frames sent after 0, 1, 2, 3+ busy scans
+    void (*onPacketReceivedCallback)(const Packet& packet);
+    void (*onLinkPacketCallback)(const Packet& packet);
+    void (*onFrameTapCallback)(const RadioEvent& event);
+    RxFrameFilter rxFrameFilter;
+    void* rxFilterContext;
+    volatile LinkCaptureSink captureSink;
+    void* captureContext;
+    PayloadReleaseHandler payloadReleaseHandler;
+    void* payloadReleaseContext;
+    PayloadEventHandler payloadEventHandler;
+    void* payloadEventContext;
+    PacketSpillHandler spillHandler;
+    PayloadReleaseHandler backlogReleaseHandler;
+    void* backlogContext;
+    SupersedeHandler supersedeHandler;
+    RetransmitHandler retransmitHandler;
+    void* freshnessContext;
+    uint8_t txHeaderVersion;     // Negotiated from the version the peer offers
+    RadioFrame txFrame;          // Scratch frame for the loop task, keeps it off the stack
+    RadioEvent rxEvent;
+    
+    // Frequency hopping - the channel follows the newest sequence the base station ACKed
+    bool hoppingEnabled;
+    uint16_t hopKey;             // Sequence the current channel is derived from
+    uint16_t hopPreviousKey;     // Base station: fallback if our last ACK never arrived
+    bool hopKeyValid;
+    bool hopResync;              // Balloon: lost the base station, back on the home channel
+    uint8_t hopLastRxChannel;    // Base station: replies go where the balloon is listening
+    uint8_t hopDwellPhase;       // Base station: 0 current, 1 previous, 2 home
+    uint32_t hopDwellStart;
+    uint32_t hopChanges;
+    uint32_t hopResyncs;
+    uint8_t radioChannel;        // Radio task: channel the module is tuned to
+    volatile uint8_t radioRxChannel;  // Channel to listen on between frames
+    
+    // Time-slotted transmission (slot = deviceId % LORA_TDMA_SLOT_COUNT)
+    bool tdmaEnabled;           // Slot time is Clock()'s UTC, else the base station's through linkClock
+    uint32_t tdmaSlotLastHeard[LORA_TDMA_SLOT_COUNT];  // Base station - last frame per slot
+    uint32_t tdmaSlotsHeard;     // Bit per slot with a frame since boot
+    bool tdmaReceiverAsleep;
+    uint32_t tdmaSlotDeferrals;  // Handoffs held back for the next slot
+    uint32_t tdmaReceiverSleeps;
+    bool tdmaDeferring;
+    
+    // Scheduled RX windows (balloon) - receiver sleeps between transmit windows
+    bool rxWindowsEnabled;
+    uint32_t rxWindowUntil;      // Keep listening until this millis()
+    bool rxWindowAsleep;         // Put to sleep by the scheduler, not by sleep()
+    bool rxWindowWaking;
+    uint32_t rxWindowWakeAt;     // Oscillator stable after this millis()
+    uint32_t rxWindowSleepStart;
+    uint32_t rxWindowSleeps;
+    uint32_t rxWindowSleepMs;    // Completed sleeps since rxWindowSince
+    uint32_t rxWindowSince;
+    
+    // Camera FEC transfer (chunks fed into the camera lane as it drains)
+    FecEncoder cameraEncoder;
+    FecDecoder cameraDecoder;
+    PacketType cameraTransferType;
+    size_t cameraNextChunk;
+    bool cameraTransferActive;
+    uint16_t nextImageId;
+    uint32_t fecChunksSent;
+    void (*onImageReceivedCallback)(uint16_t imageId, const uint8_t* data, size_t length);
+    
     // Private methods
     bool initLoRaModule();
     void configureLoRaSettings();
-    bool transmitPacket(const Packet& packet);
-    bool receivePacket(Packet& packet);
-    void processIncomingPacket();
-    void handleAck(const Packet& ack);
+    bool transmitPacket(const Packet& packet, bool clockSync = false);
+    bool queueFrame(RadioFrame& frame);
+    void handleAck(const Packet& ack, int64_t rxUs);
     void handleNack(const Packet& nack);
     void updateSignalQuality(int8_t rssi, int8_t snr);
     void adaptTransmissionSettings();
-    uint16_t calculateCRC16(const uint8_t* data, size_t length);
+    bool estimateLinkMargin(float& margin) const;
+    LinkRate chooseLinkRate(float margin) const;
+    LinkRate currentLinkRate() const;
+    void recordLinkOutcome(bool delivered, int count = 1);
+    int aggregateLimit() const;
+    uint8_t cameraParityChunks() const;
+    bool requestRateChange(const LinkRate& rate);
+    bool handleRateChange(const Packet& request);
+    void applyLinkRate(const LinkRate& rate);
+    void checkLinkFallback();
+    void updateFskBurst();
+    size_t fskBurstFrames() const;
+    float fskMarginDb(float loraMargin) const;
+    void updateFixedFrames();
+    size_t fixedFrameCapacity() const { return fixedFrameBytes ? fixedFrameBytes - 1 : MAX_PACKET_SIZE; }
+    bool queuedFramesFit(size_t capacity) const;
+    int qualitySpreadingFactor() const { return fskBitrate ? LINK_QUALITY_FSK_SF : currentSpreadingFactor; }
     bool validatePacket(const Packet& packet);
     void addToQueueInternal(const QueuedPacket& queuedPacket);
     QueuedPacket* getNextPacket();
-    void removePacketFromQueue(Priority priority, int index);
+    QueuedPacket* laneCandidate(int lane, bool windowOpen, bool& deferred);
+    void chargeLane(int lane, uint32_t airtimeUs);
+    void refillAirtimeBudget();
+    uint32_t telemetryCycleAirtimeUs() const;
+    QueuedPacket* findQueuedPacket(uint16_t sequenceNumber, Priority& priority, int& slot);
+    bool acknowledgeSequence(uint16_t sequenceNumber);
+    void checkAckTimeouts();
+    void recordReceivedSequence(uint16_t sequenceNumber);
+    int collectAggregate(QueuedPacket* first, QueuedPacket** batch, int maxRecords);
+    bool transmitNext(bool carryAck);
+    bool transmitAggregate(QueuedPacket** batch, int count, bool more = false, bool carryAck = false);
+    bool moreFramesFollow(QueuedPacket** batch, int count, size_t frameBytes) const;
+    void scheduleAck(bool moreFollow);
+    void continueAckRun(bool moreFollow);
+    uint32_t ackTurnaroundMs() const;
+    void armAckTurnaround(uint32_t frameEnd);
+    void sendHeldAck();
+    void ackSent();
+    static size_t aggregateRecordSize(const Packet& packet);
+    void stampLatency(QueuedPacket& qp, uint32_t now);
+    void handleAggregate(const Packet& aggregate);
+    void deliverPacket(const Packet& packet);
+    bool startCameraTransfer(PacketType type, const uint8_t* data, size_t length);
+    void pumpCameraTransfer();
+    bool cameraChunksQueued() const;
+    void handleFecChunk(const Packet& chunk);
+    bool gpsTimeSynced() const;
+    bool networkTimeMs(uint64_t& now) const;
+    uint32_t msUntilSlot(uint8_t slot, uint32_t& remainingMs) const;
+    bool tdmaSlotOpen(size_t frameBytes);
+    void updateRxWindow();
+    bool rxWindowReady();
+    void updateSlotReceiver();
+    uint8_t txChannel() const;
+    int32_t& airtimeBucket(uint8_t channel) { return airtimeTokensUs[channel == LORA_CHANNEL_FIXED ? 0 : channel]; }
+    void updateHopKey(uint16_t key);
+    void setReceiveChannel(uint8_t channel);
+    void updateHopDwell();
+    void removePacketFromQueue(Priority priority, int slot);
+    void releasePayload(QueuedPacket& queuedPacket);
+    void spillPacket(const QueuedPacket& queuedPacket);
+    bool supersedeQueued(const QueuedPacket& queuedPacket);
+    bool isStaleRetry(const QueuedPacket& queuedPacket, uint32_t now);
+    void notifyPayload(const QueuedPacket& queuedPacket, PayloadEvent event);
+    void compactLaneHead(PriorityLane& lane);
+    static int laneIndex(Priority priority) { return static_cast<int>(priority) - 1; }
+    
+    // Radio engine
+    bool startRadioTask();
+    void stopRadioTask();
+    static void radioTaskEntry(void* parameter);
+    static void radioIrqEntry(void* context, bool fromIsr);
+    void radioTaskLoop();
+    void lockRadio();
+    void unlockRadio();
+    void radioStartTransmit(const RadioFrame& frame);
+    void radioHandleDio0();
+    void setRadioState(RadioState state);       // Every change, so the energy ledger sees it
+    void radioStartReceive();
+    void radioTune(uint8_t channel);
+    void radioStartChannelScan();
+    void radioChannelBusy();
+    void radioSendPendingFrame();
+    void radioSendEmergency();
+    uint16_t takeSequenceNumber();
+    void postRadioEvent(const RadioEvent& event);
+    void processRadioEvents();
+    void handleReceivedFrame(const RadioEvent& event);
+    void captureFrame(LinkCaptureKind kind, uint16_t sequenceNumber, const RadioEvent* event);
     
 public:
-    LoRaManager();
+    explicit LoRaManager(LinkRole linkRole = LinkRole::PRIMARY);
     ~LoRaManager();
     
     // Initialization
@@ -134,6 +631,15 @@ public:
     void end();
     bool reinitialize();
     
+    // Swap the transceiver (e.g. a SimulatedRadio) - only while stopped
+    bool setRadioDriver(RadioDriver* driver);
+    
+    // Number frames from source's counter, so a receiver deduplicating and
+    // reordering per device sees one sequence space across both links.
+    // Before begin()
+    void shareSequenceNumbers(LoRaManager* source) { sequenceSource = source; }
+    LinkRole getRole() const { return role; }
+    
     // Configuration
     bool setFrequency(long freq);
     bool setSpreadingFactor(int sf);
@@ -146,38 +652,136 @@ public:
     int getSpreadingFactor() const { return spreadingFactor; }
     long getBandwidth() const { return bandwidth; }
     int getTxPower() const { return txPower; }
+    float getTransmitCurrentMa() const;     // Draw at the current TX power, for energy estimates
     
     // Packet operations
-    bool sendPacket(const Packet& packet, Priority priority);
+    bool sendPacket(const Packet& packet, Priority priority, bool ackRequired = true,
+                    int16_t payloadHandle = LORA_PAYLOAD_UNOWNED);
     bool sendTelemetry(const uint8_t* data, size_t length);
     bool sendGPSData(const uint8_t* data, size_t length);
     bool sendCameraThumbnail(const uint8_t* data, size_t length);
+    bool sendCameraImage(const uint8_t* data, size_t length);
     bool sendStatus(const uint8_t* data, size_t length);
     bool sendEmergency(const uint8_t* data, size_t length);
     
+    // Any task. send arms the beacon and has the radio task put it on air
+    // now; update only changes what the repeats carry
+    bool sendEmergencyBeacon(const EmergencyBeacon& beacon);
+    void updateEmergencyBeacon(const EmergencyBeacon& beacon);
+    void stopEmergencyBeacon();
+    bool isEmergencyBeaconActive() const { return emergencyActive; }
+    uint32_t getEmergencyBeaconsSent() const { return emergencyBeaconsSent; }
+    uint32_t getEmergencyLatencyUs() const { return emergencyLatencyUs; }
+    uint32_t getEmergencyWorstLatencyUs() const { return emergencyWorstLatencyUs; }
+    uint32_t getTxPreemptions() const { return txPreemptions; }
+    
     // Queue management
     void addToQueue(const Packet& packet, Priority priority);
     bool processQueue();
     void clearQueue();
     int getQueueSize(Priority priority) const;
     int getTotalQueueSize() const;
+    int getQueueHighWaterMark(Priority priority) const;
+    uint32_t getQueueDropCount(Priority priority) const;
+    uint32_t getLaneShareServes(Priority priority) const;    // Sent ahead of busier higher lanes on its share
+    bool canAccept(Priority priority) const;   // Lane has room without dropping its oldest
+    
+    // Called when a packet queued with a payload handle leaves the queue
+    // (ACKed, dropped or cleared); runs in the caller of processQueue
+    void setPayloadReleaseCallback(PayloadReleaseHandler handler, void* context);
+    void setPayloadEventCallback(PayloadEventHandler handler, void* context);
+    
+    // Store-and-forward: spill sees each ARQ packet dropped unacknowledged,
+    // release gets back the payloads queued with LORA_BACKLOG_HANDLE_BASE handles
+    void setBacklogCallbacks(PacketSpillHandler spill, PayloadReleaseHandler release, void* context);
+    
+    // Latest-value packets: a new one the supersede handler matches takes the
+    // place of the oldest queued one it makes redundant and cancels the rest;
+    // a retry the retransmit handler turns down is dropped, unspilled. Only
+    // packets queued with a payload handle (not the backlog's) are judged
+    void setFreshnessCallbacks(SupersedeHandler supersede, RetransmitHandler retransmit, void* context);
+    uint32_t getSupersededCount(Priority priority) const;
     
     // ACK/NACK handling
     void handleAcknowledgment(const Packet& ack);
     void sendAck(uint16_t sequenceNumber, uint8_t ackType, int8_t rssi, int8_t snr);
     void sendNack(uint16_t sequenceNumber, uint8_t nackType);
+    void sendSelectiveAck(uint16_t newestSequence, uint32_t bitmap, int8_t rssi);
+    
+    // Selective-repeat ARQ
+    bool setArqWindowSize(uint8_t windowSize);
+    uint8_t getArqWindowSize() const { return arqWindowSize; }
+    uint8_t getArqOutstanding() const { return arqOutstanding; }
+    void enableAutoAck(bool enable) { autoAckEnabled = enable; }
+    // Off for the far end of a simulated link: it runs in this build but on
+    // nobody's battery, so it leaves the ledger, power arbiter and watchdog
+    // to the real link
+    void setLocalLoads(bool enable) { localLoads = enable; }
+    
+    // Camera FEC transfer
+    bool isCameraTransferActive() const { return cameraTransferActive; }
+    uint32_t getFecChunksSent() const { return fecChunksSent; }
+    uint32_t getFecChunksRecovered() const { return cameraDecoder.getChunksRecovered(); }
     
     // Adaptive transmission
     void adaptTransmissionSettings(int8_t rssi, int8_t snr);
     void enableAdaptiveMode(bool enable);
     bool isAdaptiveModeEnabled() const;
+    bool getLinkMargin(float& margin) const { return estimateLinkMargin(margin); }
+    uint32_t getRateChangeCount() const { return rateChanges; }
+    uint32_t getRateFallbackCount() const { return rateFallbacks; }
+    const LinkQualityEstimator& getLinkQuality() const { return linkQuality; }
+    float getExpectedTransmissions() const;  // ETX at the current rate, 1 until known
+    bool isFskBurstActive() const { return fskBitrate != 0; }
+    uint32_t getFskBurstCount() const { return fskBursts; }
+    uint32_t getFskBurstFailures() const { return fskBurstFailures; }
+    bool isFixedFrameActive() const { return fixedFrameBytes != 0; }
+    uint32_t getFixedFrameSessions() const { return fixedFrameSessions; }
+    uint32_t getFixedFrameFailures() const { return fixedFrameFailures; }
+    
+    // Listen before talk
+    void enableListenBeforeTalk(bool enable) { lbtEnabled = enable; }
+    bool isListenBeforeTalkEnabled() const { return lbtEnabled; }
+    uint32_t getChannelBusyCount() const { return lbtBusyCount; }
+    
+    // Frequency hopping
+    void enableHopping(bool enable);
+    bool isHoppingEnabled() const { return hoppingEnabled; }
+    uint8_t getCurrentChannel() const { return txChannel(); }
+    uint32_t getHopCount() const { return hopChanges; }
+    
+    // Time-slotted transmission
+    void enableTdma(bool enable) { tdmaEnabled = enable; }
+    bool isTdmaEnabled() const { return tdmaEnabled; }
+    bool isTimeSynced() const;
+    const LinkClock& getLinkClock() const { return linkClock; }
+    uint8_t getDeviceId() const { return deviceId; }
+    uint8_t getSlotIndex() const { return deviceId % LORA_TDMA_SLOT_COUNT; }
+    uint32_t getSlotLengthMs() const;
+    uint32_t getSlotDeferrals() const { return tdmaSlotDeferrals; }
+    
+    // Scheduled RX windows
+    void enableRxWindows(bool enable);
+    bool isRxWindowsEnabled() const { return rxWindowsEnabled; }
+    uint32_t getRxWindowSleeps() const { return rxWindowSleeps; }
+    float getReceiverDutyCycle() const;  // Fraction of time listening since resetStatistics()
+    
+    // Time on air and duty cycle
+    uint32_t getTimeOnAirUs(size_t frameBytes) const;
+    uint32_t getAvailableAirtimeUs() const;
+    uint32_t getAirtimeUsedUs() const { return airtimeUsedUs; }
+    uint32_t getTransmitInterval(uint32_t baseInterval = LORA_TRANSMIT_INTERVAL_MS) const;
+    // Payload bytes the duty cycle leaves over periodMs once the telemetry cycle
+    // has had its airtime, sent payloadPerFrame at a time
+    size_t getBulkByteBudget(uint32_t periodMs, size_t payloadPerFrame, size_t overheadPerFrame = 0) const;
+    uint32_t getDutyCycleDeferrals() const { return dutyCycleDeferrals; }
     
     // Signal quality
     int8_t getLastRSSI() const { return lastRssi; }
     int8_t getLastSNR() const { return lastSnr; }
     int8_t getAverageRSSI() const;
     int8_t getAverageSNR() const;
-    float getPacketErrorRate() const;
+    float getPacketErrorRate() const;   // Recent lost fraction of ACKed records at the current rate
     
     // Status methods
     bool isReady() const;
@@ -185,14 +789,51 @@ public:
     bool isReceiving() const { return receiving; }
     uint32_t getLastTransmitTime() const;
     uint32_t getLastReceiveTime() const { return lastReceiveTime; }
+    RadioState getRadioState() const { return radioState; }
+    uint32_t getLastAirtime() const { return lastAirtime; }
+    uint32_t getFirstTransmitTime() const { return firstTransmitTime; }    // 0 before the first frame
+    uint8_t getHeaderVersion() const { return txHeaderVersion; }
+    
+    // Application callback for non-ACK/NACK packets (runs in the caller of processQueue)
+    void setPacketReceivedCallback(void (*callback)(const Packet&)) { onPacketReceivedCallback = callback; }
+    
+    // Frames the link layer consumes itself (FEC chunks, rate changes) - lets a
+    // receive pipeline account for their sequence numbers
+    void setLinkPacketCallback(void (*callback)(const Packet&)) { onLinkPacketCallback = callback; }
+    
+    // Every frame off the radio as received, before parsing - raw capture for replay
+    void setFrameTapCallback(void (*callback)(const RadioEvent&)) { onFrameTapCallback = callback; }
+    
+    // Sees each RX_DONE ahead of the link layer; a frame it takes reaches the
+    // link layer only through receiveFrame(), if at all. nullptr removes it
+    void setRxFrameFilter(RxFrameFilter filter, void* context);
+    // A received frame into the link layer, as if just off the radio - the
+    // task running processQueue() only
+    void receiveFrame(const RadioEvent& event);
+    
+    // Every frame sent and received, and each packet's ACK, timeout or drop,
+    // as pcap records (link_capture.h); nullptr stops it
+    void setCaptureSink(LinkCaptureSink sink, void* context);
+    bool isCapturing() const { return captureSink != nullptr; }
+    
+    // Called once per camera image rebuilt from FEC chunks
+    void setImageReceivedCallback(void (*callback)(uint16_t, const uint8_t*, size_t)) { onImageReceivedCallback = callback; }
     
     // Statistics
     uint32_t getTransmitErrorCount() const { return transmitErrorCount; }
     uint32_t getReceiveErrorCount() const { return receiveErrorCount; }
     uint32_t getCrcErrorCount() const { return crcErrorCount; }
     uint32_t getAckTimeoutCount() const { return ackTimeoutCount; }
+    uint8_t getAckTimeoutStreak() const { return ackTimeoutStreak; }      // ACK rounds timed out since the last ACK
     void resetStatistics();
     
+    // Across deep sleep - sequence, negotiated rate and hop key; restore before begin()
+    void saveRetained(RtcLinkState& state) const;
+    bool restoreRetained(const RtcLinkState& state);
+    // For a crash checkpoint - up to max small telemetry, position, alert and
+    // status payloads still queued, highest priority first; returns the count
+    uint8_t saveQueue(RtcQueuedFrame* frames, uint8_t max) const;
+    
     // Power management
     void enterLowPowerMode();
     void exitLowPowerMode();
@@ -212,6 +853,11 @@ public:
 // ===========================
 
 extern LoRaManager& LoRaComm();
+extern LoRaManager& BulkLoRa();                 // Never begun when its module isn't fitted
+
+// The link a payload of this priority goes out on: images and status (the
+// backlog) on the bulk link while it's up, everything else on LoRaComm()
+LoRaManager& LoRaLink(Priority priority);
 
 // ===========================
 // Utility Functions
@@ -220,8 +866,30 @@ extern LoRaManager& LoRaComm();
 Packet createPacket(PacketType type, const uint8_t* payload, size_t length);
 uint16_t calculatePacketCRC(const Packet& packet);
 bool serializePacket(const Packet& packet, uint8_t* buffer, size_t& length);
+void frameBegin(FrameWriter& writer, uint8_t* buffer, size_t capacity, const LoRaPacketHeader& header,
+                PacketType type, uint16_t sequenceNumber);
+bool frameAppend(FrameWriter& writer, const uint8_t* data, size_t length);
+bool frameFinish(FrameWriter& writer, size_t& length);
+bool verifyFrameCRC(const uint8_t* buffer, size_t length);    // A sealed frame's tag, without opening it
+bool isFrameSealed(const uint8_t* buffer, size_t length);
+size_t serializedPacketSize(const Packet& packet);
+size_t frameHeaderSize(uint8_t headerVersion);
+size_t encodeLatencyStamp(const LatencyStamp& stamp, uint8_t* out);
+size_t encodeEmergencyBeacon(const EmergencyBeacon& beacon, uint8_t repeat, uint8_t* out);
+bool decodeEmergencyBeacon(const uint8_t* data, size_t length, EmergencyBeacon& beacon, uint8_t& repeat);
+size_t decodeLatencyStamp(const uint8_t* data, size_t length, LatencyStamp& stamp);   // 0 if truncated
+size_t encodeFrameHeader(const LoRaPacketHeader& header, PacketType type, uint16_t sequenceNumber,
+                         uint8_t* out);
+uint32_t calculateTimeOnAirUs(size_t frameBytes, int spreadingFactor, long bandwidth,
+                              int codingRate, int preambleLength, bool implicitHeader = false);
+uint32_t calculateFskTimeOnAirUs(size_t frameBytes, uint32_t bitrate);
+float demodulatorFloorDb(int spreadingFactor);
+uint8_t hopChannelForSequence(uint16_t sequenceNumber);
+long hopChannelFrequency(uint8_t channel);
 bool deserializePacket(const uint8_t* buffer, size_t length, Packet& packet);
 const char* packetTypeToString(PacketType type);
 const char* priorityToString(Priority priority);
+const char* radioStateToString(RadioState state);
+const char* linkRoleToString(LinkRole role);
 
 #endif // LORA_COMM_H
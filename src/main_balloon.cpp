@@ -21,8 +21,49 @@
 #include "lora_comm.h"
 #include "power_manager.h"
 #include "packet_handler.h"
+#include "fragment_transfer.h"
+#include "image_store.h"
+#include "image_metadata.h"
+#include "flight_recorder.h"
 #include "system_state.h"
 #include "debug_utils.h"
+#include "crc_utils.h"
+#include "image_scale.h"
+#include "jpeg_dc.h"
+#include "baro_altitude.h"
+#include "metrics.h"
+#include "task_placement.h"
+#include "time_service.h"
+#include "energy_ledger.h"
+#include "power_scaling.h"
+#include "rtc_state.h"
+#include "crash_report.h"
+#include "power_planner.h"
+#include "ulp_monitor.h"
+#include "uplink_queue.h"
+#include "link_backlog.h"
+#include "job_scheduler.h"
+#include "cadence_profile.h"
+#include "report_deadband.h"
+#include "stage_profiler.h"
+#include "trace_buffer.h"
+#include "memory_ledger.h"
+#include "memory_arena.h"
+#include "perf_probe.h"
+#include "command_dispatch.h"
+#include "firmware_update.h"
+#include "geofence.h"
+#include "boot_sequence.h"
+#include "task_watchdog.h"
+#include "link_capture.h"
+#include "track_history.h"
+#include "pipeline.h"
+#include "image_downlink.h"
+#include "sd_recorder.h"
+#include "balloon_ap.h"
+#include "usb_dump.h"
+#include "power_arbiter.h"
+#include "runtime_config.h"
 
 // Forward declarations for missing types
 struct PowerData {
@@ -46,12 +87,29 @@ struct PowerData {
 
 // Timing Constants
 #define SETUP_DELAY_MS           1000
-#define MAIN_LOOP_INTERVAL_MS    100     // 10 Hz main loop
+#define MAIN_LOOP_INTERVAL_MS    100     // 10 Hz sense job, before the phase scaling
+#define UPLINK_TASK_PERIOD_MS    20      // Longest the uplink task sleeps without a post
+#define CAPTURE_PIPELINE_IDLE_MS 1000    // Longest the capture pipeline sleeps before reading its interval again
+#define SUPERVISOR_INTERVAL_MS   500     // loop()
 #define TELEMETRY_INTERVAL_MS    5000    // 5 seconds
 #define HEARTBEAT_INTERVAL_MS   30000   // 30 seconds
 #define STATUS_REPORT_INTERVAL_MS 60000   // 1 minute
 #define PERFORMANCE_INTERVAL_MS   10000   // 10 seconds
 
+// Subsystem bring-up, in initializeSubsystems()'s table order
+enum class BootStep : uint8_t {
+    POWER = 0,
+    LORA,
+    PACKETS,
+    FRAGMENTS,
+    RECORDER,
+    STATE,
+    SENSORS,
+    COUNT
+};
+
+#define BOOT_STEP_COUNT static_cast<uint8_t>(BootStep::COUNT)
+
 // ===========================
 // Application State
 // ===========================
@@ -59,10 +117,6 @@ struct PowerData {
 struct AppState {
     bool initialized;
     uint32_t startTime;
-    uint32_t lastTelemetryTime;
-    uint32_t lastHeartbeatTime;
-    uint32_t lastStatusReportTime;
-    uint32_t lastPerformanceTime;
     uint32_t loopCounter;
     uint32_t lastLoopTime;
     
@@ -71,10 +125,13 @@ struct AppState {
     bool debugMode;
     bool lowPowerMode;
     bool emergencyMode;
+    bool wakeBoot;          // Deep sleep wake with RTC state: one telemetry cycle, then back to sleep
+    bool resumeBoot;        // Crash mid-flight with a checkpoint: short bring-up, then the flight carries on
+    volatile bool cameraStopRequested;  // Flight task -> uplink task: camera off for power
     
     // Data Collection State
     bool sensorsActive;
-    bool cameraActive;
+    volatile bool cameraActive;     // Wanted - the driver itself starts ahead of a capture
     bool communicationActive;
     bool gpsActive;
     
@@ -82,11 +139,27 @@ struct AppState {
     uint32_t maxLoopTime;
     uint32_t avgLoopTime;
     uint32_t loopTimeSum;
+    uint32_t loopTimeSamples;   // Wakes in loopTimeSum
     
     // Error Tracking
     uint32_t errorCount;
     uint32_t lastErrorTime;
     char lastErrorMessage[128];
+    
+    // Tasks
+    TaskHandle_t flightTask;
+    TaskHandle_t uplinkTask;
+    
+    // The flight task's jobs
+    JobId senseJob;
+    JobId telemetryJob;
+    JobId gpsJob;
+    JobId heartbeatJob;
+    JobId statusJob;
+    JobId performanceJob;
+    JobId linkRecordJob;
+    JobId trackJob;
+    JobId digestJob;
 };
 
 // ===========================
@@ -95,6 +168,16 @@ struct AppState {
 
 static AppState appState;
 
+// Loop and capture timing for /metrics, in ms
+static const uint32_t loopTimeBounds[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+static const uint32_t captureTimeBounds[] = {50, 100, 200, 500, 1000, 2000, 5000};
+static MetricHistogram loopTimeHistogram(loopTimeBounds, sizeof(loopTimeBounds) / sizeof(loopTimeBounds[0]));
+static MetricHistogram captureTimeHistogram(captureTimeBounds, sizeof(captureTimeBounds) / sizeof(captureTimeBounds[0]));
+
+// Full clock for an iteration, let go for the wait between them
+static PowerLock flightPowerLock("flight", PowerLockType::CPU_MAX);
+static PowerLock uplinkPowerLock("uplink", PowerLockType::CPU_MAX);
+
 // ===========================
 // Function Declarations
 // ===========================
@@ -102,8 +185,20 @@ static AppState appState;
 // Initialization Functions
 bool initializeHardware();
 bool initializeSubsystems();
+bool startCamera();
 bool configureSystem();
 bool performSystemChecks();
+void registerMetrics();
+void restoreRetainedState();
+
+// Tasks
+void startTasks();
+void flightTaskEntry(void* parameter);
+void uplinkTaskEntry(void* parameter);
+void runFlightIteration();
+void runUplinkIteration();
+void superviseTasks();
+void recordTaskStall(const TaskStallRecord& record);
 
 // Hardware Initialization Helper Functions
 bool initializeBoard();
@@ -115,20 +210,33 @@ bool checkHardwareStatus();
 void updateSystemState();
 void processSensors();
 void processCamera();
+void handleCapturedImage();
+void pumpCameraDownlink();
+void manageCameraPower(uint32_t captureInterval);
+uint32_t getCaptureInterval();
+bool startCapture(uint32_t captureInterval);
+void finishCapture(CaptureStatus status);
+#if PIPELINE_COROUTINES
+Pipe capturePipeline();
+#endif
 void processCommunications();
 void processPowerManagement();
 void processPacketHandling();
+void processWakeCycle();
+void processCheckpoint();
 
 // Timing Functions
-bool shouldSendTelemetry();
-bool shouldSendHeartbeat();
-bool shouldReportStatus();
-bool shouldUpdatePerformance();
+void registerJobs();
+uint32_t getTelemetrySlackUs();
 
 // Communication Functions
 void sendTelemetryData();
+void sendGpsReport();
+void sendTrackSegment();
 void sendHeartbeatPacket();
 void sendStatusReport();
+void sendDigest();
+bool isLowRateLink();
 void processIncomingCommands();
 
 // Utility Functions
@@ -140,8 +248,16 @@ bool checkSystemHealth();
 // Event Handlers
 void onSystemEvent(const SystemEvent& event);
 void onEmergencyTriggered(const char* reason);
+void onGeofenceEvent(const SystemEvent& event);
+EmergencyBeacon buildEmergencyBeacon(const char* reason);
 void onModeChanged(SystemMode newMode);
+void onConfigApplied(const RuntimeConfig& previous, const RuntimeConfig& current, void* context);
 void onFlightPhaseChanged(FlightPhase newPhase);
+void onLoRaPacketReceived(const Packet& packet);
+void onLoRaFrameCaptured(const RadioEvent& event);
+void onLinkCaptured(void* context, const LinkCaptureFrame& frame);
+void onProfileLevel(void* context, const ProfileLevel& level);
+void onDeepSleep(uint32_t durationMs);
 
 // ===========================
 // Arduino Main Functions
@@ -150,7 +266,16 @@ void onFlightPhaseChanged(FlightPhase newPhase);
 void setup() {
     // Initialize serial communication first
     Serial.begin(SERIAL_BAUD_RATE);
-    delay(SETUP_DELAY_MS);
+    
+    // A deep sleep wake with its RTC state intact takes the short path - no one is waiting on the
+    // console - and so does a crash mid-flight with a checkpoint to resume from
+    bool wakeBoot = Retained().begin();
+    bool resumeBoot = Retained().isResume();
+    UlpMon().begin();
+    CrashReport().begin();
+    if (!wakeBoot && !resumeBoot) {
+        delay(SETUP_DELAY_MS);
+    }
     
     Serial.println();
     Serial.println("========================================");
@@ -164,6 +289,7 @@ void setup() {
         Serial.println("FATAL: Failed to initialize debug system!");
         return;
     }
+    Trace().begin();
     
     SYS_INFO("System booting...");
     
@@ -173,6 +299,16 @@ void setup() {
     appState.lastLoopTime = appState.startTime;
     appState.maxLoopTime = 0;
     appState.avgLoopTime = MAIN_LOOP_INTERVAL_MS;
+    appState.wakeBoot = wakeBoot;
+    appState.resumeBoot = resumeBoot;
+    if (wakeBoot) {
+        Retained().printStatus();
+        UlpMon().printStatus();
+    }
+    if (CrashReport().isCrashBoot()) {
+        Retained().printStatus();
+        CrashReport().printStatus();
+    }
     
     // Initialize hardware
     if (!initializeHardware()) {
@@ -192,96 +328,224 @@ void setup() {
         return;
     }
     
-    // Perform system checks
-    if (!performSystemChecks()) {
+    // Perform system checks - a wake or resume boot's flight began with a full boot that ran them
+    if (!appState.wakeBoot && !appState.resumeBoot && !performSystemChecks()) {
         SYS_ERROR("System checks failed");
         return;
     }
     
+    registerJobs();
+    registerMetrics();
+    
     // Mark as initialized
     appState.initialized = true;
     SYS_INFO("System initialization complete");
+    Firmware().confirmBoot();
+    printMemoryMap();
+    
+    if (appState.wakeBoot) {
+        // Resume the flight where it slept, with the first telemetry due as soon as there's a reading
+        const RetainedState& retained = Retained().getState();
+        SysState().restoreFlightState(static_cast<SystemMode>(retained.mode),
+                                      static_cast<FlightPhase>(retained.flightPhase));
+        Scheduler().trigger(appState.telemetryJob);
+        SYS_INFO("Wake boot ready in %lu ms", millis());
+    } else if (appState.resumeBoot) {
+        // Crashed mid-flight - back in the checkpoint's phase, with what was queued and the report first
+        const RtcCheckpoint& checkpoint = Retained().getCheckpoint();
+        SysState().restoreFlightState(static_cast<SystemMode>(checkpoint.state.mode),
+                                      static_cast<FlightPhase>(checkpoint.state.flightPhase));
+        CrashReport().sendReport();
+        for (uint8_t i = 0; i < checkpoint.frameCount; i++) {
+            const RtcQueuedFrame& frame = checkpoint.frames[i];
+            PacketMgr().createPacket(static_cast<PacketType>(frame.type), (void*)frame.payload, frame.length);
+        }
+        Scheduler().trigger(appState.telemetryJob);
+        SYS_WARNING("Crash resume %u ready in %lu ms - %s, %u frames requeued", Retained().getResumeCount(),
+                    millis(), SysState().flightPhaseToString(SysState().getFlightPhase()), checkpoint.frameCount);
+    } else if (SysState().isFlightResumed()) {
+        // Reset mid-flight - carry on from the phase NVS kept
+        CrashReport().sendReport();
+        printSystemInfo();
+        SYS_WARNING("Reset in flight - resumed in %s, %s", SysState().modeToString(SysState().getMode()),
+                    SysState().flightPhaseToString(SysState().getFlightPhase()));
+    } else {
+        // Print system information
+        CrashReport().sendReport();
+        printSystemInfo();
+        
+        // Enter pre-flight mode
+        SysState().setMode(SystemMode::PRE_FLIGHT);
+        SysState().setFlightPhase(FlightPhase::GROUND);
+        
+        // Radio first - the ground hears the payload before the camera starts
+        Scheduler().trigger(appState.heartbeatJob);
+    }
     
-    // Print system information
-    printSystemInfo();
-    
-    // Enter pre-flight mode
-    SysState().setMode(SystemMode::PRE_FLIGHT);
-    SysState().setFlightPhase(FlightPhase::GROUND);
-    
-    SYS_INFO("System ready - entering main loop");
+    startTasks();
+    Watchdog().setStallHook(recordTaskStall);
+    Watchdog().begin(TASK_WATCHDOG_TIMEOUT_MS, TASK_WATCHDOG_RESET);
+    SYS_INFO("System ready - flight and uplink tasks running");
 }
 
+// Everything the flight runs on is in the flight and uplink tasks; loop() only watches them
 void loop() {
     if (!appState.initialized) {
         delay(1000);
         return;
     }
     
+    superviseTasks();
+    delay(SUPERVISOR_INTERVAL_MS);
+}
+
+// ===========================
+// Flight and Uplink Tasks
+// ===========================
+
+// Ownership: the flight task owns SysState(), Planner() and the flight
+// recorder's periodic records, and composes what to send; the uplink task
+// owns PacketMgr(), FragmentMgr()'s sending side, LoRaComm(), Camera() and
+// the power rails. Sensors publish snapshots from their own tasks, which
+// either side reads. The flight task only reaches the uplink task through
+// Uplink() posts and appState flags; anything it reads of the other side's
+// (queue depth, sequence, intervals) is a single word.
+//
+// A reading composed on the flight task's iteration is built into a packet
+// as soon as the uplink task is scheduled - on core 0 only the radio, RX and
+// link simulator tasks are above it - and handed to the radio in the same
+// pass, so sensor-to-queued time is one flight iteration plus the uplink
+// task's wake, not a super-loop pass behind a capture hand-off.
+
+void startTasks() {
+#if PIPELINE_COROUTINES
+    // Before the uplink task that resumes it is there
+    if (CAMERA_CAPTURE_PIPELINE && !Pipes().start("capture", capturePipeline())) {
+        SYS_ERROR("Capture pipeline not started");
+    }
+#endif
+    
+    // So setup()'s posts are built at once and the tasks' go through the ring
+    if (createPlacedTask(TaskId::UPLINK, uplinkTaskEntry, nullptr, &appState.uplinkTask) != pdPASS) {
+        SYS_ERROR("Uplink task not started");
+        return;
+    }
+    Uplink().setConsumer(appState.uplinkTask);
+    Pipes().setTask(appState.uplinkTask);
+    Watchdog().watch(TaskId::UPLINK, appState.uplinkTask, TASK_BUDGET_UPLINK_MS);
+    if (createPlacedTask(TaskId::FLIGHT, flightTaskEntry, nullptr, &appState.flightTask) != pdPASS) {
+        SYS_ERROR("Flight task not started");
+        return;
+    }
+    Scheduler().setTask(appState.flightTask);
+    Watchdog().watch(TaskId::FLIGHT, appState.flightTask, TASK_BUDGET_FLIGHT_MS);
+    
+    if (USB_DUMP_ENABLED && !Dump().begin()) {
+        SYS_WARNING("USB dump task not started");
+    }
+}
+
+void flightTaskEntry(void* parameter) {
+    for (;;) {
+        runFlightIteration();
+        Watchdog().beat(TaskId::FLIGHT);
+        Scheduler().wait();
+    }
+}
+
+void uplinkTaskEntry(void* parameter) {
+    for (;;) {
+        // A post or a pipeline event wakes it at once; the period keeps the radio queue and its ACK timeouts serviced
+        uint32_t waitMs = min((uint32_t)UPLINK_TASK_PERIOD_MS, Pipes().getTimeUntilNextMs());
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+        uplinkPowerLock.hold(true);
+        runUplinkIteration();
+        uplinkPowerLock.hold(false);
+        Watchdog().beat(TaskId::UPLINK);
+    }
+}
+
+// One wake of the flight task: whatever the scheduler has due
+void runFlightIteration() {
     uint32_t loopStartTime = millis();
+    flightPowerLock.hold(true);
     
     try {
-        // Feed watchdog
-        if (Debug.isWatchdogEnabled()) {
-            Debug.feedWatchdog();
-        }
-        
-        // Update system state
-        updateSystemState();
+        uint8_t ran = Scheduler().runDue();
         
-        // Process main subsystems
-        processSensors();
-        processCamera();
-        processCommunications();
-        processPowerManagement();
-        processPacketHandling();
-        
-        // Send periodic data
-        if (shouldSendTelemetry()) {
-            sendTelemetryData();
-        }
-        
-        if (shouldSendHeartbeat()) {
-            sendHeartbeatPacket();
-        }
-        
-        if (shouldReportStatus()) {
-            sendStatusReport();
-        }
-        
-        if (shouldUpdatePerformance()) {
-            updatePerformanceMetrics(millis() - loopStartTime);
-        }
-        
-        // Process incoming commands
-        processIncomingCommands();
-        
-        // Update loop statistics
-        appState.loopCounter++;
+        // Update loop statistics - wakes that ran something
         uint32_t loopTime = millis() - loopStartTime;
-        appState.lastLoopTime = loopTime;
-        
-        if (loopTime > appState.maxLoopTime) {
-            appState.maxLoopTime = loopTime;
-        }
-        
-        appState.loopTimeSum += loopTime;
-        if (appState.loopCounter % 100 == 0) {
-            appState.avgLoopTime = appState.loopTimeSum / 100;
-            appState.loopTimeSum = 0;
-        }
-        
-        // Maintain loop timing
-        if (loopTime < MAIN_LOOP_INTERVAL_MS) {
-            delay(MAIN_LOOP_INTERVAL_MS - loopTime);
+        if (ran) {
+            appState.loopCounter++;
+            appState.lastLoopTime = loopTime;
+            loopTimeHistogram.observe(loopTime);
+            
+            if (loopTime > appState.maxLoopTime) {
+                appState.maxLoopTime = loopTime;
+            }
+            
+            // Over the wakes actually summed, whatever loopCounter has been through
+            appState.loopTimeSum += loopTime;
+            if (++appState.loopTimeSamples >= 100) {
+                appState.avgLoopTime = appState.loopTimeSum / appState.loopTimeSamples;
+                appState.loopTimeSum = 0;
+                appState.loopTimeSamples = 0;
+            }
         }
-        
     } catch (...) {
-        SYS_ERROR("Exception in main loop");
-        handleSystemError("Main loop exception");
+        SYS_ERROR("Exception in flight task");
+        handleSystemError("Flight task exception");
+    }
+    
+    // Blocked until the next deadline, so with no lock held the clock drops and the chip may sleep
+    flightPowerLock.hold(false);
+}
+
+void runUplinkIteration() {
+    // What the flight task composed, before the radio is fed
+    {
+        StageScope scope(Stage::UPLINK_QUEUE);
+        Uplink().drain();
+    }
+    
+    Pipes().runDue();
+    processCamera();
+    processCommunications();
+    processPacketHandling();
+    processIncomingCommands();
+    
+    // Rails switched on ahead of their next use, the ground AP up or down with the phase
+    {
+        StageScope scope(Stage::RAILS);
+        PowerMgr().controlPowerRails();
+        AccessPoint().service();
+    }
+    
+    processCheckpoint();
+    processWakeCycle();
+}
+
+// Every task's heartbeat against its budget, the Task WDT fed while they keep to them
+void superviseTasks() {
+    static bool bootReported = false;
+    
+    Watchdog().supervise();
+    
+    // Boot to first packet, once the first frame is out and the background steps are through
+    if (!bootReported && LoRaComm().getFirstTransmitTime() && Boot().isFinished()) {
+        bootReported = true;
+        Boot().printReport();
+        SYS_INFO("First frame out %lu ms after reset, camera %s", LoRaComm().getFirstTransmitTime(),
+                 !appState.cameraActive ? "off" : Camera().isReady() ? "started" : "starting ahead of its capture");
     }
 }
 
+// On flash before the Task WDT can fire
+void recordTaskStall(const TaskStallRecord& record) {
+    FlightRec().record(FlightRecordType::TASK_STALL, reinterpret_cast<const uint8_t*>(&record), sizeof(record));
+    FlightRec().sync();
+}
+
 // ===========================
 // Initialization Functions
 // ===========================
@@ -299,8 +563,8 @@ bool initializeHardware() {
     initializeSensorPins();
     initializeCameraPins();
     
-    // Check hardware status
-    if (!checkHardwareStatus()) {
+    // Check hardware status - found on the full boot; a wake or resume doesn't probe it again
+    if (!appState.wakeBoot && !appState.resumeBoot && !checkHardwareStatus()) {
         SYS_WARNING("Some hardware issues detected");
     }
     
@@ -308,56 +572,186 @@ bool initializeHardware() {
     return true;
 }
 
-bool initializeSubsystems() {
-    SYS_INFO("Initializing subsystems...");
-    
-    // Initialize power management first
+// The camera driver for a capture coming, and the image store (flash log of
+// every capture) behind its first start. A camera that won't start stays off
+bool startCamera() {
+    if (!Camera().begin()) {
+        SYS_WARNING("Camera did not start - continuing without camera");
+        if (PowerMgr().isRailSwitchable(PowerRail::CAMERA)) {
+            PowerMgr().setRail(PowerRail::CAMERA, false);
+        }
+        appState.cameraActive = false;
+        return false;
+    }
+    PowerMgr().markRailReady(PowerRail::CAMERA);
+    SYS_INFO("Camera started in %lu ms (%u bytes of driver buffers)", Camera().getColdResumeTime(),
+             (unsigned)Camera().getDriverMemory());
+    
+    if (CAMERA_STORE_IMAGES && !ImageStoreMgr().isReady()) {
+        if (!ImageStoreMgr().begin()) {
+            SYS_WARNING("Image store initialization failed - images are not kept");
+        } else {
+            SYS_INFO("Image store initialized (%lu images)", ImageStoreMgr().getImageCount());
+        }
+    }
+    if (CAMERA_STORE_DOWNLINK && CAMERA_SEND_IMAGES && ImageStoreMgr().isReady() && !Downlink().begin()) {
+        SYS_WARNING("Stored image downlink not started");
+    }
+    if (SD_RECORDER_ENABLED && SD_CARD_FITTED && !SdRec().isReady() && !SdRec().begin()) {
+        SYS_WARNING("SD card not mounted - no time-lapse recording");
+    }
+    return true;
+}
+
+// ===========================
+// Boot Steps
+// ===========================
+
+// Core 1 brings up the radio path, core 0 the sensors alongside it. The
+// radio's chain is what the first frame waits on; the camera isn't a step at
+// all - it starts lazily once that frame is out (manageCameraPower()).
+
+bool bootPower() {
     if (!PowerMgr().begin()) {
         SYS_ERROR("Power manager initialization failed");
         return false;
     }
+    PowerMgr().setDeepSleepCallback(onDeepSleep);
+    if (PowerMgr().getBatteryAdc().isRunning()) {
+        Arbiter().begin(&PowerMgr().getBatteryAdc());
+    }
     SYS_INFO("Power manager initialized");
-    
-    // Initialize sensor manager
+    return true;
+}
+
+bool bootSensors() {
+    // Zones first, so the first fix is checked
+    if (GEOFENCE_ENABLED && Geofence().begin()) {
+        Sensors().setFixCallback(GeofenceManager::onFix, &Geofence());
+        SYS_INFO("Geofence loaded (%u zones)", Geofence().getStatus().zoneCount);
+    }
+    if (SENSOR_PRESSURE_PROFILE) {
+        Sensors().setProfileCallback(onProfileLevel, nullptr);
+    }
     if (!Sensors().begin()) {
         SYS_ERROR("Sensor manager initialization failed");
         return false;
     }
+    PowerMgr().markRailReady(PowerRail::SENSORS);
     SYS_INFO("Sensor manager initialized");
     appState.sensorsActive = true;
-    
-    // Initialize camera manager
-    if (!Camera().begin()) {
-        SYS_WARNING("Camera manager initialization failed - continuing without camera");
-        appState.cameraActive = false;
+    return true;
+}
+
+// Flash log of telemetry, position, events and link
+bool bootRecorder() {
+    if (!FlightRec().begin(FIRMWARE_VERSION)) {
+        SYS_WARNING("Flight recorder initialization failed - nothing is logged to flash");
     } else {
-        SYS_INFO("Camera manager initialized");
-        appState.cameraActive = true;
+        SYS_INFO("Flight recorder initialized (%lu KB)", FlightRec().getCapacity() / 1024);
+        if (FLIGHT_RECORDER_CAPTURE_RAW) {
+            FlightRec().setCapture(true);
+            LoRaComm().setFrameTapCallback(onLoRaFrameCaptured);
+            BulkLoRa().setFrameTapCallback(onLoRaFrameCaptured);
+            SYS_WARNING("Flight recorder capturing raw inputs - the log wraps in minutes");
+        }
+        if (LINK_CAPTURE_FLIGHT_RECORDER) {
+            LoRaComm().setCaptureSink(onLinkCaptured, nullptr);
+            BulkLoRa().setCaptureSink(onLinkCaptured, nullptr);
+            SYS_WARNING("Flight recorder capturing link frames - GET /linkcap.pcap; the log wraps in minutes");
+        }
+        if (Backlog().begin()) {
+            SYS_INFO("Link backlog spilling dropped packets to the flight recorder");
+        }
     }
-    
-    // Initialize LoRa communication
+    return true;
+}
+
+bool bootLoRa() {
     if (!LoRaComm().begin()) {
         SYS_ERROR("LoRa communication initialization failed");
         return false;
     }
+    PowerMgr().markRailReady(PowerRail::LORA);
     SYS_INFO("LoRa communication initialized");
-    appState.communicationActive = true;
     
-    // Initialize packet handler
+    // Images and the backlog move to the second module when there is one;
+    // one sequence space, so the base station's dedup and reorder see one stream
+    if (LORA_BULK_RADIO_FITTED) {
+        BulkLoRa().shareSequenceNumbers(&LoRaComm());
+        if (BulkLoRa().begin()) {
+            SYS_INFO("Bulk LoRa link initialized (SF%d, %ld Hz)", BulkLoRa().getSpreadingFactor(),
+                     BulkLoRa().getBandwidth());
+        } else {
+            SYS_WARNING("Bulk LoRa link initialization failed - images go on the primary link");
+        }
+    }
+    appState.communicationActive = true;
+    return true;
+}
+
+bool bootPackets() {
     if (!PacketMgr().begin()) {
         SYS_ERROR("Packet handler initialization failed");
         return false;
     }
     SYS_INFO("Packet handler initialized");
-    
-    // Initialize system state
+    return true;
+}
+
+// Images and other multi-packet payloads
+bool bootFragments() {
+    if (!FragmentMgr().begin()) {
+        SYS_ERROR("Fragment transfer initialization failed");
+        return false;
+    }
+    LoRaComm().setPacketReceivedCallback(onLoRaPacketReceived);
+    BulkLoRa().setPacketReceivedCallback(onLoRaPacketReceived);
+    FragmentMgr().setTransferCompleteCallback(FirmwareUpdater::onTransferComplete, &Firmware());
+    SYS_INFO("Fragment transfer initialized");
+    return true;
+}
+
+bool bootState() {
     if (!SysState().begin()) {
         SYS_ERROR("System state initialization failed");
         return false;
     }
+    SysState().setEventHandler(EventType::MODE_CHANGE, onSystemEvent);
+    SysState().setEventHandler(EventType::FLIGHT_PHASE_CHANGE, onSystemEvent);
+    SysState().setEventHandler(EventType::GEOFENCE, onSystemEvent);
     SYS_INFO("System state initialized");
+    return true;
+}
+
+// In BootStep order: name, step, after, core, required, background
+static const BootStepSpec bootSteps[BOOT_STEP_COUNT] = {
+    {"power",     bootPower,     0,                               1, true,  false},
+    {"lora",      bootLoRa,      BOOT_AFTER(BootStep::POWER),     1, true,  false},
+    {"packets",   bootPackets,   BOOT_AFTER(BootStep::LORA),      1, true,  false},
+    {"fragments", bootFragments, BOOT_AFTER(BootStep::PACKETS),   1, true,  false},
+    {"recorder",  bootRecorder,  BOOT_AFTER(BootStep::POWER),     1, false, false},
+    {"state",     bootState,     BOOT_AFTER(BootStep::FRAGMENTS) |
+                                 BOOT_AFTER(BootStep::RECORDER),  1, true,  false},
+    {"sensors",   bootSensors,   BOOT_AFTER(BootStep::POWER),     0, true,  false}
+};
+
+bool initializeSubsystems() {
+    SYS_INFO("Initializing subsystems...");
     
-    SYS_INFO("All subsystems initialized successfully");
+    // Retained state goes in before each owner's begin()
+    if (appState.wakeBoot || appState.resumeBoot) {
+        restoreRetainedState();
+    }
+    
+    if (!Boot().run(bootSteps, BOOT_STEP_COUNT)) {
+        return false;
+    }
+    
+    // The camera starts lazily, ahead of its first capture; a wake boot's telemetry cycle has none
+    appState.cameraActive = !appState.wakeBoot;
+    
+    SYS_INFO("All subsystems initialized in %lu ms", Boot().getForegroundMs());
     return true;
 }
 
@@ -402,10 +796,213 @@ bool configureSystem() {
         // Camera().setCaptureInterval(30000);  // 30 seconds
     }
     
+    // The ground's settings, over the build's defaults, before anything reads them
+    RuntimeConfig defaults = {};
+    defaults.heartbeatIntervalMs = HEARTBEAT_INTERVAL_MS;
+    defaults.statusIntervalMs = STATUS_REPORT_INTERVAL_MS;
+    defaults.trackIntervalMs = TRACK_SEGMENT_INTERVAL_MS;
+    defaults.cameraBurstFrames = CAMERA_BURST_FRAMES;
+    defaults.loraTxPower = LORA_TX_POWER;
+    defaults.loraArqWindow = LORA_ARQ_WINDOW_SIZE;
+    defaults.debugLevel = static_cast<int32_t>(DEFAULT_DEBUG_LEVEL);
+    if (!Config().begin(defaults, onConfigApplied, nullptr)) {
+        SYS_ERROR("Runtime config failed to start");
+        return false;
+    }
+    
+    // Configure the power planner - these are the rates with charge to spare
+    Planner().begin(CAMERA_CAPTURE_INTERVAL_MS, TELEMETRY_INTERVAL_MS, GPS_REPORT_INTERVAL_MS);
+    
+    // And the sampling and reporting rates for the phase and power state we start in
+    Cadence().update();
+    
     SYS_INFO("System configuration complete");
     return true;
 }
 
+// Everything /metrics exposes; readers run on the scraping task and only load counters
+void registerMetrics() {
+    MetricsRegistry& m = Metrics();
+    
+    m.addCounter("balloon_loop_iterations_total", "Flight task iterations", [] { return appState.loopCounter; });
+    m.addGauge("balloon_loop_time_max_ms", "Longest flight task iteration", [] { return (float)appState.maxLoopTime; });
+    m.addHistogram("balloon_loop_time_ms", "Flight task iteration time", loopTimeHistogram);
+    m.addCounter("balloon_task_stalls_total", "Tasks past their watchdog budget", [] { return Watchdog().getStalls(); });
+    m.addCounter("uplink_posts_total", "Packets posted to the uplink task", [] { return Uplink().getPosted(); });
+    m.addCounter("uplink_dropped_total", "Posts dropped on a full uplink queue", [] { return Uplink().getDropped(); });
+    m.addGauge("uplink_latency_worst_us", "Longest post-to-queued time", [] { return (float)Uplink().getWorstLatencyUs(); });
+    m.addGaugeFamily("stage_time_p50_us", "Median stage run time", "stage", STAGE_COUNT,
+                     [](uint8_t i) { return StageProfiler::stageToString(static_cast<Stage>(i)); },
+                     [](uint8_t i) { return Profiler().getPercentileUs(static_cast<Stage>(i), 0.5f); });
+    m.addGaugeFamily("stage_time_p99_us", "99th percentile stage run time", "stage", STAGE_COUNT,
+                     [](uint8_t i) { return StageProfiler::stageToString(static_cast<Stage>(i)); },
+                     [](uint8_t i) { return Profiler().getPercentileUs(static_cast<Stage>(i), 0.99f); });
+    m.addGaugeFamily("stage_time_max_us", "Longest stage run", "stage", STAGE_COUNT,
+                     [](uint8_t i) { return StageProfiler::stageToString(static_cast<Stage>(i)); },
+                     [](uint8_t i) { return Profiler().getMaxUs(static_cast<Stage>(i)); });
+    m.addCounter("scheduler_wakes_total", "Flight task wakes", [] { return Scheduler().getWakes(); });
+    m.addGaugeFamily("scheduler_job_late_worst_us", "Latest start past a job's deadline", "job", Scheduler().getJobCount(),
+                     [](uint8_t i) { return Scheduler().getStatus(i).name; },
+                     [](uint8_t i) { return (float)Scheduler().getStatus(i).lateWorstUs; });
+    m.addHistogramFamily("scheduler_job_late_us", "Start past a job's deadline", "job", Scheduler().getJobCount(),
+                         [](uint8_t i) { return Scheduler().getStatus(i).name; },
+                         [](uint8_t i) -> const MetricHistogram& { return Scheduler().getLateHistogram(i); });
+    m.addGaugeFamily("scheduler_job_missed_total", "Periodic runs that ended past the job's next deadline", "job",
+                     Scheduler().getJobCount(), [](uint8_t i) { return Scheduler().getStatus(i).name; },
+                     [](uint8_t i) { return (float)Scheduler().getStatus(i).missed; });
+    m.addGaugeFamily("scheduler_job_period_ms", "Period a job last ran at, after the phase and duty cycle", "job",
+                     Scheduler().getJobCount(), [](uint8_t i) { return Scheduler().getStatus(i).name; },
+                     [](uint8_t i) { return (float)Scheduler().getStatus(i).periodMs; });
+    m.addGaugeFamily("sensor_trigger_jitter_us", "Mean distance of a driver's triggers from their target", "sensor",
+                     Sensors().getScheduler().getDriverCount(),
+                     [](uint8_t i) { return Sensors().getScheduler().getDriver(i)->getName(); },
+                     [](uint8_t i) { return (float)Sensors().getScheduler().getJitter(i).meanUs; });
+    m.addGaugeFamily("sensor_trigger_jitter_worst_us", "Furthest a driver's trigger landed from its target", "sensor",
+                     Sensors().getScheduler().getDriverCount(),
+                     [](uint8_t i) { return Sensors().getScheduler().getDriver(i)->getName(); },
+                     [](uint8_t i) { return (float)Sensors().getScheduler().getJitter(i).worstUs; });
+    m.addGaugeFamily("sensor_pps_aligned", "1 while a driver's last trigger was on a PPS epoch", "sensor",
+                     Sensors().getScheduler().getDriverCount(),
+                     [](uint8_t i) { return Sensors().getScheduler().getDriver(i)->getName(); },
+                     [](uint8_t i) { return Sensors().getScheduler().getJitter(i).onPps ? 1.0f : 0.0f; });
+    m.addCounter("balloon_errors_total", "System errors handled", [] { return appState.errorCount; });
+    m.addCounter("system_events_dropped_total", "Events posted to a full queue", [] { return SysState().getEventsDropped(); });
+    m.addCounter("system_state_commits_total", "State and statistics records written to NVS", [] { return SysState().getPersistCommits(); });
+    m.addGauge("balloon_free_heap_bytes", "Free internal heap", [] { return (float)ESP.getFreeHeap(); });
+    m.addCounter("probe_reports_total", "Performance probe reports handed to the fragment sender", [] { return Probe().getReportsSent(); });
+    m.addGaugeFamily("memory_held_bytes", "Heap and PSRAM a subsystem holds", "subsystem", MEM_TAG_COUNT,
+                     [](uint8_t i) { return MemoryLedger::tagToString(static_cast<MemTag>(i)); },
+                     [](uint8_t i) { return (float)MemLedger().getCurrent(static_cast<MemTag>(i)); });
+    m.addGaugeFamily("memory_peak_bytes", "Most heap and PSRAM a subsystem held at once", "subsystem", MEM_TAG_COUNT,
+                     [](uint8_t i) { return MemoryLedger::tagToString(static_cast<MemTag>(i)); },
+                     [](uint8_t i) { return (float)MemLedger().getPeak(static_cast<MemTag>(i)); });
+    m.addGaugeFamily("memory_largest_free_block_bytes", "Largest free block, the biggest allocation that can succeed",
+                     "region", MEM_REGION_COUNT,
+                     [](uint8_t i) { return MemoryLedger::regionToString(static_cast<MemRegion>(i)); },
+                     [](uint8_t i) { return (float)MemoryLedger::getRegion(static_cast<MemRegion>(i)).largestBlock; });
+    m.addGaugeFamily("memory_fragmentation_ratio", "1 - largest free block / free bytes", "region", MEM_REGION_COUNT,
+                     [](uint8_t i) { return MemoryLedger::regionToString(static_cast<MemRegion>(i)); },
+                     [](uint8_t i) { return MemoryLedger::getRegion(static_cast<MemRegion>(i)).fragmentation; });
+    m.addGauge("balloon_altitude_m", "Current altitude", [] { return SysState().getSnapshot().altitude; });
+    m.addGauge("balloon_vertical_speed_mps", "Filtered vertical speed, up positive", [] { return SysState().getSnapshot().velocity; });
+    m.addGauge("balloon_altitude_sigma_m", "Altitude uncertainty, 1 sigma", [] { return Sensors().getAltitudeEstimate().altitudeSigma; });
+    m.addGauge("balloon_vertical_speed_sigma_mps", "Vertical speed uncertainty, 1 sigma", [] { return Sensors().getAltitudeEstimate().verticalSpeedSigma; });
+    m.addGauge("flight_phase_window_speed_mps", "Mean vertical speed over the phase detection window", [] { return SysState().getPhaseDetector().getMeanVerticalSpeed(); });
+    m.addCounter("flight_phase_bursts_total", "Bursts detected from the pressure", [] { return SysState().getPhaseDetector().getBurstsDetected(); });
+    m.addGauge("time_source", "Timebase discipline - 0 none, 1 GPS message, 2 PPS", [] { return (float)Clock().getSource(); });
+    m.addGauge("time_drift_ppm", "Local clock rate error measured against PPS", [] { return Clock().getReference().driftPpm; });
+    m.addGauge("balloon_wake_to_transmit_ms", "Boot, or deep sleep wake, to the first frame sent; 0 before it", [] { return (float)LoRaComm().getFirstTransmitTime(); });
+    m.addGauge("balloon_wake_count", "Deep sleep wakes since the last full boot", [] { return (float)Retained().getState().wakeCount; });
+    m.addGauge("balloon_resume_count", "Crash resumes since the last stable run", [] { return (float)Retained().getResumeCount(); });
+    m.addGauge("ulp_wake_reason", "What woke this boot - 0 timer, 1 battery, 2 pressure", [] { return (float)UlpMon().getStatus().reason; });
+    m.addGauge("ulp_passes", "ULP monitor passes in the sleep before this boot", [] { return (float)UlpMon().getStatus().runs; });
+    m.addGauge("firmware_update_state", "0 idle, 1 receiving, 2 verifying, 3 applying, 4 ready, 5 restarting, 6 failed", [] { return (float)Firmware().getStatus().state; });
+    m.addGauge("firmware_update_bytes", "Running image hashed, or new image written, of the update under way", [] { return (float)Firmware().getStatus().done; });
+    m.addGauge("geofence_inside_zones", "Zones the last GPS fix was in", [] { return (float)Geofence().getStatus().inside; });
+    m.addCounter("geofence_entries_total", "Zones entered", [] { return Geofence().getStatus().entries; });
+    m.addGauge("geofence_check_worst_us", "Longest check of one fix against the zones", [] { return (float)Geofence().getStatus().worstUs; });
+    m.addCounter("track_vertices_total", "GPS fixes kept as track vertices", [] { return Track().getVertices(); });
+    m.addCounter("track_dropped_total", "Track vertices overwritten before a segment took them", [] { return Track().getDropped(); });
+    
+    m.addCounter("lora_transmit_errors_total", "Radio transmit failures", [] { return LoRaComm().getTransmitErrorCount(); });
+    m.addCounter("lora_receive_errors_total", "Radio receive failures", [] { return LoRaComm().getReceiveErrorCount(); });
+    m.addCounter("lora_crc_errors_total", "Frames received with a bad CRC", [] { return LoRaComm().getCrcErrorCount(); });
+    m.addCounter("lora_ack_timeouts_total", "ACKs not received in time", [] { return LoRaComm().getAckTimeoutCount(); });
+    m.addCounter("lora_airtime_used_us_total", "Airtime used in the duty cycle window", [] { return LoRaComm().getAirtimeUsedUs(); });
+    m.addGauge("lora_rssi_dbm", "Last packet RSSI", [] { return (float)LoRaComm().getLastRSSI(); });
+    m.addGauge("lora_rssi_avg_dbm", "RSSI averaged over the history", [] { return (float)LoRaComm().getAverageRSSI(); });
+    m.addGauge("lora_snr_avg_db", "SNR averaged over the history", [] { return (float)LoRaComm().getAverageSNR(); });
+    m.addGauge("lora_packet_error_rate", "Fraction of packets lost", [] { return LoRaComm().getPacketErrorRate(); });
+    m.addGauge("lora_queue_packets", "Packets queued for the radio", [] { return (float)LoRaComm().getTotalQueueSize(); });
+    if (LORA_BULK_RADIO_FITTED) {
+        m.addCounter("lora_bulk_ack_timeouts_total", "Bulk link ACKs not received in time", [] { return BulkLoRa().getAckTimeoutCount(); });
+        m.addCounter("lora_bulk_airtime_used_us_total", "Bulk link airtime used in the duty cycle window", [] { return BulkLoRa().getAirtimeUsedUs(); });
+        m.addGauge("lora_bulk_queue_packets", "Packets queued for the bulk radio", [] { return (float)BulkLoRa().getTotalQueueSize(); });
+    }
+    
+    m.addCounter("packet_sent_total", "Packets created", [] { return PacketMgr().getPacketsSent(); });
+    m.addCounter("packet_received_total", "Packets parsed", [] { return PacketMgr().getPacketsReceived(); });
+    m.addCounter("packet_dropped_total", "Packets dropped", [] { return PacketMgr().getPacketsDropped(); });
+    m.addCounter("packet_crc_errors_total", "Packets failing CRC", [] { return PacketMgr().getCRCErrors(); });
+    m.addCounter("packet_backpressure_rejects_total", "Packets refused with the queue full", [] { return PacketMgr().getBackpressureRejects(); });
+    
+    m.addCounter("camera_capture_errors_total", "Failed captures", [] { return Camera().getCaptureErrorCount(); });
+    m.addCounter("camera_frames_retained_total", "Frames kept on board as too like the last sent", [] { return Camera().getFramesRetained(); });
+    m.addCounter("camera_cold_starts_total", "Driver starts, lazy and prewarmed", [] { return Camera().getColdStarts(); });
+    m.addGauge("camera_released_peak_bytes", "Most heap one camera release gave back", [] { return (float)Camera().getPeakReleased(); });
+    m.addHistogram("camera_capture_time_ms", "Capture request to image", captureTimeHistogram);
+    m.addCounter("image_store_stored_total", "Images written to flash", [] { return ImageStoreMgr().getImagesStored(); });
+    m.addCounter("image_store_dropped_total", "Images not stored", [] { return ImageStoreMgr().getImagesDropped(); });
+    m.addCounter("flight_recorder_records_total", "Records written to the flight recorder", [] { return FlightRec().getRecordsWritten(); });
+    m.addCounter("flight_recorder_dropped_total", "Flight recorder records lost", [] { return FlightRec().getRecordsDropped(); });
+    
+    // Per task over the last TASK_USAGE_INTERVAL_MS; -1 without run time stats
+    m.addGaugeFamily("task_cpu_percent", "CPU use, percent of one core", "task", TASK_COUNT,
+                     [](uint8_t i) { return taskPlacement(static_cast<TaskId>(i)).name; },
+                     [](uint8_t i) { return TaskUsage().getCpuPercent(static_cast<TaskId>(i)); });
+    m.addGaugeFamily("task_stack_free_bytes", "Least free stack seen, 0 when not running", "task", TASK_COUNT,
+                     [](uint8_t i) { return taskPlacement(static_cast<TaskId>(i)).name; },
+                     [](uint8_t i) { return (float)TaskUsage().getStackFree(static_cast<TaskId>(i)); });
+    m.addGaugeFamily("task_beat_gap_worst_ms", "Longest time between a task's heartbeats, 0 when not watched", "task",
+                     TASK_COUNT, [](uint8_t i) { return taskPlacement(static_cast<TaskId>(i)).name; },
+                     [](uint8_t i) { return (float)Watchdog().getWorstGapMs(static_cast<TaskId>(i)); });
+    m.addGaugeFamily("task_watchdog_stalls_total", "Times a task went past its budget without a heartbeat", "task",
+                     TASK_COUNT, [](uint8_t i) { return taskPlacement(static_cast<TaskId>(i)).name; },
+                     [](uint8_t i) { return (float)Watchdog().getStalls(static_cast<TaskId>(i)); });
+    m.addGaugeFamily("cpu_core_load_percent", "Time the core wasn't idle", "core", portNUM_PROCESSORS,
+                     [](uint8_t i) { return i == 0 ? "0" : "1"; },
+                     [](uint8_t i) { return TaskUsage().getCoreLoad(i); });
+    
+    m.addGaugeFamily("subsystem_state", "SubsystemState value, 0 off to 5 maintenance", "subsystem", SUBSYSTEM_COUNT,
+                     [](uint8_t i) { return SysState().subsystemToString(static_cast<Subsystem>(i)); },
+                     [](uint8_t i) { return (float)SysState().getSubsystemState(static_cast<Subsystem>(i)); });
+    m.addGaugeFamily("health_check_worst_us", "Longest run of each health check", "check", HEALTH_CHECK_COUNT,
+                     [](uint8_t i) { return SysState().healthCheckToString(static_cast<HealthCheck>(i)); },
+                     [](uint8_t i) { return (float)SysState().getHealthCheckStatus(static_cast<HealthCheck>(i)).worstUs; });
+    
+    // Per subsystem since boot, from the on/off transitions each reports
+    m.addGaugeFamily("energy_charge_mah", "Charge drawn", "load", ENERGY_LOAD_COUNT,
+                     [](uint8_t i) { return energyLoadToString(static_cast<EnergyLoad>(i)); },
+                     [](uint8_t i) { return Energy().getChargeMah(static_cast<EnergyLoad>(i)); });
+    m.addGaugeFamily("energy_active_seconds", "Time switched on", "load", ENERGY_LOAD_COUNT,
+                     [](uint8_t i) { return energyLoadToString(static_cast<EnergyLoad>(i)); },
+                     [](uint8_t i) { return Energy().getStatus(static_cast<EnergyLoad>(i)).activeSeconds; });
+    m.addGaugeFamily("cpu_level_seconds", "Time at each frequency scaling level, from our PM locks", "level",
+                     POWER_LEVEL_COUNT,
+                     [](uint8_t i) { return powerLevelToString(static_cast<PowerLevel>(i)); },
+                     [](uint8_t i) { return PowerScale().getLevelSeconds(static_cast<PowerLevel>(i)); });
+    m.addGauge("battery_remaining_mah", "Charge left by the coulomb count", [] { return PowerMgr().getRemainingCapacity(); });
+    m.addGauge("power_plan_spendable_mah", "Charge above the reserve and baseline to the end of the flight", [] { return Planner().getPlan().spendableMah; });
+    m.addGaugeFamily("power_plan_interval_ms", "Planned interval, 0 when stopped", "stream", PLAN_STREAM_COUNT,
+                     [](uint8_t i) { return planStreamToString(static_cast<PlanStream>(i)); },
+                     [](uint8_t i) { return (float)Planner().getInterval(static_cast<PlanStream>(i)); });
+    m.addGaugeFamily("report_suppressed", "Reports the dead-band kept off the link", "report", DEADBAND_REPORT_COUNT,
+                     [](uint8_t i) { return deadbandReportToString(static_cast<DeadbandReport>(i)); },
+                     [](uint8_t i) { return (float)Deadband().getStats(static_cast<DeadbandReport>(i)).suppressed; });
+    m.addGaugeFamily("cadence_percent", "Phase and power state scaling of the base interval, 0 when off", "stream",
+                     CADENCE_STREAM_COUNT,
+                     [](uint8_t i) { return cadenceStreamToString(static_cast<CadenceStream>(i)); },
+                     [](uint8_t i) { return (float)Cadence().getProfile().percent[i]; });
+    m.addGaugeFamily("power_rail_settle_ms", "Worst rail-on to ready time, the prewarm lead", "rail", POWER_RAIL_COUNT,
+                     [](uint8_t i) { return powerRailToString(static_cast<PowerRail>(i)); },
+                     [](uint8_t i) { return PowerMgr().getRailStatus(static_cast<PowerRail>(i)).settleWorstUs / 1000.0f; });
+    m.addGaugeFamily("boot_step_ms", "Subsystem bring-up time, both cores at once", "step", BOOT_STEP_COUNT,
+                     [](uint8_t i) { return Boot().getName(i); },
+                     [](uint8_t i) { return (float)Boot().getStatus(i).durationMs; });
+    m.addGauge("boot_first_frame_ms", "Reset to the first frame's end, 0 before it", [] { return (float)LoRaComm().getFirstTransmitTime(); });
+    
+    SYS_INFO("Metrics: %u registered", (unsigned)m.getCount());
+}
+
+// Owners take back what the last cycle left in RTC memory, before their begin()
+void restoreRetainedState() {
+    const RetainedState& retained = Retained().getState();
+    Sensors().restoreRetained(retained.sensors, retained.sleepMs);
+    if (LoRaComm().restoreRetained(retained.link)) {
+        PacketMgr().setSequenceNumber(retained.link.packetSequence);
+    }
+}
+
 bool performSystemChecks() {
     SYS_INFO("Performing system checks...");
     
@@ -428,12 +1025,28 @@ bool performSystemChecks() {
     // LoRaComm().performHealthCheck(); // Method doesn't exist yet
     SYS_WARNING("Communication system health check skipped");
     
-    // Check camera system (if active)
-    if (appState.cameraActive) { // && !Camera().performHealthCheck()) {
+    // Check camera system (if active) - it starts lazily, so only a start that already failed counts
+    if (appState.cameraActive && Camera().getInitErrorCount() > 0) {
         SYS_WARNING("Camera system health check failed");
         allPassed = false;
     }
     
+    if (CRC_BENCHMARK_ON_BOOT) {
+        crcBenchmark();
+    }
+    
+    if (IMAGE_SCALE_BENCHMARK_ON_BOOT) {
+        imageScaleBenchmark();
+    }
+    
+    if (BARO_ALTITUDE_BENCHMARK_ON_BOOT) {
+        baroAltitudeBenchmark();
+    }
+    
+    if (JPEG_DC_BENCHMARK_ON_BOOT) {
+        jpegDcBenchmark();
+    }
+    
     // Run system diagnostics
     if (!SysState().runDiagnostics()) {
         SYS_WARNING("System diagnostics failed");
@@ -551,6 +1164,7 @@ bool checkHardwareStatus() {
 // ===========================
 
 void updateSystemState() {
+    StageScope scope(Stage::SYSTEM_STATE);
     SysState().update();
     
     // Update system mode based on conditions
@@ -562,11 +1176,26 @@ void updateSystemState() {
         if (!appState.emergencyMode) {
             SYS_ERROR("Emergency mode activated: %s", SysState().getEmergencyReason());
             appState.emergencyMode = true;
+            
+            // On air first - the radio task cuts off whatever it is sending
+            if (EMERGENCY_ENABLE_BEACON) {
+                LoRaComm().sendEmergencyBeacon(buildEmergencyBeacon(SysState().getEmergencyReason()));
+            }
+            
+            // The link as it was, and everything recorded so far, on flash before anything else happens
+            if (EMERGENCY_SAVE_LAST_DATA) {
+                FlightRec().recordLink();
+                FlightRec().sync();
+            }
+        } else if (LoRaComm().isEmergencyBeaconActive()) {
+            // The repeats carry the latest position
+            LoRaComm().updateEmergencyBeacon(buildEmergencyBeacon(SysState().getEmergencyReason()));
         }
     } else {
         if (appState.emergencyMode) {
             SYS_INFO("Emergency mode cleared");
             appState.emergencyMode = false;
+            LoRaComm().stopEmergencyBeacon();
         }
     }
     
@@ -585,6 +1214,7 @@ void updateSystemState() {
 }
 
 void processSensors() {
+    StageScope scope(Stage::SENSORS);
     if (!appState.sensorsActive) {
         return;
     }
@@ -595,91 +1225,379 @@ void processSensors() {
     BMP280Data sensorData = Sensors().getBMP280Data();
     GPSData gpsData = Sensors().getGPSData();
     
-    // Update system state with sensor data
-    SysState().setCurrentAltitude(gpsData.altitude);
-    SysState().setCurrentVelocity(gpsData.speed);
-    SysState().setCurrentTemperature(sensorData.temperature);
+    // Update system state with sensor data - fused vertical rate, not GPS ground speed
+    static uint32_t lastEstimateTime = 0;
+    AltitudeEstimate altitude = Sensors().getAltitudeEstimate();
+    if (altitude.valid) {
+        SysState().setFlightData(altitude.altitude, altitude.verticalSpeed, sensorData.temperature);
+        if (altitude.timestamp != lastEstimateTime) {
+            SysState().addFlightSample(altitude.timestamp, altitude.altitude, altitude.verticalSpeed,
+                                       sensorData.valid ? sensorData.pressure : 0.0f);
+            SysState().addStatisticsSample(altitude.altitude, altitude.verticalSpeed,
+                                           sensorData.valid ? sensorData.temperature : NAN);
+            lastEstimateTime = altitude.timestamp;
+        }
+    } else {
+        SysState().setFlightData(gpsData.altitude, 0.0f, sensorData.temperature);  // No baro - GPS altitude, no climb rate
+    }
     
-    // Check for sensor alerts
+    // Every fix, not just the ones reported - the track keeps those that shape the path
+    if (TRACK_HISTORY_ENABLED && Sensors().isGPSLocked()) {
+        Track().addFix(gpsData);
+    }
+    
+    // Check for sensor alerts - they hold for hours at float, so once per interval with a count
     if (sensorData.temperature > 60.0f) {
-        SYS_WARNING("High temperature detected: %.1f°C", sensorData.temperature);
+        SYS_WARNING_LIMITED("High temperature detected: %.1f°C", sensorData.temperature);
     }
     
     if (sensorData.pressure < 200.0f) {
-        SYS_INFO("Low pressure detected: %.1f hPa (altitude: %.1f m)", 
-                sensorData.pressure, gpsData.altitude);
+        SYS_INFO_LIMITED("Low pressure detected: %.1f hPa (altitude: %.1f m)",
+                         sensorData.pressure, gpsData.altitude);
     }
 }
 
 void processCamera() {
+    StageScope scope(Stage::CAMERA);
+    if (appState.cameraStopRequested) {
+        appState.cameraStopRequested = false;
+        if (appState.cameraActive) {
+            // Disabled - the frame buffers go back, not just the sensor to standby
+            if (Camera().isReady()) {
+                Camera().end();
+                SYS_INFO("Camera off, %u bytes freed", (unsigned)Camera().getLastReleased());
+            }
+            if (PowerMgr().isRailSwitchable(PowerRail::CAMERA)) {
+                PowerMgr().setRail(PowerRail::CAMERA, false);
+            }
+            appState.cameraActive = false;
+        }
+    }
     if (!appState.cameraActive) {
         return;
     }
     
-    // Camera manager doesn't have update() method
-    // Check if it's time to capture an image
-    if (Camera().isTimeToCapture(30000)) {  // 30 second interval
-        if (Camera().captureImage()) {
-            SYS_INFO("Camera image captured");
-            
-            // Get camera data
-            const ImageData& imageData = Camera().getCurrentImage();
-            
-            // Convert to CameraData format
-            CameraData cameraData;
-            static uint16_t nextImageId = 1;
-            cameraData.imageId = nextImageId++; // Simple counter for image ID
-            cameraData.imageSize = imageData.length;
-            cameraData.timestamp = imageData.timestamp;
-            cameraData.compression = 1; // Default compression
-            cameraData.brightness = 0.0f; // Default brightness
-            cameraData.contrast = 0.0f; // Default contrast
-            cameraData.faceCount = 0; // Default face count
-            cameraData.objectCount = 0; // Default object count
-            
-            // Create camera packet
-            if (PacketMgr().createCameraPacket(cameraData)) {
-                SYS_LOG("Camera packet created successfully");
+    pumpCameraDownlink();
+    
+    // capturePipeline() has the capture itself
+    if (CAMERA_CAPTURE_PIPELINE && PIPELINE_COROUTINES) {
+        manageCameraPower(getCaptureInterval());
+        return;
+    }
+    
+    // The capture task does the exposure and readout; the uplink task only hands off
+    CaptureStatus status = Camera().pollCaptureResult();
+    if (status == CaptureStatus::PENDING) {
+        return;
+    }
+    finishCapture(status);
+    
+    uint32_t captureInterval = getCaptureInterval();
+    manageCameraPower(captureInterval);
+    if (captureInterval && Camera().isReady() && Camera().isTimeToCapture(captureInterval)) {
+        startCapture(captureInterval);
+    }
+}
+
+// At the planner's rate for this phase; none when the battery can't carry the camera to the end of the flight
+uint32_t getCaptureInterval() {
+    return Cadence().getInterval(CadenceStream::CAPTURE, Planner().getInterval(PlanStream::CAPTURE));
+}
+
+bool startCapture(uint32_t captureInterval) {
+    // Size this image for the airtime the link can spare until the next one
+    if (CAMERA_BUDGET_CONTROL && CAMERA_SEND_IMAGES) {
+        size_t budget = LoRaLink(Priority::CAMERA).getBulkByteBudget(captureInterval, FRAGMENT_DATA_SIZE,
+                                                                     FRAGMENT_HEADER_SIZE);
+        Camera().applyByteBudget(min(budget, (size_t)FRAGMENT_MAX_TRANSFER_BYTES));
+    }
+    return Camera().requestCapture();
+}
+
+void finishCapture(CaptureStatus status) {
+    if (status == CaptureStatus::CAPTURED) {
+        handleCapturedImage();
+    } else if (status == CaptureStatus::FAILED) {
+        SYS_WARNING("Camera capture failed");
+    }
+}
+
+#if PIPELINE_COROUTINES
+// The capture cycle as one flow on the uplink task: wait for the next capture
+// to fall due, start it, wait for the capture task, hand the image on. The
+// interval is read again after every sleep, so a new phase or plan takes
+// effect within CAPTURE_PIPELINE_IDLE_MS. Camera power and the downlink pump
+// stay in processCamera()
+Pipe capturePipeline() {
+    for (;;) {
+        uint32_t captureInterval = getCaptureInterval();
+        if (!appState.cameraActive || appState.cameraStopRequested || !captureInterval || !Camera().isReady()) {
+            co_await pipeSleep(CAPTURE_PIPELINE_IDLE_MS);
+            continue;
+        }
+        if (!Camera().isTimeToCapture(captureInterval)) {
+            uint32_t remaining = captureInterval - (millis() - Camera().getLastCaptureTime());
+            co_await pipeSleep(min(remaining, (uint32_t)CAPTURE_PIPELINE_IDLE_MS));
+            continue;
+        }
+        if (!startCapture(captureInterval)) {
+            co_await pipeSleep(CAPTURE_PIPELINE_IDLE_MS);
+            continue;
+        }
+        
+        // A camera stopped meanwhile has had its capture waited out by end()
+        CaptureStatus status;
+        while ((status = Camera().pollCaptureResult()) == CaptureStatus::PENDING && appState.cameraActive) {
+            co_await pipeWait(PipeEvent::CAPTURE_DONE, CAMERA_CAPTURE_TIMEOUT_MS);
+        }
+        StageScope scope(Stage::CAMERA);
+        finishCapture(status);
+    }
+}
+#endif
+
+// The capture's CameraData fields plus the position, fused altitude and
+// exposure behind it, as an image_metadata.h segment; its length
+static size_t buildImageMetadata(const CameraData& cameraData, uint8_t* out, size_t capacity) {
+    ImageMetadata meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.imageId = cameraData.imageId;
+    meta.timestamp = cameraData.timestamp;
+    
+    GPSData gps = Sensors().getGPSData();
+    if (Sensors().isGPSLocked()) {
+        meta.latitudeE7 = (int32_t)lround(gps.latitude * 1e7);
+        meta.longitudeE7 = (int32_t)lround(gps.longitude * 1e7);
+        meta.hasPosition = true;
+    }
+    AltitudeEstimate altitude = Sensors().getAltitudeEstimate();
+    meta.altitudeCm = (int32_t)lroundf((altitude.valid ? altitude.altitude : SysState().getCurrentAltitude()) * 100.0f);
+    meta.hasAltitude = altitude.valid || Sensors().isGPSLocked();
+    
+    meta.exposureLines = Camera().getExposureLines();
+    meta.gain = Camera().getGain();
+    meta.meanLuma = Camera().getMeanLuma();
+    meta.novelty = Camera().getNovelty();
+    meta.sharpness = cameraData.sharpness;
+    meta.sceneLabel = cameraData.sceneLabel;
+    meta.sceneConfidence = cameraData.sceneConfidence;
+    meta.burstFrames = cameraData.burstFrames;
+    return imageMetadataEncode(meta, out, capacity);
+}
+
+void handleCapturedImage() {
+    SYS_INFO("Camera image captured");
+    
+    // Get camera data
+    const ImageData& imageData = Camera().getCurrentImage();
+    captureTimeHistogram.observe(Camera().getCaptureDuration());
+    
+    // Convert to CameraData format
+    CameraData cameraData;
+    static uint16_t nextImageId = 1;
+    // Ids carry on from the image store across reboots
+    if (nextImageId == 1 && ImageStoreMgr().isReady()) {
+        nextImageId = ImageStoreMgr().getNextImageId();
+    }
+    cameraData.imageId = nextImageId++;
+    if (nextImageId == 0) {
+        nextImageId = 1;
+    }
+    cameraData.imageSize = imageData.length;
+    cameraData.timestamp = imageData.timestamp;
+    cameraData.compression = 1; // Default compression
+    cameraData.brightness = 0.0f; // Default brightness
+    cameraData.contrast = 0.0f; // Default contrast
+    cameraData.faceCount = 0; // Default face count
+    cameraData.objectCount = 0; // Default object count
+    cameraData.burstFrames = Camera().getBurstScored();
+    cameraData.sharpness = Camera().getSharpness();
+    cameraData.sharpnessWorst = Camera().getSharpnessWorst();
+    const SceneClassification& scene = Camera().getScene();
+    cameraData.sceneLabel = static_cast<uint8_t>(scene.valid ? scene.label : SceneLabel::UNKNOWN);
+    cameraData.sceneConfidence = scene.valid ? scene.confidence : 0;
+    
+    // Every capture's preview frame, novel or not - it goes out at telemetry
+    // priority, ahead of this image's layers and whatever is left of the last
+    const PreviewFrame& preview = Camera().getPreview();
+    if (CAMERA_PREVIEW_FRAME && preview.valid && !PacketMgr().createPreviewPackets(cameraData.imageId, preview)) {
+        SYS_WARNING("Image %u preview not queued", cameraData.imageId);
+    }
+
+    // What a CAMERA_DATA packet would have said, and where the balloon was,
+    // inside the JPEG the ground keeps
+    uint8_t metadata[IMAGE_META_MAX_BYTES];
+    size_t metadataLength = CAMERA_EMBED_METADATA ? buildImageMetadata(cameraData, metadata, sizeof(metadata)) : 0;
+    
+    // Stream the JPEG itself, as layers or whole; a whole image captured
+    // during the last transfer is skipped, and one too like the last image
+    // sent isn't worth the airtime
+    size_t queuedBytes = 0;
+    if (CAMERA_SEND_IMAGES && imageData.valid && (CAMERA_PROGRESSIVE_MODE || !FragmentMgr().isSending())) {
+        if (!Camera().isNovelFrame()) {
+            Camera().markRetained();
+            SYS_LOG("Image %u not sent, novelty %u, %s", cameraData.imageId, Camera().getNovelty(),
+                    sceneLabelName(scene.valid ? scene.label : SceneLabel::UNKNOWN));
+        } else if (CAMERA_PROGRESSIVE_MODE) {
+            if (Camera().startLayers(cameraData.imageId, metadata, metadataLength)) {
+                Camera().markDownlinked();
+                queuedBytes = imageData.length + metadataLength;
+                SYS_LOG("Image %u queued as %u layers (%u bytes, novelty %u)", cameraData.imageId,
+                        Camera().getLayerCount(), (unsigned)imageData.length, Camera().getNovelty());
+            }
+        } else {
+            // SOI, the metadata segment, then the rest of the capture - all in the first fragment
+            const PayloadPart parts[] = {
+                {imageData.buffer, 2},
+                {metadata, metadataLength},
+                {imageData.buffer + 2, imageData.length - 2}
+            };
+            if (imageData.length > 2 && FragmentMgr().sendPayload(PacketType::CAMERA_FULL, parts, 3)) {
+                Camera().markDownlinked();
+                queuedBytes = imageData.length + metadataLength;
+                SYS_LOG("Image %u queued for transfer (%u bytes, novelty %u)", cameraData.imageId,
+                        (unsigned)imageData.length, Camera().getNovelty());
             }
         }
     }
+    
+    // Only an image that isn't going down with its metadata needs the packet
+    if ((queuedBytes == 0 || metadataLength == 0) && PacketMgr().createCameraPacket(cameraData)) {
+        SYS_LOG("Camera packet created successfully");
+    }
+    
+    // What the planner learns a capture costs and returns
+    Planner().onCapture(queuedBytes);
+    if (queuedBytes) {
+        Downlink().onLiveQueued(cameraData.imageId);
+    }
+    
+    // Kept on flash whether it went down or not
+    if (CAMERA_STORE_IMAGES && ImageStoreMgr().isReady() && imageData.valid &&
+        !ImageStoreMgr().storeImage(imageData.buffer, imageData.length, cameraData.imageId, imageData.timestamp,
+                                    SysState().getCurrentAltitude(), Camera().getNovelty(), cameraData.sceneLabel,
+                                    Camera().getSharpness() ? Camera().getSharpness() : 0xFFFF)) {
+        SYS_WARNING("Image %u not stored", cameraData.imageId);
+    }
+    
+    // Tiles can still be pulled from an image that wasn't sent whole
+    if (CAMERA_TILE_MODE && !Camera().retainForTiles(cameraData.imageId)) {
+        SYS_WARNING("Image %u not retained for tiles", cameraData.imageId);
+    }
+    
+    // Everything above has taken what it needs - give the frame buffer back to the driver
+    Camera().freeCurrentImage();
+}
+
+// The driver starts lazily, a cold start ahead of the capture it's wanted
+// for and never before the first frame is out. With a camera load switch the
+// camera is off between captures far enough apart and back on its measured
+// settle time ahead of the next; without one it is released only while the
+// plan has no captures
+void manageCameraPower(uint32_t captureInterval) {
+    bool switchable = PowerMgr().isRailSwitchable(PowerRail::CAMERA);
+    uint32_t last = Camera().getLastCaptureTime();
+    
+    if (switchable && !PowerMgr().isRailOn(PowerRail::CAMERA)) {
+        // A plan that brings the camera back, or a prewarm dropped along the way
+        if (captureInterval && !PowerMgr().getRailStatus(PowerRail::CAMERA).prewarmAt) {
+            PowerMgr().prewarmRail(PowerRail::CAMERA, last + captureInterval);
+        }
+        return;
+    }
+    
+    if (!Camera().isReady()) {
+        // Prewarmed rail - now; otherwise the driver's cold start ahead of the capture
+        int32_t until = last ? (int32_t)(last + captureInterval - millis()) : 0;
+        if (captureInterval && LoRaComm().getFirstTransmitTime() &&
+            (switchable || until <= (int32_t)Camera().getPrewarmLeadMs())) {
+            startCamera();
+        }
+        return;
+    }
+    
+    // Down only with nothing of the camera's still to send
+    if (Camera().isCapturePending() || Camera().isThumbnailPending() || Camera().getLayerImageId() ||
+        Camera().getTileImageId() || (last == 0 && captureInterval)) {
+        return;
+    }
+    int32_t gap = captureInterval ? (int32_t)(last + captureInterval - millis()) : INT32_MAX;
+    if (captureInterval && (!switchable ||
+        gap <= (int32_t)(PowerMgr().getRailLeadMs(PowerRail::CAMERA) + CAMERA_RAIL_MIN_OFF_MS))) {
+        return;
+    }
+    
+    Camera().end();
+    SYS_INFO("Camera released, %u bytes freed", (unsigned)Camera().getLastReleased());
+    if (switchable) {
+        PowerMgr().setRail(PowerRail::CAMERA, false);
+        if (captureInterval) {
+            PowerMgr().prewarmRail(PowerRail::CAMERA, last + captureInterval);
+        }
+    }
+}
+
+// One fragment transfer at a time: the preview and thumbnail of the newest
+// image first, then tiles the ground asked for, then refinement layers
+void pumpCameraDownlink() {
+    if (CAMERA_PROGRESSIVE_MODE) {
+        Camera().processLayers();
+    }
+    if (CAMERA_TILE_MODE) {
+        Camera().processTiles();
+    }
+    if (FragmentMgr().isSending()) {
+        return;
+    }
+    
+    const uint8_t* layer = nullptr;
+    size_t layerLength = 0;
+    uint8_t layerIndex = 0;
+    const uint8_t* tile = nullptr;
+    size_t tileLength = 0;
+    bool layerReady = CAMERA_PROGRESSIVE_MODE && Camera().getEncodedLayer(layer, layerLength, layerIndex);
+    bool tileReady = CAMERA_TILE_MODE && Camera().getEncodedTile(tile, tileLength);
+    
+    if (layerReady && (layerIndex < CAMERA_LAYER_BASE_LAYERS || !tileReady)) {
+        // One that can't go (too large to fragment) is dropped so the next layer still can
+        if (!FragmentMgr().sendPayload(PacketType::CAMERA_LAYER, layer, layerLength)) {
+            SYS_WARNING("Image %u layer %u not sent (%u bytes)", Camera().getLayerImageId(), layerIndex,
+                        (unsigned)layerLength);
+        }
+        Camera().releaseLayer();
+    } else if (tileReady && FragmentMgr().sendPayload(PacketType::CAMERA_TILE, tile, tileLength)) {
+        Camera().releaseTile();
+    } else if (!layerReady && !tileReady) {
+        Downlink().service();
+    }
 }
 
 void processCommunications() {
+    StageScope scope(Stage::COMMUNICATIONS);
     if (!appState.communicationActive) {
         return;
     }
     
-    // LoRaComm().update(); // Method doesn't exist
-    
-    // Check for received data - simplified for now
-    // uint8_t* receivedData = nullptr;
-    // size_t receivedLength = 0;
-    // if (LoRaComm().receiveData(receivedData, receivedLength)) {
-    //     SYS_LOG("Received %zu bytes via LoRa", receivedLength);
-    //     
-    //     // Process received data through packet handler
-    //     if (receivedData && receivedLength > 0) {
-    //         PacketMgr().processIncomingData(receivedData, receivedLength);
-    //     }
-    //     
-    //     if (receivedData) {
-    //         free(receivedData);
-    //     }
-    // }
-    
-    // Send queued packets
-    // while (PacketMgr().getBufferUsage() > 0) {
-    //     if (!PacketMgr().sendPacket()) {
-    //         SYS_WARNING("Failed to send packet");
-    //         break;
-    //     }
-    // }
+    // Queue the next fragments, hand assembled packets to the LoRa lanes (by
+    // slot, no copy), then service radio events and feed the radio task -
+    // never waits on airtime. Backfill from the link backlog goes in behind
+    // live traffic. Received packets arrive via onLoRaPacketReceived.
+    FragmentMgr().process();
+    PacketMgr().drainToRadio();
+    Backlog().service();
+    LoRaComm().processQueue();
+    if (BulkLoRa().isReady()) {
+        BulkLoRa().processQueue();
+    }
 }
 
 void processPowerManagement() {
+    StageScope scope(Stage::POWER);
     // PowerMgr().update(); // Method doesn't exist
     
+    // Capture, telemetry and GPS rates for the charge and flight left
+    Planner().update();
+    
     // Check power status - use dummy data for now
     PowerData powerData = {3.7f, 0.1f, 85, millis(), true};
     
@@ -694,16 +1612,15 @@ void processPowerManagement() {
     } else if (powerData.batteryPercentage < BATTERY_LOW_THRESHOLD) {
         SYS_WARNING("Low battery level: %d%%", powerData.batteryPercentage);
         
-        // Disable non-critical systems
-        if (appState.cameraActive) {
-            Camera().enableCamera(false); // Use correct method
-            appState.cameraActive = false;
+        // Disable non-critical systems - the uplink task owns the camera
+        if (appState.cameraActive && !appState.cameraStopRequested) {
+            appState.cameraStopRequested = true;
             SYS_INFO("Camera disabled due to low power");
         }
     }
     
     // Update system state with power data
-    // SysState().setSubsystemState("power", SubsystemState::ACTIVE);
+    // SysState().setSubsystemState(Subsystem::POWER, SubsystemState::ACTIVE);
 }
 
 void processPacketHandling() {
@@ -716,47 +1633,157 @@ void processPacketHandling() {
     // }
     
     // Update subsystem state
-    // SysState().setSubsystemState("lora", SubsystemState::ACTIVE);
+    // SysState().setSubsystemState(Subsystem::LORA, SubsystemState::ACTIVE);
 }
 
-// ===========================
-// Timing Functions
-// ===========================
-
-bool shouldSendTelemetry() {
-    uint32_t currentTime = millis();
-    if (currentTime - appState.lastTelemetryTime >= TELEMETRY_INTERVAL_MS) {
-        appState.lastTelemetryTime = currentTime;
-        return true;
+// Every RTC_CHECKPOINT_INTERVAL_MS, what a crash would need to resume the flight
+void processCheckpoint() {
+    StageScope scope(Stage::CHECKPOINT);
+    static uint32_t lastCheckpoint = 0;
+    static bool stable = false;
+    
+    if (!stable && millis() > RTC_RESUME_STABLE_MS) {
+        Retained().markStable();
+        stable = true;
+    }
+    
+    if (millis() - lastCheckpoint < RTC_CHECKPOINT_INTERVAL_MS) {
+        return;
     }
-    return false;
+    lastCheckpoint = millis();
+    
+    RtcCheckpoint& checkpoint = Retained().prepareCheckpoint();
+    LoRaComm().saveRetained(checkpoint.state.link);
+    checkpoint.state.link.packetSequence = PacketMgr().getSequenceNumber();
+    Sensors().saveRetained(checkpoint.state.sensors);
+    checkpoint.state.mode = static_cast<uint8_t>(SysState().getMode());
+    checkpoint.state.flightPhase = static_cast<uint8_t>(SysState().getFlightPhase());
+    checkpoint.frameCount = LoRaComm().saveQueue(checkpoint.frames, RTC_QUEUE_FRAMES);
+    Retained().commitCheckpoint();
 }
 
-bool shouldSendHeartbeat() {
-    uint32_t currentTime = millis();
-    if (currentTime - appState.lastHeartbeatTime >= HEARTBEAT_INTERVAL_MS) {
-        appState.lastHeartbeatTime = currentTime;
-        return true;
+// A wake boot is one cycle: telemetry out and acknowledged, or the awake time spent, then sleep again
+void processWakeCycle() {
+    if (!appState.wakeBoot || !ENABLE_DEEP_SLEEP) {
+        return;
+    }
+    
+    uint32_t sent = LoRaComm().getFirstTransmitTime();
+    bool delivered = sent != 0 && LoRaComm().getTotalQueueSize() == 0 && !LoRaComm().isTransmitting() &&
+                     BulkLoRa().getTotalQueueSize() == 0 && !BulkLoRa().isTransmitting();
+    if (!delivered && millis() < MAX_AWAKE_TIME_MS) {
+        return;
+    }
+    
+    // From esp_timer starting, so the ROM and bootloader's part of the wake isn't in it
+    if (sent) {
+        SYS_INFO("Wake %lu: first frame %lu ms after wake, %s", Retained().getState().wakeCount, sent,
+                 delivered ? "delivered" : "unacknowledged");
+    } else {
+        SYS_WARNING("Wake %lu: nothing sent in %lu ms", Retained().getState().wakeCount, millis());
+    }
+    
+    // A burst or fast descent is worth the charge to follow with everything up
+    if (UlpMon().getStatus().reason == UlpWakeReason::PRESSURE) {
+        SYS_INFO("Pressure change woke the ULP - restarting into a full boot");
+        SysState().flushPersistence();
+        FlightRec().sync();
+        ESP.restart();
+    }
+    
+    // Slept for want of power: go on cycling until the battery is back, then a full boot brings the rest up
+    PowerMgr().forceUpdate();
+    if (PowerMgr().getPowerState() < PowerState::LOW_POWER) {
+        SYS_INFO("Battery recovered - restarting into a full boot");
+        SysState().flushPersistence();
+        FlightRec().sync();
+        ESP.restart();
     }
-    return false;
+    PowerMgr().enterDeepSleep(Retained().getState().sleepMs);
 }
 
-bool shouldReportStatus() {
-    uint32_t currentTime = millis();
-    if (currentTime - appState.lastStatusReportTime >= STATUS_REPORT_INTERVAL_MS) {
-        appState.lastStatusReportTime = currentTime;
+// ===========================
+// Timing Functions
+// ===========================
+
+// The flight task's work, as the scheduler's jobs - the state update first on a shared deadline
+void registerJobs() {
+    JobScheduler& scheduler = Scheduler();
+    
+    appState.senseJob = scheduler.addPeriodic("sense", [] {
+        // Its health checks only in the time before the next telemetry frame
+        SysState().setHealthCheckSlack(getTelemetrySlackUs());
+        updateSystemState();
+        processSensors();
+        processPowerManagement();
+        Cadence().update();
+        if (FlightRec().isReady()) {
+            StageScope scope(Stage::RECORDER);
+            FlightRec().update();
+        }
         return true;
-    }
-    return false;
+    }, [] { return Cadence().getInterval(CadenceStream::SENSE, MAIN_LOOP_INTERVAL_MS); }, true);
+    
+    // Stretched if the LoRa duty cycle can't carry the cadence at the current SF
+    appState.telemetryJob = scheduler.addPeriodic("telemetry", [] {
+        // A wake cycle exists to send one reading - wait for the first
+        if (appState.wakeBoot && !Sensors().getBMP280Data().valid) {
+            return false;
+        }
+        sendTelemetryData();
+        return true;
+    }, [] {
+        uint32_t interval = Cadence().getInterval(CadenceStream::TELEMETRY, Planner().getInterval(PlanStream::TELEMETRY));
+        return appState.communicationActive ? LoRaComm().getTransmitInterval(interval) : 0;
+    });
+    
+    appState.gpsJob = scheduler.addPeriodic("gps", [] {
+        sendGpsReport();
+        return true;
+    }, [] {
+        uint32_t interval = Cadence().getInterval(CadenceStream::GPS_REPORT, Planner().getInterval(PlanStream::GPS));
+        return interval ? LoRaComm().getTransmitInterval(interval) : 0;
+    });
+    
+    appState.heartbeatJob = scheduler.addPeriodic("heartbeat", [] {
+        sendHeartbeatPacket();
+        return true;
+    }, [] { return isLowRateLink() ? 0 : (uint32_t)Config().read()->heartbeatIntervalMs; });
+    
+    appState.statusJob = scheduler.addPeriodic("status", [] {
+        sendStatusReport();
+        return true;
+    }, [] { return isLowRateLink() ? 0 : (uint32_t)Config().read()->statusIntervalMs; });
+    
+    appState.performanceJob = scheduler.addPeriodic("performance", [] {
+        updatePerformanceMetrics(appState.lastLoopTime);
+        return true;
+    }, [] { return (uint32_t)PERFORMANCE_INTERVAL_MS; });
+    
+    appState.linkRecordJob = scheduler.addPeriodic("link_record", [] {
+        if (FlightRec().isReady()) {
+            StageScope scope(Stage::RECORDER);
+            FlightRec().recordLink();
+        }
+        return true;
+    }, [] { return (uint32_t)FLIGHT_RECORDER_LINK_INTERVAL_MS; });
+    
+    appState.trackJob = scheduler.addPeriodic("track", [] {
+        sendTrackSegment();
+        return true;
+    }, [] {
+        return TRACK_HISTORY_ENABLED ? LoRaComm().getTransmitInterval(Config().read()->trackIntervalMs) : 0;
+    });
+    
+    appState.digestJob = scheduler.addPeriodic("digest", [] {
+        sendDigest();
+        return true;
+    }, [] { return DIGEST_ENABLED ? LoRaComm().getTransmitInterval(DIGEST_INTERVAL_MS) : 0; });
 }
 
-bool shouldUpdatePerformance() {
-    uint32_t currentTime = millis();
-    if (currentTime - appState.lastPerformanceTime >= PERFORMANCE_INTERVAL_MS) {
-        appState.lastPerformanceTime = currentTime;
-        return true;
-    }
-    return false;
+// Until the telemetry job's deadline; all the time there is when nothing is sent
+uint32_t getTelemetrySlackUs() {
+    return Scheduler().getTimeUntilUs(appState.telemetryJob);
 }
 
 // ===========================
@@ -764,6 +1791,7 @@ bool shouldUpdatePerformance() {
 // ===========================
 
 void sendTelemetryData() {
+    StageScope scope(Stage::REPORTS);
     if (!appState.communicationActive) {
         return;
     }
@@ -789,27 +1817,80 @@ void sendTelemetryData() {
     telemetryData.cpuTemperature = sensorData.temperature;
     telemetryData.powerState = 1;
     
-    // Create and queue telemetry packet
-    if (PacketMgr().createTelemetryPacket(telemetryData)) {
-        SYS_LOG("Telemetry packet created");
+    FlightRec().recordTelemetry(telemetryData);
+    
+    // Nothing new since the last one sent - the recorder has it, the link doesn't need it
+    uint32_t now = millis();
+    if (!Deadband().checkTelemetry(telemetryData, now)) {
+        return;
+    }
+    
+    // Hand to the uplink task, which builds and queues the packet; the
+    // pressure reading's time starts the latency stamp
+    if (Uplink().postTelemetry(telemetryData, sensorData.valid ? (uint32_t)(sensorData.timeUs / 1000) : 0)) {
+        Deadband().sentTelemetry(telemetryData, now);
+        SYS_LOG("Telemetry posted");
+    } else {
+        SYS_WARNING("Failed to post telemetry");
+    }
+}
+
+// The position on its own, for tracking at the planner's rate
+void sendGpsReport() {
+    StageScope scope(Stage::REPORTS);
+    if (!appState.communicationActive || !Sensors().isGPSLocked()) {
+        return;
+    }
+    
+    int64_t fixTimeUs;
+    GPSData gpsData = Sensors().getGPSData(fixTimeUs);
+    FlightRec().recordGps(gpsData);
+    
+    uint32_t now = millis();
+    if (!Deadband().checkGps(gpsData, now)) {
+        return;
+    }
+    
+    if (Uplink().postGps(gpsData, (uint32_t)(fixTimeUs / 1000))) {
+        Deadband().sentGps(gpsData, now);
+        SYS_LOG("GPS report posted");
     } else {
-        SYS_WARNING("Failed to create telemetry packet");
+        SYS_WARNING("Failed to post GPS report");
+    }
+}
+
+// The vertices taken are gone from the balloon; the link backlog carries a lost segment late
+void sendTrackSegment() {
+    StageScope scope(Stage::REPORTS);
+    if (!appState.communicationActive || Track().getPending() == 0) {
+        return;
+    }
+    
+    static_assert(TRACK_SEGMENT_MAX_BYTES <= UPLINK_TRACK_LENGTH, "A segment fits an uplink request");
+    uint8_t segment[TRACK_SEGMENT_MAX_BYTES];
+    size_t length = Track().takeSegment(segment, sizeof(segment));
+    if (length && Uplink().postTrackSegment(segment, length)) {
+        SYS_LOG("Track segment posted (%u bytes)", (unsigned)length);
+    } else {
+        SYS_WARNING("Failed to post track segment");
     }
 }
 
 void sendHeartbeatPacket() {
+    StageScope scope(Stage::REPORTS);
     if (!appState.communicationActive) {
         return;
     }
     
-    if (PacketMgr().createHeartbeatPacket()) {
-        SYS_LOG("Heartbeat packet created");
+    if (Uplink().postHeartbeat()) {
+        SYS_LOG("Heartbeat posted");
     } else {
-        SYS_WARNING("Failed to create heartbeat packet");
+        SYS_WARNING("Failed to post heartbeat");
     }
 }
 
 void sendStatusReport() {
+    StageScope scope(Stage::REPORTS);
     if (!appState.communicationActive) {
         return;
     }
@@ -817,23 +1898,133 @@ void sendStatusReport() {
     // Create status message
     char statusMessage[200];
     snprintf(statusMessage, sizeof(statusMessage),
-             "Mode:%s Phase:%s Status:%s Loop:%lu MaxLoop:%lu",
+             "Mode:%s Phase:%s Status:%s Subsys:%04X Loop:%lu MaxLoop:%lu",
              SysState().modeToString(SysState().getMode()),
              SysState().flightPhaseToString(SysState().getFlightPhase()),
              SysState().statusToString(SysState().getSystemStatus()),
+             SysState().getSubsystemBits(),
              appState.loopCounter,
              appState.maxLoopTime);
     
-    if (PacketMgr().createStatusPacket(statusMessage)) {
-        SYS_LOG("Status report packet created");
+    if (Uplink().postStatus(statusMessage)) {
+        SYS_LOG("Status report posted");
+    } else {
+        SYS_WARNING("Failed to post status report");
+    }
+    
+    if (PACKET_LATENCY_REPORT && !Uplink().postLatencyStatus()) {
+        SYS_WARNING("Failed to post latency report");
+    }
+    
+    char scheduleReport[UPLINK_STATUS_LENGTH + 1];
+    if (SCHEDULER_JITTER_REPORT && Scheduler().formatReport(scheduleReport, sizeof(scheduleReport)) &&
+        !Uplink().postStatus(scheduleReport)) {
+        SYS_WARNING("Failed to post scheduler report");
+    }
+    
+    char summaryReport[UPLINK_STATUS_LENGTH + 1];
+    if (SENSOR_SUMMARY_REPORT &&
+        Sensors().formatSummaryReport(summaryReport, sizeof(summaryReport), SENSOR_SUMMARY_WINDOW_MS) &&
+        !Uplink().postStatus(summaryReport)) {
+        SYS_WARNING("Failed to post sensor summary");
+    }
+    
+    char statisticsReport[UPLINK_STATUS_LENGTH + 1];
+    if (SYSTEM_STATS_REPORT && SysState().formatStatisticsReport(statisticsReport, sizeof(statisticsReport)) &&
+        !Uplink().postStatus(statisticsReport)) {
+        SYS_WARNING("Failed to post flight statistics");
+    }
+}
+
+// Every subsystem in one frame; on a slow link it stands in for the heartbeat and status reports
+void sendDigest() {
+    StageScope scope(Stage::REPORTS);
+    if (!appState.communicationActive) {
+        return;
+    }
+    
+    DigestData digest;
+    memset(&digest, 0, sizeof(digest));
+    digest.uptime = millis();
+    digest.flightPhase = static_cast<uint8_t>(SysState().getFlightPhase());
+    digest.mode = static_cast<uint8_t>(SysState().getMode());
+    digest.systemStatus = static_cast<uint8_t>(SysState().getSystemStatus());
+    digest.subsystemBits = SysState().getSubsystemBits();
+    
+    BMP280Data sensorData = Sensors().getBMP280Data();
+    AltitudeEstimate altitude = Sensors().getAltitudeEstimate();
+    digest.temperature = sensorData.temperature;
+    digest.pressure = sensorData.pressure;
+    digest.altitude = altitude.valid ? altitude.altitude : sensorData.altitude;
+    digest.verticalSpeed = altitude.valid ? altitude.verticalSpeed : 0.0f;
+    if (Sensors().isGPSLocked()) {
+        GPSData gpsData = Sensors().getGPSData();
+        digest.latitude = gpsData.latitude;
+        digest.longitude = gpsData.longitude;
+        digest.satellites = gpsData.satellites;
+    }
+    
+    digest.batteryVoltage = PowerMgr().getBatteryVoltage();
+    digest.batteryPercentage = (uint8_t)constrain(PowerMgr().getBatteryPercentage(), 0.0f, 100.0f);
+    digest.current = PowerMgr().getTotalCurrent();
+    digest.powerState = static_cast<uint8_t>(PowerMgr().getPowerState());
+    
+    digest.rssi = LoRaComm().getAverageRSSI();
+    digest.snr = LoRaComm().getAverageSNR();
+    digest.spreadingFactor = LoRaComm().getSpreadingFactor();
+    digest.txPower = LoRaComm().getTxPower();
+    digest.packetErrorRate = (uint8_t)lroundf(constrain(LoRaComm().getPacketErrorRate(), 0.0f, 1.0f) * 100);
+    digest.ackTimeouts = LoRaComm().getAckTimeoutCount();
+    
+    digest.captures = Camera().getCaptureCount();
+    digest.captureErrors = Camera().getCaptureErrorCount();
+    
+    digest.freeHeapKb = ESP.getFreeHeap() / 1024;
+    digest.configVersion = Config().getVersion();
+    
+    digest.p99SensorsUs = (uint32_t)Profiler().getPercentileUs(Stage::SENSORS, 0.99f);
+    digest.p99ReportsUs = (uint32_t)Profiler().getPercentileUs(Stage::REPORTS, 0.99f);
+    digest.p99CameraUs = (uint32_t)Profiler().getPercentileUs(Stage::CAMERA, 0.99f);
+    digest.p99CommsUs = (uint32_t)Profiler().getPercentileUs(Stage::COMMUNICATIONS, 0.99f);
+    
+    if (Uplink().postDigest(digest)) {
+        SYS_LOG("Digest posted");
     } else {
-        SYS_WARNING("Failed to create status report packet");
+        SYS_WARNING("Failed to post digest");
     }
 }
 
+// A digest frame long enough on air that the heartbeat and status reports give way to it
+bool isLowRateLink() {
+    return DIGEST_ENABLED &&
+           LoRaComm().getTimeOnAirUs(MAX_DIGEST_SIZE) >= (uint32_t)DIGEST_LOW_RATE_AIRTIME_MS * 1000;
+}
+
 void processIncomingCommands() {
-    // This would process any received commands
-    // For now, it's a placeholder
+    StageScope scope(Stage::COMMANDS);
+    Probe().update();
+
+    uint8_t commandId = 0;
+    uint8_t params[PACKET_COMMAND_MAX_PARAMS];
+    size_t paramLength = sizeof(params);
+    if (PacketMgr().extractCommand(commandId, params, paramLength)) {
+        Commands().dispatch(commandId, params, paramLength);
+    }
+
+    uint8_t batch[PACKET_COMMAND_BATCH_BYTES];
+    size_t batchLength = sizeof(batch);
+    if (PacketMgr().extractCommandBatch(batch, batchLength)) {
+        Commands().runBatch(batch, batchLength);
+    }
+
+    // A received patch, one step per iteration; the restart once activated
+    Firmware().update();
+    if (Firmware().isRestartDue()) {
+        SYS_INFO("Restarting into the updated firmware");
+        SysState().flushPersistence();
+        FlightRec().sync();
+        ESP.restart();
+    }
 }
 
 // ===========================
@@ -870,11 +2061,21 @@ void updatePerformanceMetrics(uint32_t loopTime) {
     // Update debug performance metrics
     Debug.updateLoopTime(loopTime);
     
+    static uint32_t lastTaskSampleTime = 0;
+    if (millis() - lastTaskSampleTime >= TASK_USAGE_INTERVAL_MS) {
+        TaskUsage().sample();
+        lastTaskSampleTime = millis();
+    }
+    
     // Print performance info periodically
     static uint32_t lastPrintTime = 0;
     if (millis() - lastPrintTime > 60000) {  // Every minute
         SYS_INFO("Performance - Loop: %lu ms, Max: %lu ms, Avg: %lu ms, Count: %lu",
                  loopTime, appState.maxLoopTime, appState.avgLoopTime, appState.loopCounter);
+        TaskUsage().printReport();
+        Profiler().printReport();
+        Debug.printTimers();
+        MemLedger().printLedger();
         lastPrintTime = millis();
     }
 }
@@ -904,32 +2105,52 @@ bool checkSystemHealth() {
 // ===========================
 
 void onSystemEvent(const SystemEvent& event) {
-    // SYS_LOG("System event: %s", SysState().eventTypeToString(event.eventType)); // Method may not be accessible
-    
-    // Handle different event types - simplified for now
-    // switch (event.eventType) {
-    //     case EventType::EMERGENCY_TRIGGERED:
-    //         onEmergencyTriggered(reinterpret_cast<const char*>(event.data));
-    //         break;
-    //     case EventType::MODE_CHANGE:
-    //         onModeChanged(static_cast<SystemMode>(event.data[0]));
-    //         break;
-    //     case EventType::FLIGHT_PHASE_CHANGE:
-    //         onFlightPhaseChanged(static_cast<FlightPhase>(event.data[0]));
-    //         break;
-    //     default:
-    //         break;
-    // }
+    // Change events carry the old value, then the new one
+    switch (event.eventType) {
+        case EventType::MODE_CHANGE:
+            onModeChanged(static_cast<SystemMode>(event.data[1]));
+            break;
+        case EventType::FLIGHT_PHASE_CHANGE:
+            onFlightPhaseChanged(static_cast<FlightPhase>(event.data[1]));
+            break;
+        case EventType::GEOFENCE:
+            onGeofenceEvent(event);
+            break;
+        default:
+            break;
+    }
+}
+
+EmergencyBeacon buildEmergencyBeacon(const char* reason) {
+    EmergencyBeacon beacon;
+    if (strstr(reason, "battery")) {
+        beacon.code = LORA_EMERGENCY_BATTERY;
+    } else if (strstr(reason, "Altitude")) {
+        beacon.code = LORA_EMERGENCY_ALTITUDE;
+    } else if (strstr(reason, "Velocity")) {
+        beacon.code = LORA_EMERGENCY_DESCENT;
+    } else if (strstr(reason, "GPS")) {
+        beacon.code = LORA_EMERGENCY_GPS_LOSS;
+    } else {
+        beacon.code = LORA_EMERGENCY_SYSTEM;
+    }
+    beacon.severity = 5;
+    beacon.battery = PowerMgr().getBatteryVoltage() * 100;
+    beacon.altitude = Sensors().getAltitudeEstimate().altitude;
+    GPSData gps = Sensors().getGPSData();
+    beacon.latitude = gps.latitude * 1e7;
+    beacon.longitude = gps.longitude * 1e7;
+    return beacon;
 }
 
 void onEmergencyTriggered(const char* reason) {
     SYS_ERROR("Emergency triggered: %s", reason);
     
-    // Take emergency actions
-    if (appState.cameraActive) {
-        Camera().enableCamera(false); // Use correct method
-        appState.cameraActive = false;
+    // Take emergency actions - the uplink task turns the camera off
+    if (!EMERGENCY_CONTINUE_CAMERA) {
+        appState.cameraStopRequested = true;
     }
+    Scheduler().trigger(appState.telemetryJob);
     
     // Reduce sensor reading frequency - simplified for now
     // Sensors().setReadInterval(5000);  // 0.2 Hz
@@ -938,6 +2159,46 @@ void onEmergencyTriggered(const char* reason) {
     // LoRaComm().setPower(20);  // Maximum power
 }
 
+void onGeofenceEvent(const SystemEvent& event) {
+    GeofenceEventData data;
+    memcpy(&data, event.data, sizeof(data));
+    char name[GEOFENCE_NAME_SIZE + 1];
+    memcpy(name, data.name, GEOFENCE_NAME_SIZE);
+    name[GEOFENCE_NAME_SIZE] = '\0';
+    const char* kind = GeofenceManager::kindToString(static_cast<GeofenceKind>(data.kind));
+    
+    if (!data.entered) {
+        SYS_INFO("Geofence: left %s zone %u \"%s\"", kind, data.zoneId, name);
+        return;
+    }
+    SYS_WARNING("Geofence: entered %s zone %u \"%s\" at %.5f, %.5f, %ld m", kind, data.zoneId, name,
+                data.lat * 1e-7, data.lon * 1e-7, (long)data.altitude);
+    
+    // Position and status go down now, not at their next interval
+    Scheduler().trigger(appState.gpsJob);
+    Scheduler().trigger(appState.statusJob);
+}
+
+// Each published config version; the keys that changed go to their owners
+void onConfigApplied(const RuntimeConfig& previous, const RuntimeConfig& current, void*) {
+    if (current.cameraBurstFrames != previous.cameraBurstFrames &&
+        !Camera().setBurstFrames(current.cameraBurstFrames)) {
+        SYS_WARNING("Config v%lu: camera burst %ld not applied", (unsigned long)current.version,
+                    (long)current.cameraBurstFrames);
+    }
+    if (current.loraTxPower != previous.loraTxPower && !LoRaComm().setTxPower(current.loraTxPower)) {
+        SYS_WARNING("Config v%lu: TX power %ld not applied", (unsigned long)current.version, (long)current.loraTxPower);
+    }
+    if (current.loraArqWindow != previous.loraArqWindow && !LoRaComm().setArqWindowSize(current.loraArqWindow)) {
+        SYS_WARNING("Config v%lu: ARQ window %ld not applied", (unsigned long)current.version,
+                    (long)current.loraArqWindow);
+    }
+    if (current.debugLevel != previous.debugLevel) {
+        Debug.setDebugLevel(static_cast<DebugLevel>(current.debugLevel));
+    }
+    // The intervals aren't pushed: their jobs read them as they reschedule
+}
+
 void onModeChanged(SystemMode newMode) {
     SYS_INFO("System mode changed to: %s", SysState().modeToString(newMode));
     
@@ -967,6 +2228,12 @@ void onModeChanged(SystemMode newMode) {
 void onFlightPhaseChanged(FlightPhase newPhase) {
     SYS_INFO("Flight phase changed to: %s", SysState().flightPhaseToString(newPhase));
     
+    // The position where it happened, and the new phase's cadences from here
+    Cadence().update();
+    Deadband().forceNext();
+    Scheduler().trigger(appState.gpsJob);
+    Scheduler().trigger(appState.telemetryJob);
+    
     // Adjust behavior based on flight phase - simplified for now
     // switch (newPhase) {
     //     case FlightPhase::LAUNCH:
@@ -988,6 +2255,59 @@ void onFlightPhaseChanged(FlightPhase newPhase) {
     // }
 }
 
+void onLoRaPacketReceived(const Packet& packet) {
+    // LoRaComm() has already stripped framing and checked the CRC
+    PacketMgr().processPayload(packet.type, packet.payload, packet.payloadLength);
+    Pipes().signal(PipeEvent::RADIO_RECEIVED);
+}
+
+void onLoRaFrameCaptured(const RadioEvent& event) {
+    FlightRec().captureRadioRx(event.rssi, event.snr, event.data, event.length);
+}
+
+static_assert(linkCaptureRecordMax(LINK_CAPTURE_SNAP_BYTES) <= FLIGHT_RECORDER_MAX_PAYLOAD,
+              "A link capture record is one flight record");
+
+// Encoded here, so /linkcap.pcap only strings the payloads together
+void onLinkCaptured(void* context, const LinkCaptureFrame& frame) {
+    uint8_t record[linkCaptureRecordMax(LINK_CAPTURE_SNAP_BYTES)];
+    size_t length = linkCaptureEncode(frame, record, sizeof(record), LINK_CAPTURE_SNAP_BYTES);
+    if (length) {
+        FlightRec().record(FlightRecordType::LINK_FRAME, record, length);
+    }
+}
+
+// On the sensor task; the uplink task builds the packet
+void onProfileLevel(void* context, const ProfileLevel& level) {
+    Uplink().postProfileLevel(level);
+}
+
+void onDeepSleep(uint32_t durationMs) {
+    // Everything the next wake resumes from; RTC memory is all that stays powered
+    RetainedState& state = Retained().prepare();
+    LoRaComm().saveRetained(state.link);
+    state.link.packetSequence = PacketMgr().getSequenceNumber();
+    Sensors().enterGPSBackup(durationMs);
+    Sensors().saveRetained(state.sensors);
+    state.mode = static_cast<uint8_t>(SysState().getMode());
+    state.flightPhase = static_cast<uint8_t>(SysState().getFlightPhase());
+    state.wakeToTransmitMs = LoRaComm().getFirstTransmitTime();
+    Retained().save(durationMs);
+    SysState().flushPersistence();
+    FlightRec().sync();
+    SYS_INFO("Retained state saved, sleeping %lu ms", durationMs);
+    
+    // The ULP watches battery and pressure meanwhile, so the timer can be long
+    if (ULP_MONITOR_ENABLED) {
+        UlpMonitorConfig monitor = {};
+        monitor.batteryWakeVolts = ULP_BATTERY_WAKE_VOLTAGE;
+        Sensors().prepareSleepMonitor(monitor);
+        if (!UlpMon().arm(monitor)) {
+            SYS_WARNING("ULP monitor not armed - timer wake only");
+        }
+    }
+}
+
 // ===========================
 // Debug and Development Functions
 // ===========================
@@ -1007,6 +2327,23 @@ void printDebugInfo() {
     Serial.printf("Flight Mode: %s\n", appState.flightMode ? "Yes" : "No");
     Serial.printf("Emergency Mode: %s\n", appState.emergencyMode ? "Yes" : "No");
     Serial.printf("Low Power Mode: %s\n", appState.lowPowerMode ? "Yes" : "No");
+    Watchdog().printStatus();
+    Uplink().printStatus();
+    Backlog().printStatus();
+    Downlink().printStatus();
+    SdRec().printStatus();
+    AccessPoint().printStatus();
+    Dump().printStatus();
+    Arbiter().printStatus();
+    Config().printStatus();
+    Cadence().printStatus();
+    Deadband().printStatus();
+    Scheduler().printStatus();
+    Pipes().printStatus();
+    Commands().printStatus();
+    Firmware().printStatus();
+    Geofence().printStatus();
+    Track().printStatus();
     Serial.println("========================\n");
 }
 #endif
@@ -0,0 +1,286 @@
+/**
+ * Main Base Station Firmware
+ * ESP32-S3 High-Altitude Balloon Project
+ * Phase 3 Implementation
+ *
+ * Receives the balloon's LoRa frames and serves them over WiFi. The radio
+ * engine, codecs, CRC and fragment reassembly are the balloon's own modules,
+ * built with DEVICE_TYPE set to DEVICE_BASE_STATION.
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "base_station_config.h"
+
+// Module Headers
+#include "lora_comm.h"
+#include "packet_handler.h"
+#include "fragment_transfer.h"
+#include "rx_pipeline.h"
+#include "packet_store.h"
+#include "base_station_sessions.h"
+#include "base_station_flights.h"
+#include "base_station_columns.h"
+#include "base_station_rollups.h"
+#include "base_station_images.h"
+#include "base_station_predictor.h"
+#include "base_station_alerts.h"
+#include "base_station_fanout.h"
+#include "base_station_latency.h"
+#include "base_station_web.h"
+#include "base_station_firmware.h"
+#include "base_station_capture.h"
+#include "base_station_tiles.h"
+#include "base_station_track.h"
+#include "base_station_diversity.h"
+#include "base_station_share.h"
+#include "debug_utils.h"
+#include "task_placement.h"
+#include "memory_ledger.h"
+#include "memory_arena.h"
+
+// ===========================
+// Global Configuration
+// ===========================
+
+#define FIRMWARE_VERSION "2.0.0"
+#define BUILD_DATE __DATE__ " " __TIME__
+
+#define SETUP_DELAY_MS           1000
+#define STATUS_REPORT_INTERVAL_MS 60000   // 1 minute
+
+// The RX task runs everything that touches LoRaComm()'s queues: radio
+// events, the ACKs they trigger, fragment ACKs from reassembly, and the
+// firmware uplink's transfers and commands, which POST /api/firmware only
+// hands over. loop() and the web server otherwise only read the packet
+// store and counters; loop() copies packets out of the store into the
+// flash columns. A reassembled image is copied into the image cache on the
+// RX task; its thumbnail and flash write happen on loop().
+//
+//   core 0   lora_radio (5) > lora_rx (4) > httpd (2) > loop (1)
+//
+// A frame is off the chip as soon as DIO0 wakes the radio task, and in the
+// store one RX_TASK_POLL_MS poll later; neither waits on a web client.
+
+static bool initialized = false;
+static uint32_t lastStatusReport = 0;
+static uint32_t lastUsageSample = 0;
+
+// Runs on the RX task, ahead of LoRaComm().processQueue()
+static void serviceLinkLayer() {
+    Diversity().service();      // Other stations' frames, and combined ones to the link layer
+    FirmwareUplink().process();
+    FragmentMgr().process();
+    PacketMgr().drainToRadio();
+}
+
+// Loop task, as each sample reaches flash
+static void onColumnSample(uint8_t deviceId, Column column, uint32_t time, float value) {
+    Rollups().add(deviceId, column, time, value);
+}
+
+static bool startWiFi() {
+    // A diversity secondary also joins the primary's access point, a
+    // sharing station the network with the internet
+    bool secondary = DIVERSITY_ROLE == DIVERSITY_SECONDARY;
+    WiFi.mode(secondary || SHARE_ENABLED ? WIFI_AP_STA : WIFI_AP);
+    if (!WiFi.softAP(WIFI_AP_SSID, WIFI_AP_PASSWORD, WIFI_AP_CHANNEL, 0, WIFI_AP_MAX_CLIENTS)) {
+        return false;
+    }
+    SYS_INFO("Access point %s on channel %d, %s", WIFI_AP_SSID, WIFI_AP_CHANNEL,
+             WiFi.softAPIP().toString().c_str());
+    if (secondary) {
+        WiFi.setAutoReconnect(true);
+        WiFi.begin(DIVERSITY_PRIMARY_SSID, DIVERSITY_PRIMARY_PASS);
+    } else if (SHARE_ENABLED) {
+        WiFi.setAutoReconnect(true);
+        WiFi.begin(SHARE_WIFI_SSID, SHARE_WIFI_PASS);
+    }
+    return true;
+}
+
+static bool startReceiver() {
+    if (!LoRaComm().begin()) {
+        SYS_ERROR("LoRa receiver initialization failed");
+        return false;
+    }
+    LoRaComm().enableRxWindows(false);      // LORA_CONTINUOUS_LISTEN
+
+    // Optional second module for the balloon's images and backlog; the
+    // primary link carries everything without it
+    if (LORA_BULK_RADIO_FITTED) {
+        if (BulkLoRa().begin()) {
+            BulkLoRa().enableRxWindows(false);
+        } else {
+            SYS_WARNING("Bulk LoRa receiver initialization failed - primary link only");
+        }
+    }
+
+    if (!PacketMgr().begin()) {
+        SYS_ERROR("Packet handler initialization failed");
+        return false;
+    }
+    if (!FragmentMgr().begin() || !FragmentMgr().attachToPipeline()) {
+        SYS_ERROR("Fragment reassembly initialization failed");
+        return false;
+    }
+    if (!FirmwareUplink().begin()) {
+        SYS_WARNING("Firmware uplink did not start - POST /api/firmware is refused");
+    }
+    if (!Packets().begin()) {
+        SYS_ERROR("Packet store initialization failed");
+        return false;
+    }
+
+    if (!Latency().begin()) {
+        SYS_WARNING("Latency monitor did not start - no room for its sink");
+    }
+
+    RxPipeline().setServiceHook(serviceLinkLayer);
+    if (!RxPipeline().begin()) {
+        SYS_ERROR("Receive pipeline failed to start");
+        return false;
+    }
+    SYS_INFO("Receiver started - %u packets held in %s", (unsigned)Packets().getCapacity(),
+             MemLedger().getStatus(MemTag::RECEIVE).current[static_cast<uint8_t>(MemRegion::PSRAM)] ? "PSRAM" : "internal RAM");
+    return true;
+}
+
+void printSystemStatus() {
+    SYS_INFO("Uptime %lu s, free heap %lu", millis() / 1000, (unsigned long)ESP.getFreeHeap());
+    RxPipeline().printStatus();
+    Packets().printStatus();
+    Sessions().printStatus();
+    Columns().printStatus();
+    Rollups().printStatus();
+    Images().printStatus();
+    Flights().printStatus();
+    LinkCaptures().printStatus();
+    Tiles().printStatus();
+    Predictor().printStatus();
+    Tracks().printStatus();
+    Alerts().printStatus();
+    Diversity().printStatus();
+    Share().printStatus();
+    Fanout().printStatus();
+    Latency().printStatus();
+    FragmentMgr().printStatus();
+    FirmwareUplink().printStatus();
+    MemLedger().printLedger();
+    TaskUsage().printReport();
+}
+
+// ===========================
+// Arduino Entry Points
+// ===========================
+
+void setup() {
+    Serial.begin(SERIAL_BAUD_RATE);
+    delay(SETUP_DELAY_MS);
+
+    Serial.println();
+    Serial.println("========================================");
+    Serial.printf("Cosmic1 Base Station Firmware v%s\n", FIRMWARE_VERSION);
+    Serial.printf("Build: %s\n", BUILD_DATE);
+    Serial.println("========================================");
+
+    if (!Debug.begin()) {
+        Serial.println("FATAL: Failed to initialize debug system!");
+        return;
+    }
+
+    // The receiver first - nothing the web side does waits on it
+    if (!startReceiver()) {
+        return;
+    }
+    if (!Sessions().begin()) {
+        SYS_ERROR("Session table initialization failed");
+        return;
+    }
+    if (!startWiFi()) {
+        SYS_WARNING("Access point did not start - receiving without the web interface");
+    } else if (!startBaseStationServer()) {
+        SYS_WARNING("Web server did not start");
+    } else {
+        SYS_INFO("Web server on port %d", WEB_SERVER_PORT);
+    }
+    if (!Diversity().begin()) {
+        SYS_WARNING("Receive diversity did not start - this station ACKs on its own");
+    }
+    if (!Share().begin()) {
+        SYS_WARNING("Position sharing did not start");
+    }
+    Columns().setSampleHook(onColumnSample);
+    if (ENABLE_FLASH_STORAGE && !Columns().begin()) {
+        SYS_WARNING("Column store did not start - packets are held in RAM only");
+    } else if (!Rollups().begin()) {
+        SYS_WARNING("Graph rollups did not start");
+    }
+    if (ENABLE_MAP_DISPLAY && !Predictor().begin()) {
+        SYS_WARNING("Landing predictor did not start");
+    }
+    if (ENABLE_MAP_DISPLAY && !Tracks().begin()) {
+        SYS_WARNING("Track store did not start - the map has only the position reports");
+    }
+    if (ENABLE_ALERTS && !Alerts().begin()) {
+        SYS_WARNING("Alert engine did not start");
+    } else {
+        Alerts().setEventHook(broadcastAlert);
+    }
+    if (!Images().begin()) {
+        SYS_WARNING("Image cache did not start - images are not kept");
+    } else {
+        FragmentMgr().setTransferCompleteCallback(ImageCache::onTransferComplete, &Images());
+    }
+    if (!Flights().begin()) {
+        SYS_WARNING("Flight catalog did not start");
+    }
+    if (ENABLE_LINK_CAPTURE) {
+        if (!LinkCaptures().begin()) {
+            SYS_WARNING("Link capture did not start");
+        } else {
+            LoRaComm().setCaptureSink(CaptureStore::onFrame, &LinkCaptures());
+            BulkLoRa().setCaptureSink(CaptureStore::onFrame, &LinkCaptures());
+        }
+    }
+    if (ENABLE_MAP_DISPLAY && ENABLE_TILE_SERVER) {
+        if (!Tiles().begin()) {
+            SYS_WARNING("Tile server did not start - the map needs internet");
+        } else if (Tiles().hasArchive()) {
+            SYS_INFO("Map tiles: %lu, zoom %u-%u", (unsigned long)Tiles().getHeader().tileCount,
+                     Tiles().getHeader().minZoom, Tiles().getHeader().maxZoom);
+        }
+    }
+
+    printMemoryMap();
+    initialized = true;
+    lastStatusReport = millis();
+}
+
+void loop() {
+    if (!initialized) {
+        delay(1000);
+        return;
+    }
+
+    uint32_t now = millis();
+    if (now - lastUsageSample >= TASK_USAGE_INTERVAL_MS) {
+        TaskUsage().sample();
+        lastUsageSample = now;
+    }
+    Sessions().update();
+    Columns().update();
+    Images().update();
+    Flights().update();     // After the image cache, for the images' flights
+    LinkCaptures().update();
+    Predictor().update();
+    Tracks().update();
+    Alerts().update();
+    Diversity().update();
+    updateBaseStationServer();
+    if (now - lastStatusReport >= STATUS_REPORT_INTERVAL_MS) {
+        printSystemStatus();
+        lastStatusReport = now;
+    }
+    delay(100);
+}
@@ -0,0 +1,443 @@
+/**
+ * Benchmark Firmware
+ * ESP32-S3 High-Altitude Balloon Project
+ *
+ * The balloon's hot kernels timed on the board with the CPU cycle counter:
+ * CRC, the LoRa frame codec, the queues between tasks, the BMP280 read,
+ * JPEG capture and thumbnails at each frame size the sensor has, and LoRa
+ * time on air at each spreading factor, and a replay of whatever raw
+ * inputs the "fr" partition holds (input_replay.h) through the GPS, baro
+ * and frame parsers, then the payload codecs' own table (codec_benchmark.h).
+ * Built from the balloon's own modules by the esp32-s3-benchmark
+ * environment.
+ *
+ * Results are lines tools/bench_compare.py reads out of the monitor log:
+ *   @bench-run,<firmware>,<cpu MHz>,<build>
+ *   @bench,<suite>,<name>,<param>,<n>,<min>,<median>,<mean>,<max>,<extra>
+ *   @bench-skip,<suite>,<param>,<reason>
+ *   @bench-end,<ms>
+ * min..max are CPU cycles per operation over n runs; extra is each suite's
+ * own figure (bytes handled, or the modelled airtime in us). A suite whose
+ * hardware doesn't answer is skipped, not failed. 'r' on the serial port
+ * runs everything again.
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <algorithm>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "esp_camera.h"
+#include "balloon_config.h"
+#include "debug_utils.h"
+#include "sensor_pins.h"
+
+#include "crc_utils.h"
+#include "codec_benchmark.h"
+#include "lora_comm.h"
+#include "radio_driver.h"
+#include "uplink_queue.h"
+#include "bmp280.h"
+#include "camera_manager.h"
+#include "image_scale.h"
+#include "input_replay.h"
+
+#define FIRMWARE_VERSION "2.0.0"
+#define SETUP_DELAY_MS             1000
+
+#define BENCH_MAX_SAMPLES          64      // Runs per result
+#define BENCH_INNER_RUNS           16      // Calls per run for the sub-microsecond kernels
+#define BENCH_BMP280_RUNS          32
+#define BENCH_CAMERA_RUNS          8
+#define BENCH_CAMERA_WARMUP        3       // Frames after a size change, while exposure settles
+#define BENCH_SCALE_RUNS           4
+#define BENCH_LORA_FRAME_BYTES     64
+#define BENCH_LORA_TX_POWER        2       // dBm - airtime doesn't depend on it
+#define BENCH_LORA_MIN_SF          7       // SF6 needs implicit headers
+#define BENCH_LORA_MAX_SF          12
+#define BENCH_REPLAY_RUNS          4       // Whole-capture replays; each must give the same digest
+
+static uint32_t samples[BENCH_MAX_SAMPLES];
+static volatile uint32_t txDoneCycles;
+static volatile bool txDone;
+
+// ===========================
+// Results
+// ===========================
+
+// One line per result, samples[0..n) sorted in place for the median
+static void report(const char* suite, const char* name, const char* param, int n, uint32_t extra) {
+    if (n <= 0) {
+        return;
+    }
+    std::sort(samples, samples + n);
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++) {
+        total += samples[i];
+    }
+    Serial.printf("@bench,%s,%s,%s,%d,%lu,%lu,%lu,%lu,%lu\n", suite, name, param, n, (unsigned long)samples[0],
+                  (unsigned long)samples[n / 2], (unsigned long)(total / n), (unsigned long)samples[n - 1],
+                  (unsigned long)extra);
+}
+
+static void skip(const char* suite, const char* param, const char* reason) {
+    Serial.printf("@bench-skip,%s,%s,%s\n", suite, param, reason);
+}
+
+// n runs of fn, inner calls each; a run's cycles are divided by inner
+template <typename Fn>
+static void bench(const char* suite, const char* name, const char* param, int n, int inner, uint32_t extra, Fn fn) {
+    n = min(n, BENCH_MAX_SAMPLES);
+    for (int i = 0; i < n; i++) {
+        uint32_t start = ESP.getCycleCount();
+        for (int j = 0; j < inner; j++) {
+            fn();
+        }
+        samples[i] = (ESP.getCycleCount() - start) / inner;
+    }
+    report(suite, name, param, n, extra);
+}
+
+// ===========================
+// Suites
+// ===========================
+
+static void crcSuite() {
+    static const size_t lengths[] = {16, 64, 255};
+    uint8_t data[255];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = random(256);
+    }
+    volatile uint32_t sink = 0;
+    char param[8];
+    for (size_t length : lengths) {
+        snprintf(param, sizeof(param), "%u", (unsigned)length);
+        bench("crc", "crc8", param, BENCH_MAX_SAMPLES, BENCH_INNER_RUNS, length,
+              [&]() { sink += crc8(data, length); });
+        bench("crc", "crc16_ccitt", param, BENCH_MAX_SAMPLES, BENCH_INNER_RUNS, length,
+              [&]() { sink += crc16Ccitt(data, length); });
+        bench("crc", "crc16_modbus", param, BENCH_MAX_SAMPLES, BENCH_INNER_RUNS, length,
+              [&]() { sink += crc16Modbus(data, length); });
+    }
+}
+
+static void codecSuite() {
+    uint8_t payload[TELEMETRY_KEYFRAME_SIZE];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = random(256);
+    }
+    uint8_t frame[MAX_PACKET_SIZE];
+    size_t frameLength = 0;
+    Packet packet = createPacket(PacketType::TELEMETRY, payload, sizeof(payload));
+    if (!serializePacket(packet, frame, frameLength)) {
+        skip("codec", "telemetry", "serialize failed");
+        return;
+    }
+    volatile uint32_t sink = 0;
+    bench("codec", "serialize", "telemetry", BENCH_MAX_SAMPLES, BENCH_INNER_RUNS, frameLength, [&]() {
+        size_t length = 0;
+        serializePacket(packet, frame, length);
+        sink += length;
+    });
+    bench("codec", "deserialize", "telemetry", BENCH_MAX_SAMPLES, BENCH_INNER_RUNS, frameLength, [&]() {
+        Packet decoded;
+        sink += deserializePacket(frame, frameLength, decoded) && verifyFrameCRC(frame, frameLength);
+    });
+}
+
+// The uplink queue's ring against the FreeRTOS queue it stands in for, one
+// request through each
+static void queueSuite() {
+    static EventRing<UplinkRequest, UPLINK_QUEUE_DEPTH> ring;
+    static UplinkRequest request;
+    static UplinkRequest taken;
+    memset(&request, 0, sizeof(request));
+    request.kind = UplinkKind::TELEMETRY;
+
+    bench("queue", "event_ring", "push+pop", BENCH_MAX_SAMPLES, BENCH_INNER_RUNS, sizeof(request), [&]() {
+        ring.push(request);
+        ring.pop(taken);
+    });
+
+    QueueHandle_t queue = xQueueCreate(UPLINK_QUEUE_DEPTH, sizeof(UplinkRequest));
+    if (!queue) {
+        skip("queue", "freertos", "no memory");
+        return;
+    }
+    bench("queue", "freertos", "send+receive", BENCH_MAX_SAMPLES, BENCH_INNER_RUNS, sizeof(request), [&]() {
+        xQueueSend(queue, &request, 0);
+        xQueueReceive(queue, &taken, 0);
+    });
+    vQueueDelete(queue);
+}
+
+// The two bus transactions of a forced-mode sample, the conversion waited out between them
+static void bmp280Suite() {
+    static Bmp280 sensor;
+    Wire.begin(BMP280_SDA_PIN, BMP280_SCL_PIN);
+    if (!sensor.begin(Wire, BMP280_ADDRESS, BMP280_SAMPLING_TEMP, BMP280_SAMPLING_PRESS, BMP280_FILTER)) {
+        skip("bmp280", "read", "not found");
+        return;
+    }
+    uint32_t triggers[BENCH_MAX_SAMPLES];
+    int n = 0;
+    for (; n < BENCH_BMP280_RUNS; n++) {
+        uint32_t start = ESP.getCycleCount();
+        bool started = sensor.startMeasurement();
+        triggers[n] = ESP.getCycleCount() - start;
+        delay(sensor.getMeasurementTimeMs());
+
+        Bmp280Sample sample;
+        start = ESP.getCycleCount();
+        bool read = sensor.readMeasurement(sample);
+        samples[n] = ESP.getCycleCount() - start;
+        if (!started || !read) {
+            skip("bmp280", "read", "bus error");
+            return;
+        }
+    }
+    report("bmp280", "read", "burst6", n, BMP280_DATA_LEN);
+    memcpy(samples, triggers, n * sizeof(uint32_t));
+    report("bmp280", "trigger", "ctrl_meas", n, 1);
+}
+
+// The capture and thumbnail pipeline as flown, at each frame size up to the
+// sensor's largest; the driver is restarted for each so its frame buffers fit
+static void cameraSuite() {
+    if (!Camera().begin()) {
+        skip("camera", "all", "init failed");
+        return;
+    }
+    sensor_t* sensor = esp_camera_sensor_get();
+    camera_sensor_info_t* info = sensor ? esp_camera_sensor_get_info(&sensor->id) : nullptr;
+    framesize_t largest = info ? info->max_size : BALLOON_CAMERA_FRAMESIZE;
+
+    char param[16];
+    for (int size = FRAMESIZE_96X96; size <= largest && size < FRAMESIZE_INVALID; size++) {
+        framesize_t frameSize = static_cast<framesize_t>(size);
+        snprintf(param, sizeof(param), "%ux%u", resolution[size].width, resolution[size].height);
+        if (!Camera().setFrameSize(frameSize) || !Camera().reinitialize()) {
+            skip("camera", param, "frame size refused");
+            continue;
+        }
+        for (int i = 0; i < BENCH_CAMERA_WARMUP; i++) {
+            Camera().captureImage();
+        }
+
+        int n = 0;
+        uint32_t bytes = 0;
+        for (; n < BENCH_CAMERA_RUNS; n++) {
+            uint32_t start = ESP.getCycleCount();
+            if (!Camera().captureImage()) {
+                break;
+            }
+            samples[n] = ESP.getCycleCount() - start;
+            bytes += Camera().getCurrentImage().length;
+        }
+        if (n < BENCH_CAMERA_RUNS) {
+            skip("camera", param, "capture failed");
+            continue;
+        }
+        report("camera", "capture", param, n, bytes / n);
+
+        bytes = 0;
+        for (n = 0; n < BENCH_CAMERA_RUNS; n++) {
+            uint32_t start = ESP.getCycleCount();
+            if (!Camera().captureThumbnail() || !Camera().waitForThumbnail() || !Camera().getCurrentThumbnail().valid) {
+                break;
+            }
+            samples[n] = ESP.getCycleCount() - start;
+            bytes += Camera().getCurrentThumbnail().length;
+        }
+        if (n < BENCH_CAMERA_RUNS) {
+            skip("thumbnail", param, "thumbnail failed");
+            continue;
+        }
+        report("thumbnail", "jpeg", param, n, bytes / n);
+    }
+
+    Camera().setFrameSize(BALLOON_CAMERA_FRAMESIZE);
+    Camera().end();
+}
+
+// The downscaler alone, from a synthetic RGB565 frame at each size to the
+// thumbnail width - no sensor needed
+static void scaleSuite() {
+    const resolution_info_t& full = resolution[FRAMESIZE_UXGA];
+    uint8_t* src = (uint8_t*)ps_malloc((size_t)full.width * full.height * 2);
+    uint8_t* dst = (uint8_t*)malloc(CAMERA_THUMB_MAX_WIDTH * CAMERA_THUMB_MAX_WIDTH * 2);
+    if (!src || !dst) {
+        free(src);
+        free(dst);
+        skip("thumbnail", "scale", "no memory");
+        return;
+    }
+    for (size_t i = 0; i < (size_t)full.width * full.height * 2; i++) {
+        src[i] = i * 7 + (i >> 9);
+    }
+
+    char param[16];
+    for (int size = FRAMESIZE_QQVGA; size <= FRAMESIZE_UXGA; size++) {
+        uint16_t width = resolution[size].width;
+        uint16_t height = resolution[size].height;
+        uint16_t thumbHeight = (uint32_t)height * CAMERA_THUMB_MAX_WIDTH / width;
+        snprintf(param, sizeof(param), "%ux%u", width, height);
+        bench("thumbnail", "scale_rgb565", param, BENCH_SCALE_RUNS, 1, (uint32_t)width * height, [&]() {
+            scaleImage(PIXFORMAT_RGB565, src, width, height, dst, CAMERA_THUMB_MAX_WIDTH, thumbHeight);
+        });
+    }
+    free(src);
+    free(dst);
+}
+
+static void onRadioIrq(void* context, bool fromIsr) {
+    txDoneCycles = ESP.getCycleCount();
+    txDone = true;
+}
+
+// startTransmit() to the TX done interrupt, at each spreading factor; extra
+// is calculateTimeOnAirUs() for the same frame, to check the model against
+static void loraSuite() {
+    RadioDriver& radio = HardwareRadio();
+    if (!radio.begin((long)(LORA_FREQUENCY * 1E6))) {
+        skip("lora", "all", "radio not found");
+        return;
+    }
+    radio.setSignalBandwidth(LORA_BANDWIDTH);
+    radio.setCodingRate4(LORA_CODING_RATE);
+    radio.setTxPower(BENCH_LORA_TX_POWER);
+    radio.setPreambleLength(LORA_PREAMBLE_LEN);
+    radio.setSyncWord(LORA_SYNC_WORD);
+    radio.attachIrq(onRadioIrq, nullptr);
+
+    uint8_t frame[BENCH_LORA_FRAME_BYTES];
+    for (size_t i = 0; i < sizeof(frame); i++) {
+        frame[i] = random(256);
+    }
+    uint8_t buffer[MAX_PACKET_SIZE];
+    char param[8];
+    for (int sf = BENCH_LORA_MIN_SF; sf <= BENCH_LORA_MAX_SF; sf++) {
+        snprintf(param, sizeof(param), "sf%d", sf);
+        radio.setSpreadingFactor(sf);
+        uint32_t modelUs = calculateTimeOnAirUs(sizeof(frame), sf, LORA_BANDWIDTH, LORA_CODING_RATE,
+                                                LORA_PREAMBLE_LEN);
+        int runs = sf <= 9 ? 8 : 3;     // SF12 is ~2 s a frame
+        int n = 0;
+        for (; n < runs; n++) {
+            txDone = false;
+            uint32_t started = millis();
+            uint32_t start = ESP.getCycleCount();
+            radio.startTransmit(frame, sizeof(frame));
+            while (!txDone && millis() - started < 2 * modelUs / 1000 + 500) {
+                vTaskDelay(1);
+            }
+            size_t length;
+            int8_t rssi, snr;
+            radio.serviceIrq(buffer, sizeof(buffer), length, rssi, snr);
+            if (!txDone) {
+                break;
+            }
+            samples[n] = txDoneCycles - start;
+        }
+        if (n < runs) {
+            skip("lora", param, "no TX done");
+            continue;
+        }
+        report("lora", "tx", param, n, modelUs);
+    }
+    radio.detachIrq();
+    radio.sleep();
+    radio.end();
+}
+
+// The captured inputs through the parsers and filter at full speed; cycles
+// per record by stage, extra the records a replay feeds that stage
+static void replaySuite() {
+    static const char* const stageNames[REPLAY_STAGE_COUNT] = {"gps", "baro", "radio", "camera"};
+    static InputReplay replay;
+    static ReplayPipeline pipeline;
+    static uint32_t stageSamples[REPLAY_STAGE_COUNT][BENCH_REPLAY_RUNS];
+    static uint32_t totalSamples[BENCH_REPLAY_RUNS];
+    if (!replay.begin()) {
+        skip("replay", "fr", "no partition");
+        return;
+    }
+
+    ReplayResult result;
+    uint16_t digest = 0;
+    for (int run = 0; run < BENCH_REPLAY_RUNS; run++) {
+        pipeline.reset();
+        uint32_t start = ESP.getCycleCount();
+        replay.run(pipeline, 0.0f, result);
+        uint32_t cycles = ESP.getCycleCount() - start;
+        if (result.records == 0) {
+            skip("replay", "fr", "no raw capture");
+            replay.end();
+            return;
+        }
+        if (run > 0 && pipeline.getDigest() != digest) {
+            skip("replay", "digest", "differs between runs");
+        }
+        digest = pipeline.getDigest();
+        for (uint8_t s = 0; s < REPLAY_STAGE_COUNT; s++) {
+            const ReplayStageStats& stats = pipeline.getStage(static_cast<ReplayStage>(s));
+            stageSamples[s][run] = stats.records ? (uint32_t)(stats.cycles / stats.records) : 0;
+        }
+        totalSamples[run] = cycles / result.records;
+    }
+    replay.end();
+
+    // Camera records carry metadata only - nothing to time
+    for (uint8_t s = 0; s < REPLAY_STAGE_COUNT; s++) {
+        uint32_t records = pipeline.getStage(static_cast<ReplayStage>(s)).records;
+        if (static_cast<ReplayStage>(s) == ReplayStage::CAMERA || records == 0) {
+            continue;
+        }
+        memcpy(samples, stageSamples[s], sizeof(stageSamples[s]));
+        report("replay", stageNames[s], "record", BENCH_REPLAY_RUNS, records);
+    }
+    memcpy(samples, totalSamples, sizeof(totalSamples));
+    report("replay", "all", "record", BENCH_REPLAY_RUNS, result.records);
+    Serial.printf("Replay: %lu records over %lu sectors, %lu boots, %lu ms recorded in %lu ms\n",
+                  (unsigned long)result.records, (unsigned long)result.sectors, (unsigned long)result.boots,
+                  (unsigned long)result.recordedMs, (unsigned long)result.elapsedMs);
+    pipeline.printSummary(Serial);
+}
+
+static void runBenchmarks() {
+    uint32_t start = millis();
+    Serial.printf("@bench-run,%s,%lu,%s %s\n", FIRMWARE_VERSION, (unsigned long)ESP.getCpuFreqMHz(), __DATE__,
+                  __TIME__);
+    crcSuite();
+    codecSuite();
+    queueSuite();
+    bmp280Suite();
+    scaleSuite();
+    cameraSuite();
+    loraSuite();
+    replaySuite();
+    codecBenchmark();   // Its own table - not @bench lines, bench_compare.py skips it
+    Serial.printf("@bench-end,%lu\n", (unsigned long)(millis() - start));
+}
+
+// ===========================
+// Arduino Entry Points
+// ===========================
+
+void setup() {
+    Serial.begin(SERIAL_BAUD_RATE);
+    delay(SETUP_DELAY_MS);
+
+    Serial.println();
+    Serial.println("========================================");
+    Serial.printf("Cosmic1 Benchmark Firmware v%s\n", FIRMWARE_VERSION);
+    Serial.println("========================================");
+    runBenchmarks();
+}
+
+void loop() {
+    if (Serial.available() && Serial.read() == 'r') {
+        runBenchmarks();
+    }
+    delay(100);
+}
@@ -0,0 +1,242 @@
+#include "memory_arena.h"
+#include "debug_utils.h"
+#if __has_include(<esp_memory_utils.h>)
+#include <esp_memory_utils.h>
+#else
+#include <soc/soc_memory_layout.h>
+#endif
+
+static MemoryArena* arenas[MEM_ARENA_MAX];
+static uint8_t arenaCount = 0;
+
+static inline size_t alignUp(size_t value) {
+    return (value + MEM_ARENA_ALIGN - 1) & ~(size_t)(MEM_ARENA_ALIGN - 1);
+}
+
+// ===========================
+// Memory Arena
+// ===========================
+
+MemoryArena::MemoryArena() {
+    name = "";
+    tag = MemTag::COUNT;
+    base = nullptr;
+    capacity = 0;
+    misses = 0;
+}
+
+bool MemoryArena::owns(const void* buffer) const {
+    const uint8_t* p = static_cast<const uint8_t*>(buffer);
+    return base && p >= base && p < base + capacity;
+}
+
+bool MemoryArena::reserve(const char* arenaName, MemTag arenaTag, size_t bytes, uint32_t caps) {
+    name = arenaName;
+    tag = arenaTag;
+
+    // Listed even when its block couldn't be had - the map shows it empty
+    bool listed = false;
+    for (uint8_t i = 0; i < arenaCount; i++) {
+        listed = listed || arenas[i] == this;
+    }
+    if (!listed && arenaCount < MEM_ARENA_MAX) {
+        arenas[arenaCount++] = this;
+    }
+
+    // No fallback to the other region: an arena meant for PSRAM would take
+    // the internal RAM it is there to spare
+    base = static_cast<uint8_t*>(memAllocCaps(tag, bytes, caps, MEM_ARENA_ALIGN));
+    if (!base) {
+        SYS_WARNING("Arena %s: no %lu bytes at boot - its requests go to the heap", name, (unsigned long)bytes);
+        return false;
+    }
+    capacity = bytes;
+    return true;
+}
+
+MemArenaStatus MemoryArena::baseStatus() const {
+    MemArenaStatus status;
+    memset(&status, 0, sizeof(status));
+    status.name = name;
+    status.tag = tag;
+    status.region = base && esp_ptr_external_ram(base) ? MemRegion::PSRAM : MemRegion::INTERNAL;
+    status.base = reinterpret_cast<uintptr_t>(base);
+    status.capacity = capacity;
+    status.misses = misses;
+    return status;
+}
+
+// ===========================
+// Bump Arena
+// ===========================
+
+BumpArena::BumpArena() {
+    offset = 0;
+    peak = 0;
+}
+
+bool BumpArena::begin(const char* arenaName, MemTag arenaTag, size_t bytes, uint32_t caps) {
+    if (isReserved()) {
+        return true;
+    }
+    offset = 0;
+    peak = 0;
+    return reserve(arenaName, arenaTag, alignUp(bytes), caps);
+}
+
+void* BumpArena::alloc(size_t size) {
+    size = alignUp(size);
+    if (!base || size > capacity - offset) {
+        misses++;
+        return nullptr;
+    }
+    void* buffer = base + offset;
+    offset += size;
+    if (offset > peak) {
+        peak = offset;
+    }
+    return buffer;
+}
+
+void BumpArena::rewind(ArenaMark point) {
+    if (point <= offset) {
+        offset = point;
+    }
+}
+
+MemArenaStatus BumpArena::getStatus() const {
+    MemArenaStatus status = baseStatus();
+    status.used = offset;
+    status.peak = peak;
+    return status;
+}
+
+// ===========================
+// Slab Pool
+// ===========================
+
+SlabPool::SlabPool() {
+    freeList = nullptr;
+    blockSize = 0;
+    blockCount = 0;
+    inUse = 0;
+    peakInUse = 0;
+    portMUX_INITIALIZE(&lock);
+}
+
+bool SlabPool::begin(const char* arenaName, MemTag arenaTag, size_t blockBytes, uint16_t blocks, uint32_t caps) {
+    if (isReserved()) {
+        return true;
+    }
+    blockSize = alignUp(max(blockBytes, sizeof(FreeBlock)));
+    blockCount = 0;
+    if (!reserve(arenaName, arenaTag, blockSize * blocks, caps)) {
+        return false;
+    }
+
+    blockCount = blocks;
+    freeList = nullptr;
+    for (uint16_t i = blocks; i > 0; i--) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(base + (size_t)(i - 1) * blockSize);
+        block->next = freeList;
+        freeList = block;
+    }
+    return true;
+}
+
+void* SlabPool::alloc(size_t size) {
+    FreeBlock* block = nullptr;
+    if (size <= blockSize) {
+        portENTER_CRITICAL(&lock);
+        block = freeList;
+        if (block) {
+            freeList = block->next;
+            inUse++;
+            if (inUse > peakInUse) {
+                peakInUse = inUse;
+            }
+        }
+        portEXIT_CRITICAL(&lock);
+    }
+    if (block) {
+        return block;
+    }
+
+    portENTER_CRITICAL(&lock);
+    misses++;
+    portEXIT_CRITICAL(&lock);
+    return memAlloc(tag, size);
+}
+
+void SlabPool::free(void* buffer) {
+    if (!buffer) {
+        return;
+    }
+    if (!owns(buffer)) {
+        memFree(tag, buffer);
+        return;
+    }
+    FreeBlock* block = static_cast<FreeBlock*>(buffer);
+    portENTER_CRITICAL(&lock);
+    block->next = freeList;
+    freeList = block;
+    inUse--;
+    portEXIT_CRITICAL(&lock);
+}
+
+MemArenaStatus SlabPool::getStatus() const {
+    MemArenaStatus status = baseStatus();
+    portENTER_CRITICAL(&lock);
+    status.used = (uint32_t)inUse * blockSize;
+    status.peak = (uint32_t)peakInUse * blockSize;
+    status.misses = misses;
+    portEXIT_CRITICAL(&lock);
+    return status;
+}
+
+// ===========================
+// Memory Map
+// ===========================
+
+size_t getMemoryArenas(MemArenaStatus* out, size_t maxArenas) {
+    for (uint8_t i = 0; i < arenaCount && i < maxArenas; i++) {
+        out[i] = arenas[i]->getStatus();
+    }
+    return arenaCount;
+}
+
+void printMemoryMap() {
+    Serial.println("=== Memory Map ===");
+    size_t budgetCount = 0;
+    const MemBudgetEntry* budget = memBudgetTable(budgetCount);
+    Serial.println("Budget             Region       Bytes    Limit");
+    for (size_t i = 0; i < budgetCount; i++) {
+        Serial.printf("%-18s %-8s %9lu %8lu\n", budget[i].name, MemoryLedger::regionToString(budget[i].region),
+                      (unsigned long)budget[i].bytes, (unsigned long)budget[i].limit);
+    }
+    Serial.println("Arena          Subsystem    Region        Base     Size     Used     Peak  Misses");
+    uint32_t reserved[MEM_REGION_COUNT] = {0, 0};
+    for (uint8_t i = 0; i < arenaCount; i++) {
+        MemArenaStatus status = arenas[i]->getStatus();
+        Serial.printf("%-14s %-12s %-8s 0x%08lx %8lu %8lu %8lu %7lu\n", status.name,
+                      MemoryLedger::tagToString(status.tag),
+                      status.base ? MemoryLedger::regionToString(status.region) : "none",
+                      (unsigned long)status.base, (unsigned long)status.capacity, (unsigned long)status.used,
+                      (unsigned long)status.peak, (unsigned long)status.misses);
+        reserved[static_cast<uint8_t>(status.region)] += status.capacity;
+    }
+
+    for (uint8_t r = 0; r < MEM_REGION_COUNT; r++) {
+        MemRegionStatus region = MemoryLedger::getRegion(static_cast<MemRegion>(r));
+        Serial.printf("%-8s %lu in arenas, free %lu, largest block %lu, low %lu\n",
+                      MemoryLedger::regionToString(static_cast<MemRegion>(r)), (unsigned long)reserved[r],
+                      (unsigned long)region.freeBytes, (unsigned long)region.largestBlock,
+                      (unsigned long)region.minimumFree);
+    }
+
+    MemRegionStatus internal = MemoryLedger::getRegion(MemRegion::INTERNAL);
+    if (internal.freeBytes < MEM_INTERNAL_RESERVE_BYTES) {
+        SYS_WARNING("Internal RAM free after boot %lu, under the %lu kept for WiFi and the radio",
+                    (unsigned long)internal.freeBytes, (unsigned long)MEM_INTERNAL_RESERVE_BYTES);
+    }
+}
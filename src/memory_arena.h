@@ -0,0 +1,127 @@
+#ifndef MEMORY_ARENA_H
+#define MEMORY_ARENA_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "memory_ledger.h"
+#include "memory_budget.h"
+
+// ===========================
+// Memory Arenas
+// Fixed blocks a subsystem reserves once at boot and carves up itself, so
+// what it allocates at runtime comes and goes inside its own block
+// ===========================
+
+// memAlloc() puts each buffer in the right region, but buffers freed and
+// allocated again at other sizes, every transfer or every message, still
+// leave holes, and internal RAM is where WiFi and the radio need
+// contiguous blocks long into a flight. An arena takes its whole block in
+// begin(), counted against its tag in the ledger like any other buffer,
+// and keeps it for good:
+//   BumpArena  scratch handed out in order and taken back all at once, to
+//              a mark() or with reset() - work that ends within one call
+//   SlabPool   a fixed count of equal blocks on a free list - buffers of a
+//              known largest size that come and go in any order
+//
+// A BumpArena that is full hands back nullptr and its owner takes the
+// heap for that one; a SlabPool does so itself, allocating from memAlloc()
+// what is too big or finds no block free and freeing it there again - an
+// arena bounds the churn without adding a limit. An arena whose block
+// couldn't be had runs every request that way. A BumpArena has no lock:
+// only its owner's task uses it. A SlabPool takes a spinlock, so blocks
+// can be given back from another task.
+//
+// Arenas register by name; printMemoryMap() lists them, the build's
+// budget table (memory_budget.h) and the regions once setup() is done, and
+// warns when less than MEM_INTERNAL_RESERVE_BYTES of internal RAM is left
+// for WiFi, the radio and DMA.
+
+#define MEM_ARENA_MAX               8
+#define MEM_ARENA_ALIGN             8                   // Of every block and allocation
+#define MEM_INTERNAL_RESERVE_BYTES  (48 * 1024)         // Internal RAM the boot map wants still free
+
+struct MemArenaStatus {
+    const char* name;
+    MemTag tag;
+    MemRegion region;
+    uintptr_t base;
+    uint32_t capacity;          // Bytes
+    uint32_t used;
+    uint32_t peak;
+    uint32_t misses;            // Requests that went to the heap instead
+};
+
+class MemoryArena {
+public:
+    MemoryArena();
+    virtual ~MemoryArena() {}
+
+    bool isReserved() const { return base != nullptr; }
+    bool owns(const void* buffer) const;
+    virtual MemArenaStatus getStatus() const = 0;
+
+protected:
+    bool reserve(const char* arenaName, MemTag arenaTag, size_t bytes, uint32_t caps);
+    MemArenaStatus baseStatus() const;
+
+    const char* name;
+    MemTag tag;
+    uint8_t* base;
+    size_t capacity;
+    uint32_t misses;
+};
+
+// An offset into a BumpArena to rewind to
+typedef uint32_t ArenaMark;
+
+class BumpArena : public MemoryArena {
+public:
+    BumpArena();
+
+    bool begin(const char* arenaName, MemTag arenaTag, size_t bytes, uint32_t caps);
+
+    void* alloc(size_t size);               // nullptr when full
+    ArenaMark mark() const { return offset; }
+    void rewind(ArenaMark point);
+    void reset() { rewind(0); }
+
+    MemArenaStatus getStatus() const override;
+
+private:
+    size_t offset;
+    size_t peak;
+};
+
+class SlabPool : public MemoryArena {
+public:
+    SlabPool();
+
+    bool begin(const char* arenaName, MemTag arenaTag, size_t blockBytes, uint16_t blocks, uint32_t caps);
+
+    void* alloc(size_t size);               // A block, or memAlloc() when none fits
+    void free(void* buffer);                // Either kind
+
+    size_t getBlockSize() const { return blockSize; }
+    MemArenaStatus getStatus() const override;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* freeList;
+    size_t blockSize;
+    uint16_t blockCount;
+    uint16_t inUse;
+    uint16_t peakInUse;
+    mutable portMUX_TYPE lock;
+};
+
+// The registered arenas' status into out; how many there are
+size_t getMemoryArenas(MemArenaStatus* out, size_t maxArenas);
+
+// The budget table, every registered arena, then the regions
+void printMemoryMap();
+
+#endif // MEMORY_ARENA_H
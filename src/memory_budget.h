@@ -0,0 +1,69 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "memory_ledger.h"
+
+// ===========================
+// Memory Budget
+// What each manager and fixed buffer may take, held to it by the compiler
+// ===========================
+
+// Each build's instances file lists its table in rows of two kinds:
+//   STATIC(type, count, limit)               count instances of a manager, in .bss - internal RAM
+//   RESERVED(name, region, bytes, limit)     a block begin() takes, sized from config macros
+// MEM_BUDGET_TABLE() makes a static_assert of every row and of each
+// region's total, so a queue depth raised in a header fails the build with
+// the manager's name instead of an allocation failing in flight. What is
+// sized at runtime - camera frames, time series channels - isn't listed.
+//
+// Limits are for the 32-bit target with room to grow, not sizes to fill.
+// The table is compiled into the build, and printMemoryMap() and the base
+// station's /api/memory list it next to what the ledger measures.
+
+struct MemBudgetEntry {
+    const char* name;
+    MemRegion region;
+    uint32_t bytes;
+    uint32_t limit;
+};
+
+template <size_t N>
+constexpr uint32_t memBudgetTotal(const MemBudgetEntry (&table)[N], MemRegion region) {
+    uint32_t total = 0;
+    for (size_t i = 0; i < N; i++) {
+        total += table[i].region == region ? table[i].bytes : 0;
+    }
+    return total;
+}
+
+// The simulator's host build has 64-bit pointers, so its sizes say
+// nothing about the target's; it keeps the table and skips the checks
+#ifdef BALLOON_SIM
+#define MEM_BUDGET_CHECK(condition, message)
+#else
+#define MEM_BUDGET_CHECK(condition, message) static_assert(condition, message);
+#endif
+
+#define MEM_BUDGET_ASSERT_STATIC(type, count, limit) \
+    MEM_BUDGET_CHECK(sizeof(type) * (count) <= (limit), #type " is over its static memory budget")
+#define MEM_BUDGET_ASSERT_RESERVED(name, region, bytes, limit) \
+    MEM_BUDGET_CHECK((bytes) <= (limit), name " is over its memory budget")
+#define MEM_BUDGET_ENTRY_STATIC(type, count, limit) \
+    {#type, MemRegion::INTERNAL, (uint32_t)(sizeof(type) * (count)), (uint32_t)(limit)},
+#define MEM_BUDGET_ENTRY_RESERVED(name, region, bytes, limit) \
+    {name, region, (uint32_t)(bytes), (uint32_t)(limit)},
+
+// The rows' checks, the table as name and the region totals' checks
+#define MEM_BUDGET_TABLE(name, ROWS, internalLimit, psramLimit)                                        \
+    ROWS(MEM_BUDGET_ASSERT_STATIC, MEM_BUDGET_ASSERT_RESERVED)                                          \
+    static constexpr MemBudgetEntry name[] = {ROWS(MEM_BUDGET_ENTRY_STATIC, MEM_BUDGET_ENTRY_RESERVED)}; \
+    MEM_BUDGET_CHECK(memBudgetTotal(name, MemRegion::INTERNAL) <= (internalLimit),                      \
+                     "Internal RAM budget exceeded")                                                   \
+    MEM_BUDGET_CHECK(memBudgetTotal(name, MemRegion::PSRAM) <= (psramLimit), "PSRAM budget exceeded")
+
+// The build's table, defined in its instances file
+const MemBudgetEntry* memBudgetTable(size_t& count);
+
+#endif // MEMORY_BUDGET_H
@@ -0,0 +1,199 @@
+#include "memory_ledger.h"
+#include <esp_heap_caps.h>
+#if __has_include(<esp_memory_utils.h>)
+#include <esp_memory_utils.h>
+#else
+#include <soc/soc_memory_layout.h>
+#endif
+
+static MemoryLedger memoryLedgerInstance;
+
+MemoryLedger& MemLedger() {
+    return memoryLedgerInstance;
+}
+
+static inline MemRegion regionOf(const void* buffer) {
+    return esp_ptr_external_ram(buffer) ? MemRegion::PSRAM : MemRegion::INTERNAL;
+}
+
+// ===========================
+// Allocation Wrappers
+// ===========================
+
+void* memAlloc(MemTag tag, size_t size) {
+    const uint32_t psram = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+    const uint32_t internal = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    bool large = size >= MEM_PSRAM_MIN_BYTES;
+
+    void* buffer = heap_caps_malloc(size, large ? psram : internal);
+    if (!buffer) {
+        buffer = heap_caps_malloc(size, large ? internal : psram);
+    }
+    if (!buffer) {
+        MemLedger().recordFailure(tag, size, large ? psram : internal);
+        return nullptr;
+    }
+    MemLedger().recordAllocation(tag, buffer);
+    return buffer;
+}
+
+void* memAllocCaps(MemTag tag, size_t size, uint32_t caps, size_t alignment) {
+    void* buffer = alignment ? heap_caps_aligned_alloc(alignment, size, caps) : heap_caps_malloc(size, caps);
+    if (!buffer) {
+        MemLedger().recordFailure(tag, size, caps);
+        return nullptr;
+    }
+    MemLedger().recordAllocation(tag, buffer);
+    return buffer;
+}
+
+void* memCalloc(MemTag tag, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) {
+        return nullptr;
+    }
+    void* buffer = memAlloc(tag, count * size);
+    if (buffer) {
+        memset(buffer, 0, count * size);
+    }
+    return buffer;
+}
+
+void memAdopt(MemTag tag, void* buffer) {
+    if (buffer) {
+        MemLedger().recordAllocation(tag, buffer);
+    }
+}
+
+void memFree(MemTag tag, void* buffer) {
+    if (buffer) {
+        MemLedger().recordFree(tag, buffer);
+        heap_caps_free(buffer);
+    }
+}
+
+// ===========================
+// Ledger
+// ===========================
+
+MemoryLedger::MemoryLedger() {
+    memset(tags, 0, sizeof(tags));
+    portMUX_INITIALIZE(&lock);
+}
+
+void MemoryLedger::recordAllocation(MemTag tag, void* buffer) {
+    uint32_t size = heap_caps_get_allocated_size(buffer);
+    uint8_t region = static_cast<uint8_t>(regionOf(buffer));
+
+    portENTER_CRITICAL(&lock);
+    MemTagStatus& status = tags[static_cast<uint8_t>(tag)];
+    status.current[region] += size;
+    status.allocations++;
+    uint32_t total = status.current[0] + status.current[1];
+    if (total > status.peak) {
+        status.peak = total;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void MemoryLedger::recordFree(MemTag tag, void* buffer) {
+    uint32_t size = heap_caps_get_allocated_size(buffer);
+    uint8_t region = static_cast<uint8_t>(regionOf(buffer));
+
+    portENTER_CRITICAL(&lock);
+    MemTagStatus& status = tags[static_cast<uint8_t>(tag)];
+    status.current[region] -= min(size, status.current[region]);     // A mismatched tag mustn't wrap
+    status.frees++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void MemoryLedger::recordFailure(MemTag tag, size_t size, uint32_t caps) {
+    // Walks the heap - only on the failure path
+    uint32_t largest = heap_caps_get_largest_free_block(caps);
+
+    portENTER_CRITICAL(&lock);
+    MemTagStatus& status = tags[static_cast<uint8_t>(tag)];
+    status.failures++;
+    status.lastFailedBytes = size;
+    status.largestAtFailure = largest;
+    portEXIT_CRITICAL(&lock);
+}
+
+MemTagStatus MemoryLedger::getStatus(MemTag tag) const {
+    portENTER_CRITICAL(&lock);
+    MemTagStatus status = tags[static_cast<uint8_t>(tag)];
+    portEXIT_CRITICAL(&lock);
+    return status;
+}
+
+uint32_t MemoryLedger::getCurrent(MemTag tag) const {
+    MemTagStatus status = getStatus(tag);
+    return status.current[0] + status.current[1];
+}
+
+uint32_t MemoryLedger::getPeak(MemTag tag) const {
+    return getStatus(tag).peak;
+}
+
+MemRegionStatus MemoryLedger::getRegion(MemRegion region) {
+    uint32_t caps = (region == MemRegion::PSRAM ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) | MALLOC_CAP_8BIT;
+    MemRegionStatus status;
+    status.freeBytes = heap_caps_get_free_size(caps);
+    status.largestBlock = heap_caps_get_largest_free_block(caps);
+    status.minimumFree = heap_caps_get_minimum_free_size(caps);
+    status.fragmentation = status.freeBytes ? 1.0f - (float)status.largestBlock / status.freeBytes : 0.0f;
+    return status;
+}
+
+void MemoryLedger::printLedger() const {
+    Serial.println("=== Memory Ledger ===");
+    Serial.println("Subsystem     Internal      PSRAM       Peak   Allocs    Frees  Failed");
+    for (uint8_t i = 0; i < MEM_TAG_COUNT; i++) {
+        MemTagStatus status = getStatus(static_cast<MemTag>(i));
+        Serial.printf("%-12s %9lu %10lu %10lu %8lu %8lu %7lu", tagToString(static_cast<MemTag>(i)),
+                      (unsigned long)status.current[0], (unsigned long)status.current[1],
+                      (unsigned long)status.peak, (unsigned long)status.allocations,
+                      (unsigned long)status.frees, (unsigned long)status.failures);
+        if (status.failures) {
+            Serial.printf("  (last %lu bytes, largest free %lu)", (unsigned long)status.lastFailedBytes,
+                          (unsigned long)status.largestAtFailure);
+        }
+        Serial.println();
+    }
+    for (uint8_t r = 0; r < MEM_REGION_COUNT; r++) {
+        MemRegionStatus region = getRegion(static_cast<MemRegion>(r));
+        Serial.printf("%-8s free %lu, largest block %lu (%.0f%% fragmented), low %lu\n",
+                      regionToString(static_cast<MemRegion>(r)), (unsigned long)region.freeBytes,
+                      (unsigned long)region.largestBlock, region.fragmentation * 100.0f,
+                      (unsigned long)region.minimumFree);
+    }
+}
+
+const char* MemoryLedger::tagToString(MemTag tag) {
+    switch (tag) {
+        case MemTag::CAMERA: return "camera";
+        case MemTag::STREAM: return "stream";
+        case MemTag::FEC: return "fec";
+        case MemTag::FRAGMENTS: return "fragments";
+        case MemTag::IMAGE_STORE: return "image_store";
+        case MemTag::RECEIVE: return "receive";
+        case MemTag::TIMESERIES: return "timeseries";
+        case MemTag::LOGGING: return "logging";
+        case MemTag::EXPORT: return "export";
+        case MemTag::PREDICTOR: return "predictor";
+        case MemTag::ALERTS: return "alerts";
+        case MemTag::FANOUT: return "fanout";
+        case MemTag::FIRMWARE: return "firmware";
+        case MemTag::WEB: return "web";
+        case MemTag::PIPELINE: return "pipeline";
+        case MemTag::SD_RECORDER: return "sd_recorder";
+        default: return "unknown";
+    }
+}
+
+const char* MemoryLedger::regionToString(MemRegion region) {
+    switch (region) {
+        case MemRegion::INTERNAL: return "internal";
+        case MemRegion::PSRAM: return "psram";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef MEMORY_LEDGER_H
+#define MEMORY_LEDGER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_heap_caps.h>
+#include "freertos/FreeRTOS.h"
+
+// ===========================
+// Memory Ledger
+// Heap and PSRAM bytes held by each subsystem, through tagged allocation
+// wrappers that also decide where a buffer goes
+// ===========================
+
+// memAlloc() routes by size: MEM_PSRAM_MIN_BYTES and up tries PSRAM first
+// and falls back to internal RAM, smaller tries internal first, so frame
+// and image buffers stay out of the internal heap and small, hot ones stay
+// out of the slower PSRAM. memAllocCaps() takes given caps with no
+// fallback, for buffers that must be internal or aligned. memAdopt() counts
+// a buffer a library allocated (frame2jpg()) against a tag, and memFree()
+// handles all of them.
+//
+// The wrappers keep no header: the size freed is read back with
+// heap_caps_get_allocated_size(), so a buffer must be freed with the tag
+// it was allocated with. Each tag tracks its current and peak bytes in
+// each region, its allocation and free counts, and its failures along with
+// the region's largest free block at the time - the fragmentation that
+// made it fail. The regions' free, largest block and low-water mark are
+// read at report time. Updates come from several tasks under one spinlock,
+// held for a few adds.
+
+#define MEM_PSRAM_MIN_BYTES     4096    // memAlloc() sizes from here go to PSRAM first
+
+enum class MemTag : uint8_t {
+    CAMERA = 0,         // CameraManager's image, thumbnail, tile and layer buffers, the frame pool
+    STREAM,             // /stream frames, BMP strips and rate filters
+    FEC,
+    FRAGMENTS,
+    IMAGE_STORE,
+    RECEIVE,            // The RX record pool
+    TIMESERIES,
+    LOGGING,            // Debug log and trace rings, probe reports
+    EXPORT,             // Base station export windows and deflate state
+    PREDICTOR,          // Base station wind profiles and flight tracks
+    ALERTS,             // Base station alert rule states and windows
+    FANOUT,             // Base station WebSocket messages queued to clients
+    FIRMWARE,           // Firmware patches held until applied or sent
+    WEB,                // HTTP response buffers: compression windows, API documents, map tiles
+    PIPELINE,           // Coroutine frames of pipeline.h flows
+    SD_RECORDER,        // The SD recorder's write-behind ring, index and DMA chunk
+    COUNT
+};
+
+#define MEM_TAG_COUNT static_cast<uint8_t>(MemTag::COUNT)
+
+enum class MemRegion : uint8_t {
+    INTERNAL = 0,
+    PSRAM,
+    COUNT
+};
+
+#define MEM_REGION_COUNT static_cast<uint8_t>(MemRegion::COUNT)
+
+struct MemTagStatus {
+    uint32_t current[MEM_REGION_COUNT];     // Bytes held now
+    uint32_t peak;                          // Most bytes held at once, both regions
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;
+    uint32_t lastFailedBytes;
+    uint32_t largestAtFailure;              // Largest free block the failed request could have had
+};
+
+struct MemRegionStatus {
+    uint32_t freeBytes;
+    uint32_t largestBlock;
+    uint32_t minimumFree;                   // Low-water mark since boot
+    float fragmentation;                    // 1 - largest / free
+};
+
+// Allocation wrappers; nullptr when nothing fits
+void* memAlloc(MemTag tag, size_t size);
+void* memAllocCaps(MemTag tag, size_t size, uint32_t caps, size_t alignment = 0);
+void* memCalloc(MemTag tag, size_t count, size_t size);
+void memAdopt(MemTag tag, void* buffer);
+void memFree(MemTag tag, void* buffer);
+
+class MemoryLedger {
+public:
+    MemoryLedger();
+
+    void recordAllocation(MemTag tag, void* buffer);
+    void recordFree(MemTag tag, void* buffer);
+    void recordFailure(MemTag tag, size_t size, uint32_t caps);
+
+    MemTagStatus getStatus(MemTag tag) const;
+    uint32_t getCurrent(MemTag tag) const;          // Both regions
+    uint32_t getPeak(MemTag tag) const;
+    static MemRegionStatus getRegion(MemRegion region);
+
+    void printLedger() const;
+
+    static const char* tagToString(MemTag tag);
+    static const char* regionToString(MemRegion region);
+
+private:
+    MemTagStatus tags[MEM_TAG_COUNT];
+    mutable portMUX_TYPE lock;
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern MemoryLedger& MemLedger();
+
+#endif // MEMORY_LEDGER_H
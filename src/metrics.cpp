@@ -0,0 +1,177 @@
+#include "metrics.h"
+
+// ===========================
+// Histogram
+// ===========================
+
+MetricHistogram::MetricHistogram(const uint32_t* bounds, uint8_t boundCount) {
+    setBounds(bounds, boundCount);
+}
+
+MetricHistogram::MetricHistogram() {
+    setBounds(nullptr, 0);
+}
+
+void MetricHistogram::setBounds(const uint32_t* bounds, uint8_t boundCount) {
+    this->boundCount = min(boundCount, (uint8_t)METRICS_HISTOGRAM_BOUNDS);
+    for (uint8_t i = 0; i < this->boundCount; i++) {
+        this->bounds[i] = bounds[i];
+    }
+    for (uint8_t i = 0; i <= METRICS_HISTOGRAM_BOUNDS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+}
+
+void MetricHistogram::observe(uint32_t value) {
+    uint8_t bucket = 0;
+    while (bucket < boundCount && value > bounds[bucket]) {
+        bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t MetricHistogram::getPercentileBound(uint8_t percent) const {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i <= boundCount; i++) {
+        total += getBucket(i);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    // The smallest rank at or past percent of the samples
+    uint32_t rank = ((uint64_t)total * min(percent, (uint8_t)100) + 99) / 100;
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < boundCount; i++) {
+        cumulative += getBucket(i);
+        if (cumulative >= max(rank, (uint32_t)1)) {
+            return bounds[i];
+        }
+    }
+    return UINT32_MAX;
+}
+
+// ===========================
+// Registry
+// ===========================
+
+MetricsRegistry::MetricsRegistry() {
+    count = 0;
+}
+
+bool MetricsRegistry::add(const MetricEntry& entry) {
+    if (count >= METRICS_MAX_ENTRIES) {
+        return false;
+    }
+    entries[count++] = entry;
+    return true;
+}
+
+bool MetricsRegistry::addCounter(const char* name, const char* help, MetricCounterReader reader) {
+    return add({name, help, MetricType::COUNTER, reader, nullptr, nullptr, nullptr, 0, nullptr, nullptr, nullptr});
+}
+
+bool MetricsRegistry::addGauge(const char* name, const char* help, MetricGaugeReader reader) {
+    return add({name, help, MetricType::GAUGE, nullptr, reader, nullptr, nullptr, 0, nullptr, nullptr, nullptr});
+}
+
+bool MetricsRegistry::addHistogram(const char* name, const char* help, const MetricHistogram& histogram) {
+    return add({name, help, MetricType::HISTOGRAM, nullptr, nullptr, &histogram, nullptr, 0, nullptr, nullptr, nullptr});
+}
+
+bool MetricsRegistry::addGaugeFamily(const char* name, const char* help, const char* label, uint8_t size,
+                                     MetricLabelReader labelValue, MetricFamilyReader reader) {
+    if (size > METRICS_FAMILY_MAX) {
+        return false;
+    }
+    return add({name, help, MetricType::GAUGE, nullptr, nullptr, nullptr, label, size, labelValue, reader, nullptr});
+}
+
+bool MetricsRegistry::addHistogramFamily(const char* name, const char* help, const char* label, uint8_t size,
+                                         MetricLabelReader labelValue, MetricHistogramReader reader) {
+    if (size > METRICS_FAMILY_MAX) {
+        return false;
+    }
+    return add({name, help, MetricType::HISTOGRAM, nullptr, nullptr, nullptr, label, size, labelValue, nullptr, reader});
+}
+
+uint8_t MetricsRegistry::getPartCount(size_t index) const {
+    if (index >= count) {
+        return 0;
+    }
+    const MetricEntry& entry = entries[index];
+    return entry.histogramFamily ? entry.familySize : 1;
+}
+
+size_t MetricsRegistry::renderEntry(size_t index, uint8_t part, char* out, size_t size) const {
+    if (index >= count || part >= getPartCount(index)) {
+        return 0;
+    }
+    const MetricEntry& entry = entries[index];
+    static const char* const typeNames[] = {"counter", "gauge", "histogram"};
+
+    size_t length = 0;
+    auto append = [&](const char* format, auto... args) {
+        if (length < size) {
+            int written = snprintf(out + length, size - length, format, args...);
+            length += written > 0 ? written : 0;
+        }
+    };
+
+    if (part == 0) {
+        append("# HELP %s %s\n# TYPE %s %s\n", entry.name, entry.help, entry.name,
+               typeNames[static_cast<uint8_t>(entry.type)]);
+    }
+    switch (entry.type) {
+        case MetricType::COUNTER:
+            append("%s %lu\n", entry.name, (unsigned long)entry.counter());
+            break;
+        case MetricType::GAUGE:
+            if (entry.family) {
+                for (uint8_t i = 0; i < entry.familySize; i++) {
+                    append("%s{%s=\"%s\"} %g\n", entry.name, entry.label, entry.labelValue(i), (double)entry.family(i));
+                }
+            } else {
+                append("%s %g\n", entry.name, (double)entry.gauge());
+            }
+            break;
+        case MetricType::HISTOGRAM: {
+            // Buckets are read one at a time; a scrape mid-observe can be one sample off, never torn
+            const MetricHistogram& histogram = entry.histogramFamily ? entry.histogramFamily(part) : *entry.histogram;
+            char labels[METRICS_LINE_MAX / 2] = "";
+            if (entry.histogramFamily) {
+                snprintf(labels, sizeof(labels), "%s=\"%s\",", entry.label, entry.labelValue(part));
+            }
+            uint32_t cumulative = 0;
+            for (uint8_t i = 0; i < histogram.getBoundCount(); i++) {
+                cumulative += histogram.getBucket(i);
+                append("%s_bucket{%sle=\"%lu\"} %lu\n", entry.name, labels, (unsigned long)histogram.getBound(i),
+                       (unsigned long)cumulative);
+            }
+            cumulative += histogram.getBucket(histogram.getBoundCount());
+            append("%s_bucket{%sle=\"+Inf\"} %lu\n", entry.name, labels, (unsigned long)cumulative);
+            if (entry.histogramFamily) {
+                // Drop the trailing comma; the sum and count carry only the family label
+                labels[strlen(labels) - 1] = '\0';
+                append("%s_sum{%s} %lu\n%s_count{%s} %lu\n", entry.name, labels, (unsigned long)histogram.getSum(),
+                       entry.name, labels, (unsigned long)cumulative);
+            } else {
+                append("%s_sum %lu\n%s_count %lu\n", entry.name, (unsigned long)histogram.getSum(), entry.name,
+                       (unsigned long)cumulative);
+            }
+            break;
+        }
+    }
+    return length < size ? length : 0;
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static MetricsRegistry metricsInstance;
+
+MetricsRegistry& Metrics() { return metricsInstance; }
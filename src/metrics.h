@@ -0,0 +1,121 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstdint>
+
+// ===========================
+// Metrics
+// Central registry of counters, gauges and histograms, rendered in the
+// Prometheus text exposition format for /metrics
+// ===========================
+
+// Counters and gauges are read through a getter on the manager that owns
+// them - aligned 32-bit loads, so a scrape never takes a lock or stops the
+// task updating them. Histograms are MetricHistogram, whose buckets are
+// atomics that observe() bumps from any task. A gauge family is one metric
+// with a label - a sample per index, read through an indexed getter; a
+// histogram family is the same over a MetricHistogram per index. Entries
+// are added during setup(), before any scrape; the registry is read-only
+// after that.
+
+#define METRICS_MAX_ENTRIES        96
+#define METRICS_HISTOGRAM_BOUNDS   12      // Upper bounds per histogram; +Inf is implicit
+#define METRICS_FAMILY_MAX         14      // Samples per gauge family
+#define METRICS_LINE_MAX           192     // One exposition line
+#define METRICS_ENTRY_MAX          (METRICS_LINE_MAX * (METRICS_HISTOGRAM_BOUNDS + 5))  // Longest renderEntry() output
+
+enum class MetricType : uint8_t {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM
+};
+
+typedef uint32_t (*MetricCounterReader)();
+typedef float (*MetricGaugeReader)();
+typedef float (*MetricFamilyReader)(uint8_t index);
+typedef const char* (*MetricLabelReader)(uint8_t index);
+class MetricHistogram;
+typedef const MetricHistogram& (*MetricHistogramReader)(uint8_t index);
+
+// Cumulative count of observations at or below each bound
+class MetricHistogram {
+public:
+    // bounds ascending, at most METRICS_HISTOGRAM_BOUNDS of them
+    MetricHistogram(const uint32_t* bounds, uint8_t boundCount);
+    // No bounds until setBounds(), for arrays of them; that's before any observe()
+    MetricHistogram();
+    void setBounds(const uint32_t* bounds, uint8_t boundCount);
+
+    void observe(uint32_t value);
+    // Upper bound of the bucket the percentile falls in; 0 with no samples, UINT32_MAX past the last bound
+    uint32_t getPercentileBound(uint8_t percent) const;
+
+    uint8_t getBoundCount() const { return boundCount; }
+    uint32_t getBound(uint8_t index) const { return bounds[index]; }
+    uint32_t getBucket(uint8_t index) const { return buckets[index].load(std::memory_order_relaxed); }  // index == bound count is +Inf
+    uint32_t getCount() const { return count.load(std::memory_order_relaxed); }
+    uint32_t getSum() const { return sum.load(std::memory_order_relaxed); }
+
+private:
+    uint32_t bounds[METRICS_HISTOGRAM_BOUNDS];
+    uint8_t boundCount;
+    std::atomic<uint32_t> buckets[METRICS_HISTOGRAM_BOUNDS + 1];    // Not cumulative; render() sums
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> sum;      // Wraps like a counter
+};
+
+struct MetricEntry {
+    const char* name;
+    const char* help;
+    MetricType type;
+    MetricCounterReader counter;
+    MetricGaugeReader gauge;
+    const MetricHistogram* histogram;
+    // Gauge family
+    const char* label;
+    uint8_t familySize;
+    MetricLabelReader labelValue;
+    MetricFamilyReader family;
+    MetricHistogramReader histogramFamily;
+};
+
+class MetricsRegistry {
+public:
+    MetricsRegistry();
+
+    // Names are static strings, without labels; false when the registry is full
+    bool addCounter(const char* name, const char* help, MetricCounterReader reader);
+    bool addGauge(const char* name, const char* help, MetricGaugeReader reader);
+    bool addHistogram(const char* name, const char* help, const MetricHistogram& histogram);
+    // Samples name{label="labelValue(i)"} reader(i) for i below size, at most METRICS_FAMILY_MAX
+    bool addGaugeFamily(const char* name, const char* help, const char* label, uint8_t size,
+                        MetricLabelReader labelValue, MetricFamilyReader reader);
+    // Buckets name_bucket{label="labelValue(i)",le="..."} of reader(i), likewise
+    bool addHistogramFamily(const char* name, const char* help, const char* label, uint8_t size,
+                            MetricLabelReader labelValue, MetricHistogramReader reader);
+
+    size_t getCount() const { return count; }
+    // A histogram family renders a part per member, anything else in one
+    uint8_t getPartCount(size_t index) const;
+
+    // Exposition text of one part of an entry - HELP and TYPE with the first,
+    // then its samples; 0 if it doesn't fit. Scrapes render part by part
+    // into a small buffer
+    size_t renderEntry(size_t index, uint8_t part, char* out, size_t size) const;
+
+private:
+    MetricEntry entries[METRICS_MAX_ENTRIES];
+    size_t count;
+
+    bool add(const MetricEntry& entry);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern MetricsRegistry& Metrics();
+
+#endif // METRICS_H
@@ -1,4 +1,13 @@
 #include "packet_handler.h"
+#include "crc_utils.h"
+#include "fragment_transfer.h"
+#include "text_codec.h"
+
+static_assert(PACKET_REPLAY_OFFSET >= PACKET_WIRE_HEADER_SIZE + MAX_PAYLOAD_SIZE + PACKET_WIRE_FOOTER_SIZE,
+              "A held frame must not overlap the replay area");
+static_assert(PACKET_REPLAY_OFFSET + PACKET_WIRE_HEADER_SIZE + MAX_PAYLOAD_SIZE + PACKET_WIRE_FOOTER_SIZE
+              <= PACKET_RECEIVE_BUFFER, "Replay area must fit in receiveBuffer");
+static_assert(PACKET_COMMAND_BATCH_BYTES == MAX_PAYLOAD_SIZE, "A command batch is one whole payload");
 
 // Debug Options
 #ifndef DEBUG_GLOBAL
@@ -23,14 +32,23 @@ PacketHandler::PacketHandler() {
     // Initialize internal state
     currentSequenceNumber = 0;
     receiveIndex = 0;
-    inPacket = false;
-    expectedPayloadSize = 0;
+    expectedFrameSize = 0;
+    receiveStartTime = 0;
     lastPacketTime = 0;
+    memset(&lastTelemetry, 0, sizeof(lastTelemetry));
+    memset(&sentTelemetry, 0, sizeof(sentTelemetry));
+    memset(&lastGPS, 0, sizeof(lastGPS));
+    memset(&lastCamera, 0, sizeof(lastCamera));
+    memset(&lastAlert, 0, sizeof(lastAlert));
+    lastStatus[0] = '\0';
+    lastDebug[0] = '\0';
+    lastCommandLength = 0;
+    lastBatchLength = 0;
+    pendingPayloads = 0;
 
     // Initialize buffer management
     queueSize = 0;
-    queueHead = 0;
-    queueTail = 0;
+    laneMask = 0;
     maxPacketSize = MAX_PACKET_SIZE;
     bufferSize = DEFAULT_BUFFER_SIZE;
 
@@ -39,6 +57,7 @@ PacketHandler::PacketHandler() {
     packetsReceived = 0;
     packetsDropped = 0;
     crcErrors = 0;
+    resyncBytes = 0;
     lastStatisticsReset = 0;
 
     // Initialize configuration
@@ -49,14 +68,39 @@ PacketHandler::PacketHandler() {
     memset(receiveBuffer, 0, sizeof(receiveBuffer));
     
     // Initialize packet queue
-    for (int i = 0; i < 16; i++) {
-        packetQueue[i].data = nullptr;
-        packetQueue[i].size = 0;
-        packetQueue[i].capacity = 0;
-        packetQueue[i].timestamp = 0;
-        packetQueue[i].priority = PacketPriority::PRIORITY_NORMAL;
-        packetQueue[i].ready = false;
+    for (int i = 0; i < PACKET_PRIORITY_LANES; i++) {
+        lanes[i].head = 0;
+        lanes[i].count = 0;
+    }
+    for (int i = 0; i < PACKET_SLAB_SLOTS; i++) {
+        slotInfo[i].size = 0;
+        slotInfo[i].capacity = MAX_PACKET_SIZE;
+        slotInfo[i].timestamp = 0;
+        slotInfo[i].priority = PacketPriority::PRIORITY_NORMAL;
+        slotInfo[i].ready = false;
+        slotInfo[i].deferred = false;
+        slotInfo[i].enqueuedAt = 0;
+        slotInfo[i].sampledAt = 0;
     }
+    resetSlab();
+    slabHighWater = 0;
+    slabExhausted = 0;
+    slotsInRadio = 0;
+    radioBackpressure = false;
+    radioHandoffs = 0;
+    radioStalls = 0;
+    backpressureRejects = 0;
+    textBytesRaw = 0;
+    textBytesSent = 0;
+
+    // Everything unlimited unless configured
+    memset(rateBuckets, 0, sizeof(rateBuckets));
+    lastRateRefill = 0;
+    setRateLimit(PacketType::ALERT, PACKET_RATE_ALERT, PACKET_BURST_ALERT);
+    setRateLimit(PacketType::STATUS, PACKET_RATE_STATUS, PACKET_BURST_STATUS);
+    setRateLimit(PacketType::DEBUG, PACKET_RATE_DEBUG, PACKET_BURST_DEBUG);
+
+    memset(latency, 0, sizeof(latency));
 }
 
 PacketHandler::~PacketHandler() {
@@ -76,6 +120,19 @@ bool PacketHandler::begin() {
     resetReceiveState();
     resetStatistics();
     clearBuffer();
+    telemetryEncoder.reset();
+    telemetryDecoder.reset();
+    pendingPayloads = 0;
+
+    // Slots lent to the radio come back through here, from either link
+    LoRaComm().setPayloadReleaseCallback(onRadioPayloadReleased, this);
+    LoRaComm().setPayloadEventCallback(onRadioPayloadEvent, this);
+    BulkLoRa().setPayloadReleaseCallback(onRadioPayloadReleased, this);
+    BulkLoRa().setPayloadEventCallback(onRadioPayloadEvent, this);
+    if (PACKET_LATEST_VALUE) {
+        LoRaComm().setFreshnessCallbacks(onRadioSupersede, onRadioRetransmit, this);
+        BulkLoRa().setFreshnessCallbacks(onRadioSupersede, onRadioRetransmit, this);
+    }
 
     if (DEBUG_PACKET_HANDLER) {
         Serial.println("Packet Handler: Initialized successfully");
@@ -108,68 +165,94 @@ bool PacketHandler::processIncomingData(uint8_t* data, size_t length) {
         return false;
     }
 
-    bool packetProcessed = false;
-
-    for (size_t i = 0; i < length; i++) {
-        if (processReceivedByte(data[i])) {
-            packetProcessed = true;
-        }
+    // A frame held over from a call long ago won't be continued by this one
+    if (receiveIndex > 0 && millis() - receiveStartTime > PACKET_TIMEOUT_MS) {
+        resyncBytes += receiveIndex;
+        resetReceiveState();
     }
 
-    if (packetProcessed) {
+    size_t framesParsed = parseSpan(data, length);
+
+    if (framesParsed > 0) {
         lastPacketTime = millis();
     }
 
-    return packetProcessed;
+    return framesParsed > 0;
 }
 
-bool PacketHandler::createPacket(PacketType type, void* payload, size_t payloadSize) {
+bool PacketHandler::createPacket(PacketType type, void* payload, size_t payloadSize, uint32_t sampledAt) {
     if (payloadSize > MAX_PAYLOAD_SIZE) {
         logError("Payload too large");
         return false;
     }
 
-    uint8_t* packetData = nullptr;
+    // Tell the creator to back off before the queue starts evicting
+    if (isBackpressured()) {
+        backpressureRejects++;
+        return false;
+    }
+
+    uint32_t createdAt = micros();
+    PacketSlot slot = PACKET_SLOT_NONE;
     size_t packetSize = 0;
 
-    if (!assemblePacket(type, static_cast<uint8_t*>(payload), payloadSize, packetData, packetSize)) {
+    if (!assemblePacket(type, static_cast<uint8_t*>(payload), payloadSize, slot, packetSize)) {
         return false;
     }
 
-    bool success = addToBuffer(packetData, packetSize);
-    
-    if (packetData) {
-        free(packetData);
+    // Assembled in place - the slot itself goes on the queue
+    if (!enqueuePacket(slot, packetSize, PacketPriority::PRIORITY_NORMAL)) {
+        return false;
     }
-
-    return success;
+    recordLatency(slab[slot][2], LatencyStage::CREATE_TO_ENQUEUE, slotInfo[slot].enqueuedAt - createdAt);
+    slotInfo[slot].sampledAt = sampledAt;
+    return true;
 }
 
 bool PacketHandler::sendPacket() {
-    uint8_t* packetData = nullptr;
-    size_t packetSize = 0;
-
-    if (!dequeuePacket(packetData, packetSize)) {
+    if (laneMask == 0) {
         return false;
     }
+    refillRateBuckets();
+
+    // Highest lane first, and within it the oldest packet whose type still
+    // has a token - a throttled type waits in place without holding up the
+    // rest. Types keep their own order since a whole type shares one bucket.
+    for (int lane = PACKET_PRIORITY_LANES - 1; lane >= 0; lane--) {
+        PacketLane& queue = lanes[lane];
+
+        for (uint16_t position = 0; position < queue.count; position++) {
+            PacketSlot candidate = queue.slots[(queue.head + position) & (PACKET_QUEUE_DEPTH - 1)];
+            uint8_t type = slab[candidate][2];
+            RateBucket& bucket = rateBuckets[rateBucketFor(type)];
+
+            if (bucket.ratePerSecond > 0.0f && bucket.tokens < 1.0f) {
+                if (!slotInfo[candidate].deferred) {
+                    slotInfo[candidate].deferred = true;
+                    bucket.throttled++;
+                }
+                continue;
+            }
 
-    // Send packet via LoRa (this would interface with LoRaComm)
-    bool success = true; // Placeholder - would call LoRaComm.send()
-
-    if (success) {
-        packetsSent++;
-        updateStatistics(PacketType::HEARTBEAT, true); // Update with actual type
-        logPacket(packetData, packetSize, true);
-    } else {
-        packetsDropped++;
-        logError("Failed to send packet");
-    }
+            // Look before popping - a packet the radio can't take stays queued here
+            Priority priority = radioPriorityFor(static_cast<PacketType>(type));
+            if (slotsInRadio >= PACKET_RADIO_SLOTS || !LoRaLink(priority).canAccept(priority)) {
+                radioBackpressure = true;
+                return false;
+            }
+            radioBackpressure = false;
 
-    if (packetData) {
-        free(packetData);
+            if (bucket.ratePerSecond > 0.0f) {
+                bucket.tokens -= 1.0f;
+            }
+            PacketSlot slot = removeFromLane(lane, position);
+            slotInfo[slot].ready = false;  // Radio owns the slot now
+            return handOff(slot, slotInfo[slot].size, priority);
+        }
     }
 
-    return success;
+    // Everything queued is waiting on its rate limit
+    return false;
 }
 
 bool PacketHandler::sendUrgentPacket(PacketType type, void* payload, size_t payloadSize) {
@@ -178,30 +261,185 @@ bool PacketHandler::sendUrgentPacket(PacketType type, void* payload, size_t payl
         return false;
     }
 
-    uint8_t* packetData = nullptr;
+    PacketSlot slot = PACKET_SLOT_NONE;
     size_t packetSize = 0;
 
-    if (!assemblePacket(type, static_cast<uint8_t*>(payload), payloadSize, packetData, packetSize)) {
+    if (!assemblePacket(type, static_cast<uint8_t*>(payload), payloadSize, slot, packetSize)) {
         return false;
     }
 
-    // Send urgent packet with highest priority
-    bool success = true; // Placeholder - would call LoRaComm.sendUrgent()
+    // Skips the queue and the slot cap - the emergency lane always takes it
+    slotInfo[slot].timestamp = millis();
+    slotInfo[slot].enqueuedAt = micros();
+    slotInfo[slot].sampledAt = 0;
+    return handOff(slot, packetSize, Priority::EMERGENCY);
+}
 
-    if (success) {
-        packetsSent++;
-        updateStatistics(type, true);
-        logPacket(packetData, packetSize, true);
-    } else {
-        packetsDropped++;
-        logError("Failed to send urgent packet");
+size_t PacketHandler::drainToRadio(size_t budget) {
+    // Bounded so a deep backlog can't stall the main loop
+    size_t handed = 0;
+    radioBackpressure = false;
+    while (handed < budget && sendPacket()) {
+        handed++;
+    }
+
+    if (radioBackpressure) {
+        radioStalls++;
+    }
+    return handed;
+}
+
+bool PacketHandler::isBackpressured() const {
+    return queueSize >= PACKET_BACKPRESSURE_LEVEL;
+}
+
+// ===========================
+// Rate Limiting
+// ===========================
+
+void PacketHandler::setRateLimit(PacketType type, float packetsPerSecond, uint8_t burst) {
+    RateBucket& bucket = rateBuckets[rateBucketFor(static_cast<uint8_t>(type))];
+    bucket.ratePerSecond = packetsPerSecond > 0.0f ? packetsPerSecond : 0.0f;
+    bucket.burst = burst > 0 ? burst : 1;
+    bucket.tokens = bucket.burst;
+}
+
+void PacketHandler::refillRateBuckets() {
+    uint32_t now = millis();
+    uint32_t elapsed = now - lastRateRefill;
+    if (elapsed == 0) {
+        return;
+    }
+    lastRateRefill = now;
+
+    float seconds = elapsed / 1000.0f;
+    for (int i = 0; i < PACKET_RATE_BUCKETS; i++) {
+        RateBucket& bucket = rateBuckets[i];
+        if (bucket.ratePerSecond > 0.0f) {
+            bucket.tokens += bucket.ratePerSecond * seconds;
+            if (bucket.tokens > bucket.burst) {
+                bucket.tokens = bucket.burst;
+            }
+        }
+    }
+}
+
+uint8_t PacketHandler::rateBucketFor(uint8_t type) {
+    // 0xFF is EMERGENCY, not a flagged type
+    if (type != static_cast<uint8_t>(PacketType::EMERGENCY)) {
+        type &= ~PACKET_TYPE_COMPRESSED;
     }
+    return type < PACKET_RATE_BUCKETS ? type : 0;
+}
+
+bool PacketHandler::isCoalescable(uint8_t type) {
+    uint8_t bucket = rateBucketFor(type);
+    return bucket == static_cast<uint8_t>(PacketType::HEARTBEAT) ||
+           bucket == static_cast<uint8_t>(PacketType::GPS_DATA) ||
+           bucket == static_cast<uint8_t>(PacketType::STATUS) ||
+           isLatestValue(type);
+}
 
-    if (packetData) {
-        free(packetData);
+bool PacketHandler::isLatestValue(uint8_t type) {
+    return PACKET_LATEST_VALUE &&
+           (type == static_cast<uint8_t>(PacketType::GPS_DATA) || type == static_cast<uint8_t>(PacketType::TELEMETRY));
+}
+
+// Only the newest fix or sample is worth airtime - except that a telemetry
+// keyframe gives way only to another keyframe, since the deltas after it
+// decode against it
+bool PacketHandler::supersedes(uint8_t type, const uint8_t* newerPayload, const uint8_t* olderPayload) {
+    if (!isLatestValue(type)) {
+        return false;
+    }
+    if (type == static_cast<uint8_t>(PacketType::TELEMETRY)) {
+        const uint8_t keyframe = TELEMETRY_FLAG_KEYFRAME >> 8;
+        return !(olderPayload[0] & keyframe) || (newerPayload[0] & keyframe);
     }
+    return true;
+}
+
+// ===========================
+// Latency
+// ===========================
 
-    return success;
+uint32_t PacketHandler::getLatencyPercentile(PacketType type, LatencyStage stage, uint8_t percent) const {
+    return histogramPercentile(getLatency(type, stage), percent);
+}
+
+bool PacketHandler::createLatencyStatusPacket() {
+    // "Lat ms GPS q3/18 a420/1900 ..." - queue wait and ACK time, p50/p99,
+    // for every type that has been sent; whole entries only
+    char text[PACKET_TEXT_MAX + 1];
+    size_t length = snprintf(text, sizeof(text), "Lat ms");
+
+    for (int i = 0; i < PACKET_RATE_BUCKETS; i++) {
+        const LatencyHistogram& queued = latency[i][static_cast<uint8_t>(LatencyStage::ENQUEUE_TO_TX)];
+        const LatencyHistogram& acked = latency[i][static_cast<uint8_t>(LatencyStage::ENQUEUE_TO_ACK)];
+        if (queued.samples == 0) {
+            continue;
+        }
+
+        char entry[48];
+        int entryLength = snprintf(entry, sizeof(entry), " %s q%lu/%lu",
+                                   packetTypeToString(static_cast<PacketType>(i)),
+                                   (unsigned long)((histogramPercentile(queued, 50) + 999) / 1000),
+                                   (unsigned long)((histogramPercentile(queued, 99) + 999) / 1000));
+        if (acked.samples > 0 && entryLength > 0 && entryLength < (int)sizeof(entry)) {
+            entryLength += snprintf(&entry[entryLength], sizeof(entry) - entryLength, " a%lu/%lu",
+                                    (unsigned long)((histogramPercentile(acked, 50) + 999) / 1000),
+                                    (unsigned long)((histogramPercentile(acked, 99) + 999) / 1000));
+        }
+        if (entryLength <= 0 || length + entryLength > PACKET_TEXT_MAX) {
+            break;
+        }
+        memcpy(&text[length], entry, entryLength + 1);
+        length += entryLength;
+    }
+
+    return createStatusPacket(text);
+}
+
+void PacketHandler::recordLatency(uint8_t type, LatencyStage stage, uint32_t micros) {
+    LatencyHistogram& histogram = latency[rateBucketFor(type)][static_cast<uint8_t>(stage)];
+
+    int bucket = micros < 2 ? 0 : 31 - __builtin_clz(micros);
+    if (bucket >= PACKET_LATENCY_BUCKETS) {
+        bucket = PACKET_LATENCY_BUCKETS - 1;
+    }
+
+    // Halving keeps the shape once a flight has outrun the 16-bit counts
+    if (histogram.buckets[bucket] == 0xFFFF) {
+        for (int i = 0; i < PACKET_LATENCY_BUCKETS; i++) {
+            histogram.buckets[i] >>= 1;
+        }
+    }
+    histogram.buckets[bucket]++;
+    histogram.samples++;
+    if (micros > histogram.maxMicros) {
+        histogram.maxMicros = micros;
+    }
+}
+
+uint32_t PacketHandler::histogramPercentile(const LatencyHistogram& histogram, uint8_t percent) {
+    uint32_t total = 0;
+    for (int i = 0; i < PACKET_LATENCY_BUCKETS; i++) {
+        total += histogram.buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint32_t target = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < PACKET_LATENCY_BUCKETS - 1; i++) {
+        seen += histogram.buckets[i];
+        if (seen >= target) {
+            uint32_t edge = 2u << i;
+            return edge < histogram.maxMicros ? edge : histogram.maxMicros;
+        }
+    }
+    return histogram.maxMicros;
 }
 
 // ===========================
@@ -214,134 +452,245 @@ bool PacketHandler::createHeartbeatPacket() {
     return createPacket(PacketType::HEARTBEAT, payload, sizeof(payload));
 }
 
-bool PacketHandler::createTelemetryPacket(const TelemetryData& data) {
-    uint8_t payload[sizeof(TelemetryData)];
-    size_t offset = 0;
+bool PacketHandler::createTelemetryPacket(const TelemetryData& data, uint32_t sampledAt) {
+    uint8_t payload[TELEMETRY_KEYFRAME_SIZE];
+    size_t offset = telemetryEncoder.encode(data, payload);
+
+    if (!createPacket(PacketType::TELEMETRY, payload, offset, sampledAt)) {
+        // The receiver may never see this frame - rebase the next one
+        telemetryEncoder.forceKeyframe();
+        return false;
+    }
+    sentTelemetry = data;
+    return true;
+}
 
-    // Pack telemetry data into payload
-    floatToBytes(data.temperature, &payload[offset]); offset += 4;
-    floatToBytes(data.pressure, &payload[offset]); offset += 4;
-    floatToBytes(data.humidity, &payload[offset]); offset += 4;
-    floatToBytes(data.batteryVoltage, &payload[offset]); offset += 4;
-    floatToBytes(data.batteryCurrent, &payload[offset]); offset += 4;
-    payload[offset++] = data.batteryPercentage;
-    uint32ToBytes(data.uptime, &payload[offset]); offset += 4;
-    payload[offset++] = static_cast<uint8_t>(data.rssi);
-    uint16ToBytes(data.freeHeap, &payload[offset]); offset += 2;
-    floatToBytes(data.cpuTemperature, &payload[offset]); offset += 4;
-    payload[offset++] = data.powerState;
+bool PacketHandler::createGPSPacket(const GPSData& data, uint32_t sampledAt) {
+    uint8_t payload[GPSSchema::size];
+    GPSSchema::encode(data, payload);
 
-    return createPacket(PacketType::TELEMETRY, payload, offset);
+    return createPacket(PacketType::GPS_DATA, payload, GPSSchema::size, sampledAt);
 }
 
-bool PacketHandler::createGPSPacket(const GPSData& data) {
-    uint8_t payload[sizeof(GPSData)];
-    size_t offset = 0;
+bool PacketHandler::createCameraPacket(const CameraData& data) {
+    uint8_t payload[CameraSchema::size];
+    CameraSchema::encode(data, payload);
+
+    return createPacket(PacketType::CAMERA_DATA, payload, CameraSchema::size);
+}
 
-    // Pack GPS data into payload
-    floatToBytes(data.latitude, &payload[offset]); offset += 4;
-    floatToBytes(data.longitude, &payload[offset]); offset += 4;
-    floatToBytes(data.altitude, &payload[offset]); offset += 4;
-    payload[offset++] = data.satellites;
-    floatToBytes(data.speed, &payload[offset]); offset += 4;
-    floatToBytes(data.course, &payload[offset]); offset += 4;
-    uint32ToBytes(data.fixTime, &payload[offset]); offset += 4;
-    payload[offset++] = data.hdop;
-    payload[offset++] = data.quality;
+bool PacketHandler::createAlertPacket(const AlertData& data) {
+    uint8_t payload[AlertSchema::size];
+    AlertSchema::encode(data, payload);
 
-    return createPacket(PacketType::GPS_DATA, payload, offset);
+    return createPacket(PacketType::ALERT, payload, AlertSchema::size);
 }
 
-bool PacketHandler::createCameraPacket(const CameraData& data) {
-    uint8_t payload[sizeof(CameraData)];
-    size_t offset = 0;
+bool PacketHandler::createStatusPacket(const char* status) {
+    return createTextPacket(PacketType::STATUS, status, 100);
+}
 
-    // Pack camera data into payload
-    uint16ToBytes(data.imageId, &payload[offset]); offset += 2;
-    uint32ToBytes(data.timestamp, &payload[offset]); offset += 4;
-    uint16ToBytes(data.imageSize, &payload[offset]); offset += 2;
-    payload[offset++] = data.compression;
-    floatToBytes(data.brightness, &payload[offset]); offset += 4;
-    floatToBytes(data.contrast, &payload[offset]); offset += 4;
-    payload[offset++] = data.faceCount;
-    payload[offset++] = data.objectCount;
+bool PacketHandler::createDebugPacket(const char* message) {
+    return createTextPacket(PacketType::DEBUG, message, PACKET_TEXT_MAX);
+}
 
-    return createPacket(PacketType::CAMERA_DATA, payload, offset);
+bool PacketHandler::createCommandPacket(CommandId command, const uint8_t* params, size_t paramLength) {
+    if (paramLength > PACKET_COMMAND_MAX_PARAMS || (paramLength > 0 && !params)) {
+        return false;
+    }
+
+    uint8_t payload[1 + PACKET_COMMAND_MAX_PARAMS];
+    payload[0] = static_cast<uint8_t>(command);
+    if (paramLength > 0) {
+        memcpy(&payload[1], params, paramLength);
+    }
+    return createPacket(PacketType::COMMAND, payload, 1 + paramLength);
 }
 
-bool PacketHandler::createAlertPacket(const AlertData& data) {
-    uint8_t payload[sizeof(AlertData)];
-    size_t offset = 0;
+bool PacketHandler::createCommandBatchPacket(const CommandBatch& batch) {
+    if (batch.count == 0 || batch.length > sizeof(batch.payload)) {
+        return false;
+    }
+    return createPacket(PacketType::COMMAND_BATCH, const_cast<uint8_t*>(batch.payload), batch.length);
+}
 
-    // Pack alert data into payload
-    payload[offset++] = static_cast<uint8_t>(data.alertType);
-    uint32ToBytes(data.timestamp, &payload[offset]); offset += 4;
-    payload[offset++] = data.severity;
-    memcpy(&payload[offset], data.message, sizeof(data.message)); offset += sizeof(data.message);
-    floatToBytes(data.sensorValue, &payload[offset]); offset += 4;
-    payload[offset++] = data.sensorId;
+void CommandBatch::begin(uint8_t batchId) {
+    payload[0] = batchId;
+    length = 1;
+    count = 0;
+}
 
-    return createPacket(PacketType::ALERT, payload, offset);
+bool CommandBatch::add(CommandId command, const uint8_t* params, size_t paramLength) {
+    if (count >= PACKET_COMMAND_BATCH_MAX || paramLength > PACKET_COMMAND_MAX_PARAMS ||
+        (paramLength > 0 && !params) || length + 2 + paramLength > sizeof(payload)) {
+        return false;
+    }
+    payload[length++] = static_cast<uint8_t>(command);
+    payload[length++] = paramLength;
+    if (paramLength > 0) {
+        memcpy(&payload[length], params, paramLength);
+    }
+    length += paramLength;
+    count++;
+    return true;
 }
 
-bool PacketHandler::createStatusPacket(const char* status) {
-    if (!status) {
+bool PacketHandler::createPreviewPackets(uint16_t imageId, const PreviewFrame& preview) {
+    uint8_t rowsPerBand = previewRowsPerBand(preview, MAX_PAYLOAD_SIZE);
+    if (rowsPerBand == 0) {
         return false;
     }
 
-    size_t statusLen = strlen(status);
-    if (statusLen > 100) {
-        statusLen = 100; // Truncate if too long
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    for (uint8_t row = 0; row < preview.height; row += rowsPerBand) {
+        uint8_t rows = min(rowsPerBand, (uint8_t)(preview.height - row));
+        size_t length = previewBand(preview, imageId, row, rows, payload);
+        if (length == 0 || !createPacket(PacketType::CAMERA_PREVIEW, payload, length)) {
+            return false;
+        }
     }
+    return true;
+}
 
-    return createPacket(PacketType::STATUS, const_cast<char*>(status), statusLen);
+bool PacketHandler::createProfilePacket(const ProfileLevel& level) {
+    uint8_t payload[PROFILE_PAYLOAD_SIZE];
+    size_t length = profileEncode(level, payload);
+    return createPacket(PacketType::PROFILE_LEVEL, payload, length, level.endTime);
 }
 
-bool PacketHandler::createDebugPacket(const char* message) {
-    if (!message) {
+bool PacketHandler::createTrackPacket(const uint8_t* segment, size_t length) {
+    return createPacket(PacketType::TRACK_SEGMENT, const_cast<uint8_t*>(segment), length);
+}
+
+bool PacketHandler::createDigestPacket(const DigestData& data) {
+    uint8_t payload[DigestSchema::size];
+    DigestSchema::encode(data, payload);
+
+    return createPacket(PacketType::DIGEST, payload, DigestSchema::size);
+}
+
+bool PacketHandler::createTextPacket(PacketType type, const char* text, size_t maxLength) {
+    if (!text) {
         return false;
     }
 
-    size_t messageLen = strlen(message);
-    if (messageLen > 150) {
-        messageLen = 150; // Truncate if too long
+    size_t length = strlen(text);
+    if (length > maxLength) {
+        length = maxLength; // Truncate if too long
     }
 
-    return createPacket(PacketType::DEBUG, const_cast<char*>(message), messageLen);
+    // Sent as-is when compression doesn't pay (short or non-ASCII text)
+    uint8_t compressed[PACKET_TEXT_MAX];
+    size_t compressedLength = PACKET_COMPRESS_TEXT
+        ? compressText(reinterpret_cast<const uint8_t*>(text), length, compressed, sizeof(compressed))
+        : 0;
+
+    bool created = compressedLength > 0
+        ? createPacket(static_cast<PacketType>(static_cast<uint8_t>(type) | PACKET_TYPE_COMPRESSED),
+                       compressed, compressedLength)
+        : createPacket(type, const_cast<char*>(text), length);
+
+    if (created) {
+        textBytesRaw += length;
+        textBytesSent += compressedLength > 0 ? compressedLength : length;
+    }
+    return created;
 }
 
 // ===========================
 // Data Extraction
 // ===========================
 
+// Payloads are decoded on receipt (telemetry deltas depend on the keyframe
+// before them); each extract hands out the latest one once
+
 bool PacketHandler::extractTelemetry(TelemetryData& data) {
-    // Implementation would extract telemetry from received packet
-    // This is a placeholder - would be called when telemetry packet is received
-    return false;
+    if (!(pendingPayloads & PENDING_TELEMETRY)) {
+        return false;
+    }
+
+    data = lastTelemetry;
+    pendingPayloads &= ~PENDING_TELEMETRY;
+    return true;
 }
 
 bool PacketHandler::extractGPS(GPSData& data) {
-    // Implementation would extract GPS data from received packet
-    // This is a placeholder - would be called when GPS packet is received
-    return false;
+    if (!(pendingPayloads & PENDING_GPS)) {
+        return false;
+    }
+
+    data = lastGPS;
+    pendingPayloads &= ~PENDING_GPS;
+    return true;
 }
 
 bool PacketHandler::extractCamera(CameraData& data) {
-    // Implementation would extract camera data from received packet
-    // This is a placeholder - would be called when camera packet is received
-    return false;
+    if (!(pendingPayloads & PENDING_CAMERA)) {
+        return false;
+    }
+
+    data = lastCamera;
+    pendingPayloads &= ~PENDING_CAMERA;
+    return true;
 }
 
 bool PacketHandler::extractAlert(AlertData& data) {
-    // Implementation would extract alert from received packet
-    // This is a placeholder - would be called when alert packet is received
-    return false;
+    if (!(pendingPayloads & PENDING_ALERT)) {
+        return false;
+    }
+
+    data = lastAlert;
+    pendingPayloads &= ~PENDING_ALERT;
+    return true;
+}
+
+bool PacketHandler::extractStatus(char* text, size_t capacity) {
+    return extractText(text, capacity, lastStatus, PENDING_STATUS);
+}
+
+bool PacketHandler::extractDebug(char* text, size_t capacity) {
+    return extractText(text, capacity, lastDebug, PENDING_DEBUG);
+}
+
+bool PacketHandler::extractText(char* text, size_t capacity, const char* source, uint8_t pendingBit) {
+    if (!(pendingPayloads & pendingBit) || !text || capacity == 0) {
+        return false;
+    }
+
+    strncpy(text, source, capacity - 1);
+    text[capacity - 1] = '\0';
+    pendingPayloads &= ~pendingBit;
+    return true;
 }
 
 bool PacketHandler::extractCommand(uint8_t& commandId, uint8_t* params, size_t& paramLength) {
-    // Implementation would extract command from received packet
-    // This is a placeholder - would be called when command packet is received
-    return false;
+    if (!(pendingPayloads & PENDING_COMMAND)) {
+        return false;
+    }
+
+    // Left pending if the caller's buffer is too small for the parameters
+    size_t length = lastCommandLength - 1;
+    if (length > paramLength || (length > 0 && !params)) {
+        return false;
+    }
+
+    commandId = lastCommand[0];
+    if (length > 0) {
+        memcpy(params, &lastCommand[1], length);
+    }
+    paramLength = length;
+    pendingPayloads &= ~PENDING_COMMAND;
+    return true;
+}
+
+bool PacketHandler::extractCommandBatch(uint8_t* batch, size_t& length) {
+    if (!(pendingPayloads & PENDING_COMMAND_BATCH) || !batch || lastBatchLength > length) {
+        return false;
+    }
+    memcpy(batch, lastBatch, lastBatchLength);
+    length = lastBatchLength;
+    pendingPayloads &= ~PENDING_COMMAND_BATCH;
+    return true;
 }
 
 // ===========================
@@ -349,76 +698,61 @@ bool PacketHandler::extractCommand(uint8_t& commandId, uint8_t* params, size_t&
 // ===========================
 
 bool PacketHandler::addToBuffer(uint8_t* data, size_t length, PacketPriority priority) {
-    if (queueSize >= 16) {
-        // Queue full, remove oldest low priority packet if needed
-        size_t oldestIndex = findOldestLowPriorityPacket();
-        if (oldestIndex < 16) {
-            if (packetQueue[oldestIndex].data) {
-                free(packetQueue[oldestIndex].data);
-            }
-            queueSize--;
-            
-            // Shift queue
-            for (size_t i = oldestIndex; i < queueSize; i++) {
-                packetQueue[i] = packetQueue[i + 1];
-            }
-        } else {
-            packetsDropped++;
-            return false;
-        }
-    }
-
-    // Find insertion point based on priority
-    size_t insertPos = queueSize;
-    for (size_t i = 0; i < queueSize; i++) {
-        if (static_cast<uint8_t>(priority) > static_cast<uint8_t>(packetQueue[i].priority)) {
-            insertPos = i;
-            break;
-        }
-    }
-
-    // Shift elements to make room
-    for (size_t i = queueSize; i > insertPos; i--) {
-        packetQueue[i] = packetQueue[i - 1];
+    if (!data || length == 0 || length > MAX_PACKET_SIZE) {
+        logError("Invalid packet for buffer");
+        return false;
     }
 
-    // Insert new packet
-    packetQueue[insertPos].data = static_cast<uint8_t*>(malloc(length));
-    if (!packetQueue[insertPos].data) {
-        logError("Failed to allocate memory for packet buffer");
+    PacketSlot slot = allocSlot();
+    if (slot == PACKET_SLOT_NONE) {
+        packetsDropped++;
         return false;
     }
 
-    memcpy(packetQueue[insertPos].data, data, length);
-    packetQueue[insertPos].size = length;
-    packetQueue[insertPos].capacity = length;
-    packetQueue[insertPos].timestamp = millis();
-    packetQueue[insertPos].priority = priority;
-    packetQueue[insertPos].ready = true;
+    memcpy(slab[slot], data, length);
+    return enqueuePacket(slot, length, priority);
+}
 
-    queueSize++;
-    return true;
+bool PacketHandler::getBufferedPacket(PacketSlot& slot, size_t& packetSize) {
+    return dequeuePacket(slot, packetSize);
 }
 
-bool PacketHandler::getBufferedPacket(uint8_t*& packetData, size_t& packetSize) {
-    return dequeuePacket(packetData, packetSize);
+const uint8_t* PacketHandler::getSlotData(PacketSlot slot) const {
+    if (slot < 0 || slot >= PACKET_SLAB_SLOTS) {
+        return nullptr;
+    }
+    return slab[slot];
+}
+
+void PacketHandler::releaseSlot(PacketSlot slot) {
+    if (slot < 0 || slot >= PACKET_SLAB_SLOTS || slabFreeCount >= PACKET_SLAB_SLOTS) {
+        return;
+    }
+    slabFreeList[slabFreeCount++] = slot;
 }
 
 void PacketHandler::clearBuffer() {
-    for (size_t i = 0; i < 16; i++) {
-        if (packetQueue[i].data) {
-            free(packetQueue[i].data);
-            packetQueue[i].data = nullptr;
-        }
-        packetQueue[i].size = 0;
-        packetQueue[i].capacity = 0;
-        packetQueue[i].timestamp = 0;
-        packetQueue[i].priority = PacketPriority::PRIORITY_NORMAL;
-        packetQueue[i].ready = false;
+    // Queued slots go back to the pool; slots lent to the radio stay out
+    // until LoRaComm() hands them back
+    while (laneMask != 0) {
+        releaseSlot(popLane(__builtin_ctz(laneMask)));
+    }
+    for (int i = 0; i < PACKET_PRIORITY_LANES; i++) {
+        lanes[i].head = 0;
+        lanes[i].count = 0;
+    }
+    for (int i = 0; i < PACKET_SLAB_SLOTS; i++) {
+        slotInfo[i].size = 0;
+        slotInfo[i].ready = false;
     }
     queueSize = 0;
-    queueHead = 0;
-    queueTail = 0;
+    laneMask = 0;
+
+    // With nothing lent out every slot is free again - this also recovers a
+    // dequeued slot that was never released
+    if (slotsInRadio == 0) {
+        resetSlab();
+    }
 }
 
 size_t PacketHandler::getBufferUsage() const {
@@ -426,7 +760,7 @@ size_t PacketHandler::getBufferUsage() const {
 }
 
 size_t PacketHandler::getBufferCapacity() const {
-    return 16; // Maximum queue size
+    return PACKET_QUEUE_DEPTH;
 }
 
 // ===========================
@@ -438,6 +772,10 @@ void PacketHandler::resetStatistics() {
     packetsReceived = 0;
     packetsDropped = 0;
     crcErrors = 0;
+    resyncBytes = 0;
+    slabHighWater = PACKET_SLAB_SLOTS - slabFreeCount;
+    slabExhausted = 0;
+    memset(latency, 0, sizeof(latency));
     lastStatisticsReset = millis();
 }
 
@@ -454,7 +792,7 @@ float PacketHandler::getPacketLossRate() const {
 // ===========================
 
 bool PacketHandler::validatePacket(const uint8_t* packet, size_t length) {
-    if (!packet || length < sizeof(PacketHeader) + sizeof(PacketFooter)) {
+    if (!packet || length < PACKET_WIRE_HEADER_SIZE + PACKET_WIRE_FOOTER_SIZE) {
         return false;
     }
 
@@ -473,7 +811,7 @@ bool PacketHandler::validatePacket(const uint8_t* packet, size_t length) {
 }
 
 bool PacketHandler::isBufferFull() const {
-    return queueSize >= 16;
+    return queueSize >= PACKET_QUEUE_DEPTH;
 }
 
 void PacketHandler::printStatistics() const {
@@ -486,8 +824,42 @@ void PacketHandler::printStatistics() const {
     Serial.printf("Packets Received: %lu\n", packetsReceived);
     Serial.printf("Packets Dropped: %lu\n", packetsDropped);
     Serial.printf("CRC Errors: %lu\n", crcErrors);
+    Serial.printf("Resync Bytes: %lu\n", resyncBytes);
+    Serial.printf("Radio Handoffs: %lu (%u in flight, %lu stalls, %lu refused by backpressure)\n",
+                 radioHandoffs, slotsInRadio, radioStalls, backpressureRejects);
+    Serial.printf("Telemetry: %lu keyframes, %lu deltas, %.1f bytes/sample (raw %u)\n",
+                 telemetryEncoder.getKeyframesSent(), telemetryEncoder.getDeltasSent(),
+                 telemetryEncoder.getAverageSize(), (unsigned)TELEMETRY_RAW_SIZE);
+    Serial.printf("Telemetry Decoded: %lu (%lu orphan deltas, %lu malformed)\n",
+                 telemetryDecoder.getFramesDecoded(), telemetryDecoder.getOrphanDeltas(),
+                 telemetryDecoder.getMalformed());
+    Serial.printf("Status/Debug Text: %lu bytes sent for %lu raw\n", textBytesSent, textBytesRaw);
+    for (int i = 0; i < PACKET_RATE_BUCKETS; i++) {
+        const RateBucket& bucket = rateBuckets[i];
+        if (bucket.ratePerSecond > 0.0f || bucket.throttled > 0 || bucket.coalesced > 0) {
+            Serial.printf("Rate %s: %.2f/s burst %u, %lu throttled, %lu coalesced\n",
+                         packetTypeToString(static_cast<PacketType>(i)), bucket.ratePerSecond,
+                         bucket.burst, bucket.throttled, bucket.coalesced);
+        }
+    }
+    for (int i = 0; i < PACKET_RATE_BUCKETS; i++) {
+        const LatencyHistogram& created = latency[i][static_cast<uint8_t>(LatencyStage::CREATE_TO_ENQUEUE)];
+        const LatencyHistogram& queued = latency[i][static_cast<uint8_t>(LatencyStage::ENQUEUE_TO_TX)];
+        const LatencyHistogram& acked = latency[i][static_cast<uint8_t>(LatencyStage::ENQUEUE_TO_ACK)];
+        if (created.samples == 0 && queued.samples == 0) {
+            continue;
+        }
+        Serial.printf("Latency %s: create p50 %lu us, first TX p50/p99/max %lu/%lu/%lu ms, "
+                     "ACK p50/p99/max %lu/%lu/%lu ms (%lu sent, %lu ACKed)\n",
+                     packetTypeToString(static_cast<PacketType>(i)),
+                     histogramPercentile(created, 50),
+                     histogramPercentile(queued, 50) / 1000, histogramPercentile(queued, 99) / 1000,
+                     queued.maxMicros / 1000,
+                     histogramPercentile(acked, 50) / 1000, histogramPercentile(acked, 99) / 1000,
+                     acked.maxMicros / 1000, queued.samples, acked.samples);
+    }
     Serial.printf("Packet Loss Rate: %.2f%%\n", getPacketLossRate());
-    Serial.printf("Buffer Usage: %zu/%zu\n", queueSize, (size_t)16);
+    Serial.printf("Buffer Usage: %zu/%zu\n", queueSize, (size_t)PACKET_QUEUE_DEPTH);
     Serial.printf("Last Packet Time: %lu ms\n", lastPacketTime);
     
     uint32_t uptime = millis() - lastStatisticsReset;
@@ -496,16 +868,25 @@ void PacketHandler::printStatistics() const {
 
 void PacketHandler::printBufferStatus() const {
     Serial.println("=== Packet Buffer Status ===");
-    Serial.printf("Queue Size: %zu/16\n", queueSize);
-    Serial.printf("Buffer Usage: %.1f%%\n", (static_cast<float>(queueSize) / 16.0f) * 100.0f);
+    Serial.printf("Queue Size: %zu/%d\n", queueSize, PACKET_QUEUE_DEPTH);
+    Serial.printf("Buffer Usage: %.1f%%\n", (static_cast<float>(queueSize) / PACKET_QUEUE_DEPTH) * 100.0f);
+    Serial.printf("Slab Pool: %d/%d slots in use (peak %d, %lu exhausted), %u bytes\n",
+                 PACKET_SLAB_SLOTS - slabFreeCount, PACKET_SLAB_SLOTS, slabHighWater,
+                 slabExhausted, (unsigned)sizeof(slab));
     
-    for (size_t i = 0; i < queueSize; i++) {
-        Serial.printf("Queue[%zu]: Type=%s, Priority=%s, Size=%zu, Age=%lu ms\n",
-                     i,
-                     packetTypeToString(static_cast<PacketType>(packetQueue[i].data[3])),
-                     priorityToString(packetQueue[i].priority),
-                     packetQueue[i].size,
-                     millis() - packetQueue[i].timestamp);
+    // Dequeue order: highest lane first, oldest first within a lane
+    size_t index = 0;
+    for (int lane = PACKET_PRIORITY_LANES - 1; lane >= 0; lane--) {
+        const PacketLane& queue = lanes[lane];
+        for (uint16_t i = 0; i < queue.count; i++) {
+            PacketSlot slot = queue.slots[(queue.head + i) & (PACKET_QUEUE_DEPTH - 1)];
+            Serial.printf("Queue[%zu]: Type=%s, Priority=%s, Size=%zu, Age=%lu ms\n",
+                         index++,
+                         packetTypeToString(static_cast<PacketType>(slab[slot][2])),
+                         priorityToString(slotInfo[slot].priority),
+                         slotInfo[slot].size,
+                         millis() - slotInfo[slot].timestamp);
+        }
     }
 }
 
@@ -523,6 +904,14 @@ const char* PacketHandler::packetTypeToString(PacketType type) const {
         case PacketType::COMMAND_ACK: return "Command ACK";
         case PacketType::STATUS: return "Status";
         case PacketType::DEBUG: return "Debug";
+        case PacketType::FRAGMENT: return "Fragment";
+        case PacketType::FRAGMENT_ACK: return "Fragment ACK";
+        case PacketType::COMMAND: return "Command";
+        case PacketType::CAMERA_PREVIEW: return "Camera Preview";
+        case PacketType::COMMAND_BATCH: return "Command Batch";
+        case PacketType::PROFILE_LEVEL: return "Profile Level";
+        case PacketType::TRACK_SEGMENT: return "Track Segment";
+        case PacketType::DIGEST: return "Digest";
         default: return "Unknown";
     }
 }
@@ -536,6 +925,7 @@ const char* PacketHandler::alertTypeToString(AlertType type) const {
         case AlertType::COMMUNICATION_LOST: return "Communication Lost";
         case AlertType::MEMORY_FULL: return "Memory Full";
         case AlertType::OVERHEATING: return "Overheating";
+        case AlertType::SYSTEM_CRASH: return "System Crash";
         default: return "Unknown";
     }
 }
@@ -555,62 +945,35 @@ const char* PacketHandler::priorityToString(PacketPriority priority) const {
 // ===========================
 
 uint8_t PacketHandler::calculateCRC8(const uint8_t* data, size_t length) {
-    uint8_t crc = 0x00;
-    
-    for (size_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 0x80) {
-                crc = (crc << 1) ^ CRC8_POLYNOMIAL;
-            } else {
-                crc <<= 1;
-            }
-        }
-    }
-    
-    return crc;
+    return crc8(data, length);
 }
 
 uint16_t PacketHandler::calculateCRC16(const uint8_t* data, size_t length) {
-    uint16_t crc = 0x0000;
-    
-    for (size_t i = 0; i < length; i++) {
-        crc ^= static_cast<uint16_t>(data[i]) << 8;
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 0x8000) {
-                crc = (crc << 1) ^ CRC16_POLYNOMIAL;
-            } else {
-                crc <<= 1;
-            }
-        }
-    }
-    
-    return crc;
+    return crc16Ccitt(data, length);
 }
 
 bool PacketHandler::verifyCRC(const uint8_t* packet, size_t length) {
-    if (length < sizeof(PacketHeader) + sizeof(PacketFooter)) {
+    if (length < PACKET_WIRE_HEADER_SIZE + PACKET_WIRE_FOOTER_SIZE) {
         return false;
     }
 
     // Verify header CRC8
-    uint8_t headerCRC = calculateCRC8(packet, sizeof(PacketHeader) - 1); // Exclude CRC8 field
-    PacketHeader* header = reinterpret_cast<PacketHeader*>(const_cast<uint8_t*>(packet));
-    
-    if (headerCRC != header->crc8) {
+    uint8_t headerCRC = calculateCRC8(packet, PACKET_WIRE_HEADER_SIZE - 1); // Exclude CRC8 field
+    if (headerCRC != packet[PACKET_WIRE_HEADER_SIZE - 1]) {
         crcErrors++;
         return false;
     }
 
     // Verify payload CRC16
-    size_t payloadSize = header->payloadLength;
-    const uint8_t* payloadStart = packet + sizeof(PacketHeader);
+    size_t payloadSize = bytesToUint16(&packet[4]);
+    if (length < PACKET_WIRE_HEADER_SIZE + payloadSize + PACKET_WIRE_FOOTER_SIZE) {
+        return false;
+    }
+
+    const uint8_t* payloadStart = packet + PACKET_WIRE_HEADER_SIZE;
     uint16_t payloadCRC = calculateCRC16(payloadStart, payloadSize);
     
-    PacketFooter* footer = reinterpret_cast<PacketFooter*>(
-        const_cast<uint8_t*>(packet + sizeof(PacketHeader) + payloadSize));
-    
-    if (payloadCRC != footer->crc16) {
+    if (payloadCRC != bytesToUint16(payloadStart + payloadSize)) {
         crcErrors++;
         return false;
     }
@@ -623,19 +986,20 @@ bool PacketHandler::verifyCRC(const uint8_t* packet, size_t length) {
 // ===========================
 
 bool PacketHandler::assemblePacket(PacketType type, const uint8_t* payload, size_t payloadSize,
-                                uint8_t*& packetData, size_t& packetSize) {
-    packetSize = sizeof(PacketHeader) + payloadSize + sizeof(PacketFooter);
+                                PacketSlot& slot, size_t& packetSize) {
+    packetSize = PACKET_WIRE_HEADER_SIZE + payloadSize + PACKET_WIRE_FOOTER_SIZE;
     
-    if (packetSize > maxPacketSize) {
+    if (packetSize > maxPacketSize || packetSize > MAX_PACKET_SIZE) {
         logError("Assembled packet too large");
         return false;
     }
 
-    packetData = static_cast<uint8_t*>(malloc(packetSize));
-    if (!packetData) {
-        logError("Failed to allocate memory for packet assembly");
+    slot = allocSlot();
+    if (slot == PACKET_SLOT_NONE) {
+        logError("No free slab slot for packet assembly");
         return false;
     }
+    uint8_t* packetData = slab[slot];
 
     size_t offset = 0;
 
@@ -647,7 +1011,7 @@ bool PacketHandler::assemblePacket(PacketType type, const uint8_t* payload, size
     uint16ToBytes(static_cast<uint16_t>(payloadSize), &packetData[offset]); offset += 2;
     
     // Calculate and add header CRC8
-    uint8_t headerCRC = calculateCRC8(packetData, sizeof(PacketHeader) - 1);
+    uint8_t headerCRC = calculateCRC8(packetData, PACKET_WIRE_HEADER_SIZE - 1);
     packetData[offset++] = headerCRC;
 
     // Copy payload
@@ -666,29 +1030,21 @@ bool PacketHandler::assemblePacket(PacketType type, const uint8_t* payload, size
 }
 
 bool PacketHandler::disassemblePacket(const uint8_t* packet, size_t length,
-                                   PacketType& type, uint8_t*& payload, size_t& payloadSize) {
+                                   PacketType& type, const uint8_t*& payload, size_t& payloadSize) {
     if (!validatePacket(packet, length)) {
         return false;
     }
 
-    PacketHeader* header = reinterpret_cast<PacketHeader*>(const_cast<uint8_t*>(packet));
-    type = header->packetType;
-    payloadSize = header->payloadLength;
+    type = static_cast<PacketType>(packet[2]);
+    payloadSize = bytesToUint16(&packet[4]);
 
     if (payloadSize == 0) {
         payload = nullptr;
         return true;
     }
 
-    payload = static_cast<uint8_t*>(malloc(payloadSize));
-    if (!payload) {
-        logError("Failed to allocate memory for payload extraction");
-        return false;
-    }
-
-    const uint8_t* payloadStart = packet + sizeof(PacketHeader);
-    memcpy(payload, payloadStart, payloadSize);
-
+    // Points into the packet - valid as long as the packet buffer is
+    payload = packet + PACKET_WIRE_HEADER_SIZE;
     return true;
 }
 
@@ -696,63 +1052,238 @@ bool PacketHandler::disassemblePacket(const uint8_t* packet, size_t length,
 // Private Methods - Buffer Operations
 // ===========================
 
-bool PacketHandler::enqueuePacket(const uint8_t* packetData, size_t packetSize, PacketPriority priority) {
-    return addToBuffer(const_cast<uint8_t*>(packetData), packetSize, priority);
+PacketSlot PacketHandler::allocSlot() {
+    if (slabFreeCount == 0) {
+        slabExhausted++;
+        return PACKET_SLOT_NONE;
+    }
+
+    PacketSlot slot = slabFreeList[--slabFreeCount];
+    uint8_t inUse = PACKET_SLAB_SLOTS - slabFreeCount;
+    if (inUse > slabHighWater) {
+        slabHighWater = inUse;
+    }
+    return slot;
 }
 
-bool PacketHandler::dequeuePacket(uint8_t*& packetData, size_t& packetSize) {
-    if (queueSize == 0) {
-        return false;
+void PacketHandler::resetSlab() {
+    for (int i = 0; i < PACKET_SLAB_SLOTS; i++) {
+        slabFreeList[i] = PACKET_SLAB_SLOTS - 1 - i;
     }
+    slabFreeCount = PACKET_SLAB_SLOTS;
+}
 
-    // Get highest priority packet (front of queue)
-    PacketBuffer& buffer = packetQueue[0];
-    
-    packetData = buffer.data;
-    packetSize = buffer.size;
-    buffer.data = nullptr; // Transfer ownership
-    buffer.size = 0;
-    buffer.ready = false;
+// ===========================
+// Private Methods - Radio Handoff
+// ===========================
 
-    // Shift queue
-    for (size_t i = 0; i < queueSize - 1; i++) {
-        packetQueue[i] = packetQueue[i + 1];
+bool PacketHandler::handOff(PacketSlot slot, size_t packetSize, Priority priority) {
+    const uint8_t* frame = slab[slot];
+    PacketType type = static_cast<PacketType>(frame[2]);
+    size_t payloadSize = packetSize - PACKET_WIRE_HEADER_SIZE - PACKET_WIRE_FOOTER_SIZE;
+
+    // The LoRa frame has its own header and CRC, so only the payload is
+    // sent - borrowed straight out of the slot until LoRaComm() releases it
+    Packet packet = ::createPacket(type, payloadSize > 0 ? &frame[PACKET_WIRE_HEADER_SIZE] : nullptr, payloadSize);
+    slotsInRadio++;
+
+    // Queue time on the radio's latency stamp starts where this queue did
+    const PacketBuffer& info = slotInfo[slot];
+    packet.header.createdAt = info.timestamp;
+    packet.header.sampledAt = info.sampledAt ? info.sampledAt : info.timestamp;
+
+    // Fragments are repaired by the transfer's bitmap ACK, not per-frame ARQ
+    bool ackRequired = type != PacketType::FRAGMENT;
+    if (!LoRaLink(priority).sendPacket(packet, priority, ackRequired, slot)) {
+        slotsInRadio--;
+        releaseSlot(slot);
+        packetsDropped++;
+        logError("Radio refused packet");
+        return false;
     }
 
-    queueSize--;
+    radioHandoffs++;
+    updateStatistics(type, true);
+    if (DEBUG_PACKET_HANDLER && LOG_PACKET_CONTENTS) {
+        logPacket(frame, packetSize, true);
+    }
     return true;
 }
 
-void PacketHandler::sortQueueByPriority() {
-    // Simple bubble sort for small queue
-    for (size_t i = 0; i < queueSize - 1; i++) {
-        for (size_t j = 0; j < queueSize - i - 1; j++) {
-            if (static_cast<uint8_t>(packetQueue[j].priority) < 
-                static_cast<uint8_t>(packetQueue[j + 1].priority)) {
-                // Swap
-                PacketBuffer temp = packetQueue[j];
-                packetQueue[j] = packetQueue[j + 1];
-                packetQueue[j + 1] = temp;
-            }
+Priority PacketHandler::radioPriorityFor(PacketType type) {
+    switch (type) {
+        case PacketType::ALERT:       return Priority::EMERGENCY;
+        case PacketType::GPS_DATA:    return Priority::GPS;
+        case PacketType::TELEMETRY:   return Priority::TELEMETRY;
+        case PacketType::CAMERA_DATA: return Priority::CAMERA;
+        case PacketType::FRAGMENT:    return Priority::CAMERA;
+        case PacketType::FRAGMENT_ACK: return Priority::TELEMETRY;
+        case PacketType::COMMAND:     return Priority::TELEMETRY;
+        case PacketType::COMMAND_BATCH: return Priority::TELEMETRY;
+        case PacketType::COMMAND_ACK: return Priority::TELEMETRY;     // What the ground waits on to send the next
+        case PacketType::CAMERA_PREVIEW: return Priority::TELEMETRY;   // Ahead of the capture's own fragments
+        case PacketType::PROFILE_LEVEL: return Priority::TELEMETRY;    // Each level is climbed through once
+        case PacketType::TRACK_SEGMENT: return Priority::GPS;          // The position reports' backstop
+        case PacketType::DIGEST:      return Priority::TELEMETRY;
+        default:                      return Priority::STATUS;
+    }
+}
+
+void PacketHandler::onRadioPayloadReleased(void* context, int16_t handle) {
+    PacketHandler* handler = static_cast<PacketHandler*>(context);
+    if (handler->slotsInRadio > 0) {
+        handler->slotsInRadio--;
+    }
+    handler->releaseSlot(static_cast<PacketSlot>(handle));
+}
+
+bool PacketHandler::onRadioSupersede(void* context, const Packet& newer, const Packet& older) {
+    return newer.payloadLength > 0 && older.payloadLength > 0 &&
+           supersedes(static_cast<uint8_t>(newer.type), newer.payload, older.payload);
+}
+
+bool PacketHandler::onRadioRetransmit(void* context, const Packet& packet, uint8_t attempts, uint32_t ageMs) {
+    const PacketHandler* handler = static_cast<const PacketHandler*>(context);
+    return handler->shouldRetransmit(packet.type, packet.payloadLength > 0 ? packet.payload : nullptr, attempts, ageMs);
+}
+
+void PacketHandler::onRadioPayloadEvent(void* context, int16_t handle, PayloadEvent event) {
+    PacketHandler* handler = static_cast<PacketHandler*>(context);
+    PacketSlot slot = static_cast<PacketSlot>(handle);
+    LatencyStage stage = event == PayloadEvent::TRANSMITTED ? LatencyStage::ENQUEUE_TO_TX : LatencyStage::ENQUEUE_TO_ACK;
+    handler->recordLatency(handler->slab[slot][2], stage, micros() - handler->slotInfo[slot].enqueuedAt);
+}
+
+bool PacketHandler::enqueuePacket(PacketSlot slot, size_t packetSize, PacketPriority priority) {
+    int lane = min((int)static_cast<uint8_t>(priority), PACKET_PRIORITY_LANES - 1);
+
+    if (coalescePacket(lane, slot, packetSize)) {
+        return true;
+    }
+
+    if (queueSize >= PACKET_QUEUE_DEPTH) {
+        // Queue full, drop the oldest low/normal priority packet if there is one
+        int dropLane = lowestDroppableLane();
+        if (dropLane < 0) {
+            releaseSlot(slot);
+            packetsDropped++;
+            return false;
         }
+        releaseSlot(popLane(dropLane));
+        packetsDropped++;
     }
+
+    // Ownership of the slot moves to the queue
+    PacketBuffer& info = slotInfo[slot];
+    info.size = packetSize;
+    info.capacity = MAX_PACKET_SIZE;
+    info.timestamp = millis();
+    info.enqueuedAt = micros();
+    info.sampledAt = 0;
+    info.priority = priority;
+    info.ready = true;
+    info.deferred = false;
+
+    pushLane(lane, slot);
+    return true;
 }
 
-size_t PacketHandler::findOldestLowPriorityPacket() const {
-    size_t oldestIndex = 16;
-    uint32_t oldestTime = UINT32_MAX;
-    
-    for (size_t i = 0; i < queueSize; i++) {
-        if (static_cast<uint8_t>(packetQueue[i].priority) == static_cast<uint8_t>(PacketPriority::PRIORITY_LOW) || 
-            static_cast<uint8_t>(packetQueue[i].priority) == static_cast<uint8_t>(PacketPriority::PRIORITY_NORMAL)) {
-            if (packetQueue[i].timestamp < oldestTime) {
-                oldestTime = packetQueue[i].timestamp;
-                oldestIndex = i;
-            }
+bool PacketHandler::dequeuePacket(PacketSlot& slot, size_t& packetSize) {
+    if (laneMask == 0) {
+        return false;
+    }
+
+    // Highest non-empty lane, oldest packet in it
+    int lane = 31 - __builtin_clz(laneMask);
+    slot = popLane(lane);
+    packetSize = slotInfo[slot].size;
+    slotInfo[slot].ready = false;  // Caller owns the slot now
+    return true;
+}
+
+void PacketHandler::pushLane(int lane, PacketSlot slot) {
+    PacketLane& queue = lanes[lane];
+    queue.slots[(queue.head + queue.count) & (PACKET_QUEUE_DEPTH - 1)] = slot;
+    queue.count++;
+    laneMask |= 1 << lane;
+    queueSize++;
+}
+
+PacketSlot PacketHandler::popLane(int lane) {
+    PacketLane& queue = lanes[lane];
+    PacketSlot slot = queue.slots[queue.head];
+    queue.head = (queue.head + 1) & (PACKET_QUEUE_DEPTH - 1);
+    if (--queue.count == 0) {
+        laneMask &= ~(1 << lane);
+    }
+    queueSize--;
+    return slot;
+}
+
+PacketSlot PacketHandler::removeFromLane(int lane, uint16_t position) {
+    if (position == 0) {
+        return popLane(lane);
+    }
+
+    // Close the gap - lanes are short, so shifting beats a linked list
+    PacketLane& queue = lanes[lane];
+    const uint16_t mask = PACKET_QUEUE_DEPTH - 1;
+    PacketSlot slot = queue.slots[(queue.head + position) & mask];
+    for (uint16_t i = position; i + 1 < queue.count; i++) {
+        queue.slots[(queue.head + i) & mask] = queue.slots[(queue.head + i + 1) & mask];
+    }
+    if (--queue.count == 0) {
+        laneMask &= ~(1 << lane);
+    }
+    queueSize--;
+    return slot;
+}
+
+bool PacketHandler::coalescePacket(int lane, PacketSlot slot, size_t packetSize) {
+    uint8_t type = slab[slot][2];
+    if (!isCoalescable(type)) {
+        return false;
+    }
+
+    // Only the latest heartbeat/GPS fix/status matters - a newer one takes
+    // the place of one already held back by its rate limit. GPS and
+    // telemetry are latest-value: any one still queued is replaced
+    uint8_t bucketIndex = rateBucketFor(type);
+    bool latest = isLatestValue(type);
+    PacketLane& queue = lanes[lane];
+    for (uint16_t position = 0; position < queue.count; position++) {
+        PacketSlot& queued = queue.slots[(queue.head + position) & (PACKET_QUEUE_DEPTH - 1)];
+        if (rateBucketFor(slab[queued][2]) != bucketIndex) {
+            continue;
+        }
+        bool stale = latest ? supersedes(type, &slab[slot][PACKET_WIRE_HEADER_SIZE],
+                                         &slab[queued][PACKET_WIRE_HEADER_SIZE])
+                            : slotInfo[queued].deferred;
+        if (stale) {
+            bool deferred = slotInfo[queued].deferred;
+            releaseSlot(queued);
+            queued = slot;
+
+            PacketBuffer& info = slotInfo[slot];
+            info.size = packetSize;
+            info.capacity = MAX_PACKET_SIZE;
+            info.timestamp = millis();
+            info.enqueuedAt = micros();
+            info.sampledAt = 0;
+            info.priority = static_cast<PacketPriority>(lane);
+            info.ready = true;
+            info.deferred = deferred;
+            rateBuckets[bucketIndex].coalesced++;
+            return true;
         }
     }
-    
-    return oldestIndex;
+    return false;
+}
+
+int PacketHandler::lowestDroppableLane() const {
+    // Only low and normal priority packets make room for new ones
+    uint8_t droppable = laneMask & ((1 << (static_cast<uint8_t>(PacketPriority::PRIORITY_NORMAL) + 1)) - 1);
+    return droppable ? __builtin_ctz(droppable) : -1;
 }
 
 // ===========================
@@ -798,63 +1329,156 @@ uint32_t PacketHandler::bytesToUint32(const uint8_t* bytes) {
 
 void PacketHandler::resetReceiveState() {
     receiveIndex = 0;
-    inPacket = false;
-    memset(&currentHeader, 0, sizeof(currentHeader));
-    expectedPayloadSize = 0;
-}
-
-bool PacketHandler::processReceivedByte(uint8_t byte) {
-    if (!inPacket) {
-        // Looking for start sequence
-        if (receiveIndex == 0 && byte == PACKET_START_BYTE1) {
-            receiveBuffer[receiveIndex++] = byte;
-        } else if (receiveIndex == 1 && byte == PACKET_START_BYTE2) {
-            receiveBuffer[receiveIndex++] = byte;
-            inPacket = true;
-        } else {
-            receiveIndex = 0; // Reset if not start sequence
-        }
-    } else {
-        // In packet processing
-        receiveBuffer[receiveIndex++] = byte;
-
-        // Check if we have enough for header
-        if (receiveIndex == sizeof(PacketHeader)) {
-            memcpy(&currentHeader, receiveBuffer, sizeof(PacketHeader));
-            
-            if (!validateHeader(currentHeader)) {
-                resetReceiveState();
-                crcErrors++;
-                return false;
+    expectedFrameSize = 0;
+}
+
+size_t PacketHandler::parseSpan(const uint8_t* data, size_t length) {
+    const uint8_t* cursor = data;
+    const uint8_t* end = data + length;
+    size_t framesParsed = 0;
+    PacketHeader header;
+
+    while (cursor < end) {
+        size_t remaining = end - cursor;
+
+        if (receiveIndex > 0) {
+            // Complete the frame held over from the previous call
+            if (expectedFrameSize == 0) {
+                size_t take = min(PACKET_WIRE_HEADER_SIZE - receiveIndex, remaining);
+                memcpy(&receiveBuffer[receiveIndex], cursor, take);
+                receiveIndex += take;
+                cursor += take;
+                remaining -= take;
+
+                if (receiveIndex < PACKET_WIRE_HEADER_SIZE) {
+                    break;
+                }
+                if (!decodeHeader(receiveBuffer, header)) {
+                    framesParsed += rescanHeld();
+                    continue;
+                }
+                expectedFrameSize = PACKET_WIRE_HEADER_SIZE + header.payloadLength + PACKET_WIRE_FOOTER_SIZE;
+            }
+
+            size_t take = min(expectedFrameSize - receiveIndex, remaining);
+            memcpy(&receiveBuffer[receiveIndex], cursor, take);
+            receiveIndex += take;
+            cursor += take;
+
+            if (receiveIndex < expectedFrameSize) {
+                break;
             }
-            
-            expectedPayloadSize = currentHeader.payloadLength;
-            
-            // Check if total packet size is reasonable
-            size_t totalSize = sizeof(PacketHeader) + expectedPayloadSize + sizeof(PacketFooter);
-            if (totalSize > sizeof(receiveBuffer)) {
+            if (processCompletePacket(receiveBuffer, receiveIndex)) {
+                framesParsed++;
                 resetReceiveState();
-                logError("Packet size exceeds buffer");
-                return false;
+            } else {
+                framesParsed += rescanHeld();
+            }
+            continue;
+        }
+
+        // Skip to the next candidate start byte in one pass
+        const uint8_t* start = static_cast<const uint8_t*>(memchr(cursor, PACKET_START_BYTE1, remaining));
+        if (!start) {
+            resyncBytes += remaining;
+            break;
+        }
+        resyncBytes += start - cursor;
+        cursor = start;
+        remaining = end - cursor;
+
+        if (remaining < PACKET_WIRE_HEADER_SIZE) {
+            if (remaining >= 2 && cursor[1] != PACKET_START_BYTE2) {
+                resyncBytes++;
+                cursor++;
+                continue;
             }
+            holdPartial(cursor, remaining, 0);
+            break;
+        }
+
+        // Header CRC8 is checked before any payload is looked at, so a
+        // corrupt length can't swallow the frames behind it
+        if (!decodeHeader(cursor, header)) {
+            resyncBytes++;
+            cursor++;
+            continue;
         }
 
-        // Check if complete packet received
-        size_t totalExpectedSize = sizeof(PacketHeader) + expectedPayloadSize + sizeof(PacketFooter);
-        if (receiveIndex >= totalExpectedSize) {
-            bool success = processCompletePacket();
-            resetReceiveState();
-            return success;
+        size_t frameSize = PACKET_WIRE_HEADER_SIZE + header.payloadLength + PACKET_WIRE_FOOTER_SIZE;
+        if (remaining < frameSize) {
+            holdPartial(cursor, remaining, frameSize);
+            break;
+        }
+
+        // Whole frame in the span - parse it in place
+        if (processCompletePacket(cursor, frameSize)) {
+            framesParsed++;
+            cursor += frameSize;
+        } else {
+            resyncBytes++;
+            cursor++;
         }
     }
 
-    return false;
+    return framesParsed;
+}
+
+void PacketHandler::holdPartial(const uint8_t* data, size_t length, size_t frameSize) {
+    memcpy(receiveBuffer, data, length);
+    receiveIndex = length;
+    expectedFrameSize = frameSize;
+    receiveStartTime = millis();
+}
+
+size_t PacketHandler::rescanHeld() {
+    // The held frame was rejected - anything after its start byte may be
+    // the real one, so scan it again from the replay area
+    size_t held = receiveIndex - 1;
+    memcpy(&receiveBuffer[PACKET_REPLAY_OFFSET], &receiveBuffer[1], held);
+    resetReceiveState();
+    resyncBytes++;
+
+    // Fresh scan: can only hold a partial frame at the end, below PACKET_REPLAY_OFFSET
+    return parseSpan(&receiveBuffer[PACKET_REPLAY_OFFSET], held);
+}
+
+bool PacketHandler::decodeHeader(const uint8_t* frame, PacketHeader& header) {
+    if (frame[0] != PACKET_START_BYTE1 || frame[1] != PACKET_START_BYTE2) {
+        return false;
+    }
+
+    if (calculateCRC8(frame, PACKET_WIRE_HEADER_SIZE - 1) != frame[PACKET_WIRE_HEADER_SIZE - 1]) {
+        crcErrors++;
+        return false;
+    }
+
+    header.startByte1 = frame[0];
+    header.startByte2 = frame[1];
+    header.packetType = static_cast<PacketType>(frame[2]);
+    header.sequenceNumber = frame[3];
+    header.payloadLength = bytesToUint16(&frame[4]);
+    header.crc8 = frame[6];
+
+    if (!validateHeader(header)) {
+        crcErrors++;
+        return false;
+    }
+    return true;
 }
 
 bool PacketHandler::validateHeader(const PacketHeader& header) {
     // Validate packet type
-    if (static_cast<uint8_t>(header.packetType) < static_cast<uint8_t>(PacketType::HEARTBEAT) ||
-        static_cast<uint8_t>(header.packetType) > static_cast<uint8_t>(PacketType::DEBUG)) {
+    uint8_t type = static_cast<uint8_t>(header.packetType);
+    if (type == (static_cast<uint8_t>(PacketType::STATUS) | PACKET_TYPE_COMPRESSED) ||
+        type == (static_cast<uint8_t>(PacketType::DEBUG) | PACKET_TYPE_COMPRESSED)) {
+        type &= ~PACKET_TYPE_COMPRESSED;
+    }
+    if ((type < static_cast<uint8_t>(PacketType::HEARTBEAT) || type > static_cast<uint8_t>(PacketType::DEBUG)) &&
+        header.packetType != PacketType::FRAGMENT && header.packetType != PacketType::FRAGMENT_ACK &&
+        header.packetType != PacketType::COMMAND && header.packetType != PacketType::CAMERA_PREVIEW &&
+        header.packetType != PacketType::COMMAND_BATCH && header.packetType != PacketType::PROFILE_LEVEL &&
+        header.packetType != PacketType::TRACK_SEGMENT && header.packetType != PacketType::DIGEST) {
         return false;
     }
 
@@ -866,23 +1490,118 @@ bool PacketHandler::validateHeader(const PacketHeader& header) {
     return true;
 }
 
-bool PacketHandler::processCompletePacket() {
-    if (!verifyCRC(receiveBuffer, receiveIndex)) {
+bool PacketHandler::processCompletePacket(const uint8_t* frame, size_t length) {
+    if (frame[length - 2] != PACKET_END_BYTE1 || frame[length - 1] != PACKET_END_BYTE2) {
         crcErrors++;
         return false;
     }
+    if (!verifyCRC(frame, length)) {
+        return false;
+    }
 
-    packetsReceived++;
-    updateStatistics(currentHeader.packetType, false);
+    PacketType type = static_cast<PacketType>(frame[2]);
+    updateStatistics(type, false);
     
     if (DEBUG_PACKET_HANDLER && LOG_PACKET_CONTENTS) {
-        logPacket(receiveBuffer, receiveIndex, false);
+        logPacket(frame, length, false);
     }
 
-    // Process packet based on type
-    // This would interface with other system components
-    // For now, just count it as received
-    
+    processPayload(type, &frame[PACKET_WIRE_HEADER_SIZE],
+                   length - PACKET_WIRE_HEADER_SIZE - PACKET_WIRE_FOOTER_SIZE);
+    return true;
+}
+
+void PacketHandler::processPayload(PacketType type, const uint8_t* payload, size_t payloadSize) {
+    // Only text types carry the compressed flag (0xFF is EMERGENCY, not a flagged type)
+    bool compressed = false;
+    if (type == static_cast<PacketType>(static_cast<uint8_t>(PacketType::STATUS) | PACKET_TYPE_COMPRESSED) ||
+        type == static_cast<PacketType>(static_cast<uint8_t>(PacketType::DEBUG) | PACKET_TYPE_COMPRESSED)) {
+        type = static_cast<PacketType>(static_cast<uint8_t>(type) & ~PACKET_TYPE_COMPRESSED);
+        compressed = true;
+    }
+
+    switch (type) {
+        case PacketType::TELEMETRY:
+            if (telemetryDecoder.decode(payload, payloadSize, lastTelemetry)) {
+                pendingPayloads |= PENDING_TELEMETRY;
+            }
+            break;
+
+        case PacketType::GPS_DATA:
+            if (payloadSize == GPSSchema::size) {
+                GPSSchema::decode(payload, lastGPS);
+                pendingPayloads |= PENDING_GPS;
+            }
+            break;
+
+        case PacketType::CAMERA_DATA:
+            if (payloadSize == CameraSchema::size) {
+                CameraSchema::decode(payload, lastCamera);
+                pendingPayloads |= PENDING_CAMERA;
+            }
+            break;
+
+        case PacketType::ALERT:
+            if (payloadSize == AlertSchema::size) {
+                AlertSchema::decode(payload, lastAlert);
+                pendingPayloads |= PENDING_ALERT;
+            }
+            break;
+
+        case PacketType::STATUS:
+            if (storeText(lastStatus, payload, payloadSize, compressed)) {
+                pendingPayloads |= PENDING_STATUS;
+            }
+            break;
+
+        case PacketType::DEBUG:
+            if (storeText(lastDebug, payload, payloadSize, compressed)) {
+                pendingPayloads |= PENDING_DEBUG;
+            }
+            break;
+
+        case PacketType::FRAGMENT:
+            FragmentMgr().handleFragment(0, payload, payloadSize);
+            break;
+
+        case PacketType::FRAGMENT_ACK:
+            FragmentMgr().handleAck(payload, payloadSize);
+            break;
+
+        case PacketType::COMMAND:
+            if (payloadSize >= 1 && payloadSize <= sizeof(lastCommand)) {
+                memcpy(lastCommand, payload, payloadSize);
+                lastCommandLength = payloadSize;
+                pendingPayloads |= PENDING_COMMAND;
+            }
+            break;
+
+        case PacketType::COMMAND_BATCH:
+            if (payloadSize >= 1 && payloadSize <= sizeof(lastBatch)) {
+                memcpy(lastBatch, payload, payloadSize);
+                lastBatchLength = payloadSize;
+                pendingPayloads |= PENDING_COMMAND_BATCH;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool PacketHandler::storeText(char* text, const uint8_t* payload, size_t payloadSize, bool compressed) {
+    size_t length = 0;
+    if (compressed) {
+        length = decompressText(payload, payloadSize, reinterpret_cast<uint8_t*>(text), PACKET_TEXT_MAX);
+        if (length == 0) {
+            return false;
+        }
+    } else {
+        length = payloadSize > PACKET_TEXT_MAX ? PACKET_TEXT_MAX : payloadSize;
+        memcpy(text, payload, length);
+    }
+
+    text[length] = '\0';
     return true;
 }
 
@@ -894,15 +1613,22 @@ void PacketHandler::updateStatistics(PacketType type, bool sent) {
     }
 }
 
-bool PacketHandler::shouldRetransmit(PacketType type, uint8_t attempts) {
+bool PacketHandler::shouldRetransmit(PacketType type, const uint8_t* payload, uint8_t attempts, uint32_t ageMs) const {
     if (attempts >= maxRetries) {
         return false;
     }
 
-    // Critical and alert packets should be retried
-    return (type == PacketType::ALERT || 
-            type == PacketType::HEARTBEAT ||
-            type == PacketType::STATUS);
+    // A stale fix or delta isn't worth the airtime; a keyframe is retried
+    // regardless, as the deltas queued behind it need it
+    switch (type) {
+        case PacketType::GPS_DATA:
+            return !PACKET_LATEST_VALUE || ageMs < PACKET_FRESH_GPS_MS;
+        case PacketType::TELEMETRY:
+            return !PACKET_LATEST_VALUE || (payload && (payload[0] & (TELEMETRY_FLAG_KEYFRAME >> 8))) ||
+                   ageMs < PACKET_FRESH_TELEMETRY_MS;
+        default:
+            return true;
+    }
 }
 
 // ===========================
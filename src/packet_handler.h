@@ -7,12 +7,37 @@
 #include "sensor_pins.h"
 #include "balloon_config.h"
 #include "common_types.h"
+#include "packet_schema.h"
+#include "telemetry_codec.h"
+#include "text_codec.h"
+#include "preview_frame.h"
+#include "pressure_profile.h"
+#include "lora_comm.h"
 
 // ===========================
 // Packet Handler Module
 // ESP32-S3 Balloon Project
 // ===========================
 
+// PACKET_QUEUE_DEPTH - defined in balloon_config.h
+#define PACKET_SLAB_SLOTS      (PACKET_QUEUE_DEPTH + PACKET_RADIO_SLOTS + 2)  // Queue + lent to the radio + assembly + spare
+#define PACKET_PRIORITY_LANES  6                         // One FIFO per PacketPriority value (0-5)
+
+// Wire layout - PacketHeader/PacketFooter are padded in memory, so frames are
+// read and written field by field
+#define PACKET_WIRE_HEADER_SIZE 7      // Start x2, type, sequence, length (big endian), CRC8
+#define PACKET_WIRE_FOOTER_SIZE 4      // CRC16 (big endian), end x2
+#define PACKET_RECEIVE_BUFFER  512
+#define PACKET_REPLAY_OFFSET   256     // Upper half of receiveBuffer, used to rescan a rejected frame
+
+// Type byte flag: STATUS/DEBUG payload is text_codec compressed (0x87, 0x88)
+#define PACKET_TYPE_COMPRESSED 0x80
+#define PACKET_TEXT_MAX        150     // Longest status/debug text, before compression
+
+static_assert((PACKET_QUEUE_DEPTH & (PACKET_QUEUE_DEPTH - 1)) == 0, "PACKET_QUEUE_DEPTH must be a power of two");
+static_assert(PACKET_SLAB_SLOTS <= 127, "PacketSlot is an int8_t handle");
+static_assert(PACKET_BACKPRESSURE_LEVEL < PACKET_QUEUE_DEPTH, "Backpressure must start before the queue is full");
+
 // Packet Types - defined in common_types.h
 
 // Alert Types
@@ -23,7 +48,8 @@ enum class AlertType : uint8_t {
     SENSOR_FAILURE = 0x04,
     COMMUNICATION_LOST = 0x05,
     MEMORY_FULL = 0x06,
-    OVERHEATING = 0x07
+    OVERHEATING = 0x07,
+    SYSTEM_CRASH = 0x08         // Message from crash_report.h, sensorId the reset reason
 };
 
 // Packet Priority - defined in common_types.h
@@ -60,6 +86,11 @@ struct CameraData {
     float contrast;
     uint8_t faceCount;
     uint8_t objectCount;
+    uint8_t burstFrames;        // Frames the image was picked from
+    uint16_t sharpness;         // Laplacian variance of the image sent, 0 if not scored
+    uint16_t sharpnessWorst;    // Blurriest frame of the burst
+    uint8_t sceneLabel;         // SceneLabel, 0xFF if not classified
+    uint8_t sceneConfidence;    // 0-100
 };
 
 struct AlertData {
@@ -71,14 +102,247 @@ struct AlertData {
     uint8_t sensorId;
 };
 
-// Packet Buffer
+// One frame of what the heartbeat, telemetry, GPS and status reports say
+// between them, for a ground that wants the whole picture at once
+struct DigestData {
+    uint32_t uptime;            // ms
+    uint8_t flightPhase;        // FlightPhase
+    uint8_t mode;               // SystemMode
+    uint8_t systemStatus;       // SystemStatus
+    uint16_t subsystemBits;     // SysState().getSubsystemBits()
+
+    float temperature;          // °C
+    float pressure;             // Pa
+    float altitude;             // m MSL, the altitude filter's
+    float verticalSpeed;        // m/s, up positive
+    float latitude;             // Last fix, 0 before one
+    float longitude;
+    uint8_t satellites;
+
+    float batteryVoltage;
+    uint8_t batteryPercentage;
+    float current;              // mA, the whole load
+    uint8_t powerState;         // PowerState
+
+    int8_t rssi;                // Averages of the ground's frames
+    int8_t snr;
+    uint8_t spreadingFactor;
+    int8_t txPower;             // dBm
+    uint8_t packetErrorRate;    // % at the current rate
+    uint16_t ackTimeouts;
+
+    uint16_t captures;
+    uint16_t captureErrors;
+
+    uint16_t freeHeapKb;
+    uint16_t configVersion;     // Runtime config (runtime_config.h), so a change can be confirmed
+
+    uint32_t p99SensorsUs;      // Stage profiler P99s (stage_profiler.h)
+    uint32_t p99ReportsUs;
+    uint32_t p99CameraUs;
+    uint32_t p99CommsUs;
+};
+
+// ===========================
+// Payload Schemas
+// One descriptor list per payload struct - createXPacket() and extractX()
+// are both generated from it
+// ===========================
+
+// Fixed point throughout; this is also the keyframe layout of the telemetry
+// delta codec (telemetry_codec.h)
+typedef schema::Schema<TelemetryData,
+    SCHEMA_FIELD(TelemetryData, temperature,       schema::Scaled<2, true, 100>),     // 0.01 C
+    SCHEMA_FIELD(TelemetryData, pressure,          schema::Scaled<3, false, 1>),      // 1 Pa
+    SCHEMA_FIELD(TelemetryData, humidity,          schema::Scaled<2, false, 100>),    // 0.01 %
+    SCHEMA_FIELD(TelemetryData, batteryVoltage,    schema::Scaled<2, false, 1000>),   // 1 mV
+    SCHEMA_FIELD(TelemetryData, batteryCurrent,    schema::Scaled<2, true, 1000>),    // 1 mA
+    SCHEMA_FIELD(TelemetryData, batteryPercentage, schema::Integer<uint8_t>),
+    SCHEMA_FIELD(TelemetryData, uptime,            schema::Coarse<uint32_t, 4, 100>), // 100 ms
+    SCHEMA_FIELD(TelemetryData, rssi,              schema::Integer<int8_t>),
+    SCHEMA_FIELD(TelemetryData, freeHeap,          schema::Integer<uint16_t>),
+    SCHEMA_FIELD(TelemetryData, cpuTemperature,    schema::Scaled<2, true, 100>),     // 0.01 C
+    SCHEMA_FIELD(TelemetryData, powerState,        schema::Integer<uint8_t>)
+> TelemetrySchema;
+
+typedef schema::Schema<GPSData,
+    SCHEMA_FIELD(GPSData, latitude,   schema::Float32),
+    SCHEMA_FIELD(GPSData, longitude,  schema::Float32),
+    SCHEMA_FIELD(GPSData, altitude,   schema::Float32),
+    SCHEMA_FIELD(GPSData, satellites, schema::Integer<uint8_t>),
+    SCHEMA_FIELD(GPSData, speed,      schema::Float32),
+    SCHEMA_FIELD(GPSData, course,     schema::Float32),
+    SCHEMA_FIELD(GPSData, fixTime,    schema::Integer<uint32_t>),
+    SCHEMA_FIELD(GPSData, hdop,       schema::Integer<uint8_t>),
+    SCHEMA_FIELD(GPSData, quality,    schema::Integer<uint8_t>)
+> GPSSchema;
+
+typedef schema::Schema<CameraData,
+    SCHEMA_FIELD(CameraData, imageId,     schema::Integer<uint16_t>),
+    SCHEMA_FIELD(CameraData, timestamp,   schema::Integer<uint32_t>),
+    SCHEMA_FIELD(CameraData, imageSize,   schema::Integer<uint16_t>),
+    SCHEMA_FIELD(CameraData, compression, schema::Integer<uint8_t>),
+    SCHEMA_FIELD(CameraData, brightness,  schema::Float32),
+    SCHEMA_FIELD(CameraData, contrast,    schema::Float32),
+    SCHEMA_FIELD(CameraData, faceCount,   schema::Integer<uint8_t>),
+    SCHEMA_FIELD(CameraData, objectCount, schema::Integer<uint8_t>),
+    SCHEMA_FIELD(CameraData, burstFrames, schema::Integer<uint8_t>),
+    SCHEMA_FIELD(CameraData, sharpness,   schema::Integer<uint16_t>),
+    SCHEMA_FIELD(CameraData, sharpnessWorst, schema::Integer<uint16_t>),
+    SCHEMA_FIELD(CameraData, sceneLabel,  schema::Integer<uint8_t>),
+    SCHEMA_FIELD(CameraData, sceneConfidence, schema::Integer<uint8_t>)
+> CameraSchema;
+
+typedef schema::Schema<AlertData,
+    SCHEMA_FIELD(AlertData, alertType,   schema::Integer<AlertType>),
+    SCHEMA_FIELD(AlertData, timestamp,   schema::Integer<uint32_t>),
+    SCHEMA_FIELD(AlertData, severity,    schema::Integer<uint8_t>),
+    SCHEMA_FIELD(AlertData, message,     schema::Text<64>),
+    SCHEMA_FIELD(AlertData, sensorValue, schema::Float32),
+    SCHEMA_FIELD(AlertData, sensorId,    schema::Integer<uint8_t>)
+> AlertSchema;
+
+// Counters go modulo their width; the P99s saturate at 655 ms
+typedef schema::Schema<DigestData,
+    SCHEMA_FIELD(DigestData, uptime,            schema::Coarse<uint32_t, 3, 1000>), // 1 s
+    SCHEMA_FIELD(DigestData, flightPhase,       schema::Integer<uint8_t>),
+    SCHEMA_FIELD(DigestData, mode,              schema::Integer<uint8_t>),
+    SCHEMA_FIELD(DigestData, systemStatus,      schema::Integer<uint8_t>),
+    SCHEMA_FIELD(DigestData, subsystemBits,     schema::Integer<uint16_t>),
+    SCHEMA_FIELD(DigestData, temperature,       schema::Scaled<2, true, 100>),      // 0.01 C
+    SCHEMA_FIELD(DigestData, pressure,          schema::Scaled<3, false, 1>),       // 1 Pa
+    SCHEMA_FIELD(DigestData, altitude,          schema::Scaled<3, true, 10>),       // 0.1 m
+    SCHEMA_FIELD(DigestData, verticalSpeed,     schema::Scaled<2, true, 100>),      // 0.01 m/s
+    SCHEMA_FIELD(DigestData, latitude,          schema::Scaled<4, true, 10000000>), // 1e-7 deg
+    SCHEMA_FIELD(DigestData, longitude,         schema::Scaled<4, true, 10000000>),
+    SCHEMA_FIELD(DigestData, satellites,        schema::Integer<uint8_t>),
+    SCHEMA_FIELD(DigestData, batteryVoltage,    schema::Scaled<2, false, 1000>),    // 1 mV
+    SCHEMA_FIELD(DigestData, batteryPercentage, schema::Integer<uint8_t>),
+    SCHEMA_FIELD(DigestData, current,           schema::Scaled<2, true, 1>),        // 1 mA
+    SCHEMA_FIELD(DigestData, powerState,        schema::Integer<uint8_t>),
+    SCHEMA_FIELD(DigestData, rssi,              schema::Integer<int8_t>),
+    SCHEMA_FIELD(DigestData, snr,               schema::Integer<int8_t>),
+    SCHEMA_FIELD(DigestData, spreadingFactor,   schema::Integer<uint8_t>),
+    SCHEMA_FIELD(DigestData, txPower,           schema::Integer<int8_t>),
+    SCHEMA_FIELD(DigestData, packetErrorRate,   schema::Integer<uint8_t>),
+    SCHEMA_FIELD(DigestData, ackTimeouts,       schema::Integer<uint16_t>),
+    SCHEMA_FIELD(DigestData, captures,          schema::Integer<uint16_t>),
+    SCHEMA_FIELD(DigestData, captureErrors,     schema::Integer<uint16_t>),
+    SCHEMA_FIELD(DigestData, freeHeapKb,        schema::Integer<uint16_t>),
+    SCHEMA_FIELD(DigestData, configVersion,     schema::Integer<uint16_t>),
+    SCHEMA_FIELD(DigestData, p99SensorsUs,      schema::Coarse<uint32_t, 2, 10>),   // 10 us
+    SCHEMA_FIELD(DigestData, p99ReportsUs,      schema::Coarse<uint32_t, 2, 10>),
+    SCHEMA_FIELD(DigestData, p99CameraUs,       schema::Coarse<uint32_t, 2, 10>),
+    SCHEMA_FIELD(DigestData, p99CommsUs,        schema::Coarse<uint32_t, 2, 10>)
+> DigestSchema;
+
+static_assert(TELEMETRY_KEYFRAME_SIZE == TELEMETRY_HEADER_SIZE + TelemetrySchema::size,
+              "Telemetry keyframe out of step with TelemetrySchema");
+static_assert(TELEMETRY_CODEC_FIELDS == TelemetrySchema::fields, "Telemetry field count out of step with TelemetrySchema");
+static_assert(TELEMETRY_KEYFRAME_SIZE <= MAX_TELEMETRY_SIZE, "Telemetry payload exceeds MAX_TELEMETRY_SIZE");
+static_assert(GPSSchema::size <= MAX_GPS_SIZE, "GPS payload exceeds MAX_GPS_SIZE");
+static_assert(CameraSchema::size <= MAX_CAMERA_INFO_SIZE, "Camera payload exceeds MAX_CAMERA_INFO_SIZE");
+static_assert(AlertSchema::size <= MAX_ALERT_SIZE, "Alert payload exceeds MAX_ALERT_SIZE");
+static_assert(DigestSchema::size <= MAX_DIGEST_SIZE, "Digest payload exceeds MAX_DIGEST_SIZE");
+
+// Handle to one MAX_PACKET_SIZE slot of the packet slab
+typedef int8_t PacketSlot;
+#define PACKET_SLOT_NONE       -1
+
+// Packet Buffer - metadata for one slab slot
 struct PacketBuffer {
-    uint8_t* data;
     size_t size;
     size_t capacity;
     uint32_t timestamp;
     PacketPriority priority;
     bool ready;
+    bool deferred;      // Held back by its rate bucket at least once
+    uint32_t enqueuedAt;    // micros() on entering the queue, for the latency histograms
+    uint32_t sampledAt;     // millis() of the reading behind it, 0 = timestamp
+};
+
+// COMMAND payload: [0] command id, [1..] parameters
+// COMMAND_BATCH payload: [0] batch id, then [command id][length][parameters]
+// for each command, up to PACKET_COMMAND_BATCH_MAX; answered with one
+// COMMAND_ACK - the table and the ACK's layout are in command_dispatch.h
+#define PACKET_COMMAND_MAX_PARAMS  63
+#define PACKET_COMMAND_BATCH_BYTES 200     // A whole payload, MAX_PAYLOAD_SIZE
+#define PACKET_COMMAND_BATCH_MAX   32
+
+enum class CommandId : uint8_t {
+    REQUEST_TILES = 0x01,       // Tiles of a retained camera image - layout in camera_manager.h
+    PROBE_PROFILE = 0x02,       // Performance probes - parameters and replies in perf_probe.h
+    PROBE_SLOW_SCOPES = 0x03,
+    PROBE_LOG_LEVEL = 0x04,
+    PROBE_TRACE = 0x05,
+    IMAGES_RECEIVED = 0x06,     // [0..1]... ids of images the ground holds - image_downlink.h
+
+    // Setters, parameters big endian
+    CAMERA_FRAME_SIZE = 0x10,   // [0] framesize_t
+    CAMERA_QUALITY = 0x11,      // [0] JPEG quality, 0-63 lower is better
+    CAMERA_BRIGHTNESS = 0x12,   // [0] int8, -2..2
+    CAMERA_CONTRAST = 0x13,     // [0] int8, -2..2
+    CAMERA_BURST = 0x14,        // [0] frames per capture, 1..CAMERA_BURST_MAX_FRAMES
+    CAMERA_PROFILE = 0x15,      // [0] CameraProfileId - day, night, bandwidth, quality
+    RADIO_TX_POWER = 0x20,      // [0] dBm, 2..20
+    RADIO_ARQ_WINDOW = 0x21,    // [0] frames in flight, 1..LORA_ACK_BITMAP_BITS
+    POWER_RAIL = 0x30,          // [0] PowerRail, [1] 0/1 - the LoRa rail can't be turned off
+    GPS_FULL_RATE = 0x31,       // [0..1] seconds of full GPS tracking, 0 back to the power policy
+    WIFI_AP = 0x32,             // [0..1] seconds of the ground access point, 0 back to the flight phase
+    DEBUG_LEVEL = 0x40,         // [0] DebugLevel
+    DEBUG_CATEGORY = 0x41,      // [0] DebugCategory, [1] 0/1
+
+    // Firmware update - firmware_update.h
+    FIRMWARE_ACTIVATE = 0x50,   // [0..3] new image SHA-256 prefix; boots the applied patch
+    FIRMWARE_ABORT = 0x51,      // Drops the patch, or a pending activate
+
+    // Runtime configuration - runtime_config.h
+    CONFIG_SET = 0x60,          // [0] ConfigKey, [1..4] int32 value
+    CONFIG_DEFAULTS = 0x61      // Every key back to the build's default
+};
+
+// Ground side: one COMMAND_BATCH, built up with add()
+struct CommandBatch {
+    uint8_t payload[PACKET_COMMAND_BATCH_BYTES];
+    size_t length;
+    uint8_t count;
+
+    void begin(uint8_t batchId);
+    bool add(CommandId command, const uint8_t* params, size_t paramLength);    // false when it doesn't fit
+};
+
+// Token bucket for one packet type - compressed text shares its plain type's bucket
+#define PACKET_RATE_BUCKETS    0x1B    // Type values up to DIGEST; anything else shares bucket 0
+
+struct RateBucket {
+    float tokens;
+    float ratePerSecond;    // 0 = unlimited
+    uint8_t burst;
+    uint32_t throttled;     // Packets held back at least once
+    uint32_t coalesced;     // Queued packets superseded by a newer one of the same type
+};
+
+// Latency histograms - one per packet type (indexed like the rate buckets) and stage
+#define PACKET_LATENCY_BUCKETS 26      // Bucket b counts [2^b, 2^(b+1)) us; the last one is open-ended (>= 33 s)
+#define PACKET_LATENCY_STAGES  3
+
+enum class LatencyStage : uint8_t {
+    CREATE_TO_ENQUEUE = 0,  // Assembly and queue insert
+    ENQUEUE_TO_TX = 1,      // Queue wait until LoRaComm() first hands it to the radio
+    ENQUEUE_TO_ACK = 2      // Until the ACK releases it (ACKed types only)
+};
+
+struct LatencyHistogram {
+    uint16_t buckets[PACKET_LATENCY_BUCKETS];  // All halved together when one would overflow
+    uint32_t samples;
+    uint32_t maxMicros;
+};
+
+// FIFO of slot handles for one priority - enqueue order breaks ties
+struct PacketLane {
+    PacketSlot slots[PACKET_QUEUE_DEPTH];
+    uint16_t head;
+    uint16_t count;
 };
 
 // ===========================
@@ -98,29 +362,56 @@ public:
 
     // Main Operations
     bool processIncomingData(uint8_t* data, size_t length);
-    bool createPacket(PacketType type, void* payload, size_t payloadSize);
-    bool sendPacket();
+    void processPayload(PacketType type, const uint8_t* payload, size_t payloadSize);  // Already unframed (e.g. from LoRaComm())
+    bool createPacket(PacketType type, void* payload, size_t payloadSize, uint32_t sampledAt = 0);
+    bool sendPacket();          // Hands the next queued packet to LoRaComm()
     bool sendUrgentPacket(PacketType type, void* payload, size_t payloadSize);
+    size_t drainToRadio(size_t budget = PACKET_DRAIN_BUDGET);
+    bool isBackpressured() const;
 
     // Packet Creation Methods
     bool createHeartbeatPacket();
-    bool createTelemetryPacket(const TelemetryData& data);
-    bool createGPSPacket(const GPSData& data);
+    bool createTelemetryPacket(const TelemetryData& data, uint32_t sampledAt = 0);
+    bool createGPSPacket(const GPSData& data, uint32_t sampledAt = 0);
     bool createCameraPacket(const CameraData& data);
     bool createAlertPacket(const AlertData& data);
     bool createStatusPacket(const char* status);
     bool createDebugPacket(const char* message);
+    bool createCommandPacket(CommandId command, const uint8_t* params, size_t paramLength);
+    bool createCommandBatchPacket(const CommandBatch& batch);
+    bool createPreviewPackets(uint16_t imageId, const PreviewFrame& preview);  // CAMERA_PREVIEW bands, top down
+    bool createProfilePacket(const ProfileLevel& level);
+    bool createTrackPacket(const uint8_t* segment, size_t length);
+    bool createDigestPacket(const DigestData& data);
 
     // Data Extraction
     bool extractTelemetry(TelemetryData& data);
     bool extractGPS(GPSData& data);
     bool extractCamera(CameraData& data);
     bool extractAlert(AlertData& data);
-    bool extractCommand(uint8_t& commandId, uint8_t* params, size_t& paramLength);
+    bool extractStatus(char* text, size_t capacity);   // NUL-terminated, inflated if it was compressed
+    bool extractDebug(char* text, size_t capacity);
+    bool extractCommand(uint8_t& commandId, uint8_t* params, size_t& paramLength);  // paramLength: capacity in, bytes out
+    bool extractCommandBatch(uint8_t* batch, size_t& length);                       // The whole payload; length as above
+
+    // Rate Limiting - sendPacket() holds a type back once its bucket is empty;
+    // packetsPerSecond 0 removes the limit
+    void setRateLimit(PacketType type, float packetsPerSecond, uint8_t burst);
+    uint32_t getThrottled(PacketType type) const { return rateBuckets[rateBucketFor(static_cast<uint8_t>(type))].throttled; }
+    uint32_t getCoalesced(PacketType type) const { return rateBuckets[rateBucketFor(static_cast<uint8_t>(type))].coalesced; }
+
+    // Latency - percentiles are the upper edge of the bucket they fall in, 0 with no samples
+    const LatencyHistogram& getLatency(PacketType type, LatencyStage stage) const {
+        return latency[rateBucketFor(static_cast<uint8_t>(type))][static_cast<uint8_t>(stage)];
+    }
+    uint32_t getLatencyPercentile(PacketType type, LatencyStage stage, uint8_t percent) const;
+    bool createLatencyStatusPacket();   // "Lat" STATUS text: queue and ACK p50/p99 per type
 
     // Buffer Management
     bool addToBuffer(uint8_t* data, size_t length, PacketPriority priority = PacketPriority::PRIORITY_NORMAL);
-    bool getBufferedPacket(uint8_t*& packetData, size_t& packetSize);
+    bool getBufferedPacket(PacketSlot& slot, size_t& packetSize);  // Caller releases the slot
+    const uint8_t* getSlotData(PacketSlot slot) const;
+    void releaseSlot(PacketSlot slot);
     void clearBuffer();
     size_t getBufferUsage() const;
     size_t getBufferCapacity() const;
@@ -131,6 +422,15 @@ public:
     uint32_t getPacketsReceived() const { return packetsReceived; }
     uint32_t getPacketsDropped() const { return packetsDropped; }
     uint32_t getCRCErrors() const { return crcErrors; }
+    uint32_t getResyncBytes() const { return resyncBytes; }
+    uint32_t getRadioHandoffs() const { return radioHandoffs; }
+    uint32_t getBackpressureRejects() const { return backpressureRejects; }
+    uint32_t getTextBytesRaw() const { return textBytesRaw; }
+    uint32_t getTextBytesSent() const { return textBytesSent; }
+    uint8_t getSlotsInRadio() const { return slotsInRadio; }
+    const TelemetryEncoder& getTelemetryEncoder() const { return telemetryEncoder; }
+    const TelemetryDecoder& getTelemetryDecoder() const { return telemetryDecoder; }
+    const TelemetryData& getSentTelemetry() const { return sentTelemetry; }   // Last frame queued by createTelemetryPacket()
     float getPacketLossRate() const;
     uint32_t getLastPacketTime() const { return lastPacketTime; }
 
@@ -142,6 +442,11 @@ public:
     void enableAck(bool enable) { ackEnabled = enable; }
     void setRetryCount(uint8_t retries) { maxRetries = retries; }
 
+    // Freshness policy LoRaComm() consults before each retry: none past the
+    // retry count, and none for a GPS fix or telemetry delta whose sample is
+    // older than PACKET_FRESH_GPS_MS / PACKET_FRESH_TELEMETRY_MS
+    bool shouldRetransmit(PacketType type, const uint8_t* payload, uint8_t attempts, uint32_t ageMs) const;
+
     // Validation and Diagnostics
     bool validatePacket(const uint8_t* packet, size_t length);
     bool isBufferFull() const;
@@ -156,25 +461,79 @@ public:
 private:
     // Internal State
     uint8_t currentSequenceNumber;
-    uint8_t receiveBuffer[512];
-    size_t receiveIndex;
-    bool inPacket;
-    PacketHeader currentHeader;
-    size_t expectedPayloadSize;
+    uint8_t receiveBuffer[PACKET_RECEIVE_BUFFER];
+    size_t receiveIndex;        // Bytes held of a frame split across calls
+    size_t expectedFrameSize;   // 0 until the held header has passed its CRC8
+    uint32_t receiveStartTime;
     uint32_t lastPacketTime;
 
-    // Buffer Management
-    PacketBuffer packetQueue[16];
+    enum : uint8_t {
+        PENDING_TELEMETRY = 0x01,
+        PENDING_GPS = 0x02,
+        PENDING_CAMERA = 0x04,
+        PENDING_ALERT = 0x08,
+        PENDING_STATUS = 0x10,
+        PENDING_DEBUG = 0x20,
+        PENDING_COMMAND = 0x40,
+        PENDING_COMMAND_BATCH = 0x80
+    };
+
+    // Telemetry codec - deltas are only meaningful in sequence, so both ends keep state
+    TelemetryEncoder telemetryEncoder;
+    TelemetryDecoder telemetryDecoder;
+    TelemetryData sentTelemetry;
+
+    // Last decoded payload of each schema type, handed out once by extractX()
+    TelemetryData lastTelemetry;
+    GPSData lastGPS;
+    CameraData lastCamera;
+    AlertData lastAlert;
+    char lastStatus[PACKET_TEXT_MAX + 1];
+    char lastDebug[PACKET_TEXT_MAX + 1];
+    uint8_t lastCommand[1 + PACKET_COMMAND_MAX_PARAMS];
+    size_t lastCommandLength;
+    uint8_t lastBatch[PACKET_COMMAND_BATCH_BYTES];
+    size_t lastBatchLength;
+    uint8_t pendingPayloads;    // PENDING_* bits
+
+    // Buffer Management - O(1) push, pop and drop-lowest
+    PacketLane lanes[PACKET_PRIORITY_LANES];
+    uint8_t laneMask;           // Bit per non-empty lane
     size_t queueSize;
-    size_t queueHead;
-    size_t queueTail;
     size_t maxPacketSize;
 
+    // Slab pool backing the queue - fixed slots, no per-packet heap traffic
+    uint8_t slab[PACKET_SLAB_SLOTS][MAX_PACKET_SIZE];
+    PacketBuffer slotInfo[PACKET_SLAB_SLOTS];
+    PacketSlot slabFreeList[PACKET_SLAB_SLOTS];
+    uint8_t slabFreeCount;
+    uint8_t slabHighWater;      // Peak slots in use since reset
+    uint32_t slabExhausted;     // Allocations refused for lack of a slot
+
+    // Radio handoff - frames go to LoRaComm() by slot and come back on release
+    uint8_t slotsInRadio;
+    bool radioBackpressure;     // Last drain stopped on a full radio lane or slot cap
+    uint32_t radioHandoffs;
+    uint32_t radioStalls;       // Drains stopped by radioBackpressure
+    uint32_t backpressureRejects;
+
+    // Rate limiting
+    RateBucket rateBuckets[PACKET_RATE_BUCKETS];
+    uint32_t lastRateRefill;
+
+    // Latency histograms
+    LatencyHistogram latency[PACKET_RATE_BUCKETS][PACKET_LATENCY_STAGES];
+
+    // Text compression - status/debug bytes before and after text_codec
+    uint32_t textBytesRaw;
+    uint32_t textBytesSent;
+
     // Statistics
     uint32_t packetsSent;
     uint32_t packetsReceived;
     uint32_t packetsDropped;
     uint32_t crcErrors;
+    uint32_t resyncBytes;       // Bytes skipped looking for a valid frame
     uint32_t lastStatisticsReset;
 
     // Configuration
@@ -189,15 +548,35 @@ private:
 
     // Packet Assembly
     bool assemblePacket(PacketType type, const uint8_t* payload, size_t payloadSize, 
-                     uint8_t*& packetData, size_t& packetSize);
+                     PacketSlot& slot, size_t& packetSize);
     bool disassemblePacket(const uint8_t* packet, size_t length, 
-                        PacketType& type, uint8_t*& payload, size_t& payloadSize);
+                        PacketType& type, const uint8_t*& payload, size_t& payloadSize);
+
+    // Slab Pool
+    PacketSlot allocSlot();
+    void resetSlab();
+
+    // Radio Handoff
+    bool handOff(PacketSlot slot, size_t packetSize, Priority priority);
+    static Priority radioPriorityFor(PacketType type);
+    static void onRadioPayloadReleased(void* context, int16_t handle);
+    static void onRadioPayloadEvent(void* context, int16_t handle, PayloadEvent event);
+    static bool onRadioSupersede(void* context, const Packet& newer, const Packet& older);
+    static bool onRadioRetransmit(void* context, const Packet& packet, uint8_t attempts, uint32_t ageMs);
 
     // Buffer Operations
-    bool enqueuePacket(const uint8_t* packetData, size_t packetSize, PacketPriority priority);
-    bool dequeuePacket(uint8_t*& packetData, size_t& packetSize);
-    void sortQueueByPriority();
-    size_t findOldestLowPriorityPacket() const;
+    bool enqueuePacket(PacketSlot slot, size_t packetSize, PacketPriority priority);
+    bool dequeuePacket(PacketSlot& slot, size_t& packetSize);
+    void pushLane(int lane, PacketSlot slot);
+    PacketSlot removeFromLane(int lane, uint16_t position);
+    bool coalescePacket(int lane, PacketSlot slot, size_t packetSize);
+    void refillRateBuckets();
+    static uint8_t rateBucketFor(uint8_t type);
+    static bool isCoalescable(uint8_t type);
+    static bool isLatestValue(uint8_t type);
+    static bool supersedes(uint8_t type, const uint8_t* newerPayload, const uint8_t* olderPayload);
+    PacketSlot popLane(int lane);
+    int lowestDroppableLane() const;
 
     // Data Conversion
     void floatToBytes(float value, uint8_t* bytes);
@@ -209,11 +588,18 @@ private:
 
     // Internal Helpers
     void resetReceiveState();
-    bool processReceivedByte(uint8_t byte);
+    size_t parseSpan(const uint8_t* data, size_t length);
+    void holdPartial(const uint8_t* data, size_t length, size_t frameSize);
+    size_t rescanHeld();
+    bool decodeHeader(const uint8_t* frame, PacketHeader& header);
     bool validateHeader(const PacketHeader& header);
-    bool processCompletePacket();
+    bool processCompletePacket(const uint8_t* frame, size_t length);
+    bool createTextPacket(PacketType type, const char* text, size_t maxLength);
+    bool storeText(char* text, const uint8_t* payload, size_t payloadSize, bool compressed);
+    bool extractText(char* text, size_t capacity, const char* source, uint8_t pendingBit);
     void updateStatistics(PacketType type, bool sent = true);
-    bool shouldRetransmit(PacketType type, uint8_t attempts);
+    void recordLatency(uint8_t type, LatencyStage stage, uint32_t micros);
+    static uint32_t histogramPercentile(const LatencyHistogram& histogram, uint8_t percent);
 
     // Debug and Logging
     void logPacket(const uint8_t* packet, size_t length, bool outgoing = true) const;
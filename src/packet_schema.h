@@ -0,0 +1,225 @@
+#ifndef PACKET_SCHEMA_H
+#define PACKET_SCHEMA_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// ===========================
+// Packet Schemas
+// Payload layouts described as a list of field descriptors; the encoder and
+// decoder for each struct are generated from the same list at compile time
+// ===========================
+
+// Every offset is a compile-time constant and every per-field loop runs over
+// a constant byte count, so the generated code unrolls to straight-line
+// loads and stores. Kept to C++11 (no fold expressions or if constexpr).
+
+namespace schema {
+
+// ===========================
+// Wire Primitives
+// ===========================
+
+// Big-endian integer of Bytes bytes
+template <size_t Bytes, bool Signed>
+struct BigEndian {
+    static_assert(Bytes >= 1 && Bytes <= 4, "1 to 4 byte integers");
+
+    static constexpr int32_t minValue() {
+        return !Signed ? 0 : (Bytes == 4 ? INT32_MIN : -static_cast<int32_t>(1UL << (Bytes * 8 - 1)));
+    }
+    static constexpr int32_t maxValue() {
+        return Signed ? static_cast<int32_t>((1UL << (Bytes * 8 - 1)) - 1)
+                      : (Bytes == 4 ? INT32_MAX : static_cast<int32_t>((1UL << (Bytes * 8)) - 1));
+    }
+
+    static inline void put(uint8_t* out, uint32_t value) {
+        for (size_t i = 0; i < Bytes; i++) {
+            out[i] = static_cast<uint8_t>(value >> ((Bytes - 1 - i) * 8));
+        }
+    }
+
+    static inline int32_t get(const uint8_t* in) {
+        uint32_t value = 0;
+        for (size_t i = 0; i < Bytes; i++) {
+            value = (value << 8) | in[i];
+        }
+        // Sign-extend by shifting the top wire bit into bit 31 and back
+        return (Signed && Bytes < 4)
+            ? static_cast<int32_t>(value << (32 - Bytes * 8)) >> (32 - Bytes * 8)
+            : static_cast<int32_t>(value);
+    }
+};
+
+// ===========================
+// Field Encodings
+// ===========================
+
+// Integer or enum member sent as-is
+template <typename M, size_t Bytes = sizeof(M)>
+struct Integer {
+    typedef BigEndian<Bytes, std::is_signed<M>::value> Wire;
+    static constexpr size_t size = Bytes;
+    static constexpr int32_t minFixed = Wire::minValue();
+    static constexpr int32_t maxFixed = Wire::maxValue();
+
+    static inline int32_t toFixed(M value) { return static_cast<int32_t>(value); }
+    static inline M fromFixed(int32_t value) { return static_cast<M>(value); }
+    static inline void write(uint8_t* out, M value) { Wire::put(out, static_cast<uint32_t>(value)); }
+    static inline void read(const uint8_t* in, M& value) { value = fromFixed(Wire::get(in)); }
+};
+
+// Integer member sent in units of Divisor (e.g. ms uptime as 100 ms ticks)
+template <typename M, size_t Bytes, uint32_t Divisor>
+struct Coarse {
+    typedef BigEndian<Bytes, false> Wire;
+    static constexpr size_t size = Bytes;
+    static constexpr int32_t minFixed = Wire::minValue();
+    static constexpr int32_t maxFixed = Wire::maxValue();
+
+    static inline int32_t toFixed(M value) {
+        uint32_t ticks = static_cast<uint32_t>(value) / Divisor;
+        return ticks > static_cast<uint32_t>(maxFixed) ? maxFixed : static_cast<int32_t>(ticks);
+    }
+    static inline M fromFixed(int32_t value) { return static_cast<M>(static_cast<uint32_t>(value) * Divisor); }
+    static inline void write(uint8_t* out, M value) { Wire::put(out, static_cast<uint32_t>(toFixed(value))); }
+    static inline void read(const uint8_t* in, M& value) { value = fromFixed(Wire::get(in)); }
+};
+
+// Float member sent as fixed point: wire = round(value * Scale), saturated
+template <size_t Bytes, bool Signed, int32_t Scale>
+struct Scaled {
+    typedef BigEndian<Bytes, Signed> Wire;
+    static constexpr size_t size = Bytes;
+    static constexpr int32_t minFixed = Wire::minValue();
+    static constexpr int32_t maxFixed = Wire::maxValue();
+
+    static inline int32_t toFixed(float value) {
+        float scaled = value * Scale;
+        // NaN saturates low
+        if (!(scaled >= static_cast<float>(minFixed))) return minFixed;
+        if (scaled >= static_cast<float>(maxFixed)) return maxFixed;
+        return static_cast<int32_t>(lroundf(scaled));
+    }
+    static inline float fromFixed(int32_t value) { return static_cast<float>(value) / Scale; }
+    static inline void write(uint8_t* out, float value) { Wire::put(out, static_cast<uint32_t>(toFixed(value))); }
+    static inline void read(const uint8_t* in, float& value) { value = fromFixed(Wire::get(in)); }
+};
+
+// Float member sent as IEEE 754, little endian (the layout floatToBytes produced on the ESP32)
+struct Float32 {
+    static constexpr size_t size = 4;
+
+    static inline void write(uint8_t* out, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        out[0] = static_cast<uint8_t>(bits);
+        out[1] = static_cast<uint8_t>(bits >> 8);
+        out[2] = static_cast<uint8_t>(bits >> 16);
+        out[3] = static_cast<uint8_t>(bits >> 24);
+    }
+    static inline void read(const uint8_t* in, float& value) {
+        uint32_t bits = static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+                        (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+        memcpy(&value, &bits, sizeof(value));
+    }
+};
+
+// Fixed-size char array; always NUL-terminated after decoding
+template <size_t N>
+struct Text {
+    static constexpr size_t size = N;
+
+    static inline void write(uint8_t* out, const char (&value)[N]) { memcpy(out, value, N); }
+    static inline void read(const uint8_t* in, char (&value)[N]) {
+        memcpy(value, in, N);
+        value[N - 1] = '\0';
+    }
+};
+
+// ===========================
+// Field Descriptor
+// ===========================
+
+template <typename S, typename M, M S::*Member, typename Encoding>
+struct Field {
+    static constexpr size_t size = Encoding::size;
+
+    static inline void encode(const S& s, uint8_t* out) { Encoding::write(out, s.*Member); }
+    static inline void decode(const uint8_t* in, S& s) { Encoding::read(in, s.*Member); }
+
+    // Fixed-point view, for encodings that have one (used by delta codecs)
+    static inline int32_t toFixed(const S& s) { return Encoding::toFixed(s.*Member); }
+    static inline void fromFixed(int32_t value, S& s) { s.*Member = Encoding::fromFixed(value); }
+    static inline bool inRange(int32_t value) {
+        return value >= Encoding::minFixed && value <= Encoding::maxFixed;
+    }
+    static inline void writeFixed(int32_t value, uint8_t* out) { Encoding::Wire::put(out, static_cast<uint32_t>(value)); }
+    static inline int32_t readFixed(const uint8_t* in) { return Encoding::Wire::get(in); }
+};
+
+// ===========================
+// Schema
+// ===========================
+
+template <typename S, typename... Fields>
+struct Schema;
+
+template <typename S>
+struct Schema<S> {
+    static constexpr size_t size = 0;
+    static constexpr size_t fields = 0;
+
+    static inline void encode(const S&, uint8_t*) {}
+    static inline void decode(const uint8_t*, S&) {}
+    static inline void toFixed(const S&, int32_t*) {}
+    static inline void fromFixed(const int32_t*, S&) {}
+    static inline bool inRange(const int32_t*) { return true; }
+    static inline void writeFixed(const int32_t*, uint8_t*) {}
+    static inline void readFixed(const uint8_t*, int32_t*) {}
+};
+
+template <typename S, typename F, typename... Rest>
+struct Schema<S, F, Rest...> {
+    typedef Schema<S, Rest...> Tail;
+    static constexpr size_t size = F::size + Tail::size;
+    static constexpr size_t fields = 1 + Tail::fields;
+
+    static inline void encode(const S& s, uint8_t* out) {
+        F::encode(s, out);
+        Tail::encode(s, out + F::size);
+    }
+    static inline void decode(const uint8_t* in, S& s) {
+        F::decode(in, s);
+        Tail::decode(in + F::size, s);
+    }
+    static inline void toFixed(const S& s, int32_t* values) {
+        values[0] = F::toFixed(s);
+        Tail::toFixed(s, values + 1);
+    }
+    static inline void fromFixed(const int32_t* values, S& s) {
+        F::fromFixed(values[0], s);
+        Tail::fromFixed(values + 1, s);
+    }
+    static inline bool inRange(const int32_t* values) {
+        return F::inRange(values[0]) & Tail::inRange(values + 1);
+    }
+    static inline void writeFixed(const int32_t* values, uint8_t* out) {
+        F::writeFixed(values[0], out);
+        Tail::writeFixed(values + 1, out + F::size);
+    }
+    static inline void readFixed(const uint8_t* in, int32_t* values) {
+        values[0] = F::readFixed(in);
+        Tail::readFixed(in + F::size, values + 1);
+    }
+};
+
+} // namespace schema
+
+// Descriptor for Struct::member with the given encoding
+#define SCHEMA_FIELD(Struct, member, ...) \
+    schema::Field<Struct, decltype(Struct::member), &Struct::member, __VA_ARGS__>
+
+#endif // PACKET_SCHEMA_H
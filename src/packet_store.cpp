@@ -0,0 +1,199 @@
+#include "packet_store.h"
+#include "memory_ledger.h"
+
+static PacketStore packetStoreInstance;
+
+PacketStore& Packets() {
+    return packetStoreInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+PacketStore::PacketStore() {
+    entries = nullptr;
+    capacity = 0;
+    next = 0;
+    portMUX_INITIALIZE(&lock);
+
+    for (uint8_t i = 0; i < RX_MAX_DEVICES; i++) {
+        decoders[i].active = false;
+        decoders[i].deviceId = 0;
+    }
+    nextDecoder = 0;
+
+    stored = 0;
+    decodeFailures = 0;
+}
+
+PacketStore::~PacketStore() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool PacketStore::begin() {
+    if (entries) {
+        return true;
+    }
+
+    // ~34 KB at 100 packets - memAlloc() puts it in PSRAM
+    entries = (StoredPacket*)memCalloc(MemTag::RECEIVE, MAX_STORED_PACKETS, sizeof(StoredPacket));
+    if (!entries) {
+        Serial.println("Packet store: No memory for the ring");
+        return false;
+    }
+    capacity = MAX_STORED_PACKETS;
+
+    if (!RxPipeline().addSink(onRecordBatch)) {
+        memFree(MemTag::RECEIVE, entries);
+        entries = nullptr;
+        capacity = 0;
+        return false;
+    }
+    return true;
+}
+
+// After RxPipeline().end() - the sink can't be taken back off
+void PacketStore::end() {
+    portENTER_CRITICAL(&lock);
+    StoredPacket* ring = entries;
+    entries = nullptr;
+    capacity = 0;
+    portEXIT_CRITICAL(&lock);
+
+    memFree(MemTag::RECEIVE, ring);
+}
+
+// ===========================
+// Writing (RX task)
+// ===========================
+
+void PacketStore::onRecordBatch(const ReceivedRecord* const* records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Packets().store(*records[i]);
+    }
+}
+
+void PacketStore::store(const ReceivedRecord& record) {
+    if (!entries) {
+        return;
+    }
+
+    // Decoded on the stack, so the lock only covers the copy in
+    StoredPacket packet;
+    packet.deviceId = record.deviceId;
+    packet.type = record.type;
+    packet.sequenceNumber = record.sequenceNumber;
+    packet.timestamp = record.timestamp;
+    packet.receivedAt = record.receivedAt;
+    packet.rssi = record.rssi;
+    packet.snr = record.snr;
+    packet.late = record.late;
+    packet.decoded = decode(record, packet);
+    packet.length = min((size_t)record.length, sizeof(packet.payload));
+    memcpy(packet.payload, record.payload, packet.length);
+
+    portENTER_CRITICAL(&lock);
+    packet.index = next;
+    memcpy(&entries[next % capacity], &packet, sizeof(packet));
+    next = next + 1;
+    portEXIT_CRITICAL(&lock);
+    stored++;
+}
+
+bool PacketStore::decode(const ReceivedRecord& record, StoredPacket& packet) {
+    bool decoded = false;
+    bool expected = true;
+
+    switch (record.type) {
+        case PacketType::TELEMETRY:
+            decoded = decoderFor(record.deviceId).decode(record.payload, record.length, packet.data.telemetry);
+            break;
+
+        case PacketType::GPS_DATA:
+            if ((decoded = record.length == GPSSchema::size)) {
+                GPSSchema::decode(record.payload, packet.data.gps);
+            }
+            break;
+
+        case PacketType::CAMERA_DATA:
+            if ((decoded = record.length == CameraSchema::size)) {
+                CameraSchema::decode(record.payload, packet.data.camera);
+            }
+            break;
+
+        case PacketType::ALERT:
+            if ((decoded = record.length == AlertSchema::size)) {
+                AlertSchema::decode(record.payload, packet.data.alert);
+            }
+            break;
+
+        default:
+            expected = false;       // Kept as received
+            break;
+    }
+
+    if (expected && !decoded) {
+        decodeFailures++;
+    }
+    return decoded;
+}
+
+TelemetryDecoder& PacketStore::decoderFor(uint8_t deviceId) {
+    for (uint8_t i = 0; i < RX_MAX_DEVICES; i++) {
+        if (decoders[i].active && decoders[i].deviceId == deviceId) {
+            return decoders[i].telemetry;
+        }
+    }
+
+    // A new balloon starts from its next keyframe
+    DeviceDecoder& decoder = decoders[nextDecoder];
+    nextDecoder = (nextDecoder + 1) % RX_MAX_DEVICES;
+    decoder.active = true;
+    decoder.deviceId = deviceId;
+    decoder.telemetry.reset();
+    return decoder.telemetry;
+}
+
+// ===========================
+// Reading (any task)
+// ===========================
+
+uint32_t PacketStore::getOldest() const {
+    uint32_t head = next;
+    return head > capacity ? head - capacity : 0;
+}
+
+bool PacketStore::get(uint32_t index, StoredPacket& packet) const {
+    bool found = false;
+
+    portENTER_CRITICAL(&lock);
+    if (entries && index < next && next - index <= capacity) {
+        memcpy(&packet, &entries[index % capacity], sizeof(packet));
+        found = true;
+    }
+    portEXIT_CRITICAL(&lock);
+    return found;
+}
+
+// Newest first, an entry per lock
+bool PacketStore::getLatest(PacketType type, StoredPacket& packet) const {
+    uint32_t oldest = getOldest();
+    for (uint32_t index = next; index > oldest; index--) {
+        if (get(index - 1, packet) && packet.type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PacketStore::printStatus() const {
+    Serial.println("=== Packet Store ===");
+    Serial.printf("Held: %lu of %lu (index %lu-%lu)\n", (unsigned long)(next - getOldest()),
+                  (unsigned long)capacity, (unsigned long)getOldest(), (unsigned long)next);
+    Serial.printf("Stored: %lu, decode failures %lu\n", (unsigned long)stored, (unsigned long)decodeFailures);
+}
@@ -0,0 +1,108 @@
+#ifndef PACKET_STORE_H
+#define PACKET_STORE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "packet_handler.h"
+#include "rx_pipeline.h"
+
+// ===========================
+// Packet Store (base station)
+// The last MAX_STORED_PACKETS packets the receive pipeline delivered,
+// decoded, in a PSRAM ring the web server reads from
+// ===========================
+
+// A ReceivePipeline sink: records arrive on the RX task in sequence order
+// per device, so telemetry deltas are decoded against their own balloon's
+// keyframe there and then. Telemetry, GPS, camera and alert payloads are
+// stored decoded; everything keeps the payload as received as well.
+//
+// Every packet gets the next store index, which never repeats, so a client
+// polls with the index after the last one it saw and gets only what's new.
+// Writer and readers meet under a spinlock held for one entry's copy - a
+// web handler walking the ring never holds up the RX task by more than that.
+
+// Base station settings come from base_station_config.h when it is included
+// first; this fallback keeps the module building in the balloon tree
+#ifndef MAX_STORED_PACKETS
+#define MAX_STORED_PACKETS         100
+#endif
+
+struct StoredPacket {
+    uint32_t index;             // Store index, counting from boot
+    uint8_t deviceId;
+    PacketType type;
+    uint16_t sequenceNumber;
+    uint32_t timestamp;         // Sender clock, seconds
+    uint32_t receivedAt;        // millis() on arrival
+    int8_t rssi;
+    int8_t snr;
+    bool late;                  // Delivered after its gap was given up on
+    bool decoded;               // data holds the payload's struct
+    union {
+        TelemetryData telemetry;
+        GPSData gps;
+        CameraData camera;
+        AlertData alert;
+    } data;
+    uint8_t length;
+    uint8_t payload[MAX_PACKET_SIZE];
+};
+
+class PacketStore {
+public:
+    PacketStore();
+    ~PacketStore();
+
+    // Allocates the ring and registers the sink - before RxPipeline().begin()
+    bool begin();
+    void end();
+    bool isReady() const { return entries != nullptr; }
+
+    // Any task; false once the entry has been overwritten or not arrived yet
+    bool get(uint32_t index, StoredPacket& packet) const;
+    bool getLatest(PacketType type, StoredPacket& packet) const;
+
+    // [getOldest(), getNext()) are held
+    uint32_t getOldest() const;
+    uint32_t getNext() const { return next; }
+    uint32_t getCapacity() const { return capacity; }
+
+    // Statistics
+    uint32_t getStored() const { return stored; }
+    uint32_t getDecodeFailures() const { return decodeFailures; }
+    void printStatus() const;
+
+private:
+    StoredPacket* entries;
+    uint32_t capacity;
+    volatile uint32_t next;     // Index the next packet gets
+    mutable portMUX_TYPE lock;
+
+    // One telemetry decoder per balloon - RX task only
+    struct DeviceDecoder {
+        bool active;
+        uint8_t deviceId;
+        TelemetryDecoder telemetry;
+    };
+    DeviceDecoder decoders[RX_MAX_DEVICES];
+    uint8_t nextDecoder;        // Replaced round robin past RX_MAX_DEVICES
+
+    uint32_t stored;
+    uint32_t decodeFailures;
+
+    TelemetryDecoder& decoderFor(uint8_t deviceId);
+    void store(const ReceivedRecord& record);
+    bool decode(const ReceivedRecord& record, StoredPacket& packet);
+
+    static void onRecordBatch(const ReceivedRecord* const* records, size_t count);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern PacketStore& Packets();
+
+#endif // PACKET_STORE_H
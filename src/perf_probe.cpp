@@ -0,0 +1,284 @@
+#include "perf_probe.h"
+#include <cstdarg>
+#include "debug_utils.h"
+#include "stage_profiler.h"
+#include "trace_buffer.h"
+#include "fragment_transfer.h"
+#include "text_codec.h"
+#include "memory_ledger.h"
+
+static_assert(TRACE_MAX_TASKS <= 32, "reportTrace() keeps the tasks it named in a 32-bit mask");
+
+static PerfProbe perfProbeInstance;
+
+PerfProbe& Probe() {
+    return perfProbeInstance;
+}
+
+PerfProbe::PerfProbe() {
+    report = nullptr;
+    packed = nullptr;
+    reportLength = 0;
+    reportTruncated = false;
+    pendingLength = 0;
+    pendingCompressed = false;
+
+    tracing = false;
+    traceWasEnabled = false;
+    traceStarted = 0;
+    traceDurationMs = 0;
+    traceMaxEvents = 0;
+
+    reportsSent = 0;
+    commandsRefused = 0;
+}
+
+// ===========================
+// Commands
+// ===========================
+
+bool PerfProbe::handleCommand(CommandId id, const uint8_t* params, size_t length) {
+    switch (id) {
+        case CommandId::PROBE_PROFILE:
+        case CommandId::PROBE_SLOW_SCOPES:
+        case CommandId::PROBE_LOG_LEVEL:
+        case CommandId::PROBE_TRACE:
+            break;
+        default:
+            return false;
+    }
+    if (isBusy() || !reserve()) {
+        commandsRefused++;
+        return false;
+    }
+
+    switch (id) {
+        case CommandId::PROBE_PROFILE:
+            reportProfile();
+            break;
+
+        case CommandId::PROBE_SLOW_SCOPES:
+            reportSlowScopes(length >= 1 && params[0] ? params[0] : PROBE_DEFAULT_TOP);
+            break;
+
+        case CommandId::PROBE_LOG_LEVEL: {
+            if (length < 1 || params[0] > static_cast<uint8_t>(DebugLevel::VERBOSE)) {
+                commandsRefused++;
+                return false;
+            }
+            DebugLevel level = static_cast<DebugLevel>(params[0]);
+            Debug.setDebugLevel(level);
+            startReport("log_level");
+            appendLine("level %s\n", Debug.levelToString(level));
+            if (length >= 3) {
+                DebugCategory category = static_cast<DebugCategory>(params[1]);
+                Debug.setCategoryEnabled(category, params[2] != 0);
+                appendLine("category %s %s\n", Debug.categoryToString(category), params[2] ? "on" : "off");
+            }
+            finishReport();
+            break;
+        }
+
+        case CommandId::PROBE_TRACE: {
+            uint32_t duration = length >= 2 ? ((uint32_t)params[0] << 8) | params[1] : PROBE_TRACE_MAX_MS;
+            uint32_t events = length >= 4 ? ((uint32_t)params[2] << 8) | params[3] : PROBE_TRACE_MAX_EVENTS;
+            if (Trace().getCapacity() == 0) {
+                commandsRefused++;
+                return false;
+            }
+            traceDurationMs = constrain(duration, 1u, (uint32_t)PROBE_TRACE_MAX_MS);
+            traceMaxEvents = constrain(events, 1u, (uint32_t)PROBE_TRACE_MAX_EVENTS);
+            traceWasEnabled = Trace().isEnabled();
+            Trace().clear();
+            Trace().setEnabled(true);
+            traceStarted = millis();
+            tracing = true;
+            break;
+        }
+
+        default:
+            break;
+    }
+    return true;
+}
+
+void PerfProbe::update() {
+    if (tracing && (millis() - traceStarted >= traceDurationMs || Trace().getEventCount() >= traceMaxEvents)) {
+        Trace().setEnabled(false);
+        reportTrace();
+        tracing = false;
+
+        // The continuous ring starts over from here
+        Trace().clear();
+        Trace().setEnabled(traceWasEnabled);
+    }
+
+    if (pendingLength > 0) {
+        uint8_t type = static_cast<uint8_t>(PacketType::DEBUG) | (pendingCompressed ? PACKET_TYPE_COMPRESSED : 0);
+        if (FragmentMgr().sendPayload(static_cast<PacketType>(type), packed, pendingLength)) {
+            pendingLength = 0;
+            reportsSent++;
+        }
+    }
+}
+
+// ===========================
+// Reports
+// ===========================
+
+// Both buffers live from the first probe on
+bool PerfProbe::reserve() {
+    if (!report) {
+        report = static_cast<char*>(memAlloc(MemTag::LOGGING, PROBE_REPORT_BYTES));
+    }
+    if (!packed) {
+        packed = static_cast<uint8_t*>(memAlloc(MemTag::LOGGING, PROBE_REPORT_BYTES));
+    }
+    return report && packed;
+}
+
+void PerfProbe::startReport(const char* probe) {
+    reportLength = 0;
+    reportTruncated = false;
+    appendLine("probe %s t=%lu\n", probe, (unsigned long)millis());
+}
+
+// A whole line or nothing; the first one that doesn't fit ends the report
+bool PerfProbe::appendLine(const char* format, ...) {
+    if (reportTruncated) {
+        return false;
+    }
+    // Room kept for the "...\n" that marks a cut
+    size_t space = PROBE_REPORT_BYTES - 4 - reportLength;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(report + reportLength, space, format, args);
+    va_end(args);
+    if (length < 0 || (size_t)length >= space) {
+        memcpy(report + reportLength, "...\n", 4);
+        reportLength += 4;
+        reportTruncated = true;
+        return false;
+    }
+    reportLength += length;
+    return true;
+}
+
+// Compressed when that's smaller, then queued for the sender
+void PerfProbe::finishReport() {
+    size_t compressed = compressText(reinterpret_cast<const uint8_t*>(report), reportLength,
+                                     packed, PROBE_REPORT_BYTES);
+    if (compressed) {
+        pendingLength = compressed;
+        pendingCompressed = true;
+    } else {
+        memcpy(packed, report, reportLength);
+        pendingLength = reportLength;
+        pendingCompressed = false;
+    }
+    SYS_LOG("Probe report: %u bytes, %u to send", (unsigned)reportLength, (unsigned)pendingLength);
+}
+
+// Every stage with samples: totals, then the non-empty log2 buckets of cycles
+void PerfProbe::reportProfile() {
+    startReport("profile");
+    appendLine("cycles_per_us %.0f\n", Profiler().getCyclesPerUs());
+    for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+        Stage stage = static_cast<Stage>(i);
+        const StageHistogram& histogram = Profiler().getHistogram(stage);
+        if (histogram.samples == 0) {
+            continue;
+        }
+        if (!appendLine("%s n=%lu mean=%.0f p99=%.0f max=%.0f", StageProfiler::stageToString(stage),
+                        (unsigned long)histogram.samples, Profiler().getMeanUs(stage),
+                        Profiler().getPercentileUs(stage, 0.99f), Profiler().getMaxUs(stage))) {
+            break;
+        }
+        for (uint8_t b = 0; b < STAGE_PROFILER_BUCKETS; b++) {
+            if (histogram.buckets[b] && !appendLine(" b%u=%lu", b, (unsigned long)histogram.buckets[b])) {
+                break;
+            }
+        }
+        if (!appendLine("\n")) {
+            break;
+        }
+    }
+    finishReport();
+}
+
+// Stages and code timers together, longest worst case first
+void PerfProbe::reportSlowScopes(uint8_t count) {
+    struct Scope {
+        const char* name;
+        float maxUs;
+        float meanUs;
+        uint32_t samples;
+    };
+    Scope scopes[PROBE_MAX_SCOPES];
+    uint8_t scopeCount = 0;
+
+    for (uint8_t i = 0; i < STAGE_COUNT && scopeCount < PROBE_MAX_SCOPES; i++) {
+        Stage stage = static_cast<Stage>(i);
+        if (Profiler().getSamples(stage)) {
+            scopes[scopeCount++] = {StageProfiler::stageToString(stage), Profiler().getMaxUs(stage),
+                                    Profiler().getMeanUs(stage), Profiler().getSamples(stage)};
+        }
+    }
+    for (const CodeTimer* timer = Debug.getCodeTimers(); timer && scopeCount < PROBE_MAX_SCOPES; timer = timer->next) {
+        uint32_t samples = timer->count;
+        if (samples) {
+            scopes[scopeCount++] = {timer->name, (float)timer->maxCycles / PM_MAX_FREQ_MHZ,
+                                    (float)(timer->totalCycles / samples) / PM_MAX_FREQ_MHZ, samples};
+        }
+    }
+
+    // Insertion sort - a few dozen entries
+    for (uint8_t i = 1; i < scopeCount; i++) {
+        Scope scope = scopes[i];
+        uint8_t j = i;
+        while (j > 0 && scopes[j - 1].maxUs < scope.maxUs) {
+            scopes[j] = scopes[j - 1];
+            j--;
+        }
+        scopes[j] = scope;
+    }
+
+    startReport("slow_scopes");
+    for (uint8_t i = 0; i < scopeCount && i < count; i++) {
+        if (!appendLine("%s max=%.1f mean=%.1f n=%lu\n", scopes[i].name, scopes[i].maxUs,
+                        scopes[i].meanUs, (unsigned long)scopes[i].samples)) {
+            break;
+        }
+    }
+    finishReport();
+}
+
+// What the bounded trace caught, read with recording stopped
+void PerfProbe::reportTrace() {
+    uint32_t events = min(Trace().getEventCount(), traceMaxEvents);
+    startReport("trace");
+    appendLine("events %lu ms %lu\n", (unsigned long)events, (unsigned long)(millis() - traceStarted));
+
+    // Only the tasks the events name
+    uint32_t named = 0;
+    for (uint32_t i = 0; i < events; i++) {
+        uint8_t task = Trace().getEvent(i).task;
+        if (task < TRACE_MAX_TASKS && !(named & (1u << task))) {
+            named |= 1u << task;
+            appendLine("task %u %s\n", task, Trace().getTaskName(task));
+        }
+    }
+
+    uint32_t previous = events ? Trace().getEvent(0).timestamp : 0;
+    for (uint32_t i = 0; i < events; i++) {
+        const TraceEvent& event = Trace().getEvent(i);
+        char type = event.type == TraceEventType::BEGIN ? 'B' : event.type == TraceEventType::END ? 'E' : 'S';
+        const char* name = event.type == TraceEventType::SWITCH ? "-" : (event.name ? event.name : "?");
+        if (!appendLine("%lu %c %s %u %u\n", (unsigned long)(event.timestamp - previous), type, name,
+                        event.task, event.core)) {
+            break;
+        }
+        previous = event.timestamp;
+    }
+    finishReport();
+}
@@ -0,0 +1,88 @@
+#ifndef PERF_PROBE_H
+#define PERF_PROBE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "packet_handler.h"
+
+// ===========================
+// Performance Probe
+// Ground commands that report the stage profiler, the slowest scopes and a
+// bounded trace, or change the log level, during flight
+// ===========================
+
+// Commands (COMMAND payload [0], parameters from [1]):
+//   PROBE_PROFILE      -                       every stage's log2 histogram
+//   PROBE_SLOW_SCOPES  [0] N                   the N stages and code timers with the longest max (0 = PROBE_DEFAULT_TOP)
+//   PROBE_LOG_LEVEL    [0] DebugLevel          the level from now on; with
+//                      [1] DebugCategory, [2] 0/1   that category turned off or on as well
+//   PROBE_TRACE        [0-1] duration ms       trace everything from now, up to PROBE_TRACE_MAX_MS (big endian)
+//                      [2-3] events            stopping early at this many, up to PROBE_TRACE_MAX_EVENTS
+//
+// Each command is answered with one text report as a fragment transfer of
+// content type DEBUG, compressed with the text codec and PACKET_TYPE_COMPRESSED
+// set when that comes out smaller. The first line names the probe and the
+// uptime; trace events are one line each, "dt type name task core", dt the
+// microseconds since the previous event and task an index into the "task"
+// lines before them. Reports stop at PROBE_REPORT_BYTES with a "..." line.
+//
+// A report waits for any transfer in progress (an image) and goes after
+// it; a command that arrives while one is waiting or a trace is running is
+// refused. Everything runs on the uplink task.
+
+#define PROBE_REPORT_BYTES       4096    // Text before compression; ~40 s of airtime at SF9 compressed
+#define PROBE_DEFAULT_TOP        8
+#define PROBE_MAX_SCOPES         48      // Stages and code timers ranked for PROBE_SLOW_SCOPES
+#define PROBE_TRACE_MAX_MS       10000
+#define PROBE_TRACE_MAX_EVENTS   160     // What PROBE_REPORT_BYTES holds at ~24 bytes a line
+
+class PerfProbe {
+public:
+    PerfProbe();
+
+    // From processIncomingCommands(); false for a command that isn't a
+    // probe's, or one refused (busy, bad parameters)
+    bool handleCommand(CommandId id, const uint8_t* params, size_t length);
+
+    // Every uplink iteration: ends a trace that's due, and hands a waiting
+    // report to the fragment sender once it's free
+    void update();
+
+    bool isBusy() const { return tracing || pendingLength > 0; }
+    uint32_t getReportsSent() const { return reportsSent; }
+    uint32_t getCommandsRefused() const { return commandsRefused; }
+
+private:
+    char* report;               // PROBE_REPORT_BYTES, allocated on the first probe
+    uint8_t* packed;
+    size_t reportLength;
+    bool reportTruncated;
+    size_t pendingLength;       // Bytes of packed waiting for the sender, 0 = none
+    bool pendingCompressed;
+
+    // Bounded trace
+    bool tracing;
+    bool traceWasEnabled;       // Continuous tracing, put back afterwards
+    uint32_t traceStarted;
+    uint32_t traceDurationMs;
+    uint32_t traceMaxEvents;
+
+    uint32_t reportsSent;
+    uint32_t commandsRefused;
+
+    bool reserve();
+    void startReport(const char* probe);
+    bool appendLine(const char* format, ...);
+    void finishReport();
+    void reportProfile();
+    void reportSlowScopes(uint8_t count);
+    void reportTrace();
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern PerfProbe& Probe();
+
+#endif // PERF_PROBE_H
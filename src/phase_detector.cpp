@@ -0,0 +1,242 @@
+#include "phase_detector.h"
+#include "system_state.h"
+
+PhaseDetector::PhaseDetector() {
+    reset();
+}
+
+void PhaseDetector::reset() {
+    for (uint8_t i = 0; i < PHASE_WINDOW_SAMPLES; i++) {
+        speeds[i] = 0.0f;
+        altitudes[i] = 0.0f;
+    }
+    index = 0;
+    count = 0;
+    sum = 0.0f;
+    sumSquares = 0.0f;
+    altitudeSum = 0.0f;
+    lastAltitude = 0.0f;
+    lastSpeed = 0.0f;
+
+    groundAltitude = 0.0f;
+    groundSet = false;
+
+    lastLogPressure = 0.0f;
+    lastPressureTime = 0;
+    pressureRate = 0.0f;
+    pressureAccel = 0.0f;
+    rateValid = false;
+    accelValid = false;
+    burstRun = 0;
+    burstsDetected = 0;
+
+    candidate = FlightPhase::GROUND;
+    candidateSince = 0;
+    lastSampleTime = 0;
+    pending = false;
+}
+
+void PhaseDetector::setGroundAltitude(float altitude) {
+    groundAltitude = altitude;
+    groundSet = true;
+}
+
+// ===========================
+// Samples
+// ===========================
+
+void PhaseDetector::addSample(uint32_t time, float altitude, float verticalSpeed, float pressure) {
+    if (count == PHASE_WINDOW_SAMPLES) {
+        sum -= speeds[index];
+        sumSquares -= speeds[index] * speeds[index];
+        altitudeSum -= altitudes[index];
+    } else {
+        count++;
+    }
+    speeds[index] = verticalSpeed;
+    altitudes[index] = altitude;
+    sum += verticalSpeed;
+    sumSquares += verticalSpeed * verticalSpeed;
+    altitudeSum += altitude;
+    index = (index + 1) & (PHASE_WINDOW_SAMPLES - 1);
+    if (index == 0) {
+        refreshSums();
+    }
+
+    lastAltitude = altitude;
+    lastSpeed = verticalSpeed;
+    lastSampleTime = time;
+    addPressure(time, pressure);
+    pending = true;
+}
+
+void PhaseDetector::refreshSums() {
+    sum = 0.0f;
+    sumSquares = 0.0f;
+    altitudeSum = 0.0f;
+    for (uint8_t i = 0; i < count; i++) {
+        sum += speeds[i];
+        sumSquares += speeds[i] * speeds[i];
+        altitudeSum += altitudes[i];
+    }
+}
+
+void PhaseDetector::addPressure(uint32_t time, float pressure) {
+    if (pressure <= 0.0f) {
+        return;
+    }
+
+    uint32_t elapsed = time - lastPressureTime;
+    if (lastPressureTime != 0 && elapsed == 0) {
+        return;     // The same reading again
+    }
+    float logPressure = logf(pressure);
+    float previous = lastLogPressure;
+    lastLogPressure = logPressure;
+    lastPressureTime = time;
+
+    // First reading, or too long since the last for a derivative across it
+    if (previous == 0.0f || elapsed > PHASE_MAX_GAP_MS) {
+        rateValid = false;
+        accelValid = false;
+        burstRun = 0;
+        return;
+    }
+
+    float dt = elapsed / 1000.0f;
+    float rate = (logPressure - previous) / dt;
+    if (!rateValid) {
+        pressureRate = rate;
+        rateValid = true;
+        return;
+    }
+
+    float smoothed = pressureRate + PHASE_RATE_SMOOTHING * (rate - pressureRate);
+    float accel = (smoothed - pressureRate) / dt;
+    pressureAccel = accelValid ? pressureAccel + PHASE_RATE_SMOOTHING * (accel - pressureAccel) : accel;
+    pressureRate = smoothed;
+    accelValid = true;
+
+    // Falling, fast and faster: the pressure climbs at an increasing rate
+    bool falling = pressureAccel * PHASE_SCALE_HEIGHT_M > PHASE_BURST_DECEL_MPS2 &&
+                   pressureRate * PHASE_SCALE_HEIGHT_M > PHASE_APEX_SINK_MPS &&
+                   lastSpeed < -PHASE_APEX_SINK_MPS;
+    if (!falling) {
+        burstRun = 0;
+    } else if (burstRun < PHASE_BURST_SAMPLES) {
+        burstRun++;
+    }
+}
+
+float PhaseDetector::getVerticalSpeedSigma() const {
+    if (count < 2) {
+        return 0.0f;
+    }
+    float variance = (sumSquares - sum * sum / count) / (count - 1);
+    return variance > 0.0f ? sqrtf(variance) : 0.0f;
+}
+
+// ===========================
+// Transitions
+// ===========================
+
+// The phase current's exit condition leads to, if the window meets it now
+FlightPhase PhaseDetector::exitPhase(FlightPhase current, uint32_t& dwell) const {
+    float mean = getMeanVerticalSpeed();
+    float height = getHeight();
+
+    dwell = PHASE_DWELL_MS;
+    switch (current) {
+        case FlightPhase::GROUND:
+            if (mean > PHASE_LAUNCH_CLIMB_MPS && height > PHASE_LAUNCH_HEIGHT_M) {
+                return FlightPhase::LAUNCH;
+            }
+            break;
+        case FlightPhase::LAUNCH:
+            dwell = PHASE_ASCENT_DWELL_MS;
+            if (mean > PHASE_ASCENT_CLIMB_MPS && height > PHASE_ASCENT_HEIGHT_M) {
+                return FlightPhase::POWERED_ASCENT;
+            }
+            break;
+        case FlightPhase::POWERED_ASCENT:
+            dwell = PHASE_ASCENT_DWELL_MS;
+            if (mean < -PHASE_APEX_SINK_MPS) {
+                dwell = PHASE_DWELL_MS;
+                return FlightPhase::APEX;   // A burst too gentle for the pressure to show
+            }
+            if (mean < PHASE_FLOAT_CLIMB_MPS && height > PHASE_FLOAT_HEIGHT_M) {
+                return FlightPhase::BALLOON_ASCENT;
+            }
+            break;
+        case FlightPhase::BALLOON_ASCENT:
+            if (mean < -PHASE_APEX_SINK_MPS) {
+                return FlightPhase::APEX;
+            }
+            break;
+        case FlightPhase::APEX:
+            if (mean < -PHASE_DESCENT_SINK_MPS) {
+                return FlightPhase::PARACHUTE_DESCENT;
+            }
+            break;
+        case FlightPhase::PARACHUTE_DESCENT:
+            dwell = PHASE_LANDING_DWELL_MS;
+            if (fabsf(mean) < PHASE_LANDING_SPEED_MPS && height < PHASE_LANDING_HEIGHT_M) {
+                return FlightPhase::LANDING;
+            }
+            break;
+        case FlightPhase::LANDING:
+            dwell = PHASE_LANDING_DWELL_MS;
+            if (fabsf(mean) < PHASE_STILL_SPEED_MPS && getVerticalSpeedSigma() < PHASE_STILL_SPEED_MPS) {
+                return FlightPhase::RECOVERY;
+            }
+            break;
+        default:
+            break;
+    }
+    return current;
+}
+
+bool PhaseDetector::evaluate(FlightPhase current, FlightPhase& next) {
+    if (!pending) {
+        return false;
+    }
+    pending = false;
+
+    // On the ground the reference follows the window while it's still, so
+    // it stays where launch happened from
+    if (current == FlightPhase::GROUND && count > 0 && fabsf(getMeanVerticalSpeed()) < PHASE_LAUNCH_CLIMB_MPS) {
+        setGroundAltitude(altitudeSum / count);
+    }
+
+    if ((current == FlightPhase::POWERED_ASCENT || current == FlightPhase::BALLOON_ASCENT) &&
+        burstRun >= PHASE_BURST_SAMPLES) {
+        burstsDetected++;
+        burstRun = 0;
+        candidate = FlightPhase::APEX;
+        candidateSince = lastSampleTime;
+        next = FlightPhase::APEX;
+        return true;
+    }
+
+    if (count < PHASE_MIN_SAMPLES || getVerticalSpeedSigma() > PHASE_MAX_SIGMA_MPS) {
+        candidate = current;
+        return false;
+    }
+
+    uint32_t dwell;
+    FlightPhase target = exitPhase(current, dwell);
+    if (target == current) {
+        candidate = current;
+        return false;
+    }
+    if (candidate != target) {
+        candidate = target;
+        candidateSince = lastSampleTime;
+        return false;
+    }
+    if (lastSampleTime - candidateSince < dwell) {
+        return false;
+    }
+    next = target;
+    return true;
+}
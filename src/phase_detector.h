@@ -0,0 +1,125 @@
+#ifndef PHASE_DETECTOR_H
+#define PHASE_DETECTOR_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Phase Detector
+// Flight phase from windowed statistics of the fused vertical speed, with
+// dwell-time hysteresis and burst detection from the barometric pressure
+// ===========================
+
+// Each altitude filter output is one sample; addSample() is O(1). The last
+// PHASE_WINDOW_SAMPLES vertical speeds are kept in a ring with running sums
+// for the window's mean and standard deviation (refreshed from the ring
+// once a lap, so float rounding can't build up over a flight).
+//
+// A phase's exit condition is tested on the window mean, and heights are
+// from the ground reference - the window's mean altitude while standing on
+// the ground, not MSL. The condition must hold for the transition's dwell time
+// on every sample before the phase changes; one that fails restarts the
+// dwell. A window noisier than PHASE_MAX_SIGMA_MPS holds the phase where it
+// is.
+//
+// Burst is the exception: the fall's onset shows first as a sharp downward
+// acceleration, long before a 16-sample mean turns negative. It's taken
+// from the pressure as d²(ln p)/dt², which is -a/H for an acceleration a at
+// scale height H whatever the altitude, smoothed twice. PHASE_BURST_SAMPLES
+// in a row below -PHASE_BURST_DECEL_MPS2, with both the pressure and the
+// fused speed saying the payload sinks faster than PHASE_APEX_SINK_MPS, is
+// a burst, and an ascent goes to APEX at once. Near ceiling the pressure is
+// a hundredth of the ground's and its relative noise a hundred times more,
+// hence the run and the cross-check rather than a single sample.
+
+#define PHASE_WINDOW_SAMPLES        16          // Power of two
+#define PHASE_MIN_SAMPLES           8           // Before any transition
+#define PHASE_MAX_SIGMA_MPS         5.0f        // Noisier windows hold the phase
+
+#define PHASE_LAUNCH_CLIMB_MPS      2.0f        // GROUND -> LAUNCH, above PHASE_LAUNCH_HEIGHT_M
+#define PHASE_LAUNCH_HEIGHT_M       10.0f
+#define PHASE_ASCENT_CLIMB_MPS      2.0f        // LAUNCH -> POWERED_ASCENT, above PHASE_ASCENT_HEIGHT_M
+#define PHASE_ASCENT_HEIGHT_M       100.0f
+#define PHASE_FLOAT_CLIMB_MPS       1.0f        // POWERED_ASCENT -> BALLOON_ASCENT below it, above PHASE_FLOAT_HEIGHT_M
+#define PHASE_FLOAT_HEIGHT_M        1000.0f
+#define PHASE_APEX_SINK_MPS         2.0f        // BALLOON_ASCENT -> APEX
+#define PHASE_DESCENT_SINK_MPS      5.0f        // APEX -> PARACHUTE_DESCENT
+#define PHASE_LANDING_SPEED_MPS     2.0f        // PARACHUTE_DESCENT -> LANDING, below PHASE_LANDING_HEIGHT_M
+#define PHASE_LANDING_HEIGHT_M      100.0f
+#define PHASE_STILL_SPEED_MPS       0.5f        // LANDING -> RECOVERY, mean and sigma both
+
+#define PHASE_DWELL_MS              5000        // Launch, apex and descent
+#define PHASE_ASCENT_DWELL_MS       15000       // The ascent's sub-phases, whose speeds are close
+#define PHASE_LANDING_DWELL_MS      30000       // Landing and recovery
+
+#define PHASE_SCALE_HEIGHT_M        7000.0f     // Pressure e-folding height, close enough to 20 km
+#define PHASE_BURST_DECEL_MPS2      3.0f
+#define PHASE_BURST_SAMPLES         3
+#define PHASE_RATE_SMOOTHING        0.3f        // EMA weight of the newest pressure rate and its change
+#define PHASE_MAX_GAP_MS            10000       // Longer gaps restart the pressure derivatives
+
+enum class FlightPhase : uint8_t;     // system_state.h
+
+class PhaseDetector {
+public:
+    PhaseDetector();
+
+    void reset();
+
+    // One per altitude estimate; pressure in any unit (only ln p is differentiated), 0 = none
+    void addSample(uint32_t time, float altitude, float verticalSpeed, float pressure);
+
+    // With a new sample since the last call, the phase to move to from
+    // current; false to stay. Call once per new sample
+    bool evaluate(FlightPhase current, FlightPhase& next);
+
+    // Taken over from a resumed flight; until then the ground follows the samples
+    void setGroundAltitude(float altitude);
+
+    float getMeanVerticalSpeed() const { return count ? sum / count : 0.0f; }
+    float getVerticalSpeedSigma() const;
+    float getHeight() const { return groundSet ? lastAltitude - groundAltitude : lastAltitude; }   // MSL with no ground yet
+    float getGroundAltitude() const { return groundAltitude; }
+    bool isGroundSet() const { return groundSet; }
+    float getBurstAcceleration() const { return pressureAccel * -PHASE_SCALE_HEIGHT_M; }   // m/s², from pressure
+    FlightPhase getCandidate() const { return candidate; }
+    uint32_t getBurstsDetected() const { return burstsDetected; }
+
+private:
+    // Vertical speed window
+    float speeds[PHASE_WINDOW_SAMPLES];
+    float altitudes[PHASE_WINDOW_SAMPLES];
+    uint8_t index;
+    uint8_t count;
+    float sum;
+    float sumSquares;
+    float altitudeSum;
+    float lastAltitude;
+    float lastSpeed;
+
+    // Ground reference
+    float groundAltitude;
+    bool groundSet;
+
+    // Pressure derivatives, of ln p
+    float lastLogPressure;
+    uint32_t lastPressureTime;
+    float pressureRate;         // 1/s
+    float pressureAccel;        // 1/s²
+    bool rateValid;
+    bool accelValid;
+    uint8_t burstRun;
+    uint32_t burstsDetected;
+
+    // Hysteresis
+    FlightPhase candidate;      // Phase whose entry condition is holding
+    uint32_t candidateSince;
+    uint32_t lastSampleTime;
+    bool pending;               // A sample evaluate() hasn't seen
+
+    void addPressure(uint32_t time, float pressure);
+    void refreshSums();
+    FlightPhase exitPhase(FlightPhase current, uint32_t& dwell) const;
+};
+
+#endif // PHASE_DETECTOR_H
@@ -0,0 +1,192 @@
+#include "pipeline.h"
+#include "memory_ledger.h"
+
+static PipelineRuntime pipelineInstance;
+
+PipelineRuntime& Pipes() {
+    return pipelineInstance;
+}
+
+#if PIPELINE_COROUTINES
+static uint32_t lastFrameBytes;     // The frame start() is about to take - made on the same task, just before
+#endif
+
+// ===========================
+// Constructor
+// ===========================
+
+PipelineRuntime::PipelineRuntime() {
+#if PIPELINE_COROUTINES
+    for (Pipe::Handle& handle : handles) {
+        handle = nullptr;
+    }
+#endif
+    memset(status, 0, sizeof(status));
+    task = nullptr;
+    pending = 0;
+    signalLock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+// ===========================
+// Coroutine Support
+// ===========================
+
+#if PIPELINE_COROUTINES
+
+void* Pipe::promise_type::operator new(size_t size) noexcept {
+    void* frame = memAlloc(MemTag::PIPELINE, size);
+    lastFrameBytes = frame ? size : 0;
+    return frame;
+}
+
+void Pipe::promise_type::operator delete(void* frame, size_t) {
+    memFree(MemTag::PIPELINE, frame);
+}
+
+void PipeWaitAwaiter::await_suspend(Pipe::Handle handle) {
+    promise = &handle.promise();
+    promise->waitMask = mask;
+    promise->timed = timeoutMs != 0;
+    promise->wakeAt = millis() + timeoutMs;
+}
+
+void PipeSleepAwaiter::await_suspend(Pipe::Handle handle) {
+    Pipe::promise_type& promise = handle.promise();
+    promise.waitMask = 0;
+    promise.timed = true;
+    promise.wakeAt = millis() + ms;
+}
+
+bool PipelineRuntime::start(const char* name, Pipe pipe) {
+    Pipe::Handle handle = pipe.release();
+    if (!handle) {
+        return false;
+    }
+    for (uint8_t i = 0; i < PIPELINE_MAX; i++) {
+        if (handles[i]) {
+            continue;
+        }
+        // Due at once - it runs to its first await on the next pass
+        Pipe::promise_type& promise = handle.promise();
+        promise.waitMask = 0;
+        promise.timed = true;
+        promise.wakeAt = millis();
+        promise.fired = false;
+
+        handles[i] = handle;
+        status[i].name = name;
+        status[i].running = true;
+        status[i].frameBytes = lastFrameBytes;
+        status[i].resumes = 0;
+        status[i].timeouts = 0;
+        status[i].startedAt = millis();
+        return true;
+    }
+    handle.destroy();
+    return false;
+}
+
+#endif // PIPELINE_COROUTINES
+
+// ===========================
+// Dispatch
+// ===========================
+
+void PipelineRuntime::signal(PipeEvent event) {
+    portENTER_CRITICAL(&signalLock);
+    pending = pending | (1u << static_cast<uint8_t>(event));
+    portEXIT_CRITICAL(&signalLock);
+
+    if (task && task != xTaskGetCurrentTaskHandle()) {
+        xTaskNotifyGive(task);
+    }
+}
+
+uint8_t PipelineRuntime::runDue() {
+    portENTER_CRITICAL(&signalLock);
+    uint32_t events = pending;
+    pending = 0;
+    portEXIT_CRITICAL(&signalLock);
+
+    uint8_t ran = 0;
+#if PIPELINE_COROUTINES
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < PIPELINE_MAX; i++) {
+        Pipe::Handle handle = handles[i];
+        if (!handle) {
+            continue;
+        }
+        Pipe::promise_type& promise = handle.promise();
+        bool fired = (promise.waitMask & events) != 0;
+        bool timerDue = promise.timed && (int32_t)(now - promise.wakeAt) >= 0;
+        if (!fired && !timerDue) {
+            continue;
+        }
+        if (!fired && promise.waitMask) {
+            status[i].timeouts++;
+        }
+        promise.fired = fired;
+        promise.waitMask = 0;
+        promise.timed = false;
+
+        handle.resume();
+        status[i].resumes++;
+        ran++;
+
+        if (handle.done()) {
+            handle.destroy();
+            handles[i] = nullptr;
+            status[i].running = false;
+        }
+    }
+#else
+    (void)events;
+#endif
+    return ran;
+}
+
+uint32_t PipelineRuntime::getTimeUntilNextMs() const {
+    uint32_t next = UINT32_MAX;
+#if PIPELINE_COROUTINES
+    uint32_t now = millis();
+    for (const Pipe::Handle& handle : handles) {
+        if (!handle || !handle.promise().timed) {
+            continue;
+        }
+        int32_t remaining = (int32_t)(handle.promise().wakeAt - now);
+        next = min(next, remaining > 0 ? (uint32_t)remaining : 0u);
+    }
+#endif
+    return next;
+}
+
+uint8_t PipelineRuntime::getCount() const {
+    uint8_t count = 0;
+    for (const PipeStatus& entry : status) {
+        count += entry.name ? 1 : 0;
+    }
+    return count;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void PipelineRuntime::printStatus() const {
+    if (!PIPELINE_COROUTINES) {
+        Serial.println("Pipelines: no coroutine support in this build");
+        return;
+    }
+    // A task would carry its stack and TCB whatever the flow keeps across its waits
+    uint32_t taskBytes = PIPELINE_TASK_STACK_BYTES + sizeof(StaticTask_t);
+    Serial.printf("Pipelines: %u (a task each would be %lu bytes)\n", getCount(), (unsigned long)taskBytes);
+    for (const PipeStatus& entry : status) {
+        if (!entry.name) {
+            continue;
+        }
+        Serial.printf("  %-10s %s, frame %lu bytes, %lu resumes, %lu timeouts, up %lu s\n", entry.name,
+                      entry.running ? "running" : "finished", (unsigned long)entry.frameBytes,
+                      (unsigned long)entry.resumes, (unsigned long)entry.timeouts,
+                      (unsigned long)((millis() - entry.startedAt) / 1000));
+    }
+}
@@ -0,0 +1,179 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// ===========================
+// Pipelines
+// Multi-step subsystem flows as C++20 coroutines, resumed by the task that
+// owns the subsystem instead of each flow running on a task stack of its own
+// ===========================
+
+// A pipeline is a function returning Pipe that co_awaits between its steps:
+//
+//     Pipe capture() {
+//         for (;;) {
+//             Camera().requestCapture();
+//             if (!co_await pipeWait(PipeEvent::CAPTURE_DONE, CAMERA_CAPTURE_TIMEOUT_MS)) { ... }
+//             ...
+//             co_await pipeSleep(interval);
+//         }
+//     }
+//
+// Pipes().start() takes it, and runDue() on the owning task resumes it
+// when its timer falls due or an event it waits on is signalled. signal()
+// may come from any task (the camera's capture task, the RX path). It
+// notifies the owner so the owner's wait ends early. An event nobody is
+// waiting on is dropped; a pipeline that wakes for one should still check
+// what it waited for.
+//
+// Memory: the frame holds the locals live across an await and the promise,
+// on the pipeline's own MemTag::PIPELINE allocation, made once at start().
+// printStatus() sets each frame beside what the same flow would take as a
+// task, a PIPELINE_TASK_STACK_BYTES stack and a TCB. It does so to justify,
+// or not, the next flow moved over.
+//
+// The compiler needs C++20 coroutines (GCC 10 and up with -std=gnu++20,
+// the IDF 5 toolchains). Without them PIPELINE_COROUTINES is 0, Pipe and
+// the awaitables don't exist, and callers keep their hand-written state
+// machines; signal() and runDue() stay, and do nothing.
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define PIPELINE_COROUTINES     1
+#include <coroutine>
+#else
+#define PIPELINE_COROUTINES     0
+#endif
+
+#define PIPELINE_MAX            4
+#define PIPELINE_TASK_STACK_BYTES 4096      // The smallest stack a flow of this kind runs on as a task
+
+enum class PipeEvent : uint8_t {
+    CAPTURE_DONE = 0,       // The camera's capture task has a result
+    RADIO_RECEIVED,         // A packet has come in over either link
+    COUNT
+};
+
+struct PipeStatus {
+    const char* name;
+    bool running;
+    uint32_t frameBytes;        // Coroutine frame, as allocated
+    uint32_t resumes;
+    uint32_t timeouts;          // Waits that ended on their timer
+    uint32_t startedAt;         // millis()
+};
+
+#if PIPELINE_COROUTINES
+
+class Pipe {
+public:
+    struct promise_type {
+        uint32_t waitMask;          // PipeEvent bits, 0 = a plain sleep
+        uint32_t wakeAt;            // millis()
+        bool timed;                 // Has a wakeAt
+        bool fired;                 // Woken by an event, not the timer
+
+        Pipe get_return_object() { return Pipe(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        static Pipe get_return_object_on_allocation_failure() { return Pipe(nullptr); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {}
+
+        static void* operator new(size_t size) noexcept;
+        static void operator delete(void* frame, size_t size);
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    explicit Pipe(Handle handle) : handle(handle) {}
+    Pipe(Pipe&& other) : handle(other.handle) { other.handle = nullptr; }
+    Pipe(const Pipe&) = delete;
+    Pipe& operator=(const Pipe&) = delete;
+    ~Pipe() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    // The runtime takes it over
+    Handle release() {
+        Handle taken = handle;
+        handle = nullptr;
+        return taken;
+    }
+
+private:
+    Handle handle;
+};
+
+// co_await: true if the event came, false if timeoutMs ran out first
+struct PipeWaitAwaiter {
+    uint32_t mask;
+    uint32_t timeoutMs;         // 0 = no timeout
+    Pipe::promise_type* promise;
+
+    bool await_ready() const { return false; }
+    void await_suspend(Pipe::Handle handle);
+    bool await_resume() const { return promise->fired; }
+};
+
+struct PipeSleepAwaiter {
+    uint32_t ms;
+
+    bool await_ready() const { return ms == 0; }
+    void await_suspend(Pipe::Handle handle);
+    void await_resume() const {}
+};
+
+inline PipeWaitAwaiter pipeWait(PipeEvent event, uint32_t timeoutMs = 0) {
+    return {1u << static_cast<uint8_t>(event), timeoutMs, nullptr};
+}
+inline PipeSleepAwaiter pipeSleep(uint32_t ms) { return {ms}; }
+
+#endif // PIPELINE_COROUTINES
+
+class PipelineRuntime {
+public:
+    PipelineRuntime();
+
+    // The task that calls runDue(), notified by signal()
+    void setTask(TaskHandle_t handle) { task = handle; }
+
+#if PIPELINE_COROUTINES
+    // Owning task; runs it to its first await at the next runDue(). False if
+    // every slot is taken or the frame couldn't be allocated
+    bool start(const char* name, Pipe pipe);
+#endif
+
+    // Any task
+    void signal(PipeEvent event);
+
+    // Owning task: resumes every pipeline that's due, returns how many
+    uint8_t runDue();
+    // Until the earliest timer, UINT32_MAX with none
+    uint32_t getTimeUntilNextMs() const;
+
+    uint8_t getCount() const;
+    const PipeStatus& getStatus(uint8_t index) const { return status[index]; }
+    void printStatus() const;
+
+private:
+#if PIPELINE_COROUTINES
+    Pipe::Handle handles[PIPELINE_MAX];
+#endif
+    PipeStatus status[PIPELINE_MAX];
+    TaskHandle_t task;
+    volatile uint32_t pending;      // PipeEvent bits signalled since the last runDue()
+    portMUX_TYPE signalLock;
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+PipelineRuntime& Pipes();
+
+#endif // PIPELINE_H
@@ -0,0 +1,237 @@
+#include "power_arbiter.h"
+#include "debug_utils.h"
+
+// One DMA frame of the battery ADC, the shortest load its median sees
+#define ARBITER_FRAME_MS (BATTERY_ADC_FRAME_SAMPLES * 1000 / BATTERY_ADC_SAMPLE_HZ)
+
+static PowerArbiter powerArbiterInstance;
+
+PowerArbiter& Arbiter() {
+    return powerArbiterInstance;
+}
+
+static inline uint16_t loadBit(EnergyLoad load) {
+    return 1u << static_cast<uint8_t>(load);
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+PowerArbiter::PowerArbiter() {
+    adc = nullptr;
+    lock = portMUX_INITIALIZER_UNLOCKED;
+    heldMask = 0;
+    for (int i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        heldMa[i] = 0;
+        heldSince[i] = 0;
+        restVoltage[i] = 0;
+        heldAlone[i] = false;
+    }
+    resistance = POWER_ARBITER_DEFAULT_OHM;
+    granted = 0;
+    refused = 0;
+    forced = 0;
+    overlaps = 0;
+    waitMs = 0;
+    resistanceSamples = 0;
+    txCapped = 0;
+    lastCap = 0;
+}
+
+void PowerArbiter::begin(const BatteryAdc* batteryAdc) {
+    adc = batteryAdc;
+}
+
+// ===========================
+// Margin
+// ===========================
+
+bool PowerArbiter::readBattery(float& voltage) const {
+    if (!POWER_ARBITER_ENABLED || !adc || !adc->hasReading()) {
+        return false;
+    }
+    voltage = adc->getVoltage();
+    return voltage > 0;
+}
+
+float PowerArbiter::marginFor(float voltage, float extraMa) const {
+    float milliamps = extraMa;
+    for (int i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        if (heldMask & (1u << i)) {
+            milliamps += heldMa[i];
+        }
+    }
+    return voltage - resistance * milliamps / 1000.0f - POWER_ARBITER_BROWNOUT_V;
+}
+
+float PowerArbiter::getMargin() const {
+    float voltage;
+    if (!readBattery(voltage)) {
+        return NAN;
+    }
+    portENTER_CRITICAL(&lock);
+    float margin = marginFor(voltage, 0);
+    portEXIT_CRITICAL(&lock);
+    return margin;
+}
+
+// ===========================
+// Claims
+// ===========================
+
+ArbiterDecision PowerArbiter::claim(EnergyLoad load, float milliamps, bool force) {
+    float voltage = 0;
+    bool haveBattery = readBattery(voltage);
+    uint8_t index = static_cast<uint8_t>(load);
+
+    portENTER_CRITICAL(&lock);
+    if (heldMask & loadBit(load)) {
+        portEXIT_CRITICAL(&lock);
+        return ArbiterDecision::GRANTED;
+    }
+    bool others = heldMask != 0;
+    bool fits = !others || !haveBattery || marginFor(voltage, milliamps) >= POWER_ARBITER_OVERLAP_MARGIN_V;
+    if (!fits && !force) {
+        refused++;
+        portEXIT_CRITICAL(&lock);
+        return ArbiterDecision::REFUSED;
+    }
+
+    for (int i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        if (heldMask & (1u << i)) {
+            heldAlone[i] = false;
+        }
+    }
+    heldMask |= loadBit(load);
+    heldMa[index] = milliamps;
+    heldSince[index] = millis();
+    restVoltage[index] = voltage;
+    heldAlone[index] = !others;
+    if (others) {
+        overlaps++;
+    }
+    if (fits) {
+        granted++;
+    } else {
+        forced++;
+    }
+    portEXIT_CRITICAL(&lock);
+    return fits ? ArbiterDecision::GRANTED : ArbiterDecision::FORCED;
+}
+
+ArbiterDecision PowerArbiter::waitClaim(EnergyLoad load, float milliamps, uint32_t timeoutMs) {
+    uint32_t start = millis();
+    ArbiterDecision decision;
+    while ((decision = claim(load, milliamps)) == ArbiterDecision::REFUSED) {
+        if (millis() - start >= timeoutMs) {
+            decision = claim(load, milliamps, true);
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(ARBITER_WAIT_POLL_MS));
+    }
+
+    uint32_t waited = millis() - start;
+    if (waited) {
+        portENTER_CRITICAL(&lock);
+        waitMs += waited;
+        portEXIT_CRITICAL(&lock);
+    }
+    if (decision == ArbiterDecision::FORCED) {
+        SYS_WARNING("Power arbiter: load %u forced after %lu ms, margin %.2f V", static_cast<unsigned>(load),
+                    (unsigned long)waited, getMargin());
+    }
+    return decision;
+}
+
+void PowerArbiter::release(EnergyLoad load) {
+    if (!(heldMask & loadBit(load))) {
+        return;
+    }
+    // The TX bursts are the clean steps; the camera's draw over whatever
+    // the sensor was already doing isn't known well enough to learn from
+    if (load == EnergyLoad::RADIO_TX || load == EnergyLoad::BULK_RADIO_TX) {
+        learnResistance(load);
+    }
+    portENTER_CRITICAL(&lock);
+    heldMask &= ~loadBit(load);
+    portEXIT_CRITICAL(&lock);
+}
+
+bool PowerArbiter::isHeld(EnergyLoad load) const {
+    return (heldMask & loadBit(load)) != 0;
+}
+
+// ===========================
+// Internal Resistance
+// ===========================
+
+void PowerArbiter::learnResistance(EnergyLoad load) {
+    uint8_t index = static_cast<uint8_t>(load);
+    if (!adc || !adc->hasReading() || !heldAlone[index] || restVoltage[index] <= 0 ||
+        heldMa[index] < ARBITER_IR_MIN_MA) {
+        return;
+    }
+
+    // The latest frame has to lie wholly inside the burst for its median to be the loaded voltage
+    BatteryAdcReading reading = adc->getReading();
+    if ((int32_t)(reading.timestamp - ARBITER_FRAME_MS - heldSince[index]) < 0 || !reading.millivolts) {
+        return;
+    }
+    float loaded = reading.lastFrameMv * reading.voltage / reading.millivolts;
+    float ohms = (restVoltage[index] - loaded) * 1000.0f / heldMa[index];
+    if (ohms < 0 || ohms > ARBITER_IR_MAX_OHM) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+    resistance += ARBITER_IR_ALPHA * (ohms - resistance);
+    resistanceSamples++;
+    portEXIT_CRITICAL(&lock);
+}
+
+// ===========================
+// TX Power
+// ===========================
+
+int PowerArbiter::capTxPower(int requested, float (*currentMa)(int)) {
+    float voltage;
+    if (!readBattery(voltage) || requested <= POWER_ARBITER_TX_FLOOR_DBM) {
+        return requested;
+    }
+
+    // What TX alone may draw and still leave the cap margin over the brownout
+    float limitMa = (voltage - POWER_ARBITER_BROWNOUT_V - POWER_ARBITER_TX_CAP_MARGIN_V) * 1000.0f / resistance;
+    int power = requested;
+    while (power > POWER_ARBITER_TX_FLOOR_DBM && currentMa(power) > limitMa) {
+        power--;
+    }
+    if (power < requested) {
+        if (power != lastCap) {
+            SYS_WARNING("Power arbiter: TX capped at %d dBm (asked %d), %.2f V, %.2f ohm", power, requested,
+                        voltage, resistance);
+        }
+        txCapped++;
+        lastCap = power;
+    }
+    return power;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void PowerArbiter::printStatus() const {
+    if (!POWER_ARBITER_ENABLED) {
+        return;
+    }
+    float margin = getMargin();
+    Serial.printf("Power Arbiter: %.2f ohm from %lu TX bursts, margin %.2f V over %.2f V brownout\n", resistance,
+                  (unsigned long)resistanceSamples, margin, POWER_ARBITER_BROWNOUT_V);
+    Serial.printf("  Claims: %lu granted (%lu overlapping), %lu refused, %lu forced; captures waited %lu ms\n",
+                  (unsigned long)granted, (unsigned long)overlaps, (unsigned long)refused, (unsigned long)forced,
+                  (unsigned long)waitMs);
+    if (txCapped) {
+        Serial.printf("  TX capped on %lu frames, last at %d dBm\n", (unsigned long)txCapped, lastCap);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef POWER_ARBITER_H
+#define POWER_ARBITER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "balloon_config.h"
+#include "energy_ledger.h"
+#include "battery_adc.h"
+
+// ===========================
+// Power Arbiter
+// Keeps the high-current loads - LoRa TX and a camera capture - from
+// drawing at once when a cold or flat battery can't carry both
+// ===========================
+
+// Each load claims before it starts and releases when it's done. A claim
+// is granted when nothing else holds one, or when the battery would still
+// clear the brownout with everything held drawing together:
+//
+//   filtered voltage - internal resistance * (sum of claimed currents)
+//       - POWER_ARBITER_BROWNOUT_V  >=  POWER_ARBITER_OVERLAP_MARGIN_V
+//
+// The filtered voltage is the battery ADC's one-second mean, taken with
+// the loads off. The resistance starts at POWER_ARBITER_DEFAULT_OHM and is
+// learned from the TX bursts themselves: a frame median inside a burst
+// against the mean before it, over the TX current, smoothed. A warm
+// battery's estimate falls and overlap comes back; a cold one's climbs.
+//
+// The radio task never waits: a refused frame backs off ARBITER_RETRY_MS
+// and tries again, and the emergency beacon claims by force. The capture
+// task waits for a grant up to POWER_ARBITER_CAMERA_WAIT_MS - a TX burst
+// at SF12 is under two seconds - then captures anyway.
+//
+// Past the overlap question, at the lowest margins TX alone is too much:
+// capTxPower() gives the highest power at or under the one asked for whose
+// current keeps the sag POWER_ARBITER_TX_CAP_MARGIN_V over the brownout,
+// never under POWER_ARBITER_TX_FLOOR_DBM. The radio applies it per frame
+// and goes back up as the margin comes back.
+//
+// Without a battery ADC reading nothing is refused or capped.
+
+#define ARBITER_RETRY_MS        20      // A refused TX tries again after this
+#define ARBITER_WAIT_POLL_MS    5       // A waiting capture checks this often
+#define ARBITER_IR_MIN_MA       20.0f   // Smaller steps don't give a resistance worth having
+#define ARBITER_IR_MAX_OHM      3.0f    // A sample over this is a reading taken across some other step
+#define ARBITER_IR_ALPHA        0.2f    // Weight of each new resistance sample
+
+enum class ArbiterDecision : uint8_t {
+    GRANTED = 0,        // Alone, or the margin holds with everything together
+    REFUSED,            // Would overlap on a marginal battery
+    FORCED              // Overlapping anyway - the beacon, or a capture out of patience
+};
+
+class PowerArbiter {
+public:
+    PowerArbiter();
+
+    // The battery pipeline to read; without one every claim is granted
+    void begin(const BatteryAdc* adc);
+
+    // Claim a load at this draw; a forced claim is always held
+    ArbiterDecision claim(EnergyLoad load, float milliamps, bool force = false);
+    // Claim, polling until granted or timeoutMs passes, then forced
+    ArbiterDecision waitClaim(EnergyLoad load, float milliamps, uint32_t timeoutMs);
+    // Release a load; a no-op for one not held
+    void release(EnergyLoad load);
+    bool isHeld(EnergyLoad load) const;
+
+    // The TX power to transmit at instead of requested; currentMa maps dBm to draw
+    int capTxPower(int requested, float (*currentMa)(int));
+
+    float getResistance() const { return resistance; }
+    // Volts over the brownout with the loads held now drawing, NAN without a reading
+    float getMargin() const;
+    void printStatus() const;
+
+private:
+    const BatteryAdc* adc;
+    mutable portMUX_TYPE lock;
+
+    uint16_t heldMask;                  // Bit per EnergyLoad
+    float heldMa[ENERGY_LOAD_COUNT];
+    uint32_t heldSince[ENERGY_LOAD_COUNT];  // millis() of the claim
+    float restVoltage[ENERGY_LOAD_COUNT];   // Filtered voltage at the claim
+    bool heldAlone[ENERGY_LOAD_COUNT];      // Nothing else held since the claim
+
+    float resistance;                   // Ohms, learned
+
+    // Statistics
+    uint32_t granted;
+    uint32_t refused;
+    uint32_t forced;
+    uint32_t overlaps;                  // Granted with another load held
+    uint32_t waitMs;                    // Captures kept waiting, total
+    uint32_t resistanceSamples;
+    uint32_t txCapped;                  // Frames sent under the power asked for
+    int lastCap;                        // dBm, 0 = never capped
+
+    bool readBattery(float& voltage) const;
+    float marginFor(float voltage, float extraMa) const;
+    void learnResistance(EnergyLoad load);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern PowerArbiter& Arbiter();
+
+#endif // POWER_ARBITER_H
@@ -1,4 +1,11 @@
 #include "power_manager.h"
+#include "lora_comm.h"
+#include "time_service.h"
+#include "power_scaling.h"
+#include "power_planner.h"
+
+// Rail enable pins, in PowerRail order; -1 = no switch, on with the board
+static const int railPins[POWER_RAIL_COUNT] = {CAMERA_RAIL_PIN, LORA_RAIL_PIN, POWER_ENABLE_PIN};
 
 // ===========================
 // Constructor/Destructor
@@ -13,7 +20,7 @@ PowerManager::PowerManager() {
     batteryStatus = {
         .voltage = 3.7f,
         .current = 0.0f,
-        .capacity = 2000.0f,  // 2000mAh default
+        .capacity = BATTERY_CAPACITY_MAH,
         .percentage = 100.0f,
         .temperature = 20.0f,
         .timestamp = 0,
@@ -25,9 +32,11 @@ PowerManager::PowerManager() {
     // Initialize consumption tracking
     consumption = {
         .totalCurrent = 0.0f,
+        .averageCurrent = 0.0f,
         .cameraCurrent = 0.0f,
         .loraCurrent = 0.0f,
         .sensorCurrent = 0.0f,
+        .gpsCurrent = 0.0f,
         .processorCurrent = 0.0f,
         .uptime = 0,
         .totalEnergy = 0.0f
@@ -48,6 +57,30 @@ PowerManager::PowerManager() {
     lastVoltageCheck = 0;
     lastCurrentCheck = 0;
     
+    // The ledger has been adding since boot; the first update averages over all of it
+    for (uint8_t i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        ledgerCharge[i] = 0.0f;
+    }
+    ledgerSampleUs = 0;
+    ledgerStartCapacity = BATTERY_CAPACITY_MAH;
+    
+    // Switched rails are off until begin(); the priors are the lead until measured
+    const uint32_t settlePriorUs[POWER_RAIL_COUNT] = {RAIL_CAMERA_SETTLE_PRIOR_US, RAIL_LORA_SETTLE_PRIOR_US,
+                                                      RAIL_SENSORS_SETTLE_PRIOR_US};
+    for (uint8_t i = 0; i < POWER_RAIL_COUNT; i++) {
+        rails[i] = {
+            .switchable = railPins[i] >= 0,
+            .on = railPins[i] < 0,
+            .ready = false,
+            .onUs = 0,
+            .settleUs = 0,
+            .settleWorstUs = settlePriorUs[i],
+            .settleCount = 0,
+            .prewarmAt = 0,
+            .cycles = 0
+        };
+    }
+    
     // Initialize settings
     powerSavingEnabled = false;
     adaptivePowerEnabled = true;
@@ -59,6 +92,9 @@ PowerManager::PowerManager() {
     onPowerStateChangedCallback = nullptr;
     onPowerSourceChangedCallback = nullptr;
     onEmergencyShutdownCallback = nullptr;
+    onDeepSleepCallback = nullptr;
+    
+    publishSnapshot();
 }
 
 PowerManager::~PowerManager() {
@@ -70,22 +106,40 @@ PowerManager::~PowerManager() {
 // ===========================
 
 bool PowerManager::begin() {
-    // Initialize ADC for battery monitoring
-    analogReadResolution(12);  // 12-bit resolution
-    analogSetAttenuation(ADC_11db);  // 11dB attenuation for higher voltage range
+    // Battery voltage from the DMA pipeline, so the first reading below is a filtered one
+    if (batteryAdc.begin(BATTERY_SENSE_PIN)) {
+        uint32_t start = millis();
+        while (!batteryAdc.hasReading() && millis() - start < BATTERY_ADC_FIRST_READING_MS) {
+            delay(10);
+        }
+    } else {
+        if (DEBUG_POWER) {
+            Serial.println("Power Manager: Battery ADC pipeline unavailable, using analogRead");
+        }
+        analogReadResolution(12);  // 12-bit resolution
+        analogSetAttenuation(ADC_11db);  // 11dB attenuation for higher voltage range
+    }
     
-    // Initialize power control pins
-    pinMode(POWER_ENABLE_PIN, OUTPUT);
-    // Note: Individual power control pins not available in current hardware design
-    // Using global power enable only
+    // Whatever clock the core booted at, then scaling from it if the build allows
+    applyCpuFrequency(getCpuFrequencyMhz());
+    if (PM_DFS_ENABLED && !PowerScale().begin(PM_MAX_FREQ_MHZ, PM_MIN_FREQ_MHZ, PM_LIGHT_SLEEP) && DEBUG_POWER) {
+        Serial.println("Power Manager: Frequency scaling not available in this build");
+    }
     
-    // Enable power rails
-    digitalWrite(POWER_ENABLE_PIN, HIGH);
+    // Enable power rails; settle times run from here until each owner's markRailReady()
+    for (uint8_t i = 0; i < POWER_RAIL_COUNT; i++) {
+        if (rails[i].switchable) {
+            pinMode(railPins[i], OUTPUT);
+        }
+        setRail(static_cast<PowerRail>(i), true);
+    }
     
     // Perform initial readings
     updateBatteryVoltage();
     updateCurrentConsumption();
     calculateBatteryPercentage();
+    ledgerStartCapacity = batteryStatus.capacity + Energy().getTotalChargeMah();
+    publishSnapshot();
     
     lastUpdateTime = millis();
     
@@ -98,8 +152,12 @@ bool PowerManager::begin() {
 }
 
 void PowerManager::end() {
+    batteryAdc.end();
+    
     // Disable all power rails
-    digitalWrite(POWER_ENABLE_PIN, LOW);
+    for (uint8_t i = 0; i < POWER_RAIL_COUNT; i++) {
+        setRail(static_cast<PowerRail>(i), false);
+    }
 }
 
 bool PowerManager::reinitialize() {
@@ -139,6 +197,7 @@ void PowerManager::update() {
     // Update uptime
     consumption.uptime = millis() / 1000;
     
+    publishSnapshot();
     lastUpdateTime = currentTime;
 }
 
@@ -148,6 +207,11 @@ void PowerManager::forceUpdate() {
     updatePowerState();
     calculateBatteryPercentage();
     updateEnergyConsumption();
+    publishSnapshot();
+}
+
+void PowerManager::publishSnapshot() {
+    snapshot.publish({batteryStatus, consumption, currentPowerState});
 }
 
 // ===========================
@@ -176,27 +240,47 @@ void PowerManager::updateBatteryVoltage() {
 }
 
 void PowerManager::updateCurrentConsumption() {
-    // Read actual current if available, otherwise estimate
-    float actualCurrent = readBatteryCurrent();
+    // Each load's average since the last update: the charge the ledger added, over the time
+    int64_t now = TimeService::nowUs();
+    float hours = (now - ledgerSampleUs) / 3.6e9f;
+    if (hours <= 0.0f) {
+        return;
+    }
     
+    float current[ENERGY_LOAD_COUNT];
+    for (uint8_t i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        float charge = Energy().getChargeMah(static_cast<EnergyLoad>(i));
+        current[i] = (charge - ledgerCharge[i]) / hours;
+        ledgerCharge[i] = charge;
+    }
+    ledgerSampleUs = now;
+    
+    consumption.processorCurrent = current[static_cast<uint8_t>(EnergyLoad::CPU)] +
+                                   current[static_cast<uint8_t>(EnergyLoad::WIFI)];
+    consumption.cameraCurrent = current[static_cast<uint8_t>(EnergyLoad::CAMERA)];
+    consumption.loraCurrent = current[static_cast<uint8_t>(EnergyLoad::RADIO_TX)] +
+                              current[static_cast<uint8_t>(EnergyLoad::RADIO_RX)] +
+                              current[static_cast<uint8_t>(EnergyLoad::BULK_RADIO_TX)] +
+                              current[static_cast<uint8_t>(EnergyLoad::BULK_RADIO_RX)];
+    consumption.gpsCurrent = current[static_cast<uint8_t>(EnergyLoad::GPS)];
+    consumption.sensorCurrent = current[static_cast<uint8_t>(EnergyLoad::SENSORS)];
+    
+    // A current sensor, where fitted, overrides the sum
+    float actualCurrent = readBatteryCurrent();
     if (actualCurrent > 0) {
         consumption.totalCurrent = actualCurrent;
     } else {
-        // Estimate based on active components
-        consumption.totalCurrent = PROCESSOR_CURRENT + SENSOR_CURRENT;
-        
-        // Add LoRa current (transmit vs receive)
-        consumption.loraCurrent = LORA_RX_CURRENT;  // Assume receive most of the time
-        consumption.totalCurrent += consumption.loraCurrent;
-        
-        // Camera power control not available in current hardware
-        // Assume camera is always enabled when power is on
-        consumption.cameraCurrent = CAMERA_CURRENT;
-        consumption.totalCurrent += consumption.cameraCurrent;
+        consumption.totalCurrent = consumption.processorCurrent + consumption.cameraCurrent +
+                                   consumption.loraCurrent + consumption.gpsCurrent + consumption.sensorCurrent;
     }
     
-    consumption.processorCurrent = PROCESSOR_CURRENT;
-    consumption.sensorCurrent = SENSOR_CURRENT;
+    // Camera bursts and TX slots come and go within a minute; runtime wants the long run
+    if (consumption.averageCurrent <= 0.0f) {
+        consumption.averageCurrent = consumption.totalCurrent;
+    } else {
+        float weight = 1.0f - expf(-hours * 3600.0f / POWER_RUNTIME_AVERAGE_S);
+        consumption.averageCurrent += weight * (consumption.totalCurrent - consumption.averageCurrent);
+    }
     
     batteryStatus.current = consumption.totalCurrent;
 }
@@ -257,7 +341,7 @@ void PowerManager::calculateBatteryPercentage() {
     if (batteryStatus.percentage < 0.0f) batteryStatus.percentage = 0.0f;
     
     // Update estimated capacity
-    batteryStatus.capacity = 2000.0f * (batteryStatus.percentage / 100.0f);
+    batteryStatus.capacity = BATTERY_CAPACITY_MAH * (batteryStatus.percentage / 100.0f);
 }
 
 void PowerManager::updateEnergyConsumption() {
@@ -313,19 +397,18 @@ bool PowerManager::checkBatteryHealth() {
 // ===========================
 
 float PowerManager::readBatteryVoltage() {
-    // Read from ADC pin (assuming voltage divider)
-    int rawValue = analogRead(BATTERY_SENSE_PIN);
-    
-    // Convert ADC reading to voltage
-    // Assuming 3.3V reference and voltage divider ratio
-    float voltage = (rawValue / 4095.0f) * 3.3f * 2.0f;  // 2.0 = voltage divider ratio
+    // Latest filtered value - no ADC access here
+    if (batteryAdc.isRunning()) {
+        return batteryAdc.hasReading() ? batteryAdc.getVoltage() : batteryStatus.voltage;
+    }
     
-    return voltage;
+    // One-shot fallback; analogReadMilliVolts() applies the same eFuse calibration
+    return analogReadMilliVolts(BATTERY_SENSE_PIN) * 0.001f * BATTERY_DIVIDER_RATIO * BATTERY_VOLTAGE_TRIM;
 }
 
 float PowerManager::readBatteryCurrent() {
-    // Current sensing not available in current hardware
-    // Return estimated value based on system state
+    // Current sensing not available in current hardware; the energy
+    // ledger's sum stands in for it
     return -1.0f;  // Negative indicates not available
 }
 
@@ -346,6 +429,7 @@ void PowerManager::setPowerState(PowerState state) {
     
     PowerState oldState = currentPowerState;
     currentPowerState = state;
+    publishSnapshot();
     
     if (onPowerStateChangedCallback) {
         onPowerStateChangedCallback(oldState, state);
@@ -360,20 +444,20 @@ void PowerManager::applyPowerSaving() {
             // All systems at full power
             // Individual power control not available - using global power only
             // Set processor to maximum frequency
-            setCpuFrequencyMhz(240);
+            applyCpuFrequency(240);
             break;
             
         case PowerState::NORMAL_POWER:
             // Normal operation with some optimizations
             // Individual power control not available - using global power only
             // Reduce processor frequency slightly
-            setCpuFrequencyMhz(160);
+            applyCpuFrequency(160);
             break;
             
         case PowerState::LOW_POWER:
             // Reduced camera usage, lower processor frequency
             // Individual power control not available - using global power only
-            setCpuFrequencyMhz(80);
+            applyCpuFrequency(80);
             
             // Notify other systems to enter low power mode
             if (DEBUG_POWER) {
@@ -384,7 +468,7 @@ void PowerManager::applyPowerSaving() {
         case PowerState::CRITICAL_POWER:
             // Minimal operation - only essential systems
             // Individual power control not available - using global power only
-            setCpuFrequencyMhz(40);
+            applyCpuFrequency(40);
             
             // Notify other systems to enter critical power mode
             if (DEBUG_POWER) {
@@ -400,50 +484,123 @@ void PowerManager::applyPowerSaving() {
 }
 
 void PowerManager::controlPowerRails() {
-    // This method can be used for more fine-grained power rail control
-    // Implementation depends on specific hardware design
+    // Prewarms that have come due
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < POWER_RAIL_COUNT; i++) {
+        PowerRailStatus& rail = rails[i];
+        if (rail.prewarmAt && (int32_t)(now - rail.prewarmAt) >= 0) {
+            rail.prewarmAt = 0;
+            if (!rail.on) {
+                setRail(static_cast<PowerRail>(i), true);
+                if (DEBUG_POWER) {
+                    Serial.printf("Power Manager: %s rail prewarmed, %lu ms lead\n",
+                                  powerRailToString(static_cast<PowerRail>(i)),
+                                  (unsigned long)getRailLeadMs(static_cast<PowerRail>(i)));
+                }
+            }
+        }
+    }
 }
 
 // ===========================
 // Component Power Control
 // ===========================
 
-void PowerManager::enableCamera(bool enable) {
-    // Individual power control not available in current hardware
-    // Using global power control only
-    if (enable) {
-        consumption.cameraCurrent = CAMERA_CURRENT;
-    } else {
-        consumption.cameraCurrent = 0.0f;
+bool PowerManager::setRail(PowerRail rail, bool on) {
+    uint8_t index = static_cast<uint8_t>(rail);
+    if (index >= POWER_RAIL_COUNT) {
+        return false;
     }
+    PowerRailStatus& status = rails[index];
+    
+    // No switch: on since the board came up, which is when begin() first asks
+    if (!status.switchable) {
+        if (on && status.onUs == 0) {
+            status.onUs = TimeService::nowUs();
+            status.cycles++;
+        }
+        return false;
+    }
+    
+    digitalWrite(railPins[index], on ? RAIL_ACTIVE_LEVEL : !RAIL_ACTIVE_LEVEL);
+    if (on && !status.on) {
+        status.onUs = TimeService::nowUs();
+        status.cycles++;
+    }
+    if (!on) {
+        status.prewarmAt = 0;
+    }
+    status.ready = status.ready && on;
+    status.on = on;
+    
+    // What the ledger charges a switched-off part while idle: nothing
+    if (rail == PowerRail::CAMERA) {
+        Energy().setIdleCurrent(EnergyLoad::CAMERA, on ? ENERGY_CAMERA_STANDBY_MA : 0.0f);
+    }
+    return true;
 }
 
-void PowerManager::enableLoRa(bool enable) {
-    // Individual power control not available in current hardware
-    // Using global power control only
-    if (enable) {
-        consumption.loraCurrent = LORA_RX_CURRENT;
-    } else {
-        consumption.loraCurrent = 0.0f;
+void PowerManager::markRailReady(PowerRail rail) {
+    uint8_t index = static_cast<uint8_t>(rail);
+    if (index >= POWER_RAIL_COUNT) {
+        return;
+    }
+    PowerRailStatus& status = rails[index];
+    if (!status.on || status.ready) {
+        return;
+    }
+    
+    status.ready = true;
+    status.settleUs = (uint32_t)(TimeService::nowUs() - status.onUs);
+    
+    // The first measurement replaces the prior, which is only a guess
+    if (status.settleCount == 0 || status.settleUs > status.settleWorstUs) {
+        status.settleWorstUs = status.settleUs;
+    }
+    status.settleCount++;
+    
+    if (DEBUG_POWER) {
+        Serial.printf("Power Manager: %s rail ready in %.1f ms\n", powerRailToString(rail),
+                      status.settleUs / 1000.0f);
     }
 }
 
-void PowerManager::enableSensors(bool enable) {
-    // Individual power control not available in current hardware
-    // Using global power control only
-    if (enable) {
-        consumption.sensorCurrent = SENSOR_CURRENT;
-    } else {
-        consumption.sensorCurrent = 0.0f;
+void PowerManager::prewarmRail(PowerRail rail, uint32_t neededAtMs) {
+    uint8_t index = static_cast<uint8_t>(rail);
+    if (index >= POWER_RAIL_COUNT || !rails[index].switchable) {
+        return;
+    }
+    
+    // Never 0, which is no prewarm
+    uint32_t at = neededAtMs - getRailLeadMs(rail);
+    rails[index].prewarmAt = at ? at : 1;
+}
+
+uint32_t PowerManager::getRailLeadMs(PowerRail rail) const {
+    uint8_t index = static_cast<uint8_t>(rail);
+    if (index >= POWER_RAIL_COUNT) {
+        return 0;
     }
+    return (rails[index].settleWorstUs + 999) / 1000 + RAIL_PREWARM_MARGIN_MS;
 }
 
 void PowerManager::setProcessorFrequency(uint32_t frequency) {
-    setCpuFrequencyMhz(frequency / 1000000);
+    applyCpuFrequency(frequency / 1000000);
+}
+
+void PowerManager::applyCpuFrequency(uint32_t mhz) {
+    // Under DFS the power state sets the top of the range; setCpuFrequencyMhz() would fight esp_pm
+    if (PowerScale().isEnabled()) {
+        PowerScale().setMaxFrequency(mhz);
+        return;
+    }
     
-    // Update current estimate based on frequency
-    float frequencyRatio = (float)frequency / 240000000.0f;  // Ratio to 240MHz
-    consumption.processorCurrent = PROCESSOR_CURRENT * frequencyRatio;
+    if (mhz != getCpuFrequencyMhz()) {
+        setCpuFrequencyMhz(mhz);
+    }
+    
+    // Dynamic power goes with the clock
+    Energy().setActiveCurrent(EnergyLoad::CPU, ENERGY_CPU_MA_240MHZ * getCpuFrequencyMhz() / 240.0f);
 }
 
 // ===========================
@@ -455,8 +612,16 @@ void PowerManager::enterDeepSleep(uint32_t durationMs) {
         Serial.printf("Power Manager: Entering deep sleep for %lu ms\n", durationMs);
     }
     
+    // The ADC goes to the ULP monitor, if the callback arms it
+    batteryAdc.end();
+    
+    // RTC memory is all that survives
+    if (onDeepSleepCallback) {
+        onDeepSleepCallback(durationMs);
+    }
+    
     // Configure wake-up sources
-    esp_sleep_enable_timer_wakeup(durationMs * 1000);  // Convert to microseconds
+    esp_sleep_enable_timer_wakeup((uint64_t)durationMs * 1000);  // Convert to microseconds
     
     // Enter deep sleep
     esp_deep_sleep_start();
@@ -528,7 +693,7 @@ void PowerManager::handleCriticalBattery() {
     // Using global power control only
     
     // Set minimum processor frequency
-    setCpuFrequencyMhz(20);
+    applyCpuFrequency(20);
     
     // Keep only LoRa active for emergency communications
     // Individual power control not available - using software control only
@@ -546,7 +711,7 @@ void PowerManager::handleLowBattery() {
     // Individual power control not available - using software control only
     
     // Lower processor frequency
-    setCpuFrequencyMhz(80);
+    applyCpuFrequency(80);
 }
 
 void PowerManager::handlePowerRecovery() {
@@ -561,7 +726,7 @@ void PowerManager::handlePowerRecovery() {
     // Individual power control not available - using software control only
     
     // Restore processor frequency
-    setCpuFrequencyMhz(160);
+    applyCpuFrequency(160);
 }
 
 // ===========================
@@ -587,13 +752,18 @@ bool PowerManager::isWithinLimits() const {
 // Battery Management
 // ===========================
 
+float PowerManager::getRemainingCapacity() const {
+    return max(ledgerStartCapacity - Energy().getTotalChargeMah(), 0.0f);
+}
+
 float PowerManager::getEstimatedRuntime() const {
-    if (consumption.totalCurrent <= 0) {
+    PowerSnapshot latest = snapshot.read();
+    if (latest.consumption.averageCurrent <= 0) {
         return 0;
     }
     
-    float remainingCapacity = batteryStatus.capacity;  // mAh
-    return remainingCapacity / consumption.totalCurrent;  // hours
+    float remainingCapacity = latest.battery.capacity;  // mAh
+    return remainingCapacity / latest.consumption.averageCurrent;  // hours
 }
 
 float PowerManager::getPowerEfficiency() const {
@@ -617,14 +787,13 @@ bool PowerManager::calibrateVoltage() {
         Serial.println("Power Manager: Calibrating voltage measurement");
     }
     
-    // Simple calibration - would need reference voltage
-    // This is a placeholder implementation
-    float measuredVoltage = readBatteryVoltage();
-    
-    // Store calibration factor if needed
-    // Implementation depends on specific hardware
+    // The ADC's own error is taken out by the eFuse characteristics in the
+    // pipeline; divider tolerance is BATTERY_VOLTAGE_TRIM, set from a meter
+    if (DEBUG_POWER) {
+        batteryAdc.printStatus();
+    }
     
-    return true;
+    return !batteryAdc.isRunning() || batteryAdc.isCalibrated();
 }
 
 bool PowerManager::calibrateCurrent() {
@@ -640,6 +809,13 @@ bool PowerManager::calibrateCurrent() {
 
 void PowerManager::resetEnergyCounter() {
     consumption.totalEnergy = 0.0f;
+    Energy().reset();
+    for (uint8_t i = 0; i < ENERGY_LOAD_COUNT; i++) {
+        ledgerCharge[i] = 0.0f;
+    }
+    ledgerSampleUs = TimeService::nowUs();
+    ledgerStartCapacity = batteryStatus.capacity;
+    publishSnapshot();
     
     if (DEBUG_POWER) {
         Serial.println("Power Manager: Energy counter reset");
@@ -657,13 +833,14 @@ void PowerManager::runDiagnostics() {
     // Check power limits
     bool withinLimits = isWithinLimits();
     
-    // Check power rail status - individual power control not available
-    bool globalPower = (digitalRead(POWER_ENABLE_PIN) == HIGH);
+    // Check power rail status
+    bool globalPower = (digitalRead(POWER_ENABLE_PIN) == RAIL_ACTIVE_LEVEL);
     
     Serial.println("=== Power Diagnostics ===");
     Serial.printf("Battery Healthy: %s\n", batteryStatus.healthy ? "Yes" : "No");
     Serial.printf("Within Limits: %s\n", withinLimits ? "Yes" : "No");
     Serial.printf("Global Power: %s\n", globalPower ? "On" : "Off");
+    printRailStatus();
     Serial.printf("Camera Current: %.1f mA\n", consumption.cameraCurrent);
     Serial.printf("LoRa Current: %.1f mA\n", consumption.loraCurrent);
     Serial.printf("Sensor Current: %.1f mA\n", consumption.sensorCurrent);
@@ -693,6 +870,10 @@ void PowerManager::setEmergencyShutdownCallback(void (*callback)(const char*)) {
     onEmergencyShutdownCallback = callback;
 }
 
+void PowerManager::setDeepSleepCallback(void (*callback)(uint32_t)) {
+    onDeepSleepCallback = callback;
+}
+
 // ===========================
 // Debug Methods
 // ===========================
@@ -704,6 +885,7 @@ void PowerManager::printPowerStatus() const {
     Serial.printf("Power Saving: %s\n", powerSavingEnabled ? "Enabled" : "Disabled");
     Serial.printf("Adaptive Power: %s\n", adaptivePowerEnabled ? "Enabled" : "Disabled");
     Serial.printf("Emergency Shutdown: %s\n", emergencyShutdownEnabled ? "Enabled" : "Disabled");
+    PowerScale().printStatus();
 }
 
 void PowerManager::printBatteryStatus() const {
@@ -717,17 +899,22 @@ void PowerManager::printBatteryStatus() const {
     Serial.printf("Healthy: %s\n", batteryStatus.healthy ? "Yes" : "No");
     Serial.printf("Estimated Runtime: %.1f hours\n", getEstimatedRuntime());
     Serial.printf("Power Efficiency: %.1f%%\n", getPowerEfficiency());
+    batteryAdc.printStatus();
 }
 
 void PowerManager::printConsumptionStatus() const {
     Serial.println("=== Power Consumption ===");
     Serial.printf("Total Current: %.1f mA\n", consumption.totalCurrent);
+    Serial.printf("Average Current: %.1f mA\n", consumption.averageCurrent);
     Serial.printf("Camera Current: %.1f mA\n", consumption.cameraCurrent);
     Serial.printf("LoRa Current: %.1f mA\n", consumption.loraCurrent);
     Serial.printf("Sensor Current: %.1f mA\n", consumption.sensorCurrent);
+    Serial.printf("GPS Current: %.1f mA\n", consumption.gpsCurrent);
     Serial.printf("Processor Current: %.1f mA\n", consumption.processorCurrent);
     Serial.printf("Total Energy: %.2f Wh\n", consumption.totalEnergy);
     Serial.printf("Uptime: %lu seconds\n", consumption.uptime);
+    Energy().printLedger();
+    Planner().printPlan();
 }
 
 void PowerManager::printPowerLimits() const {
@@ -739,6 +926,22 @@ void PowerManager::printPowerLimits() const {
     Serial.printf("Max Temperature: %.1f °C\n", limits.maxTemperature);
 }
 
+void PowerManager::printRailStatus() const {
+    Serial.println("=== Power Rails ===");
+    for (uint8_t i = 0; i < POWER_RAIL_COUNT; i++) {
+        const PowerRailStatus& rail = rails[i];
+        Serial.printf("  %-8s %-5s %-9s settle %.1f ms (worst %.1f, %lu measured), %lu on",
+                      powerRailToString(static_cast<PowerRail>(i)), rail.on ? "on" : "off",
+                      !rail.switchable ? "no switch" : (rail.ready ? "ready" : "settling"),
+                      rail.settleUs / 1000.0f, rail.settleWorstUs / 1000.0f, (unsigned long)rail.settleCount,
+                      (unsigned long)rail.cycles);
+        if (rail.prewarmAt) {
+            Serial.printf(", prewarm in %ld ms", (long)(int32_t)(rail.prewarmAt - millis()));
+        }
+        Serial.println();
+    }
+}
+
 void PowerManager::printSystemState() const {
     Serial.println("=== Power System State ===");
     printPowerStatus();
@@ -771,6 +974,15 @@ const char* powerSourceToString(PowerSource source) {
     }
 }
 
+const char* powerRailToString(PowerRail rail) {
+    switch (rail) {
+        case PowerRail::CAMERA: return "Camera";
+        case PowerRail::LORA: return "LoRa";
+        case PowerRail::SENSORS: return "Sensors";
+        default: return "Unknown";
+    }
+}
+
 float voltageToPercentage(float voltage, float maxVoltage) {
     // Simple linear mapping from voltage to percentage
     float percentage = ((voltage - 3.0f) / (maxVoltage - 3.0f)) * 100.0f;
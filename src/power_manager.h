@@ -4,6 +4,9 @@
 #include <Arduino.h>
 #include "balloon_config.h"
 #include "sensor_pins.h"
+#include "battery_adc.h"
+#include "energy_ledger.h"
+#include "snapshot.h"
 
 // ===========================
 // Power Management Data Structures
@@ -36,11 +39,14 @@ struct BatteryStatus {
     PowerSource source;      // Current power source
 };
 
+// Currents are averages over the last update, from the energy ledger
 struct PowerConsumption {
     float totalCurrent;      // Total current draw in mA
+    float averageCurrent;    // totalCurrent smoothed over POWER_RUNTIME_AVERAGE_S, the runtime basis
     float cameraCurrent;     // Camera current in mA
-    float loraCurrent;      // LoRa current in mA
+    float loraCurrent;      // LoRa current in mA, TX and RX
     float sensorCurrent;     // Sensors current in mA
+    float gpsCurrent;        // GPS current in mA
     float processorCurrent;  // Processor current in mA
     uint32_t uptime;        // System uptime in seconds
     float totalEnergy;       // Total energy consumed in Wh
@@ -54,6 +60,42 @@ struct PowerLimits {
     float maxTemperature;   // Maximum battery temperature
 };
 
+// Switched supplies. A rail's settle time runs from switching it on to its
+// owner's markRailReady() - the load switch's rise, the part's power-on
+// reset and the driver's bring-up together - and the worst one seen is the
+// lead prewarmRail() switches on with, so a subsystem can be off between
+// uses and still be ready for the next. Until measured the lead is the
+// rail's prior. A rail with no switch fitted (pin -1) is always on; setRail()
+// only tracks it, and its settle is measured from begin().
+enum class PowerRail : uint8_t {
+    CAMERA = 0,
+    LORA,
+    SENSORS,
+    COUNT
+};
+
+#define POWER_RAIL_COUNT static_cast<uint8_t>(PowerRail::COUNT)
+
+struct PowerRailStatus {
+    bool switchable;
+    bool on;
+    bool ready;             // Owner reported ready since the last switch-on
+    int64_t onUs;           // TimeService time of the last switch-on
+    uint32_t settleUs;      // Last measured, on to ready
+    uint32_t settleWorstUs; // Largest measured; the prewarm lead
+    uint32_t settleCount;
+    uint32_t prewarmAt;     // millis() to switch on at, 0 = none
+    uint32_t cycles;        // Switch-ons
+};
+
+// What the getters return - published whole by loop() after each update, so
+// the web and telemetry tasks never see a battery reading half written
+struct PowerSnapshot {
+    BatteryStatus battery;
+    PowerConsumption consumption;
+    PowerState state;
+};
+
 // ===========================
 // Power Manager Class
 // ===========================
@@ -66,6 +108,8 @@ private:
     BatteryStatus batteryStatus;
     PowerConsumption consumption;
     PowerLimits limits;
+    Snapshot<PowerSnapshot> snapshot;
+    BatteryAdc batteryAdc;      // Filtered battery voltage; analogRead() if it won't start
     
     // Timing and monitoring
     uint32_t lastUpdateTime;
@@ -83,18 +127,29 @@ private:
     static const uint32_t CURRENT_CHECK_INTERVAL = 1000;    // 1 second
     static const uint32_t STATE_CHECK_INTERVAL = 10000;     // 10 seconds
     static const uint32_t STATUS_UPDATE_INTERVAL = 30000;    // 30 seconds
+    static const uint32_t BATTERY_ADC_FIRST_READING_MS = 250;  // begin() waits this long for a filtered voltage
     
     // Voltage thresholds
     static constexpr float CRITICAL_VOLTAGE = 3.2f;
     static constexpr float LOW_VOLTAGE = 3.4f;
     static constexpr float NORMAL_VOLTAGE = 3.7f;
     
-    // Current consumption estimates (mA)
-    static constexpr float CAMERA_CURRENT = 200.0f;
-    static constexpr float LORA_TX_CURRENT = 120.0f;
-    static constexpr float LORA_RX_CURRENT = 15.0f;
-    static constexpr float SENSOR_CURRENT = 50.0f;
-    static constexpr float PROCESSOR_CURRENT = 100.0f;
+    // Runtime estimate - the average current over about this long
+    static constexpr float POWER_RUNTIME_AVERAGE_S = 600.0f;
+    
+    // Ledger totals at the last current update, to difference against
+    float ledgerCharge[ENERGY_LOAD_COUNT];
+    int64_t ledgerSampleUs;
+    
+    // Coulomb count: the voltage estimate when the ledger started, less what it has counted since
+    float ledgerStartCapacity;
+    
+    // Rails - loop() only
+    PowerRailStatus rails[POWER_RAIL_COUNT];
+    static const uint32_t RAIL_CAMERA_SETTLE_PRIOR_US = 800000;    // esp_camera_init() and a first frame
+    static const uint32_t RAIL_LORA_SETTLE_PRIOR_US = 15000;       // SX127x power-on reset, 10 ms
+    static const uint32_t RAIL_SENSORS_SETTLE_PRIOR_US = 5000;     // BMP280 start-up, 2 ms
+    static const uint32_t RAIL_PREWARM_MARGIN_MS = 20;                  // On top of the worst settle
     
     // Private methods
     void updateBatteryVoltage();
@@ -108,7 +163,8 @@ private:
     float readBatteryVoltage();
     float readBatteryCurrent();
     float readBatteryTemperature();
-    void controlPowerRails();
+    void applyCpuFrequency(uint32_t mhz);
+    void publishSnapshot();
     
 public:
     PowerManager();
@@ -122,8 +178,9 @@ public:
     // Power monitoring
     void update();
     void forceUpdate();
-    BatteryStatus getBatteryStatus() const { return batteryStatus; }
-    PowerConsumption getConsumption() const { return consumption; }
+    PowerSnapshot getSnapshot() const { return snapshot.read(); }
+    BatteryStatus getBatteryStatus() const { return snapshot.read().battery; }
+    PowerConsumption getConsumption() const { return snapshot.read().consumption; }
     PowerState getPowerState() const { return currentPowerState; }
     PowerSource getPowerSource() const { return primaryPowerSource; }
     
@@ -138,15 +195,16 @@ public:
     bool isEmergencyShutdownEnabled() const { return emergencyShutdownEnabled; }
     
     // Battery management
-    bool isBatteryHealthy() const { return batteryStatus.healthy; }
-    bool isCharging() const { return batteryStatus.charging; }
-    float getBatteryVoltage() const { return batteryStatus.voltage; }
-    float getBatteryPercentage() const { return batteryStatus.percentage; }
-    float getBatteryTemperature() const { return batteryStatus.temperature; }
+    bool isBatteryHealthy() const { return snapshot.read().battery.healthy; }
+    bool isCharging() const { return snapshot.read().battery.charging; }
+    float getBatteryVoltage() const { return snapshot.read().battery.voltage; }
+    float getBatteryPercentage() const { return snapshot.read().battery.percentage; }
+    float getBatteryTemperature() const { return snapshot.read().battery.temperature; }
     
     // Power consumption
-    float getTotalCurrent() const { return consumption.totalCurrent; }
+    float getTotalCurrent() const { return snapshot.read().consumption.totalCurrent; }
     float getEstimatedRuntime() const;  // Estimated runtime in hours
+    float getRemainingCapacity() const; // mAh, coulomb counted from the energy ledger
     float getPowerEfficiency() const;   // Power efficiency percentage
     
     // Power limits
@@ -154,10 +212,23 @@ public:
     PowerLimits getPowerLimits() const { return limits; }
     bool isWithinLimits() const;
     
-    // Component power control
-    void enableCamera(bool enable);
-    void enableLoRa(bool enable);
-    void enableSensors(bool enable);
+    // Component power control - the load switches
+    void enableCamera(bool enable) { setRail(PowerRail::CAMERA, enable); }
+    void enableLoRa(bool enable) { setRail(PowerRail::LORA, enable); }
+    void enableSensors(bool enable) { setRail(PowerRail::SENSORS, enable); }
+    
+    // Power rails. The owner brings its part up once the rail is on and calls
+    // markRailReady(); prewarmRail() switches on the worst settle time ahead
+    // of when the part is next needed, from controlPowerRails() in loop()
+    bool setRail(PowerRail rail, bool on);      // false with no switch fitted
+    void markRailReady(PowerRail rail);
+    void prewarmRail(PowerRail rail, uint32_t neededAtMs);
+    void controlPowerRails();
+    bool isRailSwitchable(PowerRail rail) const { return rails[static_cast<uint8_t>(rail)].switchable; }
+    bool isRailOn(PowerRail rail) const { return rails[static_cast<uint8_t>(rail)].on; }
+    bool isRailReady(PowerRail rail) const { return rails[static_cast<uint8_t>(rail)].ready; }
+    uint32_t getRailLeadMs(PowerRail rail) const;
+    PowerRailStatus getRailStatus(PowerRail rail) const { return rails[static_cast<uint8_t>(rail)]; }
     void setProcessorFrequency(uint32_t frequency);
     
     // Sleep and wake management
@@ -172,6 +243,8 @@ public:
     void handleLowBattery();
     void handlePowerRecovery();
     
+    const BatteryAdc& getBatteryAdc() const { return batteryAdc; }
+    
     // Calibration and diagnostics
     bool calibrateVoltage();
     bool calibrateCurrent();
@@ -183,6 +256,7 @@ public:
     void printBatteryStatus() const;
     void printConsumptionStatus() const;
     void printPowerLimits() const;
+    void printRailStatus() const;
     void printSystemState() const;
     
     // Event callbacks
@@ -191,6 +265,7 @@ public:
     void (*onPowerStateChangedCallback)(PowerState oldState, PowerState newState);
     void (*onPowerSourceChangedCallback)(PowerSource oldSource, PowerSource newSource);
     void (*onEmergencyShutdownCallback)(const char* reason);
+    void (*onDeepSleepCallback)(uint32_t durationMs);      // Last thing before the chip sleeps - retain state here
     
     // Callback registration
     void setLowBatteryCallback(void (*callback)(float, float));
@@ -198,6 +273,7 @@ public:
     void setPowerStateChangedCallback(void (*callback)(PowerState, PowerState));
     void setPowerSourceChangedCallback(void (*callback)(PowerSource, PowerSource));
     void setEmergencyShutdownCallback(void (*callback)(const char*));
+    void setDeepSleepCallback(void (*callback)(uint32_t));
 };
 
 // ===========================
@@ -212,6 +288,7 @@ extern PowerManager& PowerMgr();
 
 const char* powerStateToString(PowerState state);
 const char* powerSourceToString(PowerSource source);
+const char* powerRailToString(PowerRail rail);
 float voltageToPercentage(float voltage, float maxVoltage = 4.2f);
 float calculatePowerEfficiency(float outputPower, float inputPower);
 uint32_t estimateRuntime(float batteryCapacity, float currentDraw);
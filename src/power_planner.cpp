@@ -0,0 +1,242 @@
+#include "power_planner.h"
+#include "balloon_config.h"
+#include "power_manager.h"
+#include "energy_ledger.h"
+#include "system_state.h"
+#include "lora_comm.h"
+#include "fragment_transfer.h"
+#include "time_service.h"
+
+// Draw that goes on whatever the plan schedules
+static const EnergyLoad baselineLoads[] = {EnergyLoad::CPU, EnergyLoad::GPS, EnergyLoad::RADIO_RX,
+                                           EnergyLoad::SENSORS, EnergyLoad::BULK_RADIO_RX, EnergyLoad::WIFI};
+
+static float baselineChargeMah() {
+    float total = 0.0f;
+    for (EnergyLoad load : baselineLoads) {
+        total += Energy().getChargeMah(load);
+    }
+    return total;
+}
+
+PowerPlanner::PowerPlanner() {
+    fastestMs[static_cast<uint8_t>(PlanStream::CAPTURE)] = CAMERA_CAPTURE_INTERVAL_MS;
+    fastestMs[static_cast<uint8_t>(PlanStream::TELEMETRY)] = LORA_TRANSMIT_INTERVAL_MS;
+    fastestMs[static_cast<uint8_t>(PlanStream::GPS)] = GPS_REPORT_INTERVAL_MS;
+    lastPlanTime = 0;
+    lastPlanUs = 0;
+    lastBaselineMah = 0.0f;
+    lastCameraMah = 0.0f;
+    baselineMa = 0.0f;
+    captures = 0;
+    bytesSent = 0;
+    lastCaptures = 0;
+    lastBytesSent = 0;
+    cameraMahPerCapture = ENERGY_CAMERA_MA * POWER_PLAN_CAPTURE_PRIOR_S / 3600.0f;
+    bytesPerCapture = POWER_PLAN_IMAGE_PRIOR_BYTES;
+}
+
+void PowerPlanner::begin(uint32_t captureMs, uint32_t telemetryMs, uint32_t gpsMs) {
+    fastestMs[static_cast<uint8_t>(PlanStream::CAPTURE)] = captureMs;
+    fastestMs[static_cast<uint8_t>(PlanStream::TELEMETRY)] = telemetryMs;
+    fastestMs[static_cast<uint8_t>(PlanStream::GPS)] = gpsMs;
+
+    // The first plan waits a full interval - the ledger has only seen the bring-up
+    lastPlanTime = millis();
+}
+
+void PowerPlanner::update() {
+    if (!POWER_PLAN_ENABLED) {
+        return;
+    }
+    if (millis() - lastPlanTime >= POWER_PLAN_INTERVAL_MS) {
+        replan();
+    }
+}
+
+void PowerPlanner::onCapture(size_t sent) {
+    captures++;
+    bytesSent += sent;
+}
+
+uint32_t PowerPlanner::getInterval(PlanStream stream) const {
+    uint8_t index = static_cast<uint8_t>(stream);
+    if (index >= PLAN_STREAM_COUNT) {
+        return 0;
+    }
+    PowerPlan current = plan.read();
+    return current.valid ? current.intervalMs[index] : fastestMs[index];
+}
+
+float PowerPlanner::flightSecondsAhead() const {
+    SystemSnapshot state = SysState().getSnapshot();
+    float height = max(state.altitude - SysState().getLaunchAltitude(), 0.0f);
+    float descent = height / max(-state.velocity, POWER_PLAN_DESCENT_MPS);
+
+    switch (state.flightPhase) {
+        case FlightPhase::GROUND:
+            return EMERGENCY_MAX_FLIGHT_TIME;
+        case FlightPhase::LAUNCH:
+        case FlightPhase::POWERED_ASCENT:
+        case FlightPhase::BALLOON_ASCENT: {
+            uint32_t launch = SysState().getLaunchTime();
+            float flown = launch ? (millis() - launch) / 1000.0f : 0.0f;
+            return max(EMERGENCY_MAX_FLIGHT_TIME - flown, descent);
+        }
+        case FlightPhase::APEX:
+        case FlightPhase::PARACHUTE_DESCENT:
+            return descent;
+        default:
+            return 0.0f;
+    }
+}
+
+float PowerPlanner::frameCostMah(size_t payloadBytes) const {
+    size_t frameBytes = frameHeaderSize(LoRaComm().getHeaderVersion()) + payloadBytes + LORA_FRAME_TRAILER_BYTES;
+    return LoRaComm().getTimeOnAirUs(frameBytes) * LoRaComm().getTransmitCurrentMa() / 3.6e9f;
+}
+
+void PowerPlanner::learnCosts() {
+    int64_t now = TimeService::nowUs();
+    float baseline = baselineChargeMah();
+    float camera = Energy().getChargeMah(EnergyLoad::CAMERA);
+
+    // A ledger reset in between shows as negative charge; skip that window
+    if (now > lastPlanUs && baseline >= lastBaselineMah) {
+        baselineMa = (baseline - lastBaselineMah) * 3.6e9f / (now - lastPlanUs);
+    }
+
+    uint32_t taken = captures - lastCaptures;
+    if (taken > 0) {
+        if (camera >= lastCameraMah) {
+            float perCapture = (camera - lastCameraMah) / taken;
+            cameraMahPerCapture += POWER_PLAN_LEARN_GAIN * (perCapture - cameraMahPerCapture);
+        }
+        float perImage = (float)(bytesSent - lastBytesSent) / taken;
+        bytesPerCapture += POWER_PLAN_LEARN_GAIN * (perImage - bytesPerCapture);
+    }
+
+    lastPlanUs = now;
+    lastBaselineMah = baseline;
+    lastCameraMah = camera;
+    lastCaptures = captures;
+    lastBytesSent = bytesSent;
+}
+
+void PowerPlanner::replan() {
+    learnCosts();
+    lastPlanTime = millis();
+
+    PowerPlan next = {};
+    next.timestamp = lastPlanTime;
+    next.baselineMa = baselineMa;
+    next.flightSeconds = flightSecondsAhead();
+    next.remainingMah = PowerMgr().getRemainingCapacity();
+    next.spendableMah = next.remainingMah - POWER_RECOVERY_RESERVE_MAH - baselineMa * next.flightSeconds / 3600.0f;
+
+    // Per action: charge, and the bytes it brings down
+    uint8_t fragments = (uint8_t)ceilf(bytesPerCapture / FRAGMENT_DATA_SIZE);
+    next.costMah[static_cast<uint8_t>(PlanStream::CAPTURE)] =
+        cameraMahPerCapture + fragments * frameCostMah(FRAGMENT_HEADER_SIZE + FRAGMENT_DATA_SIZE);
+    next.costMah[static_cast<uint8_t>(PlanStream::TELEMETRY)] = frameCostMah(MAX_TELEMETRY_SIZE);
+    next.costMah[static_cast<uint8_t>(PlanStream::GPS)] = frameCostMah(MAX_GPS_SIZE);
+
+    float bytes[PLAN_STREAM_COUNT];
+    bytes[static_cast<uint8_t>(PlanStream::CAPTURE)] = bytesPerCapture;
+    bytes[static_cast<uint8_t>(PlanStream::TELEMETRY)] = MAX_TELEMETRY_SIZE;
+    bytes[static_cast<uint8_t>(PlanStream::GPS)] = MAX_GPS_SIZE;
+
+    const uint32_t slowestMs[PLAN_STREAM_COUNT] = {0, POWER_PLAN_TELEMETRY_SLOWEST_MS, POWER_PLAN_GPS_SLOWEST_MS};
+
+    // Floors first, charged whether or not they fit
+    float rate[PLAN_STREAM_COUNT];     // Actions per second
+    for (uint8_t i = 0; i < PLAN_STREAM_COUNT; i++) {
+        rate[i] = slowestMs[i] ? 1000.0f / slowestMs[i] : 0.0f;
+        next.plannedMah += rate[i] * next.flightSeconds * next.costMah[i];
+    }
+
+    // Then the rest, best bytes per mAh first
+    uint8_t order[PLAN_STREAM_COUNT];
+    for (uint8_t i = 0; i < PLAN_STREAM_COUNT; i++) {
+        order[i] = i;
+    }
+    for (uint8_t i = 1; i < PLAN_STREAM_COUNT; i++) {
+        for (uint8_t j = i; j > 0; j--) {
+            uint8_t a = order[j - 1];
+            uint8_t b = order[j];
+            if (bytes[b] * next.costMah[a] <= bytes[a] * next.costMah[b]) {
+                break;
+            }
+            order[j - 1] = b;
+            order[j] = a;
+        }
+    }
+
+    float left = next.spendableMah - next.plannedMah;
+    for (uint8_t k = 0; k < PLAN_STREAM_COUNT && left > 0.0f && next.flightSeconds > 0.0f; k++) {
+        uint8_t i = order[k];
+        if (!fastestMs[i] || next.costMah[i] <= 0.0f) {
+            continue;
+        }
+        float perRate = next.flightSeconds * next.costMah[i];      // mAh per action/s
+        float fastest = 1000.0f / fastestMs[i];
+        float raised = min(fastest, rate[i] + left / perRate);
+
+        // The camera only runs if it gets at least its slowest capture
+        if (slowestMs[i] == 0 && raised < 1000.0f / POWER_PLAN_CAPTURE_SLOWEST_MS) {
+            continue;
+        }
+        left -= (raised - rate[i]) * perRate;
+        next.plannedMah += (raised - rate[i]) * perRate;
+        rate[i] = raised;
+    }
+
+    for (uint8_t i = 0; i < PLAN_STREAM_COUNT; i++) {
+        next.intervalMs[i] = rate[i] > 0.0f ? max((uint32_t)(1000.0f / rate[i]), fastestMs[i]) : 0;
+    }
+    next.valid = true;
+    plan.publish(next);
+}
+
+void PowerPlanner::printPlan() const {
+    PowerPlan current = plan.read();
+    if (!current.valid) {
+        Serial.println("Power plan: none yet, fastest rates");
+        return;
+    }
+
+    Serial.printf("Power plan (%lu s ago): %.1f mAh left, %.1f spendable over %.2f h at %.1f mA baseline, "
+                  "%.1f planned\n",
+                  (unsigned long)((millis() - current.timestamp) / 1000), current.remainingMah,
+                  current.spendableMah, current.flightSeconds / 3600.0f, current.baselineMa, current.plannedMah);
+    for (uint8_t i = 0; i < PLAN_STREAM_COUNT; i++) {
+        const char* name = planStreamToString(static_cast<PlanStream>(i));
+        if (current.intervalMs[i]) {
+            Serial.printf("  %-10s every %6.1f s  %.4f mAh each\n", name, current.intervalMs[i] / 1000.0f,
+                          current.costMah[i]);
+        } else {
+            Serial.printf("  %-10s off           %.4f mAh each\n", name, current.costMah[i]);
+        }
+    }
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static PowerPlanner powerPlannerInstance;
+
+PowerPlanner& Planner() { return powerPlannerInstance; }
+
+// ===========================
+// Utility Functions
+// ===========================
+
+const char* planStreamToString(PlanStream stream) {
+    switch (stream) {
+        case PlanStream::CAPTURE: return "Capture";
+        case PlanStream::TELEMETRY: return "Telemetry";
+        case PlanStream::GPS: return "GPS";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef POWER_PLANNER_H
+#define POWER_PLANNER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "snapshot.h"
+
+// ===========================
+// Power Planner
+// Capture, telemetry and GPS report rates chosen so the battery reaches
+// the recovery reserve as the flight ends
+// ===========================
+
+// Each plan takes what is left (PowerManager's coulomb count off the
+// energy ledger), the flight time still ahead, and what each action costs:
+//
+//   flight ahead  ground: EMERGENCY_MAX_FLIGHT_TIME; ascent: that less the
+//                 time since launch, never less than the descent from here;
+//                 apex and descent: height above launch / descent rate;
+//                 landed: none - recovery rates until the reserve runs out
+//   baseline      the ledger's CPU, GPS, RX and sensor draw over the last
+//                 plan, which go on whatever is scheduled
+//   telemetry/GPS one frame of airtime at the current rate and TX power
+//   capture       the camera's ledger charge per capture, learned, and the
+//                 airtime of the bytes sent per image, learned
+//
+// Spendable = remaining - reserve - baseline x flight ahead. Every stream
+// starts at its slowest (capture off); what's left goes to the streams in
+// order of bytes returned per mAh, each raised to its fastest before the
+// next - the rates are independent and linear, so that greedy fill is the
+// most data for the charge. Replanned every POWER_PLAN_INTERVAL_MS, so
+// estimate errors are corrected while there is still flight to correct in.
+
+#define POWER_PLAN_INTERVAL_MS         60000
+#define POWER_PLAN_TELEMETRY_SLOWEST_MS 60000   // Floors - tracking doesn't stop
+#define POWER_PLAN_GPS_SLOWEST_MS      120000
+#define POWER_PLAN_CAPTURE_SLOWEST_MS  600000   // Any slower and the camera is left off
+#define POWER_PLAN_DESCENT_MPS         5.0f     // Used until the filter shows a faster descent
+#define POWER_PLAN_CAPTURE_PRIOR_S     1.5f     // Camera awake per capture until measured
+#define POWER_PLAN_IMAGE_PRIOR_BYTES   6000     // Sent per capture until measured
+#define POWER_PLAN_LEARN_GAIN          0.25f    // Weight of each plan's measurement in the learned costs
+
+enum class PlanStream : uint8_t {
+    CAPTURE = 0,
+    TELEMETRY,
+    GPS,
+    COUNT
+};
+
+#define PLAN_STREAM_COUNT static_cast<uint8_t>(PlanStream::COUNT)
+
+struct PowerPlan {
+    uint32_t intervalMs[PLAN_STREAM_COUNT];     // 0 = stopped
+    float costMah[PLAN_STREAM_COUNT];           // Per action
+    float remainingMah;
+    float spendableMah;         // Above the reserve and the baseline to the end of the flight
+    float plannedMah;           // What the rates below spend of it
+    float baselineMa;
+    float flightSeconds;        // Still ahead
+    uint32_t timestamp;         // millis()
+    bool valid;
+};
+
+class PowerPlanner {
+public:
+    PowerPlanner();
+
+    // Fastest interval of each stream - what a full battery runs at
+    void begin(uint32_t captureMs, uint32_t telemetryMs, uint32_t gpsMs);
+
+    // From loop(); plans when POWER_PLAN_INTERVAL_MS has passed
+    void update();
+    void replan();
+
+    // A capture, and the image bytes it queued for the downlink (0 if not sent); loop() only
+    void onCapture(size_t bytesSent);
+
+    // The plan's interval, or the fastest before the first plan; 0 = stopped
+    uint32_t getInterval(PlanStream stream) const;
+    PowerPlan getPlan() const { return plan.read(); }
+
+    void printPlan() const;
+
+private:
+    uint32_t fastestMs[PLAN_STREAM_COUNT];
+    Snapshot<PowerPlan> plan;
+    uint32_t lastPlanTime;
+
+    // Ledger readings at the last plan, for the deltas
+    int64_t lastPlanUs;
+    float lastBaselineMah;
+    float lastCameraMah;
+    float baselineMa;
+
+    // Learned capture costs
+    uint32_t captures;
+    uint32_t bytesSent;
+    uint32_t lastCaptures;
+    uint32_t lastBytesSent;
+    float cameraMahPerCapture;
+    float bytesPerCapture;
+
+    float flightSecondsAhead() const;
+    float frameCostMah(size_t payloadBytes) const;
+    void learnCosts();
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern PowerPlanner& Planner();
+
+const char* planStreamToString(PlanStream stream);
+
+#endif // POWER_PLANNER_H
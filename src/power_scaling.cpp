@@ -0,0 +1,242 @@
+#include "power_scaling.h"
+#include "energy_ledger.h"
+#include "time_service.h"
+
+// ===========================
+// Power Lock
+// ===========================
+
+PowerLock::PowerLock(const char* name, PowerLockType type)
+    : name(name), type(type), held(false), handle(nullptr), mux(portMUX_INITIALIZER_UNLOCKED) {
+}
+
+void PowerLock::hold(bool hold) {
+    if (hold == held) {
+        return;
+    }
+
+#if CONFIG_PM_ENABLE
+    if (!handle) {
+        // Allocates, so outside the critical section; a racing first hold keeps one
+        static const esp_pm_lock_type_t types[] = {ESP_PM_CPU_FREQ_MAX, ESP_PM_APB_FREQ_MAX, ESP_PM_NO_LIGHT_SLEEP};
+        esp_pm_lock_handle_t created = nullptr;
+        esp_pm_lock_create(types[static_cast<uint8_t>(type)], 0, name, &created);
+        portENTER_CRITICAL(&mux);
+        if (!handle) {
+            handle = created;
+            created = nullptr;
+        }
+        portEXIT_CRITICAL(&mux);
+        if (created) {
+            esp_pm_lock_delete(created);
+        }
+    }
+#endif
+
+    portENTER_CRITICAL(&mux);
+    if (held != hold) {
+        held = hold;
+#if CONFIG_PM_ENABLE
+        if (handle) {
+            if (hold) {
+                esp_pm_lock_acquire(handle);
+            } else {
+                esp_pm_lock_release(handle);
+            }
+        }
+#endif
+        PowerScale().onLockChange(type, hold);
+    }
+    portEXIT_CRITICAL(&mux);
+}
+
+// ===========================
+// Power Scaling
+// ===========================
+
+PowerScaling::PowerScaling() : mux(portMUX_INITIALIZER_UNLOCKED) {
+    enabled = false;
+    lightSleep = false;
+    maxMhz = 0;
+    minMhz = 0;
+    floorMhz = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        held[i] = 0;
+    }
+    level = PowerLevel::MIN;
+    levelSinceUs = 0;
+    for (uint8_t i = 0; i < POWER_LEVEL_COUNT; i++) {
+        levelUs[i] = 0;
+    }
+}
+
+bool PowerScaling::begin(uint32_t maxMhz, uint32_t minMhz, bool lightSleep) {
+#if CONFIG_PM_ENABLE
+    this->maxMhz = maxMhz;
+    this->minMhz = min(minMhz, maxMhz);
+    floorMhz = minMhz;
+    this->lightSleep = lightSleep;
+
+    if (!configure()) {
+        // ESP_ERR_NOT_SUPPORTED without tickless idle - DFS on its own is most of the saving
+        this->lightSleep = false;
+        if (!lightSleep || !configure()) {
+            return false;
+        }
+    }
+
+    portENTER_CRITICAL(&mux);
+    enabled = true;
+    level = currentLevel();
+    levelSinceUs = TimeService::nowUs();
+    for (uint8_t i = 0; i < POWER_LEVEL_COUNT; i++) {
+        levelUs[i] = 0;
+    }
+    reportCpuCurrent();
+    portEXIT_CRITICAL(&mux);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool PowerScaling::configure() {
+    esp_pm_config_t config = {};
+    config.max_freq_mhz = maxMhz;
+    config.min_freq_mhz = minMhz;
+    config.light_sleep_enable = lightSleep;
+    return esp_pm_configure(&config) == ESP_OK;
+}
+
+bool PowerScaling::setMaxFrequency(uint32_t mhz) {
+    if (!enabled) {
+        return false;
+    }
+
+    uint32_t oldMax = maxMhz;
+    uint32_t oldMin = minMhz;
+    maxMhz = mhz;
+    minMhz = min(floorMhz, mhz);
+    if (!configure()) {
+        maxMhz = oldMax;
+        minMhz = oldMin;
+        return false;
+    }
+
+    // The level's frequency changed under it
+    portENTER_CRITICAL(&mux);
+    reportCpuCurrent();
+    portEXIT_CRITICAL(&mux);
+    return true;
+}
+
+uint32_t PowerScaling::getLevelFrequency(PowerLevel level) const {
+    switch (level) {
+        case PowerLevel::MAX: return maxMhz;
+        case PowerLevel::APB: return max(min((uint32_t)POWER_APB_MAX_MHZ, maxMhz), minMhz);
+        default: return minMhz;
+    }
+}
+
+PowerLevel PowerScaling::currentLevel() const {
+    if (held[static_cast<uint8_t>(PowerLockType::CPU_MAX)]) {
+        return PowerLevel::MAX;
+    }
+    if (held[static_cast<uint8_t>(PowerLockType::APB_MAX)]) {
+        return PowerLevel::APB;
+    }
+    if (held[static_cast<uint8_t>(PowerLockType::NO_SLEEP)]) {
+        return PowerLevel::MIN_AWAKE;
+    }
+    return PowerLevel::MIN;
+}
+
+void PowerScaling::onLockChange(PowerLockType type, bool hold) {
+    int64_t now = TimeService::nowUs();
+    portENTER_CRITICAL(&mux);
+    uint16_t& count = held[static_cast<uint8_t>(type)];
+    count = hold ? count + 1 : (count ? count - 1 : 0);
+
+    PowerLevel next = currentLevel();
+    if (enabled && next != level) {
+        levelUs[static_cast<uint8_t>(level)] += now - levelSinceUs;
+        levelSinceUs = now;
+        level = next;
+        reportCpuCurrent();
+    } else {
+        level = next;
+    }
+    portEXIT_CRITICAL(&mux);
+}
+
+void PowerScaling::reportCpuCurrent() const {
+    // Dynamic power with the clock; light sleep isn't seen, so MIN is counted awake
+    Energy().setActiveCurrent(EnergyLoad::CPU, ENERGY_CPU_MA_240MHZ * getLevelFrequency(level) / 240.0f);
+}
+
+PowerLevel PowerScaling::getLevel() const {
+    portENTER_CRITICAL(&mux);
+    PowerLevel current = level;
+    portEXIT_CRITICAL(&mux);
+    return current;
+}
+
+float PowerScaling::getLevelSeconds(PowerLevel which) const {
+    int64_t now = TimeService::nowUs();
+    portENTER_CRITICAL(&mux);
+    int64_t total = levelUs[static_cast<uint8_t>(which)];
+    if (enabled && which == level) {
+        total += now - levelSinceUs;
+    }
+    portEXIT_CRITICAL(&mux);
+    return total / 1e6f;
+}
+
+void PowerScaling::printStatus() const {
+    if (!enabled) {
+        Serial.printf("Power scaling: off, CPU fixed at %lu MHz\n", (unsigned long)getCpuFrequencyMhz());
+        return;
+    }
+
+    float seconds[POWER_LEVEL_COUNT];
+    float total = 0.0f;
+    for (uint8_t i = 0; i < POWER_LEVEL_COUNT; i++) {
+        seconds[i] = getLevelSeconds(static_cast<PowerLevel>(i));
+        total += seconds[i];
+    }
+
+    Serial.printf("Power scaling: DFS %lu-%lu MHz, light sleep %s, now %s at %lu MHz\n", (unsigned long)minMhz,
+                  (unsigned long)maxMhz, lightSleep ? "on" : "off", powerLevelToString(getLevel()),
+                  (unsigned long)getCpuFrequencyMhz());
+    for (uint8_t i = 0; i < POWER_LEVEL_COUNT; i++) {
+        PowerLevel which = static_cast<PowerLevel>(i);
+        Serial.printf("  %-10s %3lu MHz  %9.1f s  %5.1f%%\n", powerLevelToString(which),
+                      (unsigned long)getLevelFrequency(which), seconds[i],
+                      total > 0.0f ? 100.0f * seconds[i] / total : 0.0f);
+    }
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);     // The IDF's own figures, WiFi's locks included
+#endif
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static PowerScaling powerScalingInstance;
+
+PowerScaling& PowerScale() { return powerScalingInstance; }
+
+// ===========================
+// Utility Functions
+// ===========================
+
+const char* powerLevelToString(PowerLevel level) {
+    switch (level) {
+        case PowerLevel::MAX: return "Max";
+        case PowerLevel::APB: return "APB";
+        case PowerLevel::MIN_AWAKE: return "Min awake";
+        case PowerLevel::MIN: return "Min";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef POWER_SCALING_H
+#define POWER_SCALING_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+
+// ===========================
+// Power Scaling
+// Dynamic frequency scaling and automatic light sleep through esp_pm, with
+// subsystems holding locks only while they are doing something
+// ===========================
+
+// With DFS configured the clock sits at PM_MIN_FREQ_MHZ unless a lock says
+// otherwise: CPU_MAX for work that wants the full clock (loop(), a capture,
+// a stream), APB_MAX for peripherals clocked from the APB (the camera's
+// XCLK comes from LEDC), NO_SLEEP for anything that can't miss an edge or a
+// byte - a listening radio, the GPS UART. With none held and light sleep
+// enabled the idle task sleeps the chip until the next timeout.
+//
+// PowerLock::hold() is idempotent, so owners call it at each state change
+// the way they report to the energy ledger. Every hold goes through here,
+// which is how the time at each level is measured; locks the IDF takes for
+// itself (WiFi) can raise the clock without showing up in those figures.
+//
+// Light sleep needs tickless idle in the IDF build. Without it begin()
+// falls back to DFS alone; without CONFIG_PM_ENABLE neither is available,
+// locks are no-ops and the clock stays where setCpuFrequencyMhz() put it.
+
+enum class PowerLockType : uint8_t {
+    CPU_MAX = 0,
+    APB_MAX,
+    NO_SLEEP
+};
+
+// What the held locks allow, highest first
+enum class PowerLevel : uint8_t {
+    MAX = 0,            // PM max - a CPU lock
+    APB,                // 80 MHz - an APB lock
+    MIN_AWAKE,          // PM min, kept awake by a NO_SLEEP lock
+    MIN,                // PM min, light sleep allowed (when enabled)
+    COUNT
+};
+
+#define POWER_LEVEL_COUNT static_cast<uint8_t>(PowerLevel::COUNT)
+#define POWER_APB_MAX_MHZ          80      // CPU clock the IDF keeps for an APB lock
+
+class PowerLock {
+public:
+    PowerLock(const char* name, PowerLockType type);
+
+    void hold(bool held);
+    bool isHeld() const { return held; }
+    const char* getName() const { return name; }
+
+private:
+    const char* name;
+    PowerLockType type;
+    volatile bool held;
+    esp_pm_lock_handle_t handle;    // Created on the first hold
+    portMUX_TYPE mux;
+};
+
+class PowerScaling {
+public:
+    PowerScaling();
+
+    // esp_pm_configure() with DFS between the two clocks, and light sleep if
+    // asked and built in; false if DFS isn't available
+    bool begin(uint32_t maxMhz, uint32_t minMhz, bool lightSleep);
+
+    bool isEnabled() const { return enabled; }
+    bool isLightSleepEnabled() const { return lightSleep; }
+
+    // Top of the range, for the power states; min follows it down
+    bool setMaxFrequency(uint32_t mhz);
+    uint32_t getMaxFrequency() const { return maxMhz; }
+    uint32_t getMinFrequency() const { return minMhz; }
+    uint32_t getLevelFrequency(PowerLevel level) const;
+
+    PowerLevel getLevel() const;
+    float getLevelSeconds(PowerLevel level) const;      // Since begin()
+
+    void printStatus() const;
+
+    // PowerLock bookkeeping
+    void onLockChange(PowerLockType type, bool held);
+
+private:
+    bool enabled;
+    bool lightSleep;
+    uint32_t maxMhz;
+    uint32_t minMhz;
+    uint32_t floorMhz;                  // The min begin() asked for; minMhz is lower only below it
+
+    uint16_t held[3];                   // By PowerLockType
+    PowerLevel level;
+    int64_t levelSinceUs;
+    int64_t levelUs[POWER_LEVEL_COUNT];
+    mutable portMUX_TYPE mux;
+
+    bool configure();
+    PowerLevel currentLevel() const;
+    void reportCpuCurrent() const;
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern PowerScaling& PowerScale();
+
+const char* powerLevelToString(PowerLevel level);
+
+#endif // POWER_SCALING_H
@@ -0,0 +1,182 @@
+#include "pressure_profile.h"
+#include <math.h>
+
+static_assert(PROFILE_FINE_BELOW_PA % PROFILE_BIN_PA == 0, "The fine levels start on a boundary");
+static_assert(PROFILE_HYSTERESIS_PA < PROFILE_FINE_BIN_PA / 2, "Hysteresis within half the finest level");
+
+static void putBe16(uint8_t* out, uint16_t value) {
+    out[0] = value >> 8;
+    out[1] = value & 0xFF;
+}
+
+static void putBe32(uint8_t* out, uint32_t value) {
+    putBe16(out, value >> 16);
+    putBe16(out + 2, value & 0xFFFF);
+}
+
+static uint16_t getBe16(const uint8_t* in) {
+    return (uint16_t)in[0] << 8 | in[1];
+}
+
+static uint32_t getBe32(const uint8_t* in) {
+    return (uint32_t)getBe16(in) << 16 | getBe16(in + 2);
+}
+
+static int16_t scaled16(float value, float scale) {
+    return (int16_t)constrain(lroundf(value * scale), (long)INT16_MIN, (long)INT16_MAX);
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+PressureProfile::PressureProfile() {
+    levels = 0;
+    dropped = 0;
+    reset();
+}
+
+void PressureProfile::reset() {
+    open = false;
+    partial = true;
+    binLow = 0;
+    binWidth = 0;
+    startTime = 0;
+    lastTime = 0;
+    coMoment = 0.0;
+}
+
+void PressureProfile::binFor(float pressure, uint32_t& low, uint16_t& width) {
+    uint32_t pa = pressure > 0.0f ? (uint32_t)pressure : 0;
+    width = pa < PROFILE_FINE_BELOW_PA ? PROFILE_FINE_BIN_PA : PROFILE_BIN_PA;
+    low = pa - pa % width;
+}
+
+// ===========================
+// Binning
+// ===========================
+
+void PressureProfile::start(uint32_t time, float pressure, bool acrossBoundary) {
+    binFor(pressure, binLow, binWidth);
+    open = true;
+    partial = !acrossBoundary;
+    startTime = time;
+    lastTime = time;
+    seconds = RunningStats();
+    pressureStats = RunningStats();
+    altitudeStats = RunningStats();
+    temperatureStats = RunningStats();
+    speedStats = RunningStats();
+    coMoment = 0.0;
+}
+
+bool PressureProfile::add(uint32_t time, float pressure, float temperature, float altitude, float verticalSpeed,
+                          ProfileLevel& level) {
+    if (!(pressure > 0.0f) || isnan(temperature)) {
+        return false;
+    }
+
+    bool closed = false;
+    if (open && time - lastTime > PROFILE_MAX_GAP_MS) {
+        dropped++;
+        open = false;
+    }
+    if (!open) {
+        start(time, pressure, false);
+    } else if (pressure < (float)binLow - PROFILE_HYSTERESIS_PA ||
+               pressure >= (float)(binLow + binWidth) + PROFILE_HYSTERESIS_PA) {
+        closed = close(level);
+        start(time, pressure, true);
+    }
+
+    // The trend's co-moment takes the time's old mean and the temperature's new one
+    float t = (time - startTime) / 1000.0f;
+    double dt = t - seconds.mean;
+    runningStatsAdd(seconds, t);
+    runningStatsAdd(temperatureStats, temperature);
+    coMoment += dt * (temperature - temperatureStats.mean);
+    runningStatsAdd(pressureStats, pressure);
+    runningStatsAdd(altitudeStats, altitude);
+    runningStatsAdd(speedStats, verticalSpeed);
+    lastTime = time;
+    return closed;
+}
+
+bool PressureProfile::close(ProfileLevel& level) {
+    open = false;
+    float speed = speedStats.mean;
+    ProfileDirection direction = speed > PROFILE_MIN_RATE    ? ProfileDirection::ASCENT
+                                 : speed < -PROFILE_MIN_RATE ? ProfileDirection::DESCENT
+                                                            : ProfileDirection::FLOAT;
+    if (direction == ProfileDirection::FLOAT || temperatureStats.count < PROFILE_MIN_SAMPLES) {
+        dropped++;
+        return false;
+    }
+
+    float trend = seconds.m2 > 0.0 ? (float)(coMoment / seconds.m2) : 0.0f;
+    level.binLow = binLow;
+    level.binWidth = binWidth;
+    level.direction = direction;
+    level.flags = (partial ? PROFILE_FLAG_PARTIAL : 0) | (temperatureStats.count > UINT16_MAX ? PROFILE_FLAG_SATURATED : 0);
+    level.samples = min(temperatureStats.count, (uint32_t)UINT16_MAX);
+    level.durationMs = lastTime - startTime;
+    level.endTime = lastTime;
+    level.pressure = pressureStats.mean;
+    level.altitude = altitudeStats.mean;
+    level.temperature = temperatureStats.mean;
+    level.correctedTemperature = level.temperature + PROFILE_TEMP_LAG_S * trend;
+    level.temperatureSd = sqrtf(runningStatsVariance(temperatureStats));
+    level.verticalSpeed = speed;
+    level.temperatureTrend = trend;
+    levels++;
+    return true;
+}
+
+// ===========================
+// Payload
+// ===========================
+
+size_t profileEncode(const ProfileLevel& level, uint8_t* out) {
+    putBe16(out, level.binLow / 10);
+    out[2] = level.binWidth / 10;
+    out[3] = static_cast<uint8_t>(level.direction) | level.flags;
+    putBe16(out + 4, level.samples);
+    putBe16(out + 6, min(level.durationMs / 100, (uint32_t)UINT16_MAX));
+    putBe32(out + 8, (uint32_t)lroundf(level.pressure * 10.0f));
+    putBe32(out + 12, (uint32_t)(int32_t)lroundf(level.altitude * 100.0f));
+    putBe16(out + 16, scaled16(level.temperature, 100.0f));
+    putBe16(out + 18, scaled16(level.correctedTemperature, 100.0f));
+    putBe16(out + 20, scaled16(level.temperatureSd, 100.0f));
+    putBe16(out + 22, scaled16(level.verticalSpeed, 100.0f));
+    putBe16(out + 24, scaled16(level.temperatureTrend, 1000.0f));
+    return PROFILE_PAYLOAD_SIZE;
+}
+
+bool profileDecode(const uint8_t* payload, size_t length, ProfileLevel& level) {
+    if (length < PROFILE_PAYLOAD_SIZE || (payload[3] & 0x03) > static_cast<uint8_t>(ProfileDirection::DESCENT)) {
+        return false;
+    }
+    level.binLow = getBe16(payload) * 10u;
+    level.binWidth = payload[2] * 10u;
+    level.direction = static_cast<ProfileDirection>(payload[3] & 0x03);
+    level.flags = payload[3] & ~0x03;
+    level.samples = getBe16(payload + 4);
+    level.durationMs = getBe16(payload + 6) * 100u;
+    level.endTime = 0;
+    level.pressure = getBe32(payload + 8) / 10.0f;
+    level.altitude = (int32_t)getBe32(payload + 12) / 100.0f;
+    level.temperature = (int16_t)getBe16(payload + 16) / 100.0f;
+    level.correctedTemperature = (int16_t)getBe16(payload + 18) / 100.0f;
+    level.temperatureSd = (int16_t)getBe16(payload + 20) / 100.0f;
+    level.verticalSpeed = (int16_t)getBe16(payload + 22) / 100.0f;
+    level.temperatureTrend = (int16_t)getBe16(payload + 24) / 1000.0f;
+    return true;
+}
+
+const char* profileDirectionToString(ProfileDirection direction) {
+    switch (direction) {
+        case ProfileDirection::ASCENT: return "ascent";
+        case ProfileDirection::DESCENT: return "descent";
+        default: return "float";
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef PRESSURE_PROFILE_H
+#define PRESSURE_PROFILE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "running_stats.h"
+
+// ===========================
+// Pressure Profile
+// Temperature and height per pressure level, binned on the balloon as it
+// climbs and falls: one PROFILE_LEVEL packet per level in place of the
+// 1 Hz readings it summarises
+// ===========================
+
+// Levels are PROFILE_BIN_PA wide down to PROFILE_FINE_BELOW_PA, and
+// PROFILE_FINE_BIN_PA above it, where 10 hPa would span kilometres. Every
+// BMP280 sample goes into the level it falls in; the level closes when a
+// sample lands more than PROFILE_HYSTERESIS_PA outside it, so the noise at a
+// boundary doesn't flap between two. A closed level is sent when its mean
+// vertical speed says the balloon was climbing or falling through it and it
+// holds PROFILE_MIN_SAMPLES; float and the pad stay in one level for hours
+// and end up dropped. A gap over PROFILE_MAX_GAP_MS drops the level open.
+//
+// The sensor reads behind the air by its time constant, PROFILE_TEMP_LAG_S
+// in the payload's airflow: the temperature it gives is the one lag seconds
+// ago. The level's least-squares trend against time, dT/dt, is the ascent
+// rate times the lapse rate, so its mean plus lag * dT/dt is what the air
+// was at the level. The trend goes down as well, for the ground to redo the
+// correction with a measured constant.
+//
+// PROFILE_LEVEL payload, big endian:
+//   [0-1]   the level's low pressure bound, 10 Pa
+//   [2]     its width, 10 Pa
+//   [3]     ProfileDirection in bits 0-1, PROFILE_FLAG_* above
+//   [4-5]   samples
+//   [6-7]   time in the level, 0.1 s
+//   [8-11]  mean pressure, 0.1 Pa
+//   [12-15] mean altitude, cm
+//   [16-17] mean temperature, 0.01 °C
+//   [18-19] lag corrected temperature, 0.01 °C
+//   [20-21] temperature standard deviation, 0.01 °C
+//   [22-23] mean vertical speed, cm/s
+//   [24-25] temperature trend, mK/s
+// The packet's timestamp is the level's last sample.
+
+#define PROFILE_BIN_PA             1000    // 10 hPa
+#define PROFILE_FINE_BIN_PA        100     // 1 hPa, above the level below
+#define PROFILE_FINE_BELOW_PA      10000   // 100 hPa, about 16 km
+#define PROFILE_HYSTERESIS_PA      20
+#define PROFILE_MIN_SAMPLES        8
+#define PROFILE_MIN_RATE           0.5f    // m/s; slower through a level is float
+#define PROFILE_MAX_GAP_MS         10000
+#define PROFILE_TEMP_LAG_S         20.0f   // Fit it from a step on the bench, ventilated
+#define PROFILE_PAYLOAD_SIZE       26
+
+#define PROFILE_FLAG_PARTIAL       0x04    // Not entered across a boundary: the first after boot or a gap
+#define PROFILE_FLAG_SATURATED     0x08    // More samples than the field holds
+
+enum class ProfileDirection : uint8_t {
+    FLOAT = 0,
+    ASCENT,
+    DESCENT
+};
+
+struct ProfileLevel {
+    uint32_t binLow;                // Pa
+    uint16_t binWidth;              // Pa
+    ProfileDirection direction;
+    uint8_t flags;                  // PROFILE_FLAG_*
+    uint16_t samples;
+    uint32_t durationMs;
+    uint32_t endTime;               // millis() of the last sample
+    float pressure;                 // Pa
+    float altitude;                 // m
+    float temperature;              // °C
+    float correctedTemperature;     // °C
+    float temperatureSd;            // °C
+    float verticalSpeed;            // m/s
+    float temperatureTrend;         // °C/s
+};
+
+class PressureProfile {
+public:
+    PressureProfile();
+
+    void reset();                   // The level open is dropped
+
+    // One sample, in time order; true, with level filled, when it closed a
+    // level worth sending
+    bool add(uint32_t time, float pressure, float temperature, float altitude, float verticalSpeed,
+             ProfileLevel& level);
+
+    bool isOpen() const { return open; }
+    uint32_t getBinLow() const { return binLow; }
+    uint32_t getLevels() const { return levels; }
+    uint32_t getDropped() const { return dropped; }
+
+    // The bin pressure falls in
+    static void binFor(float pressure, uint32_t& low, uint16_t& width);
+
+private:
+    bool open;
+    bool partial;
+    uint32_t binLow;
+    uint16_t binWidth;
+    uint32_t startTime;
+    uint32_t lastTime;
+    RunningStats seconds;           // Since startTime
+    RunningStats pressureStats;
+    RunningStats altitudeStats;
+    RunningStats temperatureStats;
+    RunningStats speedStats;
+    double coMoment;                // Of seconds and temperature, for the trend
+
+    uint32_t levels;
+    uint32_t dropped;
+
+    void start(uint32_t time, float pressure, bool acrossBoundary);
+    bool close(ProfileLevel& level);
+};
+
+// Payload into out, PROFILE_PAYLOAD_SIZE bytes; its length
+size_t profileEncode(const ProfileLevel& level, uint8_t* out);
+// endTime is left 0 - it is the packet's timestamp
+bool profileDecode(const uint8_t* payload, size_t length, ProfileLevel& level);
+
+const char* profileDirectionToString(ProfileDirection direction);
+
+#endif // PRESSURE_PROFILE_H
@@ -0,0 +1,124 @@
+#include "preview_frame.h"
+
+// 4x4 Bayer thresholds, scaled to the middle of each sixteenth of a level
+static const uint8_t BAYER_4X4[4][4] = {
+    {  8, 136,  40, 168},
+    {200,  72, 232, 104},
+    { 56, 184,  24, 152},
+    {248, 120, 216,  88}
+};
+
+static bool previewDepthValid(uint8_t bits) {
+    return bits == 1 || bits == 2 || bits == 4;
+}
+
+size_t previewRowBytes(uint16_t width, uint8_t bits) {
+    if (width == 0 || width > PREVIEW_MAX_WIDTH || !previewDepthValid(bits)) {
+        return 0;
+    }
+    return ((size_t)width * bits + 7) / 8;
+}
+
+// ===========================
+// Dither and Pack
+// ===========================
+
+bool previewPack(const uint8_t* gray, uint16_t width, uint16_t height, uint8_t bits, PreviewFrame& frame) {
+    size_t rowBytes = previewRowBytes(width, bits);
+    frame.valid = false;
+    if (!gray || rowBytes == 0 || height == 0 || height > PREVIEW_MAX_HEIGHT ||
+        rowBytes * height > PREVIEW_MAX_BYTES) {
+        return false;
+    }
+
+    // Level = (v * (levels - 1) + threshold) / 256: a pixel between two levels
+    // takes the upper one on the share of the matrix its fraction covers
+    uint8_t top = (1 << bits) - 1;
+    uint8_t perByte = 8 / bits;
+    for (uint16_t y = 0; y < height; y++) {
+        const uint8_t* thresholds = BAYER_4X4[y & 3];
+        const uint8_t* in = &gray[(size_t)y * width];
+        uint8_t* out = &frame.pixels[y * rowBytes];
+        memset(out, 0, rowBytes);
+        for (uint16_t x = 0; x < width; x++) {
+            uint16_t level = ((uint16_t)in[x] * top + thresholds[x & 3]) >> 8;
+            if (level > top) {
+                level = top;
+            }
+            out[x / perByte] |= level << (8 - bits * (x % perByte + 1));
+        }
+    }
+
+    frame.width = width;
+    frame.height = height;
+    frame.bits = bits;
+    frame.valid = true;
+    return true;
+}
+
+void previewUnpack(const uint8_t* packed, uint16_t width, uint16_t rows, uint8_t bits, uint8_t* gray) {
+    size_t rowBytes = previewRowBytes(width, bits);
+    if (rowBytes == 0) {
+        return;
+    }
+
+    uint8_t top = (1 << bits) - 1;
+    uint8_t perByte = 8 / bits;
+    for (uint16_t y = 0; y < rows; y++) {
+        const uint8_t* in = &packed[y * rowBytes];
+        uint8_t* out = &gray[(size_t)y * width];
+        for (uint16_t x = 0; x < width; x++) {
+            uint8_t level = (in[x / perByte] >> (8 - bits * (x % perByte + 1))) & top;
+            out[x] = level * 255 / top;
+        }
+    }
+}
+
+// ===========================
+// Bands
+// ===========================
+
+uint8_t previewRowsPerBand(const PreviewFrame& frame, size_t maxPayload) {
+    size_t rowBytes = previewRowBytes(frame.width, frame.bits);
+    if (!frame.valid || rowBytes == 0 || maxPayload < PREVIEW_HEADER_SIZE + rowBytes) {
+        return 0;
+    }
+    size_t most = (maxPayload - PREVIEW_HEADER_SIZE) / rowBytes;
+    size_t bands = (frame.height + most - 1) / most;
+    return (frame.height + bands - 1) / bands;
+}
+
+size_t previewBand(const PreviewFrame& frame, uint16_t imageId, uint8_t firstRow, uint8_t rows, uint8_t* out) {
+    size_t rowBytes = previewRowBytes(frame.width, frame.bits);
+    if (!frame.valid || rowBytes == 0 || rows == 0 || firstRow + rows > frame.height) {
+        return 0;
+    }
+
+    out[0] = imageId >> 8;
+    out[1] = imageId & 0xFF;
+    out[2] = frame.width;
+    out[3] = frame.height;
+    out[4] = frame.bits;
+    out[5] = firstRow;
+    out[6] = rows;
+    memcpy(&out[PREVIEW_HEADER_SIZE], &frame.pixels[firstRow * rowBytes], rows * rowBytes);
+    return PREVIEW_HEADER_SIZE + rows * rowBytes;
+}
+
+bool previewParseBand(const uint8_t* payload, size_t length, PreviewBand& band) {
+    if (length < PREVIEW_HEADER_SIZE) {
+        return false;
+    }
+    band.imageId = (payload[0] << 8) | payload[1];
+    band.width = payload[2];
+    band.height = payload[3];
+    band.bits = payload[4];
+    band.firstRow = payload[5];
+    band.rows = payload[6];
+    band.data = &payload[PREVIEW_HEADER_SIZE];
+
+    size_t rowBytes = previewRowBytes(band.width, band.bits);
+    return rowBytes > 0 && band.height > 0 && band.height <= PREVIEW_MAX_HEIGHT && band.rows > 0 &&
+           band.firstRow + band.rows <= band.height &&
+           length == PREVIEW_HEADER_SIZE + band.rows * rowBytes;
+}
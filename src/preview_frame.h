@@ -0,0 +1,66 @@
+#ifndef PREVIEW_FRAME_H
+#define PREVIEW_FRAME_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Preview Frame
+// A few hundred bytes of grayscale, ordered-dithered down to 1, 2 or 4 bits
+// per pixel, sent ahead of everything else from a capture
+// ===========================
+
+// The camera box-scales its analysis luma plane (image_scale.h) to the
+// preview size; previewPack() then dithers it against a 4x4 Bayer matrix
+// and packs it MSB first, each row starting on a byte. 40x30 at 2 bits is
+// 300 bytes, two frames. There is no codec to run at either end: the ground
+// shows a band the moment it arrives, and a lost band is only those rows.
+//
+// CAMERA_PREVIEW payload, standalone packets of whole rows:
+//   [0-1]  image id (big endian, CameraData::imageId)
+//   [2]    width, [3] height, [4] bits per pixel
+//   [5]    first row, [6] rows
+//   [7..]  the rows, previewRowBytes() each
+
+#define PREVIEW_HEADER_SIZE     7
+#define PREVIEW_MAX_WIDTH       80
+#define PREVIEW_MAX_HEIGHT      64      // The ground's row bitmap is 64 bits
+#define PREVIEW_MAX_BYTES       (PREVIEW_MAX_WIDTH * PREVIEW_MAX_HEIGHT / 2)
+
+struct PreviewFrame {
+    uint8_t width;
+    uint8_t height;
+    uint8_t bits;               // Per pixel: 1, 2 or 4
+    bool valid;
+    uint8_t pixels[PREVIEW_MAX_BYTES];
+};
+
+// One CAMERA_PREVIEW band as parsed; rows points into the payload
+struct PreviewBand {
+    uint16_t imageId;
+    uint8_t width;
+    uint8_t height;
+    uint8_t bits;
+    uint8_t firstRow;
+    uint8_t rows;
+    const uint8_t* data;
+};
+
+// Bytes per packed row, 0 for a width or depth out of range
+size_t previewRowBytes(uint16_t width, uint8_t bits);
+
+// Dither and pack width x height 8-bit gray into frame; false if the size
+// or depth is out of range
+bool previewPack(const uint8_t* gray, uint16_t width, uint16_t height, uint8_t bits, PreviewFrame& frame);
+
+// Rows of packed pixels back to 8-bit gray, each level spread over 0-255
+void previewUnpack(const uint8_t* packed, uint16_t width, uint16_t rows, uint8_t bits, uint8_t* gray);
+
+// Rows per packet so the bands come out about even, none over maxPayload
+uint8_t previewRowsPerBand(const PreviewFrame& frame, size_t maxPayload);
+
+// Band payload into out (PREVIEW_HEADER_SIZE + rows * previewRowBytes()); its length
+size_t previewBand(const PreviewFrame& frame, uint16_t imageId, uint8_t firstRow, uint8_t rows, uint8_t* out);
+bool previewParseBand(const uint8_t* payload, size_t length, PreviewBand& band);
+
+#endif // PREVIEW_FRAME_H
@@ -0,0 +1,227 @@
+#include "radio_driver.h"
+#include "esp_timer.h"
+
+// SX127x registers accessed directly - the CAD result isn't exposed by the
+// library, and its FIFO access is one SPI transaction per byte
+#define RADIO_REG_FIFO             0x00
+#define RADIO_REG_IRQ_FLAGS        0x12
+#define RADIO_REG_PAYLOAD_LENGTH   0x22
+#define RADIO_REG_WRITE            0x80
+#define RADIO_IRQ_CAD_DETECTED     0x01
+#define RADIO_SPI_FREQUENCY        8000000
+
+#if LORA_RADIO_CHIP == LORA_RADIO_SX126X
+static SX126xRadio hardwareRadioInstance;
+#else
+static SX127xRadio hardwareRadioInstance;
+#endif
+
+RadioDriver& HardwareRadio() {
+    return hardwareRadioInstance;
+}
+
+#if LORA_BULK_RADIO_FITTED
+static SX126xRadio bulkRadioInstance({LORA_BULK_CS_PIN, LORA_BULK_RST_PIN, LORA_BULK_BUSY_PIN, LORA_BULK_DIO1_PIN,
+                                      LORA_BULK_SCK_PIN, LORA_BULK_MOSI_PIN, LORA_BULK_MISO_PIN, LORA_BULK_SPI_NUM});
+#endif
+
+RadioDriver* BulkHardwareRadio() {
+#if LORA_BULK_RADIO_FITTED
+    return &bulkRadioInstance;
+#else
+    return nullptr;
+#endif
+}
+
+// ===========================
+// Interrupt Glue
+// ===========================
+
+static RadioIrqHandler dio0Handler = nullptr;
+static void* dio0Context = nullptr;
+static volatile int64_t dio0TimeUs = 0;
+
+static void IRAM_ATTR onDio0Interrupt() {
+    // No SPI access here - the handler just wakes the radio task
+    dio0TimeUs = esp_timer_get_time();
+    if (dio0Handler) {
+        dio0Handler(dio0Context, true);
+    }
+}
+
+static void onTxDonePlaceholder() {
+    // Registered only so LoRa.endPacket(true) maps DIO0 to TX_DONE;
+    // the library ISR is replaced by onDio0Interrupt()
+}
+
+static uint8_t radioRegisterTransfer(uint8_t address, uint8_t value) {
+    SPI.beginTransaction(SPISettings(RADIO_SPI_FREQUENCY, MSBFIRST, SPI_MODE0));
+    digitalWrite(LORA_CS_PIN, LOW);
+    SPI.transfer(address);
+    uint8_t response = SPI.transfer(value);
+    digitalWrite(LORA_CS_PIN, HIGH);
+    SPI.endTransaction();
+    return response;
+}
+
+// One transaction for the whole FIFO run - the address auto-increments
+static void radioFifoTransfer(uint8_t address, const uint8_t* out, uint8_t* in, size_t length) {
+    SPI.beginTransaction(SPISettings(RADIO_SPI_FREQUENCY, MSBFIRST, SPI_MODE0));
+    digitalWrite(LORA_CS_PIN, LOW);
+    SPI.transfer(address);
+    if (in) {
+        SPI.transferBytes(nullptr, in, length);
+    } else {
+        SPI.writeBytes(out, length);
+    }
+    digitalWrite(LORA_CS_PIN, HIGH);
+    SPI.endTransaction();
+}
+
+size_t radioUnwrapImplicitFrame(uint8_t* buffer, size_t received) {
+    size_t length = received ? buffer[0] : 0;
+    if (length == 0 || length >= received) {
+        return 0;
+    }
+    memmove(buffer, buffer + 1, length);
+    return length;
+}
+
+// ===========================
+// SX127x Driver
+// ===========================
+
+SX127xRadio::SX127xRadio() {
+    operation = Operation::NONE;
+    implicitLength = 0;
+}
+
+bool SX127xRadio::begin(long frequency) {
+    SPI.begin(LORA_SCK_PIN, LORA_MISO_PIN, LORA_MOSI_PIN, LORA_CS_PIN);
+    LoRa.setPins(LORA_CS_PIN, LORA_RST_PIN, LORA_IRQ_PIN);
+    operation = Operation::NONE;
+    implicitLength = 0;
+    return LoRa.begin(frequency);
+}
+
+void SX127xRadio::end() {
+    LoRa.end();
+    operation = Operation::NONE;
+}
+
+void SX127xRadio::attachIrq(RadioIrqHandler handler, void* context) {
+    dio0Handler = handler;
+    dio0Context = context;
+
+    // The library installs its own ISR (which talks SPI from interrupt
+    // context), so replace it with one that only notifies the radio task
+    LoRa.onTxDone(onTxDonePlaceholder);
+    attachInterrupt(digitalPinToInterrupt(LORA_IRQ_PIN), onDio0Interrupt, RISING);
+}
+
+void SX127xRadio::detachIrq() {
+    detachInterrupt(digitalPinToInterrupt(LORA_IRQ_PIN));
+    dio0Handler = nullptr;
+    dio0Context = nullptr;
+}
+
+void SX127xRadio::startTransmit(const uint8_t* data, size_t length) {
+    // beginPacket() points the FIFO at its TX base and zeroes the length
+    LoRa.beginPacket(implicitLength != 0);
+    if (implicitLength) {
+        // The length register says how much goes out, header or not
+        length = min(length, (size_t)implicitLength - 1);
+        radioRegisterTransfer(RADIO_REG_FIFO | RADIO_REG_WRITE, length);
+        radioFifoTransfer(RADIO_REG_FIFO | RADIO_REG_WRITE, data, nullptr, length);
+        length++;
+    } else {
+        length = min(length, (size_t)255);
+        radioFifoTransfer(RADIO_REG_FIFO | RADIO_REG_WRITE, data, nullptr, length);
+    }
+    radioRegisterTransfer(RADIO_REG_PAYLOAD_LENGTH | RADIO_REG_WRITE, length);
+    operation = Operation::TRANSMIT;
+
+    // Asynchronous - DIO0 fires on TX_DONE
+    LoRa.endPacket(true);
+}
+
+void SX127xRadio::startReceive() {
+    // Continuous RX - DIO0 fires on RX_DONE
+    LoRa.receive(implicitLength);
+    operation = Operation::RECEIVE;
+}
+
+bool SX127xRadio::setImplicitHeader(uint8_t length) {
+    // Without a header to say so, the receiver can't know a CRC follows -
+    // it stays off (as LoRa.begin() leaves it) and the length register,
+    // set per operation, does the rest
+    implicitLength = length;
+    LoRa.disableCrc();
+    if (operation == Operation::RECEIVE) {
+        startReceive();
+    }
+    return true;
+}
+
+void SX127xRadio::startChannelScan() {
+    // DIO0 is remapped to CAD_DONE by the library
+    LoRa.channelActivityDetection();
+    operation = Operation::CHANNEL_SCAN;
+}
+
+void SX127xRadio::idle() {
+    LoRa.idle();
+    operation = Operation::NONE;
+}
+
+void SX127xRadio::sleep() {
+    LoRa.sleep();
+    operation = Operation::NONE;
+}
+
+RadioIrq SX127xRadio::serviceIrq(uint8_t* buffer, size_t capacity, size_t& length,
+                                 int8_t& rssi, int8_t& snr) {
+    length = 0;
+
+    switch (operation) {
+        case Operation::CHANNEL_SCAN: {
+            // Read and clear CAD_DONE / CAD_DETECTED ourselves
+            uint8_t irqFlags = radioRegisterTransfer(RADIO_REG_IRQ_FLAGS, 0x00);
+            radioRegisterTransfer(RADIO_REG_IRQ_FLAGS | 0x80, irqFlags);
+            return (irqFlags & RADIO_IRQ_CAD_DETECTED) ? RadioIrq::CAD_DETECTED : RadioIrq::CAD_CLEAR;
+        }
+
+        case Operation::TRANSMIT:
+            // parsePacket() clears the latched TX_DONE flag (and sets the
+            // header mode it's given)
+            LoRa.parsePacket(implicitLength);
+            return RadioIrq::TX_DONE;
+
+        case Operation::RECEIVE: {
+            int packetSize = LoRa.parsePacket(implicitLength);
+            if (packetSize <= 0) {
+                return RadioIrq::RX_CRC_ERROR;  // RX_DONE with the payload CRC error flag set
+            }
+
+            // parsePacket() left the FIFO pointer at the frame's start
+            length = min((size_t)packetSize, capacity);
+            radioFifoTransfer(RADIO_REG_FIFO, nullptr, buffer, length);
+            if (implicitLength) {
+                length = radioUnwrapImplicitFrame(buffer, length);
+                if (length == 0) {
+                    return RadioIrq::RX_CRC_ERROR;
+                }
+            }
+            rssi = LoRa.packetRssi();
+            snr = LoRa.packetSnr();
+            return RadioIrq::RX_DONE;
+        }
+
+        default:
+            return RadioIrq::NONE;
+    }
+}
+
+int64_t SX127xRadio::getIrqTimeUs() const {
+    return dio0TimeUs;
+}
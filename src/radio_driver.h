@@ -0,0 +1,256 @@
+#ifndef RADIO_DRIVER_H
+#define RADIO_DRIVER_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <LoRa.h>
+#include <driver/spi_master.h>
+#include "esp_attr.h"
+#include "sensor_pins.h"
+
+// ===========================
+// Radio Driver Interface
+// Everything LoRaManager asks of the transceiver
+// ===========================
+
+// Two backends, picked at build time by LORA_RADIO_CHIP: the SX127x through
+// the LoRa library with its FIFO moved in single SPI bursts, and the
+// SX1262/SX1268 on its own command set through the IDF SPI master, FIFO
+// transfers by DMA. Both are interrupt driven - one line per operation's
+// completion - and stamp the interrupt's esp_timer time in the ISR, so a
+// frame's TX done or RX done time is when it happened, not when the radio
+// task got to it.
+
+// Cause of the last interrupt, as read back by serviceIrq()
+enum class RadioIrq : uint8_t {
+    NONE = 0,
+    TX_DONE = 1,
+    RX_DONE = 2,
+    RX_CRC_ERROR = 3,
+    CAD_CLEAR = 4,
+    CAD_DETECTED = 5
+};
+
+// fromIsr is false when a simulated radio raises the interrupt from a task
+typedef void (*RadioIrqHandler)(void* context, bool fromIsr);
+
+// (G)FSK frame format, the same on every backend that has one: preamble,
+// sync word, length byte, payload, CRC-16, whitened. Modulation index 1
+// (deviation half the bit rate), BT 0.5 shaping
+#define RADIO_FSK_PREAMBLE_BYTES  4
+#define RADIO_FSK_SYNC_WORD       0x2DD4
+#define RADIO_FSK_OVERHEAD_BYTES  (RADIO_FSK_PREAMBLE_BYTES + 2 + 1 + 2)
+
+// Implicit header LoRa frame: [frame length][frame], no PHY header or CRC.
+// The receiver demodulates the whole fixed length; this takes the frame
+// out of what came in and returns its length, 0 if the prefix can't be right
+size_t radioUnwrapImplicitFrame(uint8_t* buffer, size_t received);
+
+class RadioDriver {
+public:
+    virtual ~RadioDriver() {}
+
+    virtual bool begin(long frequency) = 0;
+    virtual void end() = 0;
+
+    // One interrupt line: TX done, RX done or CAD done depending on the operation
+    virtual void attachIrq(RadioIrqHandler handler, void* context) = 0;
+    virtual void detachIrq() = 0;
+
+    // Modem settings
+    virtual void setFrequency(long frequency) = 0;
+    virtual void setSpreadingFactor(int spreadingFactor) = 0;
+    virtual void setSignalBandwidth(long bandwidth) = 0;
+    virtual void setCodingRate4(int denominator) = 0;
+    virtual void setTxPower(int power) = 0;
+    virtual void setPreambleLength(long length) = 0;
+    virtual void setSyncWord(int syncWord) = 0;
+
+    // Operations - all asynchronous, completion raises the interrupt
+    virtual void startTransmit(const uint8_t* data, size_t length) = 0;
+    virtual void startReceive() = 0;
+    virtual void startChannelScan() = 0;
+    virtual void idle() = 0;
+    virtual void sleep() = 0;
+
+    // Radio task side of the interrupt: reads and clears its cause. RX frames
+    // are copied into buffer
+    virtual RadioIrq serviceIrq(uint8_t* buffer, size_t capacity, size_t& length,
+                                int8_t& rssi, int8_t& snr) = 0;
+
+    // Receiver waking itself every sleepMs to listen for listenMs, and staying
+    // up for a preamble it hears; false where the chip can't (startReceive()
+    // then still works). The peer's preamble has to outlast sleepMs
+    virtual bool startReceiveDutyCycle(uint32_t listenMs, uint32_t sleepMs) { return false; }
+
+    // (G)FSK at bitrate bps instead of LoRa, 0 back to LoRa with the LoRa
+    // settings as they were; false where the chip can't. The frequency and
+    // TX power carry over. No CAD in FSK, and SNR isn't reported
+    virtual bool supportsFsk() const { return false; }
+    virtual bool setFskMode(uint32_t bitrate) { return bitrate == 0; }
+
+    // LoRa with neither PHY header nor payload CRC, both ends set to length
+    // bytes, 0 back to the explicit header; false where the chip can't. A
+    // frame goes out as its length byte and itself and stops there, the
+    // receiver demodulates all length bytes and serviceIrq() hands back the
+    // frame alone - so a short frame leaves the peer listening to the rest.
+    // The frames' own CRC stands in for the PHY's
+    virtual bool supportsImplicitHeader() const { return false; }
+    virtual bool setImplicitHeader(uint8_t length) { return length == 0; }
+
+    // esp_timer time of the last interrupt, taken in the ISR; 0 when not known
+    virtual int64_t getIrqTimeUs() const { return 0; }
+
+    virtual const char* getName() const = 0;
+};
+
+// ===========================
+// SX127x Driver (sandeepmistry LoRa library)
+// ===========================
+
+class SX127xRadio : public RadioDriver {
+private:
+    enum class Operation : uint8_t { NONE, TRANSMIT, RECEIVE, CHANNEL_SCAN };
+    Operation operation;
+    uint8_t implicitLength;     // 0 = explicit header
+
+public:
+    SX127xRadio();
+
+    bool begin(long frequency) override;
+    void end() override;
+    void attachIrq(RadioIrqHandler handler, void* context) override;
+    void detachIrq() override;
+
+    void setFrequency(long frequency) override { LoRa.setFrequency(frequency); }
+    void setSpreadingFactor(int spreadingFactor) override { LoRa.setSpreadingFactor(spreadingFactor); }
+    void setSignalBandwidth(long bandwidth) override { LoRa.setSignalBandwidth(bandwidth); }
+    void setCodingRate4(int denominator) override { LoRa.setCodingRate4(denominator); }
+    void setTxPower(int power) override { LoRa.setTxPower(power); }
+    void setPreambleLength(long length) override { LoRa.setPreambleLength(length); }
+    void setSyncWord(int syncWord) override { LoRa.setSyncWord(syncWord); }
+
+    void startTransmit(const uint8_t* data, size_t length) override;
+    void startReceive() override;
+    void startChannelScan() override;
+    void idle() override;
+    void sleep() override;
+
+    RadioIrq serviceIrq(uint8_t* buffer, size_t capacity, size_t& length,
+                        int8_t& rssi, int8_t& snr) override;
+    bool supportsImplicitHeader() const override { return true; }
+    bool setImplicitHeader(uint8_t length) override;
+    int64_t getIrqTimeUs() const override;
+    const char* getName() const override { return "SX127x"; }
+
+    // No FSK: its 64-byte FIFO would need refilling mid-frame from the
+    // FifoLevel interrupt, on a line this board doesn't wire
+};
+
+// ===========================
+// SX126x Driver (SX1262/SX1268, radio_sx126x.cpp)
+// ===========================
+
+// Commands wait on BUSY before NSS goes low; BUSY is high after every
+// command for a few microseconds and for the oscillator start-up after a
+// wake from sleep. All interrupts go to DIO1. Modulation and packet
+// parameters are kept here and sent whole, as the chip takes them.
+// Each instance has its own pins, so a second module can share the SPI
+// host as another device; whichever starts first brings the bus up.
+
+#define SX126X_SPI_FREQUENCY    8000000
+#define SX126X_BUSY_TIMEOUT_US  10000       // Longer than any command, and the 3.5 ms wake from sleep
+#define SX126X_BUFFER_SIZE      256
+
+struct SX126xPins {
+    int8_t cs;
+    int8_t reset;
+    int8_t busy;
+    int8_t dio1;
+    int8_t sck;
+    int8_t mosi;
+    int8_t miso;
+    spi_host_device_t host;
+};
+
+class SX126xRadio : public RadioDriver {
+private:
+    enum class Operation : uint8_t { NONE, TRANSMIT, RECEIVE, CHANNEL_SCAN };
+    Operation operation;
+    SX126xPins pins;
+    spi_device_handle_t device;
+    bool ownsBus;
+    bool asleep;
+
+    // ISR side
+    RadioIrqHandler irqHandler;
+    void* irqContext;
+    volatile int64_t irqTimeUs;
+
+    // Command, address and the FIFO run in one transaction; a static
+    // instance's members are internal RAM, so DMA capable
+    WORD_ALIGNED_ATTR uint8_t txBuffer[4 + SX126X_BUFFER_SIZE];
+    WORD_ALIGNED_ATTR uint8_t rxBuffer[4 + SX126X_BUFFER_SIZE];
+
+    int spreadingFactor;
+    long bandwidth;
+    int codingRate;
+    uint16_t preambleLength;
+    uint32_t fskBitrate;        // 0 = LoRa packet type
+    uint8_t implicitLength;     // 0 = explicit header
+
+    bool waitBusy();
+    bool command(uint8_t opcode, const uint8_t* params, size_t length);
+    bool query(uint8_t opcode, uint8_t* response, size_t length);
+    void writeRegister(uint16_t address, uint8_t value);
+    uint8_t readRegister(uint16_t address);
+    bool writeBuffer(const uint8_t* data, size_t length);
+    bool readBuffer(uint8_t offset, uint8_t* data, size_t length);
+    void applyModulation();
+    void applyPacket(uint8_t payloadLength);
+    void clearIrq();
+    void wake();
+
+    static void IRAM_ATTR onDio1Interrupt(void* arg);
+
+public:
+    SX126xRadio();                              // The main module's LORA_* pins
+    explicit SX126xRadio(const SX126xPins& modulePins);
+
+    bool begin(long frequency) override;
+    void end() override;
+    void attachIrq(RadioIrqHandler handler, void* context) override;
+    void detachIrq() override;
+
+    void setFrequency(long frequency) override;
+    void setSpreadingFactor(int spreadingFactor) override;
+    void setSignalBandwidth(long bandwidth) override;
+    void setCodingRate4(int denominator) override;
+    void setTxPower(int power) override;
+    void setPreambleLength(long length) override;
+    void setSyncWord(int syncWord) override;
+
+    void startTransmit(const uint8_t* data, size_t length) override;
+    void startReceive() override;
+    void startChannelScan() override;
+    void idle() override;
+    void sleep() override;
+
+    RadioIrq serviceIrq(uint8_t* buffer, size_t capacity, size_t& length,
+                        int8_t& rssi, int8_t& snr) override;
+    bool startReceiveDutyCycle(uint32_t listenMs, uint32_t sleepMs) override;
+    bool supportsFsk() const override { return true; }
+    bool setFskMode(uint32_t bitrate) override;
+    bool supportsImplicitHeader() const override { return true; }
+    bool setImplicitHeader(uint8_t length) override;
+    int64_t getIrqTimeUs() const override;
+    const char* getName() const override { return "SX126x"; }
+};
+
+// The on-board module, per LORA_RADIO_CHIP
+extern RadioDriver& HardwareRadio();
+
+// The bulk-data module on the LORA_BULK_* pins, nullptr when not fitted
+extern RadioDriver* BulkHardwareRadio();
+
+#endif // RADIO_DRIVER_H
@@ -0,0 +1,639 @@
+#include "radio_driver.h"
+#include "esp_timer.h"
+
+// Opcodes (SX1261/2 datasheet, section 13)
+#define SX126X_SET_SLEEP               0x84
+#define SX126X_SET_STANDBY             0x80
+#define SX126X_SET_TX                  0x83
+#define SX126X_SET_RX                  0x82
+#define SX126X_SET_RX_DUTY_CYCLE       0x94
+#define SX126X_SET_CAD                 0xC5
+#define SX126X_SET_PACKET_TYPE         0x8A
+#define SX126X_SET_RF_FREQUENCY        0x86
+#define SX126X_SET_PA_CONFIG           0x95
+#define SX126X_SET_TX_PARAMS           0x8E
+#define SX126X_SET_MODULATION_PARAMS   0x8B
+#define SX126X_SET_PACKET_PARAMS       0x8C
+#define SX126X_SET_CAD_PARAMS          0x88
+#define SX126X_SET_BUFFER_BASE_ADDRESS 0x8F
+#define SX126X_SET_DIO_IRQ_PARAMS      0x08
+#define SX126X_SET_DIO2_RF_SWITCH      0x9D
+#define SX126X_SET_DIO3_TCXO           0x97
+#define SX126X_SET_REGULATOR_MODE      0x96
+#define SX126X_CALIBRATE               0x89
+#define SX126X_CALIBRATE_IMAGE         0x98
+#define SX126X_WRITE_BUFFER            0x0E
+#define SX126X_READ_BUFFER             0x1E
+#define SX126X_WRITE_REGISTER          0x0D
+#define SX126X_READ_REGISTER           0x1D
+#define SX126X_GET_STATUS              0xC0
+#define SX126X_GET_IRQ_STATUS          0x12
+#define SX126X_CLEAR_IRQ_STATUS        0x02
+#define SX126X_GET_RX_BUFFER_STATUS    0x13
+#define SX126X_GET_PACKET_STATUS       0x14
+
+// IRQ bits
+#define SX126X_IRQ_TX_DONE             0x0001
+#define SX126X_IRQ_RX_DONE             0x0002
+#define SX126X_IRQ_HEADER_ERROR        0x0020
+#define SX126X_IRQ_CRC_ERROR           0x0040
+#define SX126X_IRQ_CAD_DONE            0x0080
+#define SX126X_IRQ_CAD_DETECTED        0x0100
+#define SX126X_IRQ_TIMEOUT             0x0200
+#define SX126X_IRQ_ALL                 0x03FF
+
+// Registers
+#define SX126X_REG_SYNC_WORD           0x0740
+#define SX126X_REG_FSK_SYNC_WORD       0x06C0
+#define SX126X_REG_TX_MODULATION       0x0889   // Bit 2: 500 kHz modulation quality workaround
+#define SX126X_REG_OCP                 0x08E7
+
+#define SX126X_PACKET_TYPE_GFSK        0x00
+#define SX126X_PACKET_TYPE_LORA        0x01
+#define SX126X_GFSK_BT_0_5             0x09
+#define SX126X_GFSK_PREAMBLE_DETECT_16 0x05
+#define SX126X_GFSK_CRC_2_BYTE_INV     0x06     // CCITT with the reset values of the CRC registers
+#define SX126X_STANDBY_RC              0x00
+#define SX126X_SLEEP_WARM_START        0x04
+#define SX126X_RX_CONTINUOUS           0xFFFFFF
+#define SX126X_TICKS_PER_MS            64       // RTC steps of 15.625 us
+#define SX126X_TCXO_START_MS           5
+
+static const SX126xPins mainModulePins = {
+    LORA_CS_PIN, LORA_RST_PIN, LORA_BUSY_PIN, LORA_DIO1_PIN, LORA_SCK_PIN, LORA_MOSI_PIN, LORA_MISO_PIN, LORA_SPI_NUM
+};
+
+SX126xRadio::SX126xRadio() : SX126xRadio(mainModulePins) {
+}
+
+SX126xRadio::SX126xRadio(const SX126xPins& modulePins) {
+    operation = Operation::NONE;
+    pins = modulePins;
+    device = nullptr;
+    ownsBus = false;
+    asleep = false;
+    irqHandler = nullptr;
+    irqContext = nullptr;
+    irqTimeUs = 0;
+    spreadingFactor = LORA_SPREADING_FACTOR;
+    bandwidth = LORA_BANDWIDTH;
+    codingRate = LORA_CODING_RATE;
+    preambleLength = LORA_PREAMBLE_LEN;
+    fskBitrate = 0;
+    implicitLength = 0;
+}
+
+// ===========================
+// Interrupt Glue
+// ===========================
+
+void IRAM_ATTR SX126xRadio::onDio1Interrupt(void* arg) {
+    // No SPI access here - the handler just wakes the radio task
+    SX126xRadio* radio = static_cast<SX126xRadio*>(arg);
+    radio->irqTimeUs = esp_timer_get_time();
+    if (radio->irqHandler) {
+        radio->irqHandler(radio->irqContext, true);
+    }
+}
+
+// ===========================
+// SPI Commands
+// ===========================
+
+bool SX126xRadio::waitBusy() {
+    int64_t start = esp_timer_get_time();
+    while (digitalRead(pins.busy) == HIGH) {
+        if (esp_timer_get_time() - start > SX126X_BUSY_TIMEOUT_US) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SX126xRadio::command(uint8_t opcode, const uint8_t* params, size_t length) {
+    if (!device || length > sizeof(txBuffer) - 1 || !waitBusy()) {
+        return false;
+    }
+    txBuffer[0] = opcode;
+    if (length) {
+        memcpy(txBuffer + 1, params, length);
+    }
+
+    // Short commands are polled - cheaper than the interrupt a queued DMA transaction takes
+    spi_transaction_t transaction = {};
+    transaction.length = (1 + length) * 8;
+    transaction.tx_buffer = txBuffer;
+    esp_err_t result = length > 16 ? spi_device_transmit(device, &transaction)
+                                   : spi_device_polling_transmit(device, &transaction);
+    return result == ESP_OK;
+}
+
+bool SX126xRadio::query(uint8_t opcode, uint8_t* response, size_t length) {
+    // [opcode][status][response...]
+    if (!device || length + 2 > sizeof(rxBuffer) || !waitBusy()) {
+        return false;
+    }
+    memset(txBuffer, 0, length + 2);
+    txBuffer[0] = opcode;
+
+    spi_transaction_t transaction = {};
+    transaction.length = (2 + length) * 8;
+    transaction.tx_buffer = txBuffer;
+    transaction.rx_buffer = rxBuffer;
+    if (spi_device_polling_transmit(device, &transaction) != ESP_OK) {
+        return false;
+    }
+    memcpy(response, rxBuffer + 2, length);
+    return true;
+}
+
+void SX126xRadio::writeRegister(uint16_t address, uint8_t value) {
+    uint8_t params[3] = {(uint8_t)(address >> 8), (uint8_t)address, value};
+    command(SX126X_WRITE_REGISTER, params, sizeof(params));
+}
+
+uint8_t SX126xRadio::readRegister(uint16_t address) {
+    // [opcode][address 2][status][value]
+    if (!device || !waitBusy()) {
+        return 0;
+    }
+    memset(txBuffer, 0, 5);
+    txBuffer[0] = SX126X_READ_REGISTER;
+    txBuffer[1] = address >> 8;
+    txBuffer[2] = address & 0xFF;
+
+    spi_transaction_t transaction = {};
+    transaction.length = 5 * 8;
+    transaction.tx_buffer = txBuffer;
+    transaction.rx_buffer = rxBuffer;
+    if (spi_device_polling_transmit(device, &transaction) != ESP_OK) {
+        return 0;
+    }
+    return rxBuffer[4];
+}
+
+bool SX126xRadio::writeBuffer(const uint8_t* data, size_t length) {
+    // [opcode][offset][data...] - the whole frame in one DMA transaction
+    if (!device || length > SX126X_BUFFER_SIZE - 1 || !waitBusy()) {
+        return false;
+    }
+    txBuffer[0] = SX126X_WRITE_BUFFER;
+    txBuffer[1] = 0;
+    memcpy(txBuffer + 2, data, length);
+
+    spi_transaction_t transaction = {};
+    transaction.length = (2 + length) * 8;
+    transaction.tx_buffer = txBuffer;
+    return spi_device_transmit(device, &transaction) == ESP_OK;
+}
+
+bool SX126xRadio::readBuffer(uint8_t offset, uint8_t* data, size_t length) {
+    // [opcode][offset][status][data...]
+    if (!device || length > SX126X_BUFFER_SIZE || !waitBusy()) {
+        return false;
+    }
+    memset(txBuffer, 0, length + 3);
+    txBuffer[0] = SX126X_READ_BUFFER;
+    txBuffer[1] = offset;
+
+    spi_transaction_t transaction = {};
+    transaction.length = (3 + length) * 8;
+    transaction.tx_buffer = txBuffer;
+    transaction.rx_buffer = rxBuffer;
+    if (spi_device_transmit(device, &transaction) != ESP_OK) {
+        return false;
+    }
+    memcpy(data, rxBuffer + 3, length);
+    return true;
+}
+
+// ===========================
+// Setup
+// ===========================
+
+bool SX126xRadio::begin(long frequency) {
+    if (!device) {
+        spi_bus_config_t bus = {};
+        bus.mosi_io_num = pins.mosi;
+        bus.miso_io_num = pins.miso;
+        bus.sclk_io_num = pins.sck;
+        bus.quadwp_io_num = -1;
+        bus.quadhd_io_num = -1;
+        bus.max_transfer_sz = sizeof(txBuffer);
+
+        // Already up means the other module on this host brought it up
+        esp_err_t result = spi_bus_initialize(pins.host, &bus, SPI_DMA_CH_AUTO);
+        if (result != ESP_OK && result != ESP_ERR_INVALID_STATE) {
+            return false;
+        }
+        ownsBus = result == ESP_OK;
+
+        spi_device_interface_config_t config = {};
+        config.mode = 0;
+        config.clock_speed_hz = SX126X_SPI_FREQUENCY;
+        config.spics_io_num = pins.cs;
+        config.queue_size = 1;
+        if (spi_bus_add_device(pins.host, &config, &device) != ESP_OK) {
+            if (ownsBus) {
+                spi_bus_free(pins.host);
+            }
+            device = nullptr;
+            return false;
+        }
+    }
+
+    pinMode(pins.busy, INPUT);
+    pinMode(pins.dio1, INPUT);
+    pinMode(pins.reset, OUTPUT);
+    digitalWrite(pins.reset, LOW);
+    delay(1);
+    digitalWrite(pins.reset, HIGH);
+    delay(5);
+    asleep = false;
+    operation = Operation::NONE;
+    fskBitrate = 0;
+
+    uint8_t standby = SX126X_STANDBY_RC;
+    if (!command(SX126X_SET_STANDBY, &standby, 1)) {
+        return false;
+    }
+
+    if (LORA_SX126X_TCXO_MV > 0) {
+        // 1.6 V to 3.3 V in the chip's eight steps
+        static const uint16_t tcxoMv[] = {1600, 1700, 1800, 2200, 2400, 2700, 3000, 3300};
+        uint8_t code = 0;
+        while (code < 7 && tcxoMv[code] < LORA_SX126X_TCXO_MV) {
+            code++;
+        }
+        uint32_t delayTicks = SX126X_TCXO_START_MS * SX126X_TICKS_PER_MS;
+        uint8_t tcxo[4] = {code, (uint8_t)(delayTicks >> 16), (uint8_t)(delayTicks >> 8), (uint8_t)delayTicks};
+        command(SX126X_SET_DIO3_TCXO, tcxo, sizeof(tcxo));
+        uint8_t all = 0x7F;
+        command(SX126X_CALIBRATE, &all, 1);
+    }
+    if (LORA_SX126X_USE_DCDC) {
+        uint8_t dcdc = 0x01;
+        command(SX126X_SET_REGULATOR_MODE, &dcdc, 1);
+    }
+    if (LORA_SX126X_DIO2_RF_SWITCH) {
+        uint8_t enable = 0x01;
+        command(SX126X_SET_DIO2_RF_SWITCH, &enable, 1);
+    }
+
+    uint8_t packetType = SX126X_PACKET_TYPE_LORA;
+    command(SX126X_SET_PACKET_TYPE, &packetType, 1);
+    setFrequency(frequency);
+
+    // Image rejection calibrated for the band we're in
+    uint8_t image[2];
+    if (frequency > 900000000) {
+        image[0] = 0xE1; image[1] = 0xE9;
+    } else if (frequency > 850000000) {
+        image[0] = 0xD7; image[1] = 0xDB;
+    } else if (frequency > 770000000) {
+        image[0] = 0xC1; image[1] = 0xC5;
+    } else {
+        image[0] = 0x6B; image[1] = 0x6F;
+    }
+    command(SX126X_CALIBRATE_IMAGE, image, sizeof(image));
+
+    uint8_t base[2] = {0, 0};
+    command(SX126X_SET_BUFFER_BASE_ADDRESS, base, sizeof(base));
+
+    // High-power PA, +22 dBm table; 140 mA over-current limit
+    uint8_t pa[4] = {0x04, 0x07, 0x00, 0x01};
+    command(SX126X_SET_PA_CONFIG, pa, sizeof(pa));
+    writeRegister(SX126X_REG_OCP, 0x38);
+    setTxPower(LORA_TX_POWER);
+
+    applyModulation();
+    applyPacket(0xFF);
+
+    uint16_t mask = SX126X_IRQ_TX_DONE | SX126X_IRQ_RX_DONE | SX126X_IRQ_HEADER_ERROR | SX126X_IRQ_CRC_ERROR |
+                    SX126X_IRQ_CAD_DONE | SX126X_IRQ_CAD_DETECTED | SX126X_IRQ_TIMEOUT;
+    uint8_t irq[8] = {(uint8_t)(mask >> 8), (uint8_t)mask, (uint8_t)(mask >> 8), (uint8_t)mask, 0, 0, 0, 0};
+    command(SX126X_SET_DIO_IRQ_PARAMS, irq, sizeof(irq));
+    clearIrq();
+
+    // Present and answering if the sync word reads back
+    setSyncWord(LORA_SYNC_WORD);
+    return readRegister(SX126X_REG_SYNC_WORD) == (uint8_t)(((LORA_SYNC_WORD & 0xF0) | 0x04));
+}
+
+void SX126xRadio::end() {
+    sleep();
+    if (device) {
+        spi_bus_remove_device(device);
+        if (ownsBus) {
+            spi_bus_free(pins.host);    // Refused while the other module is still on it
+        }
+        device = nullptr;
+    }
+}
+
+void SX126xRadio::attachIrq(RadioIrqHandler handler, void* context) {
+    irqHandler = handler;
+    irqContext = context;
+    attachInterruptArg(digitalPinToInterrupt(pins.dio1), onDio1Interrupt, this, RISING);
+}
+
+void SX126xRadio::detachIrq() {
+    detachInterrupt(digitalPinToInterrupt(pins.dio1));
+    irqHandler = nullptr;
+    irqContext = nullptr;
+}
+
+// ===========================
+// Modem Settings
+// ===========================
+
+void SX126xRadio::setFrequency(long frequency) {
+    // Steps of 32 MHz / 2^25
+    uint32_t steps = (uint32_t)(((uint64_t)frequency << 25) / 32000000ULL);
+    uint8_t params[4] = {(uint8_t)(steps >> 24), (uint8_t)(steps >> 16), (uint8_t)(steps >> 8), (uint8_t)steps};
+    command(SX126X_SET_RF_FREQUENCY, params, sizeof(params));
+}
+
+void SX126xRadio::setSpreadingFactor(int sf) {
+    spreadingFactor = constrain(sf, 5, 12);
+    applyModulation();
+}
+
+void SX126xRadio::setSignalBandwidth(long bw) {
+    bandwidth = bw;
+    applyModulation();
+}
+
+void SX126xRadio::setCodingRate4(int denominator) {
+    codingRate = constrain(denominator, 5, 8);
+    applyModulation();
+}
+
+void SX126xRadio::setTxPower(int power) {
+    uint8_t params[2] = {(uint8_t)(int8_t)constrain(power, -9, LORA_SX126X_MAX_POWER), 0x04};    // 200 us ramp
+    command(SX126X_SET_TX_PARAMS, params, sizeof(params));
+}
+
+void SX126xRadio::setPreambleLength(long length) {
+    preambleLength = (uint16_t)constrain(length, 6L, 65535L);
+    applyPacket(0xFF);
+}
+
+void SX126xRadio::setSyncWord(int syncWord) {
+    // The SX127x's one byte as the SX126x's two: 0x12 -> 0x1424, 0x34 -> 0x3444
+    writeRegister(SX126X_REG_SYNC_WORD, (syncWord & 0xF0) | 0x04);
+    writeRegister(SX126X_REG_SYNC_WORD + 1, ((syncWord & 0x0F) << 4) | 0x04);
+}
+
+void SX126xRadio::applyModulation() {
+    if (fskBitrate) {
+        // Bit rate in 1/32 steps of the crystal, deviation half of it; the
+        // receiver bandwidth the narrowest of the chip's that passes both
+        static const struct { uint32_t hz; uint8_t code; } rxBandwidths[] = {
+            {9700, 0x1E}, {19500, 0x1D}, {39000, 0x1C}, {58600, 0x0C}, {78200, 0x1B}, {117300, 0x0B},
+            {156200, 0x1A}, {234300, 0x0A}, {312000, 0x19}, {373600, 0x11}, {467000, 0x09}
+        };
+        uint8_t rxBw = 0x09;
+        for (const auto& entry : rxBandwidths) {
+            if (entry.hz >= 2 * fskBitrate) {
+                rxBw = entry.code;
+                break;
+            }
+        }
+        uint32_t rate = (uint32_t)(32ULL * 32000000ULL / fskBitrate);
+        uint32_t deviation = (uint32_t)(((uint64_t)fskBitrate / 2 << 25) / 32000000ULL);
+        uint8_t params[8] = {(uint8_t)(rate >> 16), (uint8_t)(rate >> 8), (uint8_t)rate, SX126X_GFSK_BT_0_5, rxBw,
+                             (uint8_t)(deviation >> 16), (uint8_t)(deviation >> 8), (uint8_t)deviation};
+        command(SX126X_SET_MODULATION_PARAMS, params, sizeof(params));
+        return;
+    }
+
+    uint8_t bw = bandwidth >= 500000 ? 0x06 : (bandwidth >= 250000 ? 0x05 : 0x04);
+    bool lowDataRate = (float)(1L << spreadingFactor) / bandwidth > 0.01638f;    // Symbols over 16 ms
+    uint8_t params[4] = {(uint8_t)spreadingFactor, bw, (uint8_t)(codingRate - 4), (uint8_t)(lowDataRate ? 1 : 0)};
+    command(SX126X_SET_MODULATION_PARAMS, params, sizeof(params));
+
+    // Datasheet 15.1: the TX modulation register wants bit 2 clear at 500 kHz only
+    uint8_t quality = readRegister(SX126X_REG_TX_MODULATION);
+    writeRegister(SX126X_REG_TX_MODULATION, bw == 0x06 ? (quality & ~0x04) : (quality | 0x04));
+}
+
+void SX126xRadio::applyPacket(uint8_t payloadLength) {
+    if (fskBitrate) {
+        // Preamble in bits, 16 of it to detect, 16-bit sync word, no address,
+        // variable length, CRC-16, whitening
+        uint16_t preambleBits = RADIO_FSK_PREAMBLE_BYTES * 8;
+        uint8_t params[9] = {(uint8_t)(preambleBits >> 8), (uint8_t)preambleBits, SX126X_GFSK_PREAMBLE_DETECT_16,
+                             16, 0x00, 0x01, payloadLength, SX126X_GFSK_CRC_2_BYTE_INV, 0x01};
+        command(SX126X_SET_PACKET_PARAMS, params, sizeof(params));
+        return;
+    }
+
+    // Explicit header, CRC on, standard IQ - or implicit, CRC off, where
+    // the length is what goes out and what the receiver takes
+    uint8_t params[6] = {(uint8_t)(preambleLength >> 8), (uint8_t)preambleLength, 0x00, payloadLength, 0x01, 0x00};
+    if (implicitLength) {
+        params[2] = 0x01;
+        params[4] = 0x00;
+    }
+    command(SX126X_SET_PACKET_PARAMS, params, sizeof(params));
+}
+
+bool SX126xRadio::setImplicitHeader(uint8_t length) {
+    implicitLength = length;
+    if (operation == Operation::RECEIVE) {
+        startReceive();
+    } else {
+        applyPacket(length ? length : 0xFF);
+    }
+    return true;
+}
+
+bool SX126xRadio::setFskMode(uint32_t bitrate) {
+    if (bitrate == fskBitrate) {
+        return true;
+    }
+
+    // The packet type only changes in standby, and takes the modulation and
+    // packet parameters with it; a receiver goes back to listening after
+    bool receiving = operation == Operation::RECEIVE;
+    idle();
+    uint8_t packetType = bitrate ? SX126X_PACKET_TYPE_GFSK : SX126X_PACKET_TYPE_LORA;
+    if (!command(SX126X_SET_PACKET_TYPE, &packetType, 1)) {
+        return false;
+    }
+    fskBitrate = bitrate;
+    if (bitrate) {
+        writeRegister(SX126X_REG_FSK_SYNC_WORD, RADIO_FSK_SYNC_WORD >> 8);
+        writeRegister(SX126X_REG_FSK_SYNC_WORD + 1, RADIO_FSK_SYNC_WORD & 0xFF);
+    }
+    applyModulation();
+    applyPacket(0xFF);
+    if (receiving) {
+        startReceive();
+    }
+    return true;
+}
+
+void SX126xRadio::clearIrq() {
+    uint8_t params[2] = {SX126X_IRQ_ALL >> 8, SX126X_IRQ_ALL & 0xFF};
+    command(SX126X_CLEAR_IRQ_STATUS, params, sizeof(params));
+}
+
+// ===========================
+// Operations
+// ===========================
+
+void SX126xRadio::wake() {
+    if (!asleep) {
+        return;
+    }
+
+    // NSS going low is the wake-up; BUSY then stays high through the start-up
+    uint8_t status;
+    query(SX126X_GET_STATUS, &status, 0);
+    waitBusy();
+    asleep = false;
+}
+
+void SX126xRadio::startTransmit(const uint8_t* data, size_t length) {
+    wake();
+    if (implicitLength && !fskBitrate) {
+        // Length byte first, in the same buffer write
+        uint8_t frame[SX126X_BUFFER_SIZE];
+        length = min(length, (size_t)implicitLength - 1);
+        frame[0] = (uint8_t)length;
+        memcpy(frame + 1, data, length);
+        applyPacket((uint8_t)(length + 1));
+        writeBuffer(frame, length + 1);
+    } else {
+        length = min(length, (size_t)(SX126X_BUFFER_SIZE - 1));
+        applyPacket((uint8_t)length);
+        writeBuffer(data, length);
+    }
+    clearIrq();
+
+    uint8_t timeout[3] = {0, 0, 0};     // LoRaManager's TX_DONE watchdog covers a hang
+    operation = Operation::TRANSMIT;
+    command(SX126X_SET_TX, timeout, sizeof(timeout));
+}
+
+void SX126xRadio::startReceive() {
+    wake();
+    applyPacket(implicitLength ? implicitLength : 0xFF);
+    clearIrq();
+
+    uint8_t timeout[3] = {(uint8_t)(SX126X_RX_CONTINUOUS >> 16), (uint8_t)(SX126X_RX_CONTINUOUS >> 8),
+                          (uint8_t)SX126X_RX_CONTINUOUS};
+    operation = Operation::RECEIVE;
+    command(SX126X_SET_RX, timeout, sizeof(timeout));
+}
+
+bool SX126xRadio::startReceiveDutyCycle(uint32_t listenMs, uint32_t sleepMs) {
+    wake();
+    applyPacket(implicitLength ? implicitLength : 0xFF);
+    clearIrq();
+
+    uint32_t listen = listenMs * SX126X_TICKS_PER_MS;
+    uint32_t sleepTicks = sleepMs * SX126X_TICKS_PER_MS;
+    uint8_t params[6] = {(uint8_t)(listen >> 16), (uint8_t)(listen >> 8), (uint8_t)listen,
+                         (uint8_t)(sleepTicks >> 16), (uint8_t)(sleepTicks >> 8), (uint8_t)sleepTicks};
+    operation = Operation::RECEIVE;
+    return command(SX126X_SET_RX_DUTY_CYCLE, params, sizeof(params));
+}
+
+void SX126xRadio::startChannelScan() {
+    wake();
+
+    // Symbols and detection peak per the SX126x CAD application note
+    static const uint8_t peak[] = {22, 22, 22, 22, 23, 24, 25, 28};     // SF5..SF12
+    uint8_t params[7] = {(uint8_t)(spreadingFactor <= 8 ? 0x01 : 0x02), peak[spreadingFactor - 5], 10, 0x00,
+                         0, 0, 0};
+    command(SX126X_SET_CAD_PARAMS, params, sizeof(params));
+    clearIrq();
+
+    operation = Operation::CHANNEL_SCAN;
+    command(SX126X_SET_CAD, nullptr, 0);
+}
+
+void SX126xRadio::idle() {
+    wake();
+    uint8_t standby = SX126X_STANDBY_RC;
+    command(SX126X_SET_STANDBY, &standby, 1);
+    operation = Operation::NONE;
+}
+
+void SX126xRadio::sleep() {
+    wake();
+    uint8_t config = SX126X_SLEEP_WARM_START;    // Keeps the configuration for the wake
+    command(SX126X_SET_SLEEP, &config, 1);
+    asleep = true;
+    operation = Operation::NONE;
+}
+
+RadioIrq SX126xRadio::serviceIrq(uint8_t* buffer, size_t capacity, size_t& length,
+                                 int8_t& rssi, int8_t& snr) {
+    length = 0;
+
+    uint8_t status[2];
+    if (asleep || !query(SX126X_GET_IRQ_STATUS, status, sizeof(status))) {
+        return RadioIrq::NONE;
+    }
+    uint16_t flags = ((uint16_t)status[0] << 8) | status[1];
+    clearIrq();
+
+    switch (operation) {
+        case Operation::CHANNEL_SCAN:
+            if (!(flags & SX126X_IRQ_CAD_DONE)) {
+                return RadioIrq::NONE;
+            }
+            return (flags & SX126X_IRQ_CAD_DETECTED) ? RadioIrq::CAD_DETECTED : RadioIrq::CAD_CLEAR;
+
+        case Operation::TRANSMIT:
+            return (flags & SX126X_IRQ_TX_DONE) ? RadioIrq::TX_DONE : RadioIrq::NONE;
+
+        case Operation::RECEIVE: {
+            if (flags & (SX126X_IRQ_CRC_ERROR | SX126X_IRQ_HEADER_ERROR)) {
+                return RadioIrq::RX_CRC_ERROR;
+            }
+            if (!(flags & SX126X_IRQ_RX_DONE)) {
+                return RadioIrq::NONE;
+            }
+
+            uint8_t bufferStatus[2];    // [length][start]
+            if (!query(SX126X_GET_RX_BUFFER_STATUS, bufferStatus, sizeof(bufferStatus))) {
+                return RadioIrq::RX_CRC_ERROR;
+            }
+            length = min((size_t)bufferStatus[0], capacity);
+            if (!readBuffer(bufferStatus[1], buffer, length)) {
+                length = 0;
+                return RadioIrq::RX_CRC_ERROR;
+            }
+            if (implicitLength && !fskBitrate) {
+                length = radioUnwrapImplicitFrame(buffer, length);
+                if (length == 0) {
+                    return RadioIrq::RX_CRC_ERROR;
+                }
+            }
+
+            uint8_t packet[3];          // LoRa [RSSI -dBm*2][SNR dB*4][signal RSSI], GFSK [status][sync RSSI][avg RSSI]
+            if (!query(SX126X_GET_PACKET_STATUS, packet, sizeof(packet))) {
+                return RadioIrq::RX_DONE;
+            }
+            if (fskBitrate) {
+                rssi = (int8_t)max(-(int)packet[1] / 2, -128);
+            } else {
+                rssi = (int8_t)max(-(int)packet[0] / 2, -128);
+                snr = (int8_t)(((int8_t)packet[1] + 2) / 4);
+            }
+            return RadioIrq::RX_DONE;
+        }
+
+        default:
+            return RadioIrq::NONE;
+    }
+}
+
+int64_t SX126xRadio::getIrqTimeUs() const {
+    return irqTimeUs;
+}
@@ -0,0 +1,131 @@
+#include "report_deadband.h"
+#include "balloon_config.h"
+#include "packet_handler.h"
+
+#define DEADBAND_EARTH_RADIUS_M 6371000.0f
+
+ReportDeadband::ReportDeadband() {
+    memset(&lastGps, 0, sizeof(lastGps));
+    lastPressure = 0.0f;
+    lastTemperature = 0.0f;
+    lastBattery = 0.0f;
+    memset(stats, 0, sizeof(stats));
+    for (uint8_t i = 0; i < DEADBAND_REPORT_COUNT; i++) {
+        forced[i] = true;
+    }
+}
+
+// ===========================
+// Filtering (flight task)
+// ===========================
+
+bool ReportDeadband::check(DeadbandReport report, bool changed, uint32_t maxSilenceMs, uint32_t now) {
+    uint8_t index = static_cast<uint8_t>(report);
+    DeadbandStats& entry = stats[index];
+    if (forced[index] || changed) {
+        return true;
+    }
+    if (now - entry.lastSentAt >= maxSilenceMs) {
+        entry.silenceSends++;
+        return true;
+    }
+    entry.suppressed++;
+    return false;
+}
+
+void ReportDeadband::sent(DeadbandReport report, uint32_t now) {
+    uint8_t index = static_cast<uint8_t>(report);
+    forced[index] = false;
+    stats[index].sent++;
+    stats[index].lastSentAt = now;
+}
+
+bool ReportDeadband::checkGps(const GPSData& fix, uint32_t now) {
+    if (!GPS_SMART_SAVE) {
+        return true;
+    }
+    bool moved = distanceMeters(lastGps.latitude, lastGps.longitude, fix.latitude, fix.longitude) >=
+                     GPS_MIN_MOVEMENT_DISTANCE ||
+                 fabsf(fix.altitude - lastGps.altitude) >= GPS_MIN_ALTITUDE_CHANGE;
+    return check(DeadbandReport::GPS, moved, GPS_MAX_SILENCE_MS, now);
+}
+
+bool ReportDeadband::checkTelemetry(const TelemetryData& data, uint32_t now) {
+    if (!TELEMETRY_SMART_SAVE) {
+        return true;
+    }
+    bool changed = fabsf(data.pressure - lastPressure) >= TELEMETRY_DEADBAND_PRESSURE * lastPressure ||
+                   fabsf(data.temperature - lastTemperature) >= TELEMETRY_DEADBAND_TEMPERATURE ||
+                   fabsf(data.batteryVoltage - lastBattery) >= TELEMETRY_DEADBAND_BATTERY;
+    return check(DeadbandReport::TELEMETRY, changed, TELEMETRY_MAX_SILENCE_MS, now);
+}
+
+void ReportDeadband::sentGps(const GPSData& fix, uint32_t now) {
+    lastGps = fix;
+    sent(DeadbandReport::GPS, now);
+}
+
+void ReportDeadband::sentTelemetry(const TelemetryData& data, uint32_t now) {
+    lastPressure = data.pressure;
+    lastTemperature = data.temperature;
+    lastBattery = data.batteryVoltage;
+    sent(DeadbandReport::TELEMETRY, now);
+}
+
+void ReportDeadband::forceNext() {
+    for (uint8_t i = 0; i < DEADBAND_REPORT_COUNT; i++) {
+        forced[i] = true;
+    }
+}
+
+float ReportDeadband::distanceMeters(float lat1, float lon1, float lat2, float lon2) {
+    // Equirectangular: longitude shrunk by the cosine of the mean latitude
+    const float toRadians = (float)M_PI / 180.0f;
+    float x = (lon2 - lon1) * toRadians * cosf((lat1 + lat2) * 0.5f * toRadians);
+    float y = (lat2 - lat1) * toRadians;
+    return DEADBAND_EARTH_RADIUS_M * sqrtf(x * x + y * y);
+}
+
+// ===========================
+// Readers
+// ===========================
+
+DeadbandStats ReportDeadband::getStats(DeadbandReport report) const {
+    uint8_t index = static_cast<uint8_t>(report);
+    if (index >= DEADBAND_REPORT_COUNT) {
+        return DeadbandStats{};
+    }
+    return stats[index];
+}
+
+void ReportDeadband::printStatus() const {
+    Serial.println("=== Report Dead-band ===");
+    for (uint8_t i = 0; i < DEADBAND_REPORT_COUNT; i++) {
+        const DeadbandStats& entry = stats[i];
+        uint32_t total = entry.sent + entry.suppressed;
+        Serial.printf("  %-9s %lu sent (%lu on silence), %lu suppressed (%.0f%%)\n",
+                      deadbandReportToString(static_cast<DeadbandReport>(i)), (unsigned long)entry.sent,
+                      (unsigned long)entry.silenceSends, (unsigned long)entry.suppressed,
+                      total ? 100.0f * entry.suppressed / total : 0.0f);
+    }
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static ReportDeadband reportDeadbandInstance;
+
+ReportDeadband& Deadband() { return reportDeadbandInstance; }
+
+// ===========================
+// Utility Functions
+// ===========================
+
+const char* deadbandReportToString(DeadbandReport report) {
+    switch (report) {
+        case DeadbandReport::GPS: return "gps";
+        case DeadbandReport::TELEMETRY: return "telemetry";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef REPORT_DEADBAND_H
+#define REPORT_DEADBAND_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "common_types.h"
+
+struct TelemetryData;     // packet_handler.h
+
+// ===========================
+// Report Dead-band
+// Send-on-change for the GPS and telemetry reports: a report that says
+// nothing the last one sent didn't is left on the ground
+// ===========================
+
+// Each report is compared field by field with the last one that went out.
+// GPS goes when the position moved GPS_MIN_MOVEMENT_DISTANCE (equirectangular
+// - at these distances the error against the great circle is far below the
+// fix's own) or the altitude GPS_MIN_ALTITUDE_CHANGE; telemetry when the
+// pressure moved TELEMETRY_DEADBAND_PRESSURE of itself (the same height at
+// any altitude), the temperature or the battery voltage theirs. Either goes
+// anyway after its max silence, so the base station always knows we're
+// there, and forceNext() lets a phase change's reports through.
+//
+// Only the uplink is filtered; the flight recorder keeps every report. The
+// flight task calls it, between reading the sensors and posting.
+
+enum class DeadbandReport : uint8_t {
+    GPS = 0,
+    TELEMETRY,
+    COUNT
+};
+
+#define DEADBAND_REPORT_COUNT static_cast<uint8_t>(DeadbandReport::COUNT)
+
+struct DeadbandStats {
+    uint32_t sent;
+    uint32_t suppressed;
+    uint32_t silenceSends;      // Sent only because the max silence ran out
+    uint32_t lastSentAt;        // millis(), 0 before the first
+};
+
+class ReportDeadband {
+public:
+    ReportDeadband();
+
+    // True when the report should go out; sent() once it has been posted
+    bool checkGps(const GPSData& fix, uint32_t now);
+    bool checkTelemetry(const TelemetryData& data, uint32_t now);
+    void sentGps(const GPSData& fix, uint32_t now);
+    void sentTelemetry(const TelemetryData& data, uint32_t now);
+
+    // The next report of each kind goes out whatever changed
+    void forceNext();
+
+    DeadbandStats getStats(DeadbandReport report) const;
+    void printStatus() const;
+
+    static float distanceMeters(float lat1, float lon1, float lat2, float lon2);
+
+private:
+    GPSData lastGps;
+    float lastPressure;
+    float lastTemperature;
+    float lastBattery;
+    bool forced[DEADBAND_REPORT_COUNT];
+    DeadbandStats stats[DEADBAND_REPORT_COUNT];
+
+    bool check(DeadbandReport report, bool changed, uint32_t maxSilenceMs, uint32_t now);
+    void sent(DeadbandReport report, uint32_t now);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern ReportDeadband& Deadband();
+
+const char* deadbandReportToString(DeadbandReport report);
+
+#endif // REPORT_DEADBAND_H
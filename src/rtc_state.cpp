@@ -0,0 +1,202 @@
+#include "rtc_state.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "crc_utils.h"
+#include "system_state.h"
+
+struct RtcBlock {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;            // sizeof(RetainedState) - a rebuilt struct doesn't match
+    uint16_t crc;               // CRC-16/CCITT of state
+    RetainedState state;
+};
+
+struct RtcCheckpointBlock {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;            // sizeof(RtcCheckpoint)
+    uint16_t crc;               // CRC-16/CCITT of checkpoint
+    uint8_t resumeCount;        // Resumes since the last stable run - valid with the magic
+    RtcCheckpoint checkpoint;
+};
+
+// Loaded (zeroed) by the bootloader on every boot except a deep sleep wake
+static RTC_DATA_ATTR RtcBlock rtcBlock;
+
+// Never loaded - whatever the last run left, or noise after a power-on
+static RTC_NOINIT_ATTR RtcCheckpointBlock checkpointBlock;
+
+static uint16_t retainedCrc(const RetainedState& state) {
+    return crc16Ccitt(reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+}
+
+static uint16_t checkpointCrc(const RtcCheckpoint& checkpoint) {
+    return crc16Ccitt(reinterpret_cast<const uint8_t*>(&checkpoint), sizeof(checkpoint));
+}
+
+ResetClass classifyReset(esp_reset_reason_t reason) {
+    switch (reason) {
+        case ESP_RST_POWERON: return ResetClass::POWER_ON;
+        case ESP_RST_DEEPSLEEP: return ResetClass::DEEP_SLEEP;
+        case ESP_RST_SW: return ResetClass::SOFTWARE;
+        case ESP_RST_PANIC: return ResetClass::CRASH;
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT: return ResetClass::WATCHDOG;
+        case ESP_RST_BROWNOUT: return ResetClass::BROWNOUT;
+        default: return ResetClass::OTHER;
+    }
+}
+
+const char* resetClassToString(ResetClass resetClass) {
+    switch (resetClass) {
+        case ResetClass::POWER_ON: return "Power On";
+        case ResetClass::DEEP_SLEEP: return "Deep Sleep";
+        case ResetClass::SOFTWARE: return "Software";
+        case ResetClass::CRASH: return "Crash";
+        case ResetClass::WATCHDOG: return "Watchdog";
+        case ResetClass::BROWNOUT: return "Brownout";
+        default: return "Unknown";
+    }
+}
+
+RtcStateStore::RtcStateStore() {
+    wake = false;
+    resume = false;
+    resetClass = ResetClass::OTHER;
+    resumeCount = 0;
+    memset(&restored, 0, sizeof(restored));
+    memset(&staged, 0, sizeof(staged));
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    memset(&stagedCheckpoint, 0, sizeof(stagedCheckpoint));
+    checkpointsTaken = 0;
+}
+
+bool RtcStateStore::begin() {
+    wake = false;
+    resume = false;
+    resetClass = classifyReset(esp_reset_reason());
+    memset(&restored, 0, sizeof(restored));
+    memset(&checkpoint, 0, sizeof(checkpoint));
+
+    if (resetClass == ResetClass::DEEP_SLEEP && rtcBlock.magic == RTC_STATE_MAGIC &&
+        rtcBlock.version == RTC_STATE_VERSION && rtcBlock.length == sizeof(RetainedState) &&
+        rtcBlock.crc == retainedCrc(rtcBlock.state)) {
+        restored = rtcBlock.state;
+        wake = true;
+    }
+
+    // Used once; a crash later in this cycle must not bring it back
+    rtcBlock.magic = 0;
+
+    if (!wake) {
+        resume = takeCheckpoint();
+    }
+    return wake;
+}
+
+// A crash or watchdog reset mid-flight with a checkpoint that checks, and
+// not too many resumes in a row
+bool RtcStateStore::takeCheckpoint() {
+    bool valid = checkpointBlock.magic == RTC_CHECKPOINT_MAGIC &&
+                 checkpointBlock.version == RTC_STATE_VERSION &&
+                 checkpointBlock.length == sizeof(RtcCheckpoint) &&
+                 checkpointBlock.crc == checkpointCrc(checkpointBlock.checkpoint);
+    resumeCount = valid ? checkpointBlock.resumeCount : 0;
+
+    FlightPhase phase = static_cast<FlightPhase>(checkpointBlock.checkpoint.state.flightPhase);
+    bool inFlight = phase != FlightPhase::GROUND && phase <= FlightPhase::LANDING;
+    bool crashed = resetClass == ResetClass::CRASH || resetClass == ResetClass::WATCHDOG;
+    if (!valid || !crashed || !inFlight || resumeCount >= RTC_RESUME_MAX_CRASHES) {
+        // The full boot's own run starts the count again
+        checkpointBlock.magic = 0;
+        resumeCount = 0;
+        return false;
+    }
+
+    checkpoint = checkpointBlock.checkpoint;
+    restored = checkpoint.state;
+    restored.link.nextSequence += RTC_RESUME_SEQUENCE_SKIP;
+    restored.link.packetSequence += RTC_RESUME_SEQUENCE_SKIP;
+    resumeCount++;
+    checkpointBlock.resumeCount = resumeCount;
+    return true;
+}
+
+RtcCheckpoint& RtcStateStore::prepareCheckpoint() {
+    memset(&stagedCheckpoint, 0, sizeof(stagedCheckpoint));
+    stagedCheckpoint.state = restored;
+    return stagedCheckpoint;
+}
+
+void RtcStateStore::commitCheckpoint() {
+    stagedCheckpoint.uptimeMs = millis();
+    stagedCheckpoint.checkpointCount = ++checkpointsTaken;
+
+    // Magic last and cleared first, so a reset mid-copy leaves nothing that checks
+    checkpointBlock.magic = 0;
+    checkpointBlock.checkpoint = stagedCheckpoint;
+    checkpointBlock.version = RTC_STATE_VERSION;
+    checkpointBlock.length = sizeof(RtcCheckpoint);
+    checkpointBlock.crc = checkpointCrc(stagedCheckpoint);
+    checkpointBlock.resumeCount = resumeCount;
+    checkpointBlock.magic = RTC_CHECKPOINT_MAGIC;
+}
+
+void RtcStateStore::markStable() {
+    resumeCount = 0;
+    checkpointBlock.resumeCount = 0;
+}
+
+RetainedState& RtcStateStore::prepare() {
+    staged = restored;
+    return staged;
+}
+
+void RtcStateStore::save(uint32_t sleepMs) {
+    staged.sleepMs = sleepMs;
+    staged.wakeCount = wake ? restored.wakeCount + 1 : 1;
+
+    rtcBlock.state = staged;
+    rtcBlock.version = RTC_STATE_VERSION;
+    rtcBlock.length = sizeof(RetainedState);
+    rtcBlock.crc = retainedCrc(rtcBlock.state);
+    rtcBlock.magic = RTC_STATE_MAGIC;
+}
+
+void RtcStateStore::printStatus() const {
+    if (resume) {
+        Serial.printf("RTC state: resume %u after a %s reset, checkpoint %lu taken at %lu ms\n", resumeCount,
+                      resetClassToString(resetClass), (unsigned long)checkpoint.checkpointCount,
+                      (unsigned long)checkpoint.uptimeMs);
+        Serial.printf("  Link: seq %u, SF%d, %u queued frames kept\n", restored.link.nextSequence,
+                      restored.link.spreadingFactor, checkpoint.frameCount);
+        return;
+    }
+    if (!wake) {
+        Serial.printf("RTC state: full boot (%s reset, reason %d)\n", resetClassToString(resetClass),
+                      (int)esp_reset_reason());
+        return;
+    }
+    Serial.printf("RTC state: wake %lu after %lu ms asleep (cause %d), last cycle sent after %lu ms\n",
+                  (unsigned long)restored.wakeCount, (unsigned long)restored.sleepMs,
+                  (int)esp_sleep_get_wakeup_cause(), (unsigned long)restored.wakeToTransmitMs);
+    Serial.printf("  Link: seq %u, SF%d BW%ld CR4/%d %d dBm, hop key %s%u\n", restored.link.nextSequence,
+                  restored.link.spreadingFactor, (long)restored.link.bandwidth, restored.link.codingRate,
+                  restored.link.txPower, restored.link.hopKeyValid ? "" : "(none) ", restored.link.hopKey);
+    Serial.printf("  Sensors: sea level %.1f Pa, baro offset %.1f m (%s), fix %s%s%s\n",
+                  restored.sensors.seaLevelPressure, restored.sensors.baroOffset,
+                  restored.sensors.gpsReferenced ? "GPS referenced" : "unreferenced",
+                  restored.sensors.fixValid ? "kept" : "none", restored.sensors.gpsUbx ? ", UBX" : "",
+                  restored.sensors.gpsBackup ? ", receiver in backup" : "");
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static RtcStateStore rtcStateInstance;
+
+RtcStateStore& Retained() { return rtcStateInstance; }
@@ -0,0 +1,162 @@
+#ifndef RTC_STATE_H
+#define RTC_STATE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "common_types.h"
+#include "esp_system.h"
+
+// ===========================
+// RTC State
+// What a deep sleep carries over in RTC slow memory, and whether this boot
+// is a wake that can skip the full bring-up
+// ===========================
+
+// Deep sleep powers down the CPU and SRAM; RTC slow memory stays up. Just
+// before esp_deep_sleep_start() each owner writes its part into prepare()
+// - LoRaManager the sequence number, the link rate ADR settled on and the
+// hop key, SensorManager the sea level pressure, the altitude filter's baro
+// offset and the last fix, PacketHandler its sequence, SystemState the
+// flight phase - and save() seals it. On the next boot the owners take it
+// back before their begin(), so the base station sees a link that paused
+// rather than a new device at the default rate, and the altitude doesn't
+// wait for a GPS fix to find its offset again.
+//
+// The block is trusted only on a deep sleep wake with magic, version,
+// length and CRC intact; any other reset (power-on, brownout, panic, a new
+// image) zeroes RTC data and boots the full way. prepare() starts from what
+// came in, so an owner with nothing new (no fix this cycle) leaves the old.
+//
+// A crash doesn't get to run prepare(), so loop() also keeps a checkpoint
+// of the same state every RTC_CHECKPOINT_INTERVAL_MS, with the few frames
+// still waiting in the radio's queue, in RTC memory the bootloader leaves
+// alone on every reset. After a panic or watchdog reset mid-flight - with
+// the phase past GROUND and short of RECOVERY - begin() takes the
+// checkpoint and the boot resumes: the wake's short bring-up, the camera
+// deferred, the crash report and the kept frames out first. Sequence
+// numbers skip ahead by RTC_RESUME_SEQUENCE_SKIP, since anything sent after
+// the checkpoint was already numbered. A resume that crashes again within
+// RTC_RESUME_STABLE_MS counts against RTC_RESUME_MAX_CRASHES; past it the
+// boot goes the full way, in case the crash is in the short path itself.
+
+#define RTC_STATE_MAGIC            0x43534C50  // 'CSLP'
+#define RTC_STATE_VERSION          2
+#define RTC_CHECKPOINT_MAGIC       0x43534B50  // 'CSKP'
+#define RTC_CHECKPOINT_INTERVAL_MS 2000
+#define RTC_QUEUE_FRAMES           4           // Radio queue frames kept, highest priority first
+#define RTC_QUEUE_PAYLOAD          64          // Larger payloads aren't kept
+#define RTC_RESUME_MAX_CRASHES     3
+#define RTC_RESUME_STABLE_MS       60000
+#define RTC_RESUME_SEQUENCE_SKIP   32
+
+// What a reset says about the run before it
+enum class ResetClass : uint8_t {
+    POWER_ON = 0,
+    DEEP_SLEEP,
+    SOFTWARE,       // ESP.restart() - meant
+    CRASH,          // Panic: exception, abort, assert
+    WATCHDOG,       // Interrupt, task or RTC watchdog
+    BROWNOUT,
+    OTHER
+};
+
+struct RtcLinkState {
+    uint16_t nextSequence;
+    uint16_t hopKey;
+    int32_t bandwidth;          // Hz
+    int8_t spreadingFactor;
+    int8_t codingRate;
+    int8_t txPower;
+    uint8_t headerVersion;      // As negotiated with the base station
+    uint8_t packetSequence;     // PacketHandler's wire sequence
+    bool hopKeyValid;
+    bool valid;
+};
+
+struct RtcSensorState {
+    float seaLevelPressure;     // Pa
+    float baroOffset;           // m, altitude filter's b
+    float baroOffsetVariance;   // m²
+    GPSData lastFix;
+    uint32_t utcAtSave;         // Clock() UTC seconds when saved, 0 unsynced
+    bool gpsReferenced;         // baroOffset came from a GPS fix
+    bool fixValid;
+    bool gpsUbx;                // Receiver took the UBX configuration and was sending NAV-PVT
+    bool gpsBackup;             // Receiver put in backup mode for the sleep
+    bool valid;
+};
+
+struct RetainedState {
+    uint32_t sleepMs;           // Timer set for the sleep this boot woke from
+    uint32_t wakeCount;         // Wake boots since the last full one, this one included
+    uint32_t wakeToTransmitMs;  // The previous cycle's, 0 if it never sent
+    uint8_t mode;               // SystemMode
+    uint8_t flightPhase;        // FlightPhase
+    RtcLinkState link;
+    RtcSensorState sensors;
+};
+
+struct RtcQueuedFrame {
+    uint8_t type;               // PacketType
+    uint8_t length;
+    uint8_t payload[RTC_QUEUE_PAYLOAD];
+};
+
+struct RtcCheckpoint {
+    RetainedState state;
+    uint32_t uptimeMs;          // millis() when taken
+    uint32_t checkpointCount;   // Since the boot that took it
+    uint8_t frameCount;
+    RtcQueuedFrame frames[RTC_QUEUE_FRAMES];
+};
+
+class RtcStateStore {
+public:
+    RtcStateStore();
+
+    // Top of setup(): reset reason and the RTC block's checks; true on a deep sleep wake
+    bool begin();
+
+    bool isWake() const { return wake; }
+    bool isResume() const { return resume; }                        // Crash mid-flight, from the checkpoint
+    ResetClass getResetClass() const { return resetClass; }
+    const RetainedState& getState() const { return restored; }    // Zeroed on a full boot
+    const RtcCheckpoint& getCheckpoint() const { return checkpoint; }   // The resume's; zeroed otherwise
+    uint8_t getResumeCount() const { return resumeCount; }         // This one included, since the last stable run
+
+    // From loop(): owners fill prepareCheckpoint(), commitCheckpoint() seals it
+    RtcCheckpoint& prepareCheckpoint();
+    void commitCheckpoint();
+    // Once the run has lasted RTC_RESUME_STABLE_MS
+    void markStable();
+
+    // Before sleeping: owners update prepare(), save() seals it into RTC memory
+    RetainedState& prepare();
+    void save(uint32_t sleepMs);
+
+    void printStatus() const;
+
+private:
+    bool wake;
+    bool resume;
+    ResetClass resetClass;
+    uint8_t resumeCount;
+    RetainedState restored;
+    RetainedState staged;
+    RtcCheckpoint checkpoint;
+    RtcCheckpoint stagedCheckpoint;
+    uint32_t checkpointsTaken;
+
+    bool takeCheckpoint();
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern RtcStateStore& Retained();
+
+ResetClass classifyReset(esp_reset_reason_t reason);
+const char* resetClassToString(ResetClass resetClass);
+
+#endif // RTC_STATE_H
@@ -0,0 +1,219 @@
+#include "rtp_jpeg.h"
+
+#define RTP_HEADER_SIZE            12
+#define RTP_JPEG_HEADER_SIZE       8
+#define RTP_RESTART_HEADER_SIZE    4
+#define RTP_QTABLE_HEADER_SIZE     4
+#define RTP_QTABLE_SIZE            64
+#define RTP_JPEG_DYNAMIC_Q         255     // Tables in-band, may change every frame
+#define RTP_JPEG_TYPE_RESTART      64      // Added to the type when DRI is present
+
+static uint16_t readBE16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static void writeBE16(uint8_t* p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+static void writeBE32(uint8_t* p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+}
+
+// ===========================
+// Packetizer
+// ===========================
+
+RtpJpegPacketizer::RtpJpegPacketizer() {
+    ssrc = 0;
+    sequence = 0;
+    timestamp = 0;
+    scan = nullptr;
+    scanLength = 0;
+    offset = 0;
+    tables[0] = tables[1] = nullptr;
+    restartInterval = 0;
+    type = 0;
+    width8 = 0;
+    height8 = 0;
+    active = false;
+}
+
+void RtpJpegPacketizer::begin(uint32_t ssrc, uint16_t firstSequence) {
+    this->ssrc = ssrc;
+    sequence = firstSequence;
+    active = false;
+}
+
+bool RtpJpegPacketizer::setFrame(const uint8_t* jpeg, size_t length, uint32_t timestamp) {
+    active = false;
+    if (!jpeg || length < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+        return false;
+    }
+
+    const uint8_t* frameTables[2] = {nullptr, nullptr};
+    uint16_t interval = 0;
+    int frameType = -1;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    const uint8_t* scanStart = nullptr;
+
+    size_t pos = 2;
+    while (!scanStart && pos + 4 <= length) {
+        if (jpeg[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;      // Fill byte
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            pos += 2;   // No length
+            continue;
+        }
+        uint16_t segmentLength = readBE16(&jpeg[pos + 2]);
+        const uint8_t* data = &jpeg[pos + 4];
+        if (segmentLength < 2 || pos + 2 + segmentLength > length) {
+            return false;
+        }
+        size_t dataLength = segmentLength - 2;
+
+        switch (marker) {
+            case 0xDB:  // DQT - one or more tables
+                for (size_t i = 0; i + 1 + RTP_QTABLE_SIZE <= dataLength; i += 1 + RTP_QTABLE_SIZE) {
+                    if (data[i] >> 4) {
+                        return false;   // 16-bit tables don't fit the 8-bit type 0/1 layout
+                    }
+                    uint8_t id = data[i] & 0x0F;
+                    if (id < 2) {
+                        frameTables[id] = &data[i + 1];
+                    }
+                }
+                break;
+            case 0xC0:  // SOF0 - baseline
+            case 0xC1:  // SOF1 - extended sequential, Huffman; same bitstream at 8 bits
+                if (dataLength < 15 || data[0] != 8 || data[5] != 3 || data[10] != 0x11 || data[13] != 0x11) {
+                    return false;
+                }
+                height = readBE16(&data[1]);
+                width = readBE16(&data[3]);
+                if (data[7] == 0x21) {
+                    frameType = 0;      // 4:2:2
+                } else if (data[7] == 0x22) {
+                    frameType = 1;      // 4:2:0
+                } else {
+                    return false;
+                }
+                break;
+            case 0xDD:  // DRI
+                if (dataLength >= 2) {
+                    interval = readBE16(data);
+                }
+                break;
+            case 0xDA:  // SOS - entropy coded data runs from here to EOI
+                scanStart = data + dataLength;
+                break;
+            case 0xC2:  // Progressive and the rest - RFC 2435 is baseline only
+            case 0xC3:
+            case 0xC5:
+            case 0xC6:
+            case 0xC7:
+            case 0xC9:
+            case 0xCA:
+            case 0xCB:
+            case 0xCD:
+            case 0xCE:
+            case 0xCF:
+                return false;
+            default:
+                break;
+        }
+        pos += 2 + segmentLength;
+    }
+
+    if (!scanStart || frameType < 0 || !frameTables[0] || width == 0 || height == 0 ||
+        width > RTP_JPEG_MAX_DIMENSION || height > RTP_JPEG_MAX_DIMENSION) {
+        return false;
+    }
+
+    // The driver pads its buffers past EOI
+    const uint8_t* scanEnd = jpeg + length;
+    while (scanEnd - scanStart >= 2 && !(scanEnd[-2] == 0xFF && scanEnd[-1] == 0xD9)) {
+        scanEnd--;
+    }
+    if (scanEnd - scanStart < 2) {
+        return false;
+    }
+    scanEnd -= 2;
+
+    scan = scanStart;
+    scanLength = scanEnd - scanStart;
+    offset = 0;
+    tables[0] = frameTables[0];
+    tables[1] = frameTables[1] ? frameTables[1] : frameTables[0];   // One table for all components
+    restartInterval = interval;
+    type = frameType + (interval ? RTP_JPEG_TYPE_RESTART : 0);
+    width8 = (width + 7) / 8;
+    height8 = (height + 7) / 8;
+    this->timestamp = timestamp;
+    active = true;
+    return true;
+}
+
+size_t RtpJpegPacketizer::nextPacket(uint8_t* out, size_t mtu) {
+    if (!active || offset >= scanLength) {
+        active = false;
+        return 0;
+    }
+    if (mtu < RTP_JPEG_MIN_MTU) {
+        mtu = RTP_JPEG_MIN_MTU;
+    }
+    const size_t packetMax = mtu - RTP_JPEG_IP_UDP_HEADER;
+
+    uint8_t* p = out + RTP_HEADER_SIZE;
+
+    p[0] = 0;   // Type-specific
+    p[1] = (offset >> 16) & 0xFF;
+    p[2] = (offset >> 8) & 0xFF;
+    p[3] = offset & 0xFF;
+    p[4] = type;
+    p[5] = RTP_JPEG_DYNAMIC_Q;
+    p[6] = width8;
+    p[7] = height8;
+    p += RTP_JPEG_HEADER_SIZE;
+
+    if (restartInterval) {
+        // Fragments don't follow restart intervals: F and L set, count 0x3FFF
+        writeBE16(p, restartInterval);
+        writeBE16(p + 2, 0xFFFF);
+        p += RTP_RESTART_HEADER_SIZE;
+    }
+
+    if (offset == 0) {
+        p[0] = 0;   // MBZ
+        p[1] = 0;   // Precision - 8-bit tables
+        writeBE16(p + 2, 2 * RTP_QTABLE_SIZE);
+        memcpy(p + 4, tables[0], RTP_QTABLE_SIZE);
+        memcpy(p + 4 + RTP_QTABLE_SIZE, tables[1], RTP_QTABLE_SIZE);
+        p += RTP_QTABLE_HEADER_SIZE + 2 * RTP_QTABLE_SIZE;
+    }
+
+    size_t room = packetMax - (p - out);
+    size_t chunk = scanLength - offset < room ? scanLength - offset : room;
+    memcpy(p, scan + offset, chunk);
+    offset += chunk;
+    bool last = offset >= scanLength;
+
+    out[0] = 0x80;  // V=2, no padding, extension or CSRCs
+    out[1] = (last ? 0x80 : 0) | RTP_JPEG_PAYLOAD_TYPE;
+    writeBE16(&out[2], sequence++);
+    writeBE32(&out[4], timestamp);
+    writeBE32(&out[8], ssrc);
+
+    return (p - out) + chunk;
+}
@@ -0,0 +1,74 @@
+#ifndef RTP_JPEG_H
+#define RTP_JPEG_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// RTP/JPEG Packetizer
+// Baseline JPEG frames as RFC 2435 RTP packets, for a UDP video stream that
+// drops a frame on loss instead of stalling like MJPEG over TCP
+// ===========================
+
+// setFrame() parses the JPEG once - sampling, size, restart interval and the
+// quantization tables - and nextPacket() cuts the entropy coded scan into
+// packets that fit the MTU. Each packet carries its fragment offset, so a
+// receiver rebuilds a frame only if every offset arrived and otherwise waits
+// for the next frame's offset 0. The last packet of a frame has the marker
+// bit set. Quantization tables go in-band in each frame's first packet
+// (Q 255), since the stream governor changes the sensor's quality.
+//
+// Packet, network byte order:
+//   [0-11]   RTP header: V=2, M, PT 26, sequence, timestamp, SSRC
+//   [12-19]  JPEG header: type-specific 0, fragment offset (24 bit), type,
+//            Q, width / 8, height / 8
+//   [20-23]  Restart marker header, types 64-65 only
+//   [..]     Quantization table header and tables, first packet only
+//   [..]     Scan data
+//
+// Sequence numbers run on across frames and wrap; timestamps are the
+// capture time on the 90 kHz RTP video clock. The frame is not copied -
+// it must stay put until nextPacket() returns 0.
+
+#define RTP_JPEG_PAYLOAD_TYPE      26      // RFC 3551 static type for JPEG
+#define RTP_JPEG_CLOCK_HZ          90000
+#define RTP_JPEG_DEFAULT_MTU       1400    // IP MTU; leaves room for tunnels and VPNs on the ground side
+#define RTP_JPEG_MIN_MTU           256     // Room for the headers and both tables in the first packet
+#define RTP_JPEG_MAX_MTU           1500
+#define RTP_JPEG_IP_UDP_HEADER     28      // IPv4 + UDP, taken off the MTU
+#define RTP_JPEG_MAX_DIMENSION     2040    // Width and height travel as 8-bit multiples of 8
+
+class RtpJpegPacketizer {
+public:
+    RtpJpegPacketizer();
+
+    void begin(uint32_t ssrc, uint16_t firstSequence);
+
+    // False if the frame isn't a baseline 4:2:2 / 4:2:0 JPEG RFC 2435 can carry
+    bool setFrame(const uint8_t* jpeg, size_t length, uint32_t timestamp);
+
+    // Next packet of the frame, at most mtu - RTP_JPEG_IP_UDP_HEADER bytes;
+    // 0 once the frame is done
+    size_t nextPacket(uint8_t* out, size_t mtu);
+
+    uint16_t getSequence() const { return sequence; }
+    uint32_t getSsrc() const { return ssrc; }
+
+private:
+    uint32_t ssrc;
+    uint16_t sequence;
+    uint32_t timestamp;
+
+    // The frame being sent
+    const uint8_t* scan;
+    size_t scanLength;
+    size_t offset;
+    const uint8_t* tables[2];   // Luma, chroma; 64 bytes each in zigzag order
+    uint16_t restartInterval;
+    uint8_t type;
+    uint8_t width8;
+    uint8_t height8;
+    bool active;
+};
+
+#endif // RTP_JPEG_H
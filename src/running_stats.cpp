@@ -0,0 +1,134 @@
+#include "running_stats.h"
+
+// ===========================
+// Mean and Variance
+// ===========================
+
+void runningStatsAdd(RunningStats& stats, float value) {
+    stats.count++;
+    double delta = value - stats.mean;
+    stats.mean += delta / stats.count;
+    stats.m2 += delta * (value - stats.mean);
+}
+
+float runningStatsVariance(const RunningStats& stats) {
+    return stats.count > 1 ? (float)(stats.m2 / (stats.count - 1)) : 0.0f;
+}
+
+// ===========================
+// T-Digest
+// ===========================
+
+// Arcsine scale: flat in the middle, steep at the tails
+static float tdigestScale(float q) {
+    return TDIGEST_COMPRESSION / (2.0f * (float)M_PI) * asinf(constrain(2.0f * q - 1.0f, -1.0f, 1.0f));
+}
+
+// The buffer, sorted, merged with the centroids and compressed back into them
+static void tdigestMerge(TDigest& digest) {
+    if (digest.buffered == 0) {
+        return;
+    }
+
+    float* buffer = digest.buffer;
+    for (uint8_t i = 1; i < digest.buffered; i++) {
+        float value = buffer[i];
+        int8_t j = i - 1;
+        while (j >= 0 && buffer[j] > value) {
+            buffer[j + 1] = buffer[j];
+            j--;
+        }
+        buffer[j + 1] = value;
+    }
+
+    // Both runs are sorted; walk them together and fold into a centroid
+    // while its span on the scale stays within one unit
+    float means[TDIGEST_CENTROIDS];
+    uint32_t weights[TDIGEST_CENTROIDS];
+    uint8_t out = 0;
+    uint8_t c = 0, b = 0;
+    float total = digest.count;
+    uint32_t before = 0;            // Weight left of the centroid being built
+    float lowScale = tdigestScale(0.0f);
+
+    while (c < digest.centroids || b < digest.buffered) {
+        float mean;
+        uint32_t weight;
+        if (b >= digest.buffered || (c < digest.centroids && digest.means[c] <= buffer[b])) {
+            mean = digest.means[c];
+            weight = digest.weights[c++];
+        } else {
+            mean = buffer[b++];
+            weight = 1;
+        }
+
+        if (out > 0) {
+            uint32_t merged = weights[out - 1] + weight;
+            // Full, there's nowhere else for it; the last centroid grows past its bound
+            if (tdigestScale((before + merged) / total) - lowScale <= 1.0f || out == TDIGEST_CENTROIDS) {
+                means[out - 1] += (mean - means[out - 1]) * weight / merged;
+                weights[out - 1] = merged;
+                continue;
+            }
+            before += weights[out - 1];
+            lowScale = tdigestScale(before / total);
+        }
+        means[out] = mean;
+        weights[out] = weight;
+        out++;
+    }
+
+    memcpy(digest.means, means, out * sizeof(float));
+    memcpy(digest.weights, weights, out * sizeof(uint32_t));
+    digest.centroids = out;
+    digest.buffered = 0;
+}
+
+void tdigestAdd(TDigest& digest, float value) {
+    if (digest.count == 0) {
+        digest.min = value;
+        digest.max = value;
+    }
+    digest.min = min(digest.min, value);
+    digest.max = max(digest.max, value);
+    digest.count++;
+    digest.buffer[digest.buffered++] = value;
+    if (digest.buffered == TDIGEST_BUFFER) {
+        tdigestMerge(digest);
+    }
+}
+
+float tdigestQuantile(const TDigest& digest, float q) {
+    if (digest.count == 0) {
+        return 0.0f;
+    }
+    TDigest merged = digest;
+    tdigestMerge(merged);
+
+    // Each centroid's weight sits around its mean; between two centres the
+    // quantile moves in a straight line, and out to the extremes past the ends
+    float target = constrain(q, 0.0f, 1.0f) * merged.count;
+    float centre = merged.weights[0] / 2.0f;
+    if (target < centre) {
+        return merged.min + (merged.means[0] - merged.min) * target / centre;
+    }
+    for (uint8_t i = 0; i + 1 < merged.centroids; i++) {
+        float next = centre + (merged.weights[i] + merged.weights[i + 1]) / 2.0f;
+        if (target < next) {
+            return merged.means[i] + (merged.means[i + 1] - merged.means[i]) * (target - centre) / (next - centre);
+        }
+        centre = next;
+    }
+    uint8_t last = merged.centroids - 1;
+    float tail = merged.weights[last] / 2.0f;
+    return merged.means[last] + (merged.max - merged.means[last]) * min((target - centre) / tail, 1.0f);
+}
+
+// ===========================
+// Stream Summary
+// ===========================
+
+void streamSummaryAdd(StreamSummary& summary, float value) {
+    runningStatsAdd(summary.moments, value);
+    tdigestAdd(summary.digest, value);
+}
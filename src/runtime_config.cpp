@@ -0,0 +1,294 @@
+#include "runtime_config.h"
+#include <Preferences.h>
+#include <cstddef>
+#include "camera_manager.h"
+#include "crc_utils.h"
+#include "debug_utils.h"
+#include "lora_comm.h"
+
+struct ConfigRecord {
+    uint16_t version;               // CONFIG_RECORD_VERSION
+    uint16_t length;                // sizeof(RuntimeConfig) - a rebuilt struct doesn't match
+    uint16_t crc;                   // CRC-16/CCITT of config
+    RuntimeConfig config;
+};
+
+#define KEY_CONFIG_RECORD "record"
+
+static Preferences configPrefs;
+
+// In ConfigKey order
+#define CONFIG_KEY(field, min, max) {#field, offsetof(RuntimeConfig, field), min, max}
+static const ConfigKeySpec keySpecs[CONFIG_KEY_COUNT] = {
+    CONFIG_KEY(heartbeatIntervalMs, 1000, 86400000),
+    CONFIG_KEY(statusIntervalMs, 1000, 86400000),
+    CONFIG_KEY(trackIntervalMs, 1000, 86400000),
+    CONFIG_KEY(cameraBurstFrames, 1, CAMERA_BURST_MAX_FRAMES),
+    CONFIG_KEY(loraTxPower, 2, 20),
+    CONFIG_KEY(loraArqWindow, 1, LORA_ACK_BITMAP_BITS),
+    CONFIG_KEY(debugLevel, 0, static_cast<int32_t>(DebugLevel::VERBOSE)),
+};
+
+static_assert(sizeof(RuntimeConfig) == sizeof(uint32_t) + CONFIG_KEY_COUNT * sizeof(int32_t),
+              "Every RuntimeConfig field after the version needs a keySpecs row");
+static_assert(CONFIG_STORE_SLOTS >= 2 && CONFIG_STORE_SLOTS <= 255, "CONFIG_STORE_SLOTS out of range");
+
+static uint16_t configCrc(const RuntimeConfig& config) {
+    return crc16Ccitt(reinterpret_cast<const uint8_t*>(&config), sizeof(config));
+}
+
+// ===========================
+// Pinned Versions
+// ===========================
+
+ConfigRef::ConfigRef(const ConfigStore* store, uint8_t slot)
+    : store(store), slot(slot), config(&store->slots[slot]) {}
+
+ConfigRef::ConfigRef(ConfigRef&& other) : store(other.store), slot(other.slot), config(other.config) {
+    other.store = nullptr;
+}
+
+ConfigRef::~ConfigRef() {
+    if (store) {
+        store->release(slot);
+    }
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+ConfigStore::ConfigStore() {
+    memset(slots, 0, sizeof(slots));
+    for (int i = 0; i < CONFIG_STORE_SLOTS; i++) {
+        readers[i].store(0, std::memory_order_relaxed);
+    }
+    current.store(0, std::memory_order_relaxed);
+    memset(&defaults, 0, sizeof(defaults));
+    writeLock = nullptr;
+    applyCallback = nullptr;
+    applyContext = nullptr;
+    persistReady = false;
+    publishes = 0;
+    refused = 0;
+    slotsBusy = 0;
+    persistFailures = 0;
+    loadedFromNvs = false;
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool ConfigStore::begin(const RuntimeConfig& buildDefaults, ConfigApplyCallback callback, void* context) {
+    if (writeLock) {
+        return true;
+    }
+    if (!validate(buildDefaults)) {
+        SYS_ERROR("Runtime config: a build default is out of its key's range");
+        return false;
+    }
+    writeLock = xSemaphoreCreateMutex();
+    if (!writeLock) {
+        return false;
+    }
+
+    defaults = buildDefaults;
+    defaults.version = 0;
+    applyCallback = callback;
+    applyContext = context;
+
+    // Nobody reads before begin(), so slot 0 is written in place
+    RuntimeConfig initial = defaults;
+    persistReady = configPrefs.begin(CONFIG_NAMESPACE, false);
+    if (!persistReady) {
+        SYS_WARNING("Runtime config: NVS unavailable - settings last until reset");
+    } else if (load(initial)) {
+        loadedFromNvs = true;
+    }
+    slots[0] = initial;
+    current.store(0, std::memory_order_release);
+
+    if (loadedFromNvs) {
+        SYS_INFO("Runtime config: version %lu from NVS", (unsigned long)initial.version);
+        if (applyCallback && memcmp(&initial.heartbeatIntervalMs, &defaults.heartbeatIntervalMs,
+                                    sizeof(RuntimeConfig) - offsetof(RuntimeConfig, heartbeatIntervalMs)) != 0) {
+            applyCallback(defaults, initial, applyContext);
+        }
+    }
+    return true;
+}
+
+// ===========================
+// Readers (any task)
+// ===========================
+
+// Pin, then check the slot is still current: a writer that picked it
+// before the pin has published it whole by the time it is current again,
+// and one that looks after the pin sees the count and leaves it alone
+ConfigRef ConfigStore::read() const {
+    for (;;) {
+        uint8_t slot = current.load(std::memory_order_acquire);
+        readers[slot].fetch_add(1, std::memory_order_seq_cst);
+        if (current.load(std::memory_order_seq_cst) == slot) {
+            return ConfigRef(this, slot);
+        }
+        release(slot);
+    }
+}
+
+uint32_t ConfigStore::getVersion() const {
+    return read()->version;
+}
+
+// ===========================
+// Writers
+// ===========================
+
+RuntimeConfig ConfigStore::draft() const {
+    return *read();
+}
+
+bool ConfigStore::publish(const RuntimeConfig& next) {
+    if (!writeLock || !validate(next)) {
+        refused++;
+        return false;
+    }
+
+    xSemaphoreTake(writeLock, portMAX_DELAY);
+    uint8_t live = current.load(std::memory_order_relaxed);
+    int free = -1;
+    for (int i = 0; i < CONFIG_STORE_SLOTS; i++) {
+        if (i != live && readers[i].load(std::memory_order_seq_cst) == 0) {
+            free = i;
+            break;
+        }
+    }
+    if (free < 0) {
+        refused++;
+        slotsBusy++;
+        xSemaphoreGive(writeLock);
+        SYS_WARNING("Runtime config: every version is held - not published");
+        return false;
+    }
+
+    RuntimeConfig previous = slots[live];
+    slots[free] = next;
+    slots[free].version = previous.version + 1;
+    current.store(static_cast<uint8_t>(free), std::memory_order_seq_cst);
+    publishes++;
+    const RuntimeConfig& published = slots[free];
+
+    // The slot stays put until the next publish, which this lock holds off
+    if (applyCallback) {
+        applyCallback(previous, published, applyContext);
+    }
+    if (persistReady && !persist(published)) {
+        persistFailures++;
+        SYS_WARNING("Runtime config: version %lu not saved - the last saved one comes back after a reset",
+                    (unsigned long)published.version);
+    }
+    SYS_INFO("Runtime config: version %lu published", (unsigned long)published.version);
+    xSemaphoreGive(writeLock);
+    return true;
+}
+
+// ===========================
+// Keys
+// ===========================
+
+const ConfigKeySpec* ConfigStore::findKey(uint8_t key) {
+    return key < CONFIG_KEY_COUNT ? &keySpecs[key] : nullptr;
+}
+
+bool ConfigStore::setKey(RuntimeConfig& config, uint8_t key, int32_t value) {
+    const ConfigKeySpec* spec = findKey(key);
+    if (!spec || value < spec->min || value > spec->max) {
+        return false;
+    }
+    memcpy(reinterpret_cast<uint8_t*>(&config) + spec->offset, &value, sizeof(value));
+    return true;
+}
+
+int32_t ConfigStore::getKey(const RuntimeConfig& config, uint8_t key) {
+    const ConfigKeySpec* spec = findKey(key);
+    int32_t value = 0;
+    if (spec) {
+        memcpy(&value, reinterpret_cast<const uint8_t*>(&config) + spec->offset, sizeof(value));
+    }
+    return value;
+}
+
+bool ConfigStore::validate(const RuntimeConfig& config) {
+    for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++) {
+        int32_t value = getKey(config, key);
+        if (value < keySpecs[key].min || value > keySpecs[key].max) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ===========================
+// NVS
+// ===========================
+
+bool ConfigStore::persist(const RuntimeConfig& config) {
+    ConfigRecord record;
+    memset(&record, 0, sizeof(record));
+    record.version = CONFIG_RECORD_VERSION;
+    record.length = sizeof(RuntimeConfig);
+    record.config = config;
+    record.crc = configCrc(record.config);
+    return configPrefs.putBytes(KEY_CONFIG_RECORD, &record, sizeof(record)) == sizeof(record);
+}
+
+bool ConfigStore::load(RuntimeConfig& config) {
+    if (configPrefs.getBytesLength(KEY_CONFIG_RECORD) != sizeof(ConfigRecord)) {
+        return false;
+    }
+
+    ConfigRecord record;
+    if (configPrefs.getBytes(KEY_CONFIG_RECORD, &record, sizeof(record)) != sizeof(record) ||
+        record.version != CONFIG_RECORD_VERSION || record.length != sizeof(RuntimeConfig) ||
+        record.crc != configCrc(record.config)) {
+        SYS_WARNING("Runtime config: saved record doesn't match this build - defaults");
+        return false;
+    }
+    if (!validate(record.config)) {
+        SYS_WARNING("Runtime config: saved version %lu out of this build's ranges - defaults",
+                    (unsigned long)record.config.version);
+        return false;
+    }
+    config = record.config;
+    return true;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void ConfigStore::printStatus() const {
+    ConfigRef config = read();
+    Serial.println("=== Runtime Config ===");
+    Serial.printf("Version %lu%s, %lu published, %lu refused (%lu with every slot held), %lu not saved\n",
+                  (unsigned long)config->version, loadedFromNvs ? " (NVS at boot)" : "", (unsigned long)publishes,
+                  (unsigned long)refused, (unsigned long)slotsBusy, (unsigned long)persistFailures);
+    for (uint8_t key = 0; key < CONFIG_KEY_COUNT; key++) {
+        int32_t value = getKey(*config, key);
+        int32_t fallback = getKey(defaults, key);
+        if (value != fallback) {
+            Serial.printf("  %-20s %ld (default %ld)\n", keySpecs[key].name, (long)value, (long)fallback);
+        } else {
+            Serial.printf("  %-20s %ld\n", keySpecs[key].name, (long)value);
+        }
+    }
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static ConfigStore configStoreInstance;
+
+ConfigStore& Config() { return configStoreInstance; }
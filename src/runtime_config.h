@@ -0,0 +1,165 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "balloon_config.h"
+
+// ===========================
+// Runtime Configuration
+// The tunables the ground can change, as one versioned object: the build's
+// defines are the defaults, and each published version replaces the last
+// one whole
+// ===========================
+
+// A version never changes once it is published. A writer copies the
+// current one with draft(), edits the copy and publish()es it. The store
+// checks every key's range, writes the copy into a free slot and swaps the
+// current pointer in one store. Readers are on hot paths - the scheduler's
+// interval functions, for example - and take no lock. read() pins the
+// current slot with one atomic add and unpins it when the ConfigRef goes.
+// A writer reuses only a slot that nobody holds and that isn't current, so
+// a held version stays intact however many publishes follow. With every
+// slot held, a publish is refused rather than waited for; a reader holds a
+// version for a few field reads, not across a wait.
+//
+// The command dispatcher publishes once per COMMAND_BATCH, so a whole
+// profile - intervals, radio and camera settings together - arrives as one
+// version and nothing ever reads half of it. After each swap the apply
+// callback gets the previous and the new version, and pushes the keys that
+// changed to the managers that own them, on the publishing task.
+//
+// Each version is written to NVS, and begin() loads the last one over the
+// defaults, so the ground's settings survive a reset. A record from a
+// build with another key set doesn't match CONFIG_RECORD_VERSION or its
+// length, and is ignored. The version number carries on from the record.
+//
+// Settings the firmware adjusts on its own aren't keys: the camera's frame
+// size, quality, brightness and contrast follow its profiles and exposure
+// loop, and SF and bandwidth change with the peer (RATE_CHANGE).
+//
+// CONFIG_SET payload: [0] ConfigKey, [1..4] int32 value, big endian.
+
+#define CONFIG_RECORD_VERSION      1       // Of the NVS record; bump when keys change
+#define CONFIG_NAMESPACE           "rtconfig"
+
+enum class ConfigKey : uint8_t {
+    HEARTBEAT_INTERVAL = 0,
+    STATUS_INTERVAL,
+    TRACK_INTERVAL,
+    BURST_FRAMES,
+    TX_POWER,
+    ARQ_WINDOW,
+    DEBUG_LEVEL,
+    COUNT
+};
+
+#define CONFIG_KEY_COUNT static_cast<uint8_t>(ConfigKey::COUNT)
+
+struct RuntimeConfig {
+    uint32_t version;                   // Publishes since the first boot; 0 = the defaults
+    int32_t heartbeatIntervalMs;
+    int32_t statusIntervalMs;
+    int32_t trackIntervalMs;
+    int32_t cameraBurstFrames;
+    int32_t loraTxPower;                // dBm, the ceiling ADR and the power arbiter work under
+    int32_t loraArqWindow;
+    int32_t debugLevel;                 // DebugLevel
+};
+
+struct ConfigKeySpec {
+    const char* name;
+    size_t offset;                      // Of the int32_t in RuntimeConfig
+    int32_t min;
+    int32_t max;
+};
+
+// Publishing task, after the swap
+typedef void (*ConfigApplyCallback)(const RuntimeConfig& previous, const RuntimeConfig& current, void* context);
+
+class ConfigStore;
+
+// One pinned version; move-only, unpinned when it goes out of scope
+class ConfigRef {
+public:
+    ConfigRef(ConfigRef&& other);
+    ~ConfigRef();
+    ConfigRef(const ConfigRef&) = delete;
+    ConfigRef& operator=(const ConfigRef&) = delete;
+
+    const RuntimeConfig* operator->() const { return config; }
+    const RuntimeConfig& operator*() const { return *config; }
+
+private:
+    friend class ConfigStore;
+    ConfigRef(const ConfigStore* store, uint8_t slot);
+
+    const ConfigStore* store;
+    uint8_t slot;
+    const RuntimeConfig* config;
+};
+
+class ConfigStore {
+public:
+    ConfigStore();
+
+    // Defaults from the build, then the NVS record over them; the callback
+    // gets (defaults, loaded) when a record changed anything
+    bool begin(const RuntimeConfig& defaults, ConfigApplyCallback callback, void* context);
+    bool isReady() const { return writeLock != nullptr; }
+
+    // Any task, any core, no lock
+    ConfigRef read() const;
+    uint32_t getVersion() const;
+
+    // Writers: a copy of the current version to edit, and the swap; false
+    // leaves the current version - a key out of range, every slot held, or
+    // before begin()
+    RuntimeConfig draft() const;
+    RuntimeConfig getDefaults() const { return defaults; }
+    bool publish(const RuntimeConfig& next);
+
+    // Keys by number, for CONFIG_SET; false for an unknown key or a value out of range
+    static const ConfigKeySpec* findKey(uint8_t key);
+    static bool setKey(RuntimeConfig& config, uint8_t key, int32_t value);
+    static int32_t getKey(const RuntimeConfig& config, uint8_t key);
+    static bool validate(const RuntimeConfig& config);
+
+    uint32_t getPublishCount() const { return publishes; }
+    uint32_t getRefusedCount() const { return refused; }
+    void printStatus() const;
+
+private:
+    friend class ConfigRef;
+
+    RuntimeConfig slots[CONFIG_STORE_SLOTS];
+    mutable std::atomic<uint16_t> readers[CONFIG_STORE_SLOTS];
+    std::atomic<uint8_t> current;
+    RuntimeConfig defaults;
+
+    SemaphoreHandle_t writeLock;        // Writers only; created by begin()
+    ConfigApplyCallback applyCallback;
+    void* applyContext;
+    bool persistReady;
+
+    uint32_t publishes;
+    uint32_t refused;
+    uint32_t slotsBusy;                 // Refused for want of a free slot
+    uint32_t persistFailures;
+    bool loadedFromNvs;
+
+    bool persist(const RuntimeConfig& config);
+    bool load(RuntimeConfig& config);
+    void release(uint8_t slot) const { readers[slot].fetch_sub(1, std::memory_order_release); }
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern ConfigStore& Config();
+
+#endif // RUNTIME_CONFIG_H
@@ -0,0 +1,481 @@
+#include "rx_pipeline.h"
+#include "memory_ledger.h"
+#include "task_placement.h"
+#include "debug_utils.h"
+
+#define RX_SLOT_EMPTY     -1     // Nothing held for this sequence
+#define RX_SLOT_LINK      -2     // Sequence used by a link-layer frame, nothing to deliver
+
+static ReceivePipeline receivePipelineInstance;
+
+ReceivePipeline& RxPipeline() {
+    return receivePipelineInstance;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+ReceivePipeline::ReceivePipeline() {
+    memset(devices, 0, sizeof(devices));
+    pool = nullptr;
+    freeCount = 0;
+    batchCount = 0;
+    batchStarted = 0;
+    sinkCount = 0;
+    serviceHook = nullptr;
+    taskHandle = nullptr;
+    running = false;
+    batchesFlushed = 0;
+    recordsDelivered = 0;
+    poolExhausted = 0;
+}
+
+ReceivePipeline::~ReceivePipeline() {
+    end();
+}
+
+// ===========================
+// Initialization
+// ===========================
+
+bool ReceivePipeline::begin() {
+    if (!pool) {
+        // ~10 KB of records - PSRAM when we have it
+        size_t size = POOL_SIZE * sizeof(ReceivedRecord);
+        pool = (ReceivedRecord*)memAlloc(MemTag::RECEIVE, size);
+        if (!pool) {
+            LORA_TRACE("RX: Failed to allocate record pool");
+            return false;
+        }
+    }
+
+    freeCount = 0;
+    for (int i = POOL_SIZE - 1; i >= 0; i--) {
+        freeList[freeCount++] = i;
+    }
+    memset(devices, 0, sizeof(devices));
+    batchCount = 0;
+
+    // Both links feed the one pipeline - they share the balloon's sequence space
+    LoRaComm().setPacketReceivedCallback(onPacket);
+    LoRaComm().setLinkPacketCallback(onLinkPacket);
+    BulkLoRa().setPacketReceivedCallback(onPacket);
+    BulkLoRa().setLinkPacketCallback(onLinkPacket);
+    running = true;
+
+    // Own task so web and storage work in loop() never delays the radio drain
+    if (LORA_CONTINUOUS_LISTEN && !taskHandle) {
+        BaseType_t created = createPlacedTask(TaskId::LORA_RX, taskEntry, this, &taskHandle);
+        if (created != pdPASS) {
+            taskHandle = nullptr;
+            running = false;
+            return false;
+        }
+    }
+
+    LORA_TRACE("RX: Pipeline started (%s)", taskHandle ? "RX task" : "polled");
+    return true;
+}
+
+void ReceivePipeline::end() {
+    if (!running) {
+        return;
+    }
+
+    // The task clears its handle on the way out
+    running = false;
+    while (taskHandle) {
+        vTaskDelay(pdMS_TO_TICKS(RX_TASK_POLL_MS));
+    }
+
+    LoRaComm().setPacketReceivedCallback(nullptr);
+    LoRaComm().setLinkPacketCallback(nullptr);
+    BulkLoRa().setPacketReceivedCallback(nullptr);
+    BulkLoRa().setLinkPacketCallback(nullptr);
+    flushBatch();
+
+    if (pool) {
+        memFree(MemTag::RECEIVE, pool);
+        pool = nullptr;
+    }
+    freeCount = 0;
+}
+
+bool ReceivePipeline::addSink(RecordBatchHandler handler) {
+    if (!handler || sinkCount >= RX_MAX_SINKS) {
+        return false;
+    }
+
+    sinks[sinkCount++] = handler;
+    return true;
+}
+
+// ===========================
+// RX Task
+// ===========================
+
+void ReceivePipeline::taskEntry(void* parameter) {
+    ReceivePipeline* self = static_cast<ReceivePipeline*>(parameter);
+
+    while (self->running) {
+        self->service();
+        vTaskDelay(pdMS_TO_TICKS(RX_TASK_POLL_MS));
+    }
+
+    self->taskHandle = nullptr;
+    vTaskDelete(nullptr);
+}
+
+void ReceivePipeline::service() {
+    if (!running) {
+        return;
+    }
+
+    // Fragment ACKs and the like, sent in this same pass
+    if (serviceHook) {
+        serviceHook();
+    }
+
+    // Radio events -> LoRaManager -> ingest()
+    LoRaComm().processQueue();
+    if (BulkLoRa().isReady()) {
+        BulkLoRa().processQueue();
+    }
+
+    checkGapTimeouts();
+
+    if (batchCount > 0 && millis() - batchStarted >= RX_BATCH_FLUSH_MS) {
+        flushBatch();
+    }
+}
+
+void ReceivePipeline::onPacket(const Packet& packet) {
+    RxPipeline().ingest(packet);
+}
+
+void ReceivePipeline::onLinkPacket(const Packet& packet) {
+    RxPipeline().noteLinkSequence(packet.header.deviceId, packet.sequenceNumber);
+}
+
+// ===========================
+// Ingest
+// ===========================
+
+void ReceivePipeline::ingest(const Packet& packet) {
+    if (!pool) {
+        return;
+    }
+
+    DeviceRxWindow* window = findDevice(packet.header.deviceId, true);
+    if (!window) {
+        return;  // More balloons than RX_MAX_DEVICES
+    }
+
+    // Duplicates still tell us about the link
+    window->rssiHistory[window->rssiIndex] = packet.rssi;
+    window->rssiIndex = (window->rssiIndex + 1) % RSSI_HISTORY_SIZE;
+    if (window->rssiCount < RSSI_HISTORY_SIZE) {
+        window->rssiCount++;
+    }
+
+    // Retransmissions whose ACK was lost stop here
+    if (!markSeen(*window, packet.sequenceNumber)) {
+        window->duplicates++;
+        return;
+    }
+    window->received++;
+
+    int16_t slot = allocRecord();
+    if (slot < 0) {
+        flushBatch();
+        slot = allocRecord();
+    }
+    if (slot < 0) {
+        poolExhausted++;
+        return;
+    }
+
+    ReceivedRecord& record = pool[slot];
+    record.deviceId = packet.header.deviceId;
+    record.type = packet.type;
+    record.sequenceNumber = packet.sequenceNumber;
+    record.timestamp = packet.header.timestamp;
+    record.receivedAt = millis();
+    record.rssi = packet.rssi;
+    record.snr = packet.snr;
+    record.late = false;
+    record.latency = packet.header.latency;
+    record.length = min(packet.payloadLength, sizeof(record.payload));
+    memcpy(record.payload, packet.payload, record.length);
+
+    accept(*window, packet.sequenceNumber, slot);
+}
+
+void ReceivePipeline::noteLinkSequence(uint8_t deviceId, uint16_t sequenceNumber) {
+    // FEC chunks and rate changes use sequence numbers too - don't wait for them
+    DeviceRxWindow* window = findDevice(deviceId, true);
+    if (!window || !markSeen(*window, sequenceNumber)) {
+        return;
+    }
+
+    accept(*window, sequenceNumber, RX_SLOT_LINK);
+}
+
+// ===========================
+// Duplicate Filter
+// ===========================
+
+DeviceRxWindow* ReceivePipeline::findDevice(uint8_t deviceId, bool create) {
+    DeviceRxWindow* reusable = nullptr;
+    uint32_t now = millis();
+
+    for (int i = 0; i < RX_MAX_DEVICES; i++) {
+        DeviceRxWindow& window = devices[i];
+        if (window.active && window.deviceId == deviceId) {
+            return &window;
+        }
+        if (!reusable && (!window.active || now - window.lastSeen > SEQUENCE_RESET_TIMEOUT)) {
+            reusable = &window;
+        }
+    }
+
+    if (!create || !reusable) {
+        return nullptr;
+    }
+
+    // Hand off whatever the departed balloon left behind
+    if (reusable->active) {
+        while (reusable->heldCount > 0) {
+            skipGap(*reusable);
+        }
+    }
+
+    memset(reusable, 0, sizeof(DeviceRxWindow));
+    reusable->deviceId = deviceId;
+    return reusable;
+}
+
+void ReceivePipeline::resetWindow(DeviceRxWindow& window, uint8_t deviceId, uint16_t sequenceNumber) {
+    while (window.heldCount > 0) {
+        skipGap(window);
+    }
+
+    window.active = true;
+    window.deviceId = deviceId;
+    window.newestSequence = sequenceNumber;
+    window.seenBitmap = 1;
+    window.nextDeliver = sequenceNumber;
+    for (int i = 0; i < RX_REORDER_DEPTH; i++) {
+        window.held[i] = RX_SLOT_EMPTY;
+    }
+    window.heldCount = 0;
+    window.gapSince = 0;
+}
+
+bool ReceivePipeline::markSeen(DeviceRxWindow& window, uint16_t sequenceNumber) {
+    uint32_t now = millis();
+
+    // New device, long silence, or the sender restarted its sequence space
+    int16_t delta = (int16_t)(sequenceNumber - window.newestSequence);
+    if (!window.active || now - window.lastSeen > SEQUENCE_RESET_TIMEOUT ||
+        delta <= -RX_DEDUP_WINDOW_BITS) {
+        resetWindow(window, window.deviceId, sequenceNumber);
+        window.lastSeen = now;
+        return true;
+    }
+    window.lastSeen = now;
+
+    if (delta > 0) {
+        window.seenBitmap = (delta >= RX_DEDUP_WINDOW_BITS) ? 0 : window.seenBitmap << delta;
+        window.seenBitmap |= 1;
+        window.newestSequence = sequenceNumber;
+        return true;
+    }
+
+    uint64_t bit = 1ULL << (-delta);
+    if (window.seenBitmap & bit) {
+        return false;
+    }
+    window.seenBitmap |= bit;
+    return true;
+}
+
+// ===========================
+// Reorder Buffer
+// ===========================
+
+void ReceivePipeline::accept(DeviceRxWindow& window, uint16_t sequenceNumber, int16_t slot) {
+    int16_t ahead = (int16_t)(sequenceNumber - window.nextDeliver);
+
+    // Its gap was already given up on - deliver it anyway, flagged
+    if (ahead < 0) {
+        if (slot >= 0) {
+            pool[slot].late = true;
+            appendToBatch(slot);
+        }
+        return;
+    }
+
+    // Too far ahead to hold - give up on the oldest gaps to make room
+    while (ahead >= RX_REORDER_DEPTH) {
+        int index = window.nextDeliver & (RX_REORDER_DEPTH - 1);
+        if (window.held[index] == RX_SLOT_EMPTY) {
+            window.gapsSkipped++;
+        } else {
+            if (window.held[index] >= 0) {
+                appendToBatch(window.held[index]);
+            }
+            window.held[index] = RX_SLOT_EMPTY;
+            window.heldCount--;
+        }
+        window.nextDeliver++;
+        ahead--;
+    }
+
+    window.held[sequenceNumber & (RX_REORDER_DEPTH - 1)] = slot;
+    window.heldCount++;
+    if (ahead > 0) {
+        window.reordered++;
+        if (window.gapSince == 0) {
+            window.gapSince = millis();
+        }
+    }
+
+    drainInOrder(window);
+}
+
+void ReceivePipeline::drainInOrder(DeviceRxWindow& window) {
+    while (window.heldCount > 0) {
+        int index = window.nextDeliver & (RX_REORDER_DEPTH - 1);
+        int16_t slot = window.held[index];
+        if (slot == RX_SLOT_EMPTY) {
+            break;
+        }
+
+        window.held[index] = RX_SLOT_EMPTY;
+        window.heldCount--;
+        window.nextDeliver++;
+        if (slot >= 0) {
+            appendToBatch(slot);
+        }
+    }
+
+    // Restart the clock while a gap remains, so each gap gets the full timeout
+    window.gapSince = (window.heldCount > 0) ? millis() : 0;
+}
+
+void ReceivePipeline::skipGap(DeviceRxWindow& window) {
+    while (window.heldCount > 0 &&
+           window.held[window.nextDeliver & (RX_REORDER_DEPTH - 1)] == RX_SLOT_EMPTY) {
+        window.nextDeliver++;
+        window.gapsSkipped++;
+    }
+    drainInOrder(window);
+}
+
+void ReceivePipeline::checkGapTimeouts() {
+    uint32_t now = millis();
+
+    for (int i = 0; i < RX_MAX_DEVICES; i++) {
+        DeviceRxWindow& window = devices[i];
+        if (window.active && window.heldCount > 0 && now - window.gapSince > RX_REORDER_TIMEOUT_MS) {
+            skipGap(window);
+        }
+    }
+}
+
+// ===========================
+// Batched Hand-off
+// ===========================
+
+int16_t ReceivePipeline::allocRecord() {
+    return (freeCount > 0) ? freeList[--freeCount] : -1;
+}
+
+void ReceivePipeline::releaseRecord(int16_t slot) {
+    freeList[freeCount++] = slot;
+}
+
+void ReceivePipeline::appendToBatch(int16_t slot) {
+    if (batchCount == 0) {
+        batchStarted = millis();
+    }
+
+    batch[batchCount] = &pool[slot];
+    batchSlots[batchCount] = slot;
+    batchCount++;
+    recordsDelivered++;
+
+    if (batchCount >= RX_BATCH_SIZE) {
+        flushBatch();
+    }
+}
+
+void ReceivePipeline::flushBatch() {
+    if (batchCount == 0) {
+        return;
+    }
+
+    for (int i = 0; i < sinkCount; i++) {
+        sinks[i](batch, batchCount);
+    }
+
+    for (size_t i = 0; i < batchCount; i++) {
+        releaseRecord(batchSlots[i]);
+    }
+    batchCount = 0;
+    batchesFlushed++;
+}
+
+// ===========================
+// Status
+// ===========================
+
+int ReceivePipeline::getDeviceCount() const {
+    int count = 0;
+    for (int i = 0; i < RX_MAX_DEVICES; i++) {
+        if (devices[i].active) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int8_t ReceivePipeline::getAverageRSSI(uint8_t deviceId) {
+    DeviceRxWindow* window = findDevice(deviceId, false);
+    if (!window || window->rssiCount == 0) {
+        return -128;
+    }
+
+    int sum = 0;
+    for (int i = 0; i < window->rssiCount; i++) {
+        sum += window->rssiHistory[i];
+    }
+    return sum / window->rssiCount;
+}
+
+uint32_t ReceivePipeline::getDuplicateCount() const {
+    uint32_t total = 0;
+    for (int i = 0; i < RX_MAX_DEVICES; i++) {
+        total += devices[i].duplicates;
+    }
+    return total;
+}
+
+void ReceivePipeline::printStatus() const {
+    Serial.println("=== Receive Pipeline ===");
+    Serial.printf("Mode: %s\n", taskHandle ? "RX task" : (running ? "Polled" : "Stopped"));
+    Serial.printf("Records Delivered: %lu in %lu batches\n", recordsDelivered, batchesFlushed);
+    Serial.printf("Pool: %d/%d free, %lu exhausted\n", freeCount, POOL_SIZE, poolExhausted);
+
+    for (int i = 0; i < RX_MAX_DEVICES; i++) {
+        const DeviceRxWindow& window = devices[i];
+        if (!window.active) {
+            continue;
+        }
+        Serial.printf("Device %d: %lu received, %lu duplicates, %lu reordered, %lu gaps, %d held, last %lu ms ago\n",
+                     window.deviceId, window.received, window.duplicates, window.reordered,
+                     window.gapsSkipped, window.heldCount, millis() - window.lastSeen);
+    }
+}
@@ -0,0 +1,168 @@
+#ifndef RX_PIPELINE_H
+#define RX_PIPELINE_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "lora_comm.h"
+
+// ===========================
+// Receive Pipeline (base station)
+// Dedup -> reorder -> batched hand-off
+// ===========================
+
+// Base station settings come from base_station_config.h when it is included
+// first; these fallbacks keep the module building in the balloon tree
+#ifndef LORA_CONTINUOUS_LISTEN
+#define LORA_CONTINUOUS_LISTEN     true
+#endif
+#ifndef SEQUENCE_RESET_TIMEOUT
+#define SEQUENCE_RESET_TIMEOUT     300000  // Forget a device's window after this much silence
+#endif
+#ifndef RSSI_HISTORY_SIZE
+#define RSSI_HISTORY_SIZE          50      // RSSI samples kept per device
+#endif
+
+#define RX_MAX_DEVICES             4       // Balloons tracked at once
+#define RX_DEDUP_WINDOW_BITS       64      // Sequences remembered behind the newest one
+#define RX_REORDER_DEPTH           8       // Held out-of-order packets per device (power of two)
+#define RX_REORDER_TIMEOUT_MS      8000    // Give up on a gap after this long (covers ARQ retries)
+#define RX_BATCH_SIZE              8       // Records per hand-off
+#define RX_BATCH_FLUSH_MS          250     // Hand off a partial batch after this long
+#define RX_MAX_SINKS               4       // Storage, web, ...
+#define RX_TASK_POLL_MS            5
+
+static_assert((RX_REORDER_DEPTH & (RX_REORDER_DEPTH - 1)) == 0, "RX_REORDER_DEPTH must be a power of two");
+
+// One delivered packet, payload copied out of the radio buffer
+struct ReceivedRecord {
+    uint8_t deviceId;
+    PacketType type;
+    uint16_t sequenceNumber;
+    uint32_t timestamp;      // Sender clock, seconds
+    uint32_t receivedAt;     // millis() on arrival
+    int8_t rssi;
+    int8_t snr;
+    bool late;               // Arrived after its gap was given up on
+    LatencyStamp latency;    // Sender's stamp and our RX_DONE time
+    uint8_t length;
+    uint8_t payload[MAX_PACKET_SIZE];
+};
+
+// Called from the pipeline task with records in sequence order per device
+typedef void (*RecordBatchHandler)(const ReceivedRecord* const* records, size_t count);
+
+// Called from the pipeline task ahead of each LoRaComm().processQueue(), for
+// work that queues frames - LoRaComm()'s queues are the RX task's alone
+typedef void (*PipelineServiceHook)();
+
+struct DeviceRxWindow {
+    bool active;
+    uint8_t deviceId;
+    uint32_t lastSeen;
+
+    // Duplicate filter - bit i set = (newestSequence - i) seen
+    uint16_t newestSequence;
+    uint64_t seenBitmap;
+
+    // Reorder buffer - slot = sequence & (RX_REORDER_DEPTH - 1)
+    uint16_t nextDeliver;
+    int16_t held[RX_REORDER_DEPTH];   // Pool index, -1 = empty, -2 = consumed by the link layer
+    uint8_t heldCount;
+    uint32_t gapSince;                // millis() when the oldest hold started
+
+    // Signal history
+    int8_t rssiHistory[RSSI_HISTORY_SIZE];
+    uint8_t rssiIndex;
+    uint8_t rssiCount;
+
+    // Statistics
+    uint32_t received;
+    uint32_t duplicates;
+    uint32_t reordered;
+    uint32_t gapsSkipped;
+};
+
+// ===========================
+// Receive Pipeline Class
+// ===========================
+
+class ReceivePipeline {
+private:
+    DeviceRxWindow devices[RX_MAX_DEVICES];
+
+    // Record pool shared by the reorder buffers and the outgoing batch
+    static const int POOL_SIZE = RX_MAX_DEVICES * RX_REORDER_DEPTH + RX_BATCH_SIZE;
+    ReceivedRecord* pool;
+    int16_t freeList[POOL_SIZE];
+    int freeCount;
+
+    // Outgoing batch
+    const ReceivedRecord* batch[RX_BATCH_SIZE];
+    int16_t batchSlots[RX_BATCH_SIZE];
+    size_t batchCount;
+    uint32_t batchStarted;
+
+    RecordBatchHandler sinks[RX_MAX_SINKS];
+    int sinkCount;
+    PipelineServiceHook serviceHook;
+
+    TaskHandle_t taskHandle;
+    volatile bool running;
+
+    // Statistics
+    uint32_t batchesFlushed;
+    uint32_t recordsDelivered;
+    uint32_t poolExhausted;
+
+    DeviceRxWindow* findDevice(uint8_t deviceId, bool create);
+    void resetWindow(DeviceRxWindow& window, uint8_t deviceId, uint16_t sequenceNumber);
+    bool markSeen(DeviceRxWindow& window, uint16_t sequenceNumber);
+    void accept(DeviceRxWindow& window, uint16_t sequenceNumber, int16_t slot);
+    void drainInOrder(DeviceRxWindow& window);
+    void skipGap(DeviceRxWindow& window);
+    void checkGapTimeouts();
+    int16_t allocRecord();
+    void releaseRecord(int16_t slot);
+    void appendToBatch(int16_t slot);
+    void flushBatch();
+
+    static void taskEntry(void* parameter);
+    static void onPacket(const Packet& packet);
+    static void onLinkPacket(const Packet& packet);
+
+public:
+    ReceivePipeline();
+    ~ReceivePipeline();
+
+    // Initialization - hooks into LoRaComm() callbacks
+    bool begin();
+    void end();
+
+    // Hand-off targets, all called with every batch
+    bool addSink(RecordBatchHandler handler);
+    void setServiceHook(PipelineServiceHook hook) { serviceHook = hook; }
+
+    // Ingest (normally called through the LoRaComm() callbacks)
+    void ingest(const Packet& packet);
+    void noteLinkSequence(uint8_t deviceId, uint16_t sequenceNumber);
+
+    // Drives LoRaComm().processQueue() when there is no RX task
+    void service();
+
+    // Status
+    bool isRunning() const { return running; }
+    int getDeviceCount() const;
+    int8_t getAverageRSSI(uint8_t deviceId);
+    uint32_t getDuplicateCount() const;
+    uint32_t getRecordsDelivered() const { return recordsDelivered; }
+    void printStatus() const;
+};
+
+// ===========================
+// Global Instance
+// ===========================
+
+extern ReceivePipeline& RxPipeline();
+
+#endif // RX_PIPELINE_H
@@ -0,0 +1,207 @@
+#include "sample_columns.h"
+#include <esp_heap_caps.h>
+#include "memory_ledger.h"
+
+// ===========================
+// Reductions
+// ===========================
+
+void columnReduceStart(ColumnAccumulator& accumulator, float shift) {
+    accumulator.shift = shift;
+    accumulator.count = 0;
+    for (uint8_t lane = 0; lane < SAMPLE_COLUMNS_LANES; lane++) {
+        accumulator.min[lane] = INFINITY;
+        accumulator.max[lane] = -INFINITY;
+        accumulator.sum[lane] = 0.0f;
+        accumulator.sumSquares[lane] = 0.0f;
+    }
+}
+
+static inline void reduceOne(ColumnAccumulator& accumulator, float value) {
+    float delta = value - accumulator.shift;
+    accumulator.min[0] = value < accumulator.min[0] ? value : accumulator.min[0];
+    accumulator.max[0] = value > accumulator.max[0] ? value : accumulator.max[0];
+    accumulator.sum[0] += delta;
+    accumulator.sumSquares[0] += delta * delta;
+}
+
+void columnReduce(ColumnAccumulator& accumulator, const float* values, size_t count) {
+    size_t i = 0;
+    while (i < count && ((uintptr_t)&values[i] & (SAMPLE_COLUMNS_ALIGN - 1))) {
+        reduceOne(accumulator, values[i++]);
+    }
+
+    // The lanes in locals, so the loop carries no stores through the accumulator
+    float low[SAMPLE_COLUMNS_LANES], high[SAMPLE_COLUMNS_LANES];
+    float sum[SAMPLE_COLUMNS_LANES], sumSquares[SAMPLE_COLUMNS_LANES];
+    for (uint8_t lane = 0; lane < SAMPLE_COLUMNS_LANES; lane++) {
+        low[lane] = accumulator.min[lane];
+        high[lane] = accumulator.max[lane];
+        sum[lane] = accumulator.sum[lane];
+        sumSquares[lane] = accumulator.sumSquares[lane];
+    }
+    const float shift = accumulator.shift;
+    const float* __restrict aligned = static_cast<const float*>(__builtin_assume_aligned(&values[i], SAMPLE_COLUMNS_ALIGN));
+    size_t groups = (count - i) / SAMPLE_COLUMNS_LANES;
+    for (size_t group = 0; group < groups; group++) {
+        for (uint8_t lane = 0; lane < SAMPLE_COLUMNS_LANES; lane++) {
+            float value = aligned[group * SAMPLE_COLUMNS_LANES + lane];
+            float delta = value - shift;
+            low[lane] = value < low[lane] ? value : low[lane];
+            high[lane] = value > high[lane] ? value : high[lane];
+            sum[lane] += delta;
+            sumSquares[lane] += delta * delta;
+        }
+    }
+    for (uint8_t lane = 0; lane < SAMPLE_COLUMNS_LANES; lane++) {
+        accumulator.min[lane] = low[lane];
+        accumulator.max[lane] = high[lane];
+        accumulator.sum[lane] = sum[lane];
+        accumulator.sumSquares[lane] = sumSquares[lane];
+    }
+    i += groups * SAMPLE_COLUMNS_LANES;
+
+    while (i < count) {
+        reduceOne(accumulator, values[i++]);
+    }
+    accumulator.count += count;
+}
+
+void columnReduceFinish(const ColumnAccumulator& accumulator, ColumnStats& stats) {
+    float low = INFINITY, high = -INFINITY, sum = 0.0f, sumSquares = 0.0f;
+    for (uint8_t lane = 0; lane < SAMPLE_COLUMNS_LANES; lane++) {
+        low = min(low, accumulator.min[lane]);
+        high = max(high, accumulator.max[lane]);
+        sum += accumulator.sum[lane];
+        sumSquares += accumulator.sumSquares[lane];
+    }
+
+    uint32_t n = accumulator.count;
+    stats.count = n;
+    stats.min = n ? low : 0.0f;
+    stats.max = n ? high : 0.0f;
+    stats.mean = n ? accumulator.shift + sum / n : 0.0f;
+    stats.variance = n > 1 ? max((sumSquares - sum * sum / n) / (n - 1), 0.0f) : 0.0f;
+}
+
+// ===========================
+// Ring
+// ===========================
+
+SampleColumns::SampleColumns() {
+    name = "";
+    channelCount = 0;
+    capacity = 0;
+    head = 0;
+    count = 0;
+    times = nullptr;
+    values = nullptr;
+    mutex = nullptr;
+}
+
+SampleColumns::~SampleColumns() {
+    end();
+}
+
+bool SampleColumns::begin(const char* name, uint8_t channelCount, uint16_t capacity) {
+    end();
+    if (channelCount == 0 || channelCount > SAMPLE_COLUMNS_MAX_CHANNELS || capacity < SAMPLE_COLUMNS_LANES ||
+        (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+
+    // A power of two of at least four floats keeps every column on the alignment
+    this->channelCount = channelCount;
+    this->capacity = capacity;
+    size_t bytes = getBytes();
+    times = (uint32_t*)memAllocCaps(MemTag::TIMESERIES, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, SAMPLE_COLUMNS_ALIGN);
+    if (!times) {
+        times = (uint32_t*)memAllocCaps(MemTag::TIMESERIES, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+                                        SAMPLE_COLUMNS_ALIGN);
+    }
+    mutex = xSemaphoreCreateMutex();
+    if (!times || !mutex) {
+        end();
+        return false;
+    }
+
+    values = reinterpret_cast<float*>(times + capacity);
+    this->name = name;
+    head = 0;
+    count = 0;
+    return true;
+}
+
+void SampleColumns::end() {
+    if (times) {
+        memFree(MemTag::TIMESERIES, times);
+        times = nullptr;
+        values = nullptr;
+    }
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+    channelCount = 0;
+    capacity = 0;
+    head = 0;
+    count = 0;
+}
+
+bool SampleColumns::append(uint32_t time, const float* sample) {
+    if (!times) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    times[head] = time;
+    for (uint8_t channel = 0; channel < channelCount; channel++) {
+        values[(size_t)channel * capacity + head] = sample[channel];
+    }
+    head = (head + 1) & (capacity - 1);
+    if (count < capacity) {
+        count++;
+    }
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+// The oldest sample with time >= from, by bisection over the ring; count if none
+uint16_t SampleColumns::findFrom(uint32_t from) const {
+    uint16_t low = 0, high = count;
+    while (low < high) {
+        uint16_t middle = low + (high - low) / 2;
+        if ((int32_t)(times[physical(middle)] - from) >= 0) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+uint32_t SampleColumns::summarize(uint32_t from, ColumnStats* stats) const {
+    if (!times) {
+        return 0;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint16_t start = findFrom(from);
+    uint16_t n = count - start;
+
+    // At most two runs: to the end of the ring, then on from the start
+    uint16_t first = physical(start);
+    uint16_t firstRun = min((uint16_t)(capacity - first), n);
+    uint16_t last = (first + n - 1) & (capacity - 1);
+
+    for (uint8_t channel = 0; channel < channelCount; channel++) {
+        const float* column = &values[(size_t)channel * capacity];
+        ColumnAccumulator accumulator;
+        columnReduceStart(accumulator, n ? column[first] : 0.0f);
+        columnReduce(accumulator, &column[first], firstRun);
+        columnReduce(accumulator, column, n - firstRun);
+        columnReduceFinish(accumulator, stats[channel]);
+        stats[channel].firstTime = n ? times[first] : 0;
+        stats[channel].lastTime = n ? times[last] : 0;
+    }
+    xSemaphoreGive(mutex);
+    return n;
+}
@@ -0,0 +1,100 @@
+#ifndef SAMPLE_COLUMNS_H
+#define SAMPLE_COLUMNS_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// ===========================
+// Sample Columns
+// The last few thousand raw samples of a group of channels that share a
+// timestamp, one column per channel, with min/max/mean/variance over a
+// trailing window
+// ===========================
+
+// TimeSeries keeps hours of history compressed, which is right for
+// downloads and wrong for statistics: every query decodes bit fields. This
+// keeps the recent samples as they came, structure-of-arrays - a column of
+// times and a float column per channel in one ring, each column 16-byte
+// aligned - so a reduction walks one contiguous run of floats per channel.
+//
+// columnReduce() does that walk in four independent lanes, min, max and the
+// first two moments each, folded at the end; the lanes keep the FPU's
+// pipeline full and leave the loop in the shape the compiler vectorizes.
+// The moments are taken about the window's first sample: pressure near
+// 101325 Pa with a variance of 1 Pa² would otherwise cancel to nothing in a
+// float sum of squares.
+//
+// One task appends (the sensor task); summaries come from any task.
+
+#define SAMPLE_COLUMNS_ALIGN       16      // Bytes per column start; four floats
+#define SAMPLE_COLUMNS_LANES       4
+#define SAMPLE_COLUMNS_MAX_CHANNELS 8
+
+struct ColumnStats {
+    uint32_t count;
+    uint32_t firstTime;     // millis() of the oldest and newest sample in the window
+    uint32_t lastTime;
+    float min;
+    float max;
+    float mean;
+    float variance;         // Sample variance, 0 below two samples
+};
+
+// Running lanes for columnReduce(); start with columnReduceStart()
+struct ColumnAccumulator {
+    float shift;            // Moments are about this value
+    uint32_t count;
+    float min[SAMPLE_COLUMNS_LANES];
+    float max[SAMPLE_COLUMNS_LANES];
+    float sum[SAMPLE_COLUMNS_LANES];
+    float sumSquares[SAMPLE_COLUMNS_LANES];
+};
+
+void columnReduceStart(ColumnAccumulator& accumulator, float shift);
+// count values from a contiguous run; any number, at any alignment - the
+// aligned middle takes the lanes
+void columnReduce(ColumnAccumulator& accumulator, const float* values, size_t count);
+// Folds the lanes into stats' min, max, mean, variance and count
+void columnReduceFinish(const ColumnAccumulator& accumulator, ColumnStats& stats);
+
+class SampleColumns {
+public:
+    SampleColumns();
+    ~SampleColumns();
+
+    // capacity a power of two, at least SAMPLE_COLUMNS_LANES; PSRAM, or internal RAM without it
+    bool begin(const char* name, uint8_t channelCount, uint16_t capacity);
+    void end();
+    bool isReady() const { return times != nullptr; }
+
+    // One value per channel; the oldest sample goes once the ring is full.
+    // Times must not go backwards; false if not begun
+    bool append(uint32_t time, const float* sample);
+
+    // Per channel over the samples with time >= from, into stats[channelCount];
+    // the number of samples, 0 with none
+    uint32_t summarize(uint32_t from, ColumnStats* stats) const;
+
+    const char* getName() const { return name; }
+    uint8_t getChannelCount() const { return channelCount; }
+    uint16_t getCapacity() const { return capacity; }
+    uint16_t getCount() const { return count; }
+    size_t getBytes() const { return (size_t)capacity * sizeof(float) * (channelCount + 1); }
+
+private:
+    const char* name;
+    uint8_t channelCount;
+    uint16_t capacity;
+    uint16_t head;              // Next slot written
+    uint16_t count;
+    uint32_t* times;            // One allocation: times, then each channel's column
+    float* values;              // Channel c starts at values + c * capacity
+    SemaphoreHandle_t mutex;
+
+    uint16_t physical(uint16_t logical) const { return (head - count + logical) & (capacity - 1); }
+    uint16_t findFrom(uint32_t from) const;
+};
+
+#endif // SAMPLE_COLUMNS_H
@@ -0,0 +1,101 @@
+#include "scene_change.h"
+#include "image_scale.h"
+
+// ===========================
+// Signature
+// ===========================
+
+void rgb565ToLuma(const uint8_t* rgb565, size_t pixels, uint8_t* luma) {
+    // BT.601 luma from the expanded 5/6/5 channels
+    for (size_t i = 0; i < pixels; i++) {
+        uint16_t pixel = (rgb565[i * 2] << 8) | rgb565[i * 2 + 1];
+        uint32_t red = (pixel >> 8) & 0xF8;
+        uint32_t green = (pixel >> 3) & 0xFC;
+        uint32_t blue = (pixel << 3) & 0xF8;
+        luma[i] = static_cast<uint8_t>((77 * red + 150 * green + 29 * blue) >> 8);
+    }
+}
+
+bool computeSceneSignature(const uint8_t* luma, uint16_t width, uint16_t height, SceneSignature& signature) {
+    signature.valid = false;
+    if (!luma || width < SCENE_HASH_WIDTH || height < SCENE_HASH_HEIGHT) {
+        return false;
+    }
+
+    uint32_t pixels = (uint32_t)width * height;
+    uint32_t bins[SCENE_HISTOGRAM_BINS] = {0};
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < pixels; i++) {
+        bins[luma[i] >> 4]++;
+        total += luma[i];
+    }
+
+    uint8_t tiny[SCENE_HASH_WIDTH * SCENE_HASH_HEIGHT];
+    if (!scaleImage(PIXFORMAT_GRAYSCALE, luma, width, height, tiny, SCENE_HASH_WIDTH, SCENE_HASH_HEIGHT)) {
+        return false;
+    }
+
+    uint64_t hash = 0;
+    for (int y = 0; y < SCENE_HASH_HEIGHT; y++) {
+        const uint8_t* row = &tiny[y * SCENE_HASH_WIDTH];
+        for (int x = 0; x < SCENE_HASH_WIDTH - 1; x++) {
+            hash = (hash << 1) | (row[x] < row[x + 1] ? 1 : 0);
+        }
+    }
+
+    for (int i = 0; i < SCENE_HISTOGRAM_BINS; i++) {
+        signature.histogram[i] = static_cast<uint16_t>((bins[i] * SCENE_HISTOGRAM_SCALE + pixels / 2) / pixels);
+    }
+    signature.hash = hash;
+    signature.meanLuma = static_cast<uint8_t>(total / pixels);
+    signature.valid = true;
+    return true;
+}
+
+// ===========================
+// Sharpness
+// ===========================
+
+uint16_t lumaSharpness(const uint8_t* luma, uint16_t width, uint16_t height) {
+    if (!luma || width < 3 || height < 3) {
+        return 0;
+    }
+
+    int64_t sum = 0;
+    uint64_t sumSquares = 0;
+    for (uint16_t y = 1; y < height - 1; y++) {
+        const uint8_t* row = &luma[(size_t)y * width];
+        for (uint16_t x = 1; x < width - 1; x++) {
+            int32_t laplacian = 4 * row[x] - row[x - 1] - row[x + 1] - row[x - width] - row[x + width];
+            sum += laplacian;
+            sumSquares += (uint32_t)(laplacian * laplacian);
+        }
+    }
+
+    uint32_t count = (uint32_t)(width - 2) * (height - 2);
+    int64_t mean = sum / count;
+    uint64_t variance = sumSquares / count - (uint64_t)(mean * mean);
+    return variance > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(variance);
+}
+
+// ===========================
+// Novelty
+// ===========================
+
+uint8_t sceneNovelty(const SceneSignature& a, const SceneSignature& b) {
+    if (!a.valid || !b.valid) {
+        return SCENE_NOVELTY_MAX;
+    }
+
+    uint8_t structure = static_cast<uint8_t>(__builtin_popcountll(a.hash ^ b.hash));
+
+    // L1 distance is 0 to 2 * SCALE; map it onto 0-64 like the hash
+    uint32_t distance = 0;
+    for (int i = 0; i < SCENE_HISTOGRAM_BINS; i++) {
+        distance += abs((int)a.histogram[i] - (int)b.histogram[i]);
+    }
+    uint32_t exposure = distance * SCENE_NOVELTY_MAX / (2 * SCENE_HISTOGRAM_SCALE);
+
+    uint8_t novelty = structure > exposure ? structure : static_cast<uint8_t>(exposure);
+    return novelty > SCENE_NOVELTY_MAX ? SCENE_NOVELTY_MAX : novelty;
+}
@@ -0,0 +1,45 @@
+#ifndef SCENE_CHANGE_H
+#define SCENE_CHANGE_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Scene Change
+// Perceptual signature and sharpness of a tiny frame, for skipping
+// near-duplicate images and picking the sharpest of a burst
+// ===========================
+
+// Two measures, taken from the luma plane of a reduced-scale decode:
+//  - dHash: the plane box-downscaled to 9x8 (image_scale.h), one bit per
+//    horizontally adjacent pair - catches structure moving (horizon, ground)
+//  - a 16-bin luma histogram - catches exposure and cloud cover changing
+// Novelty is the larger of the hash Hamming distance and the histogram
+// distance, both on a 0-64 scale.
+
+#define SCENE_HASH_WIDTH          9
+#define SCENE_HASH_HEIGHT         8
+#define SCENE_HISTOGRAM_BINS      16
+#define SCENE_HISTOGRAM_SCALE     4096    // Histogram bins sum to this
+#define SCENE_NOVELTY_MAX         64
+
+struct SceneSignature {
+    uint64_t hash;
+    uint16_t histogram[SCENE_HISTOGRAM_BINS];
+    uint8_t meanLuma;
+    bool valid;
+};
+
+// rgb565 is big endian (jpg2rgb565() output); luma needs width * height bytes
+void rgb565ToLuma(const uint8_t* rgb565, size_t pixels, uint8_t* luma);
+bool computeSceneSignature(const uint8_t* luma, uint16_t width, uint16_t height, SceneSignature& signature);
+
+// Variance of the 4-neighbour Laplacian over the plane, saturating - motion
+// blur flattens edges and pulls it down. Only comparable between planes of
+// the same size
+uint16_t lumaSharpness(const uint8_t* luma, uint16_t width, uint16_t height);
+
+// 0 for identical frames, SCENE_NOVELTY_MAX if either signature is invalid
+uint8_t sceneNovelty(const SceneSignature& a, const SceneSignature& b);
+
+#endif // SCENE_CHANGE_H
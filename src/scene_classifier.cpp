@@ -0,0 +1,146 @@
+#include "scene_classifier.h"
+
+// ===========================
+// Prototypes
+// ===========================
+
+// Feature order: luma, contrast, blueness, greenness, saturation, texture, horizon.
+// Hand-set from flight imagery; a trained table drops in as-is
+static const uint8_t scenePrototypes[SCENE_LABEL_COUNT][SCENE_FEATURE_COUNT] = {
+    { 12,   6, 128, 128,   8,  4,   4},    // BLACK
+    {130,  16, 180, 118, 120,  6,  12},    // SKY
+    {205,  30, 136, 127,  20, 14,  20},    // CLOUD
+    {105,  50, 112, 138,  50, 40,  24},    // EARTH
+    {125,  60, 150, 126,  80, 24, 120}     // HORIZON
+};
+
+// Colour and the horizon step separate the labels best; contrast and
+// saturation move with exposure
+static const uint8_t sceneWeights[SCENE_FEATURE_COUNT] = {2, 1, 2, 2, 1, 2, 3};
+
+static const int8_t sceneBiases[SCENE_LABEL_COUNT] = {
+    0,      // BLACK - vetoed by the camera when confident
+    4,      // SKY
+    0,      // CLOUD
+    -2,     // EARTH
+    -4      // HORIZON
+};
+
+static const char* const sceneNames[SCENE_LABEL_COUNT] = {
+    "black", "sky", "cloud", "earth", "horizon"
+};
+
+static uint8_t clampFeature(int32_t value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// ===========================
+// Features
+// ===========================
+
+static void sceneFeatures(const uint8_t* rgb565, const uint8_t* luma, uint16_t width, uint16_t height,
+                          uint8_t* features) {
+    const uint32_t pixels = (uint32_t)width * height;
+
+    uint32_t lumaTotal = 0;
+    int32_t blueTotal = 0;
+    int32_t greenTotal = 0;
+    uint32_t saturationTotal = 0;
+    for (uint32_t i = 0; i < pixels; i++) {
+        uint16_t pixel = (rgb565[i * 2] << 8) | rgb565[i * 2 + 1];
+        int32_t red = (pixel >> 8) & 0xF8;
+        int32_t green = (pixel >> 3) & 0xFC;
+        int32_t blue = (pixel << 3) & 0xF8;
+        lumaTotal += luma[i];
+        blueTotal += blue - (red + green) / 2;
+        greenTotal += green - (red + blue) / 2;
+        int32_t high = max(red, max(green, blue));
+        int32_t low = min(red, min(green, blue));
+        saturationTotal += high - low;
+    }
+    const uint8_t mean = static_cast<uint8_t>(lumaTotal / pixels);
+
+    uint32_t deviationTotal = 0;
+    uint32_t stepTotal = 0;
+    for (uint16_t y = 0; y < height; y++) {
+        const uint8_t* row = &luma[(uint32_t)y * width];
+        for (uint16_t x = 0; x < width; x++) {
+            deviationTotal += abs((int)row[x] - mean);
+            if (x > 0) {
+                stepTotal += abs((int)row[x] - row[x - 1]);
+            }
+        }
+    }
+
+    // Band means top to bottom; a level horizon is one big step between two of them
+    uint32_t bandMeans[SCENE_HORIZON_BANDS];
+    for (int band = 0; band < SCENE_HORIZON_BANDS; band++) {
+        uint16_t first = (uint32_t)height * band / SCENE_HORIZON_BANDS;
+        uint16_t last = (uint32_t)height * (band + 1) / SCENE_HORIZON_BANDS;
+        uint32_t total = 0;
+        for (uint32_t i = (uint32_t)first * width; i < (uint32_t)last * width; i++) {
+            total += luma[i];
+        }
+        bandMeans[band] = total / ((uint32_t)(last - first) * width);
+    }
+    int32_t horizonStep = 0;
+    for (int band = 1; band < SCENE_HORIZON_BANDS; band++) {
+        horizonStep = max(horizonStep, (int32_t)abs((int)bandMeans[band] - (int)bandMeans[band - 1]));
+    }
+
+    features[0] = mean;
+    features[1] = clampFeature(2 * deviationTotal / pixels);
+    features[2] = clampFeature(128 + blueTotal / (int32_t)pixels / 2);
+    features[3] = clampFeature(128 + greenTotal / (int32_t)pixels / 2);
+    features[4] = clampFeature(saturationTotal / pixels);
+    features[5] = clampFeature(4 * stepTotal / (pixels - height));
+    features[6] = clampFeature(4 * horizonStep);
+}
+
+// ===========================
+// Classification
+// ===========================
+
+bool classifyScene(const uint8_t* rgb565, const uint8_t* luma, uint16_t width, uint16_t height,
+                   SceneClassification& result) {
+    result.valid = false;
+    result.label = SceneLabel::UNKNOWN;
+    result.confidence = 0;
+    if (!rgb565 || !luma || width < 2 || height < SCENE_HORIZON_BANDS) {
+        return false;
+    }
+
+    sceneFeatures(rgb565, luma, width, height, result.features);
+
+    uint32_t best = UINT32_MAX;
+    uint32_t runnerUp = UINT32_MAX;
+    int bestLabel = 0;
+    for (int label = 0; label < SCENE_LABEL_COUNT; label++) {
+        uint32_t distance = 0;
+        for (int f = 0; f < SCENE_FEATURE_COUNT; f++) {
+            distance += sceneWeights[f] * abs((int)result.features[f] - scenePrototypes[label][f]);
+        }
+        if (distance < best) {
+            runnerUp = best;
+            best = distance;
+            bestLabel = label;
+        } else if (distance < runnerUp) {
+            runnerUp = distance;
+        }
+    }
+
+    result.label = static_cast<SceneLabel>(bestLabel);
+    result.confidence = runnerUp + best > 0 ? static_cast<uint8_t>(100 * (runnerUp - best) / (runnerUp + best)) : 0;
+    result.valid = true;
+    return true;
+}
+
+int8_t sceneNoveltyBias(SceneLabel label) {
+    uint8_t index = static_cast<uint8_t>(label);
+    return index < SCENE_LABEL_COUNT ? sceneBiases[index] : 0;
+}
+
+const char* sceneLabelName(SceneLabel label) {
+    uint8_t index = static_cast<uint8_t>(label);
+    return index < SCENE_LABEL_COUNT ? sceneNames[index] : "unknown";
+}
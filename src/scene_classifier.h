@@ -0,0 +1,60 @@
+#ifndef SCENE_CLASSIFIER_H
+#define SCENE_CLASSIFIER_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Scene Classifier
+// What a frame is looking at - black sky, blue sky, cloud, ground or the
+// horizon - for deciding which frames are worth the downlink
+// ===========================
+
+// Works on the same reduced-scale decode as the scene signature
+// (CameraManager::analyzeFrame()), so it costs one pass over a few thousand
+// pixels. Seven 8-bit features are taken from the frame and it is labelled
+// with the nearest prototype by weighted L1 distance - all integer, with a
+// quantized prototype table that a trained one can replace entry for entry.
+// Confidence is how much closer the nearest prototype is than the runner-up.
+//
+// Features, each 0-255:
+//   luma        mean BT.601 luma
+//   contrast    mean absolute deviation from it, x2
+//   blueness    128 + mean(B - (R + G) / 2) / 2
+//   greenness   128 + mean(G - (R + B) / 2) / 2
+//   saturation  mean(max - min channel)
+//   texture     mean |horizontal luma step|, x4
+//   horizon     largest step between adjacent row-band means, x4
+
+#define SCENE_FEATURE_COUNT        7
+#define SCENE_HORIZON_BANDS        8       // Row bands the horizon step is measured between
+
+enum class SceneLabel : uint8_t {
+    BLACK = 0,      // Dark sky, lens cap, night - never worth the airtime
+    SKY = 1,
+    CLOUD = 2,
+    EARTH = 3,
+    HORIZON = 4,
+    UNKNOWN = 0xFF
+};
+
+#define SCENE_LABEL_COUNT          5
+
+struct SceneClassification {
+    SceneLabel label;
+    uint8_t confidence;     // 0-100
+    uint8_t features[SCENE_FEATURE_COUNT];
+    bool valid;
+};
+
+// rgb565 is big endian (jpg2rgb565() output), luma its rgb565ToLuma() plane
+bool classifyScene(const uint8_t* rgb565, const uint8_t* luma, uint16_t width, uint16_t height,
+                   SceneClassification& result);
+
+// Added to the novelty threshold for a frame with this label - negative for
+// the views worth sending more often
+int8_t sceneNoveltyBias(SceneLabel label);
+
+const char* sceneLabelName(SceneLabel label);
+
+#endif // SCENE_CLASSIFIER_H
@@ -0,0 +1,615 @@
+#include "sd_recorder.h"
+#include "task_placement.h"
+#include "memory_ledger.h"
+#include "debug_utils.h"
+#include <SD_MMC.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define AVI_HDRL_BYTES      212                             // RIFF header through strf
+#define AVI_MOVI_OFFSET     (SD_RECORDER_HEADER_BYTES - 12) // LIST 'movi'
+#define AVIF_HASINDEX       0x10
+#define AVIIF_KEYFRAME      0x10
+#define SD_SECTOR_BYTES     512
+
+static SdRecorder sdRecorderInstance;
+
+SdRecorder& SdRec() {
+    return sdRecorderInstance;
+}
+
+// ===========================
+// Helpers
+// ===========================
+
+static constexpr uint32_t fourcc(const char (&code)[5]) {
+    return (uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24);
+}
+
+static uint8_t* put16(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = value >> 24;
+    return p + 4;
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+SdRecorder::SdRecorder() {
+    cardOk = false;
+    recording = false;
+    failedAt = 0;
+    nextSegment = 0;
+    cardBytes = 0;
+
+    ring = nullptr;
+    ringHead = 0;
+    ringTail = 0;
+    ringUsed = 0;
+    ringPeak = 0;
+    memset(queue, 0, sizeof(queue));
+    queueHead = 0;
+    queueTail = 0;
+    queueCount = 0;
+    ringLock = portMUX_INITIALIZER_UNLOCKED;
+    lastPushAt = 0;
+
+    file = -1;
+    segment = 0;
+    segmentWidth = 0;
+    segmentHeight = 0;
+    dataBytes = 0;
+    maxFrameBytes = 0;
+    checkpointAt = 0;
+    checkpointFrames = 0;
+    indexAt = 0;
+    indexGap = 0;
+    index = nullptr;
+    indexCount = 0;
+
+    chunk = nullptr;
+    chunkFill = 0;
+    chunkFileOffset = 0;
+
+    task = nullptr;
+
+    framesWritten = 0;
+    framesDropped = 0;
+    bytesWritten = 0;
+    segmentsClosed = 0;
+    checkpoints = 0;
+    writeErrors = 0;
+    worstWriteMs = 0;
+}
+
+bool SdRecorder::begin() {
+    if (ring) {
+        return true;
+    }
+    if (!SD_CARD_FITTED || !mount()) {
+        return false;
+    }
+
+    ring = static_cast<uint8_t*>(memAllocCaps(MemTag::SD_RECORDER, SD_RECORDER_BUFFER_BYTES,
+                                              MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    index = static_cast<SdIndexEntry*>(memAllocCaps(MemTag::SD_RECORDER, SD_RECORDER_INDEX_MAX * sizeof(SdIndexEntry),
+                                                    MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    // The host's DMA can't reach PSRAM - frames go to the card from here
+    chunk = static_cast<uint8_t*>(memAllocCaps(MemTag::SD_RECORDER, SD_RECORDER_WRITE_CHUNK,
+                                               MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+    if (!ring || !index || !chunk ||
+        createPlacedTask(TaskId::SD_RECORDER, taskEntry, this, &task) != pdPASS) {
+        memFree(MemTag::SD_RECORDER, ring);
+        memFree(MemTag::SD_RECORDER, index);
+        memFree(MemTag::SD_RECORDER, chunk);
+        ring = nullptr;
+        index = nullptr;
+        chunk = nullptr;
+        task = nullptr;
+        SD_MMC.end();
+        cardOk = false;
+        return false;
+    }
+
+    recording = true;
+    SYS_INFO("SD recorder: %llu MB card, %s-bit, next segment %u", (unsigned long long)(cardBytes / (1024 * 1024)),
+             SD_D1_PIN >= 0 ? "4" : "1", nextSegment);
+    return true;
+}
+
+void SdRecorder::setRecording(bool enable) {
+    recording = enable;
+    if (task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+// ===========================
+// Card
+// ===========================
+
+bool SdRecorder::mount() {
+#if SD_CARD_FITTED
+    bool oneBit = SD_D1_PIN < 0 || SD_D2_PIN < 0 || SD_D3_PIN < 0;
+    SD_MMC.end();
+    bool pins = oneBit ? SD_MMC.setPins(SD_CLK_PIN, SD_CMD_PIN, SD_D0_PIN)
+                       : SD_MMC.setPins(SD_CLK_PIN, SD_CMD_PIN, SD_D0_PIN, SD_D1_PIN, SD_D2_PIN, SD_D3_PIN);
+    if (!pins || !SD_MMC.begin(SD_RECORDER_MOUNT, oneBit, false, SD_RECORDER_FREQ_KHZ)) {
+        return false;
+    }
+    if (SD_MMC.cardType() == CARD_NONE) {
+        SD_MMC.end();
+        return false;
+    }
+    cardBytes = SD_MMC.cardSize();
+    findNextSegment();
+    cardOk = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SdRecorder::findNextSegment() {
+    DIR* dir = opendir(SD_RECORDER_MOUNT);
+    if (!dir) {
+        return;
+    }
+    size_t prefix = strlen(SD_RECORDER_PREFIX);
+    while (dirent* entry = readdir(dir)) {
+        if (strncasecmp(entry->d_name, SD_RECORDER_PREFIX, prefix) == 0) {
+            long number = atol(entry->d_name + prefix);
+            if (number >= nextSegment && number < 0xFFFF) {
+                nextSegment = number + 1;
+            }
+        }
+    }
+    closedir(dir);
+}
+
+void SdRecorder::fail(const char* what) {
+    int error = errno;
+    writeErrors++;
+    if (file >= 0) {
+        close(file);
+        file = -1;
+    }
+    SD_MMC.end();
+    cardOk = false;
+    failedAt = millis();
+
+    // A full card won't be less full at the next mount
+    if (error == ENOSPC) {
+        recording = false;
+        SYS_WARNING("SD recorder: card full, recording stopped");
+    } else {
+        SYS_WARNING("SD recorder: %s failed (errno %d), remount in %u s", what, error,
+                    SD_RECORDER_RETRY_MS / 1000);
+    }
+}
+
+// ===========================
+// Write-Behind Ring
+// ===========================
+
+bool SdRecorder::pushFrame(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height) {
+    if (!ring || !isRecording() || !jpeg || length == 0) {
+        return false;
+    }
+    lastPushAt = millis();
+
+    // Frames don't wrap - one that doesn't fit before the end starts again at 0
+    uint32_t need = (length + 3) & ~(uint32_t)3;
+    uint32_t start = UINT32_MAX;
+    portENTER_CRITICAL(&ringLock);
+    if (queueCount == 0) {
+        start = need <= SD_RECORDER_BUFFER_BYTES ? 0 : UINT32_MAX;
+    } else if (queueCount < SD_RECORDER_QUEUE_FRAMES) {
+        if (ringHead >= ringTail) {
+            if (SD_RECORDER_BUFFER_BYTES - ringHead >= need) {
+                start = ringHead;
+            } else if (need < ringTail) {
+                start = 0;
+            }
+        } else if (ringTail - ringHead > need) {
+            start = ringHead;
+        }
+    }
+    portEXIT_CRITICAL(&ringLock);
+
+    if (start == UINT32_MAX) {
+        framesDropped++;
+        return false;
+    }
+
+    // The task reads nothing past the frames already queued
+    memcpy(ring + start, jpeg, length);
+
+    portENTER_CRITICAL(&ringLock);
+    if (queueCount == 0) {
+        ringTail = start;
+    }
+    queue[queueHead] = {start, (uint32_t)length, width, height};
+    queueHead = (queueHead + 1) % SD_RECORDER_QUEUE_FRAMES;
+    queueCount++;
+    ringHead = start + need;
+    ringUsed += need;
+    ringPeak = max(ringPeak, ringUsed);
+    portEXIT_CRITICAL(&ringLock);
+
+    xTaskNotifyGive(task);
+    return true;
+}
+
+bool SdRecorder::takeFrame(SdQueuedFrame& frame) {
+    portENTER_CRITICAL(&ringLock);
+    bool have = queueCount > 0;
+    if (have) {
+        frame = queue[queueTail];
+    }
+    portEXIT_CRITICAL(&ringLock);
+    return have;
+}
+
+void SdRecorder::releaseFrame(const SdQueuedFrame& frame) {
+    uint32_t need = (frame.length + 3) & ~(uint32_t)3;
+    portENTER_CRITICAL(&ringLock);
+    ringTail = frame.start + need;
+    queueTail = (queueTail + 1) % SD_RECORDER_QUEUE_FRAMES;
+    queueCount--;
+    ringUsed -= need;
+    portEXIT_CRITICAL(&ringLock);
+}
+
+TickType_t SdRecorder::getTicksUntilNext() const {
+    if (!ring || !isRecording()) {
+        return portMAX_DELAY;
+    }
+    uint32_t elapsed = millis() - lastPushAt;
+    return elapsed >= SD_RECORDER_INTERVAL_MS ? 0 : pdMS_TO_TICKS(SD_RECORDER_INTERVAL_MS - elapsed);
+}
+
+// ===========================
+// AVI File
+// ===========================
+
+void SdRecorder::buildHeader(uint8_t* hdrl, uint8_t* movi) const {
+    uint32_t fileEnd = SD_RECORDER_HEADER_BYTES + dataBytes + 8 + indexCount * sizeof(SdIndexEntry);
+    uint8_t* p = hdrl;
+
+    p = put32(p, fourcc("RIFF"));
+    p = put32(p, fileEnd - 8);
+    p = put32(p, fourcc("AVI "));
+    p = put32(p, fourcc("LIST"));
+    p = put32(p, AVI_HDRL_BYTES - 20);
+    p = put32(p, fourcc("hdrl"));
+
+    // MainAVIHeader
+    p = put32(p, fourcc("avih"));
+    p = put32(p, 56);
+    p = put32(p, 1000000 / SD_RECORDER_PLAYBACK_FPS);       // Microseconds per frame
+    p = put32(p, maxFrameBytes * SD_RECORDER_PLAYBACK_FPS); // Max bytes per second
+    p = put32(p, 0);                                        // Padding granularity
+    p = put32(p, AVIF_HASINDEX);
+    p = put32(p, indexCount);                               // Total frames
+    p = put32(p, 0);                                        // Initial frames
+    p = put32(p, 1);                                        // Streams
+    p = put32(p, maxFrameBytes);                            // Suggested buffer size
+    p = put32(p, segmentWidth);
+    p = put32(p, segmentHeight);
+    memset(p, 0, 16);
+    p += 16;
+
+    p = put32(p, fourcc("LIST"));
+    p = put32(p, AVI_HDRL_BYTES - 96);
+    p = put32(p, fourcc("strl"));
+
+    // AVIStreamHeader
+    p = put32(p, fourcc("strh"));
+    p = put32(p, 56);
+    p = put32(p, fourcc("vids"));
+    p = put32(p, fourcc("MJPG"));
+    p = put32(p, 0);                                        // Flags
+    p = put16(p, 0);                                        // Priority
+    p = put16(p, 0);                                        // Language
+    p = put32(p, 0);                                        // Initial frames
+    p = put32(p, 1);                                        // Scale
+    p = put32(p, SD_RECORDER_PLAYBACK_FPS);                 // Rate
+    p = put32(p, 0);                                        // Start
+    p = put32(p, indexCount);                               // Length
+    p = put32(p, maxFrameBytes);                            // Suggested buffer size
+    p = put32(p, 0xFFFFFFFF);                               // Quality, driver default
+    p = put32(p, 0);                                        // Sample size, varies
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, segmentWidth);
+    p = put16(p, segmentHeight);
+
+    // BITMAPINFOHEADER
+    p = put32(p, fourcc("strf"));
+    p = put32(p, 40);
+    p = put32(p, 40);
+    p = put32(p, segmentWidth);
+    p = put32(p, segmentHeight);
+    p = put16(p, 1);                                        // Planes
+    p = put16(p, 24);                                       // Bits per pixel, decoded
+    p = put32(p, fourcc("MJPG"));
+    p = put32(p, (uint32_t)segmentWidth * segmentHeight * 3);
+    memset(p, 0, 16);
+
+    p = put32(movi, fourcc("LIST"));
+    p = put32(p, 4 + dataBytes);
+    put32(p, fourcc("movi"));
+}
+
+bool SdRecorder::writeAt(uint32_t offset, const uint8_t* data, size_t length) {
+    uint32_t start = millis();
+    if (lseek(file, offset, SEEK_SET) != (off_t)offset) {
+        fail("seek");
+        return false;
+    }
+    while (length) {
+        ssize_t written = write(file, data, length);
+        if (written <= 0) {
+            fail("write");
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    worstWriteMs = max(worstWriteMs, (uint32_t)(millis() - start));
+    return true;
+}
+
+bool SdRecorder::append(const uint8_t* data, size_t length) {
+    while (length) {
+        size_t piece = min(length, (size_t)(SD_RECORDER_WRITE_CHUNK - chunkFill));
+        memcpy(chunk + chunkFill, data, piece);
+        chunkFill += piece;
+        data += piece;
+        length -= piece;
+        if (chunkFill == SD_RECORDER_WRITE_CHUNK && !flushChunk()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SdRecorder::flushChunk() {
+    if (chunkFill == 0) {
+        return true;
+    }
+    if (!writeAt(chunkFileOffset, chunk, chunkFill)) {
+        return false;
+    }
+    // A part chunk stays, and is written again whole - every full write stays aligned
+    if (chunkFill == SD_RECORDER_WRITE_CHUNK) {
+        chunkFileOffset += SD_RECORDER_WRITE_CHUNK;
+        chunkFill = 0;
+    }
+    return true;
+}
+
+bool SdRecorder::writeHeader() {
+    uint8_t hdrl[AVI_HDRL_BYTES];
+    uint8_t movi[12];
+    buildHeader(hdrl, movi);
+
+    // Still in the chunk, whose next write would put the old counts back
+    if (chunkFileOffset == 0) {
+        memcpy(chunk, hdrl, sizeof(hdrl));
+        memcpy(chunk + AVI_MOVI_OFFSET, movi, sizeof(movi));
+    }
+    return writeAt(0, hdrl, sizeof(hdrl)) && writeAt(AVI_MOVI_OFFSET, movi, sizeof(movi));
+}
+
+bool SdRecorder::writeIndex() {
+    uint8_t header[8];
+    put32(put32(header, fourcc("idx1")), indexCount * sizeof(SdIndexEntry));
+    uint32_t at = SD_RECORDER_HEADER_BYTES + dataBytes;
+    return writeAt(at, header, sizeof(header)) &&
+           (indexCount == 0 ||
+            writeAt(at + sizeof(header), reinterpret_cast<const uint8_t*>(index), indexCount * sizeof(SdIndexEntry)));
+}
+
+bool SdRecorder::checkpoint() {
+    if (!flushChunk()) {
+        return false;
+    }
+    // The last checkpoint's idx1 is inside movi now
+    if (indexAt) {
+        uint8_t junk[8];
+        put32(put32(junk, fourcc("JUNK")), indexGap);
+        if (!writeAt(indexAt, junk, sizeof(junk))) {
+            return false;
+        }
+    }
+    if (!writeIndex() || !writeHeader()) {
+        return false;
+    }
+    if (fsync(file) != 0) {
+        fail("sync");
+        return false;
+    }
+    checkpointAt = millis();
+    checkpointFrames = indexCount;
+    checkpoints++;
+
+    // Frames go on after this idx1, from the next sector, so it is never
+    // written over - a reset before the next checkpoint leaves the file as
+    // it is now
+    indexAt = SD_RECORDER_HEADER_BYTES + dataBytes;
+    uint32_t next = indexAt + 8 + indexCount * sizeof(SdIndexEntry);
+    next = (next + SD_SECTOR_BYTES - 1) & ~(uint32_t)(SD_SECTOR_BYTES - 1);
+    indexGap = next - indexAt - 8;
+    dataBytes = next - SD_RECORDER_HEADER_BYTES;
+    chunkFileOffset = next;
+    chunkFill = 0;
+    return true;
+}
+
+bool SdRecorder::openSegment(uint16_t width, uint16_t height) {
+    char path[32];
+    snprintf(path, sizeof(path), SD_RECORDER_MOUNT "/" SD_RECORDER_PREFIX "%05u.AVI", nextSegment);
+    file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        fail("open");
+        return false;
+    }
+    segment = nextSegment++;
+    segmentWidth = width;
+    segmentHeight = height;
+    dataBytes = 0;
+    maxFrameBytes = 0;
+    indexCount = 0;
+    indexAt = 0;
+
+    // Every cluster now, so FAT never looks for one between frames
+    uint8_t last = 0;
+    if (!writeAt(SD_RECORDER_SEGMENT_BYTES - 1, &last, 1)) {
+        return false;
+    }
+
+    // Header, JUNK and the movi list header fill the first sector of the chunk
+    memset(chunk, 0, SD_RECORDER_HEADER_BYTES);
+    buildHeader(chunk, chunk + AVI_MOVI_OFFSET);
+    put32(put32(chunk + AVI_HDRL_BYTES, fourcc("JUNK")), AVI_MOVI_OFFSET - AVI_HDRL_BYTES - 8);
+    chunkFill = SD_RECORDER_HEADER_BYTES;
+    chunkFileOffset = 0;
+
+    // An empty AVI until the first checkpoint with frames
+    if (!checkpoint()) {
+        return false;
+    }
+    SYS_INFO("SD recorder: %s, %ux%u", path, width, height);
+    return true;
+}
+
+bool SdRecorder::closeSegment() {
+    if (file < 0) {
+        return true;
+    }
+    if (!checkpoint()) {
+        return false;
+    }
+    // Down to its length - the rest of the preallocation goes back to the card
+    uint32_t length = indexAt + 8 + indexCount * sizeof(SdIndexEntry);
+    if (ftruncate(file, length) != 0) {
+        SYS_WARNING("SD recorder: segment %u left at its preallocated size", segment);
+    }
+    close(file);
+    file = -1;
+    segmentsClosed++;
+    SYS_INFO("SD recorder: segment %u closed, %lu frames", segment, (unsigned long)indexCount);
+    return true;
+}
+
+bool SdRecorder::writeFrame(const SdQueuedFrame& frame) {
+    uint32_t padded = (frame.length + 1) & ~(uint32_t)1;
+    uint32_t needed = SD_RECORDER_HEADER_BYTES + dataBytes + 8 + padded + 8 +
+                      (indexCount + 1) * sizeof(SdIndexEntry);
+    if (file >= 0 && (frame.width != segmentWidth || frame.height != segmentHeight ||
+                      indexCount >= SD_RECORDER_INDEX_MAX || needed > SD_RECORDER_SEGMENT_BYTES)) {
+        if (!closeSegment()) {
+            return false;
+        }
+    }
+    if (file < 0 && !openSegment(frame.width, frame.height)) {
+        return false;
+    }
+
+    uint8_t header[8];
+    put32(put32(header, fourcc("00dc")), frame.length);
+    uint8_t pad = 0;
+    if (!append(header, sizeof(header)) || !append(ring + frame.start, frame.length) ||
+        (padded != frame.length && !append(&pad, 1))) {
+        return false;
+    }
+    index[indexCount++] = {fourcc("00dc"), AVIIF_KEYFRAME, 4 + dataBytes, frame.length};
+    dataBytes += sizeof(header) + padded;
+    maxFrameBytes = max(maxFrameBytes, frame.length);
+    framesWritten++;
+    bytesWritten += sizeof(header) + padded;
+
+    if (indexCount - checkpointFrames >= SD_RECORDER_INDEX_FRAMES ||
+        millis() - checkpointAt >= SD_RECORDER_INDEX_MS) {
+        return checkpoint();
+    }
+    return true;
+}
+
+// ===========================
+// Task
+// ===========================
+
+void SdRecorder::taskEntry(void* parameter) {
+    SdRecorder* recorder = static_cast<SdRecorder*>(parameter);
+    SdQueuedFrame frame;
+
+    for (;;) {
+        // A frame, setRecording(), or the checkpoint interval
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SD_RECORDER_INDEX_MS));
+
+        if (!recorder->cardOk) {
+            while (recorder->takeFrame(frame)) {
+                recorder->framesDropped++;
+                recorder->releaseFrame(frame);
+            }
+            if (recorder->recording && millis() - recorder->failedAt >= SD_RECORDER_RETRY_MS) {
+                recorder->failedAt = millis();
+                if (recorder->mount()) {
+                    SYS_INFO("SD recorder: card remounted, next segment %u", recorder->nextSegment);
+                }
+            }
+            continue;
+        }
+
+        while (recorder->cardOk && recorder->takeFrame(frame)) {
+            if (!recorder->writeFrame(frame)) {
+                recorder->framesDropped++;
+            }
+            recorder->releaseFrame(frame);
+        }
+
+        if (recorder->file >= 0 && !recorder->recording) {
+            recorder->closeSegment();
+        } else if (recorder->file >= 0 && recorder->indexCount != recorder->checkpointFrames &&
+                   millis() - recorder->checkpointAt >= SD_RECORDER_INDEX_MS) {
+            recorder->checkpoint();
+        }
+    }
+}
+
+// ===========================
+// Status
+// ===========================
+
+void SdRecorder::printStatus() const {
+    if (!ring) {
+        if (SD_CARD_FITTED) {
+            Serial.println("SD Recorder: no card");
+        }
+        return;
+    }
+    const char* state = isRecording() ? "recording" : cardOk ? "stopped" : "card failed";
+    Serial.printf("SD Recorder: %s, segment %u (%ux%u, %lu frames), %lu frames written (%llu MB), %lu dropped\n",
+                  state, segment, segmentWidth, segmentHeight, (unsigned long)indexCount,
+                  (unsigned long)framesWritten, (unsigned long long)(bytesWritten / (1024 * 1024)),
+                  (unsigned long)framesDropped);
+    Serial.printf("  Ring %lu of %u KB (peak %lu KB), %u frames queued; %lu checkpoints, %lu segments closed, "
+                  "%lu write errors, worst write %lu ms\n",
+                  (unsigned long)(ringUsed / 1024), SD_RECORDER_BUFFER_BYTES / 1024, (unsigned long)(ringPeak / 1024),
+                  queueCount, (unsigned long)checkpoints, (unsigned long)segmentsClosed, (unsigned long)writeErrors,
+                  (unsigned long)worstWriteMs);
+}
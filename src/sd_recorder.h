@@ -0,0 +1,193 @@
+#ifndef SD_RECORDER_H
+#define SD_RECORDER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "balloon_config.h"
+#include "sensor_pins.h"
+
+// ===========================
+// SD Recorder
+// Time-lapse of every frame the camera takes, at full resolution, as MJPEG
+// AVI files on an SD card for after recovery - nothing of it goes over LoRa
+// ===========================
+
+// The card is on the SDMMC host, 4-bit where SD_D1_PIN..SD_D3_PIN are
+// fitted and 1-bit otherwise; the host DMAs whole sectors to and from
+// the card itself. FAT is mounted at SD_RECORDER_MOUNT.
+//
+// Frames come from the capture task (camera_manager.h). Each live capture's
+// kept frame is recorded. Between captures, while recording, the task
+// takes a frame of its own every SD_RECORDER_INTERVAL_MS straight out of
+// the driver's frame buffers, at the sensor's current frame size. The
+// sensor then stays out of standby between shots. pushFrame() only copies
+// the JPEG into the write-behind ring in PSRAM and returns. A frame the ring
+// has no room for is dropped and counted, so the capture task never waits
+// on the card.
+//
+// The recorder task drains the ring through an internal DMA-capable chunk
+// buffer. Its writes are SD_RECORDER_WRITE_CHUNK at a time and sector
+// aligned from the first frame on, so FAT passes them to the host without
+// a bounce copy.
+//
+// Segments are /sdcard/TLnnnnn.AVI, numbered on from the highest on the
+// card. Each is preallocated to SD_RECORDER_SEGMENT_BYTES when it is opened,
+// so FAT never has to find clusters mid-flight, and cut back to its length
+// when it is closed. A new segment starts when the frame size changes,
+// when the index is full, or when the next frame wouldn't fit.
+//
+// File:
+//   [0-211]     RIFF 'AVI ', LIST 'hdrl': avih, LIST 'strl' (strh 'vids'
+//               'MJPG', strf BITMAPINFOHEADER)
+//   [212-4083]  JUNK, so the frames start on a sector
+//   [4084-4095] LIST 'movi'
+//   [4096..]    '00dc' chunks, a JPEG each, padded to even length, and
+//               earlier checkpoints' idx1 as JUNK
+//   ...         idx1, a keyframe entry per frame
+//
+// The index is kept in PSRAM. Every SD_RECORDER_INDEX_FRAMES frames or
+// SD_RECORDER_INDEX_MS it is written after the last frame, the header's
+// counts and sizes are patched to match, and the file is synced. Frames go
+// on from the next sector after that idx1. The next checkpoint turns it
+// into a JUNK chunk inside movi and writes a new one further on. A reset or
+// a card pulled mid-flight loses only the frames since the last checkpoint:
+// the RIFF size stops at its idx1, and players ignore what follows.
+
+#define SD_RECORDER_MOUNT           "/sdcard"
+#define SD_RECORDER_PREFIX          "TL"
+#define SD_RECORDER_INTERVAL_MS     500         // Time-lapse frames between captures; 1-5 fps is 200-1000
+#define SD_RECORDER_PLAYBACK_FPS    15          // Frame rate the AVI claims
+#define SD_RECORDER_BUFFER_BYTES    (1024 * 1024)   // Write-behind ring: ~4 s of SVGA at 5 fps
+#define SD_RECORDER_QUEUE_FRAMES    64          // Frames waiting in the ring
+#define SD_RECORDER_WRITE_CHUNK     16384       // Internal DMA buffer, a multiple of 512
+#define SD_RECORDER_HEADER_BYTES    4096        // Header, JUNK and the movi list header
+#define SD_RECORDER_SEGMENT_BYTES   (256UL * 1024 * 1024)   // Preallocated per file
+#define SD_RECORDER_INDEX_MAX       16384       // Frames per segment, 16 bytes each in PSRAM
+#define SD_RECORDER_INDEX_FRAMES    100         // Checkpoint at least this often...
+#define SD_RECORDER_INDEX_MS        30000       // ...and this
+#define SD_RECORDER_FREQ_KHZ        40000       // SDMMC high speed
+#define SD_RECORDER_RETRY_MS        60000       // Card remount after a write error
+
+#define SD_CARD_FITTED (SD_CLK_PIN >= 0 && SD_CMD_PIN >= 0 && SD_D0_PIN >= 0)
+
+// A frame waiting in the ring
+struct SdQueuedFrame {
+    uint32_t start;             // Ring offset
+    uint32_t length;            // JPEG bytes
+    uint16_t width;
+    uint16_t height;
+};
+
+// An idx1 entry, as it is written
+struct SdIndexEntry {
+    uint32_t chunkId;           // '00dc'
+    uint32_t flags;             // AVIIF_KEYFRAME - every JPEG stands alone
+    uint32_t offset;            // Of its chunk header, from the 'movi' fourcc
+    uint32_t length;
+};
+
+class SdRecorder {
+public:
+    SdRecorder();
+
+    // Mounts the card, takes the ring and index and starts the task; false
+    // (and nothing recorded) without a card
+    bool begin();
+    bool isReady() const { return ring != nullptr; }
+
+    // Recording from the next frame, or closing the segment
+    void setRecording(bool enable);
+    bool isRecording() const { return recording && cardOk; }
+
+    // Capture task only: copies the JPEG in, false if it was dropped
+    bool pushFrame(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height);
+    // Until the next time-lapse frame is due, portMAX_DELAY ticks when not recording
+    TickType_t getTicksUntilNext() const;
+    // Capture task: no frame this time, the next is due an interval on
+    void skipFrame() { lastPushAt = millis(); }
+
+    uint32_t getFramesWritten() const { return framesWritten; }
+    uint32_t getFramesDropped() const { return framesDropped; }
+    uint64_t getBytesWritten() const { return bytesWritten; }
+    void printStatus() const;
+
+private:
+    // Card
+    volatile bool cardOk;
+    volatile bool recording;
+    uint32_t failedAt;          // millis() of the last write error
+    uint16_t nextSegment;
+    uint64_t cardBytes;
+
+    // Write-behind ring - the capture task fills from head, the recorder
+    // task frees to tail
+    uint8_t* ring;
+    uint32_t ringHead;
+    uint32_t ringTail;
+    uint32_t ringUsed;
+    uint32_t ringPeak;
+    SdQueuedFrame queue[SD_RECORDER_QUEUE_FRAMES];
+    uint8_t queueHead;
+    uint8_t queueTail;
+    uint8_t queueCount;
+    portMUX_TYPE ringLock;
+    volatile uint32_t lastPushAt;
+
+    // Open segment
+    int file;                   // -1 = none
+    uint16_t segment;
+    uint16_t segmentWidth;
+    uint16_t segmentHeight;
+    uint32_t dataBytes;         // movi's contents after its header, JUNK included
+    uint32_t maxFrameBytes;
+    uint32_t checkpointAt;      // millis()
+    uint32_t checkpointFrames;
+    uint32_t indexAt;           // File offset of the last checkpoint's idx1, 0 before the first
+    uint32_t indexGap;          // Its size as a JUNK chunk, to the sector the frames went on from
+    SdIndexEntry* index;
+    uint32_t indexCount;
+
+    // Chunk buffer, sector aligned with the file
+    uint8_t* chunk;
+    uint32_t chunkFill;
+    uint32_t chunkFileOffset;   // Where chunk[0] goes
+
+    TaskHandle_t task;
+
+    // Statistics
+    uint32_t framesWritten;
+    uint32_t framesDropped;
+    uint64_t bytesWritten;
+    uint32_t segmentsClosed;
+    uint32_t checkpoints;
+    uint32_t writeErrors;
+    uint32_t worstWriteMs;
+
+    bool mount();
+    void findNextSegment();
+    bool openSegment(uint16_t width, uint16_t height);
+    bool closeSegment();
+    bool checkpoint();
+    bool writeFrame(const SdQueuedFrame& frame);
+    bool append(const uint8_t* data, size_t length);
+    bool flushChunk();
+    bool writeAt(uint32_t offset, const uint8_t* data, size_t length);
+    void buildHeader(uint8_t* hdrl, uint8_t* movi) const;
+    bool writeHeader();
+    bool writeIndex();
+    bool takeFrame(SdQueuedFrame& frame);
+    void releaseFrame(const SdQueuedFrame& frame);
+    void fail(const char* what);
+
+    static void taskEntry(void* parameter);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern SdRecorder& SdRec();
+
+#endif // SD_RECORDER_H
@@ -1,31 +1,106 @@
 #include "sensor_manager.h"
 
-// Include Adafruit sensor headers here to avoid sensor_t conflicts
-#include <Adafruit_BMP280.h>
+// Include sensor headers here to keep them out of the camera's way
 #include <TinyGPSPlus.h>
+#include "bmp280.h"
+#include <driver/uart.h>
+#include "task_placement.h"
+#include "task_watchdog.h"
+#include "ubx_gps.h"
+#include "time_service.h"
+#include "baro_altitude.h"
+#include "flight_recorder.h"
+#include "debug_utils.h"
+
+// Per channel, in SensorChannel order
+static const struct {
+    const char* name;
+    float resolution;
+    uint16_t blocks;
+} seriesConfig[SENSOR_CHANNEL_COUNT] = {
+    {"pressure",        1.0f,   192},   // Below the baro's noise
+    {"temperature",     0.01f,  192},
+    {"altitude",        0.1f,   192},
+    {"vertical_speed",  0.01f,  192},
+    {"gps_altitude",    0.1f,   64},
+    {"latitude",        1e-6f,  64},    // 0.1 m
+    {"longitude",       1e-6f,  64}
+};
+
+// The GPS pulse-per-second edge is the top of a UTC second
+static void IRAM_ATTR onGpsPpsInterrupt() {
+    Clock().onPps();
+}
+
+// UTC seconds since 1970 for the proleptic Gregorian date; 0 before 2020, a receiver that doesn't know yet
+static uint32_t utcFromDate(int year, int month, int day, int hour, int minute, int second) {
+    if (year < 2020) {
+        return 0;
+    }
+    
+    year -= (month <= 2) ? 1 : 0;
+    int era = year / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    uint32_t days = (uint32_t)(era * 146097 + dayOfEra - 719468);
+    
+    return days * 86400UL + hour * 3600UL + minute * 60UL + second;
+}
 
 // ===========================
 // Constructor/Destructor
 // ===========================
 
-SensorManager::SensorManager() {
+SensorManager::SensorManager() : gpsPowerLock("gps", PowerLockType::NO_SLEEP) {
     bmp280 = nullptr;
+    bmp280Slot = -1;
     gps = nullptr;
-    gpsSerial = nullptr;
+    ubx = nullptr;
+    gpsEventQueue = nullptr;
+    gpsTask = nullptr;
+    gpsMutex = nullptr;
+    gpsUartInstalled = false;
+    ubxRetained = false;
+    gpsWakeFromBackup = false;
+    gpsInBackup = false;
+    memset(&aidFix, 0, sizeof(aidFix));
+    aidFixValid = false;
+    aidFixAccuracyCm = 0;
+    aidUtcAtBoot = 0;
+    aidTimeAccuracyS = 0;
+    gpsPowerMode = GpsPowerMode::FULL;
+    gpsPowerKnown = false;
+    gpsStart = GpsStart::FULL;
+    gpsStartMs = 0;
+    firstFixMs = 0;
+    fixCallback = nullptr;
+    fixContext = nullptr;
+    profileCallback = nullptr;
+    profileContext = nullptr;
     
     // Initialize data structures
-    currentBMP280Data = {0.0f, 0.0f, 0.0f, 0, false};
-    currentGPSData = {{0.0, 0.0, 0.0f, 0, 0.0f, 0, 0, 0, 0}, false};
+    bmp280Snapshot.publish({0.0f, 0.0f, 0.0f, 0, 0, false});
+    estimateSnapshot.publish(altitudeFilter.getEstimate());
+    altitudeResetPending = false;
+    SensorGPSData gpsData = {{0.0f, 0.0f, 0.0f, 0, 0.0f, 0.0f, 0, 0, 0}, false, false, 0, false, 0, false, 0.0f, 0.0f, 0};
+    gpsSnapshot.publish(gpsData);
+    lastFusedGPSTimestamp = 0;
+    lastBaroSeriesTime = 0;
+    lastGPSSeriesTime = 0;
+    lastTrimCapture = 0;
+    trimCaptured = false;
     
     seaLevelPressure = 101325.0f; // Standard atmospheric pressure
     
     // Initialize timing
-    lastBMP280Read = 0;
-    lastGPSRead = 0;
+    lastGPSSentence = 0;
     
     // Initialize error counts
     bmp280ErrorCount = 0;
     gpsErrorCount = 0;
+    gpsSentences = 0;
+    gpsOverflows = 0;
 }
 
 SensorManager::~SensorManager() {
@@ -39,15 +114,18 @@ SensorManager::~SensorManager() {
 bool SensorManager::begin() {
     bool success = true;
     
-    // Initialize BMP280
-    if (!initBMP280()) {
-        bmp280ErrorCount++;
+    // Series first - the sensor and GPS tasks append from their first reading
+    initSeries();
+    
+    // Initialize BMP280 and the rest of the I2C bus
+    if (!initI2CSensors()) {
+        bmp280ErrorCount = bmp280ErrorCount + 1;
         success = false;
     }
     
     // Initialize GPS
     if (!initGPS()) {
-        gpsErrorCount++;
+        gpsErrorCount = gpsErrorCount + 1;
         success = false;
     }
     
@@ -55,62 +133,165 @@ bool SensorManager::begin() {
 }
 
 void SensorManager::end() {
+    scheduler.end();
     if (bmp280) {
         delete bmp280;
         bmp280 = nullptr;
     }
     
+    stopGPSTask();
+    
     if (gps) {
         delete gps;
         gps = nullptr;
     }
     
-    if (gpsSerial) {
-        gpsSerial->end();
-        gpsSerial = nullptr;
+    if (ubx) {
+        delete ubx;
+        ubx = nullptr;
+    }
+    
+    for (uint8_t i = 0; i < SENSOR_CHANNEL_COUNT; i++) {
+        series[i].end();
     }
+    baroWindow.end();
+    gpsWindow.end();
 }
 
 // ===========================
 // Private Initialization Methods
 // ===========================
 
-bool SensorManager::initBMP280() {
+bool SensorManager::initI2CSensors() {
+    if (scheduler.isRunning()) {
+        return isBMP280Ready();
+    }
+    
     Wire.begin(BMP280_SDA_PIN, BMP280_SCL_PIN);
+    Wire.setClock(BMP280_I2C_CLOCK);
     
-    bmp280 = new Adafruit_BMP280();
+    // Configure BMP280 for balloon use
+    if (!bmp280) {
+        bmp280 = new Bmp280();
+        bmp280->configure(BMP280_ADDRESS, BMP280_SAMPLING_TEMP, BMP280_SAMPLING_PRESS, BMP280_FILTER);
+        bmp280Slot = scheduler.add(bmp280, BMP280_READ_INTERVAL_MS, bmp280SampleEntry, this);
+    }
+    scheduler.setPpsAligned(SENSOR_PPS_ALIGNED && GPS_PPS_PIN != -1);
     
-    if (!bmp280->begin(BMP280_ADDRESS)) {
-        if (DEBUG_SENSORS) {
-            Serial.println("BMP280: Could not find sensor at 0x76");
-        }
+    if (!scheduler.begin(Wire)) {
+        SENSOR_TRACE("Could not start the sensor task");
         return false;
     }
     
-    // Configure BMP280 for balloon use
-    bmp280->setSampling(Adafruit_BMP280::MODE_NORMAL,
-                       Adafruit_BMP280::SAMPLING_X2,     // Temperature
-                       Adafruit_BMP280::SAMPLING_X16,    // Pressure
-                       Adafruit_BMP280::FILTER_X16,
-                       Adafruit_BMP280::STANDBY_MS_500);
-    
-    if (DEBUG_SENSORS) {
-        Serial.println("BMP280: Initialized successfully");
+    if (!scheduler.isActive(bmp280Slot)) {
+        SENSOR_TRACE("BMP280: Could not find sensor at 0x76");
+        return false;
     }
     
+    SENSOR_TRACE("BMP280: Initialized successfully, %lu ms per measurement",
+                 bmp280->getMeasurementTimeMs());
+    
     return true;
 }
 
+void SensorManager::initSeries() {
+    size_t bytes = 0;
+    for (uint8_t i = 0; i < SENSOR_CHANNEL_COUNT; i++) {
+        // Not fatal - the latest readings still work without the history
+        if (series[i].begin(seriesConfig[i].name, seriesConfig[i].resolution, seriesConfig[i].blocks)) {
+            bytes += series[i].getCapacityBytes();
+        } else {
+            SENSOR_TRACE("No PSRAM for the %s series", seriesConfig[i].name);
+        }
+    }
+    
+    static_assert(SENSOR_WINDOW_BARO_CHANNELS + SENSOR_WINDOW_GPS_CHANNELS == SENSOR_CHANNEL_COUNT,
+                  "Every channel is in one window");
+    if (baroWindow.begin("baro", SENSOR_WINDOW_BARO_CHANNELS, SENSOR_WINDOW_BARO_SAMPLES)) {
+        bytes += baroWindow.getBytes();
+    }
+    if (gpsWindow.begin("gps", SENSOR_WINDOW_GPS_CHANNELS, SENSOR_WINDOW_GPS_SAMPLES)) {
+        bytes += gpsWindow.getBytes();
+    }
+    
+    SENSOR_TRACE("%u KB of time series and sample windows", (unsigned)(bytes / 1024));
+}
+
+static const char* const gpsStartNames[] = {"full", "tracking", "backup"};
+
 bool SensorManager::initGPS() {
-    // Use UART1 for GPS
-    gpsSerial = &Serial1;
-    gpsSerial->begin(GPS_BAUD_RATE, SERIAL_8N1, GPS_TX_PIN, GPS_RX_PIN);
+    gpsStartMs = millis();
+    firstFixMs = 0;
+    gpsStart = GpsStart::FULL;
+    
+    // IDF driver rather than Serial1 - its event queue is what lets the task sleep until a whole sentence is in
+    uart_config_t config = {};
+    config.baud_rate = GPS_BAUD_RATE;
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    config.source_clk = UART_SCLK_XTAL;     // APB changes under DFS; the crystal doesn't
+    
+    if (uart_driver_install(GPS_UART_NUM, GPS_UART_RX_BUFFER, 0, GPS_UART_QUEUE_LEN, &gpsEventQueue, 0) != ESP_OK) {
+        return false;
+    }
+    gpsUartInstalled = true;
+    gpsPowerLock.hold(true);
     
-    gps = new TinyGPSPlus();
+    // GPS TX is our RX
+    if (uart_param_config(GPS_UART_NUM, &config) != ESP_OK ||
+        uart_set_pin(GPS_UART_NUM, GPS_RX_PIN, GPS_TX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK) {
+        stopGPSTask();
+        return false;
+    }
+    
+    if (GPS_USE_UBX) {
+        if (gpsWakeFromBackup) {
+            wakeReceiver();
+        }
+        if (ubxRetained) {
+            // Powered through the sleep, still on NAV-PVT at the UBX rate - no handshake to wait for
+            uart_set_baudrate(GPS_UART_NUM, GPS_UBX_BAUD_RATE);
+            ubx = new UbxParser();
+            gpsStart = GpsStart::TRACKING;
+        } else if (configureUbx()) {
+            ubx = new UbxParser();
+            if (gpsWakeFromBackup) {
+                aidReceiver();
+                gpsStart = GpsStart::BACKUP;
+            }
+        } else if (DEBUG_GPS) {
+            Serial.println("GPS: No UBX acknowledgement - staying on NMEA");
+        }
+    }
+    
+    if (!ubx) {
+        // Pattern detect: one '\n', no idle time required around it
+        if (uart_enable_pattern_det_baud_intr(GPS_UART_NUM, '\n', 1, 9, 0, 0) != ESP_OK ||
+            uart_pattern_queue_reset(GPS_UART_NUM, GPS_UART_QUEUE_LEN) != ESP_OK) {
+            stopGPSTask();
+            return false;
+        }
+        gps = new TinyGPSPlus();
+    }
+    
+    // Events queued while configuring are for bytes already consumed
+    uart_flush_input(GPS_UART_NUM);
+    xQueueReset(gpsEventQueue);
+    
+    gpsMutex = xSemaphoreCreateMutex();
+    if (!gpsMutex || createPlacedTask(TaskId::GPS, gpsTaskEntry, this, &gpsTask) != pdPASS) {
+        gpsTask = nullptr;
+        stopGPSTask();
+        return false;
+    }
+    Watchdog().watch(TaskId::GPS, gpsTask, TASK_BUDGET_GPS_MS);
     
     // Configure PPS pin if available
     if (GPS_PPS_PIN != -1) {
         pinMode(GPS_PPS_PIN, INPUT);
+        attachInterrupt(digitalPinToInterrupt(GPS_PPS_PIN), onGpsPpsInterrupt, RISING);
     }
     
     if (DEBUG_GPS) {
@@ -127,125 +308,548 @@ bool SensorManager::initGPS() {
 void SensorManager::update() {
     uint32_t currentTime = millis();
     
-    // Update BMP280 data
-    if (currentTime - lastBMP280Read >= BMP280_READ_INTERVAL_MS) {
-        updateBMP280Data();
-        lastBMP280Read = currentTime;
-    }
-    
-    // Update GPS data
-    if (currentTime - lastGPSRead >= GPS_READ_INTERVAL_MS) {
-        updateGPSData();
-        lastGPSRead = currentTime;
+    // The BMP280 and the filter run on the sensor task; GPS arrives on its own task; only notice here when it stops arriving
+    uint32_t timeout = gpsPowerMode == GpsPowerMode::ON_OFF ? GPS_PSMOO_PERIOD_S * 1000 + GPS_TIMEOUT_MS
+                                                            : GPS_TIMEOUT_MS;
+    if (gpsTask && gpsSnapshot.read().locked && currentTime - lastGPSSentence > timeout) {
+        gpsSnapshot.modify([](SensorGPSData& data) { data.locked = false; });
+        gpsErrorCount = gpsErrorCount + 1;
+        if (DEBUG_GPS) {
+            Serial.println("GPS: No fix sentence - lock lost");
+        }
     }
 }
 
 void SensorManager::forceUpdate() {
-    updateBMP280Data();
-    updateGPSData();
-    lastBMP280Read = millis();
-    lastGPSRead = millis();
+    if (!isBMP280Ready()) {
+        bmp280ErrorCount = bmp280ErrorCount + 1;
+        return;
+    }
+    scheduler.requestSample(bmp280Slot);
 }
 
-void SensorManager::updateBMP280Data() {
-    if (!bmp280) {
-        bmp280ErrorCount++;
+void SensorManager::setBaroInterval(uint32_t intervalMs) {
+    if (bmp280Slot >= 0) {
+        scheduler.setInterval(bmp280Slot, intervalMs);
+    }
+}
+
+bool SensorManager::setGPSFixInterval(uint32_t intervalMs) {
+    if (!ubx || intervalMs == 0) {
+        return false;
+    }
+    // Aligned sampling puts the baro on the fix's epochs only when they repeat every second
+    if (scheduler.isPpsAligned() && 1000 % intervalMs != 0 && intervalMs % 1000 != 0) {
+        return false;
+    }
+    
+    // RAM layer only, no ACK wait - the GPS task is the one reading the UART
+    const UbxConfigItem rate[] = {
+        {UBX_KEY_RATE_MEAS, intervalMs}
+    };
+    return sendUbxConfig(rate, 1, false);
+}
+
+void SensorManager::setFixCallback(GPSFixCallback callback, void* context) {
+    fixCallback = callback;
+    fixContext = context;
+}
+
+void SensorManager::setProfileCallback(ProfileLevelCallback callback, void* context) {
+    profileCallback = callback;
+    profileContext = context;
+}
+
+// ===========================
+// Sensor Task
+// ===========================
+
+void SensorManager::bmp280SampleEntry(SensorDriver& driver, bool ok, int64_t timeUs, void* context) {
+    static_cast<SensorManager*>(context)->updateBMP280Data(ok, timeUs);
+}
+
+void SensorManager::updateBMP280Data(bool ok, int64_t timeUs) {
+    if (!ok) {
+        bmp280Snapshot.modify([](BMP280Data& data) { data.valid = false; });
+        bmp280ErrorCount = bmp280ErrorCount + 1;
+        
+        SENSOR_TRACE("BMP280: Invalid reading");
         return;
     }
     
-    float pressure = bmp280->readPressure();
-    float temperature = bmp280->readTemperature();
+    if (altitudeResetPending) {
+        altitudeResetPending = false;
+        altitudeFilter.reset();
+    }
     
-    if (validateBMP280Data(pressure, temperature)) {
-        currentBMP280Data.pressure = pressure;
-        currentBMP280Data.temperature = temperature;
-        currentBMP280Data.altitude = calculateAltitude(pressure, seaLevelPressure);
-        currentBMP280Data.timestamp = millis();
-        currentBMP280Data.valid = true;
-        
-        if (DEBUG_SENSORS) {
-            Serial.printf("BMP280: P=%.2fPa, T=%.2f°C, Alt=%.2fm\n", 
-                         pressure, temperature, currentBMP280Data.altitude);
-        }
-    } else {
-        currentBMP280Data.valid = false;
-        bmp280ErrorCount++;
-        
-        if (DEBUG_SENSORS) {
-            Serial.println("BMP280: Invalid reading");
+    const Bmp280Sample& sample = bmp280->getSample();
+    uint32_t time = (uint32_t)(timeUs / 1000);     // The millis() base, for the filter and the series
+    
+    if (FlightRec().isCapturing()) {
+        if (!trimCaptured || time - lastTrimCapture >= FLIGHT_RECORDER_TRIM_INTERVAL_MS) {
+            trimCaptured = FlightRec().captureBaroTrim(bmp280->getTrim(), BMP280_CALIBRATION_LEN);
+            lastTrimCapture = time;
         }
+        FlightRec().captureBaro(bmp280->getRawData(), BMP280_DATA_LEN);
+    }
+    BMP280Data data;
+    data.pressure = sample.pressure / 256.0f;
+    data.temperature = sample.temperature / 100.0f;
+    data.altitude = calculateAltitude(data.pressure, seaLevelPressure);
+    data.timestamp = time;
+    data.timeUs = timeUs;
+    data.valid = true;
+    
+    // A fix that arrived since the last sample goes in first, so the filter stays in time order
+    fuseGPSData();
+    altitudeFilter.addBaro(data.altitude, time);
+    AltitudeEstimate estimate = altitudeFilter.getEstimate();
+    
+    bmp280Snapshot.publish(data);
+    estimateSnapshot.publish(estimate);
+    
+    const float baroSample[SENSOR_WINDOW_BARO_CHANNELS] = {data.pressure, data.temperature, estimate.altitude,
+                                                           estimate.verticalSpeed};
+    baroWindow.append(time, baroSample);
+    
+    ProfileLevel level;
+    if (SENSOR_PRESSURE_PROFILE && estimate.valid &&
+        profile.add(time, data.pressure, data.temperature, estimate.altitude, estimate.verticalSpeed, level) &&
+        profileCallback) {
+        profileCallback(profileContext, level);
+    }
+    
+    if (time - lastBaroSeriesTime >= SENSOR_SERIES_BARO_INTERVAL_MS) {
+        series[static_cast<uint8_t>(SensorChannel::PRESSURE)].append(time, data.pressure);
+        series[static_cast<uint8_t>(SensorChannel::TEMPERATURE)].append(time, data.temperature);
+        series[static_cast<uint8_t>(SensorChannel::ALTITUDE)].append(time, estimate.altitude);
+        series[static_cast<uint8_t>(SensorChannel::VERTICAL_SPEED)].append(time, estimate.verticalSpeed);
+        lastBaroSeriesTime = time;
+    }
+    
+    static uint32_t lastLogTime = 0;
+    if (DEBUG_SENSORS && time - lastLogTime > 1000) {
+        lastLogTime = time;
+        SENSOR_TRACE("BMP280: P=%.2fPa, T=%.2f°C, Alt=%.2fm",
+                     data.pressure, data.temperature, data.altitude);
     }
 }
 
-void SensorManager::updateGPSData() {
-    if (!gps || !gpsSerial) {
-        gpsErrorCount++;
+void SensorManager::fuseGPSData() {
+    SensorGPSData data = gpsSnapshot.read();
+    
+    // Each fix once; timestamp is set only by a valid one
+    if (!data.valid || !data.locked || data.timestamp == lastFusedGPSTimestamp) {
         return;
     }
+    lastFusedGPSTimestamp = data.timestamp;
+    
+    float variance = data.verticalAccuracy > 0.0f ? data.verticalAccuracy * data.verticalAccuracy
+                                                  : ALT_FILTER_GPS_ALT_VAR;
+    altitudeFilter.addGpsAltitude(data.altitude, variance, data.timestamp);
+    if (ubx) {
+        altitudeFilter.addGpsVerticalSpeed(data.verticalSpeed, data.timestamp);
+    }
+    
+    uint32_t time = data.timestamp;
+    const float gpsSample[SENSOR_WINDOW_GPS_CHANNELS] = {data.altitude, data.latitude, data.longitude};
+    gpsWindow.append(time, gpsSample);
+    if (time - lastGPSSeriesTime >= SENSOR_SERIES_GPS_INTERVAL_MS) {
+        series[static_cast<uint8_t>(SensorChannel::GPS_ALTITUDE)].append(time, data.altitude);
+        series[static_cast<uint8_t>(SensorChannel::LATITUDE)].append(time, data.latitude);
+        series[static_cast<uint8_t>(SensorChannel::LONGITUDE)].append(time, data.longitude);
+        lastGPSSeriesTime = time;
+    }
+}
+
+void SensorManager::stopGPSTask() {
+    if (gpsTask) {
+        // Not in the middle of a sentence
+        xSemaphoreTake(gpsMutex, portMAX_DELAY);
+        Watchdog().unwatch(TaskId::GPS);
+        vTaskDelete(gpsTask);
+        gpsTask = nullptr;
+        xSemaphoreGive(gpsMutex);
+    }
+    
+    if (gpsMutex) {
+        vSemaphoreDelete(gpsMutex);
+        gpsMutex = nullptr;
+    }
+    
+    if (gpsUartInstalled) {
+        uart_driver_delete(GPS_UART_NUM);
+        gpsUartInstalled = false;
+        gpsEventQueue = nullptr;
+        gpsPowerLock.hold(false);
+    }
+}
+
+void SensorManager::gpsTaskEntry(void* param) {
+    static_cast<SensorManager*>(param)->gpsTaskLoop();
+}
+
+void SensorManager::gpsTaskLoop() {
+    uart_event_t event;
     
-    // Read GPS data for a short time
-    uint32_t timeout = millis() + 100; // 100ms timeout
-    while (millis() < timeout && gpsSerial->available()) {
-        gps->encode(gpsSerial->read());
+    while (true) {
+        // Silence from the receiver is GPS_TIMEOUT_MS's to catch, not the watchdog's
+        Watchdog().wait(TaskId::GPS);
+        if (xQueueReceive(gpsEventQueue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        Watchdog().beat(TaskId::GPS);
+        
+        xSemaphoreTake(gpsMutex, portMAX_DELAY);
+        switch (event.type) {
+            case UART_PATTERN_DET: {
+                // Sentences queue up in order; each position is its '\n'
+                int position;
+                while ((position = uart_pattern_pop_pos(GPS_UART_NUM)) >= 0) {
+                    readGPSLine(position + 1);
+                }
+                break;
+            }
+            
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // Sentence boundaries are lost - start over at the next '\n'
+                gpsOverflows = gpsOverflows + 1;
+                uart_flush_input(GPS_UART_NUM);
+                if (ubx) {
+                    ubx->reset();
+                } else {
+                    uart_pattern_queue_reset(GPS_UART_NUM, GPS_UART_QUEUE_LEN);
+                }
+                xQueueReset(gpsEventQueue);
+                break;
+            
+            case UART_DATA:
+                // NMEA: bytes short of a '\n' wait in the ring buffer for the pattern event
+                if (ubx) {
+                    readGPSFrames(event.size);
+                }
+                break;
+            
+            default:
+                break;
+        }
+        xSemaphoreGive(gpsMutex);
     }
+}
+
+void SensorManager::readGPSLine(size_t length) {
+    uint8_t line[GPS_LINE_MAX];
     
-    if (validateGPSData()) {
-        currentGPSData.latitude = gps->location.lat();
-        currentGPSData.longitude = gps->location.lng();
-        currentGPSData.altitude = gps->altitude.meters();
-        currentGPSData.speed = gps->speed.mps();
-        currentGPSData.course = gps->course.deg();
-        currentGPSData.satellites = gps->satellites.value();
-        currentGPSData.hdop = gps->hdop.value();
-        currentGPSData.timestamp = millis();
-        currentGPSData.valid = true;
-        currentGPSData.locked = true;
+    // Longer than any sentence means noise or a lost '\n'; TinyGPSPlus rejects it on checksum
+    while (length > 0) {
+        int chunk = uart_read_bytes(GPS_UART_NUM, line, min(length, sizeof(line)), 0);
+        if (chunk <= 0) {
+            return;
+        }
+        length -= chunk;
+        FlightRec().captureGps(FlightGpsSource::NMEA, line, chunk);
         
-        if (DEBUG_GPS && (millis() - lastGPSRead > 10000)) { // Log every 10 seconds
-            Serial.printf("GPS: Lat=%.6f, Lon=%.6f, Sats=%d, HDOP=%.1f\n",
-                         currentGPSData.latitude, currentGPSData.longitude,
-                         currentGPSData.satellites, currentGPSData.hdop);
+        for (int i = 0; i < chunk; i++) {
+            if (!gps->encode(line[i])) {
+                continue;
+            }
+            gpsSentences = gpsSentences + 1;
+            
+            // GGA commits satellites whether or not it has a fix; RMC commits location only with one
+            if (gps->location.isUpdated() || gps->satellites.isUpdated()) {
+                publishGPSData();
+            }
         }
+    }
+}
+
+void SensorManager::publishGPSData() {
+    SensorGPSData data = gpsSnapshot.read();
+    
+    bool timed = updateGPSTime(data);
+    
+    bool valid = validateGPSData();
+    if (valid) {
+        data.latitude = gps->location.lat();
+        data.longitude = gps->location.lng();
+        data.altitude = gps->altitude.meters();
+        data.speed = gps->speed.mps();
+        data.course = gps->course.deg();
+        data.satellites = gps->satellites.value();
+        data.hdop = gps->hdop.value();
+        data.timestamp = millis();
+        data.timeUs = timed ? data.timeUs : Clock().nowUs();
+        data.valid = true;
+        data.locked = true;
     } else {
-        currentGPSData.locked = false;
-        
         // Keep last valid data but mark as not locked
-        if (!currentGPSData.valid) {
-            gpsErrorCount++;
+        data.locked = false;
+    }
+    
+    // Reading the TinyGPSPlus fields clears their updated flags for the next sentence
+    gps->location.isUpdated();
+    gps->satellites.isUpdated();
+    
+    storeGPSData(data, valid);
+}
+
+void SensorManager::readGPSFrames(size_t length) {
+    uint8_t chunkBuffer[GPS_LINE_MAX];
+    
+    while (length > 0) {
+        int chunk = uart_read_bytes(GPS_UART_NUM, chunkBuffer, min(length, sizeof(chunkBuffer)), 0);
+        if (chunk <= 0) {
+            return;
+        }
+        length -= chunk;
+        FlightRec().captureGps(FlightGpsSource::UBX, chunkBuffer, chunk);
+        
+        for (int i = 0; i < chunk; i++) {
+            if (!ubx->feed(chunkBuffer[i])) {
+                continue;
+            }
+            gpsSentences = gpsSentences + 1;
             
-            if (DEBUG_GPS) {
-                Serial.println("GPS: No valid data");
+            UbxNavPvt pvt;
+            if (ubx->is(UBX_CLASS_NAV, UBX_ID_NAV_PVT) &&
+                ubxDecodeNavPvt(ubx->getPayload(), ubx->getLength(), pvt)) {
+                publishNavPvt(pvt);
             }
         }
     }
 }
 
+void SensorManager::publishNavPvt(const UbxNavPvt& pvt) {
+    SensorGPSData data = gpsSnapshot.read();
+    
+    bool timed = false;
+    if (pvt.dateValid && pvt.timeValid) {
+        uint32_t utcSeconds = utcFromDate(pvt.year, pvt.month, pvt.day, pvt.hour, pvt.minute, pvt.second);
+        // The epoch is second + nano, and nano may be negative
+        int32_t offsetMs = (pvt.nano + 500000) / 1000000;
+        if (offsetMs < 0 && utcSeconds != 0) {
+            utcSeconds--;
+            offsetMs += 1000;
+        }
+        timed = setGPSTime(data, utcSeconds, (uint32_t)offsetMs);
+    }
+    
+    // Same limits as the NMEA path, from the receiver's own fix flag and PDOP - NAV-PVT carries no HDOP
+    bool valid = pvt.fixOk && (pvt.fixType == UBX_FIX_3D || pvt.fixType == UBX_FIX_GNSS_DR) &&
+                 pvt.numSV >= GPS_MIN_SATS && pvt.pDOP <= 500;
+    if (valid) {
+        data.latitude = pvt.lat * 1e-7;
+        data.longitude = pvt.lon * 1e-7;
+        data.altitude = pvt.hMSL / 1000.0f;
+        data.speed = pvt.gSpeed / 1000.0f;
+        data.course = pvt.headMot * 1e-5f;
+        data.satellites = pvt.numSV;
+        data.hdop = min(pvt.pDOP, (uint16_t)255);
+        data.quality = pvt.fixType;
+        data.verticalSpeed = -pvt.velD / 1000.0f;
+        data.verticalAccuracy = pvt.vAcc / 1000.0f;
+        data.timestamp = millis();
+        data.timeUs = timed ? data.timeUs : Clock().nowUs();
+        data.valid = true;
+        data.locked = true;
+    } else {
+        data.locked = false;
+    }
+    
+    storeGPSData(data, valid);
+}
+
+void SensorManager::storeGPSData(const SensorGPSData& data, bool valid) {
+    gpsSnapshot.publish(data);
+    lastGPSSentence = millis();
+    if (valid && fixCallback) {
+        fixCallback(fixContext, data);
+    }
+    
+    if (valid && !firstFixMs) {
+        uint32_t ttff = millis() - gpsStartMs;
+        firstFixMs = ttff ? ttff : 1;
+        GPS_INFO("First fix in %lu ms (%s start)", (unsigned long)ttff, gpsStartNames[(uint8_t)gpsStart]);
+    }
+    
+    static uint32_t lastLogTime = 0;
+    if (valid) {
+        if (DEBUG_GPS && millis() - lastLogTime > 10000) { // Log every 10 seconds
+            Serial.printf("GPS: Lat=%.6f, Lon=%.6f, Sats=%d, HDOP=%.1f\n",
+                         data.latitude, data.longitude, data.satellites, data.hdop);
+            lastLogTime = millis();
+        }
+    } else if (!data.valid) {
+        gpsErrorCount = gpsErrorCount + 1;
+        
+        if (DEBUG_GPS && millis() - lastLogTime > 10000) {
+            Serial.println("GPS: No valid data");
+            lastLogTime = millis();
+        }
+    }
+}
+
+bool SensorManager::updateGPSTime(SensorGPSData& data) {
+    if (!gps->time.isUpdated() || !gps->time.isValid() || !gps->date.isValid()) {
+        return false;
+    }
+    
+    return setGPSTime(data, utcFromDate(gps->date.year(), gps->date.month(), gps->date.day(),
+                                 gps->time.hour(), gps->time.minute(), gps->time.second()),
+               gps->time.centisecond() * 10);
+}
+
+bool SensorManager::setGPSTime(SensorGPSData& data, uint32_t utcSeconds, uint32_t millisIntoSecond) {
+    if (utcSeconds == 0) {
+        return false;
+    }
+    
+    int64_t now = Clock().nowUs();
+    int64_t intoSecond = (int64_t)millisIntoSecond * 1000;
+    data.fixTime = utcSeconds;
+    
+    // The last PPS edge marks the start of the second being reported - unless
+    // it's younger than the fix's offset into that second, and so the next one's
+    int64_t pps;
+    int64_t secondStart;
+    if (Clock().getLastPps(pps) && now - pps >= intoSecond && now - pps < 1000000) {
+        secondStart = pps;
+        data.ppsAligned = true;
+    } else {
+        secondStart = now - intoSecond;
+        data.ppsAligned = false;
+    }
+    data.fixLocalTime = (uint32_t)(secondStart / 1000);
+    data.timeUs = secondStart + intoSecond;
+    data.timeValid = true;
+    
+    Clock().discipline(utcSeconds, secondStart, data.ppsAligned ? TimeSource::PPS : TimeSource::GPS);
+    return true;
+}
+
 // ===========================
 // Validation Methods
 // ===========================
 
-bool SensorManager::validateBMP280Data(float pressure, float temperature) {
-    // Check for valid pressure range (300hPa to 1200hPa)
-    if (pressure < 30000.0f || pressure > 120000.0f) {
-        return false;
+bool SensorManager::configureUbx() {
+    const UbxConfigItem navigation[] = {
+        {UBX_KEY_UART1OUTPROT_NMEA, 0},
+        {UBX_KEY_UART1OUTPROT_UBX, 1},
+        {UBX_KEY_MSGOUT_NAV_PVT_UART1, 1},
+        {UBX_KEY_NAVSPG_DYNMODEL, GPS_DYNAMIC_MODEL},
+        {UBX_KEY_RATE_MEAS, 1000 / GPS_NAV_RATE_HZ},
+        {UBX_KEY_RATE_NAV, 1}
+    };
+    const UbxConfigItem baudRate[] = {
+        {UBX_KEY_UART1_BAUDRATE, GPS_UBX_BAUD_RATE}
+    };
+    const UbxConfigItem restore[] = {
+        {UBX_KEY_UART1OUTPROT_NMEA, 1},
+        {UBX_KEY_UART1_BAUDRATE, GPS_BAUD_RATE}
+    };
+    
+    // Fresh from power-up at GPS_BAUD_RATE, or still configured from before our own reset
+    const uint32_t rates[] = {GPS_BAUD_RATE, GPS_UBX_BAUD_RATE};
+    for (uint32_t rate : rates) {
+        uart_set_baudrate(GPS_UART_NUM, rate);
+        uart_flush_input(GPS_UART_NUM);
+        if (!sendUbxConfig(navigation, sizeof(navigation) / sizeof(navigation[0]), true)) {
+            continue;
+        }
+        
+        // Acknowledged at the old rate while switching - not worth waiting for
+        sendUbxConfig(baudRate, 1, false);
+        uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100));
+        vTaskDelay(pdMS_TO_TICKS(20));
+        uart_set_baudrate(GPS_UART_NUM, GPS_UBX_BAUD_RATE);
+        uart_flush_input(GPS_UART_NUM);
+        
+        if (waitUbx(UBX_CLASS_NAV, UBX_ID_NAV_PVT, GPS_UBX_FIRST_PVT_MS)) {
+            if (DEBUG_GPS) {
+                Serial.printf("GPS: UBX NAV-PVT at %d Hz, %d baud, dynamic model %d\n",
+                             GPS_NAV_RATE_HZ, GPS_UBX_BAUD_RATE, GPS_DYNAMIC_MODEL);
+            }
+            return true;
+        }
+        
+        // NMEA is off by now - put it back for the fallback
+        sendUbxConfig(restore, sizeof(restore) / sizeof(restore[0]), false);
+        uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100));
+        break;
     }
     
-    // Check for valid temperature range (-40°C to +85°C)
-    if (temperature < -40.0f || temperature > 85.0f) {
-        return false;
+    uart_set_baudrate(GPS_UART_NUM, GPS_BAUD_RATE);
+    return false;
+}
+
+// Backup mode ends on an edge at the receiver's RX; what is sent meanwhile is lost
+void SensorManager::wakeReceiver() {
+    const uint8_t pulse[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    uart_write_bytes(GPS_UART_NUM, pulse, sizeof(pulse));
+    uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100));
+    vTaskDelay(pdMS_TO_TICKS(GPS_BACKUP_WAKE_MS));
+    uart_flush_input(GPS_UART_NUM);
+}
+
+// Unacknowledged - a receiver that still has better keeps its own
+void SensorManager::aidReceiver() {
+    uint8_t frame[UBX_AID_FRAME_MAX];
+    size_t length;
+    if (aidUtcAtBoot) {
+        length = ubxBuildIniTime(frame, sizeof(frame), aidUtcAtBoot + millis() / 1000, aidTimeAccuracyS);
+        if (length) {
+            uart_write_bytes(GPS_UART_NUM, frame, length);
+        }
     }
+    if (aidFixValid) {
+        length = ubxBuildIniPosition(frame, sizeof(frame), lroundf(aidFix.latitude * 1e7f),
+                                     lroundf(aidFix.longitude * 1e7f), lroundf(aidFix.altitude * 100.0f),
+                                     aidFixAccuracyCm);
+        if (length) {
+            uart_write_bytes(GPS_UART_NUM, frame, length);
+        }
+    }
+    uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100));
     
-    // Check for NaN values
-    if (isnan(pressure) || isnan(temperature)) {
+    if (DEBUG_GPS) {
+        Serial.printf("GPS: Woken from backup, aided with %s (±%u s) and %s (±%lu m)\n",
+                     aidUtcAtBoot ? "time" : "no time", aidTimeAccuracyS,
+                     aidFixValid ? "the last fix" : "no position", (unsigned long)(aidFixAccuracyCm / 100));
+    }
+}
+
+bool SensorManager::sendUbxConfig(const UbxConfigItem* items, uint8_t count, bool waitAck) {
+    uint8_t frame[UBX_FRAME_OVERHEAD + 4 + UBX_VALSET_MAX_ITEMS * 8];
+    size_t length = ubxBuildValset(frame, sizeof(frame), items, count);
+    if (length == 0 || uart_write_bytes(GPS_UART_NUM, frame, length) != (int)length) {
         return false;
     }
     
-    return true;
+    // Only one VALSET is ever outstanding, so any ACK-ACK is its
+    return !waitAck || waitUbx(UBX_CLASS_ACK, UBX_ID_ACK_ACK, GPS_UBX_ACK_TIMEOUT_MS);
+}
+
+bool SensorManager::waitUbx(uint8_t msgClass, uint8_t msgId, uint32_t timeoutMs) {
+    UbxParser parser;
+    uint8_t chunkBuffer[GPS_LINE_MAX];
+    uint32_t start = millis();
+    
+    // Before the task starts - read the driver directly, NMEA and all
+    while (millis() - start < timeoutMs) {
+        int chunk = uart_read_bytes(GPS_UART_NUM, chunkBuffer, sizeof(chunkBuffer), pdMS_TO_TICKS(10));
+        for (int i = 0; i < chunk; i++) {
+            if (parser.feed(chunkBuffer[i]) && parser.is(msgClass, msgId)) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 bool SensorManager::validateGPSData() {
-    // Check if we have a valid location fix
-    if (!gps->location.isValid()) {
+    // Check if we have a valid location fix, and a recent one
+    if (!gps->location.isValid() || gps->location.age() > GPS_TIMEOUT_MS) {
         return false;
     }
     
@@ -267,9 +871,61 @@ bool SensorManager::validateGPSData() {
 // ===========================
 
 float SensorManager::calculateAltitude(float pressure, float seaLevelPressure) {
-    // Barometric altitude formula
-    // h = 44330 * (1 - (P/P0)^(1/5.255))
-    return 44330.0f * (1.0f - pow(pressure / seaLevelPressure, 0.190263f));
+    // Layered standard atmosphere from a table - the single-layer formula is wrong above 11 km
+    return baroAltitude(pressure, seaLevelPressure);
+}
+
+void SensorManager::getWindowStats(uint32_t windowMs, ColumnStats* stats) const {
+    // A window that didn't begin leaves its channels as they are
+    memset(stats, 0, sizeof(ColumnStats) * SENSOR_CHANNEL_COUNT);
+    uint32_t from = millis() - windowMs;
+    baroWindow.summarize(from, &stats[static_cast<uint8_t>(SensorChannel::PRESSURE)]);
+    gpsWindow.summarize(from, &stats[static_cast<uint8_t>(SensorChannel::GPS_ALTITUDE)]);
+}
+
+size_t SensorManager::formatSummaryReport(char* text, size_t size, uint32_t windowMs) const {
+    // The channels worth the bytes, most telling first, with the decimals each one's noise allows
+    static const struct {
+        SensorChannel channel;
+        const char* label;
+        int decimals;
+    } entries[] = {
+        {SensorChannel::PRESSURE, "P", 0},
+        {SensorChannel::VERTICAL_SPEED, "V", 1},
+        {SensorChannel::TEMPERATURE, "T", 1},
+        {SensorChannel::ALTITUDE, "A", 0},
+        {SensorChannel::GPS_ALTITUDE, "G", 0}
+    };
+    if (size == 0) {
+        return 0;
+    }
+    
+    ColumnStats stats[SENSOR_CHANNEL_COUNT];
+    getWindowStats(windowMs, stats);
+    const ColumnStats& baro = stats[static_cast<uint8_t>(SensorChannel::PRESSURE)];
+    int length = snprintf(text, size, "Sum %lus n%lu", (unsigned long)(windowMs / 1000), (unsigned long)baro.count);
+    if (length < 0 || (size_t)length >= size) {
+        text[0] = '\0';
+        return 0;
+    }
+    
+    // " P 101301..101325 m101318 s1.2" - range, mean and standard deviation; whole entries only
+    for (const auto& entry : entries) {
+        const ColumnStats& channel = stats[static_cast<uint8_t>(entry.channel)];
+        if (channel.count == 0) {
+            continue;
+        }
+        int d = entry.decimals;
+        char part[48];
+        int partLength = snprintf(part, sizeof(part), " %s %.*f..%.*f m%.*f s%.*f", entry.label, d, channel.min, d,
+                                  channel.max, d, channel.mean, d + 1, sqrtf(channel.variance));
+        if (partLength <= 0 || partLength >= (int)sizeof(part) || (size_t)(length + partLength) >= size) {
+            break;
+        }
+        memcpy(&text[length], part, partLength + 1);
+        length += partLength;
+    }
+    return length;
 }
 
 // ===========================
@@ -277,15 +933,181 @@ float SensorManager::calculateAltitude(float pressure, float seaLevelPressure) {
 // ===========================
 
 bool SensorManager::isBMP280Ready() const {
-    return bmp280 != nullptr;
+    return scheduler.isActive(bmp280Slot);
+}
+
+BMP280Data SensorManager::getBMP280Data() const {
+    return bmp280Snapshot.read();
+}
+
+AltitudeEstimate SensorManager::getAltitudeEstimate() const {
+    return estimateSnapshot.read();
 }
 
 bool SensorManager::isGPSReady() const {
-    return gps != nullptr && gpsSerial != nullptr;
+    return gpsTask != nullptr;
 }
 
 bool SensorManager::isGPSLocked() const {
-    return currentGPSData.locked;
+    return gpsSnapshot.read().locked;
+}
+
+GPSData SensorManager::getGPSData() const {
+    return gpsSnapshot.read();
+}
+
+GPSData SensorManager::getGPSData(int64_t& timeUs) const {
+    SensorGPSData data = gpsSnapshot.read();
+    timeUs = data.timeUs;
+    return data;
+}
+
+bool SensorManager::setGPSPowerMode(GpsPowerMode mode) {
+    if (!ubx) {
+        return false;
+    }
+    if (gpsPowerKnown && mode == gpsPowerMode) {
+        return true;
+    }
+    
+    static const uint8_t operateMode[] = {UBX_PM_FULL, UBX_PM_PSMCT, UBX_PM_PSMOO};
+    const UbxConfigItem power[] = {
+        {UBX_KEY_PM_POSUPDATEPERIOD, GPS_PSMOO_PERIOD_S},
+        {UBX_KEY_PM_ACQPERIOD, GPS_PSMOO_ACQ_RETRY_S},
+        {UBX_KEY_PM_ONTIME, GPS_PSMOO_ON_TIME_S},
+        {UBX_KEY_PM_OPERATEMODE, operateMode[static_cast<uint8_t>(mode)]}
+    };
+    if (!sendUbxConfig(power, sizeof(power) / sizeof(power[0]), false)) {
+        return false;
+    }
+    gpsPowerMode = mode;
+    gpsPowerKnown = true;
+    return true;
+}
+
+float SensorManager::getGPSVerticalSpeed() const {
+    return gpsSnapshot.read().verticalSpeed;
+}
+
+bool SensorManager::getGPSTime(uint32_t& utcSeconds, uint32_t& localMillis) const {
+    SensorGPSData data = gpsSnapshot.read();
+    utcSeconds = data.fixTime;
+    localMillis = data.fixLocalTime;
+    return data.timeValid;
+}
+
+// ===========================
+// Deep Sleep Retention
+// ===========================
+
+void SensorManager::saveRetained(RtcSensorState& state) const {
+    state.seaLevelPressure = seaLevelPressure;
+
+    AltitudeEstimate estimate = estimateSnapshot.read();
+    if (estimate.valid && estimate.gpsReferenced) {
+        state.baroOffset = estimate.baroOffset;
+        state.baroOffsetVariance = estimate.baroOffsetVariance;
+        state.gpsReferenced = true;
+    }
+
+    // A cycle without a fix keeps the one before
+    SensorGPSData fix = gpsSnapshot.read();
+    if (fix.valid && fix.locked) {
+        state.lastFix = fix;
+        state.fixValid = true;
+    }
+    int64_t utcUs;
+    state.utcAtSave = Clock().utcNowUs(utcUs) ? (uint32_t)(utcUs / 1000000) : 0;
+    
+    // Nothing heard, or in backup: configure again next time
+    state.gpsUbx = ubx && gpsSentences > 0 && !gpsInBackup;
+    state.gpsBackup = gpsInBackup;
+    state.valid = true;
+}
+
+bool SensorManager::enterGPSBackup(uint32_t sleepMs) {
+    if (!GPS_HOT_START || !ubx || !gpsUartInstalled || sleepMs < GPS_BACKUP_MIN_SLEEP_MS) {
+        return false;
+    }
+    uint8_t frame[UBX_FRAME_OVERHEAD + UBX_PMREQ_LEN];
+    size_t length = ubxBuildBackupRequest(frame, sizeof(frame));
+    if (length == 0 || uart_write_bytes(GPS_UART_NUM, frame, length) != (int)length) {
+        return false;
+    }
+    uart_wait_tx_done(GPS_UART_NUM, pdMS_TO_TICKS(100));
+    gpsInBackup = true;
+    return true;
+}
+
+void SensorManager::restoreRetained(const RtcSensorState& state, uint32_t sleptMs) {
+    if (!state.valid || gpsTask) {
+        return;
+    }
+
+    // Directly - setSeaLevelPressure() would reset the filter the seed is for
+    seaLevelPressure = state.seaLevelPressure;
+    if (state.gpsReferenced) {
+        altitudeFilter.seedBaroOffset(state.baroOffset,
+                                      state.baroOffsetVariance + ALT_FILTER_BIAS_NOISE * sleptMs / 1000.0f);
+    }
+
+    // Last known position until the receiver has a fix of its own; never fused or counted as locked
+    if (state.fixValid) {
+        SensorGPSData data = gpsSnapshot.read();
+        static_cast<GPSData&>(data) = state.lastFix;
+        data.locked = false;
+        data.valid = false;
+        data.timestamp = 0;
+        data.timeValid = false;
+        gpsSnapshot.publish(data);
+    }
+    ubxRetained = GPS_USE_UBX && state.gpsUbx;
+    
+    // The aiding for a receiver woken from backup, widened for the time asleep
+    gpsWakeFromBackup = GPS_USE_UBX && GPS_HOT_START && state.gpsBackup;
+    if (gpsWakeFromBackup) {
+        uint32_t sleptS = sleptMs / 1000;
+        if (state.utcAtSave) {
+            aidUtcAtBoot = state.utcAtSave + sleptS;
+            aidTimeAccuracyS = (uint16_t)min((uint64_t)GPS_AID_TIME_ACCURACY_S +
+                                             (uint64_t)sleptS * GPS_AID_CLOCK_PPM / 1000000, (uint64_t)UINT16_MAX);
+        }
+        if (state.fixValid) {
+            uint32_t ageS = sleptS;
+            if (state.utcAtSave && state.lastFix.fixTime && state.lastFix.fixTime <= state.utcAtSave) {
+                ageS += state.utcAtSave - state.lastFix.fixTime;
+            }
+            aidFix = state.lastFix;
+            aidFixValid = true;
+            aidFixAccuracyCm = (uint32_t)min(((uint64_t)GPS_AID_POS_ACCURACY_M + (uint64_t)GPS_AID_DRIFT_MPS * ageS) * 100,
+                                             (uint64_t)UINT32_MAX);
+        }
+    }
+}
+
+bool SensorManager::prepareSleepMonitor(UlpMonitorConfig& config) {
+    config.pressureRaw = 0;
+    config.pressureDeltaRaw = 0;
+    BMP280Data data = bmp280Snapshot.read();
+    if (!bmp280 || !scheduler.isActive(bmp280Slot) || !data.valid) {
+        return false;
+    }
+
+    // The RTC I2C controller takes the pins over; nothing of ours may be mid-transaction
+    scheduler.end();
+    float countsPerPa = bmp280->getCountsPerPa();
+    bool started = countsPerPa > 0.0f && bmp280->startNormalMode(ULP_BMP280_OVERSAMPLING, ULP_BMP280_STANDBY);
+    Wire.end();
+    if (!started) {
+        return false;
+    }
+
+    // Pressure change over one ULP period at the wake speed: dP = rho g v dt, rho = P / (R T)
+    float density = data.pressure / (BARO_GAS_CONSTANT * (data.temperature + 273.15f));
+    float deltaPa = density * BARO_GRAVITY * ULP_DESCENT_WAKE_MPS * ULP_MONITOR_PERIOD_MS / 1000.0f;
+    config.pressureRaw = bmp280->getRawPressure();
+    config.pressureDeltaRaw = (uint16_t)constrain(deltaPa * countsPerPa, 1.0f, 32767.0f);
+    return true;
 }
 
 void SensorManager::resetErrorCounts() {
@@ -298,28 +1120,32 @@ void SensorManager::resetErrorCounts() {
 // ===========================
 
 void SensorManager::printBMP280Data() const {
+    BMP280Data data = getBMP280Data();
     Serial.println("=== BMP280 Data ===");
-    Serial.printf("Pressure: %.2f Pa\n", currentBMP280Data.pressure);
-    Serial.printf("Temperature: %.2f °C\n", currentBMP280Data.temperature);
-    Serial.printf("Altitude: %.2f m\n", currentBMP280Data.altitude);
-    Serial.printf("Valid: %s\n", currentBMP280Data.valid ? "Yes" : "No");
-    Serial.printf("Timestamp: %lu ms\n", currentBMP280Data.timestamp);
+    Serial.printf("Pressure: %.2f Pa\n", data.pressure);
+    Serial.printf("Temperature: %.2f °C\n", data.temperature);
+    Serial.printf("Altitude: %.2f m\n", data.altitude);
+    Serial.printf("Valid: %s\n", data.valid ? "Yes" : "No");
+    Serial.printf("Timestamp: %lu ms\n", data.timestamp);
     Serial.printf("Sea Level Pressure: %.2f Pa\n", seaLevelPressure);
     Serial.printf("Error Count: %lu\n", bmp280ErrorCount);
 }
 
 void SensorManager::printGPSData() const {
+    SensorGPSData data = gpsSnapshot.read();
     Serial.println("=== GPS Data ===");
-    Serial.printf("Latitude: %.6f°\n", currentGPSData.latitude);
-    Serial.printf("Longitude: %.6f°\n", currentGPSData.longitude);
-    Serial.printf("Altitude: %.2f m\n", currentGPSData.altitude);
-    Serial.printf("Speed: %.2f m/s\n", currentGPSData.speed);
-    Serial.printf("Course: %.2f°\n", currentGPSData.course);
-    Serial.printf("Satellites: %d\n", currentGPSData.satellites);
-    Serial.printf("HDOP: %.1f\n", currentGPSData.hdop / 100.0f);
-    Serial.printf("Valid: %s\n", currentGPSData.valid ? "Yes" : "No");
-    Serial.printf("Locked: %s\n", currentGPSData.locked ? "Yes" : "No");
-    Serial.printf("Timestamp: %lu ms\n", currentGPSData.timestamp);
+    Serial.printf("Latitude: %.6f°\n", data.latitude);
+    Serial.printf("Longitude: %.6f°\n", data.longitude);
+    Serial.printf("Altitude: %.2f m\n", data.altitude);
+    Serial.printf("Speed: %.2f m/s\n", data.speed);
+    Serial.printf("Course: %.2f°\n", data.course);
+    Serial.printf("Satellites: %d\n", data.satellites);
+    Serial.printf("HDOP: %.1f\n", data.hdop / 100.0f);
+    Serial.printf("Valid: %s\n", data.valid ? "Yes" : "No");
+    Serial.printf("Locked: %s\n", data.locked ? "Yes" : "No");
+    Serial.printf("Timestamp: %lu ms\n", data.timestamp);
+    Serial.printf("UTC Time: %s (%lu s, %s)\n", data.timeValid ? "Valid" : "Unknown",
+                 data.fixTime, data.ppsAligned ? "PPS" : "NMEA");
     Serial.printf("Error Count: %lu\n", gpsErrorCount);
 }
 
@@ -330,6 +1156,49 @@ void SensorManager::printStatus() const {
     Serial.printf("GPS Locked: %s\n", isGPSLocked() ? "Yes" : "No");
     Serial.printf("BMP280 Errors: %lu\n", bmp280ErrorCount);
     Serial.printf("GPS Errors: %lu\n", gpsErrorCount);
-    Serial.printf("Last BMP280 Read: %lu ms ago\n", millis() - lastBMP280Read);
-    Serial.printf("Last GPS Read: %lu ms ago\n", millis() - lastGPSRead);
+    Serial.printf("Last BMP280 Read: %lu ms ago\n", millis() - getBMP280Data().timestamp);
+    Serial.printf("GPS Protocol: %s\n", ubx ? "UBX NAV-PVT" : "NMEA");
+    if (ubx) {
+        static const char* const powerNames[] = {"full", "cyclic tracking", "on/off"};
+        Serial.printf("GPS Power: %s%s\n", powerNames[static_cast<uint8_t>(gpsPowerMode)],
+                     gpsPowerKnown ? "" : " (not set)");
+    }
+    if (firstFixMs) {
+        Serial.printf("GPS First Fix: %lu ms (%s start)\n", (unsigned long)firstFixMs,
+                     gpsStartNames[(uint8_t)gpsStart]);
+    } else if (gpsTask) {
+        Serial.printf("GPS First Fix: none yet, %lu ms since start (%s)\n", millis() - gpsStartMs,
+                     gpsStartNames[(uint8_t)gpsStart]);
+    }
+    Serial.printf("Last GPS Fix Sentence: %lu ms ago\n", millis() - lastGPSSentence);
+    Serial.printf("GPS Sentences: %lu, Overflows: %lu\n", gpsSentences, gpsOverflows);
+    if (ubx) {
+        Serial.printf("GPS UBX Checksum Errors: %lu\n", ubx->getChecksumErrors());
+    }
+    
+    AltitudeEstimate estimate = getAltitudeEstimate();
+    Serial.printf("Altitude: %.1f ± %.1f m, climb %.2f ± %.2f m/s (%s, baro offset %.1f m, %lu rejected)\n",
+                 estimate.altitude, estimate.altitudeSigma, estimate.verticalSpeed, estimate.verticalSpeedSigma,
+                 estimate.valid ? (estimate.gpsReferenced ? "baro+GPS" : "baro") : "no data",
+                 altitudeFilter.getBaroOffset(), altitudeFilter.getRejectedCount());
+    
+    if (SENSOR_PRESSURE_PROFILE) {
+        Serial.printf("Pressure levels: %lu closed, %lu dropped, in the %.0f hPa level\n",
+                     (unsigned long)profile.getLevels(), (unsigned long)profile.getDropped(),
+                     profile.getBinLow() / 100.0f);
+    }
+    
+    scheduler.printStatus();
+    Clock().printStatus();
+    
+    for (const SampleColumns* window : {&baroWindow, &gpsWindow}) {
+        Serial.printf("Window %-15s %6u / %6u samples, %6u bytes\n", window->getName(), (unsigned)window->getCount(),
+                     (unsigned)window->getCapacity(), (unsigned)window->getBytes());
+    }
+    for (uint8_t i = 0; i < SENSOR_CHANNEL_COUNT; i++) {
+        const TimeSeries& channel = series[i];
+        Serial.printf("Series %-15s %6lu samples, %6u / %6u bytes, %lu blocks dropped\n", channel.getName(),
+                     (unsigned long)channel.getSampleCount(), (unsigned)channel.getBytesUsed(),
+                     (unsigned)channel.getCapacityBytes(), (unsigned long)channel.getDroppedBlocks());
+    }
 }
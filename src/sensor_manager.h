@@ -3,15 +3,30 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 // Forward declaration to avoid sensor_t conflicts
 // We'll include actual headers in the .cpp file where needed
-class Adafruit_BMP280;
+class Bmp280;
 class TinyGPSPlus;
+class UbxParser;
+struct UbxNavPvt;
+struct UbxConfigItem;
 
 #include "balloon_config.h"
 #include "sensor_pins.h"
 #include "common_types.h"
+#include "altitude_filter.h"
+#include "timeseries.h"
+#include "sample_columns.h"
+#include "sensor_scheduler.h"
+#include "snapshot.h"
+#include "power_scaling.h"
+#include "rtc_state.h"
+#include "ulp_monitor.h"
+#include "pressure_profile.h"
 
 // ===========================
 // Sensor Data Structures
@@ -22,6 +37,7 @@ struct BMP280Data {
     float temperature;     // Temperature in Celsius
     float altitude;        // Calculated altitude in meters
     uint32_t timestamp;    // Timestamp in milliseconds
+    int64_t timeUs;        // Middle of the conversion, Clock() time
     bool valid;           // Data validity flag
 };
 
@@ -31,40 +47,196 @@ struct SensorGPSData : public GPSData {
     bool locked;          // GPS lock status
     bool valid;
     int timestamp;
+    bool timeValid;       // fixTime holds UTC seconds
+    uint32_t fixLocalTime; // millis() at the start of the fixTime second
+    bool ppsAligned;      // fixLocalTime taken from the PPS edge, not NMEA arrival
+    float verticalSpeed;  // m/s, up positive; UBX only, 0 from NMEA
+    float verticalAccuracy; // m, 1 sigma; UBX only, 0 from NMEA
+    int64_t timeUs;       // Fix epoch in Clock() time; arrival when the message has no time
 };
 
+// Called on the GPS task with each valid fix, once it is published
+typedef void (*GPSFixCallback)(void* context, const SensorGPSData& fix);
+
+// Called on the sensor task with each pressure level climbed or fallen through
+typedef void (*ProfileLevelCallback)(void* context, const ProfileLevel& level);
+
+// GPS is read on its own task, woken by the UART driver, and publishes a new
+// Snapshot; getGPSData() copies the latest without a lock, so loop() never
+// waits on the UART. With GPS_USE_UBX, initGPS() switches the receiver to
+// NAV-PVT only at GPS_NAV_RATE_HZ and GPS_UBX_BAUD_RATE, and every NAV-PVT
+// is decoded straight into a snapshot. Otherwise, or if the receiver never
+// acknowledges, pattern detect on each '\n' feeds one NMEA sentence at a
+// time into TinyGPSPlus, and a GGA, or an RMC with a fix, publishes
+#define GPS_UART_RX_BUFFER         2048    // Driver ring buffer - 2 s of NMEA at 9600 baud, 20 NAV-PVTs
+#define GPS_UART_QUEUE_LEN         16      // UART events and pending '\n' positions
+#define GPS_LINE_MAX               128     // NMEA sentences are at most 82 bytes; also the UBX read chunk
+#define GPS_UBX_ACK_TIMEOUT_MS     300     // Per configuration message
+#define GPS_UBX_FIRST_PVT_MS       1500    // For the first NAV-PVT at the new baud rate
+
+// Hot start (GPS_HOT_START): a sleep of GPS_BACKUP_MIN_SLEEP_MS or more
+// puts the UBX receiver in backup mode, where its battery-backed RAM keeps
+// the ephemeris, almanac, position and a running RTC at tens of µA rather
+// than tracking at tens of mA. Shorter sleeps leave it tracking, as before.
+// The wake boot pulses its UART RX, configures it again (backup loses the
+// RAM layer) and aids it with MGA-INI: the retained fix and the UTC carried
+// over the sleep, each with an accuracy widened for the time asleep - in
+// case the backup supply didn't hold. The first fix's time from initGPS()
+// is reported per boot (getTimeToFirstFix()).
+//
+// The receiver's navigation database isn't dumped to flash (MGA-DBD): it is
+// kilobytes per save, and with no switched supply the receiver only loses it
+// on a power cycle, when there is no time to aid with either.
+#define GPS_BACKUP_MIN_SLEEP_MS    60000
+#define GPS_BACKUP_WAKE_MS         250     // After the wake pulse, before it listens
+#define GPS_AID_POS_ACCURACY_M     100     // The last fix's, before drift
+#define GPS_AID_DRIFT_MPS          60      // Added per second since the fix - jet stream speed
+#define GPS_AID_TIME_ACCURACY_S    2       // Clock() at the save, before drift
+#define GPS_AID_CLOCK_PPM          20000   // RTC slow clock over the sleep
+
+// Receiver power mode, set by the cadence manager's GPS power policy
+enum class GpsPowerMode : uint8_t {
+    FULL = 0,           // Continuous tracking
+    CYCLIC,             // Cyclic tracking at the navigation rate - same fixes, receiver idle between
+    ON_OFF              // A fix every GPS_PSMOO_PERIOD_S, off in between
+};
+
+#define GPS_PSMOO_PERIOD_S         30
+#define GPS_PSMOO_ACQ_RETRY_S      20      // After an acquisition that found nothing
+#define GPS_PSMOO_ON_TIME_S        2       // Tracking after each fix, for the ephemeris to stay fresh
+
+enum class GpsStart : uint8_t {
+    FULL = 0,           // Configured from its power-up state, or after our own reset
+    TRACKING,           // Kept tracking through the sleep, still configured
+    BACKUP              // Woken from backup mode, configured and aided
+};
+
+// I2C sensors are drivers on one SensorScheduler task, each at its own rate;
+// the BMP280's callback stores the reading, runs the altitude filter - and
+// fuses any new GPS fix first - then publishes both as Snapshots. A new
+// sensor (humidity, IMU, probes on the same bus) is a SensorDriver, an add()
+// in initI2CSensors() and a callback of its own.
+
+// Every reading between telemetry ticks is kept, compressed in PSRAM, for
+// profiles sent down after the fact: baro channels at 10 Hz take about 7
+// bits a sample, so 96 KB holds 3 hours; GPS at 1 Hz about 17 bits in 32 KB
+enum class SensorChannel : uint8_t {
+    PRESSURE = 0,           // Pa
+    TEMPERATURE,            // °C
+    ALTITUDE,               // m, filtered
+    VERTICAL_SPEED,         // m/s, filtered
+    GPS_ALTITUDE,           // m
+    LATITUDE,               // degrees
+    LONGITUDE,
+    COUNT
+};
+
+#define SENSOR_CHANNEL_COUNT       static_cast<uint8_t>(SensorChannel::COUNT)
+#define SENSOR_SERIES_BARO_INTERVAL_MS  100
+#define SENSOR_SERIES_GPS_INTERVAL_MS   1000
+
+// Every raw sample of the last minute or so, uncompressed, for window
+// statistics: the baro channels at the BMP280 rate, the GPS ones per fix
+#define SENSOR_WINDOW_BARO_SAMPLES      4096    // 80 s at 50 Hz, 80 KB
+#define SENSOR_WINDOW_GPS_SAMPLES       256
+#define SENSOR_WINDOW_BARO_CHANNELS     4       // PRESSURE to VERTICAL_SPEED
+#define SENSOR_WINDOW_GPS_CHANNELS      3       // GPS_ALTITUDE to LONGITUDE
+
 // ===========================
 // Sensor Manager Class
 // ===========================
 
 class SensorManager {
 private:
-    Adafruit_BMP280* bmp280;
-    TinyGPSPlus* gps;
+    Bmp280* bmp280;
+    TinyGPSPlus* gps;           // NMEA mode
+    UbxParser* ubx;             // UBX mode
+    
+    // I2C sensors
+    SensorScheduler scheduler;
+    int bmp280Slot;
     
-    // BMP280 data
-    BMP280Data currentBMP280Data;
+    // BMP280 data - published by the sensor task, read from anywhere
+    Snapshot<BMP280Data> bmp280Snapshot;
+    Snapshot<AltitudeEstimate> estimateSnapshot;
     float seaLevelPressure;    // Sea level pressure for altitude calculation
     
-    // GPS data
-    SensorGPSData currentGPSData;
-    HardwareSerial* gpsSerial;
+    // Baro/GPS fusion - sensor task only, fed from the BMP280 callback
+    AltitudeFilter altitudeFilter;
+    int lastFusedGPSTimestamp;
+    volatile bool altitudeResetPending;     // setSeaLevelPressure() asks, the sensor task resets
+    
+    // Pressure levels - sensor task only, fed from the BMP280 callback with the filtered altitude
+    PressureProfile profile;
+    ProfileLevelCallback profileCallback;
+    void* profileContext;
+    
+    // Time series - appended from the sensor and GPS paths, read from anywhere
+    TimeSeries series[SENSOR_CHANNEL_COUNT];
+    uint32_t lastBaroSeriesTime;
+    uint32_t lastGPSSeriesTime;
+    SampleColumns baroWindow;
+    SampleColumns gpsWindow;
+    
+    // Raw capture for replay - the BMP280 trim goes with the first sample and every so often after
+    uint32_t lastTrimCapture;
+    bool trimCaptured;
+    
+    // GPS data - published by the GPS task; loop() only clears locked
+    Snapshot<SensorGPSData> gpsSnapshot;
+    QueueHandle_t gpsEventQueue;
+    TaskHandle_t gpsTask;
+    SemaphoreHandle_t gpsMutex;     // Held while a sentence is parsed, so end() never deletes mid-line
+    bool gpsUartInstalled;
+    bool ubxRetained;               // Deep sleep wake: the receiver kept its UBX configuration
+    bool gpsWakeFromBackup;         // Deep sleep wake: the receiver is in backup mode
+    bool gpsInBackup;               // Put in backup for the coming sleep
+    GPSData aidFix;                 // Retained fix, to aid a receiver woken from backup
+    bool aidFixValid;
+    uint32_t aidFixAccuracyCm;
+    uint32_t aidUtcAtBoot;          // UTC when millis() was 0, 0 unknown
+    uint16_t aidTimeAccuracyS;
+    GpsPowerMode gpsPowerMode;
+    bool gpsPowerKnown;             // False until set here - a receiver kept through a sleep may be in either
+    GpsStart gpsStart;
+    uint32_t gpsStartMs;            // millis() at initGPS()
+    volatile uint32_t firstFixMs;   // Since gpsStartMs, 0 until the first fix
+    PowerLock gpsPowerLock;         // No light sleep with the UART up - it would drop the sentence that woke it
+    GPSFixCallback fixCallback;
+    void* fixContext;
     
     // Timing
-    uint32_t lastBMP280Read;
-    uint32_t lastGPSRead;
+    volatile uint32_t lastGPSSentence;
     
     // Error tracking
-    uint32_t bmp280ErrorCount;
-    uint32_t gpsErrorCount;
+    volatile uint32_t bmp280ErrorCount;
+    volatile uint32_t gpsErrorCount;
+    volatile uint32_t gpsSentences;     // NMEA sentences or UBX frames
+    volatile uint32_t gpsOverflows;     // Input thrown away after a FIFO or ring buffer overflow
     
     // Private methods
-    bool initBMP280();
+    bool initI2CSensors();
     bool initGPS();
     float calculateAltitude(float pressure, float seaLevelPressure);
-    void updateBMP280Data();
-    void updateGPSData();
-    bool validateBMP280Data(float pressure, float temperature);
+    static void bmp280SampleEntry(SensorDriver& driver, bool ok, int64_t timeUs, void* context);
+    void updateBMP280Data(bool ok, int64_t timeUs);
+    void fuseGPSData();
+    void initSeries();
+    void stopGPSTask();
+    static void gpsTaskEntry(void* param);
+    void gpsTaskLoop();
+    void readGPSLine(size_t length);
+    void readGPSFrames(size_t length);
+    void publishGPSData();
+    void publishNavPvt(const UbxNavPvt& pvt);
+    void storeGPSData(const SensorGPSData& data, bool valid);
+    bool updateGPSTime(SensorGPSData& data);
+    bool setGPSTime(SensorGPSData& data, uint32_t utcSeconds, uint32_t millisIntoSecond);
+    bool configureUbx();
+    void wakeReceiver();
+    void aidReceiver();
+    bool sendUbxConfig(const UbxConfigItem* items, uint8_t count, bool waitAck);
+    bool waitUbx(uint8_t msgClass, uint8_t msgId, uint32_t timeoutMs);
     bool validateGPSData();
 
 public:
@@ -77,24 +249,64 @@ public:
     
     // Data updates
     void update();
-    void forceUpdate();
+    void forceUpdate();     // Asks the sensor task for a reading now; doesn't wait for it
     
     // Data access
-    BMP280Data getBMP280Data() const { return currentBMP280Data; }
-    GPSData getGPSData() const { return currentGPSData; }
+    BMP280Data getBMP280Data() const;
+    GPSData getGPSData() const;
+    GPSData getGPSData(int64_t& timeUs) const;     // And the fix's Clock() time, from the same snapshot
+    bool getGPSTime(uint32_t& utcSeconds, uint32_t& localMillis) const;
+    float getGPSVerticalSpeed() const;
+    
+    // Filtered altitude and vertical speed, baro rate with GPS for the offset
+    AltitudeEstimate getAltitudeEstimate() const;
+    uint32_t getAltitudeRejectCount() const { return altitudeFilter.getRejectedCount(); }
+    
+    // Readings since boot, or as far back as the ring reaches; empty without PSRAM
+    const TimeSeries& getSeries(SensorChannel channel) const { return series[static_cast<uint8_t>(channel)]; }
+    
+    // Each channel over the last windowMs, into stats[SENSOR_CHANNEL_COUNT]; count 0 where there's nothing
+    void getWindowStats(uint32_t windowMs, ColumnStats* stats) const;
+    // "Sum 60s P min..max mean/sd ..." for the STATUS packet, whole entries that fit; the length
+    size_t formatSummaryReport(char* text, size_t size, uint32_t windowMs) const;
     
     // Status methods
     bool isBMP280Ready() const;
     bool isGPSReady() const;
     bool isGPSLocked() const;
+    bool isGPSUbx() const { return ubx != nullptr; }
+    uint32_t getTimeToFirstFix() const { return firstFixMs; }     // ms from initGPS(), 0 before the fix
+    GpsStart getGPSStart() const { return gpsStart; }
     
     // Configuration
-    void setSeaLevelPressure(float pressure) { seaLevelPressure = pressure; }
+    void setSeaLevelPressure(float pressure) { seaLevelPressure = pressure; altitudeResetPending = true; }  // Baro altitude steps
     float getSeaLevelPressure() const { return seaLevelPressure; }
+    const SensorScheduler& getScheduler() const { return scheduler; }
+    void setBaroInterval(uint32_t intervalMs);
+    bool setGPSFixInterval(uint32_t intervalMs);   // UBX only; false on NMEA or a failed write
+    bool setGPSPowerMode(GpsPowerMode mode);        // UBX only; as setGPSFixInterval()
+    GpsPowerMode getGPSPowerMode() const { return gpsPowerMode; }
+    void setFixCallback(GPSFixCallback callback, void* context);    // Before begin()
+    void setProfileCallback(ProfileLevelCallback callback, void* context);  // Before begin()
+    const PressureProfile& getProfile() const { return profile; }
+    
+    // Across deep sleep; restore before begin(), sleptMs widens the offset's variance
+    void saveRetained(RtcSensorState& state) const;
+    void restoreRetained(const RtcSensorState& state, uint32_t sleptMs);
+    
+    // Deep sleep, ahead of saveRetained(): the receiver to backup mode if the
+    // sleep is long enough; false if it is left tracking
+    bool enterGPSBackup(uint32_t sleepMs);
+    
+    // Last thing before deep sleep: stops the sensor task, leaves the BMP280
+    // converting for the ULP and sets its pressure change threshold
+    bool prepareSleepMonitor(UlpMonitorConfig& config);
     
     // Error handling
     uint32_t getBMP280ErrorCount() const { return bmp280ErrorCount; }
     uint32_t getGPSErrorCount() const { return gpsErrorCount; }
+    uint32_t getGPSSentenceCount() const { return gpsSentences; }
+    uint32_t getGPSOverflowCount() const { return gpsOverflows; }
     void resetErrorCounts();
     
     // Debug
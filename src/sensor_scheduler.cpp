@@ -0,0 +1,300 @@
+#include "sensor_scheduler.h"
+#include "balloon_config.h"
+#include "task_placement.h"
+#include "task_watchdog.h"
+#include "time_service.h"
+#include "energy_ledger.h"
+
+SensorScheduler::SensorScheduler() {
+    count = 0;
+    task = nullptr;
+    mutex = nullptr;
+    ppsAligned = false;
+    wakeTimer = nullptr;
+    wakeUs = 0;
+}
+
+SensorScheduler::~SensorScheduler() {
+    end();
+}
+
+int SensorScheduler::add(SensorDriver* driver, uint32_t intervalMs, SensorSampleCallback callback, void* context) {
+    if (!driver || task || count >= SENSOR_MAX_DRIVERS) {
+        return -1;
+    }
+
+    Slot& slot = slots[count];
+    slot.driver = driver;
+    slot.callback = callback;
+    slot.context = context;
+    slot.interval = intervalMs;
+    slot.nextTrigger = 0;
+    slot.targetUs = 0;
+    slot.alignedUs = 0;
+    slot.leadUs = 0;
+    slot.readyAt = 0;
+    slot.sampleUs = 0;
+    slot.converting = false;
+    slot.active = false;
+    slot.reads = 0;
+    slot.errors = 0;
+    memset(&slot.jitter, 0, sizeof(slot.jitter));
+    return count++;
+}
+
+bool SensorScheduler::begin(TwoWire& bus) {
+    if (task) {
+        return true;
+    }
+
+    uint32_t now = millis();
+    int64_t nowUs = Clock().nowUs();
+    for (uint8_t i = 0; i < count; i++) {
+        slots[i].active = slots[i].driver->init(bus);
+        slots[i].nextTrigger = now;
+        slots[i].targetUs = nowUs;
+        slots[i].alignedUs = 0;
+        if (!slots[i].active) {
+            slots[i].errors = slots[i].errors + 1;
+        }
+    }
+
+    // Wakes the task on an aligned trigger's microsecond; without it they land on the tick
+    const esp_timer_create_args_t timerArgs = {wakeEntry, this, ESP_TIMER_TASK, "sensor_wake", false};
+    if (!wakeTimer && esp_timer_create(&timerArgs, &wakeTimer) != ESP_OK) {
+        wakeTimer = nullptr;
+    }
+
+    mutex = xSemaphoreCreateMutex();
+    if (!mutex || createPlacedTask(TaskId::SENSORS, taskEntry, this, &task) != pdPASS) {
+        task = nullptr;
+        end();
+        return false;
+    }
+    Watchdog().watch(TaskId::SENSORS, task, TASK_BUDGET_SENSORS_MS);
+    return true;
+}
+
+void SensorScheduler::end() {
+    if (task) {
+        // Between passes, never mid-transaction
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        Watchdog().unwatch(TaskId::SENSORS);
+        vTaskDelete(task);
+        task = nullptr;
+        xSemaphoreGive(mutex);
+    }
+
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+    if (wakeTimer) {
+        esp_timer_stop(wakeTimer);
+        esp_timer_delete(wakeTimer);
+        wakeTimer = nullptr;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        slots[i].converting = false;
+        slots[i].active = false;
+    }
+    Energy().setActive(EnergyLoad::SENSORS, false);
+}
+
+// ===========================
+// Task
+// ===========================
+
+void SensorScheduler::taskEntry(void* param) {
+    static_cast<SensorScheduler*>(param)->taskLoop();
+}
+
+void SensorScheduler::wakeEntry(void* param) {
+    SensorScheduler* scheduler = static_cast<SensorScheduler*>(param);
+    if (scheduler->task) {
+        xTaskNotifyGive(scheduler->task);
+    }
+}
+
+void SensorScheduler::taskLoop() {
+    while (true) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        uint32_t sleepMs = service(millis());
+        int64_t wakeAt = wakeUs;
+        xSemaphoreGive(mutex);
+
+        if (wakeTimer) {
+            esp_timer_stop(wakeTimer);
+            if (wakeAt != 0) {
+                int64_t delayUs = wakeAt - Clock().nowUs();
+                esp_timer_start_once(wakeTimer, delayUs > 0 ? (uint64_t)delayUs : 0);
+            }
+        }
+        Watchdog().beat(TaskId::SENSORS);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(max(sleepMs, (uint32_t)1)));
+    }
+}
+
+uint32_t SensorScheduler::service(uint32_t now) {
+    uint32_t sleepMs = SENSOR_TASK_MAX_SLEEP_MS;
+    bool anyConverting = false;
+    wakeUs = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+        Slot& slot = slots[i];
+        if (!slot.active) {
+            continue;
+        }
+
+        if (slot.converting && (int32_t)(now - slot.readyAt) >= 0) {
+            slot.converting = false;
+            bool ok = slot.driver->read() && slot.driver->validate();
+            if (ok) {
+                slot.reads = slot.reads + 1;
+            } else {
+                slot.errors = slot.errors + 1;
+            }
+            if (slot.callback) {
+                slot.callback(*slot.driver, ok, slot.sampleUs, slot.context);
+            }
+            now = millis();     // The read and the callback take time of their own
+        }
+
+        // An aligned trigger waits for its microsecond; the tick may wake the task short of it
+        int64_t nowUs = Clock().nowUs();
+        bool due = slot.alignedUs != 0 ? nowUs >= slot.targetUs : (int32_t)(now - slot.nextTrigger) >= 0;
+        if (!slot.converting && due) {
+            recordJitter(slot, nowUs);
+            uint32_t conversionMs = 0;
+            if (slot.driver->trigger(conversionMs)) {
+                slot.converting = true;
+                slot.readyAt = now + conversionMs;
+                slot.leadUs = conversionMs * 500;
+                slot.sampleUs = nowUs + slot.leadUs;
+            } else {
+                slot.errors = slot.errors + 1;
+                if (slot.callback) {
+                    slot.callback(*slot.driver, false, Clock().nowUs(), slot.context);
+                }
+            }
+            schedule(slot, now, nowUs);
+        }
+
+        uint32_t next = slot.converting ? slot.readyAt : slot.nextTrigger;
+        int32_t wait = (int32_t)(next - now);
+        sleepMs = min(sleepMs, wait > 0 ? (uint32_t)wait : 0u);
+        anyConverting |= slot.converting;
+        if (!slot.converting && slot.alignedUs != 0 && (wakeUs == 0 || slot.targetUs < wakeUs)) {
+            wakeUs = slot.targetUs;
+        }
+    }
+
+    Energy().setActive(EnergyLoad::SENSORS, anyConverting);
+    return sleepMs;
+}
+
+void SensorScheduler::schedule(Slot& slot, uint32_t now, int64_t nowUs) {
+    int64_t epochUs = 0;
+    if (nextEpoch(slot, nowUs, epochUs)) {
+        slot.alignedUs = epochUs;
+        slot.targetUs = epochUs - slot.leadUs;
+        // The tick backstop, a whole ms early; the wake timer lands it
+        slot.nextTrigger = now + (uint32_t)((slot.targetUs - nowUs) / 1000);
+        return;
+    }
+
+    // Fixed rate; a driver that fell a whole interval behind skips ahead rather than bursting
+    uint32_t next = slot.nextTrigger + slot.interval;
+    slot.nextTrigger = (int32_t)(now - next) >= 0 ? now + slot.interval : next;
+    slot.targetUs = nowUs + (int64_t)(int32_t)(slot.nextTrigger - now) * 1000;
+    slot.alignedUs = 0;
+}
+
+bool SensorScheduler::nextEpoch(const Slot& slot, int64_t nowUs, int64_t& epochUs) const {
+    int64_t intervalUs = (int64_t)slot.interval * 1000;
+    int64_t ppsUs = 0;
+    if (!ppsAligned || intervalUs <= 0 || (1000000 % intervalUs != 0 && intervalUs % 1000000 != 0) ||
+        !Clock().getLastPps(ppsUs) || nowUs - ppsUs > (int64_t)SENSOR_PPS_MAX_AGE_MS * 1000) {
+        return false;
+    }
+    // The first epoch whose trigger, leadUs ahead of it, is still to come; a missed one is skipped
+    int64_t since = nowUs + slot.leadUs - ppsUs;
+    epochUs = ppsUs + (since / intervalUs + 1) * intervalUs;
+    return true;
+}
+
+void SensorScheduler::recordJitter(Slot& slot, int64_t triggerUs) {
+    SensorJitter& jitter = slot.jitter;
+    int64_t late = triggerUs - slot.targetUs;
+    jitter.lastUs = (int32_t)constrain(late, (int64_t)INT32_MIN, (int64_t)INT32_MAX);
+    uint32_t magnitude = (uint32_t)min(late < 0 ? -late : late, (int64_t)UINT32_MAX);
+    jitter.worstUs = max(jitter.worstUs, magnitude);
+    jitter.meanUs = jitter.triggers == 0 ? magnitude
+                                         : jitter.meanUs + (int32_t)(magnitude - jitter.meanUs) / (1 << SENSOR_JITTER_GAIN_SHIFT);
+    jitter.triggers++;
+    jitter.onPps = slot.alignedUs != 0;
+    if (jitter.onPps) {
+        jitter.aligned++;
+    }
+}
+
+// ===========================
+// Configuration and Status
+// ===========================
+
+bool SensorScheduler::isActive(int index) const {
+    return index >= 0 && index < count && slots[index].active;
+}
+
+void SensorScheduler::setInterval(int index, uint32_t intervalMs) {
+    if (index >= 0 && index < count && intervalMs > 0) {
+        slots[index].interval = intervalMs;
+    }
+}
+
+void SensorScheduler::requestSample(int index) {
+    if (index >= 0 && index < count) {
+        slots[index].alignedUs = 0;
+        slots[index].targetUs = Clock().nowUs();
+        slots[index].nextTrigger = millis();
+    }
+}
+
+void SensorScheduler::setPpsAligned(bool aligned) {
+    ppsAligned = aligned;
+}
+
+const SensorDriver* SensorScheduler::getDriver(int index) const {
+    return index >= 0 && index < count ? slots[index].driver : nullptr;
+}
+
+uint32_t SensorScheduler::getReadCount(int index) const {
+    return index >= 0 && index < count ? slots[index].reads : 0;
+}
+
+uint32_t SensorScheduler::getErrorCount(int index) const {
+    return index >= 0 && index < count ? slots[index].errors : 0;
+}
+
+SensorJitter SensorScheduler::getJitter(int index) const {
+    SensorJitter jitter;
+    memset(&jitter, 0, sizeof(jitter));
+    if (index >= 0 && index < count) {
+        jitter = slots[index].jitter;
+    }
+    return jitter;
+}
+
+void SensorScheduler::printStatus() const {
+    for (uint8_t i = 0; i < count; i++) {
+        const Slot& slot = slots[i];
+        Serial.printf("Sensor %-10s %s, every %lu ms, %lu reads, %lu errors\n", slot.driver->getName(),
+                     slot.active ? "active" : "absent", (unsigned long)slot.interval,
+                     (unsigned long)slot.reads, (unsigned long)slot.errors);
+        Serial.printf("  jitter last %ld us, mean %lu us, worst %lu us, %lu of %lu triggers on PPS%s\n",
+                     (long)slot.jitter.lastUs, (unsigned long)slot.jitter.meanUs, (unsigned long)slot.jitter.worstUs,
+                     (unsigned long)slot.jitter.aligned, (unsigned long)slot.jitter.triggers,
+                     ppsAligned ? "" : " (alignment off)");
+    }
+}
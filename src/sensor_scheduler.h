@@ -0,0 +1,145 @@
+#ifndef SENSOR_SCHEDULER_H
+#define SENSOR_SCHEDULER_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <cstdint>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// ===========================
+// Sensor Scheduler
+// One task that owns the I2C bus and runs every registered sensor driver at
+// its own rate, sleeping through conversions instead of waiting in them
+// ===========================
+
+// A driver splits a reading into trigger() - start a conversion, say how
+// long it takes - and read(), which fetches and compensates the result.
+// The task keeps each driver's next trigger and ready time and sleeps until
+// the earliest of them, so a slow conversion on one sensor never delays
+// another and the bus carries only short register transactions, one at a
+// time. A validated reading is handed to the driver's callback on the
+// sensor task; the callback publishes it (under the owner's lock) for
+// loop() and everything else.
+//
+// Adding a sensor is a SensorDriver subclass and an add() before begin().
+//
+// With setPpsAligned(true) a driver whose interval divides a second, or is
+// whole seconds, is triggered on the GPS PPS edge and its sub-multiples
+// instead of free-running: the trigger goes half the last conversion
+// ahead of the epoch, so the middle of the conversion - the sample's
+// timeUs - lands on it, the instant the receiver's own fixes are for. The
+// next epoch is taken from the latest edge every time, so the crystal's
+// drift never builds up. An esp_timer wakes the task at the exact
+// microsecond, not the next tick. With the PPS older than
+// SENSOR_PPS_MAX_AGE_MS the driver free-runs until it is back.
+//
+// Either way every trigger's offset from the time it was scheduled for is
+// kept per driver (getJitter()), so the data products say how coherent
+// they are.
+
+#define SENSOR_MAX_DRIVERS         8
+#define SENSOR_TASK_MAX_SLEEP_MS   100     // Upper bound on a sleep, so interval changes and samples requested now are picked up
+#define SENSOR_JITTER_GAIN_SHIFT   4       // Mean jitter is an average over about 2^4 triggers
+#define SENSOR_PPS_MAX_AGE_MS      2500    // Two missed edges and the drivers still align; more and they free-run
+
+class SensorDriver {
+public:
+    virtual ~SensorDriver() {}
+
+    virtual const char* getName() const = 0;
+
+    // Probe and configure; once, from begin()
+    virtual bool init(TwoWire& bus) = 0;
+
+    // Start a conversion; conversionMs is how long until read() may follow, 0 for at once
+    virtual bool trigger(uint32_t& conversionMs) = 0;
+
+    // Fetch the finished conversion into the driver's latest reading
+    virtual bool read() = 0;
+
+    // Latest reading within the sensor's physical range
+    virtual bool validate() const = 0;
+};
+
+// Sensor task; ok is false when trigger, read or validate failed. timeUs is
+// the middle of the conversion, in Clock() time
+typedef void (*SensorSampleCallback)(SensorDriver& driver, bool ok, int64_t timeUs, void* context);
+
+// Trigger time against schedule, one driver
+struct SensorJitter {
+    int32_t lastUs;             // Late positive
+    uint32_t worstUs;           // Largest either way
+    uint32_t meanUs;            // Running mean of the magnitude
+    uint32_t triggers;
+    uint32_t aligned;           // Of them on a PPS epoch
+    bool onPps;                 // The last one was
+};
+
+class SensorScheduler {
+public:
+    SensorScheduler();
+    ~SensorScheduler();
+
+    // Before begin(); the index is the driver's slot, -1 when full
+    int add(SensorDriver* driver, uint32_t intervalMs, SensorSampleCallback callback, void* context);
+
+    // init() every driver and start the task; drivers that fail init are left
+    // out. False if the task couldn't start
+    bool begin(TwoWire& bus);
+    void end();
+
+    bool isRunning() const { return task != nullptr; }
+    bool isActive(int index) const;
+
+    void setInterval(int index, uint32_t intervalMs);
+    void requestSample(int index);      // Trigger on the next wake rather than at the interval
+    void setPpsAligned(bool aligned);
+    bool isPpsAligned() const { return ppsAligned; }
+
+    uint8_t getDriverCount() const { return count; }
+    const SensorDriver* getDriver(int index) const;
+    uint32_t getReadCount(int index) const;
+    uint32_t getErrorCount(int index) const;
+    SensorJitter getJitter(int index) const;
+
+    void printStatus() const;
+
+private:
+    struct Slot {
+        SensorDriver* driver;
+        SensorSampleCallback callback;
+        void* context;
+        volatile uint32_t interval;
+        volatile uint32_t nextTrigger;
+        int64_t targetUs;       // The trigger's scheduled time - on a PPS epoch when alignedUs is set
+        int64_t alignedUs;      // The epoch, 0 free-running
+        uint32_t leadUs;        // Half the last conversion
+        uint32_t readyAt;
+        int64_t sampleUs;
+        bool converting;
+        bool active;
+        volatile uint32_t reads;
+        volatile uint32_t errors;
+        SensorJitter jitter;
+    };
+
+    Slot slots[SENSOR_MAX_DRIVERS];
+    uint8_t count;
+    TaskHandle_t task;
+    SemaphoreHandle_t mutex;    // Held for a pass over the drivers, so end() never stops one mid-transaction
+    bool ppsAligned;
+    esp_timer_handle_t wakeTimer;
+    int64_t wakeUs;             // Earliest aligned trigger after a pass, 0 for none
+
+    static void taskEntry(void* param);
+    static void wakeEntry(void* param);
+    void taskLoop();
+    uint32_t service(uint32_t now);     // The pass; returns ms until the next thing is due
+    void schedule(Slot& slot, uint32_t now, int64_t nowUs);
+    bool nextEpoch(const Slot& slot, int64_t nowUs, int64_t& epochUs) const;
+    void recordJitter(Slot& slot, int64_t triggerUs);
+};
+
+#endif // SENSOR_SCHEDULER_H
@@ -0,0 +1,86 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "freertos/FreeRTOS.h"
+
+// ===========================
+// Snapshot
+// A seqlock around a plain struct: one task publishes whole copies, any task
+// or core reads a consistent one without taking a lock
+// ===========================
+
+// The sequence is odd while a copy is being written. read() copies the value
+// and keeps it only if the sequence was even and unchanged across the copy;
+// otherwise a publish overlapped and it copies again. Writers serialize on a
+// spinlock held only for the memcpy, so a reader on the writer's core can
+// never preempt a half-written copy and spin - it retries at most while the
+// other core finishes one memcpy. Reads never block a writer.
+//
+// T must be trivially copyable; the states published here are a few dozen
+// bytes, so a retry costs less than a mutex round trip would.
+
+template <typename T>
+class Snapshot {
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshot<T> copies T with memcpy");
+
+public:
+    Snapshot() : sequence(0), writeLock(portMUX_INITIALIZER_UNLOCKED) {
+        memset(&value, 0, sizeof(value));
+    }
+
+    explicit Snapshot(const T& initial) : Snapshot() {
+        memcpy(&value, &initial, sizeof(value));
+    }
+
+    void publish(const T& newValue) {
+        portENTER_CRITICAL(&writeLock);
+        write(newValue);
+        portEXIT_CRITICAL(&writeLock);
+    }
+
+    // Read-modify-publish for writers that change a field of what another
+    // writer published; update(T&) runs under the write lock, so keep it short
+    template <typename F>
+    void modify(F update) {
+        portENTER_CRITICAL(&writeLock);
+        T copy;
+        memcpy(&copy, &value, sizeof(copy));
+        update(copy);
+        write(copy);
+        portEXIT_CRITICAL(&writeLock);
+    }
+
+    T read() const {
+        T copy;
+        uint32_t before;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            memcpy(&copy, &value, sizeof(copy));
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((before & 1) || sequence.load(std::memory_order_relaxed) != before);
+        return copy;
+    }
+
+    // Publishes so far; a reader that saw the same version has the same value
+    uint32_t getVersion() const { return sequence.load(std::memory_order_acquire) >> 1; }
+
+private:
+    std::atomic<uint32_t> sequence;
+    T value;
+    portMUX_TYPE writeLock;
+
+    void write(const T& newValue) {
+        uint32_t start = sequence.load(std::memory_order_relaxed);
+        sequence.store(start + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&value, &newValue, sizeof(value));
+        sequence.store(start + 2, std::memory_order_release);
+    }
+};
+
+#endif // SNAPSHOT_H
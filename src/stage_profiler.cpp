@@ -0,0 +1,96 @@
+#include "stage_profiler.h"
+#include "balloon_config.h"
+
+StageProfiler::StageProfiler() {
+    cyclesPerUs = PM_MAX_FREQ_MHZ;
+    reset();
+}
+
+void StageProfiler::reset() {
+    memset(histograms, 0, sizeof(histograms));
+}
+
+void StageProfiler::record(Stage stage, uint32_t cycles) {
+    StageHistogram& histogram = histograms[static_cast<uint8_t>(stage)];
+    uint8_t bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    histogram.buckets[bucket]++;
+    histogram.samples++;
+    histogram.totalCycles += cycles;
+    if (cycles > histogram.maxCycles) {
+        histogram.maxCycles = cycles;
+    }
+}
+
+// ===========================
+// Statistics
+// ===========================
+
+uint32_t StageProfiler::percentileCycles(const StageHistogram& histogram, float quantile) const {
+    if (histogram.samples == 0) {
+        return 0;
+    }
+
+    // The sample's rank, then where it falls within its bucket
+    float rank = quantile * histogram.samples;
+    uint32_t below = 0;
+    for (uint8_t b = 0; b < STAGE_PROFILER_BUCKETS; b++) {
+        uint32_t count = histogram.buckets[b];
+        if (count && below + count >= rank) {
+            uint32_t low = b ? 1u << b : 0;
+            uint32_t width = b ? 1u << b : 1;
+            uint32_t cycles = low + (uint32_t)(width * ((rank - below) / count));
+            return min(cycles, histogram.maxCycles);
+        }
+        below += count;
+    }
+    return histogram.maxCycles;
+}
+
+float StageProfiler::getPercentileUs(Stage stage, float quantile) const {
+    return percentileCycles(histograms[static_cast<uint8_t>(stage)], quantile) / cyclesPerUs;
+}
+
+float StageProfiler::getMaxUs(Stage stage) const {
+    return histograms[static_cast<uint8_t>(stage)].maxCycles / cyclesPerUs;
+}
+
+float StageProfiler::getMeanUs(Stage stage) const {
+    const StageHistogram& histogram = histograms[static_cast<uint8_t>(stage)];
+    return histogram.samples ? histogram.totalCycles / (float)histogram.samples / cyclesPerUs : 0.0f;
+}
+
+void StageProfiler::printReport() const {
+    Serial.printf("=== Stage Profile (us at %.0f MHz) ===\n", cyclesPerUs);
+    Serial.println("Stage            Runs       Mean      P50      P99      Max");
+    for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+        Stage stage = static_cast<Stage>(i);
+        Serial.printf("%-15s %6lu %9.1f %8.1f %8.1f %8.1f\n", stageToString(stage),
+                      (unsigned long)getSamples(stage), getMeanUs(stage), getPercentileUs(stage, 0.5f),
+                      getPercentileUs(stage, 0.99f), getMaxUs(stage));
+    }
+}
+
+const char* StageProfiler::stageToString(Stage stage) {
+    switch (stage) {
+        case Stage::SYSTEM_STATE: return "system_state";
+        case Stage::SENSORS: return "sensors";
+        case Stage::POWER: return "power";
+        case Stage::RECORDER: return "recorder";
+        case Stage::REPORTS: return "reports";
+        case Stage::UPLINK_QUEUE: return "uplink_queue";
+        case Stage::CAMERA: return "camera";
+        case Stage::COMMUNICATIONS: return "communications";
+        case Stage::COMMANDS: return "commands";
+        case Stage::RAILS: return "rails";
+        case Stage::CHECKPOINT: return "checkpoint";
+        default: return "unknown";
+    }
+}
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+static StageProfiler stageProfilerInstance;
+
+StageProfiler& Profiler() { return stageProfilerInstance; }
@@ -0,0 +1,109 @@
+#ifndef STAGE_PROFILER_H
+#define STAGE_PROFILER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "esp_cpu.h"
+#include "trace_buffer.h"
+
+// ===========================
+// Stage Profiler
+// CPU cycles per flight and uplink task stage, as log2 histograms with
+// P50, P99 and max for the console and /metrics
+// ===========================
+
+// A StageScope at the top of a stage reads the cycle counter (CCOUNT) on
+// entry and exit - two register reads, no call into the IDF - and adds the
+// difference to the stage's histogram: bucket b counts 2^b to 2^(b+1) - 1
+// cycles. CCOUNT is per core; both tasks are pinned, so a scope starts
+// and ends on one core. Both hold a CPU_MAX power lock while running, so
+// cycles convert to time at PM_MAX_FREQ_MHZ.
+//
+// Percentiles interpolate within a bucket, so they are good to the
+// bucket's width, a factor of two at worst; max is exact. Each stage has
+// one writer, the task it runs on, and readers get aligned 32-bit loads as
+// with any other metric.
+
+#define STAGE_PROFILER_BUCKETS  32
+
+enum class Stage : uint8_t {
+    // Flight task
+    SYSTEM_STATE = 0,
+    SENSORS,
+    POWER,
+    RECORDER,
+    REPORTS,            // Telemetry, GPS, heartbeat and status composed and posted
+    // Uplink task
+    UPLINK_QUEUE,
+    CAMERA,
+    COMMUNICATIONS,
+    COMMANDS,
+    RAILS,
+    CHECKPOINT,
+    COUNT
+};
+
+#define STAGE_COUNT static_cast<uint8_t>(Stage::COUNT)
+
+struct StageHistogram {
+    uint32_t buckets[STAGE_PROFILER_BUCKETS];
+    uint32_t samples;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+};
+
+class StageProfiler {
+public:
+    StageProfiler();
+
+    void record(Stage stage, uint32_t cycles);
+    void reset();
+
+    // Microseconds at the maximum clock
+    float getPercentileUs(Stage stage, float quantile) const;
+    float getMaxUs(Stage stage) const;
+    float getMeanUs(Stage stage) const;
+    uint32_t getSamples(Stage stage) const { return histograms[static_cast<uint8_t>(stage)].samples; }
+    const StageHistogram& getHistogram(Stage stage) const { return histograms[static_cast<uint8_t>(stage)]; }
+    float getCyclesPerUs() const { return cyclesPerUs; }
+
+    void printReport() const;
+
+    static const char* stageToString(Stage stage);
+
+private:
+    StageHistogram histograms[STAGE_COUNT];
+    float cyclesPerUs;
+
+    uint32_t percentileCycles(const StageHistogram& histogram, float quantile) const;
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern StageProfiler& Profiler();
+
+// One stage's run, from construction to the end of the scope; the trace
+// events sit outside the cycles counted
+class StageScope {
+public:
+    explicit StageScope(Stage stage) : stage(stage) {
+        Trace().beginScope(StageProfiler::stageToString(stage));
+        start = esp_cpu_get_cycle_count();
+    }
+    ~StageScope() {
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        Trace().endScope(StageProfiler::stageToString(stage));
+        Profiler().record(stage, cycles);
+    }
+
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+
+private:
+    Stage stage;
+    uint32_t start;
+};
+
+#endif // STAGE_PROFILER_H
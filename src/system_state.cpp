@@ -1,4 +1,34 @@
 #include "system_state.h"
+#include <Preferences.h>
+#include "esp_system.h"
+#include "crc_utils.h"
+#include "flight_recorder.h"
+
+// What survives a reset in NVS. Times since boot mean nothing after one, so
+// uptime and the time in the current phase are stored as zero - they don't
+// make a record differ - and the launch is kept as the time flown since.
+struct PersistedState {
+    uint8_t mode;               // SystemMode
+    uint8_t flightPhase;        // FlightPhase
+    bool emergencyActive;
+    float launchAltitude;
+    uint32_t flownMs;           // Since launch when written, 0 before launch
+    SystemStatistics statistics;
+};
+
+struct PersistedRecord {
+    uint16_t version;
+    uint16_t length;            // sizeof(PersistedState) - a rebuilt struct doesn't match
+    uint16_t crc;               // CRC-16/CCITT of state
+    PersistedState state;
+};
+
+static Preferences statePrefs;
+static PersistedRecord storedRecord;    // As last read or written
+
+static uint16_t persistedCrc(const PersistedState& state) {
+    return crc16Ccitt(reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+}
 
 // ===========================
 // Constructor/Destructor
@@ -14,8 +44,9 @@ SystemState::SystemState() {
     
     modeStartTime = 0;
     phaseStartTime = 0;
+    launchTime = 0;
+    launchAltitude = 0.0f;
     lastUpdate = 0;
-    lastHealthCheck = 0;
 
     // Initialize system data
     currentAltitude = 0.0f;
@@ -26,6 +57,10 @@ SystemState::SystemState() {
     lastKnownPosition[1] = 0.0f;
 
     // Initialize event management
+    for (uint8_t i = 0; i < EVENT_TYPE_COUNT; i++) {
+        eventHandlers[i] = nullptr;
+    }
+    eventsDispatched = 0;
     eventCount = 0;
     eventIndex = 0;
 
@@ -33,8 +68,26 @@ SystemState::SystemState() {
     flightModeEnabled = true;
     autoRecoveryEnabled = true;
     healthCheckInterval = DEFAULT_HEALTH_CHECK_INTERVAL;
+    for (uint8_t i = 0; i < HEALTH_CHECK_COUNT; i++) {
+        memset(&healthChecks[i], 0, sizeof(healthChecks[i]));
+        healthChecks[i].periodMs = healthCheckTable[i].periodMs;
+        healthChecks[i].budgetUs = healthCheckTable[i].budgetUs;
+        healthChecks[i].passed = true;
+    }
+    healthCursor = 0;
+    healthSlackUs = UINT32_MAX;
     emergencyActive = false;
     emergencyReason[0] = '\0';
+
+    // Initialize persistence
+    persistReady = false;
+    persistRequested = false;
+    flightResumed = false;
+    lastCommitTime = 0;
+    lastCommitCrc = 0;
+    persistCommits = 0;
+    
+    publishSnapshot();
 }
 
 SystemState::~SystemState() {
@@ -56,6 +109,10 @@ bool SystemState::begin() {
     initializeStatistics();
 
     // Load saved state
+    persistReady = statePrefs.begin(SYSTEM_STATE_NAMESPACE, false);
+    if (!persistReady && DEBUG_SYSTEM_STATE) {
+        Serial.println("System State: NVS unavailable - state and statistics are not kept");
+    }
     loadState();
     loadStatistics();
 
@@ -63,10 +120,10 @@ bool SystemState::begin() {
     modeStartTime = millis();
     phaseStartTime = millis();
     lastUpdate = millis();
-    lastHealthCheck = millis();
 
-    // Add boot event
-    addEvent(EventType::SYSTEM_BOOT, 1);
+    // Add boot event, with why the last run ended
+    uint8_t bootData[1] = { static_cast<uint8_t>(esp_reset_reason()) };
+    addEvent(EventType::SYSTEM_BOOT, 1, bootData, 1);
 
     if (DEBUG_SYSTEM_STATE) {
         Serial.printf("System State: Initialized in mode %s\n", modeToString(currentMode));
@@ -77,8 +134,11 @@ bool SystemState::begin() {
 
 void SystemState::end() {
     // Save current state
-    saveState();
-    saveStatistics();
+    flushPersistence();
+    if (persistReady) {
+        statePrefs.end();
+        persistReady = false;
+    }
 
     if (DEBUG_SYSTEM_STATE) {
         Serial.println("System State: Shutdown complete");
@@ -98,14 +158,14 @@ bool SystemState::reinitialize() {
 void SystemState::update() {
     uint32_t currentTime = millis();
     
+    // What the other tasks posted since the last pass
+    processEvents();
+    
     // Update system status and health
     updateSystemStatus();
     
-    // Perform health checks at intervals
-    if (currentTime - lastHealthCheck >= healthCheckInterval) {
-        performHealthCheck();
-        lastHealthCheck = currentTime;
-    }
+    // One health check at most, the next one due
+    scheduleHealthChecks();
 
     // Update flight phase detection
     updateFlightPhaseDetection();
@@ -118,6 +178,11 @@ void SystemState::update() {
     // Update statistics
     updateStatistics();
 
+    // Coalesced: a change of mode or phase goes out at once, the counters with the next interval
+    if (persistRequested || currentTime - lastCommitTime >= SYSTEM_STATE_COMMIT_INTERVAL_MS) {
+        flushPersistence();
+    }
+
     lastUpdate = currentTime;
 }
 
@@ -130,18 +195,16 @@ bool SystemState::processEvent(const SystemEvent& event) {
     logEvent(event);
 
     // Process based on event type
-    switch (event.eventType) {
-        case EventType::SYSTEM_BOOT:
-            return processSystemEvent(event);
-        case EventType::MODE_CHANGE:
-            return processModeChangeEvent(event);
-        case EventType::FLIGHT_PHASE_CHANGE:
-            return processFlightPhaseChangeEvent(event);
-        case EventType::ALERT_TRIGGERED:
-            return processAlertEvent(event);
-        default:
-            return processSystemEvent(event);
+    uint8_t index = static_cast<uint8_t>(event.eventType);
+    if (index >= EVENT_TYPE_COUNT) {
+        return processSystemEvent(event);
+    }
+    bool handled = (this->*eventProcessors[index])(event);
+    if (eventHandlers[index]) {
+        eventHandlers[index](event);
     }
+    eventsDispatched++;
+    return handled;
 }
 
 bool SystemState::addEvent(EventType type, uint8_t priority, const uint8_t* data, uint16_t dataLen) {
@@ -149,7 +212,7 @@ bool SystemState::addEvent(EventType type, uint8_t priority, const uint8_t* data
     event.eventType = type;
     event.timestamp = millis();
     event.priority = priority;
-    event.dataLength = (dataLen > 32) ? 32 : dataLen;
+    event.dataLength = (dataLen > EVENT_DATA_SIZE) ? EVENT_DATA_SIZE : dataLen;
     
     if (data && event.dataLength > 0) {
         memcpy(event.data, data, event.dataLength);
@@ -157,7 +220,22 @@ bool SystemState::addEvent(EventType type, uint8_t priority, const uint8_t* data
         memset(event.data, 0, sizeof(event.data));
     }
 
-    return processEvent(event);
+    return eventQueue.push(event);
+}
+
+void SystemState::processEvents() {
+    // Only what was there at the start, so a handler that posts can't keep loop() here
+    SystemEvent event;
+    for (uint32_t i = 0; i < EVENT_QUEUE_DEPTH && eventQueue.pop(event); i++) {
+        processEvent(event);
+    }
+}
+
+void SystemState::setEventHandler(EventType type, SystemEventHandler handler) {
+    uint8_t index = static_cast<uint8_t>(type);
+    if (index < EVENT_TYPE_COUNT) {
+        eventHandlers[index] = handler;
+    }
 }
 
 // ===========================
@@ -176,10 +254,13 @@ bool SystemState::setMode(SystemMode mode) {
     previousMode = currentMode;
     currentMode = mode;
     modeStartTime = millis();
+    publishSnapshot();
 
     // Handle mode transition
     handleModeTransition(previousMode, currentMode);
 
+    saveState();
+
     // Log the change
     uint8_t modeData[2] = { static_cast<uint8_t>(previousMode), static_cast<uint8_t>(currentMode) };
     addEvent(EventType::MODE_CHANGE, 2, modeData, 2);
@@ -229,10 +310,13 @@ bool SystemState::setFlightPhase(FlightPhase phase) {
     previousFlightPhase = currentFlightPhase;
     currentFlightPhase = phase;
     phaseStartTime = millis();
+    publishSnapshot();
 
     // Handle phase transition
     handlePhaseTransition(previousFlightPhase, currentFlightPhase);
 
+    saveState();
+
     // Log the change
     uint8_t phaseData[2] = { static_cast<uint8_t>(previousFlightPhase), static_cast<uint8_t>(currentFlightPhase) };
     addEvent(EventType::FLIGHT_PHASE_CHANGE, 2, phaseData, 2);
@@ -245,6 +329,19 @@ bool SystemState::setFlightPhase(FlightPhase phase) {
     return true;
 }
 
+void SystemState::restoreFlightState(SystemMode mode, FlightPhase phase) {
+    previousMode = currentMode = mode;
+    previousFlightPhase = currentFlightPhase = phase;
+    modeStartTime = millis();
+    phaseStartTime = modeStartTime;
+    publishSnapshot();
+
+    if (DEBUG_SYSTEM_STATE) {
+        Serial.printf("System State: Resumed in %s, %s\n", modeToString(currentMode),
+                      flightPhaseToString(currentFlightPhase));
+    }
+}
+
 const char* SystemState::flightPhaseToString(FlightPhase phase) const {
     switch (phase) {
         case FlightPhase::GROUND: return "Ground";
@@ -267,6 +364,7 @@ bool SystemState::setSystemStatus(SystemStatus status) {
     if (systemStatus != status) {
         SystemStatus oldStatus = systemStatus;
         systemStatus = status;
+        publishSnapshot();
         
         uint8_t statusData[2] = { static_cast<uint8_t>(oldStatus), static_cast<uint8_t>(systemStatus) };
         addEvent(EventType::ALERT_TRIGGERED, 1, statusData, 2);
@@ -295,42 +393,23 @@ const char* SystemState::statusToString(SystemStatus status) const {
 // Subsystem State Management
 // ===========================
 
-bool SystemState::setSubsystemState(const char* subsystem, SubsystemState state) {
-    if (!subsystem) return false;
-
-    if (strcmp(subsystem, "sensor") == 0) {
-        systemHealth.sensorState = state;
-    } else if (strcmp(subsystem, "camera") == 0) {
-        systemHealth.cameraState = state;
-    } else if (strcmp(subsystem, "lora") == 0) {
-        systemHealth.loraState = state;
-    } else if (strcmp(subsystem, "power") == 0) {
-        systemHealth.powerState = state;
-    } else if (strcmp(subsystem, "gps") == 0) {
-        systemHealth.gpsState = state;
-    } else {
+bool SystemState::setSubsystemState(Subsystem subsystem, SubsystemState state) {
+    uint8_t index = static_cast<uint8_t>(subsystem);
+    if (index >= SUBSYSTEM_COUNT) {
         return false;
     }
 
+    systemHealth.subsystems[index] = state;
     return true;
 }
 
-SubsystemState SystemState::getSubsystemState(const char* subsystem) const {
-    if (!subsystem) return SubsystemState::OFF;
-
-    if (strcmp(subsystem, "sensor") == 0) {
-        return systemHealth.sensorState;
-    } else if (strcmp(subsystem, "camera") == 0) {
-        return systemHealth.cameraState;
-    } else if (strcmp(subsystem, "lora") == 0) {
-        return systemHealth.loraState;
-    } else if (strcmp(subsystem, "power") == 0) {
-        return systemHealth.powerState;
-    } else if (strcmp(subsystem, "gps") == 0) {
-        return systemHealth.gpsState;
+uint16_t SystemState::getSubsystemBits() const {
+    uint16_t bits = 0;
+    for (uint8_t i = 0; i < SUBSYSTEM_COUNT; i++) {
+        bits |= (static_cast<uint16_t>(systemHealth.subsystems[i]) & ((1 << SUBSYSTEM_STATE_BITS) - 1))
+                << (i * SUBSYSTEM_STATE_BITS);
     }
-
-    return SubsystemState::OFF;
+    return bits;
 }
 
 const char* SystemState::subsystemStateToString(SubsystemState state) const {
@@ -345,6 +424,17 @@ const char* SystemState::subsystemStateToString(SubsystemState state) const {
     }
 }
 
+const char* SystemState::subsystemToString(Subsystem subsystem) const {
+    switch (subsystem) {
+        case Subsystem::SENSORS: return "Sensors";
+        case Subsystem::CAMERA: return "Camera";
+        case Subsystem::LORA: return "LoRa";
+        case Subsystem::POWER: return "Power";
+        case Subsystem::GPS: return "GPS";
+        default: return "Unknown";
+    }
+}
+
 // ===========================
 // System Health
 // ===========================
@@ -361,37 +451,111 @@ bool SystemState::performHealthCheck() {
     bool overallHealth = true;
 
     // Check all subsystems
-    overallHealth &= checkSensorHealth();
-    overallHealth &= checkCameraHealth();
-    overallHealth &= checkLoRaHealth();
-    overallHealth &= checkPowerHealth();
-    overallHealth &= checkGPSHealth();
-    overallHealth &= checkMemoryHealth();
-    overallHealth &= checkCPUHealth();
+    for (uint8_t i = 0; i < HEALTH_CHECK_COUNT; i++) {
+        overallHealth &= runHealthCheck(i);
+    }
 
     // Update system health
     updateSystemHealth();
-    systemHealth.lastHealthCheck = millis();
 
     return overallHealth;
 }
 
+// Indexed by HealthCheck; the budgets are a little over what each takes
+const SystemState::HealthCheckEntry SystemState::healthCheckTable[HEALTH_CHECK_COUNT] = {
+    {&SystemState::checkSensorHealth,   DEFAULT_HEALTH_CHECK_INTERVAL,      200},   // SENSORS
+    {&SystemState::checkCameraHealth,   DEFAULT_HEALTH_CHECK_INTERVAL * 2,  200},   // CAMERA
+    {&SystemState::checkLoRaHealth,     DEFAULT_HEALTH_CHECK_INTERVAL,      200},   // LORA
+    {&SystemState::checkPowerHealth,    DEFAULT_HEALTH_CHECK_INTERVAL,      200},   // POWER
+    {&SystemState::checkGPSHealth,      DEFAULT_HEALTH_CHECK_INTERVAL * 2,  200},   // GPS
+    {&SystemState::checkMemoryHealth,   DEFAULT_HEALTH_CHECK_INTERVAL,      500},   // MEMORY - takes the heap lock
+    {&SystemState::checkCPUHealth,      DEFAULT_HEALTH_CHECK_INTERVAL * 2,  200},   // CPU
+};
+
+bool SystemState::runHealthCheck(uint8_t index) {
+    HealthCheckStatus& status = healthChecks[index];
+    uint32_t start = micros();
+    status.passed = (this->*healthCheckTable[index].check)();
+    uint32_t elapsed = micros() - start;
+
+    status.lastRun = millis();
+    status.lastUs = elapsed;
+    if (elapsed > status.worstUs) {
+        status.worstUs = elapsed;
+    }
+    status.runs++;
+    if (elapsed > status.budgetUs) {
+        status.overruns++;
+        if (DEBUG_SYSTEM_STATE) {
+            Serial.printf("System State: %s health check took %lu us, budget %lu\n",
+                          healthCheckToString(static_cast<HealthCheck>(index)), elapsed, status.budgetUs);
+        }
+    }
+    systemHealth.lastHealthCheck = status.lastRun;
+    return status.passed;
+}
+
+// From update(): the first check due, looking from the one after the last
+// that ran, so none is starved by another with a shorter period
+void SystemState::scheduleHealthChecks() {
+    if (!HEALTH_CHECKS_ENABLED) {
+        return;
+    }
+
+    uint32_t now = millis();
+    for (uint8_t n = 0; n < HEALTH_CHECK_COUNT; n++) {
+        uint8_t index = (healthCursor + n) % HEALTH_CHECK_COUNT;
+        HealthCheckStatus& status = healthChecks[index];
+        if (status.lastRun != 0 && now - status.lastRun < status.periodMs) {
+            continue;
+        }
+        if (max(status.budgetUs, status.worstUs) > healthSlackUs) {
+            status.deferrals++;
+            continue;
+        }
+
+        runHealthCheck(index);
+        updateSystemHealth();
+        healthCursor = (index + 1) % HEALTH_CHECK_COUNT;
+        return;
+    }
+}
+
+void SystemState::setHealthCheckPeriod(HealthCheck check, uint32_t periodMs) {
+    if (static_cast<uint8_t>(check) < HEALTH_CHECK_COUNT) {
+        healthChecks[static_cast<uint8_t>(check)].periodMs = periodMs;
+    }
+}
+
+void SystemState::setHealthCheckInterval(uint32_t intervalMs) {
+    healthCheckInterval = intervalMs;
+    for (uint8_t i = 0; i < HEALTH_CHECK_COUNT; i++) {
+        healthChecks[i].periodMs = intervalMs;
+    }
+}
+
+const char* SystemState::healthCheckToString(HealthCheck check) const {
+    switch (check) {
+        case HealthCheck::SENSORS: return "Sensors";
+        case HealthCheck::CAMERA: return "Camera";
+        case HealthCheck::LORA: return "LoRa";
+        case HealthCheck::POWER: return "Power";
+        case HealthCheck::GPS: return "GPS";
+        case HealthCheck::MEMORY: return "Memory";
+        case HealthCheck::CPU: return "CPU";
+        default: return "Unknown";
+    }
+}
+
 void SystemState::updateSystemHealth() {
     // Calculate overall system status based on subsystems
     uint8_t errorStates = 0;
     uint8_t activeStates = 0;
 
-    if (systemHealth.sensorState == SubsystemState::ERROR) errorStates++;
-    if (systemHealth.cameraState == SubsystemState::ERROR) errorStates++;
-    if (systemHealth.loraState == SubsystemState::ERROR) errorStates++;
-    if (systemHealth.powerState == SubsystemState::ERROR) errorStates++;
-    if (systemHealth.gpsState == SubsystemState::ERROR) errorStates++;
-
-    if (systemHealth.sensorState == SubsystemState::ACTIVE) activeStates++;
-    if (systemHealth.cameraState == SubsystemState::ACTIVE) activeStates++;
-    if (systemHealth.loraState == SubsystemState::ACTIVE) activeStates++;
-    if (systemHealth.powerState == SubsystemState::ACTIVE) activeStates++;
-    if (systemHealth.gpsState == SubsystemState::ACTIVE) activeStates++;
+    for (uint8_t i = 0; i < SUBSYSTEM_COUNT; i++) {
+        if (systemHealth.subsystems[i] == SubsystemState::ERROR) errorStates++;
+        if (systemHealth.subsystems[i] == SubsystemState::ACTIVE) activeStates++;
+    }
 
     // Determine overall status
     if (errorStates > 2) {
@@ -442,6 +606,55 @@ void SystemState::updateStatistics() {
     }
 }
 
+void SystemState::addStatisticsSample(float altitude, float verticalSpeed, float temperature) {
+    streamSummaryAdd(statistics.altitudeSummary, altitude);
+    streamSummaryAdd(statistics.climbSummary, verticalSpeed);
+    if (!isnan(temperature)) {
+        streamSummaryAdd(statistics.temperatureSummary, temperature);
+    }
+}
+
+size_t SystemState::formatStatisticsReport(char* text, size_t size) const {
+    const struct {
+        const char* label;
+        const StreamSummary& summary;
+        int decimals;
+    } entries[] = {
+        {"A", statistics.altitudeSummary, 0},
+        {"V", statistics.climbSummary, 1},
+        {"T", statistics.temperatureSummary, 1}
+    };
+    if (size == 0) {
+        return 0;
+    }
+
+    int length = snprintf(text, size, "Stat n%lu", (unsigned long)statistics.altitudeSummary.moments.count);
+    if (length < 0 || (size_t)length >= size) {
+        text[0] = '\0';
+        return 0;
+    }
+
+    // " A m8123 s4012 120/8000/24000" - mean, deviation, then the 5th, 50th and 95th percentiles
+    for (const auto& entry : entries) {
+        const StreamSummary& summary = entry.summary;
+        if (summary.moments.count == 0) {
+            continue;
+        }
+        int d = entry.decimals;
+        char part[64];
+        int partLength = snprintf(part, sizeof(part), " %s m%.*f s%.*f %.*f/%.*f/%.*f", entry.label, d,
+                                  (float)summary.moments.mean, d, sqrtf(runningStatsVariance(summary.moments)), d,
+                                  tdigestQuantile(summary.digest, 0.05f), d, tdigestQuantile(summary.digest, 0.5f), d,
+                                  tdigestQuantile(summary.digest, 0.95f));
+        if (partLength <= 0 || partLength >= (int)sizeof(part) || (size_t)(length + partLength) >= size) {
+            break;
+        }
+        memcpy(&text[length], part, partLength + 1);
+        length += partLength;
+    }
+    return length;
+}
+
 void SystemState::printStatistics() const {
     if (!SYSTEM_STATS_ENABLED) {
         return;
@@ -464,6 +677,22 @@ void SystemState::printStatistics() const {
     Serial.printf("Battery Cycles: %.1f\n", statistics.batteryCycles);
     Serial.printf("Images Captured: %lu\n", statistics.imagesCaptured);
     Serial.printf("Data Points Collected: %lu\n", statistics.dataPointsCollected);
+    const struct {
+        const char* name;
+        const StreamSummary& summary;
+    } summaries[] = {
+        {"Altitude", statistics.altitudeSummary},
+        {"Climb", statistics.climbSummary},
+        {"Temperature", statistics.temperatureSummary}
+    };
+    for (const auto& entry : summaries) {
+        const StreamSummary& summary = entry.summary;
+        Serial.printf("%s: %lu samples, mean %.2f, sd %.2f, p5 %.2f, p50 %.2f, p95 %.2f\n", entry.name,
+                      (unsigned long)summary.moments.count, (float)summary.moments.mean,
+                      sqrtf(runningStatsVariance(summary.moments)), tdigestQuantile(summary.digest, 0.05f),
+                      tdigestQuantile(summary.digest, 0.5f), tdigestQuantile(summary.digest, 0.95f));
+    }
+    Serial.printf("NVS Commits: %lu%s\n", (unsigned long)persistCommits, persistReady ? "" : " (NVS unavailable)");
 }
 
 // ===========================
@@ -495,6 +724,7 @@ bool SystemState::triggerEmergency(const char* reason) {
     }
 
     emergencyActive = true;
+    publishSnapshot();
     strncpy(emergencyReason, reason, sizeof(emergencyReason) - 1);
     emergencyReason[sizeof(emergencyReason) - 1] = '\0';
 
@@ -518,6 +748,7 @@ bool SystemState::clearEmergency() {
     }
 
     emergencyActive = false;
+    publishSnapshot();
     clearEmergencyReason();
 
     // Attempt to return to previous mode or safe default
@@ -534,6 +765,22 @@ bool SystemState::clearEmergency() {
     return true;
 }
 
+// ===========================
+// Snapshot
+// ===========================
+
+void SystemState::setFlightData(float altitude, float velocity, float temperature) {
+    currentAltitude = altitude;
+    currentVelocity = velocity;
+    currentTemperature = temperature;
+    publishSnapshot();
+}
+
+void SystemState::publishSnapshot() {
+    snapshot.publish({currentMode, currentFlightPhase, systemStatus, emergencyActive, modeStartTime, phaseStartTime,
+                      currentAltitude, currentVelocity, currentTemperature});
+}
+
 // ===========================
 // Diagnostics
 // ===========================
@@ -547,6 +794,9 @@ void SystemState::printSystemState() const {
     Serial.printf("Time in Phase: %lu ms\n", getTimeInPhase());
     Serial.printf("Altitude: %.2f m\n", currentAltitude);
     Serial.printf("Velocity: %.2f m/s\n", currentVelocity);
+    Serial.printf("Phase Window: %.2f m/s mean, %.2f sigma, %.0f m above ground, %lu bursts\n",
+                  phaseDetector.getMeanVerticalSpeed(), phaseDetector.getVerticalSpeedSigma(),
+                  phaseDetector.getHeight(), phaseDetector.getBurstsDetected());
     Serial.printf("Temperature: %.2f°C\n", currentTemperature);
     
     if (emergencyActive) {
@@ -561,6 +811,9 @@ void SystemState::printEventLog() const {
     }
 
     Serial.printf("=== Event Log (%u events) ===\n", eventCount);
+    Serial.printf("Queue: %lu pending of %lu, %lu dispatched, %lu dropped\n", (unsigned long)eventQueue.size(),
+                  (unsigned long)eventQueue.capacity(), (unsigned long)eventsDispatched,
+                  (unsigned long)eventQueue.getDropped());
     
     for (uint8_t i = 0; i < eventCount && i < 20; i++) {  // Limit to last 20 events
         const SystemEvent& event = eventLog[i];
@@ -572,17 +825,23 @@ void SystemState::printEventLog() const {
 void SystemState::printHealthStatus() const {
     Serial.println("=== System Health ===");
     Serial.printf("Overall Status: %s\n", statusToString(systemHealth.overallStatus));
-    Serial.printf("Sensors: %s\n", subsystemStateToString(systemHealth.sensorState));
-    Serial.printf("Camera: %s\n", subsystemStateToString(systemHealth.cameraState));
-    Serial.printf("LoRa: %s\n", subsystemStateToString(systemHealth.loraState));
-    Serial.printf("Power: %s\n", subsystemStateToString(systemHealth.powerState));
-    Serial.printf("GPS: %s\n", subsystemStateToString(systemHealth.gpsState));
+    for (uint8_t i = 0; i < SUBSYSTEM_COUNT; i++) {
+        Serial.printf("%s: %s\n", subsystemToString(static_cast<Subsystem>(i)),
+                      subsystemStateToString(systemHealth.subsystems[i]));
+    }
     Serial.printf("Error Count: %u\n", systemHealth.errorCount);
     Serial.printf("Warning Count: %u\n", systemHealth.warningCount);
     Serial.printf("Critical Count: %u\n", systemHealth.criticalCount);
     Serial.printf("CPU Temperature: %.1f°C\n", systemHealth.cpuTemperature);
     Serial.printf("Memory Usage: %u%%\n", systemHealth.memoryUsage);
     Serial.printf("Battery Health: %.1f%%\n", systemHealth.batteryHealth);
+    for (uint8_t i = 0; i < HEALTH_CHECK_COUNT; i++) {
+        const HealthCheckStatus& status = healthChecks[i];
+        Serial.printf("Check %s: %s, every %lu ms, last %lu us (worst %lu, budget %lu), %lu runs, %lu over, %lu deferred\n",
+                      healthCheckToString(static_cast<HealthCheck>(i)), status.passed ? "pass" : "FAIL",
+                      status.periodMs, status.lastUs, status.worstUs, status.budgetUs, status.runs,
+                      status.overruns, status.deferrals);
+    }
 }
 
 bool SystemState::runDiagnostics() {
@@ -615,11 +874,9 @@ void SystemState::initializeEventLog() {
 void SystemState::initializeHealth() {
     memset(&systemHealth, 0, sizeof(systemHealth));
     systemHealth.overallStatus = SystemStatus::NOMINAL;
-    systemHealth.sensorState = SubsystemState::OFF;
-    systemHealth.cameraState = SubsystemState::OFF;
-    systemHealth.loraState = SubsystemState::OFF;
-    systemHealth.powerState = SubsystemState::OFF;
-    systemHealth.gpsState = SubsystemState::OFF;
+    for (uint8_t i = 0; i < SUBSYSTEM_COUNT; i++) {
+        systemHealth.subsystems[i] = SubsystemState::OFF;
+    }
     systemHealth.batteryHealth = 100.0f;
 }
 
@@ -631,11 +888,44 @@ void SystemState::initializeStatistics() {
 // Private Methods - Event Processing
 // ===========================
 
+// Indexed by EventType; types without their own go to processSystemEvent
+const SystemState::EventProcessor SystemState::eventProcessors[EVENT_TYPE_COUNT] = {
+    &SystemState::processSystemEvent,               // 0x00, unused
+    &SystemState::processSystemEvent,               // SYSTEM_BOOT
+    &SystemState::processModeChangeEvent,           // MODE_CHANGE
+    &SystemState::processFlightPhaseChangeEvent,    // FLIGHT_PHASE_CHANGE
+    &SystemState::processAlertEvent,                // ALERT_TRIGGERED
+    &SystemState::processSystemEvent,               // SENSOR_DATA_READY
+    &SystemState::processSystemEvent,               // COMMUNICATION_EVENT
+    &SystemState::processSystemEvent,               // POWER_EVENT
+    &SystemState::processSystemEvent,               // CAMERA_EVENT
+    &SystemState::processSystemEvent,               // GPS_EVENT
+    &SystemState::processSystemEvent,               // USER_COMMAND
+    &SystemState::processSystemEvent,               // ERROR_OCCURRED
+    &SystemState::processSystemEvent,               // RECOVERY_ACTION
+    &SystemState::processAlertEvent,                // GEOFENCE
+};
+
 bool SystemState::processSystemEvent(const SystemEvent& event) {
     // Handle generic system events
     switch (event.eventType) {
         case EventType::SYSTEM_BOOT:
-            statistics.bootCount++;
+            // A deep sleep wake is the same run carrying on; a crash or brownout is a reset
+            switch (static_cast<esp_reset_reason_t>(event.data[0])) {
+                case ESP_RST_DEEPSLEEP:
+                    break;
+                case ESP_RST_PANIC:
+                case ESP_RST_INT_WDT:
+                case ESP_RST_TASK_WDT:
+                case ESP_RST_WDT:
+                case ESP_RST_BROWNOUT:
+                    statistics.resetsCount++;
+                    statistics.bootCount++;
+                    break;
+                default:
+                    statistics.bootCount++;
+                    break;
+            }
             break;
         case EventType::ERROR_OCCURRED:
             statistics.errorsCount++;
@@ -683,31 +973,31 @@ bool SystemState::processAlertEvent(const SystemEvent& event) {
 
 bool SystemState::checkSensorHealth() {
     // Placeholder - would interface with SensorMgr
-    systemHealth.sensorState = SubsystemState::ACTIVE;
+    setSubsystemState(Subsystem::SENSORS, SubsystemState::ACTIVE);
     return true;
 }
 
 bool SystemState::checkCameraHealth() {
     // Placeholder - would interface with CameraMgr
-    systemHealth.cameraState = SubsystemState::STANDBY;
+    setSubsystemState(Subsystem::CAMERA, SubsystemState::STANDBY);
     return true;
 }
 
 bool SystemState::checkLoRaHealth() {
     // Placeholder - would interface with LoRaComm
-    systemHealth.loraState = SubsystemState::ACTIVE;
+    setSubsystemState(Subsystem::LORA, SubsystemState::ACTIVE);
     return true;
 }
 
 bool SystemState::checkPowerHealth() {
     // Placeholder - would interface with PowerMgr
-    systemHealth.powerState = SubsystemState::ACTIVE;
+    setSubsystemState(Subsystem::POWER, SubsystemState::ACTIVE);
     return true;
 }
 
 bool SystemState::checkGPSHealth() {
     // Placeholder - would check GPS data
-    systemHealth.gpsState = SubsystemState::STANDBY;
+    setSubsystemState(Subsystem::GPS, SubsystemState::STANDBY);
     return true;
 }
 
@@ -809,37 +1099,10 @@ void SystemState::updateFlightPhaseDetection() {
         return;
     }
 
-    // Simple flight phase detection based on altitude and velocity
-    // This would be more sophisticated in a real implementation
-    
-    if (currentFlightPhase == FlightPhase::GROUND) {
-        if (currentVelocity > 5.0f && currentAltitude > 10.0f) {
-            setFlightPhase(FlightPhase::LAUNCH);
-        }
-    } else if (currentFlightPhase == FlightPhase::LAUNCH) {
-        if (currentAltitude > 100.0f && currentVelocity > 10.0f) {
-            setFlightPhase(FlightPhase::POWERED_ASCENT);
-        }
-    } else if (currentFlightPhase == FlightPhase::POWERED_ASCENT) {
-        if (currentVelocity < 1.0f && currentAltitude > 1000.0f) {
-            setFlightPhase(FlightPhase::BALLOON_ASCENT);
-        }
-    } else if (currentFlightPhase == FlightPhase::BALLOON_ASCENT) {
-        if (currentVelocity < -2.0f) {  // Descending
-            setFlightPhase(FlightPhase::APEX);
-        }
-    } else if (currentFlightPhase == FlightPhase::APEX) {
-        if (currentVelocity < -5.0f) {
-            setFlightPhase(FlightPhase::PARACHUTE_DESCENT);
-        }
-    } else if (currentFlightPhase == FlightPhase::PARACHUTE_DESCENT) {
-        if (currentAltitude < 100.0f && abs(currentVelocity) < 2.0f) {
-            setFlightPhase(FlightPhase::LANDING);
-        }
-    } else if (currentFlightPhase == FlightPhase::LANDING) {
-        if (abs(currentVelocity) < 0.5f && currentAltitude < 10.0f) {
-            setFlightPhase(FlightPhase::RECOVERY);
-        }
+    // Once per new altitude estimate, on the window and its dwell rather than the last sample
+    FlightPhase next;
+    if (phaseDetector.evaluate(currentFlightPhase, next)) {
+        setFlightPhase(next);
     }
 }
 
@@ -859,6 +1122,9 @@ void SystemState::logEvent(const SystemEvent& event) {
     if (eventCount < MAX_EVENTS) {
         eventCount++;
     }
+
+    // And on flash, where it outlasts the RAM log and a reset
+    FlightRec().recordEvent(event);
 }
 
 const char* SystemState::eventTypeToString(EventType type) const {
@@ -875,6 +1141,7 @@ const char* SystemState::eventTypeToString(EventType type) const {
         case EventType::USER_COMMAND: return "User Command";
         case EventType::ERROR_OCCURRED: return "Error Occurred";
         case EventType::RECOVERY_ACTION: return "Recovery Action";
+        case EventType::GEOFENCE: return "Geofence";
         default: return "Unknown";
     }
 }
@@ -947,10 +1214,13 @@ bool SystemState::validatePhaseTransition(FlightPhase from, FlightPhase to) cons
     
     // Normal flight progression
     switch (from) {
+        case FlightPhase::GROUND:
+            return true;
         case FlightPhase::LAUNCH:
             return (to == FlightPhase::POWERED_ASCENT);
         case FlightPhase::POWERED_ASCENT:
-            return (to == FlightPhase::BALLOON_ASCENT || to == FlightPhase::GROUND);
+            // APEX on a burst before the ascent has settled
+            return (to == FlightPhase::BALLOON_ASCENT || to == FlightPhase::APEX || to == FlightPhase::GROUND);
         case FlightPhase::BALLOON_ASCENT:
             return (to == FlightPhase::APEX || to == FlightPhase::GROUND);
         case FlightPhase::APEX:
@@ -999,7 +1269,9 @@ void SystemState::handlePhaseTransition(FlightPhase oldPhase, FlightPhase newPha
     // Handle phase-specific transitions
     switch (newPhase) {
         case FlightPhase::LAUNCH:
-            // Launch detected - record time
+            // Launch detected - record time and where from
+            launchTime = millis();
+            launchAltitude = phaseDetector.isGroundSet() ? phaseDetector.getGroundAltitude() : currentAltitude;
             break;
         case FlightPhase::APEX:
             // Apex reached - record max altitude
@@ -1019,27 +1291,117 @@ void SystemState::handlePhaseTransition(FlightPhase oldPhase, FlightPhase newPha
 }
 
 // ===========================
-// Private Methods - Persistence (Simplified)
+// Private Methods - Persistence
 // ===========================
 
 bool SystemState::saveState() {
-    // Placeholder for NVS save functionality
-    // In a real implementation, this would save to ESP32's NVS
-    return true;
+    persistRequested = true;
+    return persistReady;
 }
 
 bool SystemState::loadState() {
-    // Placeholder for NVS load functionality
-    // In a real implementation, this would load from ESP32's NVS
+    if (!loadFromNVS()) {
+        return false;
+    }
+
+    // Mid-flight state only after a reset the flight carried on through - not
+    // a power-up on the bench, and not a deep sleep wake, where the RTC copy
+    // is newer and setup() restores it
+    esp_reset_reason_t reason = esp_reset_reason();
+    const PersistedState& saved = storedRecord.state;
+    FlightPhase phase = static_cast<FlightPhase>(saved.flightPhase);
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_DEEPSLEEP || phase == FlightPhase::GROUND) {
+        return true;
+    }
+
+    restoreFlightState(static_cast<SystemMode>(saved.mode), phase);
+    launchAltitude = saved.launchAltitude;
+    phaseDetector.setGroundAltitude(launchAltitude);
+    launchTime = saved.flownMs ? millis() - saved.flownMs : 0;
+    if (saved.emergencyActive) {
+        // The mode came back as it was; the protocol runs again on its own conditions
+        emergencyActive = true;
+        strncpy(emergencyReason, "Active before reset", sizeof(emergencyReason) - 1);
+        publishSnapshot();
+    }
+    flightResumed = true;
     return true;
 }
 
 bool SystemState::saveStatistics() {
-    // Placeholder for statistics save
-    return true;
+    persistRequested = true;
+    return persistReady;
 }
 
 bool SystemState::loadStatistics() {
-    // Placeholder for statistics load
+    if (!loadFromNVS()) {
+        // The boot event counts this one
+        statistics.bootCount = 0;
+        return false;
+    }
+
+    statistics = storedRecord.state.statistics;
+    return true;
+}
+
+bool SystemState::flushPersistence() {
+    persistRequested = false;
+    lastCommitTime = millis();
+    return saveToNVS();
+}
+
+bool SystemState::saveToNVS() {
+    if (!persistReady) {
+        return false;
+    }
+
+    PersistedRecord record;
+    memset(&record, 0, sizeof(record));
+    record.version = SYSTEM_STATE_VERSION;
+    record.length = sizeof(PersistedState);
+    record.state.mode = static_cast<uint8_t>(currentMode);
+    record.state.flightPhase = static_cast<uint8_t>(currentFlightPhase);
+    record.state.emergencyActive = emergencyActive;
+    record.state.launchAltitude = launchAltitude;
+    record.state.flownMs = launchTime ? millis() - launchTime : 0;
+    record.state.statistics = statistics;
+    record.state.statistics.uptime = 0;
+    record.state.statistics.currentFlightTime = 0;
+    record.crc = persistedCrc(record.state);
+
+    // Unchanged since the last commit - nothing to wear the flash with
+    if (record.crc == lastCommitCrc) {
+        return true;
+    }
+
+    if (statePrefs.putBytes(KEY_STATE_RECORD, &record, sizeof(record)) != sizeof(record)) {
+        if (DEBUG_SYSTEM_STATE) {
+            Serial.println("System State: NVS commit failed");
+        }
+        return false;
+    }
+    storedRecord = record;
+    lastCommitCrc = record.crc;
+    persistCommits++;
+    return true;
+}
+
+bool SystemState::loadFromNVS() {
+    if (!persistReady || statePrefs.getBytesLength(KEY_STATE_RECORD) != sizeof(PersistedRecord)) {
+        return false;
+    }
+
+    PersistedRecord record;
+    if (statePrefs.getBytes(KEY_STATE_RECORD, &record, sizeof(record)) != sizeof(record) ||
+        record.version != SYSTEM_STATE_VERSION || record.length != sizeof(PersistedState) ||
+        record.crc != persistedCrc(record.state)) {
+        if (DEBUG_SYSTEM_STATE) {
+            Serial.println("System State: Saved record invalid - starting fresh");
+        }
+        return false;
+    }
+
+    storedRecord = record;
+    lastCommitCrc = record.crc;
     return true;
 }
@@ -4,6 +4,10 @@
 #include <Arduino.h>
 #include <cstdint>
 #include "balloon_config.h"
+#include "snapshot.h"
+#include "event_ring.h"
+#include "phase_detector.h"
+#include "running_stats.h"
 
 // ===========================
 // System State Module
@@ -56,6 +60,46 @@ enum class SubsystemState : uint8_t {
     MAINTENANCE = 0x05
 };
 
+// Subsystems SystemState tracks a state for - an index, so a lookup is one load
+enum class Subsystem : uint8_t {
+    SENSORS = 0,
+    CAMERA,
+    LORA,
+    POWER,
+    GPS,
+    COUNT
+};
+
+#define SUBSYSTEM_COUNT       static_cast<uint8_t>(Subsystem::COUNT)
+#define SUBSYSTEM_STATE_BITS  3     // Per subsystem in getSubsystemBits(), SubsystemState fits
+
+// Health checks - update() runs at most one per pass, the next one due
+// after the last that ran, so a pass never pays for more than one
+enum class HealthCheck : uint8_t {
+    SENSORS = 0,
+    CAMERA,
+    LORA,
+    POWER,
+    GPS,
+    MEMORY,
+    CPU,
+    COUNT
+};
+
+#define HEALTH_CHECK_COUNT    static_cast<uint8_t>(HealthCheck::COUNT)
+
+struct HealthCheckStatus {
+    uint32_t periodMs;          // Least time between runs
+    uint32_t budgetUs;          // Expected cost; a longer run is an overrun
+    uint32_t lastRun;           // millis(), 0 = not yet
+    uint32_t lastUs;            // Duration of the last run
+    uint32_t worstUs;
+    uint32_t runs;
+    uint32_t overruns;          // Runs over budgetUs
+    uint32_t deferrals;         // Due, but held back for want of slack
+    bool passed;                // Result of the last run
+};
+
 // Event Types
 enum class EventType : uint8_t {
     SYSTEM_BOOT = 0x01,
@@ -69,18 +113,26 @@ enum class EventType : uint8_t {
     GPS_EVENT = 0x09,
     USER_COMMAND = 0x0A,
     ERROR_OCCURRED = 0x0B,
-    RECOVERY_ACTION = 0x0C
+    RECOVERY_ACTION = 0x0C,
+    GEOFENCE = 0x0D             // GeofenceEventData (geofence.h)
 };
 
+#define EVENT_TYPE_COUNT     0x0E    // One past the highest EventType - the handler tables' size
+#define EVENT_QUEUE_DEPTH    32      // Posted and not yet dispatched, a power of two
+#define EVENT_DATA_SIZE      32
+
 // Event Data Structure
 struct SystemEvent {
     EventType eventType;
     uint32_t timestamp;
     uint8_t priority;
     uint16_t dataLength;
-    uint8_t data[32];  // Variable event data
+    uint8_t data[EVENT_DATA_SIZE];  // Variable event data
 };
 
+// Called by update() on loop() after SystemState's own handling of the type
+typedef void (*SystemEventHandler)(const SystemEvent& event);
+
 // System Statistics
 struct SystemStatistics {
     uint32_t uptime;
@@ -99,16 +151,16 @@ struct SystemStatistics {
     float batteryCycles;
     uint32_t imagesCaptured;
     uint32_t dataPointsCollected;
+    // Every altitude estimate of the flight, and the temperature with it; kept across resets
+    StreamSummary altitudeSummary;      // m
+    StreamSummary climbSummary;         // m/s
+    StreamSummary temperatureSummary;   // °C
 };
 
 // System Health Structure
 struct SystemHealth {
     SystemStatus overallStatus;
-    SubsystemState sensorState;
-    SubsystemState cameraState;
-    SubsystemState loraState;
-    SubsystemState powerState;
-    SubsystemState gpsState;
+    SubsystemState subsystems[SUBSYSTEM_COUNT];     // Indexed by Subsystem
     uint8_t errorCount;
     uint8_t warningCount;
     uint8_t criticalCount;
@@ -118,6 +170,20 @@ struct SystemHealth {
     float batteryHealth;
 };
 
+// Mode, phase and flight data as one consistent copy, for tasks other than
+// loop() - republished by every setter that changes a field of it
+struct SystemSnapshot {
+    SystemMode mode;
+    FlightPhase flightPhase;
+    SystemStatus status;
+    bool emergencyActive;
+    uint32_t modeStartTime;
+    uint32_t phaseStartTime;
+    float altitude;
+    float velocity;
+    float temperature;
+};
+
 // ===========================
 // System State Class
 // ===========================
@@ -136,7 +202,17 @@ public:
     // Main Operations
     void update();
     bool processEvent(const SystemEvent& event);
+    
+    // Events - posted from any task, core or ISR without blocking, and
+    // dispatched on loop() by update(): SystemState's handler for the type,
+    // then the one registered for it, each found by indexing on the type.
+    // false when the queue is full; the event is counted as dropped
     bool addEvent(EventType type, uint8_t priority = 0, const uint8_t* data = nullptr, uint16_t dataLen = 0);
+    void processEvents();
+    void setEventHandler(EventType type, SystemEventHandler handler);
+    uint32_t getEventsPending() const { return eventQueue.size(); }
+    uint32_t getEventsDropped() const { return eventQueue.getDropped(); }
+    uint32_t getEventsDispatched() const { return eventsDispatched; }
 
     // Mode Management
     bool setMode(SystemMode mode);
@@ -149,37 +225,66 @@ public:
     FlightPhase getFlightPhase() const { return currentFlightPhase; }
     const char* flightPhaseToString(FlightPhase phase) const;
 
+    // Back where a deep sleep left off - a resume, not transitions to validate
+    void restoreFlightState(SystemMode mode, FlightPhase phase);
+
     // Status Management
     bool setSystemStatus(SystemStatus status);
     SystemStatus getSystemStatus() const { return systemStatus; }
     const char* statusToString(SystemStatus status) const;
 
     // Subsystem State Management
-    bool setSubsystemState(const char* subsystem, SubsystemState state);
-    SubsystemState getSubsystemState(const char* subsystem) const;
+    bool setSubsystemState(Subsystem subsystem, SubsystemState state);
+    SubsystemState getSubsystemState(Subsystem subsystem) const {
+        return static_cast<uint8_t>(subsystem) < SUBSYSTEM_COUNT ? systemHealth.subsystems[static_cast<uint8_t>(subsystem)]
+                                                                 : SubsystemState::OFF;
+    }
+    uint16_t getSubsystemBits() const;  // SUBSYSTEM_STATE_BITS per subsystem, SENSORS lowest
     const char* subsystemStateToString(SubsystemState state) const;
+    const char* subsystemToString(Subsystem subsystem) const;
 
     // System Health
     SystemHealth getSystemHealth() const;
-    bool performHealthCheck();
+    bool performHealthCheck();      // Every check now, for diagnostics
     void updateSystemHealth();
 
+    // The round-robin scheduler behind update(): a due check only runs
+    // when what it may cost - its budget or its worst so far - fits the
+    // slack loop() gives it, e.g. the time to the next telemetry frame
+    void setHealthCheckSlack(uint32_t slackUs) { healthSlackUs = slackUs; }
+    void setHealthCheckPeriod(HealthCheck check, uint32_t periodMs);
+    const HealthCheckStatus& getHealthCheckStatus(HealthCheck check) const {
+        return healthChecks[static_cast<uint8_t>(check) < HEALTH_CHECK_COUNT ? static_cast<uint8_t>(check) : 0];
+    }
+    const char* healthCheckToString(HealthCheck check) const;
+
     // Statistics
     SystemStatistics getStatistics() const;
     void resetStatistics();
     void updateStatistics();
     void printStatistics() const;
+    // Each new altitude estimate; temperature NAN without a baro reading
+    void addStatisticsSample(float altitude, float verticalSpeed, float temperature);
+    // "Stat n12345 A m8123 s4012 120/8000/24000 ..." - mean, deviation and 5/50/95th
+    // percentiles for the STATUS packet, whole entries that fit; the length
+    size_t formatStatisticsReport(char* text, size_t size) const;
 
     // Event Management
     SystemEvent* getRecentEvents(uint8_t& count);
     void clearEventLog();
     bool hasEvents() const;
 
-    // Persistence
+    // Persistence - one versioned, CRC-checked NVS record of the flight state
+    // and statistics. save*() ask for a commit at the next update(); update()
+    // commits at most every SYSTEM_STATE_COMMIT_INTERVAL_MS, or at once after
+    // a mode or phase change, and never when the record hasn't changed
     bool saveState();
     bool loadState();
     bool saveStatistics();
     bool loadStatistics();
+    bool flushPersistence();        // Commit now if changed; before a reset or sleep
+    bool isFlightResumed() const { return flightResumed; }     // Mode and phase came back from NVS
+    uint32_t getPersistCommits() const { return persistCommits; }
 
     // Diagnostics
     void printSystemState() const;
@@ -192,7 +297,7 @@ public:
     bool isFlightModeEnabled() const { return flightModeEnabled; }
     void setAutoRecoveryEnabled(bool enabled) { autoRecoveryEnabled = enabled; }
     bool isAutoRecoveryEnabled() const { return autoRecoveryEnabled; }
-    void setHealthCheckInterval(uint32_t intervalMs) { healthCheckInterval = intervalMs; }
+    void setHealthCheckInterval(uint32_t intervalMs);      // Every check's period
     uint32_t getHealthCheckInterval() const { return healthCheckInterval; }
 
     // Safety and Emergency
@@ -208,14 +313,24 @@ public:
     uint32_t getPhaseStartTime() const { return phaseStartTime; }
     uint32_t getTimeInMode() const { return millis() - modeStartTime; }
     uint32_t getTimeInPhase() const { return millis() - phaseStartTime; }
+    uint32_t getLaunchTime() const { return launchTime; }          // millis(), 0 before launch
+    float getLaunchAltitude() const { return launchAltitude; }
 
     // Data Access
+    SystemSnapshot getSnapshot() const { return snapshot.read(); }
     float getCurrentAltitude() const { return currentAltitude; }
     float getCurrentVelocity() const { return currentVelocity; }
     float getCurrentTemperature() const { return currentTemperature; }
-    void setCurrentAltitude(float altitude) { currentAltitude = altitude; }
-    void setCurrentVelocity(float velocity) { currentVelocity = velocity; }
-    void setCurrentTemperature(float temperature) { currentTemperature = temperature; }
+    void setCurrentAltitude(float altitude) { currentAltitude = altitude; publishSnapshot(); }
+    void setCurrentVelocity(float velocity) { currentVelocity = velocity; publishSnapshot(); }
+    void setCurrentTemperature(float temperature) { currentTemperature = temperature; publishSnapshot(); }
+    void setFlightData(float altitude, float velocity, float temperature);     // One publish for all three
+
+    // Each new altitude estimate, for phase detection; pressure 0 = none
+    void addFlightSample(uint32_t time, float altitude, float verticalSpeed, float pressure) {
+        phaseDetector.addSample(time, altitude, verticalSpeed, pressure);
+    }
+    const PhaseDetector& getPhaseDetector() const { return phaseDetector; }
 
 private:
     // Internal State
@@ -226,8 +341,9 @@ private:
     SystemStatus systemStatus;
     uint32_t modeStartTime;
     uint32_t phaseStartTime;
+    uint32_t launchTime;
+    float launchAltitude;
     uint32_t lastUpdate;
-    uint32_t lastHealthCheck;
 
     // System Data
     float currentAltitude;
@@ -235,8 +351,12 @@ private:
     float currentTemperature;
     float pressureReference;
     float lastKnownPosition[2];  // lat, lon
+    PhaseDetector phaseDetector;
 
-    // Event Management
+    // Event Management - the queue is shared, the rest loop() only
+    EventRing<SystemEvent, EVENT_QUEUE_DEPTH> eventQueue;
+    SystemEventHandler eventHandlers[EVENT_TYPE_COUNT];
+    uint32_t eventsDispatched;
     SystemEvent eventLog[50];
     uint8_t eventCount;
     uint8_t eventIndex;
@@ -244,6 +364,9 @@ private:
     // System Health
     SystemHealth systemHealth;
     SystemStatistics statistics;
+    HealthCheckStatus healthChecks[HEALTH_CHECK_COUNT];
+    uint8_t healthCursor;           // Where the round-robin looks first
+    uint32_t healthSlackUs;
 
     // Configuration
     bool flightModeEnabled;
@@ -251,23 +374,44 @@ private:
     uint32_t healthCheckInterval;
     bool emergencyActive;
     char emergencyReason[64];
+    Snapshot<SystemSnapshot> snapshot;
+
+    // Persistence
+    bool persistReady;
+    bool persistRequested;
+    bool flightResumed;
+    uint32_t lastCommitTime;
+    uint16_t lastCommitCrc;
+    uint32_t persistCommits;
 
     // Internal Methods
     void initializeEventLog();
     void initializeHealth();
     void initializeStatistics();
+    void publishSnapshot();
     
     // Mode Transition Handlers
     void handleModeTransition(SystemMode oldMode, SystemMode newMode);
     void handlePhaseTransition(FlightPhase oldPhase, FlightPhase newPhase);
     
     // Event Processing
+    typedef bool (SystemState::*EventProcessor)(const SystemEvent& event);
+    static const EventProcessor eventProcessors[EVENT_TYPE_COUNT];
     bool processSystemEvent(const SystemEvent& event);
     bool processModeChangeEvent(const SystemEvent& event);
     bool processFlightPhaseChangeEvent(const SystemEvent& event);
     bool processAlertEvent(const SystemEvent& event);
     
     // Health Monitoring
+    typedef bool (SystemState::*HealthCheckFunction)();
+    struct HealthCheckEntry {
+        HealthCheckFunction check;
+        uint32_t periodMs;
+        uint32_t budgetUs;
+    };
+    static const HealthCheckEntry healthCheckTable[HEALTH_CHECK_COUNT];
+    bool runHealthCheck(uint8_t index);
+    void scheduleHealthChecks();
     bool checkSensorHealth();
     bool checkCameraHealth();
     bool checkLoRaHealth();
@@ -297,8 +441,6 @@ private:
     // Persistence Helpers
     bool saveToNVS();
     bool loadFromNVS();
-    bool saveStatisticsToNVS();
-    bool loadStatisticsFromNVS();
 
     // Constants and Limits
     static const uint8_t MAX_EVENTS = 50;
@@ -320,21 +462,14 @@ extern SystemState& SysState();
 // Constants and Configuration
 // ===========================
 
-#define SYSTEM_STATE_VERSION       1
+#define SYSTEM_STATE_VERSION       2       // Of the NVS record; a record of another version is ignored
 #define SYSTEM_STATE_NAMESPACE     "sysstate"
 #define STATISTICS_NAMESPACE      "stats"
 #define EVENT_LOG_NAMESPACE       "events"
+#define SYSTEM_STATE_COMMIT_INTERVAL_MS 60000   // Least time between NVS commits outside mode and phase changes
 
 // State Persistence Keys
-#define KEY_CURRENT_MODE         "cur_mode"
-#define KEY_FLIGHT_PHASE        "flight_phase"
-#define KEY_SYSTEM_STATUS       "sys_status"
-#define KEY_EMERGENCY_ACTIVE   "emergency"
-#define KEY_BOOT_COUNT          "boot_cnt"
-#define KEY_TOTAL_FLIGHT_TIME   "total_flight"
-#define KEY_MAX_ALTITUDE       "max_alt"
-#define KEY_ERROR_COUNT         "err_cnt"
-#define KEY_WARNING_COUNT       "warn_cnt"
+#define KEY_STATE_RECORD         "record"
 
 // Debug Options
 #ifndef DEBUG_SYSTEM_STATE
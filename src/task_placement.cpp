@@ -0,0 +1,182 @@
+#include "task_placement.h"
+#include "esp_idf_version.h"
+
+#ifndef ARDUINO_RUNNING_CORE
+#define ARDUINO_RUNNING_CORE       1
+#endif
+#ifndef ARDUINO_LOOP_STACK_SIZE
+#define ARDUINO_LOOP_STACK_SIZE    8192
+#endif
+
+#define TASK_USAGE_RUN_TIME_STATS  (configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS)
+
+// ===========================
+// Table
+// ===========================
+
+// In TaskId order
+static const TaskPlacement taskPlacements[TASK_COUNT] = {
+    // Flight - core 0, above everything else there
+    {"lora_radio",      4096, 5, 0},    // Above loop() so DIO0 is serviced promptly
+    {"lora_bulk",       4096, 5, 0},    // As lora_radio; its frames aren't more urgent, just as short-lived
+    {"link_sim",        3072, 6, 0},    // Above the radio tasks, like a real DIO0
+    {"lora_rx",         6144, 4, 0},    // Below the radio task, above loop()
+    {"gps_rx",          4096, 3, 0},    // Below RX; a sentence a few hundred ms late is still good
+    {"sensors",         4096, 3, 0},    // With GPS; only short I2C transactions, sleeps through conversions
+    {"battery_adc",     3072, 1, 0},    // Background - wakes per DMA frame, a median and a mean
+    // Camera
+    {"cam_capture",     6144, 2, 1},    // With loop(), above it so readout isn't starved; blocks in the driver
+    {"cam_thumb",       6144, 1, 0},    // Background - below the radio and RX tasks
+    {"img_store",       4096, 1, 0},    // Background - flash erases take tens of ms
+    {"flight_rec",      3072, 1, 0},    // Background, like the image store
+    {"sd_rec",          4096, 1, 0},    // Background - the write-behind ring covers the card's stalls
+    // Flight control
+    {"flight",          6144, 3, 1},    // Above loop() and capture on core 1; wakes on its next deadline
+    {"uplink",          8192, 3, 0},    // Below RX, with GPS and sensors; wakes on a post or its period
+    {"boot_init",       8192, 2, 0},    // Setup only - below the radio tasks it starts
+    {"log_drain",       4096, 1, 0},    // Background - Serial writes block for the UART
+    {"usb_dump",        4096, 1, 0},    // Background - polls RX at 20 Hz until a host says HELLO
+    // Web - core 0 below the flight tasks; the IDF default is priority 5 on either core
+    {"httpd",           4096, 2, 0},
+    {"stream_cam",      4096, 2, 0},    // Blocks in the camera driver between frames
+    {"stream_client",   4096, 1, 0},    // Sending - the slowest part of a stream
+    {"ws_push",         4096, 1, 0},
+    {"rtp_stream",      4096, 1, 0},    // UDP sends don't block on the receiver
+    {"share_up",        8192, 1, 0},    // Below RX; a TLS handshake or a slow server only delays the map upload
+    // Arduino
+    {"loopTask",        ARDUINO_LOOP_STACK_SIZE, 1, ARDUINO_RUNNING_CORE}
+};
+
+const TaskPlacement& taskPlacement(TaskId id) {
+    return taskPlacements[static_cast<uint8_t>(id)];
+}
+
+BaseType_t createPlacedTask(TaskId id, TaskFunction_t entry, void* param, TaskHandle_t* handle) {
+    const TaskPlacement& placement = taskPlacement(id);
+    return xTaskCreatePinnedToCore(entry, placement.name, placement.stack, param, placement.priority, handle,
+                                   placement.core);
+}
+
+// ===========================
+// CPU Usage
+// ===========================
+
+#if TASK_USAGE_RUN_TIME_STATS
+static TaskStatus_t taskStatus[TASK_USAGE_MAX_TASKS];   // Only loop() samples
+#endif
+
+TaskUsageMonitor::TaskUsageMonitor() {
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        cpuPercent[i] = -1.0f;
+        stackFree[i] = 0;
+    }
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        coreLoad[core] = -1.0f;
+    }
+    previousCount = 0;
+    previousTotal = 0;
+    havePrevious = false;
+}
+
+bool TaskUsageMonitor::isAvailable() const {
+#if TASK_USAGE_RUN_TIME_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint32_t TaskUsageMonitor::previousRunTime(TaskHandle_t handle) const {
+    for (UBaseType_t i = 0; i < previousCount; i++) {
+        if (previous[i].handle == handle) {
+            return previous[i].runTime;
+        }
+    }
+    return 0;   // New since then - all of its run time is in this interval
+}
+
+bool TaskUsageMonitor::sample() {
+#if TASK_USAGE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE totalRunTime = 0;
+    UBaseType_t count = uxTaskGetSystemState(taskStatus, TASK_USAGE_MAX_TASKS, &totalRunTime);
+    if (count == 0) {
+        return false;   // More tasks than TASK_USAGE_MAX_TASKS
+    }
+
+    // Counters are microseconds; 32-bit deltas wrap after 71 minutes, far past the interval
+    const uint32_t elapsed = (uint32_t)totalRunTime - previousTotal;
+    uint32_t busy[TASK_COUNT] = {};
+    uint32_t idle[portNUM_PROCESSORS] = {};
+    uint32_t stack[TASK_COUNT] = {};
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& status = taskStatus[i];
+        const uint32_t delta = (uint32_t)status.ulRunTimeCounter - previousRunTime(status.xHandle);
+
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+            if (status.xHandle == xTaskGetIdleTaskHandleForCore(core)) {
+#else
+            if (status.xHandle == xTaskGetIdleTaskHandleForCPU(core)) {
+#endif
+                idle[core] = delta;
+            }
+        }
+        for (uint8_t id = 0; id < TASK_COUNT; id++) {
+            if (strcmp(status.pcTaskName, taskPlacements[id].name) == 0) {
+                busy[id] += delta;
+                uint32_t free = status.usStackHighWaterMark;
+                stack[id] = stack[id] == 0 ? free : min(stack[id], free);
+                break;
+            }
+        }
+    }
+
+    if (havePrevious && elapsed > 0) {
+        for (uint8_t id = 0; id < TASK_COUNT; id++) {
+            cpuPercent[id] = 100.0f * busy[id] / elapsed;
+        }
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+            coreLoad[core] = 100.0f - min(100.0f, 100.0f * idle[core] / elapsed);
+        }
+    }
+    memcpy(stackFree, stack, sizeof(stackFree));
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        previous[i].handle = taskStatus[i].xHandle;
+        previous[i].runTime = (uint32_t)taskStatus[i].ulRunTimeCounter;
+    }
+    previousCount = count;
+    previousTotal = (uint32_t)totalRunTime;
+    havePrevious = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TaskUsageMonitor::printReport() const {
+    if (!isAvailable()) {
+        Serial.println("Task usage: run time stats not enabled in this build");
+        return;
+    }
+    Serial.printf("Task usage over %u s - core 0 %.1f%%, core 1 %.1f%%\n", TASK_USAGE_INTERVAL_MS / 1000,
+                  getCoreLoad(0), getCoreLoad(1));
+    for (uint8_t id = 0; id < TASK_COUNT; id++) {
+        const TaskPlacement& placement = taskPlacements[id];
+        if (stackFree[id] == 0) {
+            continue;   // Not running
+        }
+        Serial.printf("  %-14s core %d pri %u  %5.1f%%  stack %lu/%lu free\n", placement.name,
+                      placement.core == tskNO_AFFINITY ? -1 : (int)placement.core, (unsigned)placement.priority,
+                      cpuPercent[id], (unsigned long)stackFree[id], (unsigned long)placement.stack);
+    }
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static TaskUsageMonitor taskUsageInstance;
+
+TaskUsageMonitor& TaskUsage() { return taskUsageInstance; }
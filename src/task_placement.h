@@ -0,0 +1,120 @@
+#ifndef TASK_PLACEMENT_H
+#define TASK_PLACEMENT_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// ===========================
+// Task Placement
+// Core, priority and stack of every task the firmware runs, from one table,
+// and per-task CPU use to show the web UI never delays the flight tasks
+// ===========================
+
+// Core 0 carries the radio and everything that can wait behind it - RX,
+// the uplink task that feeds the radio, thumbnails, flash and the web
+// servers, all below the radio tasks. Core 1 is the flight task and the
+// camera capture; nothing web facing runs there, so a busy client can't
+// stretch a flight iteration or a telemetry slot. loop() is left with the
+// supervisor's work.
+// WiFi and lwIP (core 0, priorities 18-23) are the IDF's and not in the table.
+
+#define TASK_USAGE_INTERVAL_MS     10000   // CPU use is averaged over this long
+#define TASK_USAGE_MAX_TASKS       48      // Tasks read per sample, ours and the system's
+
+enum class TaskId : uint8_t {
+    LORA_RADIO = 0,
+    LORA_BULK_RADIO,    // The bulk-data link's radio task, when that module is fitted
+    LINK_SIM,
+    LORA_RX,
+    GPS,
+    SENSORS,            // The I2C sensor scheduler
+    BATTERY_ADC,        // Battery voltage filter, fed by ADC DMA
+    CAMERA_CAPTURE,
+    CAMERA_THUMB,
+    IMAGE_STORE,
+    FLIGHT_RECORDER,
+    SD_RECORDER,        // Time-lapse AVI writes to the SD card, when one is fitted
+    FLIGHT,             // State, sensors, power and what to send - main_balloon.cpp
+    UPLINK,             // Packets, fragments and the radio queue - main_balloon.cpp
+    BOOT_WORKER,        // Core 0's share of the subsystem bring-up; gone once it's done
+    LOG_DRAIN,          // Formats the debug log's records for Serial and the sink
+    USB_DUMP,           // Waits for a host on the USB console; post-flight read-out
+    HTTPD,              // Both servers - the IDF names each task "httpd"
+    STREAM_PRODUCER,
+    STREAM_CLIENT,      // One per /stream client
+    WS_PUSH,
+    RTP_STREAM,
+    SHARE,              // Base station position uploads over TLS
+    LOOP,               // Arduino's loopTask; listed for the report, created by the core
+    COUNT
+};
+
+#define TASK_COUNT static_cast<uint8_t>(TaskId::COUNT)
+
+struct TaskPlacement {
+    const char* name;           // FreeRTOS task name, how the report finds it
+    uint32_t stack;             // Bytes
+    UBaseType_t priority;
+    BaseType_t core;            // 0, 1 or tskNO_AFFINITY
+};
+
+const TaskPlacement& taskPlacement(TaskId id);
+
+// xTaskCreatePinnedToCore() with the task's row of the table
+BaseType_t createPlacedTask(TaskId id, TaskFunction_t entry, void* param, TaskHandle_t* handle);
+
+// ===========================
+// CPU Usage
+// ===========================
+
+// sample() reads every task's run time counter and turns the change since the
+// previous sample into percent of one core. It needs the IDF's run time stats
+// (CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS); without them every reading is -1
+// and only the stack high-water marks are reported
+class TaskUsageMonitor {
+public:
+    TaskUsageMonitor();
+
+    // From loop(), every TASK_USAGE_INTERVAL_MS; false if nothing could be read.
+    // Stops the scheduler for the length of uxTaskGetSystemState()
+    bool sample();
+
+    bool isAvailable() const;
+
+    // Since the previous sample; instances of one task (stream clients) add up
+    float getCpuPercent(TaskId id) const { return cpuPercent[static_cast<uint8_t>(id)]; }
+    float getCoreLoad(uint8_t core) const { return core < portNUM_PROCESSORS ? coreLoad[core] : -1.0f; }
+
+    // Least free stack of any instance ever, bytes; 0 if the task isn't running
+    uint32_t getStackFree(TaskId id) const { return stackFree[static_cast<uint8_t>(id)]; }
+
+    void printReport() const;
+
+private:
+    float cpuPercent[TASK_COUNT];
+    float coreLoad[portNUM_PROCESSORS];
+    uint32_t stackFree[TASK_COUNT];
+
+    // Previous counters by handle, so tasks that come and go between samples
+    // count only their own run time
+    struct Previous {
+        TaskHandle_t handle;
+        uint32_t runTime;
+    };
+    Previous previous[TASK_USAGE_MAX_TASKS];
+    UBaseType_t previousCount;
+    uint32_t previousTotal;
+    bool havePrevious;
+
+    uint32_t previousRunTime(TaskHandle_t handle) const;
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern TaskUsageMonitor& TaskUsage();
+
+#endif // TASK_PLACEMENT_H
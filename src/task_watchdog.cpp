@@ -0,0 +1,233 @@
+#include "task_watchdog.h"
+#include "esp_idf_version.h"
+#include "esp_task_wdt.h"
+#include "debug_utils.h"
+
+static TaskWatchdog taskWatchdogInstance;
+
+TaskWatchdog& Watchdog() { return taskWatchdogInstance; }
+
+// ===========================
+// Constructor
+// ===========================
+
+TaskWatchdog::TaskWatchdog() {
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        tasks[i].handle = nullptr;
+        tasks[i].budgetMs = 0;
+        tasks[i].lastBeat = 0;
+        tasks[i].waiting = false;
+        tasks[i].stalled = false;
+        tasks[i].worstGapMs = 0;
+        tasks[i].stalls = 0;
+    }
+    subscribed = false;
+    resetEnabled = false;
+    timeoutMs = 0;
+    feeding = true;
+    totalStalls = 0;
+    stallHook = nullptr;
+    lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+// ===========================
+// Task WDT
+// ===========================
+
+bool TaskWatchdog::begin(uint32_t timeoutMs, bool reset) {
+    resetEnabled = reset;
+    this->timeoutMs = timeoutMs;
+    if (subscribed) {
+        return true;
+    }
+
+    // The Arduino core starts the Task WDT with the idle tasks on it and no
+    // panic; this keeps the idle tasks and makes a timeout a panic
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+    esp_task_wdt_config_t config;
+    config.timeout_ms = timeoutMs;
+    config.idle_core_mask = 0;
+#ifdef CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU0
+    config.idle_core_mask |= 1 << 0;
+#endif
+#ifdef CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU1
+    config.idle_core_mask |= 1 << 1;
+#endif
+    config.trigger_panic = true;
+    esp_err_t err = esp_task_wdt_reconfigure(&config);
+    if (err == ESP_ERR_INVALID_STATE) {
+        err = esp_task_wdt_init(&config);
+    }
+#else
+    // Reconfigures when it's already running
+    esp_err_t err = esp_task_wdt_init((timeoutMs + 999) / 1000, true);
+#endif
+    if (err == ESP_OK) {
+        err = esp_task_wdt_add(nullptr);
+    }
+    if (err != ESP_OK) {
+        SYS_WARNING("Task WDT not set up: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    subscribed = true;
+    feeding = true;
+    SYS_INFO("Task watchdog: %lu ms, stalls %s", (unsigned long)timeoutMs, reset ? "reset" : "reported only");
+    return true;
+}
+
+// ===========================
+// Registry
+// ===========================
+
+void TaskWatchdog::watch(TaskId id, TaskHandle_t handle, uint32_t budgetMs) {
+    WatchedTask& task = tasks[static_cast<uint8_t>(id)];
+    // waiting stays: the task may already be in its first wait
+    portENTER_CRITICAL(&lock);
+    task.lastBeat = millis();
+    task.stalled = false;
+    task.budgetMs = budgetMs;
+    task.handle = handle;
+    portEXIT_CRITICAL(&lock);
+}
+
+void TaskWatchdog::unwatch(TaskId id) {
+    WatchedTask& task = tasks[static_cast<uint8_t>(id)];
+    portENTER_CRITICAL(&lock);
+    task.handle = nullptr;
+    task.waiting = false;
+    task.stalled = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+void TaskWatchdog::beat(TaskId id) {
+    WatchedTask& task = tasks[static_cast<uint8_t>(id)];
+    uint32_t now = millis();
+    if (!task.waiting) {
+        uint32_t gap = now - task.lastBeat;
+        if (gap > task.worstGapMs && task.handle) {
+            task.worstGapMs = gap;
+        }
+    }
+    task.lastBeat = now;
+    task.waiting = false;
+}
+
+void TaskWatchdog::wait(TaskId id) {
+    tasks[static_cast<uint8_t>(id)].waiting = true;
+}
+
+// ===========================
+// Supervision
+// ===========================
+
+// The TCB's first member is pxTopOfStack, where the port saved the task's
+// frame at its last switch out; the frame's second word is the PC, in an
+// interrupt's frame (XtExcFrame) and a yield's (XtSolFrame) alike
+void TaskWatchdog::snapshot(TaskId id, TaskHandle_t handle, TaskStallRecord& record) {
+    const TaskPlacement& placement = taskPlacement(id);
+    record.state = eTaskGetState(handle);
+    record.priority = uxTaskPriorityGet(handle);
+    record.core = placement.core == tskNO_AFFINITY ? -1 : placement.core;
+    record.stackFree = uxTaskGetStackHighWaterMark(handle);
+
+    const uint32_t* sp = *reinterpret_cast<uint32_t* const*>(handle);
+    const uint8_t* stackStart = pxTaskGetStackStart(handle);
+    const uint8_t* stackEnd = stackStart + placement.stack;
+    record.savedSp = (uint32_t)(uintptr_t)sp;
+
+    // Only while the saved pointer is inside the task's own stack - a
+    // corrupted TCB leaves the record with the pointer and no words
+    const uint8_t* top = reinterpret_cast<const uint8_t*>(sp);
+    if (top >= stackStart && top < stackEnd && ((uintptr_t)sp & 3) == 0) {
+        size_t words = min((size_t)TASK_STALL_STACK_WORDS, (size_t)(stackEnd - top) / sizeof(uint32_t));
+        memcpy(record.stack, sp, words * sizeof(uint32_t));
+        record.words = words;
+        record.pc = words > 1 ? sp[1] : 0;
+    }
+}
+
+void TaskWatchdog::supervise() {
+    bool stalledNow = false;
+
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        WatchedTask& task = tasks[i];
+        TaskId id = static_cast<TaskId>(i);
+        TaskStallRecord record;
+        bool detected = false;
+        bool cleared = false;
+        uint32_t since = 0;
+
+        portENTER_CRITICAL(&lock);
+        if (task.handle) {
+            // A beat between millis() and the read is in the future; not late
+            int32_t elapsed = (int32_t)(millis() - task.lastBeat);
+            since = task.waiting || elapsed < 0 ? 0 : elapsed;
+            bool late = since > task.budgetMs;
+            if (late && !task.stalled) {
+                task.stalled = true;
+                task.stalls++;
+                totalStalls++;
+                memset(&record, 0, sizeof(record));
+                record.task = i;
+                record.sinceBeatMs = since;
+                record.budgetMs = task.budgetMs;
+                snapshot(id, task.handle, record);
+                detected = true;
+            } else if (!late && task.stalled) {
+                task.stalled = false;
+                cleared = true;
+            }
+            stalledNow |= task.stalled;
+        }
+        portEXIT_CRITICAL(&lock);
+
+        // The record first: the stalled task may hold the log's lock
+        if (detected) {
+            if (stallHook) {
+                stallHook(record);
+            }
+            SYS_WARNING("%s task stalled - %lu ms since its last beat, budget %lu ms, state %u, pc 0x%08lx",
+                        taskPlacement(id).name, (unsigned long)since, (unsigned long)record.budgetMs,
+                        record.state, (unsigned long)record.pc);
+        }
+        if (cleared) {
+            SYS_INFO("%s task beating again", taskPlacement(id).name);
+        }
+    }
+
+    if (!subscribed) {
+        return;
+    }
+    if (stalledNow && resetEnabled) {
+        if (feeding) {
+            feeding = false;
+            SYS_ERROR("Task WDT no longer fed - reset in %lu ms unless the stall clears",
+                      (unsigned long)timeoutMs);
+        }
+        return;
+    }
+    feeding = true;
+    esp_task_wdt_reset();
+}
+
+// ===========================
+// Status
+// ===========================
+
+void TaskWatchdog::printStatus() const {
+    Serial.println("=== Task Watchdog ===");
+    Serial.printf("Task WDT: %s\n", !subscribed ? "Not subscribed" : feeding ? "Fed" : "Not fed - stall");
+    Serial.printf("Stalls: %lu\n", (unsigned long)totalStalls);
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        const WatchedTask& task = tasks[i];
+        if (!task.handle) {
+            continue;
+        }
+        Serial.printf("  %-14s budget %5lu ms  last beat %5lu ms%s  worst gap %5lu ms  stalls %lu%s\n",
+                      taskPlacement(static_cast<TaskId>(i)).name, (unsigned long)task.budgetMs,
+                      (unsigned long)(now - task.lastBeat), task.waiting ? " (waiting)" : "",
+                      (unsigned long)task.worstGapMs, (unsigned long)task.stalls, task.stalled ? "  STALLED" : "");
+    }
+}
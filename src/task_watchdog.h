@@ -0,0 +1,121 @@
+#ifndef TASK_WATCHDOG_H
+#define TASK_WATCHDOG_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "task_placement.h"
+
+// ===========================
+// Task Watchdog
+// A heartbeat and a latency budget per task, checked from loop(), with the
+// ESP-IDF Task WDT behind it
+// ===========================
+
+// Each watched task beats once an iteration; a task that goes longer than
+// its budget without one has stalled. Ahead of a wait with no bound - the
+// camera for its next request, GPS for its next UART event - the task calls
+// wait() instead, and the budget starts again at the beat after it.
+//
+// loop() is the Task WDT's only subscriber here, and supervise() feeds it
+// while every watched task is within its budget. On a stall it takes the
+// task's state and the top of its stack into a TASK_STALL flight record,
+// has the recorder synced, and stops feeding: a task that beats again within
+// TASK_WATCHDOG_TIMEOUT_MS clears the stall, one that doesn't gets the
+// board reset through the IDF's panic handler - a core dump for
+// CrashReporter and the crash resume path (rtc_state.h) after it. The same
+// timeout covers loop() itself.
+//
+// The stack is the one the task left saved in its TCB when it last
+// switched out: for a task blocked or starved that is where it's stuck,
+// for one spinning on the other core (state RUNNING) only where it last
+// yielded.
+//
+// beat() and wait() are a store each, from the task's own context. The
+// registry is shared with the base station's radio engine, so the stall
+// record reaches the flight recorder through a hook main_balloon.cpp sets.
+
+#define TASK_STALL_STACK_WORDS   32
+
+// A FlightRecordType::TASK_STALL payload
+struct TaskStallRecord {
+    uint8_t task;               // TaskId
+    uint8_t state;              // eTaskState when detected
+    uint8_t priority;
+    int8_t core;                // Its placement's, -1 for either
+    uint32_t sinceBeatMs;
+    uint32_t budgetMs;
+    uint32_t stackFree;         // Least free stack, bytes
+    uint32_t savedSp;           // Stack pointer saved at its last switch out
+    uint32_t pc;                // Program counter in the frame saved there, 0 if unreadable
+    uint8_t words;              // Of stack copied below, from savedSp up
+    uint8_t reserved[3];
+    uint32_t stack[TASK_STALL_STACK_WORDS];
+};
+
+static_assert(sizeof(TaskStallRecord) == 156, "Stall record is part of the flight recorder's format");
+
+// From loop(), once per stall, before the Task WDT feed stops
+typedef void (*TaskStallHook)(const TaskStallRecord& record);
+
+class TaskWatchdog {
+public:
+    TaskWatchdog();
+
+    // From loopTask, once setup() is through: subscribes it to the Task WDT
+    // with a timeout of timeoutMs. false if the IDF refused
+    bool begin(uint32_t timeoutMs, bool reset);
+    bool isReady() const { return subscribed; }
+
+    // After the task is created, from its creator; again replaces the budget
+    void watch(TaskId id, TaskHandle_t handle, uint32_t budgetMs);
+    // Before the task is deleted
+    void unwatch(TaskId id);
+
+    // From the task itself
+    void beat(TaskId id);
+    void wait(TaskId id);
+
+    // From loop() every SUPERVISOR_INTERVAL_MS
+    void supervise();
+    void setStallHook(TaskStallHook hook) { stallHook = hook; }
+
+    bool isWatched(TaskId id) const { return tasks[static_cast<uint8_t>(id)].handle != nullptr; }
+    bool isStalled(TaskId id) const { return tasks[static_cast<uint8_t>(id)].stalled; }
+    uint32_t getBudgetMs(TaskId id) const { return tasks[static_cast<uint8_t>(id)].budgetMs; }
+    uint32_t getWorstGapMs(TaskId id) const { return tasks[static_cast<uint8_t>(id)].worstGapMs; }
+    uint32_t getStalls(TaskId id) const { return tasks[static_cast<uint8_t>(id)].stalls; }
+    uint32_t getStalls() const { return totalStalls; }
+    void printStatus() const;
+
+private:
+    struct WatchedTask {
+        TaskHandle_t handle;            // nullptr = not watched
+        uint32_t budgetMs;
+        volatile uint32_t lastBeat;     // millis()
+        volatile bool waiting;          // Since wait(); no budget until the next beat
+        bool stalled;
+        uint32_t worstGapMs;            // Longest beat to beat, waits left out
+        uint32_t stalls;
+    };
+
+    WatchedTask tasks[TASK_COUNT];
+    bool subscribed;
+    bool resetEnabled;
+    uint32_t timeoutMs;
+    bool feeding;                       // false once a stall has stopped the feed
+    uint32_t totalStalls;
+    TaskStallHook stallHook;
+    mutable portMUX_TYPE lock;          // watch(), unwatch() and the snapshot
+
+    static void snapshot(TaskId id, TaskHandle_t handle, TaskStallRecord& record);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern TaskWatchdog& Watchdog();
+
+#endif // TASK_WATCHDOG_H
@@ -0,0 +1,220 @@
+#include "telemetry_codec.h"
+#include "packet_handler.h"
+
+// Field layout, scaling and ranges all come from TelemetrySchema (packet_handler.h)
+
+#define TELEMETRY_VARINT_MAX        5
+
+static_assert(TELEMETRY_CODEC_FIELDS <= 11, "Field mask is 11 bits");
+
+// ===========================
+// Varint Helpers
+// ===========================
+
+// Zigzag varints - small deltas of either sign take one byte
+static size_t writeVarint(int32_t value, uint8_t* out) {
+    uint32_t zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    size_t length = 0;
+    while (zigzag >= 0x80) {
+        out[length++] = static_cast<uint8_t>(zigzag) | 0x80;
+        zigzag >>= 7;
+    }
+    out[length++] = static_cast<uint8_t>(zigzag);
+    return length;
+}
+
+static bool readVarint(const uint8_t* in, size_t length, size_t& offset, int32_t& value) {
+    uint32_t zigzag = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (offset >= length) {
+            return false;
+        }
+        uint8_t byte = in[offset++];
+        zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            value = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void writeHeader(uint16_t header, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(header >> 8);
+    out[1] = static_cast<uint8_t>(header);
+}
+
+// ===========================
+// Encoder
+// ===========================
+
+TelemetryEncoder::TelemetryEncoder() {
+    keyframeId = 0;
+    reset();
+    keyframesSent = 0;
+    deltasSent = 0;
+    bytesSent = 0;
+}
+
+void TelemetryEncoder::reset() {
+    memset(reference, 0, sizeof(reference));
+    sinceKeyframe = 0;
+    haveKeyframe = false;
+    historyValid = 0;
+}
+
+size_t TelemetryEncoder::encode(const TelemetryData& data, uint8_t* out) {
+    int32_t values[TELEMETRY_CODEC_FIELDS];
+    TelemetrySchema::toFixed(data, values);
+
+    if (haveKeyframe && sinceKeyframe < TELEMETRY_KEYFRAME_INTERVAL - 1) {
+        uint16_t mask = 0;
+        size_t offset = TELEMETRY_HEADER_SIZE;
+
+        for (uint8_t i = 0; i < TELEMETRY_CODEC_FIELDS; i++) {
+            int32_t delta = values[i] - reference[i];
+            if (delta != 0) {
+                // Would not beat a keyframe - stop before overrunning the caller's buffer
+                if (offset + TELEMETRY_VARINT_MAX > TELEMETRY_KEYFRAME_SIZE) {
+                    offset = TELEMETRY_KEYFRAME_SIZE;
+                    break;
+                }
+                mask |= 1 << i;
+                offset += writeVarint(delta, &out[offset]);
+            }
+        }
+
+        // Drifted far enough that a fresh keyframe is no bigger - send that instead
+        if (offset < TELEMETRY_KEYFRAME_SIZE) {
+            writeHeader(static_cast<uint16_t>(keyframeId << 11) | mask, out);
+            sinceKeyframe++;
+            deltasSent++;
+            bytesSent += offset;
+            return offset;
+        }
+    }
+
+    keyframeId = (keyframeId + 1) & TELEMETRY_KEYFRAME_ID_MASK;
+    writeHeader(TELEMETRY_FLAG_KEYFRAME | static_cast<uint16_t>(keyframeId << 11), out);
+
+    TelemetrySchema::writeFixed(values, &out[TELEMETRY_HEADER_SIZE]);
+
+    memcpy(reference, values, sizeof(reference));
+    memcpy(history[keyframeId], values, sizeof(reference));
+    historyValid |= 1 << keyframeId;
+    haveKeyframe = true;
+    sinceKeyframe = 0;
+    keyframesSent++;
+    bytesSent += TELEMETRY_KEYFRAME_SIZE;
+    return TELEMETRY_KEYFRAME_SIZE;
+}
+
+size_t TelemetryEncoder::standalone(const uint8_t* in, size_t length, uint8_t* out) const {
+    if (!in || length < TELEMETRY_HEADER_SIZE) {
+        return 0;
+    }
+
+    uint16_t header = (static_cast<uint16_t>(in[0]) << 8) | in[1];
+    uint8_t id = (header >> 11) & TELEMETRY_KEYFRAME_ID_MASK;
+
+    if (header & TELEMETRY_FLAG_KEYFRAME) {
+        if (length != TELEMETRY_KEYFRAME_SIZE) {
+            return 0;
+        }
+        memcpy(out, in, TELEMETRY_KEYFRAME_SIZE);
+        writeHeader(header | TELEMETRY_FLAG_STANDALONE, out);
+        return TELEMETRY_KEYFRAME_SIZE;
+    }
+
+    if (!(historyValid & (1 << id))) {
+        return 0;
+    }
+    int32_t values[TELEMETRY_CODEC_FIELDS];
+    size_t offset = TELEMETRY_HEADER_SIZE;
+    for (uint8_t i = 0; i < TELEMETRY_CODEC_FIELDS; i++) {
+        int32_t delta = 0;
+        if ((header & (1 << i)) && !readVarint(in, length, offset, delta)) {
+            return 0;
+        }
+        values[i] = (int32_t)((uint32_t)history[id][i] + (uint32_t)delta);
+    }
+    if (offset != length) {
+        return 0;
+    }
+
+    writeHeader(TELEMETRY_FLAG_KEYFRAME | TELEMETRY_FLAG_STANDALONE | static_cast<uint16_t>(id << 11), out);
+    TelemetrySchema::writeFixed(values, &out[TELEMETRY_HEADER_SIZE]);
+    return TELEMETRY_KEYFRAME_SIZE;
+}
+
+float TelemetryEncoder::getAverageSize() const {
+    uint32_t frames = keyframesSent + deltasSent;
+    return frames > 0 ? static_cast<float>(bytesSent) / frames : 0.0f;
+}
+
+// ===========================
+// Decoder
+// ===========================
+
+TelemetryDecoder::TelemetryDecoder() {
+    reset();
+    framesDecoded = 0;
+    orphanDeltas = 0;
+    malformed = 0;
+}
+
+void TelemetryDecoder::reset() {
+    memset(reference, 0, sizeof(reference));
+    keyframeId = 0;
+    haveKeyframe = false;
+}
+
+bool TelemetryDecoder::decode(const uint8_t* in, size_t length, TelemetryData& data) {
+    if (!in || length < TELEMETRY_HEADER_SIZE) {
+        malformed++;
+        return false;
+    }
+
+    uint16_t header = (static_cast<uint16_t>(in[0]) << 8) | in[1];
+    uint8_t id = (header >> 11) & TELEMETRY_KEYFRAME_ID_MASK;
+    int32_t values[TELEMETRY_CODEC_FIELDS];
+
+    if (header & TELEMETRY_FLAG_KEYFRAME) {
+        if (length != TELEMETRY_KEYFRAME_SIZE) {
+            malformed++;
+            return false;
+        }
+
+        TelemetrySchema::readFixed(&in[TELEMETRY_HEADER_SIZE], values);
+        if (!(header & TELEMETRY_FLAG_STANDALONE)) {
+            memcpy(reference, values, sizeof(reference));
+            keyframeId = id;
+            haveKeyframe = true;
+        }
+    } else {
+        if (!haveKeyframe || id != keyframeId) {
+            orphanDeltas++;
+            return false;
+        }
+
+        size_t offset = TELEMETRY_HEADER_SIZE;
+        for (uint8_t i = 0; i < TELEMETRY_CODEC_FIELDS; i++) {
+            int32_t delta = 0;
+            if ((header & (1 << i)) && !readVarint(in, length, offset, delta)) {
+                malformed++;
+                return false;
+            }
+            // A corrupt delta wraps rather than overflows; inRange() rejects the result
+            values[i] = (int32_t)((uint32_t)reference[i] + (uint32_t)delta);
+        }
+
+        if (offset != length || !TelemetrySchema::inRange(values)) {
+            malformed++;
+            return false;
+        }
+    }
+
+    TelemetrySchema::fromFixed(values, data);
+    framesDecoded++;
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "balloon_config.h"
+
+// ===========================
+// Telemetry Codec
+// Fixed-point fields, sent as deltas against the last keyframe
+// ===========================
+
+struct TelemetryData;
+
+// Frame header (2 bytes, big endian):
+//   bit 15      keyframe
+//   bits 14-11  keyframe id (mod 16) - a delta only decodes against its own keyframe
+//   bits 10-0   delta frames: one bit per field present, zero deltas are left out
+//   bit 10      keyframes: standalone - decoded but never taken as the reference
+//
+// A standalone keyframe is a reading re-sent out of order, e.g. backfilled
+// after a link loss; the live stream's reference stays as it was. The
+// encoder keeps the last 16 keyframes so standalone() can turn any recent
+// frame into one.
+#define TELEMETRY_CODEC_FIELDS      11
+#define TELEMETRY_HEADER_SIZE       2
+#define TELEMETRY_KEYFRAME_SIZE     24    // Header + absolute fixed-point fields
+#define TELEMETRY_FLAG_KEYFRAME     0x8000
+#define TELEMETRY_KEYFRAME_ID_MASK  0x0F
+#define TELEMETRY_FLAG_STANDALONE   0x0400
+#define TELEMETRY_KEYFRAME_HISTORY  (TELEMETRY_KEYFRAME_ID_MASK + 1)
+#define TELEMETRY_RAW_SIZE          35    // The packed-float layout this replaced
+
+// TELEMETRY_KEYFRAME_INTERVAL - defined in balloon_config.h
+
+class TelemetryEncoder {
+private:
+    int32_t reference[TELEMETRY_CODEC_FIELDS];
+    uint8_t keyframeId;
+    uint16_t sinceKeyframe;
+    bool haveKeyframe;
+    int32_t history[TELEMETRY_KEYFRAME_HISTORY][TELEMETRY_CODEC_FIELDS];   // By keyframe id
+    uint16_t historyValid;      // Bit per id
+
+    // Statistics
+    uint32_t keyframesSent;
+    uint32_t deltasSent;
+    uint32_t bytesSent;
+
+public:
+    TelemetryEncoder();
+
+    void reset();
+    void forceKeyframe() { haveKeyframe = false; }
+
+    // Returns the encoded size, never more than TELEMETRY_KEYFRAME_SIZE
+    size_t encode(const TelemetryData& data, uint8_t* out);
+
+    // A frame this encoder produced, as a standalone keyframe in out
+    // (TELEMETRY_KEYFRAME_SIZE bytes); 0 if malformed or its keyframe is
+    // 16 keyframes gone
+    size_t standalone(const uint8_t* in, size_t length, uint8_t* out) const;
+
+    uint32_t getKeyframesSent() const { return keyframesSent; }
+    uint32_t getDeltasSent() const { return deltasSent; }
+    float getAverageSize() const;
+};
+
+class TelemetryDecoder {
+private:
+    int32_t reference[TELEMETRY_CODEC_FIELDS];
+    uint8_t keyframeId;
+    bool haveKeyframe;
+
+    // Statistics
+    uint32_t framesDecoded;
+    uint32_t orphanDeltas;      // Delta whose keyframe was lost
+    uint32_t malformed;
+
+public:
+    TelemetryDecoder();
+
+    void reset();
+    bool decode(const uint8_t* in, size_t length, TelemetryData& data);
+
+    uint32_t getFramesDecoded() const { return framesDecoded; }
+    uint32_t getOrphanDeltas() const { return orphanDeltas; }
+    uint32_t getMalformed() const { return malformed; }
+};
+
+#endif // TELEMETRY_CODEC_H
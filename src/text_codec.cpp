@@ -0,0 +1,140 @@
+#include "text_codec.h"
+
+// ===========================
+// Shared Dictionary
+// ===========================
+
+// Changing this breaks decoding of anything sent with the old one, so both
+// ends must be on the same build. Built from the sendStatusReport() format,
+// the SystemState names and the words subsystems log most.
+static const char TEXT_CODEC_DICTIONARY[] =
+    "Error: failed to initialize timeout Warning: not found invalid "
+    "Sensor Camera LoRa GPS Power Battery Temperature Pressure Altitude Humidity "
+    "Voltage Current RSSI SNR Packet Queue Buffer Memory Heap PSRAM "
+    "started stopped enabled disabled initialized ready complete lost "
+    "Unknown Offline Critical Nominal Ground Launch Apex Recovery "
+    "Powered Ascent Balloon Ascent Parachute Descent Landing "
+    "Initializing Pre-Flight Launch Detected Apex Detected Landing Detected "
+    "Post-Flight Emergency Safe Mode Maintenance "
+    "Mode:Ascent Phase:Balloon Ascent Status:Nominal Loop: MaxLoop:";
+
+#define TEXT_CODEC_DICTIONARY_SIZE (sizeof(TEXT_CODEC_DICTIONARY) - 1)
+
+static_assert(TEXT_CODEC_DICTIONARY_SIZE <= TEXT_CODEC_MAX_DISTANCE, "Dictionary must be reachable from the first byte");
+
+// Byte at window position pos: the dictionary, then the text itself
+static inline uint8_t windowAt(const uint8_t* text, size_t pos) {
+    return pos < TEXT_CODEC_DICTIONARY_SIZE
+        ? static_cast<uint8_t>(TEXT_CODEC_DICTIONARY[pos])
+        : text[pos - TEXT_CODEC_DICTIONARY_SIZE];
+}
+
+// ===========================
+// Compression
+// ===========================
+
+size_t compressText(const uint8_t* text, size_t length, uint8_t* out, size_t capacity) {
+    if (!text || !out || length < TEXT_CODEC_MIN_MATCH) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] & 0x80) {
+            return 0;
+        }
+    }
+
+    size_t written = 0;
+    size_t pos = 0;
+
+    while (pos < length) {
+        // Greedy longest match - texts are short enough for a plain search
+        size_t here = TEXT_CODEC_DICTIONARY_SIZE + pos;
+        size_t windowStart = here > TEXT_CODEC_MAX_DISTANCE ? here - TEXT_CODEC_MAX_DISTANCE : 0;
+        size_t maxLength = length - pos < TEXT_CODEC_MAX_MATCH ? length - pos : TEXT_CODEC_MAX_MATCH;
+        size_t bestLength = 0;
+        size_t bestDistance = 0;
+
+        if (maxLength >= TEXT_CODEC_MIN_MATCH) {
+            for (size_t candidate = windowStart; candidate < here; candidate++) {
+                if (windowAt(text, candidate) != text[pos]) {
+                    continue;
+                }
+
+                // May run on into the bytes being encoded (overlapping copy)
+                size_t matched = 1;
+                while (matched < maxLength && windowAt(text, candidate + matched) == text[pos + matched]) {
+                    matched++;
+                }
+                if (matched > bestLength) {
+                    bestLength = matched;
+                    bestDistance = here - candidate;
+                    if (matched == maxLength) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (bestLength >= TEXT_CODEC_MIN_MATCH) {
+            if (written + 2 >= length || written + 2 > capacity) {
+                return 0;
+            }
+            size_t distance = bestDistance - 1;
+            out[written++] = static_cast<uint8_t>(0x80 | ((bestLength - TEXT_CODEC_MIN_MATCH) << 3) | (distance >> 8));
+            out[written++] = static_cast<uint8_t>(distance);
+            pos += bestLength;
+        } else {
+            if (written + 1 >= length || written + 1 > capacity) {
+                return 0;
+            }
+            out[written++] = text[pos++];
+        }
+    }
+
+    return written;
+}
+
+// ===========================
+// Decompression
+// ===========================
+
+size_t decompressText(const uint8_t* in, size_t length, uint8_t* text, size_t capacity) {
+    if (!in || !text) {
+        return 0;
+    }
+
+    size_t written = 0;
+    size_t offset = 0;
+
+    while (offset < length) {
+        uint8_t token = in[offset++];
+
+        if (!(token & 0x80)) {
+            if (written >= capacity) {
+                return 0;
+            }
+            text[written++] = token;
+            continue;
+        }
+
+        if (offset >= length) {
+            return 0;
+        }
+        size_t matchLength = ((token >> 3) & 0x0F) + TEXT_CODEC_MIN_MATCH;
+        size_t distance = ((static_cast<size_t>(token & 0x07) << 8) | in[offset++]) + 1;
+        size_t here = TEXT_CODEC_DICTIONARY_SIZE + written;
+
+        if (distance > here || written + matchLength > capacity) {
+            return 0;
+        }
+
+        // Byte by byte - a copy may overlap the bytes it produces
+        size_t source = here - distance;
+        for (size_t i = 0; i < matchLength; i++) {
+            text[written] = windowAt(text, source + i);
+            written++;
+        }
+    }
+
+    return written;
+}
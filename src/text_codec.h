@@ -0,0 +1,35 @@
+#ifndef TEXT_CODEC_H
+#define TEXT_CODEC_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Text Codec
+// LZ77 over a static shared dictionary, for STATUS/DEBUG strings
+// ===========================
+
+// Status and debug text is short (under 150 bytes) and made of the same few
+// words every time, so a plain LZ window has nothing to match against. Both
+// ends instead prime the window with TEXT_CODEC_DICTIONARY: a match may
+// reach back into the dictionary as well as into the text decoded so far.
+//
+// Token stream:
+//   0xxxxxxx                    literal ASCII byte
+//   1LLLLDDD DDDDDDDD           copy L + 3 bytes (3-18) from D + 1 bytes back (1-2048)
+//
+// Text with bytes >= 0x80 is never compressed. Packets carry the result with
+// PACKET_TYPE_COMPRESSED set in their type byte (packet_handler.h).
+
+#define TEXT_CODEC_MIN_MATCH    3
+#define TEXT_CODEC_MAX_MATCH    18
+#define TEXT_CODEC_MAX_DISTANCE 2048
+
+// Returns the compressed size, or 0 if the text can't be compressed or
+// wouldn't come out smaller (send it as-is then)
+size_t compressText(const uint8_t* text, size_t length, uint8_t* out, size_t capacity);
+
+// Returns the inflated size, or 0 if the stream is malformed or overflows capacity
+size_t decompressText(const uint8_t* in, size_t length, uint8_t* text, size_t capacity);
+
+#endif // TEXT_CODEC_H
@@ -0,0 +1,104 @@
+#include "time_service.h"
+
+TimeService::TimeService() {
+    reference.publish({0, 0, 0.0f, false, TimeSource::NONE, 0});
+    ppsLow = 0;
+    ppsSeen = false;
+    rejectedPps = 0;
+}
+
+bool TimeService::getLastPps(int64_t& localUs) const {
+    if (!ppsSeen) {
+        return false;
+    }
+    // The low 32 bits wrap every 71 minutes; the age is exact until then
+    int64_t now = nowUs();
+    localUs = now - (uint32_t)((uint32_t)now - ppsLow);
+    return true;
+}
+
+// ===========================
+// Discipline
+// ===========================
+
+void TimeService::discipline(uint32_t utcSeconds, int64_t secondStartUs, TimeSource source) {
+    if (utcSeconds == 0 || source == TimeSource::NONE) {
+        return;
+    }
+
+    TimeReference previous = reference.read();
+    bool previousPps = previous.source == TimeSource::PPS && previous.updates > 0;
+
+    // GGA and RMC both report each second, and a missed edge shouldn't throw away a good reference
+    if (source != TimeSource::PPS && previousPps &&
+        secondStartUs - previous.localUs < (int64_t)TIME_PPS_PREFER_MS * 1000) {
+        return;
+    }
+
+    TimeReference next = previous;
+    next.localUs = secondStartUs;
+    next.utcSeconds = utcSeconds;
+    next.source = source;
+    next.updates = previous.updates + 1;
+
+    if (source == TimeSource::PPS && previousPps && utcSeconds > previous.utcSeconds &&
+        utcSeconds - previous.utcSeconds <= TIME_DRIFT_MAX_SPAN_S) {
+        uint32_t span = utcSeconds - previous.utcSeconds;
+        float ppm = (float)(secondStartUs - previous.localUs - (int64_t)span * 1000000) / span;
+        if (fabsf(ppm) > TIME_DRIFT_MAX_PPM) {
+            rejectedPps = rejectedPps + 1;  // Edge and second paired wrongly; the reference moves, the drift doesn't
+        } else if (!previous.driftKnown) {
+            next.driftPpm = ppm;
+            next.driftKnown = true;
+        } else {
+            next.driftPpm = previous.driftPpm + TIME_DRIFT_GAIN * (ppm - previous.driftPpm);
+        }
+    }
+
+    reference.publish(next);
+}
+
+// ===========================
+// Conversion
+// ===========================
+
+bool TimeService::isSynced() const {
+    TimeReference ref = reference.read();
+    return ref.updates > 0 && nowUs() - ref.localUs < (int64_t)TIME_HOLDOVER_MS * 1000;
+}
+
+TimeSource TimeService::getSource() const {
+    return isSynced() ? reference.read().source : TimeSource::NONE;
+}
+
+bool TimeService::toUtc(int64_t localUs, int64_t& utcUs) const {
+    TimeReference ref = reference.read();
+    if (ref.updates == 0 || nowUs() - ref.localUs >= (int64_t)TIME_HOLDOVER_MS * 1000) {
+        return false;
+    }
+
+    int64_t elapsed = localUs - ref.localUs;
+    if (ref.driftKnown) {
+        elapsed -= (int64_t)((float)elapsed * ref.driftPpm * 1e-6f);
+    }
+    utcUs = (int64_t)ref.utcSeconds * 1000000 + elapsed;
+    return true;
+}
+
+void TimeService::printStatus() const {
+    static const char* const sources[] = {"none", "GPS", "PPS"};
+    TimeReference ref = reference.read();
+    TimeSource source = getSource();
+    Serial.printf("Time: %s, UTC %lu s at %lld us, drift %s%.2f ppm, %lu updates, %lu PPS rejected\n",
+                 sources[static_cast<uint8_t>(source)], (unsigned long)ref.utcSeconds, (long long)ref.localUs,
+                 ref.driftKnown ? "" : "unknown ", ref.driftPpm, (unsigned long)ref.updates,
+                 (unsigned long)rejectedPps);
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static TimeService timeServiceInstance;
+
+TimeService& Clock() { return timeServiceInstance; }
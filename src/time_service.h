@@ -0,0 +1,89 @@
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "esp_timer.h"
+#include "snapshot.h"
+
+// ===========================
+// Time Service
+// One timebase for every reading: esp_timer microseconds since boot, with
+// a mapping to UTC disciplined by GPS time and the PPS edge
+// ===========================
+
+// nowUs() is the stamp - monotonic, never stepped, and the same clock as
+// millis() (which is nowUs() / 1000), so millisecond code lines up with it.
+// The GPS path calls discipline() with each UTC second and the local time
+// it began at, from the PPS edge when there is one. Consecutive PPS seconds
+// measure the crystal's drift and toUtc() takes it off when extrapolating:
+// through the whole holdover a 1 ppm residual is 0.6 ms, where the crystal
+// alone, at 20 ppm, would be 12 ms. Without PPS the mapping is as good as
+// the message's arrival, tens of ms, and drift isn't estimated.
+//
+// The reference is a Snapshot, so any task reads it without a lock; the PPS
+// interrupt only stores the low 32 bits of the edge time.
+
+#define TIME_HOLDOVER_MS           600000  // Synced this long after the last discipline()
+#define TIME_DRIFT_MAX_PPM         200.0f  // A PPS second further off than this is a missed or extra edge
+#define TIME_DRIFT_GAIN            0.125f  // Weight of each new PPS second in the drift estimate
+#define TIME_DRIFT_MAX_SPAN_S      64      // Longest gap between PPS seconds used for drift
+#define TIME_PPS_PREFER_MS         5000    // A PPS reference this fresh beats a new GPS-only one
+
+enum class TimeSource : uint8_t {
+    NONE = 0,   // Boot time only
+    GPS,        // UTC from the GPS message, aligned to its arrival
+    PPS         // UTC second aligned to the PPS edge
+};
+
+struct TimeReference {
+    int64_t localUs;        // nowUs() at the start of utcSeconds
+    uint32_t utcSeconds;
+    float driftPpm;         // Local clock fast by this much
+    bool driftKnown;        // From two PPS seconds at least
+    TimeSource source;
+    uint32_t updates;
+};
+
+class TimeService {
+public:
+    TimeService();
+
+    static int64_t nowUs() { return esp_timer_get_time(); }
+    static uint32_t nowMs() { return (uint32_t)(esp_timer_get_time() / 1000); }
+
+    // From the PPS interrupt
+    void IRAM_ATTR onPps() { ppsLow = (uint32_t)esp_timer_get_time(); ppsSeen = true; }
+
+    // Last PPS edge in nowUs() time, exact for 71 minutes after it; false before the first
+    bool getLastPps(int64_t& localUs) const;
+
+    // utcSeconds began at secondStartUs; from the GPS task
+    void discipline(uint32_t utcSeconds, int64_t secondStartUs, TimeSource source);
+
+    bool isSynced() const;
+    TimeSource getSource() const;       // NONE once the holdover runs out
+    TimeReference getReference() const { return reference.read(); }
+
+    // Microseconds since 1970; false while unsynced
+    bool toUtc(int64_t localUs, int64_t& utcUs) const;
+    bool utcNowUs(int64_t& utcUs) const { return toUtc(nowUs(), utcUs); }
+
+    uint32_t getRejectedPps() const { return rejectedPps; }
+
+    void printStatus() const;
+
+private:
+    Snapshot<TimeReference> reference;
+    volatile uint32_t ppsLow;
+    volatile bool ppsSeen;
+    volatile uint32_t rejectedPps;
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern TimeService& Clock();
+
+#endif // TIME_SERVICE_H
@@ -0,0 +1,356 @@
+#include "timeseries.h"
+#include <esp_heap_caps.h>
+#include "memory_ledger.h"
+
+#define TIMESERIES_DATA_BITS       ((int)sizeof(((TimeSeriesBlock*)0)->data) * 8)
+
+static_assert(sizeof(TimeSeriesBlock) == TIMESERIES_BLOCK_SIZE, "TimeSeriesBlock header is 16 bytes");
+
+// ===========================
+// Bit Streams
+// ===========================
+
+static void writeBits(uint8_t* data, uint16_t& position, uint32_t value, uint8_t count) {
+    while (count > 0) {
+        count--;
+        uint8_t bit = (value >> count) & 1;
+        uint8_t& byte = data[position >> 3];
+        uint8_t mask = 0x80 >> (position & 7);
+        byte = bit ? (byte | mask) : (byte & ~mask);
+        position++;
+    }
+}
+
+static uint32_t readBits(const uint8_t* data, uint16_t& position, uint8_t count) {
+    uint32_t value = 0;
+    while (count > 0) {
+        count--;
+        value = (value << 1) | ((data[position >> 3] >> (7 - (position & 7))) & 1);
+        position++;
+    }
+    return value;
+}
+
+// Bucket widths after a 0, 10, 110, 1110, 1111 prefix
+static const uint8_t timeBuckets[4] = {7, 9, 12, 32};
+static const uint8_t valueBuckets[4] = {4, 7, 12, 32};
+
+static void writeField(uint8_t* data, uint16_t& position, int32_t value, const uint8_t* widths) {
+    if (value == 0) {
+        writeBits(data, position, 0, 1);
+        return;
+    }
+    for (uint8_t bucket = 0; bucket < 4; bucket++) {
+        uint8_t width = widths[bucket];
+        int32_t low = width == 32 ? INT32_MIN : -(1 << (width - 1)) + 1;
+        int32_t high = width == 32 ? INT32_MAX : (1 << (width - 1));
+        if (value >= low && value <= high) {
+            // Prefix: bucket + 1 ones, then a zero except for the last bucket
+            uint8_t prefixBits = bucket < 3 ? bucket + 2 : 4;
+            uint32_t prefix = bucket < 3 ? ((1u << (bucket + 2)) - 2) : 0x0F;
+            writeBits(data, position, prefix, prefixBits);
+            // -low.. stored offset so the field is unsigned: value - low
+            writeBits(data, position, width == 32 ? (uint32_t)value : (uint32_t)(value - low), width);
+            return;
+        }
+    }
+}
+
+static int32_t readField(const uint8_t* data, uint16_t& position, const uint8_t* widths) {
+    uint8_t bucket = 0;
+    while (bucket < 4 && readBits(data, position, 1)) {
+        bucket++;
+    }
+    if (bucket == 0) {
+        return 0;
+    }
+    uint8_t width = widths[bucket - 1];
+    uint32_t raw = readBits(data, position, width);
+    if (width == 32) {
+        return (int32_t)raw;
+    }
+    return (int32_t)raw + (-(1 << (width - 1)) + 1);
+}
+
+// ===========================
+// Block Codec
+// ===========================
+
+int32_t timeSeriesQuantize(float value, float resolution) {
+    float steps = roundf(value / resolution);
+    return steps >= 2147483520.0f ? INT32_MAX : (steps <= -2147483520.0f ? INT32_MIN : (int32_t)steps);
+}
+
+void timeSeriesStartBlock(TimeSeriesBlock& block, TimeSeriesCursor& cursor, uint32_t time, int32_t value) {
+    block.firstTime = time;
+    block.lastTime = time;
+    block.firstValue = value;
+    block.count = 1;
+    block.bits = 0;
+
+    cursor.prevTime = time;
+    cursor.prevDelta = 0;
+    cursor.prevValue = value;
+}
+
+bool timeSeriesAppend(TimeSeriesBlock& block, TimeSeriesCursor& cursor, uint32_t time, int32_t value) {
+    if (block.bits + TIMESERIES_MAX_SAMPLE_BITS > TIMESERIES_DATA_BITS) {
+        return false;
+    }
+
+    int32_t delta = (int32_t)(time - cursor.prevTime);
+    writeField(block.data, block.bits, (int32_t)((uint32_t)delta - (uint32_t)cursor.prevDelta), timeBuckets);
+    // Wrapping subtraction; the reader wraps back the same way
+    writeField(block.data, block.bits, (int32_t)((uint32_t)value - (uint32_t)cursor.prevValue), valueBuckets);
+    block.count++;
+    block.lastTime = time;
+
+    cursor.prevTime = time;
+    cursor.prevDelta = delta;
+    cursor.prevValue = value;
+    return true;
+}
+
+bool timeSeriesDecode(const TimeSeriesBlock& block, float resolution, uint32_t from, uint32_t to,
+                      TimeSeriesVisitor visitor, void* context, size_t& visited) {
+    TimeSeriesSample sample;
+    uint32_t time = block.firstTime;
+    int32_t delta = 0;
+    int32_t value = block.firstValue;
+    uint16_t position = 0;
+    for (uint16_t n = 0; n < block.count; n++) {
+        if (n > 0) {
+            delta = (int32_t)((uint32_t)delta + (uint32_t)readField(block.data, position, timeBuckets));
+            time += delta;
+            value = (int32_t)((uint32_t)value + (uint32_t)readField(block.data, position, valueBuckets));
+        }
+        if (time > to) {
+            break;
+        }
+        if (time >= from) {
+            sample.time = time;
+            sample.value = value * resolution;
+            visited++;
+            if (!visitor(sample, context)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void timeSeriesResume(const TimeSeriesBlock& block, TimeSeriesCursor& cursor) {
+    uint32_t time = block.firstTime;
+    int32_t delta = 0;
+    int32_t value = block.firstValue;
+    uint16_t position = 0;
+    for (uint16_t n = 1; n < block.count; n++) {
+        delta = (int32_t)((uint32_t)delta + (uint32_t)readField(block.data, position, timeBuckets));
+        time += delta;
+        value = (int32_t)((uint32_t)value + (uint32_t)readField(block.data, position, valueBuckets));
+    }
+    cursor.prevTime = time;
+    cursor.prevDelta = delta;
+    cursor.prevValue = value;
+}
+
+// ===========================
+// Constructor/Destructor
+// ===========================
+
+TimeSeries::TimeSeries() {
+    name = "";
+    resolution = 1.0f;
+    blocks = nullptr;
+    blockCount = 0;
+    head = 0;
+    used = 0;
+    droppedBlocks = 0;
+    mutex = nullptr;
+    cursor = {0, 0, 0};
+}
+
+TimeSeries::~TimeSeries() {
+    end();
+}
+
+bool TimeSeries::begin(const char* name, float resolution, uint16_t blockCount) {
+    end();
+    if (blockCount == 0 || resolution <= 0.0f) {
+        return false;
+    }
+
+    // Hundreds of KB across the channels - PSRAM or nothing
+    blocks = (TimeSeriesBlock*)memAllocCaps(MemTag::TIMESERIES, (size_t)blockCount * sizeof(TimeSeriesBlock),
+                                            MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    mutex = xSemaphoreCreateMutex();
+    if (!blocks || !mutex) {
+        end();
+        return false;
+    }
+
+    this->name = name;
+    this->resolution = resolution;
+    this->blockCount = blockCount;
+    head = 0;
+    used = 0;
+    droppedBlocks = 0;
+    return true;
+}
+
+void TimeSeries::end() {
+    if (blocks) {
+        memFree(MemTag::TIMESERIES, blocks);
+        blocks = nullptr;
+    }
+    if (mutex) {
+        vSemaphoreDelete(mutex);
+        mutex = nullptr;
+    }
+    blockCount = 0;
+    used = 0;
+}
+
+// ===========================
+// Writing
+// ===========================
+
+void TimeSeries::startBlock(uint32_t time, int32_t value) {
+    if (used > 0) {
+        head = (head + 1) % blockCount;
+    }
+    if (used == blockCount) {
+        droppedBlocks++;    // Overwriting the oldest
+    } else {
+        used++;
+    }
+
+    timeSeriesStartBlock(blocks[head], cursor, time, value);
+}
+
+bool TimeSeries::append(uint32_t time, float value) {
+    if (!blocks) {
+        return false;
+    }
+
+    int32_t quantized = timeSeriesQuantize(value, resolution);
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (used > 0 && time <= cursor.prevTime) {
+        xSemaphoreGive(mutex);
+        return false;
+    }
+
+    if (used == 0 || !timeSeriesAppend(blocks[head], cursor, time, quantized)) {
+        startBlock(time, quantized);
+    }
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+// ===========================
+// Reading
+// ===========================
+
+size_t TimeSeries::visit(uint32_t from, uint32_t to, TimeSeriesVisitor visitor, void* context) const {
+    if (!blocks || !visitor) {
+        return 0;
+    }
+
+    size_t visited = 0;
+    uint32_t cursor = from;
+    TimeSeriesBlock copy;
+
+    while (true) {
+        // The ring may move between blocks, so find the next one by time,
+        // copy it under the lock and decode outside it
+        bool haveBlock = false;
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        for (uint16_t i = 0; i < used; i++) {
+            const TimeSeriesBlock& block = blocks[(head + blockCount - (used - 1) + i) % blockCount];
+            if (block.lastTime >= cursor) {
+                if (block.firstTime <= to) {
+                    memcpy(&copy, &block, sizeof(copy));
+                    haveBlock = true;
+                }
+                break;  // In time order - the first that reaches the cursor is the only candidate
+            }
+        }
+        xSemaphoreGive(mutex);
+        if (!haveBlock) {
+            break;
+        }
+
+        if (!timeSeriesDecode(copy, resolution, cursor, to, visitor, context, visited)) {
+            return visited;
+        }
+        if (copy.lastTime >= to) {
+            break;
+        }
+        cursor = copy.lastTime + 1;
+    }
+    return visited;
+}
+
+struct QueryContext {
+    TimeSeriesSample* out;
+    size_t found;
+    size_t maxSamples;
+};
+
+static bool collectSample(const TimeSeriesSample& sample, void* context) {
+    QueryContext* query = static_cast<QueryContext*>(context);
+    query->out[query->found++] = sample;
+    return query->found < query->maxSamples;
+}
+
+size_t TimeSeries::query(uint32_t from, uint32_t to, TimeSeriesSample* out, size_t maxSamples) const {
+    if (maxSamples == 0) {
+        return 0;
+    }
+
+    QueryContext query = {out, 0, maxSamples};
+    visit(from, to, collectSample, &query);
+    return query.found;
+}
+
+bool TimeSeries::getRange(uint32_t& first, uint32_t& last) const {
+    if (!blocks) {
+        return false;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool any = used > 0;
+    if (any) {
+        first = blocks[(head + blockCount - (used - 1)) % blockCount].firstTime;
+        last = blocks[head].lastTime;
+    }
+    xSemaphoreGive(mutex);
+    return any;
+}
+
+uint32_t TimeSeries::getSampleCount() const {
+    if (!blocks) {
+        return 0;
+    }
+
+    uint32_t count = 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (uint16_t i = 0; i < used; i++) {
+        count += blocks[(head + blockCount - i) % blockCount].count;
+    }
+    xSemaphoreGive(mutex);
+    return count;
+}
+
+size_t TimeSeries::getBytesUsed() const {
+    if (!blocks || used == 0) {
+        return 0;
+    }
+
+    // Full blocks, and the head up to its last bit
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    size_t bytes = (size_t)(used - 1) * sizeof(TimeSeriesBlock) + 16 + (blocks[head].bits + 7) / 8;
+    xSemaphoreGive(mutex);
+    return bytes;
+}
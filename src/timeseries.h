@@ -0,0 +1,127 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// ===========================
+// Time Series
+// Compressed ring of (millis, value) samples for one sensor channel, in
+// PSRAM, with range queries by time
+// ===========================
+
+// Samples go into fixed blocks; each block starts with its first sample in
+// full and codes the rest as bit fields, so any block decodes on its own and
+// the ring drops whole blocks, oldest first, when it wraps.
+//
+// Timestamps are Gorilla's delta-of-delta - a steady sample rate costs one
+// bit. Values are quantized to the channel's resolution and stored as the
+// delta from the previous one in the same prefix buckets. Sensor readings
+// are noisy in their low mantissa bits, which defeats Gorilla's float XOR;
+// quantized deltas of a slowly changing signal take 6-10 bits.
+//
+//   timestamp delta-of-delta            value delta (in resolution steps)
+//   0                 0                 0                 0
+//   10   + 7 bits     -63..64           10   + 4 bits     -7..8
+//   110  + 9 bits     -255..256         110  + 7 bits     -63..64
+//   1110 + 12 bits    -2047..2048       1110 + 12 bits    -2047..2048
+//   1111 + 32 bits    anything          1111 + 32 bits    anything
+
+#define TIMESERIES_BLOCK_SIZE      512     // Bytes, header included
+#define TIMESERIES_MAX_SAMPLE_BITS 72      // Worst case for one sample, both fields 1111 + 32
+
+struct TimeSeriesSample {
+    uint32_t time;          // millis()
+    float value;
+};
+
+struct TimeSeriesBlock {
+    uint32_t firstTime;
+    uint32_t lastTime;
+    int32_t firstValue;     // Quantized
+    uint16_t count;
+    uint16_t bits;          // Used in data
+    uint8_t data[TIMESERIES_BLOCK_SIZE - 16];
+};
+
+// Called oldest first; false stops the walk
+typedef bool (*TimeSeriesVisitor)(const TimeSeriesSample& sample, void* context);
+
+// ===========================
+// Block Codec
+// One block on its own, for stores that keep blocks somewhere other than
+// the ring (the base station's column files)
+// ===========================
+
+// Encoder state after a block's last sample
+struct TimeSeriesCursor {
+    uint32_t prevTime;
+    int32_t prevDelta;
+    int32_t prevValue;
+};
+
+int32_t timeSeriesQuantize(float value, float resolution);
+void timeSeriesStartBlock(TimeSeriesBlock& block, TimeSeriesCursor& cursor, uint32_t time, int32_t value);
+
+// false when the sample doesn't fit - it starts the next block instead.
+// time must be past cursor.prevTime
+bool timeSeriesAppend(TimeSeriesBlock& block, TimeSeriesCursor& cursor, uint32_t time, int32_t value);
+
+// The block's samples with from <= time <= to, oldest first; false if the
+// visitor stopped the walk. visited counts the samples handed over
+bool timeSeriesDecode(const TimeSeriesBlock& block, float resolution, uint32_t from, uint32_t to,
+                      TimeSeriesVisitor visitor, void* context, size_t& visited);
+
+// The cursor after the block's last sample, to carry on appending to it
+void timeSeriesResume(const TimeSeriesBlock& block, TimeSeriesCursor& cursor);
+
+class TimeSeries {
+public:
+    TimeSeries();
+    ~TimeSeries();
+
+    // resolution is the quantization step, in the value's units
+    bool begin(const char* name, float resolution, uint16_t blockCount);
+    void end();
+
+    // Samples must arrive in time order, at most one per millisecond; false
+    // if not begun or out of order
+    bool append(uint32_t time, float value);
+
+    // Samples with from <= time <= to, oldest first, at most maxSamples of
+    // them. For more, query again from the last time returned + 1
+    size_t query(uint32_t from, uint32_t to, TimeSeriesSample* out, size_t maxSamples) const;
+
+    // Every sample with from <= time <= to, decoded once, without a buffer;
+    // the number visited
+    size_t visit(uint32_t from, uint32_t to, TimeSeriesVisitor visitor, void* context) const;
+
+    // Oldest and newest stored sample; false when empty
+    bool getRange(uint32_t& first, uint32_t& last) const;
+
+    const char* getName() const { return name; }
+    float getResolution() const { return resolution; }
+    uint32_t getSampleCount() const;
+    size_t getBytesUsed() const;
+    size_t getCapacityBytes() const { return (size_t)blockCount * sizeof(TimeSeriesBlock); }
+    uint32_t getDroppedBlocks() const { return droppedBlocks; }
+
+private:
+    const char* name;
+    float resolution;
+    TimeSeriesBlock* blocks;    // PSRAM ring
+    uint16_t blockCount;
+    uint16_t head;              // Block being written
+    uint16_t used;              // Blocks holding samples, head included
+    uint32_t droppedBlocks;
+    SemaphoreHandle_t mutex;    // append() from loop(), queries from the web and radio tasks
+
+    // Encoder state for the head block
+    TimeSeriesCursor cursor;
+
+    void startBlock(uint32_t time, int32_t value);
+};
+
+#endif // TIMESERIES_H
@@ -0,0 +1,260 @@
+#include "trace_buffer.h"
+#include <cstdarg>
+#include <esp_heap_caps.h>
+#include "memory_ledger.h"
+
+static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0, "TRACE_BUFFER_EVENTS must be a power of two");
+static_assert((TRACE_FALLBACK_EVENTS & (TRACE_FALLBACK_EVENTS - 1)) == 0, "TRACE_FALLBACK_EVENTS must be a power of two");
+static_assert(TRACE_MAX_TASKS <= 256, "TraceEvent::task is a byte");
+
+// The scheduler's hook may run with the flash cache off
+#if TRACE_TASK_SWITCHES
+#define TRACE_IRAM IRAM_ATTR
+#else
+#define TRACE_IRAM
+#endif
+
+static TraceBuffer traceInstance;
+
+TraceBuffer& Trace() {
+    return traceInstance;
+}
+
+TraceBuffer::TraceBuffer() {
+    events = nullptr;
+    capacity = 0;
+    inPsram = false;
+    enabled = false;
+    exporting = false;
+    resumeEnabled = false;
+    head = 0;
+    portMUX_INITIALIZE(&lock);
+
+    memset(taskHandles, 0, sizeof(taskHandles));
+    memset(taskNames, 0, sizeof(taskNames));
+    strncpy(taskNames[TRACE_MAX_TASKS - 1], "other", TRACE_TASK_NAME_MAX - 1);
+    taskCount = 0;
+}
+
+bool TraceBuffer::begin() {
+    if (events) {
+        return true;
+    }
+
+    uint32_t count = TRACE_BUFFER_EVENTS;
+    TraceEvent* ring = nullptr;
+    if (TRACE_BUFFER_IN_PSRAM) {
+        ring = (TraceEvent*)memAllocCaps(MemTag::LOGGING, count * sizeof(TraceEvent), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    bool psram = ring != nullptr;
+    if (!ring) {
+        count = TRACE_FALLBACK_EVENTS;
+        ring = (TraceEvent*)memAllocCaps(MemTag::LOGGING, count * sizeof(TraceEvent), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!ring) {
+        Serial.println("Trace: No memory for the event ring");
+        return false;
+    }
+
+    portENTER_CRITICAL(&lock);
+    events = ring;
+    capacity = count;
+    inPsram = psram;
+    head = 0;
+    enabled = true;
+    portEXIT_CRITICAL(&lock);
+    Serial.printf("Trace: %lu events in %s\n", (unsigned long)count, psram ? "PSRAM" : "internal RAM");
+    return true;
+}
+
+void TraceBuffer::setEnabled(bool enable) {
+    portENTER_CRITICAL(&lock);
+    if (exporting) {
+        resumeEnabled = enable;         // Takes effect when the export is done
+    } else {
+        enabled = enable && events;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void TraceBuffer::clear() {
+    portENTER_CRITICAL(&lock);
+    head = 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+const TraceEvent& TraceBuffer::getEvent(uint32_t index) const {
+    uint32_t start = head > capacity ? head - capacity : 0;
+    return events[(start + index) & (capacity - 1)];
+}
+
+// ===========================
+// Recording
+// ===========================
+
+void TRACE_IRAM TraceBuffer::record(TraceEventType type, const char* name) {
+    uint32_t now = micros();
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    uint8_t core = (uint8_t)xPortGetCoreID();
+
+    portENTER_CRITICAL_SAFE(&lock);
+    if (enabled) {          // Again, under the lock an export takes to pause
+        TraceEvent& event = events[head & (capacity - 1)];
+        event.timestamp = now;
+        event.name = name;
+        event.type = type;
+        event.core = core;
+        event.task = taskIndex(task);
+        event.reserved = 0;
+        head++;
+    }
+    portEXIT_CRITICAL_SAFE(&lock);
+}
+
+void TRACE_IRAM TraceBuffer::taskSwitched() {
+    if (enabled) {
+        record(TraceEventType::SWITCH, nullptr);
+    }
+}
+
+// Tasks past the table's size share its last row
+uint8_t TRACE_IRAM TraceBuffer::taskIndex(TaskHandle_t task) {
+    for (uint8_t i = 0; i < taskCount; i++) {
+        if (taskHandles[i] == task) {
+            return i;
+        }
+    }
+    if (taskCount == TRACE_MAX_TASKS - 1) {
+        return TRACE_MAX_TASKS - 1;
+    }
+    taskHandles[taskCount] = task;
+    strncpy(taskNames[taskCount], pcTaskGetName(task), TRACE_TASK_NAME_MAX - 1);
+    return taskCount++;
+}
+
+#if TRACE_TASK_SWITCHES
+extern "C" void IRAM_ATTR traceTaskSwitchedIn(void) {
+    Trace().taskSwitched();
+}
+#endif
+
+// ===========================
+// Export
+// ===========================
+
+// Output gathered into TRACE_CHUNK_BYTES pieces
+struct TraceOutput {
+    TraceWriteFn write;
+    void* context;
+    char chunk[TRACE_CHUNK_BYTES];
+    size_t used;
+    bool first;             // No comma before the first event
+    bool ok;
+};
+
+static void flushOutput(TraceOutput& out) {
+    if (out.ok && out.used) {
+        out.ok = out.write(out.context, out.chunk, out.used);
+    }
+    out.used = 0;
+}
+
+static void appendOutput(TraceOutput& out, const char* format, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length <= 0) {
+        return;
+    }
+    if ((size_t)length >= sizeof(line)) {
+        length = sizeof(line) - 1;
+    }
+    if (out.used + length > sizeof(out.chunk)) {
+        flushOutput(out);
+    }
+    memcpy(out.chunk + out.used, line, length);
+    out.used += length;
+}
+
+// One trace event object, comma first unless it's the first
+static void appendEvent(TraceOutput& out, const char* format, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    appendOutput(out, out.first ? "%s" : ",%s", line);
+    out.first = false;
+}
+
+bool TraceBuffer::exportJson(TraceWriteFn write, void* context) {
+    // One export at a time, so the output buffer can be static
+    static TraceOutput out;
+
+    portENTER_CRITICAL(&lock);
+    if (exporting || !events) {
+        portEXIT_CRITICAL(&lock);
+        return false;
+    }
+    exporting = true;
+    resumeEnabled = enabled;
+    enabled = false;
+    uint32_t end = head;
+    uint8_t tasks = taskCount;
+    portEXIT_CRITICAL(&lock);
+
+    out.write = write;
+    out.context = context;
+    out.used = 0;
+    out.first = true;
+    out.ok = true;
+
+    uint32_t start = end > capacity ? end - capacity : 0;
+    uint32_t mask = capacity - 1;
+    uint32_t base = end > start ? events[start & mask].timestamp : 0;
+
+    appendOutput(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    appendEvent(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"cores\"}}");
+    appendEvent(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"tasks\"}}");
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        appendEvent(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"core %u\"}}",
+                    core, core);
+    }
+    for (uint8_t i = 0; i < TRACE_MAX_TASKS; i++) {
+        if (i < tasks || (i == TRACE_MAX_TASKS - 1 && tasks == TRACE_MAX_TASKS - 1)) {
+            appendEvent(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                        i, taskNames[i]);
+        }
+    }
+
+    // A switch ends the slice the core's previous one opened
+    bool running[portNUM_PROCESSORS] = {};
+    for (uint32_t i = start; i != end && out.ok; i++) {
+        const TraceEvent& event = events[i & mask];
+        unsigned long ts = event.timestamp - base;
+        if (event.type == TraceEventType::SWITCH) {
+            if (event.core < portNUM_PROCESSORS && running[event.core]) {
+                appendEvent(out, "{\"ph\":\"E\",\"ts\":%lu,\"pid\":0,\"tid\":%u}", ts, event.core);
+            }
+            appendEvent(out, "{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%lu,\"pid\":0,\"tid\":%u}",
+                        taskNames[event.task], ts, event.core);
+            if (event.core < portNUM_PROCESSORS) {
+                running[event.core] = true;
+            }
+        } else {
+            appendEvent(out, "{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%lu,\"pid\":1,\"tid\":%u,\"args\":{\"core\":%u}}",
+                        event.name ? event.name : "?", event.type == TraceEventType::BEGIN ? "B" : "E",
+                        ts, event.task, event.core);
+        }
+    }
+    appendOutput(out, "]}");
+    flushOutput(out);
+
+    portENTER_CRITICAL(&lock);
+    exporting = false;
+    enabled = resumeEnabled;
+    portEXIT_CRITICAL(&lock);
+    return out.ok;
+}
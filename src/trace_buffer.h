@@ -0,0 +1,124 @@
+#ifndef TRACE_BUFFER_H
+#define TRACE_BUFFER_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// ===========================
+// Trace Buffer
+// Begin/end events from the stage scopes and code timers, and optionally
+// FreeRTOS task switches, kept for a Chrome trace / Perfetto timeline
+// ===========================
+
+// An event is a micros() timestamp, a name pointer (flash - a stage's or a
+// DEBUG_TIMER's literal), the core and the task it ran on: 12 bytes in a
+// ring begin() puts in PSRAM, overwriting the oldest. Recording is on from
+// begin() and costs the timestamp and a few stores under a spinlock.
+//
+// exportJson() pauses recording, writes the ring as Chrome trace JSON (the
+// format ui.perfetto.dev and chrome://tracing both open) and resumes. Scope
+// events go on one track per task in the "tasks" process, their core as an
+// argument; switches go on one track per core in the "cores" process, the
+// task that ran as the slice. Timestamps are microseconds from the oldest
+// event, so a ring spanning more than micros()' 71-minute wrap is not
+// supported - 8192 events last minutes at the stages' rates.
+//
+// The switch hook needs a FreeRTOS built with traceTASK_SWITCHED_IN()
+// defined as traceTaskSwitchedIn() - an IDF build with its own FreeRTOS
+// config; the Arduino core's prebuilt kernel has no hook, and without it
+// the per-task scope tracks are the timeline. TRACE_TASK_SWITCHES compiles
+// the hook in; it runs inside the scheduler, so the ring must then be in
+// internal RAM (TRACE_BUFFER_IN_PSRAM 0), reachable with the cache off.
+
+#define TRACE_BUFFER_EVENTS         8192    // PSRAM, power of two
+#define TRACE_FALLBACK_EVENTS       256     // Internal RAM, without PSRAM; power of two
+#define TRACE_MAX_TASKS             32      // Distinct tasks named in one ring
+#define TRACE_TASK_NAME_MAX         16      // configMAX_TASK_NAME_LEN
+#define TRACE_CHUNK_BYTES           1024    // exportJson() writes in pieces this big
+
+#ifndef TRACE_TASK_SWITCHES
+#define TRACE_TASK_SWITCHES         0
+#endif
+
+#ifndef TRACE_BUFFER_IN_PSRAM
+#define TRACE_BUFFER_IN_PSRAM       !TRACE_TASK_SWITCHES
+#endif
+
+enum class TraceEventType : uint8_t {
+    BEGIN = 0,
+    END,
+    SWITCH              // The task now running on the core
+};
+
+struct TraceEvent {
+    uint32_t timestamp;         // micros()
+    const char* name;           // In flash; nullptr for a switch
+    TraceEventType type;
+    uint8_t core;
+    uint8_t task;               // Index into the task table
+    uint8_t reserved;
+};
+
+// Gets one piece of the export; false stops it
+typedef bool (*TraceWriteFn)(void* context, const char* data, size_t length);
+
+class TraceBuffer {
+public:
+    TraceBuffer();
+
+    bool begin();
+    void setEnabled(bool enable);
+    bool isEnabled() const { return enabled; }
+
+    // Any task; nothing while disabled
+    void beginScope(const char* name) { if (enabled) record(TraceEventType::BEGIN, name); }
+    void endScope(const char* name) { if (enabled) record(TraceEventType::END, name); }
+    void taskSwitched();                    // From the scheduler's hook
+
+    // The ring, oldest first, as Chrome trace JSON; false if write gave up
+    bool exportJson(TraceWriteFn write, void* context);
+
+    // Starts the ring over; the task table is kept
+    void clear();
+
+    // Event i from the oldest kept - read them with recording disabled
+    uint32_t getEventCount() const { return head < capacity ? head : capacity; }
+    const TraceEvent& getEvent(uint32_t index) const;
+    const char* getTaskName(uint8_t task) const { return task < TRACE_MAX_TASKS ? taskNames[task] : "?"; }
+
+    uint32_t getRecorded() const { return head; }
+    uint32_t getCapacity() const { return capacity; }
+    bool isInPsram() const { return inPsram; }
+
+private:
+    TraceEvent* events;
+    uint32_t capacity;
+    bool inPsram;
+    volatile bool enabled;
+    bool exporting;
+    bool resumeEnabled;         // What enabled goes back to after the export
+    uint32_t head;              // Events ever recorded, under lock
+    mutable portMUX_TYPE lock;
+
+    // Tasks seen, in order of first event
+    TaskHandle_t taskHandles[TRACE_MAX_TASKS];
+    char taskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_MAX];
+    uint8_t taskCount;
+
+    void record(TraceEventType type, const char* name);
+    uint8_t taskIndex(TaskHandle_t task);   // Caller holds lock
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern TraceBuffer& Trace();
+
+#if TRACE_TASK_SWITCHES
+extern "C" void traceTaskSwitchedIn(void);
+#endif
+
+#endif // TRACE_BUFFER_H
@@ -0,0 +1,261 @@
+#include "track_history.h"
+#include <math.h>
+
+#define TRACK_METRES_PER_UNIT      0.111319f   // 1e-6 degrees of latitude
+
+static size_t putVarint(uint8_t* out, size_t space, uint32_t value) {
+    size_t used = 0;
+    do {
+        if (used == space) {
+            return 0;
+        }
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[used++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return used;
+}
+
+static bool getVarint(const uint8_t*& in, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (in == end) {
+            return false;
+        }
+        uint8_t byte = *in++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// One point as the difference from previous, or whole when there is none; 0 if it doesn't fit
+static size_t putPoint(uint8_t* out, size_t space, const TrackPoint& point, const TrackPoint* previous) {
+    uint32_t fields[4];
+    if (previous) {
+        fields[0] = point.time - previous->time;
+        fields[1] = zigzag(point.latitude - previous->latitude);
+        fields[2] = zigzag(point.longitude - previous->longitude);
+        fields[3] = zigzag(point.altitude - previous->altitude);
+    } else {
+        fields[0] = point.time;
+        fields[1] = zigzag(point.latitude);
+        fields[2] = zigzag(point.longitude);
+        fields[3] = zigzag(point.altitude);
+    }
+    size_t used = 0;
+    for (uint32_t field : fields) {
+        size_t length = putVarint(out + used, space - used, field);
+        if (length == 0) {
+            return 0;
+        }
+        used += length;
+    }
+    return used;
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+TrackHistory::TrackHistory() {
+    nextIndex = 0;
+    fixes = 0;
+    segments = 0;
+    dropped = 0;
+    bytesSent = 0;
+    reset();
+}
+
+// The numbering carries on, so the ground sees no overlap
+void TrackHistory::reset() {
+    hasAnchor = false;
+    hasLatest = false;
+    memset(&anchor, 0, sizeof(anchor));
+    memset(&latest, 0, sizeof(latest));
+    windowCount = 0;
+    pendingHead = 0;
+    pendingCount = 0;
+}
+
+// ===========================
+// Simplification
+// ===========================
+
+bool TrackHistory::addFix(const GPSData& fix) {
+    if (fix.fixTime == 0 || (hasLatest && fix.fixTime <= latest.time)) {
+        return false;
+    }
+    TrackPoint point;
+    point.time = fix.fixTime;
+    point.latitude = (int32_t)lround(fix.latitude * 1e6);
+    point.longitude = (int32_t)lround(fix.longitude * 1e6);
+    point.altitude = (int32_t)lroundf(fix.altitude);
+    latest = point;
+    hasLatest = true;
+    fixes++;
+
+    if (!hasAnchor) {
+        anchor = point;
+        hasAnchor = true;
+        keep(point);
+        return true;
+    }
+    if (windowCount > 0 && (windowCount == TRACK_WINDOW_MAX || !fits(point))) {
+        anchor = window[windowCount - 1];
+        keep(anchor);
+        windowCount = 0;
+        window[windowCount++] = point;
+        return true;
+    }
+    window[windowCount++] = point;
+    return false;
+}
+
+// Every fix since the anchor within tolerance of anchor -> end at its own time
+bool TrackHistory::fits(const TrackPoint& end) const {
+    float span = end.time - anchor.time;
+    float metresPerLongitude = TRACK_METRES_PER_UNIT * cosf(anchor.latitude * 1e-6f * (float)M_PI / 180.0f);
+    float tolerance2 = TRACK_TOLERANCE_M * TRACK_TOLERANCE_M;
+    for (uint16_t i = 0; i < windowCount; i++) {
+        const TrackPoint& p = window[i];
+        float f = (p.time - anchor.time) / span;
+        float north = (p.latitude - (anchor.latitude + f * (end.latitude - anchor.latitude))) * TRACK_METRES_PER_UNIT;
+        float east = (p.longitude - (anchor.longitude + f * (end.longitude - anchor.longitude))) * metresPerLongitude;
+        float up = p.altitude - (anchor.altitude + f * (end.altitude - anchor.altitude));
+        if (north * north + east * east > tolerance2 || fabsf(up) > TRACK_ALT_TOLERANCE_M) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TrackHistory::keep(const TrackPoint& point) {
+    if (pendingCount == TRACK_PENDING_MAX) {
+        pendingHead = (pendingHead + 1) % TRACK_PENDING_MAX;
+        pendingCount--;
+        dropped++;
+    }
+    pending[(pendingHead + pendingCount) % TRACK_PENDING_MAX] = point;
+    pendingCount++;
+    nextIndex++;
+}
+
+// ===========================
+// Segments
+// ===========================
+
+size_t TrackHistory::takeSegment(uint8_t* out, size_t space) {
+    if (pendingCount == 0 || space < 4) {
+        return 0;
+    }
+    uint32_t firstIndex = nextIndex - pendingCount;
+
+    // The point count goes ahead of the points; at most TRACK_SEGMENT_MAX_POINTS, one varint byte
+    size_t header = 1 + putVarint(out + 1, space - 1, firstIndex);
+    size_t used = header + 1;
+    uint8_t taken = 0;
+    const TrackPoint* previous = nullptr;
+    while (taken < pendingCount && taken < TRACK_SEGMENT_MAX_POINTS - 1) {
+        const TrackPoint& point = pending[(pendingHead + taken) % TRACK_PENDING_MAX];
+        size_t length = putPoint(out + used, space - used, point, previous);
+        if (length == 0) {
+            break;
+        }
+        used += length;
+        previous = &point;
+        taken++;
+    }
+    if (taken == 0) {
+        return 0;
+    }
+
+    out[0] = 0;
+    uint8_t count = taken;
+    if (hasLatest && latest.time > previous->time) {
+        size_t length = putPoint(out + used, space - used, latest, previous);
+        if (length) {
+            used += length;
+            out[0] |= TRACK_FLAG_LATEST;
+            count++;
+        }
+    }
+    out[header] = count;
+
+    pendingHead = (pendingHead + taken) % TRACK_PENDING_MAX;
+    pendingCount -= taken;
+    segments++;
+    bytesSent += used;
+    return used;
+}
+
+// The points start at in, once it returns true
+static bool readHeader(const uint8_t*& in, const uint8_t* end, uint8_t& flags, uint32_t& firstIndex, uint8_t& count) {
+    uint32_t points;
+    if (in == end) {
+        return false;
+    }
+    flags = *in++;
+    if (!getVarint(in, end, firstIndex) || !getVarint(in, end, points) || points == 0 ||
+        points > TRACK_SEGMENT_MAX_POINTS) {
+        return false;
+    }
+    count = points;
+    return true;
+}
+
+bool trackHeader(const uint8_t* payload, size_t length, uint8_t& flags, uint32_t& firstIndex, uint8_t& count) {
+    return readHeader(payload, payload + length, flags, firstIndex, count);
+}
+
+bool trackDecode(const uint8_t* payload, size_t length, TrackSegment& segment) {
+    const uint8_t* in = payload;
+    const uint8_t* end = payload + length;
+    uint8_t count;
+    if (!readHeader(in, end, segment.flags, segment.firstIndex, count)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t fields[4];
+        for (uint32_t& field : fields) {
+            if (!getVarint(in, end, field)) {
+                return false;
+            }
+        }
+        TrackPoint& point = segment.points[i];
+        if (i == 0) {
+            point.time = fields[0];
+            point.latitude = unzigzag(fields[1]);
+            point.longitude = unzigzag(fields[2]);
+            point.altitude = unzigzag(fields[3]);
+        } else {
+            const TrackPoint& previous = segment.points[i - 1];
+            point.time = previous.time + fields[0];
+            point.latitude = previous.latitude + unzigzag(fields[1]);
+            point.longitude = previous.longitude + unzigzag(fields[2]);
+            point.altitude = previous.altitude + unzigzag(fields[3]);
+        }
+    }
+    segment.count = count;
+    return true;
+}
+
+// ===========================
+// Status
+// ===========================
+
+void TrackHistory::printStatus() const {
+    Serial.printf("Track: %lu fixes, %lu vertices (%.1f%%), %u pending, %lu dropped, %lu segments, %lu bytes\n",
+                  (unsigned long)fixes, (unsigned long)nextIndex, fixes ? 100.0f * nextIndex / fixes : 0.0f,
+                  pendingCount, (unsigned long)dropped, (unsigned long)segments, (unsigned long)bytesSent);
+}
@@ -0,0 +1,116 @@
+#ifndef TRACK_HISTORY_H
+#define TRACK_HISTORY_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include "common_types.h"
+
+// ===========================
+// Track History
+// The flight path as the few fixes that keep its shape, sent in bulk
+// TRACK_SEGMENT packets that survive what the live position reports lose
+// ===========================
+
+// Simplification is the opening window - Douglas-Peucker run online: from
+// the last vertex kept (the anchor), each new fix is tried as the end of a
+// straight segment, and the fixes in between are checked against where dead
+// reckoning along it puts them at their own time (synchronized Euclidean
+// distance, so a change of speed counts, not only a turn). Once one is off
+// by more than TRACK_TOLERANCE_M across or TRACK_ALT_TOLERANCE_M up, the
+// fix before becomes a vertex and the new anchor. Each fix costs a pass
+// over the window, at most TRACK_WINDOW_MAX; a full window keeps its
+// newest fix whatever the error. A 5 m/s climb through still air is one
+// vertex per window; a loop in the jet stream a vertex every few fixes.
+//
+// Vertices wait in a ring of TRACK_PENDING_MAX for takeSegment(), which
+// numbers them from boot: a segment that never arrives is a gap in the
+// numbers, and one the link backlog brings late fills it. A full ring
+// drops its oldest.
+//
+// TRACK_SEGMENT payload, LEB128 varints, signed ones zigzagged:
+//   [0]     flags: TRACK_FLAG_LATEST - the last point is the newest fix,
+//           not a vertex, and has no index
+//   varint  index of the first vertex
+//   varint  points
+//   first point: time (UTC s), latitude, longitude (1e-6 degrees), altitude (m)
+//   each after: the differences from the one before, the same fields
+//
+// addFix() and takeSegment() run on one task.
+
+#define TRACK_TOLERANCE_M          20.0f   // Across, off the dead-reckoned position
+#define TRACK_ALT_TOLERANCE_M      15.0f
+#define TRACK_WINDOW_MAX           120     // Fixes since the anchor - 2 minutes at 1 Hz
+#define TRACK_PENDING_MAX          128     // Vertices waiting for a segment
+#define TRACK_SEGMENT_MAX_BYTES    96      // Within an UplinkRequest
+#define TRACK_SEGMENT_MAX_POINTS   48      // Decoded per segment, at the best case of 2 bytes a point
+
+#define TRACK_FLAG_LATEST          0x01
+
+struct TrackPoint {
+    uint32_t time;              // UTC seconds
+    int32_t latitude;           // 1e-6 degrees
+    int32_t longitude;
+    int32_t altitude;           // m
+};
+
+struct TrackSegment {
+    uint8_t flags;
+    uint32_t firstIndex;
+    uint8_t count;              // Points, the latest included
+    TrackPoint points[TRACK_SEGMENT_MAX_POINTS];
+};
+
+class TrackHistory {
+public:
+    TrackHistory();
+
+    void reset();
+
+    // A locked fix with its UTC time; one per second, later ones ignored.
+    // true when it made the fix before a vertex
+    bool addFix(const GPSData& fix);
+
+    // The oldest pending vertices that fit, and the newest fix after them
+    // if it does, into out; the length, 0 with no vertex pending
+    size_t takeSegment(uint8_t* out, size_t space);
+
+    uint32_t getFixes() const { return fixes; }
+    uint32_t getVertices() const { return nextIndex; }
+    uint16_t getPending() const { return pendingCount; }
+    uint32_t getSegments() const { return segments; }
+    uint32_t getDropped() const { return dropped; }
+    void printStatus() const;
+
+private:
+    bool hasAnchor;
+    bool hasLatest;
+    TrackPoint anchor;
+    TrackPoint latest;
+    TrackPoint window[TRACK_WINDOW_MAX];    // Fixes since the anchor, oldest first
+    uint16_t windowCount;
+
+    TrackPoint pending[TRACK_PENDING_MAX];
+    uint16_t pendingHead;
+    uint16_t pendingCount;
+    uint32_t nextIndex;         // Of the next vertex kept
+    uint32_t fixes;
+    uint32_t segments;
+    uint32_t dropped;           // Pending vertices written over
+    uint32_t bytesSent;
+
+    bool fits(const TrackPoint& end) const;
+    void keep(const TrackPoint& point);
+};
+
+// false for a payload that doesn't parse
+bool trackDecode(const uint8_t* payload, size_t length, TrackSegment& segment);
+// Only the flags, first index and point count, with no TrackSegment to fill
+bool trackHeader(const uint8_t* payload, size_t length, uint8_t& flags, uint32_t& firstIndex, uint8_t& count);
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern TrackHistory& Track();
+
+#endif // TRACK_HISTORY_H
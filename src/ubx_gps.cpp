@@ -0,0 +1,246 @@
+#include "ubx_gps.h"
+#include <time.h>
+
+#define UBX_VALSET_HEADER_LEN      4       // Version, layers, reserved
+#define UBX_LAYER_RAM              0x01
+#define UBX_PMREQ_BACKUP           0x02
+#define UBX_PMREQ_FORCE            0x04    // Even with the UART still in use
+#define UBX_PMREQ_WAKE_UARTRX      0x08
+#define UBX_MGA_INI_POS_LLH        0x01
+#define UBX_MGA_INI_TIME_UTC       0x10
+
+static uint16_t readLE16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t readLE32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Value bytes from the key's size field: 1 bit and 1 byte both take a byte
+static uint8_t keyValueSize(uint32_t key) {
+    switch ((key >> 28) & 0x07) {
+        case 1:
+        case 2: return 1;
+        case 3: return 2;
+        case 4: return 4;
+        default: return 0;  // 8-byte values aren't used here
+    }
+}
+
+// ===========================
+// Parser
+// ===========================
+
+UbxParser::UbxParser() {
+    checksumErrors = 0;
+    reset();
+}
+
+void UbxParser::reset() {
+    state = State::SYNC_1;
+    msgClass = 0;
+    msgId = 0;
+    length = 0;
+    received = 0;
+}
+
+void UbxParser::checksum(uint8_t b) {
+    ckA += b;
+    ckB += ckA;
+}
+
+bool UbxParser::feed(uint8_t b) {
+    switch (state) {
+        case State::SYNC_1:
+            if (b == UBX_SYNC_1) {
+                state = State::SYNC_2;
+            }
+            break;
+        case State::SYNC_2:
+            state = b == UBX_SYNC_2 ? State::CLASS : (b == UBX_SYNC_1 ? State::SYNC_2 : State::SYNC_1);
+            break;
+        case State::CLASS:
+            ckA = ckB = 0;
+            checksum(b);
+            msgClass = b;
+            state = State::ID;
+            break;
+        case State::ID:
+            checksum(b);
+            msgId = b;
+            state = State::LENGTH_1;
+            break;
+        case State::LENGTH_1:
+            checksum(b);
+            length = b;
+            state = State::LENGTH_2;
+            break;
+        case State::LENGTH_2:
+            checksum(b);
+            length |= b << 8;
+            received = 0;
+            if (length > UBX_MAX_PAYLOAD) {
+                state = State::SYNC_1;  // Not one of ours, or noise that looked like sync
+            } else {
+                state = length ? State::PAYLOAD : State::CK_A;
+            }
+            break;
+        case State::PAYLOAD:
+            checksum(b);
+            payload[received++] = b;
+            if (received == length) {
+                state = State::CK_A;
+            }
+            break;
+        case State::CK_A:
+            rxCkA = b;
+            state = State::CK_B;
+            break;
+        case State::CK_B:
+            state = State::SYNC_1;
+            if (rxCkA == ckA && b == ckB) {
+                return true;
+            }
+            checksumErrors++;
+            break;
+    }
+    return false;
+}
+
+// ===========================
+// Messages
+// ===========================
+
+// Sync, class, id and length ahead of the payload already at out + 6, the checksum after it
+static size_t finishFrame(uint8_t* out, uint8_t msgClass, uint8_t msgId, size_t payloadLength) {
+    out[0] = UBX_SYNC_1;
+    out[1] = UBX_SYNC_2;
+    out[2] = msgClass;
+    out[3] = msgId;
+    out[4] = payloadLength & 0xFF;
+    out[5] = payloadLength >> 8;
+
+    uint8_t* p = out + 6 + payloadLength;
+    uint8_t ckA = 0;
+    uint8_t ckB = 0;
+    for (uint8_t* c = out + 2; c < p; c++) {
+        ckA += *c;
+        ckB += ckA;
+    }
+    *p++ = ckA;
+    *p++ = ckB;
+    return p - out;
+}
+
+static uint8_t* writeLE(uint8_t* p, uint32_t value, uint8_t bytes) {
+    for (uint8_t b = 0; b < bytes; b++) {
+        *p++ = (value >> (8 * b)) & 0xFF;
+    }
+    return p;
+}
+
+size_t ubxBuildValset(uint8_t* out, size_t size, const UbxConfigItem* items, uint8_t count) {
+    size_t payloadLength = UBX_VALSET_HEADER_LEN;
+    for (uint8_t i = 0; i < count; i++) {
+        payloadLength += 4 + keyValueSize(items[i].key);
+    }
+    if (count > UBX_VALSET_MAX_ITEMS || payloadLength + UBX_FRAME_OVERHEAD > size) {
+        return 0;
+    }
+
+    uint8_t* p = out + 6;
+    *p++ = 0;                   // Version
+    *p++ = UBX_LAYER_RAM;
+    *p++ = 0;                   // Reserved
+    *p++ = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t key = items[i].key;
+        p = writeLE(p, key, 4);
+        p = writeLE(p, items[i].value, keyValueSize(key));
+    }
+    return finishFrame(out, UBX_CLASS_CFG, UBX_ID_CFG_VALSET, payloadLength);
+}
+
+size_t ubxBuildBackupRequest(uint8_t* out, size_t size) {
+    if (UBX_PMREQ_LEN + UBX_FRAME_OVERHEAD > size) {
+        return 0;
+    }
+    uint8_t* p = out + 6;
+    memset(p, 0, UBX_PMREQ_LEN);
+    p[0] = 0;                                   // Version
+    writeLE(&p[4], 0, 4);                       // Duration: until woken
+    writeLE(&p[8], UBX_PMREQ_BACKUP | UBX_PMREQ_FORCE, 4);
+    writeLE(&p[12], UBX_PMREQ_WAKE_UARTRX, 4);
+    return finishFrame(out, UBX_CLASS_RXM, UBX_ID_RXM_PMREQ, UBX_PMREQ_LEN);
+}
+
+size_t ubxBuildIniPosition(uint8_t* out, size_t size, int32_t lat, int32_t lon, int32_t altCm, uint32_t accuracyCm) {
+    if (UBX_MGA_INI_POS_LEN + UBX_FRAME_OVERHEAD > size) {
+        return 0;
+    }
+    uint8_t* p = out + 6;
+    *p++ = UBX_MGA_INI_POS_LLH;
+    *p++ = 0;                   // Version
+    *p++ = 0;                   // Reserved
+    *p++ = 0;
+    p = writeLE(p, (uint32_t)lat, 4);
+    p = writeLE(p, (uint32_t)lon, 4);
+    p = writeLE(p, (uint32_t)altCm, 4);
+    writeLE(p, accuracyCm, 4);
+    return finishFrame(out, UBX_CLASS_MGA, UBX_ID_MGA_INI, UBX_MGA_INI_POS_LEN);
+}
+
+size_t ubxBuildIniTime(uint8_t* out, size_t size, uint32_t utcSeconds, uint16_t accuracySeconds) {
+    if (UBX_MGA_INI_TIME_LEN + UBX_FRAME_OVERHEAD > size) {
+        return 0;
+    }
+    time_t utc = utcSeconds;
+    struct tm parts;
+    gmtime_r(&utc, &parts);
+
+    uint8_t* p = out + 6;
+    memset(p, 0, UBX_MGA_INI_TIME_LEN);
+    p[0] = UBX_MGA_INI_TIME_UTC;
+    p[1] = 0;                   // Version
+    p[2] = 0;                   // Reference: on receipt of the message
+    p[3] = (uint8_t)-128;       // Leap seconds unknown
+    writeLE(&p[4], parts.tm_year + 1900, 2);
+    p[6] = parts.tm_mon + 1;
+    p[7] = parts.tm_mday;
+    p[8] = parts.tm_hour;
+    p[9] = parts.tm_min;
+    p[10] = parts.tm_sec;
+    writeLE(&p[16], accuracySeconds, 2);        // ns (12) and tAccNs (20) stay 0
+    return finishFrame(out, UBX_CLASS_MGA, UBX_ID_MGA_INI, UBX_MGA_INI_TIME_LEN);
+}
+
+bool ubxDecodeNavPvt(const uint8_t* payload, uint16_t length, UbxNavPvt& pvt) {
+    if (length != UBX_NAV_PVT_LEN) {
+        return false;
+    }
+
+    pvt.iTOW = readLE32(&payload[0]);
+    pvt.year = readLE16(&payload[4]);
+    pvt.month = payload[6];
+    pvt.day = payload[7];
+    pvt.hour = payload[8];
+    pvt.minute = payload[9];
+    pvt.second = payload[10];
+    pvt.dateValid = payload[11] & 0x01;
+    pvt.timeValid = (payload[11] & 0x06) == 0x06;   // Valid and fully resolved
+    pvt.nano = (int32_t)readLE32(&payload[16]);
+    pvt.fixType = payload[20];
+    pvt.fixOk = payload[21] & 0x01;
+    pvt.numSV = payload[23];
+    pvt.lon = (int32_t)readLE32(&payload[24]);
+    pvt.lat = (int32_t)readLE32(&payload[28]);
+    pvt.hMSL = (int32_t)readLE32(&payload[36]);
+    pvt.hAcc = readLE32(&payload[40]);
+    pvt.vAcc = readLE32(&payload[44]);
+    pvt.velD = (int32_t)readLE32(&payload[56]);
+    pvt.gSpeed = (int32_t)readLE32(&payload[60]);
+    pvt.headMot = (int32_t)readLE32(&payload[64]);
+    pvt.pDOP = readLE16(&payload[76]);
+    return true;
+}
@@ -0,0 +1,152 @@
+#ifndef UBX_GPS_H
+#define UBX_GPS_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// UBX Protocol
+// u-blox binary frames - VALSET configuration, aiding and power requests
+// out, NAV-PVT and ACK in
+// ===========================
+
+// Frame: 0xB5 0x62, class, id, length (LE16), payload, Fletcher-8 CK_A CK_B
+// over class through payload. Generation 9/10 receivers (the MAX-M10S) are
+// configured only through CFG-VALSET key/value pairs; each key carries its
+// value size in bits 28-30. Configuration goes to the RAM layer, so a power
+// cycle returns the receiver to 9600 baud NMEA and initGPS() finds it there.
+
+#define UBX_SYNC_1                 0xB5
+#define UBX_SYNC_2                 0x62
+#define UBX_FRAME_OVERHEAD         8       // Sync, class, id, length, checksum
+#define UBX_MAX_PAYLOAD            100     // NAV-PVT is the largest frame we take
+
+#define UBX_CLASS_NAV              0x01
+#define UBX_CLASS_RXM              0x02
+#define UBX_CLASS_ACK              0x05
+#define UBX_CLASS_CFG              0x06
+#define UBX_CLASS_MGA              0x13
+#define UBX_ID_NAV_PVT             0x07
+#define UBX_ID_ACK_NAK             0x00
+#define UBX_ID_ACK_ACK             0x01
+#define UBX_ID_CFG_VALSET          0x8A
+#define UBX_ID_RXM_PMREQ           0x41
+#define UBX_ID_MGA_INI             0x40
+
+#define UBX_NAV_PVT_LEN            92
+#define UBX_VALSET_MAX_ITEMS       8
+#define UBX_PMREQ_LEN              16
+#define UBX_MGA_INI_POS_LEN        20
+#define UBX_MGA_INI_TIME_LEN       24
+#define UBX_AID_FRAME_MAX          (UBX_FRAME_OVERHEAD + UBX_MGA_INI_TIME_LEN)
+
+// Configuration keys (u-blox M10 interface description)
+#define UBX_KEY_RATE_MEAS                 0x30210001  // U2, ms between measurements
+#define UBX_KEY_RATE_NAV                  0x30210002  // U2, measurements per solution
+#define UBX_KEY_NAVSPG_DYNMODEL           0x20110021  // E1
+#define UBX_KEY_MSGOUT_NAV_PVT_UART1      0x20910007  // U1, per navigation solution
+#define UBX_KEY_UART1_BAUDRATE            0x40520001  // U4
+#define UBX_KEY_UART1OUTPROT_UBX          0x10740001  // L
+#define UBX_KEY_UART1OUTPROT_NMEA         0x10740002  // L
+#define UBX_KEY_PM_OPERATEMODE            0x20D00001  // E1, UBX_PM_*
+#define UBX_KEY_PM_POSUPDATEPERIOD        0x40D00002  // U4, s between on/off fixes
+#define UBX_KEY_PM_ACQPERIOD              0x40D00003  // U4, s before retrying a failed acquisition
+#define UBX_KEY_PM_ONTIME                 0x30D00005  // U2, s tracking after each on/off fix
+
+#define UBX_PM_FULL                0       // Continuous tracking
+#define UBX_PM_PSMOO               1       // On/off: a fix, then off until the next period
+#define UBX_PM_PSMCT               2       // Cyclic tracking at the navigation rate
+
+#define UBX_DYNMODEL_AIRBORNE_1G   6       // No altitude limit short of 50 km; the 12 km cap is the default model's
+#define UBX_DYNMODEL_AIRBORNE_2G   7
+#define UBX_DYNMODEL_AIRBORNE_4G   8
+
+// NAV-PVT fixType
+#define UBX_FIX_NONE               0
+#define UBX_FIX_2D                 2
+#define UBX_FIX_3D                 3
+#define UBX_FIX_GNSS_DR            4
+
+struct UbxConfigItem {
+    uint32_t key;
+    uint32_t value;
+};
+
+// NAV-PVT, in the receiver's units
+struct UbxNavPvt {
+    uint32_t iTOW;          // ms of GPS week
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+    int32_t nano;           // -1e9..1e9, signed offset from second
+    bool dateValid;
+    bool timeValid;
+    uint8_t fixType;
+    bool fixOk;             // Within the receiver's DOP and accuracy masks
+    uint8_t numSV;
+    int32_t lon;            // 1e-7 deg
+    int32_t lat;            // 1e-7 deg
+    int32_t hMSL;           // mm above mean sea level
+    uint32_t hAcc;          // mm
+    uint32_t vAcc;          // mm
+    int32_t velD;           // mm/s, down positive
+    int32_t gSpeed;         // mm/s
+    int32_t headMot;        // 1e-5 deg
+    uint16_t pDOP;          // 0.01
+};
+
+// Byte-at-a-time frame sync; the payload stays valid until the next feed()
+class UbxParser {
+public:
+    UbxParser();
+
+    // True when b completes a frame with a good checksum
+    bool feed(uint8_t b);
+    void reset();
+
+    uint8_t getClass() const { return msgClass; }
+    uint8_t getId() const { return msgId; }
+    uint16_t getLength() const { return length; }
+    const uint8_t* getPayload() const { return payload; }
+    bool is(uint8_t cls, uint8_t id) const { return msgClass == cls && msgId == id; }
+
+    uint32_t getChecksumErrors() const { return checksumErrors; }
+
+private:
+    enum class State : uint8_t { SYNC_1, SYNC_2, CLASS, ID, LENGTH_1, LENGTH_2, PAYLOAD, CK_A, CK_B };
+    State state;
+    uint8_t msgClass;
+    uint8_t msgId;
+    uint16_t length;
+    uint16_t received;
+    uint8_t ckA;
+    uint8_t ckB;
+    uint8_t rxCkA;
+    uint8_t payload[UBX_MAX_PAYLOAD];
+    uint32_t checksumErrors;
+
+    void checksum(uint8_t b);
+};
+
+// CFG-VALSET of the items to the RAM layer; frame length, 0 if out is too small
+size_t ubxBuildValset(uint8_t* out, size_t size, const UbxConfigItem* items, uint8_t count);
+
+// RXM-PMREQ: backup mode until a byte arrives on the receiver's UART RX.
+// Its battery-backed RAM keeps the ephemeris, almanac, last position and
+// its RTC running, so the next start is a hot one; the RAM configuration
+// layer is lost
+size_t ubxBuildBackupRequest(uint8_t* out, size_t size);
+
+// MGA-INI-POS_LLH: a position to start the search from, to within accuracyCm
+size_t ubxBuildIniPosition(uint8_t* out, size_t size, int32_t lat, int32_t lon, int32_t altCm, uint32_t accuracyCm);
+
+// MGA-INI-TIME_UTC: the time now, to within accuracySeconds; leap seconds left to the receiver
+size_t ubxBuildIniTime(uint8_t* out, size_t size, uint32_t utcSeconds, uint16_t accuracySeconds);
+
+// False if the payload isn't a NAV-PVT
+bool ubxDecodeNavPvt(const uint8_t* payload, uint16_t length, UbxNavPvt& pvt);
+
+#endif // UBX_GPS_H
@@ -0,0 +1,297 @@
+#include "ulp_monitor.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_idf_version.h"
+#include "sensor_pins.h"
+#include "battery_adc.h"
+
+#if CONFIG_ULP_COPROC_TYPE_FSM
+#include "ulp.h"
+#include "ulp_adc.h"
+#include "driver/rtc_io.h"
+#include "esp_adc/adc_oneshot.h"
+#include "soc/soc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/rtc_io_reg.h"
+#include "soc/rtc_i2c_reg.h"
+#include "soc/sens_reg.h"
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#define ULP_ADC_ATTEN              ADC_ATTEN_DB_12
+#else
+#define ULP_ADC_ATTEN              ADC_ATTEN_DB_11     // Same setting, older name
+#endif
+
+#ifndef RTC_SLOW_MEM
+#define RTC_SLOW_MEM               ((uint32_t*)SOC_RTC_DATA_LOW)
+#endif
+
+#define ULP_RTCIO_FUNC_I2C         3       // RTC IO mux function of the SAR I2C pads
+#define ULP_I2C_HALF_PERIOD        88      // RTC fast clock cycles, ~100 kHz at 17.5 MHz
+#define ULP_I2C_TIMEOUT            3500    // ~200 us, so a missing sensor can't stall a pass
+
+#define BMP280_REG_PRESS_MSB       0xF7
+#define BMP280_REG_PRESS_LSB       0xF8
+#define BMP280_REG_PRESS_XLSB      0xF9
+
+// Shared with the ULP, 16 bits each in RTC slow memory ahead of the program
+enum UlpWord : uint8_t {
+    WORD_MAGIC = 0,
+    WORD_RUNS,
+    WORD_REASON,
+    WORD_BATTERY,               // Last average, raw
+    WORD_BATTERY_WAKE,          // Below this wakes; 0 = not sampled
+    WORD_PRESSURE_PREV,         // Low 16 bits of adc_P, last pass
+    WORD_PRESSURE_DELTA,        // Change that wakes; 0 = not read
+    WORD_BATTERY_REPORTED,
+    WORD_COUNT
+};
+
+#define ULP_PROGRAM_OFFSET         WORD_COUNT
+
+enum UlpLabel : uint8_t {
+    LABEL_PRESSURE = 1,
+    LABEL_CHANGE_POSITIVE,
+    LABEL_DONE,
+    LABEL_WAKE_BATTERY,
+    LABEL_WAKE_PRESSURE,
+    LABEL_WAKE
+};
+
+static uint16_t readWord(UlpWord word) {
+    return RTC_SLOW_MEM[word] & 0xFFFF;     // The ULP's ST puts its PC in the high half
+}
+#endif
+
+UlpMonitor::UlpMonitor() {
+    memset(&status, 0, sizeof(status));
+    armed = false;
+}
+
+void UlpMonitor::begin() {
+    memset(&status, 0, sizeof(status));
+    armed = false;
+
+#if CONFIG_ULP_COPROC_TYPE_FSM
+    // No pass starts while the words are read; a wake has stopped it already, a timer wake hasn't
+    CLEAR_PERI_REG_MASK(RTC_CNTL_ULP_CP_TIMER_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+
+    // Slow memory outlives other resets, but only a deep sleep wake follows an arm()
+    if (esp_reset_reason() == ESP_RST_DEEPSLEEP && readWord(WORD_MAGIC) == ULP_MONITOR_MAGIC) {
+        status.runs = readWord(WORD_RUNS);
+        if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_ULP) {
+            status.reason = static_cast<UlpWakeReason>(readWord(WORD_REASON));
+        }
+        status.batteryVolts = readWord(WORD_BATTERY) * (float)BATTERY_ADC_UNCAL_FULL_MV / ULP_ADC_FULL_SCALE *
+                              BATTERY_DIVIDER_RATIO * BATTERY_VOLTAGE_TRIM / 1000.0f;
+        status.batteryReported = readWord(WORD_BATTERY_REPORTED) || status.reason == UlpWakeReason::BATTERY;
+        status.valid = status.runs > 0;
+    }
+    RTC_SLOW_MEM[WORD_MAGIC] = 0;
+
+    releasePins();
+#endif
+}
+
+bool UlpMonitor::arm(const UlpMonitorConfig& config) {
+    armed = false;
+
+#if CONFIG_ULP_COPROC_TYPE_FSM
+    // Battery: once per full boot, on the nominal scale
+    adc_unit_t unit = ADC_UNIT_1;
+    adc_channel_t channel = ADC_CHANNEL_0;
+    uint16_t batteryWake = 0;
+    if (config.batteryWakeVolts > 0.0f && !status.batteryReported &&
+        adc_oneshot_io_to_channel(BATTERY_SENSE_PIN, &unit, &channel) == ESP_OK && unit == ADC_UNIT_1) {
+        ulp_adc_cfg_t adc = {};
+        adc.adc_n = ADC_UNIT_1;
+        adc.channel = channel;
+        adc.atten = ULP_ADC_ATTEN;
+        adc.width = ADC_BITWIDTH_12;
+        adc.ulp_mode = ADC_ULP_MODE_FSM;
+        if (ulp_adc_init(&adc) == ESP_OK) {
+            float pinMv = config.batteryWakeVolts * 1000.0f / (BATTERY_DIVIDER_RATIO * BATTERY_VOLTAGE_TRIM);
+            batteryWake = (uint16_t)constrain(pinMv * ULP_ADC_FULL_SCALE / BATTERY_ADC_UNCAL_FULL_MV, 1.0f,
+                                              (float)ULP_ADC_FULL_SCALE);
+        }
+    }
+
+    uint16_t pressureDelta = config.pressureDeltaRaw && setupI2c() ? config.pressureDeltaRaw : 0;
+    if (!batteryWake && !pressureDelta) {
+        return false;
+    }
+
+    const ulp_insn_t program[] = {
+        I_MOVI(R3, 0),                              // Data words from 0
+        I_LD(R0, R3, WORD_RUNS),
+        I_ADDI(R0, R0, 1),
+        I_ST(R0, R3, WORD_RUNS),
+
+        // Battery, averaged over ULP_ADC_SAMPLES
+        I_LD(R0, R3, WORD_BATTERY_WAKE),
+        M_BL(LABEL_PRESSURE, 1),
+        I_MOVI(R1, 0),
+        I_ADC(R0, 0, channel),
+        I_ADDR(R1, R1, R0),
+        I_ADC(R0, 0, channel),
+        I_ADDR(R1, R1, R0),
+        I_ADC(R0, 0, channel),
+        I_ADDR(R1, R1, R0),
+        I_ADC(R0, 0, channel),
+        I_ADDR(R1, R1, R0),
+        I_RSHI(R1, R1, 2),
+        I_ST(R1, R3, WORD_BATTERY),
+        I_LD(R2, R3, WORD_BATTERY_WAKE),
+        I_SUBR(R0, R1, R2),                         // Borrows below the threshold
+        M_BXF(LABEL_WAKE_BATTERY),
+
+        // Pressure, the low 16 bits of adc_P - differences over a pass never wrap
+        M_LABEL(LABEL_PRESSURE),
+        I_LD(R0, R3, WORD_PRESSURE_DELTA),
+        M_BL(LABEL_DONE, 1),
+        I_I2C_READ(0, BMP280_REG_PRESS_MSB),        // Bits 19..12
+        I_ANDI(R0, R0, 0x0F),
+        I_LSHI(R1, R0, 12),
+        I_I2C_READ(0, BMP280_REG_PRESS_LSB),        // Bits 11..4
+        I_LSHI(R0, R0, 4),
+        I_ORR(R1, R1, R0),
+        I_I2C_READ(0, BMP280_REG_PRESS_XLSB),       // Bits 3..0, in the top nibble
+        I_RSHI(R0, R0, 4),
+        I_ORR(R1, R1, R0),
+        I_LD(R2, R3, WORD_PRESSURE_PREV),
+        I_ST(R1, R3, WORD_PRESSURE_PREV),
+        I_SUBR(R0, R1, R2),                         // Change since the last pass, mod 2^16
+        M_BL(LABEL_CHANGE_POSITIVE, 0x8000),
+        I_SUBR(R0, R2, R1),                         // Negative - take the other way round
+        M_LABEL(LABEL_CHANGE_POSITIVE),
+        I_LD(R2, R3, WORD_PRESSURE_DELTA),
+        I_SUBR(R2, R2, R0),                         // Borrows past the threshold
+        M_BXF(LABEL_WAKE_PRESSURE),
+        M_LABEL(LABEL_DONE),
+        I_HALT(),
+
+        M_LABEL(LABEL_WAKE_BATTERY),
+        I_MOVI(R0, static_cast<uint16_t>(UlpWakeReason::BATTERY)),
+        M_BX(LABEL_WAKE),
+        M_LABEL(LABEL_WAKE_PRESSURE),
+        I_MOVI(R0, static_cast<uint16_t>(UlpWakeReason::PRESSURE)),
+        M_LABEL(LABEL_WAKE),
+        I_ST(R0, R3, WORD_REASON),
+        I_WAKE(),
+        I_WR_REG_BIT(RTC_CNTL_ULP_CP_TIMER_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN_S, 0),    // No more passes
+        I_HALT(),
+    };
+
+    for (uint8_t i = 0; i < WORD_COUNT; i++) {
+        RTC_SLOW_MEM[i] = 0;
+    }
+    RTC_SLOW_MEM[WORD_BATTERY_WAKE] = batteryWake;
+    RTC_SLOW_MEM[WORD_PRESSURE_PREV] = config.pressureRaw & 0xFFFF;
+    RTC_SLOW_MEM[WORD_PRESSURE_DELTA] = pressureDelta;
+    RTC_SLOW_MEM[WORD_BATTERY_REPORTED] = status.batteryReported;
+
+    // Fails with ESP_ERR_NO_MEM past CONFIG_ULP_COPROC_RESERVE_MEM
+    size_t size = sizeof(program) / sizeof(ulp_insn_t);
+    if (ulp_process_macros_and_load(ULP_PROGRAM_OFFSET, program, &size) != ESP_OK ||
+        ulp_set_wakeup_period(0, ULP_MONITOR_PERIOD_MS * 1000) != ESP_OK) {
+        return false;
+    }
+
+    // The RTC I2C controller and SAR ADC sit in the RTC peripheral domain
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+    if (esp_sleep_enable_ulp_wakeup() != ESP_OK) {
+        return false;
+    }
+    RTC_SLOW_MEM[WORD_MAGIC] = ULP_MONITOR_MAGIC;
+    if (ulp_run(ULP_PROGRAM_OFFSET) != ESP_OK) {
+        RTC_SLOW_MEM[WORD_MAGIC] = 0;
+        return false;
+    }
+    armed = true;
+#endif
+    return armed;
+}
+
+void UlpMonitor::releasePins() {
+#if CONFIG_ULP_COPROC_TYPE_FSM
+    // The RTC mux survives the sleep; Wire needs the pads back on the GPIO matrix
+    rtc_gpio_deinit((gpio_num_t)BMP280_SDA_PIN);
+    rtc_gpio_deinit((gpio_num_t)BMP280_SCL_PIN);
+#endif
+}
+
+bool UlpMonitor::setupI2c() {
+#if CONFIG_ULP_COPROC_TYPE_FSM
+    // The RTC I2C controller only reaches SDA on GPIO1 or 3 and SCL on GPIO0 or 2
+#if (BMP280_SDA_PIN != 1 && BMP280_SDA_PIN != 3) || (BMP280_SCL_PIN != 0 && BMP280_SCL_PIN != 2)
+    return false;
+#else
+    const gpio_num_t pins[] = {(gpio_num_t)BMP280_SDA_PIN, (gpio_num_t)BMP280_SCL_PIN};
+    for (gpio_num_t pin : pins) {
+        rtc_gpio_init(pin);
+        rtc_gpio_set_direction(pin, RTC_GPIO_MODE_INPUT_OUTPUT_OD);
+        rtc_gpio_pulldown_dis(pin);
+        rtc_gpio_pullup_en(pin);
+        rtc_gpio_iomux_func_sel(pin, ULP_RTCIO_FUNC_I2C);
+    }
+    REG_SET_FIELD(RTC_IO_SAR_I2C_IO_REG, RTC_IO_SAR_I2C_SDA_SEL, BMP280_SDA_PIN == 3 ? 1 : 0);
+    REG_SET_FIELD(RTC_IO_SAR_I2C_IO_REG, RTC_IO_SAR_I2C_SCL_SEL, BMP280_SCL_PIN == 2 ? 1 : 0);
+
+    SET_PERI_REG_MASK(SENS_SAR_PERI_CLK_GATE_CONF_REG, SENS_RTC_I2C_CLK_EN);
+    SET_PERI_REG_MASK(SENS_SAR_PERI_RESET_CONF_REG, SENS_RTC_I2C_RESET);
+    CLEAR_PERI_REG_MASK(SENS_SAR_PERI_RESET_CONF_REG, SENS_RTC_I2C_RESET);
+
+    // Master, open drain, standard mode
+    SET_PERI_REG_MASK(RTC_I2C_CTRL_REG, RTC_I2C_MS_MODE | RTC_I2C_SDA_FORCE_OUT | RTC_I2C_SCL_FORCE_OUT |
+                                        RTC_I2C_I2C_CTRL_CLK_GATE_EN);
+    REG_SET_FIELD(RTC_I2C_SCL_LOW_REG, RTC_I2C_SCL_LOW_PERIOD, ULP_I2C_HALF_PERIOD);
+    REG_SET_FIELD(RTC_I2C_SCL_HIGH_REG, RTC_I2C_SCL_HIGH_PERIOD, ULP_I2C_HALF_PERIOD);
+    REG_SET_FIELD(RTC_I2C_SDA_DUTY_REG, RTC_I2C_SDA_DUTY_NUM, ULP_I2C_HALF_PERIOD / 2);
+    REG_SET_FIELD(RTC_I2C_SCL_START_REG, RTC_I2C_SCL_START_PERIOD, ULP_I2C_HALF_PERIOD);
+    REG_SET_FIELD(RTC_I2C_SCL_STOP_REG, RTC_I2C_SCL_STOP_PERIOD, ULP_I2C_HALF_PERIOD);
+    REG_SET_FIELD(RTC_I2C_TO_REG, RTC_I2C_TIME_OUT_REG, ULP_I2C_TIMEOUT);
+
+    // I2C_RD's slave 0; transactions started by the ULP, not software
+    REG_SET_FIELD(SENS_SAR_SLAVE_ADDR1_REG, SENS_I2C_SLAVE_ADDR0, BMP280_ADDRESS);
+    CLEAR_PERI_REG_MASK(SENS_SAR_I2C_CTRL_REG, SENS_SAR_I2C_START_FORCE);
+    return true;
+#endif
+#else
+    return false;
+#endif
+}
+
+void UlpMonitor::printStatus() const {
+#if CONFIG_ULP_COPROC_TYPE_FSM
+    if (!status.valid) {
+        Serial.println("ULP monitor: no passes before this boot");
+        return;
+    }
+    Serial.printf("ULP monitor: %u passes, woke on %s, battery %.2f V%s\n", status.runs,
+                  ulpWakeReasonToString(status.reason), status.batteryVolts,
+                  status.batteryReported ? " (low reported)" : "");
+#else
+    Serial.println("ULP monitor: not in this IDF build");
+#endif
+}
+
+// ===========================
+// Global Instance
+// ===========================
+
+static UlpMonitor ulpMonitorInstance;
+
+UlpMonitor& UlpMon() { return ulpMonitorInstance; }
+
+// ===========================
+// Utility Functions
+// ===========================
+
+const char* ulpWakeReasonToString(UlpWakeReason reason) {
+    switch (reason) {
+        case UlpWakeReason::NONE: return "timer";
+        case UlpWakeReason::BATTERY: return "battery";
+        case UlpWakeReason::PRESSURE: return "pressure";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef ULP_MONITOR_H
+#define ULP_MONITOR_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// ULP Monitor
+// The ULP coprocessor samples the battery and the BMP280 during deep sleep
+// and wakes the main cores only when one crosses its threshold
+// ===========================
+
+// The program is the FSM ULP's, assembled at arm() from the IDF's ulp.h
+// macros into the CONFIG_ULP_COPROC_RESERVE_MEM region of RTC slow memory;
+// the Arduino core's IDF build has the FSM enabled but no ULP toolchain, so
+// a separately built RISC-V binary has nothing to embed it. Every
+// ULP_MONITOR_PERIOD_MS the ULP timer starts it for one pass:
+//
+//   battery   four ADC1 conversions of the sense pin, averaged; below the
+//             threshold wakes (once - after that the threshold is cleared
+//             until a full boot)
+//   pressure  press_msb..xlsb from the BMP280 over the RTC I2C controller
+//             (GPIO1 SDA, GPIO2 SCL - the S3's RTC I2C pins), the low 16
+//             bits of adc_P; a change since the last pass larger than the
+//             threshold wakes, so a burst or fast descent is caught within
+//             one period while the ascent never wakes anything
+//
+// The BMP280 is left converting in normal mode for it, with no IIR filter,
+// which would delay the step. Thresholds are in raw counts worked out by
+// the main cores before sleeping: the battery from the divider and the
+// ADC's nominal 12 dB scale (the eFuse curve isn't available to the ULP, a
+// few percent at most), the pressure from ULP_DESCENT_WAKE_MPS through the
+// air density at the last reading and the compensation's slope there.
+//
+// A wake from the ULP is still a deep sleep wake with the RTC state intact,
+// so it takes the short boot; getStatus() says why it woke.
+
+#define ULP_MONITOR_MAGIC           0xC051       // Data words valid
+#define ULP_ADC_SAMPLES             4            // Averaged per pass, a power of two
+#define ULP_ADC_FULL_SCALE          4095         // 12-bit conversions
+#define ULP_BMP280_OVERSAMPLING     3            // x4 pressure and temperature in normal mode
+#define ULP_BMP280_STANDBY          4            // t_sb code: 500 ms between conversions
+
+enum class UlpWakeReason : uint8_t {
+    NONE = 0,       // Timer, or not a ULP wake
+    BATTERY,
+    PRESSURE
+};
+
+struct UlpMonitorConfig {
+    float batteryWakeVolts;     // 0 = not watched
+    int32_t pressureRaw;        // BMP280 adc_P at sleep
+    uint16_t pressureDeltaRaw;  // adc_P change per period that wakes; 0 = not watched
+};
+
+struct UlpMonitorStatus {
+    UlpWakeReason reason;
+    uint16_t runs;              // ULP passes during the sleep
+    float batteryVolts;         // Last sample, nominal scale
+    bool batteryReported;       // A battery wake happened since the last full boot
+    bool valid;                 // The ULP ran during the sleep this boot woke from
+};
+
+class UlpMonitor {
+public:
+    UlpMonitor();
+
+    // Top of setup(): reads what the ULP left, stops it and gives the pins back
+    void begin();
+
+    // Last thing before esp_deep_sleep_start(); true with the ULP running and its wakeup enabled
+    bool arm(const UlpMonitorConfig& config);
+
+    bool isArmed() const { return armed; }
+    const UlpMonitorStatus& getStatus() const { return status; }
+
+    void printStatus() const;
+
+private:
+    UlpMonitorStatus status;
+    bool armed;
+
+    void releasePins();
+    bool setupI2c();
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern UlpMonitor& UlpMon();
+
+const char* ulpWakeReasonToString(UlpWakeReason reason);
+
+#endif // ULP_MONITOR_H
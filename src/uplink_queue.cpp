@@ -0,0 +1,167 @@
+#include "uplink_queue.h"
+
+UplinkQueue::UplinkQueue() {
+    consumer = nullptr;
+    posted = 0;
+    failed = 0;
+    worstLatencyUs = 0;
+    for (uint8_t i = 0; i < UPLINK_KIND_COUNT; i++) {
+        builtByKind[i] = 0;
+    }
+}
+
+// ===========================
+// Producers
+// ===========================
+
+bool UplinkQueue::post(UplinkRequest& request) {
+    request.postedAt = micros();
+
+    // Setup, before the tasks: the caller owns everything still
+    if (!consumer) {
+        return build(request);
+    }
+
+    if (!ring.push(request)) {
+        return false;
+    }
+    posted = posted + 1;
+    xTaskNotifyGive(consumer);
+    return true;
+}
+
+bool UplinkQueue::postTelemetry(const TelemetryData& data, uint32_t sampledAt) {
+    UplinkRequest request;
+    request.kind = UplinkKind::TELEMETRY;
+    request.sampledAt = sampledAt;
+    request.telemetry = data;
+    return post(request);
+}
+
+bool UplinkQueue::postGps(const GPSData& data, uint32_t sampledAt) {
+    UplinkRequest request;
+    request.kind = UplinkKind::GPS;
+    request.sampledAt = sampledAt;
+    request.gps = data;
+    return post(request);
+}
+
+bool UplinkQueue::postHeartbeat() {
+    UplinkRequest request;
+    request.kind = UplinkKind::HEARTBEAT;
+    return post(request);
+}
+
+bool UplinkQueue::postStatus(const char* status) {
+    UplinkRequest request;
+    request.kind = UplinkKind::STATUS;
+    strncpy(request.status, status, UPLINK_STATUS_LENGTH);
+    request.status[UPLINK_STATUS_LENGTH] = '\0';
+    return post(request);
+}
+
+bool UplinkQueue::postLatencyStatus() {
+    UplinkRequest request;
+    request.kind = UplinkKind::LATENCY_STATUS;
+    return post(request);
+}
+
+bool UplinkQueue::postProfileLevel(const ProfileLevel& level) {
+    UplinkRequest request;
+    request.kind = UplinkKind::PROFILE_LEVEL;
+    request.sampledAt = level.endTime;
+    request.level = level;
+    return post(request);
+}
+
+bool UplinkQueue::postTrackSegment(const uint8_t* segment, size_t length) {
+    if (length > UPLINK_TRACK_LENGTH) {
+        return false;
+    }
+    UplinkRequest request;
+    request.kind = UplinkKind::TRACK_SEGMENT;
+    request.track.length = length;
+    memcpy(request.track.bytes, segment, length);
+    return post(request);
+}
+
+bool UplinkQueue::postDigest(const DigestData& data) {
+    UplinkRequest request;
+    request.kind = UplinkKind::DIGEST;
+    request.sampledAt = 0;
+    request.digest = data;
+    return post(request);
+}
+
+// ===========================
+// Consumer
+// ===========================
+
+size_t UplinkQueue::drain(size_t budget) {
+    size_t taken = 0;
+    UplinkRequest request;
+    while (taken < budget && ring.pop(request)) {
+        taken++;
+        if (!build(request)) {
+            failed++;
+            continue;
+        }
+        uint32_t latency = micros() - request.postedAt;
+        if (latency > worstLatencyUs) {
+            worstLatencyUs = latency;
+        }
+    }
+    return taken;
+}
+
+bool UplinkQueue::build(const UplinkRequest& request) {
+    bool built;
+    switch (request.kind) {
+        case UplinkKind::TELEMETRY: built = PacketMgr().createTelemetryPacket(request.telemetry, request.sampledAt); break;
+        case UplinkKind::GPS: built = PacketMgr().createGPSPacket(request.gps, request.sampledAt); break;
+        case UplinkKind::HEARTBEAT: built = PacketMgr().createHeartbeatPacket(); break;
+        case UplinkKind::STATUS: built = PacketMgr().createStatusPacket(request.status); break;
+        case UplinkKind::LATENCY_STATUS: built = PacketMgr().createLatencyStatusPacket(); break;
+        case UplinkKind::PROFILE_LEVEL: built = PacketMgr().createProfilePacket(request.level); break;
+        case UplinkKind::TRACK_SEGMENT:
+            built = PacketMgr().createTrackPacket(request.track.bytes, request.track.length);
+            break;
+        case UplinkKind::DIGEST: built = PacketMgr().createDigestPacket(request.digest); break;
+        default: built = false; break;
+    }
+    if (built) {
+        builtByKind[static_cast<uint8_t>(request.kind)]++;
+    }
+    return built;
+}
+
+void UplinkQueue::printStatus() const {
+    Serial.printf("Uplink queue: %lu posted, %lu pending, %lu dropped, %lu refused, worst %lu us\n",
+                  (unsigned long)posted, (unsigned long)getPending(), (unsigned long)getDropped(),
+                  (unsigned long)failed, (unsigned long)worstLatencyUs);
+    for (uint8_t i = 0; i < UPLINK_KIND_COUNT; i++) {
+        Serial.printf("  %s: %lu\n", kindToString(static_cast<UplinkKind>(i)), (unsigned long)builtByKind[i]);
+    }
+}
+
+const char* UplinkQueue::kindToString(UplinkKind kind) {
+    switch (kind) {
+        case UplinkKind::TELEMETRY: return "Telemetry";
+        case UplinkKind::GPS: return "GPS";
+        case UplinkKind::HEARTBEAT: return "Heartbeat";
+        case UplinkKind::STATUS: return "Status";
+        case UplinkKind::LATENCY_STATUS: return "Latency Status";
+        case UplinkKind::PROFILE_LEVEL: return "Profile Level";
+        case UplinkKind::TRACK_SEGMENT: return "Track Segment";
+        case UplinkKind::DIGEST: return "Digest";
+        default: return "Unknown";
+    }
+}
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+static UplinkQueue uplinkQueueInstance;
+
+UplinkQueue& Uplink() { return uplinkQueueInstance; }
@@ -0,0 +1,110 @@
+#ifndef UPLINK_QUEUE_H
+#define UPLINK_QUEUE_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "event_ring.h"
+#include "packet_handler.h"
+
+// ===========================
+// Uplink Queue
+// How tasks other than the uplink task get a packet sent: PacketMgr(),
+// FragmentMgr()'s sending side and LoRaComm() belong to the uplink task,
+// and everyone else posts here
+// ===========================
+
+// post() copies the request - the reading itself, not a pointer to it -
+// into an EventRing and wakes the uplink task, so the flight task never
+// waits on packet assembly, the telemetry codec or a full radio lane. The
+// uplink task drains the ring first thing each time it wakes, builds each
+// packet with the PacketHandler call it names and hands it on to the radio
+// in the same pass; post-to-queued time is kept as a worst case.
+//
+// A full ring drops the new request and counts it: a reading that late is
+// superseded by the next one anyway.
+
+#define UPLINK_QUEUE_DEPTH      16          // Power of two
+#define UPLINK_STATUS_LENGTH    100         // createStatusPacket() sends no more
+#define UPLINK_TRACK_LENGTH     96          // TRACK_SEGMENT_MAX_BYTES, within the status
+
+enum class UplinkKind : uint8_t {
+    TELEMETRY = 0,
+    GPS,
+    HEARTBEAT,
+    STATUS,
+    LATENCY_STATUS,     // PacketHandler's own latency report, no payload
+    PROFILE_LEVEL,
+    TRACK_SEGMENT,
+    DIGEST,
+    COUNT
+};
+
+#define UPLINK_KIND_COUNT static_cast<uint8_t>(UplinkKind::COUNT)
+
+struct UplinkRequest {
+    UplinkKind kind;
+    uint32_t postedAt;          // micros()
+    uint32_t sampledAt;         // millis() of the reading, 0 = when built
+    union {
+        TelemetryData telemetry;
+        GPSData gps;
+        char status[UPLINK_STATUS_LENGTH + 1];
+        ProfileLevel level;
+        DigestData digest;
+        struct {
+            uint8_t length;
+            uint8_t bytes[UPLINK_TRACK_LENGTH];
+        } track;
+    };
+};
+
+class UplinkQueue {
+public:
+    UplinkQueue();
+
+    // The uplink task, once it runs; until then posts are built at once by the caller
+    void setConsumer(TaskHandle_t task) { consumer = task; }
+
+    // Any task; false if the ring was full or the packet couldn't be built
+    bool postTelemetry(const TelemetryData& data, uint32_t sampledAt = 0);
+    bool postGps(const GPSData& data, uint32_t sampledAt = 0);
+    bool postHeartbeat();
+    bool postStatus(const char* status);
+    bool postLatencyStatus();
+    bool postProfileLevel(const ProfileLevel& level);
+    bool postTrackSegment(const uint8_t* segment, size_t length);
+    bool postDigest(const DigestData& data);
+
+    // The uplink task only; builds up to budget packets, returns how many were taken
+    size_t drain(size_t budget = UPLINK_QUEUE_DEPTH);
+
+    uint32_t getPosted() const { return posted; }
+    uint32_t getDropped() const { return ring.getDropped(); }
+    uint32_t getFailed() const { return failed; }
+    uint32_t getWorstLatencyUs() const { return worstLatencyUs; }
+    uint32_t getPending() const { return ring.size(); }
+    void printStatus() const;
+
+    static const char* kindToString(UplinkKind kind);
+
+private:
+    EventRing<UplinkRequest, UPLINK_QUEUE_DEPTH> ring;
+    TaskHandle_t consumer;
+    volatile uint32_t posted;
+    uint32_t failed;            // Taken from the ring but refused by PacketMgr()
+    uint32_t worstLatencyUs;
+    uint32_t builtByKind[UPLINK_KIND_COUNT];
+
+    bool post(UplinkRequest& request);
+    bool build(const UplinkRequest& request);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern UplinkQueue& Uplink();
+
+#endif // UPLINK_QUEUE_H
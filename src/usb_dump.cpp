@@ -0,0 +1,440 @@
+#include "usb_dump.h"
+#include <esp_heap_caps.h>
+#include "crc_utils.h"
+#include "debug_utils.h"
+#include "flight_recorder.h"
+#include "image_store.h"
+#include "task_placement.h"
+
+static UsbDump usbDumpInstance;
+
+UsbDump& Dump() {
+    return usbDumpInstance;
+}
+
+// dumpBinary() into the log snapshot
+class SnapshotPrint : public Print {
+public:
+    SnapshotPrint(uint8_t* buffer, size_t capacity) : length(0), buffer(buffer), capacity(capacity) {}
+
+    size_t write(uint8_t byte) override {
+        return write(&byte, 1);
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+        size = min(size, capacity - length);
+        memcpy(buffer + length, data, size);
+        length += size;
+        return size;
+    }
+
+    size_t length;
+
+private:
+    uint8_t* buffer;
+    size_t capacity;
+};
+
+static inline void putLE32(uint8_t* p, uint32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+}
+
+static inline uint32_t getLE32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ===========================
+// Constructor
+// ===========================
+
+UsbDump::UsbDump() {
+    active = false;
+    logWasOn = true;
+    lastHostAt = 0;
+    task = nullptr;
+    rxLength = 0;
+    reading = false;
+    readFinished = false;
+    source = DumpSource::FLIGHT_RECORDER;
+    readStart = 0;
+    readEnd = 0;
+    acked = 0;
+    sent = 0;
+    window = 1;
+    ackedAt = 0;
+    mappedPartition = nullptr;
+    mappedStart = 0;
+    mappedLength = 0;
+    mapped = nullptr;
+    mapHandle = 0;
+    logSnapshot = nullptr;
+    logLength = 0;
+    sessions = 0;
+    bytesSent = 0;
+    resends = 0;
+    badFrames = 0;
+    readStartedAt = 0;
+    lastReadMs = 0;
+    lastReadBytes = 0;
+}
+
+bool UsbDump::begin() {
+    if (!USB_DUMP_ENABLED) {
+        return false;
+    }
+    if (task) {
+        return true;
+    }
+    return createPlacedTask(TaskId::USB_DUMP, taskEntry, this, &task) == pdPASS;
+}
+
+void UsbDump::taskEntry(void* parameter) {
+    UsbDump* dump = static_cast<UsbDump*>(parameter);
+    for (;;) {
+        if (!dump->poll()) {
+            vTaskDelay(pdMS_TO_TICKS(dump->active ? 1 : DUMP_POLL_MS));
+        }
+    }
+}
+
+// ===========================
+// Sources
+// ===========================
+
+const char* UsbDump::sourceName(DumpSource id) {
+    switch (id) {
+        case DumpSource::FLIGHT_RECORDER: return "flight";
+        case DumpSource::IMAGES: return "images";
+        case DumpSource::COREDUMP: return "coredump";
+        case DumpSource::LOG: return "log";
+        default: return "";
+    }
+}
+
+const esp_partition_t* UsbDump::findPartition(DumpSource id) const {
+    switch (id) {
+        case DumpSource::FLIGHT_RECORDER:
+            return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                            FLIGHT_RECORDER_PARTITION_LABEL);
+        case DumpSource::IMAGES:
+            return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                            IMAGE_STORE_PARTITION_LABEL);
+        case DumpSource::COREDUMP:
+            return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_COREDUMP, nullptr);
+        default:
+            return nullptr;
+    }
+}
+
+uint32_t UsbDump::sourceSize(DumpSource id) const {
+    if (id == DumpSource::LOG) {
+        return logLength;
+    }
+    const esp_partition_t* partition = findPartition(id);
+    return partition ? partition->size : 0;
+}
+
+// Up to length bytes at offset, fewer at the end of a mapped window
+const uint8_t* UsbDump::readSource(uint32_t offset, uint32_t& length) {
+    if (source == DumpSource::LOG) {
+        length = min(length, logLength - offset);
+        return logSnapshot + offset;
+    }
+
+    const esp_partition_t* partition = findPartition(source);
+    if (!partition) {
+        return nullptr;
+    }
+    if (!mapped || partition != mappedPartition || offset < mappedStart || offset >= mappedStart + mappedLength) {
+        unmap();
+        uint32_t start = offset - offset % DUMP_MAP_WINDOW;
+        uint32_t size = min((uint32_t)DUMP_MAP_WINDOW, (uint32_t)partition->size - start);
+        const void* view;
+        if (esp_partition_mmap(partition, start, size, ESP_PARTITION_MMAP_DATA, &view, &mapHandle) != ESP_OK) {
+            return nullptr;
+        }
+        mapped = static_cast<const uint8_t*>(view);
+        mappedPartition = partition;
+        mappedStart = start;
+        mappedLength = size;
+    }
+    length = min(length, mappedStart + mappedLength - offset);
+    return mapped + (offset - mappedStart);
+}
+
+void UsbDump::unmap() {
+    if (mapped) {
+        esp_partition_munmap(mapHandle);
+        mapped = nullptr;
+        mappedPartition = nullptr;
+    }
+}
+
+// ===========================
+// Protocol
+// ===========================
+
+bool UsbDump::poll() {
+    bool busy = false;
+    while (receiveFrame()) {
+        lastHostAt = millis();
+        handleFrame(static_cast<DumpCommand>(rx[2]), &rx[4], rx[3]);
+        busy = true;
+    }
+    if (!active) {
+        return busy;
+    }
+    if (millis() - lastHostAt > DUMP_IDLE_MS) {
+        endSession();
+        return false;
+    }
+    return (reading && sendNext()) || busy;
+}
+
+// A whole frame with a good CRC in rx, or false once nothing is waiting
+bool UsbDump::receiveFrame() {
+    while (Serial.available() > 0) {
+        uint8_t byte = Serial.read();
+        if (rxLength == 0 && byte != DUMP_SYNC) {
+            continue;
+        }
+        if (rxLength == 1 && byte != DUMP_SYNC_HOST) {
+            rxLength = byte == DUMP_SYNC ? 1 : 0;
+            continue;
+        }
+        rx[rxLength++] = byte;
+        if (rxLength < 4 || rxLength < 4 + rx[3] + 2) {
+            continue;
+        }
+
+        size_t payloadEnd = 4 + rx[3];
+        rxLength = 0;
+        if (crc16Ccitt(&rx[2], payloadEnd - 2) == (rx[payloadEnd] | (rx[payloadEnd + 1] << 8))) {
+            return true;
+        }
+        badFrames++;
+    }
+    return false;
+}
+
+void UsbDump::handleFrame(DumpCommand command, const uint8_t* payload, uint8_t length) {
+    // Nothing but HELLO starts a session - the console's own bytes stay the console's
+    if (command == DumpCommand::HELLO) {
+        startSession();
+        return;
+    }
+    if (!active) {
+        return;
+    }
+
+    switch (command) {
+        case DumpCommand::READ:
+            startRead(payload, length);
+            break;
+
+        case DumpCommand::ACK:
+        case DumpCommand::NACK:
+            if (length >= 4) {
+                handleAck(command == DumpCommand::NACK, getLE32(payload));
+            }
+            break;
+
+        case DumpCommand::STOP:
+            endSession();
+            break;
+
+        default:
+            sendError(DumpError::BAD_COMMAND);
+            break;
+    }
+}
+
+void UsbDump::handleAck(bool nack, uint32_t offset) {
+    // Still asking for the end of a finished read: its DONE went missing
+    if (!reading) {
+        if (readFinished && offset == readEnd) {
+            sendDone();
+        }
+        return;
+    }
+
+    if (nack) {
+        if (offset >= acked && offset < sent) {
+            acked = offset;
+            sent = offset;
+            ackedAt = millis();
+            resends++;
+        }
+        return;
+    }
+    // Taken even past sent: a NACK the host sent before it may have rewound us since
+    if (offset > acked && offset <= readEnd) {
+        acked = offset;
+        sent = max(sent, acked);
+        ackedAt = millis();
+    }
+    if (acked == readEnd) {
+        reading = false;
+        readFinished = true;
+        lastReadMs = millis() - readStartedAt;
+        lastReadBytes = readEnd - readStart;
+        sendDone();
+    }
+}
+
+void UsbDump::sendDone() {
+    uint8_t done[5] = {static_cast<uint8_t>(source)};
+    putLE32(&done[1], readEnd);
+    sendFrame(DumpReply::DONE, done, sizeof(done));
+}
+
+void UsbDump::startSession() {
+    if (!active) {
+        sessions++;
+        logWasOn = Debug.isSerialEnabled();
+        Debug.setSerialEnabled(false);
+        active = true;
+
+        // The log ring as it is now; the records logged during the dump stay in it
+        logLength = 0;
+        logSnapshot = static_cast<uint8_t*>(heap_caps_malloc(DUMP_LOG_SNAPSHOT_BYTES, MALLOC_CAP_SPIRAM));
+        if (logSnapshot) {
+            SnapshotPrint snapshot(logSnapshot, DUMP_LOG_SNAPSHOT_BYTES);
+            Debug.dumpBinary(snapshot);
+            logLength = snapshot.length;
+        }
+    }
+    reading = false;
+    readFinished = false;
+
+    uint8_t info[5 + DUMP_SOURCE_COUNT * (5 + DUMP_NAME_BYTES)] = {
+        DUMP_PROTOCOL_VERSION, DUMP_WINDOW_MAX, DUMP_CHUNK_BYTES & 0xFF, DUMP_CHUNK_BYTES >> 8, DUMP_SOURCE_COUNT
+    };
+    uint8_t* p = &info[5];
+    for (uint8_t i = 0; i < DUMP_SOURCE_COUNT; i++) {
+        DumpSource id = static_cast<DumpSource>(i);
+        p[0] = i;
+        putLE32(&p[1], sourceSize(id));
+        strncpy(reinterpret_cast<char*>(&p[5]), sourceName(id), DUMP_NAME_BYTES);
+        p += 5 + DUMP_NAME_BYTES;
+    }
+    sendFrame(DumpReply::INFO, info, sizeof(info));
+}
+
+void UsbDump::endSession() {
+    reading = false;
+    unmap();
+    heap_caps_free(logSnapshot);
+    logSnapshot = nullptr;
+    logLength = 0;
+    active = false;
+    Debug.setSerialEnabled(logWasOn);
+    SYS_INFO("USB dump: session ended, %llu bytes sent, %lu resent", (unsigned long long)bytesSent,
+             (unsigned long)resends);
+}
+
+void UsbDump::startRead(const uint8_t* payload, uint8_t length) {
+    if (length < 10 || payload[0] >= DUMP_SOURCE_COUNT) {
+        sendError(DumpError::BAD_SOURCE);
+        return;
+    }
+    DumpSource id = static_cast<DumpSource>(payload[0]);
+    uint32_t offset = getLE32(&payload[1]);
+    uint32_t requested = getLE32(&payload[5]);
+    uint32_t size = sourceSize(id);
+    if (offset > size) {
+        sendError(DumpError::BAD_OFFSET);
+        return;
+    }
+
+    unmap();
+    source = id;
+    readStart = offset;
+    readEnd = offset + min(requested, size - offset);
+    acked = offset;
+    sent = offset;
+    window = constrain(payload[9], 1, DUMP_WINDOW_MAX);
+    ackedAt = millis();
+    readStartedAt = millis();
+    reading = readEnd > offset;
+    readFinished = !reading;
+
+    if (readFinished) {
+        sendDone();
+    }
+}
+
+// The next chunk, if the window has room; false while waiting on the host
+bool UsbDump::sendNext() {
+    bool windowFull = sent >= readEnd || sent - acked >= (uint32_t)window * DUMP_CHUNK_BYTES;
+    if (windowFull) {
+        // The host has gone quiet on what's in flight - from the ACK again
+        if (sent > acked && millis() - ackedAt > DUMP_ACK_TIMEOUT_MS) {
+            sent = acked;
+            ackedAt = millis();
+            resends++;
+        }
+        return false;
+    }
+
+    uint32_t length = min(readEnd - sent, (uint32_t)DUMP_CHUNK_BYTES);
+    const uint8_t* data = readSource(sent, length);
+    if (!data) {
+        sendError(DumpError::MAP_FAILED);
+        reading = false;
+        return false;
+    }
+
+    uint8_t head[5] = {static_cast<uint8_t>(source)};
+    putLE32(&head[1], sent);
+    sendFrame(DumpReply::DATA, head, sizeof(head), data, length);
+    sent += length;
+    bytesSent += length;
+    return true;
+}
+
+void UsbDump::sendFrame(DumpReply type, const uint8_t* head, size_t headLength, const uint8_t* body,
+                        size_t bodyLength) {
+    size_t length = headLength + bodyLength;
+    uint8_t header[5] = {
+        DUMP_SYNC, DUMP_SYNC_DEVICE, static_cast<uint8_t>(type), (uint8_t)(length & 0xFF), (uint8_t)(length >> 8)
+    };
+    uint16_t crc = crc16CcittUpdate(CRC16_CCITT_INIT, &header[2], 3);
+    crc = crc16CcittUpdate(crc, head, headLength);
+    if (bodyLength) {
+        crc = crc16CcittUpdate(crc, body, bodyLength);
+    }
+    uint8_t trailer[2] = {(uint8_t)(crc & 0xFF), (uint8_t)(crc >> 8)};
+
+    Serial.write(header, sizeof(header));
+    Serial.write(head, headLength);
+    if (bodyLength) {
+        Serial.write(body, bodyLength);
+    }
+    Serial.write(trailer, sizeof(trailer));
+}
+
+void UsbDump::sendError(DumpError code) {
+    uint8_t payload = static_cast<uint8_t>(code);
+    sendFrame(DumpReply::ERROR, &payload, 1);
+}
+
+// ===========================
+// Status
+// ===========================
+
+void UsbDump::printStatus() const {
+    if (!USB_DUMP_ENABLED) {
+        return;
+    }
+    Serial.printf("USB Dump: %s, %lu sessions, %llu bytes sent, %lu resends, %lu bad host frames\n",
+                  active ? (reading ? "reading" : "session open") : "waiting for a host", (unsigned long)sessions,
+                  (unsigned long long)bytesSent, (unsigned long)resends, (unsigned long)badFrames);
+    if (lastReadMs) {
+        Serial.printf("  Last read: %lu bytes in %lu ms, %.0f KB/s\n", (unsigned long)lastReadBytes,
+                      (unsigned long)lastReadMs, lastReadBytes / 1.024f / lastReadMs);
+    }
+}
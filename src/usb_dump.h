@@ -0,0 +1,178 @@
+#ifndef USB_DUMP_H
+#define USB_DUMP_H
+
+#include <Arduino.h>
+#include <cstdint>
+#include <esp_partition.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "balloon_config.h"
+
+// ===========================
+// USB Dump
+// Post-flight bulk read-out of the flight recorder, image store, core dump
+// and log ring over the S3's native USB CDC, for tools/usb_dump.py
+// ===========================
+
+// The console stays a console until a host sends HELLO; from then until
+// STOP, or DUMP_IDLE_MS without a frame from the host, the debug log is
+// kept off Serial and everything the dump task writes is a frame.
+//
+// Host to balloon:  [D5 AA][cmd][len][payload: len bytes][CRC-16 CCITT LE]
+// Balloon to host:  [D5 BB][type][len LE16][payload][CRC-16 CCITT LE]
+// The CRC covers cmd/type, length and payload. Both ends resync on the
+// next D5 after a bad frame, so stray console bytes cost nothing.
+//
+// Commands:
+//   HELLO  ()                                   -> INFO
+//   READ   [source][offset LE32][length LE32][window]
+//          Sends DATA from offset to offset + length (the source's end if
+//          past it), window chunks at most ahead of the host's ACK
+//   ACK    [offset LE32]   Everything before offset arrived
+//   NACK   [offset LE32]   A chunk at offset failed its CRC or went missing;
+//                          sending goes back to it
+//   STOP   ()              Ends a READ and the dump session
+// Replies:
+//   INFO   [version][window max][chunk LE16][sources], then per source
+//          [id][size LE32][name: DUMP_NAME_BYTES, NUL padded]
+//   DATA   [source][offset LE32][bytes]
+//   DONE   [source][end LE32]  The ACK reached the end of the READ
+//   ERROR  [code]
+//
+// Go-back-N: a NACK, or DUMP_ACK_TIMEOUT_MS with the window full and no
+// new ACK, rewinds to the last ACKed offset. A READ at a non-zero offset
+// is how the host resumes a file it already has part of.
+//
+// Partitions are read straight out of their memory map, one
+// DUMP_MAP_WINDOW at a time, so a chunk goes from flash cache to the USB
+// FIFO with no copy of its own. The log ring isn't in flash: HELLO takes a
+// dumpBinary() snapshot of it into PSRAM, freed at STOP.
+
+#define DUMP_PROTOCOL_VERSION   1
+#define DUMP_CHUNK_BYTES        4096    // DATA payload after its offset
+#define DUMP_WINDOW_MAX         16      // Chunks in flight a host may ask for
+#define DUMP_MAP_WINDOW         (256 * 1024)    // Partition bytes mapped at a time, a multiple of 64 KB
+#define DUMP_ACK_TIMEOUT_MS     500     // Window full and nothing ACKed: resend from the ACK
+#define DUMP_IDLE_MS            10000   // Back to the console after this long without a host frame
+#define DUMP_POLL_MS            50      // RX checked this often outside a session
+#define DUMP_NAME_BYTES         8
+#define DUMP_LOG_SNAPSHOT_BYTES (DEBUG_LOG_RING_BYTES + 16)
+
+#define DUMP_SYNC               0xD5
+#define DUMP_SYNC_HOST          0xAA
+#define DUMP_SYNC_DEVICE        0xBB
+
+enum class DumpCommand : uint8_t {
+    HELLO = 0x01,
+    READ = 0x02,
+    ACK = 0x03,
+    NACK = 0x04,
+    STOP = 0x05
+};
+
+enum class DumpReply : uint8_t {
+    INFO = 0x81,
+    DATA = 0x82,
+    DONE = 0x83,
+    ERROR = 0x84
+};
+
+enum class DumpError : uint8_t {
+    BAD_SOURCE = 1,
+    BAD_OFFSET,
+    MAP_FAILED,
+    BAD_COMMAND
+};
+
+enum class DumpSource : uint8_t {
+    FLIGHT_RECORDER = 0,
+    IMAGES,
+    COREDUMP,
+    LOG,
+    COUNT
+};
+
+#define DUMP_SOURCE_COUNT static_cast<uint8_t>(DumpSource::COUNT)
+
+class UsbDump {
+public:
+    UsbDump();
+
+    // Starts the task that waits for a host; false with USB_DUMP_ENABLED off
+    bool begin();
+    bool isActive() const { return active; }
+
+    uint64_t getBytesSent() const { return bytesSent; }
+    void printStatus() const;
+
+private:
+    volatile bool active;
+    bool logWasOn;                  // Debug's Serial output before the session
+    uint32_t lastHostAt;            // millis() of the last good host frame
+    TaskHandle_t task;
+
+    // Host frame being parsed
+    uint8_t rx[4 + 255 + 2];
+    uint16_t rxLength;
+
+    // Read in progress
+    bool reading;
+    bool readFinished;              // The last READ was ACKed to its end
+    DumpSource source;
+    uint32_t readStart;
+    uint32_t readEnd;
+    uint32_t acked;                 // Host has everything before this
+    uint32_t sent;                  // Next byte to send
+    uint8_t window;
+    uint32_t ackedAt;               // millis() acked last moved or was resent from
+
+    // Mapped partition window
+    const esp_partition_t* mappedPartition;
+    uint32_t mappedStart;           // Partition offset of mapped[0]
+    uint32_t mappedLength;
+    const uint8_t* mapped;
+    esp_partition_mmap_handle_t mapHandle;
+
+    // Log snapshot
+    uint8_t* logSnapshot;
+    uint32_t logLength;
+
+    // Statistics
+    uint32_t sessions;
+    uint64_t bytesSent;             // DATA payload, resends included
+    uint32_t resends;
+    uint32_t badFrames;
+    uint32_t readStartedAt;         // millis()
+    uint32_t lastReadMs;            // The last READ to finish
+    uint32_t lastReadBytes;
+
+    const esp_partition_t* findPartition(DumpSource id) const;
+    uint32_t sourceSize(DumpSource id) const;
+    static const char* sourceName(DumpSource id);
+    const uint8_t* readSource(uint32_t offset, uint32_t& length);
+    void unmap();
+
+    bool poll();                    // False with nothing to do
+    bool receiveFrame();
+    void handleFrame(DumpCommand command, const uint8_t* payload, uint8_t length);
+    void startSession();
+    void endSession();
+    void startRead(const uint8_t* payload, uint8_t length);
+    void handleAck(bool nack, uint32_t offset);
+    void sendDone();
+    bool sendNext();
+    // The payload as two spans, so DATA goes out of the map without a copy
+    void sendFrame(DumpReply type, const uint8_t* head, size_t headLength, const uint8_t* body = nullptr,
+                   size_t bodyLength = 0);
+    void sendError(DumpError code);
+
+    static void taskEntry(void* parameter);
+};
+
+// ===========================
+// Global Instance Access
+// ===========================
+
+extern UsbDump& Dump();
+
+#endif // USB_DUMP_H
@@ -0,0 +1,539 @@
+#include "wavelet_codec.h"
+
+#define WAVELET_TYPE_B      0x8000  // LIS entry tests L(p), the grandchildren; else D(p), all descendants
+#define WAVELET_INDEX_MASK  0x7FFF
+
+struct WaveletGeometry {
+    uint16_t width;             // The plane's own size
+    uint16_t height;
+    uint16_t stride;            // Padded to a multiple of 2^levels
+    uint16_t rows;
+    uint16_t llWidth;
+    uint16_t llHeight;
+    uint8_t levels;
+    size_t count;               // stride * rows coefficients
+};
+
+// Carved out of the caller's workspace, 16-bit arrays first
+struct WaveletWorkspace {
+    int16_t* coef;
+    int16_t* line;              // One row or column for the lifting steps
+    uint16_t* lip;              // Insignificant pixels
+    uint16_t* lsp;              // Significant pixels
+    uint16_t* lis;              // Insignificant sets, WAVELET_TYPE_B marks L(p)
+    uint8_t* descendantBits;    // Bit length of the largest magnitude in D(p) - encoder
+    uint8_t* grandchildBits;    // ... in L(p)
+    size_t lisCapacity;
+};
+
+static bool waveletGeometry(uint16_t width, uint16_t height, WaveletGeometry& g) {
+    if (width < WAVELET_MIN_DIMENSION || height < WAVELET_MIN_DIMENSION ||
+        width > WAVELET_MAX_DIMENSION || height > WAVELET_MAX_DIMENSION) {
+        return false;
+    }
+
+    uint16_t shortest = min(width, height);
+    uint8_t levels = 0;
+    while (levels < WAVELET_MAX_LEVELS && (shortest >> (levels + 1)) >= WAVELET_MIN_LL) {
+        levels++;
+    }
+
+    uint16_t block = 1 << levels;
+    g.width = width;
+    g.height = height;
+    g.stride = (width + block - 1) & ~(block - 1);
+    g.rows = (height + block - 1) & ~(block - 1);
+    g.llWidth = g.stride >> levels;
+    g.llHeight = g.rows >> levels;
+    g.levels = levels;
+    g.count = (size_t)g.stride * g.rows;
+    return g.count <= WAVELET_INDEX_MASK + 1;
+}
+
+static WaveletWorkspace waveletLayout(const WaveletGeometry& g, void* workspace) {
+    WaveletWorkspace ws;
+    int16_t* words = static_cast<int16_t*>(workspace);
+    ws.coef = words;
+    ws.line = ws.coef + g.count;
+    ws.lip = reinterpret_cast<uint16_t*>(ws.line + max(g.stride, g.rows));
+    ws.lsp = ws.lip + g.count;
+    ws.lis = ws.lsp + g.count;
+    ws.lisCapacity = g.count * 2;
+    ws.descendantBits = reinterpret_cast<uint8_t*>(ws.lis + ws.lisCapacity);
+    ws.grandchildBits = ws.descendantBits + g.count;
+    return ws;
+}
+
+size_t waveletWorkspaceSize(uint16_t width, uint16_t height) {
+    WaveletGeometry g;
+    if (!waveletGeometry(width, height, g)) {
+        return 0;
+    }
+    // coef, line, LIP, LSP, LIS (two per coefficient), then the two bit-length planes
+    return g.count * sizeof(int16_t) * 5 + max(g.stride, g.rows) * sizeof(int16_t) + g.count * 2;
+}
+
+// ===========================
+// LeGall 5/3 Lifting
+// ===========================
+
+// n even; lows to the first half, highs to the second, mirrored at both ends
+static void liftForward(int16_t* a, uint16_t n, uint16_t step, int16_t* line) {
+    uint16_t half = n >> 1;
+    for (uint16_t i = 0; i < half; i++) {
+        int32_t even = a[2 * i * step];
+        int32_t next = 2 * i + 2 < n ? a[(2 * i + 2) * step] : even;
+        line[half + i] = (int16_t)(a[(2 * i + 1) * step] - ((even + next) >> 1));
+    }
+    for (uint16_t i = 0; i < half; i++) {
+        int32_t previous = line[half + (i ? i - 1 : 0)];
+        line[i] = (int16_t)(a[2 * i * step] + ((previous + line[half + i] + 2) >> 2));
+    }
+    for (uint16_t i = 0; i < n; i++) {
+        a[i * step] = line[i];
+    }
+}
+
+static void liftInverse(int16_t* a, uint16_t n, uint16_t step, int16_t* line) {
+    uint16_t half = n >> 1;
+    for (uint16_t i = 0; i < n; i++) {
+        line[i] = a[i * step];
+    }
+    for (uint16_t i = 0; i < half; i++) {
+        int32_t previous = line[half + (i ? i - 1 : 0)];
+        a[2 * i * step] = (int16_t)(line[i] - ((previous + line[half + i] + 2) >> 2));
+    }
+    for (uint16_t i = 0; i < half; i++) {
+        int32_t even = a[2 * i * step];
+        int32_t next = 2 * i + 2 < n ? a[(2 * i + 2) * step] : even;
+        a[(2 * i + 1) * step] = (int16_t)(line[half + i] + ((even + next) >> 1));
+    }
+}
+
+static void transformForward(const WaveletGeometry& g, const WaveletWorkspace& ws) {
+    for (uint8_t level = 0; level < g.levels; level++) {
+        uint16_t width = g.stride >> level;
+        uint16_t height = g.rows >> level;
+        for (uint16_t y = 0; y < height; y++) {
+            liftForward(&ws.coef[y * g.stride], width, 1, ws.line);
+        }
+        for (uint16_t x = 0; x < width; x++) {
+            liftForward(&ws.coef[x], height, g.stride, ws.line);
+        }
+    }
+}
+
+static void transformInverse(const WaveletGeometry& g, const WaveletWorkspace& ws) {
+    for (int level = g.levels - 1; level >= 0; level--) {
+        uint16_t width = g.stride >> level;
+        uint16_t height = g.rows >> level;
+        for (uint16_t x = 0; x < width; x++) {
+            liftInverse(&ws.coef[x], height, g.stride, ws.line);
+        }
+        for (uint16_t y = 0; y < height; y++) {
+            liftInverse(&ws.coef[y * g.stride], width, 1, ws.line);
+        }
+    }
+}
+
+// Band weight as a shift: details of level l (1 finest) by l - 1, LL by levels
+static uint8_t bandShift(const WaveletGeometry& g, uint16_t x, uint16_t y) {
+    for (uint8_t level = 1; level <= g.levels; level++) {
+        if (x >= (g.stride >> level) || y >= (g.rows >> level)) {
+            return level - 1;
+        }
+    }
+    return g.levels;
+}
+
+// ===========================
+// Spatial Orientation Trees
+// ===========================
+
+static bool hasChildren(const WaveletGeometry& g, uint16_t p) {
+    uint16_t x = p % g.stride;
+    uint16_t y = p / g.stride;
+    return (x < g.llWidth && y < g.llHeight) || (2 * x < g.stride && 2 * y < g.rows);
+}
+
+// An LL coefficient's children are its level's three detail coefficients;
+// a detail coefficient's are the 2x2 block under it one level finer
+static uint8_t childrenOf(const WaveletGeometry& g, uint16_t p, uint16_t* children) {
+    uint16_t x = p % g.stride;
+    uint16_t y = p / g.stride;
+    if (x < g.llWidth && y < g.llHeight) {
+        uint16_t below = g.llHeight * g.stride;
+        children[0] = p + g.llWidth;
+        children[1] = p + below;
+        children[2] = p + below + g.llWidth;
+        return 3;
+    }
+    if (2 * x >= g.stride || 2 * y >= g.rows) {
+        return 0;
+    }
+    uint16_t first = 2 * y * g.stride + 2 * x;
+    children[0] = first;
+    children[1] = first + 1;
+    children[2] = first + g.stride;
+    children[3] = first + g.stride + 1;
+    return 4;
+}
+
+static inline uint16_t magnitude(int16_t value) {
+    return value < 0 ? -value : value;
+}
+
+static inline uint8_t bitLength(uint16_t value) {
+    return value ? 32 - __builtin_clz(value) : 0;
+}
+
+// Reverse raster visits every coefficient after all of its children
+static void computeSetBits(const WaveletGeometry& g, const WaveletWorkspace& ws) {
+    uint16_t children[4];
+    for (int p = (int)g.count - 1; p >= 0; p--) {
+        uint8_t count = childrenOf(g, p, children);
+        uint8_t descendants = 0;
+        uint8_t grandchildren = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            uint16_t child = children[i];
+            uint8_t below = ws.descendantBits[child];
+            descendants = max(descendants, max(bitLength(magnitude(ws.coef[child])), below));
+            grandchildren = max(grandchildren, below);
+        }
+        ws.descendantBits[p] = descendants;
+        ws.grandchildBits[p] = grandchildren;
+    }
+}
+
+// ===========================
+// Bit I/O
+// ===========================
+
+struct WaveletBitWriter {
+    uint8_t* out;
+    size_t capacity;
+    size_t byte;
+    uint8_t bit;
+
+    bool put(bool value) {
+        if (byte >= capacity) {
+            return false;
+        }
+        if (bit == 0) {
+            out[byte] = 0;
+        }
+        out[byte] |= (uint8_t)value << (7 - bit);
+        if (++bit == 8) {
+            bit = 0;
+            byte++;
+        }
+        return true;
+    }
+
+    size_t length() const { return byte + (bit ? 1 : 0); }
+};
+
+struct WaveletBitReader {
+    const uint8_t* in;
+    size_t length;
+    size_t byte;
+    uint8_t bit;
+
+    int get() {
+        if (byte >= length) {
+            return -1;
+        }
+        int value = (in[byte] >> (7 - bit)) & 1;
+        if (++bit == 8) {
+            bit = 0;
+            byte++;
+        }
+        return value;
+    }
+};
+
+// ===========================
+// SPIHT
+// ===========================
+
+static void listsBegin(const WaveletGeometry& g, const WaveletWorkspace& ws, size_t& lipCount,
+                       size_t& lisCount) {
+    lipCount = 0;
+    lisCount = 0;
+    for (uint16_t y = 0; y < g.llHeight; y++) {
+        for (uint16_t x = 0; x < g.llWidth; x++) {
+            uint16_t p = y * g.stride + x;
+            ws.lip[lipCount++] = p;
+            ws.lis[lisCount++] = p;
+        }
+    }
+}
+
+// Returns once capacity is reached or every bit plane is out
+static void spihtEncode(const WaveletGeometry& g, const WaveletWorkspace& ws, int top, WaveletBitWriter& writer) {
+    size_t lipCount, lisCount;
+    size_t lspCount = 0;
+    uint16_t children[4];
+    listsBegin(g, ws, lipCount, lisCount);
+
+    for (int n = top; n >= 0; n--) {
+        size_t refineCount = lspCount;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < lipCount; i++) {
+            uint16_t p = ws.lip[i];
+            bool significant = (magnitude(ws.coef[p]) >> n) != 0;
+            if (!writer.put(significant)) {
+                return;
+            }
+            if (!significant) {
+                ws.lip[kept++] = p;
+                continue;
+            }
+            if (!writer.put(ws.coef[p] < 0)) {
+                return;
+            }
+            ws.lsp[lspCount++] = p;
+        }
+        lipCount = kept;
+
+        // Entries appended during the pass are tested in it too
+        kept = 0;
+        for (size_t i = 0; i < lisCount; i++) {
+            uint16_t entry = ws.lis[i];
+            uint16_t p = entry & WAVELET_INDEX_MASK;
+            bool typeB = entry & WAVELET_TYPE_B;
+            bool significant = (typeB ? ws.grandchildBits[p] : ws.descendantBits[p]) > n;
+            if (!writer.put(significant)) {
+                return;
+            }
+            if (!significant) {
+                ws.lis[kept++] = entry;
+                continue;
+            }
+
+            uint8_t count = childrenOf(g, p, children);
+            if (typeB) {
+                for (uint8_t c = 0; c < count && lisCount < ws.lisCapacity; c++) {
+                    if (hasChildren(g, children[c])) {
+                        ws.lis[lisCount++] = children[c];
+                    }
+                }
+                continue;
+            }
+            for (uint8_t c = 0; c < count; c++) {
+                uint16_t child = children[c];
+                bool childSignificant = (magnitude(ws.coef[child]) >> n) != 0;
+                if (!writer.put(childSignificant)) {
+                    return;
+                }
+                if (!childSignificant) {
+                    ws.lip[lipCount++] = child;
+                } else if (!writer.put(ws.coef[child] < 0)) {
+                    return;
+                } else {
+                    ws.lsp[lspCount++] = child;
+                }
+            }
+            if (hasChildren(g, children[0]) && lisCount < ws.lisCapacity) {
+                ws.lis[lisCount++] = p | WAVELET_TYPE_B;
+            }
+        }
+        lisCount = kept;
+
+        for (size_t i = 0; i < refineCount; i++) {
+            if (!writer.put((magnitude(ws.coef[ws.lsp[i]]) >> n) & 1)) {
+                return;
+            }
+        }
+    }
+}
+
+// A coefficient found significant at plane n is put mid-interval, 1.5 x 2^n;
+// each refinement bit halves the interval and moves it to the new middle
+static inline int16_t significantValue(int n, bool negative) {
+    int16_t value = (1 << n) | ((1 << n) >> 1);
+    return negative ? -value : value;
+}
+
+static inline void refine(int16_t& coefficient, int n, int bit) {
+    uint16_t value = magnitude(coefficient);
+    value = (value & ~(1 << n)) | (bit << n) | ((1 << n) >> 1);
+    coefficient = coefficient < 0 ? -(int16_t)value : (int16_t)value;
+}
+
+// Mirror of spihtEncode(), stopping where the stream does
+static void spihtDecode(const WaveletGeometry& g, const WaveletWorkspace& ws, int top, WaveletBitReader& reader) {
+    size_t lipCount, lisCount;
+    size_t lspCount = 0;
+    uint16_t children[4];
+    listsBegin(g, ws, lipCount, lisCount);
+
+    for (int n = top; n >= 0; n--) {
+        size_t refineCount = lspCount;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < lipCount; i++) {
+            uint16_t p = ws.lip[i];
+            int significant = reader.get();
+            if (significant < 0) {
+                return;
+            }
+            if (!significant) {
+                ws.lip[kept++] = p;
+                continue;
+            }
+            int negative = reader.get();
+            if (negative < 0) {
+                return;
+            }
+            ws.coef[p] = significantValue(n, negative);
+            ws.lsp[lspCount++] = p;
+        }
+        lipCount = kept;
+
+        kept = 0;
+        for (size_t i = 0; i < lisCount; i++) {
+            uint16_t entry = ws.lis[i];
+            uint16_t p = entry & WAVELET_INDEX_MASK;
+            int significant = reader.get();
+            if (significant < 0) {
+                return;
+            }
+            if (!significant) {
+                ws.lis[kept++] = entry;
+                continue;
+            }
+
+            uint8_t count = childrenOf(g, p, children);
+            if (entry & WAVELET_TYPE_B) {
+                for (uint8_t c = 0; c < count && lisCount < ws.lisCapacity; c++) {
+                    if (hasChildren(g, children[c])) {
+                        ws.lis[lisCount++] = children[c];
+                    }
+                }
+                continue;
+            }
+            for (uint8_t c = 0; c < count; c++) {
+                uint16_t child = children[c];
+                int childSignificant = reader.get();
+                if (childSignificant < 0) {
+                    return;
+                }
+                if (!childSignificant) {
+                    ws.lip[lipCount++] = child;
+                    continue;
+                }
+                int negative = reader.get();
+                if (negative < 0) {
+                    return;
+                }
+                ws.coef[child] = significantValue(n, negative);
+                ws.lsp[lspCount++] = child;
+            }
+            if (hasChildren(g, children[0]) && lisCount < ws.lisCapacity) {
+                ws.lis[lisCount++] = p | WAVELET_TYPE_B;
+            }
+        }
+        lisCount = kept;
+
+        for (size_t i = 0; i < refineCount; i++) {
+            int bit = reader.get();
+            if (bit < 0) {
+                return;
+            }
+            refine(ws.coef[ws.lsp[i]], n, bit);
+        }
+    }
+}
+
+// ===========================
+// Encoder / Decoder
+// ===========================
+
+size_t waveletEncode(const uint8_t* plane, uint16_t width, uint16_t height, uint8_t* out, size_t capacity,
+                     void* workspace) {
+    WaveletGeometry g;
+    if (!plane || !out || !workspace || capacity < WAVELET_HEADER_SIZE || !waveletGeometry(width, height, g)) {
+        return 0;
+    }
+    WaveletWorkspace ws = waveletLayout(g, workspace);
+
+    // Centred on zero, the last row and column repeated into the padding
+    for (uint16_t y = 0; y < g.rows; y++) {
+        const uint8_t* row = &plane[min(y, (uint16_t)(height - 1)) * width];
+        int16_t* coef = &ws.coef[y * g.stride];
+        for (uint16_t x = 0; x < g.stride; x++) {
+            coef[x] = (int16_t)row[min(x, (uint16_t)(width - 1))] - 128;
+        }
+    }
+    transformForward(g, ws);
+
+    uint16_t largest = 0;
+    for (uint16_t y = 0; y < g.rows; y++) {
+        for (uint16_t x = 0; x < g.stride; x++) {
+            int16_t& coef = ws.coef[y * g.stride + x];
+            coef = (int16_t)(coef * (1 << bandShift(g, x, y)));
+            largest = max(largest, magnitude(coef));
+        }
+    }
+    int top = largest ? bitLength(largest) - 1 : 0;
+    computeSetBits(g, ws);
+
+    out[0] = WAVELET_MAGIC;
+    out[1] = (uint8_t)width;
+    out[2] = (uint8_t)height;
+    out[3] = (uint8_t)((g.levels << 4) | top);
+
+    WaveletBitWriter writer = {&out[WAVELET_HEADER_SIZE], capacity - WAVELET_HEADER_SIZE, 0, 0};
+    spihtEncode(g, ws, top, writer);
+    return WAVELET_HEADER_SIZE + writer.length();
+}
+
+bool waveletDimensions(const uint8_t* stream, size_t length, uint16_t& width, uint16_t& height) {
+    WaveletGeometry g;
+    if (!stream || length < WAVELET_HEADER_SIZE || stream[0] != WAVELET_MAGIC ||
+        !waveletGeometry(stream[1], stream[2], g) || (stream[3] >> 4) != g.levels) {
+        return false;
+    }
+    width = stream[1];
+    height = stream[2];
+    return true;
+}
+
+bool waveletDecode(const uint8_t* stream, size_t length, uint8_t* plane, size_t capacity, void* workspace) {
+    uint16_t width, height;
+    WaveletGeometry g;
+    if (!plane || !workspace || !waveletDimensions(stream, length, width, height) ||
+        !waveletGeometry(width, height, g) || capacity < (size_t)width * height) {
+        return false;
+    }
+    WaveletWorkspace ws = waveletLayout(g, workspace);
+    memset(ws.coef, 0, g.count * sizeof(int16_t));
+
+    WaveletBitReader reader = {&stream[WAVELET_HEADER_SIZE], length - WAVELET_HEADER_SIZE, 0, 0};
+    spihtDecode(g, ws, stream[3] & 0x0F, reader);
+
+    // Band weights off, rounding half away from zero
+    for (uint16_t y = 0; y < g.rows; y++) {
+        for (uint16_t x = 0; x < g.stride; x++) {
+            uint8_t shift = bandShift(g, x, y);
+            if (shift == 0) {
+                continue;
+            }
+            int16_t& coef = ws.coef[y * g.stride + x];
+            int32_t half = 1 << (shift - 1);
+            coef = (int16_t)(coef >= 0 ? (coef + half) >> shift : -((-coef + half) >> shift));
+        }
+    }
+    transformInverse(g, ws);
+
+    for (uint16_t y = 0; y < height; y++) {
+        const int16_t* coef = &ws.coef[y * g.stride];
+        uint8_t* row = &plane[y * width];
+        for (uint16_t x = 0; x < width; x++) {
+            row[x] = (uint8_t)constrain(coef[x] + 128, 0, 255);
+        }
+    }
+    return true;
+}
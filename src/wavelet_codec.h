@@ -0,0 +1,52 @@
+#ifndef WAVELET_CODEC_H
+#define WAVELET_CODEC_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+// ===========================
+// Wavelet Codec
+// Embedded (truncatable) coder for small 8-bit planes - the downscaled luma
+// or a chroma plane of a preview sent in a kilobyte or two
+// ===========================
+
+// The plane is padded to a multiple of 2^levels by repeating its last row
+// and column, then taken through a reversible LeGall 5/3 integer lifting
+// transform (the JPEG 2000 lossless one). Each band's coefficients are
+// shifted up so bit planes weigh about the same across levels; that's where
+// 5/3 falls short of orthonormal. The coefficients are then coded a bit
+// plane at a time by SPIHT (Said & Pearlman 1996): sets are spatial
+// orientation trees, and an LL coefficient roots its level's three detail
+// coefficients. Bits come out most important first, so any prefix of the
+// stream, cut at any byte, decodes to the best image those bytes describe.
+// The encoder just stops at the capacity it is given.
+//
+// Stream: [0x57 'W'][width][height][levels << 4 | top bit plane][SPIHT bits, MSB first]
+//
+// Integer only, no multiplies in the transform. The set significance tests
+// read per-coefficient bit lengths computed once, bottom up, so a pass costs
+// the list lengths and not the tree sizes. Nothing is allocated; both ends
+// work in a caller's workspace of waveletWorkspaceSize() bytes.
+
+#define WAVELET_MAGIC            0x57
+#define WAVELET_HEADER_SIZE      4
+#define WAVELET_MIN_DIMENSION    8
+#define WAVELET_MAX_DIMENSION    160     // Padded coefficient indices fit 15 bits
+#define WAVELET_MAX_LEVELS       4
+#define WAVELET_MIN_LL           4       // Fewest LL rows or columns left by the last level
+
+// Bytes of workspace for a width x height plane, 0 if the size is out of range
+size_t waveletWorkspaceSize(uint16_t width, uint16_t height);
+
+// Returns the stream length, at most capacity; 0 if the plane can't be
+// coded or capacity doesn't hold the header
+size_t waveletEncode(const uint8_t* plane, uint16_t width, uint16_t height, uint8_t* out, size_t capacity,
+                     void* workspace);
+
+// Size from a stream's header; false if it isn't one
+bool waveletDimensions(const uint8_t* stream, size_t length, uint16_t& width, uint16_t& height);
+
+// Any prefix of a stream (header included) into width * height bytes of plane
+bool waveletDecode(const uint8_t* stream, size_t length, uint8_t* plane, size_t capacity, void* workspace);
+
+#endif // WAVELET_CODEC_H
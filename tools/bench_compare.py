@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Compare a benchmark firmware run against a saved baseline.
+
+Reads the @bench lines the esp32-s3-benchmark environment prints - a
+`pio device monitor` log (its log2file filter writes one), or stdin - and
+compares each result's median cycles with the baseline's:
+
+    pio run -e esp32-s3-benchmark -t upload -t monitor
+    tools/bench_compare.py platformio-device-monitor-*.log --save baseline.json
+    tools/bench_compare.py new.log --baseline baseline.json --threshold 5
+
+Exits 1 if any result got slower than the threshold (percent), or a result
+in the baseline is missing from the run; 0 otherwise. Results only in the
+run are listed as new. When a log holds several runs ('r' on the serial
+port), the last complete one is used.
+"""
+
+import argparse
+import json
+import sys
+
+FIELDS = ("suite", "name", "param", "n", "min", "median", "mean", "max", "extra")
+
+
+def parse(lines):
+    """The last complete run in lines: {"info": {...}, "results": {key: {...}}, "skipped": [...]}"""
+    runs = []
+    current = None
+    for line in lines:
+        line = line.strip()
+        at = line.find("@bench")
+        if at < 0:
+            continue
+        parts = line[at:].split(",")
+        tag = parts[0]
+        if tag == "@bench-run" and len(parts) >= 4:
+            current = {"info": {"firmware": parts[1], "cpu_mhz": int(parts[2]), "build": ",".join(parts[3:])},
+                       "results": {}, "skipped": []}
+        elif current is None:
+            continue
+        elif tag == "@bench" and len(parts) == len(FIELDS) + 1:
+            result = dict(zip(FIELDS, parts[1:]))
+            for field in FIELDS[3:]:
+                result[field] = int(result[field])
+            current["results"]["/".join((result["suite"], result["name"], result["param"]))] = result
+        elif tag == "@bench-skip" and len(parts) >= 4:
+            current["skipped"].append({"suite": parts[1], "param": parts[2], "reason": ",".join(parts[3:])})
+        elif tag == "@bench-end" and len(parts) >= 2:
+            current["info"]["elapsed_ms"] = int(parts[1])
+            runs.append(current)
+            current = None
+    return runs[-1] if runs else None
+
+
+def compare(baseline, run, threshold):
+    """Prints a row per result; returns the number of regressions"""
+    regressions = 0
+    mhz = run["info"]["cpu_mhz"]
+    if baseline["info"]["cpu_mhz"] != mhz:
+        print("note: baseline at %d MHz, run at %d MHz - cycles compared as they are"
+              % (baseline["info"]["cpu_mhz"], mhz))
+    print("%-40s %12s %12s %8s %10s" % ("result", "baseline", "run", "change", "run us"))
+    for key in sorted(set(baseline["results"]) | set(run["results"])):
+        before = baseline["results"].get(key)
+        after = run["results"].get(key)
+        if after is None:
+            print("%-40s %12d %12s %8s" % (key, before["median"], "missing", ""))
+            regressions += 1
+            continue
+        micros = after["median"] / mhz
+        if before is None:
+            print("%-40s %12s %12d %8s %10.1f" % (key, "new", after["median"], "", micros))
+            continue
+        change = 100.0 * (after["median"] - before["median"]) / max(before["median"], 1)
+        flag = ""
+        if change > threshold:
+            flag = "  SLOWER"
+            regressions += 1
+        elif change < -threshold:
+            flag = "  faster"
+        print("%-40s %12d %12d %+7.1f%% %10.1f%s" % (key, before["median"], after["median"], change, micros, flag))
+    for skipped in run["skipped"]:
+        print("skipped: %s %s (%s)" % (skipped["suite"], skipped["param"], skipped["reason"]))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("log", help="monitor log with the run, - for stdin")
+    parser.add_argument("--baseline", help="baseline JSON to compare against")
+    parser.add_argument("--save", metavar="FILE", help="write the run as a baseline JSON")
+    parser.add_argument("--threshold", type=float, default=5.0, help="percent slower that counts (default 5)")
+    args = parser.parse_args()
+
+    if args.log == "-":
+        run = parse(sys.stdin)
+    else:
+        with open(args.log, errors="replace") as log:
+            run = parse(log)
+    if run is None:
+        sys.exit("no complete @bench-run..@bench-end in %s" % args.log)
+
+    if args.save:
+        with open(args.save, "w") as out:
+            json.dump(run, out, indent=1, sort_keys=True)
+        print("saved %d results to %s" % (len(run["results"]), args.save))
+    if not args.baseline:
+        if not args.save:
+            json.dump(run, sys.stdout, indent=1, sort_keys=True)
+            print()
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    regressions = compare(baseline, run, args.threshold)
+    if regressions:
+        print("%d result(s) slower by more than %.1f%% or missing" % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,268 @@
+-- Wireshark dissector for the balloon link capture (link_capture.h)
+--
+-- Records are LINKTYPE_USER0 (147): a 24-byte capture header, little
+-- endian, then the LoRa frame as it went on air. Copy this file to the
+-- personal Lua plugins folder (Help > About Wireshark > Folders) and open
+-- a capture from GET /api/linkcap on the base station or /linkcap.pcap on
+-- the balloon.
+--
+--   linkcap.kind == 0 && linkframe.type == 0x02   telemetry sent
+--   linkcap.outcome == 7                         frames whose ACK timed out
+--
+-- Each TX of a tracked frame is linked to the ACKED, ACK_TIMEOUT or DROPPED
+-- record of its sequence on the same link, once the capture has been read
+-- through (a reload, or any filter, does it).
+
+local linkcap = Proto("linkcap", "Balloon Link Capture")
+local frame_proto = Proto("linkframe", "Balloon LoRa Frame")
+
+local kinds = {
+    [0] = "TX", [1] = "RX", [2] = "RX CRC error", [3] = "TX timeout", [4] = "TX aborted",
+    [5] = "Beacon", [6] = "ACKed", [7] = "ACK timeout", [8] = "Dropped"
+}
+local links = { [0] = "Primary", [1] = "Bulk" }
+local packet_types = {
+    [0x01] = "Heartbeat", [0x02] = "Telemetry", [0x03] = "GPS", [0x04] = "Camera",
+    [0x05] = "Alert", [0x06] = "Command ACK", [0x07] = "Status", [0x08] = "Debug",
+    [0x09] = "Pong", [0x0A] = "Aggregate", [0x0B] = "Rate change", [0x0C] = "ACK",
+    [0x0D] = "NACK", [0x0E] = "Ping", [0x10] = "Fragment", [0x11] = "Fragment ACK",
+    [0x12] = "Command", [0x13] = "Camera tile", [0x14] = "Camera layer",
+    [0x15] = "Camera preview", [0x16] = "Command batch", [0x17] = "Firmware delta",
+    [0x18] = "Profile level", [0x19] = "Track segment",
+    [0xFF] = "Emergency"
+}
+local ack_types = { [0x00] = "Single", [0x04] = "Selective" }
+
+local f = linkcap.fields
+f.version = ProtoField.uint8("linkcap.version", "Version")
+f.kind = ProtoField.uint8("linkcap.kind", "Kind", base.DEC, kinds)
+f.link = ProtoField.uint8("linkcap.link", "Link", base.DEC, links)
+f.flags = ProtoField.uint8("linkcap.flags", "Flags", base.HEX)
+f.flag_utc = ProtoField.bool("linkcap.flags.utc", "UTC timestamp", 8, nil, 0x01)
+f.flag_tracked = ProtoField.bool("linkcap.flags.tracked", "Waits for an ACK", 8, nil, 0x02)
+f.flag_sync = ProtoField.bool("linkcap.flags.clock_sync", "Clock sync extension", 8, nil, 0x04)
+f.flag_fsk = ProtoField.bool("linkcap.flags.fsk", "FSK", 8, nil, 0x08)
+f.sf = ProtoField.uint8("linkcap.sf", "Spreading factor")
+f.cr = ProtoField.uint8("linkcap.cr", "Coding rate 4/")
+f.power = ProtoField.int8("linkcap.tx_power", "TX power (dBm)")
+f.channel = ProtoField.uint8("linkcap.channel", "Hop channel")
+f.bandwidth = ProtoField.uint32("linkcap.bandwidth", "Bandwidth (Hz) / bit rate (bps)")
+f.frequency = ProtoField.uint32("linkcap.frequency", "Frequency (Hz)")
+f.rssi = ProtoField.int8("linkcap.rssi", "RSSI (dBm)")
+f.snr = ProtoField.int8("linkcap.snr", "SNR (dB)")
+f.sequence = ProtoField.uint16("linkcap.sequence", "Sequence")
+f.airtime = ProtoField.uint16("linkcap.airtime", "Airtime (ms)")
+f.device = ProtoField.uint8("linkcap.device", "Capturing device")
+f.length = ProtoField.uint8("linkcap.length", "Frame length")
+f.outcome = ProtoField.uint8("linkcap.outcome", "Outcome", base.DEC, kinds)
+f.outcome_frame = ProtoField.framenum("linkcap.outcome_frame", "Outcome in")
+
+local g = frame_proto.fields
+g.version = ProtoField.uint8("linkframe.version", "Header version")
+g.flags = ProtoField.uint8("linkframe.flags", "Flags", base.HEX)
+g.device = ProtoField.uint8("linkframe.device", "Device")
+g.retry = ProtoField.uint8("linkframe.retry", "Retry count")
+g.timestamp = ProtoField.uint32("linkframe.timestamp", "Timestamp (s)")
+g.age = ProtoField.uint32("linkframe.age", "Age (s)")
+g.type = ProtoField.uint8("linkframe.type", "Type", base.HEX, packet_types)
+g.sequence = ProtoField.uint16("linkframe.seq", "Sequence")
+g.stamp = ProtoField.bytes("linkframe.latency_stamp", "Latency stamp")
+g.payload = ProtoField.bytes("linkframe.payload", "Payload")
+g.crc = ProtoField.uint16("linkframe.crc", "CRC-16", base.HEX)
+g.ack_seq = ProtoField.uint16("linkframe.ack.seq", "ACK sequence")
+g.ack_type = ProtoField.uint8("linkframe.ack.type", "ACK type", base.HEX, ack_types)
+g.ack_rssi = ProtoField.int8("linkframe.ack.rssi", "Peer RSSI (dBm)")
+g.ack_bitmap = ProtoField.uint32("linkframe.ack.bitmap", "Older sequences received", base.HEX)
+g.record = ProtoField.bytes("linkframe.aggregate.record", "Record")
+g.record_type = ProtoField.uint8("linkframe.aggregate.type", "Type", base.HEX, packet_types)
+g.record_seq = ProtoField.uint16("linkframe.aggregate.seq", "Sequence")
+g.record_length = ProtoField.uint8("linkframe.aggregate.length", "Length")
+
+-- First pass: the TX frame number of each (link, sequence), and each TX's outcome
+local last_tx = {}
+local outcomes = {}
+
+function linkcap.init()
+    last_tx = {}
+    outcomes = {}
+end
+
+-- Varint: up to five bytes, seven bits each; value and bytes used
+local function varint(tvb, offset, limit)
+    local value, shift, used = 0, 0, 0
+    while offset + used < limit and shift < 35 do
+        local byte = tvb(offset + used, 1):uint()
+        used = used + 1
+        value = value + bit.lshift(bit.band(byte, 0x7F), shift)
+        if bit.band(byte, 0x80) == 0 then
+            break
+        end
+        shift = shift + 7
+    end
+    return value, used
+end
+
+local function dissect_payload(tvb, tree, ptype, offset, stop, v2_timing)
+    if ptype == 0x0C and stop - offset >= 4 then
+        tree:add(g.ack_seq, tvb(offset, 2))
+        tree:add(g.ack_type, tvb(offset + 2, 1))
+        tree:add(g.ack_rssi, tvb(offset + 3, 1))
+        if tvb(offset + 2, 1):uint() == 0x04 and stop - offset >= 8 then
+            tree:add(g.ack_bitmap, tvb(offset + 4, 4))
+        end
+    elseif ptype == 0x0A then
+        -- [type][sequence 2][length], a latency stamp ahead of each with timing
+        while stop - offset >= 4 do
+            local length = tvb(offset + 3, 1):uint()
+            local extra = 0
+            if v2_timing then
+                local _, a = varint(tvb, offset + 4, stop)
+                local _, b = varint(tvb, offset + 4 + a, stop)
+                local _, c = varint(tvb, offset + 4 + a + b, stop)
+                extra = a + b + c + 1
+            end
+            local size = math.min(4 + extra + length, stop - offset)
+            local record = tree:add(g.record, tvb(offset, size))
+            record:add(g.record_type, tvb(offset, 1))
+            record:add(g.record_seq, tvb(offset + 1, 2))
+            record:add(g.record_length, tvb(offset + 3, 1))
+            offset = offset + size
+        end
+    end
+end
+
+local function dissect_frame(tvb, pinfo, tree, length)
+    if tvb:len() < 1 then
+        return
+    end
+    local subtree = tree:add(frame_proto, tvb())
+    local complete = tvb:len() >= length
+    local stop = complete and length - 2 or tvb:len()
+    local offset, ptype, timing
+    local first = tvb(0, 1):uint()
+
+    if bit.band(first, 0xE0) == 0x40 then
+        if tvb:len() < 6 then
+            return
+        end
+        subtree:add(g.version, 2):set_generated()
+        subtree:add(g.flags, tvb(0, 1), bit.band(first, 0x1F))
+        subtree:add(g.device, tvb(1, 1))
+        subtree:add(g.type, tvb(2, 1))
+        subtree:add(g.sequence, tvb(3, 2))
+        ptype = tvb(2, 1):uint()
+        local age, used = varint(tvb, 5, stop)
+        subtree:add(g.age, tvb(5, used), age)
+        offset = 5 + used
+        timing = bit.band(first, 0x02) ~= 0
+        if timing and ptype ~= 0x0A then
+            local _, a = varint(tvb, offset, stop)
+            local _, b = varint(tvb, offset + a, stop)
+            local _, c = varint(tvb, offset + a + b, stop)
+            local size = math.min(a + b + c + 1, stop - offset)
+            subtree:add(g.stamp, tvb(offset, size))
+            offset = offset + size
+        end
+    else
+        if tvb:len() < 11 then
+            return
+        end
+        subtree:add(g.version, tvb(0, 1))
+        subtree:add(g.device, tvb(1, 1))
+        subtree:add(g.flags, tvb(2, 1))
+        subtree:add(g.retry, tvb(3, 1))
+        subtree:add_le(g.timestamp, tvb(4, 4))
+        subtree:add(g.type, tvb(8, 1))
+        subtree:add(g.sequence, tvb(9, 2))
+        ptype = tvb(8, 1):uint()
+        offset = 11
+        timing = false
+    end
+
+    if stop > offset then
+        subtree:add(g.payload, tvb(offset, stop - offset))
+        dissect_payload(tvb, subtree, ptype, offset, stop, timing)
+    end
+    if complete and length >= 2 then
+        subtree:add(g.crc, tvb(length - 2, 2))
+    end
+    pinfo.cols.info:append(" " .. (packet_types[ptype] or string.format("Type 0x%02X", ptype)))
+end
+
+function linkcap.dissector(tvb, pinfo, tree)
+    if tvb:len() < 24 then
+        return 0
+    end
+    pinfo.cols.protocol = "LINKCAP"
+
+    local kind = tvb(1, 1):uint()
+    local link = tvb(2, 1):uint()
+    local flags = tvb(3, 1):uint()
+    local sequence = tvb(18, 2):le_uint()
+    local length = tvb(23, 1):uint()
+
+    local subtree = tree:add(linkcap, tvb(0, 24))
+    subtree:add(f.version, tvb(0, 1))
+    subtree:add(f.kind, tvb(1, 1))
+    subtree:add(f.link, tvb(2, 1))
+    local flag_tree = subtree:add(f.flags, tvb(3, 1))
+    flag_tree:add(f.flag_utc, tvb(3, 1))
+    flag_tree:add(f.flag_tracked, tvb(3, 1))
+    flag_tree:add(f.flag_sync, tvb(3, 1))
+    flag_tree:add(f.flag_fsk, tvb(3, 1))
+    subtree:add(f.sf, tvb(4, 1))
+    subtree:add(f.cr, tvb(5, 1))
+    subtree:add(f.power, tvb(6, 1))
+    subtree:add(f.channel, tvb(7, 1))
+    subtree:add_le(f.bandwidth, tvb(8, 4))
+    subtree:add_le(f.frequency, tvb(12, 4))
+    if kind == 1 or kind == 2 then
+        subtree:add(f.rssi, tvb(16, 1))
+        subtree:add(f.snr, tvb(17, 1))
+    end
+    subtree:add(f.device, tvb(22, 1))
+    subtree:add(f.length, tvb(23, 1))
+
+    local key = link * 65536 + sequence
+    if not pinfo.visited then
+        if kind == 0 and bit.band(flags, 0x02) ~= 0 then
+            last_tx[key] = pinfo.number
+        elseif kind >= 6 and last_tx[key] then
+            outcomes[last_tx[key]] = { kind = kind, number = pinfo.number }
+            if kind ~= 7 then
+                last_tx[key] = nil
+            end
+        end
+    end
+
+    local info = string.format("%s %s", links[link] or "Link " .. link, kinds[kind] or "Kind " .. kind)
+    if kind == 1 or kind == 2 then
+        info = info .. string.format(" %d dBm %d dB", tvb(16, 1):int(), tvb(17, 1):int())
+    else
+        subtree:add_le(f.sequence, tvb(18, 2))
+        info = info .. string.format(" seq %d", sequence)
+    end
+    if kind == 0 or kind == 5 then
+        subtree:add_le(f.airtime, tvb(20, 2))
+    end
+    if bit.band(flags, 0x08) ~= 0 then
+        info = info .. string.format(" FSK %d bps", tvb(8, 4):le_uint())
+    else
+        info = info .. string.format(" SF%d", tvb(4, 1):uint())
+    end
+    pinfo.cols.info = info
+
+    local outcome = outcomes[pinfo.number]
+    if outcome then
+        subtree:add(f.outcome, outcome.kind):set_generated()
+        subtree:add(f.outcome_frame, outcome.number):set_generated()
+        pinfo.cols.info:append(" [" .. kinds[outcome.kind] .. "]")
+    end
+
+    if tvb:len() > 24 then
+        dissect_frame(tvb(24):tvb(), pinfo, tree, length)
+    end
+    return tvb:len()
+end
+
+DissectorTable.get("wtap_encap"):add(wtap.USER0, linkcap)
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""Build a firmware patch for the balloon's delta OTA update.
+
+Takes the image the balloon is running and the new one - both the .bin
+PlatformIO builds, .pio/build/<env>/firmware.bin - and writes the patch
+firmware_update.h describes, checked by applying it here first:
+
+    tools/make_delta.py flight-2.0.0.bin .pio/build/esp32-s3-balloon/firmware.bin -o update.bdlt
+    tools/make_delta.py old.bin new.bin -o update.bdlt --upload http://192.168.4.1
+
+--upload POSTs it to the base station's /api/firmware, which sends it up.
+Once the balloon logs the update ready, boot it with
+    curl -X POST 'http://192.168.4.1/api/firmware?activate=<first 8 hex digits>'
+using the new image's SHA-256 this prints.
+
+The matching is bsdiff's idea without its suffix array: old windows are
+indexed by their first INDEX_BYTES bytes, a match found through the index
+is extended exactly both ways, then on forward while at least half of each
+WINDOW bytes still agree - code moved by a few bytes changes addresses in
+it, not the rest. The extended block goes as COPY runs where the bytes
+agree and DIFF where they don't; what no match covers goes as INSERT.
+Exits 1 if the patch is larger than the balloon can hold.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import urllib.request
+
+MAGIC = b"BDLT"
+VERSION = 1
+HEADER = struct.Struct(">4sB3xI32sI32s")
+
+OP_COPY = 0x00
+OP_DIFF = 0x01
+OP_INSERT = 0x02
+OP_SEEK = 0x03
+OP_END = 0xFF
+
+# firmware_update.h: FIRMWARE_DELTA_MAX_CHUNKS * FIRMWARE_CHUNK_DATA_BYTES
+MAX_PATCH_BYTES = 8 * (256 * 193 - 4)
+
+INDEX_BYTES = 8         # Old window length indexed, and the shortest match worth a SEEK
+INDEX_STEP = 4          # Old positions indexed - a match is found within this many new bytes of its start
+WINDOW = 16             # Approximate extension step
+MIN_COPY_RUN = 3        # Agreeing bytes inside a block shorter than this stay in the DIFF around them
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return value * 2 if value >= 0 else -value * 2 - 1
+
+
+def build_index(old):
+    index = {}
+    for i in range(0, len(old) - INDEX_BYTES + 1, INDEX_STEP):
+        index.setdefault(old[i:i + INDEX_BYTES], i)
+    return index
+
+
+def extend(old, new, op, np, floor):
+    """Exact match at old[op:], new[np:] grown back to floor; (old start, new start, length)"""
+    back = 0
+    while np - back > floor and op - back > 0 and old[op - back - 1] == new[np - back - 1]:
+        back += 1
+    length = 0
+    while op + length < len(old) and np + length < len(new) and old[op + length] == new[np + length]:
+        length += 1
+    return op - back, np - back, back + length
+
+
+def extend_approximate(old, new, op, np, length):
+    """Grows an exact match while half of each WINDOW bytes beyond it agree"""
+    end = length
+    while op + end + WINDOW <= len(old) and np + end + WINDOW <= len(new):
+        agree = sum(1 for i in range(WINDOW) if old[op + end + i] == new[np + end + i])
+        if agree * 2 < WINDOW:
+            break
+        end += WINDOW
+    # Not past the last byte that agreed
+    while end > length and old[op + end - 1] != new[np + end - 1]:
+        end -= 1
+    return end
+
+
+def encode_block(out, old, new, op, np, length):
+    """COPY where old and new agree for MIN_COPY_RUN bytes or more, DIFF between"""
+    i = 0
+    while i < length:
+        run = 0
+        while i + run < length and old[op + i + run] == new[np + i + run]:
+            run += 1
+        if run >= MIN_COPY_RUN or i + run == length:
+            if run:
+                out += bytes([OP_COPY]) + varint(run)
+            i += run
+            continue
+        # DIFF up to the next run of agreeing bytes long enough for a COPY
+        start = i
+        while i < length:
+            run = 0
+            while i + run < length and run < MIN_COPY_RUN and old[op + i + run] == new[np + i + run]:
+                run += 1
+            if run >= MIN_COPY_RUN:
+                break
+            i += max(run, 1)
+        out += bytes([OP_DIFF]) + varint(i - start)
+        out += bytes((new[np + k] - old[op + k]) & 0xFF for k in range(start, i))
+
+
+def make_patch(old, new):
+    index = build_index(old)
+    ops = bytearray()
+    cursor = 0          # Old cursor, as the balloon keeps it
+    literal = 0         # Start of the new bytes no block has taken yet
+    j = 0
+    while j + INDEX_BYTES <= len(new):
+        candidates = []
+        # Where the last block leaves off, shifted by the literal since - an edit that kept the length
+        follow = cursor + (j - literal)
+        if follow + INDEX_BYTES <= len(old):
+            candidates.append(follow)
+        found = index.get(new[j:j + INDEX_BYTES])
+        if found is not None:
+            candidates.append(found)
+
+        best = None
+        for candidate in candidates:
+            match = extend(old, new, candidate, j, literal)
+            if match[2] >= INDEX_BYTES and (best is None or match[2] > best[2]):
+                best = match
+        if best is None:
+            j += 1
+            continue
+
+        op, np, length = best
+        length = extend_approximate(old, new, op, np, length)
+        if np > literal:
+            ops += bytes([OP_INSERT]) + varint(np - literal) + new[literal:np]
+        if op != cursor:
+            ops += bytes([OP_SEEK]) + varint(zigzag(op - cursor))
+        encode_block(ops, old, new, op, np, length)
+        cursor = op + length
+        literal = j = np + length
+
+    if literal < len(new):
+        ops += bytes([OP_INSERT]) + varint(len(new) - literal) + new[literal:]
+    ops.append(OP_END)
+
+    header = HEADER.pack(MAGIC, VERSION, len(old), hashlib.sha256(old).digest(),
+                         len(new), hashlib.sha256(new).digest())
+    return header + bytes(ops)
+
+
+def apply_patch(old, patch):
+    """As firmware_update.cpp applies it; raises ValueError on a bad patch"""
+    magic, version, old_length, old_hash, new_length, new_hash = HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a patch")
+    if old_length > len(old) or hashlib.sha256(old[:old_length]).digest() != old_hash:
+        raise ValueError("old image isn't the patch's base")
+
+    pos = HEADER.size
+    cursor = 0
+    out = bytearray()
+
+    def read_varint():
+        nonlocal pos
+        value = shift = 0
+        while True:
+            byte = patch[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    while True:
+        code = patch[pos]
+        pos += 1
+        if code == OP_END:
+            break
+        n = read_varint()
+        if code == OP_SEEK:
+            cursor += -(n >> 1) - 1 if n & 1 else n >> 1
+        elif code == OP_INSERT:
+            out += patch[pos:pos + n]
+            pos += n
+        elif code in (OP_COPY, OP_DIFF):
+            if cursor < 0 or cursor + n > old_length:
+                raise ValueError("reads outside the old image")
+            if code == OP_COPY:
+                out += old[cursor:cursor + n]
+            else:
+                out += bytes((old[cursor + k] + patch[pos + k]) & 0xFF for k in range(n))
+                pos += n
+            cursor += n
+        else:
+            raise ValueError("unknown op 0x%02x" % code)
+
+    if len(out) != new_length or hashlib.sha256(out).digest() != new_hash:
+        raise ValueError("new image doesn't match")
+    return bytes(out)
+
+
+def upload(url, patch):
+    request = urllib.request.Request(url.rstrip("/") + "/api/firmware", data=patch, method="POST",
+                                     headers={"Content-Type": "application/octet-stream"})
+    with urllib.request.urlopen(request, timeout=60) as response:
+        return response.read().decode()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old", help="image the balloon is running")
+    parser.add_argument("new", help="image to update it to")
+    parser.add_argument("-o", "--output", help="patch file to write")
+    parser.add_argument("--upload", metavar="URL", help="POST the patch to the base station at URL")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    patch = make_patch(old, new)
+    if apply_patch(old, patch) != new:
+        print("error: the patch doesn't rebuild the new image", file=sys.stderr)
+        return 1
+
+    new_hash = hashlib.sha256(new).hexdigest()
+    print("%s: %d -> %d bytes, patch %d bytes (%.1f%% of the new image)"
+          % (args.new, len(old), len(new), len(patch), 100.0 * len(patch) / max(len(new), 1)))
+    print("new image SHA-256 %s - activate=%s" % (new_hash, new_hash[:8]))
+    if len(patch) > MAX_PATCH_BYTES:
+        print("error: over the %d bytes the balloon holds - flash it instead" % MAX_PATCH_BYTES, file=sys.stderr)
+        return 1
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(patch)
+    if args.upload:
+        print(upload(args.upload, patch))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
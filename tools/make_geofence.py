@@ -0,0 +1,315 @@
+#!/usr/bin/env python3
+"""Build the balloon's geofence partition image from GeoJSON zones.
+
+Each Polygon or MultiPolygon feature is one zone; holes are kept. The
+feature's properties give the rest:
+
+    id       zone number, reported in the balloon's events (default: its index)
+    name     up to 12 characters
+    kind     "no_fly", "restricted" or "caution" (default "no_fly")
+    floor    m MSL, the bottom of the zone (default -1000)
+    ceiling  m MSL, the top (default 100000)
+
+    tools/make_geofence.py zones.geojson -o geofence.bin
+    tools/make_geofence.py zones.geojson -o geofence.bin --cell 0.02
+    parttool.py write_partition --partition-name geofence --input geofence.bin
+
+The grid and its cell lists are what geofence.h describes. Before writing,
+random points over the grid are checked the way the balloon checks a fix
+against a plain point-in-polygon test of every zone; any disagreement fails
+the build.
+"""
+
+import argparse
+import binascii
+import json
+import math
+import random
+import struct
+import sys
+
+MAGIC = 0x314F4547
+VERSION = 1
+NAME_SIZE = 12
+CENTRE_INSIDE = 0x01
+PARTITION_BYTES = 0x40000       # partitions.csv "geofence"
+
+HEADER = struct.Struct("<IHHHHiiiiIIIIIIIIIHH")
+ZONE = struct.Struct("<HBBiiII12s")
+CELL = struct.Struct("<IHbb")
+REF = struct.Struct("<HBBII")
+VERTEX = struct.Struct("<ii")
+
+KINDS = {"no_fly": 0, "restricted": 1, "caution": 2}
+
+
+def e7(degrees):
+    return int(round(degrees * 1e7))
+
+
+def load_zones(path):
+    """[(properties, [ring, ...])], rings as closed (lat, lon) degrees * 1e7 lists"""
+    with open(path) as f:
+        document = json.load(f)
+    features = document["features"] if document.get("type") == "FeatureCollection" else [document]
+
+    zones = []
+    for index, feature in enumerate(features):
+        geometry = feature["geometry"]
+        if geometry["type"] == "Polygon":
+            polygons = [geometry["coordinates"]]
+        elif geometry["type"] == "MultiPolygon":
+            polygons = geometry["coordinates"]
+        else:
+            continue
+        rings = []
+        for polygon in polygons:
+            for ring in polygon:
+                points = [(e7(lat), e7(lon)) for lon, lat in ((p[0], p[1]) for p in ring)]
+                if points[0] != points[-1]:
+                    points.append(points[0])
+                if len(points) >= 4:
+                    rings.append(points)
+        properties = dict(feature.get("properties") or {})
+        properties.setdefault("id", index)
+        zones.append((properties, rings))
+    return zones
+
+
+def segment_meets_box(a, b, south, west, north, east):
+    """Liang-Barsky: does segment a-b touch the closed box"""
+    t0, t1 = 0.0, 1.0
+    dlat, dlon = b[0] - a[0], b[1] - a[1]
+    for p, q in ((-dlon, a[1] - west), (dlon, east - a[1]), (-dlat, a[0] - south), (dlat, north - a[0])):
+        if p == 0:
+            if q < 0:
+                return False
+            continue
+        t = q / p
+        if p < 0:
+            t0 = max(t0, t)
+        else:
+            t1 = min(t1, t)
+        if t0 > t1:
+            return False
+    return True
+
+
+def point_in_rings(lat, lon, rings):
+    """Even-odd ray cast over every ring"""
+    inside = False
+    for ring in rings:
+        for (alat, alon), (blat, blon) in zip(ring, ring[1:]):
+            if (alat > lat) != (blat > lat):
+                cross_lon = alon + (lat - alat) * (blon - alon) / (blat - alat)
+                if lon < cross_lon:
+                    inside = not inside
+    return inside
+
+
+def cross(ax, ay, bx, by):
+    return ax * by - ay * bx
+
+
+def contains_ref(flags, edge_list, vertices, lat, lon, centre_lat, centre_lon):
+    """As GeofenceManager::containsRef()"""
+    inside = bool(flags & CENTRE_INSIDE)
+    cx, cy = float(centre_lon - lon), float(centre_lat - lat)
+    for i in edge_list:
+        a, b = vertices[i], vertices[i + 1]
+        ax, ay = float(a[1] - lon), float(a[0] - lat)
+        bx, by = float(b[1] - lon), float(b[0] - lat)
+        if (cross(cx, cy, ax, ay) > 0) == (cross(cx, cy, bx, by) > 0):
+            continue
+        ex, ey = bx - ax, by - ay
+        if (cross(ex, ey, -ax, -ay) > 0) != (cross(ex, ey, cx - ax, cy - ay) > 0):
+            inside = not inside
+    return inside
+
+
+def centre(grid, r, c, nudge):
+    """As GeofenceManager::find() places a cell's centre"""
+    cell = grid["cell"]
+    return (grid["min_lat"] + r * cell + cell * (128 + nudge[0]) // 256,
+            grid["min_lon"] + c * cell + cell * (128 + nudge[1]) // 256)
+
+
+def on_an_edge(point, edges, vertices):
+    for i in edges:
+        a, b = vertices[i], vertices[i + 1]
+        if ((b[0] - a[0]) * (point[1] - a[1]) - (b[1] - a[1]) * (point[0] - a[0]) == 0 and
+                min(a[0], b[0]) <= point[0] <= max(a[0], b[0]) and min(a[1], b[1]) <= point[1] <= max(a[1], b[1])):
+            return True
+    return False
+
+
+def pick_nudge(grid, r, c, edges, vertices):
+    """The cell's centre, moved off any edge that runs through it"""
+    rng = random.Random(r * 65536 + c)
+    nudge = (0, 0)
+    while on_an_edge(centre(grid, r, c, nudge), edges, vertices):
+        nudge = (rng.randint(-100, 100), rng.randint(-100, 100))
+    return nudge
+
+
+def build(zones, cell_degrees, max_cells):
+    vertices = []
+    zone_rows = []
+    zone_edges = []
+    for properties, rings in zones:
+        first = len(vertices)
+        edges = []
+        for ring in rings:
+            start = len(vertices)
+            vertices.extend(ring)
+            edges.extend(range(start, start + len(ring) - 1))
+        zone_rows.append((properties, first, len(vertices) - first))
+        zone_edges.append(edges)
+    if not vertices:
+        raise ValueError("no polygons in the input")
+
+    min_lat = min(v[0] for v in vertices)
+    min_lon = min(v[1] for v in vertices)
+    max_lat = max(v[0] for v in vertices)
+    max_lon = max(v[1] for v in vertices)
+
+    cell = e7(cell_degrees)
+    while True:
+        rows = (max_lat - min_lat) // cell + 1
+        columns = (max_lon - min_lon) // cell + 1
+        if rows * columns <= max_cells and rows <= 0xFFFF and columns <= 0xFFFF:
+            break
+        cell = int(cell * math.sqrt(rows * columns / max_cells)) + 1
+
+    # Per cell: {zone: set of edges}
+    cell_edges = [dict() for _ in range(rows * columns)]
+    for z, edges in enumerate(zone_edges):
+        for i in edges:
+            a, b = vertices[i], vertices[i + 1]
+            r0 = (min(a[0], b[0]) - min_lat) // cell
+            r1 = (max(a[0], b[0]) - min_lat) // cell
+            c0 = (min(a[1], b[1]) - min_lon) // cell
+            c1 = (max(a[1], b[1]) - min_lon) // cell
+            for r in range(r0, r1 + 1):
+                south = min_lat + r * cell
+                for c in range(c0, c1 + 1):
+                    west = min_lon + c * cell
+                    if segment_meets_box(a, b, south, west, south + cell, west + cell):
+                        cell_edges[r * columns + c].setdefault(z, []).append(i)
+
+    grid = dict(min_lat=min_lat, min_lon=min_lon, cell=cell, rows=rows, columns=columns)
+    boxes = [(min(v[0] for ring in rings for v in ring), max(v[0] for ring in rings for v in ring),
+              min(v[1] for ring in rings for v in ring), max(v[1] for ring in rings for v in ring))
+             if rings else None for _, rings in zones]
+    cells = []
+    refs = []
+    edge_table = []
+    for r in range(rows):
+        for c in range(columns):
+            listed = cell_edges[r * columns + c]
+            nudge = pick_nudge(grid, r, c, [i for edges in listed.values() for i in edges], vertices)
+            centre_lat, centre_lon = centre(grid, r, c, nudge)
+            first = len(refs)
+            for z, (properties, rings) in enumerate(zones):
+                crossing = listed.get(z, [])
+                box = boxes[z]
+                centre_inside = (box is not None and box[0] <= centre_lat <= box[1] and
+                                 box[2] <= centre_lon <= box[3] and point_in_rings(centre_lat, centre_lon, rings))
+                if not crossing and not centre_inside:
+                    continue
+                refs.append((z, CENTRE_INSIDE if centre_inside else 0, len(edge_table), len(crossing)))
+                edge_table.extend(crossing)
+            cells.append((first, len(refs) - first, nudge))
+
+    return grid, zone_rows, cells, refs, edge_table, vertices
+
+
+def pack(grid, zone_rows, cells, refs, edge_table, vertices):
+    body = bytearray()
+    for properties, first, count in zone_rows:
+        kind = KINDS[properties.get("kind", "no_fly")]
+        name = str(properties.get("name", "")).encode()[:NAME_SIZE]
+        body += ZONE.pack(int(properties["id"]), kind, 0, int(properties.get("floor", -1000)),
+                          int(properties.get("ceiling", 100000)), first, count, name)
+    cells_offset = HEADER.size + len(body)
+    for first, count, nudge in cells:
+        if count > 0xFFFF:
+            raise ValueError("a cell with more than 65535 zones")
+        body += CELL.pack(first, count, nudge[0], nudge[1])
+    refs_offset = HEADER.size + len(body)
+    for zone, flags, first, count in refs:
+        body += REF.pack(zone, flags, 0, first, count)
+    edges_offset = HEADER.size + len(body)
+    body += struct.pack("<%dI" % len(edge_table), *edge_table)
+    vertices_offset = HEADER.size + len(body)
+    for lat, lon in vertices:
+        body += VERTEX.pack(lat, lon)
+
+    length = HEADER.size + len(body)
+    fields = [MAGIC, VERSION, len(zone_rows), grid["columns"], grid["rows"], grid["min_lat"], grid["min_lon"],
+              grid["cell"], grid["cell"], HEADER.size, cells_offset, refs_offset, edges_offset, vertices_offset,
+              len(refs), len(edge_table), len(vertices), length, binascii.crc_hqx(bytes(body), 0)]
+    header = HEADER.pack(*fields, 0)
+    header = HEADER.pack(*fields, binascii.crc_hqx(header[:HEADER.size - 2], 0))
+    return header + bytes(body)
+
+
+def verify(zones, grid, cells, refs, edge_table, vertices, samples):
+    """Random points against a plain point-in-polygon test; returns the count that disagree"""
+    cell = grid["cell"]
+    extent_lat = grid["rows"] * cell
+    extent_lon = grid["columns"] * cell
+    wrong = 0
+    rng = random.Random(1)
+    for _ in range(samples):
+        lat = grid["min_lat"] + rng.randrange(extent_lat)
+        lon = grid["min_lon"] + rng.randrange(extent_lon)
+        r = (lat - grid["min_lat"]) // cell
+        c = (lon - grid["min_lon"]) // cell
+        first, count, nudge = cells[r * grid["columns"] + c]
+        centre_lat, centre_lon = centre(grid, r, c, nudge)
+        found = set()
+        for zone, flags, edge_first, edge_count in refs[first:first + count]:
+            if contains_ref(flags, edge_table[edge_first:edge_first + edge_count], vertices, lat, lon,
+                            centre_lat, centre_lon):
+                found.add(zone)
+        expected = {z for z, (_, rings) in enumerate(zones) if point_in_rings(lat, lon, rings)}
+        if found != expected:
+            wrong += 1
+    return wrong
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("zones", help="GeoJSON file of zone polygons")
+    parser.add_argument("-o", "--output", required=True, help="partition image to write")
+    parser.add_argument("--cell", type=float, default=0.05, help="grid cell size in degrees (default 0.05)")
+    parser.add_argument("--max-cells", type=int, default=8192, help="cells at most; the size grows to fit")
+    parser.add_argument("--samples", type=int, default=5000, help="random points checked before writing")
+    args = parser.parse_args()
+
+    zones = load_zones(args.zones)
+    grid, zone_rows, cells, refs, edge_table, vertices = build(zones, args.cell, args.max_cells)
+    image = pack(grid, zone_rows, cells, refs, edge_table, vertices)
+
+    busiest = max(sum(refs[i][3] for i in range(first, first + count)) for first, count, _ in cells)
+    print("%d zones, %d vertices; %dx%d grid of %.4f deg cells, %d refs, %d edges listed, at most %d in a cell"
+          % (len(zones), len(vertices), grid["columns"], grid["rows"], grid["cell"] * 1e-7, len(refs),
+             len(edge_table), busiest))
+    print("image %d bytes of the partition's %d" % (len(image), PARTITION_BYTES))
+    if len(image) > PARTITION_BYTES:
+        print("error: the image doesn't fit - take a larger --cell or fewer zones", file=sys.stderr)
+        return 1
+
+    wrong = verify(zones, grid, cells, refs, edge_table, vertices, args.samples)
+    if wrong:
+        print("error: %d of %d sample points disagree with the plain test" % (wrong, args.samples), file=sys.stderr)
+        return 1
+
+    with open(args.output, "wb") as f:
+        f.write(image)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""Pack map tiles into the base station's tile archive.
+
+The tiles come from an MBTiles file (its TMS rows turned to XYZ) or a
+z/x/y.<ext> directory such as a tile downloader leaves. Only the zooms and
+the box given are kept; tiles with the same bytes - open sea, empty land -
+are stored once. All tiles must be one format: png, jpeg or webp.
+
+    tools/make_tiles.py launch_site.mbtiles -o tiles.pack --max-zoom 14
+    tools/make_tiles.py tiles/ -o tiles.pack --bbox=-1.9,51.2,-1.5,51.5
+    curl --data-binary @tiles.pack http://192.168.4.1/api/tiles
+
+The layout is what base_station_tiles.h describes: the header, the index
+sorted by tile key, then the tile data.
+"""
+
+import argparse
+import hashlib
+import math
+import os
+import sqlite3
+import struct
+import sys
+import time
+
+MAGIC = 0x4C495442
+VERSION = 1
+INDEX_MAX = 16384               # TILE_INDEX_MAX
+LITTLEFS_BYTES = 0xC20000       # partitions_base_station.csv "spiffs", which the column store shares
+
+HEADER = struct.Struct("<IHBBB3sIIiiii")
+ENTRY = struct.Struct("<QII")
+
+FORMATS = {"png": 0, "jpeg": 1, "webp": 2}
+
+
+def e7(degrees):
+    return int(round(degrees * 1e7))
+
+
+def key(z, x, y):
+    return z << 48 | (x & 0xFFFFFF) << 24 | (y & 0xFFFFFF)
+
+
+def sniff(data):
+    """The format of one tile's bytes, from its signature"""
+    if data.startswith(b"\x89PNG"):
+        return "png"
+    if data.startswith(b"\xff\xd8"):
+        return "jpeg"
+    if data[:4] == b"RIFF" and data[8:12] == b"WEBP":
+        return "webp"
+    return None
+
+
+def tile_bounds(z, x, y):
+    """(west, south, east, north) of an XYZ tile in degrees"""
+    n = 2 ** z
+
+    def latitude(row):
+        return math.degrees(math.atan(math.sinh(math.pi * (1 - 2 * row / n))))
+
+    return x / n * 360 - 180, latitude(y + 1), (x + 1) / n * 360 - 180, latitude(y)
+
+
+def load_mbtiles(path):
+    """[(z, x, y, bytes)] with y counted down from the north"""
+    db = sqlite3.connect(path)
+    rows = db.execute("SELECT zoom_level, tile_column, tile_row, tile_data FROM tiles").fetchall()
+    db.close()
+    return [(z, x, (1 << z) - 1 - row, bytes(data)) for z, x, row, data in rows]
+
+
+def load_directory(path):
+    tiles = []
+    for z in os.listdir(path):
+        if not z.isdigit():
+            continue
+        for x in os.listdir(os.path.join(path, z)):
+            if not x.isdigit():
+                continue
+            for name in os.listdir(os.path.join(path, z, x)):
+                y = name.split(".")[0]
+                if y.isdigit():
+                    with open(os.path.join(path, z, x, name), "rb") as f:
+                        tiles.append((int(z), int(x), int(y), f.read()))
+    return tiles
+
+
+def select(tiles, min_zoom, max_zoom, bbox):
+    kept = []
+    for z, x, y, data in tiles:
+        if z < min_zoom or z > max_zoom:
+            continue
+        if bbox:
+            west, south, east, north = tile_bounds(z, x, y)
+            if east < bbox[0] or west > bbox[2] or north < bbox[1] or south > bbox[3]:
+                continue
+        kept.append((z, x, y, data))
+    return kept
+
+
+def pack(tiles, format_name):
+    """The archive's bytes, and how many tiles' data was shared"""
+    tiles = sorted(tiles, key=lambda t: key(t[0], t[1], t[2]))
+    data_start = HEADER.size + ENTRY.size * len(tiles)
+    offsets = {}
+    blobs = []
+    entries = []
+    offset = data_start
+    for z, x, y, data in tiles:
+        digest = hashlib.sha1(data).digest()
+        if digest not in offsets:
+            offsets[digest] = offset
+            blobs.append(data)
+            offset += len(data)
+        entries.append(ENTRY.pack(key(z, x, y), offsets[digest], len(data)))
+
+    bounds = [tile_bounds(z, x, y) for z, x, y, _ in tiles]
+    header = HEADER.pack(MAGIC, VERSION, FORMATS[format_name], min(t[0] for t in tiles), max(t[0] for t in tiles),
+                         b"\0\0\0", len(tiles), int(time.time()), e7(min(b[0] for b in bounds)),
+                         e7(min(b[1] for b in bounds)), e7(max(b[2] for b in bounds)), e7(max(b[3] for b in bounds)))
+    return header + b"".join(entries) + b"".join(blobs), len(tiles) - len(blobs)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="MBTiles file or z/x/y tile directory")
+    parser.add_argument("-o", "--output", required=True, help="archive to write")
+    parser.add_argument("--min-zoom", type=int, default=0)
+    parser.add_argument("--max-zoom", type=int, default=22)
+    parser.add_argument("--bbox", help="west,south,east,north in degrees; tiles touching it are kept")
+    args = parser.parse_args()
+
+    bbox = [float(v) for v in args.bbox.split(",")] if args.bbox else None
+    tiles = load_directory(args.source) if os.path.isdir(args.source) else load_mbtiles(args.source)
+    tiles = select(tiles, args.min_zoom, args.max_zoom, bbox)
+    if not tiles:
+        print("error: no tiles in those zooms and bounds", file=sys.stderr)
+        return 1
+    if len(tiles) > INDEX_MAX:
+        print("error: %d tiles, the base station indexes %d - take a lower --max-zoom or a smaller --bbox"
+              % (len(tiles), INDEX_MAX), file=sys.stderr)
+        return 1
+    formats = set(sniff(t[3]) for t in tiles)
+    if len(formats) != 1 or None in formats:
+        print("error: tiles must all be one of png, jpeg or webp, not %s" % sorted(map(str, formats)),
+              file=sys.stderr)
+        return 1
+
+    image, shared = pack(tiles, formats.pop())
+    print("%d tiles, zoom %d-%d, %d sharing another's bytes" % (len(tiles), min(t[0] for t in tiles),
+                                                               max(t[0] for t in tiles), shared))
+    print("archive %d bytes of LittleFS's %d" % (len(image), LITTLEFS_BYTES))
+    if len(image) > LITTLEFS_BYTES:
+        print("error: the archive doesn't fit - take a lower --max-zoom or a smaller --bbox", file=sys.stderr)
+        return 1
+
+    with open(args.output, "wb") as f:
+        f.write(image)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
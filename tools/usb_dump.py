@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Pull the balloon's flight data over its native USB port after recovery.
+
+Talks to usb_dump.h on the balloon: the flight recorder, image store and
+core dump partitions as they are in flash, and the debug log ring as
+DebugUtils::dumpBinary() writes it. Each goes to <out>/<name>.bin.
+
+    tools/usb_dump.py /dev/ttyACM0
+    tools/usb_dump.py /dev/ttyACM0 -o flight42 --source flight --source images
+    tools/usb_dump.py /dev/ttyACM0 --list
+
+A partition file already partly there is resumed from its length; a
+complete one is skipped. --fresh starts them over. The log is a snapshot
+taken when the session opens, so it is always fetched whole.
+
+Every DATA chunk is checked against its CRC and written only in order; a
+bad or missing one is NACKed and the balloon goes back to it. Needs
+pyserial.
+"""
+
+import argparse
+import binascii
+import os
+import struct
+import sys
+import time
+
+try:
+    import serial
+except ImportError:
+    sys.exit("pyserial is needed: pip install pyserial")
+
+SYNC = 0xD5
+SYNC_HOST = 0xAA
+SYNC_DEVICE = 0xBB
+
+HELLO, READ, ACK, NACK, STOP = 0x01, 0x02, 0x03, 0x04, 0x05
+INFO, DATA, DONE, ERROR = 0x81, 0x82, 0x83, 0x84
+
+ERRORS = {1: "bad source", 2: "bad offset", 3: "partition map failed", 4: "bad command"}
+PROTOCOL_VERSION = 1
+NAME_BYTES = 8
+DEFAULT_CHUNK = 4096
+LOG_SOURCE = "log"
+FRAME_TIMEOUT_S = 2.0       # Nothing heard this long: NACK from what we have
+PROGRESS_S = 0.25
+HELLO_TRIES = 5
+
+
+class DumpLink:
+    def __init__(self, port):
+        self.port = serial.Serial(port, timeout=0.05)
+        self.buffer = bytearray()
+        self.bad_frames = 0
+        self.max_payload = 5 + DEFAULT_CHUNK     # INFO gives the balloon's chunk size
+
+    def send(self, command, payload=b""):
+        body = bytes([command, len(payload)]) + payload
+        self.port.write(bytes([SYNC, SYNC_HOST]) + body + struct.pack("<H", binascii.crc_hqx(body, 0)))
+
+    def receive(self, timeout):
+        """(type, payload) of the next good frame, None on a timeout or a bad one"""
+        deadline = time.monotonic() + timeout
+        while True:
+            frame = self._parse()
+            if frame is not None:
+                return frame if frame is not False else None
+            if time.monotonic() > deadline:
+                return None
+            self.buffer += self.port.read(max(1, self.port.in_waiting))
+
+    def _parse(self):
+        """A frame, False for a bad one, None for not enough bytes yet"""
+        while True:
+            start = self.buffer.find(bytes([SYNC, SYNC_DEVICE]))
+            if start < 0:
+                # Console text before the session; keep a trailing sync byte
+                del self.buffer[:-1]
+                return None
+            del self.buffer[:start]
+            if len(self.buffer) < 5:
+                return None
+            length = self.buffer[3] | (self.buffer[4] << 8)
+            if length > self.max_payload:
+                # A sync inside some other frame's bytes
+                del self.buffer[:2]
+                continue
+            end = 5 + length + 2
+            if len(self.buffer) < end:
+                return None
+            body = bytes(self.buffer[2:5 + length])
+            crc = self.buffer[5 + length] | (self.buffer[6 + length] << 8)
+            if binascii.crc_hqx(body, 0) != crc:
+                self.bad_frames += 1
+                del self.buffer[:2]
+                return False
+            del self.buffer[:end]
+            return body[0], body[3:]
+
+
+def hello(link):
+    for _ in range(HELLO_TRIES):
+        link.send(HELLO)
+        deadline = time.monotonic() + 1.0
+        while time.monotonic() < deadline:
+            frame = link.receive(1.0)
+            if frame and frame[0] == INFO:
+                window_max, chunk, sources = parse_info(frame[1])
+                link.max_payload = max(5 + chunk, len(frame[1]))
+                return window_max, sources
+    sys.exit("No answer to HELLO - is USB_DUMP_ENABLED on and this the balloon's USB port?")
+
+
+def parse_info(payload):
+    version, window_max, chunk, count = struct.unpack_from("<BBHB", payload)
+    if version != PROTOCOL_VERSION:
+        sys.exit(f"Balloon speaks dump protocol {version}, this tool {PROTOCOL_VERSION}")
+    sources = []
+    for i in range(count):
+        source, size, name = struct.unpack_from(f"<BI{NAME_BYTES}s", payload, 5 + i * (5 + NAME_BYTES))
+        sources.append((source, name.rstrip(b"\0").decode(), size))
+    return window_max, chunk, sources
+
+
+def pull(link, source, name, size, path, window, fresh):
+    offset = 0 if fresh or name == LOG_SOURCE or not os.path.exists(path) else os.path.getsize(path)
+    if offset > size:
+        offset = 0
+    if offset == size and size:
+        print(f"{name}: {size} bytes already here")
+        return
+    mode = "r+b" if offset else "wb"
+    with open(path, mode) as f:
+        f.seek(offset)
+        f.truncate()
+        link.send(READ, struct.pack("<BIIB", source, offset, size - offset, window))
+
+        expected = offset
+        nacked = None
+        started = shown = time.monotonic()
+        while True:
+            frame = link.receive(FRAME_TIMEOUT_S)
+            if frame is None:
+                # A bad frame or silence - from where we are
+                link.send(NACK, struct.pack("<I", expected))
+                nacked = expected
+                continue
+            kind, payload = frame
+            if kind == ERROR:
+                sys.exit(f"{name}: {ERRORS.get(payload[0], payload[0])}")
+            if kind == DONE:
+                break
+            if kind != DATA:
+                continue
+
+            chunk_source, chunk_offset = struct.unpack_from("<BI", payload)
+            if chunk_source != source:
+                continue
+            if chunk_offset == expected:
+                f.write(payload[5:])
+                expected += len(payload) - 5
+                nacked = None
+                link.send(ACK, struct.pack("<I", expected))
+                now = time.monotonic()
+                if now - shown > PROGRESS_S:
+                    shown = now
+                    rate = (expected - offset) / (now - started)
+                    print(f"\r{name}: {expected}/{size} bytes, {rate / 1024:.0f} KB/s", end="", flush=True)
+            elif chunk_offset < expected:
+                # A resend of what we have - our ACK may have crossed a NACK
+                link.send(ACK, struct.pack("<I", expected))
+            elif nacked != expected:
+                # One NACK per gap; the chunks after it are thrown away until it is filled
+                link.send(NACK, struct.pack("<I", expected))
+                nacked = expected
+
+    elapsed = time.monotonic() - started
+    print(f"\r{name}: {expected - offset} bytes in {elapsed:.1f} s, "
+          f"{(expected - offset) / max(elapsed, 1e-3) / 1024:.0f} KB/s{' (resumed)' if offset else ''}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", help="the balloon's USB CDC port, /dev/ttyACM0 or COMn")
+    parser.add_argument("-o", "--out", default="dump", help="directory for the .bin files (default dump)")
+    parser.add_argument("--source", action="append", help="only this source (repeatable): flight, images, coredump, log")
+    parser.add_argument("--window", type=int, default=16, help="chunks in flight (default 16)")
+    parser.add_argument("--fresh", action="store_true", help="start every file over")
+    parser.add_argument("--list", action="store_true", help="print the sources and exit")
+    args = parser.parse_args()
+
+    link = DumpLink(args.port)
+    window_max, sources = hello(link)
+    try:
+        if args.list:
+            for source, name, size in sources:
+                print(f"{source}  {name:<10} {size} bytes")
+            return
+
+        os.makedirs(args.out, exist_ok=True)
+        window = max(1, min(args.window, window_max))
+        for source, name, size in sources:
+            if args.source and name not in args.source:
+                continue
+            pull(link, source, name, size, os.path.join(args.out, name + ".bin"), window, args.fresh)
+        if link.bad_frames:
+            print(f"{link.bad_frames} bad frames resent")
+    finally:
+        link.send(STOP)
+
+
+if __name__ == "__main__":
+    main()